@@ -103,6 +103,7 @@ typedef enum _XSK_NOTIFY_FLAGS {
     XSK_NOTIFY_FLAG_POKE_TX = 0x2,
     XSK_NOTIFY_FLAG_WAIT_RX = 0x4,
     XSK_NOTIFY_FLAG_WAIT_TX = 0x8,
+    XSK_NOTIFY_FLAG_WAIT_SPIN = 0x10,
 } XSK_NOTIFY_FLAGS;
 
 DEFINE_ENUM_FLAG_OPERATORS(XSK_NOTIFY_FLAGS)
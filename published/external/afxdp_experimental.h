@@ -11,6 +11,10 @@
 #ifndef AFXDP_EXPERIMENTAL_H
 #define AFXDP_EXPERIMENTAL_H
 
+#include <xdp/extension.h>
+#include <xdp/objectheader.h>
+#include <xdp/offload.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -18,9 +22,12 @@ extern "C" {
 //
 // XSK_SOCKOPT_POLL_MODE
 //
-// Supports: set
-// Optval type: XSK_POLL_MODE
-// Description: Sets the poll mode of a socket.
+// Supports: get/set
+// Optval type: XSK_POLL_MODE or XSK_POLL_PARAMETERS
+// Description: Sets or gets the poll mode of a socket. Setting an
+//              XSK_POLL_MODE resets the remaining XSK_POLL_PARAMETERS fields to
+//              zero. Setting a mode other than XSK_POLL_MODE_DEFAULT requires
+//              the socket is activated.
 //
 
 #define XSK_SOCKOPT_POLL_MODE 1000
@@ -46,8 +53,39 @@ typedef enum _XSK_POLL_MODE {
     // Expectation: XSK_RING_FLAG_NEED_POKE is usually TRUE.
     //
     XSK_POLL_MODE_SOCKET,
+
+    //
+    // Sets the XSK polling mode to transmit on the thread poking the TX ring.
+    // If the interface's poll context is idle, XskNotifySocket with
+    // XSK_NOTIFY_FLAG_POKE_TX polls the interface inline; otherwise, the poke
+    // notifies the interface as in the default mode. Interfaces that do not
+    // support polling always use notifications. RX is unaffected.
+    //
+    // Expectation: XSK_RING_FLAG_NEED_POKE varies.
+    //
+    XSK_POLL_MODE_INLINE,
 } XSK_POLL_MODE;
 
+typedef struct _XSK_POLL_PARAMETERS {
+    XSK_POLL_MODE PollMode;
+
+    //
+    // The maximum number of frames polled in each direction per poll
+    // iteration, or zero for the system default. In XSK_POLL_MODE_BUSY, this
+    // bounds the TX frames the socket posts per poll iteration.
+    //
+    UINT32 Budget;
+
+    //
+    // XSK_POLL_MODE_BUSY only: the number of milliseconds without RX or TX
+    // progress after which busy polling is suspended and the socket reverts to
+    // the default interrupt/notification behavior, or zero to busy poll
+    // indefinitely. Busy polling resumes when the socket is poked, or within
+    // one idle timeout of traffic resuming.
+    //
+    UINT32 IdleTimeoutMs;
+} XSK_POLL_PARAMETERS;
+
 //
 // XSK_SOCKOPT_TX_FRAME_LAYOUT_EXTENSION
 //
@@ -80,7 +118,12 @@ typedef enum _XSK_POLL_MODE {
 // Description: Sets whether UDP checksum transmit offload is enabled. This
 //              option requires the socket is bound and the TX frame ring size
 //              is not set. This option enables the XDP_FRAME_LAYOUT and
-//              XDP_FRAME_CHECKSUM extensions on the TX frame ring.
+//              XDP_FRAME_CHECKSUM extensions on the TX frame ring: for each TX
+//              descriptor, the application describes the frame's headers in
+//              the layout extension and sets the checksum extension's Layer4
+//              field to XdpFrameTxChecksumActionRequired to request the UDP
+//              checksum. Descriptors requesting a checksum offload that is not
+//              enabled are dropped as invalid.
 //
 #define XSK_SOCKOPT_OFFLOAD_UDP_CHECKSUM_TX 1003
 
@@ -98,6 +141,1072 @@ typedef struct _XSK_OFFLOAD_UDP_CHECKSUM_TX_CAPABILITIES {
     BOOLEAN Supported;
 } XSK_OFFLOAD_UDP_CHECKSUM_TX_CAPABILITIES;
 
+//
+// XSK_SOCKOPT_RX_MULTI_BUFFER
+//
+// Supports: get/set
+// Optval type: BOOLEAN
+// Description: Sets or gets whether RX frames may span multiple UMEM chunks.
+//              When enabled, a frame larger than a chunk is delivered in
+//              consecutive RX descriptors, each consuming one FILL descriptor,
+//              and every descriptor except a frame's last has
+//              XSK_BUFFER_FLAG_CONTINUATION set in its Reserved field. Frames
+//              are dropped rather than truncated if the RX or FILL rings lack
+//              descriptors for the whole frame. Setting this option requires
+//              the socket is not activated.
+//
+#define XSK_SOCKOPT_RX_MULTI_BUFFER 1006
+
+//
+// XSK_SOCKOPT_TX_ZERO_COPY
+//
+// Supports: get/set
+// Optval type: BOOLEAN
+// Description: Sets whether zero-copy TX is requested, or gets whether zero-copy
+//              TX is in effect. By default, TX frames on generic interfaces are
+//              copied into a kernel bounce buffer so they cannot be modified
+//              while in flight. A zero-copy TX socket transmits directly from
+//              the locked UMEM pages instead; the application must not modify
+//              a buffer until its completion is returned, and each TX buffer
+//              must fit within a single UMEM chunk. If the TX queue cannot
+//              transmit from UMEM pages, e.g. its DMA adapter cannot map them,
+//              the socket falls back to a bounce buffer. Setting this option
+//              requires the socket is not activated; getting it requires the
+//              socket is activated with a TX ring.
+//
+#define XSK_SOCKOPT_TX_ZERO_COPY 1007
+
+//
+// XSK_SOCKOPT_TIMESTAMPS
+//
+// Supports: get/set
+// Optval type: UINT32 (XSK_TIMESTAMP_FLAG_*)
+// Description: Sets which interface timestamps are written into UMEM, or gets
+//              which of the requested timestamps the interface provides.
+//              Timestamps are UINT64 values in performance counter units; a
+//              zero timestamp indicates the interface did not stamp the frame.
+//              RX timestamps are written to the 8 bytes immediately preceding
+//              each received frame's data, which requires a UMEM headroom of
+//              at least 8 bytes. TX timestamps are written to the first 8
+//              bytes of each TX buffer before its completion is returned,
+//              which requires each TX descriptor's offset to be at least 8
+//              bytes; other TX descriptors are dropped as invalid. Setting
+//              this option requires the UMEM is registered and the socket is
+//              not activated; getting it requires the socket is activated.
+//
+#define XSK_SOCKOPT_TIMESTAMPS 1008
+
+#define XSK_TIMESTAMP_FLAG_RX 0x1
+#define XSK_TIMESTAMP_FLAG_TX 0x2
+
+//
+// XSK_SOCKOPT_RX_METADATA
+//
+// Supports: get/set
+// Optval type: BOOLEAN
+// Description: Sets whether an XSK_RX_METADATA structure is written into the
+//              UMEM headroom of each received frame, or gets whether the
+//              interface provides RX metadata. The metadata immediately
+//              precedes the frame data, or the RX timestamp if RX timestamps
+//              are also enabled (see XSK_SOCKOPT_TIMESTAMPS), which requires a
+//              UMEM headroom large enough for both. Fields the interface does
+//              not provide are zero. Setting this option requires the UMEM is
+//              registered and the socket is not activated; getting it requires
+//              the socket is activated with an RX ring.
+//
+#define XSK_SOCKOPT_RX_METADATA 1009
+
+//
+// Checksum results of XSK_RX_METADATA.
+//
+#define XSK_RX_CHECKSUM_NOT_CHECKED 0
+#define XSK_RX_CHECKSUM_SUCCEEDED 1
+#define XSK_RX_CHECKSUM_FAILED 2
+#define XSK_RX_CHECKSUM_INVALID 3
+
+typedef struct _XSK_RX_METADATA {
+    //
+    // The RSS hash value. Valid only if RssHashType is nonzero.
+    //
+    UINT32 RssHash;
+
+    //
+    // The NDIS_HASH_TYPE_* flags of the RSS hash, or zero if the frame does not
+    // have an RSS hash.
+    //
+    UINT32 RssHashType;
+
+    //
+    // The queue the frame was received on.
+    //
+    UINT32 QueueId;
+
+    //
+    // The IP (Layer3) and TCP/UDP (Layer4) checksum results, one of
+    // XSK_RX_CHECKSUM_*.
+    //
+    UINT8 Layer3Checksum;
+    UINT8 Layer4Checksum;
+
+    //
+    // The number of TCP segments coalesced into the frame by receive segment
+    // coalescing (RSC), or zero if the frame was not coalesced. Coalesced
+    // frames are delivered whole and typically span multiple buffers (see
+    // XSK_SOCKOPT_RX_MULTI_BUFFER).
+    //
+    UINT16 CoalescedSegmentCount;
+} XSK_RX_METADATA;
+
+C_ASSERT(sizeof(XSK_RX_METADATA) == 16);
+
+//
+// XSK_SOCKOPT_NOTIFY_COMPLETION_PORT
+//
+// Supports: set
+// Optval type: XSK_NOTIFY_COMPLETION_PORT
+// Description: Sets which rings deliver readiness as completion packets to the
+//              I/O completion port the socket handle is associated with (see
+//              CreateIoCompletionPort). A packet is queued whenever the RX ring
+//              or TX completion ring becomes non-empty after being drained by
+//              the application, so packets coalesce until the application
+//              catches up and no wait is issued per packet. After draining a
+//              ring and releasing its consumer index, the application must
+//              check the ring once more, since entries produced concurrently
+//              with the release do not queue another packet. Each packet's
+//              number of bytes transferred contains the XSK_NOTIFY_RESULT_FLAGS
+//              of the ready rings, its key is the handle's completion key, and
+//              its OVERLAPPED pointer is the Context value, which is never
+//              dereferenced. A packet is also queued immediately if a
+//              requested ring is already non-empty. Setting zero flags
+//              disables packets. Requires the socket is activated with the
+//              requested rings and, unless disabling, the handle is associated
+//              with a completion port.
+//
+#define XSK_SOCKOPT_NOTIFY_COMPLETION_PORT 1010
+
+typedef struct _XSK_NOTIFY_COMPLETION_PORT {
+    //
+    // XSK_NOTIFY_FLAG_WAIT_RX and/or XSK_NOTIFY_FLAG_WAIT_TX, or zero.
+    //
+    XSK_NOTIFY_FLAGS Flags;
+
+    //
+    // An opaque value returned as the OVERLAPPED pointer of each packet.
+    //
+    VOID *Context;
+} XSK_NOTIFY_COMPLETION_PORT;
+
+//
+// XSK_SOCKOPT_SHARED_UMEM
+//
+// Supports: set
+// Optval type: HANDLE
+// Description: Sets the socket's UMEM to the UMEM registered by another
+//              socket instead of registering a new UMEM. Each socket keeps its
+//              own rings, including fill and completion rings, and may be bound
+//              to any interface and queue. Descriptors received on one socket
+//              can be transmitted directly on another socket sharing the UMEM,
+//              without copying frames. The application is responsible for
+//              partitioning UMEM chunks between the sockets' rings. The UMEM
+//              remains valid until every socket referencing it is closed.
+//              Setting this option requires the socket has no UMEM and is not
+//              bound, and the other socket has a UMEM. The handle may be a
+//              duplicate of a socket handle owned by another process; to share
+//              a UMEM across processes, register it with XSK_SOCKOPT_UMEM_ALLOC.
+//
+#define XSK_SOCKOPT_SHARED_UMEM 1011
+
+//
+// XSK_SOCKOPT_STATISTICS_EX
+//
+// Supports: get
+// Optval type: XSK_STATISTICS_EX
+// Description: Gets extended socket statistics, which are a superset of
+//              XSK_SOCKOPT_STATISTICS. The optval must be at least
+//              XSK_SIZEOF_STATISTICS_EX_REVISION_1 bytes. On success, the
+//              header's revision and size describe the returned structure.
+//
+#define XSK_SOCKOPT_STATISTICS_EX 1012
+
+typedef struct _XSK_STATISTICS_EX {
+    XDP_OBJECT_HEADER Header;
+
+    //
+    // The statistics returned by XSK_SOCKOPT_STATISTICS.
+    //
+    XSK_STATISTICS Statistics;
+
+    //
+    // Number of RX batches that dropped frames because the fill ring was empty
+    // or because the RX ring was full, respectively.
+    //
+    UINT64 RxFillRingEmpty;
+    UINT64 RxRingFull;
+
+    //
+    // Number of times the XSK_RING_FLAG_NEED_POKE flag was set on the fill ring
+    // and the TX ring, respectively.
+    //
+    UINT64 RxFillNeedPoke;
+    UINT64 TxNeedPoke;
+
+    //
+    // Number of XSK_NOTIFY_FLAG_POKE_RX and XSK_NOTIFY_FLAG_POKE_TX requests.
+    //
+    UINT64 RxPokes;
+    UINT64 TxPokes;
+
+    //
+    // Number of TX descriptors dropped because they could not be bounced or
+    // transmitted directly from the UMEM. These are also counted in
+    // TxInvalidDescriptors.
+    //
+    UINT64 TxBounceFailures;
+
+    //
+    // The current number of entries in each ring, or zero if the ring does not
+    // exist.
+    //
+    UINT32 RxRingUsed;
+    UINT32 RxFillRingUsed;
+    UINT32 TxRingUsed;
+    UINT32 TxCompletionRingUsed;
+
+    //
+    // Number of TX frames the socket posted to its TX queue, and the number of
+    // times the socket consumed its entire TX scheduling credit (see
+    // XSK_SOCKOPT_TX_WEIGHT). Added in XSK_STATISTICS_EX_REVISION_2.
+    //
+    UINT64 TxFramesScheduled;
+    UINT64 TxQuantumExhausted;
+
+    //
+    // Number of TX completions that arrived ahead of an older frame while
+    // XSK_SOCKOPT_TX_COMPLETION_IN_ORDER reordered them, and the largest number
+    // of frames any completion arrived ahead of. Added in
+    // XSK_STATISTICS_EX_REVISION_3.
+    //
+    UINT64 TxCompletionsReordered;
+    UINT32 TxCompletionReorderDepthMax;
+} XSK_STATISTICS_EX;
+
+#define XSK_STATISTICS_EX_REVISION_1 1
+#define XSK_STATISTICS_EX_REVISION_2 2
+#define XSK_STATISTICS_EX_REVISION_3 3
+
+#define XSK_SIZEOF_STATISTICS_EX_REVISION_1 \
+    RTL_SIZEOF_THROUGH_FIELD(XSK_STATISTICS_EX, TxCompletionRingUsed)
+#define XSK_SIZEOF_STATISTICS_EX_REVISION_2 \
+    RTL_SIZEOF_THROUGH_FIELD(XSK_STATISTICS_EX, TxQuantumExhausted)
+#define XSK_SIZEOF_STATISTICS_EX_REVISION_3 \
+    RTL_SIZEOF_THROUGH_FIELD(XSK_STATISTICS_EX, TxCompletionReorderDepthMax)
+
+//
+// XSK_SOCKOPT_TX_SEGMENTATION
+//
+// Supports: get/set
+// Optval type: UINT32
+// Description: Sets the segment size used to transmit frames exceeding the
+//              interface MTU, or gets the segment size in effect. Zero disables
+//              segmentation. When enabled, a TX descriptor may describe a UDP
+//              or TCP super-frame up to the interface's maximum buffer size;
+//              the interface splits its UDP or TCP payload into segments of at
+//              most the segment size (the TCP MSS), replicating the frame's
+//              Ethernet, IP, and UDP or TCP headers. The interface may
+//              overwrite the frame's UDP or TCP checksum field. Generic XDP
+//              uses the NIC's USO or LSO when available and otherwise
+//              segments in software. Setting this option requires the socket
+//              is not activated; getting it requires the socket is activated,
+//              and returns zero if the interface does not support
+//              segmentation.
+//
+#define XSK_SOCKOPT_TX_SEGMENTATION 1013
+
+//
+// Set in an XSK_BUFFER_DESCRIPTOR's Reserved field if the frame continues in
+// the next descriptor of the ring.
+//
+#define XSK_BUFFER_FLAG_CONTINUATION 0x1
+
+//
+// XSK_SOCKOPT_NUMA_NODE
+//
+// Supports: get
+// Optval type: XSK_NUMA_NODE_INFO
+// Description: Gets the NUMA node on which XDP placed the memory of the RX and
+//              TX queues the socket is bound to, or XSK_NUMA_NODE_UNSPECIFIED
+//              if the socket is not bound to a queue in that direction or the
+//              interface did not report an ideal processor for the queue.
+//              Applications can use this to place their UMEM and data path
+//              threads on the same node. Requires the socket is activated.
+//
+#define XSK_SOCKOPT_NUMA_NODE 1014
+
+#define XSK_NUMA_NODE_UNSPECIFIED MAXUINT32
+
+typedef struct _XSK_NUMA_NODE_INFO {
+    UINT32 Rx;
+    UINT32 Tx;
+} XSK_NUMA_NODE_INFO;
+
+//
+// XSK_SOCKOPT_EBPF_MAP_KEY
+//
+// Supports: set
+// Optval type: UINT32
+// Description: Inserts the socket into the socket map of its RX queue at the
+//              given key, which must be less than XSK_EBPF_MAP_MAX_KEYS. eBPF
+//              programs attached to the interface redirect frames to the
+//              socket with the bpf_xdp_redirect_xsk helper. The socket is
+//              inserted when it is activated, and activation fails if another
+//              socket bound to the same RX queue already occupies the key. The
+//              socket is removed when it is closed. Requires the socket is not
+//              activated.
+//
+#define XSK_SOCKOPT_EBPF_MAP_KEY 1015
+
+#define XSK_EBPF_MAP_MAX_KEYS 16
+
+//
+// XSK_SOCKOPT_EBPF_METADATA
+//
+// Supports: set
+// Optval type: UINT32
+// Description: Sets the size of the UMEM headroom area receiving the metadata
+//              eBPF programs place before the frame data with the
+//              bpf_xdp_adjust_meta helper, or zero to disable delivery. The
+//              size must be a multiple of 4 bytes and at most
+//              XSK_EBPF_METADATA_MAX_SIZE. The area precedes the RX metadata
+//              and RX timestamp, if enabled (see XSK_SOCKOPT_RX_METADATA and
+//              XSK_SOCKOPT_TIMESTAMPS), which requires a UMEM headroom large
+//              enough for all of them. As with data_meta, the program's
+//              metadata ends at the end of the area; leading bytes the program
+//              did not write are zero, and metadata larger than the area is
+//              truncated to the bytes nearest the end. Setting this option
+//              requires the UMEM is registered and the socket is not
+//              activated.
+//
+#define XSK_SOCKOPT_EBPF_METADATA 1016
+
+#define XSK_EBPF_METADATA_MAX_SIZE 32
+
+//
+// XSK_SOCKOPT_TX_WEIGHT
+//
+// Supports: get/set
+// Optval type: UINT32
+// Description: Sets the socket's weight when sharing a TX queue with other
+//              sockets, or gets the weight in effect. Sockets bound to the same
+//              TX queue are scheduled with deficit round-robin, and each
+//              socket's share of the queue is proportional to its weight. The
+//              weight must be between 1 and XSK_TX_WEIGHT_MAX, and defaults to
+//              XSK_TX_WEIGHT_DEFAULT. This option may be set at any time.
+//
+#define XSK_SOCKOPT_TX_WEIGHT 1017
+
+#define XSK_TX_WEIGHT_DEFAULT 1
+#define XSK_TX_WEIGHT_MAX 64
+
+//
+// XSK_SOCKOPT_TX_RATE_LIMIT
+//
+// Supports: get/set
+// Optval type: XSK_TX_RATE_LIMIT
+// Description: Paces the socket's transmit path with a token bucket, or gets
+//              the rate limit in effect. Frames remain in the TX ring until the
+//              bucket admits them. A rate of zero is not limited; if both rates
+//              are zero, pacing is disabled. BurstMs sets the bucket depth as a
+//              duration at the configured rates, and zero selects
+//              XSK_TX_RATE_LIMIT_BURST_MS_DEFAULT. The bucket always admits at
+//              least one frame. This option must be set before the socket is
+//              activated.
+//
+#define XSK_SOCKOPT_TX_RATE_LIMIT 1018
+
+typedef struct _XSK_TX_RATE_LIMIT {
+    UINT64 BitsPerSecond;
+    UINT64 FramesPerSecond;
+    UINT32 BurstMs;
+} XSK_TX_RATE_LIMIT;
+
+#define XSK_TX_RATE_LIMIT_BURST_MS_DEFAULT 16
+#define XSK_TX_RATE_LIMIT_BURST_MS_MAX 1000
+
+//
+// XSK_SOCKOPT_TX_LAUNCH_TIME
+//
+// Supports: get/set
+// Optval type: BOOLEAN
+// Description: Sets whether each TX descriptor carries a launch time, or gets
+//              whether launch times are enabled. The launch time is a UINT64
+//              value in performance counter units stored in the first 8 bytes
+//              of each TX buffer, which requires each TX descriptor's offset
+//              to be at least 8 bytes; other TX descriptors are dropped as
+//              invalid. A descriptor is held in the TX ring until its launch
+//              time, and descriptors behind it are held in ring order, so
+//              launch times should not decrease. Launch times in the past,
+//              including zero, transmit immediately. Held descriptors are
+//              released with timer resolution unless the socket is busy
+//              polling. If TX timestamps are also enabled, the timestamp
+//              overwrites the launch time when the frame completes. This option
+//              must be set before the socket is activated.
+//
+#define XSK_SOCKOPT_TX_LAUNCH_TIME 1019
+
+//
+// XSK_SOCKOPT_LARGE_PAGES
+//
+// Supports: get/set
+// Optval type: BOOLEAN
+// Description: Sets whether the socket uses large pages, or gets whether large
+//              pages are enabled. When enabled, rings are allocated from large
+//              pages, and the UMEM registration must be backed by large pages
+//              (e.g. VirtualAlloc with MEM_LARGE_PAGES): the UMEM address and
+//              total size must be multiples of GetLargePageMinimum, otherwise
+//              the registration fails. Each ring consumes at least one large
+//              page. This option must be set before the UMEM and rings are
+//              configured.
+//
+#define XSK_SOCKOPT_LARGE_PAGES 1020
+
+//
+// XSK_SOCKOPT_OFFLOAD_TCP_CHECKSUM_TX
+//
+// Supports: set
+// Optval type: BOOLEAN
+// Description: Sets whether TCP checksum transmit offload is enabled. This
+//              option requires the socket is bound and the TX frame ring size
+//              is not set. As with XSK_SOCKOPT_OFFLOAD_UDP_CHECKSUM_TX, this
+//              option enables the XDP_FRAME_LAYOUT and XDP_FRAME_CHECKSUM
+//              extensions on the TX frame ring, and the checksum extension's
+//              Layer4 field requests the TCP checksum.
+//
+#define XSK_SOCKOPT_OFFLOAD_TCP_CHECKSUM_TX 1021
+
+//
+// XSK_SOCKOPT_OFFLOAD_TCP_CHECKSUM_TX_CAPABILITIES
+//
+// Supports: get
+// Optval type: XSK_OFFLOAD_TCP_CHECKSUM_TX_CAPABILITIES
+// Description: Returns the TCP checksum transmit offload capabilities. This
+//              option requires the socket is bound.
+//
+#define XSK_SOCKOPT_OFFLOAD_TCP_CHECKSUM_TX_CAPABILITIES 1022
+
+typedef struct _XSK_OFFLOAD_TCP_CHECKSUM_TX_CAPABILITIES {
+    BOOLEAN Supported;
+} XSK_OFFLOAD_TCP_CHECKSUM_TX_CAPABILITIES;
+
+//
+// XSK_SOCKOPT_OFFLOAD_IPV4_CHECKSUM_TX
+//
+// Supports: set
+// Optval type: BOOLEAN
+// Description: Sets whether IPv4 header checksum transmit offload is enabled.
+//              This option requires the socket is bound and the TX frame ring
+//              size is not set. As with XSK_SOCKOPT_OFFLOAD_UDP_CHECKSUM_TX,
+//              this option enables the XDP_FRAME_LAYOUT and XDP_FRAME_CHECKSUM
+//              extensions on the TX frame ring, and the checksum extension's
+//              Layer3 field requests the IPv4 header checksum.
+//
+#define XSK_SOCKOPT_OFFLOAD_IPV4_CHECKSUM_TX 1023
+
+//
+// XSK_SOCKOPT_OFFLOAD_IPV4_CHECKSUM_TX_CAPABILITIES
+//
+// Supports: get
+// Optval type: XSK_OFFLOAD_IPV4_CHECKSUM_TX_CAPABILITIES
+// Description: Returns the IPv4 header checksum transmit offload capabilities.
+//              This option requires the socket is bound.
+//
+#define XSK_SOCKOPT_OFFLOAD_IPV4_CHECKSUM_TX_CAPABILITIES 1024
+
+typedef struct _XSK_OFFLOAD_IPV4_CHECKSUM_TX_CAPABILITIES {
+    BOOLEAN Supported;
+} XSK_OFFLOAD_IPV4_CHECKSUM_TX_CAPABILITIES;
+
+//
+// XSK_SOCKOPT_TX_POKE_LINGER
+//
+// Supports: get/set
+// Optval type: UINT32
+// Description: Sets how long, in milliseconds, the TX path keeps watching the
+//              TX ring after it goes idle before setting
+//              XSK_RING_FLAG_NEED_POKE, or gets the linger time in effect.
+//              While the TX path lingers, descriptors produced to the TX ring
+//              are picked up with timer resolution without a
+//              XSK_NOTIFY_FLAG_POKE_TX request, so applications that check the
+//              need poke flag before poking avoid a syscall per burst. Zero,
+//              the default, disables lingering; the maximum is 1000. This
+//              option must be set before the socket is activated.
+//
+#define XSK_SOCKOPT_TX_POKE_LINGER 1025
+
+//
+// XSK_SOCKOPT_RX_HEADER_SPLIT
+//
+// Supports: get/set
+// Optval type: UINT32
+// Description: Sets or gets the maximum header length of RX header/data split.
+//              When nonzero and XSK_SOCKOPT_RX_MULTI_BUFFER is enabled, each
+//              frame's headers are delivered alone in the first RX descriptor,
+//              after the UMEM headroom, and the payload follows in continuation
+//              descriptors that start at offset zero of their chunks and use
+//              the whole chunk. If the UMEM region and chunk size are page
+//              aligned, payload buffers are page aligned. The headers end where
+//              the interface split them, if the RX queue splits headers and
+//              the split fits the maximum, and at the maximum header length
+//              otherwise. Header split disables RX zero copy. Zero, the
+//              default, disables header split. Setting this option requires
+//              the socket is not activated.
+//
+#define XSK_SOCKOPT_RX_HEADER_SPLIT 1026
+
+//
+// XSK_SOCKOPT_RX_COALESCE
+//
+// Supports: get/set
+// Optval type: UINT32
+// Description: Sets or gets the maximum length of a frame coalesced from
+//              received segments. When nonzero and XSK_SOCKOPT_RX_MULTI_BUFFER
+//              is enabled, consecutive in-order TCP segments of a flow, and
+//              consecutive UDP datagrams of a flow, that are received in the
+//              same batch are delivered as a single frame: the first segment,
+//              headers included, followed by the payloads of the remaining
+//              segments. The headers of the first segment are not updated.
+//              Every coalesced UDP datagram except the last has the payload
+//              length of the first. Only single-buffer, unfragmented IPv4
+//              frames without options and IPv6 frames without extension
+//              headers, carrying TCP segments with no flags other than ACK and
+//              PSH or UDP datagrams, are coalesced. The checksums of every
+//              segment are validated, and the RX metadata of a coalesced frame
+//              reports the number of segments (see XSK_SOCKOPT_RX_METADATA).
+//              Coalescing disables RX zero copy. Zero, the default, disables
+//              coalescing. Setting this option requires the socket is not
+//              activated.
+//
+#define XSK_SOCKOPT_RX_COALESCE 1027
+
+//
+// XSK_SOCKOPT_UMEM_ALIGNED_CHUNKS
+//
+// Supports: get/set
+// Optval type: BOOLEAN
+// Description: Sets whether the UMEM is registered in aligned-chunk mode, or
+//              gets whether the socket's UMEM uses aligned chunks. Aligned-chunk
+//              mode requires a power-of-two ChunkSize and a UMEM address that
+//              is a multiple of ChunkSize, otherwise the registration fails.
+//              In this mode, any address within a chunk in an RX fill
+//              descriptor refers to the whole chunk, and the buffer of each TX
+//              descriptor must lie within a single chunk, otherwise the
+//              descriptor is dropped as invalid. In exchange, descriptors are
+//              validated and mapped to chunks with masks and shifts rather than
+//              divisions and overflow checks. This option must be set before
+//              the UMEM is registered. Sockets sharing a UMEM use the mode the
+//              UMEM was registered with.
+//
+#define XSK_SOCKOPT_UMEM_ALIGNED_CHUNKS 1028
+
+//
+// XSK_SOCKOPT_RX_NONTEMPORAL_COPY
+//
+// Supports: get/set
+// Optval type: UINT32
+// Description: Sets or gets the minimum length, in bytes, of an RX copy into
+//              the UMEM that uses non-temporal stores. Non-temporal stores
+//              bypass the caches of the processor receiving the frame, so large
+//              copies do not evict its working set, and the application reads
+//              the data from memory rather than from another processor's cache.
+//              Shorter copies use regular stores. Zero, the default, disables
+//              non-temporal copies. This option has no effect with RX zero copy
+//              or on platforms without non-temporal stores, and may be set at
+//              any time.
+//
+#define XSK_SOCKOPT_RX_NONTEMPORAL_COPY 1029
+
+//
+// XSK_SOCKOPT_NOTIFY_MODERATION
+//
+// Supports: get/set
+// Optval type: XSK_NOTIFY_MODERATION
+// Description: Sets or gets the moderation of XskNotifySocket waits. While
+//              moderated, a wait for RX or TX completion is satisfied once the
+//              ring holds at least MinFrames entries, or once MaxDelayUs
+//              microseconds have elapsed since the ring became non-empty,
+//              whichever is first. This amortizes wake-ups across frames at the
+//              cost of bounded latency. The delay is subject to the system timer
+//              resolution. A MinFrames of zero or one, the default, disables
+//              moderation. MaxDelayUs must be nonzero when moderation is enabled
+//              and cannot exceed one second. I/O completion port notifications
+//              are not moderated. This option may be set at any time.
+//
+#define XSK_SOCKOPT_NOTIFY_MODERATION 1030
+
+typedef struct _XSK_NOTIFY_MODERATION {
+    UINT32 MinFrames;
+    UINT32 MaxDelayUs;
+} XSK_NOTIFY_MODERATION;
+
+//
+// XSK_SOCKOPT_TX_COMPLETION_BATCH
+//
+// Supports: get/set
+// Optval type: UINT32
+// Description: Sets or gets the number of TX completions accumulated before
+//              they are published to the TX completion ring. Publishing fewer,
+//              larger batches reduces contention on the ring's producer index.
+//              Completions are published earlier when every outstanding frame
+//              has completed, when the socket waits for TX completions, when
+//              the ring is half full, and at least once per TX poll. Zero or
+//              one, the default, publishes completions as they arrive. This
+//              option may be set at any time.
+//
+#define XSK_SOCKOPT_TX_COMPLETION_BATCH 1031
+
+//
+// XSK_SOCKOPT_SHARED_FILL_RING
+//
+// Supports: set
+// Optval type: HANDLE
+// Description: Sets the socket's fill ring to the fill ring of another socket
+//              sharing the same UMEM, instead of allocating a new fill ring.
+//              Buffers produced to the shared fill ring are consumed by
+//              whichever sharing socket receives traffic, so the application
+//              need not partition UMEM chunks between the sockets' fill rings.
+//              Each socket claims fill descriptors in batches and may hold up
+//              to 256 claimed descriptors that are not yet visible to the
+//              other sockets. Interface detach errors are not reported on a
+//              shared fill ring. Setting this option requires the socket has
+//              no fill ring and shares the other socket's UMEM, is not
+//              activated, and belongs to the process that created the other
+//              socket's fill ring. The other socket must have a fill ring and,
+//              unless its fill ring is already shared, must not be activated.
+//
+#define XSK_SOCKOPT_SHARED_FILL_RING 1032
+
+//
+// XSK_SOCKOPT_UMEM_ADD_REGION
+//
+// Supports: set
+// Optval type: XSK_UMEM_REGION
+// Description: Adds a memory region to the socket's UMEM, so the UMEM can grow
+//              with load instead of being sized for peak when registered. The
+//              UMEM may be shared and its sockets may be active. Descriptors
+//              refer to a region by its ID in the high bits of the
+//              UMEM-relative address; see XSK_UMEM_REGION_ADDRESS. Region 0 is
+//              the memory registered with XSK_SOCKOPT_UMEM_REG. A region uses
+//              the chunk size and headroom of the UMEM, and a truncated final
+//              chunk is ignored. Chunks of added regions may be posted to fill
+//              rings; TX descriptors must refer to region 0.
+//
+#define XSK_SOCKOPT_UMEM_ADD_REGION 1033
+
+#define XSK_UMEM_MAX_REGIONS 64
+#define XSK_UMEM_REGION_SHIFT 32
+
+#define XSK_UMEM_REGION_ADDRESS(RegionId, Offset) \
+    (((UINT64)(RegionId) << XSK_UMEM_REGION_SHIFT) | (UINT64)(Offset))
+
+typedef struct _XSK_UMEM_REGION {
+    //
+    // The region ID, from 1 to XSK_UMEM_MAX_REGIONS - 1.
+    //
+    UINT32 RegionId;
+    UINT64 TotalSize;
+    VOID *Address;
+} XSK_UMEM_REGION;
+
+//
+// XSK_SOCKOPT_UMEM_REMOVE_REGION
+//
+// Supports: set
+// Optval type: UINT32
+// Description: Removes a region added by XSK_SOCKOPT_UMEM_ADD_REGION and
+//              unlocks its memory. Fill descriptors referring to a removed
+//              region are invalid. The application must not remove a region
+//              while the region's chunks are posted to a fill ring or held in
+//              an RX ring. Removal waits for in-progress receives into the
+//              region to complete.
+//
+#define XSK_SOCKOPT_UMEM_REMOVE_REGION 1034
+
+//
+// XSK_SOCKOPT_MODE_FAILOVER
+//
+// Supports: get/set
+// Optval type: BOOLEAN
+// Description: Enables failover between native and generic XDP. When the
+//              native interface an active socket is bound to detaches, the
+//              socket is moved to the generic interface instead of failing
+//              with XSK_ERROR_INTERFACE_DETACH, keeping its UMEM and rings.
+//              While failed over, XDP periodically probes for the native
+//              interface and moves the socket back once it returns. Frames in
+//              flight during a move may be dropped. XDP programs are not
+//              moved, so applications receiving via a native program should
+//              also attach a generic program. Has no effect on sockets bound
+//              in generic mode. Can only be set prior to binding.
+//              Default: FALSE
+//
+#define XSK_SOCKOPT_MODE_FAILOVER 1035
+
+//
+// XSK_SOCKOPT_TX_COMPLETION_IN_ORDER
+//
+// Supports: get/set
+// Optval type: BOOLEAN
+// Description: Returns TX completions in the order the frames were consumed
+//              from the TX ring, even if the interface completes them out of
+//              order, e.g. across multiple hardware TX engines. Completions
+//              that arrive early are held until every older frame completes,
+//              then published as one contiguous run. Has no effect on
+//              interfaces that complete frames in order. Can only be set prior
+//              to activation.
+//              Default: FALSE
+//
+#define XSK_SOCKOPT_TX_COMPLETION_IN_ORDER 1036
+
+//
+// XSK_SOCKOPT_MEMORY_USAGE
+//
+// Supports: get
+// Optval type: XSK_MEMORY_USAGE
+// Description: Gets the amount of non-paged memory XDP allocated on behalf of
+//              the socket. If the XskProcessMemoryLimitMb registry value is
+//              non-zero, the memory of all user mode sockets created by a
+//              process is limited to that many megabytes, and options or
+//              activation that would exceed the limit fail with
+//              ERROR_NOT_ENOUGH_QUOTA.
+//
+#define XSK_SOCKOPT_MEMORY_USAGE 1037
+
+typedef struct _XSK_MEMORY_USAGE {
+    //
+    // Memory backing the socket's rings, including large page rounding.
+    //
+    UINT64 RingBytes;
+    //
+    // Memory of the TX bounce buffer, a copy of the entire UMEM.
+    //
+    UINT64 BounceBytes;
+    //
+    // Other per-socket allocations, e.g. fill caches and reorder buffers.
+    //
+    UINT64 OtherBytes;
+    //
+    // The memory of all sockets created by the socket's process, and the
+    // process limit, or zero if unlimited. Both are zero for kernel sockets.
+    //
+    UINT64 ProcessBytes;
+    UINT64 ProcessLimitBytes;
+} XSK_MEMORY_USAGE;
+
+//
+// XSK_SOCKOPT_RX_BACKPRESSURE
+//
+// Supports: get/set
+// Optval type: BOOLEAN
+// Description: Enables RX backpressure. While the socket is the exclusive
+//              receiver of a native RX queue whose interface supports
+//              backpressure, frames that do not fit in the RX ring or for
+//              which the fill ring has no buffers are left in the interface's
+//              RX ring instead of being dropped, so the interface stops
+//              receiving, and drops frames in hardware, without spending CPU on
+//              them. Frames left in the interface are not counted as RxDropped.
+//              XDP sets XSK_RING_FLAG_NEED_POKE on the fill ring when it leaves
+//              frames in the interface; the application must then poke RX
+//              (XSK_NOTIFY_FLAG_POKE_RX) after producing fill descriptors or
+//              consuming RX descriptors. Has no effect on multi-buffer sockets,
+//              in generic mode, or on interfaces without backpressure support.
+//              Can only be set prior to binding.
+//              Default: FALSE
+//
+#define XSK_SOCKOPT_RX_BACKPRESSURE 1038
+
+//
+// XSK_SOCKOPT_STATISTICS_PAGE
+//
+// Supports: get
+// Optval type: XSK_STATISTICS_PAGE_INFO
+// Description: Maps the socket's statistics into the address space of the
+//              process that first gets this option, alongside the socket's
+//              rings, and returns the address of the mapping. The data path
+//              updates the statistics in place, so monitoring them requires no
+//              system calls. The mapping is valid until the socket is closed,
+//              and must be treated as read-only. Counters are updated without
+//              synchronization, so each counter must be read individually
+//              with a 64-bit load; there is no consistent snapshot across
+//              counters.
+//
+#define XSK_SOCKOPT_STATISTICS_PAGE 1039
+
+//
+// The statistics a socket counts on each processor. The application sums each
+// counter across processors.
+//
+typedef struct _XSK_STATISTICS_PAGE_PROCESSOR {
+    UINT64 RxFrames;
+    UINT64 RxBytes;
+    UINT64 TxFrames;
+    UINT64 TxBytes;
+    UINT64 TxBounceFrames;
+    UINT64 RxFillRingEmpty;
+    UINT64 RxRingFull;
+    UINT64 RxFillNeedPoke;
+    UINT64 TxNeedPoke;
+    UINT64 RxPokes;
+    UINT64 TxPokes;
+    UINT64 TxBounceFailures;
+} XSK_STATISTICS_PAGE_PROCESSOR;
+
+typedef struct _XSK_STATISTICS_PAGE {
+    XDP_OBJECT_HEADER Header;
+
+    //
+    // The per-processor statistics are an array of ProcessorCount
+    // XSK_STATISTICS_PAGE_PROCESSOR elements, ProcessorStride bytes apart,
+    // starting ProcessorOffset bytes from the start of the page.
+    //
+    UINT32 ProcessorCount;
+    UINT32 ProcessorOffset;
+    UINT32 ProcessorStride;
+
+    //
+    // The statistics returned by XSK_SOCKOPT_STATISTICS.
+    //
+    XSK_STATISTICS Statistics;
+} XSK_STATISTICS_PAGE;
+
+#define XSK_STATISTICS_PAGE_REVISION_1 1
+
+#define XSK_SIZEOF_STATISTICS_PAGE_REVISION_1 \
+    RTL_SIZEOF_THROUGH_FIELD(XSK_STATISTICS_PAGE, Statistics)
+
+typedef struct _XSK_STATISTICS_PAGE_INFO {
+    const XSK_STATISTICS_PAGE *Page;
+
+    //
+    // The size of the mapping, in bytes.
+    //
+    UINT32 Size;
+} XSK_STATISTICS_PAGE_INFO;
+
+//
+// XSK_SOCKOPT_UMEM_ALLOC
+//
+// Supports: set
+// Optval type: XSK_UMEM_REG
+// Description: Registers a UMEM allocated by XDP from nonpaged memory instead
+//              of application memory. The registration's Address must be NULL.
+//              Unlike XSK_SOCKOPT_UMEM_REG, the UMEM is not bound to the
+//              address space of the registering process, so sockets in other
+//              processes can share it via XSK_SOCKOPT_SHARED_UMEM using a
+//              duplicated socket handle, and the UMEM remains valid after the
+//              registering process exits. The memory is charged to the
+//              registering socket until it is closed. Applications access the
+//              UMEM via XSK_SOCKOPT_UMEM_MAPPING. Large pages and UMEM regions
+//              are not supported. Setting this option requires the socket has
+//              no UMEM and is not bound.
+//
+#define XSK_SOCKOPT_UMEM_ALLOC 1040
+
+//
+// XSK_SOCKOPT_UMEM_MAPPING
+//
+// Supports: get
+// Optval type: VOID *
+// Description: Maps the socket's UMEM, which must have been registered with
+//              XSK_SOCKOPT_UMEM_ALLOC, into the address space of the process
+//              that first gets this option, and returns the address of the
+//              mapping. Each socket sharing the UMEM provides its own mapping,
+//              so every process in a pipeline maps the same frames. The mapping
+//              is valid until the socket is closed.
+//
+#define XSK_SOCKOPT_UMEM_MAPPING 1041
+
+//
+// XSK_SOCKOPT_HANDOFF
+//
+// Supports: set
+// Optval type: none
+// Description: Transfers a socket to the calling process, e.g. to upgrade an
+//              application without tearing down its sockets. The socket stays
+//              bound and active, and its rings keep their contents, so RX
+//              buffers already posted to the fill ring are not lost. The
+//              handoff protocol is:
+//
+//              1. The previous process quiesces: it stops accessing the
+//                 socket's rings, UMEM and statistics, and cancels its waits.
+//              2. The previous process duplicates the socket handle, and the
+//                 handles of any XDP programs redirecting to the socket, into
+//                 the new process.
+//              3. The new process sets this option, which maps the rings into
+//                 its address space and unmaps them from the previous process,
+//                 and then resumes by getting XSK_SOCKOPT_RING_INFO,
+//                 XSK_SOCKOPT_UMEM_MAPPING and XSK_SOCKOPT_STATISTICS_PAGE, and
+//                 setting XSK_SOCKOPT_NOTIFY_COMPLETION_PORT if used.
+//              4. The previous process closes its handles and may exit.
+//
+//              Frames received while neither process services the rings are
+//              dropped once the RX ring is full. The socket's memory remains
+//              charged to the process that created it. Handoff requires the
+//              socket's UMEM, if any, to be registered with
+//              XSK_SOCKOPT_UMEM_ALLOC, and is not supported for sockets with a
+//              shared fill ring.
+//
+#define XSK_SOCKOPT_HANDOFF 1042
+
+//
+// XSK_SOCKOPT_RX_FILL_POOL
+//
+// Supports: set
+// Optval type: XSK_RX_FILL_POOL
+// Description: Enables a kernel-managed pool of RX buffers. Rather than keeping
+//              the fill ring stocked with a buffer for every frame it expects
+//              to receive, the application seeds the pool with the first
+//              InitialChunkCount chunks of the UMEM, at addresses
+//              0, ChunkSize, 2 * ChunkSize, and so on, and thereafter returns
+//              consumed RX buffers to the fill ring in bulk, at its own pace.
+//              Each receive drains every returned buffer from the fill ring
+//              into the pool and allocates RX buffers from the pool, so frames
+//              are dropped only when the pool is empty. Capacity is the maximum
+//              number of buffers the pool holds, and must be a power of two no
+//              greater than 2^20. Buffers returned while the pool is full
+//              remain in the fill ring. InitialChunkCount cannot exceed
+//              Capacity or the number of chunks in the UMEM. Setting this
+//              option requires the socket has a UMEM and a fill ring, is not
+//              activated, and does not use XSK_SOCKOPT_SHARED_FILL_RING;
+//              a socket with a fill pool cannot share its fill ring.
+//
+#define XSK_SOCKOPT_RX_FILL_POOL 1043
+
+typedef struct _XSK_RX_FILL_POOL {
+    UINT32 Capacity;
+    UINT32 InitialChunkCount;
+} XSK_RX_FILL_POOL;
+
+//
+// XSK_SOCKOPT_RX_PRIORITY_RING_SIZE
+//
+// Supports: set
+// Optval type: UINT32
+// Description: Sets the size of the socket's priority RX ring, which receives
+//              the frames XDP programs redirect to the socket with
+//              XDP_REDIRECT_TARGET_TYPE_XSK_PRIORITY. Priority frames are
+//              received into buffers from the socket's fill ring, like the
+//              frames of the RX ring, but the application can drain them
+//              first, so latency-critical frames do not wait behind bulk
+//              frames. Any frame on the priority RX ring satisfies an RX wait
+//              without notification moderation. The size must be a power of
+//              two, and the ring is optional even if the socket receives. This
+//              option must be set before the socket is activated.
+//
+#define XSK_SOCKOPT_RX_PRIORITY_RING_SIZE 1044
+
+//
+// XSK_SOCKOPT_RX_PRIORITY_RING_INFO
+//
+// Supports: get
+// Optval type: XSK_RING_INFO
+// Description: Gets the priority RX ring, which is initialized and consumed
+//              like the RX ring returned by XSK_SOCKOPT_RING_INFO. Fails if
+//              the socket has no priority RX ring.
+//
+#define XSK_SOCKOPT_RX_PRIORITY_RING_INFO 1045
+
+//
+// XSK_SOCKOPT_SHARED_RX_RING
+//
+// Supports: set
+// Optval type: HANDLE
+// Description: Sets the socket's RX ring to the RX ring of another socket
+//              sharing the same UMEM, instead of allocating a new RX ring.
+//              Each sharing socket is bound to its own RX queue, and all of
+//              them produce received frames to the one ring, so an application
+//              with few threads can consume many RSS queues from a single ring
+//              and a single wait. Each socket reserves ring entries for a whole
+//              receive batch and publishes them in reservation order, so the
+//              frames of one queue stay in order. Waits and I/O completion
+//              port notifications for the shared ring are signaled on the
+//              other socket, i.e. the socket that created the ring, which
+//              should also share its fill ring with the sharing sockets (see
+//              XSK_SOCKOPT_SHARED_FILL_RING). Interface detach errors are not
+//              reported on a shared RX ring. Setting this option requires the
+//              socket has no RX ring and shares the other socket's UMEM, is not
+//              activated, and belongs to the process that created the other
+//              socket's RX ring. The other socket must have an RX ring and,
+//              unless its RX ring is already shared, must not be activated.
+//              Sockets sharing an RX ring do not support XSK_SOCKOPT_HANDOFF or
+//              XSK_SOCKOPT_RX_MULTI_BUFFER.
+//
+#define XSK_SOCKOPT_SHARED_RX_RING 1046
+
+//
+// XSK_SOCKOPT_WAKE_PARAMETERS
+//
+// Supports: get/set
+// Optval type: XSK_WAKE_PARAMETERS
+// Description: Sets or gets how threads waiting in XskNotifySocket are woken.
+//              PriorityIncrement is the priority boost given to a waiting
+//              thread when the wait is satisfied, and to the thread completing
+//              an overlapped XskNotifyAsync request. It cannot exceed
+//              XSK_WAKE_MAX_PRIORITY_INCREMENT; the default is the network I/O
+//              increment. Flags is a combination of XSK_WAKE_FLAG_* values.
+//              With XSK_WAKE_FLAG_RX_PROCESSOR, a thread waiting for RX is
+//              restricted, for the duration of the wait, to the processor that
+//              last signaled the socket's RX wait, so the thread wakes where
+//              the received frames are cache-hot. Waits on multiple sockets
+//              only apply the priority boost. The XskNotifyWakeup ETW event
+//              reports the latency from each RX signal to the wake-up of the
+//              waiting thread. This option may be set at any time.
+//
+#define XSK_SOCKOPT_WAKE_PARAMETERS 1047
+
+#define XSK_WAKE_MAX_PRIORITY_INCREMENT 8
+
+#define XSK_WAKE_FLAG_RX_PROCESSOR 0x1
+
+typedef struct _XSK_WAKE_PARAMETERS {
+    UINT32 PriorityIncrement;
+    UINT32 Flags;
+} XSK_WAKE_PARAMETERS;
+
+//
+// XSK_SOCKOPT_RING_OCCUPANCY
+//
+// Supports: get
+// Optval type: XSK_RING_OCCUPANCY
+// Description: Gets the size, observed high-water mark and recommended size of
+//              each of the socket's rings. The data path samples the
+//              occupancy of a ring whenever it refreshes its view of the
+//              application's index, which happens at least once per ring's
+//              worth of descriptors and whenever the ring appears full or
+//              empty. A ring whose high-water mark reached its size overflowed
+//              or blocked its producer, and is recommended to double in size;
+//              other rings are recommended to be twice their high-water mark,
+//              rounded up to a power of two. A ring without samples is
+//              recommended to keep its size. A full fill ring only means the
+//              application posted buffers in advance, so the fill ring is
+//              recommended to match the RX ring's recommended size instead.
+//              Ring sizes are fixed once the socket is activated, so
+//              applications apply the recommendations to the sockets they
+//              create next. Absent rings have zero sizes.
+//
+#define XSK_SOCKOPT_RING_OCCUPANCY 1048
+
+typedef struct _XSK_RING_OCCUPANCY_ENTRY {
+    UINT32 Size;
+    UINT32 HighWater;
+    UINT32 RecommendedSize;
+} XSK_RING_OCCUPANCY_ENTRY;
+
+typedef struct _XSK_RING_OCCUPANCY {
+    XSK_RING_OCCUPANCY_ENTRY Rx;
+    XSK_RING_OCCUPANCY_ENTRY RxFill;
+    XSK_RING_OCCUPANCY_ENTRY Tx;
+    XSK_RING_OCCUPANCY_ENTRY TxCompletion;
+    XSK_RING_OCCUPANCY_ENTRY RxPriority;
+} XSK_RING_OCCUPANCY;
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
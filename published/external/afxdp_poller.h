@@ -0,0 +1,521 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+//
+// Optional header-only AF_XDP poller built on the afxdp_helper.h ring helpers.
+// The poller manages a UMEM chunk pool, batched RX fill and TX completion
+// recycling, coalesced pokes, and an optional multi-socket event loop.
+//
+// The poller uses experimental XDP interfaces when available, and is subject
+// to the same breaking changes as xdpapi_experimental.h.
+//
+
+#ifndef AFXDP_POLLER_H
+#define AFXDP_POLLER_H
+
+#include <xdpapi.h>
+#include <xdpapi_experimental.h>
+#include <afxdp_helper.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// The maximum number of elements moved across a ring in a single batch.
+//
+#define XSK_POLLER_BATCH_MAXIMUM 64
+
+//
+// A LIFO pool of free UMEM chunks, identified by their offset from the start of
+// the UMEM. Recently freed chunks are reused first, which keeps the working set
+// of UMEM warm in the CPU cache. The caller provides the backing storage.
+//
+typedef struct _XSK_CHUNK_POOL {
+    UINT64 *Chunks;
+    UINT32 Count;
+    UINT32 Capacity;
+} XSK_CHUNK_POOL;
+
+//
+// Initializes a chunk pool with every chunk of the registered UMEM, or as many
+// as the storage can hold.
+//
+inline
+VOID
+XskChunkPoolInitialize(
+    _Out_ XSK_CHUNK_POOL *Pool,
+    _Out_writes_(Capacity) UINT64 *Chunks,
+    _In_ UINT32 Capacity,
+    _In_ const XSK_UMEM_REG *UmemReg
+    )
+{
+    UINT64 ChunkCount = UmemReg->TotalSize / UmemReg->ChunkSize;
+
+    Pool->Chunks = Chunks;
+    Pool->Capacity = Capacity;
+    Pool->Count = ChunkCount < Capacity ? (UINT32)ChunkCount : Capacity;
+
+    //
+    // Push the chunks in reverse so the lowest offsets are popped first.
+    //
+    for (UINT32 i = 0; i < Pool->Count; i++) {
+        Pool->Chunks[i] = (UINT64)(Pool->Count - 1 - i) * UmemReg->ChunkSize;
+    }
+}
+
+inline
+UINT32
+XskChunkPoolCount(
+    _In_ const XSK_CHUNK_POOL *Pool
+    )
+{
+    return Pool->Count;
+}
+
+inline
+BOOLEAN
+XskChunkPoolPop(
+    _Inout_ XSK_CHUNK_POOL *Pool,
+    _Out_ UINT64 *Chunk
+    )
+{
+    if (Pool->Count == 0) {
+        return FALSE;
+    }
+
+    *Chunk = Pool->Chunks[--Pool->Count];
+    return TRUE;
+}
+
+//
+// Returns a chunk to the pool. The pool never holds more chunks than the UMEM
+// contains, so a pool sized for the whole UMEM cannot overflow.
+//
+inline
+VOID
+XskChunkPoolPush(
+    _Inout_ XSK_CHUNK_POOL *Pool,
+    _In_ UINT64 Chunk
+    )
+{
+    if (Pool->Count < Pool->Capacity) {
+        Pool->Chunks[Pool->Count++] = Chunk;
+    }
+}
+
+//
+// Per-socket poller state. Rings not configured on the socket have zero size.
+//
+typedef struct _XSK_POLLER_SOCKET {
+    HANDLE Socket;
+    XSK_CHUNK_POOL *Pool;
+    XSK_RING Rx;
+    XSK_RING Fill;
+    XSK_RING Tx;
+    XSK_RING Completion;
+    UINT32 BatchSize;
+    //
+    // The number of buffers enqueued for TX and not yet completed.
+    //
+    UINT32 TxOutstanding;
+    //
+    // Pokes required by ring updates since the last flush.
+    //
+    XSK_NOTIFY_FLAGS PendingPokes;
+} XSK_POLLER_SOCKET;
+
+//
+// Initializes the poller state of an activated socket. Multiple sockets may
+// share a chunk pool if they share a UMEM and are polled by the same thread.
+//
+inline
+HRESULT
+XskPollerSocketInitialize(
+    _Out_ XSK_POLLER_SOCKET *PollerSocket,
+    _In_ const XDP_API_TABLE *XdpApi,
+    _In_ HANDLE Socket,
+    _In_ XSK_CHUNK_POOL *Pool,
+    _In_ UINT32 BatchSize
+    )
+{
+    XSK_RING_INFO_SET InfoSet;
+    UINT32 OptionLength = sizeof(InfoSet);
+    HRESULT Result;
+
+    RtlZeroMemory(PollerSocket, sizeof(*PollerSocket));
+
+    if (BatchSize == 0 || BatchSize > XSK_POLLER_BATCH_MAXIMUM) {
+        return E_INVALIDARG;
+    }
+
+    Result = XdpApi->XskGetSockopt(Socket, XSK_SOCKOPT_RING_INFO, &InfoSet, &OptionLength);
+    if (FAILED(Result)) {
+        return Result;
+    }
+
+    PollerSocket->Socket = Socket;
+    PollerSocket->Pool = Pool;
+    PollerSocket->BatchSize = BatchSize;
+
+    if (InfoSet.Rx.Size > 0) {
+        XskRingInitialize(&PollerSocket->Rx, &InfoSet.Rx);
+    }
+    if (InfoSet.Fill.Size > 0) {
+        XskRingInitialize(&PollerSocket->Fill, &InfoSet.Fill);
+    }
+    if (InfoSet.Tx.Size > 0) {
+        XskRingInitialize(&PollerSocket->Tx, &InfoSet.Tx);
+    }
+    if (InfoSet.Completion.Size > 0) {
+        XskRingInitialize(&PollerSocket->Completion, &InfoSet.Completion);
+    }
+
+    return S_OK;
+}
+
+//
+// Moves up to one batch of free chunks from the pool to the RX fill ring.
+//
+inline
+UINT32
+XskPollerRefill(
+    _Inout_ XSK_POLLER_SOCKET *PollerSocket
+    )
+{
+    XSK_CHUNK_POOL *Pool = PollerSocket->Pool;
+    UINT32 Count = PollerSocket->BatchSize;
+    UINT32 Index;
+
+    if (PollerSocket->Fill.Size == 0) {
+        return 0;
+    }
+
+    if (Count > Pool->Count) {
+        Count = Pool->Count;
+    }
+
+    Count = XskRingProducerReserve(&PollerSocket->Fill, Count, &Index);
+    if (Count == 0) {
+        return 0;
+    }
+
+    for (UINT32 i = 0; i < Count; i++) {
+        *(UINT64 *)XskRingGetElement(&PollerSocket->Fill, Index++) =
+            Pool->Chunks[--Pool->Count];
+    }
+
+    XskRingProducerSubmit(&PollerSocket->Fill, Count);
+
+    if (XskRingProducerNeedPoke(&PollerSocket->Fill)) {
+        PollerSocket->PendingPokes |= XSK_NOTIFY_FLAG_POKE_RX;
+    }
+
+    return Count;
+}
+
+//
+// Moves up to one batch of completed TX chunks from the TX completion ring to
+// the pool.
+//
+inline
+UINT32
+XskPollerRecycleCompletions(
+    _Inout_ XSK_POLLER_SOCKET *PollerSocket
+    )
+{
+    XSK_CHUNK_POOL *Pool = PollerSocket->Pool;
+    UINT32 Count;
+    UINT32 Index;
+
+    if (PollerSocket->Completion.Size == 0) {
+        return 0;
+    }
+
+    Count = XskRingConsumerReserve(&PollerSocket->Completion, PollerSocket->BatchSize, &Index);
+    if (Count == 0) {
+        return 0;
+    }
+
+    for (UINT32 i = 0; i < Count; i++) {
+        XSK_BUFFER_ADDRESS Address;
+
+        Address.AddressAndOffset =
+            *(UINT64 *)XskRingGetElement(&PollerSocket->Completion, Index++);
+        XskChunkPoolPush(Pool, Address.BaseAddress);
+    }
+
+    XskRingConsumerRelease(&PollerSocket->Completion, Count);
+    PollerSocket->TxOutstanding -= Count;
+
+    return Count;
+}
+
+//
+// Dequeues up to MaxCount received buffers. Ownership of each buffer passes to
+// the caller, which must eventually transmit it or return it to the pool via
+// XskPollerReleaseBuffers.
+//
+inline
+UINT32
+XskPollerReceive(
+    _Inout_ XSK_POLLER_SOCKET *PollerSocket,
+    _Out_writes_to_(MaxCount, return) XSK_BUFFER_DESCRIPTOR *Buffers,
+    _In_ UINT32 MaxCount
+    )
+{
+    UINT32 Count;
+    UINT32 Index;
+
+    if (PollerSocket->Rx.Size == 0) {
+        return 0;
+    }
+
+    Count = XskRingConsumerReserve(&PollerSocket->Rx, MaxCount, &Index);
+    if (Count == 0) {
+        return 0;
+    }
+
+    for (UINT32 i = 0; i < Count; i++) {
+        Buffers[i] = *(XSK_BUFFER_DESCRIPTOR *)XskRingGetElement(&PollerSocket->Rx, Index++);
+    }
+
+    XskRingConsumerRelease(&PollerSocket->Rx, Count);
+
+    return Count;
+}
+
+//
+// Enqueues up to Count buffers for transmission, returning the number of
+// buffers enqueued. Ownership of enqueued buffers passes to XDP until they are
+// recycled from the TX completion ring; the caller retains the remainder.
+//
+inline
+UINT32
+XskPollerTransmit(
+    _Inout_ XSK_POLLER_SOCKET *PollerSocket,
+    _In_reads_(Count) const XSK_BUFFER_DESCRIPTOR *Buffers,
+    _In_ UINT32 Count
+    )
+{
+    UINT32 Index;
+
+    if (PollerSocket->Tx.Size == 0) {
+        return 0;
+    }
+
+    Count = XskRingProducerReserve(&PollerSocket->Tx, Count, &Index);
+    if (Count == 0) {
+        return 0;
+    }
+
+    for (UINT32 i = 0; i < Count; i++) {
+        *(XSK_BUFFER_DESCRIPTOR *)XskRingGetElement(&PollerSocket->Tx, Index++) = Buffers[i];
+    }
+
+    XskRingProducerSubmit(&PollerSocket->Tx, Count);
+    PollerSocket->TxOutstanding += Count;
+
+    if (XskRingProducerNeedPoke(&PollerSocket->Tx)) {
+        PollerSocket->PendingPokes |= XSK_NOTIFY_FLAG_POKE_TX;
+    }
+
+    return Count;
+}
+
+//
+// Returns buffers owned by the caller to the pool.
+//
+inline
+VOID
+XskPollerReleaseBuffers(
+    _Inout_ XSK_POLLER_SOCKET *PollerSocket,
+    _In_reads_(Count) const XSK_BUFFER_DESCRIPTOR *Buffers,
+    _In_ UINT32 Count
+    )
+{
+    for (UINT32 i = 0; i < Count; i++) {
+        XskChunkPoolPush(PollerSocket->Pool, Buffers[i].Address.BaseAddress);
+    }
+}
+
+//
+// Performs any pokes required by ring updates since the last flush.
+//
+inline
+HRESULT
+XskPollerFlush(
+    _In_ const XDP_API_TABLE *XdpApi,
+    _Inout_ XSK_POLLER_SOCKET *PollerSocket
+    )
+{
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    XSK_NOTIFY_FLAGS Pokes = PollerSocket->PendingPokes;
+
+    if (Pokes == XSK_NOTIFY_FLAG_NONE) {
+        return S_OK;
+    }
+
+    PollerSocket->PendingPokes = XSK_NOTIFY_FLAG_NONE;
+
+    return XdpApi->XskNotifySocket(PollerSocket->Socket, Pokes, 0, &NotifyResult);
+}
+
+//
+// Invoked by XskPollerPoll with a batch of received buffers. Ownership of the
+// buffers passes to the callback, which must transmit or release each of them.
+//
+typedef
+VOID
+XSK_POLLER_RECEIVE_FN(
+    _In_opt_ VOID *Context,
+    _Inout_ XSK_POLLER_SOCKET *PollerSocket,
+    _In_reads_(Count) XSK_BUFFER_DESCRIPTOR *Buffers,
+    _In_ UINT32 Count
+    );
+
+typedef struct _XSK_POLLER {
+    const XDP_API_TABLE *XdpApi;
+    XSK_POLLER_SOCKET **Sockets;
+    UINT32 SocketCount;
+    //
+    // The multi-socket wait routine, if supported by the installed XDP.
+    //
+    XSK_NOTIFY_SOCKETS_FN *NotifySockets;
+    XSK_NOTIFY_SOCKET_ENTRY NotifyEntries[XSK_NOTIFY_SOCKETS_MAXIMUM];
+} XSK_POLLER;
+
+inline
+HRESULT
+XskPollerInitialize(
+    _Out_ XSK_POLLER *Poller,
+    _In_ const XDP_API_TABLE *XdpApi,
+    _In_reads_(SocketCount) XSK_POLLER_SOCKET **Sockets,
+    _In_ UINT32 SocketCount
+    )
+{
+    RtlZeroMemory(Poller, sizeof(*Poller));
+
+    if (SocketCount == 0 || SocketCount > XSK_NOTIFY_SOCKETS_MAXIMUM) {
+        return E_INVALIDARG;
+    }
+
+    Poller->XdpApi = XdpApi;
+    Poller->Sockets = Sockets;
+    Poller->SocketCount = SocketCount;
+    Poller->NotifySockets =
+        (XSK_NOTIFY_SOCKETS_FN *)XdpApi->XdpGetRoutine(XSK_NOTIFY_SOCKETS_FN_NAME);
+
+    return S_OK;
+}
+
+inline
+XSK_NOTIFY_FLAGS
+XskPollerSocketWaitFlags(
+    _In_ const XSK_POLLER_SOCKET *PollerSocket
+    )
+{
+    XSK_NOTIFY_FLAGS Flags = XSK_NOTIFY_FLAG_NONE;
+
+    if (PollerSocket->Rx.Size > 0) {
+        Flags |= XSK_NOTIFY_FLAG_WAIT_RX;
+    }
+    if (PollerSocket->TxOutstanding > 0) {
+        Flags |= XSK_NOTIFY_FLAG_WAIT_TX;
+    }
+
+    return Flags;
+}
+
+//
+// Performs one pass over every socket: recycles TX completions, refills the RX
+// fill ring, delivers a batch of received buffers to ReceiveCallback, and then
+// performs coalesced pokes. If no socket made progress and
+// WaitTimeoutMilliseconds is nonzero, waits for RX or TX completions on any
+// socket. Multi-socket waits require XskNotifySocketsExperimental; without it,
+// the poller does not wait when polling multiple sockets.
+//
+inline
+HRESULT
+XskPollerPoll(
+    _Inout_ XSK_POLLER *Poller,
+    _In_ XSK_POLLER_RECEIVE_FN *ReceiveCallback,
+    _In_opt_ VOID *Context,
+    _In_ UINT32 WaitTimeoutMilliseconds,
+    _Out_opt_ UINT32 *ProcessedCount
+    )
+{
+    XSK_BUFFER_DESCRIPTOR Buffers[XSK_POLLER_BATCH_MAXIMUM];
+    UINT32 Processed = 0;
+    UINT32 WaitCount = 0;
+    HRESULT Result = S_OK;
+
+    for (UINT32 i = 0; i < Poller->SocketCount; i++) {
+        XSK_POLLER_SOCKET *PollerSocket = Poller->Sockets[i];
+        UINT32 Count;
+
+        Processed += XskPollerRecycleCompletions(PollerSocket);
+        Processed += XskPollerRefill(PollerSocket);
+
+        Count = XskPollerReceive(PollerSocket, Buffers, PollerSocket->BatchSize);
+        if (Count > 0) {
+            ReceiveCallback(Context, PollerSocket, Buffers, Count);
+            Processed += Count;
+        }
+
+        Result = XskPollerFlush(Poller->XdpApi, PollerSocket);
+        if (FAILED(Result)) {
+            goto Exit;
+        }
+    }
+
+    if (Processed > 0 || WaitTimeoutMilliseconds == 0) {
+        goto Exit;
+    }
+
+    for (UINT32 i = 0; i < Poller->SocketCount; i++) {
+        XSK_NOTIFY_FLAGS Flags = XskPollerSocketWaitFlags(Poller->Sockets[i]);
+
+        if (Flags != XSK_NOTIFY_FLAG_NONE) {
+            Poller->NotifyEntries[WaitCount].Socket = Poller->Sockets[i]->Socket;
+            Poller->NotifyEntries[WaitCount].Flags = Flags;
+            Poller->NotifyEntries[WaitCount].Result = XSK_NOTIFY_RESULT_FLAG_NONE;
+            WaitCount++;
+        }
+    }
+
+    if (WaitCount == 1) {
+        XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+
+        Result =
+            Poller->XdpApi->XskNotifySocket(
+                Poller->NotifyEntries[0].Socket, Poller->NotifyEntries[0].Flags,
+                WaitTimeoutMilliseconds, &NotifyResult);
+    } else if (WaitCount > 1 && Poller->NotifySockets != NULL) {
+        UINT32 ReadyCount;
+
+        Result =
+            Poller->NotifySockets(
+                Poller->NotifyEntries, WaitCount, WaitTimeoutMilliseconds, &ReadyCount);
+    }
+
+    if (Result == HRESULT_FROM_WIN32(ERROR_TIMEOUT)) {
+        Result = S_OK;
+    }
+
+Exit:
+
+    if (ProcessedCount != NULL) {
+        *ProcessedCount = Processed;
+    }
+
+    return Result;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
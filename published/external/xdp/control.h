@@ -38,12 +38,22 @@ struct _XDP_CAPABILITIES_EX {
     UINT32 DriverApiVersionCount;
     XDP_VERSION DdkDriverApiVersion;
     GUID InstanceId;
+
+    //
+    // The interface presents outgoing frames to XDP before posting them to the
+    // hardware. XDP creates RX queues for the L2 TX inspect hook on the
+    // interface; see XdpRxQueueGetHookId.
+    //
+    BOOLEAN TxInspectSupported;
 } XDP_CAPABILITIES_EX;
 
 #define XDP_CAPABILITIES_EX_REVISION_1 1
+#define XDP_CAPABILITIES_EX_REVISION_2 2
 
 #define XDP_SIZEOF_CAPABILITIES_EX_REVISION_1 \
     RTL_SIZEOF_THROUGH_FIELD(XDP_CAPABILITIES_EX, InstanceId)
+#define XDP_SIZEOF_CAPABILITIES_EX_REVISION_2 \
+    RTL_SIZEOF_THROUGH_FIELD(XDP_CAPABILITIES_EX, TxInspectSupported)
 
 typedef struct _XDP_CAPABILITIES {
     XDP_CAPABILITIES_EX CapabilitiesEx;
@@ -64,8 +74,8 @@ XdpInitializeCapabilities(
     };
 
     RtlZeroMemory(Capabilities, sizeof(*Capabilities));
-    Capabilities->CapabilitiesEx.Header.Revision = XDP_CAPABILITIES_EX_REVISION_1;
-    Capabilities->CapabilitiesEx.Header.Size = XDP_SIZEOF_CAPABILITIES_EX_REVISION_1;
+    Capabilities->CapabilitiesEx.Header.Revision = XDP_CAPABILITIES_EX_REVISION_2;
+    Capabilities->CapabilitiesEx.Header.Size = XDP_SIZEOF_CAPABILITIES_EX_REVISION_2;
 
     Capabilities->CapabilitiesEx.DriverApiVersionsOffset =
         FIELD_OFFSET(XDP_CAPABILITIES, DriverApiVersion);
@@ -16,6 +16,12 @@ XDP_RX_QUEUE_GET_TARGET_QUEUE_INFO(
     _In_ XDP_RX_QUEUE_CONFIG_CREATE RxQueueConfig
     );
 
+typedef
+CONST XDP_HOOK_ID *
+XDP_RX_QUEUE_CREATE_GET_HOOK_ID(
+    _In_ XDP_RX_QUEUE_CONFIG_CREATE RxQueueConfig
+    );
+
 typedef
 BOOLEAN
 XDP_RX_QUEUE_CREATE_IS_ENABLED(
@@ -70,6 +76,21 @@ XDP_RX_QUEUE_ACTIVATE_IS_ENABLED(
     _In_ XDP_RX_QUEUE_CONFIG_ACTIVATE RxQueueConfig
     );
 
+//
+// Routines appended to the create dispatch table after its first revision. The
+// table is referenced by the dispatch table's Reserved field, so drivers built
+// against either revision interoperate with any version of XDP.
+//
+typedef struct _XDP_RX_QUEUE_CONFIG_RESERVED {
+    XDP_OBJECT_HEADER               Header;
+    XDP_RX_QUEUE_CREATE_GET_HOOK_ID *GetHookId;
+} XDP_RX_QUEUE_CONFIG_RESERVED;
+
+#define XDP_RX_QUEUE_CONFIG_RESERVED_REVISION_1 1
+
+#define XDP_SIZEOF_RX_QUEUE_CONFIG_RESERVED_REVISION_1 \
+    RTL_SIZEOF_THROUGH_FIELD(XDP_RX_QUEUE_CONFIG_RESERVED, GetHookId)
+
 typedef struct _XDP_RX_QUEUE_CONFIG_CREATE_DISPATCH {
     XDP_OBJECT_HEADER                       Header;
     const VOID                              *Reserved;
@@ -117,6 +138,25 @@ XDPEXPORT(XdpRxQueueGetTargetQueueInfo)(
     return Details->Dispatch->GetTargetQueueInfo(RxQueueConfig);
 }
 
+inline
+CONST XDP_HOOK_ID *
+XDPEXPORT(XdpRxQueueGetHookId)(
+    _In_ XDP_RX_QUEUE_CONFIG_CREATE RxQueueConfig
+    )
+{
+    XDP_RX_QUEUE_CONFIG_CREATE_DETAILS *Details = (XDP_RX_QUEUE_CONFIG_CREATE_DETAILS *)RxQueueConfig;
+    const XDP_RX_QUEUE_CONFIG_RESERVED *Reserved = Details->Dispatch->Reserved;
+
+    if (Reserved == NULL ||
+        Reserved->Header.Revision < XDP_RX_QUEUE_CONFIG_RESERVED_REVISION_1 ||
+        Reserved->Header.Size < XDP_SIZEOF_RX_QUEUE_CONFIG_RESERVED_REVISION_1 ||
+        Reserved->GetHookId == NULL) {
+        return NULL;
+    }
+
+    return Reserved->GetHookId(RxQueueConfig);
+}
+
 inline
 VOID
 XDPEXPORT(XdpRxQueueSetCapabilities)(
@@ -0,0 +1,37 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+EXTERN_C_START
+
+#include <xdp/offload.h>
+
+//
+// The ms_frame_checksum extension (XDP_FRAME_CHECKSUM) requests the interface
+// compute checksums of a TX frame. If Layer3 is XdpFrameTxChecksumActionRequired
+// the interface computes the IPv4 header checksum, and if Layer4 is
+// XdpFrameTxChecksumActionRequired the interface computes the TCP or UDP
+// checksum, locating each header with the frame's ms_frame_layout extension.
+// Interfaces registering this extension must also register ms_frame_layout and
+// support all three checksums.
+//
+#define XDP_FRAME_EXTENSION_CHECKSUM_NAME L"ms_frame_checksum"
+#define XDP_FRAME_EXTENSION_CHECKSUM_VERSION_1 1U
+
+#include <xdp/datapath.h>
+#include <xdp/extension.h>
+
+inline
+XDP_FRAME_CHECKSUM *
+XdpGetFrameChecksumExtension(
+    _In_ XDP_FRAME *Frame,
+    _In_ XDP_EXTENSION *Extension
+    )
+{
+    return (XDP_FRAME_CHECKSUM *)XdpGetExtensionData(Frame, Extension);
+}
+
+EXTERN_C_END
@@ -0,0 +1,39 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+EXTERN_C_START
+
+#include <xdp/offload.h>
+
+//
+// The ms_frame_gso extension (XDP_FRAME_GSO) requests the interface perform
+// segmentation offload on a TX frame. A zero MSS indicates the frame is not
+// segmented. Otherwise, the interface splits the frame's layer 4 payload into
+// segments of at most UDP.Mss (or the equivalent TCP.Mss) bytes, replicating
+// the frame's Ethernet, IP, and UDP or TCP headers and rewriting the IP
+// lengths and layer 4 checksums of each segment. UDP segments also have their
+// UDP length rewritten; TCP segments have their sequence number advanced, and
+// the FIN and PSH flags are retained only on the last segment and the CWR flag
+// only on the first.
+//
+#define XDP_FRAME_EXTENSION_GSO_NAME L"ms_frame_gso"
+#define XDP_FRAME_EXTENSION_GSO_VERSION_1 1U
+
+#include <xdp/datapath.h>
+#include <xdp/extension.h>
+
+inline
+XDP_FRAME_GSO *
+XdpGetFrameGsoExtension(
+    _In_ XDP_FRAME *Frame,
+    _In_ XDP_EXTENSION *Extension
+    )
+{
+    return (XDP_FRAME_GSO *)XdpGetExtensionData(Frame, Extension);
+}
+
+EXTERN_C_END
@@ -0,0 +1,33 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+EXTERN_C_START
+
+#include <xdp/offload.h>
+
+//
+// The ms_frame_layout extension (XDP_FRAME_LAYOUT) describes the protocol
+// headers of a TX frame. It accompanies the ms_frame_checksum extension, and
+// its header types and lengths are valid only if a checksum is requested.
+//
+#define XDP_FRAME_EXTENSION_LAYOUT_NAME L"ms_frame_layout"
+#define XDP_FRAME_EXTENSION_LAYOUT_VERSION_1 1U
+
+#include <xdp/datapath.h>
+#include <xdp/extension.h>
+
+inline
+XDP_FRAME_LAYOUT *
+XdpGetFrameLayoutExtension(
+    _In_ XDP_FRAME *Frame,
+    _In_ XDP_EXTENSION *Extension
+    )
+{
+    return (XDP_FRAME_LAYOUT *)XdpGetExtensionData(Frame, Extension);
+}
+
+EXTERN_C_END
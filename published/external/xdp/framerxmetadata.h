@@ -0,0 +1,72 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+EXTERN_C_START
+
+typedef enum _XDP_FRAME_RX_CHECKSUM_EVALUATION {
+    XdpFrameRxChecksumEvaluationNotChecked = 0,
+    XdpFrameRxChecksumEvaluationSucceeded = 1,
+    XdpFrameRxChecksumEvaluationFailed = 2,
+    XdpFrameRxChecksumEvaluationInvalid = 3,
+} XDP_FRAME_RX_CHECKSUM_EVALUATION;
+
+#pragma warning(push)
+#pragma warning(default:4820) // warn if the compiler inserted padding
+
+//
+// Receive metadata reported by the interface for an RX frame.
+//
+typedef struct _XDP_FRAME_RX_METADATA {
+    //
+    // The RSS hash value of the frame. Valid only if RssHashType is nonzero.
+    //
+    UINT32 RssHash;
+
+    //
+    // The NDIS_HASH_TYPE_* flags of the RSS hash, or zero if the frame does not
+    // have an RSS hash.
+    //
+    UINT32 RssHashType;
+
+    //
+    // One of XDP_FRAME_RX_CHECKSUM_EVALUATION.
+    //
+    UINT8 Layer3Checksum;
+
+    //
+    // One of XDP_FRAME_RX_CHECKSUM_EVALUATION.
+    //
+    UINT8 Layer4Checksum;
+
+    //
+    // The number of TCP segments coalesced into the frame by receive segment
+    // coalescing (RSC), or zero if the frame was not coalesced.
+    //
+    UINT16 CoalescedSegmentCount;
+} XDP_FRAME_RX_METADATA;
+
+C_ASSERT(sizeof(XDP_FRAME_RX_METADATA) == 12);
+
+#pragma warning(pop)
+
+#define XDP_FRAME_EXTENSION_RX_METADATA_NAME L"ms_frame_rx_metadata"
+#define XDP_FRAME_EXTENSION_RX_METADATA_VERSION_1 1U
+
+#include <xdp/datapath.h>
+#include <xdp/extension.h>
+
+inline
+XDP_FRAME_RX_METADATA *
+XdpGetRxMetadataExtension(
+    _In_ XDP_FRAME *Frame,
+    _In_ XDP_EXTENSION *Extension
+    )
+{
+    return (XDP_FRAME_RX_METADATA *)XdpGetExtensionData(Frame, Extension);
+}
+
+EXTERN_C_END
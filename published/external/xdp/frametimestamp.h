@@ -0,0 +1,54 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+EXTERN_C_START
+
+#pragma warning(push)
+#pragma warning(default:4820) // warn if the compiler inserted padding
+
+//
+// A frame timestamp, in units of the system performance counter
+// (KeQueryPerformanceCounter). RX frames are stamped by the interface when
+// the frame is received; TX frames are stamped by the interface when the frame
+// is transmitted, prior to completion. A timestamp of zero indicates the
+// interface did not stamp the frame.
+//
+typedef struct _XDP_FRAME_TIMESTAMP {
+    UINT64 Timestamp;
+} XDP_FRAME_TIMESTAMP;
+
+C_ASSERT(sizeof(XDP_FRAME_TIMESTAMP) == 8);
+
+#pragma warning(pop)
+
+#define XDP_FRAME_EXTENSION_TIMESTAMP_NAME L"ms_frame_timestamp"
+#define XDP_FRAME_EXTENSION_TIMESTAMP_VERSION_1 1U
+
+#include <xdp/datapath.h>
+#include <xdp/extension.h>
+
+inline
+XDP_FRAME_TIMESTAMP *
+XdpGetFrameTimestampExtension(
+    _In_ XDP_FRAME *Frame,
+    _In_ XDP_EXTENSION *Extension
+    )
+{
+    return (XDP_FRAME_TIMESTAMP *)XdpGetExtensionData(Frame, Extension);
+}
+
+inline
+XDP_FRAME_TIMESTAMP *
+XdpGetTxCompletionTimestampExtension(
+    _In_ XDP_TX_FRAME_COMPLETION *Completion,
+    _In_ XDP_EXTENSION *Extension
+    )
+{
+    return (XDP_FRAME_TIMESTAMP *)XdpGetExtensionData(Completion, Extension);
+}
+
+EXTERN_C_END
@@ -0,0 +1,465 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+//
+// This file contains helpers for NDIS6 XDP interface drivers to indicate RX
+// frames with XDP_RX_ACTION_PASS to the NDIS receive path. Frames are described
+// by NBLs preallocated into a per-queue cache, and by the MDLs registered in
+// each buffer's ms_buffer_mdl extension, so the PASS path does not allocate or
+// copy.
+//
+
+EXTERN_C_START
+
+#if NDIS_SUPPORT_NDIS6
+
+#include <xdp/buffermdl.h>
+#include <xdp/buffervirtualaddress.h>
+#include <xdp/datapath.h>
+#include <xdp/framefragment.h>
+#include <xdp/framerxaction.h>
+#include <xdp/framerxmetadata.h>
+
+//
+// A cache of NBLs, each with a single NET_BUFFER, for an RX queue. Only the
+// queue's receive path allocates from the cache; NBLs may be released to the
+// cache on any processor.
+//
+typedef struct _XDP_NDIS_RX_NBL_CACHE {
+    //
+    // NBLs available to the receive path.
+    //
+    NET_BUFFER_LIST *Free;
+
+    //
+    // NBLs released to the cache, reclaimed by the receive path once the free
+    // list is empty.
+    //
+    NET_BUFFER_LIST *volatile Released;
+
+    NDIS_HANDLE SourceHandle;
+
+    //
+    // The byte count of each RX buffer's MDL. The MDLs of multi-buffer frames
+    // are chained and trimmed to the frame's data, and restored to this byte
+    // count on release.
+    //
+    UINT32 MdlByteCount;
+} XDP_NDIS_RX_NBL_CACHE;
+
+//
+// The RX queue extensions used to convert frames. The MDL and virtual address
+// buffer extensions and the RX action frame extension are required. The
+// fragment extension is required if the queue has a fragment ring, and the RX
+// metadata extension is used only if RxMetadataEnabled is set.
+//
+typedef struct _XDP_NDIS_RX_EXTENSIONS {
+    XDP_EXTENSION MdlExtension;
+    XDP_EXTENSION VaExtension;
+    XDP_EXTENSION FragmentExtension;
+    XDP_EXTENSION RxActionExtension;
+    XDP_EXTENSION RxMetadataExtension;
+    BOOLEAN RxMetadataEnabled;
+} XDP_NDIS_RX_EXTENSIONS;
+
+typedef struct _XDP_NDIS_RX_NBL_CHAIN {
+    NET_BUFFER_LIST *Head;
+    NET_BUFFER_LIST **Tail;
+    UINT32 Count;
+} XDP_NDIS_RX_NBL_CHAIN;
+
+inline
+VOID
+XdpNdisRxInitializeNblChain(
+    _Out_ XDP_NDIS_RX_NBL_CHAIN *NblChain
+    )
+{
+    NblChain->Head = NULL;
+    NblChain->Tail = &NblChain->Head;
+    NblChain->Count = 0;
+}
+
+//
+// Frees all NBLs in the cache. All NBLs allocated from the cache must have
+// been released.
+//
+inline
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpNdisRxCleanupNblCache(
+    _Inout_ XDP_NDIS_RX_NBL_CACHE *Cache
+    )
+{
+    NET_BUFFER_LIST *Nbl = Cache->Free;
+
+    while (Nbl != NULL) {
+        NET_BUFFER_LIST *Next = NET_BUFFER_LIST_NEXT_NBL(Nbl);
+        NdisFreeNetBufferList(Nbl);
+        Nbl = Next;
+    }
+
+    Nbl =
+        (NET_BUFFER_LIST *)
+            InterlockedExchangePointer((VOID *volatile *)&Cache->Released, NULL);
+
+    while (Nbl != NULL) {
+        NET_BUFFER_LIST *Next = NET_BUFFER_LIST_NEXT_NBL(Nbl);
+        NdisFreeNetBufferList(Nbl);
+        Nbl = Next;
+    }
+
+    Cache->Free = NULL;
+}
+
+//
+// Preallocates NBLs from an NBL pool. The pool must be allocated with
+// fAllocateNetBuffer set, and the cache should hold at least as many NBLs as
+// the RX queue has buffers.
+//
+inline
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NDIS_STATUS
+XdpNdisRxInitializeNblCache(
+    _Out_ XDP_NDIS_RX_NBL_CACHE *Cache,
+    _In_ NDIS_HANDLE NblPoolHandle,
+    _In_ NDIS_HANDLE SourceHandle,
+    _In_ UINT32 NblCount,
+    _In_ UINT32 MdlByteCount
+    )
+{
+    RtlZeroMemory(Cache, sizeof(*Cache));
+    Cache->SourceHandle = SourceHandle;
+    Cache->MdlByteCount = MdlByteCount;
+
+    for (UINT32 Index = 0; Index < NblCount; Index++) {
+        NET_BUFFER_LIST *Nbl =
+            NdisAllocateNetBufferAndNetBufferList(NblPoolHandle, 0, 0, NULL, 0, 0);
+
+        if (Nbl == NULL) {
+            XdpNdisRxCleanupNblCache(Cache);
+            return NDIS_STATUS_RESOURCES;
+        }
+
+        Nbl->SourceHandle = SourceHandle;
+        NET_BUFFER_LIST_NEXT_NBL(Nbl) = Cache->Free;
+        Cache->Free = Nbl;
+    }
+
+    return NDIS_STATUS_SUCCESS;
+}
+
+inline
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NET_BUFFER_LIST *
+XdpNdisRxAllocateNbl(
+    _Inout_ XDP_NDIS_RX_NBL_CACHE *Cache
+    )
+{
+    NET_BUFFER_LIST *Nbl;
+
+    if (Cache->Free == NULL) {
+        //
+        // Reclaim every released NBL at once. Since only the receive path
+        // removes NBLs from the released list, pushes cannot suffer ABA.
+        //
+        Cache->Free =
+            (NET_BUFFER_LIST *)
+                InterlockedExchangePointer((VOID *volatile *)&Cache->Released, NULL);
+    }
+
+    Nbl = Cache->Free;
+
+    if (Nbl != NULL) {
+        Cache->Free = NET_BUFFER_LIST_NEXT_NBL(Nbl);
+        NET_BUFFER_LIST_NEXT_NBL(Nbl) = NULL;
+    }
+
+    return Nbl;
+}
+
+//
+// Returns the IP protocol of an Ethernet frame's first buffer, or zero if the
+// buffer does not contain the IP header.
+//
+inline
+UINT8
+XdpNdisRxGetIpProtocol(
+    _In_reads_bytes_(Length) const UCHAR *Data,
+    _In_ UINT32 Length
+    )
+{
+    UINT16 EtherType;
+
+    if (Length < 14) {
+        return 0;
+    }
+
+    EtherType = (UINT16)((Data[12] << 8) | Data[13]);
+
+    if (EtherType == 0x0800 && Length >= 14 + 20) {
+        return Data[14 + 9];
+    } else if (EtherType == 0x86DD && Length >= 14 + 40) {
+        return Data[14 + 6];
+    }
+
+    return 0;
+}
+
+inline
+VOID
+XdpNdisRxSetNblInfo(
+    _Inout_ NET_BUFFER_LIST *Nbl,
+    _In_ const XDP_FRAME_RX_METADATA *RxMetadata,
+    _In_reads_bytes_(Length) const UCHAR *Data,
+    _In_ UINT32 Length
+    )
+{
+    NDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO Checksum;
+
+    if (RxMetadata->RssHashType != 0) {
+        NET_BUFFER_LIST_SET_HASH_VALUE(Nbl, RxMetadata->RssHash);
+        NET_BUFFER_LIST_SET_HASH_TYPE(Nbl, RxMetadata->RssHashType);
+        NET_BUFFER_LIST_SET_HASH_FUNCTION(Nbl, NdisHashFunctionToeplitz);
+    }
+
+    Checksum.Value = NULL;
+
+    if (RxMetadata->Layer3Checksum == XdpFrameRxChecksumEvaluationSucceeded) {
+        Checksum.Receive.IpChecksumSucceeded = TRUE;
+    } else if (RxMetadata->Layer3Checksum == XdpFrameRxChecksumEvaluationFailed) {
+        Checksum.Receive.IpChecksumFailed = TRUE;
+    }
+
+    if (RxMetadata->Layer4Checksum == XdpFrameRxChecksumEvaluationSucceeded ||
+        RxMetadata->Layer4Checksum == XdpFrameRxChecksumEvaluationFailed) {
+        BOOLEAN Succeeded =
+            RxMetadata->Layer4Checksum == XdpFrameRxChecksumEvaluationSucceeded;
+
+        //
+        // NDIS reports TCP and UDP checksums separately.
+        //
+        switch (XdpNdisRxGetIpProtocol(Data, Length)) {
+        case 6:
+            Checksum.Receive.TcpChecksumSucceeded = Succeeded;
+            Checksum.Receive.TcpChecksumFailed = !Succeeded;
+            break;
+        case 17:
+            Checksum.Receive.UdpChecksumSucceeded = Succeeded;
+            Checksum.Receive.UdpChecksumFailed = !Succeeded;
+            break;
+        default:
+            break;
+        }
+    }
+
+    NET_BUFFER_LIST_INFO(Nbl, TcpIpChecksumNetBufferListInfo) = Checksum.Value;
+
+    if (RxMetadata->CoalescedSegmentCount > 0) {
+        NDIS_RSC_NBL_INFO RscInfo;
+
+        RscInfo.Value = NULL;
+        RscInfo.Info.CoalescedSegCount = RxMetadata->CoalescedSegmentCount;
+        NET_BUFFER_LIST_INFO(Nbl, TcpRecvSegCoalesceInfo) = RscInfo.Value;
+    }
+}
+
+//
+// Describes a frame with an NBL from the cache. Returns FALSE if the cache is
+// empty, or if a fragment buffer's data does not begin its MDL, in which case
+// the frame's MDLs cannot be chained.
+//
+inline
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+XdpNdisRxBuildNbl(
+    _Inout_ XDP_NDIS_RX_NBL_CACHE *Cache,
+    _Inout_ XDP_NDIS_RX_EXTENSIONS *Extensions,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_ UINT32 FragmentIndex,
+    _Out_ NET_BUFFER_LIST **NetBufferList
+    )
+{
+    XDP_BUFFER *Buffer = &Frame->Buffer;
+    XDP_BUFFER_MDL *BufferMdl = XdpGetMdlExtension(Buffer, &Extensions->MdlExtension);
+    XDP_BUFFER_VIRTUAL_ADDRESS *Va =
+        XdpGetVirtualAddressExtension(Buffer, &Extensions->VaExtension);
+    UINT32 FragmentCount = 0;
+    UINT32 DataLength = Buffer->DataLength;
+    ULONG ByteCount = (ULONG)(BufferMdl->MdlOffset + Buffer->DataOffset + Buffer->DataLength);
+    NET_BUFFER_LIST *Nbl;
+    NET_BUFFER *Nb;
+    MDL *Mdl;
+
+    *NetBufferList = NULL;
+
+    if (FragmentRing != NULL) {
+        FragmentCount =
+            XdpGetFragmentExtension(Frame, &Extensions->FragmentExtension)->FragmentBufferCount;
+    }
+
+    for (UINT32 Index = 0; Index < FragmentCount; Index++) {
+        XDP_BUFFER *Fragment =
+            (XDP_BUFFER *)XdpRingGetElement(
+                FragmentRing, (FragmentIndex + Index) & FragmentRing->Mask);
+
+        if (XdpGetMdlExtension(Fragment, &Extensions->MdlExtension)->MdlOffset +
+                Fragment->DataOffset != 0) {
+            return FALSE;
+        }
+    }
+
+    Nbl = XdpNdisRxAllocateNbl(Cache);
+    if (Nbl == NULL) {
+        return FALSE;
+    }
+
+    Nb = NET_BUFFER_LIST_FIRST_NB(Nbl);
+    Mdl = BufferMdl->Mdl;
+    NET_BUFFER_FIRST_MDL(Nb) = Mdl;
+    NET_BUFFER_CURRENT_MDL(Nb) = Mdl;
+    NET_BUFFER_DATA_OFFSET(Nb) = (ULONG)(BufferMdl->MdlOffset + Buffer->DataOffset);
+    NET_BUFFER_CURRENT_MDL_OFFSET(Nb) = NET_BUFFER_DATA_OFFSET(Nb);
+
+    //
+    // Chain the MDLs of a multi-buffer frame, trimming each non-terminal MDL to
+    // the end of its data.
+    //
+    for (UINT32 Index = 0; Index < FragmentCount; Index++) {
+        XDP_BUFFER *Fragment =
+            (XDP_BUFFER *)XdpRingGetElement(
+                FragmentRing, (FragmentIndex + Index) & FragmentRing->Mask);
+        MDL *FragmentMdl = XdpGetMdlExtension(Fragment, &Extensions->MdlExtension)->Mdl;
+
+        Mdl->ByteCount = ByteCount;
+        Mdl->Next = FragmentMdl;
+        Mdl = FragmentMdl;
+        ByteCount = Fragment->DataLength;
+        DataLength += Fragment->DataLength;
+    }
+
+    Mdl->Next = NULL;
+    NET_BUFFER_DATA_LENGTH(Nb) = DataLength;
+
+    if (Extensions->RxMetadataEnabled) {
+        XdpNdisRxSetNblInfo(
+            Nbl, XdpGetRxMetadataExtension(Frame, &Extensions->RxMetadataExtension),
+            Va->VirtualAddress + Buffer->DataOffset, Buffer->DataLength);
+    }
+
+    *NetBufferList = Nbl;
+    return TRUE;
+}
+
+//
+// Converts the frames with XDP_RX_ACTION_PASS in a range of the frame ring into
+// NBLs appended to the chain. FrameIndex and FragmentIndex are the unmasked
+// ring indexes of the range's first frame and first fragment buffer. Frames
+// that cannot be converted have their RX action changed to XDP_RX_ACTION_DROP,
+// so the driver recycles their buffers along with other dropped frames.
+// Returns the number of NBLs appended.
+//
+inline
+_IRQL_requires_max_(DISPATCH_LEVEL)
+UINT32
+XdpNdisRxPassFrames(
+    _Inout_ XDP_NDIS_RX_NBL_CACHE *Cache,
+    _Inout_ XDP_NDIS_RX_EXTENSIONS *Extensions,
+    _In_ XDP_RING *FrameRing,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_ UINT32 FrameIndex,
+    _In_ UINT32 FrameCount,
+    _In_ UINT32 FragmentIndex,
+    _Inout_ XDP_NDIS_RX_NBL_CHAIN *NblChain
+    )
+{
+    UINT32 NblCount = 0;
+
+    for (UINT32 Index = 0; Index < FrameCount; Index++) {
+        XDP_FRAME *Frame =
+            (XDP_FRAME *)XdpRingGetElement(FrameRing, (FrameIndex + Index) & FrameRing->Mask);
+        XDP_FRAME_RX_ACTION *RxAction =
+            XdpGetRxActionExtension(Frame, &Extensions->RxActionExtension);
+        NET_BUFFER_LIST *Nbl;
+
+        if (RxAction->RxAction == XDP_RX_ACTION_PASS) {
+            if (XdpNdisRxBuildNbl(Cache, Extensions, Frame, FragmentRing, FragmentIndex, &Nbl)) {
+                *NblChain->Tail = Nbl;
+                NblChain->Tail = &NET_BUFFER_LIST_NEXT_NBL(Nbl);
+                NblChain->Count++;
+                NblCount++;
+            } else {
+                RxAction->RxAction = XDP_RX_ACTION_DROP;
+            }
+        }
+
+        if (FragmentRing != NULL) {
+            FragmentIndex +=
+                XdpGetFragmentExtension(Frame, &Extensions->FragmentExtension)->FragmentBufferCount;
+        }
+    }
+
+    return NblCount;
+}
+
+//
+// Releases an NBL built by XdpNdisRxBuildNbl to the cache, and returns the
+// frame's MDLs in buffer order so the driver can recycle the buffers. The MDL
+// chain is undone and trimmed MDLs are restored. This routine may be invoked
+// on any processor, e.g. from MiniportReturnNetBufferLists.
+//
+inline
+_IRQL_requires_max_(DISPATCH_LEVEL)
+UINT32
+XdpNdisRxReleaseNbl(
+    _Inout_ XDP_NDIS_RX_NBL_CACHE *Cache,
+    _In_ NET_BUFFER_LIST *Nbl,
+    _Out_writes_to_(MdlCount, return) MDL **Mdls,
+    _In_ UINT32 MdlCount
+    )
+{
+    NET_BUFFER *Nb = NET_BUFFER_LIST_FIRST_NB(Nbl);
+    MDL *Mdl = NET_BUFFER_FIRST_MDL(Nb);
+    NET_BUFFER_LIST *Head;
+    UINT32 Count = 0;
+
+    while (Mdl != NULL) {
+        MDL *Next = Mdl->Next;
+
+        ASSERT(Count < MdlCount);
+        if (Count < MdlCount) {
+            Mdls[Count++] = Mdl;
+        }
+
+        if (Next != NULL) {
+            Mdl->ByteCount = Cache->MdlByteCount;
+            Mdl->Next = NULL;
+        }
+
+        Mdl = Next;
+    }
+
+    NET_BUFFER_FIRST_MDL(Nb) = NULL;
+    NET_BUFFER_CURRENT_MDL(Nb) = NULL;
+    NET_BUFFER_DATA_OFFSET(Nb) = 0;
+    NET_BUFFER_CURRENT_MDL_OFFSET(Nb) = 0;
+    NET_BUFFER_DATA_LENGTH(Nb) = 0;
+    RtlZeroMemory(Nbl->NetBufferListInfo, sizeof(Nbl->NetBufferListInfo));
+
+    do {
+        Head = (NET_BUFFER_LIST *)ReadPointerNoFence((VOID *volatile *)&Cache->Released);
+        NET_BUFFER_LIST_NEXT_NBL(Nbl) = Head;
+    } while (
+        InterlockedCompareExchangePointer((VOID *volatile *)&Cache->Released, Nbl, Head) !=
+            Head);
+
+    return Count;
+}
+
+#endif // NDIS_SUPPORT_NDIS6
+
+EXTERN_C_END
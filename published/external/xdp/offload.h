@@ -5,6 +5,9 @@
 
 #pragma once
 
+#include <xdp/framerxmetadata.h>
+#include <xdp/frametimestamp.h>
+
 EXTERN_C_START
 
 //
@@ -70,13 +73,6 @@ typedef enum _XDP_FRAME_TX_CHECKSUM_ACTION {
     XdpFrameTxChecksumActionRequired = 1,
 } XDP_FRAME_TX_CHECKSUM_ACTION;
 
-typedef enum _XDP_FRAME_RX_CHECKSUM_EVALUATION {
-    XdpFrameRxChecksumEvaluationNotChecked = 0,
-    XdpFrameRxChecksumEvaluationSucceeded = 1,
-    XdpFrameRxChecksumEvaluationFailed = 2,
-    XdpFrameRxChecksumEvaluationInvalid = 3,
-} XDP_FRAME_RX_CHECKSUM_EVALUATION;
-
 #pragma warning(push)
 #pragma warning(default:4820) // warn if the compiler inserted padding
 
@@ -145,12 +141,4 @@ C_ASSERT(sizeof(XDP_FRAME_GRO_TIMESTAMP) == 4);
 
 #pragma warning(pop)
 
-typedef struct _XDP_FRAME_TIMESTAMP {
-    UINT64 Timestamp;
-} XDP_FRAME_TIMESTAMP;
-
-C_ASSERT(sizeof(XDP_FRAME_TIMESTAMP) == 8);
-
-#pragma warning(pop)
-
 EXTERN_C_END
@@ -35,6 +35,27 @@ typedef enum _XDP_MATCH_TYPE {
     XDP_MATCH_TCP_QUIC_FLOW_SRC_CID,
     XDP_MATCH_TCP_QUIC_FLOW_DST_CID,
     XDP_MATCH_TCP_CONTROL_DST,
+    XDP_MATCH_IPV4_DST_LPM,
+    XDP_MATCH_IPV6_DST_LPM,
+    XDP_MATCH_UDP_PORT_RANGE,
+    XDP_MATCH_IPV4_UDP_PORT_RANGE,
+    XDP_MATCH_IPV6_UDP_PORT_RANGE,
+    XDP_MATCH_IPV4_TCP_PORT_RANGE,
+    XDP_MATCH_IPV6_TCP_PORT_RANGE,
+    XDP_MATCH_VLAN_ID,
+    XDP_MATCH_CONNTRACK_TRACK,
+    XDP_MATCH_CONNTRACK_ESTABLISHED,
+    XDP_MATCH_IPV4_SRC_LPM,
+    XDP_MATCH_IPV6_SRC_LPM,
+    XDP_MATCH_IPV4_MASKED_TUPLE,
+    XDP_MATCH_IPV6_MASKED_TUPLE,
+    XDP_MATCH_TUNNEL,
+    XDP_MATCH_TUNNEL_IPV4_MASKED_TUPLE,
+    XDP_MATCH_TUNNEL_IPV6_MASKED_TUPLE,
+    XDP_MATCH_IPV4_TCP_TUPLE,
+    XDP_MATCH_IPV6_TCP_TUPLE,
+    XDP_MATCH_UDP_PAYLOAD,
+    XDP_MATCH_TCP_PAYLOAD,
 } XDP_MATCH_TYPE;
 
 typedef union _XDP_INET_ADDR {
@@ -75,13 +96,126 @@ typedef struct _XDP_IP_PORT_SET {
     XDP_PORT_SET PortSet;
 } XDP_IP_PORT_SET;
 
+typedef enum _XDP_IP_PREFIX_ACTION {
+    XDP_IP_PREFIX_ACTION_RULE,
+    XDP_IP_PREFIX_ACTION_DROP,
+    XDP_IP_PREFIX_ACTION_PASS,
+    XDP_IP_PREFIX_ACTION_SKIP,
+} XDP_IP_PREFIX_ACTION;
+
+typedef struct _XDP_IP_PREFIX {
+    XDP_INET_ADDR Address;
+    UINT8 PrefixLength;
+    XDP_IP_PREFIX_ACTION Action;
+} XDP_IP_PREFIX;
+
+#define XDP_IP_PREFIX_TABLE_MAX_PREFIXES 0x10000
+
+typedef struct _XDP_IP_PREFIX_TABLE {
+    const XDP_IP_PREFIX *Prefixes;
+    UINT32 PrefixCount;
+    VOID *Reserved;
+} XDP_IP_PREFIX_TABLE;
+
+typedef struct _XDP_PORT_RANGE {
+    UINT16 LowPort;
+    UINT16 HighPort;
+} XDP_PORT_RANGE;
+
+#define XDP_PORT_RANGE_SET_MAX_RANGES 0x10000
+
+typedef struct _XDP_PORT_RANGE_SET {
+    const XDP_PORT_RANGE *Ranges;
+    UINT32 RangeCount;
+    VOID *Reserved;
+} XDP_PORT_RANGE_SET;
+
+typedef struct _XDP_IP_PORT_RANGE_SET {
+    XDP_INET_ADDR Address;
+    XDP_PORT_RANGE_SET PortRanges;
+} XDP_IP_PORT_RANGE_SET;
+
+typedef struct _XDP_FIVE_TUPLE {
+    XDP_INET_ADDR SourceAddress;
+    XDP_INET_ADDR DestinationAddress;
+    UINT16 SourcePort;
+    UINT16 DestinationPort;
+    UINT8 Protocol;
+} XDP_FIVE_TUPLE;
+
+typedef struct _XDP_MASKED_TUPLE {
+    XDP_FIVE_TUPLE Mask;
+    XDP_FIVE_TUPLE Tuple;
+} XDP_MASKED_TUPLE;
+
+#define XDP_MASKED_TUPLE_SET_MAX_TUPLES 0x10000
+#define XDP_MASKED_TUPLE_SET_MAX_MASKS 32
+
+typedef struct _XDP_MASKED_TUPLE_SET {
+    const XDP_MASKED_TUPLE *Tuples;
+    UINT32 TupleCount;
+    VOID *Reserved;
+} XDP_MASKED_TUPLE_SET;
+
+typedef enum _XDP_TUNNEL_TYPE {
+    XDP_TUNNEL_TYPE_VXLAN,
+    XDP_TUNNEL_TYPE_GENEVE,
+} XDP_TUNNEL_TYPE;
+
+#define XDP_VXLAN_DEFAULT_UDP_PORT 4789
+#define XDP_GENEVE_DEFAULT_UDP_PORT 6081
+
+typedef struct _XDP_TUNNEL {
+    XDP_TUNNEL_TYPE Type;
+    UINT16 UdpPort;
+} XDP_TUNNEL;
+
+typedef struct _XDP_TUNNEL_TUPLE_SET {
+    XDP_TUNNEL Tunnel;
+    XDP_MASKED_TUPLE_SET TupleSet;
+} XDP_TUNNEL_TUPLE_SET;
+
+#define XDP_PAYLOAD_PATTERN_MAX_LENGTH 32
+
+typedef struct _XDP_PAYLOAD_PATTERN {
+    UINT16 Offset;
+    UINT8 Length;
+    UINT8 Value[XDP_PAYLOAD_PATTERN_MAX_LENGTH];
+    UINT8 Mask[XDP_PAYLOAD_PATTERN_MAX_LENGTH];
+} XDP_PAYLOAD_PATTERN;
+
+typedef struct _XDP_PAYLOAD_MATCH {
+    UINT16 Port;
+    const XDP_PAYLOAD_PATTERN *Pattern;
+    VOID *Reserved;
+} XDP_PAYLOAD_MATCH;
+
+#define XDP_VLAN_ID_MAX 0xFFF
+
+//
+// The connection tracking table of the rule's interface. Reserved for
+// internal use.
+//
+typedef struct _XDP_CONNTRACK {
+    VOID *Reserved;
+} XDP_CONNTRACK;
+
 typedef union _XDP_MATCH_PATTERN {
     UINT16 Port;
+    UINT16 VlanId;
     XDP_IP_ADDRESS_MASK IpMask;
     XDP_TUPLE Tuple;
     XDP_QUIC_FLOW QuicFlow;
     XDP_PORT_SET PortSet;
     XDP_IP_PORT_SET IpPortSet;
+    XDP_IP_PREFIX_TABLE PrefixTable;
+    XDP_PORT_RANGE_SET PortRanges;
+    XDP_IP_PORT_RANGE_SET IpPortRanges;
+    XDP_CONNTRACK Conntrack;
+    XDP_MASKED_TUPLE_SET TupleSet;
+    XDP_TUNNEL Tunnel;
+    XDP_TUNNEL_TUPLE_SET TunnelTupleSet;
+    XDP_PAYLOAD_MATCH Payload;
 } XDP_MATCH_PATTERN;
 
 typedef enum _XDP_RULE_ACTION {
@@ -93,17 +227,194 @@ typedef enum _XDP_RULE_ACTION {
     // Reserved.
     //
     XDP_PROGRAM_ACTION_EBPF,
+    XDP_PROGRAM_ACTION_SAMPLE,
+    XDP_PROGRAM_ACTION_POLICE,
+    XDP_PROGRAM_ACTION_DECAP_REDIRECT,
+    XDP_PROGRAM_ACTION_LOAD_BALANCE,
+    XDP_PROGRAM_ACTION_ENCAP,
+    XDP_PROGRAM_ACTION_SYN_COOKIE,
 } XDP_RULE_ACTION;
 
 typedef enum _XDP_REDIRECT_TARGET_TYPE {
     XDP_REDIRECT_TARGET_TYPE_XSK,
+    XDP_REDIRECT_TARGET_TYPE_XSK_MAP,
+    XDP_REDIRECT_TARGET_TYPE_INTERFACE_TX,
+    XDP_REDIRECT_TARGET_TYPE_XSK_FANOUT,
+    XDP_REDIRECT_TARGET_TYPE_QUIC_LB,
+    XDP_REDIRECT_TARGET_TYPE_XSK_PRIORITY,
 } XDP_REDIRECT_TARGET_TYPE;
 
+//
+// A set of XDP sockets. Frames redirected to a socket map are steered to one
+// of the sockets by a hash of their IP addresses and transport ports, so all
+// frames of a flow reach the same socket. Frames redirected to a socket fanout
+// are delivered to every socket in the set, which must be distinct.
+//
+#define XDP_XSK_MAP_MAX_SOCKETS 256
+
+typedef struct _XDP_XSK_MAP {
+    const HANDLE *Sockets;
+    UINT32 SocketCount;
+} XDP_XSK_MAP;
+
+//
+// A QUIC-LB configuration: frames redirected to it are steered to the XDP
+// socket of the server whose ID is encoded in the frame's QUIC destination
+// connection ID. Frames whose connection ID is not routable by the
+// configuration are steered like a socket map of the servers' sockets.
+//
+#define XDP_QUIC_LB_MAX_CONFIG_ID 6
+#define XDP_QUIC_LB_MAX_SERVER_ID_LENGTH 15
+#define XDP_QUIC_LB_KEY_LENGTH 16
+#define XDP_QUIC_LB_MAX_SERVERS 256
+
+//
+// Server IDs are encrypted with the configuration's key.
+//
+#define XDP_QUIC_LB_FLAG_ENCRYPTED 0x1
+
+typedef struct _XDP_QUIC_LB_SERVER {
+    UINT8 ServerId[XDP_QUIC_LB_MAX_SERVER_ID_LENGTH];
+    HANDLE Socket;
+} XDP_QUIC_LB_SERVER;
+
+typedef struct _XDP_QUIC_LB {
+    UINT32 Flags;
+    UINT8 ConfigId;
+    UINT8 ServerIdLength;
+    UINT8 NonceLength;
+    UINT8 Key[XDP_QUIC_LB_KEY_LENGTH];
+    const XDP_QUIC_LB_SERVER *Servers;
+    UINT32 ServerCount;
+} XDP_QUIC_LB;
+
+//
+// A TX queue of an XDP-capable interface. Frames redirected to an interface TX
+// queue are copied into XDP-owned buffers and transmitted in the kernel, so
+// frames can be forwarded between interfaces without reaching user mode.
+//
+typedef struct _XDP_INTERFACE_TX_TARGET {
+    UINT32 IfIndex;
+    UINT32 QueueId;
+} XDP_INTERFACE_TX_TARGET;
+
 typedef struct _XDP_REDIRECT_PARAMS {
     XDP_REDIRECT_TARGET_TYPE TargetType;
-    HANDLE Target;
+    union {
+        HANDLE Target;
+        const XDP_XSK_MAP *XskMap;
+        XDP_INTERFACE_TX_TARGET InterfaceTx;
+        const XDP_QUIC_LB *QuicLb;
+    };
 } XDP_REDIRECT_PARAMS;
 
+typedef struct _XDP_SAMPLE_PARAMS {
+    XDP_REDIRECT_TARGET_TYPE TargetType;
+    UINT32 Rate;
+    union {
+        HANDLE Target;
+        const XDP_XSK_MAP *XskMap;
+        XDP_INTERFACE_TX_TARGET InterfaceTx;
+        const XDP_QUIC_LB *QuicLb;
+    };
+} XDP_SAMPLE_PARAMS;
+
+//
+// Token bucket rate limits, enforced separately on each processor. A limit of
+// zero is not enforced. Conforming frames are redirected to the ConformTarget
+// XDP socket, or passed if ConformTarget is NULL; exceeding frames are dropped.
+//
+typedef struct _XDP_POLICE_PARAMS {
+    UINT32 PacketsPerSecond;
+    UINT32 BytesPerSecond;
+    HANDLE ConformTarget;
+} XDP_POLICE_PARAMS;
+
+//
+// Frames encapsulated in the tunnel have their outer headers stripped and are
+// redirected; other frames are passed unmodified.
+//
+typedef struct _XDP_DECAP_REDIRECT_PARAMS {
+    XDP_TUNNEL Tunnel;
+    XDP_REDIRECT_PARAMS Redirect;
+} XDP_DECAP_REDIRECT_PARAMS;
+
+//
+// A load balancer backend: the Ethernet address frames are forwarded to, and
+// the IP address substituted for the destination address of frames of the
+// same address family when the load balancer rewrites IP addresses.
+//
+typedef struct _XDP_LOAD_BALANCER_BACKEND {
+    UINT8 EthernetAddress[6];
+    XDP_INET_ADDR IpAddress;
+} XDP_LOAD_BALANCER_BACKEND;
+
+#define XDP_LOAD_BALANCER_MAX_BACKENDS 256
+
+//
+// Rewrite the destination IP address, and incrementally update the IP and
+// transport checksums, in addition to the Ethernet addresses.
+//
+#define XDP_LOAD_BALANCE_FLAG_REWRITE_IP 0x1
+
+//
+// Frames of TCP and UDP flows are forwarded out of the interface to one of the
+// backends, selected by a consistent hash of the flow's addresses and ports,
+// so all frames of a flow reach the same backend and adding or removing a
+// backend moves few flows. Other frames are passed.
+//
+typedef struct _XDP_LOAD_BALANCE_PARAMS {
+    const XDP_LOAD_BALANCER_BACKEND *Backends;
+    UINT32 BackendCount;
+    UINT32 Flags;
+    VOID *Reserved;
+} XDP_LOAD_BALANCE_PARAMS;
+
+typedef enum _XDP_ENCAP_TYPE {
+    XDP_ENCAP_TYPE_VXLAN,
+    XDP_ENCAP_TYPE_GRE,
+    XDP_ENCAP_TYPE_IP_IN_IP,
+} XDP_ENCAP_TYPE;
+
+#define XDP_ENCAP_MAX_HEADER_LENGTH 128
+
+//
+// Redirect encapsulated frames to the redirect target instead of transmitting
+// them on the interface they were received on.
+//
+#define XDP_ENCAP_FLAG_REDIRECT 0x1
+
+//
+// Frames are encapsulated in the outer header template, which is an untagged
+// Ethernet header and an IPv4 or IPv6 header followed, for VXLAN, by UDP and
+// VXLAN headers or, for GRE, by a GRE header. The outer lengths and IPv4
+// header checksum are set for each frame, and the VXLAN UDP source port and
+// IPv6 flow label are set from a hash of the inner flow. IP-in-IP and GRE
+// encapsulation replace the inner Ethernet header, unless the GRE protocol
+// type is Transparent Ethernet Bridging. Frames without enough headroom for
+// the outer headers are passed.
+//
+typedef struct _XDP_ENCAP_PARAMS {
+    XDP_ENCAP_TYPE Type;
+    UINT32 Flags;
+    const UINT8 *Header;
+    UINT32 HeaderLength;
+    XDP_REDIRECT_PARAMS Redirect;
+    VOID *Reserved;
+} XDP_ENCAP_PARAMS;
+
+//
+// TCP SYNs are answered with a SYN-ACK carrying a SYN cookie, built in place
+// and transmitted on the interface the SYN was received on. ACKs echoing a
+// valid cookie, and segments of flows in the interface's connection tracking
+// table, are passed; other TCP segments are dropped. SYNs that cannot be
+// answered in place are passed.
+//
+typedef struct _XDP_SYN_COOKIE_PARAMS {
+    UINT16 Mss;
+    VOID *Reserved;
+} XDP_SYN_COOKIE_PARAMS;
+
 typedef struct _XDP_EBPF_PARAMS {
     HANDLE Target;
 } XDP_EBPF_PARAMS;
@@ -114,6 +425,12 @@ typedef struct _XDP_RULE {
     XDP_RULE_ACTION Action;
     union {
         XDP_REDIRECT_PARAMS Redirect;
+        XDP_SAMPLE_PARAMS Sample;
+        XDP_POLICE_PARAMS Police;
+        XDP_DECAP_REDIRECT_PARAMS DecapRedirect;
+        XDP_LOAD_BALANCE_PARAMS LoadBalance;
+        XDP_ENCAP_PARAMS Encap;
+        XDP_SYN_COOKIE_PARAMS SynCookie;
         XDP_EBPF_PARAMS Ebpf;
     };
 } XDP_RULE;
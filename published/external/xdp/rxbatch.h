@@ -0,0 +1,161 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+//
+// This file contains helpers for XDP interface drivers that produce RX frames
+// incrementally. Rather than filling the frame ring before invoking XdpReceive,
+// the driver commits each frame as it processes the frame's hardware
+// descriptor, and the helper invokes XdpReceive as soon as a sub-batch of
+// frames is ready. Committing a frame prefetches its headers, so the headers
+// are brought into cache while the driver processes the remaining descriptors
+// of the sub-batch, and inspection finds them warm.
+//
+
+EXTERN_C_START
+
+#include <xdp/buffervirtualaddress.h>
+#include <xdp/datapath.h>
+
+typedef struct _XDP_RX_BATCH {
+    XDP_RX_QUEUE_HANDLE XdpRxQueue;
+    XDP_RING *FrameRing;
+    XDP_RING *FragmentRing;
+    XDP_EXTENSION VaExtension;
+    UINT32 SubBatchSize;
+    UINT32 MaxFragments;
+
+    //
+    // The unmasked ring indexes of the first frame and first fragment buffer
+    // of the most recently inspected sub-batch. The driver completes the
+    // sub-batch's frames, starting at these indexes, after each inspection.
+    //
+    UINT32 InspectedFrameIndex;
+    UINT32 InspectedFragmentIndex;
+} XDP_RX_BATCH;
+
+//
+// Initializes a batch for an activated RX queue. A SubBatchSize of zero, or
+// larger than the frame ring, inspects frames only once the frame ring is
+// full. MaxFragments is the maximum number of fragment buffers of a frame, and
+// is ignored if FragmentRing is NULL.
+//
+inline
+VOID
+XdpRxBatchInitialize(
+    _Out_ XDP_RX_BATCH *Batch,
+    _In_ XDP_RX_QUEUE_HANDLE XdpRxQueue,
+    _In_ XDP_RING *FrameRing,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_ XDP_EXTENSION *VaExtension,
+    _In_ UINT32 SubBatchSize,
+    _In_ UINT32 MaxFragments
+    )
+{
+    RtlZeroMemory(Batch, sizeof(*Batch));
+    Batch->XdpRxQueue = XdpRxQueue;
+    Batch->FrameRing = FrameRing;
+    Batch->FragmentRing = FragmentRing;
+    Batch->VaExtension = *VaExtension;
+    Batch->SubBatchSize = FrameRing->Mask + 1;
+    Batch->MaxFragments = MaxFragments;
+
+    if (SubBatchSize > 0 && SubBatchSize < Batch->SubBatchSize) {
+        Batch->SubBatchSize = SubBatchSize;
+    }
+}
+
+//
+// Returns the frame ring element for the driver to fill. The frame's fragment
+// buffers, if any, are produced directly to the fragment ring.
+//
+inline
+XDP_FRAME *
+XdpRxBatchGetFrame(
+    _In_ XDP_RX_BATCH *Batch
+    )
+{
+    XDP_RING *FrameRing = Batch->FrameRing;
+
+    ASSERT(XdpRingFree(FrameRing) > 0);
+    return (XDP_FRAME *)XdpRingGetElement(FrameRing, FrameRing->ProducerIndex & FrameRing->Mask);
+}
+
+//
+// Inspects all committed frames. Returns the number of frames inspected, which
+// the driver must complete before committing more frames. If the interface
+// supports backpressure, frames XDP left in the frame ring remain committed
+// and are inspected again by the next call.
+//
+inline
+_IRQL_requires_max_(DISPATCH_LEVEL)
+UINT32
+XdpRxBatchInspect(
+    _Inout_ XDP_RX_BATCH *Batch
+    )
+{
+    if (XdpRingCount(Batch->FrameRing) == 0) {
+        return 0;
+    }
+
+    Batch->InspectedFrameIndex = Batch->FrameRing->ConsumerIndex;
+    if (Batch->FragmentRing != NULL) {
+        Batch->InspectedFragmentIndex = Batch->FragmentRing->ConsumerIndex;
+    }
+
+    XdpReceive(Batch->XdpRxQueue);
+
+    return Batch->FrameRing->ConsumerIndex - Batch->InspectedFrameIndex;
+}
+
+//
+// Returns whether the rings can hold another frame. Under backpressure, XDP
+// leaves frames in the rings, and the driver stops committing frames until
+// they are consumed.
+//
+inline
+BOOLEAN
+XdpRxBatchCanCommitFrame(
+    _In_ XDP_RX_BATCH *Batch
+    )
+{
+    return
+        XdpRingFree(Batch->FrameRing) > 0 &&
+        (Batch->FragmentRing == NULL || XdpRingFree(Batch->FragmentRing) >= Batch->MaxFragments);
+}
+
+//
+// Commits the frame returned by XdpRxBatchGetFrame and prefetches its headers.
+// If a sub-batch is ready, or the rings cannot hold another frame, inspects
+// all committed frames. Returns the number of frames inspected, which the
+// driver must complete before committing more frames.
+//
+inline
+_IRQL_requires_max_(DISPATCH_LEVEL)
+UINT32
+XdpRxBatchCommitFrame(
+    _Inout_ XDP_RX_BATCH *Batch
+    )
+{
+    XDP_RING *FrameRing = Batch->FrameRing;
+    XDP_FRAME *Frame =
+        (XDP_FRAME *)XdpRingGetElement(FrameRing, FrameRing->ProducerIndex & FrameRing->Mask);
+    XDP_BUFFER_VIRTUAL_ADDRESS *Va =
+        XdpGetVirtualAddressExtension(&Frame->Buffer, &Batch->VaExtension);
+
+    PreFetchCacheLine(PF_TEMPORAL_LEVEL_1, Va->VirtualAddress + Frame->Buffer.DataOffset);
+    FrameRing->ProducerIndex++;
+
+    if (XdpRingCount(FrameRing) >= Batch->SubBatchSize ||
+        (Batch->FragmentRing != NULL &&
+            XdpRingFree(Batch->FragmentRing) < Batch->MaxFragments)) {
+        return XdpRxBatchInspect(Batch);
+    }
+
+    return 0;
+}
+
+EXTERN_C_END
@@ -9,6 +9,7 @@ EXTERN_C_START
 
 #include <xdp/extension.h>
 #include <xdp/extensioninfo.h>
+#include <xdp/hookid.h>
 #include <xdp/pollinfo.h>
 #include <xdp/queueinfo.h>
 #include <xdp/objectheader.h>
@@ -21,18 +22,77 @@ XdpRxQueueGetTargetQueueInfo(
     _In_ XDP_RX_QUEUE_CONFIG_CREATE RxQueueConfig
     );
 
+//
+// Returns the hook the queue is created for, or NULL if XDP predates this
+// routine, in which case the hook is L2 RX inspect.
+//
+// Interfaces that set TxInspectSupported in their XDP_CAPABILITIES_EX also
+// receive RX queues for the L2 TX inspect hook. The data path of a TX inspect
+// queue is identical to that of an RX queue, except that the interface
+// presents outgoing frames, in the order the protocol stack sent them, before
+// posting them to the hardware TX ring. The interface produces a batch of
+// frames into the frame ring, invokes XdpReceive once for the entire batch,
+// and then applies each frame's XDP_FRAME_RX_ACTION: XDP_RX_ACTION_PASS posts
+// the frame to the hardware, XDP_RX_ACTION_DROP completes the frame to the
+// protocol stack without posting it, and, if the interface sets
+// TxActionSupported, XDP_RX_ACTION_TX returns the frame to the local receive
+// path. Frames redirected to XDP sockets are copied by XDP, so the interface
+// completes them to the protocol stack as if they were dropped.
+//
+CONST XDP_HOOK_ID *
+XdpRxQueueGetHookId(
+    _In_ XDP_RX_QUEUE_CONFIG_CREATE RxQueueConfig
+    );
+
 typedef struct _XDP_RX_CAPABILITIES {
     XDP_OBJECT_HEADER Header;
     BOOLEAN VirtualAddressSupported;
     UINT16 ReceiveFrameCountHint;
     UINT8 MaximumFragments;
     BOOLEAN TxActionSupported;
+
+    //
+    // The processor the interface expects to service this queue's data path.
+    // If valid, XDP allocates the queue's data path memory on the processor's
+    // NUMA node.
+    //
+    BOOLEAN IdealProcessorValid;
+    PROCESSOR_NUMBER IdealProcessor;
+
+    //
+    // The interface splits the headers of each multi-buffer frame from its
+    // payload: the first buffer holds only the protocol headers, and the
+    // payload begins in the first fragment buffer. XDP sockets use the split
+    // to deliver headers and payload in separate UMEM chunks.
+    //
+    BOOLEAN HeaderSplit;
+
+    //
+    // The interface tolerates XdpReceive returning with frames left in the
+    // frame ring. XDP leaves frames in the ring only while an XDP socket with
+    // XSK_SOCKOPT_RX_BACKPRESSURE is the queue's exclusive receiver and has no
+    // space for them. The interface keeps the frames, and their hardware
+    // descriptors, in the ring until a later XdpReceive consumes them, so the
+    // hardware RX ring fills and further frames are dropped by the hardware.
+    // The interface invokes XdpReceive again on its next poll, or when
+    // notified with XDP_NOTIFY_QUEUE_FLAG_RX.
+    //
+    BOOLEAN BackpressureSupported;
 } XDP_RX_CAPABILITIES;
 
 #define XDP_RX_CAPABILITIES_REVISION_1 1
+#define XDP_RX_CAPABILITIES_REVISION_2 2
+#define XDP_RX_CAPABILITIES_REVISION_3 3
+#define XDP_RX_CAPABILITIES_REVISION_4 4
 
 #define XDP_SIZEOF_RX_CAPABILITIES_REVISION_1 \
     RTL_SIZEOF_THROUGH_FIELD(XDP_RX_CAPABILITIES, TxActionSupported)
+#define XDP_SIZEOF_RX_CAPABILITIES_REVISION_2 \
+    RTL_SIZEOF_THROUGH_FIELD(XDP_RX_CAPABILITIES, IdealProcessor)
+#define XDP_SIZEOF_RX_CAPABILITIES_REVISION_3 \
+    RTL_SIZEOF_THROUGH_FIELD(XDP_RX_CAPABILITIES, HeaderSplit)
+#define XDP_SIZEOF_RX_CAPABILITIES_REVISION_4 \
+    RTL_SIZEOF_THROUGH_FIELD(XDP_RX_CAPABILITIES, BackpressureSupported)
 
 inline
 VOID
@@ -41,8 +101,8 @@ XdpInitializeRxCapabilitiesDriverVa(
     )
 {
     RtlZeroMemory(Capabilities, sizeof(*Capabilities));
-    Capabilities->Header.Revision = XDP_RX_CAPABILITIES_REVISION_1;
-    Capabilities->Header.Size = XDP_SIZEOF_RX_CAPABILITIES_REVISION_1;
+    Capabilities->Header.Revision = XDP_RX_CAPABILITIES_REVISION_4;
+    Capabilities->Header.Size = XDP_SIZEOF_RX_CAPABILITIES_REVISION_4;
     Capabilities->VirtualAddressSupported = TRUE;
 }
 
@@ -32,13 +32,24 @@ typedef struct _XDP_TX_CAPABILITIES {
     UINT32 MaximumFrameSize;
     UINT8 MaximumFragments;
     BOOLEAN OutOfOrderCompletionEnabled;
+
+    //
+    // The processor the interface expects to service this queue's data path.
+    // If valid, XDP allocates the queue's data path memory on the processor's
+    // NUMA node.
+    //
+    BOOLEAN IdealProcessorValid;
+    PROCESSOR_NUMBER IdealProcessor;
 } XDP_TX_CAPABILITIES;
 
 
 #define XDP_TX_CAPABILITIES_REVISION_1 1
+#define XDP_TX_CAPABILITIES_REVISION_2 2
 
 #define XDP_SIZEOF_TX_CAPABILITIES_REVISION_1 \
     RTL_SIZEOF_THROUGH_FIELD(XDP_TX_CAPABILITIES, OutOfOrderCompletionEnabled)
+#define XDP_SIZEOF_TX_CAPABILITIES_REVISION_2 \
+    RTL_SIZEOF_THROUGH_FIELD(XDP_TX_CAPABILITIES, IdealProcessor)
 
 //
 // Reserved for system use.
@@ -50,8 +61,8 @@ XdpInitializeTxCapabilities(
     )
 {
     RtlZeroMemory(Capabilities, sizeof(*Capabilities));
-    Capabilities->Header.Revision = XDP_TX_CAPABILITIES_REVISION_1;
-    Capabilities->Header.Size = XDP_SIZEOF_TX_CAPABILITIES_REVISION_1;
+    Capabilities->Header.Revision = XDP_TX_CAPABILITIES_REVISION_2;
+    Capabilities->Header.Size = XDP_SIZEOF_TX_CAPABILITIES_REVISION_2;
     Capabilities->MaximumBufferSize = MAXUINT32;
     Capabilities->MaximumFrameSize = MAXUINT32;
 }
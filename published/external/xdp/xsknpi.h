@@ -0,0 +1,201 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+//
+// This file declares the kernel-mode AF_XDP client interface. Kernel drivers
+// attach to the XSK network programming interface (NPI) via NMR, and the XDP
+// driver provides a dispatch table of socket routines. Sockets are configured
+// with the same options as user mode sockets, but their rings and UMEM stay in
+// kernel address space: ring info returns system addresses, so the client
+// accesses the rings directly, e.g. via afxdp_helper.h, and notifications
+// invoke a client routine instead of completing an IRP.
+//
+
+#include <afxdp.h>
+#include <xdpapi.h>
+#include <xdp/objectheader.h>
+
+EXTERN_C_START
+
+//
+// The NPI ID clients specify in their NPI_CLIENT_CHARACTERISTICS.
+//
+CONST GUID DECLSPEC_SELECTANY XSK_KERNEL_NPI_ID = { /* 8b1b3c36-3a6f-4f4b-9a55-0f2f6d8e6c21 */
+    0x8b1b3c36,
+    0x3a6f,
+    0x4f4b,
+    {0x9a, 0x55, 0x0f, 0x2f, 0x6d, 0x8e, 0x6c, 0x21}
+};
+
+typedef struct _XSK_KERNEL_SOCKET XSK_KERNEL_SOCKET;
+
+//
+// Invoked at IRQL <= DISPATCH_LEVEL when a ring selected by the notify flags
+// transitions from empty to non-empty, with the XSK_NOTIFY_RESULT_FLAGS of
+// the ready rings. The routine may be invoked concurrently on multiple
+// processors, and must not call back into the socket's control routines.
+//
+typedef
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XSK_KERNEL_NOTIFY_ROUTINE(
+    _In_opt_ VOID *Context,
+    _In_ XSK_NOTIFY_RESULT_FLAGS Result
+    );
+
+//
+// Creates a socket. Kernel UMEM registrations must describe resident or
+// pageable system memory, which XDP locks for the lifetime of the UMEM.
+//
+typedef
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XSK_KERNEL_CREATE(
+    _Out_ XSK_KERNEL_SOCKET **Socket
+    );
+
+//
+// Closes a socket. Once this routine returns, the socket's notify routine is
+// no longer invoked.
+//
+typedef
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XSK_KERNEL_CLOSE(
+    _In_ XSK_KERNEL_SOCKET *Socket
+    );
+
+typedef
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XSK_KERNEL_BIND(
+    _In_ XSK_KERNEL_SOCKET *Socket,
+    _In_ UINT32 IfIndex,
+    _In_ UINT32 QueueId,
+    _In_ XSK_BIND_FLAGS Flags
+    );
+
+typedef
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XSK_KERNEL_ACTIVATE(
+    _In_ XSK_KERNEL_SOCKET *Socket,
+    _In_ XSK_ACTIVATE_FLAGS Flags
+    );
+
+typedef
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XSK_KERNEL_SET_SOCKOPT(
+    _In_ XSK_KERNEL_SOCKET *Socket,
+    _In_ UINT32 OptionName,
+    _In_reads_bytes_opt_(OptionLength) const VOID *OptionValue,
+    _In_ UINT32 OptionLength
+    );
+
+typedef
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XSK_KERNEL_GET_SOCKOPT(
+    _In_ XSK_KERNEL_SOCKET *Socket,
+    _In_ UINT32 OptionName,
+    _Out_writes_bytes_(*OptionLength) VOID *OptionValue,
+    _Inout_ UINT32 *OptionLength
+    );
+
+//
+// Pokes and/or waits on the socket directly, without an IO request. Unlike
+// user mode sockets, XSK_NOTIFY_FLAG_WAIT_SPIN is always permitted.
+//
+typedef
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XSK_KERNEL_NOTIFY(
+    _In_ XSK_KERNEL_SOCKET *Socket,
+    _In_ XSK_NOTIFY_FLAGS Flags,
+    _In_ UINT32 WaitTimeoutMilliseconds,
+    _Out_ XSK_NOTIFY_RESULT_FLAGS *Result
+    );
+
+//
+// Sets the routine invoked when the rings selected by Flags, a combination of
+// XSK_NOTIFY_FLAG_WAIT_RX and XSK_NOTIFY_FLAG_WAIT_TX, become non-empty. The
+// routine stays armed until cleared by setting zero flags, so the client does
+// not need to re-arm it after each notification. Rings that are already
+// non-empty are notified immediately. The socket must be active. Replacing
+// the routine does not wait for in-flight invocations of the previous one;
+// only closing the socket does.
+//
+typedef
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XSK_KERNEL_SET_NOTIFY_ROUTINE(
+    _In_ XSK_KERNEL_SOCKET *Socket,
+    _In_ XSK_NOTIFY_FLAGS Flags,
+    _In_opt_ XSK_KERNEL_NOTIFY_ROUTINE *NotifyRoutine,
+    _In_opt_ VOID *NotifyContext
+    );
+
+//
+// Returns the socket's kernel handle, which remains valid until the socket is
+// closed. The handle is used as the XSK redirect target of programs created
+// with XSK_KERNEL_CREATE_PROGRAM, and must not be closed by the client.
+//
+typedef
+HANDLE
+XSK_KERNEL_GET_HANDLE(
+    _In_ XSK_KERNEL_SOCKET *Socket
+    );
+
+//
+// Creates an XDP program, like XdpCreateProgram in user mode. Handles in the
+// rules are kernel handles. The program is detached by closing the returned
+// kernel handle with ZwClose.
+//
+typedef
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XSK_KERNEL_CREATE_PROGRAM(
+    _In_ UINT32 IfIndex,
+    _In_ const XDP_HOOK_ID *HookId,
+    _In_ UINT32 QueueId,
+    _In_ XDP_CREATE_PROGRAM_FLAGS Flags,
+    _In_reads_(RuleCount) const XDP_RULE *Rules,
+    _In_ UINT32 RuleCount,
+    _Out_ HANDLE *Program
+    );
+
+#define XSK_KERNEL_DISPATCH_REVISION_1 1
+#define XSK_KERNEL_DISPATCH_REVISION_2 2
+
+#define XSK_KERNEL_DISPATCH_REVISION_1_SIZE \
+    RTL_SIZEOF_THROUGH_FIELD(XSK_KERNEL_DISPATCH, SetNotifyRoutine)
+#define XSK_KERNEL_DISPATCH_REVISION_2_SIZE \
+    RTL_SIZEOF_THROUGH_FIELD(XSK_KERNEL_DISPATCH, CreateProgram)
+
+//
+// The provider dispatch table returned when a client attaches to the NPI.
+//
+typedef struct _XSK_KERNEL_DISPATCH {
+    XDP_OBJECT_HEADER Header;
+    XSK_KERNEL_CREATE *Create;
+    XSK_KERNEL_CLOSE *Close;
+    XSK_KERNEL_BIND *Bind;
+    XSK_KERNEL_ACTIVATE *Activate;
+    XSK_KERNEL_SET_SOCKOPT *SetSockopt;
+    XSK_KERNEL_GET_SOCKOPT *GetSockopt;
+    XSK_KERNEL_NOTIFY *Notify;
+    XSK_KERNEL_SET_NOTIFY_ROUTINE *SetNotifyRoutine;
+
+    //
+    // Revision 2.
+    //
+    XSK_KERNEL_GET_HANDLE *GetHandle;
+    XSK_KERNEL_CREATE_PROGRAM *CreateProgram;
+} XSK_KERNEL_DISPATCH;
+
+EXTERN_C_END
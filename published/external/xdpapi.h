@@ -23,6 +23,11 @@ typedef enum _XDP_CREATE_PROGRAM_FLAGS {
     XDP_CREATE_PROGRAM_FLAG_GENERIC = 0x1,
     XDP_CREATE_PROGRAM_FLAG_NATIVE = 0x2,
     XDP_CREATE_PROGRAM_FLAG_ALL_QUEUES = 0x4,
+    //
+    // Maintain per-rule hit counters, queried via the experimental
+    // XDP_PROGRAM_GET_RULE_COUNTERS_FN routine.
+    //
+    XDP_CREATE_PROGRAM_FLAG_RULE_COUNTERS = 0x8,
 } XDP_CREATE_PROGRAM_FLAGS;
 
 DEFINE_ENUM_FLAG_OPERATORS(XDP_CREATE_PROGRAM_FLAGS);
@@ -126,11 +126,20 @@ XDP_RSS_GET_CAPABILITIES_FN(
 // Upon get, indicates RSS is disabled.
 //
 #define XDP_RSS_FLAG_DISABLED              0x0008
+//
+// Upon set, indicates the hash must be symmetric, i.e. both directions of a
+// connection must map to the same queue. If XDP_RSS_FLAG_SET_HASH_SECRET_KEY
+// is also set, the hash secret key must repeat with a 16-bit period; otherwise,
+// a symmetric hash secret key is generated.
+// Upon get, indicates the hash secret key is symmetric.
+//
+#define XDP_RSS_FLAG_SYMMETRIC_HASH        0x0010
 #define XDP_RSS_VALID_FLAGS ( \
     XDP_RSS_FLAG_SET_HASH_TYPE | \
     XDP_RSS_FLAG_SET_HASH_SECRET_KEY | \
     XDP_RSS_FLAG_SET_INDIRECTION_TABLE | \
     XDP_RSS_FLAG_DISABLED | \
+    XDP_RSS_FLAG_SYMMETRIC_HASH | \
     0)
 
 typedef struct _XDP_RSS_CONFIGURATION {
@@ -219,6 +228,29 @@ XDP_RSS_GET_FN(
 
 #define XDP_RSS_GET_FN_NAME "XdpRssGetExperimental"
 
+//
+// Points the RSS indirection table entries of an XDP socket's RX queue at the
+// given processor, so the queue's receive processing runs on the same processor
+// as the application thread servicing the socket. The queue's entries are those
+// targeting the processor reported by XSK_SOCKOPT_RX_PROCESSOR_AFFINITY, so the
+// socket must be active and have received frames; otherwise,
+// HRESULT_FROM_WIN32(ERROR_NOT_READY) is returned. If no entries target that
+// processor, HRESULT_FROM_WIN32(ERROR_NOT_FOUND) is returned. The update applies
+// to both native and generic XDP, and, like XDP_RSS_SET_FN, remains in effect
+// until the interface handle is closed. Once frames are processed on the new
+// processor, the socket's RX ring indicates an affinity change. If another
+// queue already targets the processor, the queues' entries are merged.
+//
+typedef
+HRESULT
+XDP_RSS_SET_QUEUE_PROCESSOR_FN(
+    _In_ HANDLE InterfaceHandle,
+    _In_ HANDLE Socket,
+    _In_ const PROCESSOR_NUMBER *Processor
+    );
+
+#define XDP_RSS_SET_QUEUE_PROCESSOR_FN_NAME "XdpRssSetQueueProcessorExperimental"
+
 typedef enum _XDP_QUIC_OPERATION {
     XDP_QUIC_OPERATION_ADD,     // Add (or modify) a QUIC connection offload
     XDP_QUIC_OPERATION_REMOVE,  // Remove a QUIC connection offload
@@ -300,6 +332,598 @@ XDP_QEO_SET_FN(
 
 #define XDP_QEO_SET_FN_NAME "XdpQeoSetExperimental"
 
+//
+// Flow steering offload.
+//
+
+typedef enum _XDP_FLOW_STEERING_OPERATION {
+    XDP_FLOW_STEERING_OPERATION_ADD,    // Add a flow steering filter
+    XDP_FLOW_STEERING_OPERATION_REMOVE, // Remove a flow steering filter
+} XDP_FLOW_STEERING_OPERATION;
+
+typedef enum _XDP_FLOW_STEERING_ADDRESS_FAMILY {
+    XDP_FLOW_STEERING_ADDRESS_FAMILY_INET4,
+    XDP_FLOW_STEERING_ADDRESS_FAMILY_INET6,
+} XDP_FLOW_STEERING_ADDRESS_FAMILY;
+
+typedef enum _XDP_FLOW_STEERING_PROTOCOL {
+    XDP_FLOW_STEERING_PROTOCOL_UDP,
+    XDP_FLOW_STEERING_PROTOCOL_TCP,
+} XDP_FLOW_STEERING_PROTOCOL;
+
+//
+// Dedicated receive queues are generic mode queues outside the RSS indirection
+// table: the interface indicates no frames to them except those steered by
+// flow steering filters, so an XDP socket bound to a dedicated queue receives
+// only its steered flows and does not contend with RSS traffic. Steered frames
+// that XDP programs do not consume are passed to the network stack. Dedicated
+// queue IDs are XDP_DEDICATED_QUEUE_ID_BASE through
+// XDP_DEDICATED_QUEUE_ID_BASE + XDP_DEDICATED_QUEUE_COUNT - 1, and are valid
+// only with XDP_GENERIC sockets and programs.
+//
+#define XDP_DEDICATED_QUEUE_ID_BASE 0x80000000
+#define XDP_DEDICATED_QUEUE_COUNT 8
+
+//
+// Steers received frames matching a transport tuple to a receive queue. The
+// destination address and port must be specified; a zero source address or
+// source port matches any source. Addresses and ports are in network byte
+// order. Filters are identified by their tuple: an add fails if a filter with
+// the same tuple exists, and a remove ignores the QueueId.
+//
+typedef struct _XDP_FLOW_STEERING_FILTER {
+    XDP_OBJECT_HEADER Header;
+    XDP_FLOW_STEERING_OPERATION Operation;
+    XDP_FLOW_STEERING_ADDRESS_FAMILY AddressFamily;
+    XDP_FLOW_STEERING_PROTOCOL Protocol;
+    UINT16 SourcePort;
+    UINT16 DestinationPort;
+    UINT8 SourceAddress[16];
+    UINT8 DestinationAddress[16];
+    UINT32 QueueId;         // The RSS or dedicated queue the flow is steered to.
+    HRESULT Status;         // The result of trying to offload this filter.
+} XDP_FLOW_STEERING_FILTER;
+
+#define XDP_FLOW_STEERING_FILTER_REVISION_1 1
+
+#define XDP_SIZEOF_FLOW_STEERING_FILTER_REVISION_1 \
+    RTL_SIZEOF_THROUGH_FIELD(XDP_FLOW_STEERING_FILTER, Status)
+
+//
+// Initializes a flow steering filter object.
+//
+inline
+VOID
+XdpInitializeFlowSteeringFilter(
+    _Out_writes_bytes_(FlowSteeringFilterSize) XDP_FLOW_STEERING_FILTER *FlowSteeringFilter,
+    _In_ UINT32 FlowSteeringFilterSize
+    )
+{
+    RtlZeroMemory(FlowSteeringFilter, FlowSteeringFilterSize);
+    FlowSteeringFilter->Header.Revision = XDP_FLOW_STEERING_FILTER_REVISION_1;
+    FlowSteeringFilter->Header.Size = XDP_SIZEOF_FLOW_STEERING_FILTER_REVISION_1;
+}
+
+//
+// Add or remove flow steering filters on an interface. The Status of each
+// filter is set upon return. Configured filters will remain valid until the
+// handle is closed. Upon handle closure, the handle's filters are removed.
+//
+// Interfaces without hardware flow steering emulate it in generic mode by
+// overriding the RSS queue of matching frames before XDP inspection.
+//
+typedef
+HRESULT
+XDP_FLOW_STEERING_SET_FN(
+    _In_ HANDLE InterfaceHandle,
+    _Inout_ XDP_FLOW_STEERING_FILTER *FlowSteeringFilters,
+    _In_ UINT32 FlowSteeringFiltersSize
+    );
+
+#define XDP_FLOW_STEERING_SET_FN_NAME "XdpFlowSteeringSetExperimental"
+
+//
+// Query the flow steering filters added via an interface handle. If the input
+// FlowSteeringFiltersSize is too small, HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER)
+// will be returned. Call with a NULL FlowSteeringFilters to get the length.
+//
+typedef
+HRESULT
+XDP_FLOW_STEERING_GET_FN(
+    _In_ HANDLE InterfaceHandle,
+    _Out_writes_bytes_opt_(*FlowSteeringFiltersSize) XDP_FLOW_STEERING_FILTER *FlowSteeringFilters,
+    _Inout_ UINT32 *FlowSteeringFiltersSize
+    );
+
+#define XDP_FLOW_STEERING_GET_FN_NAME "XdpFlowSteeringGetExperimental"
+
+//
+// Atomically update the rules of an XDP program. DeleteRuleCount rules starting
+// at RuleIndex are removed and replaced with the InsertRuleCount rules in
+// Rules; either count may be zero. Only the inserted rules are validated, and
+// each RX queue the program is attached to switches from the old rules to the
+// new rules without pausing its data path. Updates that would leave a program
+// without rules, or that target an eBPF program, are rejected.
+//
+typedef
+HRESULT
+XDP_PROGRAM_UPDATE_RULES_FN(
+    _In_ HANDLE ProgramHandle,
+    _In_ UINT32 RuleIndex,
+    _In_ UINT32 DeleteRuleCount,
+    _In_reads_opt_(InsertRuleCount) const XDP_RULE *Rules,
+    _In_ UINT32 InsertRuleCount
+    );
+
+#define XDP_PROGRAM_UPDATE_RULES_FN_NAME "XdpProgramUpdateRulesExperimental"
+
+typedef struct _XDP_RULE_COUNTERS {
+    //
+    // Number of frames matched by the rule.
+    //
+    UINT64 Hits;
+
+    //
+    // Interrupt time, in 100-nanosecond units, of the most recent match, or 0
+    // if the rule has never matched. Comparable with QueryInterruptTime.
+    //
+    UINT64 LastHitTime;
+
+    //
+    // Number of frames the interface dropped on behalf of the rule before
+    // inspection, since the rule was last offloaded. These frames are not
+    // counted in Hits. Only leading drop rules of all-queues programs are
+    // offloaded.
+    //
+    UINT64 OffloadedHits;
+} XDP_RULE_COUNTERS;
+
+//
+// Query the per-rule counters of a program created with
+// XDP_CREATE_PROGRAM_FLAG_RULE_COUNTERS. One XDP_RULE_COUNTERS element is
+// returned per rule, in rule order; counters of rules retained by
+// XDP_PROGRAM_UPDATE_RULES_FN are preserved. If the input RuleCountersSize is
+// too small, HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER) will be returned.
+// Call with a NULL RuleCounters to get the length.
+//
+typedef
+HRESULT
+XDP_PROGRAM_GET_RULE_COUNTERS_FN(
+    _In_ HANDLE ProgramHandle,
+    _Out_writes_bytes_opt_(*RuleCountersSize) XDP_RULE_COUNTERS *RuleCounters,
+    _Inout_ UINT32 *RuleCountersSize
+    );
+
+#define XDP_PROGRAM_GET_RULE_COUNTERS_FN_NAME "XdpProgramGetRuleCountersExperimental"
+
+//
+// Multi-socket notification.
+//
+
+//
+// The maximum number of sockets in a single XSK_NOTIFY_SOCKETS_FN call.
+//
+#define XSK_NOTIFY_SOCKETS_MAXIMUM 64
+
+typedef struct _XSK_NOTIFY_SOCKET_ENTRY {
+    //
+    // The AF_XDP socket. Each socket may appear at most once per call.
+    //
+    HANDLE Socket;
+
+    //
+    // The notification flags for this socket, with the same semantics as
+    // XSK_NOTIFY_SOCKET_FN.
+    //
+    XSK_NOTIFY_FLAGS Flags;
+
+    //
+    // Set on return to the socket's ready IO.
+    //
+    XSK_NOTIFY_RESULT_FLAGS Result;
+} XSK_NOTIFY_SOCKET_ENTRY;
+
+//
+// Pokes and/or waits on a set of AF_XDP sockets in a single call. Each socket's
+// pokes are performed, then, if any socket requested a wait and no requested
+// IO is ready, waits until requested IO is ready on any socket or the timeout
+// expires. On success, the Result of every entry is set and ReadyCount is the
+// number of entries with a nonzero Result. If the wait times out,
+// HRESULT_FROM_WIN32(ERROR_TIMEOUT) is returned. Each socket may have only one
+// wait active at a time, including waits via XSK_NOTIFY_SOCKET_FN and
+// XSK_NOTIFY_ASYNC_FN.
+//
+typedef
+HRESULT
+XSK_NOTIFY_SOCKETS_FN(
+    _Inout_updates_(SocketCount) XSK_NOTIFY_SOCKET_ENTRY *Sockets,
+    _In_ UINT32 SocketCount,
+    _In_ UINT32 WaitTimeoutMilliseconds,
+    _Out_ UINT32 *ReadyCount
+    );
+
+#define XSK_NOTIFY_SOCKETS_FN_NAME "XskNotifySocketsExperimental"
+
+//
+// Vectored socket options.
+//
+
+//
+// The maximum number of options in a single XSK_SOCKOPTS_FN call.
+//
+#define XSK_SOCKOPTS_MAXIMUM 64
+
+typedef enum _XSK_SOCKOPT_ENTRY_FLAGS {
+    XSK_SOCKOPT_ENTRY_FLAG_NONE = 0x0,
+
+    //
+    // Get the option, as if by XSK_GET_SOCKOPT_FN. Otherwise, the option is
+    // set, as if by XSK_SET_SOCKOPT_FN.
+    //
+    XSK_SOCKOPT_ENTRY_FLAG_GET = 0x1,
+} XSK_SOCKOPT_ENTRY_FLAGS;
+
+DEFINE_ENUM_FLAG_OPERATORS(XSK_SOCKOPT_ENTRY_FLAGS)
+C_ASSERT(sizeof(XSK_SOCKOPT_ENTRY_FLAGS) == sizeof(UINT32));
+
+typedef struct _XSK_SOCKOPT_ENTRY {
+    //
+    // One of the XSK_SOCKOPT_* option names.
+    //
+    UINT32 OptionName;
+
+    XSK_SOCKOPT_ENTRY_FLAGS Flags;
+
+    //
+    // The option value buffer: read for set options, written for get options.
+    //
+    VOID *OptionValue;
+
+    //
+    // The length of the option value buffer. For get options, set on return to
+    // the number of bytes written.
+    //
+    UINT32 OptionLength;
+} XSK_SOCKOPT_ENTRY;
+
+//
+// Sets and/or gets a list of options on an AF_XDP socket in a single call.
+// Options are processed in order, with the same semantics as the individual
+// XSK_SET_SOCKOPT_FN and XSK_GET_SOCKOPT_FN calls, and processing stops at the
+// first option that fails; options already set are not rolled back. On return,
+// CompletedCount is the number of options successfully processed, and on
+// failure the returned HRESULT is that of option Options[*CompletedCount].
+//
+typedef
+HRESULT
+XSK_SOCKOPTS_FN(
+    _In_ HANDLE Socket,
+    _Inout_updates_(OptionCount) XSK_SOCKOPT_ENTRY *Options,
+    _In_ UINT32 OptionCount,
+    _Out_ UINT32 *CompletedCount
+    );
+
+#define XSK_SOCKOPTS_FN_NAME "XskSockoptsExperimental"
+
+//
+// Datapath flight recorder.
+//
+// XDP records a compact binary event for each RX and TX data path batch into a
+// per-processor in-memory ring. The rings are always on unless disabled via
+// the XdpFlightRecorderSize registry value, and are included in kernel crash
+// dumps as secondary dump data.
+//
+
+typedef enum _XDP_FLIGHT_RECORD_EVENT {
+    //
+    // An RX queue completed a batch. ProducerIndex and ConsumerIndex are the RX
+    // frame ring indices before the batch is returned to the interface, and
+    // Count is the number of frames in the batch.
+    //
+    XDP_FLIGHT_RECORD_EVENT_RX_BATCH = 1,
+
+    //
+    // An RX queue dropped Count frames. Action is the drop reason, with the
+    // same values as the RxDrop ETW event.
+    //
+    XDP_FLIGHT_RECORD_EVENT_RX_DROP = 2,
+
+    //
+    // A TX queue flushed its completions and filled its frame ring.
+    // ProducerIndex and ConsumerIndex are the TX frame ring indices after the
+    // fill, and Count is the number of frames filled.
+    //
+    XDP_FLIGHT_RECORD_EVENT_TX_FLUSH = 3,
+} XDP_FLIGHT_RECORD_EVENT;
+
+typedef struct _XDP_FLIGHT_RECORD {
+    //
+    // The performance counter value when the event was recorded. Comparable
+    // with QueryPerformanceCounter and ETW event timestamps.
+    //
+    UINT64 Timestamp;
+    UINT32 IfIndex;
+    UINT32 QueueId;
+    UINT32 ProducerIndex;
+    UINT32 ConsumerIndex;
+    UINT32 Count;
+    UINT16 Processor;
+
+    //
+    // An XDP_FLIGHT_RECORD_EVENT value.
+    //
+    UINT8 Event;
+    UINT8 Action;
+} XDP_FLIGHT_RECORD;
+
+//
+// Query the flight recorder events of an interface. Events are returned
+// oldest first within each processor, and processors are returned in order.
+// Call with a NULL FlightRecords to get the maximum length; the returned
+// length is updated to the number of bytes written. If the input
+// FlightRecordsSize is too small, HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER)
+// will be returned.
+//
+typedef
+HRESULT
+XDP_FLIGHT_RECORDER_GET_FN(
+    _In_ HANDLE InterfaceHandle,
+    _Out_writes_bytes_opt_(*FlightRecordsSize) XDP_FLIGHT_RECORD *FlightRecords,
+    _Inout_ UINT32 *FlightRecordsSize
+    );
+
+#define XDP_FLIGHT_RECORDER_GET_FN_NAME "XdpFlightRecorderGetExperimental"
+
+//
+// The flight recorder is written to crash dumps as secondary dump data tagged
+// with GUID {d109fbcd-dd47-4cbc-b6e9-f7179198a5b3}. The data starts with an
+// XDP_FLIGHT_RECORDER_DUMP_HEADER, followed by one block of ProcessorStride
+// bytes per processor. Each block starts with the UINT32 index of the next
+// record to be written, followed at RecordOffset by RecordCount records. If
+// the dump space is limited, the data may contain fewer than ProcessorCount
+// blocks.
+//
+#define XDP_FLIGHT_RECORDER_DUMP_SIGNATURE 'rFdX'
+
+typedef struct _XDP_FLIGHT_RECORDER_DUMP_HEADER {
+    UINT32 Signature;
+    UINT32 HeaderSize;
+    UINT32 RecordSize;
+    UINT32 RecordOffset;
+    UINT32 RecordCount;
+    UINT32 ProcessorCount;
+    UINT32 ProcessorStride;
+} XDP_FLIGHT_RECORDER_DUMP_HEADER;
+
+//
+// Runtime tuning.
+//
+// Tuning parameters adjust the generic (NDIS LWF) data path of an interface
+// without restarting its queues. Settings apply to the interface's existing
+// queues at their next poll and to queues created afterwards, and remain in
+// effect until the interface is detached; they are not reverted when the
+// handle is closed. Unset parameters use the registry-configured defaults.
+//
+
+typedef enum _XDP_TUNING_PARAMETER {
+    //
+    // The maximum number of cloned NBLs each generic RX queue caches for
+    // frames forwarded with XDP_RX_ACTION_TX. Valid values are 0 to 4096.
+    //
+    XDP_TUNING_PARAMETER_GENERIC_RX_CLONE_CACHE_LIMIT = 1,
+
+    //
+    // The maximum number of frames processed by each generic execution context
+    // poll. Valid values are 1 to 65536.
+    //
+    XDP_TUNING_PARAMETER_GENERIC_EC_BUDGET = 2,
+
+    //
+    // The maximum number of frames inspected per batch by generic TX
+    // inspection workers. Valid values are 1 to 1024.
+    //
+    XDP_TUNING_PARAMETER_GENERIC_TX_INSPECT_BATCH_SIZE = 3,
+} XDP_TUNING_PARAMETER;
+
+typedef struct _XDP_TUNING_SETTING {
+    XDP_TUNING_PARAMETER Parameter;
+    UINT32 Value;
+} XDP_TUNING_SETTING;
+
+//
+// Apply tuning settings to an interface. Settings are validated before any is
+// applied, so either all settings are applied or none are.
+//
+typedef
+HRESULT
+XDP_INTERFACE_SET_TUNING_FN(
+    _In_ HANDLE InterfaceHandle,
+    _In_reads_(SettingCount) const XDP_TUNING_SETTING *Settings,
+    _In_ UINT32 SettingCount
+    );
+
+#define XDP_INTERFACE_SET_TUNING_FN_NAME "XdpInterfaceSetTuningExperimental"
+
+//
+// Teamed interfaces.
+//
+// The members of a team, such as an LBFO team, are the interfaces directly
+// below the team interface in the interface stack. An interface without lower
+// interfaces is treated as a team with itself as the only member, so the same
+// code path serves teamed and standalone interfaces.
+//
+
+typedef struct _XDP_TEAM_QUEUE {
+    //
+    // The interface index of the team member owning the queue.
+    //
+    UINT32 IfIndex;
+
+    //
+    // The queue ID on the team member.
+    //
+    UINT32 QueueId;
+} XDP_TEAM_QUEUE;
+
+//
+// Enumerate the queues of a team as a single logical interface. Each member
+// contributes one queue per RSS queue, or a single queue if the member does not
+// report RSS capabilities, and members are enumerated in interface index order.
+// The array index of each queue is its logical queue ID, which remains stable
+// until the team membership or a member's queue count changes. To bind an XDP
+// socket to a logical queue, pass the queue's IfIndex and QueueId to XskBind.
+//
+// Call with a NULL Queues to get the queue count. If the input QueueCount is
+// too small, HRESULT_FROM_WIN32(ERROR_MORE_DATA) is returned and QueueCount is
+// set to the required count.
+//
+typedef
+HRESULT
+XDP_TEAM_GET_QUEUES_FN(
+    _In_ UINT32 TeamIfIndex,
+    _Out_writes_opt_(*QueueCount) XDP_TEAM_QUEUE *Queues,
+    _Inout_ UINT32 *QueueCount
+    );
+
+#define XDP_TEAM_GET_QUEUES_FN_NAME "XdpTeamGetQueuesExperimental"
+
+//
+// Create a program inspecting every queue of a team: one program is created on
+// each member with XDP_CREATE_PROGRAM_FLAG_ALL_QUEUES, so queues a member adds
+// later are inspected too. Every member program uses the same rules, so rules
+// targeting objects bound to a single queue, such as XDP sockets, should
+// instead be applied with XdpCreateProgram on the queues returned by
+// XDP_TEAM_GET_QUEUES_FN. Either all member programs are created or none are.
+//
+// Call with a NULL Programs to get the member count. If the input ProgramCount
+// is too small, HRESULT_FROM_WIN32(ERROR_MORE_DATA) is returned and
+// ProgramCount is set to the required count. Each program handle must be
+// closed with CloseHandle.
+//
+typedef
+HRESULT
+XDP_TEAM_CREATE_PROGRAM_FN(
+    _In_ UINT32 TeamIfIndex,
+    _In_ const XDP_HOOK_ID *HookId,
+    _In_ XDP_CREATE_PROGRAM_FLAGS Flags,
+    _In_reads_(RuleCount) const XDP_RULE *Rules,
+    _In_ UINT32 RuleCount,
+    _Out_writes_opt_(*ProgramCount) HANDLE *Programs,
+    _Inout_ UINT32 *ProgramCount
+    );
+
+#define XDP_TEAM_CREATE_PROGRAM_FN_NAME "XdpTeamCreateProgramExperimental"
+
+//
+// Persisted programs.
+//
+// A persisted program is stored in the XDP service's registry parameters and
+// is created by XDP itself each time its interface is added, e.g. at boot or
+// when the adapter restarts, so it filters frames before any application
+// starts and regardless of application restarts. A persisted program is
+// attached to all queues of its interface, as if created with
+// XDP_CREATE_PROGRAM_FLAG_ALL_QUEUES, and applies after programs previously
+// attached to the same queues.
+//
+// Only rules with drop or pass actions, and matches whose patterns do not
+// reference additional memory, may be persisted. Changes take effect the next
+// time the interface is added. Persisted programs failing validation or
+// attachment are skipped and traced by XDP.
+//
+
+#define XDP_PERSISTED_PROGRAMS_KEY \
+    L"System\\CurrentControlSet\\Services\\Xdp\\Parameters\\Programs"
+
+#define XDP_PERSISTED_PROGRAM_VERSION 1
+
+//
+// Each value of XDP_PERSISTED_PROGRAMS_KEY is a REG_BINARY persisted program:
+// this header followed by RuleCount XDP_RULE elements. The value name is chosen
+// by the application.
+//
+typedef struct _XDP_PERSISTED_PROGRAM {
+    UINT32 Version;
+    UINT32 IfIndex;
+    XDP_HOOK_ID HookId;
+    XDP_CREATE_PROGRAM_FLAGS Flags;
+    UINT32 RuleCount;
+    UINT32 Reserved;
+} XDP_PERSISTED_PROGRAM;
+
+//
+// Persist a program under the given value name, replacing any persisted
+// program of the same name. Flags may only include
+// XDP_CREATE_PROGRAM_FLAG_GENERIC, XDP_CREATE_PROGRAM_FLAG_NATIVE and
+// XDP_CREATE_PROGRAM_FLAG_RULE_COUNTERS. Requires administrator privileges.
+//
+typedef
+HRESULT
+XDP_PERSIST_PROGRAM_FN(
+    _In_z_ const WCHAR *Name,
+    _In_ UINT32 IfIndex,
+    _In_ const XDP_HOOK_ID *HookId,
+    _In_ XDP_CREATE_PROGRAM_FLAGS Flags,
+    _In_reads_(RuleCount) const XDP_RULE *Rules,
+    _In_ UINT32 RuleCount
+    );
+
+#define XDP_PERSIST_PROGRAM_FN_NAME "XdpPersistProgramExperimental"
+
+//
+// Delete a persisted program. Programs already created from it remain attached
+// until the interface is next added.
+//
+typedef
+HRESULT
+XDP_DELETE_PERSISTED_PROGRAM_FN(
+    _In_z_ const WCHAR *Name
+    );
+
+#define XDP_DELETE_PERSISTED_PROGRAM_FN_NAME "XdpDeletePersistedProgramExperimental"
+
+//
+// eBPF program attach parameters.
+//
+// By default, eBPF XDP programs are attached to the L2 RX inspect hook and the
+// attach parameters consist of only a UINT32 interface index. To attach to a
+// different hook, provide an XDP_EBPF_ATTACH_PARAMS structure as the attach
+// parameters instead. Only the L2 RX and L2 TX inspect hooks are supported.
+//
+// If PrefilterMatch is not XDP_MATCH_ALL, the eBPF program is invoked only for
+// frames matching the native PrefilterMatch and PrefilterPattern; all other
+// frames are passed without invoking the program. Prefilter match types whose
+// patterns reference additional memory, such as port sets, port ranges and
+// prefix tables, are not supported.
+//
+typedef struct _XDP_EBPF_ATTACH_PARAMS {
+    UINT32 IfIndex;
+    XDP_HOOK_ID HookId;
+    UINT32 Flags;
+    XDP_MATCH_TYPE PrefilterMatch;
+    XDP_MATCH_PATTERN PrefilterPattern;
+} XDP_EBPF_ATTACH_PARAMS;
+
+//
+// Cache the program's XDP_PASS and XDP_DROP verdicts per TCP or UDP flow on
+// each RX queue, and skip invoking the program for subsequent frames of a
+// cached flow. The cache is invalidated when the programs or eBPF sockets
+// bound to the RX queue change, but not when the program's own maps are
+// updated; this flag may only be set if the program's verdicts depend solely
+// on the flow's 5-tuple and the program does not modify frames it passes.
+// Verdicts are not cached for programs with a prefilter.
+//
+#define XDP_EBPF_ATTACH_FLAG_FLOW_VERDICT_CACHE 0x00000001
+
+//
+// Replace the eBPF program attached to the interface hook instead of failing
+// to attach. Every RX queue switches from the attached program to this program
+// in a single program swap, so no frames are passed without inspection while
+// the program is replaced. The replaced program's link remains attached, but
+// no longer inspects any frames, until it is detached. Detaching this
+// program's link detaches the eBPF program from the hook.
+//
+#define XDP_EBPF_ATTACH_FLAG_REPLACE 0x00000002
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -20,17 +20,24 @@
 #include <xdp/driverapi.h>
 #include <xdp/extension.h>
 #include <xdp/extensioninfo.h>
+#include <xdp/framechecksum.h>
 #include <xdp/framefragment.h>
+#include <xdp/framegso.h>
 #include <xdp/frameinterfacecontext.h>
+#include <xdp/framelayout.h>
 #include <xdp/framerxaction.h>
+#include <xdp/framerxmetadata.h>
+#include <xdp/frametimestamp.h>
 #include <xdp/guid.h>
 #include <xdp/interfaceconfig.h>
 #include <xdp/ndis6.h>
 #include <xdp/ndis6poll.h>
+#include <xdp/ndis6rx.h>
 #include <xdp/objectheader.h>
 #include <xdp/pollinfo.h>
 #include <xdp/queueinfo.h>
 #include <xdp/rtl.h>
+#include <xdp/rxbatch.h>
 #include <xdp/rxqueueconfig.h>
 #include <xdp/txframecompletioncontext.h>
 #include <xdp/txqueueconfig.h>
@@ -0,0 +1,68 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+//
+// This header declares experimental XDP interfaces for eBPF programs. All
+// definitions within this file are subject to breaking changes, including
+// removal. Include this header after bpf_helpers.h.
+//
+
+#ifndef XDPEBPF_EXPERIMENTAL_H
+#define XDPEBPF_EXPERIMENTAL_H
+
+//
+// The eBPF program result which redirects the frame to the socket selected by
+// bpf_xdp_redirect_xsk. This matches the Linux XDP_REDIRECT value.
+//
+#define XDP_REDIRECT 4
+
+#ifndef XDP_EXT_HELPER_FN_BASE
+#define XDP_EXT_HELPER_FN_BASE 0xFFFF
+#endif
+
+#define BPF_FUNC_xdp_redirect_xsk (XDP_EXT_HELPER_FN_BASE + 2)
+#define BPF_FUNC_xdp_adjust_meta (XDP_EXT_HELPER_FN_BASE + 3)
+#define BPF_FUNC_xdp_adjust_tail (XDP_EXT_HELPER_FN_BASE + 4)
+
+//
+// Selects the socket at the given key of the RX queue's socket map as the
+// frame's redirect target. See XSK_SOCKOPT_EBPF_MAP_KEY. Returns XDP_REDIRECT
+// if a socket occupies the key. Otherwise, returns the action in the low two
+// bits of flags, or XDP_DROP if no action is specified.
+//
+// Usage: return bpf_xdp_redirect_xsk(ctx, 0, XDP_PASS);
+//
+typedef int (*const bpf_xdp_redirect_xsk_t)(xdp_md_t *ctx, uint32_t key, uint64_t flags);
+#define bpf_xdp_redirect_xsk ((bpf_xdp_redirect_xsk_t)BPF_FUNC_xdp_redirect_xsk)
+
+//
+// Grows (negative delta) or shrinks (positive delta) the metadata area between
+// ctx->data_meta and ctx->data, which is initially empty. The metadata length
+// must be a multiple of 4 bytes and at most 32 bytes, and the frame headroom
+// must be large enough. Metadata of frames redirected to a socket is delivered
+// into the UMEM headroom; see XSK_SOCKOPT_EBPF_METADATA. Returns 0 on success
+// or a negative value on failure. As with any packet-modifying helper, packet
+// pointers must be revalidated after a successful call.
+//
+// Usage: if (bpf_xdp_adjust_meta(ctx, -(int)sizeof(meta)) < 0) { ... }
+//
+typedef int (*const bpf_xdp_adjust_meta_t)(xdp_md_t *ctx, int delta);
+#define bpf_xdp_adjust_meta ((bpf_xdp_adjust_meta_t)BPF_FUNC_xdp_adjust_meta)
+
+//
+// Grows (positive delta) or truncates (negative delta) the end of the frame.
+// The frame can grow only within the capacity of its final buffer, and the
+// new bytes are zero. Truncating removes data from the end of the frame,
+// including from fragment buffers, but cannot shrink the frame below an
+// Ethernet header (14 bytes). Returns 0 on success or a negative value on
+// failure. As with any packet-modifying helper, packet pointers must be
+// revalidated after a successful call.
+//
+// Usage: if (bpf_xdp_adjust_tail(ctx, -(int)trim) < 0) { ... }
+//
+typedef int (*const bpf_xdp_adjust_tail_t)(xdp_md_t *ctx, int delta);
+#define bpf_xdp_adjust_tail ((bpf_xdp_adjust_tail_t)BPF_FUNC_xdp_adjust_tail)
+
+#endif
@@ -85,6 +85,9 @@ XDP_REMOVE_INTERFACE_COMPLETE(
 typedef enum {
     XdpOffloadRss,
     XdpOffloadQeo,
+    XdpOffloadFlowSteering,
+    XdpOffloadTuning,
+    XdpOffloadDropFilter,
 } XDP_INTERFACE_OFFLOAD_TYPE;
 
 typedef enum {
@@ -148,6 +151,43 @@ typedef struct _XDP_OFFLOAD_PARAMS_QEO {
     UINT32 ConnectionCount;
 } XDP_OFFLOAD_PARAMS_QEO;
 
+typedef struct _XDP_OFFLOAD_PARAMS_FLOW_STEERING_FILTER {
+    LIST_ENTRY TransactionEntry;
+    XDP_FLOW_STEERING_FILTER Params;
+} XDP_OFFLOAD_PARAMS_FLOW_STEERING_FILTER;
+
+typedef struct _XDP_OFFLOAD_PARAMS_FLOW_STEERING {
+    LIST_ENTRY Filters;
+    UINT32 FilterCount;
+} XDP_OFFLOAD_PARAMS_FLOW_STEERING;
+
+typedef struct _XDP_OFFLOAD_PARAMS_TUNING {
+    const XDP_TUNING_SETTING *Settings;
+    UINT32 SettingCount;
+} XDP_OFFLOAD_PARAMS_TUNING;
+
+//
+// Drops received frames of the given IP protocol, IPPROTO_UDP or IPPROTO_TCP,
+// and destination port before XDP inspection. A DestinationPort of zero
+// matches every UDP port. Filters apply to frames on the interface's RSS
+// queues; the interface may leave any frame to XDP inspection instead.
+//
+typedef struct _XDP_OFFLOAD_DROP_FILTER {
+    UINT8 IpProtocol;
+    UINT16 DestinationPort;
+} XDP_OFFLOAD_DROP_FILTER;
+
+//
+// Set: replaces the interface's drop filters; a FilterCount of zero removes
+// all filters. Get: returns the number of frames each filter has dropped since
+// the filters were set, in Hits.
+//
+typedef struct _XDP_OFFLOAD_PARAMS_DROP_FILTER {
+    const XDP_OFFLOAD_DROP_FILTER *Filters;
+    UINT64 *Hits;
+    UINT32 FilterCount;
+} XDP_OFFLOAD_PARAMS_DROP_FILTER;
+
 //
 // Open an interface queue offload configuration handle.
 //
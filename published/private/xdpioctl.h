@@ -11,6 +11,7 @@
 
 #include <afxdp.h>
 #include <xdpapi.h>
+#include <xdpapi_experimental.h>
 #include <xdpifmode.h>
 #include <xdp/program.h>
 
@@ -63,6 +64,24 @@ typedef struct _XDP_INTERFACE_OPEN {
     UINT32 IfIndex;
 } XDP_INTERFACE_OPEN;
 
+//
+// IOCTLs supported by a program file handle.
+//
+#define IOCTL_PROGRAM_UPDATE_RULES \
+    CTL_CODE(FILE_DEVICE_NETWORK, 0, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+#define IOCTL_PROGRAM_GET_RULE_COUNTERS \
+    CTL_CODE(FILE_DEVICE_NETWORK, 1, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+//
+// Input struct for IOCTL_PROGRAM_UPDATE_RULES
+//
+typedef struct _XDP_PROGRAM_UPDATE_RULES_IN {
+    UINT32 RuleIndex;
+    UINT32 DeleteRuleCount;
+    UINT32 InsertRuleCount;
+    const XDP_RULE *Rules;
+} XDP_PROGRAM_UPDATE_RULES_IN;
+
 //
 // IOCTLs supported by an interface file handle.
 //
@@ -74,6 +93,14 @@ typedef struct _XDP_INTERFACE_OPEN {
     CTL_CODE(FILE_DEVICE_NETWORK, 2, METHOD_BUFFERED, FILE_WRITE_ACCESS)
 #define IOCTL_INTERFACE_OFFLOAD_QEO_SET \
     CTL_CODE(FILE_DEVICE_NETWORK, 3, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+#define IOCTL_INTERFACE_OFFLOAD_FLOW_STEERING_SET \
+    CTL_CODE(FILE_DEVICE_NETWORK, 4, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+#define IOCTL_INTERFACE_OFFLOAD_FLOW_STEERING_GET \
+    CTL_CODE(FILE_DEVICE_NETWORK, 5, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+#define IOCTL_INTERFACE_FLIGHT_RECORDER_GET \
+    CTL_CODE(FILE_DEVICE_NETWORK, 6, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+#define IOCTL_INTERFACE_TUNING_SET \
+    CTL_CODE(FILE_DEVICE_NETWORK, 7, METHOD_BUFFERED, FILE_WRITE_ACCESS)
 
 //
 // Define IOCTLs supported by an XSK file handle.
@@ -91,6 +118,10 @@ typedef struct _XDP_INTERFACE_OPEN {
     CTL_CODE(FILE_DEVICE_NETWORK, 4, METHOD_NEITHER, FILE_WRITE_ACCESS)
 #define IOCTL_XSK_NOTIFY_ASYNC \
     CTL_CODE(FILE_DEVICE_NETWORK, 5, METHOD_NEITHER, FILE_WRITE_ACCESS)
+#define IOCTL_XSK_NOTIFY_SOCKETS \
+    CTL_CODE(FILE_DEVICE_NETWORK, 6, METHOD_NEITHER, FILE_WRITE_ACCESS)
+#define IOCTL_XSK_SOCKOPTS \
+    CTL_CODE(FILE_DEVICE_NETWORK, 7, METHOD_NEITHER, FILE_WRITE_ACCESS)
 
 //
 // Input struct for IOCTL_XSK_BIND
@@ -124,3 +155,21 @@ typedef struct _XSK_NOTIFY_IN {
     XSK_NOTIFY_FLAGS Flags;
     UINT32 WaitTimeoutMilliseconds;
 } XSK_NOTIFY_IN;
+
+//
+// Input struct for IOCTL_XSK_NOTIFY_SOCKETS
+//
+typedef struct _XSK_NOTIFY_SOCKETS_IN {
+    XSK_NOTIFY_SOCKET_ENTRY *Sockets;
+    UINT32 SocketCount;
+    UINT32 WaitTimeoutMilliseconds;
+} XSK_NOTIFY_SOCKETS_IN;
+
+//
+// Input struct for IOCTL_XSK_SOCKOPTS. The output buffer receives the UINT32
+// count of options successfully processed.
+//
+typedef struct _XSK_SOCKOPTS_IN {
+    XSK_SOCKOPT_ENTRY *Options;
+    UINT32 OptionCount;
+} XSK_SOCKOPTS_IN;
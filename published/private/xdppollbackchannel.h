@@ -77,6 +77,49 @@ NDIS_POLL_BACKCHANNEL_INVOKE_POLL(
     _In_ UINT32 TxQuota
     );
 
+typedef struct _NDIS_POLL_BACKCHANNEL_INVOKE_DATA {
+    //
+    // The maximum number of RX and TX frames the poll may process. Callers size
+    // the quotas to their actual demand, e.g. the space available in rings.
+    //
+    UINT32 RxQuota;
+    UINT32 TxQuota;
+
+    //
+    // Set by the backchannel to the number of RX and TX frames the poll
+    // processed. A poll that exhausts a quota likely has work remaining.
+    //
+    UINT32 RxCompleted;
+    UINT32 TxCompleted;
+} NDIS_POLL_BACKCHANNEL_INVOKE_DATA;
+
+//
+// Invoke the NDIS poll routine and report the work it completed.
+//
+typedef
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+NDIS_POLL_BACKCHANNEL_INVOKE_POLL_EX(
+    _In_ NDIS_POLL_BACKCHANNEL *Backchannel,
+    _Inout_ NDIS_POLL_BACKCHANNEL_INVOKE_DATA *InvokeData
+    );
+
+//
+// Invoke the NDIS poll routine on the calling thread only if the poll context
+// is idle: no poll is scheduled or running, and no backchannel owns the poll
+// context exclusively. Returns FALSE without invoking the poll routine if the
+// poll context is busy, in which case the caller should request a poll via the
+// interface instead. If the poll indicates more work remains, the backchannel
+// schedules a regular poll to complete it.
+//
+typedef
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+NDIS_POLL_BACKCHANNEL_TRY_INVOKE_POLL(
+    _In_ NDIS_POLL_BACKCHANNEL *Backchannel,
+    _Inout_ NDIS_POLL_BACKCHANNEL_INVOKE_DATA *InvokeData
+    );
+
 //
 // Set the notification state of a polling context.
 //
@@ -111,4 +154,6 @@ typedef struct _NDIS_POLL_BACKCHANNEL_DISPATCH {
     NDIS_POLL_BACKCHANNEL_SET_NOTIFICATIONS *SetNotifications;
     NDIS_POLL_BACKCHANNEL_ADD_BUSY_REFERENCE *AddBusyReference;
     NDIS_POLL_BACKCHANNEL_RELEASE_BUSY_REFERENCE *ReleaseBusyReference;
+    NDIS_POLL_BACKCHANNEL_INVOKE_POLL_EX *InvokePollEx;
+    NDIS_POLL_BACKCHANNEL_TRY_INVOKE_POLL *TryInvokePoll;
 } NDIS_POLL_BACKCHANNEL_DISPATCH;
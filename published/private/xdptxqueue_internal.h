@@ -20,16 +20,36 @@ XDP_TX_QUEUE_CREATE_GET_NOTIFY_HANDLE(
     _In_ XDP_TX_QUEUE_CONFIG_CREATE TxQueueConfig
     );
 
+//
+// Returns the address of the TX queue's buffer MDL generation. The generation
+// changes whenever a data path client is added to or removed from the queue,
+// so any state an interface derives from frame buffer MDLs, such as partial
+// MDLs, is stale once the generation changes: a removed client's MDLs may be
+// freed and their addresses reused. The generation is zero while frames may
+// come from clients whose buffer MDLs are not stable across frames, in which
+// case such state must not be reused at all. The generation is updated only
+// by the TX queue's data path, e.g. within XdpFlushTransmit.
+//
+typedef
+CONST UINT32 *
+XDP_TX_QUEUE_CREATE_GET_BUFFER_MDL_GENERATION(
+    _In_ XDP_TX_QUEUE_CONFIG_CREATE TxQueueConfig
+    );
+
 typedef struct _XDP_TX_QUEUE_CONFIG_RESERVED {
-    XDP_OBJECT_HEADER                       Header;
-    XDP_TX_QUEUE_CREATE_GET_HOOK_ID         *GetHookId;
-    XDP_TX_QUEUE_CREATE_GET_NOTIFY_HANDLE   *GetNotifyHandle;
+    XDP_OBJECT_HEADER                               Header;
+    XDP_TX_QUEUE_CREATE_GET_HOOK_ID                 *GetHookId;
+    XDP_TX_QUEUE_CREATE_GET_NOTIFY_HANDLE           *GetNotifyHandle;
+    XDP_TX_QUEUE_CREATE_GET_BUFFER_MDL_GENERATION   *GetBufferMdlGeneration;
 } XDP_TX_QUEUE_CONFIG_RESERVED;
 
 #define XDP_TX_QUEUE_CONFIG_RESERVED_REVISION_1 1
+#define XDP_TX_QUEUE_CONFIG_RESERVED_REVISION_2 2
 
 #define XDP_SIZEOF_TX_QUEUE_CONFIG_RESERVED_REVISION_1 \
     RTL_SIZEOF_THROUGH_FIELD(XDP_TX_QUEUE_CONFIG_RESERVED, GetNotifyHandle)
+#define XDP_SIZEOF_TX_QUEUE_CONFIG_RESERVED_REVISION_2 \
+    RTL_SIZEOF_THROUGH_FIELD(XDP_TX_QUEUE_CONFIG_RESERVED, GetBufferMdlGeneration)
 
 inline
 CONST XDP_HOOK_ID *
@@ -69,6 +89,25 @@ XdpTxQueueGetNotifyHandle(
     return Reserved->GetNotifyHandle(TxQueueConfig);
 }
 
+inline
+CONST UINT32 *
+XdpTxQueueGetBufferMdlGeneration(
+    _In_ XDP_TX_QUEUE_CONFIG_CREATE TxQueueConfig
+    )
+{
+    XDP_TX_QUEUE_CONFIG_CREATE_DETAILS *Details = (XDP_TX_QUEUE_CONFIG_CREATE_DETAILS *)TxQueueConfig;
+    const XDP_TX_QUEUE_CONFIG_RESERVED *Reserved = Details->Dispatch->Reserved;
+
+    if (Reserved == NULL ||
+        Reserved->Header.Revision < XDP_TX_QUEUE_CONFIG_RESERVED_REVISION_2 ||
+        Reserved->Header.Size < XDP_SIZEOF_TX_QUEUE_CONFIG_RESERVED_REVISION_2 ||
+        Reserved->GetBufferMdlGeneration == NULL) {
+        return NULL;
+    }
+
+    return Reserved->GetBufferMdlGeneration(TxQueueConfig);
+}
+
 typedef enum _XDP_TX_QUEUE_NOTIFY_CODE {
     //
     // The TX queue's MTU has changed. The XDP platform will mark the TX queue
@@ -3,18 +3,23 @@
 // Licensed under the MIT License.
 //
 
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <mstcpip.h>
 #include <windows.h>
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <xdpapi.h>
+#include <xdpapi_experimental.h>
 
 CONST CHAR *UsageText =
-"rxfilter.exe -IfIndex <IfIndex> -QueueId <QueueId> [OPTIONS] RULE_PARAMS\n"
+"rxfilter.exe -IfIndex <IfIndex> -QueueId <QueueId> [OPTIONS] <RULE_PARAMS | -RuleFile <Path>>\n"
 "\n"
 "Filters RX traffic using an XDP program. Traffic that does not match the\n"
-"filter will be allowed to pass through.\n"
+"filter will be allowed to pass through. A QueueId of * attaches the program\n"
+"to all queues of the interface.\n"
 "\n"
 "RULE_PARAMS:\n"
 "\n"
@@ -43,8 +48,35 @@ CONST CHAR *UsageText =
 "       -UdpDstPort <Port>\n"
 "           The UDP destination port\n"
 "\n"
+"RULE_FILE:\n"
+"\n"
+"   -RuleFile <Path>\n"
+"\n"
+"       Loads the program's rules from a file instead of RULE_PARAMS, one rule\n"
+"       per line, in order of precedence. Empty lines and lines starting with\n"
+"       # are ignored. Each line has the form:\n"
+"\n"
+"       <MatchType> [Pattern] <Action>\n"
+"\n"
+"       - All <Action>\n"
+"       - UdpDstPort <Port> <Action>\n"
+"       - TcpDstPort <Port> <Action>\n"
+"       - Ipv4Dst <Address>/<PrefixLength> <Action>\n"
+"       - Ipv6Dst <Address>/<PrefixLength> <Action>\n"
+"       - Ipv4DstLpm <Address>/<PrefixLength> <Pass|Drop>\n"
+"       - Ipv6DstLpm <Address>/<PrefixLength> <Pass|Drop>\n"
+"\n"
+"       All Ipv4DstLpm lines are loaded into a single longest prefix match\n"
+"       rule at the position of the first such line, and likewise for\n"
+"       Ipv6DstLpm lines.\n"
+"\n"
 "OPTIONS:\n"
 "\n"
+"   -RuleStats\n"
+"\n"
+"       Print the hit rate of each rule every second. Always enabled with\n"
+"       -RuleFile.\n"
+"\n"
 "   -XdpMode <Mode>\n"
 "\n"
 "       The XDP interface provider mode:\n"
@@ -57,6 +89,7 @@ CONST CHAR *UsageText =
 "\n"
 "   rxfilter.exe -IfIndex 6 -QueueId 0 -MatchType All -Action Drop\n"
 "   rxfilter.exe -IfIndex 6 -QueueId * -MatchType UdpDstPort -UdpDstPort 53 -Action Drop\n"
+"   rxfilter.exe -IfIndex 6 -QueueId * -RuleFile rules.txt\n"
 ;
 
 #define LOGERR(...) \
@@ -66,6 +99,313 @@ UINT32 IfIndex;
 UINT32 QueueId;
 XDP_RULE Rule;
 XDP_CREATE_PROGRAM_FLAGS ProgramFlags;
+CONST CHAR *RuleFile;
+
+//
+// The program's rules, and the rule file line each rule was loaded from.
+//
+XDP_RULE *Rules;
+UINT32 *RuleLines;
+UINT32 RuleCount;
+UINT32 RuleCapacity;
+UINT32 RuleLineCapacity;
+
+//
+// The prefixes of the IPv4 and IPv6 longest prefix match rules, if any.
+//
+typedef struct _PREFIX_TABLE {
+    XDP_IP_PREFIX *Prefixes;
+    UINT32 PrefixCount;
+    UINT32 PrefixCapacity;
+    UINT32 RuleIndex;
+} PREFIX_TABLE;
+
+PREFIX_TABLE Ipv4Prefixes;
+PREFIX_TABLE Ipv6Prefixes;
+
+static
+BOOLEAN
+GrowArray(
+    _Inout_ VOID **Array,
+    _Inout_ UINT32 *Capacity,
+    _In_ UINT32 Count,
+    _In_ SIZE_T ElementSize
+    )
+{
+    VOID *NewArray;
+    UINT32 NewCapacity;
+
+    if (Count < *Capacity) {
+        return TRUE;
+    }
+
+    NewCapacity = (*Capacity == 0) ? 64 : *Capacity * 2;
+    NewArray = realloc(*Array, NewCapacity * ElementSize);
+    if (NewArray == NULL) {
+        LOGERR("Failed to allocate rules");
+        return FALSE;
+    }
+
+    *Array = NewArray;
+    *Capacity = NewCapacity;
+    return TRUE;
+}
+
+static
+XDP_RULE *
+AddRule(
+    _In_ UINT32 Line
+    )
+{
+    if (!GrowArray((VOID **)&Rules, &RuleCapacity, RuleCount, sizeof(*Rules)) ||
+        !GrowArray((VOID **)&RuleLines, &RuleLineCapacity, RuleCount, sizeof(*RuleLines))) {
+        return NULL;
+    }
+
+    ZeroMemory(&Rules[RuleCount], sizeof(Rules[RuleCount]));
+    RuleLines[RuleCount] = Line;
+
+    return &Rules[RuleCount++];
+}
+
+static
+BOOLEAN
+ParseAction(
+    _In_ CONST CHAR *Arg,
+    _Out_ XDP_RULE_ACTION *Action
+    )
+{
+    if (!_stricmp(Arg, "Pass")) {
+        *Action = XDP_PROGRAM_ACTION_PASS;
+    } else if (!_stricmp(Arg, "Drop")) {
+        *Action = XDP_PROGRAM_ACTION_DROP;
+    } else if (!_stricmp(Arg, "L2Fwd")) {
+        *Action = XDP_PROGRAM_ACTION_L2FWD;
+    } else {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+BOOLEAN
+ParsePrefix(
+    _In_ CHAR *Arg,
+    _In_ BOOLEAN Ipv6,
+    _Out_ XDP_INET_ADDR *Address,
+    _Out_ UINT8 *PrefixLength
+    )
+{
+    CHAR *Slash;
+    CONST CHAR *Terminator;
+    ULONG Length;
+
+    ZeroMemory(Address, sizeof(*Address));
+
+    Slash = strchr(Arg, '/');
+    if (Slash == NULL) {
+        return FALSE;
+    }
+    *Slash = '\0';
+
+    if (Ipv6) {
+        if (RtlIpv6StringToAddressA(Arg, &Terminator, &Address->Ipv6) != 0) {
+            return FALSE;
+        }
+    } else if (RtlIpv4StringToAddressA(Arg, TRUE, &Terminator, &Address->Ipv4) != 0) {
+        return FALSE;
+    }
+
+    Length = strtoul(Slash + 1, NULL, 10);
+    if (*Terminator != '\0' || Length > (Ipv6 ? 128u : 32u)) {
+        return FALSE;
+    }
+
+    *PrefixLength = (UINT8)Length;
+    return TRUE;
+}
+
+static
+VOID
+PrefixLengthToMask(
+    _In_ UINT8 PrefixLength,
+    _Out_writes_bytes_(MaskSize) UINT8 *Mask,
+    _In_ UINT32 MaskSize
+    )
+{
+    for (UINT32 Index = 0; Index < MaskSize; Index++) {
+        if (PrefixLength >= 8) {
+            Mask[Index] = 0xFF;
+            PrefixLength -= 8;
+        } else {
+            Mask[Index] = (UINT8)(0xFF << (8 - PrefixLength));
+            PrefixLength = 0;
+        }
+    }
+}
+
+static
+BOOLEAN
+ParseRuleLine(
+    _In_ CHAR *Line,
+    _In_ UINT32 LineNumber
+    )
+{
+    CHAR *Context = NULL;
+    CHAR *Tokens[3];
+    UINT32 TokenCount = 0;
+    CHAR *Token;
+    XDP_RULE *NewRule;
+    XDP_RULE_ACTION Action;
+    BOOLEAN Ipv6;
+
+    for (Token = strtok_s(Line, " \t\r\n", &Context);
+        Token != NULL;
+        Token = strtok_s(NULL, " \t\r\n", &Context)) {
+        if (TokenCount == RTL_NUMBER_OF(Tokens)) {
+            return FALSE;
+        }
+        Tokens[TokenCount++] = Token;
+    }
+
+    if (TokenCount == 0 || Tokens[0][0] == '#') {
+        return TRUE;
+    }
+
+    if (!ParseAction(Tokens[TokenCount - 1], &Action)) {
+        return FALSE;
+    }
+
+    if (!_stricmp(Tokens[0], "Ipv4DstLpm") || !_stricmp(Tokens[0], "Ipv6DstLpm")) {
+        PREFIX_TABLE *Table;
+        XDP_IP_PREFIX *Prefix;
+
+        Ipv6 = !_stricmp(Tokens[0], "Ipv6DstLpm");
+        Table = Ipv6 ? &Ipv6Prefixes : &Ipv4Prefixes;
+
+        if (TokenCount != 3 || Action == XDP_PROGRAM_ACTION_L2FWD) {
+            return FALSE;
+        }
+
+        if (Table->PrefixCount == 0) {
+            //
+            // The prefix table is attached to the rule once the whole file is
+            // loaded, since the table may still be reallocated.
+            //
+            NewRule = AddRule(LineNumber);
+            if (NewRule == NULL) {
+                return FALSE;
+            }
+            NewRule->Match = Ipv6 ? XDP_MATCH_IPV6_DST_LPM : XDP_MATCH_IPV4_DST_LPM;
+            NewRule->Action = XDP_PROGRAM_ACTION_PASS;
+            Table->RuleIndex = RuleCount - 1;
+        }
+
+        if (Table->PrefixCount == XDP_IP_PREFIX_TABLE_MAX_PREFIXES ||
+            !GrowArray(
+                (VOID **)&Table->Prefixes, &Table->PrefixCapacity, Table->PrefixCount,
+                sizeof(*Table->Prefixes))) {
+            return FALSE;
+        }
+
+        Prefix = &Table->Prefixes[Table->PrefixCount];
+        if (!ParsePrefix(Tokens[1], Ipv6, &Prefix->Address, &Prefix->PrefixLength)) {
+            return FALSE;
+        }
+        Prefix->Action =
+            (Action == XDP_PROGRAM_ACTION_DROP) ?
+                XDP_IP_PREFIX_ACTION_DROP : XDP_IP_PREFIX_ACTION_PASS;
+        Table->PrefixCount++;
+
+        return TRUE;
+    }
+
+    NewRule = AddRule(LineNumber);
+    if (NewRule == NULL) {
+        return FALSE;
+    }
+    NewRule->Action = Action;
+
+    if (!_stricmp(Tokens[0], "All") && TokenCount == 2) {
+        NewRule->Match = XDP_MATCH_ALL;
+    } else if (!_stricmp(Tokens[0], "UdpDstPort") && TokenCount == 3) {
+        NewRule->Match = XDP_MATCH_UDP_DST;
+        NewRule->Pattern.Port = _byteswap_ushort((UINT16)atoi(Tokens[1]));
+    } else if (!_stricmp(Tokens[0], "TcpDstPort") && TokenCount == 3) {
+        NewRule->Match = XDP_MATCH_TCP_DST;
+        NewRule->Pattern.Port = _byteswap_ushort((UINT16)atoi(Tokens[1]));
+    } else if ((!_stricmp(Tokens[0], "Ipv4Dst") || !_stricmp(Tokens[0], "Ipv6Dst")) &&
+        TokenCount == 3) {
+        UINT8 PrefixLength;
+
+        Ipv6 = !_stricmp(Tokens[0], "Ipv6Dst");
+        NewRule->Match = Ipv6 ? XDP_MATCH_IPV6_DST_MASK : XDP_MATCH_IPV4_DST_MASK;
+
+        if (!ParsePrefix(Tokens[1], Ipv6, &NewRule->Pattern.IpMask.Address, &PrefixLength)) {
+            return FALSE;
+        }
+
+        PrefixLengthToMask(
+            PrefixLength, (UINT8 *)&NewRule->Pattern.IpMask.Mask,
+            Ipv6 ? sizeof(IN6_ADDR) : sizeof(IN_ADDR));
+    } else {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+BOOLEAN
+LoadRuleFile(
+    VOID
+    )
+{
+    FILE *File;
+    CHAR Line[256];
+    UINT32 LineNumber = 0;
+    BOOLEAN Success = FALSE;
+
+    if (fopen_s(&File, RuleFile, "r") != 0) {
+        LOGERR("Failed to open rule file %s", RuleFile);
+        return FALSE;
+    }
+
+    while (fgets(Line, sizeof(Line), File) != NULL) {
+        LineNumber++;
+
+        if (!ParseRuleLine(Line, LineNumber)) {
+            LOGERR("Invalid rule at %s:%u", RuleFile, LineNumber);
+            goto Exit;
+        }
+    }
+
+    if (Ipv4Prefixes.PrefixCount > 0) {
+        Rules[Ipv4Prefixes.RuleIndex].Pattern.PrefixTable.Prefixes = Ipv4Prefixes.Prefixes;
+        Rules[Ipv4Prefixes.RuleIndex].Pattern.PrefixTable.PrefixCount = Ipv4Prefixes.PrefixCount;
+    }
+
+    if (Ipv6Prefixes.PrefixCount > 0) {
+        Rules[Ipv6Prefixes.RuleIndex].Pattern.PrefixTable.Prefixes = Ipv6Prefixes.Prefixes;
+        Rules[Ipv6Prefixes.RuleIndex].Pattern.PrefixTable.PrefixCount = Ipv6Prefixes.PrefixCount;
+    }
+
+    if (RuleCount == 0) {
+        LOGERR("No rules in %s", RuleFile);
+        goto Exit;
+    }
+
+    printf(
+        "Loaded %u rules (%u IPv4 and %u IPv6 prefixes) from %s\n",
+        RuleCount, Ipv4Prefixes.PrefixCount, Ipv6Prefixes.PrefixCount, RuleFile);
+    Success = TRUE;
+
+Exit:
+
+    fclose(File);
+    return Success;
+}
 
 VOID
 ParseArgs(
@@ -101,6 +441,15 @@ ParseArgs(
             } else {
                 QueueId = atoi(ArgV[i]);
             }
+        } else if (!_stricmp(ArgV[i], "-RuleFile")) {
+            if (++i >= ArgC) {
+                LOGERR("Missing RuleFile");
+                goto Usage;
+            }
+            RuleFile = ArgV[i];
+            ProgramFlags |= XDP_CREATE_PROGRAM_FLAG_RULE_COUNTERS;
+        } else if (!_stricmp(ArgV[i], "-RuleStats")) {
+            ProgramFlags |= XDP_CREATE_PROGRAM_FLAG_RULE_COUNTERS;
         } else if (!_stricmp(ArgV[i], "-XdpMode")) {
             if (++i >= ArgC) {
                 LOGERR("Missing XdpMode");
@@ -132,13 +481,7 @@ ParseArgs(
                 LOGERR("Missing Action");
                 goto Usage;
             }
-            if (!_stricmp(ArgV[i], "Pass")) {
-                Rule.Action = XDP_PROGRAM_ACTION_PASS;
-            } else if (!_stricmp(ArgV[i], "Drop")) {
-                Rule.Action = XDP_PROGRAM_ACTION_DROP;
-            } else if (!_stricmp(ArgV[i], "L2Fwd")) {
-                Rule.Action = XDP_PROGRAM_ACTION_L2FWD;
-            } else {
+            if (!ParseAction(ArgV[i], &Rule.Action)) {
                 LOGERR("Invalid Action");
                 goto Usage;
             }
@@ -178,6 +521,70 @@ Usage:
     exit(1);
 }
 
+static
+VOID
+PrintRuleStats(
+    _In_ const XDP_API_TABLE *XdpApi,
+    _In_ HANDLE Program
+    )
+{
+    XDP_PROGRAM_GET_RULE_COUNTERS_FN *XdpProgramGetRuleCounters;
+    XDP_RULE_COUNTERS *Counters;
+    UINT64 *LastHits;
+    UINT32 CountersSize = RuleCount * sizeof(*Counters);
+    HRESULT Result;
+
+    XdpProgramGetRuleCounters =
+        (XDP_PROGRAM_GET_RULE_COUNTERS_FN *)
+            XdpApi->XdpGetRoutine(XDP_PROGRAM_GET_RULE_COUNTERS_FN_NAME);
+    if (XdpProgramGetRuleCounters == NULL) {
+        LOGERR("XdpGetRoutine(%s) failed", XDP_PROGRAM_GET_RULE_COUNTERS_FN_NAME);
+        return;
+    }
+
+    Counters = calloc(RuleCount, sizeof(*Counters));
+    LastHits = calloc(RuleCount, sizeof(*LastHits));
+    if (Counters == NULL || LastHits == NULL) {
+        LOGERR("Failed to allocate rule counters");
+        goto Exit;
+    }
+
+    //
+    // Print the hit rate of every rule matched during the last second, in rule
+    // order, followed by the total across all rules.
+    //
+    while (TRUE) {
+        UINT64 TotalHits = 0;
+
+        Sleep(1000);
+
+        Result = XdpProgramGetRuleCounters(Program, Counters, &CountersSize);
+        if (FAILED(Result)) {
+            LOGERR("XdpProgramGetRuleCounters failed: %x", Result);
+            goto Exit;
+        }
+
+        for (UINT32 Index = 0; Index < RuleCount; Index++) {
+            UINT64 Hits =
+                Counters[Index].Hits + Counters[Index].OffloadedHits - LastHits[Index];
+
+            if (Hits > 0) {
+                printf("rule %u (line %u): %llu hits/s\n", Index, RuleLines[Index], Hits);
+            }
+
+            LastHits[Index] += Hits;
+            TotalHits += Hits;
+        }
+
+        printf("total: %llu hits/s\n\n", TotalHits);
+    }
+
+Exit:
+
+    free(Counters);
+    free(LastHits);
+}
+
 INT
 __cdecl
 main(
@@ -188,6 +595,7 @@ main(
     const XDP_API_TABLE *XdpApi;
     HRESULT Result;
     HANDLE Program;
+    XDP_RULE *NewRule;
     const XDP_HOOK_ID XdpInspectRxL2 = {
         XDP_HOOK_L2,
         XDP_HOOK_RX,
@@ -199,6 +607,18 @@ main(
     //
     ParseArgs(argc, argv);
 
+    if (RuleFile != NULL) {
+        if (!LoadRuleFile()) {
+            return 1;
+        }
+    } else {
+        NewRule = AddRule(0);
+        if (NewRule == NULL) {
+            return 1;
+        }
+        *NewRule = Rule;
+    }
+
     Result = XdpOpenApi(XDP_API_VERSION_1, &XdpApi);
     if (FAILED(Result)) {
         LOGERR("XdpOpenApi failed: %x", Result);
@@ -206,11 +626,11 @@ main(
     }
 
     //
-    // Create an XDP program using the parsed rule at the L2 inspect hook point.
+    // Create an XDP program using the parsed rules at the L2 inspect hook point.
     //
     Result =
         XdpApi->XdpCreateProgram(
-            IfIndex, &XdpInspectRxL2, QueueId, ProgramFlags, &Rule, 1, &Program);
+            IfIndex, &XdpInspectRxL2, QueueId, ProgramFlags, Rules, RuleCount, &Program);
     if (FAILED(Result)) {
         LOGERR("XdpCreateProgram failed: %x", Result);
         return 1;
@@ -219,6 +639,10 @@ main(
     //
     // Let XDP filter frames until this process is terminated.
     //
+    if (ProgramFlags & XDP_CREATE_PROGRAM_FLAG_RULE_COUNTERS) {
+        PrintRuleStats(XdpApi, Program);
+    }
+
     Sleep(INFINITE);
 
     return 0;
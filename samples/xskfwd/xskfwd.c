@@ -7,15 +7,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <xdpapi.h>
+#include <xdpapi_experimental.h>
+#include <afxdp_experimental.h>
 #include <afxdp_helper.h>
 
 const CHAR *UsageText =
-"xskfwd.exe <IfIndex>"
+"xskfwd.exe <IfIndex> [QueueCount]"
 "\n"
 "Forwards RX traffic using an XDP program and AF_XDP sockets. This sample\n"
 "application forwards traffic on the specified IfIndex originally destined to\n"
-"UDP port 1234 back to the sender. Only the 0th data path queue on the interface\n"
-"is used.\n"
+"UDP port 1234 back to the sender. One socket and forwarding thread is created\n"
+"for each of the first QueueCount data path queues on the interface; by default,\n"
+"every RSS queue is used. The sockets share a single UMEM. Per-queue throughput\n"
+"is printed every second.\n"
 ;
 
 const XDP_HOOK_ID XdpInspectRxL2 = {
@@ -27,6 +31,38 @@ const XDP_HOOK_ID XdpInspectRxL2 = {
 #define LOGERR(...) \
     fprintf(stderr, "ERR: "); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n")
 
+//
+// Each queue owns a fixed partition of the shared UMEM. Every ring is as large
+// as the partition, so a ring always has space for every frame the queue owns,
+// and no ring reservation below can fail.
+//
+#define FRAMES_PER_QUEUE 256
+#define FRAME_SIZE 2048
+
+typedef struct _QUEUE_CONTEXT {
+    UINT32 QueueId;
+    HANDLE Socket;
+    HANDLE Program;
+    HANDLE Thread;
+    XSK_RING RxRing;
+    XSK_RING RxFillRing;
+    XSK_RING TxRing;
+    XSK_RING TxCompRing;
+
+    //
+    // Written only by the queue's forwarding thread, and read by the main
+    // thread to report throughput.
+    //
+    volatile UINT64 FramesForwarded;
+    volatile UINT64 Pokes;
+
+    UINT64 LastFramesForwarded;
+    UINT64 LastPokes;
+} QUEUE_CONTEXT;
+
+static const XDP_API_TABLE *XdpApi;
+static UCHAR *Umem;
+
 static
 VOID
 TranslateRxToTx(
@@ -49,277 +85,452 @@ TranslateRxToTx(
     }
 }
 
-INT
-__cdecl
-main(
-    INT argc,
-    CHAR **argv
+static
+UINT32
+GetRssQueueCount(
+    _In_ UINT32 IfIndex
     )
 {
-    const XDP_API_TABLE *XdpApi;
+    XDP_RSS_GET_CAPABILITIES_FN *XdpRssGetCapabilities;
+    XDP_RSS_CAPABILITIES RssCapabilities;
+    UINT32 RssCapabilitiesSize = sizeof(RssCapabilities);
+    HANDLE InterfaceHandle;
     HRESULT Result;
-    HANDLE Socket;
-    HANDLE Program;
-    UINT32 IfIndex;
-    XDP_RULE Rule = {0};
-    UCHAR Frame[1514];
-    XSK_UMEM_REG UmemReg = {0};
-    const UINT32 RingSize = 1;
-    XSK_RING_INFO_SET RingInfo;
-    UINT32 OptionLength;
-    XSK_RING RxRing;
-    XSK_RING RxFillRing;
-    XSK_RING TxRing;
-    XSK_RING TxCompRing;
-    UINT32 RingIndex;
-
-    if (argc < 2) {
-        fprintf(stderr, UsageText);
-        return EXIT_FAILURE;
-    }
-
-    IfIndex = atoi(argv[1]);
+    UINT32 QueueCount = 1;
 
     //
-    // Retrieve the XDP API dispatch table.
+    // The RSS capabilities are an experimental API, so fall back to a single
+    // queue if they are unavailable.
     //
-    Result = XdpOpenApi(XDP_API_VERSION_1, &XdpApi);
+    XdpRssGetCapabilities =
+        (XDP_RSS_GET_CAPABILITIES_FN *)XdpApi->XdpGetRoutine(XDP_RSS_GET_CAPABILITIES_FN_NAME);
+    if (XdpRssGetCapabilities == NULL) {
+        return QueueCount;
+    }
+
+    Result = XdpApi->XdpInterfaceOpen(IfIndex, &InterfaceHandle);
     if (FAILED(Result)) {
-        LOGERR("XdpOpenApi failed: %x", Result);
-        return EXIT_FAILURE;
+        return QueueCount;
     }
 
+    Result = XdpRssGetCapabilities(InterfaceHandle, &RssCapabilities, &RssCapabilitiesSize);
+    if (SUCCEEDED(Result) && RssCapabilities.NumberOfReceiveQueues > 0) {
+        QueueCount = RssCapabilities.NumberOfReceiveQueues;
+    }
+
+    CloseHandle(InterfaceHandle);
+
+    return QueueCount;
+}
+
+static
+HRESULT
+SetupQueue(
+    _Inout_ QUEUE_CONTEXT *Queue,
+    _In_ UINT32 IfIndex,
+    _In_opt_ HANDLE UmemSocket,
+    _In_ UINT32 UmemSize
+    )
+{
+    HRESULT Result;
+    XSK_UMEM_REG UmemReg = {0};
+    const UINT32 RingSize = FRAMES_PER_QUEUE;
+    XSK_RING_INFO_SET RingInfo;
+    UINT32 OptionLength;
+    UINT32 RingIndex;
+    XDP_RULE Rule = {0};
+
     //
     // Create an AF_XDP socket. The newly created socket is not connected.
     //
-    Result = XdpApi->XskCreate(&Socket);
+    Result = XdpApi->XskCreate(&Queue->Socket);
     if (FAILED(Result)) {
         LOGERR("XskCreate failed: %x", Result);
-        return EXIT_FAILURE;
+        return Result;
     }
 
-    //
-    // Register our frame buffer(s) with the AF_XDP socket. For simplicity, we
-    // register a buffer containing a single frame. The registered buffer is
-    // available mapped into AF_XDP's address space, and elements of descriptor
-    // rings refer to relative offets from the start of the UMEM.
-    //
-    UmemReg.TotalSize = sizeof(Frame);
-    UmemReg.ChunkSize = sizeof(Frame);
-    UmemReg.Address = Frame;
-
-    Result = XdpApi->XskSetSockopt(Socket, XSK_SOCKOPT_UMEM_REG, &UmemReg, sizeof(UmemReg));
-    if (FAILED(Result)) {
-        LOGERR("XSK_UMEM_REG failed: %x", Result);
-        return EXIT_FAILURE;
+    if (UmemSocket == NULL) {
+        //
+        // The first socket registers the UMEM holding the frame buffers of
+        // every queue. Elements of descriptor rings refer to offsets from the
+        // start of the UMEM.
+        //
+        UmemReg.TotalSize = UmemSize;
+        UmemReg.ChunkSize = FRAME_SIZE;
+        UmemReg.Address = Umem;
+
+        Result =
+            XdpApi->XskSetSockopt(Queue->Socket, XSK_SOCKOPT_UMEM_REG, &UmemReg, sizeof(UmemReg));
+        if (FAILED(Result)) {
+            LOGERR("XSK_UMEM_REG failed: %x", Result);
+            return Result;
+        }
+    } else {
+        //
+        // The remaining sockets share the first socket's UMEM instead of each
+        // registering, and locking, their own memory. A descriptor received on
+        // one queue could be transmitted on any other queue without copying.
+        //
+        Result =
+            XdpApi->XskSetSockopt(
+                Queue->Socket, XSK_SOCKOPT_SHARED_UMEM, &UmemSocket, sizeof(UmemSocket));
+        if (FAILED(Result)) {
+            LOGERR("XSK_SOCKOPT_SHARED_UMEM failed: %x", Result);
+            return Result;
+        }
     }
 
     //
-    // Bind the AF_XDP socket to the specified interface and 0th data path
-    // queue, and indicate the intent to perform RX and TX actions.
+    // Bind the AF_XDP socket to the specified interface and data path queue,
+    // and indicate the intent to perform RX and TX actions.
     //
-    Result = XdpApi->XskBind(Socket, IfIndex, 0, XSK_BIND_FLAG_RX | XSK_BIND_FLAG_TX);
+    Result =
+        XdpApi->XskBind(
+            Queue->Socket, IfIndex, Queue->QueueId, XSK_BIND_FLAG_RX | XSK_BIND_FLAG_TX);
     if (FAILED(Result)) {
         LOGERR("XskBind failed: %x", Result);
-        return EXIT_FAILURE;
+        return Result;
     }
 
     //
-    // Request a set of RX, RX fill, TX, and TX completion descriptor rings.
-    // Request a capacity of one frame in each ring for simplicity. XDP will
-    // create the rings and map them into the process address space as part of
-    // the XskActivate step further below.
+    // Request a set of RX, RX fill, TX, and TX completion descriptor rings,
+    // each able to hold every frame of the queue's UMEM partition.
     //
-
-    Result = XdpApi->XskSetSockopt(Socket, XSK_SOCKOPT_RX_RING_SIZE, &RingSize, sizeof(RingSize));
+    Result =
+        XdpApi->XskSetSockopt(
+            Queue->Socket, XSK_SOCKOPT_RX_RING_SIZE, &RingSize, sizeof(RingSize));
     if (FAILED(Result)) {
         LOGERR("XSK_SOCKOPT_RX_RING_SIZE failed: %x", Result);
-        return EXIT_FAILURE;
+        return Result;
     }
 
-    Result = XdpApi->XskSetSockopt(Socket, XSK_SOCKOPT_RX_FILL_RING_SIZE, &RingSize, sizeof(RingSize));
+    Result =
+        XdpApi->XskSetSockopt(
+            Queue->Socket, XSK_SOCKOPT_RX_FILL_RING_SIZE, &RingSize, sizeof(RingSize));
     if (FAILED(Result)) {
         LOGERR("XSK_SOCKOPT_RX_FILL_RING_SIZE failed: %x", Result);
-        return EXIT_FAILURE;
+        return Result;
     }
 
-    Result = XdpApi->XskSetSockopt(Socket, XSK_SOCKOPT_TX_RING_SIZE, &RingSize, sizeof(RingSize));
+    Result =
+        XdpApi->XskSetSockopt(
+            Queue->Socket, XSK_SOCKOPT_TX_RING_SIZE, &RingSize, sizeof(RingSize));
     if (FAILED(Result)) {
         LOGERR("XSK_SOCKOPT_TX_RING_SIZE failed: %x", Result);
-        return EXIT_FAILURE;
+        return Result;
     }
 
-    Result = XdpApi->XskSetSockopt(Socket, XSK_SOCKOPT_TX_COMPLETION_RING_SIZE, &RingSize, sizeof(RingSize));
+    Result =
+        XdpApi->XskSetSockopt(
+            Queue->Socket, XSK_SOCKOPT_TX_COMPLETION_RING_SIZE, &RingSize, sizeof(RingSize));
     if (FAILED(Result)) {
         LOGERR("XSK_SOCKOPT_TX_COMPLETION_RING_SIZE failed: %x", Result);
-        return EXIT_FAILURE;
+        return Result;
     }
 
     //
     // Activate the AF_XDP socket. Once activated, descriptor rings are
     // available and RX and TX can occur.
     //
-    Result = XdpApi->XskActivate(Socket, XSK_ACTIVATE_FLAG_NONE);
+    Result = XdpApi->XskActivate(Queue->Socket, XSK_ACTIVATE_FLAG_NONE);
     if (FAILED(Result)) {
         LOGERR("XskActivate failed: %x", Result);
-        return EXIT_FAILURE;
+        return Result;
     }
 
-    //
-    // Retrieve the RX, RX fill, TX, and TX completion ring info from AF_XDP.
-    //
     OptionLength = sizeof(RingInfo);
-    Result = XdpApi->XskGetSockopt(Socket, XSK_SOCKOPT_RING_INFO, &RingInfo, &OptionLength);
+    Result =
+        XdpApi->XskGetSockopt(Queue->Socket, XSK_SOCKOPT_RING_INFO, &RingInfo, &OptionLength);
     if (FAILED(Result)) {
         LOGERR("XSK_SOCKOPT_RING_INFO failed: %x", Result);
-        return EXIT_FAILURE;
+        return Result;
     }
 
-    //
-    // Initialize the optional AF_XDP helper library with the socket ring info.
-    // These helpers simplify manipulation of the shared rings.
-    //
-    XskRingInitialize(&RxRing, &RingInfo.Rx);
-    XskRingInitialize(&RxFillRing, &RingInfo.Fill);
-    XskRingInitialize(&TxRing, &RingInfo.Tx);
-    XskRingInitialize(&TxCompRing, &RingInfo.Completion);
+    XskRingInitialize(&Queue->RxRing, &RingInfo.Rx);
+    XskRingInitialize(&Queue->RxFillRing, &RingInfo.Fill);
+    XskRingInitialize(&Queue->TxRing, &RingInfo.Tx);
+    XskRingInitialize(&Queue->TxCompRing, &RingInfo.Completion);
 
     //
-    // Place an empty frame descriptor into the RX fill ring. When the AF_XDP
-    // socket receives a frame from XDP, it will pop the first available
-    // frame descriptor from the RX fill ring and copy the frame payload into
-    // that descriptor's buffer.
+    // Post every frame of the queue's UMEM partition to the RX fill ring in a
+    // single batch.
     //
-    XskRingProducerReserve(&RxFillRing, 1, &RingIndex);
+    XskRingProducerReserve(&Queue->RxFillRing, FRAMES_PER_QUEUE, &RingIndex);
 
-    //
-    // The value of each RX fill and TX completion ring element is an offset
-    // from the start of the UMEM to the start of the frame. Since this sample
-    // is using a single buffer, the offset is always zero.
-    //
-    *(UINT64 *)XskRingGetElement(&RxFillRing, RingIndex) = 0;
+    for (UINT32 Index = 0; Index < FRAMES_PER_QUEUE; Index++) {
+        *(UINT64 *)XskRingGetElement(&Queue->RxFillRing, RingIndex++) =
+            ((UINT64)Queue->QueueId * FRAMES_PER_QUEUE + Index) * FRAME_SIZE;
+    }
 
-    XskRingProducerSubmit(&RxFillRing, 1);
+    XskRingProducerSubmit(&Queue->RxFillRing, FRAMES_PER_QUEUE);
 
     //
-    // Create an XDP program using the parsed rule at the L2 inspect hook point.
-    // The rule intercepts all UDP frames destined to local port 1234 and
-    // redirects them to the AF_XDP socket.
+    // Create an XDP program on the queue that redirects all UDP frames
+    // destined to local port 1234 to the queue's AF_XDP socket.
     //
-
     Rule.Match = XDP_MATCH_UDP_DST;
     Rule.Pattern.Port = 53764; // htons(1234)
     Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
     Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
-    Rule.Redirect.Target = Socket;
+    Rule.Redirect.Target = Queue->Socket;
 
-    Result = XdpApi->XdpCreateProgram(IfIndex, &XdpInspectRxL2, 0, 0, &Rule, 1, &Program);
+    Result =
+        XdpApi->XdpCreateProgram(
+            IfIndex, &XdpInspectRxL2, Queue->QueueId, 0, &Rule, 1, &Queue->Program);
     if (FAILED(Result)) {
         LOGERR("XdpCreateProgram failed: %x", Result);
-        return EXIT_FAILURE;
+        return Result;
+    }
+
+    return S_OK;
+}
+
+static
+VOID
+UpdateAffinity(
+    _In_ QUEUE_CONTEXT *Queue
+    )
+{
+    PROCESSOR_NUMBER Processor;
+    UINT32 OptionLength = sizeof(Processor);
+    GROUP_AFFINITY Affinity = {0};
+    HRESULT Result;
+
+    //
+    // Run the forwarding thread on the processor XDP receives the queue's
+    // frames on, so the frames and rings stay in that processor's cache.
+    // Getting the affinity also clears the RX ring's affinity changed flag.
+    // The affinity is unknown until the socket receives its first frames.
+    //
+    Result =
+        XdpApi->XskGetSockopt(
+            Queue->Socket, XSK_SOCKOPT_RX_PROCESSOR_AFFINITY, &Processor, &OptionLength);
+    if (FAILED(Result)) {
+        return;
     }
 
+    Affinity.Group = Processor.Group;
+    Affinity.Mask = (KAFFINITY)1 << Processor.Number;
+
+    if (!SetThreadGroupAffinity(GetCurrentThread(), &Affinity, NULL)) {
+        LOGERR("SetThreadGroupAffinity failed: %x", GetLastError());
+    }
+}
+
+static
+DWORD
+WINAPI
+ForwardThread(
+    _In_ VOID *Context
+    )
+{
+    QUEUE_CONTEXT *Queue = Context;
+    HRESULT Result;
+
     //
-    // Continuously scan the RX ring and TX completion ring for new descriptors.
-    // For simplicity, this loop performs actions one frame at a time. This can
-    // be optimized further by consuming, reserving, and submitting batches of
-    // frames across each XskRing* function.
+    // Continuously scan the RX ring and TX completion ring for new descriptors,
+    // processing every available descriptor of a ring in a single batch.
     //
     while (TRUE) {
-        if (XskRingConsumerReserve(&RxRing, 1, &RingIndex) == 1) {
-            XSK_BUFFER_DESCRIPTOR *RxBuffer;
-            XSK_BUFFER_DESCRIPTOR *TxBuffer;
-            XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+        UINT32 Count;
+        UINT32 RxIndex;
+        UINT32 TxIndex;
+        BOOLEAN Idle = TRUE;
 
-            //
-            // A new RX frame appeared on the RX ring. Forward it to the TX
-            // ring.
-
-            RxBuffer = XskRingGetElement(&RxRing, RingIndex);
+        if (XskRingAffinityChanged(&Queue->RxRing)) {
+            UpdateAffinity(Queue);
+        }
 
-            //
-            // Reserve space in the TX ring. Since we're only using one frame in
-            // this sample, space is guaranteed to be available.
-            //
-            XskRingProducerReserve(&TxRing, 1, &RingIndex);
-            TxBuffer = XskRingGetElement(&TxRing, RingIndex);
+        //
+        // Recycle every completed TX frame onto the RX fill ring. Since the
+        // TX completion and RX fill descriptor formats are identical, simply
+        // copy the descriptors across rings.
+        //
+        Count = XskRingConsumerReserve(&Queue->TxCompRing, MAXUINT32, &TxIndex);
+        if (Count > 0) {
+            XskRingProducerReserve(&Queue->RxFillRing, Count, &RxIndex);
+
+            for (UINT32 Index = 0; Index < Count; Index++) {
+                *(UINT64 *)XskRingGetElement(&Queue->RxFillRing, RxIndex++) =
+                    *(UINT64 *)XskRingGetElement(&Queue->TxCompRing, TxIndex++);
+            }
 
-            //
-            // Swap source and destination fields within the frame payload.
-            //
-            TranslateRxToTx(
-                &Frame[RxBuffer->Address.BaseAddress + RxBuffer->Address.Offset],
-                RxBuffer->Length);
+            XskRingConsumerRelease(&Queue->TxCompRing, Count);
+            XskRingProducerSubmit(&Queue->RxFillRing, Count);
+            Idle = FALSE;
+        }
 
-            //
-            // Since the RX and TX buffer descriptor formats are identical,
-            // simply copy the descriptor across rings.
-            //
-            *TxBuffer = *RxBuffer;
+        //
+        // Forward every received frame to the TX ring.
+        //
+        Count = XskRingConsumerReserve(&Queue->RxRing, MAXUINT32, &RxIndex);
+        if (Count > 0) {
+            XskRingProducerReserve(&Queue->TxRing, Count, &TxIndex);
+
+            for (UINT32 Index = 0; Index < Count; Index++) {
+                XSK_BUFFER_DESCRIPTOR *RxBuffer = XskRingGetElement(&Queue->RxRing, RxIndex++);
+                XSK_BUFFER_DESCRIPTOR *TxBuffer = XskRingGetElement(&Queue->TxRing, TxIndex++);
+
+                //
+                // Swap source and destination fields within the frame payload.
+                //
+                TranslateRxToTx(
+                    &Umem[RxBuffer->Address.BaseAddress + RxBuffer->Address.Offset],
+                    RxBuffer->Length);
+
+                //
+                // Since the RX and TX buffer descriptor formats are identical,
+                // simply copy the descriptor across rings.
+                //
+                *TxBuffer = *RxBuffer;
+            }
 
-            //
-            // Advance the consumer index of the RX ring and the producer index
-            // of the TX ring, which allows XDP to write and read the descriptor
-            // elements respectively.
-            //
-            XskRingConsumerRelease(&RxRing, 1);
-            XskRingProducerSubmit(&TxRing, 1);
+            XskRingConsumerRelease(&Queue->RxRing, Count);
+            XskRingProducerSubmit(&Queue->TxRing, Count);
 
             //
-            // Notify XDP that a new element is available on the TX ring, since
-            // XDP isn't continuously checking the shared ring. This can be
-            // optimized further using the XskRingProducerNeedPoke helper.
+            // Notify XDP that new elements are available on the TX ring only
+            // if XDP has stopped checking the shared ring.
             //
-            Result = XdpApi->XskNotifySocket(Socket, XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
-            if (FAILED(Result)) {
-                LOGERR("XskNotifySocket failed: %x", Result);
-                return EXIT_FAILURE;
+            if (XskRingProducerNeedPoke(&Queue->TxRing)) {
+                XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+
+                Result =
+                    XdpApi->XskNotifySocket(
+                        Queue->Socket, XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+                if (FAILED(Result)) {
+                    LOGERR("XskNotifySocket failed: %x", Result);
+                    return EXIT_FAILURE;
+                }
+
+                Queue->Pokes++;
             }
+
+            Queue->FramesForwarded += Count;
+            Idle = FALSE;
         }
 
-        if (XskRingConsumerReserve(&TxCompRing, 1, &RingIndex) == 1) {
-            UINT64 *Tx;
-            UINT64 *Rx;
+        if (Idle) {
+            YieldProcessor();
+        }
+    }
+}
 
-            //
-            // A TX frame address appeared on the TX completion ring. Recycle
-            // the frame onto the RX fill ring.
-            //
+INT
+__cdecl
+main(
+    INT argc,
+    CHAR **argv
+    )
+{
+    HRESULT Result;
+    UINT32 IfIndex;
+    UINT32 QueueCount;
+    UINT32 UmemSize;
+    QUEUE_CONTEXT *Queues;
 
-            Tx = XskRingGetElement(&TxCompRing, RingIndex);
+    if (argc < 2) {
+        fprintf(stderr, UsageText);
+        return EXIT_FAILURE;
+    }
 
-            //
-            // Reserve space in the RX fill ring. Since we're only using one
-            // frame in this sample, space is guaranteed to be available.
-            //
-            XskRingProducerReserve(&RxFillRing, 1, &RingIndex);
-            Rx = XskRingGetElement(&RxFillRing, RingIndex);
+    IfIndex = atoi(argv[1]);
 
-            //
-            // Since the TX completion and RX fill descriptor formats are
-            // identical, simply copy the descriptor across rings.
-            //
-            *Rx = *Tx;
+    //
+    // Retrieve the XDP API dispatch table.
+    //
+    Result = XdpOpenApi(XDP_API_VERSION_1, &XdpApi);
+    if (FAILED(Result)) {
+        LOGERR("XdpOpenApi failed: %x", Result);
+        return EXIT_FAILURE;
+    }
 
-            //
-            // Advance the consumer index of the RX ring and the producer index
-            // of the TX ring, which allows XDP to write and read the descriptor
-            // elements respectively.
-            //
-            XskRingConsumerRelease(&TxCompRing, 1);
-            XskRingProducerSubmit(&RxFillRing, 1);
+    if (argc > 2) {
+        QueueCount = atoi(argv[2]);
+    } else {
+        QueueCount = GetRssQueueCount(IfIndex);
+    }
+
+    if (QueueCount == 0 || QueueCount > MAXUINT32 / (FRAMES_PER_QUEUE * FRAME_SIZE)) {
+        fprintf(stderr, UsageText);
+        return EXIT_FAILURE;
+    }
+
+    Queues = calloc(QueueCount, sizeof(*Queues));
+    if (Queues == NULL) {
+        LOGERR("Failed to allocate queue contexts");
+        return EXIT_FAILURE;
+    }
+
+    UmemSize = QueueCount * FRAMES_PER_QUEUE * FRAME_SIZE;
+    Umem = VirtualAlloc(NULL, UmemSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (Umem == NULL) {
+        LOGERR("VirtualAlloc failed: %x", GetLastError());
+        return EXIT_FAILURE;
+    }
+
+    for (UINT32 Index = 0; Index < QueueCount; Index++) {
+        Queues[Index].QueueId = Index;
+
+        Result =
+            SetupQueue(
+                &Queues[Index], IfIndex, (Index == 0) ? NULL : Queues[0].Socket, UmemSize);
+        if (FAILED(Result)) {
+            return EXIT_FAILURE;
         }
     }
 
     //
-    // Close the XDP program. Traffic will no longer be intercepted by XDP.
+    // Service each queue with its own thread, so the forwarder scales with
+    // the number of RSS queues.
     //
-    CloseHandle(Program);
+    for (UINT32 Index = 0; Index < QueueCount; Index++) {
+        Queues[Index].Thread = CreateThread(NULL, 0, ForwardThread, &Queues[Index], 0, NULL);
+        if (Queues[Index].Thread == NULL) {
+            LOGERR("CreateThread failed: %x", GetLastError());
+            return EXIT_FAILURE;
+        }
+    }
 
     //
-    // Close the AF_XDP socket. All socket resources will be cleaned up by XDP.
+    // Report the throughput of each queue once per second.
     //
-    CloseHandle(Socket);
+    while (TRUE) {
+        UINT64 TotalFrames = 0;
+
+        Sleep(1000);
+
+        for (UINT32 Index = 0; Index < QueueCount; Index++) {
+            QUEUE_CONTEXT *Queue = &Queues[Index];
+            UINT64 Frames = Queue->FramesForwarded;
+            UINT64 Pokes = Queue->Pokes;
+
+            printf(
+                "queue %u: %llu frames/s %llu pokes/s\n", Queue->QueueId,
+                Frames - Queue->LastFramesForwarded, Pokes - Queue->LastPokes);
+
+            TotalFrames += Frames - Queue->LastFramesForwarded;
+            Queue->LastFramesForwarded = Frames;
+            Queue->LastPokes = Pokes;
+        }
+
+        printf("total: %llu frames/s\n\n", TotalFrames);
+    }
+
+    //
+    // Close the XDP programs before the AF_XDP sockets. Traffic will no longer
+    // be intercepted by XDP, and all socket resources will be cleaned up.
+    //
+    for (UINT32 Index = 0; Index < QueueCount; Index++) {
+        CloseHandle(Queues[Index].Program);
+    }
+
+    for (UINT32 Index = 0; Index < QueueCount; Index++) {
+        CloseHandle(Queues[Index].Socket);
+    }
+
+    VirtualFree(Umem, 0, MEM_RELEASE);
+    free(Queues);
 
     return EXIT_SUCCESS;
 }
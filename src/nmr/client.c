@@ -54,11 +54,24 @@ XdpNmrClientAttachProvider(
     )
 {
     XDP_CLIENT *Client = ClientContext;
+    const NPI_REGISTRATION_INSTANCE *ClientRegistrationInstance =
+        &Client->NpiClientCharacteristics.ClientRegistrationInstance;
     NTSTATUS Status;
     VOID *ProviderBindingContext;
     const VOID *ProviderBindingDispatch;
 
-    UNREFERENCED_PARAMETER(ProviderRegistrationInstance);
+    //
+    // NMR offers every XDP provider to every XDP client, so each provider
+    // registration is offered to all other interfaces on the system. Reject
+    // providers bound to a different interface before acquiring the resource
+    // and performing the attach handshake; the provider repeats these checks.
+    //
+    if (ProviderRegistrationInstance->Version != XDP_BINDING_VERSION_1 ||
+        ProviderRegistrationInstance->Number != ClientRegistrationInstance->Number ||
+        !NmrIsEqualNpiModuleId(
+            ProviderRegistrationInstance->ModuleId, ClientRegistrationInstance->ModuleId)) {
+        return STATUS_NOINTERFACE;
+    }
 
     //
     // The NMR client allows at most one active binding at a time, but defers
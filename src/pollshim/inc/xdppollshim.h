@@ -12,6 +12,8 @@ NDIS_POLL_BACKCHANNEL_DELETE XdpPollDeleteBackchannel;
 NDIS_POLL_BACKCHANNEL_ACQUIRE_EXCLUSIVE XdpPollAcquireExclusive;
 NDIS_POLL_BACKCHANNEL_RELEASE_EXCLUSIVE XdpPollReleaseExclusive;
 NDIS_POLL_BACKCHANNEL_INVOKE_POLL XdpPollInvoke;
+NDIS_POLL_BACKCHANNEL_INVOKE_POLL_EX XdpPollInvokeEx;
+NDIS_POLL_BACKCHANNEL_TRY_INVOKE_POLL XdpPollTryInvoke;
 NDIS_POLL_BACKCHANNEL_SET_NOTIFICATIONS XdpPollSetNotifications;
 NDIS_POLL_BACKCHANNEL_ADD_BUSY_REFERENCE XdpPollAddBusyReference;
 NDIS_POLL_BACKCHANNEL_RELEASE_BUSY_REFERENCE XdpPollReleaseBusyReference;
@@ -62,6 +62,48 @@ XdpPollInvoke(
     return XdpPollDispatch->InvokePoll(Backchannel, RxQuota, TxQuota);
 }
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+XdpPollInvokeEx(
+    _In_ NDIS_POLL_BACKCHANNEL *Backchannel,
+    _Inout_ NDIS_POLL_BACKCHANNEL_INVOKE_DATA *InvokeData
+    )
+{
+    BOOLEAN MoreData;
+
+    if (XdpPollDispatch->InvokePollEx != NULL) {
+        return XdpPollDispatch->InvokePollEx(Backchannel, InvokeData);
+    }
+
+    //
+    // The backchannel does not report completed work, so conservatively
+    // assume any progress exhausted the quotas.
+    //
+    MoreData = XdpPollDispatch->InvokePoll(Backchannel, InvokeData->RxQuota, InvokeData->TxQuota);
+    InvokeData->RxCompleted = MoreData ? InvokeData->RxQuota : 0;
+    InvokeData->TxCompleted = MoreData ? InvokeData->TxQuota : 0;
+
+    return MoreData;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+XdpPollTryInvoke(
+    _In_ NDIS_POLL_BACKCHANNEL *Backchannel,
+    _Inout_ NDIS_POLL_BACKCHANNEL_INVOKE_DATA *InvokeData
+    )
+{
+    //
+    // Older backchannels cannot poll opportunistically, so the caller falls
+    // back to requesting a poll.
+    //
+    if (XdpPollDispatch->TryInvokePoll == NULL) {
+        return FALSE;
+    }
+
+    return XdpPollDispatch->TryInvokePoll(Backchannel, InvokeData);
+}
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
 XdpPollSetNotifications(
@@ -49,3 +49,116 @@ XdpDecrementReferenceCount(
 
     return NewValue == 0;
 }
+
+//
+// A reference count sharded across processors, for objects referenced from
+// many processors concurrently. References are counted in a per-processor
+// shard, so they do not contend on a shared cache line, until the owner
+// releases the initial reference by draining the shards into the shared
+// count. After draining, the count behaves like an XDP_REFERENCE_COUNT.
+//
+
+#define XDP_REFERENCE_COUNT_SHARD_DRAINED MINLONG64
+
+typedef struct DECLSPEC_CACHEALIGN _XDP_REFERENCE_COUNT_SHARD {
+    INT64 Count;
+} XDP_REFERENCE_COUNT_SHARD;
+
+typedef struct _XDP_SHARDED_REFERENCE_COUNT {
+    XDP_REFERENCE_COUNT Shared;
+    UINT32 ShardCount;
+    XDP_REFERENCE_COUNT_SHARD *Shards;
+} XDP_SHARDED_REFERENCE_COUNT;
+
+//
+// Initializes the count with the owner's initial reference. The count remains
+// usable, albeit unsharded, if the shards cannot be allocated.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+XdpInitializeShardedReferenceCount(
+    _Out_ XDP_SHARDED_REFERENCE_COUNT *RefCount
+    );
+
+//
+// Frees the shards once the count has reached zero.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpCleanupShardedReferenceCount(
+    _Inout_ XDP_SHARDED_REFERENCE_COUNT *RefCount
+    );
+
+//
+// Releases the owner's initial reference. Folds the shards into the shared
+// count, so that releasing the last reference can be detected. Returns TRUE
+// if no references remain.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+XdpDrainShardedReferenceCount(
+    _Inout_ XDP_SHARDED_REFERENCE_COUNT *RefCount
+    );
+
+//
+// Adds Delta to the current processor's shard. Returns FALSE if the shards
+// were drained, in which case the shared count must be used instead. The
+// caller may be rescheduled to another processor, since the counts of all
+// shards are summed when draining.
+//
+inline
+BOOLEAN
+XdpAddReferenceCountShard(
+    _Inout_ XDP_SHARDED_REFERENCE_COUNT *RefCount,
+    _In_ INT64 Delta
+    )
+{
+    INT64 *Count;
+    INT64 OldValue;
+    INT64 Value;
+
+    if (RefCount->Shards == NULL) {
+        return FALSE;
+    }
+
+    Count = &RefCount->Shards[KeGetCurrentProcessorIndex()].Count;
+    OldValue = ReadNoFence64(Count);
+
+    while (OldValue != XDP_REFERENCE_COUNT_SHARD_DRAINED) {
+        Value = InterlockedCompareExchange64(Count, OldValue + Delta, OldValue);
+        if (Value == OldValue) {
+            return TRUE;
+        }
+        OldValue = Value;
+    }
+
+    return FALSE;
+}
+
+inline
+VOID
+XdpIncrementShardedReferenceCount(
+    _Inout_ XDP_SHARDED_REFERENCE_COUNT *RefCount
+    )
+{
+    if (!XdpAddReferenceCountShard(RefCount, 1)) {
+        XdpIncrementReferenceCount(&RefCount->Shared);
+    }
+}
+
+inline
+BOOLEAN
+XdpDecrementShardedReferenceCount(
+    _Inout_ XDP_SHARDED_REFERENCE_COUNT *RefCount
+    )
+{
+    //
+    // Until the shards are drained, the shared count holds the initial
+    // reference, so releasing a reference to a shard never releases the last.
+    //
+    if (XdpAddReferenceCountShard(RefCount, -1)) {
+        return FALSE;
+    }
+
+    return XdpDecrementReferenceCount(&RefCount->Shared);
+}
@@ -96,6 +96,31 @@ RtlReleasePushLockShared(
     _Inout_ EX_PUSH_LOCK *Lock
     );
 
+//
+// Returns the NUMA node of the processor, or MM_ANY_NODE_OK if the node cannot
+// be determined.
+//
+_IRQL_requires_max_(PASSIVE_LEVEL)
+ULONG
+XdpGetProcessorNodeNumber(
+    _In_ const PROCESSOR_NUMBER *ProcessorNumber
+    );
+
+//
+// Allocates pool, preferring memory on the specified NUMA node. If the node is
+// MM_ANY_NODE_OK or the system cannot allocate by node, this is equivalent to
+// allocating without a node preference.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+_Must_inspect_result_
+VOID *
+XdpAllocatePoolOnNode(
+    _In_ POOL_FLAGS Flags,
+    _In_ SIZE_T NumberOfBytes,
+    _In_ ULONG Tag,
+    _In_ ULONG NodeNumber
+    );
+
 NTSTATUS
 XdpRtlStart(
     VOID
@@ -0,0 +1,82 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+//
+// A per-processor hierarchical timer wheel for large numbers of coarse timers.
+//
+// Entries are embedded in the caller's objects, so starting and canceling an
+// entry takes constant time and never allocates. A single periodic tick drives
+// every processor's wheel; the tick stops while all wheels are empty.
+//
+// Entries are started on the current processor's wheel and expire in a DPC on
+// that processor. Starts and cancels of a given entry must be serialized by
+// the caller; the wheel synchronizes them with expiration. Canceling does not
+// wait for a running expiration routine, so callers must keep the entry alive
+// until its routine has returned (e.g. by holding a reference while started).
+//
+
+typedef struct _XDP_TIMER_WHEEL XDP_TIMER_WHEEL;
+typedef struct _XDP_TIMER_WHEEL_ENTRY XDP_TIMER_WHEEL_ENTRY;
+
+typedef
+_IRQL_requires_(DISPATCH_LEVEL)
+VOID
+XDP_TIMER_WHEEL_ROUTINE(
+    _In_ XDP_TIMER_WHEEL_ENTRY *Entry
+    );
+
+typedef struct _XDP_TIMER_WHEEL_ENTRY {
+    LIST_ENTRY Link;
+    XDP_TIMER_WHEEL_ROUTINE *Routine;
+    UINT64 DueTick;
+    UINT32 Processor;
+} XDP_TIMER_WHEEL_ENTRY;
+
+_IRQL_requires_(PASSIVE_LEVEL)
+XDP_TIMER_WHEEL *
+XdpTimerWheelCreate(
+    _In_ UINT32 TickInMs
+    );
+
+//
+// Deletes a timer wheel. All entries must have been canceled or expired.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpTimerWheelDelete(
+    _In_ XDP_TIMER_WHEEL *Wheel
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpTimerWheelInitializeEntry(
+    _Out_ XDP_TIMER_WHEEL_ENTRY *Entry,
+    _In_ XDP_TIMER_WHEEL_ROUTINE *Routine
+    );
+
+//
+// Starts or restarts an entry. The due time is rounded up to whole ticks.
+// Returns TRUE if and only if the entry had been started and was canceled.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+XdpTimerWheelStart(
+    _In_ XDP_TIMER_WHEEL *Wheel,
+    _Inout_ XDP_TIMER_WHEEL_ENTRY *Entry,
+    _In_ UINT32 DueTimeInMs
+    );
+
+//
+// Cancels an entry. Returns TRUE if and only if the entry had been started and
+// was canceled before it expired.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+XdpTimerWheelCancel(
+    _In_ XDP_TIMER_WHEEL *Wheel,
+    _Inout_ XDP_TIMER_WHEEL_ENTRY *Entry
+    );
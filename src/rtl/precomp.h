@@ -5,6 +5,10 @@
 
 #pragma once
 
+#if USER_MODE
+#include <precomp.h>
+#else
+
 #pragma warning(disable:4201)  // nonstandard extension used: nameless struct/union
 
 #include <ntdef.h>
@@ -39,14 +43,19 @@ ZwNotifyChangeKey(
 #include <xdpregistry.h>
 #include <xdprtl.h>
 #include <xdptimer.h>
+#include <xdptimerwheel.h>
 #include <xdptrace.h>
 #include <xdpworkqueue.h>
 
 #pragma warning(disable:4200) // nonstandard extension used: zero-sized array in struct/union
 
 #define XDP_POOLTAG_LIFETIME    'LcdX' // XdcL
+#define XDP_POOLTAG_REFCOUNT    'CcdX' // XdcC
 #define XDP_POOLTAG_REGISTRY    'RcdX' // XdcR
 #define XDP_POOLTAG_TIMER       'TcdX' // XdcT
+#define XDP_POOLTAG_TIMER_WHEEL 'HcdX' // XdcH
 #define XDP_POOLTAG_WORKQUEUE   'WcdX' // XdcW
 
 extern EX_RUNDOWN_REF XdpRtlRundown;
+
+#endif // USER_MODE
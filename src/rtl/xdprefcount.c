@@ -0,0 +1,79 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#include "precomp.h"
+
+//
+// While draining, the shared count is biased, so that folding in a shard with
+// a negative count, e.g. from references acquired on one processor and
+// released on another, cannot drop the shared count to zero before all shards
+// are folded in.
+//
+#define XDP_REFERENCE_COUNT_DRAIN_BIAS (1i64 << 48)
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+XdpInitializeShardedReferenceCount(
+    _Out_ XDP_SHARDED_REFERENCE_COUNT *RefCount
+    )
+{
+    UINT32 ShardCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+    XdpInitializeReferenceCount(&RefCount->Shared);
+    RefCount->ShardCount = ShardCount;
+    RefCount->Shards =
+        ExAllocatePoolZero(
+            NonPagedPoolNxCacheAligned, sizeof(*RefCount->Shards) * ShardCount,
+            XDP_POOLTAG_REFCOUNT);
+    if (RefCount->Shards == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpCleanupShardedReferenceCount(
+    _Inout_ XDP_SHARDED_REFERENCE_COUNT *RefCount
+    )
+{
+    ASSERT(ReadNoFence64(&RefCount->Shared) == 0);
+
+    if (RefCount->Shards != NULL) {
+        ExFreePoolWithTag(RefCount->Shards, XDP_POOLTAG_REFCOUNT);
+        RefCount->Shards = NULL;
+    }
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+XdpDrainShardedReferenceCount(
+    _Inout_ XDP_SHARDED_REFERENCE_COUNT *RefCount
+    )
+{
+    if (RefCount->Shards != NULL) {
+        InterlockedAdd64(&RefCount->Shared, XDP_REFERENCE_COUNT_DRAIN_BIAS);
+
+        //
+        // Retire each shard atomically: references counted in a shard before
+        // it is retired are folded into the shared count, and references
+        // counted after it is retired use the shared count directly.
+        //
+        for (UINT32 Index = 0; Index < RefCount->ShardCount; Index++) {
+            INT64 Count =
+                InterlockedExchange64(
+                    &RefCount->Shards[Index].Count, XDP_REFERENCE_COUNT_SHARD_DRAINED);
+
+            FRE_ASSERT(Count != XDP_REFERENCE_COUNT_SHARD_DRAINED);
+            InterlockedAdd64(&RefCount->Shared, Count);
+        }
+
+        FRE_ASSERT(
+            InterlockedAdd64(&RefCount->Shared, -XDP_REFERENCE_COUNT_DRAIN_BIAS) > 0);
+    }
+
+    return XdpDecrementReferenceCount(&RefCount->Shared);
+}
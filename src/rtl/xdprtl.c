@@ -9,6 +9,23 @@ EX_RUNDOWN_REF XdpRtlRundown = {
     .Count = EX_RUNDOWN_ACTIVE
 };
 
+typedef
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID *
+XDP_EX_ALLOCATE_POOL3(
+    _In_ POOL_FLAGS Flags,
+    _In_ SIZE_T NumberOfBytes,
+    _In_ ULONG Tag,
+    _In_reads_opt_(ExtendedParametersCount) PCPOOL_EXTENDED_PARAMETER ExtendedParameters,
+    _In_ ULONG ExtendedParametersCount
+    );
+
+//
+// ExAllocatePool3 is unavailable on older Windows versions, so resolve it at
+// runtime.
+//
+static XDP_EX_ALLOCATE_POOL3 *XdpExAllocatePool3;
+
 _IRQL_requires_max_(APC_LEVEL)
 _Acquires_exclusive_lock_(Lock)
 VOID
@@ -118,13 +135,79 @@ RtlRandomNumberInRange(
     return Number;
 }
 
+_IRQL_requires_max_(PASSIVE_LEVEL)
+ULONG
+XdpGetProcessorNodeNumber(
+    _In_ const PROCESSOR_NUMBER *ProcessorNumber
+    )
+{
+    NTSTATUS Status;
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX Info = {0};
+    ULONG Length = sizeof(Info);
+
+    Status =
+        KeQueryLogicalProcessorRelationship(
+            (PROCESSOR_NUMBER *)ProcessorNumber, RelationNumaNode, &Info, &Length);
+    if (!NT_SUCCESS(Status)) {
+        return MM_ANY_NODE_OK;
+    }
+
+    return Info.NumaNode.NodeNumber;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+_Must_inspect_result_
+VOID *
+XdpAllocatePoolOnNode(
+    _In_ POOL_FLAGS Flags,
+    _In_ SIZE_T NumberOfBytes,
+    _In_ ULONG Tag,
+    _In_ ULONG NodeNumber
+    )
+{
+    POOL_TYPE PoolType;
+    XDP_EX_ALLOCATE_POOL3 *AllocatePool3 = ReadPointerNoFence((VOID **)&XdpExAllocatePool3);
+
+    if (NodeNumber != MM_ANY_NODE_OK && AllocatePool3 != NULL) {
+        POOL_EXTENDED_PARAMETER NodeParameter = {0};
+
+        NodeParameter.Type = PoolExtendedParameterNumaNode;
+        NodeParameter.PreferredNode = NodeNumber;
+
+        return AllocatePool3(Flags, NumberOfBytes, Tag, &NodeParameter, 1);
+    }
+
+    ASSERT((Flags & ~(POOL_FLAG_NON_PAGED | POOL_FLAG_PAGED | POOL_FLAG_CACHE_ALIGNED |
+        POOL_FLAG_UNINITIALIZED)) == 0);
+
+    if (Flags & POOL_FLAG_PAGED) {
+        PoolType = PagedPool;
+    } else if (Flags & POOL_FLAG_CACHE_ALIGNED) {
+        PoolType = NonPagedPoolNxCacheAligned;
+    } else {
+        PoolType = NonPagedPoolNx;
+    }
+
+    if (Flags & POOL_FLAG_UNINITIALIZED) {
+        return ExAllocatePoolUninitialized(PoolType, NumberOfBytes, Tag);
+    }
+
+    return ExAllocatePoolZero(PoolType, NumberOfBytes, Tag);
+}
+
 NTSTATUS
 XdpRtlStart(
     VOID
     )
 {
+    UNICODE_STRING RoutineName;
+
     ExReInitializeRundownProtection(&XdpRtlRundown);
 
+    RtlInitUnicodeString(&RoutineName, L"ExAllocatePool3");
+    WritePointerNoFence(
+        (VOID **)&XdpExAllocatePool3, MmGetSystemRoutineAddress(&RoutineName));
+
     return STATUS_SUCCESS;
 }
 
@@ -0,0 +1,448 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#include "precomp.h"
+#include "xdptimerwheel.tmh"
+
+//
+// Each processor's wheel has four levels of 64 slots. Level N slots each span
+// 64^N ticks; entries cascade to lower levels as their due tick approaches.
+// Entries due beyond the span of the wheel are parked in the last level and
+// re-placed each time they cascade.
+//
+#define XDP_TIMER_WHEEL_LEVELS 4
+#define XDP_TIMER_WHEEL_SLOT_BITS 6
+#define XDP_TIMER_WHEEL_SLOTS (1 << XDP_TIMER_WHEEL_SLOT_BITS)
+#define XDP_TIMER_WHEEL_SLOT_MASK (XDP_TIMER_WHEEL_SLOTS - 1)
+#define XDP_TIMER_WHEEL_SPAN (1ui64 << (XDP_TIMER_WHEEL_SLOT_BITS * XDP_TIMER_WHEEL_LEVELS))
+
+typedef struct _EX_TIMER EX_TIMER;
+
+typedef struct DECLSPEC_CACHEALIGN _XDP_TIMER_WHEEL_PROCESSOR {
+    KSPIN_LOCK Lock;
+    LONG Count;
+    UINT64 CurrentTick;
+    XDP_TIMER_WHEEL *Wheel;
+    KDPC Dpc;
+    LIST_ENTRY Slots[XDP_TIMER_WHEEL_LEVELS][XDP_TIMER_WHEEL_SLOTS];
+} XDP_TIMER_WHEEL_PROCESSOR;
+
+typedef struct _XDP_TIMER_WHEEL {
+    EX_TIMER *ExTimer;
+    UINT64 TickDuration;
+    UINT64 StartTime;
+    LONG Armed;
+    UINT32 ProcessorCount;
+    XDP_TIMER_WHEEL_PROCESSOR Processors[0];
+} XDP_TIMER_WHEEL;
+
+static EXT_CALLBACK XdpTimerWheelTick;
+static KDEFERRED_ROUTINE XdpTimerWheelDpc;
+
+static
+UINT64
+XdpTimerWheelGetTick(
+    _In_ const XDP_TIMER_WHEEL *Wheel
+    )
+{
+    //
+    // Use unbiased time so the wheel does not have to catch up on ticks that
+    // elapsed while the system was asleep.
+    //
+    return (KeQueryUnbiasedInterruptTime() - Wheel->StartTime) / Wheel->TickDuration;
+}
+
+static
+VOID
+XdpTimerWheelArm(
+    _In_ XDP_TIMER_WHEEL *Wheel
+    )
+{
+    if (ReadNoFence(&Wheel->Armed) == FALSE &&
+        InterlockedCompareExchange(&Wheel->Armed, TRUE, FALSE) == FALSE) {
+        ExSetTimer(
+            Wheel->ExTimer, -(LONGLONG)Wheel->TickDuration, (LONGLONG)Wheel->TickDuration, NULL);
+    }
+}
+
+static
+_Requires_lock_held_(Processor->Lock)
+VOID
+XdpTimerWheelInsert(
+    _In_ XDP_TIMER_WHEEL_PROCESSOR *Processor,
+    _In_ XDP_TIMER_WHEEL_ENTRY *Entry,
+    _In_ UINT64 BaseTick
+    )
+{
+    UINT64 DueTick = max(Entry->DueTick, BaseTick + 1);
+    UINT64 Delta = DueTick - BaseTick;
+    UINT32 Level;
+
+    //
+    // Place the entry in the lowest level whose span covers its due tick,
+    // relative to the last processed tick. Slots are indexed by absolute tick,
+    // so each slot is cascaded before any of its entries are due.
+    //
+    if (Delta >= XDP_TIMER_WHEEL_SPAN) {
+        DueTick = BaseTick + XDP_TIMER_WHEEL_SPAN - 1;
+        Delta = XDP_TIMER_WHEEL_SPAN - 1;
+    }
+
+    for (Level = 0; Level < XDP_TIMER_WHEEL_LEVELS - 1; Level++) {
+        if (Delta < (1ui64 << (XDP_TIMER_WHEEL_SLOT_BITS * (Level + 1)))) {
+            break;
+        }
+    }
+
+    InsertTailList(
+        &Processor->Slots[Level][
+            (DueTick >> (XDP_TIMER_WHEEL_SLOT_BITS * Level)) & XDP_TIMER_WHEEL_SLOT_MASK],
+        &Entry->Link);
+}
+
+static
+_Requires_lock_held_(Processor->Lock)
+VOID
+XdpTimerWheelCascade(
+    _In_ XDP_TIMER_WHEEL_PROCESSOR *Processor
+    )
+{
+    UINT64 Tick = Processor->CurrentTick;
+
+    //
+    // Each slot due for cascading on this tick holds entries due within its
+    // span from this tick, so they are placed in strictly lower levels, in
+    // slots that are cascaded after this tick.
+    //
+    for (UINT32 Level = XDP_TIMER_WHEEL_LEVELS - 1; Level > 0; Level--) {
+        LIST_ENTRY *Slot;
+        LIST_ENTRY SlotList;
+
+        if ((Tick & ((1ui64 << (XDP_TIMER_WHEEL_SLOT_BITS * Level)) - 1)) != 0) {
+            continue;
+        }
+
+        Slot =
+            &Processor->Slots[Level][
+                (Tick >> (XDP_TIMER_WHEEL_SLOT_BITS * Level)) & XDP_TIMER_WHEEL_SLOT_MASK];
+        if (IsListEmpty(Slot)) {
+            continue;
+        }
+
+        InitializeListHead(&SlotList);
+        AppendTailList(&SlotList, Slot);
+        RemoveEntryList(Slot);
+        InitializeListHead(Slot);
+
+        while (!IsListEmpty(&SlotList)) {
+            XDP_TIMER_WHEEL_ENTRY *Entry =
+                CONTAINING_RECORD(RemoveHeadList(&SlotList), XDP_TIMER_WHEEL_ENTRY, Link);
+
+            //
+            // Entries due on this tick must land in the level 0 slot that is
+            // about to expire.
+            //
+            if (Entry->DueTick <= Tick) {
+                InsertTailList(
+                    &Processor->Slots[0][Tick & XDP_TIMER_WHEEL_SLOT_MASK], &Entry->Link);
+            } else {
+                XdpTimerWheelInsert(Processor, Entry, Tick);
+            }
+        }
+    }
+}
+
+static
+_Function_class_(KDEFERRED_ROUTINE)
+_IRQL_requires_(DISPATCH_LEVEL)
+VOID
+XdpTimerWheelDpc(
+    _In_ KDPC *Dpc,
+    _In_opt_ VOID *DeferredContext,
+    _In_opt_ VOID *SystemArgument1,
+    _In_opt_ VOID *SystemArgument2
+    )
+{
+    XDP_TIMER_WHEEL_PROCESSOR *Processor = DeferredContext;
+    UINT64 NowTick;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+    ASSERT(Processor);
+
+    NowTick = XdpTimerWheelGetTick(Processor->Wheel);
+
+    KeAcquireSpinLockAtDpcLevel(&Processor->Lock);
+
+    while (Processor->Count > 0 && Processor->CurrentTick < NowTick) {
+        LIST_ENTRY *Slot;
+
+        Processor->CurrentTick++;
+        XdpTimerWheelCascade(Processor);
+
+        //
+        // Every entry in the current level 0 slot is due. Expire them one at
+        // a time so routines may restart their own entries; restarted entries
+        // are always placed in a later slot.
+        //
+        Slot = &Processor->Slots[0][Processor->CurrentTick & XDP_TIMER_WHEEL_SLOT_MASK];
+
+        while (!IsListEmpty(Slot)) {
+            XDP_TIMER_WHEEL_ENTRY *Entry =
+                CONTAINING_RECORD(RemoveHeadList(Slot), XDP_TIMER_WHEEL_ENTRY, Link);
+
+            InitializeListHead(&Entry->Link);
+            Processor->Count--;
+
+            KeReleaseSpinLockFromDpcLevel(&Processor->Lock);
+            Entry->Routine(Entry);
+            KeAcquireSpinLockAtDpcLevel(&Processor->Lock);
+        }
+    }
+
+    //
+    // An empty wheel has nothing to cascade, so skip straight to the present.
+    //
+    if (Processor->Count == 0 && Processor->CurrentTick < NowTick) {
+        Processor->CurrentTick = NowTick;
+    }
+
+    KeReleaseSpinLockFromDpcLevel(&Processor->Lock);
+}
+
+static
+_Function_class_(EXT_CALLBACK)
+_IRQL_requires_(DISPATCH_LEVEL)
+_IRQL_requires_same_
+VOID
+XdpTimerWheelTick(
+    _In_ EX_TIMER *ExTimer,
+    _In_opt_ VOID *Context
+    )
+{
+    XDP_TIMER_WHEEL *Wheel = Context;
+    BOOLEAN Active = FALSE;
+
+    UNREFERENCED_PARAMETER(ExTimer);
+    ASSERT(Wheel);
+
+    for (UINT32 Index = 0; Index < Wheel->ProcessorCount; Index++) {
+        XDP_TIMER_WHEEL_PROCESSOR *Processor = &Wheel->Processors[Index];
+
+        if (ReadNoFence(&Processor->Count) > 0) {
+            KeInsertQueueDpc(&Processor->Dpc, NULL, NULL);
+            Active = TRUE;
+        }
+    }
+
+    if (!Active) {
+        //
+        // Stop ticking while every wheel is empty. Disarm before re-checking
+        // the wheels, so a concurrent start either observes the disarmed tick
+        // and re-arms it or is observed here.
+        //
+        ExCancelTimer(Wheel->ExTimer, NULL);
+        InterlockedExchange(&Wheel->Armed, FALSE);
+
+        for (UINT32 Index = 0; Index < Wheel->ProcessorCount; Index++) {
+            if (ReadNoFence(&Wheel->Processors[Index].Count) > 0) {
+                XdpTimerWheelArm(Wheel);
+                break;
+            }
+        }
+    }
+}
+
+_IRQL_requires_(PASSIVE_LEVEL)
+XDP_TIMER_WHEEL *
+XdpTimerWheelCreate(
+    _In_ UINT32 TickInMs
+    )
+{
+    XDP_TIMER_WHEEL *Wheel = NULL;
+    UINT32 ProcessorCount;
+    SIZE_T Size;
+    NTSTATUS Status;
+
+    ASSERT(TickInMs > 0);
+
+    if (!ExAcquireRundownProtection(&XdpRtlRundown)) {
+        return NULL;
+    }
+
+    ProcessorCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+    Status = RtlSIZETMult(sizeof(XDP_TIMER_WHEEL_PROCESSOR), ProcessorCount, &Size);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = RtlSIZETAdd(Size, sizeof(*Wheel), &Size);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Wheel = ExAllocatePoolZero(NonPagedPoolNxCacheAligned, Size, XDP_POOLTAG_TIMER_WHEEL);
+    if (Wheel == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Wheel->TickDuration = RTL_MILLISEC_TO_100NANOSEC(TickInMs);
+    Wheel->StartTime = KeQueryUnbiasedInterruptTime();
+    Wheel->ProcessorCount = ProcessorCount;
+
+    for (UINT32 Index = 0; Index < ProcessorCount; Index++) {
+        XDP_TIMER_WHEEL_PROCESSOR *Processor = &Wheel->Processors[Index];
+        PROCESSOR_NUMBER ProcessorNumber;
+
+        KeInitializeSpinLock(&Processor->Lock);
+        Processor->Wheel = Wheel;
+
+        for (UINT32 Level = 0; Level < XDP_TIMER_WHEEL_LEVELS; Level++) {
+            for (UINT32 Slot = 0; Slot < XDP_TIMER_WHEEL_SLOTS; Slot++) {
+                InitializeListHead(&Processor->Slots[Level][Slot]);
+            }
+        }
+
+        KeInitializeDpc(&Processor->Dpc, XdpTimerWheelDpc, Processor);
+        NT_VERIFY(NT_SUCCESS(KeGetProcessorNumberFromIndex(Index, &ProcessorNumber)));
+        KeSetTargetProcessorDpcEx(&Processor->Dpc, &ProcessorNumber);
+    }
+
+    Wheel->ExTimer = ExAllocateTimer(XdpTimerWheelTick, Wheel, 0);
+    if (Wheel->ExTimer == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        TraceError(TRACE_RTL, "Failed to create timer wheel Status=%!STATUS!", Status);
+
+        if (Wheel != NULL) {
+            ExFreePoolWithTag(Wheel, XDP_POOLTAG_TIMER_WHEEL);
+            Wheel = NULL;
+        }
+
+        ExReleaseRundownProtection(&XdpRtlRundown);
+    }
+
+    return Wheel;
+}
+
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpTimerWheelDelete(
+    _In_ XDP_TIMER_WHEEL *Wheel
+    )
+{
+    //
+    // Stop the tick, then flush any expiration DPCs it queued.
+    //
+    ExDeleteTimer(Wheel->ExTimer, TRUE, TRUE, NULL);
+    KeFlushQueuedDpcs();
+
+    for (UINT32 Index = 0; Index < Wheel->ProcessorCount; Index++) {
+        FRE_ASSERT(Wheel->Processors[Index].Count == 0);
+    }
+
+    ExFreePoolWithTag(Wheel, XDP_POOLTAG_TIMER_WHEEL);
+    ExReleaseRundownProtection(&XdpRtlRundown);
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpTimerWheelInitializeEntry(
+    _Out_ XDP_TIMER_WHEEL_ENTRY *Entry,
+    _In_ XDP_TIMER_WHEEL_ROUTINE *Routine
+    )
+{
+    RtlZeroMemory(Entry, sizeof(*Entry));
+    InitializeListHead(&Entry->Link);
+    Entry->Routine = Routine;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+XdpTimerWheelCancel(
+    _In_ XDP_TIMER_WHEEL *Wheel,
+    _Inout_ XDP_TIMER_WHEEL_ENTRY *Entry
+    )
+{
+    XDP_TIMER_WHEEL_PROCESSOR *Processor = &Wheel->Processors[Entry->Processor];
+    KIRQL OldIrql;
+    BOOLEAN Canceled = FALSE;
+
+    KeAcquireSpinLock(&Processor->Lock, &OldIrql);
+
+    if (!IsListEmpty(&Entry->Link)) {
+        RemoveEntryList(&Entry->Link);
+        InitializeListHead(&Entry->Link);
+        Processor->Count--;
+        Canceled = TRUE;
+    }
+
+    KeReleaseSpinLock(&Processor->Lock, OldIrql);
+
+    return Canceled;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+XdpTimerWheelStart(
+    _In_ XDP_TIMER_WHEEL *Wheel,
+    _Inout_ XDP_TIMER_WHEEL_ENTRY *Entry,
+    _In_ UINT32 DueTimeInMs
+    )
+{
+    XDP_TIMER_WHEEL_PROCESSOR *Processor;
+    UINT64 DueTicks;
+    UINT64 NowTick;
+    KIRQL OldIrql;
+    BOOLEAN Canceled;
+
+    Canceled = XdpTimerWheelCancel(Wheel, Entry);
+
+    DueTicks = RTL_MILLISEC_TO_100NANOSEC(DueTimeInMs);
+    DueTicks = max((DueTicks + Wheel->TickDuration - 1) / Wheel->TickDuration, 1);
+
+    OldIrql = KeRaiseIrqlToDpcLevel();
+
+    Entry->Processor = KeGetCurrentProcessorIndex();
+    Processor = &Wheel->Processors[Entry->Processor];
+    NowTick = XdpTimerWheelGetTick(Wheel);
+
+    KeAcquireSpinLockAtDpcLevel(&Processor->Lock);
+
+    //
+    // An empty wheel is not ticked, so bring it up to date before placing the
+    // entry relative to its last processed tick.
+    //
+    if (Processor->Count == 0 && Processor->CurrentTick < NowTick) {
+        Processor->CurrentTick = NowTick;
+    }
+
+    Entry->DueTick = NowTick + DueTicks;
+    XdpTimerWheelInsert(Processor, Entry, Processor->CurrentTick);
+    Processor->Count++;
+
+    KeReleaseSpinLockFromDpcLevel(&Processor->Lock);
+
+    KeLowerIrql(OldIrql);
+
+    //
+    // Order the insertion before checking whether the tick is armed; pairs
+    // with the disarm in XdpTimerWheelTick.
+    //
+    KeMemoryBarrier();
+    XdpTimerWheelArm(Wheel);
+
+    return Canceled;
+}
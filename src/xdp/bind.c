@@ -110,8 +110,15 @@ static const XDP_VERSION XdpDriverApiCurrentVersion = {
     .Patch = XDP_DRIVER_API_PATCH_VER
 };
 
+//
+// Interface sets are indexed by IfIndex. Interface indices are allocated
+// densely, so the low bits are a sufficient hash.
+//
+#define XDP_IFSET_HASH_BUCKETS 64
+C_ASSERT(RTL_IS_POWER_OF_TWO(XDP_IFSET_HASH_BUCKETS));
+
 static EX_PUSH_LOCK XdpInterfaceSetsLock;
-static LIST_ENTRY XdpInterfaceSets;
+static LIST_ENTRY XdpInterfaceSets[XDP_IFSET_HASH_BUCKETS];
 static BOOLEAN XdpBindInitialized = FALSE;
 
 static
@@ -223,6 +230,14 @@ XdpIfpDereferenceIfSet(
     }
 }
 
+VOID
+XdpIfReferenceBinding(
+    _In_ XDP_BINDING_HANDLE BindingHandle
+    )
+{
+    XdpIfpReferenceInterface((XDP_INTERFACE *)BindingHandle);
+}
+
 VOID
 XdpIfDereferenceBinding(
     _In_ XDP_BINDING_HANDLE BindingHandle
@@ -548,6 +563,15 @@ Exit:
     return Status;
 }
 
+static
+LIST_ENTRY *
+XdpIfpGetIfSetBucket(
+    _In_ NET_IFINDEX IfIndex
+    )
+{
+    return &XdpInterfaceSets[IfIndex & (XDP_IFSET_HASH_BUCKETS - 1)];
+}
+
 static
 _IRQL_requires_(PASSIVE_LEVEL)
 _Requires_lock_held_(&XdpInterfaceSetsLock)
@@ -557,9 +581,10 @@ XdpIfpFindIfSet(
     )
 {
     XDP_INTERFACE_SET *IfSet = NULL;
-    LIST_ENTRY *Entry = XdpInterfaceSets.Flink;
+    LIST_ENTRY *Bucket = XdpIfpGetIfSetBucket(IfIndex);
+    LIST_ENTRY *Entry = Bucket->Flink;
 
-    while (Entry != &XdpInterfaceSets) {
+    while (Entry != Bucket) {
         XDP_INTERFACE_SET *Candidate = CONTAINING_RECORD(Entry, XDP_INTERFACE_SET, Link);
         Entry = Entry->Flink;
 
@@ -1173,6 +1198,18 @@ XdpIfpInterfaceWorker(
     _In_ SINGLE_LIST_ENTRY *WorkQueueHead
     )
 {
+    //
+    // Let each item in the batch start its asynchronous work first, so e.g.
+    // many sockets detaching from a queue share a single data path sync.
+    //
+    for (SINGLE_LIST_ENTRY *Entry = WorkQueueHead; Entry != NULL; Entry = Entry->Next) {
+        XDP_BINDING_WORKITEM *Item = CONTAINING_RECORD(Entry, XDP_BINDING_WORKITEM, Link);
+
+        if (Item->PrepareRoutine != NULL) {
+            Item->PrepareRoutine(Item);
+        }
+    }
+
     while (WorkQueueHead != NULL) {
         XDP_BINDING_WORKITEM *Item;
         XDP_INTERFACE *Interface;
@@ -1242,7 +1279,7 @@ XdpIfCreateInterfaceSet(
     XdpInitializeReferenceCount(&IfSet->OffloadReferenceCount);
     ExInitializePushLock(&IfSet->Lock);
     InitializeListHead(&IfSet->OffloadObjects);
-    InsertTailList(&XdpInterfaceSets, &IfSet->Link);
+    InsertTailList(XdpIfpGetIfSetBucket(IfIndex), &IfSet->Link);
 
     *InterfaceSetHandle = (XDPIF_INTERFACE_SET_HANDLE)IfSet;
     Status = STATUS_SUCCESS;
@@ -1424,6 +1461,8 @@ Exit:
                 XdpIfpDereferenceIfSet(IfSet);
             }
         }
+    } else {
+        XdpProgramNotifyInterfaceAdded(IfSet->IfIndex);
     }
 
     TraceExitStatus(TRACE_CORE);
@@ -1631,6 +1670,24 @@ XdpIfpDereferenceProvider(
     }
 }
 
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XdpIfReferenceProvider(
+    _In_ XDP_BINDING_HANDLE BindingHandle
+    )
+{
+    return XdpIfpReferenceProvider((XDP_INTERFACE *)BindingHandle);
+}
+
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpIfDereferenceProvider(
+    _In_ XDP_BINDING_HANDLE BindingHandle
+    )
+{
+    XdpIfpDereferenceProvider((XDP_INTERFACE *)BindingHandle);
+}
+
 static
 _IRQL_requires_(PASSIVE_LEVEL)
 NTSTATUS
@@ -1947,7 +2004,9 @@ XdpIfStart(
     )
 {
     ExInitializePushLock(&XdpInterfaceSetsLock);
-    InitializeListHead(&XdpInterfaceSets);
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(XdpInterfaceSets); Index++) {
+        InitializeListHead(&XdpInterfaceSets[Index]);
+    }
     XdpBindInitialized = TRUE;
     return STATUS_SUCCESS;
 }
@@ -1965,7 +2024,9 @@ XdpIfStop(
 
     RtlAcquirePushLockExclusive(&XdpInterfaceSetsLock);
 
-    ASSERT(IsListEmpty(&XdpInterfaceSets));
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(XdpInterfaceSets); Index++) {
+        ASSERT(IsListEmpty(&XdpInterfaceSets[Index]));
+    }
 
     RtlReleasePushLockExclusive(&XdpInterfaceSetsLock);
 }
@@ -27,9 +27,16 @@ XDP_BINDING_WORK_ROUTINE(
 //
 // Element of the per-binding serialized work queue.
 //
+// The binding worker drains every queued item on each wakeup. Before running
+// any work routine, it invokes the optional prepare routine of each item in
+// the batch, so items can start asynchronous operations (e.g. data path syncs)
+// that their work routines later wait for. Prepare routines must not assume
+// earlier items in the batch have run.
+//
 typedef struct _XDP_BINDING_WORKITEM {
     SINGLE_LIST_ENTRY Link;
     XDP_BINDING_HANDLE BindingHandle;
+    XDP_BINDING_WORK_ROUTINE *PrepareRoutine;
     XDP_BINDING_WORK_ROUTINE *WorkRoutine;
     UINT16 IdealNode;
 } XDP_BINDING_WORKITEM;
@@ -52,6 +59,11 @@ XdpIfFindAndReferenceIfSet(
     _In_opt_ XDP_INTERFACE_MODE *RequiredMode
     );
 
+VOID
+XdpIfReferenceBinding(
+    _In_ XDP_BINDING_HANDLE BindingHandle
+    );
+
 VOID
 XdpIfDereferenceBinding(
     _In_ XDP_BINDING_HANDLE BindingHandle
@@ -166,6 +178,7 @@ typedef enum _XDP_BINDING_CLIENT_ID {
     XDP_BINDING_CLIENT_ID_INVALID,
     XDP_BINDING_CLIENT_ID_RX_QUEUE,
     XDP_BINDING_CLIENT_ID_TX_QUEUE,
+    XDP_BINDING_CLIENT_ID_PROGRAM,
 } XDP_BINDING_CLIENT_ID;
 
 typedef struct _XDP_BINDING_CLIENT {
@@ -216,6 +229,23 @@ XdpIfGetIfIndex(
     _In_ XDP_BINDING_HANDLE BindingHandle
     );
 
+//
+// Opens the interface's driver, if needed, and holds it open without creating
+// any queues. Fails if the driver is detaching or detached. Must be invoked
+// from a binding work item.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XdpIfReferenceProvider(
+    _In_ XDP_BINDING_HANDLE BindingHandle
+    );
+
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpIfDereferenceProvider(
+    _In_ XDP_BINDING_HANDLE BindingHandle
+    );
+
 _IRQL_requires_(PASSIVE_LEVEL)
 NTSTATUS
 XdpIfCreateRxQueue(
@@ -404,6 +404,7 @@ XdpStop(
     XdpTxStop();
     XdpRxStop();
     XdpPollStop();
+    XdpFlightRecorderStop();
     XdpRegWatcherRemoveClient(XdpRegWatcher, &XdpRegWatcherEntry);
 
     if (XdpRegWatcher != NULL) {
@@ -457,6 +458,11 @@ XdpStart(
 
     XdpRegWatcherAddClient(XdpRegWatcher, XdpRegistryUpdate, &XdpRegWatcherEntry);
 
+    Status = XdpFlightRecorderStart();
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
     Status = XdpPollStart();
     if (!NT_SUCCESS(Status)) {
         goto Exit;
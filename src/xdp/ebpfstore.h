@@ -33,6 +33,37 @@ static const ebpf_helper_function_prototype_t EbpfXdpHelperFunctionPrototype[] =
             EBPF_ARGUMENT_TYPE_ANYTHING,
         },
     },
+    {
+        .header = EBPF_HELPER_FUNCTION_PROTOTYPE_HEADER,
+        .helper_id = XDP_EXT_HELPER_FUNCTION_START + 2,
+        .name = "bpf_xdp_redirect_xsk",
+        .return_type = EBPF_RETURN_TYPE_INTEGER,
+        .arguments = {
+            EBPF_ARGUMENT_TYPE_PTR_TO_CTX,
+            EBPF_ARGUMENT_TYPE_ANYTHING,
+            EBPF_ARGUMENT_TYPE_ANYTHING,
+        },
+    },
+    {
+        .header = EBPF_HELPER_FUNCTION_PROTOTYPE_HEADER,
+        .helper_id = XDP_EXT_HELPER_FUNCTION_START + 3,
+        .name = "bpf_xdp_adjust_meta",
+        .return_type = EBPF_RETURN_TYPE_INTEGER,
+        .arguments = {
+            EBPF_ARGUMENT_TYPE_PTR_TO_CTX,
+            EBPF_ARGUMENT_TYPE_ANYTHING,
+        },
+    },
+    {
+        .header = EBPF_HELPER_FUNCTION_PROTOTYPE_HEADER,
+        .helper_id = XDP_EXT_HELPER_FUNCTION_START + 4,
+        .name = "bpf_xdp_adjust_tail",
+        .return_type = EBPF_RETURN_TYPE_INTEGER,
+        .arguments = {
+            EBPF_ARGUMENT_TYPE_PTR_TO_CTX,
+            EBPF_ARGUMENT_TYPE_ANYTHING,
+        },
+    },
 };
 
 static const ebpf_program_type_descriptor_t EbpfXdpProgramTypeDescriptor = {
@@ -10,6 +10,7 @@ typedef struct _XDP_EXTENSION_ENTRY {
     BOOLEAN InterfaceRegistered;
     BOOLEAN InternalExtension;
     BOOLEAN Assigned;
+    BOOLEAN Hot;
     UINT8 Size;
     UINT8 Alignment;
     UINT16 AssignedOffset;
@@ -106,26 +107,31 @@ XdpExtensionSetAssignLayout(
     //
     // TODO: This layout algorithm is nowhere near optimal.
     //
-    // Make two passes through the extensions: first constrained by the initial
-    // offset and then unconstrained for the remainder. Assigning extensions by
-    // decreasing alignment reduces padding.
+    // Hot extensions are assigned before all others, so the extensions touched
+    // for every frame share cache lines with the frame or buffer header.
+    //
+    // Within each group, make two passes through the extensions: first
+    // constrained by the initial offset and then unconstrained for the
+    // remainder. Assigning extensions by decreasing alignment reduces padding.
     //
 
     qsort(
         ExtensionSet->Entries, ExtensionSet->Count, sizeof(ExtensionSet->Entries[0]),
         XdpExtensionSetCompare);
 
-    for (UINT8 Iteration = 0; Iteration <= 1; Iteration++) {
+    for (UINT8 Iteration = 0; Iteration <= 3; Iteration++) {
+        const BOOLEAN HotPass = Iteration < 2;
+
         for (UINT16 Index = 0; Index < ExtensionSet->Count; Index++) {
             XDP_EXTENSION_ENTRY *Entry = &ExtensionSet->Entries[Index];
 
             FRE_ASSERT(!Entry->Enabled || Entry->InternalExtension || Entry->InterfaceRegistered);
 
-            if (!Entry->Enabled || Entry->Assigned) {
+            if (!Entry->Enabled || Entry->Assigned || Entry->Hot != HotPass) {
                 continue;
             }
 
-            if (Iteration == 1) {
+            if (Iteration % 2 == 1) {
                 //
                 // Insert padding to force alignment.
                 //
@@ -304,6 +310,7 @@ XdpExtensionSetCreate(
         Entry->Info = Reg->Info;
         Entry->Size = Reg->Size;
         Entry->Alignment = Reg->Alignment;
+        Entry->Hot = Reg->Hot;
     }
 
     *ExtensionSet = Set;
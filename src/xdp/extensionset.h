@@ -11,6 +11,11 @@ typedef struct _XDP_EXTENSION_REGISTRATION {
     XDP_EXTENSION_INFO Info;
     UINT8 Size;
     UINT8 Alignment;
+    //
+    // The extension is accessed for every frame on the data path and is laid
+    // out ahead of other extensions, adjacent to the frame or buffer header.
+    //
+    BOOLEAN Hot;
 } XDP_EXTENSION_REGISTRATION;
 
 NTSTATUS
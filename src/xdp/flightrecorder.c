@@ -0,0 +1,228 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#include "precomp.h"
+#include "flightrecorder.tmh"
+
+//
+// The number of records in each per-processor ring. Zero disables the flight
+// recorder. Changes take effect when the driver restarts.
+//
+#define XDP_DEFAULT_FLIGHT_RECORDER_SIZE 1024
+#define XDP_MAX_FLIGHT_RECORDER_SIZE 65536
+
+// {d109fbcd-dd47-4cbc-b6e9-f7179198a5b3}
+static const GUID XdpFlightRecorderDumpGuid = {
+    0xd109fbcd, 0xdd47, 0x4cbc, { 0xb6, 0xe9, 0xf7, 0x17, 0x91, 0x98, 0xa5, 0xb3 }
+};
+
+XDP_FLIGHT_RECORDER XdpFlightRecorder;
+static KBUGCHECK_REASON_CALLBACK_RECORD XdpFlightRecorderBugCheckRecord;
+static BOOLEAN XdpFlightRecorderBugCheckRegistered;
+
+_Use_decl_annotations_
+NTSTATUS
+XdpIrpInterfaceFlightRecorderGet(
+    XDP_INTERFACE_OBJECT *InterfaceObject,
+    IRP *Irp,
+    IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    const XDP_FLIGHT_RECORDER_DUMP_HEADER *Header = XdpFlightRecorder.Header;
+    XDP_FLIGHT_RECORD *RecordsOut = Irp->AssociatedIrp.SystemBuffer;
+    SIZE_T OutputBufferLength = IrpSp->Parameters.DeviceIoControl.OutputBufferLength;
+    SIZE_T *BytesReturned = &Irp->IoStatus.Information;
+    UINT32 RequiredSize;
+
+    TraceEnter(TRACE_CORE, "Interface=%p", InterfaceObject);
+
+    *BytesReturned = 0;
+
+    if (Header == NULL) {
+        Status = STATUS_SUCCESS;
+        goto Exit;
+    }
+
+    //
+    // The rings are written concurrently, so the number of matching records
+    // is not known in advance: require space for every record.
+    //
+    RequiredSize = Header->RecordCount * Header->ProcessorCount * sizeof(*RecordsOut);
+
+    if (OutputBufferLength == 0 && (Irp->Flags & IRP_INPUT_OPERATION) == 0) {
+        *BytesReturned = RequiredSize;
+        Status = STATUS_BUFFER_OVERFLOW;
+        goto Exit;
+    }
+
+    if (OutputBufferLength < RequiredSize) {
+        TraceError(
+            TRACE_CORE,
+            "Interface=%p Output buffer length too small OutputBufferLength=%llu RequiredSize=%u",
+            InterfaceObject, (UINT64)OutputBufferLength, RequiredSize);
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    for (UINT32 Processor = 0; Processor < Header->ProcessorCount; Processor++) {
+        const XDP_FLIGHT_RECORD *Records = XdpFlightRecorderGetRecords(Processor);
+        UINT32 NextIndex = ReadUInt32Acquire(XdpFlightRecorderGetNextIndex(Processor));
+        UINT32 Count = min(NextIndex, Header->RecordCount);
+
+        //
+        // Records are copied without synchronizing with the data path, so the
+        // oldest records may be overwritten during the copy.
+        //
+        for (UINT32 Index = NextIndex - Count; Index != NextIndex; Index++) {
+            const XDP_FLIGHT_RECORD *Record = &Records[Index & XdpFlightRecorder.RecordMask];
+
+            if (Record->IfIndex == InterfaceObject->IfIndex) {
+                RtlCopyMemory(RecordsOut, Record, sizeof(*RecordsOut));
+                RecordsOut++;
+                *BytesReturned += sizeof(*RecordsOut);
+            }
+        }
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+static
+_Function_class_(KBUGCHECK_REASON_CALLBACK_ROUTINE)
+_IRQL_requires_same_
+VOID
+XdpFlightRecorderBugCheckCallback(
+    _In_ KBUGCHECK_CALLBACK_REASON Reason,
+    _In_ KBUGCHECK_REASON_CALLBACK_RECORD *Record,
+    _Inout_ VOID *ReasonSpecificData,
+    _In_ ULONG ReasonSpecificDataLength
+    )
+{
+    KBUGCHECK_SECONDARY_DUMP_DATA *DumpData = ReasonSpecificData;
+
+    UNREFERENCED_PARAMETER(Record);
+
+    if (Reason != KbCallbackSecondaryDumpData ||
+        ReasonSpecificDataLength < sizeof(*DumpData) ||
+        XdpFlightRecorder.Header == NULL) {
+        return;
+    }
+
+    //
+    // The flight recorder is nonpaged, so it is written to the dump directly.
+    //
+    DumpData->OutBuffer = XdpFlightRecorder.Header;
+    DumpData->OutBufferLength = min(XdpFlightRecorder.Size, DumpData->MaximumAllowed);
+    DumpData->Guid = XdpFlightRecorderDumpGuid;
+}
+
+NTSTATUS
+XdpFlightRecorderStart(
+    VOID
+    )
+{
+    NTSTATUS Status;
+    XDP_FLIGHT_RECORDER_DUMP_HEADER *Header;
+    UINT32 RecordCount;
+    UINT32 ProcessorCount;
+    UINT32 ProcessorStride;
+    UINT32 Size;
+    DWORD Value;
+
+    TraceEnter(TRACE_CORE, "-");
+
+    Status = XdpRegQueryDwordValue(XDP_PARAMETERS_KEY, L"XdpFlightRecorderSize", &Value);
+    if (NT_SUCCESS(Status) &&
+        (Value == 0 || (RTL_IS_POWER_OF_TWO(Value) && Value <= XDP_MAX_FLIGHT_RECORDER_SIZE))) {
+        RecordCount = Value;
+    } else {
+        RecordCount = XDP_DEFAULT_FLIGHT_RECORDER_SIZE;
+    }
+
+    if (RecordCount == 0) {
+        TraceInfo(TRACE_CORE, "Flight recorder disabled");
+        Status = STATUS_SUCCESS;
+        goto Exit;
+    }
+
+    ProcessorCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+    //
+    // Keep each processor's next index on a separate cache line.
+    //
+    ProcessorStride = SYSTEM_CACHE_ALIGNMENT_SIZE + RecordCount * sizeof(XDP_FLIGHT_RECORD);
+
+    Status = RtlUInt32Mult(ProcessorCount, ProcessorStride, &Size);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = RtlUInt32Add(Size, SYSTEM_CACHE_ALIGNMENT_SIZE, &Size);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Header = ExAllocatePoolZero(NonPagedPoolNx, Size, XDP_POOLTAG_FLIGHT_RECORDER);
+    if (Header == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Header->Signature = XDP_FLIGHT_RECORDER_DUMP_SIGNATURE;
+    Header->HeaderSize = SYSTEM_CACHE_ALIGNMENT_SIZE;
+    Header->RecordSize = sizeof(XDP_FLIGHT_RECORD);
+    Header->RecordOffset = SYSTEM_CACHE_ALIGNMENT_SIZE;
+    Header->RecordCount = RecordCount;
+    Header->ProcessorCount = ProcessorCount;
+    Header->ProcessorStride = ProcessorStride;
+
+    XdpFlightRecorder.Size = Size;
+    XdpFlightRecorder.RecordMask = RecordCount - 1;
+    XdpFlightRecorder.Header = Header;
+
+    KeInitializeCallbackRecord(&XdpFlightRecorderBugCheckRecord);
+    XdpFlightRecorderBugCheckRegistered =
+        KeRegisterBugCheckReasonCallback(
+            &XdpFlightRecorderBugCheckRecord, XdpFlightRecorderBugCheckCallback,
+            KbCallbackSecondaryDumpData, (UCHAR *)"XdpFlightRecorder");
+    if (!XdpFlightRecorderBugCheckRegistered) {
+        TraceWarn(TRACE_CORE, "Failed to register flight recorder bug check callback");
+    }
+
+    TraceInfo(
+        TRACE_CORE, "Flight recorder RecordCount=%u ProcessorCount=%u Size=%u",
+        RecordCount, ProcessorCount, Size);
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+VOID
+XdpFlightRecorderStop(
+    VOID
+    )
+{
+    if (XdpFlightRecorderBugCheckRegistered) {
+        KeDeregisterBugCheckReasonCallback(&XdpFlightRecorderBugCheckRecord);
+        XdpFlightRecorderBugCheckRegistered = FALSE;
+    }
+
+    if (XdpFlightRecorder.Header != NULL) {
+        ExFreePoolWithTag(XdpFlightRecorder.Header, XDP_POOLTAG_FLIGHT_RECORDER);
+        XdpFlightRecorder.Header = NULL;
+    }
+}
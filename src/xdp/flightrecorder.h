@@ -0,0 +1,109 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+#include "offload.h"
+
+//
+// The flight recorder is a single nonpaged allocation laid out exactly as it
+// appears in crash dumps: an XDP_FLIGHT_RECORDER_DUMP_HEADER followed by one
+// block per processor. Each block holds the index of the next record to write
+// on its own cache line, followed by a power-of-two ring of records.
+//
+typedef struct _XDP_FLIGHT_RECORDER {
+    XDP_FLIGHT_RECORDER_DUMP_HEADER *Header;
+    UINT32 Size;
+    UINT32 RecordMask;
+} XDP_FLIGHT_RECORDER;
+
+extern XDP_FLIGHT_RECORDER XdpFlightRecorder;
+
+FORCEINLINE
+UINT32 *
+XdpFlightRecorderGetNextIndex(
+    _In_ UINT32 Processor
+    )
+{
+    XDP_FLIGHT_RECORDER_DUMP_HEADER *Header = XdpFlightRecorder.Header;
+
+    return
+        (UINT32 *)RTL_PTR_ADD(
+            Header, Header->HeaderSize + (SIZE_T)Processor * Header->ProcessorStride);
+}
+
+FORCEINLINE
+XDP_FLIGHT_RECORD *
+XdpFlightRecorderGetRecords(
+    _In_ UINT32 Processor
+    )
+{
+    return
+        (XDP_FLIGHT_RECORD *)RTL_PTR_ADD(
+            XdpFlightRecorderGetNextIndex(Processor), XdpFlightRecorder.Header->RecordOffset);
+}
+
+//
+// Appends an event to the current processor's ring. Data path callers run at
+// DISPATCH_LEVEL, so each ring has a single writer and needs no interlocked
+// operations: the record is filled in place and published by a single store
+// to the ring's next index.
+//
+FORCEINLINE
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpFlightRecord(
+    _In_ XDP_FLIGHT_RECORD_EVENT Event,
+    _In_ UINT32 IfIndex,
+    _In_ UINT32 QueueId,
+    _In_ UINT32 ProducerIndex,
+    _In_ UINT32 ConsumerIndex,
+    _In_ UINT32 Count,
+    _In_ UINT8 Action
+    )
+{
+    UINT32 Processor;
+    UINT32 *NextIndex;
+    UINT32 Index;
+    XDP_FLIGHT_RECORD *Record;
+
+    if (XdpFlightRecorder.Header == NULL) {
+        return;
+    }
+
+    Processor = KeGetCurrentProcessorIndex();
+    NextIndex = XdpFlightRecorderGetNextIndex(Processor);
+    Index = *NextIndex;
+    Record = &XdpFlightRecorderGetRecords(Processor)[Index & XdpFlightRecorder.RecordMask];
+
+    Record->Timestamp = KeQueryPerformanceCounter(NULL).QuadPart;
+    Record->IfIndex = IfIndex;
+    Record->QueueId = QueueId;
+    Record->ProducerIndex = ProducerIndex;
+    Record->ConsumerIndex = ConsumerIndex;
+    Record->Count = Count;
+    Record->Processor = (UINT16)Processor;
+    Record->Event = (UINT8)Event;
+    Record->Action = Action;
+
+    WriteUInt32Release(NextIndex, Index + 1);
+}
+
+NTSTATUS
+XdpIrpInterfaceFlightRecorderGet(
+    _In_ XDP_INTERFACE_OBJECT *InterfaceObject,
+    _Inout_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    );
+
+NTSTATUS
+XdpFlightRecorderStart(
+    VOID
+    );
+
+VOID
+XdpFlightRecorderStop(
+    VOID
+    );
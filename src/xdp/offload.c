@@ -153,6 +153,7 @@ XdpIrpInterfaceOffloadRssGet(
     RssConfiguration = OutputBuffer;
     RssConfiguration->Header.Revision = XDP_RSS_CONFIGURATION_REVISION_1;
     RssConfiguration->Header.Size = XDP_SIZEOF_RSS_CONFIGURATION_REVISION_1;
+    RssConfiguration->Flags = RssParams.Flags & XDP_RSS_FLAG_SYMMETRIC_HASH;
     RssConfiguration->HashType = RssParams.HashType;
     RssConfiguration->HashSecretKeyOffset = sizeof(*RssConfiguration);
     RssConfiguration->HashSecretKeySize = RssParams.HashSecretKeySize;
@@ -348,12 +349,61 @@ Exit:
     return Status;
 }
 
+static
+NTSTATUS
+XdpIrpInterfaceTuningSet(
+    _In_ XDP_INTERFACE_OBJECT *InterfaceObject,
+    _In_ VOID *InputBuffer,
+    _In_ SIZE_T InputBufferLength
+    )
+{
+    NTSTATUS Status;
+    XDP_OFFLOAD_PARAMS_TUNING TuningParams = {0};
+
+    TraceEnter(TRACE_CORE, "Interface=%p", InterfaceObject);
+
+    if (InputBufferLength == 0 ||
+        InputBufferLength % sizeof(XDP_TUNING_SETTING) != 0 ||
+        InputBufferLength / sizeof(XDP_TUNING_SETTING) > MAXUINT32) {
+        TraceError(
+            TRACE_CORE,
+            "Interface=%p Invalid input buffer length InputBufferLength=%llu",
+            InterfaceObject, (UINT64)InputBufferLength);
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    //
+    // Settings are validated and applied by the interface. The system buffer
+    // remains valid for the duration of the synchronous request.
+    //
+    TuningParams.Settings = InputBuffer;
+    TuningParams.SettingCount = (UINT32)(InputBufferLength / sizeof(XDP_TUNING_SETTING));
+
+    Status =
+        XdpIfSetInterfaceOffload(
+            InterfaceObject->IfSetHandle, InterfaceObject->InterfaceOffloadHandle,
+            XdpOffloadTuning, &TuningParams, sizeof(TuningParams));
+
+Exit:
+
+    TraceInfo(
+        TRACE_CORE, "Interface=%p Status=%!STATUS! InputBuffer=%!HEXDUMP!",
+        InterfaceObject, Status, WppHexDump(InputBuffer, InputBufferLength));
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
 VOID
 XdpOffloadInitializeIfSettings(
     _Out_ XDP_OFFLOAD_IF_SETTINGS *OffloadIfSettings
     )
 {
     XdpOffloadQeoInitializeSettings(&OffloadIfSettings->Qeo);
+    XdpOffloadFlowSteeringInitializeSettings(&OffloadIfSettings->FlowSteering);
+    XdpOffloadDropFilterInitializeSettings(&OffloadIfSettings->DropFilter);
 }
 
 _IRQL_requires_max_(PASSIVE_LEVEL)
@@ -415,6 +465,7 @@ XdpIrpCreateInterface(
     InterfaceObject->Header.Dispatch = &XdpInterfaceFileDispatch;
     InterfaceObject->IfSetHandle = IfSetHandle;
     InterfaceObject->InterfaceOffloadHandle = InterfaceOffloadHandle;
+    InterfaceObject->IfIndex = Params->IfIndex;
     IrpSp->FileObject->FsContext = InterfaceObject;
     IfSetHandle = NULL;
     InterfaceOffloadHandle = NULL;
@@ -452,6 +503,8 @@ XdpOffloadRevertSettings(
     )
 {
     XdpOffloadQeoRevertSettings(IfSetHandle, InterfaceOffloadHandle);
+    XdpOffloadFlowSteeringRevertSettings(IfSetHandle, InterfaceOffloadHandle);
+    XdpOffloadDropFilterRevertSettings(IfSetHandle, InterfaceOffloadHandle);
 }
 
 static
@@ -516,6 +569,21 @@ XdpIrpInterfaceDeviceIoControl(
     case IOCTL_INTERFACE_OFFLOAD_QEO_SET:
         Status = XdpIrpInterfaceOffloadQeoSet(InterfaceObject, Irp, IrpSp);
         break;
+    case IOCTL_INTERFACE_OFFLOAD_FLOW_STEERING_SET:
+        Status = XdpIrpInterfaceOffloadFlowSteeringSet(InterfaceObject, Irp, IrpSp);
+        break;
+    case IOCTL_INTERFACE_OFFLOAD_FLOW_STEERING_GET:
+        Status = XdpIrpInterfaceOffloadFlowSteeringGet(InterfaceObject, Irp, IrpSp);
+        break;
+    case IOCTL_INTERFACE_FLIGHT_RECORDER_GET:
+        Status = XdpIrpInterfaceFlightRecorderGet(InterfaceObject, Irp, IrpSp);
+        break;
+    case IOCTL_INTERFACE_TUNING_SET:
+        Status =
+            XdpIrpInterfaceTuningSet(
+                InterfaceObject, Irp->AssociatedIrp.SystemBuffer,
+                IrpSp->Parameters.DeviceIoControl.InputBufferLength);
+        break;
     default:
         Status = STATUS_NOT_SUPPORTED;
         goto Exit;
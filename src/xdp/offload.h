@@ -11,16 +11,35 @@
 typedef struct _XDP_OFFLOAD_QEO_SETTINGS {
     EX_PUSH_LOCK Lock;
     LIST_ENTRY Connections;
+
+    //
+    // Connections are also indexed by their key. The table is created when
+    // the first connection is added and deleted when the last is removed.
+    //
+    RTL_DYNAMIC_HASH_TABLE *ConnectionTable;
 } XDP_OFFLOAD_QEO_SETTINGS;
 
+typedef struct _XDP_OFFLOAD_FLOW_STEERING_SETTINGS {
+    EX_PUSH_LOCK Lock;
+    LIST_ENTRY Filters;
+} XDP_OFFLOAD_FLOW_STEERING_SETTINGS;
+
+typedef struct _XDP_OFFLOAD_DROP_FILTER_SETTINGS {
+    EX_PUSH_LOCK Lock;
+    UINT32 FilterCount;
+} XDP_OFFLOAD_DROP_FILTER_SETTINGS;
+
 typedef struct _XDP_OFFLOAD_IF_SETTINGS {
     XDP_OFFLOAD_QEO_SETTINGS Qeo;
+    XDP_OFFLOAD_FLOW_STEERING_SETTINGS FlowSteering;
+    XDP_OFFLOAD_DROP_FILTER_SETTINGS DropFilter;
 } XDP_OFFLOAD_IF_SETTINGS;
 
 typedef struct _XDP_INTERFACE_OBJECT {
     XDP_FILE_OBJECT_HEADER Header;
     XDP_IFSET_HANDLE IfSetHandle;
     XDP_IF_OFFLOAD_HANDLE InterfaceOffloadHandle;
+    UINT32 IfIndex;
 } XDP_INTERFACE_OBJECT;
 
 _IRQL_requires_max_(PASSIVE_LEVEL)
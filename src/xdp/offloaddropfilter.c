@@ -0,0 +1,164 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+//
+// This module implements drop filter offload routines. Unlike flow steering
+// filters, drop filters are programmed by the core driver itself, on behalf
+// of program objects, and are replaced as a whole.
+//
+
+#include "precomp.h"
+#include "offloaddropfilter.tmh"
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XdpOffloadDropFilterSet(
+    _In_ XDP_IFSET_HANDLE IfSetHandle,
+    _In_ XDP_IF_OFFLOAD_HANDLE InterfaceOffloadHandle,
+    _In_reads_opt_(FilterCount) const XDP_OFFLOAD_DROP_FILTER *Filters,
+    _In_ UINT32 FilterCount
+    )
+{
+    XDP_OFFLOAD_DROP_FILTER_SETTINGS *DropFilterSettings;
+    XDP_OFFLOAD_PARAMS_DROP_FILTER DropFilterParams = {0};
+    NTSTATUS Status;
+
+    TraceEnter(
+        TRACE_CORE, "IfSetHandle=%p InterfaceOffloadHandle=%p FilterCount=%u",
+        IfSetHandle, InterfaceOffloadHandle, FilterCount);
+
+    DropFilterSettings =
+        &XdpIfGetOffloadIfSettings(IfSetHandle, InterfaceOffloadHandle)->DropFilter;
+
+    //
+    // Acquire an interface offload rundown reference to ensure offload cleanup
+    // waits until the recorded filter count matches the interface.
+    //
+    if (!XdpIfAcquireOffloadRundown(IfSetHandle)) {
+        Status = STATUS_DEVICE_NOT_READY;
+        goto Exit;
+    }
+
+    RtlAcquirePushLockExclusive(&DropFilterSettings->Lock);
+
+    if (FilterCount == 0 && DropFilterSettings->FilterCount == 0) {
+        Status = STATUS_SUCCESS;
+    } else {
+        DropFilterParams.Filters = Filters;
+        DropFilterParams.FilterCount = FilterCount;
+
+        Status =
+            XdpIfSetInterfaceOffload(
+                IfSetHandle, InterfaceOffloadHandle, XdpOffloadDropFilter, &DropFilterParams,
+                sizeof(DropFilterParams));
+        if (NT_SUCCESS(Status)) {
+            DropFilterSettings->FilterCount = FilterCount;
+        }
+    }
+
+    RtlReleasePushLockExclusive(&DropFilterSettings->Lock);
+
+    XdpIfReleaseOffloadRundown(IfSetHandle);
+
+Exit:
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XdpOffloadDropFilterGetHits(
+    _In_ XDP_IFSET_HANDLE IfSetHandle,
+    _In_ XDP_IF_OFFLOAD_HANDLE InterfaceOffloadHandle,
+    _Out_writes_(FilterCount) UINT64 *Hits,
+    _In_ UINT32 FilterCount
+    )
+{
+    XDP_OFFLOAD_DROP_FILTER_SETTINGS *DropFilterSettings;
+    XDP_OFFLOAD_PARAMS_DROP_FILTER DropFilterParams = {0};
+    UINT32 DropFilterParamsSize = sizeof(DropFilterParams);
+    NTSTATUS Status;
+
+    TraceEnter(
+        TRACE_CORE, "IfSetHandle=%p InterfaceOffloadHandle=%p FilterCount=%u",
+        IfSetHandle, InterfaceOffloadHandle, FilterCount);
+
+    RtlZeroMemory(Hits, sizeof(*Hits) * FilterCount);
+
+    DropFilterSettings =
+        &XdpIfGetOffloadIfSettings(IfSetHandle, InterfaceOffloadHandle)->DropFilter;
+
+    RtlAcquirePushLockShared(&DropFilterSettings->Lock);
+
+    if (FilterCount != DropFilterSettings->FilterCount) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    DropFilterParams.Hits = Hits;
+    DropFilterParams.FilterCount = FilterCount;
+
+    Status =
+        XdpIfGetInterfaceOffload(
+            IfSetHandle, InterfaceOffloadHandle, XdpOffloadDropFilter, &DropFilterParams,
+            &DropFilterParamsSize);
+
+Exit:
+
+    RtlReleasePushLockShared(&DropFilterSettings->Lock);
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+VOID
+XdpOffloadDropFilterInitializeSettings(
+    _Inout_ XDP_OFFLOAD_DROP_FILTER_SETTINGS *DropFilterSettings
+    )
+{
+    ExInitializePushLock(&DropFilterSettings->Lock);
+    DropFilterSettings->FilterCount = 0;
+}
+
+VOID
+XdpOffloadDropFilterRevertSettings(
+    _In_ XDP_IFSET_HANDLE IfSetHandle,
+    _In_ XDP_IF_OFFLOAD_HANDLE InterfaceOffloadHandle
+    )
+{
+    XDP_OFFLOAD_DROP_FILTER_SETTINGS *DropFilterSettings;
+    XDP_OFFLOAD_PARAMS_DROP_FILTER DropFilterParams = {0};
+    NTSTATUS Status;
+
+    DropFilterSettings =
+        &XdpIfGetOffloadIfSettings(IfSetHandle, InterfaceOffloadHandle)->DropFilter;
+
+    RtlAcquirePushLockExclusive(&DropFilterSettings->Lock);
+
+    if (DropFilterSettings->FilterCount == 0) {
+        goto Exit;
+    }
+
+    Status =
+        XdpIfRevertInterfaceOffload(
+            IfSetHandle, InterfaceOffloadHandle, XdpOffloadDropFilter, &DropFilterParams,
+            sizeof(DropFilterParams));
+    if (!NT_SUCCESS(Status)) {
+        TraceError(
+            TRACE_CORE,
+            "Failed to revert drop filters from interface "
+            "IfSetHandle=%p InterfaceOffloadHandle=%p Status=%!STATUS!",
+            IfSetHandle, InterfaceOffloadHandle, Status);
+    }
+
+    DropFilterSettings->FilterCount = 0;
+
+Exit:
+
+    RtlReleasePushLockExclusive(&DropFilterSettings->Lock);
+}
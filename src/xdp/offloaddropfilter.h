@@ -0,0 +1,44 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+#include "offload.h"
+
+VOID
+XdpOffloadDropFilterInitializeSettings(
+    _Inout_ XDP_OFFLOAD_DROP_FILTER_SETTINGS *DropFilterSettings
+    );
+
+VOID
+XdpOffloadDropFilterRevertSettings(
+    _In_ XDP_IFSET_HANDLE IfSetHandle,
+    _In_ XDP_IF_OFFLOAD_HANDLE InterfaceOffloadHandle
+    );
+
+//
+// Replaces the drop filters programmed via the interface offload handle. A
+// FilterCount of zero removes all filters.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XdpOffloadDropFilterSet(
+    _In_ XDP_IFSET_HANDLE IfSetHandle,
+    _In_ XDP_IF_OFFLOAD_HANDLE InterfaceOffloadHandle,
+    _In_reads_opt_(FilterCount) const XDP_OFFLOAD_DROP_FILTER *Filters,
+    _In_ UINT32 FilterCount
+    );
+
+//
+// Queries the number of frames each programmed drop filter has dropped.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XdpOffloadDropFilterGetHits(
+    _In_ XDP_IFSET_HANDLE IfSetHandle,
+    _In_ XDP_IF_OFFLOAD_HANDLE InterfaceOffloadHandle,
+    _Out_writes_(FilterCount) UINT64 *Hits,
+    _In_ UINT32 FilterCount
+    );
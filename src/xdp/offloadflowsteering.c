@@ -0,0 +1,492 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+//
+// This module implements flow steering offload routines.
+//
+
+#include "precomp.h"
+#include "offloadflowsteering.tmh"
+
+typedef enum _XDP_OFFLOAD_FLOW_STEERING_FILTER_STATE {
+    XdpOffloadFlowSteeringInvalid,
+    XdpOffloadFlowSteeringAdding,
+    XdpOffloadFlowSteeringAdded,
+    XdpOffloadFlowSteeringRemoving,
+} XDP_OFFLOAD_FLOW_STEERING_FILTER_STATE;
+
+typedef struct _XDP_OFFLOAD_FLOW_STEERING_FILTER {
+    LIST_ENTRY Entry;
+    XDP_OFFLOAD_FLOW_STEERING_FILTER_STATE State;
+    HRESULT *OutputResult;
+    XDP_OFFLOAD_PARAMS_FLOW_STEERING_FILTER Offload;
+} XDP_OFFLOAD_FLOW_STEERING_FILTER;
+
+static
+BOOLEAN
+XdpOffloadFlowSteeringEqualFilters(
+    _In_ const XDP_FLOW_STEERING_FILTER *A,
+    _In_ const XDP_FLOW_STEERING_FILTER *B
+    )
+{
+    return
+        A->AddressFamily == B->AddressFamily &&
+        A->Protocol == B->Protocol &&
+        A->SourcePort == B->SourcePort &&
+        A->DestinationPort == B->DestinationPort &&
+        RtlEqualMemory(A->SourceAddress, B->SourceAddress, sizeof(A->SourceAddress)) &&
+        RtlEqualMemory(
+            A->DestinationAddress, B->DestinationAddress, sizeof(A->DestinationAddress));
+}
+
+static
+_Requires_lock_held_(FlowSteeringSettings->Lock)
+XDP_OFFLOAD_FLOW_STEERING_FILTER *
+XdpOffloadFlowSteeringFindFilter(
+    _In_ XDP_OFFLOAD_FLOW_STEERING_SETTINGS *FlowSteeringSettings,
+    _In_ const XDP_FLOW_STEERING_FILTER *FilterKey
+    )
+{
+    LIST_ENTRY *Entry = FlowSteeringSettings->Filters.Flink;
+
+    while (Entry != &FlowSteeringSettings->Filters) {
+        XDP_OFFLOAD_FLOW_STEERING_FILTER *Filter =
+            CONTAINING_RECORD(Entry, XDP_OFFLOAD_FLOW_STEERING_FILTER, Entry);
+        Entry = Entry->Flink;
+
+        if (XdpOffloadFlowSteeringEqualFilters(&Filter->Offload.Params, FilterKey)) {
+            return Filter;
+        }
+    }
+
+    return NULL;
+}
+
+static
+_Requires_exclusive_lock_held_(FlowSteeringSettings->Lock)
+VOID
+XdpOffloadFlowSteeringInvalidateFilter(
+    _In_ XDP_OFFLOAD_FLOW_STEERING_SETTINGS *FlowSteeringSettings,
+    _In_ XDP_OFFLOAD_FLOW_STEERING_FILTER *Filter
+    )
+{
+    UNREFERENCED_PARAMETER(FlowSteeringSettings);
+
+    ASSERT(Filter->State != XdpOffloadFlowSteeringInvalid);
+    ASSERT(!IsListEmpty(&Filter->Entry));
+    ASSERT(IsListEmpty(&Filter->Offload.TransactionEntry));
+    ASSERT(Filter->OutputResult == NULL);
+
+    Filter->State = XdpOffloadFlowSteeringInvalid;
+    RemoveEntryList(&Filter->Entry);
+    ExFreePoolWithTag(Filter, XDP_POOLTAG_OFFLOAD_FLOW);
+}
+
+static
+BOOLEAN
+XdpOffloadFlowSteeringValidateFilter(
+    _In_ const XDP_FLOW_STEERING_FILTER *Filter
+    )
+{
+    static const UINT8 WildcardAddress[RTL_FIELD_SIZE(XDP_FLOW_STEERING_FILTER, SourceAddress)];
+
+    if ((UINT32)Filter->Operation > (UINT32)XDP_FLOW_STEERING_OPERATION_REMOVE ||
+        (UINT32)Filter->AddressFamily > (UINT32)XDP_FLOW_STEERING_ADDRESS_FAMILY_INET6 ||
+        (UINT32)Filter->Protocol > (UINT32)XDP_FLOW_STEERING_PROTOCOL_TCP) {
+        return FALSE;
+    }
+
+    //
+    // The destination tuple must be fully specified.
+    //
+    if (Filter->DestinationPort == 0 ||
+        RtlEqualMemory(Filter->DestinationAddress, WildcardAddress, sizeof(WildcardAddress))) {
+        return FALSE;
+    }
+
+    if (Filter->Operation == XDP_FLOW_STEERING_OPERATION_ADD &&
+        Filter->QueueId >= XDP_DEDICATED_QUEUE_ID_BASE &&
+        Filter->QueueId - XDP_DEDICATED_QUEUE_ID_BASE >= XDP_DEDICATED_QUEUE_COUNT) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+NTSTATUS
+XdpIrpInterfaceOffloadFlowSteeringSet(
+    _In_ XDP_INTERFACE_OBJECT *InterfaceObject,
+    _Inout_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    XDP_OFFLOAD_FLOW_STEERING_SETTINGS *FlowSteeringSettings;
+    XDP_OFFLOAD_PARAMS_FLOW_STEERING FlowSteeringParams = {0};
+    const XDP_FLOW_STEERING_FILTER *FiltersIn = Irp->AssociatedIrp.SystemBuffer;
+    UINT32 InputBufferLength = IrpSp->Parameters.DeviceIoControl.InputBufferLength;
+    UINT32 OutputBufferLength = IrpSp->Parameters.DeviceIoControl.OutputBufferLength;
+    BOOLEAN RundownAcquired = FALSE;
+    BOOLEAN LockHeld = FALSE;
+
+    TraceEnter(TRACE_CORE, "Interface=%p", InterfaceObject);
+
+    InitializeListHead(&FlowSteeringParams.Filters);
+    FlowSteeringParams.FilterCount = 0;
+
+    FlowSteeringSettings =
+        &XdpIfGetOffloadIfSettings(
+            InterfaceObject->IfSetHandle, InterfaceObject->InterfaceOffloadHandle)->FlowSteering;
+
+    if (InputBufferLength == 0 || OutputBufferLength != InputBufferLength) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    //
+    // Acquire an interface offload rundown reference to ensure offload cleanup
+    // waits until all flow steering pre- and post-processing has completed.
+    //
+    if (XdpIfAcquireOffloadRundown(InterfaceObject->IfSetHandle)) {
+        RundownAcquired = TRUE;
+    } else {
+        Status = STATUS_DEVICE_NOT_READY;
+        goto Exit;
+    }
+
+    RtlAcquirePushLockExclusive(&FlowSteeringSettings->Lock);
+    LockHeld = TRUE;
+
+    while (InputBufferLength > 0) {
+        XDP_OFFLOAD_FLOW_STEERING_FILTER *OffloadFilter = NULL;
+
+        //
+        // Validate input.
+        //
+
+        if (InputBufferLength < sizeof(FiltersIn->Header) ||
+            InputBufferLength < FiltersIn->Header.Size) {
+            TraceError(
+                TRACE_CORE,
+                "Interface=%p Input buffer length too small InputBufferLength=%u",
+                InterfaceObject, InputBufferLength);
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+
+        if (FiltersIn->Header.Revision != XDP_FLOW_STEERING_FILTER_REVISION_1 ||
+            FiltersIn->Header.Size < XDP_SIZEOF_FLOW_STEERING_FILTER_REVISION_1) {
+            TraceError(
+                TRACE_CORE, "Interface=%p Unsupported revision Revision=%u Size=%u",
+                InterfaceObject, FiltersIn->Header.Revision, FiltersIn->Header.Size);
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+
+        if (!XdpOffloadFlowSteeringValidateFilter(FiltersIn)) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+
+        switch (FiltersIn->Operation) {
+        case XDP_FLOW_STEERING_OPERATION_ADD:
+            if (XdpOffloadFlowSteeringFindFilter(FlowSteeringSettings, FiltersIn)) {
+                Status = STATUS_DUPLICATE_OBJECTID;
+                goto Exit;
+            }
+
+            OffloadFilter =
+                ExAllocatePoolZero(
+                    NonPagedPoolNx, sizeof(*OffloadFilter), XDP_POOLTAG_OFFLOAD_FLOW);
+            if (OffloadFilter == NULL) {
+                Status = STATUS_NO_MEMORY;
+                goto Exit;
+            }
+
+            OffloadFilter->State = XdpOffloadFlowSteeringAdding;
+            RtlCopyMemory(
+                &OffloadFilter->Offload.Params, FiltersIn,
+                sizeof(OffloadFilter->Offload.Params));
+            OffloadFilter->Offload.Params.Header.Size = XDP_SIZEOF_FLOW_STEERING_FILTER_REVISION_1;
+            InsertTailList(&FlowSteeringParams.Filters, &OffloadFilter->Offload.TransactionEntry);
+            InsertTailList(&FlowSteeringSettings->Filters, &OffloadFilter->Entry);
+
+            break;
+        case XDP_FLOW_STEERING_OPERATION_REMOVE:
+            OffloadFilter = XdpOffloadFlowSteeringFindFilter(FlowSteeringSettings, FiltersIn);
+            if (OffloadFilter == NULL) {
+                Status = STATUS_NOT_FOUND;
+                goto Exit;
+            }
+
+            if (OffloadFilter->State != XdpOffloadFlowSteeringAdded) {
+                Status = STATUS_INVALID_DEVICE_STATE;
+                goto Exit;
+            }
+
+            OffloadFilter->State = XdpOffloadFlowSteeringRemoving;
+            OffloadFilter->Offload.Params.Operation = XDP_FLOW_STEERING_OPERATION_REMOVE;
+            ASSERT(IsListEmpty(&OffloadFilter->Offload.TransactionEntry));
+            InsertTailList(&FlowSteeringParams.Filters, &OffloadFilter->Offload.TransactionEntry);
+
+            break;
+        default:
+            ASSERT(FALSE);
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+
+        OffloadFilter->Offload.Params.Status = HRESULT_FROM_WIN32(ERROR_IO_PENDING);
+
+        //
+        // Store a pointer to the filter's status field in the output buffer.
+        // Cast away the const-ness for this field only.
+        //
+        ASSERT(OffloadFilter->OutputResult == NULL);
+        OffloadFilter->OutputResult = (HRESULT *)&FiltersIn->Status;
+
+        InputBufferLength -= FiltersIn->Header.Size;
+        FiltersIn = RTL_PTR_ADD(FiltersIn, FiltersIn->Header.Size);
+        FlowSteeringParams.FilterCount++;
+    }
+
+    RtlReleasePushLockExclusive(&FlowSteeringSettings->Lock);
+    LockHeld = FALSE;
+
+    ASSERT(InputBufferLength == 0);
+
+    //
+    // Issue the internal request to the interface.
+    //
+    Status =
+        XdpIfSetInterfaceOffload(
+            InterfaceObject->IfSetHandle, InterfaceObject->InterfaceOffloadHandle,
+            XdpOffloadFlowSteering, &FlowSteeringParams, sizeof(FlowSteeringParams));
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+Exit:
+
+    if (!LockHeld) {
+        RtlAcquirePushLockExclusive(&FlowSteeringSettings->Lock);
+        LockHeld = TRUE;
+    }
+
+    while (!IsListEmpty(&FlowSteeringParams.Filters)) {
+        LIST_ENTRY *Entry = RemoveHeadList(&FlowSteeringParams.Filters);
+        XDP_OFFLOAD_FLOW_STEERING_FILTER *Filter =
+            CONTAINING_RECORD(Entry, XDP_OFFLOAD_FLOW_STEERING_FILTER, Offload.TransactionEntry);
+
+        InitializeListHead(&Filter->Offload.TransactionEntry);
+
+        if (NT_SUCCESS(Status)) {
+            ASSERT(Filter->OutputResult != NULL);
+            *Filter->OutputResult = Filter->Offload.Params.Status;
+        }
+
+        Filter->OutputResult = NULL;
+
+        switch (Filter->State) {
+        case XdpOffloadFlowSteeringAdding:
+            if (NT_SUCCESS(Status) && SUCCEEDED(Filter->Offload.Params.Status)) {
+                Filter->State = XdpOffloadFlowSteeringAdded;
+            } else {
+                XdpOffloadFlowSteeringInvalidateFilter(FlowSteeringSettings, Filter);
+            }
+
+            break;
+
+        case XdpOffloadFlowSteeringRemoving:
+            if (NT_SUCCESS(Status) && SUCCEEDED(Filter->Offload.Params.Status)) {
+                XdpOffloadFlowSteeringInvalidateFilter(FlowSteeringSettings, Filter);
+            } else {
+                Filter->State = XdpOffloadFlowSteeringAdded;
+                Filter->Offload.Params.Operation = XDP_FLOW_STEERING_OPERATION_ADD;
+                Filter->Offload.Params.Status = S_OK;
+            }
+
+            break;
+
+        default:
+            FRE_ASSERT(FALSE);
+            break;
+        }
+    }
+
+    if (LockHeld) {
+        RtlReleasePushLockExclusive(&FlowSteeringSettings->Lock);
+    }
+
+    if (RundownAcquired) {
+        XdpIfReleaseOffloadRundown(InterfaceObject->IfSetHandle);
+    }
+
+    if (NT_SUCCESS(Status)) {
+        Irp->IoStatus.Information = OutputBufferLength;
+    }
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+NTSTATUS
+XdpIrpInterfaceOffloadFlowSteeringGet(
+    _In_ XDP_INTERFACE_OBJECT *InterfaceObject,
+    _Inout_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    XDP_OFFLOAD_FLOW_STEERING_SETTINGS *FlowSteeringSettings;
+    XDP_FLOW_STEERING_FILTER *FiltersOut = Irp->AssociatedIrp.SystemBuffer;
+    SIZE_T OutputBufferLength = IrpSp->Parameters.DeviceIoControl.OutputBufferLength;
+    SIZE_T *BytesReturned = &Irp->IoStatus.Information;
+    UINT32 RequiredSize = 0;
+    LIST_ENTRY *Entry;
+
+    TraceEnter(TRACE_CORE, "Interface=%p", InterfaceObject);
+
+    FlowSteeringSettings =
+        &XdpIfGetOffloadIfSettings(
+            InterfaceObject->IfSetHandle, InterfaceObject->InterfaceOffloadHandle)->FlowSteering;
+
+    *BytesReturned = 0;
+
+    RtlAcquirePushLockShared(&FlowSteeringSettings->Lock);
+
+    for (Entry = FlowSteeringSettings->Filters.Flink;
+        Entry != &FlowSteeringSettings->Filters;
+        Entry = Entry->Flink) {
+        XDP_OFFLOAD_FLOW_STEERING_FILTER *Filter =
+            CONTAINING_RECORD(Entry, XDP_OFFLOAD_FLOW_STEERING_FILTER, Entry);
+
+        if (Filter->State == XdpOffloadFlowSteeringAdded ||
+            Filter->State == XdpOffloadFlowSteeringRemoving) {
+            RequiredSize += sizeof(*FiltersOut);
+        }
+    }
+
+    if (OutputBufferLength == 0 && RequiredSize > 0 && (Irp->Flags & IRP_INPUT_OPERATION) == 0) {
+        *BytesReturned = RequiredSize;
+        Status = STATUS_BUFFER_OVERFLOW;
+        goto Exit;
+    }
+
+    if (OutputBufferLength < RequiredSize) {
+        TraceError(
+            TRACE_CORE,
+            "Interface=%p Output buffer length too small OutputBufferLength=%llu RequiredSize=%u",
+            InterfaceObject, (UINT64)OutputBufferLength, RequiredSize);
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    for (Entry = FlowSteeringSettings->Filters.Flink;
+        Entry != &FlowSteeringSettings->Filters;
+        Entry = Entry->Flink) {
+        XDP_OFFLOAD_FLOW_STEERING_FILTER *Filter =
+            CONTAINING_RECORD(Entry, XDP_OFFLOAD_FLOW_STEERING_FILTER, Entry);
+
+        if (Filter->State == XdpOffloadFlowSteeringAdded ||
+            Filter->State == XdpOffloadFlowSteeringRemoving) {
+            RtlCopyMemory(FiltersOut, &Filter->Offload.Params, sizeof(*FiltersOut));
+            FiltersOut->Operation = XDP_FLOW_STEERING_OPERATION_ADD;
+            FiltersOut->Status = S_OK;
+            FiltersOut++;
+        }
+    }
+
+    *BytesReturned = RequiredSize;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    RtlReleasePushLockShared(&FlowSteeringSettings->Lock);
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+VOID
+XdpOffloadFlowSteeringInitializeSettings(
+    _Inout_ XDP_OFFLOAD_FLOW_STEERING_SETTINGS *FlowSteeringSettings
+    )
+{
+    ExInitializePushLock(&FlowSteeringSettings->Lock);
+    InitializeListHead(&FlowSteeringSettings->Filters);
+}
+
+VOID
+XdpOffloadFlowSteeringRevertSettings(
+    _In_ XDP_IFSET_HANDLE IfSetHandle,
+    _In_ XDP_IF_OFFLOAD_HANDLE InterfaceOffloadHandle
+    )
+{
+    XDP_OFFLOAD_FLOW_STEERING_SETTINGS *FlowSteeringSettings;
+    XDP_OFFLOAD_PARAMS_FLOW_STEERING FlowSteeringParams = {0};
+    LIST_ENTRY *Entry;
+    NTSTATUS Status;
+
+    FlowSteeringSettings =
+        &XdpIfGetOffloadIfSettings(IfSetHandle, InterfaceOffloadHandle)->FlowSteering;
+
+    RtlAcquirePushLockExclusive(&FlowSteeringSettings->Lock);
+
+    if (IsListEmpty(&FlowSteeringSettings->Filters)) {
+        goto Exit;
+    }
+
+    InitializeListHead(&FlowSteeringParams.Filters);
+
+    for (Entry = FlowSteeringSettings->Filters.Flink;
+        Entry != &FlowSteeringSettings->Filters;
+        Entry = Entry->Flink) {
+        XDP_OFFLOAD_FLOW_STEERING_FILTER *Filter =
+            CONTAINING_RECORD(Entry, XDP_OFFLOAD_FLOW_STEERING_FILTER, Entry);
+
+        FRE_ASSERT(Filter->State == XdpOffloadFlowSteeringAdded);
+        Filter->State = XdpOffloadFlowSteeringRemoving;
+        Filter->Offload.Params.Operation = XDP_FLOW_STEERING_OPERATION_REMOVE;
+        Filter->Offload.Params.Status = HRESULT_FROM_WIN32(ERROR_IO_PENDING);
+        InsertTailList(&FlowSteeringParams.Filters, &Filter->Offload.TransactionEntry);
+        FlowSteeringParams.FilterCount++;
+    }
+
+    RtlReleasePushLockExclusive(&FlowSteeringSettings->Lock);
+
+    Status =
+        XdpIfRevertInterfaceOffload(
+            IfSetHandle, InterfaceOffloadHandle, XdpOffloadFlowSteering, &FlowSteeringParams,
+            sizeof(FlowSteeringParams));
+
+    RtlAcquirePushLockExclusive(&FlowSteeringSettings->Lock);
+
+    while (!IsListEmpty(&FlowSteeringParams.Filters)) {
+        Entry = RemoveHeadList(&FlowSteeringParams.Filters);
+        XDP_OFFLOAD_FLOW_STEERING_FILTER *Filter =
+            CONTAINING_RECORD(Entry, XDP_OFFLOAD_FLOW_STEERING_FILTER, Offload.TransactionEntry);
+
+        FRE_ASSERT(Filter->State == XdpOffloadFlowSteeringRemoving);
+
+        InitializeListHead(&Filter->Offload.TransactionEntry);
+
+        if (!NT_SUCCESS(Status) || FAILED(Filter->Offload.Params.Status)) {
+            TraceError(
+                TRACE_CORE,
+                "Failed to revert flow steering filter from interface "
+                "IfSetHandle=%p InterfaceOffloadHandle=%p Status=%!STATUS! Filter.Status=%!HRESULT!",
+                IfSetHandle, InterfaceOffloadHandle, Status, Filter->Offload.Params.Status);
+        }
+
+        XdpOffloadFlowSteeringInvalidateFilter(FlowSteeringSettings, Filter);
+    }
+
+Exit:
+
+    RtlReleasePushLockExclusive(&FlowSteeringSettings->Lock);
+}
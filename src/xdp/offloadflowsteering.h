@@ -0,0 +1,33 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+#include "offload.h"
+
+VOID
+XdpOffloadFlowSteeringInitializeSettings(
+    _Inout_ XDP_OFFLOAD_FLOW_STEERING_SETTINGS *FlowSteeringSettings
+    );
+
+VOID
+XdpOffloadFlowSteeringRevertSettings(
+    _In_ XDP_IFSET_HANDLE IfSetHandle,
+    _In_ XDP_IF_OFFLOAD_HANDLE InterfaceOffloadHandle
+    );
+
+NTSTATUS
+XdpIrpInterfaceOffloadFlowSteeringSet(
+    _In_ XDP_INTERFACE_OBJECT *InterfaceObject,
+    _Inout_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    );
+
+NTSTATUS
+XdpIrpInterfaceOffloadFlowSteeringGet(
+    _In_ XDP_INTERFACE_OBJECT *InterfaceObject,
+    _Inout_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    );
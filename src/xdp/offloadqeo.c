@@ -10,6 +10,9 @@
 #include "precomp.h"
 #include "offloadqeo.tmh"
 
+#define XDP_OFFLOAD_QEO_HASH_BASIS 0x811C9DC5ui32
+#define XDP_OFFLOAD_QEO_HASH_PRIME 0x01000193ui32
+
 typedef enum _XDP_OFFLOAD_QEO_CONNECTION_STATE {
     XdpOffloadQeoInvalid,
     XdpOffloadQeoAdding,
@@ -19,6 +22,7 @@ typedef enum _XDP_OFFLOAD_QEO_CONNECTION_STATE {
 
 typedef struct _XDP_OFFLOAD_QEO_CONNECTION {
     LIST_ENTRY Entry;
+    RTL_DYNAMIC_HASH_TABLE_ENTRY HashEntry;
     XDP_OFFLOAD_QEO_CONNECTION_STATE State;
     HRESULT *OutputResult;
     XDP_OFFLOAD_PARAMS_QEO_CONNECTION Offload;
@@ -42,6 +46,55 @@ XdpOffloadQeoEqualConnections(
         RtlEqualMemory(A->ConnectionId, B->ConnectionId, A->ConnectionIdLength);
 }
 
+static
+UINT32
+XdpOffloadQeoHashUpdate(
+    _In_ UINT32 Hash,
+    _In_reads_bytes_(Length) const VOID *Data,
+    _In_ UINT32 Length
+    )
+{
+    const UINT8 *Bytes = Data;
+
+    //
+    // FNV-1a.
+    //
+    for (UINT32 i = 0; i < Length; i++) {
+        Hash ^= Bytes[i];
+        Hash *= XDP_OFFLOAD_QEO_HASH_PRIME;
+    }
+
+    return Hash;
+}
+
+static
+ULONG_PTR
+XdpOffloadQeoHashConnection(
+    _In_ const XDP_QUIC_CONNECTION *ConnectionKey
+    )
+{
+    UINT32 Hash = XDP_OFFLOAD_QEO_HASH_BASIS;
+
+    //
+    // Hash exactly the fields compared by XdpOffloadQeoEqualConnections.
+    //
+    ASSERT(ConnectionKey->ConnectionIdLength <= sizeof(ConnectionKey->ConnectionId));
+    Hash =
+        XdpOffloadQeoHashUpdate(
+            Hash, &ConnectionKey->Direction, sizeof(ConnectionKey->Direction));
+    Hash =
+        XdpOffloadQeoHashUpdate(
+            Hash, &ConnectionKey->AddressFamily, sizeof(ConnectionKey->AddressFamily));
+    Hash =
+        XdpOffloadQeoHashUpdate(
+            Hash, &ConnectionKey->UdpPort, sizeof(ConnectionKey->UdpPort));
+    Hash =
+        XdpOffloadQeoHashUpdate(
+            Hash, ConnectionKey->ConnectionId, ConnectionKey->ConnectionIdLength);
+
+    return Hash;
+}
+
 static
 _Requires_lock_held_(QeoSettings->Lock)
 XDP_OFFLOAD_QEO_CONNECTION *
@@ -50,21 +103,65 @@ XdpOffloadQeoFindOffloadedConnection(
     _In_ const XDP_QUIC_CONNECTION *ConnectionKey
     )
 {
-    LIST_ENTRY *Entry = QeoSettings->Connections.Flink;
+    RTL_DYNAMIC_HASH_TABLE_CONTEXT Context;
+    RTL_DYNAMIC_HASH_TABLE_ENTRY *Entry;
+
+    if (QeoSettings->ConnectionTable == NULL) {
+        return NULL;
+    }
 
-    while (Entry != &QeoSettings->Connections) {
+    Entry =
+        RtlLookupEntryHashTable(
+            QeoSettings->ConnectionTable, XdpOffloadQeoHashConnection(ConnectionKey),
+            &Context);
+
+    while (Entry != NULL) {
         XDP_OFFLOAD_QEO_CONNECTION *Connection =
-            CONTAINING_RECORD(Entry, XDP_OFFLOAD_QEO_CONNECTION, Entry);
-        Entry = Entry->Flink;
+            CONTAINING_RECORD(Entry, XDP_OFFLOAD_QEO_CONNECTION, HashEntry);
 
         if (XdpOffloadQeoEqualConnections(&Connection->Offload.Params, ConnectionKey)) {
             return Connection;
         }
+
+        Entry = RtlGetNextEntryHashTable(QeoSettings->ConnectionTable, &Context);
     }
 
     return NULL;
 }
 
+static
+_Requires_exclusive_lock_held_(QeoSettings->Lock)
+NTSTATUS
+XdpOffloadQeoInsertConnection(
+    _In_ XDP_OFFLOAD_QEO_SETTINGS *QeoSettings,
+    _In_ XDP_OFFLOAD_QEO_CONNECTION *Connection
+    )
+{
+    RTL_DYNAMIC_HASH_TABLE *Table = QeoSettings->ConnectionTable;
+
+    if (Table == NULL) {
+        if (!RtlCreateHashTable(&QeoSettings->ConnectionTable, 0, 0)) {
+            return STATUS_NO_MEMORY;
+        }
+        Table = QeoSettings->ConnectionTable;
+    }
+
+    RtlInsertEntryHashTable(
+        Table, &Connection->HashEntry,
+        XdpOffloadQeoHashConnection(&Connection->Offload.Params), NULL);
+    InsertTailList(&QeoSettings->Connections, &Connection->Entry);
+
+    //
+    // Keep chains short as the table grows. Failing to expand only degrades
+    // lookups, so the result is ignored.
+    //
+    if (Table->NumEntries > Table->TableSize * 2) {
+        (VOID)RtlExpandHashTable(Table);
+    }
+
+    return STATUS_SUCCESS;
+}
+
 static
 VOID
 XdpOffloadQeoDereferenceConnection(
@@ -87,8 +184,6 @@ XdpOffloadQeoInvalidateConnection(
     _In_ XDP_OFFLOAD_QEO_CONNECTION *Connection
     )
 {
-    UNREFERENCED_PARAMETER(QeoSettings);
-
     ASSERT(Connection->State != XdpOffloadQeoInvalid);
     ASSERT(!IsListEmpty(&Connection->Entry));
     ASSERT(IsListEmpty(&Connection->Offload.TransactionEntry));
@@ -97,7 +192,15 @@ XdpOffloadQeoInvalidateConnection(
     Connection->State = XdpOffloadQeoInvalid;
     RemoveEntryList(&Connection->Entry);
     InitializeListHead(&Connection->Entry);
+    NT_VERIFY(
+        RtlRemoveEntryHashTable(QeoSettings->ConnectionTable, &Connection->HashEntry, NULL));
     XdpOffloadQeoDereferenceConnection(Connection);
+
+    if (QeoSettings->ConnectionTable->NumEntries == 0) {
+        ASSERT(IsListEmpty(&QeoSettings->Connections));
+        RtlDeleteHashTable(QeoSettings->ConnectionTable);
+        QeoSettings->ConnectionTable = NULL;
+    }
 }
 
 NTSTATUS
@@ -199,8 +302,14 @@ XdpIrpInterfaceOffloadQeoSet(
             RtlCopyMemory(
                 &OffloadConnection->Offload.Params, ConnectionsIn,
                 sizeof(OffloadConnection->Offload.Params));
+
+            Status = XdpOffloadQeoInsertConnection(QeoSettings, OffloadConnection);
+            if (!NT_SUCCESS(Status)) {
+                ExFreePoolWithTag(OffloadConnection, XDP_POOLTAG_OFFLOAD_QEO);
+                goto Exit;
+            }
+
             InsertTailList(&QeoParams.Connections, &OffloadConnection->Offload.TransactionEntry);
-            InsertTailList(&QeoSettings->Connections, &OffloadConnection->Entry);
 
             break;
         case XDP_QUIC_OPERATION_REMOVE:
@@ -16,6 +16,7 @@
 #include <ntifs.h>
 #include <ntintsafe.h>
 #include <ndis.h>
+#include <bcrypt.h>
 #include <wdmsec.h>
 
 //
@@ -50,10 +51,16 @@
 #include <xdp/buffervirtualaddress.h>
 #include <xdp/control.h>
 #include <xdp/datapath.h>
+#include <xdp/framechecksum.h>
 #include <xdp/framefragment.h>
+#include <xdp/framegso.h>
 #include <xdp/frameinterfacecontext.h>
+#include <xdp/framelayout.h>
 #include <xdp/framerxaction.h>
+#include <xdp/framerxmetadata.h>
+#include <xdp/frametimestamp.h>
 #include <xdp/txframecompletioncontext.h>
+#include <xdp/xsknpi.h>
 
 #include <xdpapi.h>
 #include <xdpapi_experimental.h>
@@ -68,7 +75,8 @@
 #include <xdprefcount.h>
 #include <xdpregistry.h>
 #include <xdprtl.h>
-#include <xdprxqueue_internal.h>
+#include <xdptimer.h>
+#include <xdptimerwheel.h>
 #include <xdptrace.h>
 #include <xdptransport.h>
 #include <xdptxqueue_internal.h>
@@ -82,7 +90,10 @@
 #include "dispatch.h"
 #include "ebpfextension.h"
 #include "extensionset.h"
+#include "flightrecorder.h"
 #include "offload.h"
+#include "offloaddropfilter.h"
+#include "offloadflowsteering.h"
 #include "offloadqeo.h"
 #include "program.h"
 #include "queue.h"
@@ -90,6 +101,7 @@
 #include "ring.h"
 #include "rx.h"
 #include "tx.h"
+#include "txtarget.h"
 #include "xsk.h"
 
 #endif // USER_MODE
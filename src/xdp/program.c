@@ -17,10 +17,10 @@ typedef struct _EBPF_PROG_TEST_RUN_CONTEXT {
     SIZE_T DataSize;
 } EBPF_PROG_TEST_RUN_CONTEXT;
 
-typedef struct _EBPF_XDP_MD {
-    xdp_md_t Base;
-    EBPF_PROG_TEST_RUN_CONTEXT* ProgTestRunContext;
-} EBPF_XDP_MD;
+//
+// eBPF program results not defined by eBPF-for-Windows.
+//
+#define XDP_REDIRECT 4
 
 static __forceinline NTSTATUS EbpfResultToNtStatus(ebpf_result_t Result)
 {
@@ -56,6 +56,10 @@ static void EbpfProgramTestRunContextFree(_In_opt_ _Post_invalid_ EBPF_PROG_TEST
  * @brief Build a EBPF_XDP_MD Context for the eBPF program. This includes copying the packet data and
  * metadata into a contiguous buffer and building an MDL chain for the same.
  *
+ * For BPF_PROG_TEST_RUN with a repeat count, the eBPF runtime invokes the program repeatedly on
+ * this single context and reports the average invocation duration, as Linux does for XDP. The
+ * context is not reset between invocations, so frame adjustments accumulate.
+ *
  * @param[in] DataIn The packet data.
  * @param[in] DataSizeIn The size of the packet data.
  * @param[in] context_in The Context.
@@ -112,6 +116,7 @@ XdpCreateContext(
     XdpMd->ProgTestRunContext->DataSize = DataSizeIn;
 
     XdpMd->Base.data = (void*)XdpMd->ProgTestRunContext->Data;
+    XdpMd->BufferStart = (UCHAR*)XdpMd->ProgTestRunContext->Data;
     XdpMd->Base.data_end = (void*)(XdpMd->ProgTestRunContext->Data + XdpMd->ProgTestRunContext->DataSize);
 
     if (context_in != NULL && ContextSizeIn >= sizeof(xdp_md_t)) {
@@ -196,10 +201,12 @@ Exit:
 //
 
 static
-XDP_RX_ACTION
-XdpInvokeEbpf(
-    _In_ HANDLE EbpfTarget,
+FORCEINLINE
+VOID
+XdpInitializeEbpfContext(
+    _Out_ EBPF_XDP_MD *XdpMd,
     _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_PCW_RX_QUEUE *RxQueueStats,
     _In_ XDP_FRAME *Frame,
     _In_opt_ XDP_RING *FragmentRing,
     _In_opt_ XDP_EXTENSION *FragmentExtension,
@@ -207,18 +214,8 @@ XdpInvokeEbpf(
     _In_ XDP_EXTENSION *VirtualAddressExtension
     )
 {
-    const EBPF_EXTENSION_CLIENT *Client = (const EBPF_EXTENSION_CLIENT *)EbpfTarget;
-    const VOID *ClientBindingContext = EbpfExtensionClientGetClientContext(Client);
-    XDP_PCW_RX_QUEUE *RxQueueStats = XdpRxQueueGetStatsFromInspectionContext(InspectionContext);
-    XDP_INSPECTION_EBPF_CONTEXT *EbpfContext = &InspectionContext->EbpfContext;
     XDP_BUFFER *Buffer;
     UCHAR *Va;
-    EBPF_XDP_MD XdpMd;
-    ebpf_result_t EbpfResult;
-    XDP_RX_ACTION RxAction;
-    UINT32 Result;
-
-    UNREFERENCED_PARAMETER(FragmentIndex);
 
     ASSERT((FragmentRing == NULL) || (FragmentExtension != NULL));
 
@@ -239,21 +236,51 @@ XdpInvokeEbpf(
 
     Buffer = &Frame->Buffer;
     Va = XdpGetVirtualAddressExtension(Buffer, VirtualAddressExtension)->VirtualAddress;
+    XdpMd->BufferStart = Va;
     Va += Buffer->DataOffset;
 
-    XdpMd.Base.data = Va;
-    XdpMd.Base.data_end = Va + Buffer->DataLength;
-    XdpMd.Base.data_meta = 0;
-    XdpMd.Base.ingress_ifindex = InspectionContext->IfIndex;
+    //
+    // The metadata area is initially empty and grows into the headroom via
+    // bpf_xdp_adjust_meta.
+    //
+    XdpMd->Base.data = Va;
+    XdpMd->Base.data_end = Va + Buffer->DataLength;
+    XdpMd->Base.data_meta = Va;
+    XdpMd->Base.ingress_ifindex = InspectionContext->IfIndex;
+    XdpMd->ProgTestRunContext = NULL;
+    XdpMd->InspectionContext = InspectionContext;
+    XdpMd->RedirectTarget = NULL;
+    XdpMd->Frame = Frame;
+    XdpMd->FragmentRing = FragmentRing;
+    XdpMd->FragmentExtension = FragmentExtension;
+    XdpMd->VirtualAddressExtension = VirtualAddressExtension;
+    XdpMd->FragmentIndex = FragmentIndex;
+    XdpMd->FrameModified = FALSE;
+}
 
-    ebpf_program_batch_invoke_function_t EbpfInvokeProgram =
-        EbpfExtensionClientGetProgramDispatch(Client)->ebpf_program_batch_invoke_function;
-    EbpfResult = EbpfInvokeProgram(ClientBindingContext, &XdpMd.Base, &Result, EbpfContext);
+static
+FORCEINLINE
+XDP_RX_ACTION
+XdpCompleteEbpfInvoke(
+    _In_ const VOID *ClientBindingContext,
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_PCW_RX_QUEUE *RxQueueStats,
+    _In_ EBPF_XDP_MD *XdpMd,
+    _In_ ebpf_result_t EbpfResult,
+    _In_ UINT32 Result,
+    _In_ UINT32 FrameIndex,
+    _In_ UINT32 FragmentIndex
+    )
+{
+    XDP_RX_ACTION RxAction;
+    UINT32 MetadataLength;
 
     if (EbpfResult != EBPF_SUCCESS) {
         EventWriteEbpfProgramFailure(&MICROSOFT_XDP_PROVIDER, ClientBindingContext, EbpfResult);
         RxAction = XDP_RX_ACTION_DROP;
         STAT_INC(RxQueueStats, InspectFramesDropped);
+        STAT_INC(RxQueueStats, InspectDropsEbpfFailure);
+        XdpRxQueueSampleDrop(RxQueueStats, XdpDropReasonEbpfFailure, 1, NULL, NULL);
         goto Exit;
     }
 
@@ -268,12 +295,41 @@ XdpInvokeEbpf(
         STAT_INC(RxQueueStats, InspectFramesForwarded);
         break;
 
+    case XDP_REDIRECT:
+        //
+        // Programs must select a target via a redirect helper; otherwise there
+        // is nowhere to redirect the frame to.
+        //
+        if (XdpMd->RedirectTarget == NULL) {
+            RxAction = XDP_RX_ACTION_DROP;
+            STAT_INC(RxQueueStats, InspectFramesDropped);
+            STAT_INC(RxQueueStats, InspectDropsEbpfFailure);
+            XdpRxQueueSampleDrop(RxQueueStats, XdpDropReasonEbpfFailure, 1, NULL, NULL);
+            break;
+        }
+
+        //
+        // The metadata remains in the frame headroom until the redirect batch
+        // is flushed.
+        //
+        MetadataLength = (UINT32)((UCHAR *)XdpMd->Base.data - (UCHAR *)XdpMd->Base.data_meta);
+        ASSERT(MetadataLength <= XDP_EBPF_METADATA_MAX_LENGTH);
+
+        XdpRedirect(
+            &InspectionContext->RedirectContext, FrameIndex, FragmentIndex, MetadataLength,
+            XDP_REDIRECT_TARGET_TYPE_XSK, XdpMd->RedirectTarget);
+        RxAction = XDP_RX_ACTION_DROP;
+        STAT_INC(RxQueueStats, InspectFramesRedirected);
+        break;
+
     default:
         ASSERT(FALSE);
         __fallthrough;
     case XDP_DROP:
         RxAction = XDP_RX_ACTION_DROP;
         STAT_INC(RxQueueStats, InspectFramesDropped);
+        STAT_INC(RxQueueStats, InspectDropsRule);
+        XdpRxQueueSampleDrop(RxQueueStats, XdpDropReasonRule, 1, NULL, NULL);
         break;
     }
 
@@ -282,6 +338,42 @@ Exit:
     return RxAction;
 }
 
+static
+XDP_RX_ACTION
+XdpInvokeEbpf(
+    _In_ HANDLE EbpfTarget,
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_FRAME *Frame,
+    _In_ UINT32 FrameIndex,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension
+    )
+{
+    const EBPF_EXTENSION_CLIENT *Client = (const EBPF_EXTENSION_CLIENT *)EbpfTarget;
+    const VOID *ClientBindingContext = EbpfExtensionClientGetClientContext(Client);
+    XDP_PCW_RX_QUEUE *RxQueueStats = XdpRxQueueGetStatsFromInspectionContext(InspectionContext);
+    EBPF_XDP_MD XdpMd;
+    ebpf_result_t EbpfResult;
+    UINT32 Result;
+
+    XdpInitializeEbpfContext(
+        &XdpMd, InspectionContext, RxQueueStats, Frame, FragmentRing, FragmentExtension,
+        FragmentIndex, VirtualAddressExtension);
+
+    ebpf_program_batch_invoke_function_t EbpfInvokeProgram =
+        EbpfExtensionClientGetProgramDispatch(Client)->ebpf_program_batch_invoke_function;
+    EbpfResult =
+        EbpfInvokeProgram(
+            ClientBindingContext, &XdpMd.Base, &Result, &InspectionContext->EbpfContext);
+
+    return
+        XdpCompleteEbpfInvoke(
+            ClientBindingContext, InspectionContext, RxQueueStats, &XdpMd, EbpfResult, Result,
+            FrameIndex, FragmentIndex);
+}
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 XDP_RX_ACTION
 XdpInspectEbpf(
@@ -307,10 +399,188 @@ XdpInspectEbpf(
 
     return
         XdpInvokeEbpf(
-            Program->Rules[0].Ebpf.Target, InspectionContext, Frame, FragmentRing,
+            Program->Rules[0].Ebpf.Target, InspectionContext, Frame, FrameIndex, FragmentRing,
             FragmentExtension, FragmentIndex, VirtualAddressExtension);
 }
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+XDP_RX_ACTION
+XdpInspectEbpfRule(
+    _In_ HANDLE EbpfTarget,
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_FRAME *Frame,
+    _In_ UINT32 FrameIndex,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension
+    )
+{
+    const EBPF_EXTENSION_CLIENT *Client = (const EBPF_EXTENSION_CLIENT *)EbpfTarget;
+    const ebpf_extension_program_dispatch_table_t *ProgramDispatch =
+        EbpfExtensionClientGetProgramDispatch(Client);
+    XDP_RX_ACTION RxAction;
+    ebpf_result_t EbpfResult;
+
+    //
+    // Native rules are not inspected within an eBPF invocation batch, so
+    // bracket each invocation with its own batch. Only frames matching the
+    // native rule pay this cost.
+    //
+    EbpfResult =
+        ProgramDispatch->ebpf_program_batch_begin_invoke_function(
+            sizeof(InspectionContext->EbpfContext), &InspectionContext->EbpfContext);
+    if (EbpfResult != EBPF_SUCCESS) {
+        XDP_PCW_RX_QUEUE *RxQueueStats =
+            XdpRxQueueGetStatsFromInspectionContext(InspectionContext);
+
+        EventWriteEbpfProgramFailure(
+            &MICROSOFT_XDP_PROVIDER, EbpfExtensionClientGetClientContext(Client), EbpfResult);
+        STAT_INC(RxQueueStats, InspectFramesDropped);
+        STAT_INC(RxQueueStats, InspectDropsEbpfFailure);
+        XdpRxQueueSampleDrop(
+            RxQueueStats, XdpDropReasonEbpfFailure, 1, Frame, VirtualAddressExtension);
+        return XDP_RX_ACTION_DROP;
+    }
+
+    RxAction =
+        XdpInvokeEbpf(
+            EbpfTarget, InspectionContext, Frame, FrameIndex, FragmentRing, FragmentExtension,
+            FragmentIndex, VirtualAddressExtension);
+
+    EbpfResult =
+        ProgramDispatch->ebpf_program_batch_end_invoke_function(&InspectionContext->EbpfContext);
+    ASSERT(EbpfResult == EBPF_SUCCESS);
+
+    return RxAction;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+UINT32
+XdpInspectEbpfBatch(
+    _In_ XDP_PROGRAM *Program,
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_RING *FrameRing,
+    _In_ UINT32 FrameIndex,
+    _In_ UINT32 FrameCount,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ XDP_EXTENSION *RxActionExtension
+    )
+{
+    const EBPF_EXTENSION_CLIENT *Client =
+        (const EBPF_EXTENSION_CLIENT *)Program->Rules[0].Ebpf.Target;
+    const VOID *ClientBindingContext = EbpfExtensionClientGetClientContext(Client);
+    ebpf_program_batch_invoke_function_t EbpfInvokeProgram =
+        EbpfExtensionClientGetProgramDispatch(Client)->ebpf_program_batch_invoke_function;
+    XDP_PCW_RX_QUEUE *RxQueueStats = XdpRxQueueGetStatsFromInspectionContext(InspectionContext);
+    XDP_EBPF_INVOKE_ENTRY *Entries = InspectionContext->EbpfInvokeBatch;
+    XDP_EBPF_FLOW_CACHE *FlowCache =
+        Program->EbpfFlowVerdictCache ? &InspectionContext->EbpfFlowCache : NULL;
+    UINT32 FragmentBufferCount = 0;
+
+    ASSERT(XdpProgramIsEbpf(Program));
+    ASSERT(FragmentRing == NULL || FragmentExtension != NULL);
+
+    //
+    // The client dispatch and binding context are resolved once for the whole
+    // batch. Within each chunk of the batch, all program contexts are built
+    // first, which also prefetches the frame data, then the program is invoked
+    // on each context back-to-back, then the results are applied. Frames of
+    // flows with a cached verdict skip the program entirely.
+    //
+    for (UINT32 Start = 0; Start < FrameCount; Start += XDP_EBPF_INVOKE_BATCH_SIZE) {
+        UINT32 Count = min(FrameCount - Start, XDP_EBPF_INVOKE_BATCH_SIZE);
+
+        for (UINT32 i = 0; i < Count; i++) {
+            XDP_EBPF_INVOKE_ENTRY *Entry = &Entries[i];
+
+            Entry->FrameIndex = (FrameIndex + Start + i) & FrameRing->Mask;
+            Entry->Frame = XdpRingGetElement(FrameRing, Entry->FrameIndex);
+            Entry->FragmentIndex = 0;
+
+            if (FragmentRing != NULL) {
+                Entry->FragmentIndex =
+                    (FragmentIndex + FragmentBufferCount) & FragmentRing->Mask;
+                FragmentBufferCount +=
+                    XdpGetFragmentExtension(Entry->Frame, FragmentExtension)->FragmentBufferCount;
+            }
+
+            Entry->FlowCacheEntry = NULL;
+            Entry->FlowCacheHit = FALSE;
+
+            if (FlowCache != NULL) {
+                UINT32 Hash;
+
+                if (XdpInspectGetEbpfFlowKey(
+                        InspectionContext, Entry->Frame, FragmentRing, FragmentExtension,
+                        Entry->FragmentIndex, VirtualAddressExtension, &Entry->FlowKey,
+                        &Hash)) {
+                    XDP_EBPF_FLOW_CACHE_ENTRY *CacheEntry =
+                        &FlowCache->Entries[Hash & (XDP_EBPF_FLOW_CACHE_SIZE - 1)];
+
+                    if (CacheEntry->Generation == FlowCache->Generation &&
+                        RtlEqualMemory(
+                            &CacheEntry->Key, &Entry->FlowKey, sizeof(Entry->FlowKey))) {
+                        Entry->Result = CacheEntry->Result;
+                        Entry->EbpfResult = EBPF_SUCCESS;
+                        Entry->FlowCacheHit = TRUE;
+                        STAT_INC(RxQueueStats, InspectFramesFlowCacheHits);
+                        continue;
+                    }
+
+                    Entry->FlowCacheEntry = CacheEntry;
+                }
+            }
+
+            XdpInitializeEbpfContext(
+                &Entry->XdpMd, InspectionContext, RxQueueStats, Entry->Frame, FragmentRing,
+                FragmentExtension, Entry->FragmentIndex, VirtualAddressExtension);
+
+            PreFetchCacheLine(PF_TEMPORAL_LEVEL_1, Entry->XdpMd.Base.data);
+        }
+
+        for (UINT32 i = 0; i < Count; i++) {
+            XDP_EBPF_INVOKE_ENTRY *Entry = &Entries[i];
+
+            if (Entry->FlowCacheHit) {
+                continue;
+            }
+
+            Entry->EbpfResult =
+                EbpfInvokeProgram(
+                    ClientBindingContext, &Entry->XdpMd.Base, &Entry->Result,
+                    &InspectionContext->EbpfContext);
+        }
+
+        for (UINT32 i = 0; i < Count; i++) {
+            XDP_EBPF_INVOKE_ENTRY *Entry = &Entries[i];
+
+            //
+            // Only verdicts that can be replayed without running the program,
+            // i.e. passing or dropping an unmodified frame, are cached.
+            //
+            if (Entry->FlowCacheEntry != NULL &&
+                Entry->EbpfResult == EBPF_SUCCESS &&
+                (Entry->Result == XDP_PASS || Entry->Result == XDP_DROP) &&
+                !Entry->XdpMd.FrameModified) {
+                Entry->FlowCacheEntry->Key = Entry->FlowKey;
+                Entry->FlowCacheEntry->Generation = FlowCache->Generation;
+                Entry->FlowCacheEntry->Result = Entry->Result;
+            }
+
+            XdpGetRxActionExtension(Entry->Frame, RxActionExtension)->RxAction =
+                XdpCompleteEbpfInvoke(
+                    ClientBindingContext, InspectionContext, RxQueueStats, &Entry->XdpMd,
+                    Entry->EbpfResult, Entry->Result, Entry->FrameIndex, Entry->FragmentIndex);
+        }
+    }
+
+    return FragmentBufferCount;
+}
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 _Success_(return)
 BOOLEAN
@@ -356,6 +626,31 @@ XdpInspectEbpfEndBatch(
     ASSERT(EbpfResult == EBPF_SUCCESS);
 }
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramInvalidateVerdictCaches(
+    _Inout_ XDP_INSPECTION_CONTEXT *InspectionContext
+    )
+{
+    XDP_EBPF_FLOW_CACHE *FlowCache = &InspectionContext->EbpfFlowCache;
+    XDP_FRAGMENT_CACHE *FragmentCache = &InspectionContext->FragmentCache;
+
+    //
+    // Advancing the generation invalidates every entry at once. Entries
+    // written before the generation wrapped would erroneously become valid
+    // again, so clear them on wraparound.
+    //
+    if (++FlowCache->Generation == 0) {
+        RtlZeroMemory(FlowCache->Entries, sizeof(FlowCache->Entries));
+        FlowCache->Generation = 1;
+    }
+
+    if (++FragmentCache->Generation == 0) {
+        RtlZeroMemory(FragmentCache->Entries, sizeof(FragmentCache->Entries));
+        FragmentCache->Generation = 1;
+    }
+}
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 VOID *
 XdpProgramGetXskBypassTarget(
@@ -373,6 +668,7 @@ XdpProgramGetXskBypassTarget(
 // Control path routines.
 //
 typedef struct _XDP_PROGRAM_OBJECT XDP_PROGRAM_OBJECT;
+typedef struct _XDP_PROGRAM_ALL_QUEUES_SET XDP_PROGRAM_ALL_QUEUES_SET;
 
 typedef struct _XDP_PROGRAM_BINDING {
     LIST_ENTRY Link;
@@ -382,15 +678,97 @@ typedef struct _XDP_PROGRAM_BINDING {
     XDP_PROGRAM_OBJECT *OwningProgram;
 } XDP_PROGRAM_BINDING;
 
+//
+// Per-rule hit counters of a program object. Each processor increments its
+// own cache-aligned slice; readers aggregate across processors.
+//
+typedef struct _XDP_RULE_COUNTER_SET {
+    UINT32 RuleCount;
+    UINT32 ProcessorCount;
+    SIZE_T ProcessorStride;
+
+    //
+    // Counters carried over from previous rule sets. Only written on the
+    // control path, before the counter set is published.
+    //
+    XDP_RULE_HIT_COUNTER *Base;
+
+    UCHAR *Processors;
+} XDP_RULE_COUNTER_SET;
+
+//
+// A connection tracking table shared by the program objects of an interface,
+// across all of its hooks. Referenced under XdpProgramConntrackLock.
+//
+typedef struct _XDP_PROGRAM_CONNTRACK {
+    LIST_ENTRY Link;
+    UINT32 IfIndex;
+    UINT32 ReferenceCount;
+    XDP_TIMER_WHEEL_ENTRY AgingEntry;
+    BOOLEAN AgingShutdown;
+    XDP_CONNTRACK_TABLE Table;
+} XDP_PROGRAM_CONNTRACK;
+
 typedef struct _XDP_PROGRAM_OBJECT {
     XDP_FILE_OBJECT_HEADER Header;
     XDP_BINDING_HANDLE IfHandle;
+    UINT32 IfIndex;
     LIST_ENTRY ProgramBindings;
     ULONG_PTR CreatedByPid;
 
-    XDP_PROGRAM Program;
+    //
+    // The connection tracking table of the interface, if any rule of this
+    // program object has used one.
+    //
+    XDP_PROGRAM_CONNTRACK *Conntrack;
+
+    //
+    // Optional rule counters. Once the program is attached, the object is
+    // linked into XdpProgramCountersObjects and the counter set is replaced
+    // only under XdpProgramCountersLock.
+    //
+    XDP_RULE_COUNTER_SET *RuleCounters;
+    LIST_ENTRY CountersLink;
+    UINT32 CountersId;
+    UINT32 CountersIfIndex;
+
+    //
+    // The validated rules of this program object. Rule updates replace the
+    // rule set on the interface work queue.
+    //
+    XDP_PROGRAM *Program;
+
+    //
+    // For all-queues program objects, the compiled program run by every RX
+    // queue this program object is the only program bound to, and the link
+    // in the interface hook's all-queues set.
+    //
+    XDP_PROGRAM *SharedProgram;
+    XDP_PROGRAM_ALL_QUEUES_SET *AllQueuesSet;
+    LIST_ENTRY AllQueuesLink;
+
+    //
+    // For RX all-queues program objects, the interface offload handle that
+    // drops frames matching the program's leading drop rules before they
+    // reach any RX queue, and the number of rules offloaded. The interface
+    // set is kept valid by the binding.
+    //
+    XDP_IFSET_HANDLE DropOffloadIfSet;
+    XDP_IF_OFFLOAD_HANDLE DropOffloadHandle;
+    UINT32 DropOffloadRuleCount;
 } XDP_PROGRAM_OBJECT;
 
+//
+// The all-queues program objects attached to an interface hook, which are
+// also attached to RX queues created on the hook afterwards.
+//
+typedef struct _XDP_PROGRAM_ALL_QUEUES_SET {
+    XDP_BINDING_CLIENT_ENTRY BindingClientEntry;
+    XDP_BINDING_HANDLE BindingHandle;
+    XDP_HOOK_ID HookId;
+    LIST_ENTRY ProgramObjects;
+} XDP_PROGRAM_ALL_QUEUES_SET;
+
 typedef struct _XDP_PROGRAM_WORKITEM {
     XDP_BINDING_WORKITEM Bind;
     XDP_HOOK_ID HookId;
@@ -403,8 +781,80 @@ typedef struct _XDP_PROGRAM_WORKITEM {
     NTSTATUS CompletionStatus;
 } XDP_PROGRAM_WORKITEM;
 
+typedef struct _XDP_PROGRAM_UPDATE_WORKITEM {
+    XDP_BINDING_WORKITEM Bind;
+    XDP_PROGRAM_OBJECT *ProgramObject;
+    UINT32 RuleIndex;
+    UINT32 DeleteRuleCount;
+    XDP_PROGRAM *InsertRules;
+
+    //
+    // For eBPF program replacement, the hook whose eBPF program object is
+    // updated and the eBPF client taking it over.
+    //
+    XDP_HOOK_ID HookId;
+    const EBPF_EXTENSION_CLIENT *EbpfClient;
+
+    KEVENT CompletionEvent;
+    NTSTATUS CompletionStatus;
+} XDP_PROGRAM_UPDATE_WORKITEM;
+
+//
+// Program objects with rule counters, enumerated by the PCW callback.
+//
+static EX_PUSH_LOCK XdpProgramCountersLock;
+static LIST_ENTRY XdpProgramCountersObjects;
+static LONG XdpProgramNextCountersId;
+
+//
+// Serializes eBPF client detach with the transfer of a program object from a
+// replaced eBPF client to its replacement.
+//
+static EX_PUSH_LOCK XdpProgramEbpfClientLock;
+
+//
+// Connection tracking tables, one per interface with connection tracking
+// rules.
+//
+#define XDP_CONNTRACK_TABLE_SIZE 0x4000
+#define XDP_PROGRAM_MAX_DROP_OFFLOAD_RULES 64
+#define XDP_CONNTRACK_IDLE_TIMEOUT_MS (120 * 1000)
+#define XDP_CONNTRACK_AGING_INTERVAL_MS (10 * 1000)
+
+static EX_PUSH_LOCK XdpProgramConntrackLock;
+static LIST_ENTRY XdpProgramConntrackTables;
+
+//
+// Drives periodic program work, such as connection tracking table aging, from
+// a single tick rather than a kernel timer per object.
+//
+#define XDP_PROGRAM_TIMER_WHEEL_TICK_MS 100
+
+static XDP_TIMER_WHEEL *XdpProgramTimerWheel;
+
+//
+// Program objects created from persisted programs, which are recreated each
+// time their interface is added. Accessed only by the persisted program work
+// queue, or after the work queue is shut down.
+//
+typedef struct _XDP_PROGRAM_PERSISTED_OBJECT {
+    LIST_ENTRY Link;
+    UINT32 IfIndex;
+    XDP_PROGRAM_OBJECT *ProgramObject;
+} XDP_PROGRAM_PERSISTED_OBJECT;
+
+typedef struct _XDP_PROGRAM_PERSISTED_WORKITEM {
+    SINGLE_LIST_ENTRY Link;
+    UINT32 IfIndex;
+} XDP_PROGRAM_PERSISTED_WORKITEM;
+
+static XDP_WORK_QUEUE *XdpProgramPersistedQueue;
+static LIST_ENTRY XdpProgramPersistedObjects;
+
+static XDP_FILE_IRP_ROUTINE XdpIrpProgramDeviceIoControl;
 static XDP_FILE_IRP_ROUTINE XdpIrpProgramClose;
 static XDP_FILE_DISPATCH XdpProgramFileDispatch = {
+    .IoControl = XdpIrpProgramDeviceIoControl,
     .Close = XdpIrpProgramClose,
 };
 
@@ -561,64 +1011,292 @@ XdpProgramTrace(
                 Program, i, ntohs(Rule->Pattern.Port));
             break;
 
-        default:
-            ASSERT(FALSE);
+        case XDP_MATCH_IPV4_DST_LPM:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_IPV4_DST_LPM PrefixCount=%u",
+                Program, i, Rule->Pattern.PrefixTable.PrefixCount);
             break;
-        }
 
-        switch (Rule->Action) {
-        case XDP_PROGRAM_ACTION_DROP:
+        case XDP_MATCH_IPV6_DST_LPM:
             TraceInfo(
-                TRACE_CORE, "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_DROP",
-                Program, i);
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_IPV6_DST_LPM PrefixCount=%u",
+                Program, i, Rule->Pattern.PrefixTable.PrefixCount);
             break;
 
-        case XDP_PROGRAM_ACTION_PASS:
+        case XDP_MATCH_UDP_PORT_RANGE:
             TraceInfo(
-                TRACE_CORE, "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_PASS",
-                Program, i);
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_UDP_PORT_RANGE RangeCount=%u",
+                Program, i, Rule->Pattern.PortRanges.RangeCount);
             break;
 
-        case XDP_PROGRAM_ACTION_REDIRECT:
+        case XDP_MATCH_IPV4_UDP_PORT_RANGE:
             TraceInfo(
                 TRACE_CORE,
-                "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_REDIRECT "
-                "TargetType=%!REDIRECT_TARGET_TYPE! Target=%p",
-                Program, i, Rule->Redirect.TargetType, Rule->Redirect.Target);
+                "Program=%p Rule[%u]=XDP_MATCH_IPV4_UDP_PORT_RANGE "
+                "Destination=%!IPADDR! RangeCount=%u",
+                Program, i, Rule->Pattern.IpPortRanges.Address.Ipv4.s_addr,
+                Rule->Pattern.IpPortRanges.PortRanges.RangeCount);
             break;
 
-        case XDP_PROGRAM_ACTION_L2FWD:
+        case XDP_MATCH_IPV4_TCP_PORT_RANGE:
             TraceInfo(
-                TRACE_CORE, "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_L2FWD",
-                Program, i);
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV4_TCP_PORT_RANGE "
+                "Destination=%!IPADDR! RangeCount=%u",
+                Program, i, Rule->Pattern.IpPortRanges.Address.Ipv4.s_addr,
+                Rule->Pattern.IpPortRanges.PortRanges.RangeCount);
             break;
 
-        case XDP_PROGRAM_ACTION_EBPF:
+        case XDP_MATCH_IPV6_UDP_PORT_RANGE:
             TraceInfo(
                 TRACE_CORE,
-                "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_EBPF "
-                "Target=%p",
-                Program, i, Rule->Ebpf.Target);
+                "Program=%p Rule[%u]=XDP_MATCH_IPV6_UDP_PORT_RANGE "
+                "Destination=%!IPV6ADDR! RangeCount=%u",
+                Program, i, Rule->Pattern.IpPortRanges.Address.Ipv6.u.Byte,
+                Rule->Pattern.IpPortRanges.PortRanges.RangeCount);
             break;
 
-        default:
-            ASSERT(FALSE);
+        case XDP_MATCH_IPV6_TCP_PORT_RANGE:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV6_TCP_PORT_RANGE "
+                "Destination=%!IPV6ADDR! RangeCount=%u",
+                Program, i, Rule->Pattern.IpPortRanges.Address.Ipv6.u.Byte,
+                Rule->Pattern.IpPortRanges.PortRanges.RangeCount);
             break;
-        }
-    }
-}
-
-static
-VOID
-XdpProgramTraceObject(
-    _In_ const XDP_PROGRAM_OBJECT *ProgramObject
-    )
-{
-    TraceInfo(
-        TRACE_CORE, "ProgramObject=%p Program=%p CreatedByPid=%Iu",
-        ProgramObject, &ProgramObject->Program, ProgramObject->CreatedByPid);
 
-    XdpProgramTrace(&ProgramObject->Program);
+        case XDP_MATCH_VLAN_ID:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_VLAN_ID VlanId=%u",
+                Program, i, Rule->Pattern.VlanId);
+            break;
+
+        case XDP_MATCH_CONNTRACK_TRACK:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_CONNTRACK_TRACK Table=%p",
+                Program, i, Rule->Pattern.Conntrack.Reserved);
+            break;
+
+        case XDP_MATCH_CONNTRACK_ESTABLISHED:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_CONNTRACK_ESTABLISHED Table=%p",
+                Program, i, Rule->Pattern.Conntrack.Reserved);
+            break;
+
+        case XDP_MATCH_IPV4_SRC_LPM:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_IPV4_SRC_LPM PrefixCount=%u",
+                Program, i, Rule->Pattern.PrefixTable.PrefixCount);
+            break;
+
+        case XDP_MATCH_IPV6_SRC_LPM:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_IPV6_SRC_LPM PrefixCount=%u",
+                Program, i, Rule->Pattern.PrefixTable.PrefixCount);
+            break;
+
+        case XDP_MATCH_IPV4_MASKED_TUPLE:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_IPV4_MASKED_TUPLE TupleCount=%u",
+                Program, i, Rule->Pattern.TupleSet.TupleCount);
+            break;
+
+        case XDP_MATCH_IPV6_MASKED_TUPLE:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_IPV6_MASKED_TUPLE TupleCount=%u",
+                Program, i, Rule->Pattern.TupleSet.TupleCount);
+            break;
+
+        case XDP_MATCH_TUNNEL:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_TUNNEL Type=%u UdpPort=%u",
+                Program, i, Rule->Pattern.Tunnel.Type, ntohs(Rule->Pattern.Tunnel.UdpPort));
+            break;
+
+        case XDP_MATCH_TUNNEL_IPV4_MASKED_TUPLE:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_TUNNEL_IPV4_MASKED_TUPLE Type=%u UdpPort=%u "
+                "TupleCount=%u",
+                Program, i, Rule->Pattern.TunnelTupleSet.Tunnel.Type,
+                ntohs(Rule->Pattern.TunnelTupleSet.Tunnel.UdpPort),
+                Rule->Pattern.TunnelTupleSet.TupleSet.TupleCount);
+            break;
+
+        case XDP_MATCH_TUNNEL_IPV6_MASKED_TUPLE:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_TUNNEL_IPV6_MASKED_TUPLE Type=%u UdpPort=%u "
+                "TupleCount=%u",
+                Program, i, Rule->Pattern.TunnelTupleSet.Tunnel.Type,
+                ntohs(Rule->Pattern.TunnelTupleSet.Tunnel.UdpPort),
+                Rule->Pattern.TunnelTupleSet.TupleSet.TupleCount);
+            break;
+
+        case XDP_MATCH_IPV4_TCP_TUPLE:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV4_TCP_TUPLE "
+                "Source=%!IPADDR!:%u Destination=%!IPADDR!:%u",
+                Program, i, Rule->Pattern.Tuple.SourceAddress.Ipv4.s_addr,
+                ntohs(Rule->Pattern.Tuple.SourcePort),
+                Rule->Pattern.Tuple.DestinationAddress.Ipv4.s_addr,
+                ntohs(Rule->Pattern.Tuple.DestinationPort));
+            break;
+
+        case XDP_MATCH_IPV6_TCP_TUPLE:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV6_TCP_TUPLE "
+                "Source=[%!IPV6ADDR!]:%u Destination=[%!IPV6ADDR!]:%u",
+                Program, i, Rule->Pattern.Tuple.SourceAddress.Ipv6.u.Byte,
+                ntohs(Rule->Pattern.Tuple.SourcePort),
+                Rule->Pattern.Tuple.DestinationAddress.Ipv6.u.Byte,
+                ntohs(Rule->Pattern.Tuple.DestinationPort));
+            break;
+
+        case XDP_MATCH_UDP_PAYLOAD:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_UDP_PAYLOAD Port=%u Offset=%u Length=%u",
+                Program, i, ntohs(Rule->Pattern.Payload.Port),
+                ((const XDP_PAYLOAD_PATTERN_TABLE *)Rule->Pattern.Payload.Reserved)->Offset,
+                ((const XDP_PAYLOAD_PATTERN_TABLE *)Rule->Pattern.Payload.Reserved)->Length);
+            break;
+
+        case XDP_MATCH_TCP_PAYLOAD:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_TCP_PAYLOAD Port=%u Offset=%u Length=%u",
+                Program, i, ntohs(Rule->Pattern.Payload.Port),
+                ((const XDP_PAYLOAD_PATTERN_TABLE *)Rule->Pattern.Payload.Reserved)->Offset,
+                ((const XDP_PAYLOAD_PATTERN_TABLE *)Rule->Pattern.Payload.Reserved)->Length);
+            break;
+
+        default:
+            ASSERT(FALSE);
+            break;
+        }
+
+        switch (Rule->Action) {
+        case XDP_PROGRAM_ACTION_DROP:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_DROP",
+                Program, i);
+            break;
+
+        case XDP_PROGRAM_ACTION_PASS:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_PASS",
+                Program, i);
+            break;
+
+        case XDP_PROGRAM_ACTION_REDIRECT:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_REDIRECT "
+                "TargetType=%!REDIRECT_TARGET_TYPE! Target=%p",
+                Program, i, Rule->Redirect.TargetType, Rule->Redirect.Target);
+            break;
+
+        case XDP_PROGRAM_ACTION_L2FWD:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_L2FWD",
+                Program, i);
+            break;
+
+        case XDP_PROGRAM_ACTION_EBPF:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_EBPF "
+                "Target=%p",
+                Program, i, Rule->Ebpf.Target);
+            break;
+
+        case XDP_PROGRAM_ACTION_SAMPLE:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_SAMPLE "
+                "TargetType=%!REDIRECT_TARGET_TYPE! Target=%p Rate=%u",
+                Program, i, Rule->Sample.TargetType, Rule->Sample.Target, Rule->Sample.Rate);
+            break;
+
+        case XDP_PROGRAM_ACTION_POLICE:
+        {
+            const XDP_POLICER *Policer = Rule->Police.ConformTarget;
+
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_POLICE "
+                "PacketsPerSecond=%u BytesPerSecond=%u ConformTarget=%p",
+                Program, i, Rule->Police.PacketsPerSecond, Rule->Police.BytesPerSecond,
+                Policer->ConformTarget);
+            break;
+        }
+
+        case XDP_PROGRAM_ACTION_DECAP_REDIRECT:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_DECAP_REDIRECT "
+                "Type=%u UdpPort=%u TargetType=%!REDIRECT_TARGET_TYPE! Target=%p",
+                Program, i, Rule->DecapRedirect.Tunnel.Type,
+                ntohs(Rule->DecapRedirect.Tunnel.UdpPort),
+                Rule->DecapRedirect.Redirect.TargetType, Rule->DecapRedirect.Redirect.Target);
+            break;
+
+        case XDP_PROGRAM_ACTION_LOAD_BALANCE:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_LOAD_BALANCE "
+                "BackendCount=%u Flags=0x%x",
+                Program, i, Rule->LoadBalance.BackendCount, Rule->LoadBalance.Flags);
+            break;
+
+        case XDP_PROGRAM_ACTION_ENCAP:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_ENCAP "
+                "Type=%u Flags=0x%x HeaderLength=%u "
+                "TargetType=%!REDIRECT_TARGET_TYPE! Target=%p",
+                Program, i, Rule->Encap.Type, Rule->Encap.Flags, Rule->Encap.HeaderLength,
+                Rule->Encap.Redirect.TargetType, Rule->Encap.Redirect.Target);
+            break;
+
+        case XDP_PROGRAM_ACTION_SYN_COOKIE:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_SYN_COOKIE Mss=%u",
+                Program, i, Rule->SynCookie.Mss);
+            break;
+
+        default:
+            ASSERT(FALSE);
+            break;
+        }
+    }
+
+    for (UINT32 i = 0; i < Program->SegmentCount; i++) {
+        const XDP_PROGRAM_RULE_SEGMENT *Segment = &Program->Segments[i];
+
+        TraceInfo(
+            TRACE_CORE,
+            "Program=%p Segment[%u] StartIndex=%u RuleCount=%u HashSlots=%u",
+            Program, i, Segment->StartIndex, Segment->RuleCount,
+            Segment->HashSlotMask != 0 ? Segment->HashSlotMask + 1 : 0);
+    }
+}
+
+static
+VOID
+XdpProgramTraceObject(
+    _In_ const XDP_PROGRAM_OBJECT *ProgramObject
+    )
+{
+    TraceInfo(
+        TRACE_CORE, "ProgramObject=%p Program=%p CreatedByPid=%Iu",
+        ProgramObject, ProgramObject->Program, ProgramObject->CreatedByPid);
+
+    XdpProgramTrace(ProgramObject->Program);
 }
 
 static
@@ -636,8 +1314,174 @@ EbpfXdpAdjustHead(
     return -1;
 }
 
+static
+int
+EbpfXdpRedirectXsk(
+    _Inout_ xdp_md_t *Context,
+    _In_ UINT32 Key,
+    _In_ UINT64 Flags
+    )
+{
+    EBPF_XDP_MD *XdpMd = CONTAINING_RECORD(Context, EBPF_XDP_MD, Base);
+    HANDLE Xsk = NULL;
+
+    if (XdpMd->InspectionContext != NULL &&
+        Key < RTL_NUMBER_OF(XdpMd->InspectionContext->EbpfXskMap)) {
+        Xsk = ReadPointerNoFence(&XdpMd->InspectionContext->EbpfXskMap[Key]);
+    }
+
+    if (Xsk == NULL) {
+        //
+        // As with Linux redirect helpers, the low bits of the flags are the
+        // fallback action.
+        //
+        return (Flags & 0x3) != 0 ? (int)(Flags & 0x3) : XDP_DROP;
+    }
+
+    XdpMd->RedirectTarget = Xsk;
+    return XDP_REDIRECT;
+}
+
+static
+int
+EbpfXdpAdjustMeta(
+    _Inout_ xdp_md_t *Context,
+    _In_ int Delta
+    )
+{
+    EBPF_XDP_MD *XdpMd = CONTAINING_RECORD(Context, EBPF_XDP_MD, Base);
+    UCHAR *Data = Context->data;
+    UCHAR *Meta = Context->data_meta;
+    INT_PTR NewLength;
+
+    //
+    // The metadata must lie between the buffer start and the frame data, and
+    // as on Linux, its length must be a multiple of 4 bytes and at most
+    // XDP_EBPF_METADATA_MAX_LENGTH bytes. Any return < 0 is an error.
+    //
+    if (Meta < XdpMd->BufferStart || Meta > Data) {
+        return -1;
+    }
+
+    NewLength = (Data - Meta) - Delta;
+
+    if (NewLength < 0 || NewLength > XDP_EBPF_METADATA_MAX_LENGTH ||
+        NewLength > Data - XdpMd->BufferStart || (NewLength & 0x3) != 0) {
+        return -1;
+    }
+
+    Context->data_meta = Data - NewLength;
+    return 0;
+}
+
+static
+XDP_BUFFER *
+EbpfXdpGetBuffer(
+    _In_ EBPF_XDP_MD *XdpMd,
+    _In_ UINT32 BufferIndex
+    )
+{
+    //
+    // Buffer 0 is the first buffer of the frame, and the remaining buffers are
+    // its fragments.
+    //
+    if (BufferIndex == 0) {
+        return &XdpMd->Frame->Buffer;
+    }
+
+    return
+        XdpRingGetElement(
+            XdpMd->FragmentRing,
+            (XdpMd->FragmentIndex + BufferIndex - 1) & XdpMd->FragmentRing->Mask);
+}
+
+static
+int
+EbpfXdpAdjustTail(
+    _Inout_ xdp_md_t *Context,
+    _In_ int Delta
+    )
+{
+    EBPF_XDP_MD *XdpMd = CONTAINING_RECORD(Context, EBPF_XDP_MD, Base);
+    UINT32 BufferCount = 1;
+    UINT64 FrameLength;
+    XDP_BUFFER *Buffer;
+
+    //
+    // Any return < 0 is an error.
+    //
+    if (XdpMd->Frame == NULL) {
+        //
+        // BPF_PROG_TEST_RUN data has no tailroom, so it can only be truncated.
+        //
+        FrameLength = (UCHAR *)Context->data_end - (UCHAR *)Context->data;
+        if (Delta > 0 || (INT64)FrameLength + Delta < XDP_EBPF_MIN_FRAME_LENGTH) {
+            return -1;
+        }
+
+        Context->data_end = (UCHAR *)Context->data_end + Delta;
+        return 0;
+    }
+
+    if (XdpMd->FragmentRing != NULL) {
+        BufferCount +=
+            XdpGetFragmentExtension(
+                XdpMd->Frame, XdpMd->FragmentExtension)->FragmentBufferCount;
+    }
+
+    if (Delta > 0) {
+        //
+        // Grow the final buffer within its capacity and zero the new bytes.
+        //
+        UCHAR *Va;
+
+        Buffer = EbpfXdpGetBuffer(XdpMd, BufferCount - 1);
+        if ((UINT64)Buffer->DataOffset + Buffer->DataLength + Delta > Buffer->BufferLength) {
+            return -1;
+        }
+
+        Va = XdpGetVirtualAddressExtension(Buffer, XdpMd->VirtualAddressExtension)->VirtualAddress;
+        RtlZeroMemory(Va + Buffer->DataOffset + Buffer->DataLength, Delta);
+        Buffer->DataLength += Delta;
+    } else if (Delta < 0) {
+        //
+        // Trim from the end of the frame, emptying trailing fragment buffers
+        // as necessary. Empty buffers remain part of the frame.
+        //
+        UINT32 Trim = (UINT32)(-(INT64)Delta);
+
+        FrameLength = 0;
+        for (UINT32 Index = 0; Index < BufferCount; Index++) {
+            FrameLength += EbpfXdpGetBuffer(XdpMd, Index)->DataLength;
+        }
+
+        if (FrameLength < (UINT64)Trim + XDP_EBPF_MIN_FRAME_LENGTH) {
+            return -1;
+        }
+
+        for (UINT32 Index = BufferCount; Index > 0 && Trim > 0; Index--) {
+            UINT32 BufferTrim;
+
+            Buffer = EbpfXdpGetBuffer(XdpMd, Index - 1);
+            BufferTrim = min(Buffer->DataLength, Trim);
+            Buffer->DataLength -= BufferTrim;
+            Trim -= BufferTrim;
+        }
+    }
+
+    //
+    // The program can directly access only the first buffer.
+    //
+    Context->data_end = (UCHAR *)Context->data + XdpMd->Frame->Buffer.DataLength;
+    XdpMd->FrameModified = TRUE;
+    return 0;
+}
+
 static const VOID *EbpfXdpHelperFunctions[] = {
     (VOID *)EbpfXdpAdjustHead,
+    (VOID *)EbpfXdpRedirectXsk,
+    (VOID *)EbpfXdpAdjustMeta,
+    (VOID *)EbpfXdpAdjustTail,
 };
 
 static const ebpf_helper_function_addresses_t XdpHelperFunctionAddresses = {
@@ -678,46 +1522,179 @@ static EBPF_EXTENSION_PROVIDER *EbpfXdpProgramInfoProvider;
 static EBPF_EXTENSION_PROVIDER *EbpfXdpProgramHookProvider;
 
 static
-_IRQL_requires_max_(DISPATCH_LEVEL)
-VOID
-XdpProgramUpdateCompiledProgram(
-    _In_ XDP_RX_QUEUE *RxQueue
+NTSTATUS
+XdpProgramCounterSetAllocate(
+    _In_ UINT32 RuleCount,
+    _Out_ XDP_RULE_COUNTER_SET **NewCounterSet
     )
 {
-    LIST_ENTRY *BindingListHead = XdpRxQueueGetProgramBindingList(RxQueue);
-    XDP_PROGRAM *Program = XdpRxQueueGetProgram(RxQueue);
-    LIST_ENTRY *Entry = BindingListHead->Flink;
-    UINT32 RuleIndex = 0;
-
-    TraceEnter(TRACE_CORE, "Updating Program=%p on RxQueue=%p", Program, RxQueue);
-
-    while (Entry != BindingListHead) {
-        XDP_PROGRAM_BINDING *ProgramBinding =
-            CONTAINING_RECORD(Entry, XDP_PROGRAM_BINDING, RxQueueEntry);
-        const XDP_PROGRAM_OBJECT *BoundProgramObject = ProgramBinding->OwningProgram;
-
-        TraceInfo(
-            TRACE_CORE, "Compiling ProgramObject=%p into Program=%p",
-            BoundProgramObject, Program);
-        XdpProgramTraceObject(BoundProgramObject);
+    XDP_RULE_COUNTER_SET *CounterSet = NULL;
+    UINT32 ProcessorCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    SIZE_T CountersSize;
+    SIZE_T ProcessorStride;
+    SIZE_T AllocationSize;
+    NTSTATUS Status;
 
-        for (UINT32 i = 0; i < BoundProgramObject->Program.RuleCount; i++) {
-            Program->Rules[RuleIndex++] = BoundProgramObject->Program.Rules[i];
-        }
+    Status = RtlSizeTMult(sizeof(XDP_RULE_HIT_COUNTER), RuleCount, &CountersSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
 
-        Entry = Entry->Flink;
+    Status = RtlSizeTAdd(CountersSize, SYSTEM_CACHE_ALIGNMENT_SIZE - 1, &ProcessorStride);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
     }
+    ProcessorStride &= ~((SIZE_T)SYSTEM_CACHE_ALIGNMENT_SIZE - 1);
 
     //
-    // If the program compiled for this newly added binding failed to be added
-    // to the RX queue, we will end up having Program->RuleCount == RuleIndex.
+    // Allocate the header, the base counters, padding to align the first
+    // processor's counters, and the per-processor counters.
     //
-    ASSERT(Program->RuleCount >= RuleIndex);
-    Program->RuleCount = RuleIndex;
+    Status = RtlSizeTMult(ProcessorStride, ProcessorCount, &AllocationSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
 
-    TraceInfo(TRACE_CORE, "Updated Program=%p on RxQueue=%p", Program, RxQueue);
-    XdpProgramTrace(Program);
-    TraceExitSuccess(TRACE_CORE);
+    Status = RtlSizeTAdd(AllocationSize, CountersSize, &AllocationSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status =
+        RtlSizeTAdd(
+            AllocationSize, sizeof(*CounterSet) + SYSTEM_CACHE_ALIGNMENT_SIZE, &AllocationSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    CounterSet = ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, XDP_POOLTAG_PROGRAM_COUNTERS);
+    if (CounterSet == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    CounterSet->RuleCount = RuleCount;
+    CounterSet->ProcessorCount = ProcessorCount;
+    CounterSet->ProcessorStride = ProcessorStride;
+    CounterSet->Base = (XDP_RULE_HIT_COUNTER *)(CounterSet + 1);
+    CounterSet->Processors =
+        ALIGN_UP_POINTER_BY((UCHAR *)CounterSet->Base + CountersSize, SYSTEM_CACHE_ALIGNMENT_SIZE);
+
+Exit:
+
+    *NewCounterSet = CounterSet;
+    return Status;
+}
+
+static
+VOID
+XdpProgramCounterSetRead(
+    _In_ const XDP_RULE_COUNTER_SET *CounterSet,
+    _In_ UINT32 RuleIndex,
+    _Out_ XDP_RULE_HIT_COUNTER *Total
+    )
+{
+    ASSERT(RuleIndex < CounterSet->RuleCount);
+
+    *Total = CounterSet->Base[RuleIndex];
+
+    for (UINT32 Processor = 0; Processor < CounterSet->ProcessorCount; Processor++) {
+        XDP_RULE_HIT_COUNTER *Counter =
+            (XDP_RULE_HIT_COUNTER *)
+                (CounterSet->Processors + CounterSet->ProcessorStride * Processor) + RuleIndex;
+        UINT64 LastHitTime = ReadUInt64NoFence(&Counter->LastHitTime);
+
+        Total->Hits += ReadUInt64NoFence(&Counter->Hits);
+        Total->LastHitTime = max(Total->LastHitTime, LastHitTime);
+    }
+}
+
+static
+VOID
+XdpProgramGetRuleCounter(
+    _In_ const XDP_PROGRAM_OBJECT *ProgramObject,
+    _In_ UINT32 RuleIndex,
+    _Out_ XDP_PROGRAM_RULE_COUNTER *RuleCounter
+    )
+{
+    const XDP_RULE_COUNTER_SET *CounterSet = ProgramObject->RuleCounters;
+
+    if (CounterSet == NULL) {
+        RuleCounter->Counter = NULL;
+        RuleCounter->ProcessorStride = 0;
+    } else {
+        ASSERT(RuleIndex < CounterSet->RuleCount);
+        RuleCounter->Counter = (XDP_RULE_HIT_COUNTER *)CounterSet->Processors + RuleIndex;
+        RuleCounter->ProcessorStride = CounterSet->ProcessorStride;
+    }
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramAppendObjectRules(
+    _Inout_ XDP_PROGRAM *Program,
+    _In_ const XDP_PROGRAM_OBJECT *ProgramObject
+    )
+{
+    TraceInfo(
+        TRACE_CORE, "Compiling ProgramObject=%p into Program=%p", ProgramObject, Program);
+    XdpProgramTraceObject(ProgramObject);
+
+    for (UINT32 i = 0; i < ProgramObject->Program->RuleCount; i++) {
+        XdpProgramGetRuleCounter(ProgramObject, i, &Program->RuleCounters[Program->RuleCount]);
+        Program->Rules[Program->RuleCount++] = ProgramObject->Program->Rules[i];
+    }
+    Program->EbpfFlowVerdictCache |= ProgramObject->Program->EbpfFlowVerdictCache;
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramUpdateCompiledProgram(
+    _In_ XDP_RX_QUEUE *RxQueue
+    )
+{
+    LIST_ENTRY *BindingListHead = XdpRxQueueGetProgramBindingList(RxQueue);
+    XDP_PROGRAM *Program = XdpRxQueueGetProgram(RxQueue);
+    LIST_ENTRY *Entry = BindingListHead->Flink;
+    UINT32 RuleCapacity = Program->RuleCount;
+
+    TraceEnter(TRACE_CORE, "Updating Program=%p on RxQueue=%p", Program, RxQueue);
+
+    //
+    // Shared programs are never updated in place.
+    //
+    ASSERT(!Program->Shared);
+
+    //
+    // The program only shrinks here, so its allocation still fits counters
+    // and an index sized for the previous rule count.
+    //
+    Program->RuleCounters = XdpProgramGetRuleCounters(Program, RuleCapacity);
+    Program->EbpfFlowVerdictCache = FALSE;
+    Program->RuleCount = 0;
+
+    while (Entry != BindingListHead) {
+        XDP_PROGRAM_BINDING *ProgramBinding =
+            CONTAINING_RECORD(Entry, XDP_PROGRAM_BINDING, RxQueueEntry);
+
+        XdpProgramAppendObjectRules(Program, ProgramBinding->OwningProgram);
+        Entry = Entry->Flink;
+    }
+
+    ASSERT(Program->RuleCount <= RuleCapacity);
+
+    XdpProgramCompile(Program, RuleCapacity);
+
+    //
+    // Verdicts cached for the previous rules no longer apply.
+    //
+    XdpProgramInvalidateVerdictCaches(XdpRxQueueGetInspectionContext(RxQueue));
+
+    TraceInfo(TRACE_CORE, "Updated Program=%p on RxQueue=%p", Program, RxQueue);
+    XdpProgramTrace(Program);
+    TraceExitSuccess(TRACE_CORE);
 }
 
 static
@@ -742,7 +1719,7 @@ XdpProgramCompileNewProgram(
             CONTAINING_RECORD(Entry, XDP_PROGRAM_BINDING, RxQueueEntry);
         Status =
             RtlUInt32Add(
-                RuleCount, ProgramBinding->OwningProgram->Program.RuleCount, &RuleCount);
+                RuleCount, ProgramBinding->OwningProgram->Program->RuleCount, &RuleCount);
         if (!NT_SUCCESS(Status)) {
             goto Exit;
         }
@@ -758,12 +1735,7 @@ XdpProgramCompileNewProgram(
         goto Exit;
     }
 
-    Status = RtlSizeTMult(sizeof(XDP_RULE), RuleCount, &AllocationSize);
-    if (!NT_SUCCESS(Status)) {
-        goto Exit;
-    }
-
-    Status = RtlSizeTAdd(FIELD_OFFSET(XDP_PROGRAM, Rules), AllocationSize, &AllocationSize);
+    Status = XdpProgramGetCompiledSize(RuleCount, &AllocationSize);
     if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
@@ -774,25 +1746,19 @@ XdpProgramCompileNewProgram(
         goto Exit;
     }
 
+    NewProgram->RuleCounters = XdpProgramGetRuleCounters(NewProgram, RuleCount);
+
     Entry = BindingListHead->Flink;
     while (Entry != BindingListHead) {
         XDP_PROGRAM_BINDING *ProgramBinding =
             CONTAINING_RECORD(Entry, XDP_PROGRAM_BINDING, RxQueueEntry);
-        const XDP_PROGRAM_OBJECT *BoundProgramObject = ProgramBinding->OwningProgram;
-
-        TraceInfo(
-            TRACE_CORE, "Compiling ProgramObject=%p into Program=%p",
-            BoundProgramObject, NewProgram);
-        XdpProgramTraceObject(BoundProgramObject);
-
-        for (UINT32 i = 0; i < BoundProgramObject->Program.RuleCount; i++) {
-            NewProgram->Rules[NewProgram->RuleCount++] = BoundProgramObject->Program.Rules[i];
-        }
 
+        XdpProgramAppendObjectRules(NewProgram, ProgramBinding->OwningProgram);
         Entry = Entry->Flink;
     }
 
     ASSERT(NewProgram->RuleCount == RuleCount);
+    XdpProgramCompile(NewProgram, RuleCount);
 
     TraceInfo(TRACE_CORE, "Compiled Program=%p on RxQueue=%p", NewProgram, RxQueue);
     XdpProgramTrace(NewProgram);
@@ -803,12 +1769,115 @@ Exit:
     return Status;
 }
 
+//
+// Compiles the rules of an all-queues program object into a program shared by
+// every RX queue the program object is the only program bound to.
+//
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+XdpProgramCompileSharedProgram(
+    _In_ const XDP_PROGRAM_OBJECT *ProgramObject,
+    _Out_ XDP_PROGRAM **Program
+    )
+{
+    NTSTATUS Status;
+    UINT32 RuleCount = ProgramObject->Program->RuleCount;
+    XDP_PROGRAM *NewProgram;
+    SIZE_T AllocationSize;
+
+    TraceEnter(TRACE_CORE, "Compiling shared program for ProgramObject=%p", ProgramObject);
+
+    *Program = NULL;
+
+    Status = XdpProgramGetCompiledSize(RuleCount, &AllocationSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    NewProgram = ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, XDP_POOLTAG_PROGRAM);
+    if (NewProgram == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    NewProgram->Shared = TRUE;
+    NewProgram->RuleCounters = XdpProgramGetRuleCounters(NewProgram, RuleCount);
+    XdpProgramAppendObjectRules(NewProgram, ProgramObject);
+
+    ASSERT(NewProgram->RuleCount == RuleCount);
+    XdpProgramCompile(NewProgram, RuleCount);
+
+    TraceInfo(
+        TRACE_CORE, "Compiled shared Program=%p for ProgramObject=%p",
+        NewProgram, ProgramObject);
+    XdpProgramTrace(NewProgram);
+    *Program = NewProgram;
+
+Exit:
+    TraceExitStatus(TRACE_CORE);
+    return Status;
+}
+
+//
+// Returns the shared program the RX queue can run, i.e. the shared program of
+// its only bound program object, or NULL if the RX queue needs a program
+// compiled from all of its program bindings.
+//
+static
+XDP_PROGRAM *
+XdpProgramGetSharedProgram(
+    _In_ XDP_RX_QUEUE *RxQueue
+    )
+{
+    LIST_ENTRY *BindingListHead = XdpRxQueueGetProgramBindingList(RxQueue);
+    XDP_PROGRAM_BINDING *ProgramBinding;
+
+    if (IsListEmpty(BindingListHead) || BindingListHead->Flink->Flink != BindingListHead) {
+        return NULL;
+    }
+
+    ProgramBinding = CONTAINING_RECORD(BindingListHead->Flink, XDP_PROGRAM_BINDING, RxQueueEntry);
+    return ProgramBinding->OwningProgram->SharedProgram;
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramSyncBarrier(
+    _In_opt_ VOID *CallbackContext
+    )
+{
+    //
+    // Nothing to do: completing the sync shows the data path has run every
+    // sync started before it.
+    //
+    UNREFERENCED_PARAMETER(CallbackContext);
+}
+
+//
+// Frees a compiled program no RX queue references anymore. Shared programs are
+// freed by their program object instead.
+//
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramFreeCompiledProgram(
+    _In_ XDP_PROGRAM *Program
+    )
+{
+    if (!Program->Shared) {
+        ExFreePoolWithTag(Program, XDP_POOLTAG_PROGRAM);
+    }
+}
+
 static
 VOID
 XdpProgramDetachRxQueue(
     _In_ XDP_PROGRAM_BINDING *ProgramBinding
     )
 {
+    XDP_PROGRAM *SharedProgram;
     XDP_RX_QUEUE *RxQueue = ProgramBinding->RxQueue;
 
     TraceEnter(
@@ -825,85 +1894,1308 @@ XdpProgramDetachRxQueue(
     RemoveEntryList(&ProgramBinding->RxQueueEntry);
     InitializeListHead(&ProgramBinding->RxQueueEntry);
 
-    XdpRxQueueDeregisterNotifications(RxQueue, &ProgramBinding->RxQueueNotificationEntry);
-    if (IsListEmpty(XdpRxQueueGetProgramBindingList(ProgramBinding->RxQueue))) {
-        XDP_PROGRAM *OldCompiledProgram = XdpRxQueueGetProgram(RxQueue);
-        XdpRxQueueSetProgram(RxQueue, NULL, NULL, NULL);
-        if (OldCompiledProgram != NULL) {
-            ExFreePoolWithTag(OldCompiledProgram, XDP_POOLTAG_PROGRAM);
-        }
-    } else {
+    XdpRxQueueDeregisterNotifications(RxQueue, &ProgramBinding->RxQueueNotificationEntry);
+    if (IsListEmpty(XdpRxQueueGetProgramBindingList(ProgramBinding->RxQueue))) {
+        XDP_PROGRAM *OldCompiledProgram = XdpRxQueueGetProgram(RxQueue);
+        XdpRxQueueSetProgram(RxQueue, NULL, NULL, NULL, NULL);
+        if (OldCompiledProgram != NULL) {
+            XdpProgramFreeCompiledProgram(OldCompiledProgram);
+        }
+    } else if ((SharedProgram = XdpProgramGetSharedProgram(RxQueue)) != NULL) {
+        //
+        // Only an all-queues program object remains bound, so switch the RX
+        // queue back to its shared program.
+        //
+        XDP_PROGRAM *OldCompiledProgram = XdpRxQueueGetProgram(RxQueue);
+        NTSTATUS Status;
+
+        ASSERT(OldCompiledProgram != NULL && OldCompiledProgram != SharedProgram);
+
+        //
+        // The old compiled program references the detaching object's rules,
+        // which are freed once detach returns, so wait for the swap.
+        //
+        Status = XdpRxQueueSetProgram(RxQueue, SharedProgram, NULL, NULL, NULL);
+        ASSERT(NT_SUCCESS(Status));
+        XdpProgramFreeCompiledProgram(OldCompiledProgram);
+    } else {
+        //
+        // Update the program in-place because we are down sizing the program bindings.
+        //
+        XdpRxQueueSync(RxQueue, XdpProgramUpdateCompiledProgram, RxQueue);
+    }
+
+    TraceExitSuccess(TRACE_CORE);
+}
+
+VOID
+XdpProgramReleasePortSet(
+    _Inout_ XDP_PORT_SET *PortSet
+    )
+{
+    PortSet->PortSet = NULL;
+
+    if (PortSet->Reserved != NULL) {
+        MDL *Mdl = PortSet->Reserved;
+        if (Mdl->MdlFlags & MDL_PAGES_LOCKED) {
+            MmUnlockPages(Mdl);
+        }
+        IoFreeMdl(Mdl);
+        PortSet->Reserved = NULL;
+    }
+}
+
+NTSTATUS
+XdpProgramCapturePortSet(
+    _In_ const XDP_PORT_SET *UserPortSet,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_PORT_SET *KernelPortSet
+    )
+{
+    NTSTATUS Status;
+
+    __try {
+        if (UserPortSet->Reserved != NULL) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+
+        KernelPortSet->Reserved =
+            IoAllocateMdl(
+                (VOID *)UserPortSet->PortSet, XDP_PORT_SET_BUFFER_SIZE, FALSE, FALSE, NULL);
+        if (KernelPortSet->Reserved == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
+
+        MmProbeAndLockPages(KernelPortSet->Reserved, RequestorMode, IoReadAccess);
+
+        KernelPortSet->PortSet =
+            MmGetSystemAddressForMdlSafe(KernelPortSet->Reserved, LowPagePriority);
+        if (KernelPortSet->PortSet == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
+
+        Status = STATUS_SUCCESS;
+    } __except(EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        XdpProgramReleasePortSet(KernelPortSet);
+    }
+
+    return Status;
+}
+
+NTSTATUS
+XdpProgramCapturePrefixTable(
+    _In_ const XDP_IP_PREFIX_TABLE *UserPrefixTable,
+    _In_ UINT32 AddressLength,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_IP_PREFIX_TABLE *KernelPrefixTable
+    )
+{
+    NTSTATUS Status;
+    XDP_IP_PREFIX *Prefixes = NULL;
+    UINT32 PrefixCount = UserPrefixTable->PrefixCount;
+    XDP_LPM_TABLE *Table;
+    SIZE_T PrefixesSize;
+
+    if (UserPrefixTable->Reserved != NULL ||
+        PrefixCount == 0 || PrefixCount > XDP_IP_PREFIX_TABLE_MAX_PREFIXES) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Status = RtlSizeTMult(sizeof(*Prefixes), PrefixCount, &PrefixesSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Prefixes = ExAllocatePoolZero(PagedPool, PrefixesSize, XDP_POOLTAG_LPM);
+    if (Prefixes == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID *)UserPrefixTable->Prefixes, PrefixesSize, PROBE_ALIGNMENT(XDP_IP_PREFIX));
+        }
+        RtlCopyVolatileMemory(Prefixes, UserPrefixTable->Prefixes, PrefixesSize);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    Status = XdpProgramCreateLpmTable(AddressLength, Prefixes, PrefixCount, &Table);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    //
+    // The prefix array is not referenced after the table is built.
+    //
+    KernelPrefixTable->Prefixes = NULL;
+    KernelPrefixTable->PrefixCount = PrefixCount;
+    KernelPrefixTable->Reserved = Table;
+
+Exit:
+
+    if (Prefixes != NULL) {
+        ExFreePoolWithTag(Prefixes, XDP_POOLTAG_LPM);
+    }
+
+    return Status;
+}
+
+NTSTATUS
+XdpProgramCaptureTupleSet(
+    _In_ const XDP_MASKED_TUPLE_SET *UserTupleSet,
+    _In_ UINT32 AddressLength,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_MASKED_TUPLE_SET *KernelTupleSet
+    )
+{
+    NTSTATUS Status;
+    XDP_MASKED_TUPLE *Tuples = NULL;
+    UINT32 TupleCount = UserTupleSet->TupleCount;
+    XDP_TUPLE_TABLE *Table;
+    SIZE_T TuplesSize;
+
+    if (UserTupleSet->Reserved != NULL ||
+        TupleCount == 0 || TupleCount > XDP_MASKED_TUPLE_SET_MAX_TUPLES) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Status = RtlSizeTMult(sizeof(*Tuples), TupleCount, &TuplesSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Tuples = ExAllocatePoolZero(PagedPool, TuplesSize, XDP_POOLTAG_TUPLE_TABLE);
+    if (Tuples == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID *)UserTupleSet->Tuples, TuplesSize, PROBE_ALIGNMENT(XDP_MASKED_TUPLE));
+        }
+        RtlCopyVolatileMemory(Tuples, UserTupleSet->Tuples, TuplesSize);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    Status = XdpProgramCreateTupleTable(AddressLength, Tuples, TupleCount, &Table);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    //
+    // The tuple array is not referenced after the table is built.
+    //
+    KernelTupleSet->Tuples = NULL;
+    KernelTupleSet->TupleCount = TupleCount;
+    KernelTupleSet->Reserved = Table;
+
+Exit:
+
+    if (Tuples != NULL) {
+        ExFreePoolWithTag(Tuples, XDP_POOLTAG_TUPLE_TABLE);
+    }
+
+    return Status;
+}
+
+NTSTATUS
+XdpProgramCapturePortRangeSet(
+    _In_ const XDP_PORT_RANGE_SET *UserPortRanges,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_PORT_RANGE_SET *KernelPortRanges
+    )
+{
+    NTSTATUS Status;
+    XDP_PORT_RANGE *Ranges = NULL;
+    UINT32 RangeCount = UserPortRanges->RangeCount;
+    XDP_PORT_RANGE_TABLE *Table;
+    SIZE_T RangesSize;
+
+    if (UserPortRanges->Reserved != NULL ||
+        RangeCount == 0 || RangeCount > XDP_PORT_RANGE_SET_MAX_RANGES) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Status = RtlSizeTMult(sizeof(*Ranges), RangeCount, &RangesSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Ranges = ExAllocatePoolZero(PagedPool, RangesSize, XDP_POOLTAG_PORT_RANGE);
+    if (Ranges == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID *)UserPortRanges->Ranges, RangesSize, PROBE_ALIGNMENT(XDP_PORT_RANGE));
+        }
+        RtlCopyVolatileMemory(Ranges, UserPortRanges->Ranges, RangesSize);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    Status = XdpProgramCreatePortRangeTable(Ranges, RangeCount, &Table);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    //
+    // The range array is not referenced after the table is built.
+    //
+    KernelPortRanges->Ranges = NULL;
+    KernelPortRanges->RangeCount = RangeCount;
+    KernelPortRanges->Reserved = Table;
+
+Exit:
+
+    if (Ranges != NULL) {
+        ExFreePoolWithTag(Ranges, XDP_POOLTAG_PORT_RANGE);
+    }
+
+    return Status;
+}
+
+NTSTATUS
+XdpProgramCapturePayloadMatch(
+    _In_ const XDP_PAYLOAD_MATCH *UserPayload,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_PAYLOAD_MATCH *KernelPayload
+    )
+{
+    NTSTATUS Status;
+    XDP_PAYLOAD_PATTERN Pattern;
+    XDP_PAYLOAD_PATTERN_TABLE *Table;
+
+    if (UserPayload->Reserved != NULL) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID *)UserPayload->Pattern, sizeof(Pattern),
+                PROBE_ALIGNMENT(XDP_PAYLOAD_PATTERN));
+        }
+        RtlCopyVolatileMemory(&Pattern, UserPayload->Pattern, sizeof(Pattern));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    Status = XdpProgramCreatePayloadPatternTable(&Pattern, &Table);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    //
+    // The pattern is not referenced after the table is built.
+    //
+    KernelPayload->Port = UserPayload->Port;
+    KernelPayload->Pattern = NULL;
+    KernelPayload->Reserved = Table;
+
+Exit:
+
+    return Status;
+}
+
+NTSTATUS
+XdpProgramCaptureXskMap(
+    _In_ const XDP_XSK_MAP *UserXskMap,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _In_ BOOLEAN Distinct,
+    _Out_ XDP_XSK_MAP_TABLE **Table
+    )
+{
+    NTSTATUS Status;
+    XDP_XSK_MAP XskMap;
+    HANDLE *Sockets = NULL;
+    XDP_XSK_MAP_TABLE *NewTable = NULL;
+    SIZE_T SocketsSize;
+    SIZE_T TableSize;
+
+    *Table = NULL;
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead((VOID *)UserXskMap, sizeof(*UserXskMap), PROBE_ALIGNMENT(XDP_XSK_MAP));
+        }
+        RtlCopyVolatileMemory(&XskMap, UserXskMap, sizeof(XskMap));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if (XskMap.SocketCount == 0 || XskMap.SocketCount > XDP_XSK_MAP_MAX_SOCKETS) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Status = RtlSizeTMult(sizeof(*Sockets), XskMap.SocketCount, &SocketsSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = RtlSizeTAdd(sizeof(*NewTable), SocketsSize, &TableSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Sockets = ExAllocatePoolZero(PagedPool, SocketsSize, XDP_POOLTAG_XSK_MAP);
+    if (Sockets == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead((VOID *)XskMap.Sockets, SocketsSize, PROBE_ALIGNMENT(HANDLE));
+        }
+        RtlCopyVolatileMemory(Sockets, XskMap.Sockets, SocketsSize);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    NewTable = ExAllocatePoolZero(NonPagedPoolNx, TableSize, XDP_POOLTAG_XSK_MAP);
+    if (NewTable == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    //
+    // Unreferenced entries remain NULL, so a partially referenced table can be
+    // deleted on failure.
+    //
+    NewTable->SocketCount = XskMap.SocketCount;
+
+    for (UINT32 Index = 0; Index < XskMap.SocketCount; Index++) {
+        Status =
+            XskReferenceDatapathHandle(
+                RequestorMode, &Sockets[Index], TRUE, &NewTable->Sockets[Index]);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        //
+        // Compare the referenced datapath handles rather than the user handles,
+        // which may be duplicates of each other.
+        //
+        for (UINT32 Previous = 0; Distinct && Previous < Index; Previous++) {
+            if (NewTable->Sockets[Previous] == NewTable->Sockets[Index]) {
+                Status = STATUS_INVALID_PARAMETER;
+                goto Exit;
+            }
+        }
+    }
+
+    *Table = NewTable;
+    NewTable = NULL;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (NewTable != NULL) {
+        XdpProgramDeleteXskMap(NewTable);
+    }
+
+    if (Sockets != NULL) {
+        ExFreePoolWithTag(Sockets, XDP_POOLTAG_XSK_MAP);
+    }
+
+    return Status;
+}
+
+static
+NTSTATUS
+XdpProgramCreateQuicLbKey(
+    _In_ const XDP_QUIC_LB *QuicLb,
+    _Inout_ XDP_QUIC_LB_TABLE *Table
+    )
+{
+    NTSTATUS Status;
+    ULONG KeyObjectLength;
+    ULONG Result;
+
+    Status =
+        BCryptOpenAlgorithmProvider(
+            &Table->Algorithm, BCRYPT_AES_ALGORITHM, NULL, BCRYPT_PROV_DISPATCH);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    //
+    // Single-pass decryption is one AES block, so chaining is not used.
+    //
+    Status =
+        BCryptSetProperty(
+            Table->Algorithm, BCRYPT_CHAINING_MODE, (UCHAR *)BCRYPT_CHAIN_MODE_ECB,
+            sizeof(BCRYPT_CHAIN_MODE_ECB), 0);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status =
+        BCryptGetProperty(
+            Table->Algorithm, BCRYPT_OBJECT_LENGTH, (UCHAR *)&KeyObjectLength,
+            sizeof(KeyObjectLength), &Result, 0);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Table->KeyObject = ExAllocatePoolZero(NonPagedPoolNx, KeyObjectLength, XDP_POOLTAG_QUIC_LB);
+    if (Table->KeyObject == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Status =
+        BCryptGenerateSymmetricKey(
+            Table->Algorithm, &Table->Key, Table->KeyObject, KeyObjectLength,
+            (UCHAR *)QuicLb->Key, sizeof(QuicLb->Key), 0);
+
+Exit:
+
+    return Status;
+}
+
+NTSTATUS
+XdpProgramCaptureQuicLb(
+    _In_ const XDP_QUIC_LB *UserQuicLb,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Out_ XDP_QUIC_LB_TABLE **Table
+    )
+{
+    NTSTATUS Status;
+    XDP_QUIC_LB QuicLb;
+    XDP_QUIC_LB_SERVER *Servers = NULL;
+    XDP_QUIC_LB_TABLE *NewTable = NULL;
+    SIZE_T ServersSize;
+
+    *Table = NULL;
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead((VOID *)UserQuicLb, sizeof(*UserQuicLb), PROBE_ALIGNMENT(XDP_QUIC_LB));
+        }
+        RtlCopyVolatileMemory(&QuicLb, UserQuicLb, sizeof(QuicLb));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if (QuicLb.ServerCount == 0 || QuicLb.ServerCount > XDP_QUIC_LB_MAX_SERVERS) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    ServersSize = sizeof(*Servers) * QuicLb.ServerCount;
+
+    Servers = ExAllocatePoolZero(PagedPool, ServersSize, XDP_POOLTAG_QUIC_LB);
+    if (Servers == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID *)QuicLb.Servers, ServersSize, PROBE_ALIGNMENT(XDP_QUIC_LB_SERVER));
+        }
+        RtlCopyVolatileMemory(Servers, QuicLb.Servers, ServersSize);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    Status = XdpProgramCreateQuicLbTable(&QuicLb, Servers, &NewTable);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    //
+    // Servers may share a socket, e.g. when one socket serves several server
+    // IDs, so sockets are not required to be distinct.
+    //
+    for (UINT32 Index = 0; Index < QuicLb.ServerCount; Index++) {
+        Status =
+            XskReferenceDatapathHandle(
+                RequestorMode, &Servers[Index].Socket, TRUE, &NewTable->Servers[Index].Socket);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    if (QuicLb.Flags & XDP_QUIC_LB_FLAG_ENCRYPTED) {
+        Status = XdpProgramCreateQuicLbKey(&QuicLb, NewTable);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    *Table = NewTable;
+    NewTable = NULL;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    RtlSecureZeroMemory(QuicLb.Key, sizeof(QuicLb.Key));
+
+    if (NewTable != NULL) {
+        XdpProgramDeleteQuicLbTable(NewTable);
+    }
+
+    if (Servers != NULL) {
+        ExFreePoolWithTag(Servers, XDP_POOLTAG_QUIC_LB);
+    }
+
+    return Status;
+}
+
+NTSTATUS
+XdpProgramCreatePolicer(
+    _In_ const XDP_POLICE_PARAMS *Params,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Out_ XDP_POLICER **Policer
+    )
+{
+    NTSTATUS Status;
+    XDP_POLICER *NewPolicer = NULL;
+    UINT32 BucketCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    SIZE_T BucketsSize;
+    SIZE_T PolicerSize;
+
+    *Policer = NULL;
+
+    if (Params->PacketsPerSecond == 0 && Params->BytesPerSecond == 0) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Status = RtlSizeTMult(sizeof(NewPolicer->Buckets[0]), BucketCount, &BucketsSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = RtlSizeTAdd(sizeof(*NewPolicer), BucketsSize, &PolicerSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    //
+    // Each processor's bucket is on its own cache line. The buckets start
+    // empty with a zero refill time, so the first frame on each processor
+    // fills its bucket.
+    //
+    NewPolicer = ExAllocatePoolZero(NonPagedPoolNxCacheAligned, PolicerSize, XDP_POOLTAG_POLICER);
+    if (NewPolicer == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    NewPolicer->PacketsPerSecond = Params->PacketsPerSecond;
+    NewPolicer->BytesPerSecond = Params->BytesPerSecond;
+    NewPolicer->BucketCount = BucketCount;
+
+    if (Params->ConformTarget != NULL) {
+        Status =
+            XskReferenceDatapathHandle(
+                RequestorMode, &Params->ConformTarget, TRUE, &NewPolicer->ConformTarget);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    *Policer = NewPolicer;
+    NewPolicer = NULL;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (NewPolicer != NULL) {
+        XdpProgramDeletePolicer(NewPolicer);
+    }
+
+    return Status;
+}
+
+NTSTATUS
+XdpProgramCaptureLoadBalancer(
+    _In_ const XDP_LOAD_BALANCE_PARAMS *UserParams,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_LOAD_BALANCE_PARAMS *KernelParams
+    )
+{
+    NTSTATUS Status;
+    XDP_LOAD_BALANCER_BACKEND *Backends = NULL;
+    UINT32 BackendCount = UserParams->BackendCount;
+    XDP_LOAD_BALANCER *LoadBalancer;
+    SIZE_T BackendsSize;
+
+    if (UserParams->Reserved != NULL ||
+        BackendCount == 0 || BackendCount > XDP_LOAD_BALANCER_MAX_BACKENDS) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    BackendsSize = sizeof(*Backends) * BackendCount;
+
+    Backends = ExAllocatePoolZero(PagedPool, BackendsSize, XDP_POOLTAG_LOAD_BALANCER);
+    if (Backends == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID *)UserParams->Backends, BackendsSize,
+                PROBE_ALIGNMENT(XDP_LOAD_BALANCER_BACKEND));
+        }
+        RtlCopyVolatileMemory(Backends, UserParams->Backends, BackendsSize);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    Status =
+        XdpProgramCreateLoadBalancer(Backends, BackendCount, UserParams->Flags, &LoadBalancer);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    //
+    // The load balancer holds its own copy of the backends.
+    //
+    KernelParams->Backends = NULL;
+    KernelParams->BackendCount = BackendCount;
+    KernelParams->Flags = UserParams->Flags;
+    KernelParams->Reserved = LoadBalancer;
+
+Exit:
+
+    if (Backends != NULL) {
+        ExFreePoolWithTag(Backends, XDP_POOLTAG_LOAD_BALANCER);
+    }
+
+    return Status;
+}
+
+NTSTATUS
+XdpProgramCaptureEncap(
+    _In_ const XDP_ENCAP_PARAMS *UserParams,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_ENCAP_PARAMS *KernelParams
+    )
+{
+    NTSTATUS Status;
+    UINT8 Header[XDP_ENCAP_MAX_HEADER_LENGTH];
+    UINT32 HeaderLength = UserParams->HeaderLength;
+    XDP_ENCAPSULATOR *Encapsulator;
+
+    if (UserParams->Reserved != NULL || HeaderLength > sizeof(Header)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead((VOID *)UserParams->Header, HeaderLength, 1);
+        }
+        RtlCopyVolatileMemory(Header, UserParams->Header, HeaderLength);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    Status =
+        XdpProgramCreateEncapsulator(UserParams->Type, Header, HeaderLength, &Encapsulator);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    //
+    // The encapsulator holds its own copy of the header template.
+    //
+    KernelParams->Type = UserParams->Type;
+    KernelParams->Flags = UserParams->Flags;
+    KernelParams->Header = NULL;
+    KernelParams->HeaderLength = HeaderLength;
+    KernelParams->Reserved = Encapsulator;
+
+Exit:
+
+    return Status;
+}
+
+static XDP_TIMER_WHEEL_ROUTINE XdpProgramConntrackAgingTimeout;
+
+_Use_decl_annotations_
+VOID
+XdpProgramConntrackAgingTimeout(
+    XDP_TIMER_WHEEL_ENTRY *Entry
+    )
+{
+    XDP_PROGRAM_CONNTRACK *Conntrack =
+        CONTAINING_RECORD(Entry, XDP_PROGRAM_CONNTRACK, AgingEntry);
+
+    //
+    // Timer wheel routines run in DPCs, which are flushed before the table is
+    // freed, so the table remains valid for the duration of this routine.
+    //
+    XdpProgramAgeConntrackTable(&Conntrack->Table);
+
+    if (!ReadBooleanAcquire(&Conntrack->AgingShutdown)) {
+        (VOID)XdpTimerWheelStart(
+            XdpProgramTimerWheel, &Conntrack->AgingEntry, XDP_CONNTRACK_AGING_INTERVAL_MS);
+    }
+}
+
+static
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpProgramConntrackFree(
+    _In_ XDP_PROGRAM_CONNTRACK *Conntrack
+    )
+{
+    //
+    // Prevent the aging routine from restarting its entry, wait for any routine
+    // that may already have decided to restart it, then cancel the entry and
+    // wait for any routine that raced with the cancel.
+    //
+    WriteBooleanRelease(&Conntrack->AgingShutdown, TRUE);
+    KeFlushQueuedDpcs();
+    (VOID)XdpTimerWheelCancel(XdpProgramTimerWheel, &Conntrack->AgingEntry);
+    KeFlushQueuedDpcs();
+
+    if (Conntrack->Table.Entries != NULL) {
+        ExFreePoolWithTag(Conntrack->Table.Entries, XDP_POOLTAG_CONNTRACK);
+    }
+
+    ExFreePoolWithTag(Conntrack, XDP_POOLTAG_CONNTRACK);
+}
+
+static
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XdpProgramConntrackReference(
+    _In_ UINT32 IfIndex,
+    _Out_ XDP_PROGRAM_CONNTRACK **NewConntrack
+    )
+{
+    NTSTATUS Status;
+    XDP_PROGRAM_CONNTRACK *Conntrack = NULL;
+
+    RtlAcquirePushLockExclusive(&XdpProgramConntrackLock);
+
+    for (LIST_ENTRY *Entry = XdpProgramConntrackTables.Flink;
+        Entry != &XdpProgramConntrackTables;
+        Entry = Entry->Flink) {
+        XDP_PROGRAM_CONNTRACK *Candidate = CONTAINING_RECORD(Entry, XDP_PROGRAM_CONNTRACK, Link);
+
+        if (Candidate->IfIndex == IfIndex) {
+            Candidate->ReferenceCount++;
+            *NewConntrack = Candidate;
+            Status = STATUS_SUCCESS;
+            goto Exit;
+        }
+    }
+
+    Conntrack = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Conntrack), XDP_POOLTAG_CONNTRACK);
+    if (Conntrack == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Conntrack->IfIndex = IfIndex;
+    Conntrack->ReferenceCount = 1;
+    XdpTimerWheelInitializeEntry(&Conntrack->AgingEntry, XdpProgramConntrackAgingTimeout);
+    Conntrack->Table.IdleTimeout = RTL_MILLISEC_TO_100NANOSEC(XDP_CONNTRACK_IDLE_TIMEOUT_MS);
+    Conntrack->Table.EntryMask = XDP_CONNTRACK_TABLE_SIZE - 1;
+    Conntrack->Table.Entries =
+        ExAllocatePoolZero(
+            NonPagedPoolNxCacheAligned,
+            sizeof(*Conntrack->Table.Entries) * XDP_CONNTRACK_TABLE_SIZE,
+            XDP_POOLTAG_CONNTRACK);
+    if (Conntrack->Table.Entries == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    (VOID)XdpTimerWheelStart(
+        XdpProgramTimerWheel, &Conntrack->AgingEntry, XDP_CONNTRACK_AGING_INTERVAL_MS);
+
+    InsertTailList(&XdpProgramConntrackTables, &Conntrack->Link);
+    *NewConntrack = Conntrack;
+    Conntrack = NULL;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    RtlReleasePushLockExclusive(&XdpProgramConntrackLock);
+
+    if (Conntrack != NULL) {
+        XdpProgramConntrackFree(Conntrack);
+    }
+
+    return Status;
+}
+
+static
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpProgramConntrackDereference(
+    _In_ XDP_PROGRAM_CONNTRACK *Conntrack
+    )
+{
+    BOOLEAN Free;
+
+    RtlAcquirePushLockExclusive(&XdpProgramConntrackLock);
+
+    ASSERT(Conntrack->ReferenceCount > 0);
+    Free = --Conntrack->ReferenceCount == 0;
+    if (Free) {
+        RemoveEntryList(&Conntrack->Link);
+    }
+
+    RtlReleasePushLockExclusive(&XdpProgramConntrackLock);
+
+    if (Free) {
+        XdpProgramConntrackFree(Conntrack);
+    }
+}
+
+//
+// Attaches the connection tracking rules and SYN cookie actions of a rule set
+// to the connection tracking table of the program object's interface.
+//
+static
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XdpProgramAttachConntrackRules(
+    _Inout_ XDP_PROGRAM_OBJECT *ProgramObject,
+    _Inout_ XDP_PROGRAM *Program
+    )
+{
+    NTSTATUS Status;
+
+    for (UINT32 Index = 0; Index < Program->RuleCount; Index++) {
+        XDP_RULE *Rule = &Program->Rules[Index];
+
+        if (Rule->Match != XDP_MATCH_CONNTRACK_TRACK &&
+            Rule->Match != XDP_MATCH_CONNTRACK_ESTABLISHED &&
+            Rule->Action != XDP_PROGRAM_ACTION_SYN_COOKIE) {
+            continue;
+        }
+
+        if (ProgramObject->Conntrack == NULL) {
+            Status = XdpProgramConntrackReference(ProgramObject->IfIndex, &ProgramObject->Conntrack);
+            if (!NT_SUCCESS(Status)) {
+                return Status;
+            }
+        }
+
+        if (Rule->Match == XDP_MATCH_CONNTRACK_TRACK ||
+            Rule->Match == XDP_MATCH_CONNTRACK_ESTABLISHED) {
+            Rule->Pattern.Conntrack.Reserved = &ProgramObject->Conntrack->Table;
+        }
+
+        //
+        // SYN cookie actions track the connections they complete.
+        //
+        if (Rule->Action == XDP_PROGRAM_ACTION_SYN_COOKIE) {
+            XDP_SYN_COOKIE *SynCookie = Rule->SynCookie.Reserved;
+
+            SynCookie->Conntrack = &ProgramObject->Conntrack->Table;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XdpProgramRulesAllocate(
+    _In_ UINT32 RuleCount,
+    _Out_ XDP_PROGRAM **NewProgram
+    )
+{
+    XDP_PROGRAM *Program = NULL;
+    SIZE_T AllocationSize;
+    NTSTATUS Status;
+
+    Status = RtlSizeTMult(sizeof(XDP_RULE), RuleCount, &AllocationSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = RtlSizeTAdd(sizeof(*Program), AllocationSize, &AllocationSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Program = ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, XDP_POOLTAG_PROGRAM_RULES);
+    if (Program == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+Exit:
+
+    *NewProgram = Program;
+    return Status;
+}
+
+static
+VOID
+XdpProgramDeleteRules(
+    _In_ XDP_PROGRAM *Program
+    )
+{
+    for (UINT32 Index = 0; Index < Program->RuleCount; Index++) {
+        XdpProgramDeleteRule(&Program->Rules[Index]);
+    }
+
+    ExFreePoolWithTag(Program, XDP_POOLTAG_PROGRAM_RULES);
+}
+
+static
+VOID
+XdpProgramAllQueuesSetDetach(
+    _In_ XDP_BINDING_CLIENT_ENTRY *ClientEntry
+    )
+{
+    XDP_PROGRAM_ALL_QUEUES_SET *AllQueuesSet =
+        CONTAINING_RECORD(ClientEntry, XDP_PROGRAM_ALL_QUEUES_SET, BindingClientEntry);
+
+    TraceEnter(TRACE_CORE, "AllQueuesSet=%p", AllQueuesSet);
+
+    //
+    // The interface is being removed, so no further RX queues are created.
+    //
+    while (!IsListEmpty(&AllQueuesSet->ProgramObjects)) {
+        XDP_PROGRAM_OBJECT *ProgramObject =
+            CONTAINING_RECORD(
+                AllQueuesSet->ProgramObjects.Flink, XDP_PROGRAM_OBJECT, AllQueuesLink);
+
+        RemoveEntryList(&ProgramObject->AllQueuesLink);
+        InitializeListHead(&ProgramObject->AllQueuesLink);
+        ProgramObject->AllQueuesSet = NULL;
+    }
+
+    ExFreePoolWithTag(AllQueuesSet, XDP_POOLTAG_PROGRAM_SET);
+
+    TraceExitSuccess(TRACE_CORE);
+}
+
+static
+CONST
+XDP_BINDING_CLIENT XdpProgramAllQueuesBindingClient = {
+    .ClientId           = XDP_BINDING_CLIENT_ID_PROGRAM,
+    .KeySize            = sizeof(XDP_HOOK_ID),
+    .BindingDetached    = XdpProgramAllQueuesSetDetach,
+};
+
+static
+XDP_PROGRAM_ALL_QUEUES_SET *
+XdpProgramFindAllQueuesSet(
+    _In_ XDP_BINDING_HANDLE BindingHandle,
+    _In_ const XDP_HOOK_ID *HookId
+    )
+{
+    XDP_BINDING_CLIENT_ENTRY *ClientEntry;
+
+    ClientEntry = XdpIfFindClientEntry(BindingHandle, &XdpProgramAllQueuesBindingClient, HookId);
+    if (ClientEntry == NULL) {
+        return NULL;
+    }
+
+    return CONTAINING_RECORD(ClientEntry, XDP_PROGRAM_ALL_QUEUES_SET, BindingClientEntry);
+}
+
+static
+NTSTATUS
+XdpProgramJoinAllQueuesSet(
+    _In_ XDP_BINDING_HANDLE BindingHandle,
+    _In_ const XDP_HOOK_ID *HookId,
+    _Inout_ XDP_PROGRAM_OBJECT *ProgramObject
+    )
+{
+    XDP_PROGRAM_ALL_QUEUES_SET *AllQueuesSet;
+    NTSTATUS Status;
+
+    AllQueuesSet = XdpProgramFindAllQueuesSet(BindingHandle, HookId);
+    if (AllQueuesSet == NULL) {
+        AllQueuesSet =
+            ExAllocatePoolZero(NonPagedPoolNx, sizeof(*AllQueuesSet), XDP_POOLTAG_PROGRAM_SET);
+        if (AllQueuesSet == NULL) {
+            Status = STATUS_NO_MEMORY;
+            goto Exit;
+        }
+
+        XdpIfInitializeClientEntry(&AllQueuesSet->BindingClientEntry);
+        AllQueuesSet->BindingHandle = BindingHandle;
+        AllQueuesSet->HookId = *HookId;
+        InitializeListHead(&AllQueuesSet->ProgramObjects);
+
+        Status =
+            XdpIfRegisterClient(
+                BindingHandle, &XdpProgramAllQueuesBindingClient, &AllQueuesSet->HookId,
+                &AllQueuesSet->BindingClientEntry);
+        if (!NT_SUCCESS(Status)) {
+            ExFreePoolWithTag(AllQueuesSet, XDP_POOLTAG_PROGRAM_SET);
+            goto Exit;
+        }
+    }
+
+    InsertTailList(&AllQueuesSet->ProgramObjects, &ProgramObject->AllQueuesLink);
+    ProgramObject->AllQueuesSet = AllQueuesSet;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceInfo(
+        TRACE_CORE, "ProgramObject=%p AllQueuesSet=%p Status=%!STATUS!",
+        ProgramObject, AllQueuesSet, Status);
+    return Status;
+}
+
+static
+VOID
+XdpProgramLeaveAllQueuesSet(
+    _Inout_ XDP_PROGRAM_OBJECT *ProgramObject
+    )
+{
+    XDP_PROGRAM_ALL_QUEUES_SET *AllQueuesSet = ProgramObject->AllQueuesSet;
+
+    if (AllQueuesSet == NULL) {
+        return;
+    }
+
+    RemoveEntryList(&ProgramObject->AllQueuesLink);
+    InitializeListHead(&ProgramObject->AllQueuesLink);
+    ProgramObject->AllQueuesSet = NULL;
+
+    if (IsListEmpty(&AllQueuesSet->ProgramObjects)) {
+        XdpIfDeregisterClient(AllQueuesSet->BindingHandle, &AllQueuesSet->BindingClientEntry);
+        ExFreePoolWithTag(AllQueuesSet, XDP_POOLTAG_PROGRAM_SET);
+    }
+}
+
+//
+// Returns whether the interface can drop frames matching the rule on behalf of
+// the program, and if so, the equivalent drop filter.
+//
+static
+BOOLEAN
+XdpProgramGetDropOffloadFilter(
+    _In_ const XDP_RULE *Rule,
+    _Out_ XDP_OFFLOAD_DROP_FILTER *Filter
+    )
+{
+    RtlZeroMemory(Filter, sizeof(*Filter));
+
+    if (Rule->Action != XDP_PROGRAM_ACTION_DROP) {
+        return FALSE;
+    }
+
+    switch (Rule->Match) {
+    case XDP_MATCH_UDP:
+        Filter->IpProtocol = IPPROTO_UDP;
+        return TRUE;
+    case XDP_MATCH_UDP_DST:
+        Filter->IpProtocol = IPPROTO_UDP;
+        Filter->DestinationPort = Rule->Pattern.Port;
+        return Filter->DestinationPort != 0;
+    case XDP_MATCH_TCP_DST:
+        Filter->IpProtocol = IPPROTO_TCP;
+        Filter->DestinationPort = Rule->Pattern.Port;
+        return Filter->DestinationPort != 0;
+    default:
+        return FALSE;
+    }
+}
+
+//
+// Returns whether the program object's rules run before those of any other
+// program object on each of its RX queues.
+//
+static
+BOOLEAN
+XdpProgramRunsFirst(
+    _In_ const XDP_PROGRAM_OBJECT *ProgramObject
+    )
+{
+    for (LIST_ENTRY *Entry = ProgramObject->ProgramBindings.Flink;
+        Entry != &ProgramObject->ProgramBindings;
+        Entry = Entry->Flink) {
+        XDP_PROGRAM_BINDING *ProgramBinding = CONTAINING_RECORD(Entry, XDP_PROGRAM_BINDING, Link);
+
+        if (!IsListEmpty(&ProgramBinding->RxQueueEntry) &&
+            XdpRxQueueGetProgramBindingList(ProgramBinding->RxQueue)->Flink !=
+                &ProgramBinding->RxQueueEntry) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+//
+// Programs the leading drop rules of an all-queues program object into the
+// interface, which drops matching frames before inspection. Only leading rules
+// are offloaded, and only while the program object's rules run first on every
+// RX queue, so no frame the interface drops could have matched an earlier rule.
+// Rules the interface cannot or does not apply still run in software.
+//
+static
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpProgramOffloadDropRules(
+    _Inout_ XDP_PROGRAM_OBJECT *ProgramObject
+    )
+{
+    const XDP_PROGRAM *Program = ProgramObject->Program;
+    XDP_OFFLOAD_DROP_FILTER *Filters = NULL;
+    UINT32 FilterCount = 0;
+    NTSTATUS Status;
+
+    if (ProgramObject->DropOffloadHandle == NULL) {
+        return;
+    }
+
+    TraceEnter(TRACE_CORE, "ProgramObject=%p", ProgramObject);
+
+    Filters =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, sizeof(*Filters) * XDP_PROGRAM_MAX_DROP_OFFLOAD_RULES,
+            XDP_POOLTAG_PROGRAM);
+    if (Filters == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    if (XdpProgramRunsFirst(ProgramObject)) {
+        while (FilterCount < min(Program->RuleCount, XDP_PROGRAM_MAX_DROP_OFFLOAD_RULES) &&
+            XdpProgramGetDropOffloadFilter(&Program->Rules[FilterCount], &Filters[FilterCount])) {
+            FilterCount++;
+        }
+    }
+
+    Status =
+        XdpOffloadDropFilterSet(
+            ProgramObject->DropOffloadIfSet, ProgramObject->DropOffloadHandle, Filters,
+            FilterCount);
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
         //
-        // Update the program in-place because we are down sizing the program bindings.
+        // Never leave filters of previous rules in place.
         //
-        XdpRxQueueSync(RxQueue, XdpProgramUpdateCompiledProgram, RxQueue);
+        FilterCount = 0;
+        XdpOffloadDropFilterSet(
+            ProgramObject->DropOffloadIfSet, ProgramObject->DropOffloadHandle, NULL, 0);
+    }
+
+    ProgramObject->DropOffloadRuleCount = FilterCount;
+
+    if (Filters != NULL) {
+        ExFreePoolWithTag(Filters, XDP_POOLTAG_PROGRAM);
     }
 
+    TraceInfo(
+        TRACE_CORE, "ProgramObject=%p DropOffloadRuleCount=%u Status=%!STATUS!",
+        ProgramObject, FilterCount, Status);
     TraceExitSuccess(TRACE_CORE);
 }
 
+static
+_IRQL_requires_(PASSIVE_LEVEL)
 VOID
-XdpProgramReleasePortSet(
-    _Inout_ XDP_PORT_SET *PortSet
+XdpProgramWithdrawDropRules(
+    _Inout_ XDP_PROGRAM_OBJECT *ProgramObject
     )
 {
-    PortSet->PortSet = NULL;
-
-    if (PortSet->Reserved != NULL) {
-        MDL *Mdl = PortSet->Reserved;
-        if (Mdl->MdlFlags & MDL_PAGES_LOCKED) {
-            MmUnlockPages(Mdl);
-        }
-        IoFreeMdl(Mdl);
-        PortSet->Reserved = NULL;
+    if (ProgramObject->DropOffloadRuleCount > 0) {
+        XdpOffloadDropFilterSet(
+            ProgramObject->DropOffloadIfSet, ProgramObject->DropOffloadHandle, NULL, 0);
+        ProgramObject->DropOffloadRuleCount = 0;
     }
 }
 
-NTSTATUS
-XdpProgramCapturePortSet(
-    _In_ const XDP_PORT_SET *UserPortSet,
-    _In_ KPROCESSOR_MODE RequestorMode,
-    _Inout_ XDP_PORT_SET *KernelPortSet
+static
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpProgramOpenDropOffload(
+    _Inout_ XDP_PROGRAM_OBJECT *ProgramObject,
+    _In_ XDP_BINDING_HANDLE BindingHandle,
+    _In_ const XDP_HOOK_ID *HookId
     )
 {
+    XDP_IFSET_HANDLE IfSetHandle = XdpIfGetIfSetHandle(BindingHandle);
     NTSTATUS Status;
 
-    __try {
-        if (UserPortSet->Reserved != NULL) {
-            Status = STATUS_INVALID_PARAMETER;
-            goto Exit;
-        }
-
-        KernelPortSet->Reserved =
-            IoAllocateMdl(
-                (VOID *)UserPortSet->PortSet, XDP_PORT_SET_BUFFER_SIZE, FALSE, FALSE, NULL);
-        if (KernelPortSet->Reserved == NULL) {
-            Status = STATUS_INSUFFICIENT_RESOURCES;
-            goto Exit;
-        }
-
-        MmProbeAndLockPages(KernelPortSet->Reserved, RequestorMode, IoReadAccess);
-
-        KernelPortSet->PortSet =
-            MmGetSystemAddressForMdlSafe(KernelPortSet->Reserved, LowPagePriority);
-        if (KernelPortSet->PortSet == NULL) {
-            Status = STATUS_INSUFFICIENT_RESOURCES;
-            goto Exit;
-        }
-
-        Status = STATUS_SUCCESS;
-    } __except(EXCEPTION_EXECUTE_HANDLER) {
-        Status = GetExceptionCode();
-        goto Exit;
+    Status =
+        XdpIfOpenInterfaceOffloadHandle(
+            IfSetHandle, HookId, &ProgramObject->DropOffloadHandle);
+    if (!NT_SUCCESS(Status)) {
+        //
+        // The program's rules all run in software.
+        //
+        TraceWarn(
+            TRACE_CORE, "ProgramObject=%p Failed to open drop offload Status=%!STATUS!",
+            ProgramObject, Status);
+        ProgramObject->DropOffloadHandle = NULL;
+        return;
     }
 
-Exit:
+    ProgramObject->DropOffloadIfSet = IfSetHandle;
+    XdpProgramOffloadDropRules(ProgramObject);
+}
 
-    if (!NT_SUCCESS(Status)) {
-        XdpProgramReleasePortSet(KernelPortSet);
+static
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpProgramCloseDropOffload(
+    _Inout_ XDP_PROGRAM_OBJECT *ProgramObject
+    )
+{
+    if (ProgramObject->DropOffloadHandle != NULL) {
+        //
+        // Closing the handle reverts the programmed filters.
+        //
+        XdpIfCloseInterfaceOffloadHandle(
+            ProgramObject->DropOffloadIfSet, ProgramObject->DropOffloadHandle);
+        ProgramObject->DropOffloadHandle = NULL;
+        ProgramObject->DropOffloadRuleCount = 0;
     }
-
-    return Status;
 }
 
 static
@@ -914,6 +3206,13 @@ XdpProgramDelete(
 {
     TraceEnter(TRACE_CORE, "ProgramObject=%p", ProgramObject);
 
+    //
+    // Stop following RX queue creation before detaching from RX queues, and
+    // stop dropping frames on behalf of the program.
+    //
+    XdpProgramLeaveAllQueuesSet(ProgramObject);
+    XdpProgramCloseDropOffload(ProgramObject);
+
     while (!IsListEmpty(&ProgramObject->ProgramBindings)) {
         XDP_PROGRAM_BINDING *ProgramBinding =
             (XDP_PROGRAM_BINDING *)ProgramObject->ProgramBindings.Flink;
@@ -940,11 +3239,26 @@ XdpProgramDelete(
     //
     // Clean up the XDP program after data path references are dropped.
     //
+    if (ProgramObject->SharedProgram != NULL) {
+        ExFreePoolWithTag(ProgramObject->SharedProgram, XDP_POOLTAG_PROGRAM);
+    }
+
+    if (ProgramObject->Program != NULL) {
+        XdpProgramDeleteRules(ProgramObject->Program);
+    }
+
+    if (!IsListEmpty(&ProgramObject->CountersLink)) {
+        RtlAcquirePushLockExclusive(&XdpProgramCountersLock);
+        RemoveEntryList(&ProgramObject->CountersLink);
+        RtlReleasePushLockExclusive(&XdpProgramCountersLock);
+    }
 
-    for (ULONG Index = 0; Index < ProgramObject->Program.RuleCount; Index++) {
-        XDP_RULE *Rule = &ProgramObject->Program.Rules[Index];
+    if (ProgramObject->RuleCounters != NULL) {
+        ExFreePoolWithTag(ProgramObject->RuleCounters, XDP_POOLTAG_PROGRAM_COUNTERS);
+    }
 
-        XdpProgramDeleteRule(Rule);
+    if (ProgramObject->Conntrack != NULL) {
+        XdpProgramConntrackDereference(ProgramObject->Conntrack);
     }
 
     TraceVerbose(TRACE_CORE, "Deleted ProgramObject=%p", ProgramObject);
@@ -976,7 +3290,24 @@ XdpProgramIsEbpf(
     _In_ XDP_PROGRAM *Program
     )
 {
-    return Program->RuleCount == 1 && Program->Rules[0].Action == XDP_PROGRAM_ACTION_EBPF;
+    return
+        Program->RuleCount == 1 &&
+        Program->Rules[0].Match == XDP_MATCH_ALL &&
+        Program->Rules[0].Action == XDP_PROGRAM_ACTION_EBPF;
+}
+
+BOOLEAN
+XdpProgramContainsEbpf(
+    _In_ XDP_PROGRAM *Program
+    )
+{
+    for (UINT32 Index = 0; Index < Program->RuleCount; Index++) {
+        if (Program->Rules[Index].Action == XDP_PROGRAM_ACTION_EBPF) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
 }
 
 BOOLEAN
@@ -993,28 +3324,118 @@ XdpProgramCanXskBypass(
         XskCanBypass(Program->Rules[0].Redirect.Target, RxQueue);
 }
 
+BOOLEAN
+XdpProgramCanXskPortSetBypass(
+    _In_ XDP_PROGRAM *Program,
+    _In_ XDP_RX_QUEUE *RxQueue
+    )
+{
+    if (Program->RuleCount == 0) {
+        return FALSE;
+    }
+
+    for (UINT32 Index = 0; Index < Program->RuleCount; Index++) {
+        const XDP_RULE *Rule = &Program->Rules[Index];
+
+        if (Rule->Match != XDP_MATCH_UDP_PORT_SET ||
+            Rule->Action != XDP_PROGRAM_ACTION_REDIRECT ||
+            Rule->Redirect.TargetType != XDP_REDIRECT_TARGET_TYPE_XSK ||
+            !XskCanBypass(Rule->Redirect.Target, RxQueue)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+BOOLEAN
+XdpProgramCanMatchAllBypass(
+    _In_ XDP_PROGRAM *Program
+    )
+{
+    return
+        Program->RuleCount == 1 &&
+        Program->Rules[0].Match == XDP_MATCH_ALL &&
+        (Program->Rules[0].Action == XDP_PROGRAM_ACTION_DROP ||
+            Program->Rules[0].Action == XDP_PROGRAM_ACTION_PASS);
+}
+
+BOOLEAN
+XdpProgramIsCompiled(
+    _In_ XDP_PROGRAM *Program
+    )
+{
+    return Program->Ops != NULL;
+}
+
 static
+_IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
-XdpProgramObjectAllocate(
+XdpProgramCaptureRules(
+    _In_reads_opt_(RuleCount) const XDP_RULE *Rules,
     _In_ UINT32 RuleCount,
-    _Out_ XDP_PROGRAM_OBJECT **NewProgramObject
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Out_ XDP_PROGRAM **NewProgram
     )
 {
-    XDP_PROGRAM_OBJECT *ProgramObject = NULL;
-    SIZE_T AllocationSize;
     NTSTATUS Status;
+    XDP_PROGRAM *Program = NULL;
 
-    Status = RtlSizeTMult(sizeof(XDP_RULE), RuleCount, &AllocationSize);
+    Status = XdpProgramRulesAllocate(RuleCount, &Program);
     if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
 
-    Status = RtlSizeTAdd(sizeof(*ProgramObject), AllocationSize, &AllocationSize);
-    if (!NT_SUCCESS(Status)) {
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead((VOID*)Rules, sizeof(*Rules) * RuleCount, PROBE_ALIGNMENT(XDP_RULE));
+        }
+        RtlCopyVolatileMemory(Program->Rules, Rules, sizeof(*Rules) * RuleCount);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
         goto Exit;
     }
 
-    ProgramObject = ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, XDP_POOLTAG_PROGRAM_OBJECT);
+    for (UINT32 Index = 0; Index < RuleCount; Index++) {
+        XDP_RULE UserRule = Program->Rules[Index];
+
+        Status = XdpProgramValidateRule(&Program->Rules[Index], RequestorMode, &UserRule);
+
+        //
+        // Whether or not the validation returns success, the program's rule
+        // fields have been sanitized.
+        //
+        Program->RuleCount++;
+
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status) && Program != NULL) {
+        XdpProgramDeleteRules(Program);
+        Program = NULL;
+    }
+
+    *NewProgram = Program;
+    return Status;
+}
+
+static
+NTSTATUS
+XdpProgramObjectAllocate(
+    _Out_ XDP_PROGRAM_OBJECT **NewProgramObject
+    )
+{
+    XDP_PROGRAM_OBJECT *ProgramObject = NULL;
+    NTSTATUS Status;
+
+    ProgramObject =
+        ExAllocatePoolZero(NonPagedPoolNx, sizeof(*ProgramObject), XDP_POOLTAG_PROGRAM_OBJECT);
     if (ProgramObject == NULL) {
         Status = STATUS_NO_MEMORY;
         goto Exit;
@@ -1022,6 +3443,9 @@ XdpProgramObjectAllocate(
 
     ProgramObject->CreatedByPid = (ULONG_PTR)PsGetCurrentProcessId();
     InitializeListHead(&ProgramObject->ProgramBindings);
+    InitializeListHead(&ProgramObject->CountersLink);
+    InitializeListHead(&ProgramObject->AllQueuesLink);
+    Status = STATUS_SUCCESS;
 
 Exit:
 
@@ -1033,57 +3457,45 @@ static
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
 XdpCaptureProgram(
+    _In_ UINT32 IfIndex,
     _In_ const XDP_RULE *Rules,
     _In_ ULONG RuleCount,
+    _In_ BOOLEAN EnableRuleCounters,
     _In_ KPROCESSOR_MODE RequestorMode,
     _Out_ XDP_PROGRAM_OBJECT **NewProgramObject
     )
 {
     NTSTATUS Status;
     XDP_PROGRAM_OBJECT *ProgramObject = NULL;
-    XDP_PROGRAM *Program = NULL;
 
     TraceEnter(TRACE_CORE, "-");
 
-    Status = XdpProgramObjectAllocate(RuleCount, &ProgramObject);
+    Status = XdpProgramObjectAllocate(&ProgramObject);
     if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
 
     TraceVerbose(TRACE_CORE, "Allocated ProgramObject=%p", ProgramObject);
 
-    Program = &ProgramObject->Program;
+    ProgramObject->IfIndex = IfIndex;
 
-    __try {
-        if (RequestorMode != KernelMode) {
-            ProbeForRead((VOID*)Rules, sizeof(*Rules) * RuleCount, PROBE_ALIGNMENT(XDP_RULE));
-        }
-        RtlCopyVolatileMemory(ProgramObject->Program.Rules, Rules, sizeof(*Rules) * RuleCount);
-    } __except (EXCEPTION_EXECUTE_HANDLER) {
-        Status = GetExceptionCode();
+    Status = XdpProgramCaptureRules(Rules, RuleCount, RequestorMode, &ProgramObject->Program);
+    if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
 
-    for (ULONG Index = 0; Index < RuleCount; Index++) {
-        XDP_RULE UserRule = Program->Rules[Index];
-
-        Status =
-            XdpProgramValidateRule(
-                &Program->Rules[Index], RequestorMode, &UserRule, RuleCount, Index);
-
-        //
-        // Whether or not the validation returns success, the program's rule
-        // fields have been sanitized.
-        //
-        Program->RuleCount++;
+    Status = XdpProgramAttachConntrackRules(ProgramObject, ProgramObject->Program);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
 
+    if (EnableRuleCounters) {
+        Status = XdpProgramCounterSetAllocate(RuleCount, &ProgramObject->RuleCounters);
         if (!NT_SUCCESS(Status)) {
             goto Exit;
         }
     }
 
-    Status = STATUS_SUCCESS;
-
 Exit:
 
     if (NT_SUCCESS(Status)) {
@@ -1110,7 +3522,7 @@ XdpProgramValidateIfQueue(
     )
 {
     XDP_PROGRAM_OBJECT *ProgramObject = ValidationContext;
-    XDP_PROGRAM *Program = &ProgramObject->Program;
+    XDP_PROGRAM *Program = ProgramObject->Program;
     NTSTATUS Status;
 
     TraceEnter(TRACE_CORE, "ProgramObject=%p", ProgramObject);
@@ -1119,21 +3531,20 @@ XdpProgramValidateIfQueue(
     // Perform further rule validation that requires an interface RX queue.
     //
 
-    //
-    // Since we don't know what an eBPF program will return, assume it will
-    // return all statuses.
-    //
-    if (XdpProgramIsEbpf(Program) && !XdpRxQueueIsTxActionSupported(XdpRxQueueGetConfig(RxQueue))) {
-        TraceError(
-            TRACE_CORE, "ProgramObject=%p RX queue does not support TX action", ProgramObject);
-        Status = STATUS_NOT_SUPPORTED;
-        goto Exit;
-    }
-
     for (ULONG Index = 0; Index < Program->RuleCount; Index++) {
         XDP_RULE *Rule = &Program->Rules[Index];
 
-        if (Rule->Action == XDP_PROGRAM_ACTION_L2FWD) {
+        //
+        // L2 forwarding, load balancing, SYN cookies, and encapsulation without
+        // a redirect require the TX action. Since we don't know what an eBPF
+        // program will return, assume it will return all statuses.
+        //
+        if (Rule->Action == XDP_PROGRAM_ACTION_L2FWD ||
+            Rule->Action == XDP_PROGRAM_ACTION_LOAD_BALANCE ||
+            Rule->Action == XDP_PROGRAM_ACTION_SYN_COOKIE ||
+            (Rule->Action == XDP_PROGRAM_ACTION_ENCAP &&
+                (Rule->Encap.Flags & XDP_ENCAP_FLAG_REDIRECT) == 0) ||
+            Rule->Action == XDP_PROGRAM_ACTION_EBPF) {
             if (!XdpRxQueueIsTxActionSupported(XdpRxQueueGetConfig(RxQueue))) {
                 TraceError(
                     TRACE_CORE, "ProgramObject=%p RX queue does not support TX action",
@@ -1144,11 +3555,97 @@ XdpProgramValidateIfQueue(
         }
     }
 
-    Status = STATUS_SUCCESS;
-
-Exit:
-
-    TraceExitStatus(TRACE_CORE);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_CORE);
+    return Status;
+}
+
+static
+NTSTATUS
+XdpProgramValidateRedirectTarget(
+    _In_ XDP_REDIRECT_TARGET_TYPE TargetType,
+    _In_ VOID *Target
+    )
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    switch (TargetType) {
+
+    case XDP_REDIRECT_TARGET_TYPE_XSK:
+    case XDP_REDIRECT_TARGET_TYPE_XSK_PRIORITY:
+        Status = XskValidateDatapathHandle(Target);
+        break;
+
+    case XDP_REDIRECT_TARGET_TYPE_XSK_MAP:
+    case XDP_REDIRECT_TARGET_TYPE_XSK_FANOUT:
+    {
+        const XDP_XSK_MAP_TABLE *Table = Target;
+
+        for (UINT32 SocketIndex = 0; SocketIndex < Table->SocketCount; SocketIndex++) {
+            Status = XskValidateDatapathHandle(Table->Sockets[SocketIndex]);
+            if (!NT_SUCCESS(Status)) {
+                break;
+            }
+        }
+
+        break;
+    }
+
+    case XDP_REDIRECT_TARGET_TYPE_QUIC_LB:
+    {
+        const XDP_QUIC_LB_TABLE *Table = Target;
+
+        for (UINT32 ServerIndex = 0; ServerIndex < Table->ServerCount; ServerIndex++) {
+            Status = XskValidateDatapathHandle(Table->Servers[ServerIndex].Socket);
+            if (!NT_SUCCESS(Status)) {
+                break;
+            }
+        }
+
+        break;
+    }
+
+    default:
+        break;
+    }
+
+    return Status;
+}
+
+static
+NTSTATUS
+XdpProgramValidateRedirectTargets(
+    _In_ const XDP_PROGRAM *Program
+    )
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    for (ULONG Index = 0; Index < Program->RuleCount && NT_SUCCESS(Status); Index++) {
+        const XDP_RULE *Rule = &Program->Rules[Index];
+
+        if (Rule->Action == XDP_PROGRAM_ACTION_REDIRECT) {
+            Status =
+                XdpProgramValidateRedirectTarget(
+                    Rule->Redirect.TargetType, Rule->Redirect.Target);
+        } else if (Rule->Action == XDP_PROGRAM_ACTION_SAMPLE) {
+            Status =
+                XdpProgramValidateRedirectTarget(Rule->Sample.TargetType, Rule->Sample.Target);
+        } else if (Rule->Action == XDP_PROGRAM_ACTION_DECAP_REDIRECT) {
+            Status =
+                XdpProgramValidateRedirectTarget(
+                    Rule->DecapRedirect.Redirect.TargetType, Rule->DecapRedirect.Redirect.Target);
+        } else if (Rule->Action == XDP_PROGRAM_ACTION_POLICE) {
+            const XDP_POLICER *Policer = Rule->Police.ConformTarget;
+
+            if (Policer->ConformTarget != NULL) {
+                Status = XskValidateDatapathHandle(Policer->ConformTarget);
+            }
+        }
+    }
+
     return Status;
 }
 
@@ -1193,7 +3690,7 @@ XdpProgramBindingAttach(
     _In_ UINT32 QueueId
     )
 {
-    XDP_PROGRAM *Program = &ProgramObject->Program;
+    XDP_PROGRAM *Program = ProgramObject->Program;
     XDP_PROGRAM_BINDING *ProgramBinding = NULL;
     XDP_PROGRAM *CompiledProgram = NULL;
     NTSTATUS Status;
@@ -1212,25 +3709,9 @@ XdpProgramBindingAttach(
         goto Exit;
     }
 
-    for (ULONG Index = 0; Index < Program->RuleCount; Index++) {
-        XDP_RULE *Rule = &Program->Rules[Index];
-
-        if (Rule->Action == XDP_PROGRAM_ACTION_REDIRECT) {
-
-            switch (Rule->Redirect.TargetType) {
-
-            case XDP_REDIRECT_TARGET_TYPE_XSK:
-                Status = XskValidateDatapathHandle(Rule->Redirect.Target);
-                if (!NT_SUCCESS(Status)) {
-                    goto Exit;
-                }
-
-                break;
-
-            default:
-                break;
-            }
-        }
+    Status = XdpProgramValidateRedirectTargets(Program);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
     }
 
     XDP_PROGRAM *OldCompiledProgram = XdpRxQueueGetProgram(ProgramBinding->RxQueue);
@@ -1240,16 +3721,19 @@ XdpProgramBindingAttach(
     // programs.
     //
     if (OldCompiledProgram != NULL &&
-        (XdpProgramIsEbpf(OldCompiledProgram) || XdpProgramIsEbpf(Program))) {
+        (XdpProgramContainsEbpf(OldCompiledProgram) || XdpProgramContainsEbpf(Program))) {
         Status = STATUS_INVALID_DEVICE_STATE;
         goto Exit;
     }
 
     InsertTailList(
         XdpRxQueueGetProgramBindingList(ProgramBinding->RxQueue), &ProgramBinding->RxQueueEntry);
-    Status = XdpProgramCompileNewProgram(ProgramBinding->RxQueue, &CompiledProgram);
-    if (!NT_SUCCESS(Status)) {
-        goto Exit;
+    CompiledProgram = XdpProgramGetSharedProgram(ProgramBinding->RxQueue);
+    if (CompiledProgram == NULL) {
+        Status = XdpProgramCompileNewProgram(ProgramBinding->RxQueue, &CompiledProgram);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
     }
 
     //
@@ -1268,10 +3752,15 @@ XdpProgramBindingAttach(
         ProgramBinding, ProgramBinding->RxQueue, ProgramObject);
     XdpProgramTraceObject(ProgramObject);
 
+    //
+    // If this swaps out an old compiled program, every rule it references is
+    // still owned by a bound program object, so the swap need not wait for
+    // the data path: the old program is freed once the data path retires it.
+    //
     Status =
         XdpRxQueueSetProgram(
             ProgramBinding->RxQueue, CompiledProgram, XdpProgramValidateIfQueue,
-            ProgramObject);
+            ProgramObject, XdpProgramFreeCompiledProgram);
     if (!NT_SUCCESS(Status)) {
         TraceError(
             TRACE_CORE, "Failed to attach ProgramObject=%p to RxQueue=%p Status=%!STATUS!",
@@ -1281,19 +3770,23 @@ XdpProgramBindingAttach(
 
     CompiledProgram = NULL;
 
-    if (OldCompiledProgram != NULL) {
-        //
-        // We just swapped in a new compiled program. Delete the old one.
-        //
-        ExFreePoolWithTag(OldCompiledProgram, XDP_POOLTAG_PROGRAM);
-        OldCompiledProgram = NULL;
-    }
-
 Exit:
 
     if (!NT_SUCCESS(Status)) {
+        //
+        // The RX queue still runs its previous program, if any, so unlink the
+        // binding from the RX queue. The binding itself is freed with the
+        // program object.
+        //
+        if (ProgramBinding != NULL && !IsListEmpty(&ProgramBinding->RxQueueEntry)) {
+            XdpRxQueueDeregisterNotifications(
+                ProgramBinding->RxQueue, &ProgramBinding->RxQueueNotificationEntry);
+            RemoveEntryList(&ProgramBinding->RxQueueEntry);
+            InitializeListHead(&ProgramBinding->RxQueueEntry);
+        }
+
         if (CompiledProgram != NULL) {
-            ExFreePoolWithTag(CompiledProgram, XDP_POOLTAG_PROGRAM);
+            XdpProgramFreeCompiledProgram(CompiledProgram);
         }
     }
 
@@ -1301,6 +3794,47 @@ Exit:
     return Status;
 }
 
+VOID
+XdpProgramAttachAllQueuesPrograms(
+    _In_ XDP_RX_QUEUE *RxQueue
+    )
+{
+    XDP_BINDING_HANDLE BindingHandle = XdpRxQueueGetBinding(RxQueue);
+    UINT32 QueueId = XdpRxQueueGetQueueId(RxQueue);
+    XDP_PROGRAM_ALL_QUEUES_SET *AllQueuesSet;
+    LIST_ENTRY *Entry;
+
+    AllQueuesSet = XdpProgramFindAllQueuesSet(BindingHandle, XdpRxQueueGetHookId(RxQueue));
+    if (AllQueuesSet == NULL) {
+        return;
+    }
+
+    TraceEnter(TRACE_CORE, "RxQueue=%p AllQueuesSet=%p", RxQueue, AllQueuesSet);
+
+    for (Entry = AllQueuesSet->ProgramObjects.Flink;
+        Entry != &AllQueuesSet->ProgramObjects;
+        Entry = Entry->Flink) {
+        XDP_PROGRAM_OBJECT *ProgramObject =
+            CONTAINING_RECORD(Entry, XDP_PROGRAM_OBJECT, AllQueuesLink);
+        NTSTATUS Status;
+
+        Status =
+            XdpProgramBindingAttach(
+                BindingHandle, &AllQueuesSet->HookId, ProgramObject, QueueId);
+        if (!NT_SUCCESS(Status)) {
+            //
+            // The program object keeps running on its other RX queues.
+            //
+            TraceError(
+                TRACE_CORE,
+                "Failed to attach ProgramObject=%p to new RxQueue=%p Status=%!STATUS!",
+                ProgramObject, RxQueue, Status);
+        }
+    }
+
+    TraceExitSuccess(TRACE_CORE);
+}
+
 static
 VOID
 XdpProgramAttach(
@@ -1355,6 +3889,15 @@ XdpProgramAttach(
             ProgramObject, RssCapabilities.NumberOfReceiveQueues);
         QueueIdStart = 0;
         QueueIdEnd = RssCapabilities.NumberOfReceiveQueues;
+
+        //
+        // Compile the rules once; every RX queue this program object is the
+        // only program bound to runs the same compiled program.
+        //
+        Status = XdpProgramCompileSharedProgram(ProgramObject, &ProgramObject->SharedProgram);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
     }
 
     for (UINT32 QueueId = QueueIdStart; QueueId < QueueIdEnd; ++QueueId) {
@@ -1371,6 +3914,26 @@ XdpProgramAttach(
         }
     }
 
+    if (Item->BindToAllQueues) {
+        //
+        // Follow RX queues created on the interface hook from now on, e.g.
+        // queues beyond the RSS queue count at attach time.
+        //
+        Status =
+            XdpProgramJoinAllQueuesSet(Item->Bind.BindingHandle, &Item->HookId, ProgramObject);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        //
+        // RX queues created later attach this program object before any
+        // other, so its leading drop rules can be applied interface-wide.
+        //
+        if (Item->HookId.Direction == XDP_HOOK_RX) {
+            XdpProgramOpenDropOffload(ProgramObject, Item->Bind.BindingHandle, &Item->HookId);
+        }
+    }
+
 Exit:
 
     if (!NT_SUCCESS(Status)) {
@@ -1381,30 +3944,434 @@ Exit:
         XdpIfDereferenceIfSet(IfSetHandle);
     }
 
-    Item->CompletionStatus = Status;
+    Item->CompletionStatus = Status;
+    KeSetEvent(&Item->CompletionEvent, 0, FALSE);
+
+    TraceExitStatus(TRACE_CORE);
+}
+
+static
+VOID
+XdpProgramDetach(
+    _In_ XDP_BINDING_WORKITEM *WorkItem
+    )
+{
+    XDP_PROGRAM_WORKITEM *Item = (XDP_PROGRAM_WORKITEM *)WorkItem;
+
+    TraceEnter(TRACE_CORE, "ProgramObject=%p", Item->ProgramObject);
+
+    XdpIfDereferenceBinding(Item->ProgramObject->IfHandle);
+    XdpProgramDelete(Item->ProgramObject);
+    TraceInfo(TRACE_CORE, "Detached ProgramObject=%p", Item->ProgramObject);
+
+    Item->CompletionStatus = STATUS_SUCCESS;
+    KeSetEvent(&Item->CompletionEvent, 0, FALSE);
+
+    TraceExitSuccess(TRACE_CORE);
+}
+
+static
+NTSTATUS
+XdpProgramApplyRuleUpdate(
+    _Inout_ XDP_PROGRAM_UPDATE_WORKITEM *Item
+    )
+{
+    XDP_PROGRAM_OBJECT *ProgramObject = Item->ProgramObject;
+    XDP_PROGRAM *OldProgram = ProgramObject->Program;
+    XDP_PROGRAM *InsertRules = Item->InsertRules;
+    XDP_PROGRAM *NewProgram = NULL;
+    XDP_PROGRAM **CompiledPrograms = NULL;
+    XDP_QUEUE_BLOCKING_SYNC_CONTEXT *SyncEntries = NULL;
+    XDP_PROGRAM *OldSharedProgram = ProgramObject->SharedProgram;
+    XDP_PROGRAM *NewSharedProgram = NULL;
+    XDP_RULE_COUNTER_SET *OldCounterSet = ProgramObject->RuleCounters;
+    XDP_RULE_COUNTER_SET *NewCounterSet = NULL;
+    BOOLEAN CountersLocked = FALSE;
+    BOOLEAN DropOffloadChanged;
+    UINT32 BindingCount = 0;
+    UINT32 RuleCount;
+    UINT32 TailIndex;
+    UINT32 Index;
+    LIST_ENTRY *Entry;
+    NTSTATUS Status;
+
+    TraceEnter(
+        TRACE_CORE, "ProgramObject=%p RuleIndex=%u DeleteRuleCount=%u InsertRuleCount=%u",
+        ProgramObject, Item->RuleIndex, Item->DeleteRuleCount, InsertRules->RuleCount);
+
+    //
+    // eBPF programs have no XDP rules to update, but their eBPF rule can be
+    // replaced as a whole.
+    //
+    if (XdpProgramContainsEbpf(OldProgram) != (Item->EbpfClient != NULL) ||
+        XdpProgramContainsEbpf(InsertRules) != (Item->EbpfClient != NULL)) {
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    Status = RtlUInt32Add(Item->RuleIndex, Item->DeleteRuleCount, &TailIndex);
+    if (!NT_SUCCESS(Status) || TailIndex > OldProgram->RuleCount) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    //
+    // Programs cannot be emptied by rule updates; close the program handle
+    // instead.
+    //
+    RuleCount = OldProgram->RuleCount - Item->DeleteRuleCount;
+    Status = RtlUInt32Add(RuleCount, InsertRules->RuleCount, &RuleCount);
+    if (!NT_SUCCESS(Status) || RuleCount == 0) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Status = XdpProgramValidateRedirectTargets(InsertRules);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = XdpProgramAttachConntrackRules(ProgramObject, InsertRules);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = XdpProgramRulesAllocate(RuleCount, &NewProgram);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    NewProgram->EbpfFlowVerdictCache =
+        (Item->EbpfClient != NULL) ?
+            InsertRules->EbpfFlowVerdictCache : OldProgram->EbpfFlowVerdictCache;
+
+    //
+    // Splice the inserted rules into a copy of the existing rules. The rules
+    // within the deleted range remain owned by the old rule set until every
+    // RX queue has stopped referencing them.
+    //
+    for (Index = 0; Index < Item->RuleIndex; Index++) {
+        NewProgram->Rules[NewProgram->RuleCount++] = OldProgram->Rules[Index];
+    }
+    for (Index = 0; Index < InsertRules->RuleCount; Index++) {
+        NewProgram->Rules[NewProgram->RuleCount++] = InsertRules->Rules[Index];
+    }
+    for (Index = TailIndex; Index < OldProgram->RuleCount; Index++) {
+        NewProgram->Rules[NewProgram->RuleCount++] = OldProgram->Rules[Index];
+    }
+    ASSERT(NewProgram->RuleCount == RuleCount);
+
+    for (Entry = ProgramObject->ProgramBindings.Flink;
+        Entry != &ProgramObject->ProgramBindings;
+        Entry = Entry->Flink) {
+        BindingCount++;
+    }
+
+    CompiledPrograms =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, sizeof(*CompiledPrograms) * BindingCount, XDP_POOLTAG_PROGRAM);
+    if (CompiledPrograms == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    SyncEntries =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, sizeof(*SyncEntries) * BindingCount, XDP_POOLTAG_PROGRAM);
+    if (SyncEntries == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    if (OldCounterSet != NULL) {
+        Status = XdpProgramCounterSetAllocate(RuleCount, &NewCounterSet);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    //
+    // Validate and compile the new rule set for every attached RX queue
+    // before publishing it to any of them, so a failure leaves every queue
+    // running the old rules. Counter readers are held off until the retained
+    // rules' counters have been carried over.
+    //
+    RtlAcquirePushLockExclusive(&XdpProgramCountersLock);
+    CountersLocked = TRUE;
+
+    ProgramObject->Program = NewProgram;
+    ProgramObject->RuleCounters = NewCounterSet;
+
+    //
+    // RX queues running the shared program of an all-queues program object
+    // all switch to a single new shared program.
+    //
+    if (OldSharedProgram != NULL) {
+        Status = XdpProgramCompileSharedProgram(ProgramObject, &NewSharedProgram);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    Index = 0;
+    for (Entry = ProgramObject->ProgramBindings.Flink;
+        Entry != &ProgramObject->ProgramBindings;
+        Entry = Entry->Flink, Index++) {
+        XDP_PROGRAM_BINDING *ProgramBinding = CONTAINING_RECORD(Entry, XDP_PROGRAM_BINDING, Link);
+
+        //
+        // The binding might have already been detached during interface
+        // tear-down.
+        //
+        if (IsListEmpty(&ProgramBinding->RxQueueEntry)) {
+            continue;
+        }
+
+        Status = XdpProgramValidateIfQueue(ProgramBinding->RxQueue, ProgramObject);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        if (OldSharedProgram != NULL &&
+            XdpRxQueueGetProgram(ProgramBinding->RxQueue) == OldSharedProgram) {
+            CompiledPrograms[Index] = NewSharedProgram;
+            continue;
+        }
+
+        Status = XdpProgramCompileNewProgram(ProgramBinding->RxQueue, &CompiledPrograms[Index]);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        ASSERT(CompiledPrograms[Index] != NULL);
+    }
+
+    //
+    // The update cannot fail from here on. If it changes offloaded rules, stop
+    // dropping frames on their behalf before the new rules run, then offload
+    // the new rules once no RX queue runs the old ones.
+    //
+    DropOffloadChanged = Item->RuleIndex <= ProgramObject->DropOffloadRuleCount;
+    if (Item->RuleIndex < ProgramObject->DropOffloadRuleCount) {
+        XdpProgramWithdrawDropRules(ProgramObject);
+    }
+
+    //
+    // Publish the new compiled program to every RX queue without waiting, so
+    // the RX queues' data paths swap programs concurrently and retire the old
+    // compiled programs themselves. Then wait for a sync on each RX queue:
+    // once those complete, no RX queue references the old rules, counters, or
+    // shared program.
+    //
+    Index = 0;
+    for (Entry = ProgramObject->ProgramBindings.Flink;
+        Entry != &ProgramObject->ProgramBindings;
+        Entry = Entry->Flink, Index++) {
+        XDP_PROGRAM_BINDING *ProgramBinding = CONTAINING_RECORD(Entry, XDP_PROGRAM_BINDING, Link);
+
+        if (CompiledPrograms[Index] == NULL) {
+            continue;
+        }
+
+        ASSERT(XdpRxQueueGetProgram(ProgramBinding->RxQueue) != NULL);
+
+        Status =
+            XdpRxQueueSetProgram(
+                ProgramBinding->RxQueue, CompiledPrograms[Index], NULL, NULL,
+                XdpProgramFreeCompiledProgram);
+        ASSERT(NT_SUCCESS(Status));
+        CompiledPrograms[Index] = NULL;
+
+        XdpRxQueueSyncStart(
+            ProgramBinding->RxQueue, &SyncEntries[Index], XdpProgramSyncBarrier, NULL);
+    }
+
+    for (Index = 0; Index < BindingCount; Index++) {
+        if (SyncEntries[Index].Callback != NULL) {
+            XdpRxQueueSyncWait(&SyncEntries[Index]);
+        }
+    }
+
+    if (OldSharedProgram != NULL) {
+        ProgramObject->SharedProgram = NewSharedProgram;
+        NewSharedProgram = NULL;
+        ExFreePoolWithTag(OldSharedProgram, XDP_POOLTAG_PROGRAM);
+    }
+
+    //
+    // No RX queue references the old counters anymore, so carry the retained
+    // rules' totals over to the new counters.
+    //
+    if (OldCounterSet != NULL) {
+        for (Index = 0; Index < Item->RuleIndex; Index++) {
+            XdpProgramCounterSetRead(OldCounterSet, Index, &NewCounterSet->Base[Index]);
+        }
+        for (Index = TailIndex; Index < OldProgram->RuleCount; Index++) {
+            XdpProgramCounterSetRead(
+                OldCounterSet, Index,
+                &NewCounterSet->Base[Index - TailIndex + Item->RuleIndex + InsertRules->RuleCount]);
+        }
+
+        ExFreePoolWithTag(OldCounterSet, XDP_POOLTAG_PROGRAM_COUNTERS);
+        NewCounterSet = NULL;
+    }
+
+    if (DropOffloadChanged) {
+        XdpProgramOffloadDropRules(ProgramObject);
+    }
+
+    RtlReleasePushLockExclusive(&XdpProgramCountersLock);
+    CountersLocked = FALSE;
+
+    TraceInfo(TRACE_CORE, "Updated ProgramObject=%p", ProgramObject);
+    XdpProgramTraceObject(ProgramObject);
+
+    //
+    // Release the deleted rules. The surviving and inserted rules were moved
+    // into the new rule set.
+    //
+    for (Index = Item->RuleIndex; Index < TailIndex; Index++) {
+        XdpProgramDeleteRule(&OldProgram->Rules[Index]);
+    }
+    ExFreePoolWithTag(OldProgram, XDP_POOLTAG_PROGRAM_RULES);
+    ExFreePoolWithTag(InsertRules, XDP_POOLTAG_PROGRAM_RULES);
+    Item->InsertRules = NULL;
+    NewProgram = NULL;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        ProgramObject->Program = OldProgram;
+        ProgramObject->RuleCounters = OldCounterSet;
+
+        if (NewProgram != NULL) {
+            ExFreePoolWithTag(NewProgram, XDP_POOLTAG_PROGRAM_RULES);
+        }
+
+        if (NewCounterSet != NULL) {
+            ExFreePoolWithTag(NewCounterSet, XDP_POOLTAG_PROGRAM_COUNTERS);
+        }
+
+        if (NewSharedProgram != NULL) {
+            ExFreePoolWithTag(NewSharedProgram, XDP_POOLTAG_PROGRAM);
+        }
+    }
+
+    if (CountersLocked) {
+        RtlReleasePushLockExclusive(&XdpProgramCountersLock);
+    }
+
+    if (CompiledPrograms != NULL) {
+        for (Index = 0; Index < BindingCount; Index++) {
+            if (CompiledPrograms[Index] != NULL) {
+                XdpProgramFreeCompiledProgram(CompiledPrograms[Index]);
+            }
+        }
+
+        ExFreePoolWithTag(CompiledPrograms, XDP_POOLTAG_PROGRAM);
+    }
+
+    if (SyncEntries != NULL) {
+        ExFreePoolWithTag(SyncEntries, XDP_POOLTAG_PROGRAM);
+    }
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+static
+VOID
+XdpProgramUpdateRules(
+    _In_ XDP_BINDING_WORKITEM *WorkItem
+    )
+{
+    XDP_PROGRAM_UPDATE_WORKITEM *Item = (XDP_PROGRAM_UPDATE_WORKITEM *)WorkItem;
+
+    Item->CompletionStatus = XdpProgramApplyRuleUpdate(Item);
     KeSetEvent(&Item->CompletionEvent, 0, FALSE);
-
-    TraceExitStatus(TRACE_CORE);
 }
 
+//
+// Replaces the eBPF rule of the eBPF program object attached to the hook with
+// the attaching eBPF client's rule, and hands the program object over to the
+// attaching client. Each RX queue switches programs in a single program swap,
+// so every frame is inspected by either the old or the new eBPF program.
+//
 static
 VOID
-XdpProgramDetach(
+XdpProgramReplaceEbpf(
     _In_ XDP_BINDING_WORKITEM *WorkItem
     )
 {
-    XDP_PROGRAM_WORKITEM *Item = (XDP_PROGRAM_WORKITEM *)WorkItem;
+    XDP_PROGRAM_UPDATE_WORKITEM *Item = (XDP_PROGRAM_UPDATE_WORKITEM *)WorkItem;
+    XDP_PROGRAM_ALL_QUEUES_SET *AllQueuesSet;
+    XDP_PROGRAM_OBJECT *ProgramObject = NULL;
+    const EBPF_EXTENSION_CLIENT *OldClient;
+    NTSTATUS Status;
 
-    TraceEnter(TRACE_CORE, "ProgramObject=%p", Item->ProgramObject);
+    TraceEnter(TRACE_CORE, "EbpfClient=%p", Item->EbpfClient);
 
-    XdpIfDereferenceBinding(Item->ProgramObject->IfHandle);
-    XdpProgramDelete(Item->ProgramObject);
-    TraceInfo(TRACE_CORE, "Detached ProgramObject=%p", Item->ProgramObject);
+    //
+    // eBPF program objects are attached to all queues, and exclude any other
+    // program from the hook.
+    //
+    AllQueuesSet = XdpProgramFindAllQueuesSet(Item->Bind.BindingHandle, &Item->HookId);
+    if (AllQueuesSet != NULL) {
+        for (LIST_ENTRY *Entry = AllQueuesSet->ProgramObjects.Flink;
+            Entry != &AllQueuesSet->ProgramObjects;
+            Entry = Entry->Flink) {
+            XDP_PROGRAM_OBJECT *Candidate =
+                CONTAINING_RECORD(Entry, XDP_PROGRAM_OBJECT, AllQueuesLink);
+
+            if (XdpProgramContainsEbpf(Candidate->Program)) {
+                ProgramObject = Candidate;
+                break;
+            }
+        }
+    }
 
-    Item->CompletionStatus = STATUS_SUCCESS;
+    if (ProgramObject == NULL) {
+        Status = STATUS_NOT_FOUND;
+        goto Exit;
+    }
+
+    ASSERT(ProgramObject->Program->RuleCount == 1);
+    OldClient = (const EBPF_EXTENSION_CLIENT *)ProgramObject->Program->Rules[0].Ebpf.Target;
+
+    //
+    // Hold off the replaced client's detach until no RX queue invokes its
+    // program anymore, and fail if the replaced client is already detaching.
+    //
+    RtlAcquirePushLockExclusive(&XdpProgramEbpfClientLock);
+
+    if (EbpfExtensionClientGetProviderData(OldClient) != ProgramObject) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        Item->ProgramObject = ProgramObject;
+        Item->RuleIndex = 0;
+        Item->DeleteRuleCount = ProgramObject->Program->RuleCount;
+
+        Status = XdpProgramApplyRuleUpdate(Item);
+        if (NT_SUCCESS(Status)) {
+            EbpfExtensionClientSetProviderData(OldClient, NULL);
+            EbpfExtensionClientSetProviderData(Item->EbpfClient, ProgramObject);
+        }
+    }
+
+    RtlReleasePushLockExclusive(&XdpProgramEbpfClientLock);
+
+Exit:
+
+    TraceInfo(
+        TRACE_CORE, "ProgramObject=%p EbpfClient=%p Status=%!STATUS!",
+        ProgramObject, Item->EbpfClient, Status);
+
+    Item->CompletionStatus = Status;
     KeSetEvent(&Item->CompletionEvent, 0, FALSE);
 
-    TraceExitSuccess(TRACE_CORE);
+    TraceExitStatus(TRACE_CORE);
 }
 
 static
@@ -1412,6 +4379,7 @@ NTSTATUS
 XdpProgramCreate(
     _Out_ XDP_PROGRAM_OBJECT **NewProgramObject,
     _In_ const XDP_PROGRAM_OPEN *Params,
+    _In_ BOOLEAN EbpfFlowVerdictCache,
     _In_ KPROCESSOR_MODE RequestorMode
     )
 {
@@ -1424,7 +4392,8 @@ XdpProgramCreate(
     const UINT32 ValidFlags =
         XDP_CREATE_PROGRAM_FLAG_GENERIC |
         XDP_CREATE_PROGRAM_FLAG_NATIVE |
-        XDP_CREATE_PROGRAM_FLAG_ALL_QUEUES;
+        XDP_CREATE_PROGRAM_FLAG_ALL_QUEUES |
+        XDP_CREATE_PROGRAM_FLAG_RULE_COUNTERS;
 
     TraceEnter(
         TRACE_CORE,
@@ -1458,11 +4427,16 @@ RetryBinding:
     }
 
     Status =
-        XdpCaptureProgram(Params->Rules, Params->RuleCount, RequestorMode, &ProgramObject);
+        XdpCaptureProgram(
+            Params->IfIndex, Params->Rules, Params->RuleCount,
+            !!(Params->Flags & XDP_CREATE_PROGRAM_FLAG_RULE_COUNTERS), RequestorMode,
+            &ProgramObject);
     if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
 
+    ProgramObject->Program->EbpfFlowVerdictCache = EbpfFlowVerdictCache;
+
     KeInitializeEvent(&WorkItem.CompletionEvent, NotificationEvent, FALSE);
     WorkItem.QueueId = Params->QueueId;
     WorkItem.HookId = Params->HookId;
@@ -1506,6 +4480,18 @@ RetryBinding:
 Exit:
 
     if (NT_SUCCESS(Status)) {
+        if (ProgramObject->RuleCounters != NULL) {
+            //
+            // Expose the rule counters via PCW.
+            //
+            ProgramObject->CountersId = (UINT32)InterlockedIncrement(&XdpProgramNextCountersId);
+            ProgramObject->CountersIfIndex = Params->IfIndex;
+
+            RtlAcquirePushLockExclusive(&XdpProgramCountersLock);
+            InsertTailList(&XdpProgramCountersObjects, &ProgramObject->CountersLink);
+            RtlReleasePushLockExclusive(&XdpProgramCountersLock);
+        }
+
         ProgramObject->IfHandle = BindingHandle, BindingHandle = NULL;
         *NewProgramObject = ProgramObject;
     }
@@ -1548,7 +4534,7 @@ XdpIrpCreateProgram(
     }
     Params = InputBuffer;
 
-    Status = XdpProgramCreate(&ProgramObject, Params, Irp->RequestorMode);
+    Status = XdpProgramCreate(&ProgramObject, Params, FALSE, Irp->RequestorMode);
     if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
@@ -1577,40 +4563,351 @@ XdpProgramClose(
     TraceEnter(TRACE_CORE, "ProgramObject=%p", ProgramObject);
     TraceInfo(TRACE_CORE, "Closing ProgramObject=%p", ProgramObject);
 
-    KeInitializeEvent(&WorkItem.CompletionEvent, NotificationEvent, FALSE);
-    WorkItem.ProgramObject = ProgramObject;
-    WorkItem.Bind.BindingHandle = ProgramObject->IfHandle;
-    WorkItem.Bind.WorkRoutine = XdpProgramDetach;
+    KeInitializeEvent(&WorkItem.CompletionEvent, NotificationEvent, FALSE);
+    WorkItem.ProgramObject = ProgramObject;
+    WorkItem.Bind.BindingHandle = ProgramObject->IfHandle;
+    WorkItem.Bind.WorkRoutine = XdpProgramDetach;
+
+    //
+    // Perform the detach on the interface's work queue.
+    //
+    XdpIfQueueWorkItem(&WorkItem.Bind);
+    KeWaitForSingleObject(&WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
+    ASSERT(NT_SUCCESS(WorkItem.CompletionStatus));
+
+    TraceExitSuccess(TRACE_CORE);
+}
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+_IRQL_requires_same_
+NTSTATUS
+XdpIrpProgramClose(
+    _Inout_ IRP *Irp,
+    _Inout_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    XDP_PROGRAM_OBJECT *ProgramObject = IrpSp->FileObject->FsContext;
+
+    TraceEnter(TRACE_CORE, "ProgramObject=%p", ProgramObject);
+
+    UNREFERENCED_PARAMETER(Irp);
+
+    XdpProgramClose(ProgramObject);
+
+    TraceExitSuccess(TRACE_CORE);
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XdpIrpProgramUpdateRules(
+    _In_ XDP_PROGRAM_OBJECT *ProgramObject,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    XDP_PROGRAM_UPDATE_RULES_IN Params = {0};
+    XDP_PROGRAM_UPDATE_WORKITEM WorkItem = {0};
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_CORE, "ProgramObject=%p", ProgramObject);
+
+    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(Params)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+    Params = *(const XDP_PROGRAM_UPDATE_RULES_IN *)Irp->AssociatedIrp.SystemBuffer;
+
+    //
+    // Capture and validate only the inserted rules in the context of the
+    // calling thread; existing rules are carried over as-is.
+    //
+    Status =
+        XdpProgramCaptureRules(
+            Params.Rules, Params.InsertRuleCount, Irp->RequestorMode, &WorkItem.InsertRules);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    KeInitializeEvent(&WorkItem.CompletionEvent, NotificationEvent, FALSE);
+    WorkItem.ProgramObject = ProgramObject;
+    WorkItem.RuleIndex = Params.RuleIndex;
+    WorkItem.DeleteRuleCount = Params.DeleteRuleCount;
+    WorkItem.Bind.BindingHandle = ProgramObject->IfHandle;
+    WorkItem.Bind.WorkRoutine = XdpProgramUpdateRules;
+
+    //
+    // Perform the update on the interface's work queue, which serializes it
+    // with program attach and detach.
+    //
+    XdpIfQueueWorkItem(&WorkItem.Bind);
+    KeWaitForSingleObject(&WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
+    Status = WorkItem.CompletionStatus;
+
+Exit:
+
+    if (WorkItem.InsertRules != NULL) {
+        XdpProgramDeleteRules(WorkItem.InsertRules);
+    }
+
+    TraceInfo(
+        TRACE_CORE, "ProgramObject=%p RuleIndex=%u DeleteRuleCount=%u InsertRuleCount=%u Status=%!STATUS!",
+        ProgramObject, Params.RuleIndex, Params.DeleteRuleCount, Params.InsertRuleCount, Status);
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XdpIrpProgramGetRuleCounters(
+    _In_ XDP_PROGRAM_OBJECT *ProgramObject,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    XDP_RULE_COUNTERS *OutputBuffer = Irp->AssociatedIrp.SystemBuffer;
+    SIZE_T OutputBufferLength = IrpSp->Parameters.DeviceIoControl.OutputBufferLength;
+    SIZE_T *BytesReturned = &Irp->IoStatus.Information;
+    XDP_RULE_COUNTER_SET *CounterSet;
+    UINT64 *OffloadedHits = NULL;
+    SIZE_T RequiredSize;
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_CORE, "ProgramObject=%p", ProgramObject);
+
+    *BytesReturned = 0;
+
+    RtlAcquirePushLockShared(&XdpProgramCountersLock);
+
+    CounterSet = ProgramObject->RuleCounters;
+    if (CounterSet == NULL) {
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    RequiredSize = sizeof(*OutputBuffer) * CounterSet->RuleCount;
+
+    if ((OutputBufferLength == 0) && (Irp->Flags & IRP_INPUT_OPERATION) == 0) {
+        *BytesReturned = RequiredSize;
+        Status = STATUS_BUFFER_OVERFLOW;
+        goto Exit;
+    }
+
+    if (OutputBufferLength < RequiredSize) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    if (ProgramObject->DropOffloadRuleCount > 0) {
+        OffloadedHits =
+            ExAllocatePoolZero(
+                NonPagedPoolNx, sizeof(*OffloadedHits) * ProgramObject->DropOffloadRuleCount,
+                XDP_POOLTAG_PROGRAM);
+        if (OffloadedHits == NULL) {
+            Status = STATUS_NO_MEMORY;
+            goto Exit;
+        }
+
+        //
+        // Offloaded hits are best effort: if the interface is being removed,
+        // report none.
+        //
+        XdpOffloadDropFilterGetHits(
+            ProgramObject->DropOffloadIfSet, ProgramObject->DropOffloadHandle, OffloadedHits,
+            ProgramObject->DropOffloadRuleCount);
+    }
+
+    for (UINT32 Index = 0; Index < CounterSet->RuleCount; Index++) {
+        XDP_RULE_HIT_COUNTER Total;
+
+        XdpProgramCounterSetRead(CounterSet, Index, &Total);
+        OutputBuffer[Index].Hits = Total.Hits;
+        OutputBuffer[Index].LastHitTime = Total.LastHitTime;
+        OutputBuffer[Index].OffloadedHits =
+            (Index < ProgramObject->DropOffloadRuleCount) ? OffloadedHits[Index] : 0;
+    }
+
+    *BytesReturned = RequiredSize;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    RtlReleasePushLockShared(&XdpProgramCountersLock);
+
+    if (OffloadedHits != NULL) {
+        ExFreePoolWithTag(OffloadedHits, XDP_POOLTAG_PROGRAM);
+    }
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+_Use_decl_annotations_
+NTSTATUS
+XdpIrpProgramDeviceIoControl(
+    IRP *Irp,
+    IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    ULONG IoControlCode = IrpSp->Parameters.DeviceIoControl.IoControlCode;
+    XDP_PROGRAM_OBJECT *ProgramObject = IrpSp->FileObject->FsContext;
+
+    TraceEnter(TRACE_CORE, "ProgramObject=%p", ProgramObject);
+
+    Irp->IoStatus.Information = 0;
+
+    switch (IoControlCode) {
+    case IOCTL_PROGRAM_UPDATE_RULES:
+        Status = XdpIrpProgramUpdateRules(ProgramObject, Irp, IrpSp);
+        break;
+    case IOCTL_PROGRAM_GET_RULE_COUNTERS:
+        Status = XdpIrpProgramGetRuleCounters(ProgramObject, Irp, IrpSp);
+        break;
+    default:
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+Exit:
+
+    TraceInfo(
+        TRACE_CORE, "ProgramObject=%p Ioctl=%u Status=%!STATUS!",
+        ProgramObject, IoControlCode, Status);
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+static
+NTSTATUS
+EbpfProgramReplace(
+    _In_ const EBPF_EXTENSION_CLIENT *AttachingClient,
+    _In_ const XDP_PROGRAM_OPEN *Params,
+    _In_ BOOLEAN EbpfFlowVerdictCache
+    )
+{
+    XDP_INTERFACE_MODE InterfaceMode;
+    XDP_INTERFACE_MODE *RequiredMode = NULL;
+    XDP_BINDING_HANDLE BindingHandle = NULL;
+    XDP_PROGRAM_UPDATE_WORKITEM WorkItem = {0};
+    NTSTATUS Status;
+
+    TraceEnter(
+        TRACE_CORE,
+        "AttachingClient=%p IfIndex=%u Hook={%!HOOK_LAYER!, %!HOOK_DIR!, %!HOOK_SUBLAYER!}",
+        AttachingClient, Params->IfIndex, Params->HookId.Layer, Params->HookId.Direction,
+        Params->HookId.SubLayer);
+
+    if (Params->Flags & XDP_CREATE_PROGRAM_FLAG_GENERIC) {
+        InterfaceMode = XDP_INTERFACE_MODE_GENERIC;
+        RequiredMode = &InterfaceMode;
+    }
+
+    if (Params->Flags & XDP_CREATE_PROGRAM_FLAG_NATIVE) {
+        InterfaceMode = XDP_INTERFACE_MODE_NATIVE;
+        RequiredMode = &InterfaceMode;
+    }
+
+    Status =
+        XdpProgramCaptureRules(Params->Rules, Params->RuleCount, KernelMode, &WorkItem.InsertRules);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    WorkItem.InsertRules->EbpfFlowVerdictCache = EbpfFlowVerdictCache;
+
+RetryBinding:
+
+    BindingHandle = XdpIfFindAndReferenceBinding(Params->IfIndex, &Params->HookId, 1, RequiredMode);
+    if (BindingHandle == NULL) {
+        Status = STATUS_NOT_FOUND;
+        goto Exit;
+    }
+
+    KeInitializeEvent(&WorkItem.CompletionEvent, NotificationEvent, FALSE);
+    WorkItem.HookId = Params->HookId;
+    WorkItem.EbpfClient = AttachingClient;
+    WorkItem.Bind.BindingHandle = BindingHandle;
+    WorkItem.Bind.WorkRoutine = XdpProgramReplaceEbpf;
+
+    //
+    // Perform the replacement on the interface's work queue, which serializes
+    // it with program attach and detach.
+    //
+    XdpIfQueueWorkItem(&WorkItem.Bind);
+    KeWaitForSingleObject(&WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
+    Status = WorkItem.CompletionStatus;
+
+    if (Status == STATUS_NOT_FOUND &&
+        XdpIfGetCapabilities(BindingHandle)->Mode == XDP_INTERFACE_MODE_NATIVE &&
+        RequiredMode == NULL) {
+        //
+        // The replaced program may have fallen back to generic mode.
+        //
+        XdpIfDereferenceBinding(BindingHandle);
+        BindingHandle = NULL;
+
+        InterfaceMode = XDP_INTERFACE_MODE_GENERIC;
+        RequiredMode = &InterfaceMode;
+        goto RetryBinding;
+    }
+
+Exit:
+
+    if (BindingHandle != NULL) {
+        XdpIfDereferenceBinding(BindingHandle);
+    }
+
+    if (WorkItem.InsertRules != NULL) {
+        XdpProgramDeleteRules(WorkItem.InsertRules);
+    }
 
-    //
-    // Perform the detach on the interface's work queue.
-    //
-    XdpIfQueueWorkItem(&WorkItem.Bind);
-    KeWaitForSingleObject(&WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
-    ASSERT(NT_SUCCESS(WorkItem.CompletionStatus));
+    TraceExitStatus(TRACE_CORE);
 
-    TraceExitSuccess(TRACE_CORE);
+    return Status;
 }
 
-_IRQL_requires_max_(PASSIVE_LEVEL)
-_IRQL_requires_same_
-NTSTATUS
-XdpIrpProgramClose(
-    _Inout_ IRP *Irp,
-    _Inout_ IO_STACK_LOCATION *IrpSp
+//
+// Returns whether the match's pattern references memory beyond the rule.
+//
+static
+BOOLEAN
+XdpProgramMatchReferencesMemory(
+    _In_ XDP_MATCH_TYPE Match
     )
 {
-    XDP_PROGRAM_OBJECT *ProgramObject = IrpSp->FileObject->FsContext;
-
-    TraceEnter(TRACE_CORE, "ProgramObject=%p", ProgramObject);
-
-    UNREFERENCED_PARAMETER(Irp);
+    switch (Match) {
+    case XDP_MATCH_UDP_PORT_SET:
+    case XDP_MATCH_IPV4_UDP_PORT_SET:
+    case XDP_MATCH_IPV6_UDP_PORT_SET:
+    case XDP_MATCH_IPV4_TCP_PORT_SET:
+    case XDP_MATCH_IPV6_TCP_PORT_SET:
+    case XDP_MATCH_IPV4_DST_LPM:
+    case XDP_MATCH_IPV6_DST_LPM:
+    case XDP_MATCH_IPV4_SRC_LPM:
+    case XDP_MATCH_IPV6_SRC_LPM:
+    case XDP_MATCH_IPV4_MASKED_TUPLE:
+    case XDP_MATCH_IPV6_MASKED_TUPLE:
+    case XDP_MATCH_TUNNEL_IPV4_MASKED_TUPLE:
+    case XDP_MATCH_TUNNEL_IPV6_MASKED_TUPLE:
+    case XDP_MATCH_UDP_PORT_RANGE:
+    case XDP_MATCH_IPV4_UDP_PORT_RANGE:
+    case XDP_MATCH_IPV6_UDP_PORT_RANGE:
+    case XDP_MATCH_IPV4_TCP_PORT_RANGE:
+    case XDP_MATCH_IPV6_TCP_PORT_RANGE:
+    case XDP_MATCH_UDP_PAYLOAD:
+    case XDP_MATCH_TCP_PAYLOAD:
+        return TRUE;
 
-    XdpProgramClose(ProgramObject);
-
-    TraceExitSuccess(TRACE_CORE);
-
-    return STATUS_SUCCESS;
+    default:
+        return FALSE;
+    }
 }
 
 static
@@ -1624,7 +4921,7 @@ EbpfProgramOnClientAttach(
     const ebpf_extension_data_t *ClientData = EbpfExtensionClientGetClientData(AttachingClient);
     const ebpf_extension_dispatch_table_t *ClientDispatch =
         EbpfExtensionClientGetDispatch(AttachingClient);
-    UINT32 IfIndex;
+    XDP_EBPF_ATTACH_PARAMS AttachParams = {0};
     XDP_PROGRAM_OPEN OpenParams = {0};
     XDP_RULE XdpRule = {0};
     XDP_PROGRAM_OBJECT *ProgramObject;
@@ -1635,15 +4932,51 @@ EbpfProgramOnClientAttach(
 
     if (ClientData == NULL ||
         ClientData->header.version != 0 ||
-        ClientData->header.size != sizeof(IfIndex) ||
         ClientData->data == NULL) {
         Status = STATUS_INVALID_PARAMETER;
         goto Exit;
     }
 
-    IfIndex = *(UINT32 *)ClientData->data;
+    if (ClientData->header.size == sizeof(AttachParams.IfIndex)) {
+        //
+        // Legacy attach parameters consist of only the interface index and
+        // implicitly target the RX inspect hook.
+        //
+        AttachParams.IfIndex = *(UINT32 *)ClientData->data;
+        AttachParams.HookId.Layer = XDP_HOOK_L2;
+        AttachParams.HookId.Direction = XDP_HOOK_RX;
+        AttachParams.HookId.SubLayer = XDP_HOOK_INSPECT;
+    } else if (ClientData->header.size == sizeof(AttachParams)) {
+        AttachParams = *(XDP_EBPF_ATTACH_PARAMS *)ClientData->data;
+    } else {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    if (AttachParams.Flags &
+            ~(XDP_EBPF_ATTACH_FLAG_FLOW_VERDICT_CACHE | XDP_EBPF_ATTACH_FLAG_REPLACE)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    if (XdpProgramMatchReferencesMemory(AttachParams.PrefilterMatch)) {
+        //
+        // The pattern references memory that would be captured in kernel
+        // mode, so the attach parameters cannot safely supply it.
+        //
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    if (AttachParams.IfIndex == IFI_UNSPECIFIED) {
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
 
-    if (IfIndex == IFI_UNSPECIFIED) {
+    if (AttachParams.HookId.Layer != XDP_HOOK_L2 ||
+        AttachParams.HookId.SubLayer != XDP_HOOK_INSPECT ||
+        (AttachParams.HookId.Direction != XDP_HOOK_RX &&
+            AttachParams.HookId.Direction != XDP_HOOK_TX)) {
         Status = STATUS_NOT_SUPPORTED;
         goto Exit;
     }
@@ -1653,10 +4986,8 @@ EbpfProgramOnClientAttach(
         goto Exit;
     }
 
-    OpenParams.IfIndex = IfIndex;
-    OpenParams.HookId.Layer = XDP_HOOK_L2;
-    OpenParams.HookId.Direction = XDP_HOOK_RX;
-    OpenParams.HookId.SubLayer = XDP_HOOK_INSPECT;
+    OpenParams.IfIndex = AttachParams.IfIndex;
+    OpenParams.HookId = AttachParams.HookId;
     OpenParams.Flags = XDP_CREATE_PROGRAM_FLAG_ALL_QUEUES;
     OpenParams.RuleCount = 1;
     OpenParams.Rules = &XdpRule;
@@ -1678,11 +5009,27 @@ EbpfProgramOnClientAttach(
         }
     }
 
-    XdpRule.Match = XDP_MATCH_ALL;
+    XdpRule.Match = AttachParams.PrefilterMatch;
+    XdpRule.Pattern = AttachParams.PrefilterPattern;
     XdpRule.Action = XDP_PROGRAM_ACTION_EBPF;
     XdpRule.Ebpf.Target = (HANDLE)AttachingClient;
 
-    Status = XdpProgramCreate(&ProgramObject, &OpenParams, KernelMode);
+    if (AttachParams.Flags & XDP_EBPF_ATTACH_FLAG_REPLACE) {
+        //
+        // The replacement takes over the program object of the attached eBPF
+        // program instead of creating its own.
+        //
+        Status =
+            EbpfProgramReplace(
+                AttachingClient, &OpenParams,
+                !!(AttachParams.Flags & XDP_EBPF_ATTACH_FLAG_FLOW_VERDICT_CACHE));
+        goto Exit;
+    }
+
+    Status =
+        XdpProgramCreate(
+            &ProgramObject, &OpenParams,
+            !!(AttachParams.Flags & XDP_EBPF_ATTACH_FLAG_FLOW_VERDICT_CACHE), KernelMode);
     if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
@@ -1702,18 +5049,350 @@ EbpfProgramOnClientDetach(
     _In_ const EBPF_EXTENSION_CLIENT *DetachingClient
     )
 {
-    XDP_PROGRAM_OBJECT *ProgramObject = EbpfExtensionClientGetProviderData(DetachingClient);
+    XDP_PROGRAM_OBJECT *ProgramObject;
 
-    TraceEnter(TRACE_CORE, "ProgramObject=%p", ProgramObject);
+    //
+    // If the client's program was replaced, the program object now belongs to
+    // the replacement client, and the client has no program object to close.
+    //
+    RtlAcquirePushLockExclusive(&XdpProgramEbpfClientLock);
+    ProgramObject = EbpfExtensionClientGetProviderData(DetachingClient);
+    EbpfExtensionClientSetProviderData(DetachingClient, NULL);
+    RtlReleasePushLockExclusive(&XdpProgramEbpfClientLock);
 
-    ASSERT(ProgramObject != NULL);
+    TraceEnter(TRACE_CORE, "ProgramObject=%p", ProgramObject);
 
-    XdpProgramClose(ProgramObject);
+    if (ProgramObject != NULL) {
+        XdpProgramClose(ProgramObject);
+    }
 
     TraceExitSuccess(TRACE_CORE);
     return STATUS_SUCCESS;
 }
 
+//
+// Closes the program objects created from persisted programs for an interface,
+// or for all interfaces if IfIndex is IFI_UNSPECIFIED.
+//
+static
+VOID
+XdpProgramClosePersisted(
+    _In_ UINT32 IfIndex
+    )
+{
+    LIST_ENTRY *Entry = XdpProgramPersistedObjects.Flink;
+
+    while (Entry != &XdpProgramPersistedObjects) {
+        XDP_PROGRAM_PERSISTED_OBJECT *Persisted =
+            CONTAINING_RECORD(Entry, XDP_PROGRAM_PERSISTED_OBJECT, Link);
+        Entry = Entry->Flink;
+
+        if (IfIndex != IFI_UNSPECIFIED && Persisted->IfIndex != IfIndex) {
+            continue;
+        }
+
+        RemoveEntryList(&Persisted->Link);
+        XdpProgramClose(Persisted->ProgramObject);
+        ExFreePoolWithTag(Persisted, XDP_POOLTAG_PROGRAM_PERSISTED);
+    }
+}
+
+//
+// Validates a persisted program read from the registry and, if it targets the
+// interface, creates its program object.
+//
+static
+NTSTATUS
+XdpProgramCreatePersisted(
+    _In_ UINT32 IfIndex,
+    _In_ const KEY_VALUE_PARTIAL_INFORMATION_ALIGN64 *Value
+    )
+{
+    const XDP_PERSISTED_PROGRAM *Program = (const XDP_PERSISTED_PROGRAM *)Value->Data;
+    const XDP_RULE *Rules = (const XDP_RULE *)(Program + 1);
+    XDP_PROGRAM_OPEN OpenParams = {0};
+    XDP_PROGRAM_PERSISTED_OBJECT *Persisted = NULL;
+    NTSTATUS Status;
+    const UINT32 ValidFlags =
+        XDP_CREATE_PROGRAM_FLAG_GENERIC |
+        XDP_CREATE_PROGRAM_FLAG_NATIVE |
+        XDP_CREATE_PROGRAM_FLAG_RULE_COUNTERS;
+
+    C_ASSERT(sizeof(XDP_PERSISTED_PROGRAM) % __alignof(XDP_RULE) == 0);
+
+    if (Value->Type != REG_BINARY ||
+        Value->DataLength < sizeof(*Program) ||
+        Program->Version != XDP_PERSISTED_PROGRAM_VERSION ||
+        (Program->Flags & ~ValidFlags) ||
+        (Value->DataLength - sizeof(*Program)) / sizeof(*Rules) != Program->RuleCount ||
+        (Value->DataLength - sizeof(*Program)) % sizeof(*Rules) != 0) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    if (Program->IfIndex != IfIndex) {
+        Status = STATUS_SUCCESS;
+        goto Exit;
+    }
+
+    for (UINT32 Index = 0; Index < Program->RuleCount; Index++) {
+        //
+        // The rules are captured in kernel mode, so only rules which are
+        // entirely contained in the registry value can be persisted.
+        //
+        if ((Rules[Index].Action != XDP_PROGRAM_ACTION_DROP &&
+                Rules[Index].Action != XDP_PROGRAM_ACTION_PASS) ||
+            XdpProgramMatchReferencesMemory(Rules[Index].Match)) {
+            Status = STATUS_NOT_SUPPORTED;
+            goto Exit;
+        }
+    }
+
+    Persisted =
+        ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Persisted), XDP_POOLTAG_PROGRAM_PERSISTED);
+    if (Persisted == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    OpenParams.IfIndex = Program->IfIndex;
+    OpenParams.HookId = Program->HookId;
+    OpenParams.Flags = Program->Flags | XDP_CREATE_PROGRAM_FLAG_ALL_QUEUES;
+    OpenParams.RuleCount = Program->RuleCount;
+    OpenParams.Rules = Rules;
+
+    Status = XdpProgramCreate(&Persisted->ProgramObject, &OpenParams, FALSE, KernelMode);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Persisted->IfIndex = IfIndex;
+    InsertTailList(&XdpProgramPersistedObjects, &Persisted->Link);
+    Persisted = NULL;
+
+Exit:
+
+    if (Persisted != NULL) {
+        ExFreePoolWithTag(Persisted, XDP_POOLTAG_PROGRAM_PERSISTED);
+    }
+
+    return Status;
+}
+
+//
+// Creates the program objects of the persisted programs targeting an
+// interface.
+//
+static
+VOID
+XdpProgramCreatePersistedForInterface(
+    _In_ UINT32 IfIndex
+    )
+{
+    HANDLE ParametersKey = NULL;
+    HANDLE ProgramsKey = NULL;
+    UNICODE_STRING KeyName;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    KEY_VALUE_PARTIAL_INFORMATION_ALIGN64 *Value = NULL;
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_CORE, "IfIndex=%u", IfIndex);
+
+    RtlInitUnicodeString(&KeyName, XDP_PARAMETERS_KEY);
+    InitializeObjectAttributes(
+        &ObjectAttributes, &KeyName, OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE, NULL, NULL);
+    Status = ZwOpenKey(&ParametersKey, KEY_READ, &ObjectAttributes);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    RtlInitUnicodeString(&KeyName, L"Programs");
+    InitializeObjectAttributes(
+        &ObjectAttributes, &KeyName, OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE, ParametersKey,
+        NULL);
+    Status = ZwOpenKey(&ProgramsKey, KEY_READ, &ObjectAttributes);
+    if (!NT_SUCCESS(Status)) {
+        //
+        // No programs are persisted.
+        //
+        Status = STATUS_SUCCESS;
+        goto Exit;
+    }
+
+    for (ULONG Index = 0;; Index++) {
+        ULONG ValueLength;
+
+        Status =
+            ZwEnumerateValueKey(
+                ProgramsKey, Index, KeyValuePartialInformationAlign64, NULL, 0, &ValueLength);
+        if (Status == STATUS_NO_MORE_ENTRIES) {
+            Status = STATUS_SUCCESS;
+            break;
+        }
+
+        if (Status == STATUS_BUFFER_TOO_SMALL || Status == STATUS_BUFFER_OVERFLOW) {
+            Value = ExAllocatePoolZero(PagedPool, ValueLength, XDP_POOLTAG_PROGRAM_PERSISTED);
+            if (Value == NULL) {
+                Status = STATUS_NO_MEMORY;
+                goto Exit;
+            }
+
+            Status =
+                ZwEnumerateValueKey(
+                    ProgramsKey, Index, KeyValuePartialInformationAlign64, Value, ValueLength,
+                    &ValueLength);
+            if (NT_SUCCESS(Status)) {
+                Status = XdpProgramCreatePersisted(IfIndex, Value);
+            }
+
+            ExFreePoolWithTag(Value, XDP_POOLTAG_PROGRAM_PERSISTED);
+            Value = NULL;
+        }
+
+        if (!NT_SUCCESS(Status)) {
+            //
+            // Skip the invalid or unattachable program, but continue creating
+            // the others.
+            //
+            TraceError(
+                TRACE_CORE, "IfIndex=%u ValueIndex=%u persisted program failed Status=%!STATUS!",
+                IfIndex, Index, Status);
+        }
+    }
+
+Exit:
+
+    if (ProgramsKey != NULL) {
+        ZwClose(ProgramsKey);
+    }
+
+    if (ParametersKey != NULL) {
+        ZwClose(ParametersKey);
+    }
+
+    TraceExitStatus(TRACE_CORE);
+}
+
+static
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpProgramPersistedWorker(
+    _In_ SINGLE_LIST_ENTRY *WorkQueueHead
+    )
+{
+    while (WorkQueueHead != NULL) {
+        XDP_PROGRAM_PERSISTED_WORKITEM *Item =
+            CONTAINING_RECORD(WorkQueueHead, XDP_PROGRAM_PERSISTED_WORKITEM, Link);
+        WorkQueueHead = WorkQueueHead->Next;
+
+        //
+        // Replace any program objects created for a previous instance of the
+        // interface.
+        //
+        XdpProgramClosePersisted(Item->IfIndex);
+        XdpProgramCreatePersistedForInterface(Item->IfIndex);
+
+        ExFreePoolWithTag(Item, XDP_POOLTAG_PROGRAM_PERSISTED);
+    }
+}
+
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpProgramNotifyInterfaceAdded(
+    _In_ UINT32 IfIndex
+    )
+{
+    XDP_PROGRAM_PERSISTED_WORKITEM *Item;
+
+    if (XdpProgramPersistedQueue == NULL) {
+        return;
+    }
+
+    Item = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Item), XDP_POOLTAG_PROGRAM_PERSISTED);
+    if (Item == NULL) {
+        TraceError(
+            TRACE_CORE, "IfIndex=%u persisted programs not created Status=%!STATUS!",
+            IfIndex, STATUS_NO_MEMORY);
+        return;
+    }
+
+    //
+    // Programs cannot be attached until the interface provider finishes adding
+    // the interface, so create them asynchronously.
+    //
+    Item->IfIndex = IfIndex;
+    XdpInsertWorkQueue(XdpProgramPersistedQueue, &Item->Link);
+}
+
+static
+NTSTATUS
+XdpProgramPcwCallback(
+    _In_ PCW_CALLBACK_TYPE Type,
+    _In_ PCW_CALLBACK_INFORMATION *Info,
+    _In_opt_ VOID *Context
+    )
+{
+    PCW_BUFFER *Buffer;
+    NTSTATUS Status = STATUS_SUCCESS;
+    DECLARE_UNICODE_STRING_SIZE(
+        Name, ARRAYSIZE("if_" MAXUINT32_STR "_program_" MAXUINT32_STR "_rule_" MAXUINT32_STR));
+    ULONG InstanceId = 0;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    switch (Type) {
+    case PcwCallbackEnumerateInstances:
+        Buffer = Info->EnumerateInstances.Buffer;
+        break;
+    case PcwCallbackCollectData:
+        Buffer = Info->CollectData.Buffer;
+        break;
+    default:
+        return STATUS_SUCCESS;
+    }
+
+    //
+    // Counters are created on demand: report one instance per counted rule.
+    //
+    RtlAcquirePushLockShared(&XdpProgramCountersLock);
+
+    for (LIST_ENTRY *Entry = XdpProgramCountersObjects.Flink;
+        Entry != &XdpProgramCountersObjects;
+        Entry = Entry->Flink) {
+        XDP_PROGRAM_OBJECT *ProgramObject =
+            CONTAINING_RECORD(Entry, XDP_PROGRAM_OBJECT, CountersLink);
+        XDP_RULE_COUNTER_SET *CounterSet = ProgramObject->RuleCounters;
+
+        for (UINT32 Index = 0; Index < CounterSet->RuleCount; Index++) {
+            XDP_RULE_HIT_COUNTER Total;
+            XDP_PCW_PROGRAM_RULE Values;
+
+            Status =
+                RtlUnicodeStringPrintf(
+                    &Name, L"if_%u_program_%u_rule_%u",
+                    ProgramObject->CountersIfIndex, ProgramObject->CountersId, Index);
+            if (!NT_SUCCESS(Status)) {
+                goto Exit;
+            }
+
+            XdpProgramCounterSetRead(CounterSet, Index, &Total);
+            Values.Hits = Total.Hits;
+            Values.LastHitTime = Total.LastHitTime;
+
+            Status = XdpPcwAddProgramRule(Buffer, &Name, InstanceId++, &Values);
+            if (!NT_SUCCESS(Status)) {
+                goto Exit;
+            }
+        }
+    }
+
+Exit:
+
+    RtlReleasePushLockShared(&XdpProgramCountersLock);
+
+    return Status;
+}
+
 NTSTATUS
 XdpProgramStart(
     VOID
@@ -1732,6 +5411,31 @@ XdpProgramStart(
 
     TraceEnter(TRACE_CORE, "-");
 
+    ExInitializePushLock(&XdpProgramCountersLock);
+    InitializeListHead(&XdpProgramCountersObjects);
+    ExInitializePushLock(&XdpProgramConntrackLock);
+    InitializeListHead(&XdpProgramConntrackTables);
+    ExInitializePushLock(&XdpProgramEbpfClientLock);
+    InitializeListHead(&XdpProgramPersistedObjects);
+
+    Status = XdpPcwRegisterProgramRule(XdpProgramPcwCallback, NULL);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    XdpProgramTimerWheel = XdpTimerWheelCreate(XDP_PROGRAM_TIMER_WHEEL_TICK_MS);
+    if (XdpProgramTimerWheel == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    XdpProgramPersistedQueue =
+        XdpCreateWorkQueue(XdpProgramPersistedWorker, PASSIVE_LEVEL, XdpDriverObject, NULL);
+    if (XdpProgramPersistedQueue == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
     //
     // eBPF is disabled by default while reliability bugs are outstanding.
     //
@@ -1771,6 +5475,12 @@ XdpProgramStop(
 {
     TraceEnter(TRACE_CORE, "-");
 
+    if (XdpProgramPersistedQueue != NULL) {
+        XdpShutdownWorkQueue(XdpProgramPersistedQueue, TRUE);
+        XdpProgramPersistedQueue = NULL;
+        XdpProgramClosePersisted(IFI_UNSPECIFIED);
+    }
+
     if (EbpfXdpProgramHookProvider != NULL) {
         EbpfExtensionProviderUnregister(EbpfXdpProgramHookProvider);
         EbpfXdpProgramHookProvider = NULL;
@@ -1781,5 +5491,19 @@ XdpProgramStop(
         EbpfXdpProgramInfoProvider = NULL;
     }
 
+    if (XdpPcwProgramRule != NULL) {
+        PcwUnregister(XdpPcwProgramRule);
+        XdpPcwProgramRule = NULL;
+    }
+
+    //
+    // Every connection tracking table has been freed along with the program
+    // objects referencing it, so the timer wheel has no entries left.
+    //
+    if (XdpProgramTimerWheel != NULL) {
+        XdpTimerWheelDelete(XdpProgramTimerWheel);
+        XdpProgramTimerWheel = NULL;
+    }
+
     TraceExitSuccess(TRACE_CORE);
 }
@@ -9,13 +9,287 @@
 
 typedef struct _XDP_PROGRAM XDP_PROGRAM;
 typedef struct _XDP_RX_QUEUE XDP_RX_QUEUE;
+typedef struct _XDP_INSPECTION_CONTEXT XDP_INSPECTION_CONTEXT;
+typedef struct _EBPF_PROG_TEST_RUN_CONTEXT EBPF_PROG_TEST_RUN_CONTEXT;
 
 typedef ebpf_execution_context_state_t XDP_INSPECTION_EBPF_CONTEXT;
 
+#pragma warning(push)
+#pragma warning(disable:4200) // nonstandard extension used: zero-sized array in struct/union
+
+#pragma pack(push)
+#pragma pack(1)
+typedef struct QUIC_HEADER_INVARIANT {
+    union {
+        struct {
+            UCHAR VARIANT : 7;
+            UCHAR IsLongHeader : 1;
+        } COMMON_HDR;
+        struct {
+            UCHAR VARIANT : 7;
+            UCHAR IsLongHeader : 1;
+            UINT32 Version;
+            UCHAR DestCidLength;
+            UCHAR DestCid[0];
+            //UCHAR SourceCidLength;
+            //UCHAR SourceCid[SourceCidLength];
+        } LONG_HDR;
+        struct {
+            UCHAR VARIANT : 7;
+            UCHAR IsLongHeader : 1;
+            UCHAR DestCid[0];
+        } SHORT_HDR;
+    };
+} QUIC_HEADER_INVARIANT;
+
+//
+// VXLAN (RFC 7348) and Geneve (RFC 8926) tunnel headers.
+//
+#define XDP_VXLAN_FLAG_VNI 0x08
+
+typedef struct _XDP_VXLAN_HEADER {
+    UINT8 Flags;
+    UINT8 Reserved1[3];
+    UINT8 Vni[3];
+    UINT8 Reserved2;
+} XDP_VXLAN_HEADER;
+
+#define XDP_GENEVE_PROTOCOL_ETHERNET 0x6558
+
+typedef struct _XDP_GENEVE_HEADER {
+    UINT8 OptionLength : 6; // In 4-byte units.
+    UINT8 Version : 2;
+    UINT8 Flags;
+    UINT16 ProtocolType;
+    UINT8 Vni[3];
+    UINT8 Reserved;
+} XDP_GENEVE_HEADER;
+
+//
+// GRE (RFC 2784, RFC 2890) header. Optional fields follow the base header.
+//
+#define XDP_GRE_FLAG_CHECKSUM 0x80
+#define XDP_GRE_FLAG_KEY 0x20
+#define XDP_GRE_FLAG_SEQUENCE 0x10
+#define XDP_GRE_PROTOCOL_ETHERNET 0x6558
+
+typedef struct _XDP_GRE_HEADER {
+    UINT8 Flags;
+    UINT8 Version;
+    UINT16 ProtocolType;
+} XDP_GRE_HEADER;
+#pragma pack(pop)
+
+#pragma warning(pop)
+
+//
+// Storage for headers which are discontiguous in the frame. This is scratch
+// space of the queue inspecting the frame, not of the program.
+//
+typedef struct _XDP_PROGRAM_FRAME_STORAGE {
+    ETHERNET_HEADER EthHdr;
+    VLAN_TAG VlanTag; // Scratch space; not referenced by the frame cache.
+    union {
+        IPV4_HEADER Ip4Hdr;
+        IPV6_HEADER Ip6Hdr;
+    };
+    IPV6_FRAGMENT_HEADER Ip6ExtHdr; // Scratch space; not referenced by the frame cache.
+    union {
+        UDP_HDR UdpHdr;
+        TCP_HDR TcpHdr;
+    };
+    UINT8 TcpHdrOptions[40]; // Up to 40B options/paddings
+    // Invariant header + 1 for SourceCidLength + 2x CIDS
+    UINT8 QuicStorage[
+        sizeof(QUIC_HEADER_INVARIANT) +
+        sizeof(UCHAR) +
+        XDP_QUIC_MAX_CID_LENGTH * 2];
+    UINT8 PayloadStorage[XDP_PAYLOAD_PATTERN_MAX_LENGTH]; // Zero-padded pattern bytes.
+} XDP_PROGRAM_FRAME_STORAGE;
+
+//
+// The number of keys in an RX queue's eBPF socket map.
+//
+#define XDP_EBPF_XSK_MAP_SIZE 16
+
+//
+// The maximum length of the metadata eBPF programs place before the frame
+// data. This matches the Linux limit.
+//
+#define XDP_EBPF_METADATA_MAX_LENGTH 32
+
+//
+// The minimum frame length bpf_xdp_adjust_tail can truncate to: an Ethernet
+// header. This matches the Linux limit.
+//
+#define XDP_EBPF_MIN_FRAME_LENGTH 14
+
+typedef struct _EBPF_XDP_MD {
+    xdp_md_t Base;
+    EBPF_PROG_TEST_RUN_CONTEXT* ProgTestRunContext;
+
+    //
+    // The inspection context and the redirect target selected by the program,
+    // if any. The inspection context is NULL for BPF_PROG_TEST_RUN.
+    //
+    XDP_INSPECTION_CONTEXT *InspectionContext;
+    HANDLE RedirectTarget;
+
+    //
+    // The start of the buffer containing the frame data. The headroom between
+    // the buffer start and the data is available for metadata.
+    //
+    UCHAR *BufferStart;
+
+    //
+    // The frame and its fragment buffers, which packet-modifying helpers
+    // update. The frame is NULL for BPF_PROG_TEST_RUN.
+    //
+    XDP_FRAME *Frame;
+    XDP_RING *FragmentRing;
+    XDP_EXTENSION *FragmentExtension;
+    XDP_EXTENSION *VirtualAddressExtension;
+    UINT32 FragmentIndex;
+
+    //
+    // Set by helpers that modify the frame, whose verdicts cannot be replayed
+    // from the flow verdict cache.
+    //
+    BOOLEAN FrameModified;
+} EBPF_XDP_MD;
+
+//
+// The number of entries in an RX queue's direct-mapped eBPF flow verdict
+// cache. Must be a power of two.
+//
+#define XDP_EBPF_FLOW_CACHE_SIZE 256
+
+typedef struct _XDP_EBPF_FLOW_KEY {
+    XDP_INET_ADDR SourceAddress;
+    XDP_INET_ADDR DestinationAddress;
+    UINT16 SourcePort;
+    UINT16 DestinationPort;
+    UINT16 EthType;
+    UINT16 VlanId;
+    UINT8 IpProto;
+    UINT8 Reserved[3];
+} XDP_EBPF_FLOW_KEY;
+
+typedef struct _XDP_EBPF_FLOW_CACHE_ENTRY {
+    XDP_EBPF_FLOW_KEY Key;
+
+    //
+    // The entry is valid only if its generation matches the cache generation;
+    // generation zero is never valid.
+    //
+    UINT32 Generation;
+    UINT32 Result;
+} XDP_EBPF_FLOW_CACHE_ENTRY;
+
+typedef struct _XDP_EBPF_FLOW_CACHE {
+    UINT32 Generation;
+    XDP_EBPF_FLOW_CACHE_ENTRY Entries[XDP_EBPF_FLOW_CACHE_SIZE];
+} XDP_EBPF_FLOW_CACHE;
+
+//
+// The number of entries in an RX queue's direct-mapped IP fragment verdict
+// cache. Must be a power of two.
+//
+#define XDP_FRAGMENT_CACHE_SIZE 64
+
+typedef struct _XDP_FRAGMENT_KEY {
+    XDP_INET_ADDR SourceAddress;
+    XDP_INET_ADDR DestinationAddress;
+    UINT32 Id;
+    UINT16 EthType;
+    UINT8 IpProto;
+    UINT8 Reserved;
+} XDP_FRAGMENT_KEY;
+
+typedef struct _XDP_FRAGMENT_CACHE_ENTRY {
+    XDP_FRAGMENT_KEY Key;
+
+    //
+    // The entry is valid only if its generation matches the cache generation;
+    // generation zero is never valid.
+    //
+    UINT32 Generation;
+
+    //
+    // The index of the rule the first fragment matched, or MAXUINT32 if it
+    // matched no rule, and the action applied to the first fragment.
+    //
+    UINT32 RuleIndex;
+    XDP_RULE_ACTION RuleAction;
+} XDP_FRAGMENT_CACHE_ENTRY;
+
+typedef struct _XDP_FRAGMENT_CACHE {
+    UINT32 Generation;
+    XDP_FRAGMENT_CACHE_ENTRY Entries[XDP_FRAGMENT_CACHE_SIZE];
+} XDP_FRAGMENT_CACHE;
+
+//
+// The maximum number of frames whose eBPF program contexts are built before
+// the program is invoked on each of them.
+//
+#define XDP_EBPF_INVOKE_BATCH_SIZE 32
+
+typedef struct _XDP_EBPF_INVOKE_ENTRY {
+    EBPF_XDP_MD XdpMd;
+    XDP_FRAME *Frame;
+    UINT32 FrameIndex;
+    UINT32 FragmentIndex;
+    UINT32 Result;
+    ebpf_result_t EbpfResult;
+
+    //
+    // The flow verdict cache entry the frame's verdict is stored to, if the
+    // verdict was not found in the cache.
+    //
+    XDP_EBPF_FLOW_CACHE_ENTRY *FlowCacheEntry;
+    XDP_EBPF_FLOW_KEY FlowKey;
+    BOOLEAN FlowCacheHit;
+} XDP_EBPF_INVOKE_ENTRY;
+
 typedef struct _XDP_INSPECTION_CONTEXT {
     XDP_INSPECTION_EBPF_CONTEXT EbpfContext;
     XDP_REDIRECT_CONTEXT RedirectContext;
     ULONG IfIndex;
+
+    //
+    // Storage for discontiguous headers of the frame being inspected. Compiled
+    // programs are immutable and may be shared by multiple RX queues.
+    //
+    XDP_PROGRAM_FRAME_STORAGE FrameStorage;
+
+    //
+    // Random state for sample actions. Never zero.
+    //
+    UINT32 SampleSeed;
+
+    //
+    // Per-frame eBPF invocation state for the current RX batch.
+    //
+    XDP_EBPF_INVOKE_ENTRY EbpfInvokeBatch[XDP_EBPF_INVOKE_BATCH_SIZE];
+
+    //
+    // eBPF verdicts of recently inspected flows. Invalidated only on the data
+    // path execution context, or while the data path is not running.
+    //
+    XDP_EBPF_FLOW_CACHE EbpfFlowCache;
+
+    //
+    // Rule verdicts of the first fragments of recently inspected IP packets,
+    // applied to the packets' later fragments. Invalidated like the eBPF flow
+    // verdict cache.
+    //
+    XDP_FRAGMENT_CACHE FragmentCache;
+
+    //
+    // Sockets eBPF programs can redirect to, indexed by key. Updated only via
+    // XdpRxQueueSync.
+    //
+    HANDLE EbpfXskMap[XDP_EBPF_XSK_MAP_SIZE];
 } XDP_INSPECTION_CONTEXT;
 
 //
@@ -39,6 +313,68 @@ XDP_RX_INSPECT_ROUTINE(
 XDP_RX_INSPECT_ROUTINE XdpInspect;
 XDP_RX_INSPECT_ROUTINE XdpInspectEbpf;
 
+//
+// Invokes the eBPF program targeted by a native rule's eBPF action on a single
+// frame matching the rule.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+XDP_RX_ACTION
+XdpInspectEbpfRule(
+    _In_ HANDLE EbpfTarget,
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_FRAME *Frame,
+    _In_ UINT32 FrameIndex,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension
+    );
+
+//
+// Inspects FrameCount frames starting at the unmasked frame ring index
+// FrameIndex, writing each frame's RX action extension, and returns the number
+// of fragment buffers consumed by the batch. FragmentIndex is the unmasked
+// fragment ring index of the first frame's fragments.
+//
+typedef
+_IRQL_requires_max_(DISPATCH_LEVEL)
+UINT32
+XDP_RX_INSPECT_BATCH_ROUTINE(
+    _In_ XDP_PROGRAM *Program,
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_RING *FrameRing,
+    _In_ UINT32 FrameIndex,
+    _In_ UINT32 FrameCount,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ XDP_EXTENSION *RxActionExtension
+    );
+
+XDP_RX_INSPECT_BATCH_ROUTINE XdpInspectBatch;
+XDP_RX_INSPECT_BATCH_ROUTINE XdpInspectEbpfBatch;
+
+//
+// Inspects frames of RX queues without a fragment ring.
+//
+XDP_RX_INSPECT_BATCH_ROUTINE XdpInspectSingleBufferBatch;
+
+//
+// Inspects programs accepted by XdpProgramCanXskPortSetBypass.
+//
+XDP_RX_INSPECT_BATCH_ROUTINE XdpInspectXskPortSetBatch;
+
+//
+// Inspects programs accepted by XdpProgramCanMatchAllBypass.
+//
+XDP_RX_INSPECT_BATCH_ROUTINE XdpInspectMatchAllBatch;
+
+//
+// Inspects programs accepted by XdpProgramIsCompiled.
+//
+XDP_RX_INSPECT_BATCH_ROUTINE XdpInspectCompiledBatch;
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 _Success_(return)
 BOOLEAN
@@ -61,23 +397,94 @@ XdpProgramGetXskBypassTarget(
     _In_ XDP_RX_QUEUE *RxQueue
     );
 
+//
+// Invalidates all eBPF flow verdicts and IP fragment verdicts cached in the
+// inspection context. Must be called on the RX queue's data path execution
+// context, or while the data path is not running.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramInvalidateVerdictCaches(
+    _Inout_ XDP_INSPECTION_CONTEXT *InspectionContext
+    );
+
 //
 // Control path routines.
 //
 
+//
+// Returns whether the program consists of only an unconditional eBPF action,
+// which is inspected by the batched eBPF routines.
+//
 BOOLEAN
 XdpProgramIsEbpf(
     _In_ XDP_PROGRAM *Program
     );
 
+//
+// Returns whether any of the program's rules has an eBPF action.
+//
+BOOLEAN
+XdpProgramContainsEbpf(
+    _In_ XDP_PROGRAM *Program
+    );
+
 BOOLEAN
 XdpProgramCanXskBypass(
     _In_ XDP_PROGRAM *Program,
     _In_ XDP_RX_QUEUE *RxQueue
     );
 
+//
+// Returns whether every rule of the program redirects a UDP destination port
+// set to an XSK bound to the RX queue, which is inspected by the batched XSK
+// port set routine.
+//
+BOOLEAN
+XdpProgramCanXskPortSetBypass(
+    _In_ XDP_PROGRAM *Program,
+    _In_ XDP_RX_QUEUE *RxQueue
+    );
+
+//
+// Returns whether the program is a single rule dropping or passing all frames,
+// which is inspected by the batched match-all routine.
+//
+BOOLEAN
+XdpProgramCanMatchAllBypass(
+    _In_ XDP_PROGRAM *Program
+    );
+
+//
+// Returns whether the program's rules were compiled into ops, which are
+// inspected by the batched compiled routine.
+//
+BOOLEAN
+XdpProgramIsCompiled(
+    _In_ XDP_PROGRAM *Program
+    );
+
+//
+// Attaches the all-queues programs of the RX queue's interface hook to a newly
+// created RX queue. Must be invoked from the interface's work queue.
+//
+VOID
+XdpProgramAttachAllQueuesPrograms(
+    _In_ XDP_RX_QUEUE *RxQueue
+    );
+
 XDP_FILE_CREATE_ROUTINE XdpIrpCreateProgram;
 
+//
+// Creates the program objects of the programs persisted for a newly added
+// interface.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpProgramNotifyInterfaceAdded(
+    _In_ UINT32 IfIndex
+    );
+
 NTSTATUS
 XdpProgramStart(
     VOID
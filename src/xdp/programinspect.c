@@ -10,7 +10,29 @@
 #include "precomp.h"
 #include "programinspect.h"
 
+#if defined(_M_AMD64) || defined(_M_IX86)
+#include <emmintrin.h>
+#endif
+
 #define TCP_HDR_LEN_TO_BYTES(x) (((UINT64)(x)) * 4)
+#define IP4_FRAGMENT_MASK 0x3FFF
+#define IP4_FRAGMENT_OFFSET_MASK 0x1FFF
+#define IP6_FRAGMENT_MASK 0xFFF9
+#define IP6_FRAGMENT_OFFSET_MASK 0xFFF8
+
+#define XDP_PROGRAM_HASH_BASIS 0x811C9DC5ui32
+#define XDP_PROGRAM_HASH_PRIME 0x01000193ui32
+#define XDP_PROGRAM_HASH_SLOT_EMPTY MAXUINT32
+
+//
+// Runs of fewer exact-match rules than this are cheaper to scan linearly.
+//
+#define XDP_PROGRAM_INDEX_MIN_RULES 4
+
+//
+// Tracked flows are refreshed at most this often, in 100ns units.
+//
+#define XDP_CONNTRACK_REFRESH_INTERVAL (1000 * 10000ui64)
 
 //
 // Data path routines.
@@ -106,6 +128,136 @@ XdpGetContiguousHeader(
     return ReadLength == HeaderSize;
 }
 
+static
+_Success_(return != FALSE)
+BOOLEAN
+XdpSkipFragmentedBytes(
+    _Inout_ XDP_BUFFER **Buffer,
+    _Inout_ UINT32 *BufferDataOffset,
+    _Inout_ UINT32 *FragmentIndex,
+    _Inout_ UINT32 *FragmentsRemaining,
+    _In_ XDP_RING *FragmentRing,
+    _In_ UINT32 Length
+    )
+{
+    while (Length > 0) {
+        UINT32 SkipLength = min(Length, (*Buffer)->DataLength - *BufferDataOffset);
+
+        //
+        // If the current buffer is depleted, advance to the next fragment.
+        //
+        if (SkipLength == 0) {
+            if (*FragmentsRemaining == 0) {
+                return FALSE;
+            }
+
+            *FragmentIndex = (*FragmentIndex + 1) & FragmentRing->Mask;
+            *FragmentsRemaining -= 1;
+            *Buffer = XdpRingGetElement(FragmentRing, *FragmentIndex);
+            *BufferDataOffset = 0;
+            continue;
+        }
+
+        *BufferDataOffset += SkipLength;
+        Length -= SkipLength;
+    }
+
+    return TRUE;
+}
+
+static
+BOOLEAN
+XdpIsVlanEthType(
+    _In_ UINT16 EthType
+    )
+{
+    return EthType == htons(ETHERNET_TYPE_802_1Q) || EthType == htons(ETHERNET_TYPE_802_1AD);
+}
+
+static
+UINT16
+XdpGetVlanId(
+    _In_ const VLAN_TAG *VlanTag
+    )
+{
+    return ntohs(VlanTag->Tag) & 0x0FFF;
+}
+
+static
+BOOLEAN
+XdpIsIp6ExtensionHeader(
+    _In_ UINT8 NextHeader
+    )
+{
+    return
+        NextHeader == IPPROTO_HOPOPTS || NextHeader == IPPROTO_ROUTING ||
+        NextHeader == IPPROTO_FRAGMENT || NextHeader == IPPROTO_DSTOPTS;
+}
+
+//
+// Records the fragment identity of an IPv4 frame. Returns FALSE if the frame
+// is a later fragment of a packet, which carries no upper layer headers.
+//
+static
+BOOLEAN
+XdpParseIp4Fragment(
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *Cache
+    )
+{
+    UINT16 FlagsAndOffset = ntohs(Cache->Ip4Hdr->FlagsAndOffset);
+
+    if ((FlagsAndOffset & IP4_FRAGMENT_MASK) == 0) {
+        return TRUE;
+    }
+
+    Cache->IpFragment = TRUE;
+    Cache->IpFirstFragment = (FlagsAndOffset & IP4_FRAGMENT_OFFSET_MASK) == 0;
+    Cache->IpFragmentId = Cache->Ip4Hdr->Identification;
+    Cache->IpFragmentProtocol = Cache->Ip4Hdr->Protocol;
+
+    return Cache->IpFirstFragment;
+}
+
+//
+// Parses the fixed portion of an IPv6 extension header, returning the total
+// header length and updating NextHeader, or returning zero if the upper layer
+// headers cannot be found beyond this header.
+//
+static
+UINT32
+XdpParseIp6ExtensionHeader(
+    _In_ const IPV6_FRAGMENT_HEADER *ExtHdr,
+    _Inout_ UINT8 *NextHeader,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *Cache
+    )
+{
+    if (*NextHeader == IPPROTO_FRAGMENT) {
+        UINT16 OffsetAndFlags = ntohs(ExtHdr->OffsetAndFlags);
+
+        //
+        // Atomic fragments carry a whole upper layer packet, and the first
+        // fragment of a fragmented packet carries the upper layer headers.
+        // Later fragments are opaque IPv6 payload.
+        //
+        if ((OffsetAndFlags & IP6_FRAGMENT_MASK) != 0) {
+            Cache->IpFragment = TRUE;
+            Cache->IpFirstFragment = (OffsetAndFlags & IP6_FRAGMENT_OFFSET_MASK) == 0;
+            Cache->IpFragmentId = ExtHdr->Id;
+            Cache->IpFragmentProtocol = ExtHdr->NextHeader;
+
+            if (!Cache->IpFirstFragment) {
+                return 0;
+            }
+        }
+
+        *NextHeader = ExtHdr->NextHeader;
+        return sizeof(*ExtHdr);
+    }
+
+    *NextHeader = ExtHdr->NextHeader;
+    return (((const IPV6_EXTENSION_HEADER *)ExtHdr)->Length + 1) * 8;
+}
+
 static
 VOID
 XdpCopyMemoryToFrame(
@@ -165,10 +317,36 @@ XdpParseFragmentedEthernet(
     _Inout_ XDP_PROGRAM_FRAME_STORAGE *Storage
     )
 {
-    Cache->EthValid =
-        XdpGetContiguousHeader(
+    UINT16 EthType;
+
+    if (!XdpGetContiguousHeader(
             Frame, Buffer, BufferDataOffset, FragmentIndex, FragmentsRemaining, FragmentRing,
-            VirtualAddressExtension, &Storage->EthHdr, sizeof(Storage->EthHdr), &Cache->EthHdr);
+            VirtualAddressExtension, &Storage->EthHdr, sizeof(Storage->EthHdr), &Cache->EthHdr)) {
+        return;
+    }
+
+    EthType = Cache->EthHdr->Type;
+
+    for (UINT32 i = 0; i < XDP_PROGRAM_MAX_VLAN_TAGS && XdpIsVlanEthType(EthType); i++) {
+        VLAN_TAG *VlanTag;
+
+        if (!XdpGetContiguousHeader(
+                Frame, Buffer, BufferDataOffset, FragmentIndex, FragmentsRemaining,
+                FragmentRing, VirtualAddressExtension, &Storage->VlanTag,
+                sizeof(Storage->VlanTag), &VlanTag)) {
+            return;
+        }
+
+        if (i == 0) {
+            Cache->VlanId = XdpGetVlanId(VlanTag);
+            Cache->VlanValid = TRUE;
+        }
+
+        EthType = VlanTag->Type;
+    }
+
+    Cache->EthType = EthType;
+    Cache->EthValid = TRUE;
 }
 
 static
@@ -206,10 +384,46 @@ XdpParseFragmentedIp6(
     _Inout_ XDP_PROGRAM_FRAME_STORAGE *Storage
     )
 {
-    Cache->Ip6Valid =
-        XdpGetContiguousHeader(
+    UINT8 NextHeader;
+
+    if (!XdpGetContiguousHeader(
             Frame, Buffer, BufferDataOffset, FragmentIndex, FragmentsRemaining, FragmentRing,
-            VirtualAddressExtension, &Storage->Ip6Hdr, sizeof(Storage->Ip6Hdr), &Cache->Ip6Hdr);
+            VirtualAddressExtension, &Storage->Ip6Hdr, sizeof(Storage->Ip6Hdr), &Cache->Ip6Hdr)) {
+        return;
+    }
+
+    NextHeader = Cache->Ip6Hdr->NextHeader;
+
+    for (UINT32 i = 0;
+        i < XDP_PROGRAM_MAX_IPV6_EXTENSION_HEADERS && XdpIsIp6ExtensionHeader(NextHeader);
+        i++) {
+        IPV6_FRAGMENT_HEADER *ExtHdr;
+        UINT32 ExtHdrLength;
+
+        //
+        // Every extension header is at least 8 bytes long.
+        //
+        if (!XdpGetContiguousHeader(
+                Frame, Buffer, BufferDataOffset, FragmentIndex, FragmentsRemaining,
+                FragmentRing, VirtualAddressExtension, &Storage->Ip6ExtHdr,
+                sizeof(Storage->Ip6ExtHdr), &ExtHdr)) {
+            return;
+        }
+
+        ExtHdrLength = XdpParseIp6ExtensionHeader(ExtHdr, &NextHeader, Cache);
+        if (ExtHdrLength == 0) {
+            break;
+        }
+
+        if (!XdpSkipFragmentedBytes(
+                Buffer, BufferDataOffset, FragmentIndex, FragmentsRemaining, FragmentRing,
+                ExtHdrLength - sizeof(*ExtHdr))) {
+            return;
+        }
+    }
+
+    Cache->Ip6NextHeader = NextHeader;
+    Cache->Ip6Valid = TRUE;
 }
 
 static
@@ -310,7 +524,7 @@ XdpParseFragmentedFrame(
         }
     }
 
-    if (Cache->EthHdr->Type == htons(ETHERNET_TYPE_IPV4)) {
+    if (Cache->EthType == htons(ETHERNET_TYPE_IPV4)) {
         if (!Cache->Ip4Valid) {
             XdpParseFragmentedIp4(
                 Frame, &Buffer, &BufferDataOffset, &FragmentIndex, &FragmentCount, FragmentRing,
@@ -320,8 +534,11 @@ XdpParseFragmentedFrame(
                 return;
             }
         }
+        if (!XdpParseIp4Fragment(Cache)) {
+            return;
+        }
         IpProto = Cache->Ip4Hdr->Protocol;
-    } else if (Cache->EthHdr->Type == htons(ETHERNET_TYPE_IPV6)) {
+    } else if (Cache->EthType == htons(ETHERNET_TYPE_IPV6)) {
         if (!Cache->Ip6Valid) {
             XdpParseFragmentedIp6(
                 Frame, &Buffer, &BufferDataOffset, &FragmentIndex, &FragmentCount, FragmentRing,
@@ -331,7 +548,7 @@ XdpParseFragmentedFrame(
                 return;
             }
         }
-        IpProto = Cache->Ip6Hdr->NextHeader;
+        IpProto = Cache->Ip6NextHeader;
     } else {
         return;
     }
@@ -373,14 +590,20 @@ XdpParseFragmentedFrame(
     }
 }
 
+//
+// Parses the headers of a frame starting at an offset from the start of the
+// frame data: zero for the frame itself, or the inner Ethernet header of a
+// tunneled frame.
+//
 static
 VOID
-XdpParseFrame(
+XdpParseFrameAt(
     _In_ XDP_FRAME *Frame,
     _In_opt_ XDP_RING *FragmentRing,
     _In_opt_ XDP_EXTENSION *FragmentExtension,
     _In_ UINT32 FragmentIndex,
     _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ UINT32 Offset,
     _Out_ XDP_PROGRAM_FRAME_CACHE *Cache,
     _Inout_ XDP_PROGRAM_FRAME_STORAGE *Storage
     )
@@ -388,7 +611,8 @@ XdpParseFrame(
     XDP_BUFFER *Buffer;
     UCHAR *Va;
     IPPROTO IpProto = IPPROTO_MAX;
-    UINT32 Offset = 0;
+    UINT32 Length;
+    UINT16 EthType;
 
     //
     // This routine always attempts to parse Ethernet through UDP headers.
@@ -410,14 +634,37 @@ XdpParseFrame(
     Va = XdpGetVirtualAddressExtension(Buffer, VirtualAddressExtension)->VirtualAddress;
     Va += Buffer->DataOffset;
 
-    if (Buffer->DataLength < sizeof(*Cache->EthHdr)) {
+    if (Buffer->DataLength < Offset + sizeof(*Cache->EthHdr)) {
         goto BufferTooSmall;
     }
     Cache->EthHdr = (ETHERNET_HEADER *)&Va[Offset];
+    EthType = Cache->EthHdr->Type;
+    Length = sizeof(*Cache->EthHdr);
+
+    //
+    // Headers are committed to the cache, and Offset advanced past them, only
+    // once each layer is fully parsed, so the fragmented parser can resume
+    // from Offset.
+    //
+    for (UINT32 i = 0; i < XDP_PROGRAM_MAX_VLAN_TAGS && XdpIsVlanEthType(EthType); i++) {
+        const VLAN_TAG *VlanTag;
+
+        if (Buffer->DataLength < Offset + Length + sizeof(*VlanTag)) {
+            goto BufferTooSmall;
+        }
+        VlanTag = (const VLAN_TAG *)&Va[Offset + Length];
+        if (i == 0) {
+            Cache->VlanId = XdpGetVlanId(VlanTag);
+        }
+        EthType = VlanTag->Type;
+        Length += sizeof(*VlanTag);
+    }
+    Cache->VlanValid = Length > sizeof(*Cache->EthHdr);
+    Cache->EthType = EthType;
     Cache->EthValid = TRUE;
-    Offset += sizeof(*Cache->EthHdr);
+    Offset += Length;
 
-    if (Cache->EthHdr->Type == htons(ETHERNET_TYPE_IPV4)) {
+    if (Cache->EthType == htons(ETHERNET_TYPE_IPV4)) {
         if (Buffer->DataLength < Offset + sizeof(*Cache->Ip4Hdr)) {
             goto BufferTooSmall;
         }
@@ -427,15 +674,43 @@ XdpParseFrame(
         }
         Cache->Ip4Valid = TRUE;
         Offset += sizeof(*Cache->Ip4Hdr);
+        if (!XdpParseIp4Fragment(Cache)) {
+            return;
+        }
         IpProto = Cache->Ip4Hdr->Protocol;
-    } else if (Cache->EthHdr->Type == htons(ETHERNET_TYPE_IPV6)) {
+    } else if (Cache->EthType == htons(ETHERNET_TYPE_IPV6)) {
+        UINT8 NextHeader;
+
         if (Buffer->DataLength < Offset + sizeof(*Cache->Ip6Hdr)) {
             goto BufferTooSmall;
         }
+        NextHeader = ((IPV6_HEADER *)&Va[Offset])->NextHeader;
+        Length = sizeof(*Cache->Ip6Hdr);
+
+        for (UINT32 i = 0;
+            i < XDP_PROGRAM_MAX_IPV6_EXTENSION_HEADERS && XdpIsIp6ExtensionHeader(NextHeader);
+            i++) {
+            const IPV6_FRAGMENT_HEADER *ExtHdr;
+            UINT32 ExtHdrLength;
+
+            if (Buffer->DataLength < Offset + Length + sizeof(*ExtHdr)) {
+                goto BufferTooSmall;
+            }
+            ExtHdr = (const IPV6_FRAGMENT_HEADER *)&Va[Offset + Length];
+            ExtHdrLength = XdpParseIp6ExtensionHeader(ExtHdr, &NextHeader, Cache);
+            if (ExtHdrLength == 0) {
+                break;
+            }
+            if (Buffer->DataLength < Offset + Length + ExtHdrLength) {
+                goto BufferTooSmall;
+            }
+            Length += ExtHdrLength;
+        }
         Cache->Ip6Hdr = (IPV6_HEADER *)&Va[Offset];
+        Cache->Ip6NextHeader = NextHeader;
         Cache->Ip6Valid = TRUE;
-        Offset += sizeof(*Cache->Ip6Hdr);
-        IpProto = Cache->Ip6Hdr->NextHeader;
+        Offset += Length;
+        IpProto = NextHeader;
     } else {
         return;
     }
@@ -483,6 +758,127 @@ BufferTooSmall:
     }
 }
 
+static
+FORCEINLINE
+VOID
+XdpParseFrame(
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Out_ XDP_PROGRAM_FRAME_CACHE *Cache,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *Storage
+    )
+{
+    XdpParseFrameAt(
+        Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension, 0, Cache,
+        Storage);
+}
+
+//
+// Parses the tunnel header following the outer UDP header and the inner
+// frame's headers. Returns whether the frame is encapsulated in the tunnel.
+//
+static
+BOOLEAN
+XdpParseTunnel(
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ const XDP_TUNNEL *Tunnel,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *Cache,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *Storage
+    )
+{
+    XDP_BUFFER *Buffer = &Frame->Buffer;
+    UCHAR *Va;
+    UINT32 Offset;
+
+    if (Cache->TunnelCached &&
+        Cache->Tunnel.Type == Tunnel->Type && Cache->Tunnel.UdpPort == Tunnel->UdpPort) {
+        return Cache->TunnelValid;
+    }
+
+    Cache->TunnelCached = TRUE;
+    Cache->TunnelValid = FALSE;
+    Cache->Tunnel = *Tunnel;
+
+    if (!Cache->UdpCached) {
+        XdpParseFrame(
+            Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+            Cache, Storage);
+    }
+
+    //
+    // The inner headers are parsed only within the first buffer, so tunneled
+    // frames can be decapsulated by advancing the frame's data offset.
+    //
+    if (!Cache->UdpValid || Cache->UdpHdr->uh_dport != Tunnel->UdpPort ||
+        Cache->TransportPayload.IsFragmentedBuffer) {
+        return FALSE;
+    }
+
+    if (Cache->IpFragment) {
+        return FALSE;
+    }
+
+    Va = XdpGetVirtualAddressExtension(Buffer, VirtualAddressExtension)->VirtualAddress;
+    Va += Buffer->DataOffset;
+    Offset = Cache->TransportPayload.BufferDataOffset;
+
+    switch (Tunnel->Type) {
+    case XDP_TUNNEL_TYPE_VXLAN:
+    {
+        const XDP_VXLAN_HEADER *VxlanHdr;
+
+        if (Buffer->DataLength < Offset + sizeof(*VxlanHdr)) {
+            return FALSE;
+        }
+        VxlanHdr = (const XDP_VXLAN_HEADER *)&Va[Offset];
+        if ((VxlanHdr->Flags & XDP_VXLAN_FLAG_VNI) == 0) {
+            return FALSE;
+        }
+        Offset += sizeof(*VxlanHdr);
+        break;
+    }
+
+    case XDP_TUNNEL_TYPE_GENEVE:
+    {
+        const XDP_GENEVE_HEADER *GeneveHdr;
+
+        if (Buffer->DataLength < Offset + sizeof(*GeneveHdr)) {
+            return FALSE;
+        }
+        GeneveHdr = (const XDP_GENEVE_HEADER *)&Va[Offset];
+        if (GeneveHdr->Version != 0 ||
+            GeneveHdr->ProtocolType != htons(XDP_GENEVE_PROTOCOL_ETHERNET)) {
+            return FALSE;
+        }
+        Offset += sizeof(*GeneveHdr) + GeneveHdr->OptionLength * sizeof(UINT32);
+        break;
+    }
+
+    default:
+        ASSERT(FALSE);
+        return FALSE;
+    }
+
+    XdpInitializeFrameCache(Cache->Inner);
+    XdpParseFrameAt(
+        Frame, NULL, NULL, 0, VirtualAddressExtension, Offset, Cache->Inner, Storage);
+    if (!Cache->Inner->EthValid) {
+        return FALSE;
+    }
+
+    Cache->InnerOffset = Offset;
+    Cache->TunnelValid = TRUE;
+
+    return TRUE;
+}
+
 static
 BOOLEAN
 Ipv4PrefixMatch(
@@ -519,7 +915,7 @@ UdpTupleMatch(
     _In_ const XDP_TUPLE *Tuple
     )
 {
-    if (Cache->EthHdr->Type == htons(ETHERNET_TYPE_IPV4)) {
+    if (Cache->EthType == htons(ETHERNET_TYPE_IPV4)) {
         return
             Type == XDP_MATCH_IPV4_UDP_TUPLE &&
             Cache->UdpHdr->uh_sport == Tuple->SourcePort &&
@@ -536,6 +932,93 @@ UdpTupleMatch(
     }
 }
 
+static
+BOOLEAN
+TcpTupleMatch(
+    _In_ XDP_MATCH_TYPE Type,
+    _In_ const XDP_PROGRAM_FRAME_CACHE *Cache,
+    _In_ const XDP_TUPLE *Tuple
+    )
+{
+    if (Cache->EthType == htons(ETHERNET_TYPE_IPV4)) {
+        return
+            Type == XDP_MATCH_IPV4_TCP_TUPLE &&
+            Cache->TcpHdr->th_sport == Tuple->SourcePort &&
+            Cache->TcpHdr->th_dport == Tuple->DestinationPort &&
+            IN4_ADDR_EQUAL(&Cache->Ip4Hdr->SourceAddress, &Tuple->SourceAddress.Ipv4) &&
+            IN4_ADDR_EQUAL(&Cache->Ip4Hdr->DestinationAddress, &Tuple->DestinationAddress.Ipv4);
+    } else { // IPv6
+        return
+            Type == XDP_MATCH_IPV6_TCP_TUPLE &&
+            Cache->TcpHdr->th_sport == Tuple->SourcePort &&
+            Cache->TcpHdr->th_dport == Tuple->DestinationPort &&
+            IN6_ADDR_EQUAL(&Cache->Ip6Hdr->SourceAddress, &Tuple->SourceAddress.Ipv6) &&
+            IN6_ADDR_EQUAL(&Cache->Ip6Hdr->DestinationAddress, &Tuple->DestinationAddress.Ipv6);
+    }
+}
+
+static
+BOOLEAN
+XdpQuicCidEqual(
+    _In_reads_bytes_(Length) const UINT8 *FrameCid,
+    _In_reads_bytes_(Length) const UINT8 *RuleCid,
+    _In_ UINT32 Length
+    )
+{
+    //
+    // Compare CIDs of up to XDP_QUIC_MAX_CID_LENGTH bytes with two possibly
+    // overlapping loads from each end, so no load strays beyond the CID.
+    // Only SSE2 is used: AVX would require saving extended processor state
+    // in kernel mode, and CIDs are no wider than two SSE2 registers.
+    //
+    C_ASSERT(XDP_QUIC_MAX_CID_LENGTH <= 2 * 16);
+
+    if (Length >= 16) {
+#if defined(_M_AMD64) || defined(_M_IX86)
+        __m128i Head =
+            _mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i *)FrameCid),
+                _mm_loadu_si128((const __m128i *)RuleCid));
+        __m128i Tail =
+            _mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i *)(FrameCid + Length - 16)),
+                _mm_loadu_si128((const __m128i *)(RuleCid + Length - 16)));
+        return _mm_movemask_epi8(_mm_and_si128(Head, Tail)) == 0xFFFF;
+#else
+        return
+            ((*(const UINT64 UNALIGNED *)FrameCid ^ *(const UINT64 UNALIGNED *)RuleCid) |
+             (*(const UINT64 UNALIGNED *)(FrameCid + 8) ^
+                *(const UINT64 UNALIGNED *)(RuleCid + 8)) |
+             (*(const UINT64 UNALIGNED *)(FrameCid + Length - 16) ^
+                *(const UINT64 UNALIGNED *)(RuleCid + Length - 16)) |
+             (*(const UINT64 UNALIGNED *)(FrameCid + Length - 8) ^
+                *(const UINT64 UNALIGNED *)(RuleCid + Length - 8))) == 0;
+#endif
+    }
+
+    if (Length >= 8) {
+        return
+            ((*(const UINT64 UNALIGNED *)FrameCid ^ *(const UINT64 UNALIGNED *)RuleCid) |
+             (*(const UINT64 UNALIGNED *)(FrameCid + Length - 8) ^
+                *(const UINT64 UNALIGNED *)(RuleCid + Length - 8))) == 0;
+    }
+
+    if (Length >= 4) {
+        return
+            ((*(const UINT32 UNALIGNED *)FrameCid ^ *(const UINT32 UNALIGNED *)RuleCid) |
+             (*(const UINT32 UNALIGNED *)(FrameCid + Length - 4) ^
+                *(const UINT32 UNALIGNED *)(RuleCid + Length - 4))) == 0;
+    }
+
+    for (UINT32 i = 0; i < Length; i++) {
+        if (FrameCid[i] != RuleCid[i]) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
 static
 BOOLEAN
 QuicCidMatch(
@@ -553,7 +1036,7 @@ QuicCidMatch(
     if (QuicHeader->QuicCidLength < Flow->CidOffset + Flow->CidLength) {
         return FALSE;
     }
-    return memcmp(&QuicHeader->QuicCid[Flow->CidOffset], Flow->CidData, Flow->CidLength) == 0;
+    return XdpQuicCidEqual(&QuicHeader->QuicCid[Flow->CidOffset], Flow->CidData, Flow->CidLength);
 }
 
 static
@@ -593,6 +1076,8 @@ XdpParseQuicHeaderPayload(
             QuicHdr->LONG_HDR.DestCid +
             QuicHdr->LONG_HDR.DestCidLength +
             sizeof(UCHAR);
+        FrameCache->QuicDestCidLength = QuicHdr->LONG_HDR.DestCidLength;
+        FrameCache->QuicDestCid = QuicHdr->LONG_HDR.DestCid;
         FrameCache->QuicValid = TRUE;
         FrameCache->QuicIsLongHeader = TRUE;
         return TRUE;
@@ -603,6 +1088,8 @@ XdpParseQuicHeaderPayload(
             DataLength - RTL_SIZEOF_THROUGH_FIELD(QUIC_HEADER_INVARIANT, SHORT_HDR),
             XDP_QUIC_MAX_CID_LENGTH);
     FrameCache->QuicCid = QuicHdr->SHORT_HDR.DestCid;
+    FrameCache->QuicDestCidLength = FrameCache->QuicCidLength;
+    FrameCache->QuicDestCid = FrameCache->QuicCid;
     FrameCache->QuicValid = TRUE;
     FrameCache->QuicIsLongHeader = FALSE;
     return FrameCache->QuicCidLength == XDP_QUIC_MAX_CID_LENGTH;
@@ -686,13 +1173,144 @@ BufferTooSmall:
     }
 }
 
+//
+// Returns XDP_PAYLOAD_PATTERN_MAX_LENGTH bytes starting at the pattern's
+// payload offset, or NULL if the payload ends before the pattern does. Bytes
+// beyond the pattern length are masked off, so they are read in place from
+// the buffer if it holds them, and are zero if the pattern is copied.
+//
 static
-BOOLEAN
-XdpTestBit(
-    _In_ const UINT8 *BitMap,
-    _In_ UINT32 Index
-    )
-{
+const UINT8 *
+XdpGetPayloadPatternBytes(
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ const XDP_PROGRAM_PAYLOAD_CACHE *Payload,
+    _In_ const XDP_PAYLOAD_PATTERN_TABLE *Pattern,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *FrameStore
+    )
+{
+    XDP_BUFFER *Buffer = Payload->Buffer;
+    UINT32 BufferDataOffset = Payload->BufferDataOffset;
+    UINT32 FragmentCount = 0;
+    VOID *Bytes;
+
+    if (BufferDataOffset <= Buffer->DataLength &&
+        Buffer->DataLength - BufferDataOffset >=
+            Pattern->Offset + XDP_PAYLOAD_PATTERN_MAX_LENGTH) {
+        UCHAR *Va = XdpGetVirtualAddressExtension(Buffer, VirtualAddressExtension)->VirtualAddress;
+        return Va + Buffer->DataOffset + BufferDataOffset + Pattern->Offset;
+    }
+
+    if (FragmentRing != NULL) {
+        ASSERT(FragmentExtension);
+        if (Payload->IsFragmentedBuffer) {
+            FragmentIndex = Payload->FragmentIndex;
+            FragmentCount = Payload->FragmentCount;
+        } else {
+            //
+            // The first buffer is stored in the frame ring, so bias the
+            // fragment index so the initial increment yields the first buffer
+            // in the fragment ring.
+            //
+            FragmentIndex--;
+            FragmentCount = XdpGetFragmentExtension(Frame, FragmentExtension)->FragmentBufferCount;
+        }
+    }
+
+    if (!XdpSkipFragmentedBytes(
+            &Buffer, &BufferDataOffset, &FragmentIndex, &FragmentCount, FragmentRing,
+            Pattern->Offset)) {
+        return NULL;
+    }
+
+    RtlZeroMemory(FrameStore->PayloadStorage, sizeof(FrameStore->PayloadStorage));
+
+    if (!XdpGetContiguousHeader(
+            Frame, &Buffer, &BufferDataOffset, &FragmentIndex, &FragmentCount, FragmentRing,
+            VirtualAddressExtension, FrameStore->PayloadStorage, Pattern->Length, &Bytes)) {
+        return NULL;
+    }
+
+    //
+    // A pattern contiguous at the end of a buffer is returned in place, but
+    // the bytes following it may not be readable.
+    //
+    if (Bytes != FrameStore->PayloadStorage) {
+        RtlCopyMemory(FrameStore->PayloadStorage, Bytes, Pattern->Length);
+    }
+
+    return FrameStore->PayloadStorage;
+}
+
+static
+BOOLEAN
+XdpPayloadPatternMatch(
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ const XDP_PROGRAM_PAYLOAD_CACHE *Payload,
+    _In_ const XDP_PAYLOAD_PATTERN_TABLE *Pattern,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *FrameStore
+    )
+{
+    const UINT8 *Bytes =
+        XdpGetPayloadPatternBytes(
+            Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+            Payload, Pattern, FrameStore);
+
+    C_ASSERT(XDP_PAYLOAD_PATTERN_MAX_LENGTH == 2 * 16);
+
+    if (Bytes == NULL) {
+        return FALSE;
+    }
+
+    //
+    // Compare the whole pattern width at once; the mask zeroes the bytes
+    // beyond the pattern length. As with CIDs, only SSE2 is used, since AVX
+    // would require saving extended processor state in kernel mode.
+    //
+#if defined(_M_AMD64) || defined(_M_IX86)
+    __m128i Low =
+        _mm_xor_si128(
+            _mm_and_si128(
+                _mm_loadu_si128((const __m128i *)Bytes),
+                _mm_loadu_si128((const __m128i *)Pattern->Mask)),
+            _mm_loadu_si128((const __m128i *)Pattern->Value));
+    __m128i High =
+        _mm_xor_si128(
+            _mm_and_si128(
+                _mm_loadu_si128((const __m128i *)(Bytes + 16)),
+                _mm_loadu_si128((const __m128i *)(Pattern->Mask + 16))),
+            _mm_loadu_si128((const __m128i *)(Pattern->Value + 16)));
+    return
+        _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(Low, High), _mm_setzero_si128())) ==
+            0xFFFF;
+#else
+    UINT64 Difference = 0;
+
+    for (UINT32 i = 0; i < XDP_PAYLOAD_PATTERN_MAX_LENGTH; i += sizeof(UINT64)) {
+        Difference |=
+            (*(const UINT64 UNALIGNED *)(Bytes + i) &
+                *(const UINT64 UNALIGNED *)(Pattern->Mask + i)) ^
+            *(const UINT64 UNALIGNED *)(Pattern->Value + i);
+    }
+
+    return Difference == 0;
+#endif
+}
+
+static
+BOOLEAN
+XdpTestBit(
+    _In_ const UINT8 *BitMap,
+    _In_ UINT32 Index
+    )
+{
     return (ReadUCharNoFence(&BitMap[Index >> 3]) >> (Index & 0x7)) & 0x1;
 }
 
@@ -719,6 +1337,8 @@ XdpL2Fwd(
 
     if (!Cache->EthValid) {
         STAT_INC(RxQueueStats, InspectFramesDropped);
+        STAT_INC(RxQueueStats, InspectDropsRule);
+        XdpRxQueueSampleDrop(RxQueueStats, XdpDropReasonRule, 1, Frame, VirtualAddressExtension);
 
         return XDP_RX_ACTION_DROP;
     }
@@ -740,531 +1360,4980 @@ XdpL2Fwd(
     return XDP_RX_ACTION_TX;
 }
 
-_IRQL_requires_max_(DISPATCH_LEVEL)
-XDP_RX_ACTION
-XdpInspect(
-    _In_ XDP_PROGRAM *Program,
-    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
-    _In_ XDP_RING *FrameRing,
-    _In_ UINT32 FrameIndex,
-    _In_opt_ XDP_RING *FragmentRing,
-    _In_opt_ XDP_EXTENSION *FragmentExtension,
-    _In_ UINT32 FragmentIndex,
-    _In_ XDP_EXTENSION *VirtualAddressExtension
+static
+UINT32
+XdpLpmLookup(
+    _In_ const XDP_LPM_TABLE *Table,
+    _In_reads_bytes_(Table->AddressLength) const UINT8 *Address
     )
 {
-    XDP_RX_ACTION Action = XDP_RX_ACTION_PASS;
-    XDP_PROGRAM_FRAME_CACHE FrameCache;
-    XDP_FRAME *Frame;
-    BOOLEAN Matched = FALSE;
-    XDP_PCW_RX_QUEUE *RxQueueStats = XdpRxQueueGetStatsFromInspectionContext(InspectionContext);
-
-    ASSERT(FrameIndex <= FrameRing->Mask);
-    ASSERT(
-        (FragmentRing == NULL && FragmentIndex == 0) ||
-        (FragmentRing && FragmentIndex <= FragmentRing->Mask));
-
-    XdpInitializeFrameCache(&FrameCache);
-    Frame = XdpRingGetElement(FrameRing, FrameIndex);
+    const XDP_LPM_NODE *Node = &Table->Nodes[0];
+    UINT32 Result = Table->DefaultResult;
 
-    for (ULONG RuleIndex = 0; RuleIndex < Program->RuleCount; RuleIndex++) {
-        XDP_RULE *Rule = &Program->Rules[RuleIndex];
+    for (UINT32 i = 0; i < Table->AddressLength; i++) {
+        const XDP_LPM_SLOT *Slot = &Node->Slots[Address[i]];
 
-        //
-        // Check the match conditions.
-        //
+        if (Slot->Result != 0) {
+            Result = Slot->Result;
+        }
 
-        switch (Rule->Match) {
-        case XDP_MATCH_ALL:
-            Matched = TRUE;
+        if (Slot->Child == 0) {
             break;
+        }
 
-        case XDP_MATCH_UDP:
-            if (!FrameCache.UdpCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.UdpValid) {
-                Matched = TRUE;
-            }
-            break;
+        Node = &Table->Nodes[Slot->Child];
+    }
 
-        case XDP_MATCH_UDP_DST:
-            if (!FrameCache.UdpCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.UdpValid &&
-                FrameCache.UdpHdr->uh_dport == Rule->Pattern.Port) {
-                Matched = TRUE;
-            }
-            break;
+    return Result;
+}
 
-        case XDP_MATCH_IPV4_DST_MASK:
-            if (!FrameCache.Ip4Cached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.Ip4Valid &&
-                Ipv4PrefixMatch(
-                    &FrameCache.Ip4Hdr->DestinationAddress, &Rule->Pattern.IpMask.Address.Ipv4,
-                    &Rule->Pattern.IpMask.Mask.Ipv4)) {
-                Matched = TRUE;
-            }
-            break;
+static
+BOOLEAN
+XdpLpmMatch(
+    _In_ const XDP_LPM_TABLE *Table,
+    _In_reads_bytes_(Table->AddressLength) const UINT8 *Address,
+    _Inout_ XDP_RULE_ACTION *Action
+    )
+{
+    UINT32 Result = XdpLpmLookup(Table, Address);
 
-        case XDP_MATCH_IPV6_DST_MASK:
-            if (!FrameCache.Ip6Cached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.Ip6Valid &&
-                Ipv6PrefixMatch(
-                    &FrameCache.Ip6Hdr->DestinationAddress,
-                    &Rule->Pattern.IpMask.Address.Ipv6,
-                    &Rule->Pattern.IpMask.Mask.Ipv6)) {
-                Matched = TRUE;
-            }
-            break;
+    if (Result == 0) {
+        return FALSE;
+    }
 
-        case XDP_MATCH_QUIC_FLOW_SRC_CID:
-        case XDP_MATCH_QUIC_FLOW_DST_CID:
-            if (!FrameCache.UdpCached || !FrameCache.TransportPayloadCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
+    switch (Table->Actions[Result - 1]) {
+    case XDP_IP_PREFIX_ACTION_RULE:
+        return TRUE;
 
-            if (!FrameCache.UdpValid || !FrameCache.TransportPayloadValid ||
-                FrameCache.UdpHdr->uh_dport != Rule->Pattern.QuicFlow.UdpPort) {
-                break;
-            }
+    case XDP_IP_PREFIX_ACTION_DROP:
+        *Action = XDP_PROGRAM_ACTION_DROP;
+        return TRUE;
 
-            if (!FrameCache.QuicCached) {
-                XdpParseQuicHeader(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache.TransportPayload, &Program->FrameStorage, &FrameCache);
-            }
+    case XDP_IP_PREFIX_ACTION_PASS:
+        *Action = XDP_PROGRAM_ACTION_PASS;
+        return TRUE;
 
-            if (FrameCache.QuicValid &&
-                QuicCidMatch(
-                    Rule->Match,
-                    &FrameCache,
-                    &Rule->Pattern.QuicFlow)) {
-                Matched = TRUE;
-            }
-            break;
+    case XDP_IP_PREFIX_ACTION_SKIP:
+        return FALSE;
 
-        case XDP_MATCH_IPV4_UDP_TUPLE:
-        case XDP_MATCH_IPV6_UDP_TUPLE:
-            if (!FrameCache.UdpCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.UdpValid &&
-                UdpTupleMatch(
-                    Rule->Match,
-                    &FrameCache,
-                    &Rule->Pattern.Tuple)) {
-                Matched = TRUE;
-            }
-            break;
+    default:
+        ASSERT(FALSE);
+        return FALSE;
+    }
+}
 
-        case XDP_MATCH_UDP_PORT_SET:
-            if (!FrameCache.UdpCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.UdpValid &&
-                XdpTestBit(Rule->Pattern.PortSet.PortSet, FrameCache.UdpHdr->uh_dport)) {
-                Matched = TRUE;
-            }
-            break;
+static
+BOOLEAN
+XdpPortRangeMatch(
+    _In_ const XDP_PORT_RANGE_TABLE *Table,
+    _In_ UINT16 NetworkPort
+    )
+{
+    const UINT16 Port = ntohs(NetworkPort);
+    UINT32 Low = 0;
+    UINT32 High = Table->RangeCount;
+
+    while (Low < High) {
+        const UINT32 Mid = Low + (High - Low) / 2;
+        const XDP_PORT_RANGE *Range = &Table->Ranges[Mid];
+
+        if (Port < Range->LowPort) {
+            High = Mid;
+        } else if (Port > Range->HighPort) {
+            Low = Mid + 1;
+        } else {
+            return TRUE;
+        }
+    }
 
-        case XDP_MATCH_IPV4_UDP_PORT_SET:
-            if (!FrameCache.UdpCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.Ip4Valid &&
-                IN4_ADDR_EQUAL(
-                    &FrameCache.Ip4Hdr->DestinationAddress,
-                    &Rule->Pattern.IpPortSet.Address.Ipv4) &&
-                FrameCache.UdpValid &&
-                XdpTestBit(Rule->Pattern.IpPortSet.PortSet.PortSet, FrameCache.UdpHdr->uh_dport)) {
-                Matched = TRUE;
-            }
-            break;
+    return FALSE;
+}
 
-        case XDP_MATCH_IPV6_UDP_PORT_SET:
-            if (!FrameCache.UdpCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.Ip6Valid &&
-                IN6_ADDR_EQUAL(
-                    &FrameCache.Ip6Hdr->DestinationAddress,
-                    &Rule->Pattern.IpPortSet.Address.Ipv6) &&
-                FrameCache.UdpValid &&
-                XdpTestBit(Rule->Pattern.IpPortSet.PortSet.PortSet, FrameCache.UdpHdr->uh_dport)) {
-                Matched = TRUE;
-            }
-            break;
+static
+UINT32
+XdpProgramHashUpdate(
+    _In_ UINT32 Hash,
+    _In_reads_bytes_(Length) const VOID *Data,
+    _In_ UINT32 Length
+    )
+{
+    const UINT8 *Bytes = Data;
 
-        case XDP_MATCH_IPV4_TCP_PORT_SET:
-            if (!FrameCache.TcpCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.Ip4Valid &&
-                IN4_ADDR_EQUAL(
-                    &FrameCache.Ip4Hdr->DestinationAddress,
-                    &Rule->Pattern.IpPortSet.Address.Ipv4) &&
-                FrameCache.TcpValid &&
-                XdpTestBit(Rule->Pattern.IpPortSet.PortSet.PortSet, FrameCache.TcpHdr->th_dport)) {
-                Matched = TRUE;
-            }
-            break;
+    //
+    // FNV-1a: cheap to compute per frame and good enough to spread exact-match
+    // keys; collisions are resolved by a full rule match.
+    //
+    for (UINT32 i = 0; i < Length; i++) {
+        Hash ^= Bytes[i];
+        Hash *= XDP_PROGRAM_HASH_PRIME;
+    }
 
-        case XDP_MATCH_IPV6_TCP_PORT_SET:
-            if (!FrameCache.TcpCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.Ip6Valid &&
-                IN6_ADDR_EQUAL(
-                    &FrameCache.Ip6Hdr->DestinationAddress,
-                    &Rule->Pattern.IpPortSet.Address.Ipv6) &&
-                FrameCache.TcpValid &&
-                XdpTestBit(Rule->Pattern.IpPortSet.PortSet.PortSet, FrameCache.TcpHdr->th_dport)) {
-                Matched = TRUE;
-            }
-            break;
+    return Hash;
+}
 
-        case XDP_MATCH_TCP_DST:
-            if (!FrameCache.TcpCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.TcpValid &&
-                FrameCache.TcpHdr->th_dport == Rule->Pattern.Port) {
-                Matched = TRUE;
-            }
-            break;
+//
+// Builds the flow key of a parsed TCP or UDP frame. Returns FALSE if the frame
+// does not belong to a TCP or UDP flow.
+//
+static
+BOOLEAN
+XdpInspectGetFlowKey(
+    _In_ const XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _Out_ XDP_EBPF_FLOW_KEY *Key
+    )
+{
+    RtlZeroMemory(Key, sizeof(*Key));
 
-        case XDP_MATCH_TCP_QUIC_FLOW_SRC_CID:
-        case XDP_MATCH_TCP_QUIC_FLOW_DST_CID:
-            if (!FrameCache.TcpCached || !FrameCache.TransportPayloadCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
+    //
+    // Non-initial fragments carry no transport header, and the first fragment
+    // carries only part of the packet.
+    //
+    if (FrameCache->IpFragment) {
+        return FALSE;
+    }
 
-            if (!FrameCache.TcpValid || !FrameCache.TransportPayloadValid ||
-                FrameCache.TcpHdr->th_dport != Rule->Pattern.QuicFlow.UdpPort) {
-                break;
-            }
+    if (FrameCache->Ip4Valid) {
+        Key->SourceAddress.Ipv4 = FrameCache->Ip4Hdr->SourceAddress;
+        Key->DestinationAddress.Ipv4 = FrameCache->Ip4Hdr->DestinationAddress;
+    } else if (FrameCache->Ip6Valid) {
+        Key->SourceAddress.Ipv6 = FrameCache->Ip6Hdr->SourceAddress;
+        Key->DestinationAddress.Ipv6 = FrameCache->Ip6Hdr->DestinationAddress;
+    } else {
+        return FALSE;
+    }
 
-            if (!FrameCache.QuicCached) {
-                XdpParseQuicHeader(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache.TransportPayload, &Program->FrameStorage, &FrameCache);
-            }
+    if (FrameCache->UdpValid) {
+        Key->SourcePort = FrameCache->UdpHdr->uh_sport;
+        Key->DestinationPort = FrameCache->UdpHdr->uh_dport;
+        Key->IpProto = IPPROTO_UDP;
+    } else if (FrameCache->TcpValid) {
+        Key->SourcePort = FrameCache->TcpHdr->th_sport;
+        Key->DestinationPort = FrameCache->TcpHdr->th_dport;
+        Key->IpProto = IPPROTO_TCP;
+    } else {
+        return FALSE;
+    }
 
-            if (FrameCache.QuicValid &&
-                QuicCidMatch(
-                    Rule->Match,
-                    &FrameCache,
-                    &Rule->Pattern.QuicFlow)) {
-                Matched = TRUE;
-            }
-            break;
+    Key->EthType = FrameCache->EthType;
+    if (FrameCache->VlanValid) {
+        Key->VlanId = FrameCache->VlanId;
+    }
 
-        case XDP_MATCH_TCP_CONTROL_DST:
-            if (!FrameCache.TcpCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.TcpValid &&
-                FrameCache.TcpHdr->th_dport == Rule->Pattern.Port &&
-                (FrameCache.TcpHdr->th_flags & (TH_SYN | TH_FIN | TH_RST)) != 0) {
-                Matched = TRUE;
-            }
-            break;
+    return TRUE;
+}
 
-        default:
-            ASSERT(FALSE);
-            break;
-        }
+//
+// Adds data, as big-endian 16-bit words, to an unfolded ones' complement sum.
+//
+static
+UINT32
+XdpChecksumAdd(
+    _In_ UINT32 Sum,
+    _In_reads_bytes_(Length) const VOID *Data,
+    _In_ UINT32 Length
+    )
+{
+    const UINT8 *Bytes = Data;
 
-        if (Matched) {
-            //
-            // Apply the action.
-            //
-            switch (Rule->Action) {
+    ASSERT(Length % sizeof(UINT16) == 0);
 
-            case XDP_PROGRAM_ACTION_REDIRECT:
-                XdpRedirect(
-                    &InspectionContext->RedirectContext, FrameIndex, FragmentIndex,
-                    Rule->Redirect.TargetType, Rule->Redirect.Target);
+    for (UINT32 i = 0; i < Length; i += sizeof(UINT16)) {
+        Sum += (Bytes[i] << 8) | Bytes[i + 1];
+    }
 
-                Action = XDP_RX_ACTION_DROP;
-                STAT_INC(RxQueueStats, InspectFramesRedirected);
-                break;
+    return Sum;
+}
 
-            case XDP_PROGRAM_ACTION_EBPF:
-                //
-                // Programs containing an eBPF action are expected to use the
-                // XdpInspectEbpf routine instead of XdpInspect.
-                //
-                ASSERT(FALSE);
-                __fallthrough;
+//
+// Folds a ones' complement sum into a checksum in network byte order.
+//
+static
+UINT16
+XdpChecksumFinish(
+    _In_ UINT32 Sum
+    )
+{
+    Sum = (Sum & 0xFFFF) + (Sum >> 16);
+    Sum = (Sum & 0xFFFF) + (Sum >> 16);
 
-            case XDP_PROGRAM_ACTION_DROP:
-                Action = XDP_RX_ACTION_DROP;
-                STAT_INC(RxQueueStats, InspectFramesDropped);
-                break;
+    return htons((UINT16)~Sum);
+}
 
-            case XDP_PROGRAM_ACTION_PASS:
-                Action = XDP_RX_ACTION_PASS;
-                STAT_INC(RxQueueStats, InspectFramesPassed);
-                break;
+//
+// Incrementally updates a ones' complement checksum for data replaced within
+// the checksummed bytes (RFC 1624, eqn. 3): HC' = ~(~HC + ~m + m').
+//
+static
+UINT16
+XdpChecksumReplace(
+    _In_ UINT16 Checksum,
+    _In_reads_bytes_(Length) const VOID *OldData,
+    _In_reads_bytes_(Length) const VOID *NewData,
+    _In_ UINT32 Length
+    )
+{
+    const UINT8 *Old = OldData;
+    const UINT8 *New = NewData;
+    UINT32 Sum = (UINT16)~ntohs(Checksum);
 
-            case XDP_PROGRAM_ACTION_L2FWD:
-                Action =
-                    XdpL2Fwd(
-                        Frame, FragmentRing, FragmentExtension, FragmentIndex,
-                        VirtualAddressExtension, &FrameCache, &Program->FrameStorage, RxQueueStats);
-                break;
+    ASSERT(Length % sizeof(UINT16) == 0);
 
+    for (UINT32 i = 0; i < Length; i += sizeof(UINT16)) {
+        Sum += (UINT16)~((Old[i] << 8) | Old[i + 1]);
+        Sum += (New[i] << 8) | New[i + 1];
+    }
 
-            default:
-                ASSERT(FALSE);
-                break;
-            }
+    return XdpChecksumFinish(Sum);
+}
 
-            goto Done;
-        }
-    }
+//
+// Computes the checksum of an IPv4 header without options. The header's
+// checksum field must be zero.
+//
+static
+UINT16
+XdpChecksumIp4Header(
+    _In_ const IPV4_HEADER *Ip4Hdr
+    )
+{
+    return XdpChecksumFinish(XdpChecksumAdd(0, Ip4Hdr, sizeof(*Ip4Hdr)));
+}
 
-    //
-    // No match resulted in a terminating action; perform the default action.
-    //
-    ASSERT(Action == XDP_RX_ACTION_PASS);
-    STAT_INC(RxQueueStats, InspectFramesPassed);
+static
+BOOLEAN
+XdpInspectIsHeaderInFirstBuffer(
+    _In_ XDP_FRAME *Frame,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ const VOID *Header,
+    _In_ UINT32 HeaderLength
+    )
+{
+    const UCHAR *Va =
+        XdpGetVirtualAddressExtension(&Frame->Buffer, VirtualAddressExtension)->VirtualAddress;
+    const UCHAR *Hdr = Header;
 
-Done:
+    Va += Frame->Buffer.DataOffset;
 
-    return Action;
+    return Hdr >= Va && Hdr + HeaderLength <= Va + Frame->Buffer.DataLength;
 }
 
 //
-// Control path routines.
+// Rewrites the destination IP address of a parsed TCP or UDP frame, updating
+// the IP header and transport checksums. IPv4 UDP frames without a checksum
+// are left without one.
 //
-
+static
 VOID
-XdpProgramDeleteRule(
-    _Inout_ XDP_RULE *Rule
+XdpInspectRewriteDestination(
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *Cache,
+    _In_ const XDP_INET_ADDR *Address
     )
 {
-    if (Rule->Match == XDP_MATCH_IPV4_UDP_PORT_SET ||
-        Rule->Match == XDP_MATCH_IPV6_UDP_PORT_SET ||
-        Rule->Match == XDP_MATCH_IPV4_TCP_PORT_SET ||
-        Rule->Match == XDP_MATCH_IPV6_TCP_PORT_SET) {
-        XdpProgramReleasePortSet(&Rule->Pattern.IpPortSet.PortSet);
+    VOID *Destination;
+    UINT32 AddressLength;
+
+    if (Cache->Ip4Valid) {
+        Destination = &Cache->Ip4Hdr->DestinationAddress;
+        AddressLength = sizeof(IN_ADDR);
+        Cache->Ip4Hdr->HeaderChecksum =
+            XdpChecksumReplace(
+                Cache->Ip4Hdr->HeaderChecksum, Destination, &Address->Ipv4, AddressLength);
+    } else {
+        ASSERT(Cache->Ip6Valid);
+        Destination = &Cache->Ip6Hdr->DestinationAddress;
+        AddressLength = sizeof(IN6_ADDR);
     }
 
-    if (Rule->Match == XDP_MATCH_UDP_PORT_SET) {
+    //
+    // The transport checksums cover the destination address through the
+    // pseudo-header.
+    //
+    if (Cache->UdpValid) {
+        if (Cache->UdpHdr->uh_sum != 0) {
+            UINT16 Checksum =
+                XdpChecksumReplace(Cache->UdpHdr->uh_sum, Destination, Address, AddressLength);
+
+            Cache->UdpHdr->uh_sum = (Checksum != 0) ? Checksum : 0xFFFF;
+        }
+    } else {
+        ASSERT(Cache->TcpValid);
+        Cache->TcpHdr->th_sum =
+            XdpChecksumReplace(Cache->TcpHdr->th_sum, Destination, Address, AddressLength);
+    }
+
+    RtlCopyMemory(Destination, Address, AddressLength);
+}
+
+static
+XDP_RX_ACTION
+XdpInspectLoadBalance(
+    _In_ const XDP_LOAD_BALANCER *LoadBalancer,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *Cache,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *Storage,
+    _Inout_ XDP_PCW_RX_QUEUE *RxQueueStats
+    )
+{
+    const XDP_LOAD_BALANCER_BACKEND *Backend;
+    XDP_EBPF_FLOW_KEY Key;
+    UINT32 Hash;
+
+    if (!Cache->UdpCached) {
+        XdpParseFrame(
+            Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+            Cache, Storage);
+    }
+
+    if (!XdpInspectGetFlowKey(Cache, &Key)) {
+        STAT_INC(RxQueueStats, InspectFramesPassed);
+        return XDP_RX_ACTION_PASS;
+    }
+
+    Hash = XdpProgramHashUpdate(XDP_PROGRAM_HASH_BASIS, &Key, sizeof(Key));
+    Backend =
+        &LoadBalancer->Backends[LoadBalancer->Lookup[Hash % XDP_LOAD_BALANCER_TABLE_SIZE]];
+
+    if (LoadBalancer->Flags & XDP_LOAD_BALANCE_FLAG_REWRITE_IP) {
+        //
+        // Headers parsed into the frame storage span buffers and cannot be
+        // rewritten in place; leave such frames to the local stack.
+        //
+        if (!XdpInspectIsHeaderInFirstBuffer(
+                Frame, VirtualAddressExtension, Cache->UdpHdr,
+                Cache->UdpValid ? sizeof(*Cache->UdpHdr) : sizeof(*Cache->TcpHdr))) {
+            STAT_INC(RxQueueStats, InspectFramesPassed);
+            return XDP_RX_ACTION_PASS;
+        }
+
+        XdpInspectRewriteDestination(Cache, &Backend->IpAddress);
+    }
+
+    Cache->EthHdr->Source = Cache->EthHdr->Destination;
+    RtlCopyMemory(
+        &Cache->EthHdr->Destination, Backend->EthernetAddress,
+        sizeof(Cache->EthHdr->Destination));
+
+    if (Frame->Buffer.DataLength < sizeof(*Cache->EthHdr)) {
+        ASSERT(FragmentRing != NULL);
+        ASSERT(FragmentExtension != NULL);
+        XdpCopyMemoryToFrame(
+            Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension, 0,
+            Cache->EthHdr, sizeof(*Cache->EthHdr));
+    }
+
+    STAT_INC(RxQueueStats, InspectFramesForwarded);
+
+    return XDP_RX_ACTION_TX;
+}
+
+//
+// Returns the live entry tracking a flow, or NULL if there is none.
+//
+static
+XDP_CONNTRACK_ENTRY *
+XdpInspectConntrackLookup(
+    _In_ XDP_CONNTRACK_TABLE *Table,
+    _In_ const XDP_EBPF_FLOW_KEY *Key,
+    _In_ UINT32 Hash
+    )
+{
+    for (UINT32 Probe = 0; Probe < XDP_CONNTRACK_PROBE_LENGTH; Probe++) {
+        XDP_CONNTRACK_ENTRY *Entry = &Table->Entries[(Hash + Probe) & Table->EntryMask];
+        LONG Sequence = ReadAcquire(&Entry->Sequence);
+        BOOLEAN Equal;
+
+        if ((Sequence & 1) != 0 || Entry->Hash != Hash || ReadNoFence64(&Entry->LastSeen) == 0) {
+            continue;
+        }
+
+        Equal = RtlEqualMemory(&Entry->Key, Key, sizeof(*Key));
+
+        //
+        // Order the key comparison before the sequence number is read again.
+        //
+        KeMemoryBarrier();
+
+        if (Equal && ReadNoFence(&Entry->Sequence) == Sequence) {
+            return Entry;
+        }
+    }
+
+    return NULL;
+}
+
+//
+// Records a flow, or refreshes it if it is already tracked. If every entry
+// the flow hashes to is in use, the flow is not tracked.
+//
+static
+VOID
+XdpInspectConntrackTrack(
+    _In_ XDP_CONNTRACK_TABLE *Table,
+    _In_ const XDP_EBPF_FLOW_KEY *Key,
+    _In_ UINT32 Hash
+    )
+{
+    XDP_CONNTRACK_ENTRY *Entry;
+    UINT64 Now = KeQueryInterruptTime();
+
+    Entry = XdpInspectConntrackLookup(Table, Key, Hash);
+    if (Entry != NULL) {
+        //
+        // Refresh coarsely, so processors sending on the same flow rarely
+        // write the shared entry.
+        //
+        if (Now - (UINT64)ReadNoFence64(&Entry->LastSeen) >= XDP_CONNTRACK_REFRESH_INTERVAL) {
+            WriteNoFence64(&Entry->LastSeen, (LONG64)Now);
+        }
+
+        return;
+    }
+
+    for (UINT32 Probe = 0; Probe < XDP_CONNTRACK_PROBE_LENGTH; Probe++) {
+        LONG Sequence;
+
+        Entry = &Table->Entries[(Hash + Probe) & Table->EntryMask];
+        Sequence = ReadAcquire(&Entry->Sequence);
+
+        if ((Sequence & 1) != 0 || ReadNoFence64(&Entry->LastSeen) != 0 ||
+            InterlockedCompareExchange(&Entry->Sequence, Sequence + 1, Sequence) != Sequence) {
+            continue;
+        }
+
+        //
+        // Concurrent senders of a new flow may each claim an entry; the
+        // duplicates are harmless and age out.
+        //
+        Entry->Hash = Hash;
+        Entry->Key = *Key;
+        WriteNoFence64(&Entry->LastSeen, (LONG64)Now);
+        InterlockedIncrement(&Entry->Sequence);
+
+        return;
+    }
+}
+
+//
+// Turns the flow key of a frame into the flow key of frames sent in the
+// opposite direction.
+//
+static
+VOID
+XdpInspectReverseFlowKey(
+    _Inout_ XDP_EBPF_FLOW_KEY *Key
+    )
+{
+    XDP_INET_ADDR Address;
+    UINT16 Port;
+
+    Address = Key->SourceAddress;
+    Key->SourceAddress = Key->DestinationAddress;
+    Key->DestinationAddress = Address;
+    Port = Key->SourcePort;
+    Key->SourcePort = Key->DestinationPort;
+    Key->DestinationPort = Port;
+}
+
+static
+BOOLEAN
+XdpInspectMatchConntrack(
+    _In_ const XDP_RULE *Rule,
+    _In_ const XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    XDP_CONNTRACK_TABLE *Table = Rule->Pattern.Conntrack.Reserved;
+    XDP_EBPF_FLOW_KEY Key;
+
+    if (Table == NULL || !XdpInspectGetFlowKey(FrameCache, &Key)) {
+        return FALSE;
+    }
+
+    if (Rule->Match == XDP_MATCH_CONNTRACK_TRACK) {
+        XdpInspectConntrackTrack(
+            Table, &Key, XdpProgramHashUpdate(XDP_PROGRAM_HASH_BASIS, &Key, sizeof(Key)));
+        return TRUE;
+    }
+
+    //
+    // Established frames flow in the opposite direction of the tracked ones.
+    //
+    XdpInspectReverseFlowKey(&Key);
+
+    return
+        XdpInspectConntrackLookup(
+            Table, &Key, XdpProgramHashUpdate(XDP_PROGRAM_HASH_BASIS, &Key, sizeof(Key))) != NULL;
+}
+
+//
+// SipHash-2-4 (Aumasson and Bernstein), a keyed hash that is cheap for short
+// inputs and hard to predict without the key.
+//
+static
+FORCEINLINE
+VOID
+XdpSipRound(
+    _Inout_updates_(4) UINT64 *V
+    )
+{
+    V[0] += V[1];
+    V[1] = RotateLeft64(V[1], 13);
+    V[1] ^= V[0];
+    V[0] = RotateLeft64(V[0], 32);
+    V[2] += V[3];
+    V[3] = RotateLeft64(V[3], 16);
+    V[3] ^= V[2];
+    V[0] += V[3];
+    V[3] = RotateLeft64(V[3], 21);
+    V[3] ^= V[0];
+    V[2] += V[1];
+    V[1] = RotateLeft64(V[1], 17);
+    V[1] ^= V[2];
+    V[2] = RotateLeft64(V[2], 32);
+}
+
+static
+UINT64
+XdpSipHash24(
+    _In_reads_bytes_(XDP_SYN_COOKIE_KEY_LENGTH) const UINT8 *Key,
+    _In_reads_bytes_(Length) const VOID *Data,
+    _In_ UINT32 Length
+    )
+{
+    const UINT8 *Bytes = Data;
+    UINT64 K0 = *(const UINT64 UNALIGNED *)&Key[0];
+    UINT64 K1 = *(const UINT64 UNALIGNED *)&Key[sizeof(UINT64)];
+    UINT64 V[4];
+    UINT64 Word;
+    UINT32 Offset;
+
+    V[0] = K0 ^ 0x736F6D6570736575ui64;
+    V[1] = K1 ^ 0x646F72616E646F6Dui64;
+    V[2] = K0 ^ 0x6C7967656E657261ui64;
+    V[3] = K1 ^ 0x7465646279746573ui64;
+
+    for (Offset = 0; Offset + sizeof(Word) <= Length; Offset += sizeof(Word)) {
+        Word = *(const UINT64 UNALIGNED *)&Bytes[Offset];
+        V[3] ^= Word;
+        XdpSipRound(V);
+        XdpSipRound(V);
+        V[0] ^= Word;
+    }
+
+    //
+    // The final word holds the remaining bytes and the input length.
+    //
+    Word = (UINT64)Length << 56;
+    for (UINT32 i = 0; Offset + i < Length; i++) {
+        Word |= (UINT64)Bytes[Offset + i] << (i * 8);
+    }
+
+    V[3] ^= Word;
+    XdpSipRound(V);
+    XdpSipRound(V);
+    V[0] ^= Word;
+
+    V[2] ^= 0xFF;
+    XdpSipRound(V);
+    XdpSipRound(V);
+    XdpSipRound(V);
+    XdpSipRound(V);
+
+    return V[0] ^ V[1] ^ V[2] ^ V[3];
+}
+
+//
+// A SYN cookie is the SYN-ACK's initial sequence number: a 5-bit counter of
+// 64 second periods in the top bits, and a keyed hash of the flow, the
+// client's initial sequence number and the period in the remaining bits. A
+// cookie is valid for the period it was issued in and the next one.
+//
+#define XDP_SYN_COOKIE_PERIOD RTL_MILLISEC_TO_100NANOSEC(64 * 1000)
+#define XDP_SYN_COOKIE_PERIOD_SHIFT 27
+#define XDP_SYN_COOKIE_PERIOD_MASK 0x1F
+#define XDP_SYN_COOKIE_HASH_MASK ((1ui32 << XDP_SYN_COOKIE_PERIOD_SHIFT) - 1)
+
+//
+// The receive window and hop limit of SYN-ACKs.
+//
+#define XDP_SYN_COOKIE_WINDOW 65535
+#define XDP_SYN_COOKIE_HOP_LIMIT 64
+
+typedef struct _XDP_SYN_COOKIE_INPUT {
+    XDP_EBPF_FLOW_KEY Key;
+    UINT32 Isn;
+    UINT32 Period;
+} XDP_SYN_COOKIE_INPUT;
+
+static
+UINT32
+XdpSynCookiePeriod(
+    VOID
+    )
+{
+    return (UINT32)(KeQueryInterruptTime() / XDP_SYN_COOKIE_PERIOD) & XDP_SYN_COOKIE_PERIOD_MASK;
+}
+
+//
+// Computes the cookie of a flow, keyed in the client's direction, for a
+// client initial sequence number in host byte order.
+//
+static
+UINT32
+XdpSynCookieCompute(
+    _In_ const XDP_SYN_COOKIE *SynCookie,
+    _In_ const XDP_EBPF_FLOW_KEY *Key,
+    _In_ UINT32 Isn,
+    _In_ UINT32 Period
+    )
+{
+    XDP_SYN_COOKIE_INPUT Input;
+
+    Input.Key = *Key;
+    Input.Isn = Isn;
+    Input.Period = Period;
+
+    return
+        (Period << XDP_SYN_COOKIE_PERIOD_SHIFT) |
+        ((UINT32)XdpSipHash24(SynCookie->Key, &Input, sizeof(Input)) & XDP_SYN_COOKIE_HASH_MASK);
+}
+
+//
+// Returns TRUE if a handshake-completing ACK echoes a valid cookie.
+//
+static
+BOOLEAN
+XdpSynCookieValidate(
+    _In_ const XDP_SYN_COOKIE *SynCookie,
+    _In_ const XDP_EBPF_FLOW_KEY *Key,
+    _In_ const TCP_HDR *TcpHdr
+    )
+{
+    UINT32 Cookie = ntohl(TcpHdr->th_ack) - 1;
+    UINT32 Isn = ntohl(TcpHdr->th_seq) - 1;
+    UINT32 CookiePeriod = Cookie >> XDP_SYN_COOKIE_PERIOD_SHIFT;
+    UINT32 Period = XdpSynCookiePeriod();
+
+    if (CookiePeriod != Period &&
+        CookiePeriod != ((Period - 1) & XDP_SYN_COOKIE_PERIOD_MASK)) {
+        return FALSE;
+    }
+
+    return XdpSynCookieCompute(SynCookie, Key, Isn, CookiePeriod) == Cookie;
+}
+
+//
+// Rewrites a SYN into a SYN-ACK carrying a cookie. Returns FALSE, leaving the
+// frame unmodified, if the frame cannot be rewritten in place: the SYN-ACK is
+// built within the first buffer, so the frame must be a single buffer with
+// room for it, and have no IPv4 options or IPv6 extension headers.
+//
+static
+BOOLEAN
+XdpSynCookieReply(
+    _In_ const XDP_SYN_COOKIE *SynCookie,
+    _In_ const XDP_EBPF_FLOW_KEY *Key,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *Cache
+    )
+{
+    UCHAR *Va;
+    TCP_HDR *TcpHdr = Cache->TcpHdr;
+    TCP_OPT_MSS *MssOption = (TCP_OPT_MSS *)(TcpHdr + 1);
+    const UINT32 TcpLength = sizeof(*TcpHdr) + sizeof(*MssOption);
+    UINT32 TcpOffset;
+    UINT32 Isn;
+    UINT32 Sum;
+    VOID *SourceAddress;
+    VOID *DestinationAddress;
+    UINT32 AddressLength;
+    DL_EUI48 TempDlAddress;
+    UINT8 TempAddress[sizeof(IN6_ADDR)];
+    UINT16 TempPort;
+
+    if (FragmentRing != NULL &&
+        XdpGetFragmentExtension(Frame, FragmentExtension)->FragmentBufferCount > 0) {
+        return FALSE;
+    }
+
+    if (Cache->Ip6Valid && Cache->Ip6Hdr->NextHeader != IPPROTO_TCP) {
+        return FALSE;
+    }
+
+    Va = XdpGetVirtualAddressExtension(&Frame->Buffer, VirtualAddressExtension)->VirtualAddress;
+    TcpOffset = (UINT32)((UCHAR *)TcpHdr - (Va + Frame->Buffer.DataOffset));
+    if (Frame->Buffer.BufferLength - Frame->Buffer.DataOffset < TcpOffset + TcpLength) {
+        return FALSE;
+    }
+
+    Isn = ntohl(TcpHdr->th_seq);
+
+    TempDlAddress = Cache->EthHdr->Destination;
+    Cache->EthHdr->Destination = Cache->EthHdr->Source;
+    Cache->EthHdr->Source = TempDlAddress;
+
+    if (Cache->Ip4Valid) {
+        IPV4_HEADER *Ip4Hdr = Cache->Ip4Hdr;
+
+        SourceAddress = &Ip4Hdr->SourceAddress;
+        DestinationAddress = &Ip4Hdr->DestinationAddress;
+        AddressLength = sizeof(IN_ADDR);
+
+        Ip4Hdr->TotalLength = htons((UINT16)(sizeof(*Ip4Hdr) + TcpLength));
+        Ip4Hdr->TimeToLive = XDP_SYN_COOKIE_HOP_LIMIT;
+    } else {
+        IPV6_HEADER *Ip6Hdr = Cache->Ip6Hdr;
+
+        ASSERT(Cache->Ip6Valid);
+        SourceAddress = &Ip6Hdr->SourceAddress;
+        DestinationAddress = &Ip6Hdr->DestinationAddress;
+        AddressLength = sizeof(IN6_ADDR);
+
+        Ip6Hdr->PayloadLength = htons((UINT16)TcpLength);
+        Ip6Hdr->HopLimit = XDP_SYN_COOKIE_HOP_LIMIT;
+    }
+
+    RtlCopyMemory(TempAddress, DestinationAddress, AddressLength);
+    RtlCopyMemory(DestinationAddress, SourceAddress, AddressLength);
+    RtlCopyMemory(SourceAddress, TempAddress, AddressLength);
+
+    if (Cache->Ip4Valid) {
+        Cache->Ip4Hdr->HeaderChecksum = 0;
+        Cache->Ip4Hdr->HeaderChecksum = XdpChecksumIp4Header(Cache->Ip4Hdr);
+    }
+
+    TempPort = TcpHdr->th_dport;
+    TcpHdr->th_dport = TcpHdr->th_sport;
+    TcpHdr->th_sport = TempPort;
+    TcpHdr->th_seq = htonl(XdpSynCookieCompute(SynCookie, Key, Isn, XdpSynCookiePeriod()));
+    TcpHdr->th_ack = htonl(Isn + 1);
+    TcpHdr->th_x2 = 0;
+    TcpHdr->th_len = (UINT8)(TcpLength / 4);
+    TcpHdr->th_flags = TH_SYN | TH_ACK;
+    TcpHdr->th_win = htons(XDP_SYN_COOKIE_WINDOW);
+    TcpHdr->th_urp = 0;
+    MssOption->Kind = TH_OPT_MSS;
+    MssOption->Length = (UINT8)sizeof(*MssOption);
+    MssOption->Mss = SynCookie->Mss;
+
+    //
+    // The TCP checksum covers a pseudo-header of the addresses, protocol and
+    // TCP length.
+    //
+    TcpHdr->th_sum = 0;
+    Sum = XdpChecksumAdd(0, SourceAddress, AddressLength);
+    Sum = XdpChecksumAdd(Sum, DestinationAddress, AddressLength);
+    Sum += IPPROTO_TCP + TcpLength;
+    Sum = XdpChecksumAdd(Sum, TcpHdr, TcpLength);
+    TcpHdr->th_sum = XdpChecksumFinish(Sum);
+
+    Frame->Buffer.DataLength = TcpOffset + TcpLength;
+
+    return TRUE;
+}
+
+static
+XDP_RX_ACTION
+XdpInspectSynCookie(
+    _In_ const XDP_SYN_COOKIE *SynCookie,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *Cache,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *Storage,
+    _Inout_ XDP_PCW_RX_QUEUE *RxQueueStats
+    )
+{
+    XDP_EBPF_FLOW_KEY Key;
+    XDP_EBPF_FLOW_KEY TrackedKey;
+    UINT32 Hash;
+    UINT8 Flags;
+
+    if (!Cache->UdpCached) {
+        XdpParseFrame(
+            Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+            Cache, Storage);
+    }
+
+    if (!Cache->TcpValid || !XdpInspectGetFlowKey(Cache, &Key)) {
+        STAT_INC(RxQueueStats, InspectFramesPassed);
+        return XDP_RX_ACTION_PASS;
+    }
+
+    Flags = Cache->TcpHdr->th_flags;
+
+    if ((Flags & (TH_SYN | TH_ACK | TH_RST | TH_FIN)) == TH_SYN) {
+        if (!XdpSynCookieReply(
+                SynCookie, &Key, Frame, FragmentRing, FragmentExtension,
+                VirtualAddressExtension, Cache)) {
+            STAT_INC(RxQueueStats, InspectFramesPassed);
+            return XDP_RX_ACTION_PASS;
+        }
+
+        STAT_INC(RxQueueStats, InspectFramesForwarded);
+        return XDP_RX_ACTION_TX;
+    }
+
+    //
+    // Connections are tracked in the direction of the local stack's frames,
+    // as XDP_MATCH_CONNTRACK_TRACK rules on the TX path track them.
+    //
+    TrackedKey = Key;
+    XdpInspectReverseFlowKey(&TrackedKey);
+    Hash = XdpProgramHashUpdate(XDP_PROGRAM_HASH_BASIS, &TrackedKey, sizeof(TrackedKey));
+
+    if ((SynCookie->Conntrack == NULL ||
+            XdpInspectConntrackLookup(SynCookie->Conntrack, &TrackedKey, Hash) == NULL) &&
+        ((Flags & (TH_SYN | TH_ACK | TH_RST)) != TH_ACK ||
+            !XdpSynCookieValidate(SynCookie, &Key, Cache->TcpHdr))) {
+        STAT_INC(RxQueueStats, InspectFramesDropped);
+        STAT_INC(RxQueueStats, InspectDropsRule);
+        XdpRxQueueSampleDrop(RxQueueStats, XdpDropReasonRule, 1, Frame, VirtualAddressExtension);
+
+        return XDP_RX_ACTION_DROP;
+    }
+
+    if (SynCookie->Conntrack != NULL) {
+        XdpInspectConntrackTrack(SynCookie->Conntrack, &TrackedKey, Hash);
+    }
+
+    STAT_INC(RxQueueStats, InspectFramesPassed);
+    return XDP_RX_ACTION_PASS;
+}
+
+static
+VOID
+XdpTupleTableMaskKey(
+    _In_ const XDP_EBPF_FLOW_KEY *Key,
+    _In_ const XDP_EBPF_FLOW_KEY *Mask,
+    _Out_ XDP_EBPF_FLOW_KEY *MaskedKey
+    )
+{
+    const UINT32 *KeyWords = (const UINT32 *)Key;
+    const UINT32 *MaskWords = (const UINT32 *)Mask;
+    UINT32 *MaskedWords = (UINT32 *)MaskedKey;
+
+    C_ASSERT(sizeof(*Key) % sizeof(UINT32) == 0);
+
+    for (UINT32 i = 0; i < sizeof(*Key) / sizeof(UINT32); i++) {
+        MaskedWords[i] = KeyWords[i] & MaskWords[i];
+    }
+}
+
+static
+BOOLEAN
+XdpTupleTableMatch(
+    _In_ const XDP_TUPLE_TABLE *Table,
+    _In_ const XDP_EBPF_FLOW_KEY *Key
+    )
+{
+    for (UINT32 GroupIndex = 0; GroupIndex < Table->GroupCount; GroupIndex++) {
+        const XDP_TUPLE_TABLE_GROUP *Group = &Table->Groups[GroupIndex];
+        const XDP_TUPLE_TABLE_SLOT *Slots = &Table->Slots[Group->SlotOffset];
+        XDP_EBPF_FLOW_KEY MaskedKey;
+        UINT32 Hash;
+
+        XdpTupleTableMaskKey(Key, &Group->Mask, &MaskedKey);
+        Hash = XdpProgramHashUpdate(XDP_PROGRAM_HASH_BASIS, &MaskedKey, sizeof(MaskedKey));
+
+        //
+        // Groups are at most half full, so every probe sequence ends at an
+        // empty slot.
+        //
+        for (UINT32 Probe = Hash & Group->SlotMask;
+            Slots[Probe].Valid;
+            Probe = (Probe + 1) & Group->SlotMask) {
+            if (Slots[Probe].Hash == Hash &&
+                RtlEqualMemory(&Slots[Probe].Key, &MaskedKey, sizeof(MaskedKey))) {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+static
+BOOLEAN
+XdpInspectMatchTupleTable(
+    _In_ const XDP_TUPLE_TABLE *Table,
+    _In_ const XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    XDP_EBPF_FLOW_KEY Key;
+
+    if (Table->AddressLength == sizeof(IN_ADDR) ? !FrameCache->Ip4Valid : !FrameCache->Ip6Valid) {
+        return FALSE;
+    }
+
+    //
+    // The group masks clear the flow key fields that are not part of a
+    // 5-tuple.
+    //
+    if (!XdpInspectGetFlowKey(FrameCache, &Key)) {
+        return FALSE;
+    }
+
+    return XdpTupleTableMatch(Table, &Key);
+}
+
+static
+BOOLEAN
+XdpInspectMatchRule(
+    _In_ const XDP_RULE *Rule,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *FrameStorage,
+    _Out_ XDP_RULE_ACTION *Action
+    )
+{
+    BOOLEAN Matched = FALSE;
+
+    *Action = Rule->Action;
+
+    switch (Rule->Match) {
+    case XDP_MATCH_ALL:
+        Matched = TRUE;
+        break;
+
+    case XDP_MATCH_UDP:
+        if (!FrameCache->UdpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->UdpValid) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_UDP_DST:
+        if (!FrameCache->UdpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->UdpValid &&
+            FrameCache->UdpHdr->uh_dport == Rule->Pattern.Port) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV4_DST_MASK:
+        if (!FrameCache->Ip4Cached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->Ip4Valid &&
+            Ipv4PrefixMatch(
+                &FrameCache->Ip4Hdr->DestinationAddress, &Rule->Pattern.IpMask.Address.Ipv4,
+                &Rule->Pattern.IpMask.Mask.Ipv4)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV6_DST_MASK:
+        if (!FrameCache->Ip6Cached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->Ip6Valid &&
+            Ipv6PrefixMatch(
+                &FrameCache->Ip6Hdr->DestinationAddress,
+                &Rule->Pattern.IpMask.Address.Ipv6,
+                &Rule->Pattern.IpMask.Mask.Ipv6)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_QUIC_FLOW_SRC_CID:
+    case XDP_MATCH_QUIC_FLOW_DST_CID:
+        if (!FrameCache->UdpCached || !FrameCache->TransportPayloadCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+
+        if (!FrameCache->UdpValid || !FrameCache->TransportPayloadValid ||
+            FrameCache->UdpHdr->uh_dport != Rule->Pattern.QuicFlow.UdpPort) {
+            break;
+        }
+
+        if (!FrameCache->QuicCached) {
+            XdpParseQuicHeader(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                &FrameCache->TransportPayload, FrameStorage, FrameCache);
+        }
+
+        if (FrameCache->QuicValid &&
+            QuicCidMatch(
+                Rule->Match,
+                FrameCache,
+                &Rule->Pattern.QuicFlow)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV4_UDP_TUPLE:
+    case XDP_MATCH_IPV6_UDP_TUPLE:
+        if (!FrameCache->UdpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->UdpValid &&
+            UdpTupleMatch(
+                Rule->Match,
+                FrameCache,
+                &Rule->Pattern.Tuple)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV4_TCP_TUPLE:
+    case XDP_MATCH_IPV6_TCP_TUPLE:
+        if (!FrameCache->TcpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->TcpValid &&
+            TcpTupleMatch(
+                Rule->Match,
+                FrameCache,
+                &Rule->Pattern.Tuple)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_UDP_PAYLOAD:
+        if (!FrameCache->UdpCached || !FrameCache->TransportPayloadCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->UdpValid && FrameCache->TransportPayloadValid &&
+            FrameCache->UdpHdr->uh_dport == Rule->Pattern.Payload.Port &&
+            XdpPayloadPatternMatch(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                &FrameCache->TransportPayload, Rule->Pattern.Payload.Reserved, FrameStorage)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_TCP_PAYLOAD:
+        if (!FrameCache->TcpCached || !FrameCache->TransportPayloadCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->TcpValid && FrameCache->TransportPayloadValid &&
+            FrameCache->TcpHdr->th_dport == Rule->Pattern.Payload.Port &&
+            XdpPayloadPatternMatch(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                &FrameCache->TransportPayload, Rule->Pattern.Payload.Reserved, FrameStorage)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_UDP_PORT_SET:
+        if (!FrameCache->UdpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->UdpValid &&
+            XdpTestBit(Rule->Pattern.PortSet.PortSet, FrameCache->UdpHdr->uh_dport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV4_UDP_PORT_SET:
+        if (!FrameCache->UdpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->Ip4Valid &&
+            IN4_ADDR_EQUAL(
+                &FrameCache->Ip4Hdr->DestinationAddress,
+                &Rule->Pattern.IpPortSet.Address.Ipv4) &&
+            FrameCache->UdpValid &&
+            XdpTestBit(Rule->Pattern.IpPortSet.PortSet.PortSet, FrameCache->UdpHdr->uh_dport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV6_UDP_PORT_SET:
+        if (!FrameCache->UdpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->Ip6Valid &&
+            IN6_ADDR_EQUAL(
+                &FrameCache->Ip6Hdr->DestinationAddress,
+                &Rule->Pattern.IpPortSet.Address.Ipv6) &&
+            FrameCache->UdpValid &&
+            XdpTestBit(Rule->Pattern.IpPortSet.PortSet.PortSet, FrameCache->UdpHdr->uh_dport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV4_TCP_PORT_SET:
+        if (!FrameCache->TcpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->Ip4Valid &&
+            IN4_ADDR_EQUAL(
+                &FrameCache->Ip4Hdr->DestinationAddress,
+                &Rule->Pattern.IpPortSet.Address.Ipv4) &&
+            FrameCache->TcpValid &&
+            XdpTestBit(Rule->Pattern.IpPortSet.PortSet.PortSet, FrameCache->TcpHdr->th_dport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV6_TCP_PORT_SET:
+        if (!FrameCache->TcpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->Ip6Valid &&
+            IN6_ADDR_EQUAL(
+                &FrameCache->Ip6Hdr->DestinationAddress,
+                &Rule->Pattern.IpPortSet.Address.Ipv6) &&
+            FrameCache->TcpValid &&
+            XdpTestBit(Rule->Pattern.IpPortSet.PortSet.PortSet, FrameCache->TcpHdr->th_dport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_TCP_DST:
+        if (!FrameCache->TcpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->TcpValid &&
+            FrameCache->TcpHdr->th_dport == Rule->Pattern.Port) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_TCP_QUIC_FLOW_SRC_CID:
+    case XDP_MATCH_TCP_QUIC_FLOW_DST_CID:
+        if (!FrameCache->TcpCached || !FrameCache->TransportPayloadCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+
+        if (!FrameCache->TcpValid || !FrameCache->TransportPayloadValid ||
+            FrameCache->TcpHdr->th_dport != Rule->Pattern.QuicFlow.UdpPort) {
+            break;
+        }
+
+        if (!FrameCache->QuicCached) {
+            XdpParseQuicHeader(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                &FrameCache->TransportPayload, FrameStorage, FrameCache);
+        }
+
+        if (FrameCache->QuicValid &&
+            QuicCidMatch(
+                Rule->Match,
+                FrameCache,
+                &Rule->Pattern.QuicFlow)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_TCP_CONTROL_DST:
+        if (!FrameCache->TcpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->TcpValid &&
+            FrameCache->TcpHdr->th_dport == Rule->Pattern.Port &&
+            (FrameCache->TcpHdr->th_flags & (TH_SYN | TH_FIN | TH_RST)) != 0) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV4_DST_LPM:
+        if (!FrameCache->Ip4Cached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->Ip4Valid &&
+            XdpLpmMatch(
+                Rule->Pattern.PrefixTable.Reserved,
+                (const UINT8 *)&FrameCache->Ip4Hdr->DestinationAddress, Action)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV6_DST_LPM:
+        if (!FrameCache->Ip6Cached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->Ip6Valid &&
+            XdpLpmMatch(
+                Rule->Pattern.PrefixTable.Reserved,
+                (const UINT8 *)&FrameCache->Ip6Hdr->DestinationAddress, Action)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_UDP_PORT_RANGE:
+        if (!FrameCache->UdpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->UdpValid &&
+            XdpPortRangeMatch(
+                Rule->Pattern.PortRanges.Reserved, FrameCache->UdpHdr->uh_dport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV4_UDP_PORT_RANGE:
+        if (!FrameCache->UdpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->Ip4Valid &&
+            IN4_ADDR_EQUAL(
+                &FrameCache->Ip4Hdr->DestinationAddress,
+                &Rule->Pattern.IpPortRanges.Address.Ipv4) &&
+            FrameCache->UdpValid &&
+            XdpPortRangeMatch(
+                Rule->Pattern.IpPortRanges.PortRanges.Reserved, FrameCache->UdpHdr->uh_dport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV6_UDP_PORT_RANGE:
+        if (!FrameCache->UdpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->Ip6Valid &&
+            IN6_ADDR_EQUAL(
+                &FrameCache->Ip6Hdr->DestinationAddress,
+                &Rule->Pattern.IpPortRanges.Address.Ipv6) &&
+            FrameCache->UdpValid &&
+            XdpPortRangeMatch(
+                Rule->Pattern.IpPortRanges.PortRanges.Reserved, FrameCache->UdpHdr->uh_dport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV4_TCP_PORT_RANGE:
+        if (!FrameCache->TcpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->Ip4Valid &&
+            IN4_ADDR_EQUAL(
+                &FrameCache->Ip4Hdr->DestinationAddress,
+                &Rule->Pattern.IpPortRanges.Address.Ipv4) &&
+            FrameCache->TcpValid &&
+            XdpPortRangeMatch(
+                Rule->Pattern.IpPortRanges.PortRanges.Reserved, FrameCache->TcpHdr->th_dport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV6_TCP_PORT_RANGE:
+        if (!FrameCache->TcpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->Ip6Valid &&
+            IN6_ADDR_EQUAL(
+                &FrameCache->Ip6Hdr->DestinationAddress,
+                &Rule->Pattern.IpPortRanges.Address.Ipv6) &&
+            FrameCache->TcpValid &&
+            XdpPortRangeMatch(
+                Rule->Pattern.IpPortRanges.PortRanges.Reserved, FrameCache->TcpHdr->th_dport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_VLAN_ID:
+        if (!FrameCache->EthCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->VlanValid && FrameCache->VlanId == Rule->Pattern.VlanId) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_CONNTRACK_TRACK:
+    case XDP_MATCH_CONNTRACK_ESTABLISHED:
+        if (!FrameCache->UdpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        Matched = XdpInspectMatchConntrack(Rule, FrameCache);
+        break;
+
+    case XDP_MATCH_IPV4_SRC_LPM:
+        if (!FrameCache->Ip4Cached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->Ip4Valid &&
+            XdpLpmMatch(
+                Rule->Pattern.PrefixTable.Reserved,
+                (const UINT8 *)&FrameCache->Ip4Hdr->SourceAddress, Action)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV6_SRC_LPM:
+        if (!FrameCache->Ip6Cached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (FrameCache->Ip6Valid &&
+            XdpLpmMatch(
+                Rule->Pattern.PrefixTable.Reserved,
+                (const UINT8 *)&FrameCache->Ip6Hdr->SourceAddress, Action)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV4_MASKED_TUPLE:
+    case XDP_MATCH_IPV6_MASKED_TUPLE:
+        if (!FrameCache->UdpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        Matched = XdpInspectMatchTupleTable(Rule->Pattern.TupleSet.Reserved, FrameCache);
+        break;
+
+    case XDP_MATCH_TUNNEL:
+        Matched =
+            XdpParseTunnel(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                &Rule->Pattern.Tunnel, FrameCache, FrameStorage);
+        break;
+
+    case XDP_MATCH_TUNNEL_IPV4_MASKED_TUPLE:
+    case XDP_MATCH_TUNNEL_IPV6_MASKED_TUPLE:
+        if (XdpParseTunnel(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                &Rule->Pattern.TunnelTupleSet.Tunnel, FrameCache, FrameStorage)) {
+            Matched =
+                XdpInspectMatchTupleTable(
+                    Rule->Pattern.TunnelTupleSet.TupleSet.Reserved, FrameCache->Inner);
+        }
+        break;
+
+    default:
+        ASSERT(FALSE);
+        break;
+    }
+
+    return Matched;
+}
+
+static
+UINT32
+XdpProgramHashTuple(
+    _In_reads_bytes_(AddressLength) const VOID *SourceAddress,
+    _In_reads_bytes_(AddressLength) const VOID *DestinationAddress,
+    _In_ UINT32 AddressLength,
+    _In_ UINT16 SourcePort,
+    _In_ UINT16 DestinationPort
+    )
+{
+    UINT32 Hash = XDP_PROGRAM_HASH_BASIS;
+
+    Hash = XdpProgramHashUpdate(Hash, SourceAddress, AddressLength);
+    Hash = XdpProgramHashUpdate(Hash, DestinationAddress, AddressLength);
+    Hash = XdpProgramHashUpdate(Hash, &SourcePort, sizeof(SourcePort));
+    Hash = XdpProgramHashUpdate(Hash, &DestinationPort, sizeof(DestinationPort));
+
+    return Hash;
+}
+
+static
+BOOLEAN
+XdpProgramIsQuicFlowMatch(
+    _In_ XDP_MATCH_TYPE Match
+    )
+{
+    return
+        Match == XDP_MATCH_QUIC_FLOW_SRC_CID || Match == XDP_MATCH_QUIC_FLOW_DST_CID ||
+        Match == XDP_MATCH_TCP_QUIC_FLOW_SRC_CID || Match == XDP_MATCH_TCP_QUIC_FLOW_DST_CID;
+}
+
+static
+_Success_(return != FALSE)
+BOOLEAN
+XdpInspectHashFrame(
+    _In_ const XDP_RULE *SegmentRule,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *FrameStorage,
+    _Out_ UINT32 *Hash
+    )
+{
+    const XDP_QUIC_FLOW *Flow = &SegmentRule->Pattern.QuicFlow;
+
+    //
+    // Compute the hash of the frame's key for an indexed segment. All rules in
+    // the segment share the match type and, for QUIC flows, the port and CID
+    // window, so any frame failing these checks cannot match any of the rules.
+    //
+
+    switch (SegmentRule->Match) {
+    case XDP_MATCH_UDP_DST:
+        if (!FrameCache->UdpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (!FrameCache->UdpValid) {
+            return FALSE;
+        }
+        *Hash =
+            XdpProgramHashUpdate(
+                XDP_PROGRAM_HASH_BASIS, &FrameCache->UdpHdr->uh_dport,
+                sizeof(FrameCache->UdpHdr->uh_dport));
+        return TRUE;
+
+    case XDP_MATCH_TCP_DST:
+        if (!FrameCache->TcpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (!FrameCache->TcpValid) {
+            return FALSE;
+        }
+        *Hash =
+            XdpProgramHashUpdate(
+                XDP_PROGRAM_HASH_BASIS, &FrameCache->TcpHdr->th_dport,
+                sizeof(FrameCache->TcpHdr->th_dport));
+        return TRUE;
+
+    case XDP_MATCH_IPV4_UDP_TUPLE:
+        if (!FrameCache->UdpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (!FrameCache->UdpValid || !FrameCache->Ip4Valid) {
+            return FALSE;
+        }
+        *Hash =
+            XdpProgramHashTuple(
+                &FrameCache->Ip4Hdr->SourceAddress, &FrameCache->Ip4Hdr->DestinationAddress,
+                sizeof(IN_ADDR), FrameCache->UdpHdr->uh_sport, FrameCache->UdpHdr->uh_dport);
+        return TRUE;
+
+    case XDP_MATCH_IPV6_UDP_TUPLE:
+        if (!FrameCache->UdpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (!FrameCache->UdpValid || !FrameCache->Ip6Valid) {
+            return FALSE;
+        }
+        *Hash =
+            XdpProgramHashTuple(
+                &FrameCache->Ip6Hdr->SourceAddress, &FrameCache->Ip6Hdr->DestinationAddress,
+                sizeof(IN6_ADDR), FrameCache->UdpHdr->uh_sport, FrameCache->UdpHdr->uh_dport);
+        return TRUE;
+
+    case XDP_MATCH_IPV4_TCP_TUPLE:
+        if (!FrameCache->TcpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (!FrameCache->TcpValid || !FrameCache->Ip4Valid) {
+            return FALSE;
+        }
+        *Hash =
+            XdpProgramHashTuple(
+                &FrameCache->Ip4Hdr->SourceAddress, &FrameCache->Ip4Hdr->DestinationAddress,
+                sizeof(IN_ADDR), FrameCache->TcpHdr->th_sport, FrameCache->TcpHdr->th_dport);
+        return TRUE;
+
+    case XDP_MATCH_IPV6_TCP_TUPLE:
+        if (!FrameCache->TcpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (!FrameCache->TcpValid || !FrameCache->Ip6Valid) {
+            return FALSE;
+        }
+        *Hash =
+            XdpProgramHashTuple(
+                &FrameCache->Ip6Hdr->SourceAddress, &FrameCache->Ip6Hdr->DestinationAddress,
+                sizeof(IN6_ADDR), FrameCache->TcpHdr->th_sport, FrameCache->TcpHdr->th_dport);
+        return TRUE;
+
+    case XDP_MATCH_QUIC_FLOW_SRC_CID:
+    case XDP_MATCH_QUIC_FLOW_DST_CID:
+        if (!FrameCache->UdpCached || !FrameCache->TransportPayloadCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (!FrameCache->UdpValid || !FrameCache->TransportPayloadValid ||
+            FrameCache->UdpHdr->uh_dport != Flow->UdpPort) {
+            return FALSE;
+        }
+        break;
+
+    case XDP_MATCH_TCP_QUIC_FLOW_SRC_CID:
+    case XDP_MATCH_TCP_QUIC_FLOW_DST_CID:
+        if (!FrameCache->TcpCached || !FrameCache->TransportPayloadCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, FrameStorage);
+        }
+        if (!FrameCache->TcpValid || !FrameCache->TransportPayloadValid ||
+            FrameCache->TcpHdr->th_dport != Flow->UdpPort) {
+            return FALSE;
+        }
+        break;
+
+    default:
+        ASSERT(FALSE);
+        return FALSE;
+    }
+
+    //
+    // QUIC flows: hash the CID window shared by the segment.
+    //
+
+    if (!FrameCache->QuicCached) {
+        XdpParseQuicHeader(
+            Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+            &FrameCache->TransportPayload, FrameStorage, FrameCache);
+    }
+
+    if (!FrameCache->QuicValid) {
+        return FALSE;
+    }
+
+    if ((SegmentRule->Match == XDP_MATCH_QUIC_FLOW_SRC_CID ||
+         SegmentRule->Match == XDP_MATCH_TCP_QUIC_FLOW_SRC_CID) !=
+        (FrameCache->QuicIsLongHeader == 1)) {
+        return FALSE;
+    }
+
+    if (FrameCache->QuicCidLength < Flow->CidOffset + Flow->CidLength) {
+        return FALSE;
+    }
+
+    *Hash =
+        XdpProgramHashUpdate(
+            XDP_PROGRAM_HASH_BASIS, &FrameCache->QuicCid[Flow->CidOffset], Flow->CidLength);
+    return TRUE;
+}
+
+static
+VOID
+XdpInspectCountRuleHit(
+    _In_ const XDP_PROGRAM_RULE_COUNTER *RuleCounter,
+    _In_ UINT32 HitCount
+    )
+{
+    XDP_RULE_HIT_COUNTER *Counter;
+
+    if (RuleCounter->Counter == NULL) {
+        return;
+    }
+
+    //
+    // Each processor owns a cache-aligned slice of counters, so no interlocked
+    // operations are needed. If the data path runs below DISPATCH_LEVEL, a
+    // thread migration may rarely lose an increment.
+    //
+    Counter =
+        (XDP_RULE_HIT_COUNTER *)
+            ((UCHAR *)RuleCounter->Counter +
+                RuleCounter->ProcessorStride * KeGetCurrentProcessorIndex());
+    Counter->Hits += HitCount;
+    Counter->LastHitTime = KeQueryInterruptTime();
+}
+
+static
+XDP_RULE *
+XdpInspectLookupRule(
+    _In_ XDP_PROGRAM *Program,
+    _In_ const XDP_PROGRAM_RULE_SEGMENT *Segment,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *FrameStorage,
+    _Out_ XDP_RULE_ACTION *Action
+    )
+{
+    const UINT32 *HashSlots = &Program->HashSlots[Segment->HashSlotOffset];
+    const XDP_RULE *SegmentRule = &Program->Rules[Segment->StartIndex];
+    UINT32 Hash;
+    UINT32 Slot;
+
+    if (!XdpInspectHashFrame(
+            SegmentRule, Frame, FragmentRing, FragmentExtension, FragmentIndex,
+            VirtualAddressExtension, FrameCache, FrameStorage, &Hash)) {
+        return NULL;
+    }
+
+    if (XdpProgramIsQuicFlowMatch(SegmentRule->Match)) {
+        const XDP_QUIC_FLOW *Flow = &SegmentRule->Pattern.QuicFlow;
+        const UINT8 *FrameCid = &FrameCache->QuicCid[Flow->CidOffset];
+
+        //
+        // Hashing the frame already checked the port, header form and CID
+        // window shared by every rule in the segment, so only the CIDs remain
+        // to be compared.
+        //
+        for (Slot = Hash & Segment->HashSlotMask;
+            HashSlots[Slot] != XDP_PROGRAM_HASH_SLOT_EMPTY;
+            Slot = (Slot + 1) & Segment->HashSlotMask) {
+            XDP_RULE *Rule = &Program->Rules[HashSlots[Slot]];
+
+            if (XdpQuicCidEqual(FrameCid, Rule->Pattern.QuicFlow.CidData, Flow->CidLength)) {
+                *Action = Rule->Action;
+                return Rule;
+            }
+        }
+
+        return NULL;
+    }
+
+    //
+    // Rules are inserted in order with linear probing, so the first matching
+    // rule found along the probe sequence is the first matching rule within
+    // the segment.
+    //
+    for (Slot = Hash & Segment->HashSlotMask;
+        HashSlots[Slot] != XDP_PROGRAM_HASH_SLOT_EMPTY;
+        Slot = (Slot + 1) & Segment->HashSlotMask) {
+        XDP_RULE *Rule = &Program->Rules[HashSlots[Slot]];
+
+        if (XdpInspectMatchRule(
+                Rule, Frame, FragmentRing, FragmentExtension, FragmentIndex,
+                VirtualAddressExtension, FrameCache, FrameStorage, Action)) {
+            return Rule;
+        }
+    }
+
+    return NULL;
+}
+
+//
+// Hashes the flow tuple of a parsed frame, so every frame of a flow maps to the
+// same socket. Frames without an IP header all hash to zero.
+//
+static
+UINT32
+XdpInspectHashFlow(
+    _In_ const XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    UINT32 Hash = 0;
+    UINT16 SourcePort = 0;
+    UINT16 DestinationPort = 0;
+
+    if (FrameCache->UdpValid) {
+        SourcePort = FrameCache->UdpHdr->uh_sport;
+        DestinationPort = FrameCache->UdpHdr->uh_dport;
+    } else if (FrameCache->TcpValid) {
+        SourcePort = FrameCache->TcpHdr->th_sport;
+        DestinationPort = FrameCache->TcpHdr->th_dport;
+    }
+
+    if (FrameCache->Ip4Valid) {
+        Hash =
+            XdpProgramHashTuple(
+                &FrameCache->Ip4Hdr->SourceAddress, &FrameCache->Ip4Hdr->DestinationAddress,
+                sizeof(IN_ADDR), SourcePort, DestinationPort);
+    } else if (FrameCache->Ip6Valid) {
+        Hash =
+            XdpProgramHashTuple(
+                &FrameCache->Ip6Hdr->SourceAddress, &FrameCache->Ip6Hdr->DestinationAddress,
+                sizeof(IN6_ADDR), SourcePort, DestinationPort);
+    }
+
+    return Hash;
+}
+
+static
+HANDLE
+XdpInspectSelectXsk(
+    _In_ const XDP_XSK_MAP_TABLE *XskMap,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *FrameStorage
+    )
+{
+    if (!FrameCache->EthCached) {
+        XdpParseFrame(
+            Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+            FrameCache, FrameStorage);
+    }
+
+    //
+    // Scale the hash onto the socket count with a multiply rather than a
+    // division.
+    //
+    return XskMap->Sockets[((UINT64)XdpInspectHashFlow(FrameCache) * XskMap->SocketCount) >> 32];
+}
+
+//
+// Returns the socket of the server whose ID is encoded in a QUIC destination
+// CID, or NULL if the CID is not routable by the configuration.
+//
+static
+HANDLE
+XdpInspectLookupQuicLbServer(
+    _In_ const XDP_QUIC_LB_TABLE *QuicLb,
+    _In_reads_bytes_(CidLength) const UINT8 *Cid,
+    _In_ UINT32 CidLength
+    )
+{
+    UINT8 Plaintext[XDP_QUIC_LB_KEY_LENGTH];
+    const UINT8 *ServerId;
+    UINT32 Slot;
+
+    //
+    // The first byte carries the configuration ID in its three most
+    // significant bits, and the server ID follows.
+    //
+    if (CidLength == 0 || (Cid[0] >> 5) != QuicLb->ConfigId) {
+        return NULL;
+    }
+
+    if (QuicLb->Key != NULL) {
+        ULONG Result;
+
+        //
+        // Single-pass encryption: the server ID and nonce form exactly one
+        // AES block.
+        //
+        if (CidLength < 1 + sizeof(Plaintext) ||
+            !NT_SUCCESS(BCryptDecrypt(
+                QuicLb->Key, (UCHAR *)&Cid[1], sizeof(Plaintext), NULL, NULL, 0, Plaintext,
+                sizeof(Plaintext), &Result, 0))) {
+            return NULL;
+        }
+
+        ServerId = Plaintext;
+    } else {
+        if (CidLength < 1 + (UINT32)QuicLb->ServerIdLength) {
+            return NULL;
+        }
+
+        ServerId = &Cid[1];
+    }
+
+    for (Slot =
+            XdpProgramHashUpdate(XDP_PROGRAM_HASH_BASIS, ServerId, QuicLb->ServerIdLength) &
+                QuicLb->SlotMask;
+        QuicLb->Slots[Slot] != XDP_QUIC_LB_SLOT_EMPTY;
+        Slot = (Slot + 1) & QuicLb->SlotMask) {
+        const XDP_QUIC_LB_TABLE_SERVER *Server = &QuicLb->Servers[QuicLb->Slots[Slot]];
+
+        if (RtlEqualMemory(Server->ServerId, ServerId, QuicLb->ServerIdLength)) {
+            return Server->Socket;
+        }
+    }
+
+    return NULL;
+}
+
+static
+HANDLE
+XdpInspectSelectQuicLbXsk(
+    _In_ const XDP_QUIC_LB_TABLE *QuicLb,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *FrameStorage
+    )
+{
+    HANDLE Socket = NULL;
+
+    if (!FrameCache->UdpCached || !FrameCache->TransportPayloadCached) {
+        XdpParseFrame(
+            Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+            FrameCache, FrameStorage);
+    }
+
+    if (FrameCache->UdpValid && FrameCache->TransportPayloadValid) {
+        if (!FrameCache->QuicCached) {
+            XdpParseQuicHeader(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                &FrameCache->TransportPayload, FrameStorage, FrameCache);
+        }
+
+        if (FrameCache->QuicValid) {
+            Socket =
+                XdpInspectLookupQuicLbServer(
+                    QuicLb, FrameCache->QuicDestCid, FrameCache->QuicDestCidLength);
+        }
+    }
+
+    //
+    // Connection IDs chosen by clients, such as those of Initial packets, are
+    // not routable: steer their flows consistently across the servers, whose
+    // replies then carry routable connection IDs.
+    //
+    if (Socket == NULL) {
+        Socket =
+            QuicLb->Servers[
+                ((UINT64)XdpInspectHashFlow(FrameCache) * QuicLb->ServerCount) >> 32].Socket;
+    }
+
+    return Socket;
+}
+
+//
+// The frame inspection shared by XdpInspect and the batch routines
+// instantiated for specific extension layouts.
+//
+static
+VOID
+XdpInspectRedirect(
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_REDIRECT_TARGET_TYPE TargetType,
+    _In_ VOID *Target,
+    _In_ XDP_FRAME *Frame,
+    _In_ UINT32 FrameIndex,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    if (TargetType == XDP_REDIRECT_TARGET_TYPE_XSK_MAP) {
+        XdpRedirect(
+            &InspectionContext->RedirectContext, FrameIndex, FragmentIndex, 0,
+            XDP_REDIRECT_TARGET_TYPE_XSK,
+            XdpInspectSelectXsk(
+                Target, Frame, FragmentRing, FragmentExtension, FragmentIndex,
+                VirtualAddressExtension, FrameCache, &InspectionContext->FrameStorage));
+    } else if (TargetType == XDP_REDIRECT_TARGET_TYPE_QUIC_LB) {
+        XdpRedirect(
+            &InspectionContext->RedirectContext, FrameIndex, FragmentIndex, 0,
+            XDP_REDIRECT_TARGET_TYPE_XSK,
+            XdpInspectSelectQuicLbXsk(
+                Target, Frame, FragmentRing, FragmentExtension, FragmentIndex,
+                VirtualAddressExtension, FrameCache, &InspectionContext->FrameStorage));
+    } else {
+        XdpRedirect(
+            &InspectionContext->RedirectContext, FrameIndex, FragmentIndex, 0, TargetType,
+            Target);
+    }
+}
+
+static
+FORCEINLINE
+BOOLEAN
+XdpInspectShouldSample(
+    _Inout_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ UINT32 Rate
+    )
+{
+    UINT32 Seed = InspectionContext->SampleSeed;
+
+    if (Rate == 1) {
+        return TRUE;
+    }
+
+    //
+    // Advance a per-queue xorshift generator rather than counting frames per
+    // rule: compiled programs may be shared by several RX queues, and rules
+    // with different rates still sample independently.
+    //
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 17;
+    Seed ^= Seed << 5;
+    InspectionContext->SampleSeed = Seed;
+
+    return (((UINT64)Seed * Rate) >> 32) == 0;
+}
+
+//
+// Returns the frame's length, including all of its fragment buffers.
+//
+static
+UINT32
+XdpInspectGetFrameLength(
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex
+    )
+{
+    UINT32 FrameLength = Frame->Buffer.DataLength;
+    UINT32 FragmentCount;
+
+    if (FragmentRing == NULL) {
+        return FrameLength;
+    }
+
+    ASSERT(FragmentExtension != NULL);
+    FragmentCount = XdpGetFragmentExtension(Frame, FragmentExtension)->FragmentBufferCount;
+
+    while (FragmentCount-- > 0) {
+        XDP_BUFFER *Buffer = XdpRingGetElement(FragmentRing, FragmentIndex);
+
+        FrameLength += Buffer->DataLength;
+        FragmentIndex = (FragmentIndex + 1) & FragmentRing->Mask;
+    }
+
+    return FrameLength;
+}
+
+//
+// Charges a frame to the current processor's token buckets. Returns FALSE if
+// the frame exceeds either rate.
+//
+static
+BOOLEAN
+XdpInspectPolice(
+    _In_ XDP_POLICER *Policer,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex
+    )
+{
+    XDP_POLICER_BUCKET *Bucket;
+    UINT64 Now = KeQueryInterruptTime();
+    UINT64 Elapsed;
+    UINT64 PacketCost = 0;
+    UINT64 ByteCost = 0;
+    UINT32 ProcessorIndex = KeGetCurrentProcessorIndex();
+
+    ASSERT(ProcessorIndex < Policer->BucketCount);
+    Bucket = &Policer->Buckets[ProcessorIndex];
+
+    //
+    // Refill the buckets for the elapsed time. Each bucket holds at most one
+    // second's worth of tokens, which bounds the burst size.
+    //
+    Elapsed = min(Now - Bucket->LastRefillTime, XDP_POLICER_TICKS_PER_SECOND);
+    if (Elapsed > 0) {
+        Bucket->LastRefillTime = Now;
+        Bucket->PacketTokens =
+            min(Bucket->PacketTokens + Elapsed * Policer->PacketsPerSecond,
+                XDP_POLICER_TICKS_PER_SECOND * Policer->PacketsPerSecond);
+        Bucket->ByteTokens =
+            min(Bucket->ByteTokens + Elapsed * Policer->BytesPerSecond,
+                XDP_POLICER_TICKS_PER_SECOND * Policer->BytesPerSecond);
+    }
+
+    if (Policer->PacketsPerSecond != 0) {
+        PacketCost = XDP_POLICER_TICKS_PER_SECOND;
+    }
+
+    if (Policer->BytesPerSecond != 0) {
+        ByteCost =
+            XDP_POLICER_TICKS_PER_SECOND *
+                XdpInspectGetFrameLength(Frame, FragmentRing, FragmentExtension, FragmentIndex);
+    }
+
+    if (Bucket->PacketTokens < PacketCost || Bucket->ByteTokens < ByteCost) {
+        return FALSE;
+    }
+
+    Bucket->PacketTokens -= PacketCost;
+    Bucket->ByteTokens -= ByteCost;
+
+    return TRUE;
+}
+
+//
+// Prepends the outer headers to a frame, in place of its Ethernet header if the
+// encapsulation carries IP packets. Returns FALSE if the frame cannot be
+// encapsulated.
+//
+static
+BOOLEAN
+XdpInspectEncap(
+    _In_ const XDP_ENCAPSULATOR *Encapsulator,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *Cache,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *Storage
+    )
+{
+    UCHAR *Va;
+    UINT8 *Outer;
+    UINT32 InnerOffset = 0;
+    UINT32 OuterLength;
+    UINT32 Hash;
+    UINT16 InnerEthType;
+    BOOLEAN InnerIp4;
+    XDP_EBPF_FLOW_KEY Key;
+
+    if (!Cache->UdpCached) {
+        XdpParseFrame(
+            Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+            Cache, Storage);
+    }
+
+    if (!Cache->EthValid) {
+        return FALSE;
+    }
+
+    Va = XdpGetVirtualAddressExtension(&Frame->Buffer, VirtualAddressExtension)->VirtualAddress;
+
+    if (Encapsulator->ReplaceInnerEthernet) {
+        //
+        // The outer headers overwrite the inner Ethernet header and any VLAN
+        // tags, so the inner IP header must start in the first buffer.
+        //
+        if ((!Cache->Ip4Valid && !Cache->Ip6Valid) ||
+            !XdpInspectIsHeaderInFirstBuffer(
+                Frame, VirtualAddressExtension, Cache->Ip4Hdr, sizeof(*Cache->Ip4Hdr))) {
+            return FALSE;
+        }
+
+        InnerOffset = (UINT32)((UCHAR *)Cache->Ip4Hdr - (Va + Frame->Buffer.DataOffset));
+    }
+
+    if (Frame->Buffer.DataOffset + InnerOffset < Encapsulator->HeaderLength) {
+        return FALSE;
+    }
+
+    OuterLength =
+        Encapsulator->HeaderLength - InnerOffset +
+        XdpInspectGetFrameLength(Frame, FragmentRing, FragmentExtension, FragmentIndex);
+    if (OuterLength - sizeof(ETHERNET_HEADER) > MAXUINT16) {
+        return FALSE;
+    }
+
+    //
+    // Read everything needed from the inner headers before the outer headers
+    // overwrite them.
+    //
+    if (XdpInspectGetFlowKey(Cache, &Key)) {
+        Hash = XdpProgramHashUpdate(XDP_PROGRAM_HASH_BASIS, &Key, sizeof(Key));
+    } else {
+        Hash =
+            XdpProgramHashUpdate(
+                XDP_PROGRAM_HASH_BASIS, Cache->EthHdr, FIELD_OFFSET(ETHERNET_HEADER, Type));
+    }
+    InnerEthType = Cache->EthType;
+    InnerIp4 = Cache->Ip4Valid;
+
+    Frame->Buffer.DataOffset -= Encapsulator->HeaderLength - InnerOffset;
+    Frame->Buffer.DataLength += Encapsulator->HeaderLength - InnerOffset;
+    Outer = Va + Frame->Buffer.DataOffset;
+    RtlCopyMemory(Outer, Encapsulator->Header, Encapsulator->HeaderLength);
+
+    if (Encapsulator->Ipv6) {
+        IPV6_HEADER *Ip6Hdr = (IPV6_HEADER *)&Outer[sizeof(ETHERNET_HEADER)];
+
+        Ip6Hdr->PayloadLength =
+            htons((UINT16)(OuterLength - sizeof(ETHERNET_HEADER) - sizeof(*Ip6Hdr)));
+
+        //
+        // The flow label is the low 20 bits of the first word (RFC 6438).
+        //
+        Ip6Hdr->VersionClassFlow =
+            (Ip6Hdr->VersionClassFlow & htonl(~0xFFFFFui32)) | htonl(Hash & 0xFFFFF);
+
+        if (Encapsulator->Type == XDP_ENCAP_TYPE_IP_IN_IP) {
+            Ip6Hdr->NextHeader = InnerIp4 ? IPPROTO_IPV4 : IPPROTO_IPV6;
+        }
+    } else {
+        IPV4_HEADER *Ip4Hdr = (IPV4_HEADER *)&Outer[sizeof(ETHERNET_HEADER)];
+
+        Ip4Hdr->TotalLength = htons((UINT16)(OuterLength - sizeof(ETHERNET_HEADER)));
+
+        if (Encapsulator->Type == XDP_ENCAP_TYPE_IP_IN_IP) {
+            Ip4Hdr->Protocol = InnerIp4 ? IPPROTO_IPV4 : IPPROTO_IPV6;
+        }
+
+        Ip4Hdr->HeaderChecksum = 0;
+        Ip4Hdr->HeaderChecksum = XdpChecksumIp4Header(Ip4Hdr);
+    }
+
+    switch (Encapsulator->Type) {
+    case XDP_ENCAP_TYPE_VXLAN:
+    {
+        UDP_HDR *UdpHdr = (UDP_HDR *)&Outer[Encapsulator->TransportOffset];
+
+        //
+        // Spread flows over the dynamic port range (RFC 7348) so the underlay
+        // can balance them. The outer UDP checksum is not used.
+        //
+        UdpHdr->uh_sport = htons((UINT16)(0xC000 | (Hash & 0x3FFF)));
+        UdpHdr->uh_ulen = htons((UINT16)(OuterLength - Encapsulator->TransportOffset));
+        UdpHdr->uh_sum = 0;
+        break;
+    }
+
+    case XDP_ENCAP_TYPE_GRE:
+        if (Encapsulator->ReplaceInnerEthernet) {
+            ((XDP_GRE_HEADER *)&Outer[Encapsulator->TransportOffset])->ProtocolType =
+                InnerEthType;
+        }
+        break;
+
+    default:
+        ASSERT(Encapsulator->Type == XDP_ENCAP_TYPE_IP_IN_IP);
+        break;
+    }
+
+    return TRUE;
+}
+
+//
+// Returns the fragment verdict cache entry of a fragmented IP packet. Later
+// fragments carry no transport header, so they are given the verdict of the
+// packet's first fragment, if the first fragment was inspected recently.
+//
+static
+XDP_FRAGMENT_CACHE_ENTRY *
+XdpInspectGetFragmentCacheEntry(
+    _In_ XDP_FRAGMENT_CACHE *FragmentCache,
+    _In_ const XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _Out_ XDP_FRAGMENT_KEY *Key
+    )
+{
+    UINT32 Hash;
+
+    ASSERT(FrameCache->IpFragment);
+
+    RtlZeroMemory(Key, sizeof(*Key));
+
+    if (FrameCache->Ip4Valid) {
+        Key->SourceAddress.Ipv4 = FrameCache->Ip4Hdr->SourceAddress;
+        Key->DestinationAddress.Ipv4 = FrameCache->Ip4Hdr->DestinationAddress;
+    } else {
+        ASSERT(FrameCache->Ip6Valid);
+        Key->SourceAddress.Ipv6 = FrameCache->Ip6Hdr->SourceAddress;
+        Key->DestinationAddress.Ipv6 = FrameCache->Ip6Hdr->DestinationAddress;
+    }
+
+    Key->Id = FrameCache->IpFragmentId;
+    Key->EthType = FrameCache->EthType;
+    Key->IpProto = FrameCache->IpFragmentProtocol;
+
+    Hash = XdpProgramHashUpdate(XDP_PROGRAM_HASH_BASIS, Key, sizeof(*Key));
+
+    return &FragmentCache->Entries[Hash & (XDP_FRAGMENT_CACHE_SIZE - 1)];
+}
+
+static
+FORCEINLINE
+BOOLEAN
+XdpInspectIsFragmentCacheHit(
+    _In_ const XDP_FRAGMENT_CACHE *FragmentCache,
+    _In_ const XDP_FRAGMENT_CACHE_ENTRY *Entry,
+    _In_ const XDP_FRAGMENT_KEY *Key
+    )
+{
+    return
+        Entry->Generation == FragmentCache->Generation &&
+        RtlEqualMemory(&Entry->Key, Key, sizeof(*Key));
+}
+
+static
+FORCEINLINE
+VOID
+XdpInspectStoreFragmentVerdict(
+    _In_ const XDP_FRAGMENT_CACHE *FragmentCache,
+    _Out_ XDP_FRAGMENT_CACHE_ENTRY *Entry,
+    _In_ const XDP_FRAGMENT_KEY *Key,
+    _In_ UINT32 RuleIndex,
+    _In_ XDP_RULE_ACTION RuleAction
+    )
+{
+    Entry->Key = *Key;
+    Entry->Generation = FragmentCache->Generation;
+    Entry->RuleIndex = RuleIndex;
+    Entry->RuleAction = RuleAction;
+}
+
+static
+FORCEINLINE
+XDP_RX_ACTION
+XdpInspectFrame(
+    _In_ XDP_PROGRAM *Program,
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_RING *FrameRing,
+    _In_ UINT32 FrameIndex,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension
+    )
+{
+    XDP_RX_ACTION Action = XDP_RX_ACTION_PASS;
+    XDP_PROGRAM_FRAME_CACHE FrameCache;
+    XDP_PROGRAM_FRAME_CACHE InnerFrameCache;
+    XDP_FRAME *Frame;
+    XDP_RULE *Rule = NULL;
+    XDP_RULE_ACTION RuleAction = XDP_PROGRAM_ACTION_PASS;
+    const XDP_PROGRAM_RULE_SEGMENT *Segments = Program->Segments;
+    UINT32 SegmentCount = Program->SegmentCount;
+    XDP_PROGRAM_RULE_SEGMENT LinearSegment;
+    XDP_FRAGMENT_CACHE *FragmentCache = &InspectionContext->FragmentCache;
+    XDP_FRAGMENT_CACHE_ENTRY *FragmentEntry = NULL;
+    XDP_FRAGMENT_KEY FragmentKey;
+    XDP_PCW_RX_QUEUE *RxQueueStats = XdpRxQueueGetStatsFromInspectionContext(InspectionContext);
+
+    ASSERT(FrameIndex <= FrameRing->Mask);
+    ASSERT(
+        (FragmentRing == NULL && FragmentIndex == 0) ||
+        (FragmentRing && FragmentIndex <= FragmentRing->Mask));
+
+    XdpInitializeFrameCache(&FrameCache);
+    FrameCache.Inner = &InnerFrameCache;
+    Frame = XdpRingGetElement(FrameRing, FrameIndex);
+
+    if (Segments == NULL) {
+        //
+        // The program has not been compiled; evaluate every rule in order.
+        //
+        LinearSegment.StartIndex = 0;
+        LinearSegment.RuleCount = Program->RuleCount;
+        LinearSegment.HashSlotOffset = 0;
+        LinearSegment.HashSlotMask = 0;
+        Segments = &LinearSegment;
+        SegmentCount = 1;
+    }
+
+    if (Program->FragmentAffinity) {
+        XdpParseFrame(
+            Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+            &FrameCache, &InspectionContext->FrameStorage);
+
+        if (FrameCache.IpFragment) {
+            FragmentEntry =
+                XdpInspectGetFragmentCacheEntry(FragmentCache, &FrameCache, &FragmentKey);
+
+            if (!FrameCache.IpFirstFragment) {
+                //
+                // Apply the first fragment's verdict without evaluating the
+                // rules. If the verdict is unknown, evaluate the rules, but do
+                // not record the verdict of a fragment without transport
+                // headers.
+                //
+                if (XdpInspectIsFragmentCacheHit(FragmentCache, FragmentEntry, &FragmentKey)) {
+                    if (FragmentEntry->RuleIndex != MAXUINT32) {
+                        Rule = &Program->Rules[FragmentEntry->RuleIndex];
+                        RuleAction = FragmentEntry->RuleAction;
+                    }
+
+                    SegmentCount = 0;
+                }
+
+                FragmentEntry = NULL;
+            }
+        }
+    }
+
+    for (UINT32 SegmentIndex = 0; SegmentIndex < SegmentCount && Rule == NULL; SegmentIndex++) {
+        const XDP_PROGRAM_RULE_SEGMENT *Segment = &Segments[SegmentIndex];
+
+        if (Segment->HashSlotMask != 0) {
+            Rule =
+                XdpInspectLookupRule(
+                    Program, Segment, Frame, FragmentRing, FragmentExtension, FragmentIndex,
+                    VirtualAddressExtension, &FrameCache, &InspectionContext->FrameStorage,
+                    &RuleAction);
+            continue;
+        }
+
+        for (UINT32 RuleIndex = Segment->StartIndex;
+            RuleIndex < Segment->StartIndex + Segment->RuleCount;
+            RuleIndex++) {
+            //
+            // Check the match conditions.
+            //
+            if (XdpInspectMatchRule(
+                    &Program->Rules[RuleIndex], Frame, FragmentRing, FragmentExtension,
+                    FragmentIndex, VirtualAddressExtension, &FrameCache,
+                    &InspectionContext->FrameStorage, &RuleAction)) {
+                Rule = &Program->Rules[RuleIndex];
+                break;
+            }
+        }
+    }
+
+    if (FragmentEntry != NULL) {
+        XdpInspectStoreFragmentVerdict(
+            FragmentCache, FragmentEntry, &FragmentKey,
+            Rule != NULL ? (UINT32)(Rule - Program->Rules) : MAXUINT32, RuleAction);
+    }
+
+    if (Rule == NULL) {
+        //
+        // No match resulted in a terminating action; perform the default action.
+        //
+        ASSERT(Action == XDP_RX_ACTION_PASS);
+        STAT_INC(RxQueueStats, InspectFramesPassed);
+        goto Done;
+    }
+
+    if (Program->RuleCounters != NULL) {
+        XdpInspectCountRuleHit(&Program->RuleCounters[Rule - Program->Rules], 1);
+    }
+
+    //
+    // Apply the action.
+    //
+    switch (RuleAction) {
+
+    case XDP_PROGRAM_ACTION_REDIRECT:
+        XdpInspectRedirect(
+            InspectionContext, Rule->Redirect.TargetType, Rule->Redirect.Target, Frame,
+            FrameIndex, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+            &FrameCache);
+
+        Action = XDP_RX_ACTION_DROP;
+        STAT_INC(RxQueueStats, InspectFramesRedirected);
+        break;
+
+    case XDP_PROGRAM_ACTION_SAMPLE:
+        //
+        // The redirect copies the frame into the socket when the batch is
+        // flushed, which happens before the interface completes the frame.
+        //
+        if (XdpInspectShouldSample(InspectionContext, Rule->Sample.Rate)) {
+            XdpInspectRedirect(
+                InspectionContext, Rule->Sample.TargetType, Rule->Sample.Target, Frame,
+                FrameIndex, FragmentRing, FragmentExtension, FragmentIndex,
+                VirtualAddressExtension, &FrameCache);
+        }
+
+        Action = XDP_RX_ACTION_PASS;
+        STAT_INC(RxQueueStats, InspectFramesPassed);
+        break;
+
+    case XDP_PROGRAM_ACTION_POLICE:
+    {
+        XDP_POLICER *Policer = Rule->Police.ConformTarget;
+
+        if (!XdpInspectPolice(Policer, Frame, FragmentRing, FragmentExtension, FragmentIndex)) {
+            Action = XDP_RX_ACTION_DROP;
+            STAT_INC(RxQueueStats, InspectFramesDropped);
+            STAT_INC(RxQueueStats, InspectDropsRule);
+            XdpRxQueueSampleDrop(
+                RxQueueStats, XdpDropReasonRule, 1, Frame, VirtualAddressExtension);
+        } else if (Policer->ConformTarget != NULL) {
+            XdpInspectRedirect(
+                InspectionContext, XDP_REDIRECT_TARGET_TYPE_XSK, Policer->ConformTarget, Frame,
+                FrameIndex, FragmentRing, FragmentExtension, FragmentIndex,
+                VirtualAddressExtension, &FrameCache);
+
+            Action = XDP_RX_ACTION_DROP;
+            STAT_INC(RxQueueStats, InspectFramesRedirected);
+        } else {
+            Action = XDP_RX_ACTION_PASS;
+            STAT_INC(RxQueueStats, InspectFramesPassed);
+        }
+
+        break;
+    }
+
+    case XDP_PROGRAM_ACTION_DECAP_REDIRECT:
+        if (!XdpParseTunnel(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                &Rule->DecapRedirect.Tunnel, &FrameCache, &InspectionContext->FrameStorage)) {
+            Action = XDP_RX_ACTION_PASS;
+            STAT_INC(RxQueueStats, InspectFramesPassed);
+            break;
+        }
+
+        //
+        // Strip the outer headers. The frame is consumed by the redirect, so
+        // the adjusted frame is never indicated up the stack.
+        //
+        Frame->Buffer.DataOffset += FrameCache.InnerOffset;
+        Frame->Buffer.DataLength -= FrameCache.InnerOffset;
+
+        XdpInspectRedirect(
+            InspectionContext, Rule->DecapRedirect.Redirect.TargetType,
+            Rule->DecapRedirect.Redirect.Target, Frame, FrameIndex, FragmentRing,
+            FragmentExtension, FragmentIndex, VirtualAddressExtension, FrameCache.Inner);
+
+        Action = XDP_RX_ACTION_DROP;
+        STAT_INC(RxQueueStats, InspectFramesRedirected);
+        break;
+
+    case XDP_PROGRAM_ACTION_ENCAP:
+        if (!XdpInspectEncap(
+                Rule->Encap.Reserved, Frame, FragmentRing, FragmentExtension, FragmentIndex,
+                VirtualAddressExtension, &FrameCache, &InspectionContext->FrameStorage)) {
+            Action = XDP_RX_ACTION_PASS;
+            STAT_INC(RxQueueStats, InspectFramesPassed);
+            break;
+        }
+
+        if (Rule->Encap.Flags & XDP_ENCAP_FLAG_REDIRECT) {
+            XdpInspectRedirect(
+                InspectionContext, Rule->Encap.Redirect.TargetType, Rule->Encap.Redirect.Target,
+                Frame, FrameIndex, FragmentRing, FragmentExtension, FragmentIndex,
+                VirtualAddressExtension, &FrameCache);
+
+            Action = XDP_RX_ACTION_DROP;
+            STAT_INC(RxQueueStats, InspectFramesRedirected);
+        } else {
+            Action = XDP_RX_ACTION_TX;
+            STAT_INC(RxQueueStats, InspectFramesForwarded);
+        }
+        break;
+
+    case XDP_PROGRAM_ACTION_EBPF:
+        //
+        // Programs consisting of only an unconditional eBPF action use the
+        // batched XdpInspectEbpf routines instead; otherwise, the eBPF program
+        // is invoked only for frames matching its native rule.
+        //
+        Action =
+            XdpInspectEbpfRule(
+                Rule->Ebpf.Target, InspectionContext, Frame, FrameIndex, FragmentRing,
+                FragmentExtension, FragmentIndex, VirtualAddressExtension);
+        break;
+
+    case XDP_PROGRAM_ACTION_DROP:
+        Action = XDP_RX_ACTION_DROP;
+        STAT_INC(RxQueueStats, InspectFramesDropped);
+        STAT_INC(RxQueueStats, InspectDropsRule);
+        XdpRxQueueSampleDrop(RxQueueStats, XdpDropReasonRule, 1, Frame, VirtualAddressExtension);
+        break;
+
+    case XDP_PROGRAM_ACTION_PASS:
+        Action = XDP_RX_ACTION_PASS;
+        STAT_INC(RxQueueStats, InspectFramesPassed);
+        break;
+
+    case XDP_PROGRAM_ACTION_L2FWD:
+        Action =
+            XdpL2Fwd(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex,
+                VirtualAddressExtension, &FrameCache, &InspectionContext->FrameStorage,
+                RxQueueStats);
+        break;
+
+    case XDP_PROGRAM_ACTION_LOAD_BALANCE:
+        Action =
+            XdpInspectLoadBalance(
+                Rule->LoadBalance.Reserved, Frame, FragmentRing, FragmentExtension,
+                FragmentIndex, VirtualAddressExtension, &FrameCache,
+                &InspectionContext->FrameStorage, RxQueueStats);
+        break;
+
+    case XDP_PROGRAM_ACTION_SYN_COOKIE:
+        Action =
+            XdpInspectSynCookie(
+                Rule->SynCookie.Reserved, Frame, FragmentRing, FragmentExtension,
+                FragmentIndex, VirtualAddressExtension, &FrameCache,
+                &InspectionContext->FrameStorage, RxQueueStats);
+        break;
+
+    default:
+        ASSERT(FALSE);
+        break;
+    }
+
+Done:
+
+    return Action;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+XDP_RX_ACTION
+XdpInspect(
+    _In_ XDP_PROGRAM *Program,
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_RING *FrameRing,
+    _In_ UINT32 FrameIndex,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension
+    )
+{
+    return
+        XdpInspectFrame(
+            Program, InspectionContext, FrameRing, FrameIndex, FragmentRing, FragmentExtension,
+            FragmentIndex, VirtualAddressExtension);
+}
+
+static
+VOID
+XdpInspectPrefetchFrame(
+    _In_ XDP_FRAME *Frame,
+    _In_ XDP_EXTENSION *VirtualAddressExtension
+    )
+{
+    UCHAR *Va =
+        XdpGetVirtualAddressExtension(&Frame->Buffer, VirtualAddressExtension)->VirtualAddress;
+
+    PreFetchCacheLine(PF_TEMPORAL_LEVEL_1, Va + Frame->Buffer.DataOffset);
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+UINT32
+XdpInspectBatch(
+    _In_ XDP_PROGRAM *Program,
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_RING *FrameRing,
+    _In_ UINT32 FrameIndex,
+    _In_ UINT32 FrameCount,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ XDP_EXTENSION *RxActionExtension
+    )
+{
+    UINT32 FragmentBufferCount = 0;
+    XDP_FRAME *NextFrame;
+
+    ASSERT(FragmentRing == NULL || FragmentExtension != NULL);
+
+    if (FrameCount == 0) {
+        return 0;
+    }
+
+    NextFrame = XdpRingGetElement(FrameRing, FrameIndex & FrameRing->Mask);
+    XdpInspectPrefetchFrame(NextFrame, VirtualAddressExtension);
+
+    for (UINT32 i = 0; i < FrameCount; i++) {
+        UINT32 RingIndex = (FrameIndex + i) & FrameRing->Mask;
+        UINT32 FragmentRingIndex = 0;
+        XDP_FRAME *Frame = NextFrame;
+        XDP_RX_ACTION Action;
+
+        //
+        // Pull the next frame's headers into the cache while the rules are
+        // evaluated against this frame; at high packet rates the header miss
+        // otherwise dominates the per-frame cost.
+        //
+        if (i + 1 < FrameCount) {
+            NextFrame = XdpRingGetElement(FrameRing, (RingIndex + 1) & FrameRing->Mask);
+            XdpInspectPrefetchFrame(NextFrame, VirtualAddressExtension);
+        }
+
+        if (FragmentRing != NULL) {
+            FragmentRingIndex = (FragmentIndex + FragmentBufferCount) & FragmentRing->Mask;
+        }
+
+        Action =
+            XdpInspect(
+                Program, InspectionContext, FrameRing, RingIndex, FragmentRing,
+                FragmentExtension, FragmentRingIndex, VirtualAddressExtension);
+
+        XdpGetRxActionExtension(Frame, RxActionExtension)->RxAction = Action;
+
+        if (FragmentRing != NULL) {
+            FragmentBufferCount +=
+                XdpGetFragmentExtension(Frame, FragmentExtension)->FragmentBufferCount;
+        }
+    }
+
+    return FragmentBufferCount;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+UINT32
+XdpInspectSingleBufferBatch(
+    _In_ XDP_PROGRAM *Program,
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_RING *FrameRing,
+    _In_ UINT32 FrameIndex,
+    _In_ UINT32 FrameCount,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ XDP_EXTENSION *RxActionExtension
+    )
+{
+    //
+    // The extension layout is fixed while the RX queue is active, so copy the
+    // extensions once per batch rather than loading their offsets through the
+    // RX queue for every frame.
+    //
+    XDP_EXTENSION BatchVirtualAddressExtension = *VirtualAddressExtension;
+    XDP_EXTENSION BatchRxActionExtension = *RxActionExtension;
+    XDP_FRAME *NextFrame;
+
+    UNREFERENCED_PARAMETER(FragmentRing);
+    UNREFERENCED_PARAMETER(FragmentExtension);
+    UNREFERENCED_PARAMETER(FragmentIndex);
+
+    ASSERT(FragmentRing == NULL);
+
+    if (FrameCount == 0) {
+        return 0;
+    }
+
+    NextFrame = XdpRingGetElement(FrameRing, FrameIndex & FrameRing->Mask);
+    XdpInspectPrefetchFrame(NextFrame, &BatchVirtualAddressExtension);
+
+    for (UINT32 i = 0; i < FrameCount; i++) {
+        UINT32 RingIndex = (FrameIndex + i) & FrameRing->Mask;
+        XDP_FRAME *Frame = NextFrame;
+        XDP_RX_ACTION Action;
+
+        if (i + 1 < FrameCount) {
+            NextFrame = XdpRingGetElement(FrameRing, (RingIndex + 1) & FrameRing->Mask);
+            XdpInspectPrefetchFrame(NextFrame, &BatchVirtualAddressExtension);
+        }
+
+        //
+        // Inline the inspection with the fragment ring compiled out.
+        //
+        Action =
+            XdpInspectFrame(
+                Program, InspectionContext, FrameRing, RingIndex, NULL, NULL, 0,
+                &BatchVirtualAddressExtension);
+
+        XdpGetRxActionExtension(Frame, &BatchRxActionExtension)->RxAction = Action;
+    }
+
+    return 0;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+UINT32
+XdpInspectXskPortSetBatch(
+    _In_ XDP_PROGRAM *Program,
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_RING *FrameRing,
+    _In_ UINT32 FrameIndex,
+    _In_ UINT32 FrameCount,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ XDP_EXTENSION *RxActionExtension
+    )
+{
+    UINT32 FragmentBufferCount = 0;
+    XDP_FRAME *NextFrame;
+    XDP_PCW_RX_QUEUE *RxQueueStats = XdpRxQueueGetStatsFromInspectionContext(InspectionContext);
+
+    ASSERT(FragmentRing == NULL || FragmentExtension != NULL);
+
+    if (FrameCount == 0) {
+        return 0;
+    }
+
+    NextFrame = XdpRingGetElement(FrameRing, FrameIndex & FrameRing->Mask);
+    XdpInspectPrefetchFrame(NextFrame, VirtualAddressExtension);
+
+    for (UINT32 i = 0; i < FrameCount; i++) {
+        UINT32 RingIndex = (FrameIndex + i) & FrameRing->Mask;
+        UINT32 FragmentRingIndex = 0;
+        XDP_FRAME *Frame = NextFrame;
+        XDP_PROGRAM_FRAME_CACHE FrameCache;
+        XDP_RX_ACTION Action = XDP_RX_ACTION_PASS;
+
+        if (i + 1 < FrameCount) {
+            NextFrame = XdpRingGetElement(FrameRing, (RingIndex + 1) & FrameRing->Mask);
+            XdpInspectPrefetchFrame(NextFrame, VirtualAddressExtension);
+        }
+
+        if (FragmentRing != NULL) {
+            FragmentRingIndex = (FragmentIndex + FragmentBufferCount) & FragmentRing->Mask;
+        }
+
+        //
+        // Every rule matches a UDP destination port set and redirects to an
+        // XSK, so a single parse and one bit test per rule replace the generic
+        // segment walk and match dispatch.
+        //
+        XdpInitializeFrameCache(&FrameCache);
+        XdpParseFrame(
+            Frame, FragmentRing, FragmentExtension, FragmentRingIndex, VirtualAddressExtension,
+            &FrameCache, &InspectionContext->FrameStorage);
+
+        if (FrameCache.UdpValid) {
+            for (UINT32 RuleIndex = 0; RuleIndex < Program->RuleCount; RuleIndex++) {
+                XDP_RULE *Rule = &Program->Rules[RuleIndex];
+
+                ASSERT(Rule->Match == XDP_MATCH_UDP_PORT_SET);
+                ASSERT(Rule->Redirect.TargetType == XDP_REDIRECT_TARGET_TYPE_XSK);
+
+                if (XdpTestBit(Rule->Pattern.PortSet.PortSet, FrameCache.UdpHdr->uh_dport)) {
+                    if (Program->RuleCounters != NULL) {
+                        XdpInspectCountRuleHit(&Program->RuleCounters[RuleIndex], 1);
+                    }
+
+                    XdpRedirect(
+                        &InspectionContext->RedirectContext, RingIndex, FragmentRingIndex, 0,
+                        XDP_REDIRECT_TARGET_TYPE_XSK, Rule->Redirect.Target);
+                    Action = XDP_RX_ACTION_DROP;
+                    break;
+                }
+            }
+        }
+
+        if (Action == XDP_RX_ACTION_DROP) {
+            STAT_INC(RxQueueStats, InspectFramesRedirected);
+        } else {
+            STAT_INC(RxQueueStats, InspectFramesPassed);
+        }
+
+        XdpGetRxActionExtension(Frame, RxActionExtension)->RxAction = Action;
+
+        if (FragmentRing != NULL) {
+            FragmentBufferCount +=
+                XdpGetFragmentExtension(Frame, FragmentExtension)->FragmentBufferCount;
+        }
+    }
+
+    return FragmentBufferCount;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+UINT32
+XdpInspectMatchAllBatch(
+    _In_ XDP_PROGRAM *Program,
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_RING *FrameRing,
+    _In_ UINT32 FrameIndex,
+    _In_ UINT32 FrameCount,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ XDP_EXTENSION *RxActionExtension
+    )
+{
+    const XDP_RULE *Rule = &Program->Rules[0];
+    UINT32 FragmentBufferCount = 0;
+    XDP_PCW_RX_QUEUE *RxQueueStats = XdpRxQueueGetStatsFromInspectionContext(InspectionContext);
+    XDP_RX_ACTION Action;
+
+    UNREFERENCED_PARAMETER(FragmentIndex);
+    UNREFERENCED_PARAMETER(VirtualAddressExtension);
+
+    ASSERT(FragmentRing == NULL || FragmentExtension != NULL);
+    ASSERT(Program->RuleCount == 1 && Rule->Match == XDP_MATCH_ALL);
+
+    if (FrameCount == 0) {
+        return 0;
+    }
+
+    //
+    // Every frame takes the same action, so the frame data is never read and
+    // the statistics and rule counter are updated once for the whole batch.
+    //
+    if (Rule->Action == XDP_PROGRAM_ACTION_DROP) {
+        Action = XDP_RX_ACTION_DROP;
+        STAT_ADD(RxQueueStats, InspectFramesDropped, FrameCount);
+        STAT_ADD(RxQueueStats, InspectDropsRule, FrameCount);
+        XdpRxQueueSampleDrop(RxQueueStats, XdpDropReasonRule, FrameCount, NULL, NULL);
+    } else {
+        ASSERT(Rule->Action == XDP_PROGRAM_ACTION_PASS);
+        Action = XDP_RX_ACTION_PASS;
+        STAT_ADD(RxQueueStats, InspectFramesPassed, FrameCount);
+    }
+
+    if (Program->RuleCounters != NULL) {
+        XdpInspectCountRuleHit(&Program->RuleCounters[0], FrameCount);
+    }
+
+    for (UINT32 i = 0; i < FrameCount; i++) {
+        XDP_FRAME *Frame = XdpRingGetElement(FrameRing, (FrameIndex + i) & FrameRing->Mask);
+
+        XdpGetRxActionExtension(Frame, RxActionExtension)->RxAction = Action;
+
+        if (FragmentRing != NULL) {
+            FragmentBufferCount +=
+                XdpGetFragmentExtension(Frame, FragmentExtension)->FragmentBufferCount;
+        }
+    }
+
+    return FragmentBufferCount;
+}
+
+static
+FORCEINLINE
+BOOLEAN
+XdpInspectMatchOp(
+    _In_ const XDP_PROGRAM_OP *Op,
+    _In_ const XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    const XDP_IP_ADDRESS_MASK *IpMask;
+
+    switch (Op->Opcode) {
+    case XdpProgramOpAll:
+        return TRUE;
+
+    case XdpProgramOpUdp:
+        return FrameCache->UdpValid;
+
+    case XdpProgramOpUdpDst:
+        return FrameCache->UdpValid && FrameCache->UdpHdr->uh_dport == Op->Port;
+
+    case XdpProgramOpTcpDst:
+        return FrameCache->TcpValid && FrameCache->TcpHdr->th_dport == Op->Port;
+
+    case XdpProgramOpUdpPortSet:
+        return FrameCache->UdpValid && XdpTestBit(Op->Pattern, FrameCache->UdpHdr->uh_dport);
+
+    case XdpProgramOpIpv4DstMask:
+        IpMask = Op->Pattern;
+        return
+            FrameCache->Ip4Valid &&
+            Ipv4PrefixMatch(
+                &FrameCache->Ip4Hdr->DestinationAddress, &IpMask->Address.Ipv4,
+                &IpMask->Mask.Ipv4);
+
+    case XdpProgramOpIpv6DstMask:
+        IpMask = Op->Pattern;
+        return
+            FrameCache->Ip6Valid &&
+            Ipv6PrefixMatch(
+                &FrameCache->Ip6Hdr->DestinationAddress, &IpMask->Address.Ipv6,
+                &IpMask->Mask.Ipv6);
+
+    default:
+        ASSERT(FALSE);
+        return FALSE;
+    }
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+UINT32
+XdpInspectCompiledBatch(
+    _In_ XDP_PROGRAM *Program,
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_RING *FrameRing,
+    _In_ UINT32 FrameIndex,
+    _In_ UINT32 FrameCount,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ XDP_EXTENSION *RxActionExtension
+    )
+{
+    const XDP_PROGRAM_OP *Ops = Program->Ops;
+    UINT32 FragmentBufferCount = 0;
+    XDP_FRAME *NextFrame;
+    XDP_PCW_RX_QUEUE *RxQueueStats = XdpRxQueueGetStatsFromInspectionContext(InspectionContext);
+
+    ASSERT(FragmentRing == NULL || FragmentExtension != NULL);
+
+    if (Ops == NULL) {
+        //
+        // Updating the program in place may have merged rules into an indexed
+        // segment, which is only evaluated by the generic routine.
+        //
+        return
+            XdpInspectBatch(
+                Program, InspectionContext, FrameRing, FrameIndex, FrameCount, FragmentRing,
+                FragmentExtension, FragmentIndex, VirtualAddressExtension, RxActionExtension);
+    }
+
+    if (FrameCount == 0) {
+        return 0;
+    }
+
+    NextFrame = XdpRingGetElement(FrameRing, FrameIndex & FrameRing->Mask);
+    XdpInspectPrefetchFrame(NextFrame, VirtualAddressExtension);
+
+    for (UINT32 i = 0; i < FrameCount; i++) {
+        UINT32 RingIndex = (FrameIndex + i) & FrameRing->Mask;
+        UINT32 FragmentRingIndex = 0;
+        XDP_FRAME *Frame = NextFrame;
+        XDP_PROGRAM_FRAME_CACHE FrameCache;
+        XDP_RX_ACTION Action = XDP_RX_ACTION_PASS;
+        XDP_FRAGMENT_CACHE_ENTRY *FragmentEntry = NULL;
+        XDP_FRAGMENT_KEY FragmentKey;
+        UINT32 MatchIndex = MAXUINT32;
+        BOOLEAN Replayed = FALSE;
+
+        if (i + 1 < FrameCount) {
+            NextFrame = XdpRingGetElement(FrameRing, (RingIndex + 1) & FrameRing->Mask);
+            XdpInspectPrefetchFrame(NextFrame, VirtualAddressExtension);
+        }
+
+        if (FragmentRing != NULL) {
+            FragmentRingIndex = (FragmentIndex + FragmentBufferCount) & FragmentRing->Mask;
+        }
+
+        //
+        // Every op matches headers up to the transport layer, so the headers
+        // are parsed once up front instead of on demand by each rule.
+        //
+        XdpInitializeFrameCache(&FrameCache);
+        if (Program->ParseHeaders) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentRingIndex,
+                VirtualAddressExtension, &FrameCache, &InspectionContext->FrameStorage);
+        }
+
+        if (FrameCache.IpFragment) {
+            FragmentEntry =
+                XdpInspectGetFragmentCacheEntry(
+                    &InspectionContext->FragmentCache, &FrameCache, &FragmentKey);
+
+            if (!FrameCache.IpFirstFragment) {
+                if (XdpInspectIsFragmentCacheHit(
+                        &InspectionContext->FragmentCache, FragmentEntry, &FragmentKey)) {
+                    MatchIndex = FragmentEntry->RuleIndex;
+                    Replayed = TRUE;
+                }
+
+                FragmentEntry = NULL;
+            }
+        }
+
+        for (UINT32 OpIndex = 0; !Replayed && OpIndex < Program->RuleCount; OpIndex++) {
+            if (XdpInspectMatchOp(&Ops[OpIndex], &FrameCache)) {
+                MatchIndex = OpIndex;
+                break;
+            }
+        }
+
+        if (FragmentEntry != NULL) {
+            XdpInspectStoreFragmentVerdict(
+                &InspectionContext->FragmentCache, FragmentEntry, &FragmentKey, MatchIndex,
+                MatchIndex != MAXUINT32 ?
+                    Program->Rules[MatchIndex].Action : XDP_PROGRAM_ACTION_PASS);
+        }
+
+        if (MatchIndex != MAXUINT32) {
+            const XDP_PROGRAM_OP *Op = &Ops[MatchIndex];
+
+            if (Program->RuleCounters != NULL) {
+                XdpInspectCountRuleHit(&Program->RuleCounters[Op->RuleIndex], 1);
+            }
+
+            if (Op->Drop) {
+                Action = XDP_RX_ACTION_DROP;
+            }
+        }
+
+        if (Action == XDP_RX_ACTION_DROP) {
+            STAT_INC(RxQueueStats, InspectFramesDropped);
+            STAT_INC(RxQueueStats, InspectDropsRule);
+            XdpRxQueueSampleDrop(
+                RxQueueStats, XdpDropReasonRule, 1, Frame, VirtualAddressExtension);
+        } else {
+            STAT_INC(RxQueueStats, InspectFramesPassed);
+        }
+
+        XdpGetRxActionExtension(Frame, RxActionExtension)->RxAction = Action;
+
+        if (FragmentRing != NULL) {
+            FragmentBufferCount +=
+                XdpGetFragmentExtension(Frame, FragmentExtension)->FragmentBufferCount;
+        }
+    }
+
+    return FragmentBufferCount;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+_Success_(return != FALSE)
+BOOLEAN
+XdpInspectGetEbpfFlowKey(
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Out_ XDP_EBPF_FLOW_KEY *Key,
+    _Out_ UINT32 *Hash
+    )
+{
+    XDP_PROGRAM_FRAME_CACHE FrameCache;
+
+    XdpInitializeFrameCache(&FrameCache);
+    XdpParseFrame(
+        Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+        &FrameCache, &InspectionContext->FrameStorage);
+
+    if (!XdpInspectGetFlowKey(&FrameCache, Key)) {
+        return FALSE;
+    }
+
+    *Hash = XdpProgramHashUpdate(XDP_PROGRAM_HASH_BASIS, Key, sizeof(*Key));
+
+    return TRUE;
+}
+
+//
+// Control path routines.
+//
+
+static
+VOID
+XdpProgramReleaseRedirectTarget(
+    _In_ XDP_REDIRECT_TARGET_TYPE TargetType,
+    _Inout_ VOID **Target
+    )
+{
+    if (*Target == NULL) {
+        return;
+    }
+
+    switch (TargetType) {
+
+    case XDP_REDIRECT_TARGET_TYPE_XSK:
+    case XDP_REDIRECT_TARGET_TYPE_XSK_PRIORITY:
+        XskDereferenceDatapathHandle(*Target);
+        break;
+
+    case XDP_REDIRECT_TARGET_TYPE_XSK_MAP:
+    case XDP_REDIRECT_TARGET_TYPE_XSK_FANOUT:
+        XdpProgramDeleteXskMap(*Target);
+        break;
+
+    case XDP_REDIRECT_TARGET_TYPE_QUIC_LB:
+        XdpProgramDeleteQuicLbTable(*Target);
+        break;
+
+    case XDP_REDIRECT_TARGET_TYPE_INTERFACE_TX:
+        XdpTxTargetDelete(*Target);
+        break;
+
+    default:
+        ASSERT(FALSE);
+    }
+
+    *Target = NULL;
+}
+
+static
+NTSTATUS
+XdpProgramCaptureRedirectTarget(
+    _In_ XDP_REDIRECT_TARGET_TYPE TargetType,
+    _In_ const HANDLE *UserTarget,
+    _In_ const XDP_XSK_MAP *UserXskMap,
+    _In_ const XDP_INTERFACE_TX_TARGET *InterfaceTx,
+    _In_ const XDP_QUIC_LB *UserQuicLb,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Out_ VOID **Target
+    )
+{
+    switch (TargetType) {
+
+    case XDP_REDIRECT_TARGET_TYPE_XSK:
+    case XDP_REDIRECT_TARGET_TYPE_XSK_PRIORITY:
+        return XskReferenceDatapathHandle(RequestorMode, UserTarget, TRUE, Target);
+
+    case XDP_REDIRECT_TARGET_TYPE_XSK_MAP:
+        return
+            XdpProgramCaptureXskMap(
+                UserXskMap, RequestorMode, FALSE, (XDP_XSK_MAP_TABLE **)Target);
+
+    case XDP_REDIRECT_TARGET_TYPE_XSK_FANOUT:
+        return
+            XdpProgramCaptureXskMap(
+                UserXskMap, RequestorMode, TRUE, (XDP_XSK_MAP_TABLE **)Target);
+
+    case XDP_REDIRECT_TARGET_TYPE_INTERFACE_TX:
+        return XdpTxTargetCreate(InterfaceTx, (XDP_TX_TARGET **)Target);
+
+    case XDP_REDIRECT_TARGET_TYPE_QUIC_LB:
+        return XdpProgramCaptureQuicLb(UserQuicLb, RequestorMode, (XDP_QUIC_LB_TABLE **)Target);
+
+    default:
+        return STATUS_INVALID_PARAMETER;
+    }
+}
+
+VOID
+XdpProgramDeleteRule(
+    _Inout_ XDP_RULE *Rule
+    )
+{
+    if (Rule->Match == XDP_MATCH_IPV4_UDP_PORT_SET ||
+        Rule->Match == XDP_MATCH_IPV6_UDP_PORT_SET ||
+        Rule->Match == XDP_MATCH_IPV4_TCP_PORT_SET ||
+        Rule->Match == XDP_MATCH_IPV6_TCP_PORT_SET) {
+        XdpProgramReleasePortSet(&Rule->Pattern.IpPortSet.PortSet);
+    }
+
+    if (Rule->Match == XDP_MATCH_UDP_PORT_SET) {
         XdpProgramReleasePortSet(&Rule->Pattern.PortSet);
     }
 
-    if (Rule->Action == XDP_PROGRAM_ACTION_REDIRECT) {
+    if ((Rule->Match == XDP_MATCH_IPV4_DST_LPM || Rule->Match == XDP_MATCH_IPV6_DST_LPM ||
+            Rule->Match == XDP_MATCH_IPV4_SRC_LPM || Rule->Match == XDP_MATCH_IPV6_SRC_LPM) &&
+        Rule->Pattern.PrefixTable.Reserved != NULL) {
+        XdpProgramDeleteLpmTable(Rule->Pattern.PrefixTable.Reserved);
+        Rule->Pattern.PrefixTable.Reserved = NULL;
+    }
+
+    if ((Rule->Match == XDP_MATCH_IPV4_MASKED_TUPLE ||
+            Rule->Match == XDP_MATCH_IPV6_MASKED_TUPLE) &&
+        Rule->Pattern.TupleSet.Reserved != NULL) {
+        XdpProgramDeleteTupleTable(Rule->Pattern.TupleSet.Reserved);
+        Rule->Pattern.TupleSet.Reserved = NULL;
+    }
+
+    if ((Rule->Match == XDP_MATCH_TUNNEL_IPV4_MASKED_TUPLE ||
+            Rule->Match == XDP_MATCH_TUNNEL_IPV6_MASKED_TUPLE) &&
+        Rule->Pattern.TunnelTupleSet.TupleSet.Reserved != NULL) {
+        XdpProgramDeleteTupleTable(Rule->Pattern.TunnelTupleSet.TupleSet.Reserved);
+        Rule->Pattern.TunnelTupleSet.TupleSet.Reserved = NULL;
+    }
+
+    if ((Rule->Match == XDP_MATCH_UDP_PAYLOAD || Rule->Match == XDP_MATCH_TCP_PAYLOAD) &&
+        Rule->Pattern.Payload.Reserved != NULL) {
+        XdpProgramDeletePayloadPatternTable(Rule->Pattern.Payload.Reserved);
+        Rule->Pattern.Payload.Reserved = NULL;
+    }
+
+    if (Rule->Match == XDP_MATCH_UDP_PORT_RANGE &&
+        Rule->Pattern.PortRanges.Reserved != NULL) {
+        XdpProgramDeletePortRangeTable(Rule->Pattern.PortRanges.Reserved);
+        Rule->Pattern.PortRanges.Reserved = NULL;
+    }
+
+    if ((Rule->Match == XDP_MATCH_IPV4_UDP_PORT_RANGE ||
+         Rule->Match == XDP_MATCH_IPV6_UDP_PORT_RANGE ||
+         Rule->Match == XDP_MATCH_IPV4_TCP_PORT_RANGE ||
+         Rule->Match == XDP_MATCH_IPV6_TCP_PORT_RANGE) &&
+        Rule->Pattern.IpPortRanges.PortRanges.Reserved != NULL) {
+        XdpProgramDeletePortRangeTable(Rule->Pattern.IpPortRanges.PortRanges.Reserved);
+        Rule->Pattern.IpPortRanges.PortRanges.Reserved = NULL;
+    }
+
+    if (Rule->Action == XDP_PROGRAM_ACTION_REDIRECT) {
+        XdpProgramReleaseRedirectTarget(Rule->Redirect.TargetType, &Rule->Redirect.Target);
+    } else if (Rule->Action == XDP_PROGRAM_ACTION_SAMPLE) {
+        XdpProgramReleaseRedirectTarget(Rule->Sample.TargetType, &Rule->Sample.Target);
+    } else if (Rule->Action == XDP_PROGRAM_ACTION_DECAP_REDIRECT) {
+        XdpProgramReleaseRedirectTarget(
+            Rule->DecapRedirect.Redirect.TargetType, &Rule->DecapRedirect.Redirect.Target);
+    } else if (Rule->Action == XDP_PROGRAM_ACTION_POLICE &&
+        Rule->Police.ConformTarget != NULL) {
+        XdpProgramDeletePolicer(Rule->Police.ConformTarget);
+        Rule->Police.ConformTarget = NULL;
+    } else if (Rule->Action == XDP_PROGRAM_ACTION_LOAD_BALANCE &&
+        Rule->LoadBalance.Reserved != NULL) {
+        XdpProgramDeleteLoadBalancer(Rule->LoadBalance.Reserved);
+        Rule->LoadBalance.Reserved = NULL;
+    } else if (Rule->Action == XDP_PROGRAM_ACTION_ENCAP) {
+        if (Rule->Encap.Flags & XDP_ENCAP_FLAG_REDIRECT) {
+            XdpProgramReleaseRedirectTarget(
+                Rule->Encap.Redirect.TargetType, &Rule->Encap.Redirect.Target);
+        }
+
+        if (Rule->Encap.Reserved != NULL) {
+            XdpProgramDeleteEncapsulator(Rule->Encap.Reserved);
+            Rule->Encap.Reserved = NULL;
+        }
+    } else if (Rule->Action == XDP_PROGRAM_ACTION_SYN_COOKIE &&
+        Rule->SynCookie.Reserved != NULL) {
+        XdpProgramDeleteSynCookie(Rule->SynCookie.Reserved);
+        Rule->SynCookie.Reserved = NULL;
+    }
+}
+
+static
+NTSTATUS
+XdpProgramValidateTunnel(
+    _In_ const XDP_TUNNEL *Tunnel
+    )
+{
+    if (Tunnel->Type < XDP_TUNNEL_TYPE_VXLAN || Tunnel->Type > XDP_TUNNEL_TYPE_GENEVE ||
+        Tunnel->UdpPort == 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+XdpProgramValidateQuicFlow(
+    _Out_ XDP_QUIC_FLOW *ValidatedFlow,
+    _In_ const XDP_QUIC_FLOW *UserFlow
+    )
+{
+    NTSTATUS Status;
+    UINT32 TotalSize;
+
+    RtlZeroMemory(ValidatedFlow, sizeof(*ValidatedFlow));
+
+    Status = RtlUInt32Add(UserFlow->CidOffset, UserFlow->CidLength, &TotalSize);
+    if (!NT_SUCCESS(Status)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    if (TotalSize > RTL_FIELD_SIZE(XDP_QUIC_FLOW, CidData)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    *ValidatedFlow = *UserFlow;
+
+Exit:
+
+    return Status;
+}
+
+NTSTATUS
+XdpProgramValidateRule(
+    _Out_ XDP_RULE *ValidatedRule,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _In_ const XDP_RULE *UserRule
+    )
+{
+    NTSTATUS Status;
+
+    //
+    // Initialize the trusted kernel rule buffer and increment the count of
+    // validated rules. The error path will not attempt to clean up
+    // unvalidated rules.
+    //
+    RtlZeroMemory(ValidatedRule, sizeof(*ValidatedRule));
+
+    if (UserRule->Match < XDP_MATCH_ALL || UserRule->Match > XDP_MATCH_TCP_PAYLOAD) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    ValidatedRule->Match = UserRule->Match;
+
+    //
+    // Validate each match condition. Many match conditions support all
+    // possible input pattern values.
+    //
+    switch (ValidatedRule->Match) {
+    case XDP_MATCH_QUIC_FLOW_SRC_CID:
+    case XDP_MATCH_QUIC_FLOW_DST_CID:
+    case XDP_MATCH_TCP_QUIC_FLOW_SRC_CID:
+    case XDP_MATCH_TCP_QUIC_FLOW_DST_CID:
+        Status =
+            XdpProgramValidateQuicFlow(
+                &ValidatedRule->Pattern.QuicFlow, &UserRule->Pattern.QuicFlow);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
+    case XDP_MATCH_UDP_PORT_SET:
+        Status =
+            XdpProgramCapturePortSet(
+                &UserRule->Pattern.PortSet, RequestorMode, &ValidatedRule->Pattern.PortSet);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
+    case XDP_MATCH_IPV4_UDP_PORT_SET:
+    case XDP_MATCH_IPV6_UDP_PORT_SET:
+    case XDP_MATCH_IPV4_TCP_PORT_SET:
+    case XDP_MATCH_IPV6_TCP_PORT_SET:
+        Status =
+            XdpProgramCapturePortSet(
+                &UserRule->Pattern.IpPortSet.PortSet, RequestorMode,
+                &ValidatedRule->Pattern.IpPortSet.PortSet);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        ValidatedRule->Pattern.IpPortSet.Address = UserRule->Pattern.IpPortSet.Address;
+        break;
+    case XDP_MATCH_IPV4_DST_LPM:
+    case XDP_MATCH_IPV4_SRC_LPM:
+        Status =
+            XdpProgramCapturePrefixTable(
+                &UserRule->Pattern.PrefixTable, sizeof(IN_ADDR), RequestorMode,
+                &ValidatedRule->Pattern.PrefixTable);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
+    case XDP_MATCH_IPV6_DST_LPM:
+    case XDP_MATCH_IPV6_SRC_LPM:
+        Status =
+            XdpProgramCapturePrefixTable(
+                &UserRule->Pattern.PrefixTable, sizeof(IN6_ADDR), RequestorMode,
+                &ValidatedRule->Pattern.PrefixTable);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
+    case XDP_MATCH_VLAN_ID:
+        if (UserRule->Pattern.VlanId > XDP_VLAN_ID_MAX) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+        ValidatedRule->Pattern.VlanId = UserRule->Pattern.VlanId;
+        break;
+    case XDP_MATCH_CONNTRACK_TRACK:
+    case XDP_MATCH_CONNTRACK_ESTABLISHED:
+        //
+        // The rule is attached to its interface's connection tracking table
+        // once the program's interface is known.
+        //
+        break;
+    case XDP_MATCH_IPV4_MASKED_TUPLE:
+        Status =
+            XdpProgramCaptureTupleSet(
+                &UserRule->Pattern.TupleSet, sizeof(IN_ADDR), RequestorMode,
+                &ValidatedRule->Pattern.TupleSet);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
+    case XDP_MATCH_IPV6_MASKED_TUPLE:
+        Status =
+            XdpProgramCaptureTupleSet(
+                &UserRule->Pattern.TupleSet, sizeof(IN6_ADDR), RequestorMode,
+                &ValidatedRule->Pattern.TupleSet);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
+    case XDP_MATCH_TUNNEL:
+        Status = XdpProgramValidateTunnel(&UserRule->Pattern.Tunnel);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        ValidatedRule->Pattern.Tunnel = UserRule->Pattern.Tunnel;
+        break;
+    case XDP_MATCH_TUNNEL_IPV4_MASKED_TUPLE:
+    case XDP_MATCH_TUNNEL_IPV6_MASKED_TUPLE:
+        Status = XdpProgramValidateTunnel(&UserRule->Pattern.TunnelTupleSet.Tunnel);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        ValidatedRule->Pattern.TunnelTupleSet.Tunnel = UserRule->Pattern.TunnelTupleSet.Tunnel;
+        Status =
+            XdpProgramCaptureTupleSet(
+                &UserRule->Pattern.TunnelTupleSet.TupleSet,
+                UserRule->Match == XDP_MATCH_TUNNEL_IPV4_MASKED_TUPLE ?
+                    sizeof(IN_ADDR) : sizeof(IN6_ADDR),
+                RequestorMode, &ValidatedRule->Pattern.TunnelTupleSet.TupleSet);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
+    case XDP_MATCH_UDP_PORT_RANGE:
+        Status =
+            XdpProgramCapturePortRangeSet(
+                &UserRule->Pattern.PortRanges, RequestorMode,
+                &ValidatedRule->Pattern.PortRanges);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
+    case XDP_MATCH_IPV4_UDP_PORT_RANGE:
+    case XDP_MATCH_IPV6_UDP_PORT_RANGE:
+    case XDP_MATCH_IPV4_TCP_PORT_RANGE:
+    case XDP_MATCH_IPV6_TCP_PORT_RANGE:
+        Status =
+            XdpProgramCapturePortRangeSet(
+                &UserRule->Pattern.IpPortRanges.PortRanges, RequestorMode,
+                &ValidatedRule->Pattern.IpPortRanges.PortRanges);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        ValidatedRule->Pattern.IpPortRanges.Address = UserRule->Pattern.IpPortRanges.Address;
+        break;
+    case XDP_MATCH_UDP_PAYLOAD:
+    case XDP_MATCH_TCP_PAYLOAD:
+        Status =
+            XdpProgramCapturePayloadMatch(
+                &UserRule->Pattern.Payload, RequestorMode, &ValidatedRule->Pattern.Payload);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
+    default:
+        ValidatedRule->Pattern = UserRule->Pattern;
+        break;
+    }
+
+    if (UserRule->Action < XDP_PROGRAM_ACTION_DROP ||
+        UserRule->Action > XDP_PROGRAM_ACTION_SYN_COOKIE) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    ValidatedRule->Action = UserRule->Action;
+
+    //
+    // Capture object handle references in the context of the calling thread.
+    // The handle will be validated further on the control path.
+    //
+    switch (UserRule->Action) {
+    case XDP_PROGRAM_ACTION_REDIRECT:
+        ValidatedRule->Redirect.TargetType = UserRule->Redirect.TargetType;
+        Status =
+            XdpProgramCaptureRedirectTarget(
+                UserRule->Redirect.TargetType, &UserRule->Redirect.Target,
+                UserRule->Redirect.XskMap, &UserRule->Redirect.InterfaceTx,
+                UserRule->Redirect.QuicLb, RequestorMode, &ValidatedRule->Redirect.Target);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        break;
+
+    case XDP_PROGRAM_ACTION_SAMPLE:
+        if (UserRule->Sample.Rate == 0) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+
+        ValidatedRule->Sample.TargetType = UserRule->Sample.TargetType;
+        ValidatedRule->Sample.Rate = UserRule->Sample.Rate;
+        Status =
+            XdpProgramCaptureRedirectTarget(
+                UserRule->Sample.TargetType, &UserRule->Sample.Target, UserRule->Sample.XskMap,
+                &UserRule->Sample.InterfaceTx, UserRule->Sample.QuicLb, RequestorMode,
+                &ValidatedRule->Sample.Target);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        break;
+
+    case XDP_PROGRAM_ACTION_POLICE:
+        ValidatedRule->Police.PacketsPerSecond = UserRule->Police.PacketsPerSecond;
+        ValidatedRule->Police.BytesPerSecond = UserRule->Police.BytesPerSecond;
+        Status =
+            XdpProgramCreatePolicer(
+                &UserRule->Police, RequestorMode,
+                (XDP_POLICER **)&ValidatedRule->Police.ConformTarget);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        break;
+
+    case XDP_PROGRAM_ACTION_DECAP_REDIRECT:
+        Status = XdpProgramValidateTunnel(&UserRule->DecapRedirect.Tunnel);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        ValidatedRule->DecapRedirect.Tunnel = UserRule->DecapRedirect.Tunnel;
+        ValidatedRule->DecapRedirect.Redirect.TargetType =
+            UserRule->DecapRedirect.Redirect.TargetType;
+        Status =
+            XdpProgramCaptureRedirectTarget(
+                UserRule->DecapRedirect.Redirect.TargetType,
+                &UserRule->DecapRedirect.Redirect.Target,
+                UserRule->DecapRedirect.Redirect.XskMap,
+                &UserRule->DecapRedirect.Redirect.InterfaceTx,
+                UserRule->DecapRedirect.Redirect.QuicLb, RequestorMode,
+                &ValidatedRule->DecapRedirect.Redirect.Target);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        break;
+
+    case XDP_PROGRAM_ACTION_LOAD_BALANCE:
+        Status =
+            XdpProgramCaptureLoadBalancer(
+                &UserRule->LoadBalance, RequestorMode, &ValidatedRule->LoadBalance);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        break;
+
+    case XDP_PROGRAM_ACTION_ENCAP:
+        if ((UserRule->Encap.Flags & ~XDP_ENCAP_FLAG_REDIRECT) != 0) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+
+        Status = XdpProgramCaptureEncap(&UserRule->Encap, RequestorMode, &ValidatedRule->Encap);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        if (UserRule->Encap.Flags & XDP_ENCAP_FLAG_REDIRECT) {
+            ValidatedRule->Encap.Redirect.TargetType = UserRule->Encap.Redirect.TargetType;
+            Status =
+                XdpProgramCaptureRedirectTarget(
+                    UserRule->Encap.Redirect.TargetType, &UserRule->Encap.Redirect.Target,
+                    UserRule->Encap.Redirect.XskMap, &UserRule->Encap.Redirect.InterfaceTx,
+                    UserRule->Encap.Redirect.QuicLb, RequestorMode,
+                    &ValidatedRule->Encap.Redirect.Target);
+            if (!NT_SUCCESS(Status)) {
+                goto Exit;
+            }
+        }
+
+        break;
+
+    case XDP_PROGRAM_ACTION_SYN_COOKIE:
+        if (UserRule->SynCookie.Reserved != NULL) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+
+        ValidatedRule->SynCookie.Mss = UserRule->SynCookie.Mss;
+        Status =
+            XdpProgramCreateSynCookie(
+                UserRule->SynCookie.Mss, (XDP_SYN_COOKIE **)&ValidatedRule->SynCookie.Reserved);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        break;
+
+    case XDP_PROGRAM_ACTION_EBPF:
+        if (RequestorMode != KernelMode) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+
+        //
+        // eBPF actions may follow any native match, so the eBPF program is
+        // invoked only for frames matching the rule.
+        //
+        ValidatedRule->Ebpf.Target = UserRule->Ebpf.Target;
+
+        break;
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        XdpProgramDeleteRule(ValidatedRule);
+    }
+
+    return Status;
+}
+
+static
+NTSTATUS
+XdpProgramAllocateLpmNode(
+    _Inout_ XDP_LPM_TABLE *Table,
+    _Out_ UINT32 *NodeIndex
+    )
+{
+    if (Table->NodeCount == Table->NodeCapacity) {
+        XDP_LPM_NODE *Nodes;
+        UINT32 NodeCapacity;
+
+        if (Table->NodeCapacity >= XDP_LPM_MAX_NODES) {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        NodeCapacity = min(Table->NodeCapacity * 2, XDP_LPM_MAX_NODES);
+        Nodes =
+            ExAllocatePoolZero(
+                NonPagedPoolNx, (SIZE_T)NodeCapacity * sizeof(*Nodes), XDP_POOLTAG_LPM);
+        if (Nodes == NULL) {
+            return STATUS_NO_MEMORY;
+        }
+
+        RtlCopyMemory(Nodes, Table->Nodes, (SIZE_T)Table->NodeCount * sizeof(*Nodes));
+        ExFreePoolWithTag(Table->Nodes, XDP_POOLTAG_LPM);
+        Table->Nodes = Nodes;
+        Table->NodeCapacity = NodeCapacity;
+    }
+
+    *NodeIndex = Table->NodeCount++;
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XdpProgramInsertLpmPrefix(
+    _Inout_ XDP_LPM_TABLE *Table,
+    _In_ const XDP_IP_PREFIX *Prefix,
+    _In_ UINT32 PrefixIndex
+    )
+{
+    NTSTATUS Status;
+    const UINT8 *Address = (const UINT8 *)&Prefix->Address;
+    UINT32 NodeIndex = 0;
+    UINT32 Depth;
+    UINT32 Bits;
+    UINT32 FirstSlot;
+    UINT32 SlotCount;
+
+    if (Prefix->PrefixLength == 0) {
+        Table->DefaultResult = PrefixIndex + 1;
+        return STATUS_SUCCESS;
+    }
+
+    //
+    // Walk to the node holding the final stride of the prefix, creating
+    // nodes along the way, then expand the prefix over every slot it covers.
+    // Prefixes are inserted from shortest to longest, so longer prefixes
+    // overwrite the expansions of shorter ones.
+    //
+    Depth = (Prefix->PrefixLength - 1) / XDP_LPM_STRIDE_BITS;
+    Bits = Prefix->PrefixLength - Depth * XDP_LPM_STRIDE_BITS;
+
+    for (UINT32 i = 0; i < Depth; i++) {
+        UINT32 Child = Table->Nodes[NodeIndex].Slots[Address[i]].Child;
+
+        if (Child == 0) {
+            Status = XdpProgramAllocateLpmNode(Table, &Child);
+            if (!NT_SUCCESS(Status)) {
+                return Status;
+            }
+
+            Table->Nodes[NodeIndex].Slots[Address[i]].Child = Child;
+        }
+
+        NodeIndex = Child;
+    }
+
+    FirstSlot = Address[Depth] & (UINT8)(0xFF << (XDP_LPM_STRIDE_BITS - Bits));
+    SlotCount = 1 << (XDP_LPM_STRIDE_BITS - Bits);
+
+    for (UINT32 i = FirstSlot; i < FirstSlot + SlotCount; i++) {
+        Table->Nodes[NodeIndex].Slots[i].Result = PrefixIndex + 1;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+XdpProgramDeleteLpmTable(
+    _In_ XDP_LPM_TABLE *Table
+    )
+{
+    if (Table->Nodes != NULL) {
+        ExFreePoolWithTag(Table->Nodes, XDP_POOLTAG_LPM);
+    }
+
+    ExFreePoolWithTag(Table, XDP_POOLTAG_LPM);
+}
+
+NTSTATUS
+XdpProgramCreateLpmTable(
+    _In_ UINT32 AddressLength,
+    _In_reads_(PrefixCount) const XDP_IP_PREFIX *Prefixes,
+    _In_ UINT32 PrefixCount,
+    _Out_ XDP_LPM_TABLE **Table
+    )
+{
+    NTSTATUS Status;
+    XDP_LPM_TABLE *NewTable = NULL;
+    SIZE_T AllocationSize;
+    UINT32 MaxPrefixLength = AddressLength * 8;
+
+    ASSERT(AddressLength == sizeof(IN_ADDR) || AddressLength == sizeof(IN6_ADDR));
+
+    if (PrefixCount == 0 || PrefixCount > XDP_IP_PREFIX_TABLE_MAX_PREFIXES) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    for (UINT32 i = 0; i < PrefixCount; i++) {
+        if (Prefixes[i].PrefixLength > MaxPrefixLength ||
+            Prefixes[i].Action < XDP_IP_PREFIX_ACTION_RULE ||
+            Prefixes[i].Action > XDP_IP_PREFIX_ACTION_SKIP) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+    }
+
+    Status =
+        RtlSizeTAdd(
+            FIELD_OFFSET(XDP_LPM_TABLE, Actions), PrefixCount * sizeof(UINT8),
+            &AllocationSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    NewTable = ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, XDP_POOLTAG_LPM);
+    if (NewTable == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    NewTable->AddressLength = AddressLength;
+    NewTable->PrefixCount = PrefixCount;
+    NewTable->NodeCapacity = 16;
+    NewTable->Nodes =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, NewTable->NodeCapacity * sizeof(*NewTable->Nodes), XDP_POOLTAG_LPM);
+    if (NewTable->Nodes == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    //
+    // The root node.
+    //
+    NewTable->NodeCount = 1;
+
+    for (UINT32 i = 0; i < PrefixCount; i++) {
+        NewTable->Actions[i] = (UINT8)Prefixes[i].Action;
+    }
+
+    for (UINT32 PrefixLength = 0; PrefixLength <= MaxPrefixLength; PrefixLength++) {
+        for (UINT32 i = 0; i < PrefixCount; i++) {
+            if (Prefixes[i].PrefixLength != PrefixLength) {
+                continue;
+            }
+
+            Status = XdpProgramInsertLpmPrefix(NewTable, &Prefixes[i], i);
+            if (!NT_SUCCESS(Status)) {
+                goto Exit;
+            }
+        }
+    }
+
+    *Table = NewTable;
+    NewTable = NULL;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (NewTable != NULL) {
+        XdpProgramDeleteLpmTable(NewTable);
+    }
+
+    return Status;
+}
+
+static
+VOID
+XdpProgramTupleToFlowKey(
+    _In_ const XDP_FIVE_TUPLE *Tuple,
+    _In_ UINT32 AddressLength,
+    _Out_ XDP_EBPF_FLOW_KEY *Key
+    )
+{
+    RtlZeroMemory(Key, sizeof(*Key));
+    RtlCopyMemory(&Key->SourceAddress, &Tuple->SourceAddress, AddressLength);
+    RtlCopyMemory(&Key->DestinationAddress, &Tuple->DestinationAddress, AddressLength);
+    Key->SourcePort = Tuple->SourcePort;
+    Key->DestinationPort = Tuple->DestinationPort;
+    Key->IpProto = Tuple->Protocol;
+}
+
+static
+UINT32
+XdpProgramFindTupleGroup(
+    _In_ const XDP_TUPLE_TABLE *Table,
+    _In_ const XDP_EBPF_FLOW_KEY *Mask
+    )
+{
+    UINT32 GroupIndex;
+
+    for (GroupIndex = 0; GroupIndex < Table->GroupCount; GroupIndex++) {
+        if (RtlEqualMemory(&Table->Groups[GroupIndex].Mask, Mask, sizeof(*Mask))) {
+            break;
+        }
+    }
+
+    return GroupIndex;
+}
+
+VOID
+XdpProgramDeleteTupleTable(
+    _In_ XDP_TUPLE_TABLE *Table
+    )
+{
+    if (Table->Slots != NULL) {
+        ExFreePoolWithTag(Table->Slots, XDP_POOLTAG_TUPLE_TABLE);
+    }
+
+    ExFreePoolWithTag(Table, XDP_POOLTAG_TUPLE_TABLE);
+}
+
+NTSTATUS
+XdpProgramCreateTupleTable(
+    _In_ UINT32 AddressLength,
+    _In_reads_(TupleCount) const XDP_MASKED_TUPLE *Tuples,
+    _In_ UINT32 TupleCount,
+    _Out_ XDP_TUPLE_TABLE **Table
+    )
+{
+    NTSTATUS Status;
+    XDP_TUPLE_TABLE *NewTable = NULL;
+    XDP_EBPF_FLOW_KEY Mask;
+    XDP_EBPF_FLOW_KEY Key;
+    UINT32 SlotCount = 0;
+
+    ASSERT(AddressLength == sizeof(IN_ADDR) || AddressLength == sizeof(IN6_ADDR));
+
+    if (TupleCount == 0 || TupleCount > XDP_MASKED_TUPLE_SET_MAX_TUPLES) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    NewTable = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*NewTable), XDP_POOLTAG_TUPLE_TABLE);
+    if (NewTable == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    NewTable->AddressLength = AddressLength;
+
+    //
+    // Group the tuples by mask.
+    //
+    for (UINT32 i = 0; i < TupleCount; i++) {
+        UINT32 GroupIndex;
+
+        if (Tuples[i].Mask.Protocol != 0 &&
+            Tuples[i].Tuple.Protocol != IPPROTO_TCP && Tuples[i].Tuple.Protocol != IPPROTO_UDP) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+
+        XdpProgramTupleToFlowKey(&Tuples[i].Mask, AddressLength, &Mask);
+        GroupIndex = XdpProgramFindTupleGroup(NewTable, &Mask);
+
+        if (GroupIndex == NewTable->GroupCount) {
+            if (NewTable->GroupCount == RTL_NUMBER_OF(NewTable->Groups)) {
+                Status = STATUS_INVALID_PARAMETER;
+                goto Exit;
+            }
+
+            NewTable->Groups[NewTable->GroupCount++].Mask = Mask;
+        }
+
+        NewTable->Groups[GroupIndex].TupleCount++;
+    }
+
+    //
+    // Size each group's hash table to at most half full.
+    //
+    for (UINT32 GroupIndex = 0; GroupIndex < NewTable->GroupCount; GroupIndex++) {
+        XDP_TUPLE_TABLE_GROUP *Group = &NewTable->Groups[GroupIndex];
+        UINT32 GroupSlotCount = 2;
+
+        while (GroupSlotCount < Group->TupleCount * 2) {
+            GroupSlotCount *= 2;
+        }
+
+        Group->SlotOffset = SlotCount;
+        Group->SlotMask = GroupSlotCount - 1;
+        SlotCount += GroupSlotCount;
+    }
+
+    NewTable->Slots =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, (SIZE_T)SlotCount * sizeof(*NewTable->Slots),
+            XDP_POOLTAG_TUPLE_TABLE);
+    if (NewTable->Slots == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    for (UINT32 i = 0; i < TupleCount; i++) {
+        XDP_TUPLE_TABLE_GROUP *Group;
+        XDP_TUPLE_TABLE_SLOT *Slots;
+        XDP_EBPF_FLOW_KEY MaskedKey;
+        UINT32 Hash;
+        UINT32 Probe;
+
+        XdpProgramTupleToFlowKey(&Tuples[i].Mask, AddressLength, &Mask);
+        XdpProgramTupleToFlowKey(&Tuples[i].Tuple, AddressLength, &Key);
+        Group = &NewTable->Groups[XdpProgramFindTupleGroup(NewTable, &Mask)];
+        Slots = &NewTable->Slots[Group->SlotOffset];
+
+        XdpTupleTableMaskKey(&Key, &Mask, &MaskedKey);
+        Hash = XdpProgramHashUpdate(XDP_PROGRAM_HASH_BASIS, &MaskedKey, sizeof(MaskedKey));
+
+        for (Probe = Hash & Group->SlotMask;
+            Slots[Probe].Valid;
+            Probe = (Probe + 1) & Group->SlotMask) {
+            if (Slots[Probe].Hash == Hash &&
+                RtlEqualMemory(&Slots[Probe].Key, &MaskedKey, sizeof(MaskedKey))) {
+                break;
+            }
+        }
+
+        Slots[Probe].Hash = Hash;
+        Slots[Probe].Valid = TRUE;
+        Slots[Probe].Key = MaskedKey;
+    }
+
+    *Table = NewTable;
+    NewTable = NULL;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (NewTable != NULL) {
+        XdpProgramDeleteTupleTable(NewTable);
+    }
+
+    return Status;
+}
+
+VOID
+XdpProgramDeleteLoadBalancer(
+    _In_ XDP_LOAD_BALANCER *LoadBalancer
+    )
+{
+    ExFreePoolWithTag(LoadBalancer, XDP_POOLTAG_LOAD_BALANCER);
+}
+
+NTSTATUS
+XdpProgramCreateLoadBalancer(
+    _In_reads_(BackendCount) const XDP_LOAD_BALANCER_BACKEND *Backends,
+    _In_ UINT32 BackendCount,
+    _In_ UINT32 Flags,
+    _Out_ XDP_LOAD_BALANCER **LoadBalancer
+    )
+{
+    NTSTATUS Status;
+    XDP_LOAD_BALANCER *NewLoadBalancer = NULL;
+    UINT32 *Positions = NULL;
+    UINT32 *Skips = NULL;
+    UINT8 *SlotBitmap = NULL;
+    UINT32 SlotsFilled = 0;
+
+    C_ASSERT(XDP_LOAD_BALANCER_MAX_BACKENDS <= MAXUINT8 + 1);
+
+    if (BackendCount == 0 || BackendCount > XDP_LOAD_BALANCER_MAX_BACKENDS ||
+        (Flags & ~XDP_LOAD_BALANCE_FLAG_REWRITE_IP) != 0) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    NewLoadBalancer =
+        ExAllocatePoolZero(NonPagedPoolNx, sizeof(*NewLoadBalancer), XDP_POOLTAG_LOAD_BALANCER);
+    Positions =
+        ExAllocatePoolZero(
+            PagedPool, sizeof(*Positions) * BackendCount, XDP_POOLTAG_LOAD_BALANCER);
+    Skips =
+        ExAllocatePoolZero(PagedPool, sizeof(*Skips) * BackendCount, XDP_POOLTAG_LOAD_BALANCER);
+    SlotBitmap =
+        ExAllocatePoolZero(
+            PagedPool, (XDP_LOAD_BALANCER_TABLE_SIZE + 7) / 8, XDP_POOLTAG_LOAD_BALANCER);
+    if (NewLoadBalancer == NULL || Positions == NULL || Skips == NULL || SlotBitmap == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    NewLoadBalancer->Flags = Flags;
+    NewLoadBalancer->BackendCount = BackendCount;
+    RtlCopyMemory(NewLoadBalancer->Backends, Backends, sizeof(*Backends) * BackendCount);
+
+    //
+    // Each backend's permutation visits the slots starting at an offset and
+    // stepping by a skip, both derived from the backend's addresses. The table
+    // size is prime, so every nonzero skip visits every slot. The structure's
+    // padding is not hashed, so identical backends permute identically.
+    //
+    for (UINT32 i = 0; i < BackendCount; i++) {
+        UINT32 Hash = XDP_PROGRAM_HASH_BASIS;
+
+        Hash =
+            XdpProgramHashUpdate(
+                Hash, Backends[i].EthernetAddress, sizeof(Backends[i].EthernetAddress));
+        Hash = XdpProgramHashUpdate(Hash, &Backends[i].IpAddress, sizeof(Backends[i].IpAddress));
+        Positions[i] = Hash % XDP_LOAD_BALANCER_TABLE_SIZE;
+
+        Hash = XdpProgramHashUpdate(Hash, &Hash, sizeof(Hash));
+        Skips[i] = Hash % (XDP_LOAD_BALANCER_TABLE_SIZE - 1) + 1;
+    }
+
+    while (SlotsFilled < XDP_LOAD_BALANCER_TABLE_SIZE) {
+        for (UINT32 i = 0; i < BackendCount && SlotsFilled < XDP_LOAD_BALANCER_TABLE_SIZE; i++) {
+            UINT32 Slot = Positions[i];
+
+            while ((SlotBitmap[Slot >> 3] >> (Slot & 0x7)) & 0x1) {
+                Slot = (Slot + Skips[i]) % XDP_LOAD_BALANCER_TABLE_SIZE;
+            }
+
+            SlotBitmap[Slot >> 3] |= (UINT8)(1 << (Slot & 0x7));
+            NewLoadBalancer->Lookup[Slot] = (UINT8)i;
+            Positions[i] = (Slot + Skips[i]) % XDP_LOAD_BALANCER_TABLE_SIZE;
+            SlotsFilled++;
+        }
+    }
+
+    *LoadBalancer = NewLoadBalancer;
+    NewLoadBalancer = NULL;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (SlotBitmap != NULL) {
+        ExFreePoolWithTag(SlotBitmap, XDP_POOLTAG_LOAD_BALANCER);
+    }
+
+    if (Skips != NULL) {
+        ExFreePoolWithTag(Skips, XDP_POOLTAG_LOAD_BALANCER);
+    }
+
+    if (Positions != NULL) {
+        ExFreePoolWithTag(Positions, XDP_POOLTAG_LOAD_BALANCER);
+    }
+
+    if (NewLoadBalancer != NULL) {
+        XdpProgramDeleteLoadBalancer(NewLoadBalancer);
+    }
+
+    return Status;
+}
+
+VOID
+XdpProgramDeleteSynCookie(
+    _In_ XDP_SYN_COOKIE *SynCookie
+    )
+{
+    RtlSecureZeroMemory(SynCookie->Key, sizeof(SynCookie->Key));
+    ExFreePoolWithTag(SynCookie, XDP_POOLTAG_SYN_COOKIE);
+}
+
+NTSTATUS
+XdpProgramCreateSynCookie(
+    _In_ UINT16 Mss,
+    _Out_ XDP_SYN_COOKIE **SynCookie
+    )
+{
+    NTSTATUS Status;
+    XDP_SYN_COOKIE *NewSynCookie = NULL;
+
+    if (Mss == 0) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    NewSynCookie =
+        ExAllocatePoolZero(NonPagedPoolNx, sizeof(*NewSynCookie), XDP_POOLTAG_SYN_COOKIE);
+    if (NewSynCookie == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Status =
+        BCryptGenRandom(
+            NULL, NewSynCookie->Key, sizeof(NewSynCookie->Key),
+            BCRYPT_USE_SYSTEM_PREFERRED_RNG);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    NewSynCookie->Mss = htons(Mss);
+
+    *SynCookie = NewSynCookie;
+    NewSynCookie = NULL;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (NewSynCookie != NULL) {
+        XdpProgramDeleteSynCookie(NewSynCookie);
+    }
+
+    return Status;
+}
+
+VOID
+XdpProgramDeleteEncapsulator(
+    _In_ XDP_ENCAPSULATOR *Encapsulator
+    )
+{
+    ExFreePoolWithTag(Encapsulator, XDP_POOLTAG_ENCAP);
+}
+
+NTSTATUS
+XdpProgramCreateEncapsulator(
+    _In_ XDP_ENCAP_TYPE Type,
+    _In_reads_bytes_(HeaderLength) const UINT8 *Header,
+    _In_ UINT32 HeaderLength,
+    _Out_ XDP_ENCAPSULATOR **Encapsulator
+    )
+{
+    NTSTATUS Status;
+    XDP_ENCAPSULATOR *NewEncapsulator = NULL;
+    const ETHERNET_HEADER *EthHdr;
+    UINT32 Offset = sizeof(*EthHdr);
+    UINT8 IpProto;
+
+    if (HeaderLength < sizeof(*EthHdr) || HeaderLength > XDP_ENCAP_MAX_HEADER_LENGTH) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    NewEncapsulator =
+        ExAllocatePoolZero(NonPagedPoolNx, sizeof(*NewEncapsulator), XDP_POOLTAG_ENCAP);
+    if (NewEncapsulator == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    NewEncapsulator->Type = Type;
+    NewEncapsulator->HeaderLength = HeaderLength;
+    RtlCopyMemory(NewEncapsulator->Header, Header, HeaderLength);
+
+    //
+    // The template's headers must exactly fill it, and must not carry fields
+    // that would have to be computed for each frame beyond those the data path
+    // sets.
+    //
+    Status = STATUS_INVALID_PARAMETER;
+    EthHdr = (const ETHERNET_HEADER *)NewEncapsulator->Header;
+
+    if (EthHdr->Type == htons(ETHERNET_TYPE_IPV4)) {
+        const IPV4_HEADER *Ip4Hdr = (const IPV4_HEADER *)&NewEncapsulator->Header[Offset];
+
+        if (HeaderLength < Offset + sizeof(*Ip4Hdr) ||
+            Ip4Hdr->VersionAndHeaderLength != ((4 << 4) | (sizeof(*Ip4Hdr) >> 2))) {
+            goto Exit;
+        }
+
+        IpProto = Ip4Hdr->Protocol;
+        Offset += sizeof(*Ip4Hdr);
+    } else if (EthHdr->Type == htons(ETHERNET_TYPE_IPV6)) {
+        const IPV6_HEADER *Ip6Hdr = (const IPV6_HEADER *)&NewEncapsulator->Header[Offset];
+
+        if (HeaderLength < Offset + sizeof(*Ip6Hdr) ||
+            (NewEncapsulator->Header[Offset] >> 4) != 6) {
+            goto Exit;
+        }
+
+        NewEncapsulator->Ipv6 = TRUE;
+        IpProto = Ip6Hdr->NextHeader;
+        Offset += sizeof(*Ip6Hdr);
+    } else {
+        goto Exit;
+    }
+
+    NewEncapsulator->TransportOffset = Offset;
+
+    switch (Type) {
+    case XDP_ENCAP_TYPE_VXLAN:
+    {
+        const XDP_VXLAN_HEADER *VxlanHdr;
+
+        if (IpProto != IPPROTO_UDP ||
+            HeaderLength != Offset + sizeof(UDP_HDR) + sizeof(*VxlanHdr)) {
+            goto Exit;
+        }
+
+        VxlanHdr = (const XDP_VXLAN_HEADER *)&NewEncapsulator->Header[Offset + sizeof(UDP_HDR)];
+        if ((VxlanHdr->Flags & XDP_VXLAN_FLAG_VNI) == 0) {
+            goto Exit;
+        }
+
+        break;
+    }
+
+    case XDP_ENCAP_TYPE_GRE:
+    {
+        const XDP_GRE_HEADER *GreHdr;
+        UINT32 GreLength = sizeof(*GreHdr);
+
+        if (IpProto != IPPROTO_GRE || HeaderLength < Offset + sizeof(*GreHdr)) {
+            goto Exit;
+        }
+
+        //
+        // Only a key may follow the base header: checksums and sequence
+        // numbers would differ for each frame.
+        //
+        GreHdr = (const XDP_GRE_HEADER *)&NewEncapsulator->Header[Offset];
+        if ((GreHdr->Flags & ~XDP_GRE_FLAG_KEY) != 0 || GreHdr->Version != 0) {
+            goto Exit;
+        }
+
+        if (GreHdr->Flags & XDP_GRE_FLAG_KEY) {
+            GreLength += sizeof(UINT32);
+        }
+
+        if (HeaderLength != Offset + GreLength) {
+            goto Exit;
+        }
+
+        NewEncapsulator->ReplaceInnerEthernet =
+            GreHdr->ProtocolType != htons(XDP_GRE_PROTOCOL_ETHERNET);
+        break;
+    }
+
+    case XDP_ENCAP_TYPE_IP_IN_IP:
+        //
+        // The outer IP protocol is set from each inner frame.
+        //
+        if (HeaderLength != Offset) {
+            goto Exit;
+        }
+
+        NewEncapsulator->TransportOffset = 0;
+        NewEncapsulator->ReplaceInnerEthernet = TRUE;
+        break;
+
+    default:
+        goto Exit;
+    }
+
+    *Encapsulator = NewEncapsulator;
+    NewEncapsulator = NULL;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (NewEncapsulator != NULL) {
+        XdpProgramDeleteEncapsulator(NewEncapsulator);
+    }
+
+    return Status;
+}
+
+static
+VOID
+XdpProgramSiftDownPortRange(
+    _Inout_updates_(RangeCount) XDP_PORT_RANGE *Ranges,
+    _In_ UINT32 RangeCount,
+    _In_ UINT32 Index
+    )
+{
+    for (;;) {
+        UINT32 Largest = Index;
+        UINT32 Child = Index * 2 + 1;
+
+        for (UINT32 i = Child; i < Child + 2 && i < RangeCount; i++) {
+            if (Ranges[i].LowPort > Ranges[Largest].LowPort) {
+                Largest = i;
+            }
+        }
+
+        if (Largest == Index) {
+            break;
+        }
+
+        XDP_PORT_RANGE Range = Ranges[Index];
+        Ranges[Index] = Ranges[Largest];
+        Ranges[Largest] = Range;
+        Index = Largest;
+    }
+}
+
+static
+VOID
+XdpProgramSortPortRanges(
+    _Inout_updates_(RangeCount) XDP_PORT_RANGE *Ranges,
+    _In_ UINT32 RangeCount
+    )
+{
+    //
+    // Heapsort by low port: in place and O(n log n) for any input, since
+    // range sets are user-supplied.
+    //
+    for (UINT32 i = RangeCount / 2; i > 0; i--) {
+        XdpProgramSiftDownPortRange(Ranges, RangeCount, i - 1);
+    }
+
+    for (UINT32 i = RangeCount; i > 1; i--) {
+        XDP_PORT_RANGE Range = Ranges[0];
+        Ranges[0] = Ranges[i - 1];
+        Ranges[i - 1] = Range;
+        XdpProgramSiftDownPortRange(Ranges, i - 1, 0);
+    }
+}
+
+VOID
+XdpProgramDeletePortRangeTable(
+    _In_ XDP_PORT_RANGE_TABLE *Table
+    )
+{
+    ExFreePoolWithTag(Table, XDP_POOLTAG_PORT_RANGE);
+}
+
+VOID
+XdpProgramDeleteXskMap(
+    _In_ XDP_XSK_MAP_TABLE *Table
+    )
+{
+    for (UINT32 Index = 0; Index < Table->SocketCount; Index++) {
+        if (Table->Sockets[Index] != NULL) {
+            XskDereferenceDatapathHandle(Table->Sockets[Index]);
+        }
+    }
+
+    ExFreePoolWithTag(Table, XDP_POOLTAG_XSK_MAP);
+}
+
+VOID
+XdpProgramDeleteQuicLbTable(
+    _In_ XDP_QUIC_LB_TABLE *Table
+    )
+{
+    for (UINT32 Index = 0; Index < Table->ServerCount; Index++) {
+        if (Table->Servers[Index].Socket != NULL) {
+            XskDereferenceDatapathHandle(Table->Servers[Index].Socket);
+        }
+    }
+
+    if (Table->Key != NULL) {
+        BCryptDestroyKey(Table->Key);
+    }
+
+    if (Table->Algorithm != NULL) {
+        BCryptCloseAlgorithmProvider(Table->Algorithm, 0);
+    }
+
+    if (Table->KeyObject != NULL) {
+        ExFreePoolWithTag(Table->KeyObject, XDP_POOLTAG_QUIC_LB);
+    }
+
+    ExFreePoolWithTag(Table, XDP_POOLTAG_QUIC_LB);
+}
+
+NTSTATUS
+XdpProgramCreateQuicLbTable(
+    _In_ const XDP_QUIC_LB *Config,
+    _In_reads_(Config->ServerCount) const XDP_QUIC_LB_SERVER *Servers,
+    _Out_ XDP_QUIC_LB_TABLE **Table
+    )
+{
+    NTSTATUS Status;
+    XDP_QUIC_LB_TABLE *NewTable = NULL;
+    UINT32 SlotCount;
+    SIZE_T ServersSize;
+    SIZE_T TableSize;
+
+    C_ASSERT(XDP_QUIC_LB_MAX_SERVERS < XDP_QUIC_LB_SLOT_EMPTY);
+
+    *Table = NULL;
+
+    if (Config->ConfigId > XDP_QUIC_LB_MAX_CONFIG_ID ||
+        (Config->Flags & ~XDP_QUIC_LB_FLAG_ENCRYPTED) != 0 ||
+        Config->ServerIdLength == 0 ||
+        Config->ServerIdLength > XDP_QUIC_LB_MAX_SERVER_ID_LENGTH ||
+        Config->ServerCount == 0 || Config->ServerCount > XDP_QUIC_LB_MAX_SERVERS) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    //
+    // Only the single-pass encryption algorithm is implemented, which requires
+    // the server ID and nonce to fill exactly one AES block.
+    //
+    if ((Config->Flags & XDP_QUIC_LB_FLAG_ENCRYPTED) &&
+        (UINT32)Config->ServerIdLength + Config->NonceLength != XDP_QUIC_LB_KEY_LENGTH) {
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    //
+    // Keep the open-addressed server ID table at most half full.
+    //
+    SlotCount = 1;
+    while (SlotCount < Config->ServerCount * 2) {
+        SlotCount <<= 1;
+    }
+
+    ServersSize = sizeof(NewTable->Servers[0]) * Config->ServerCount;
+    TableSize =
+        sizeof(*NewTable) + ServersSize + sizeof(NewTable->Slots[0]) * SlotCount;
+
+    NewTable = ExAllocatePoolZero(NonPagedPoolNx, TableSize, XDP_POOLTAG_QUIC_LB);
+    if (NewTable == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    NewTable->ConfigId = Config->ConfigId;
+    NewTable->ServerIdLength = Config->ServerIdLength;
+    NewTable->ServerCount = Config->ServerCount;
+    NewTable->SlotMask = SlotCount - 1;
+    NewTable->Slots = (UINT16 *)((UCHAR *)NewTable->Servers + ServersSize);
+
+    for (UINT32 Slot = 0; Slot < SlotCount; Slot++) {
+        NewTable->Slots[Slot] = XDP_QUIC_LB_SLOT_EMPTY;
+    }
+
+    //
+    // Sockets are referenced by the caller; unreferenced entries remain NULL
+    // so a partially referenced table can be deleted on failure.
+    //
+    for (UINT32 Index = 0; Index < Config->ServerCount; Index++) {
+        UINT32 Slot;
+
+        RtlCopyMemory(
+            NewTable->Servers[Index].ServerId, Servers[Index].ServerId,
+            Config->ServerIdLength);
+
+        for (Slot =
+                XdpProgramHashUpdate(
+                    XDP_PROGRAM_HASH_BASIS, Servers[Index].ServerId, Config->ServerIdLength) &
+                    NewTable->SlotMask;
+            NewTable->Slots[Slot] != XDP_QUIC_LB_SLOT_EMPTY;
+            Slot = (Slot + 1) & NewTable->SlotMask) {
+            if (RtlEqualMemory(
+                    NewTable->Servers[NewTable->Slots[Slot]].ServerId,
+                    Servers[Index].ServerId, Config->ServerIdLength)) {
+                Status = STATUS_INVALID_PARAMETER;
+                goto Exit;
+            }
+        }
+
+        NewTable->Slots[Slot] = (UINT16)Index;
+    }
+
+    *Table = NewTable;
+    NewTable = NULL;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (NewTable != NULL) {
+        XdpProgramDeleteQuicLbTable(NewTable);
+    }
+
+    return Status;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramAgeConntrackTable(
+    _Inout_ XDP_CONNTRACK_TABLE *Table
+    )
+{
+    UINT64 Now = KeQueryInterruptTime();
+
+    for (UINT32 Index = 0; Index <= Table->EntryMask; Index++) {
+        XDP_CONNTRACK_ENTRY *Entry = &Table->Entries[Index];
+        LONG Sequence = ReadAcquire(&Entry->Sequence);
+        UINT64 LastSeen = (UINT64)ReadNoFence64(&Entry->LastSeen);
+
+        if ((Sequence & 1) != 0 || LastSeen == 0 || Now - LastSeen < Table->IdleTimeout ||
+            InterlockedCompareExchange(&Entry->Sequence, Sequence + 1, Sequence) != Sequence) {
+            continue;
+        }
+
+        //
+        // The flow may have been refreshed before the entry was claimed.
+        //
+        if (Now - (UINT64)ReadNoFence64(&Entry->LastSeen) >= Table->IdleTimeout) {
+            Entry->Hash = 0;
+            RtlZeroMemory(&Entry->Key, sizeof(Entry->Key));
+            WriteNoFence64(&Entry->LastSeen, 0);
+        }
+
+        InterlockedIncrement(&Entry->Sequence);
+    }
+}
+
+VOID
+XdpProgramDeletePolicer(
+    _In_ XDP_POLICER *Policer
+    )
+{
+    if (Policer->ConformTarget != NULL) {
+        XskDereferenceDatapathHandle(Policer->ConformTarget);
+    }
+
+    ExFreePoolWithTag(Policer, XDP_POOLTAG_POLICER);
+}
+
+VOID
+XdpProgramDeletePayloadPatternTable(
+    _In_ XDP_PAYLOAD_PATTERN_TABLE *Table
+    )
+{
+    ExFreePoolWithTag(Table, XDP_POOLTAG_PAYLOAD_PATTERN);
+}
+
+NTSTATUS
+XdpProgramCreatePayloadPatternTable(
+    _In_ const XDP_PAYLOAD_PATTERN *Pattern,
+    _Out_ XDP_PAYLOAD_PATTERN_TABLE **Table
+    )
+{
+    XDP_PAYLOAD_PATTERN_TABLE *NewTable;
 
-        switch (Rule->Redirect.TargetType) {
+    *Table = NULL;
 
-        case XDP_REDIRECT_TARGET_TYPE_XSK:
-            if (Rule->Redirect.Target != NULL) {
-                XskDereferenceDatapathHandle(Rule->Redirect.Target);
-                Rule->Redirect.Target = NULL;
-            }
-            break;
+    if (Pattern->Length == 0 || Pattern->Length > XDP_PAYLOAD_PATTERN_MAX_LENGTH) {
+        return STATUS_INVALID_PARAMETER;
+    }
 
-        default:
-            ASSERT(FALSE);
-        }
+    NewTable = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*NewTable), XDP_POOLTAG_PAYLOAD_PATTERN);
+    if (NewTable == NULL) {
+        return STATUS_NO_MEMORY;
     }
+
+    NewTable->Offset = Pattern->Offset;
+    NewTable->Length = Pattern->Length;
+
+    for (UINT32 i = 0; i < Pattern->Length; i++) {
+        NewTable->Mask[i] = Pattern->Mask[i];
+        NewTable->Value[i] = Pattern->Value[i] & Pattern->Mask[i];
+    }
+
+    *Table = NewTable;
+    return STATUS_SUCCESS;
 }
 
 NTSTATUS
-XdpProgramValidateQuicFlow(
-    _Out_ XDP_QUIC_FLOW *ValidatedFlow,
-    _In_ const XDP_QUIC_FLOW *UserFlow
+XdpProgramCreatePortRangeTable(
+    _In_reads_(RangeCount) XDP_PORT_RANGE *Ranges,
+    _In_ UINT32 RangeCount,
+    _Out_ XDP_PORT_RANGE_TABLE **Table
     )
 {
     NTSTATUS Status;
-    UINT32 TotalSize;
+    XDP_PORT_RANGE_TABLE *NewTable = NULL;
+    UINT32 MergedCount;
+    SIZE_T AllocationSize;
 
-    RtlZeroMemory(ValidatedFlow, sizeof(*ValidatedFlow));
+    if (RangeCount == 0 || RangeCount > XDP_PORT_RANGE_SET_MAX_RANGES) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
 
-    Status = RtlUInt32Add(UserFlow->CidOffset, UserFlow->CidLength, &TotalSize);
+    for (UINT32 i = 0; i < RangeCount; i++) {
+        if (Ranges[i].LowPort > Ranges[i].HighPort) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+    }
+
+    //
+    // Sort the ranges, then coalesce overlapping and adjacent ranges in place
+    // so the table holds disjoint ranges in ascending order.
+    //
+    XdpProgramSortPortRanges(Ranges, RangeCount);
+
+    MergedCount = 1;
+    for (UINT32 i = 1; i < RangeCount; i++) {
+        XDP_PORT_RANGE *Last = &Ranges[MergedCount - 1];
+
+        if ((UINT32)Ranges[i].LowPort <= (UINT32)Last->HighPort + 1) {
+            Last->HighPort = max(Last->HighPort, Ranges[i].HighPort);
+        } else {
+            Ranges[MergedCount++] = Ranges[i];
+        }
+    }
+
+    Status =
+        RtlSizeTAdd(
+            FIELD_OFFSET(XDP_PORT_RANGE_TABLE, Ranges), MergedCount * sizeof(*Ranges),
+            &AllocationSize);
     if (!NT_SUCCESS(Status)) {
-        Status = STATUS_INVALID_PARAMETER;
         goto Exit;
     }
 
-    if (TotalSize > RTL_FIELD_SIZE(XDP_QUIC_FLOW, CidData)) {
-        Status = STATUS_INVALID_PARAMETER;
+    NewTable = ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, XDP_POOLTAG_PORT_RANGE);
+    if (NewTable == NULL) {
+        Status = STATUS_NO_MEMORY;
         goto Exit;
     }
 
-    *ValidatedFlow = *UserFlow;
+    NewTable->RangeCount = MergedCount;
+    RtlCopyMemory(NewTable->Ranges, Ranges, MergedCount * sizeof(*Ranges));
+
+    *Table = NewTable;
+    Status = STATUS_SUCCESS;
 
 Exit:
 
     return Status;
 }
 
+static
+BOOLEAN
+XdpProgramIsIndexableRule(
+    _In_ const XDP_RULE *Rule
+    )
+{
+    switch (Rule->Match) {
+    case XDP_MATCH_UDP_DST:
+    case XDP_MATCH_TCP_DST:
+    case XDP_MATCH_IPV4_UDP_TUPLE:
+    case XDP_MATCH_IPV6_UDP_TUPLE:
+    case XDP_MATCH_IPV4_TCP_TUPLE:
+    case XDP_MATCH_IPV6_TCP_TUPLE:
+    case XDP_MATCH_QUIC_FLOW_SRC_CID:
+    case XDP_MATCH_QUIC_FLOW_DST_CID:
+    case XDP_MATCH_TCP_QUIC_FLOW_SRC_CID:
+    case XDP_MATCH_TCP_QUIC_FLOW_DST_CID:
+        return TRUE;
+
+    default:
+        return FALSE;
+    }
+}
+
+static
+BOOLEAN
+XdpProgramIsSameSegment(
+    _In_ const XDP_RULE *SegmentRule,
+    _In_ const XDP_RULE *Rule
+    )
+{
+    if (SegmentRule->Match != Rule->Match) {
+        return FALSE;
+    }
+
+    switch (Rule->Match) {
+    case XDP_MATCH_QUIC_FLOW_SRC_CID:
+    case XDP_MATCH_QUIC_FLOW_DST_CID:
+    case XDP_MATCH_TCP_QUIC_FLOW_SRC_CID:
+    case XDP_MATCH_TCP_QUIC_FLOW_DST_CID:
+        //
+        // The frame's key is extracted once per segment, so every QUIC flow
+        // rule in a segment must describe the same port and CID window.
+        //
+        return
+            SegmentRule->Pattern.QuicFlow.UdpPort == Rule->Pattern.QuicFlow.UdpPort &&
+            SegmentRule->Pattern.QuicFlow.CidOffset == Rule->Pattern.QuicFlow.CidOffset &&
+            SegmentRule->Pattern.QuicFlow.CidLength == Rule->Pattern.QuicFlow.CidLength;
+
+    default:
+        return TRUE;
+    }
+}
+
+static
+UINT32
+XdpProgramHashRule(
+    _In_ const XDP_RULE *Rule
+    )
+{
+    switch (Rule->Match) {
+    case XDP_MATCH_UDP_DST:
+    case XDP_MATCH_TCP_DST:
+        return
+            XdpProgramHashUpdate(
+                XDP_PROGRAM_HASH_BASIS, &Rule->Pattern.Port, sizeof(Rule->Pattern.Port));
+
+    case XDP_MATCH_IPV4_UDP_TUPLE:
+    case XDP_MATCH_IPV4_TCP_TUPLE:
+        return
+            XdpProgramHashTuple(
+                &Rule->Pattern.Tuple.SourceAddress.Ipv4,
+                &Rule->Pattern.Tuple.DestinationAddress.Ipv4, sizeof(IN_ADDR),
+                Rule->Pattern.Tuple.SourcePort, Rule->Pattern.Tuple.DestinationPort);
+
+    case XDP_MATCH_IPV6_UDP_TUPLE:
+    case XDP_MATCH_IPV6_TCP_TUPLE:
+        return
+            XdpProgramHashTuple(
+                &Rule->Pattern.Tuple.SourceAddress.Ipv6,
+                &Rule->Pattern.Tuple.DestinationAddress.Ipv6, sizeof(IN6_ADDR),
+                Rule->Pattern.Tuple.SourcePort, Rule->Pattern.Tuple.DestinationPort);
+
+    case XDP_MATCH_QUIC_FLOW_SRC_CID:
+    case XDP_MATCH_QUIC_FLOW_DST_CID:
+    case XDP_MATCH_TCP_QUIC_FLOW_SRC_CID:
+    case XDP_MATCH_TCP_QUIC_FLOW_DST_CID:
+        return
+            XdpProgramHashUpdate(
+                XDP_PROGRAM_HASH_BASIS, Rule->Pattern.QuicFlow.CidData,
+                Rule->Pattern.QuicFlow.CidLength);
+
+    default:
+        ASSERT(FALSE);
+        return 0;
+    }
+}
+
 NTSTATUS
-XdpProgramValidateRule(
-    _Out_ XDP_RULE *ValidatedRule,
-    _In_ KPROCESSOR_MODE RequestorMode,
-    _In_ const XDP_RULE *UserRule,
+XdpProgramGetCompiledSize(
     _In_ UINT32 RuleCount,
-    _In_ UINT32 RuleIndex
+    _Out_ SIZE_T *CompiledSize
     )
 {
     NTSTATUS Status;
+    SIZE_T PerRuleSize;
+    SIZE_T Size;
 
     //
-    // Initialize the trusted kernel rule buffer and increment the count of
-    // validated rules. The error path will not attempt to clean up
-    // unvalidated rules.
+    // Each rule needs its own storage, a counter reference, at most one
+    // segment, at most XDP_PROGRAM_HASH_SLOTS_PER_RULE hash slots, and an op.
     //
-    RtlZeroMemory(ValidatedRule, sizeof(*ValidatedRule));
+    PerRuleSize =
+        sizeof(XDP_RULE) + sizeof(XDP_PROGRAM_RULE_COUNTER) +
+        sizeof(XDP_PROGRAM_RULE_SEGMENT) + XDP_PROGRAM_HASH_SLOTS_PER_RULE * sizeof(UINT32) +
+        sizeof(XDP_PROGRAM_OP);
 
-    if (UserRule->Match < XDP_MATCH_ALL || UserRule->Match > XDP_MATCH_TCP_CONTROL_DST) {
-        Status = STATUS_INVALID_PARAMETER;
+    Status = RtlSizeTMult(PerRuleSize, RuleCount, &Size);
+    if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
 
-    ValidatedRule->Match = UserRule->Match;
+    Status = RtlSizeTAdd(FIELD_OFFSET(XDP_PROGRAM, Rules), Size, &Size);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
 
-    //
-    // Validate each match condition. Many match conditions support all
-    // possible input pattern values.
-    //
-    switch (ValidatedRule->Match) {
-    case XDP_MATCH_QUIC_FLOW_SRC_CID:
-    case XDP_MATCH_QUIC_FLOW_DST_CID:
-    case XDP_MATCH_TCP_QUIC_FLOW_SRC_CID:
-    case XDP_MATCH_TCP_QUIC_FLOW_DST_CID:
-        Status =
-            XdpProgramValidateQuicFlow(
-                &ValidatedRule->Pattern.QuicFlow, &UserRule->Pattern.QuicFlow);
-        if (!NT_SUCCESS(Status)) {
-            goto Exit;
-        }
+    *CompiledSize = Size;
+
+Exit:
+
+    return Status;
+}
+
+XDP_PROGRAM_RULE_COUNTER *
+XdpProgramGetRuleCounters(
+    _In_ XDP_PROGRAM *Program,
+    _In_ UINT32 RuleCapacity
+    )
+{
+    return (XDP_PROGRAM_RULE_COUNTER *)&Program->Rules[RuleCapacity];
+}
+
+static
+BOOLEAN
+XdpProgramCompileOp(
+    _In_ const XDP_RULE *Rule,
+    _In_ UINT32 RuleIndex,
+    _Out_ XDP_PROGRAM_OP *Op
+    )
+{
+    RtlZeroMemory(Op, sizeof(*Op));
+
+    if (Rule->Action != XDP_PROGRAM_ACTION_DROP && Rule->Action != XDP_PROGRAM_ACTION_PASS) {
+        return FALSE;
+    }
+
+    switch (Rule->Match) {
+    case XDP_MATCH_ALL:
+        Op->Opcode = XdpProgramOpAll;
+        break;
+
+    case XDP_MATCH_UDP:
+        Op->Opcode = XdpProgramOpUdp;
+        break;
+
+    case XDP_MATCH_UDP_DST:
+        Op->Opcode = XdpProgramOpUdpDst;
+        Op->Port = Rule->Pattern.Port;
+        break;
+
+    case XDP_MATCH_TCP_DST:
+        Op->Opcode = XdpProgramOpTcpDst;
+        Op->Port = Rule->Pattern.Port;
         break;
+
     case XDP_MATCH_UDP_PORT_SET:
-        Status =
-            XdpProgramCapturePortSet(
-                &UserRule->Pattern.PortSet, RequestorMode, &ValidatedRule->Pattern.PortSet);
-        if (!NT_SUCCESS(Status)) {
-            goto Exit;
-        }
+        Op->Opcode = XdpProgramOpUdpPortSet;
+        Op->Pattern = Rule->Pattern.PortSet.PortSet;
         break;
-    case XDP_MATCH_IPV4_UDP_PORT_SET:
-    case XDP_MATCH_IPV6_UDP_PORT_SET:
-    case XDP_MATCH_IPV4_TCP_PORT_SET:
-    case XDP_MATCH_IPV6_TCP_PORT_SET:
-        Status =
-            XdpProgramCapturePortSet(
-                &UserRule->Pattern.IpPortSet.PortSet, RequestorMode,
-                &ValidatedRule->Pattern.IpPortSet.PortSet);
-        if (!NT_SUCCESS(Status)) {
-            goto Exit;
-        }
-        ValidatedRule->Pattern.IpPortSet.Address = UserRule->Pattern.IpPortSet.Address;
+
+    case XDP_MATCH_IPV4_DST_MASK:
+        Op->Opcode = XdpProgramOpIpv4DstMask;
+        Op->Pattern = &Rule->Pattern.IpMask;
         break;
-    default:
-        ValidatedRule->Pattern = UserRule->Pattern;
+
+    case XDP_MATCH_IPV6_DST_MASK:
+        Op->Opcode = XdpProgramOpIpv6DstMask;
+        Op->Pattern = &Rule->Pattern.IpMask;
         break;
-    }
 
-    if (UserRule->Action < XDP_PROGRAM_ACTION_DROP ||
-        UserRule->Action > XDP_PROGRAM_ACTION_EBPF) {
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
+    default:
+        return FALSE;
     }
 
-    ValidatedRule->Action = UserRule->Action;
+    Op->Drop = (Rule->Action == XDP_PROGRAM_ACTION_DROP);
+    Op->RuleIndex = RuleIndex;
 
-    //
-    // Capture object handle references in the context of the calling thread.
-    // The handle will be validated further on the control path.
-    //
-    switch (UserRule->Action) {
-    case XDP_PROGRAM_ACTION_REDIRECT:
-        switch (UserRule->Redirect.TargetType) {
+    return TRUE;
+}
 
-        case XDP_REDIRECT_TARGET_TYPE_XSK:
-            Status =
-                XskReferenceDatapathHandle(
-                    RequestorMode, &UserRule->Redirect.Target, TRUE,
-                    &ValidatedRule->Redirect.Target);
-            break;
+//
+// Compiles the program's rules into ops, if every rule can be compiled. Rules
+// indexed by a hash table are left to the generic routine, which looks them up
+// faster than a scan of their ops.
+//
+static
+VOID
+XdpProgramCompileOps(
+    _Inout_ XDP_PROGRAM *Program,
+    _In_ UINT32 RuleCapacity
+    )
+{
+    XDP_PROGRAM_OP *Ops =
+        (XDP_PROGRAM_OP *)&Program->HashSlots[RuleCapacity * XDP_PROGRAM_HASH_SLOTS_PER_RULE];
 
-        default:
-            Status = STATUS_INVALID_PARAMETER;
-            break;
+    Program->Ops = NULL;
+    Program->ParseHeaders = FALSE;
+
+    if (Program->RuleCount == 0) {
+        return;
+    }
+
+    for (UINT32 i = 0; i < Program->SegmentCount; i++) {
+        if (Program->Segments[i].HashSlotMask != 0) {
+            return;
         }
+    }
 
-        if (!NT_SUCCESS(Status)) {
-            goto Exit;
+    for (UINT32 i = 0; i < Program->RuleCount; i++) {
+        if (!XdpProgramCompileOp(&Program->Rules[i], i, &Ops[i])) {
+            return;
         }
 
-        break;
+        if (Ops[i].Opcode != XdpProgramOpAll) {
+            Program->ParseHeaders = TRUE;
+        }
+    }
 
-    case XDP_PROGRAM_ACTION_EBPF:
-        if (RequestorMode != KernelMode) {
-            Status = STATUS_INVALID_PARAMETER;
-            goto Exit;
+    Program->Ops = Ops;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramCompile(
+    _Inout_ XDP_PROGRAM *Program,
+    _In_ UINT32 RuleCapacity
+    )
+{
+    UINT32 HashSlotCount = 0;
+    UINT32 RuleIndex = 0;
+
+    ASSERT(Program->RuleCount <= RuleCapacity);
+
+    Program->Segments =
+        (XDP_PROGRAM_RULE_SEGMENT *)&XdpProgramGetRuleCounters(Program, RuleCapacity)[RuleCapacity];
+    Program->HashSlots = (UINT32 *)&Program->Segments[RuleCapacity];
+    Program->SegmentCount = 0;
+    Program->FragmentAffinity = FALSE;
+
+    for (UINT32 i = 0; i < Program->RuleCount; i++) {
+        if (Program->Rules[i].Match != XDP_MATCH_ALL) {
+            Program->FragmentAffinity = TRUE;
+            break;
         }
+    }
 
-        //
-        // eBPF programs must be the sole, unconditional action.
-        //
-        if (RuleCount != 1 || ValidatedRule->Match != XDP_MATCH_ALL) {
-            Status = STATUS_INVALID_PARAMETER;
-            goto Exit;
+    //
+    // Split the rules into segments of consecutive rules. Runs of exact-match
+    // rules sharing a match type are indexed by a hash table keyed on the
+    // match pattern; everything else is scanned linearly. Segments are
+    // evaluated in rule order, preserving first-match semantics.
+    //
+    while (RuleIndex < Program->RuleCount) {
+        const XDP_RULE *SegmentRule = &Program->Rules[RuleIndex];
+        XDP_PROGRAM_RULE_SEGMENT *Segment;
+        UINT32 Count = 1;
+
+        if (XdpProgramIsIndexableRule(SegmentRule)) {
+            while (RuleIndex + Count < Program->RuleCount &&
+                XdpProgramIsSameSegment(SegmentRule, &Program->Rules[RuleIndex + Count])) {
+                Count++;
+            }
         }
 
-        DBG_UNREFERENCED_PARAMETER(RuleIndex);
-        ASSERT(RuleIndex == 0);
-        ValidatedRule->Ebpf.Target = UserRule->Ebpf.Target;
+        if (Count < XDP_PROGRAM_INDEX_MIN_RULES) {
+            if (Program->SegmentCount > 0 &&
+                Program->Segments[Program->SegmentCount - 1].HashSlotMask == 0) {
+                Segment = &Program->Segments[Program->SegmentCount - 1];
+            } else {
+                Segment = &Program->Segments[Program->SegmentCount++];
+                Segment->StartIndex = RuleIndex;
+                Segment->RuleCount = 0;
+                Segment->HashSlotOffset = 0;
+                Segment->HashSlotMask = 0;
+            }
 
-        break;
-    }
+            Segment->RuleCount += Count;
+        } else {
+            UINT32 TableSize = 1;
+            UINT32 *HashSlots = &Program->HashSlots[HashSlotCount];
 
-    Status = STATUS_SUCCESS;
+            //
+            // Size the table to a power of two at most half full. Since the
+            // table is smaller than 4x the rule count, the per-rule slot budget
+            // reserved by XdpProgramGetCompiledSize is never exceeded.
+            //
+            while (TableSize < Count * 2) {
+                TableSize <<= 1;
+            }
 
-Exit:
+            ASSERT(HashSlotCount + TableSize <= RuleCapacity * XDP_PROGRAM_HASH_SLOTS_PER_RULE);
 
-    if (!NT_SUCCESS(Status)) {
-        XdpProgramDeleteRule(ValidatedRule);
+            for (UINT32 i = 0; i < TableSize; i++) {
+                HashSlots[i] = XDP_PROGRAM_HASH_SLOT_EMPTY;
+            }
+
+            for (UINT32 i = RuleIndex; i < RuleIndex + Count; i++) {
+                UINT32 Slot = XdpProgramHashRule(&Program->Rules[i]) & (TableSize - 1);
+
+                while (HashSlots[Slot] != XDP_PROGRAM_HASH_SLOT_EMPTY) {
+                    Slot = (Slot + 1) & (TableSize - 1);
+                }
+
+                HashSlots[Slot] = i;
+            }
+
+            Segment = &Program->Segments[Program->SegmentCount++];
+            Segment->StartIndex = RuleIndex;
+            Segment->RuleCount = Count;
+            Segment->HashSlotOffset = HashSlotCount;
+            Segment->HashSlotMask = TableSize - 1;
+
+            HashSlotCount += TableSize;
+        }
+
+        RuleIndex += Count;
     }
 
-    return Status;
+    XdpProgramCompileOps(Program, RuleCapacity);
 }
@@ -8,49 +8,12 @@
 #pragma warning(push)
 #pragma warning(disable:4200) // nonstandard extension used: zero-sized array in struct/union
 
-#pragma pack(push)
-#pragma pack(1)
-typedef struct QUIC_HEADER_INVARIANT {
-    union {
-        struct {
-            UCHAR VARIANT : 7;
-            UCHAR IsLongHeader : 1;
-        } COMMON_HDR;
-        struct {
-            UCHAR VARIANT : 7;
-            UCHAR IsLongHeader : 1;
-            UINT32 Version;
-            UCHAR DestCidLength;
-            UCHAR DestCid[0];
-            //UCHAR SourceCidLength;
-            //UCHAR SourceCid[SourceCidLength];
-        } LONG_HDR;
-        struct {
-            UCHAR VARIANT : 7;
-            UCHAR IsLongHeader : 1;
-            UCHAR DestCid[0];
-        } SHORT_HDR;
-    };
-} QUIC_HEADER_INVARIANT;
-#pragma pack(pop)
-
-typedef struct _XDP_PROGRAM_FRAME_STORAGE {
-    ETHERNET_HEADER EthHdr;
-    union {
-        IPV4_HEADER Ip4Hdr;
-        IPV6_HEADER Ip6Hdr;
-    };
-    union {
-        UDP_HDR UdpHdr;
-        TCP_HDR TcpHdr;
-    };
-    UINT8 TcpHdrOptions[40]; // Up to 40B options/paddings
-    // Invariant header + 1 for SourceCidLength + 2x CIDS
-    UINT8 QuicStorage[
-        sizeof(QUIC_HEADER_INVARIANT) +
-        sizeof(UCHAR) +
-        XDP_QUIC_MAX_CID_LENGTH * 2];
-} XDP_PROGRAM_FRAME_STORAGE;
+//
+// The parser skips up to this many VLAN tags and IPv6 extension headers
+// before giving up on finding the upper layer headers.
+//
+#define XDP_PROGRAM_MAX_VLAN_TAGS 2
+#define XDP_PROGRAM_MAX_IPV6_EXTENSION_HEADERS 4
 
 typedef struct _XDP_PROGRAM_PAYLOAD_CACHE {
     XDP_BUFFER *Buffer;
@@ -78,11 +41,21 @@ typedef struct _XDP_PROGRAM_FRAME_CACHE {
             UINT32 QuicCached : 1;
             UINT32 QuicValid : 1;
             UINT32 QuicIsLongHeader : 1;
+            UINT32 VlanValid : 1;
+            UINT32 TunnelCached : 1;
+            UINT32 TunnelValid : 1;
+            UINT32 IpFragment : 1; // The frame is a fragment of a larger IP packet.
+            UINT32 IpFirstFragment : 1;
         };
         UINT32 Flags;
     };
 
     ETHERNET_HEADER *EthHdr;
+    UINT16 EthType; // Network byte order, following any VLAN tags.
+    UINT16 VlanId; // Host byte order, from the outermost VLAN tag.
+    UINT8 Ip6NextHeader; // The upper layer protocol following any extension headers.
+    UINT8 IpFragmentProtocol;
+    UINT32 IpFragmentId; // Network byte order; zero-extended for IPv4.
     union {
         IPV4_HEADER *Ip4Hdr;
         IPV6_HEADER *Ip6Hdr;
@@ -94,19 +67,338 @@ typedef struct _XDP_PROGRAM_FRAME_CACHE {
     UINT8 *TcpHdrOptions;
     UINT8 QuicCidLength;
     const UINT8 *QuicCid; // Src CID for long header, Dest CID for short header
+    UINT8 QuicDestCidLength;
+    const UINT8 *QuicDestCid;
     XDP_PROGRAM_PAYLOAD_CACHE TransportPayload;
+
+    //
+    // The tunnel the frame was last parsed for, the offset of the inner
+    // Ethernet header from the start of the frame data, and the cache of the
+    // inner headers, which are parsed only within the first buffer.
+    //
+    XDP_TUNNEL Tunnel;
+    UINT32 InnerOffset;
+    struct _XDP_PROGRAM_FRAME_CACHE *Inner;
 } XDP_PROGRAM_FRAME_CACHE;
 
+//
+// Longest-prefix-match table: a multibit trie with an 8-bit stride, so an
+// IPv4 lookup visits at most 4 nodes and an IPv6 lookup at most 16. Prefixes
+// are expanded to the node slots they cover.
+//
+#define XDP_LPM_STRIDE_BITS 8
+#define XDP_LPM_NODE_SLOTS (1 << XDP_LPM_STRIDE_BITS)
+#define XDP_LPM_MAX_NODES 0x10000
+
+typedef struct _XDP_LPM_SLOT {
+    //
+    // Index of the next level node, or zero if there is none. The root node
+    // is never a child.
+    //
+    UINT32 Child;
+
+    //
+    // One plus the index of the longest prefix covering this slot at this
+    // level, or zero if there is none.
+    //
+    UINT32 Result;
+} XDP_LPM_SLOT;
+
+typedef struct _XDP_LPM_NODE {
+    XDP_LPM_SLOT Slots[XDP_LPM_NODE_SLOTS];
+} XDP_LPM_NODE;
+
+typedef struct _XDP_LPM_TABLE {
+    UINT32 AddressLength;
+    UINT32 DefaultResult;
+    UINT32 PrefixCount;
+    UINT32 NodeCount;
+    UINT32 NodeCapacity;
+    XDP_LPM_NODE *Nodes;
+    UINT8 Actions[0]; // XDP_IP_PREFIX_ACTION per prefix.
+} XDP_LPM_TABLE;
+
+//
+// Port range table: disjoint ranges sorted by port, in host order, searched
+// with a binary search.
+//
+typedef struct _XDP_PORT_RANGE_TABLE {
+    UINT32 RangeCount;
+    XDP_PORT_RANGE Ranges[0];
+} XDP_PORT_RANGE_TABLE;
+
+//
+// Payload pattern: the value is pre-masked, and both the value and mask are
+// zero beyond the pattern length, so a full XDP_PAYLOAD_PATTERN_MAX_LENGTH
+// bytes are always compared at once.
+//
+typedef struct _XDP_PAYLOAD_PATTERN_TABLE {
+    UINT32 Offset;
+    UINT32 Length;
+    UINT8 Value[XDP_PAYLOAD_PATTERN_MAX_LENGTH];
+    UINT8 Mask[XDP_PAYLOAD_PATTERN_MAX_LENGTH];
+} XDP_PAYLOAD_PATTERN_TABLE;
+
+//
+// Socket map or fanout: referenced XSK datapath handles. A captured socket map
+// or fanout redirect rule stores this table in its redirect target.
+//
+typedef struct _XDP_XSK_MAP_TABLE {
+    UINT32 SocketCount;
+    HANDLE Sockets[0];
+} XDP_XSK_MAP_TABLE;
+
+//
+// QUIC-LB: the servers' IDs and referenced XSK datapath handles, indexed by a
+// linear probing hash table of server IDs, and the AES-128-ECB key that
+// decrypts single-pass encrypted server IDs, if any. The slots follow the
+// servers in the same allocation.
+//
+#define XDP_QUIC_LB_SLOT_EMPTY MAXUINT16
+
+typedef struct _XDP_QUIC_LB_TABLE_SERVER {
+    HANDLE Socket;
+    UINT8 ServerId[XDP_QUIC_LB_MAX_SERVER_ID_LENGTH];
+} XDP_QUIC_LB_TABLE_SERVER;
+
+typedef struct _XDP_QUIC_LB_TABLE {
+    UINT8 ConfigId;
+    UINT8 ServerIdLength;
+    UINT32 ServerCount;
+    UINT32 SlotMask;
+    UINT16 *Slots;
+    BCRYPT_ALG_HANDLE Algorithm;
+    BCRYPT_KEY_HANDLE Key;
+    UCHAR *KeyObject;
+    XDP_QUIC_LB_TABLE_SERVER Servers[0];
+} XDP_QUIC_LB_TABLE;
+
+//
+// Policer: per-processor token buckets. Tokens are scaled by the interrupt
+// time frequency, so refilling a bucket needs no division: each tick adds the
+// rate, and a packet or byte costs XDP_POLICER_TICKS_PER_SECOND. A captured
+// police rule stores the policer in its conform target.
+//
+#define XDP_POLICER_TICKS_PER_SECOND 10000000ui64
+
+#pragma warning(push)
+#pragma warning(disable:4324) // structure was padded due to alignment specifier
+
+typedef struct DECLSPEC_CACHEALIGN _XDP_POLICER_BUCKET {
+    UINT64 LastRefillTime;
+    UINT64 PacketTokens;
+    UINT64 ByteTokens;
+} XDP_POLICER_BUCKET;
+
+typedef struct _XDP_POLICER {
+    HANDLE ConformTarget;
+    UINT32 PacketsPerSecond;
+    UINT32 BytesPerSecond;
+    UINT32 BucketCount;
+    XDP_POLICER_BUCKET Buckets[0];
+} XDP_POLICER;
+
+#pragma warning(pop)
+
+//
+// Load balancer: a Maglev consistent hashing lookup table. Each backend takes
+// turns claiming the next free slot in its own permutation of the table, so
+// backends own nearly equal shares of the table and a change to the set of
+// backends remaps few slots. The table is immutable once built.
+//
+#define XDP_LOAD_BALANCER_TABLE_SIZE 65537 // Prime, and much larger than the backend count.
+
+typedef struct _XDP_LOAD_BALANCER {
+    UINT32 Flags;
+    UINT32 BackendCount;
+    XDP_LOAD_BALANCER_BACKEND Backends[XDP_LOAD_BALANCER_MAX_BACKENDS];
+    UINT8 Lookup[XDP_LOAD_BALANCER_TABLE_SIZE]; // Backend index per slot.
+} XDP_LOAD_BALANCER;
+
+//
+// Encapsulator: a validated copy of an outer header template and the offsets
+// of the fields set for each frame.
+//
+typedef struct _XDP_ENCAPSULATOR {
+    XDP_ENCAP_TYPE Type;
+    UINT32 HeaderLength;
+    UINT32 TransportOffset; // The UDP or GRE header; zero for IP-in-IP.
+    BOOLEAN Ipv6;
+    BOOLEAN ReplaceInnerEthernet;
+    UINT8 Header[XDP_ENCAP_MAX_HEADER_LENGTH];
+} XDP_ENCAPSULATOR;
+
+//
+// Connection tracking table: the flows recorded by an interface's
+// XDP_MATCH_CONNTRACK_TRACK rules, in an open-addressed hash table the data
+// path reads and updates without locks. An entry's sequence number is odd
+// while the entry is being claimed or freed, and readers treat such entries,
+// or entries whose sequence number changed while being read, as misses.
+// Entries are freed by a periodic aging pass once idle for IdleTimeout.
+//
+#define XDP_CONNTRACK_PROBE_LENGTH 8
+
+typedef struct _XDP_CONNTRACK_ENTRY {
+    volatile LONG Sequence;
+    UINT32 Hash;
+
+    //
+    // The interrupt time at which the flow was last tracked, or zero if the
+    // entry is free.
+    //
+    volatile LONG64 LastSeen;
+    XDP_EBPF_FLOW_KEY Key;
+} XDP_CONNTRACK_ENTRY;
+
+typedef struct _XDP_CONNTRACK_TABLE {
+    UINT64 IdleTimeout; // In 100ns units.
+    UINT32 EntryMask;
+    XDP_CONNTRACK_ENTRY *Entries;
+} XDP_CONNTRACK_TABLE;
+
+//
+// SYN cookie responder: the secret key of the cookie hash, generated when the
+// rule is created, and the connection tracking table of the rule's interface,
+// attached on the control path before the rule is published.
+//
+#define XDP_SYN_COOKIE_KEY_LENGTH 16
+
+typedef struct _XDP_SYN_COOKIE {
+    UINT8 Key[XDP_SYN_COOKIE_KEY_LENGTH];
+    UINT16 Mss; // Network byte order.
+    XDP_CONNTRACK_TABLE *Conntrack;
+} XDP_SYN_COOKIE;
+
+//
+// Masked tuple table: a tuple space search. Tuples are grouped by mask, and
+// each group is an open-addressed hash table of masked flow keys, so a lookup
+// probes one hash table per distinct mask. The table is immutable once built.
+//
+typedef struct _XDP_TUPLE_TABLE_SLOT {
+    UINT32 Hash;
+    BOOLEAN Valid;
+    XDP_EBPF_FLOW_KEY Key;
+} XDP_TUPLE_TABLE_SLOT;
+
+typedef struct _XDP_TUPLE_TABLE_GROUP {
+    XDP_EBPF_FLOW_KEY Mask;
+    UINT32 TupleCount;
+    UINT32 SlotOffset;
+    UINT32 SlotMask;
+} XDP_TUPLE_TABLE_GROUP;
+
+typedef struct _XDP_TUPLE_TABLE {
+    UINT32 AddressLength;
+    UINT32 GroupCount;
+    XDP_TUPLE_TABLE_SLOT *Slots;
+    XDP_TUPLE_TABLE_GROUP Groups[XDP_MASKED_TUPLE_SET_MAX_MASKS];
+} XDP_TUPLE_TABLE;
+
+//
+// A compiled program may use up to this many hash slots per rule.
+//
+#define XDP_PROGRAM_HASH_SLOTS_PER_RULE 4
+
+//
+// A run of consecutive rules within a compiled program. If HashSlotMask is
+// non-zero, the rules share a match type and are indexed by a hash table of
+// rule indexes at HashSlots[HashSlotOffset]; otherwise the rules are
+// evaluated linearly.
+//
+typedef struct _XDP_PROGRAM_RULE_SEGMENT {
+    UINT32 StartIndex;
+    UINT32 RuleCount;
+    UINT32 HashSlotOffset;
+    UINT32 HashSlotMask;
+} XDP_PROGRAM_RULE_SEGMENT;
+
+//
+// A compiled rule of a program whose rules only drop or pass frames based on
+// their UDP or TCP destination port or IP destination prefix. The ops are a
+// dense copy of the rules' match parameters, so the program is evaluated with
+// one header parse and a scan of a few cache lines rather than the generic
+// segment walk and match dispatch.
+//
+typedef enum _XDP_PROGRAM_OPCODE {
+    XdpProgramOpAll,
+    XdpProgramOpUdp,
+    XdpProgramOpUdpDst,
+    XdpProgramOpTcpDst,
+    XdpProgramOpUdpPortSet,
+    XdpProgramOpIpv4DstMask,
+    XdpProgramOpIpv6DstMask,
+} XDP_PROGRAM_OPCODE;
+
+typedef struct _XDP_PROGRAM_OP {
+    UINT8 Opcode;
+    BOOLEAN Drop;
+    UINT16 Port; // Network byte order.
+    UINT32 RuleIndex;
+    const VOID *Pattern; // The port set or IP address and mask.
+} XDP_PROGRAM_OP;
+
+//
+// A hit counter for one rule on one processor.
+//
+typedef struct _XDP_RULE_HIT_COUNTER {
+    UINT64 Hits;
+    UINT64 LastHitTime;
+} XDP_RULE_HIT_COUNTER;
+
+//
+// A compiled rule's hit counter on processor 0; processor N's counter is
+// ProcessorStride * N bytes beyond it. Counter is NULL if the rule's program
+// does not maintain rule counters.
+//
+typedef struct _XDP_PROGRAM_RULE_COUNTER {
+    XDP_RULE_HIT_COUNTER *Counter;
+    SIZE_T ProcessorStride;
+} XDP_PROGRAM_RULE_COUNTER;
+
 #pragma warning(push)
 #pragma warning(disable:4324) // structure was padded due to alignment specifier
 
 typedef struct _XDP_PROGRAM {
     //
-    // Storage for discontiguous headers.
+    // Whether the verdicts of the program's eBPF rule may be cached per flow.
+    //
+    BOOLEAN EbpfFlowVerdictCache;
+
+    //
+    // Whether the compiled program is shared by the RX queues of an
+    // all-queues program object, which owns it.
     //
-    XDP_PROGRAM_FRAME_STORAGE FrameStorage;
+    BOOLEAN Shared;
 
+    //
+    // Rule index built by XdpProgramCompile. If Segments is NULL, all rules
+    // are evaluated linearly.
+    //
     DECLSPEC_CACHEALIGN
+    XDP_PROGRAM_RULE_SEGMENT *Segments;
+    UINT32 *HashSlots;
+    UINT32 SegmentCount;
+
+    //
+    // Ops built by XdpProgramCompile if every rule can be compiled and no
+    // rule is indexed, otherwise NULL. ParseHeaders is whether any op needs
+    // the frame's headers.
+    //
+    XDP_PROGRAM_OP *Ops;
+    BOOLEAN ParseHeaders;
+
+    //
+    // Whether any rule inspects the frame's headers, in which case the later
+    // fragments of IP packets are given the verdict of the first fragment.
+    //
+    BOOLEAN FragmentAffinity;
+
+    //
+    // Per-rule hit counters, parallel to Rules, or NULL if no rule is
+    // counted.
+    //
+    XDP_PROGRAM_RULE_COUNTER *RuleCounters;
+
     UINT32 RuleCount;
     XDP_RULE Rules[0];
 } XDP_PROGRAM;
@@ -115,6 +407,24 @@ typedef struct _XDP_PROGRAM {
 
 #pragma warning(pop)
 
+//
+// Parses the frame's TCP or UDP flow into a flow verdict cache key. Returns
+// FALSE if the frame does not belong to a TCP or UDP flow.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+_Success_(return != FALSE)
+BOOLEAN
+XdpInspectGetEbpfFlowKey(
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Out_ XDP_EBPF_FLOW_KEY *Key,
+    _Out_ UINT32 *Hash
+    );
+
 VOID
 XdpProgramDeleteRule(
     _Inout_ XDP_RULE *Rule
@@ -124,9 +434,7 @@ NTSTATUS
 XdpProgramValidateRule(
     _Out_ XDP_RULE *ValidatedRule,
     _In_ KPROCESSOR_MODE RequestorMode,
-    _In_ const XDP_RULE *UserRule,
-    _In_ UINT32 RuleCount,
-    _In_ UINT32 RuleIndex
+    _In_ const XDP_RULE *UserRule
     );
 
 VOID
@@ -140,3 +448,215 @@ XdpProgramCapturePortSet(
     _In_ KPROCESSOR_MODE RequestorMode,
     _Inout_ XDP_PORT_SET *KernelPortSet
     );
+
+NTSTATUS
+XdpProgramGetCompiledSize(
+    _In_ UINT32 RuleCount,
+    _Out_ SIZE_T *CompiledSize
+    );
+
+//
+// Returns the rule counter array of a program allocated with at least
+// XdpProgramGetCompiledSize(RuleCapacity) bytes.
+//
+XDP_PROGRAM_RULE_COUNTER *
+XdpProgramGetRuleCounters(
+    _In_ XDP_PROGRAM *Program,
+    _In_ UINT32 RuleCapacity
+    );
+
+//
+// Builds the rule index of a program. The program must be allocated with at
+// least XdpProgramGetCompiledSize(RuleCapacity) bytes, and its rule count
+// must not exceed RuleCapacity.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramCompile(
+    _Inout_ XDP_PROGRAM *Program,
+    _In_ UINT32 RuleCapacity
+    );
+
+NTSTATUS
+XdpProgramCreateLpmTable(
+    _In_ UINT32 AddressLength,
+    _In_reads_(PrefixCount) const XDP_IP_PREFIX *Prefixes,
+    _In_ UINT32 PrefixCount,
+    _Out_ XDP_LPM_TABLE **Table
+    );
+
+VOID
+XdpProgramDeleteLpmTable(
+    _In_ XDP_LPM_TABLE *Table
+    );
+
+NTSTATUS
+XdpProgramCapturePrefixTable(
+    _In_ const XDP_IP_PREFIX_TABLE *UserPrefixTable,
+    _In_ UINT32 AddressLength,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_IP_PREFIX_TABLE *KernelPrefixTable
+    );
+
+NTSTATUS
+XdpProgramCreatePortRangeTable(
+    _In_reads_(RangeCount) XDP_PORT_RANGE *Ranges,
+    _In_ UINT32 RangeCount,
+    _Out_ XDP_PORT_RANGE_TABLE **Table
+    );
+
+VOID
+XdpProgramDeletePortRangeTable(
+    _In_ XDP_PORT_RANGE_TABLE *Table
+    );
+
+NTSTATUS
+XdpProgramCapturePortRangeSet(
+    _In_ const XDP_PORT_RANGE_SET *UserPortRanges,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_PORT_RANGE_SET *KernelPortRanges
+    );
+
+NTSTATUS
+XdpProgramCreatePayloadPatternTable(
+    _In_ const XDP_PAYLOAD_PATTERN *Pattern,
+    _Out_ XDP_PAYLOAD_PATTERN_TABLE **Table
+    );
+
+VOID
+XdpProgramDeletePayloadPatternTable(
+    _In_ XDP_PAYLOAD_PATTERN_TABLE *Table
+    );
+
+NTSTATUS
+XdpProgramCapturePayloadMatch(
+    _In_ const XDP_PAYLOAD_MATCH *UserPayload,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_PAYLOAD_MATCH *KernelPayload
+    );
+
+NTSTATUS
+XdpProgramCreateTupleTable(
+    _In_ UINT32 AddressLength,
+    _In_reads_(TupleCount) const XDP_MASKED_TUPLE *Tuples,
+    _In_ UINT32 TupleCount,
+    _Out_ XDP_TUPLE_TABLE **Table
+    );
+
+VOID
+XdpProgramDeleteTupleTable(
+    _In_ XDP_TUPLE_TABLE *Table
+    );
+
+NTSTATUS
+XdpProgramCaptureTupleSet(
+    _In_ const XDP_MASKED_TUPLE_SET *UserTupleSet,
+    _In_ UINT32 AddressLength,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_MASKED_TUPLE_SET *KernelTupleSet
+    );
+
+VOID
+XdpProgramDeleteXskMap(
+    _In_ XDP_XSK_MAP_TABLE *Table
+    );
+
+NTSTATUS
+XdpProgramCaptureXskMap(
+    _In_ const XDP_XSK_MAP *UserXskMap,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _In_ BOOLEAN Distinct,
+    _Out_ XDP_XSK_MAP_TABLE **Table
+    );
+
+NTSTATUS
+XdpProgramCreateQuicLbTable(
+    _In_ const XDP_QUIC_LB *Config,
+    _In_reads_(Config->ServerCount) const XDP_QUIC_LB_SERVER *Servers,
+    _Out_ XDP_QUIC_LB_TABLE **Table
+    );
+
+VOID
+XdpProgramDeleteQuicLbTable(
+    _In_ XDP_QUIC_LB_TABLE *Table
+    );
+
+NTSTATUS
+XdpProgramCaptureQuicLb(
+    _In_ const XDP_QUIC_LB *UserQuicLb,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Out_ XDP_QUIC_LB_TABLE **Table
+    );
+
+VOID
+XdpProgramDeletePolicer(
+    _In_ XDP_POLICER *Policer
+    );
+
+NTSTATUS
+XdpProgramCreatePolicer(
+    _In_ const XDP_POLICE_PARAMS *Params,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Out_ XDP_POLICER **Policer
+    );
+
+NTSTATUS
+XdpProgramCreateLoadBalancer(
+    _In_reads_(BackendCount) const XDP_LOAD_BALANCER_BACKEND *Backends,
+    _In_ UINT32 BackendCount,
+    _In_ UINT32 Flags,
+    _Out_ XDP_LOAD_BALANCER **LoadBalancer
+    );
+
+VOID
+XdpProgramDeleteLoadBalancer(
+    _In_ XDP_LOAD_BALANCER *LoadBalancer
+    );
+
+NTSTATUS
+XdpProgramCaptureLoadBalancer(
+    _In_ const XDP_LOAD_BALANCE_PARAMS *UserParams,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_LOAD_BALANCE_PARAMS *KernelParams
+    );
+
+NTSTATUS
+XdpProgramCreateEncapsulator(
+    _In_ XDP_ENCAP_TYPE Type,
+    _In_reads_bytes_(HeaderLength) const UINT8 *Header,
+    _In_ UINT32 HeaderLength,
+    _Out_ XDP_ENCAPSULATOR **Encapsulator
+    );
+
+VOID
+XdpProgramDeleteEncapsulator(
+    _In_ XDP_ENCAPSULATOR *Encapsulator
+    );
+
+NTSTATUS
+XdpProgramCaptureEncap(
+    _In_ const XDP_ENCAP_PARAMS *UserParams,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_ENCAP_PARAMS *KernelParams
+    );
+
+NTSTATUS
+XdpProgramCreateSynCookie(
+    _In_ UINT16 Mss,
+    _Out_ XDP_SYN_COOKIE **SynCookie
+    );
+
+VOID
+XdpProgramDeleteSynCookie(
+    _In_ XDP_SYN_COOKIE *SynCookie
+    );
+
+//
+// Frees the entries of a connection tracking table that have been idle for
+// at least the table's idle timeout.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramAgeConntrackTable(
+    _Inout_ XDP_CONNTRACK_TABLE *Table
+    );
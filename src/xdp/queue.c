@@ -46,7 +46,7 @@ XdpQueueSyncInitialize(
     InitializeListHead(&Sync->PendingList);
 }
 
-VOID
+BOOLEAN
 XdpQueueSyncInsert(
     _In_ XDP_QUEUE_SYNC *Sync,
     _In_ XDP_QUEUE_SYNC_ENTRY *Entry,
@@ -55,13 +55,17 @@ XdpQueueSyncInsert(
     )
 {
     KIRQL OldIrql;
+    BOOLEAN WasEmpty;
 
     Entry->Callback = Callback;
     Entry->CallbackContext = CallbackContext;
 
     KeAcquireSpinLock(&Sync->Lock, &OldIrql);
+    WasEmpty = IsListEmpty(&Sync->PendingList);
     InsertTailList(&Sync->PendingList, &Entry->Link);
     KeReleaseSpinLock(&Sync->Lock, OldIrql);
+
+    return WasEmpty;
 }
 
 static
@@ -79,7 +83,7 @@ XdpQueueBlockingSyncCallback(
     KeSetEvent(&SyncContext->Event, 0, FALSE);
 }
 
-VOID
+BOOLEAN
 XdpQueueBlockingSyncInsert(
     _In_ XDP_QUEUE_SYNC *Sync,
     _In_ XDP_QUEUE_BLOCKING_SYNC_CONTEXT *Entry,
@@ -91,7 +95,30 @@ XdpQueueBlockingSyncInsert(
     Entry->CallbackContext = CallbackContext;
     KeInitializeEvent(&Entry->Event, SynchronizationEvent, FALSE);
 
-    XdpQueueSyncInsert(Sync, &Entry->SyncEntry, XdpQueueBlockingSyncCallback, Entry);
+    return XdpQueueSyncInsert(Sync, &Entry->SyncEntry, XdpQueueBlockingSyncCallback, Entry);
+}
+
+VOID
+XdpQueueBlockingSyncInvoke(
+    _Out_ XDP_QUEUE_BLOCKING_SYNC_CONTEXT *Entry,
+    _In_ XDP_QUEUE_SYNC_CALLBACK *Callback,
+    _In_opt_ VOID *CallbackContext
+    )
+{
+    Entry->Callback = Callback;
+    Entry->CallbackContext = CallbackContext;
+    KeInitializeEvent(&Entry->Event, SynchronizationEvent, TRUE);
+
+    Callback(CallbackContext);
+}
+
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpQueueBlockingSyncWait(
+    _In_ XDP_QUEUE_BLOCKING_SYNC_CONTEXT *Entry
+    )
+{
+    KeWaitForSingleObject(&Entry->Event, Executive, KernelMode, FALSE, NULL);
 }
 
 VOID
@@ -109,6 +136,40 @@ XdpInitializeQueueInfo(
     QueueInfo->QueueId = QueueId;
 }
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpQueueLatencyRecord(
+    _Inout_ XDP_PCW_LATENCY_HISTOGRAM *Histogram,
+    _In_ INT64 StartQpc
+    )
+{
+    LARGE_INTEGER FrequencyQpc;
+    INT64 ElapsedQpc;
+    UINT64 ElapsedUs;
+    UINT32 Bucket;
+
+    ElapsedQpc = KeQueryPerformanceCounter(&FrequencyQpc).QuadPart - StartQpc;
+    if (ElapsedQpc <= 0) {
+        ElapsedUs = 0;
+    } else if (ElapsedQpc > MAXINT64 / 1000000) {
+        ElapsedUs = MAXUINT64;
+    } else {
+        ElapsedUs = (UINT64)ElapsedQpc * 1000000 / FrequencyQpc.QuadPart;
+    }
+
+    //
+    // Bucket 0 holds sub-microsecond samples; bucket N holds [2^(N-1), 2^N) us.
+    //
+    if (ElapsedUs == 0) {
+        Bucket = 0;
+    } else {
+        Bucket = min(RtlFindMostSignificantBit(ElapsedUs) + 1, XDP_PCW_LATENCY_BUCKETS - 1);
+    }
+
+    STAT_INC(Histogram, Samples);
+    STAT_INC(Histogram, Buckets[Bucket]);
+}
+
 #if DBG
 
 VOID
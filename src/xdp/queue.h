@@ -58,7 +58,12 @@ XdpQueueSyncInitialize(
     _Out_ XDP_QUEUE_SYNC *Sync
     );
 
-VOID
+//
+// Inserts a callback into the queue's pending list. Returns TRUE if the list
+// was previously empty, in which case the caller must notify the interface;
+// otherwise an earlier insertion has already requested a data path flush.
+//
+BOOLEAN
 XdpQueueSyncInsert(
     _In_ XDP_QUEUE_SYNC *Sync,
     _In_ XDP_QUEUE_SYNC_ENTRY *Entry,
@@ -66,7 +71,7 @@ XdpQueueSyncInsert(
     _In_opt_ VOID *CallbackContext
     );
 
-VOID
+BOOLEAN
 XdpQueueBlockingSyncInsert(
     _In_ XDP_QUEUE_SYNC *Sync,
     _In_ XDP_QUEUE_BLOCKING_SYNC_CONTEXT *Entry,
@@ -74,6 +79,23 @@ XdpQueueBlockingSyncInsert(
     _In_opt_ VOID *CallbackContext
     );
 
+//
+// Completes a blocking sync entry without queueing it, for queues whose data
+// path is not running.
+//
+VOID
+XdpQueueBlockingSyncInvoke(
+    _Out_ XDP_QUEUE_BLOCKING_SYNC_CONTEXT *Entry,
+    _In_ XDP_QUEUE_SYNC_CALLBACK *Callback,
+    _In_opt_ VOID *CallbackContext
+    );
+
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpQueueBlockingSyncWait(
+    _In_ XDP_QUEUE_BLOCKING_SYNC_CONTEXT *Entry
+    );
+
 VOID
 XdpInitializeQueueInfo(
     _Out_ XDP_QUEUE_INFO *QueueInfo,
@@ -81,6 +103,35 @@ XdpInitializeQueueInfo(
     _In_ UINT32 QueueId
     );
 
+//
+// Latency histograms are sampled once every N data path iterations, where N is
+// a per-module registry setting. A rate of zero disables sampling.
+//
+#define XDP_DEFAULT_LATENCY_SAMPLE_RATE 256
+
+FORCEINLINE
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+XdpQueueLatencyShouldSample(
+    _Inout_ UINT32 *SampleCount,
+    _In_ UINT32 SampleRate
+    )
+{
+    if (SampleRate == 0 || ++*SampleCount < SampleRate) {
+        return FALSE;
+    }
+
+    *SampleCount = 0;
+    return TRUE;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpQueueLatencyRecord(
+    _Inout_ XDP_PCW_LATENCY_HISTOGRAM *Histogram,
+    _In_ INT64 StartQpc
+    );
+
 #if DBG
 typedef struct _XDP_DBG_QUEUE_EC {
     KSPIN_LOCK Lock;
@@ -5,6 +5,29 @@
 
 #include "precomp.h"
 
+//
+// Delivers a fanout batch to each of its sockets in turn. Sockets only read
+// the batch's frames while copying them into their own UMEM, so the frames are
+// pended once for the whole fanout rather than once per socket, and no socket
+// depends on another consuming the frames first.
+//
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpFlushFanoutBatch(
+    _In_ XDP_REDIRECT_BATCH *Batch
+    )
+{
+    const XDP_XSK_MAP_TABLE *Table = Batch->Target;
+
+    for (UINT32 Index = 0; Index < Table->SocketCount; Index++) {
+        Batch->Target = Table->Sockets[Index];
+        XskReceive(Batch);
+    }
+
+    Batch->Target = (VOID *)Table;
+}
+
 static
 _IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
@@ -15,9 +38,18 @@ XdpFlushRedirectBatch(
     switch (Batch->TargetType) {
 
     case XDP_REDIRECT_TARGET_TYPE_XSK:
+    case XDP_REDIRECT_TARGET_TYPE_XSK_PRIORITY:
         XskReceive(Batch);
         break;
 
+    case XDP_REDIRECT_TARGET_TYPE_INTERFACE_TX:
+        XdpTxTargetReceive(Batch);
+        break;
+
+    case XDP_REDIRECT_TARGET_TYPE_XSK_FANOUT:
+        XdpFlushFanoutBatch(Batch);
+        break;
+
     default:
         ASSERT(FALSE);
     }
@@ -40,22 +72,83 @@ XdpFlushRedirect(
     }
 }
 
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+XDP_REDIRECT_BATCH *
+XdpFindRedirectBatch(
+    _In_ XDP_REDIRECT_CONTEXT *Redirect,
+    _In_ XDP_REDIRECT_TARGET_TYPE TargetType,
+    _In_ VOID *Target
+    )
+{
+    XDP_REDIRECT_BATCH *Batch;
+    XDP_REDIRECT_BATCH *FreeBatch = NULL;
+
+    //
+    // Consecutive frames are usually redirected to the same target, so check
+    // the most recently used batch first.
+    //
+    Batch = &Redirect->RedirectBatches[Redirect->LastBatchIndex];
+    if (Batch->Count > 0 && Batch->Target == Target && Batch->TargetType == TargetType) {
+        return Batch;
+    }
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Redirect->RedirectBatches); Index++) {
+        Batch = &Redirect->RedirectBatches[Index];
+
+        if (Batch->Count == 0) {
+            if (FreeBatch == NULL) {
+                FreeBatch = Batch;
+            }
+        } else if (Batch->Target == Target && Batch->TargetType == TargetType) {
+            Redirect->LastBatchIndex = Index;
+            return Batch;
+        }
+    }
+
+    if (FreeBatch == NULL) {
+        //
+        // All batches are in use by other targets: flush the batches in the
+        // order they were started.
+        //
+        FreeBatch = &Redirect->RedirectBatches[Redirect->EvictBatchIndex];
+        XdpFlushRedirectBatch(FreeBatch);
+    }
+
+    ASSERT(FreeBatch->Count == 0);
+    Redirect->LastBatchIndex = (UINT32)(FreeBatch - Redirect->RedirectBatches);
+    Redirect->EvictBatchIndex =
+        (Redirect->LastBatchIndex + 1) % RTL_NUMBER_OF(Redirect->RedirectBatches);
+
+    return FreeBatch;
+}
+
+VOID
+XdpInitializeRedirectContext(
+    _Out_ XDP_REDIRECT_CONTEXT *Redirect,
+    _In_ UINT32 BatchLimit
+    )
+{
+    RtlZeroMemory(Redirect, sizeof(*Redirect));
+
+    ASSERT(BatchLimit > 0 && BatchLimit <= XDP_REDIRECT_BATCH_MAX_FRAMES);
+    Redirect->BatchLimit = BatchLimit;
+}
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
 XdpRedirect(
     _In_ XDP_REDIRECT_CONTEXT *Redirect,
     _In_ UINT32 FrameIndex,
     _In_ UINT32 FragmentIndex,
+    _In_ UINT32 MetadataLength,
     _In_ XDP_REDIRECT_TARGET_TYPE TargetType,
     _In_ VOID *Target
     )
 {
-    XDP_REDIRECT_BATCH *Batch = &Redirect->RedirectBatches[0];
+    XDP_REDIRECT_BATCH *Batch = XdpFindRedirectBatch(Redirect, TargetType, Target);
 
-    if (Batch->Count > 0 &&
-        (Batch->TargetType != TargetType ||
-         Batch->Target != Target ||
-         Batch->Count == RTL_NUMBER_OF(Batch->FrameIndexes))) {
+    if (Batch->Count == Redirect->BatchLimit) {
         //
         // Flush the batch.
         //
@@ -74,8 +167,9 @@ XdpRedirect(
     //
     // Pend the frame for internal consumption.
     //
-    ASSERT(Batch->Count < RTL_NUMBER_OF(Batch->FrameIndexes));
+    ASSERT(Batch->Count < Redirect->BatchLimit);
     Batch->FrameIndexes[Batch->Count].FrameIndex = FrameIndex;
     Batch->FrameIndexes[Batch->Count].FragmentIndex = FragmentIndex;
+    Batch->FrameIndexes[Batch->Count].MetadataLength = MetadataLength;
     Batch->Count++;
 }
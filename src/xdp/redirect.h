@@ -10,26 +10,56 @@ typedef struct _XDP_RX_QUEUE XDP_RX_QUEUE;
 typedef struct _XDP_REDIRECT_FRAME {
     UINT32 FrameIndex;
     UINT32 FragmentIndex;
+
+    //
+    // The length of the metadata an eBPF program placed in the headroom
+    // immediately preceding the frame data, or zero.
+    //
+    UINT32 MetadataLength;
 } XDP_REDIRECT_FRAME;
 
+//
+// The maximum number of frames pended for a single redirect target before the
+// batch is flushed. The effective limit is configurable via the registry.
+//
+#define XDP_REDIRECT_BATCH_MAX_FRAMES 128
+#define XDP_REDIRECT_BATCH_DEFAULT_FRAMES 32
+
+//
+// The maximum number of redirect targets batched concurrently within a single
+// inspection context. Redirecting to more distinct targets within one receive
+// batch flushes the least recently started batch.
+//
+#define XDP_REDIRECT_MAX_BATCHES 4
+
 typedef struct _XDP_REDIRECT_BATCH {
     VOID *Target;
     XDP_RX_QUEUE *RxQueue;
     XDP_REDIRECT_TARGET_TYPE TargetType;
     UINT32 Count;
-    XDP_REDIRECT_FRAME FrameIndexes[32];
+    XDP_REDIRECT_FRAME FrameIndexes[XDP_REDIRECT_BATCH_MAX_FRAMES];
 } XDP_REDIRECT_BATCH;
 
 typedef struct _XDP_REDIRECT_CONTEXT {
-    XDP_REDIRECT_BATCH RedirectBatches[1];
+    UINT32 BatchLimit;
+    UINT32 LastBatchIndex;
+    UINT32 EvictBatchIndex;
+    XDP_REDIRECT_BATCH RedirectBatches[XDP_REDIRECT_MAX_BATCHES];
 } XDP_REDIRECT_CONTEXT;
 
+VOID
+XdpInitializeRedirectContext(
+    _Out_ XDP_REDIRECT_CONTEXT *Redirect,
+    _In_ UINT32 BatchLimit
+    );
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
 XdpRedirect(
     _In_ XDP_REDIRECT_CONTEXT *Redirect,
     _In_ UINT32 FrameIndex,
     _In_ UINT32 FragmentIndex,
+    _In_ UINT32 MetadataLength,
     _In_ XDP_REDIRECT_TARGET_TYPE TargetType,
     _In_ VOID *Target
     );
@@ -15,6 +15,7 @@ XdpRingAllocate(
     _In_ UINT32 ElementSize,
     _In_ UINT32 ElementCount,
     _In_ UINT8 Alignment,
+    _In_ ULONG NodeNumber,
     _Out_ XDP_RING **Ring
     )
 {
@@ -23,8 +24,8 @@ XdpRingAllocate(
     NTSTATUS Status;
 
     TraceEnter(
-        TRACE_CORE, "ElementSize=%u ElementCount=%u Alignment=%u",
-        ElementSize, ElementCount, Alignment);
+        TRACE_CORE, "ElementSize=%u ElementCount=%u Alignment=%u NodeNumber=%u",
+        ElementSize, ElementCount, Alignment, NodeNumber);
 
     Padding = ALIGN_UP_BY((UINT64)ElementSize, Alignment) - ElementSize;
     Status = RtlUInt32Add(ElementSize, (UINT32)Padding, &ElementSize);
@@ -48,7 +49,10 @@ XdpRingAllocate(
     }
 
     ASSERT(Alignment <= SYSTEM_CACHE_ALIGNMENT_SIZE);
-    *Ring = ExAllocatePoolZero(NonPagedPoolNxCacheAligned, RingSize, XDP_POOLTAG_RING);
+    *Ring =
+        XdpAllocatePoolOnNode(
+            POOL_FLAG_NON_PAGED | POOL_FLAG_CACHE_ALIGNED, RingSize, XDP_POOLTAG_RING,
+            NodeNumber);
     if (*Ring == NULL) {
         Status = STATUS_NO_MEMORY;
         goto Exit;
@@ -71,3 +75,11 @@ XdpRingFreeRing(
 {
     ExFreePoolWithTag(Ring, XDP_POOLTAG_RING);
 }
+
+SIZE_T
+XdpRingGetAllocationSize(
+    _In_ const XDP_RING *Ring
+    )
+{
+    return sizeof(*Ring) + (SIZE_T)Ring->ElementStride * (Ring->Mask + 1);
+}
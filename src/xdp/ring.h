@@ -10,6 +10,7 @@ XdpRingAllocate(
     _In_ UINT32 ElementSize,
     _In_ UINT32 ElementCount,
     _In_ UINT8 Alignment,
+    _In_ ULONG NodeNumber,
     _Out_ XDP_RING **Ring
     );
 
@@ -17,3 +18,11 @@ VOID
 XdpRingFreeRing(
     _In_ XDP_RING *Ring
     );
+
+//
+// Returns the number of bytes allocated for the ring, including its header.
+//
+SIZE_T
+XdpRingGetAllocationSize(
+    _In_ const XDP_RING *Ring
+    );
@@ -11,6 +11,16 @@ static XDP_REG_WATCHER_CLIENT_ENTRY XdpRxRegWatcherEntry;
 
 #define XDP_DEFAULT_RX_RING_SIZE 32
 static UINT32 XdpRxRingSize = XDP_DEFAULT_RX_RING_SIZE;
+static UINT32 XdpRxRedirectBatchSize = XDP_REDIRECT_BATCH_DEFAULT_FRAMES;
+static UINT32 XdpRxLatencySampleRate = XDP_DEFAULT_LATENCY_SAMPLE_RATE;
+
+//
+// One in every XdpRxDropSampleRate drops is reported via ETW with up to
+// XDP_DROP_SAMPLE_BYTES of frame data. A rate of zero disables sampling.
+//
+#define XDP_DEFAULT_DROP_SAMPLE_RATE 1024
+#define XDP_DROP_SAMPLE_BYTES 128
+static UINT32 XdpRxDropSampleRate = XDP_DEFAULT_DROP_SAMPLE_RATE;
 
 typedef enum _XDP_RX_QUEUE_STATE {
     XdpRxQueueStateUnbound,
@@ -28,6 +38,7 @@ typedef struct _XDP_RX_QUEUE {
     XDP_PROGRAM *Program;
 
     XDP_RX_QUEUE_DISPATCH Dispatch;
+    XDP_RX_INSPECT_BATCH_ROUTINE *InspectBatch;
     XDP_RING *FrameRing;
     XDP_RING *FragmentRing;
     XDP_EXTENSION VirtualAddressExtension;
@@ -59,6 +70,13 @@ typedef struct _XDP_RX_QUEUE {
     // Perf counters.
     //
     XDP_PCW_RX_QUEUE PcwStats;
+    XDP_PCW_RX_QUEUE_LATENCY PcwLatencyStats;
+    UINT32 LatencySampleCount;
+    INT64 LatencySampleQpc;
+    UINT32 DropSampleCount;
+#ifdef XDP_PERF_STAGES
+    XDP_PCW_RX_QUEUE_STAGES PcwStageStats;
+#endif
 
     //
     // The pending data path / control path serialization callback.
@@ -74,7 +92,15 @@ typedef struct _XDP_RX_QUEUE {
     XDP_RX_QUEUE_KEY Key;
     XDP_BINDING_CLIENT_ENTRY BindingClientEntry;
     XDP_RX_QUEUE_STATE State;
+
+    //
+    // The program most recently set by the control path. The data path adopts
+    // it at its next sync, after which it matches Program.
+    //
+    XDP_PROGRAM *PublishedProgram;
+
     XDP_RX_CAPABILITIES InterfaceRxCapabilities;
+    ULONG NumaNode;
     XDP_INTERFACE_HANDLE InterfaceRxQueue;
     const XDP_INTERFACE_RX_QUEUE_DISPATCH *InterfaceRxDispatch;
     NDIS_HANDLE InterfaceRxPollHandle;
@@ -88,15 +114,28 @@ typedef struct _XDP_RX_QUEUE {
 
     XDP_IF_OFFLOAD_HANDLE InterfaceOffloadHandle;
     PCW_INSTANCE *PcwInstance;
+    PCW_INSTANCE *PcwLatencyInstance;
+#ifdef XDP_PERF_STAGES
+    PCW_INSTANCE *PcwStageInstance;
+#endif
 
     LIST_ENTRY NotifyClients;
 } XDP_RX_QUEUE;
 
 typedef struct _XDP_RX_QUEUE_SWAP_PROGRAM_PARAMS {
+    XDP_QUEUE_SYNC_ENTRY SyncEntry;
     XDP_RX_QUEUE *RxQueue;
     XDP_PROGRAM *NewProgram;
+    XDP_PROGRAM *OldProgram;
+    XDP_RX_QUEUE_RETIRE_PROGRAM *RetireRoutine;
 } XDP_RX_QUEUE_SWAP_PROGRAM_PARAMS;
 
+typedef struct _XDP_RX_QUEUE_SET_EBPF_XSK_PARAMS {
+    XDP_RX_QUEUE *RxQueue;
+    UINT32 Key;
+    HANDLE Xsk;
+} XDP_RX_QUEUE_SET_EBPF_XSK_PARAMS;
+
 static
 XDP_RX_QUEUE *
 XdpRxQueueFromHandle(
@@ -114,6 +153,21 @@ XdpRxQueueFromRedirectContext(
     return CONTAINING_RECORD(RedirectContext, XDP_RX_QUEUE, InspectionContext.RedirectContext);
 }
 
+VOID
+XdpRxQueueGetFrameRings(
+    _In_ XDP_RX_QUEUE *RxQueue,
+    _Out_ XDP_RING **FrameRing,
+    _Out_ XDP_RING **FragmentRing,
+    _Out_ XDP_EXTENSION **VirtualAddressExtension,
+    _Out_ XDP_EXTENSION **FragmentExtension
+    )
+{
+    *FrameRing = RxQueue->FrameRing;
+    *FragmentRing = RxQueue->FragmentRing;
+    *VirtualAddressExtension = &RxQueue->VirtualAddressExtension;
+    *FragmentExtension = &RxQueue->FragmentExtension;
+}
+
 static
 VOID
 XdpReceiveBatchStart(
@@ -122,6 +176,11 @@ XdpReceiveBatchStart(
 {
     XdbgEnterQueueEc(RxQueue);
     STAT_INC(XdpRxQueueGetStats(RxQueue), InspectBatches);
+
+    if (XdpQueueLatencyShouldSample(
+            &RxQueue->LatencySampleCount, ReadUInt32NoFence(&XdpRxLatencySampleRate))) {
+        RxQueue->LatencySampleQpc = KeQueryPerformanceCounter(NULL).QuadPart;
+    }
 }
 
 static
@@ -130,6 +189,15 @@ XdpReceiveBatchComplete(
     _In_ XDP_RX_QUEUE *RxQueue
     )
 {
+    //
+    // Every receive path flushes redirects, and therefore produces to AF_XDP
+    // rings, before completing the batch.
+    //
+    if (RxQueue->LatencySampleQpc != 0) {
+        XdpQueueLatencyRecord(&RxQueue->PcwLatencyStats.Receive, RxQueue->LatencySampleQpc);
+        RxQueue->LatencySampleQpc = 0;
+    }
+
     XdbgExitQueueEc(RxQueue);
 }
 
@@ -141,20 +209,35 @@ XdppFlushReceive(
     )
 {
     XDP_RING *FrameRing = RxQueue->FrameRing;
+    STAGE_START(FlushTsc);
 
     XdpFlushRedirect(&RxQueue->InspectionContext.RedirectContext);
 
+    STAGE_END(&RxQueue->PcwStageStats, FlushRedirectCycles, FlushTsc);
+
+    XdpFlightRecord(
+        XDP_FLIGHT_RECORD_EVENT_RX_BATCH, RxQueue->InspectionContext.IfIndex,
+        RxQueue->Key.QueueId, FrameRing->ProducerIndex, FrameRing->ConsumerIndex,
+        FrameRing->ProducerIndex - FrameRing->ConsumerIndex, 0);
+
     //
     // We've removed all references to the internally buffered frames, so
     // release the elements back to the interface.
     //
+    // Under backpressure, frames left in the ring remain with the interface
+    // until a later receive consumes them.
+    //
 #if DBG
-    ASSERT(RxQueue->FrameConsumerIndex == FrameRing->ProducerIndex);
+    ASSERT(
+        RxQueue->FrameConsumerIndex == FrameRing->ProducerIndex ||
+        RxQueue->InterfaceRxCapabilities.BackpressureSupported);
 #endif
-    FrameRing->ConsumerIndex = FrameRing->ProducerIndex;
+    if (!RxQueue->InterfaceRxCapabilities.BackpressureSupported) {
+        FrameRing->ConsumerIndex = FrameRing->ProducerIndex;
 
-    if (RxQueue->FragmentRing != NULL) {
-        RxQueue->FragmentRing->ConsumerIndex = RxQueue->FragmentRing->ProducerIndex;
+        if (RxQueue->FragmentRing != NULL) {
+            RxQueue->FragmentRing->ConsumerIndex = RxQueue->FragmentRing->ProducerIndex;
+        }
     }
 
     XdpQueueDatapathSync(&RxQueue->Sync);
@@ -180,51 +263,49 @@ _IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
 XdppReceiveBatch(
     _In_ XDP_RX_QUEUE *RxQueue,
-    _In_ XDP_RX_INSPECT_ROUTINE *InspectRoutine
+    _In_ XDP_RX_INSPECT_BATCH_ROUTINE *InspectBatchRoutine
     )
 {
     XDP_RING *FrameRing = RxQueue->FrameRing;
+    UINT32 FrameCount;
+    UINT32 FragmentIndex = 0;
+    UINT32 FragmentBufferCount;
 
     //
     // XdpReceive makes no assumptions on the number of elements queued at
-    // a time. Look at all elements in the ring and always flush on behalf of
-    // the caller.
+    // a time. Inspect all elements in the ring as a single batch and always
+    // flush on behalf of the caller.
     //
 
-    while (XdpRingCount(FrameRing) > 0) {
-        UINT32 FrameIndex = FrameRing->ConsumerIndex & FrameRing->Mask;
-        UINT32 FragmentIndex = 0;
-        XDP_FRAME *Frame;
-        XDP_RX_ACTION Action;
-        XDP_FRAME_FRAGMENT *Fragment = NULL;
-        XDP_FRAME_RX_ACTION *ActionExtension;
+    FrameCount = XdpRingCount(FrameRing);
+    if (FrameCount == 0) {
+        return;
+    }
 
-        Frame = XdpRingGetElement(FrameRing, FrameIndex);
+    if (RxQueue->FragmentRing != NULL) {
+        FragmentIndex = RxQueue->FragmentRing->ConsumerIndex;
+    }
 
-        if (RxQueue->FragmentRing != NULL) {
-            FragmentIndex = RxQueue->FragmentRing->ConsumerIndex & RxQueue->FragmentRing->Mask;
-            Fragment = XdpGetFragmentExtension(Frame, &RxQueue->FragmentExtension);
-        }
+    STAGE_START(InspectTsc);
 
-        Action =
-            InspectRoutine(
-                RxQueue->Program, &RxQueue->InspectionContext, RxQueue->FrameRing, FrameIndex,
-                RxQueue->FragmentRing, &RxQueue->FragmentExtension, FragmentIndex,
-                &RxQueue->VirtualAddressExtension);
+    FragmentBufferCount =
+        InspectBatchRoutine(
+            RxQueue->Program, &RxQueue->InspectionContext, FrameRing, FrameRing->ConsumerIndex,
+            FrameCount, RxQueue->FragmentRing, &RxQueue->FragmentExtension, FragmentIndex,
+            &RxQueue->VirtualAddressExtension, &RxQueue->RxActionExtension);
 
-        ActionExtension = XdpGetRxActionExtension(Frame, &RxQueue->RxActionExtension);
-        ActionExtension->RxAction = Action;
+    STAGE_END(&RxQueue->PcwStageStats, InspectCycles, InspectTsc);
+    STAGE_ADD(&RxQueue->PcwStageStats, Frames, FrameCount);
 
-        FrameRing->ConsumerIndex++;
+    FrameRing->ConsumerIndex += FrameCount;
 
-        if (RxQueue->FragmentRing != NULL) {
-            RxQueue->FragmentRing->ConsumerIndex += Fragment->FragmentBufferCount;
-        }
+    if (RxQueue->FragmentRing != NULL) {
+        RxQueue->FragmentRing->ConsumerIndex += FragmentBufferCount;
+    }
 
 #if DBG
-        RxQueue->FrameConsumerIndex = FrameRing->ConsumerIndex;
+    RxQueue->FrameConsumerIndex = FrameRing->ConsumerIndex;
 #endif
-    }
 }
 
 _IRQL_requires_max_(DISPATCH_LEVEL)
@@ -237,7 +318,7 @@ XdpReceive(
 
     XdpReceiveBatchStart(RxQueue);
 
-    XdppReceiveBatch(RxQueue, XdpInspect);
+    XdppReceiveBatch(RxQueue, RxQueue->InspectBatch);
     XdppFlushReceive(RxQueue);
 
     XdpReceiveBatchComplete(RxQueue);
@@ -255,10 +336,10 @@ XdpReceiveEbpf(
     XdpReceiveBatchStart(RxQueue);
 
     if (XdpInspectEbpfStartBatch(RxQueue->Program, &RxQueue->InspectionContext)) {
-        XdppReceiveBatch(RxQueue, XdpInspectEbpf);
+        XdppReceiveBatch(RxQueue, XdpInspectEbpfBatch);
         XdpInspectEbpfEndBatch(RxQueue->Program, &RxQueue->InspectionContext);
     } else {
-        XdppReceiveBatch(RxQueue, XdpInspect);
+        XdppReceiveBatch(RxQueue, RxQueue->InspectBatch);
     }
 
     XdppFlushReceive(RxQueue);
@@ -275,14 +356,19 @@ XdpRxQueueExclusiveFlush(
 {
     //
     // Perform a flush after an exclusive RX batch handler has completed. The
-    // batch handler is responsible for processing all frames on the ring, but
-    // we still need handle the sync.
+    // batch handler is responsible for processing all frames on the ring,
+    // except those it leaves under backpressure, but we still need handle the
+    // sync.
     //
 
-    ASSERT(RxQueue->FrameRing->ConsumerIndex == RxQueue->FrameRing->ProducerIndex);
+    ASSERT(
+        RxQueue->FrameRing->ConsumerIndex == RxQueue->FrameRing->ProducerIndex ||
+        RxQueue->InterfaceRxCapabilities.BackpressureSupported);
 
     if (RxQueue->FragmentRing != NULL) {
-        ASSERT(RxQueue->FragmentRing->ConsumerIndex == RxQueue->FragmentRing->ProducerIndex);
+        ASSERT(
+            RxQueue->FragmentRing->ConsumerIndex == RxQueue->FragmentRing->ProducerIndex ||
+            RxQueue->InterfaceRxCapabilities.BackpressureSupported);
     }
 
 #if DBG
@@ -313,13 +399,64 @@ XdpReceiveXskExclusiveBatch(
         //
         // XSK could not process the batch, so fall back to the common code path.
         //
-        XdppReceiveBatch(RxQueue, XdpInspect);
+        XdppReceiveBatch(RxQueue, RxQueue->InspectBatch);
         XdppFlushReceive(RxQueue);
     }
 
     XdpReceiveBatchComplete(RxQueue);
 }
 
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpReceiveXskPortSet(
+    _In_ XDP_RX_QUEUE_HANDLE XdpRxQueue
+    )
+{
+    XDP_RX_QUEUE *RxQueue = XdpRxQueueFromHandle(XdpRxQueue);
+
+    XdpReceiveBatchStart(RxQueue);
+
+    XdppReceiveBatch(RxQueue, XdpInspectXskPortSetBatch);
+    XdppFlushReceive(RxQueue);
+
+    XdpReceiveBatchComplete(RxQueue);
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpReceiveMatchAll(
+    _In_ XDP_RX_QUEUE_HANDLE XdpRxQueue
+    )
+{
+    XDP_RX_QUEUE *RxQueue = XdpRxQueueFromHandle(XdpRxQueue);
+
+    XdpReceiveBatchStart(RxQueue);
+
+    XdppReceiveBatch(RxQueue, XdpInspectMatchAllBatch);
+    XdppFlushReceive(RxQueue);
+
+    XdpReceiveBatchComplete(RxQueue);
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpReceiveCompiled(
+    _In_ XDP_RX_QUEUE_HANDLE XdpRxQueue
+    )
+{
+    XDP_RX_QUEUE *RxQueue = XdpRxQueueFromHandle(XdpRxQueue);
+
+    XdpReceiveBatchStart(RxQueue);
+
+    XdppReceiveBatch(RxQueue, XdpInspectCompiledBatch);
+    XdppFlushReceive(RxQueue);
+
+    XdpReceiveBatchComplete(RxQueue);
+}
+
 static const XDP_RX_QUEUE_DISPATCH XdpRxDispatch = {
     .Receive = XdpReceive,
     .FlushReceive = XdpFlushReceive,
@@ -334,6 +471,15 @@ static const XDP_RX_QUEUE_DISPATCH XdpRxExclusiveXskDispatch = {
     .FlushReceive = XdpFlushReceive,
 };
 
+//
+// This dispatch table optimizes the case with UDP port sets steering traffic
+// to several XSKs on the queue.
+//
+static const XDP_RX_QUEUE_DISPATCH XdpRxXskPortSetDispatch = {
+    .Receive = XdpReceiveXskPortSet,
+    .FlushReceive = XdpFlushReceive,
+};
+
 //
 // This dispatch table optimizes the case with an eBPF program receiving all
 // traffic.
@@ -343,6 +489,24 @@ static const XDP_RX_QUEUE_DISPATCH XdpRxEbpfDispatch = {
     .FlushReceive = XdpFlushReceive,
 };
 
+//
+// This dispatch table optimizes the case with a single rule dropping or
+// passing all traffic.
+//
+static const XDP_RX_QUEUE_DISPATCH XdpRxMatchAllDispatch = {
+    .Receive = XdpReceiveMatchAll,
+    .FlushReceive = XdpFlushReceive,
+};
+
+//
+// This dispatch table optimizes the case with rules compiled into ops that
+// drop or pass traffic.
+//
+static const XDP_RX_QUEUE_DISPATCH XdpRxCompiledDispatch = {
+    .Receive = XdpReceiveCompiled,
+    .FlushReceive = XdpFlushReceive,
+};
+
 //
 // The RX queue control path.
 //
@@ -363,6 +527,7 @@ static const XDP_EXTENSION_REGISTRATION XdpRxFrameExtensions[] = {
         .Info.ExtensionType     = XDP_EXTENSION_TYPE_FRAME,
         .Size                   = sizeof(XDP_FRAME_FRAGMENT),
         .Alignment              = __alignof(XDP_FRAME_FRAGMENT),
+        .Hot                    = TRUE,
     },
     {
         .Info.ExtensionName     = XDP_FRAME_EXTENSION_RX_ACTION_NAME,
@@ -370,6 +535,7 @@ static const XDP_EXTENSION_REGISTRATION XdpRxFrameExtensions[] = {
         .Info.ExtensionType     = XDP_EXTENSION_TYPE_FRAME,
         .Size                   = sizeof(XDP_FRAME_RX_ACTION),
         .Alignment              = __alignof(XDP_FRAME_RX_ACTION),
+        .Hot                    = TRUE,
     },
     {
         .Info.ExtensionName     = XDP_FRAME_EXTENSION_INTERFACE_CONTEXT_NAME,
@@ -378,6 +544,20 @@ static const XDP_EXTENSION_REGISTRATION XdpRxFrameExtensions[] = {
         .Size                   = 0,
         .Alignment              = __alignof(UCHAR),
     },
+    {
+        .Info.ExtensionName     = XDP_FRAME_EXTENSION_TIMESTAMP_NAME,
+        .Info.ExtensionVersion  = XDP_FRAME_EXTENSION_TIMESTAMP_VERSION_1,
+        .Info.ExtensionType     = XDP_EXTENSION_TYPE_FRAME,
+        .Size                   = sizeof(XDP_FRAME_TIMESTAMP),
+        .Alignment              = __alignof(XDP_FRAME_TIMESTAMP),
+    },
+    {
+        .Info.ExtensionName     = XDP_FRAME_EXTENSION_RX_METADATA_NAME,
+        .Info.ExtensionVersion  = XDP_FRAME_EXTENSION_RX_METADATA_VERSION_1,
+        .Info.ExtensionType     = XDP_EXTENSION_TYPE_FRAME,
+        .Size                   = sizeof(XDP_FRAME_RX_METADATA),
+        .Alignment              = __alignof(XDP_FRAME_RX_METADATA),
+    },
 };
 
 static const XDP_EXTENSION_REGISTRATION XdpRxBufferExtensions[] = {
@@ -387,6 +567,14 @@ static const XDP_EXTENSION_REGISTRATION XdpRxBufferExtensions[] = {
         .Info.ExtensionType     = XDP_EXTENSION_TYPE_BUFFER,
         .Size                   = sizeof(XDP_BUFFER_VIRTUAL_ADDRESS),
         .Alignment              = __alignof(XDP_BUFFER_VIRTUAL_ADDRESS),
+        .Hot                    = TRUE,
+    },
+    {
+        .Info.ExtensionName     = XDP_BUFFER_EXTENSION_MDL_NAME,
+        .Info.ExtensionVersion  = XDP_BUFFER_EXTENSION_MDL_VERSION_1,
+        .Info.ExtensionType     = XDP_EXTENSION_TYPE_BUFFER,
+        .Size                   = sizeof(XDP_BUFFER_MDL),
+        .Alignment              = __alignof(XDP_BUFFER_MDL),
     },
     {
         .Info.ExtensionName     = XDP_BUFFER_EXTENSION_INTERFACE_CONTEXT_NAME,
@@ -457,7 +645,20 @@ XdpRxQueueSetCapabilities(
     FRE_ASSERT(Capabilities->Header.Revision >= XDP_RX_CAPABILITIES_REVISION_1);
     FRE_ASSERT(Capabilities->Header.Size >= XDP_SIZEOF_RX_CAPABILITIES_REVISION_1);
 
-    RxQueue->InterfaceRxCapabilities = *Capabilities;
+    //
+    // Interfaces built against older headers register smaller structures.
+    //
+    RtlZeroMemory(&RxQueue->InterfaceRxCapabilities, sizeof(RxQueue->InterfaceRxCapabilities));
+    RtlCopyMemory(
+        &RxQueue->InterfaceRxCapabilities, Capabilities,
+        min(Capabilities->Header.Size, sizeof(RxQueue->InterfaceRxCapabilities)));
+
+    RxQueue->NumaNode = MM_ANY_NODE_OK;
+    if (Capabilities->Header.Revision >= XDP_RX_CAPABILITIES_REVISION_2 &&
+        Capabilities->Header.Size >= XDP_SIZEOF_RX_CAPABILITIES_REVISION_2 &&
+        Capabilities->IdealProcessorValid) {
+        RxQueue->NumaNode = XdpGetProcessorNodeNumber(&Capabilities->IdealProcessor);
+    }
 
     //
     // XDP programs require a system virtual address. Ensure the driver has
@@ -491,6 +692,18 @@ XdpRxQueueRegisterExtensionVersion(
         RxQueue, ExtensionInfo->ExtensionName, ExtensionInfo->ExtensionVersion,
         ExtensionInfo->ExtensionType);
     XdpExtensionSetRegisterEntry(Set, ExtensionInfo);
+
+    //
+    // Timestamps, receive metadata, and buffer MDLs are provided only by
+    // interfaces that register the extensions.
+    //
+    if ((ExtensionInfo->ExtensionType == XDP_EXTENSION_TYPE_FRAME &&
+         (wcscmp(ExtensionInfo->ExtensionName, XDP_FRAME_EXTENSION_TIMESTAMP_NAME) == 0 ||
+          wcscmp(ExtensionInfo->ExtensionName, XDP_FRAME_EXTENSION_RX_METADATA_NAME) == 0)) ||
+        (ExtensionInfo->ExtensionType == XDP_EXTENSION_TYPE_BUFFER &&
+         wcscmp(ExtensionInfo->ExtensionName, XDP_BUFFER_EXTENSION_MDL_NAME) == 0)) {
+        XdpExtensionSetEnableEntry(Set, ExtensionInfo->ExtensionName);
+    }
 }
 
 VOID
@@ -606,6 +819,30 @@ XdpRxQueueGetMaximumFragments(
     return RxQueue->InterfaceRxCapabilities.MaximumFragments;
 }
 
+BOOLEAN
+XdpRxQueueIsTimestampEnabled(
+    _In_ XDP_RX_QUEUE_CONFIG_ACTIVATE RxQueueConfig
+    )
+{
+    XDP_RX_QUEUE *RxQueue = XdpRxQueueFromConfigActivate(RxQueueConfig);
+
+    return
+        XdpExtensionSetIsExtensionEnabled(
+            RxQueue->FrameExtensionSet, XDP_FRAME_EXTENSION_TIMESTAMP_NAME);
+}
+
+BOOLEAN
+XdpRxQueueIsRxMetadataEnabled(
+    _In_ XDP_RX_QUEUE_CONFIG_ACTIVATE RxQueueConfig
+    )
+{
+    XDP_RX_QUEUE *RxQueue = XdpRxQueueFromConfigActivate(RxQueueConfig);
+
+    return
+        XdpExtensionSetIsExtensionEnabled(
+            RxQueue->FrameExtensionSet, XDP_FRAME_EXTENSION_RX_METADATA_NAME);
+}
+
 BOOLEAN
 XdpRxQueueIsTxActionSupported(
     _In_ XDP_RX_QUEUE_CONFIG_ACTIVATE RxQueueConfig
@@ -616,6 +853,34 @@ XdpRxQueueIsTxActionSupported(
     return RxQueue->InterfaceRxCapabilities.TxActionSupported;
 }
 
+BOOLEAN
+XdpRxQueueIsBackpressureSupported(
+    _In_ XDP_RX_QUEUE_CONFIG_ACTIVATE RxQueueConfig
+    )
+{
+    XDP_RX_QUEUE *RxQueue = XdpRxQueueFromConfigActivate(RxQueueConfig);
+
+    //
+    // Capabilities registered before revision 4 were zero-extended.
+    //
+    return RxQueue->InterfaceRxCapabilities.BackpressureSupported;
+}
+
+BOOLEAN
+XdpRxQueueIsHeaderSplit(
+    _In_ XDP_RX_QUEUE_CONFIG_ACTIVATE RxQueueConfig
+    )
+{
+    XDP_RX_QUEUE *RxQueue = XdpRxQueueFromConfigActivate(RxQueueConfig);
+
+    //
+    // Capabilities registered before revision 3 were zero-extended.
+    //
+    return
+        RxQueue->InterfaceRxCapabilities.HeaderSplit &&
+        RxQueue->InterfaceRxCapabilities.MaximumFragments > 1;
+}
+
 static
 CONST XDP_HOOK_ID *
 XdppRxQueueGetHookId(
@@ -698,6 +963,12 @@ XdpRxQueueDetachInterface(
         XdpRxQueueNotifyClients(RxQueue, XDP_RX_QUEUE_NOTIFICATION_DETACH);
         XdpIfDeleteRxQueue(RxQueue->Binding, RxQueue->InterfaceRxQueue);
         RxQueue->State = XdpRxQueueStateUnbound;
+
+        //
+        // The interface no longer invokes the data path, so complete any
+        // syncs that were started but not yet flushed.
+        //
+        XdpQueueDatapathSync(&RxQueue->Sync);
         XdpRxQueueNotifyClients(RxQueue, XDP_RX_QUEUE_NOTIFICATION_DETACH_COMPLETE);
 
         RxQueue->InterfaceRxDispatch = NULL;
@@ -726,6 +997,8 @@ XdpRxQueueDetachInterface(
         RxQueue->FrameRing = NULL;
     }
 
+    STAT_SET(&RxQueue->PcwStats, RingMemoryBytes, 0);
+
     if (RxQueue->BufferExtensionSet != NULL) {
         XdpExtensionSetCleanup(RxQueue->BufferExtensionSet);
         RxQueue->BufferExtensionSet = NULL;
@@ -752,6 +1025,12 @@ XdpRxQueueUpdateDispatch(
         RxQueue->Dispatch = XdpRxEbpfDispatch;
     } else if (XdpProgramCanXskBypass(RxQueue->Program, RxQueue) && !XdpFaultInject()) {
         RxQueue->Dispatch = XdpRxExclusiveXskDispatch;
+    } else if (XdpProgramCanXskPortSetBypass(RxQueue->Program, RxQueue) && !XdpFaultInject()) {
+        RxQueue->Dispatch = XdpRxXskPortSetDispatch;
+    } else if (XdpProgramCanMatchAllBypass(RxQueue->Program) && !XdpFaultInject()) {
+        RxQueue->Dispatch = XdpRxMatchAllDispatch;
+    } else if (XdpProgramIsCompiled(RxQueue->Program) && !XdpFaultInject()) {
+        RxQueue->Dispatch = XdpRxCompiledDispatch;
     } else {
         RxQueue->Dispatch = XdpRxDispatch;
     }
@@ -830,7 +1109,9 @@ XdpRxQueueAttachInterface(
         goto Exit;
     }
 
-    Status = XdpRingAllocate(FrameSize, XdpRxRingSize, FrameAlignment, &RxQueue->FrameRing);
+    Status =
+        XdpRingAllocate(
+            FrameSize, XdpRxRingSize, FrameAlignment, RxQueue->NumaNode, &RxQueue->FrameRing);
     if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
@@ -839,12 +1120,18 @@ XdpRxQueueAttachInterface(
         Status =
             XdpRingAllocate(
                 BufferSize, max(RxQueue->InterfaceRxCapabilities.MaximumFragments, XdpRxRingSize),
-                BufferAlignment, &RxQueue->FragmentRing);
+                BufferAlignment, RxQueue->NumaNode, &RxQueue->FragmentRing);
         if (!NT_SUCCESS(Status)) {
             goto Exit;
         }
     }
 
+    STAT_SET(
+        &RxQueue->PcwStats, RingMemoryBytes,
+        XdpRingGetAllocationSize(RxQueue->FrameRing) +
+            ((RxQueue->FragmentRing != NULL) ?
+                XdpRingGetAllocationSize(RxQueue->FragmentRing) : 0));
+
     XdpInitializeExtensionInfo(
         &ExtensionInfo, XDP_FRAME_EXTENSION_RX_ACTION_NAME,
         XDP_FRAME_EXTENSION_RX_ACTION_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
@@ -862,6 +1149,9 @@ XdpRxQueueAttachInterface(
             &ExtensionInfo, XDP_FRAME_EXTENSION_FRAGMENT_NAME,
             XDP_FRAME_EXTENSION_FRAGMENT_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
         XdpRxQueueGetExtension(ConfigActivate, &ExtensionInfo, &RxQueue->FragmentExtension);
+        RxQueue->InspectBatch = XdpInspectBatch;
+    } else {
+        RxQueue->InspectBatch = XdpInspectSingleBufferBatch;
     }
 
     Status =
@@ -1010,6 +1300,9 @@ XdpRxQueueCreate(
     RxQueue->Binding = Binding;
     RxQueue->Key = Key;
     RxQueue->InspectionContext.IfIndex = XdpIfGetIfIndex(Binding);
+    RxQueue->InspectionContext.SampleSeed = (UINT32)KeQueryPerformanceCounter(NULL).QuadPart | 1;
+    XdpInitializeRedirectContext(
+        &RxQueue->InspectionContext.RedirectContext, XdpRxRedirectBatchSize);
     XdpInitializeQueueInfo(&RxQueue->QueueInfo, XDP_QUEUE_TYPE_DEFAULT_RSS, QueueId);
     XdbgInitializeQueueEc(RxQueue);
 
@@ -1025,6 +1318,21 @@ XdpRxQueueCreate(
         goto Exit;
     }
 
+    Status =
+        XdpPcwCreateRxQueueLatency(
+            &RxQueue->PcwLatencyInstance, &Name, &RxQueue->PcwLatencyStats);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+#ifdef XDP_PERF_STAGES
+    Status =
+        XdpPcwCreateRxQueueStages(&RxQueue->PcwStageInstance, &Name, &RxQueue->PcwStageStats);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+#endif
+
     Status =
         XdpIfRegisterClient(
             Binding, &RxQueueBindingClient, &RxQueue->Key, &RxQueue->BindingClientEntry);
@@ -1082,12 +1390,22 @@ XdpRxQueueFindOrCreate(
     _Out_ XDP_RX_QUEUE **RxQueue
     )
 {
+    NTSTATUS Status;
+
     *RxQueue = XdpRxQueueFind(Binding, HookId, QueueId);
     if (*RxQueue != NULL) {
         return STATUS_SUCCESS;
     }
 
-    return XdpRxQueueCreate(Binding, HookId, QueueId, RxQueue);
+    Status = XdpRxQueueCreate(Binding, HookId, QueueId, RxQueue);
+    if (NT_SUCCESS(Status)) {
+        //
+        // Extend the interface's all-queues programs to the new RX queue.
+        //
+        XdpProgramAttachAllQueuesPrograms(*RxQueue);
+    }
+
+    return Status;
 }
 
 VOID
@@ -1131,18 +1449,38 @@ XdpRxQueueDeregisterNotifications(
 }
 
 VOID
-XdpRxQueueSync(
+XdpRxQueueInvokeInterfaceNotify(
+    _In_ XDP_RX_QUEUE *RxQueue,
+    _In_ XDP_NOTIFY_QUEUE_FLAGS Flags
+    )
+{
+    ASSERT(RxQueue->State == XdpRxQueueStateActive);
+
+    XdbgNotifyQueueEc(RxQueue, Flags);
+    RxQueue->InterfaceRxDispatch->InterfaceNotifyQueue(RxQueue->InterfaceRxQueue, Flags);
+}
+
+static
+VOID
+XdpRxQueueNotifySync(
+    _In_ XDP_RX_QUEUE *RxQueue
+    )
+{
+    XdpRxQueueInvokeInterfaceNotify(RxQueue, XDP_NOTIFY_QUEUE_FLAG_RX_FLUSH);
+}
+
+VOID
+XdpRxQueueSyncStart(
     _In_ XDP_RX_QUEUE *RxQueue,
+    _Out_ XDP_QUEUE_BLOCKING_SYNC_CONTEXT *SyncEntry,
     _In_ XDP_QUEUE_SYNC_CALLBACK *Callback,
     _In_opt_ VOID *CallbackContext
     )
 {
-    XDP_QUEUE_BLOCKING_SYNC_CONTEXT SyncEntry = {0};
-    XDP_NOTIFY_QUEUE_FLAGS NotifyFlags = XDP_NOTIFY_QUEUE_FLAG_RX_FLUSH;
-
     //
     // Serialize a callback with the datapath execution context. This routine
-    // must be called from the interface binding thread.
+    // must be called from the interface binding thread, and the sync must be
+    // completed with XdpRxQueueSyncWait before the binding work item returns.
     //
 
     if (RxQueue->State != XdpRxQueueStateActive) {
@@ -1150,16 +1488,38 @@ XdpRxQueueSync(
         // If the RX queue is not active (i.e. the XDP data path cannot be
         // invoked by interfaces), simply invoke the callback.
         //
-        Callback(CallbackContext);
+        XdpQueueBlockingSyncInvoke(SyncEntry, Callback, CallbackContext);
         return;
     }
 
-    XdpQueueBlockingSyncInsert(&RxQueue->Sync, &SyncEntry, Callback, CallbackContext);
+    //
+    // Syncs started back to back share a single data path flush: only the
+    // first insertion into an empty pending list notifies the interface.
+    //
+    if (XdpQueueBlockingSyncInsert(&RxQueue->Sync, SyncEntry, Callback, CallbackContext)) {
+        XdpRxQueueNotifySync(RxQueue);
+    }
+}
+
+VOID
+XdpRxQueueSyncWait(
+    _In_ XDP_QUEUE_BLOCKING_SYNC_CONTEXT *SyncEntry
+    )
+{
+    XdpQueueBlockingSyncWait(SyncEntry);
+}
 
-    XdbgNotifyQueueEc(RxQueue, NotifyFlags);
-    RxQueue->InterfaceRxDispatch->InterfaceNotifyQueue(RxQueue->InterfaceRxQueue, NotifyFlags);
+VOID
+XdpRxQueueSync(
+    _In_ XDP_RX_QUEUE *RxQueue,
+    _In_ XDP_QUEUE_SYNC_CALLBACK *Callback,
+    _In_opt_ VOID *CallbackContext
+    )
+{
+    XDP_QUEUE_BLOCKING_SYNC_CONTEXT SyncEntry = {0};
 
-    KeWaitForSingleObject(&SyncEntry.Event, Executive, KernelMode, FALSE, NULL);
+    XdpRxQueueSyncStart(RxQueue, &SyncEntry, Callback, CallbackContext);
+    XdpRxQueueSyncWait(&SyncEntry);
 }
 
 static
@@ -1174,23 +1534,90 @@ XdpRxQueueSwapProgram(
     ASSERT(CallbackContext != NULL);
 
     SwapParams->RxQueue->Program = SwapParams->NewProgram;
+    XdpProgramInvalidateVerdictCaches(&SwapParams->RxQueue->InspectionContext);
     XdpRxQueueUpdateDispatch(SwapParams->RxQueue);
 }
 
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpRxQueueSwapAndRetireProgram(
+    _In_opt_ VOID *CallbackContext
+    )
+{
+    XDP_RX_QUEUE_SWAP_PROGRAM_PARAMS *SwapParams = CallbackContext;
+
+    ASSERT(CallbackContext != NULL);
+
+    //
+    // The data path has finished every batch that could have referenced the
+    // old program, so it can be retired here.
+    //
+    XdpRxQueueSwapProgram(SwapParams);
+    SwapParams->RetireRoutine(SwapParams->OldProgram);
+
+    ExFreePoolWithTag(SwapParams, XDP_POOLTAG_RXQUEUE);
+}
+
+static
+VOID
+XdpRxQueueSwapProgramAsync(
+    _In_ XDP_RX_QUEUE *RxQueue,
+    _In_ XDP_PROGRAM *Program,
+    _In_ XDP_RX_QUEUE_RETIRE_PROGRAM *RetireRoutine
+    )
+{
+    XDP_RX_QUEUE_SWAP_PROGRAM_PARAMS *SwapParams;
+    XDP_PROGRAM *OldProgram = RxQueue->PublishedProgram;
+
+    SwapParams = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*SwapParams), XDP_POOLTAG_RXQUEUE);
+    if (SwapParams == NULL) {
+        //
+        // Fall back to a blocking swap.
+        //
+        XDP_RX_QUEUE_SWAP_PROGRAM_PARAMS BlockingSwapParams = {0};
+        BlockingSwapParams.RxQueue = RxQueue;
+        BlockingSwapParams.NewProgram = Program;
+        XdpRxQueueSync(RxQueue, XdpRxQueueSwapProgram, &BlockingSwapParams);
+        RetireRoutine(OldProgram);
+        return;
+    }
+
+    SwapParams->RxQueue = RxQueue;
+    SwapParams->NewProgram = Program;
+    SwapParams->OldProgram = OldProgram;
+    SwapParams->RetireRoutine = RetireRoutine;
+
+    //
+    // Syncs execute in order, so any sync started after this one observes the
+    // new program, and waiting for such a sync also waits for the retirement.
+    //
+    if (RxQueue->State != XdpRxQueueStateActive) {
+        XdpRxQueueSwapAndRetireProgram(SwapParams);
+    } else if (
+        XdpQueueSyncInsert(
+            &RxQueue->Sync, &SwapParams->SyncEntry, XdpRxQueueSwapAndRetireProgram,
+            SwapParams)) {
+        XdpRxQueueNotifySync(RxQueue);
+    }
+}
+
 NTSTATUS
 XdpRxQueueSetProgram(
     _In_ XDP_RX_QUEUE *RxQueue,
     _In_opt_ XDP_PROGRAM *Program,
     _In_opt_ XDP_RX_QUEUE_VALIDATE ValidationRoutine,
-    _In_opt_ VOID *ValidationContext
+    _In_opt_ VOID *ValidationContext,
+    _In_opt_ XDP_RX_QUEUE_RETIRE_PROGRAM *RetireRoutine
     )
 {
     NTSTATUS Status;
 
     TraceEnter(
-        TRACE_CORE, "RxQueue=%p Program=%p OldProgram=%p", RxQueue, Program, RxQueue->Program);
+        TRACE_CORE, "RxQueue=%p Program=%p OldProgram=%p", RxQueue, Program,
+        RxQueue->PublishedProgram);
 
-    if (Program != NULL && RxQueue->Program != NULL) {
+    if (Program != NULL && RxQueue->PublishedProgram != NULL) {
         if (ValidationRoutine != NULL) {
             Status = ValidationRoutine(RxQueue, ValidationContext);
             if (!NT_SUCCESS(Status)) {
@@ -1201,24 +1628,35 @@ XdpRxQueueSetProgram(
         //
         // Swap the existing program for a new program; perform the swap on the
         // data path execution context to ensure the old program is not touched
-        // after the swap is performed. The caller is responsible for cleaning
-        // up the old program.
+        // after the swap is performed. With a retire routine, the swap
+        // completes asynchronously and the routine cleans up the old program.
+        // Otherwise, the caller is responsible for cleaning up the old program.
         //
-        XDP_RX_QUEUE_SWAP_PROGRAM_PARAMS SwapParams = {0};
-        SwapParams.RxQueue = RxQueue;
-        SwapParams.NewProgram = Program;
-        XdpRxQueueSync(RxQueue, XdpRxQueueSwapProgram, &SwapParams);
+        if (RetireRoutine != NULL) {
+            XdpRxQueueSwapProgramAsync(RxQueue, Program, RetireRoutine);
+        } else {
+            XDP_RX_QUEUE_SWAP_PROGRAM_PARAMS SwapParams = {0};
+            SwapParams.RxQueue = RxQueue;
+            SwapParams.NewProgram = Program;
+            XdpRxQueueSync(RxQueue, XdpRxQueueSwapProgram, &SwapParams);
+        }
+
+        RxQueue->PublishedProgram = Program;
     } else if (Program != NULL) {
         //
         // Add a new program, which requires activating the underlying XDP RX
-        // queue on the interface.
+        // queue on the interface. The data path is not running, so verdicts
+        // cached for any previous program can be invalidated directly.
         //
+        XdpProgramInvalidateVerdictCaches(&RxQueue->InspectionContext);
         RxQueue->Program = Program;
         Status = XdpRxQueueAttachInterface(RxQueue, ValidationRoutine, ValidationContext);
         if (!NT_SUCCESS(Status)) {
             RxQueue->Program = NULL;
             goto Exit;
         }
+
+        RxQueue->PublishedProgram = Program;
     } else {
         //
         // Remove the program and detach from the underlying XDP RX queue on the
@@ -1226,6 +1664,7 @@ XdpRxQueueSetProgram(
         //
         XdpRxQueueDetachInterface(RxQueue);
         RxQueue->Program = NULL;
+        RxQueue->PublishedProgram = NULL;
     }
 
     Status = STATUS_SUCCESS;
@@ -1236,6 +1675,113 @@ Exit:
     return Status;
 }
 
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpRxQueueSyncSetEbpfXsk(
+    _In_opt_ VOID *CallbackContext
+    )
+{
+    XDP_RX_QUEUE_SET_EBPF_XSK_PARAMS *Params = CallbackContext;
+
+    ASSERT(CallbackContext != NULL);
+
+    WritePointerNoFence(
+        &Params->RxQueue->InspectionContext.EbpfXskMap[Params->Key], Params->Xsk);
+
+    //
+    // Cached verdicts may depend on which sockets are present.
+    //
+    XdpProgramInvalidateVerdictCaches(&Params->RxQueue->InspectionContext);
+}
+
+NTSTATUS
+XdpRxQueueInsertEbpfXsk(
+    _In_ XDP_RX_QUEUE *RxQueue,
+    _In_ UINT32 Key,
+    _In_ HANDLE Xsk
+    )
+{
+    XDP_RX_QUEUE_SET_EBPF_XSK_PARAMS Params = {0};
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_CORE, "RxQueue=%p Key=%u Xsk=%p", RxQueue, Key, Xsk);
+
+    FRE_ASSERT(Key < RTL_NUMBER_OF(RxQueue->InspectionContext.EbpfXskMap));
+
+    //
+    // The socket map is only written on the binding thread, so it can be read
+    // here without synchronizing with the data path.
+    //
+    if (RxQueue->InspectionContext.EbpfXskMap[Key] != NULL) {
+        Status = STATUS_DUPLICATE_OBJECTID;
+        goto Exit;
+    }
+
+    Params.RxQueue = RxQueue;
+    Params.Key = Key;
+    Params.Xsk = Xsk;
+    XdpRxQueueSync(RxQueue, XdpRxQueueSyncSetEbpfXsk, &Params);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+VOID
+XdpRxQueueRemoveEbpfXsk(
+    _In_ XDP_RX_QUEUE *RxQueue,
+    _In_ UINT32 Key,
+    _In_ HANDLE Xsk
+    )
+{
+    XDP_RX_QUEUE_SET_EBPF_XSK_PARAMS Params = {0};
+
+    TraceEnter(TRACE_CORE, "RxQueue=%p Key=%u Xsk=%p", RxQueue, Key, Xsk);
+
+    FRE_ASSERT(Key < RTL_NUMBER_OF(RxQueue->InspectionContext.EbpfXskMap));
+    ASSERT(RxQueue->InspectionContext.EbpfXskMap[Key] == Xsk);
+    UNREFERENCED_PARAMETER(Xsk);
+
+    //
+    // Once the callback has executed, the data path no longer references the
+    // socket.
+    //
+    Params.RxQueue = RxQueue;
+    Params.Key = Key;
+    Params.Xsk = NULL;
+    XdpRxQueueSync(RxQueue, XdpRxQueueSyncSetEbpfXsk, &Params);
+
+    TraceExitSuccess(TRACE_CORE);
+}
+
+XDP_BINDING_HANDLE
+XdpRxQueueGetBinding(
+    _In_ XDP_RX_QUEUE *RxQueue
+    )
+{
+    return RxQueue->Binding;
+}
+
+const XDP_HOOK_ID *
+XdpRxQueueGetHookId(
+    _In_ XDP_RX_QUEUE *RxQueue
+    )
+{
+    return &RxQueue->Key.HookId;
+}
+
+UINT32
+XdpRxQueueGetQueueId(
+    _In_ XDP_RX_QUEUE *RxQueue
+    )
+{
+    return RxQueue->Key.QueueId;
+}
+
 LIST_ENTRY *
 XdpRxQueueGetProgramBindingList(
     _In_ XDP_RX_QUEUE *RxQueue
@@ -1244,12 +1790,20 @@ XdpRxQueueGetProgramBindingList(
     return &RxQueue->ProgramBindings;
 }
 
+XDP_INSPECTION_CONTEXT *
+XdpRxQueueGetInspectionContext(
+    _In_ XDP_RX_QUEUE *RxQueue
+    )
+{
+    return &RxQueue->InspectionContext;
+}
+
 XDP_PROGRAM *
 XdpRxQueueGetProgram(
     _In_ XDP_RX_QUEUE *RxQueue
     )
 {
-    return RxQueue->Program;
+    return RxQueue->PublishedProgram;
 }
 
 NDIS_HANDLE
@@ -1260,6 +1814,14 @@ XdpRxQueueGetInterfacePollHandle(
     return RxQueue->InterfaceRxPollHandle;
 }
 
+ULONG
+XdpRxQueueGetNumaNode(
+    _In_ XDP_RX_QUEUE *RxQueue
+    )
+{
+    return RxQueue->NumaNode;
+}
+
 XDP_RX_QUEUE_CONFIG_ACTIVATE
 XdpRxQueueGetConfig(
     _In_ XDP_RX_QUEUE *RxQueue
@@ -1276,6 +1838,16 @@ XdpRxQueueGetStats(
     return &RxQueue->PcwStats;
 }
 
+#ifdef XDP_PERF_STAGES
+XDP_PCW_RX_QUEUE_STAGES *
+XdpRxQueueGetStageStats(
+    _In_ XDP_RX_QUEUE *RxQueue
+    )
+{
+    return &RxQueue->PcwStageStats;
+}
+#endif
+
 XDP_PCW_RX_QUEUE *
 XdpRxQueueGetStatsFromInspectionContext(
     _In_ const XDP_INSPECTION_CONTEXT *Context
@@ -1285,6 +1857,55 @@ XdpRxQueueGetStatsFromInspectionContext(
     return XdpRxQueueGetStats(RxQueue);
 }
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpRxQueueSampleDrop(
+    _In_ XDP_PCW_RX_QUEUE *RxQueueStats,
+    _In_ XDP_DROP_REASON Reason,
+    _In_ UINT32 DropCount,
+    _In_opt_ XDP_FRAME *Frame,
+    _In_opt_ XDP_EXTENSION *VirtualAddressExtension
+    )
+{
+    XDP_RX_QUEUE *RxQueue = CONTAINING_RECORD(RxQueueStats, XDP_RX_QUEUE, PcwStats);
+    UINT32 SampleRate = ReadUInt32NoFence(&XdpRxDropSampleRate);
+    const UCHAR *Data = NULL;
+    UINT32 FrameLength = 0;
+    UINT16 DataLength = 0;
+
+    XdpFlightRecord(
+        XDP_FLIGHT_RECORD_EVENT_RX_DROP, RxQueue->InspectionContext.IfIndex,
+        RxQueue->Key.QueueId, RxQueue->FrameRing->ProducerIndex,
+        RxQueue->FrameRing->ConsumerIndex, DropCount, (UINT8)Reason);
+
+    if (SampleRate == 0) {
+        return;
+    }
+
+    RxQueue->DropSampleCount += DropCount;
+    if (RxQueue->DropSampleCount < SampleRate) {
+        return;
+    }
+
+    RxQueue->DropSampleCount = 0;
+
+    if (Frame != NULL && VirtualAddressExtension != NULL) {
+        XDP_BUFFER *Buffer = &Frame->Buffer;
+        XDP_BUFFER_VIRTUAL_ADDRESS *Va =
+            XdpGetVirtualAddressExtension(Buffer, VirtualAddressExtension);
+
+        //
+        // Only the leading bytes of the first buffer are sampled.
+        //
+        FrameLength = Buffer->DataLength;
+        DataLength = (UINT16)min(Buffer->DataLength, XDP_DROP_SAMPLE_BYTES);
+        Data = Va->VirtualAddress + Buffer->DataOffset;
+    }
+
+    EventWriteRxDrop(
+        &MICROSOFT_XDP_PROVIDER, RxQueue, Reason, DropCount, FrameLength, DataLength, Data);
+}
+
 VOID
 XdpRxQueueDereference(
     _In_ XDP_RX_QUEUE *RxQueue
@@ -1297,6 +1918,16 @@ XdpRxQueueDereference(
             PcwCloseInstance(RxQueue->PcwInstance);
             RxQueue->PcwInstance = NULL;
         }
+        if (RxQueue->PcwLatencyInstance != NULL) {
+            PcwCloseInstance(RxQueue->PcwLatencyInstance);
+            RxQueue->PcwLatencyInstance = NULL;
+        }
+#ifdef XDP_PERF_STAGES
+        if (RxQueue->PcwStageInstance != NULL) {
+            PcwCloseInstance(RxQueue->PcwStageInstance);
+            RxQueue->PcwStageInstance = NULL;
+        }
+#endif
         ExFreePoolWithTag(RxQueue, XDP_POOLTAG_RXQUEUE);
     }
 }
@@ -1316,6 +1947,27 @@ XdpRxRegistryUpdate(
     } else {
         XdpRxRingSize = XDP_DEFAULT_RX_RING_SIZE;
     }
+
+    Status = XdpRegQueryDwordValue(XDP_PARAMETERS_KEY, L"XdpRxRedirectBatchSize", &Value);
+    if (NT_SUCCESS(Status) && Value >= 1 && Value <= XDP_REDIRECT_BATCH_MAX_FRAMES) {
+        XdpRxRedirectBatchSize = Value;
+    } else {
+        XdpRxRedirectBatchSize = XDP_REDIRECT_BATCH_DEFAULT_FRAMES;
+    }
+
+    Status = XdpRegQueryDwordValue(XDP_PARAMETERS_KEY, L"XdpRxLatencySampleRate", &Value);
+    if (NT_SUCCESS(Status)) {
+        XdpRxLatencySampleRate = Value;
+    } else {
+        XdpRxLatencySampleRate = XDP_DEFAULT_LATENCY_SAMPLE_RATE;
+    }
+
+    Status = XdpRegQueryDwordValue(XDP_PARAMETERS_KEY, L"XdpRxDropSampleRate", &Value);
+    if (NT_SUCCESS(Status)) {
+        XdpRxDropSampleRate = Value;
+    } else {
+        XdpRxDropSampleRate = XDP_DEFAULT_DROP_SAMPLE_RATE;
+    }
 }
 
 NTSTATUS
@@ -1334,6 +1986,18 @@ XdpRxStart(
         goto Exit;
     }
 
+    Status = XdpPcwRegisterRxQueueLatency(NULL, NULL);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+#ifdef XDP_PERF_STAGES
+    Status = XdpPcwRegisterRxQueueStages(NULL, NULL);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+#endif
+
 Exit:
 
     TraceExitStatus(TRACE_CORE);
@@ -1351,5 +2015,17 @@ XdpRxStop(
         XdpPcwRxQueue = NULL;
     }
 
+    if (XdpPcwRxQueueLatency != NULL) {
+        PcwUnregister(XdpPcwRxQueueLatency);
+        XdpPcwRxQueueLatency = NULL;
+    }
+
+#ifdef XDP_PERF_STAGES
+    if (XdpPcwRxQueueStages != NULL) {
+        PcwUnregister(XdpPcwRxQueueStages);
+        XdpPcwRxQueueStages = NULL;
+    }
+#endif
+
     XdpRegWatcherRemoveClient(XdpRegWatcher, &XdpRxRegWatcherEntry);
 }
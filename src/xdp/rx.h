@@ -22,6 +22,17 @@ XdpRxQueueFindOrCreate(
     _Out_ XDP_RX_QUEUE **RxQueue
     );
 
+//
+// Notifies the interface, e.g. to resume receiving frames XDP left in the
+// frame ring under backpressure. The RX queue must be attached to the
+// interface.
+//
+VOID
+XdpRxQueueInvokeInterfaceNotify(
+    _In_ XDP_RX_QUEUE *RxQueue,
+    _In_ XDP_NOTIFY_QUEUE_FLAGS Flags
+    );
+
 typedef struct _XDP_RX_QUEUE_NOTIFY_ENTRY XDP_RX_QUEUE_NOTIFICATION_ENTRY;
 
 typedef enum _XDP_RX_QUEUE_NOTIFICATION_TYPE {
@@ -73,6 +84,23 @@ XdpRxQueueSync(
     _In_opt_ VOID *CallbackContext
     );
 
+//
+// Split form of XdpRxQueueSync, allowing a binding worker to start syncs on
+// many queues (or many syncs on one queue) before waiting for any of them.
+//
+VOID
+XdpRxQueueSyncStart(
+    _In_ XDP_RX_QUEUE *RxQueue,
+    _Out_ XDP_QUEUE_BLOCKING_SYNC_CONTEXT *SyncEntry,
+    _In_ XDP_QUEUE_SYNC_CALLBACK *Callback,
+    _In_opt_ VOID *CallbackContext
+    );
+
+VOID
+XdpRxQueueSyncWait(
+    _In_ XDP_QUEUE_BLOCKING_SYNC_CONTEXT *SyncEntry
+    );
+
 typedef
 NTSTATUS
 XDP_RX_QUEUE_VALIDATE(
@@ -80,12 +108,48 @@ XDP_RX_QUEUE_VALIDATE(
     _In_opt_ VOID *ValidationContext
     );
 
+//
+// Retires a program the RX queue's data path no longer references. Invoked on
+// the data path execution context.
+//
+typedef
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XDP_RX_QUEUE_RETIRE_PROGRAM(
+    _In_ XDP_PROGRAM *Program
+    );
+
+//
+// Sets, replaces, or removes the RX queue's program. When replacing a program
+// with a retire routine, the swap completes asynchronously and the old program
+// is passed to the retire routine once the data path stops referencing it;
+// syncs started afterwards complete only after the retirement.
+//
 NTSTATUS
 XdpRxQueueSetProgram(
     _In_ XDP_RX_QUEUE *RxQueue,
     _In_opt_ XDP_PROGRAM *Program,
     _In_opt_ XDP_RX_QUEUE_VALIDATE ValidationRoutine,
-    _In_opt_ VOID *ValidationContext
+    _In_opt_ VOID *ValidationContext,
+    _In_opt_ XDP_RX_QUEUE_RETIRE_PROGRAM *RetireRoutine
+    );
+
+//
+// Inserts or removes a socket in the RX queue's eBPF socket map. Must be
+// called from the interface binding thread.
+//
+NTSTATUS
+XdpRxQueueInsertEbpfXsk(
+    _In_ XDP_RX_QUEUE *RxQueue,
+    _In_ UINT32 Key,
+    _In_ HANDLE Xsk
+    );
+
+VOID
+XdpRxQueueRemoveEbpfXsk(
+    _In_ XDP_RX_QUEUE *RxQueue,
+    _In_ UINT32 Key,
+    _In_ HANDLE Xsk
     );
 
 XDP_RX_QUEUE *
@@ -93,6 +157,34 @@ XdpRxQueueFromRedirectContext(
     _In_ XDP_REDIRECT_CONTEXT *RedirectContext
     );
 
+//
+// Returns the rings and extensions needed to read the frames of the RX queue's
+// current receive batch, for redirect targets that copy frames.
+//
+VOID
+XdpRxQueueGetFrameRings(
+    _In_ XDP_RX_QUEUE *RxQueue,
+    _Out_ XDP_RING **FrameRing,
+    _Out_ XDP_RING **FragmentRing,
+    _Out_ XDP_EXTENSION **VirtualAddressExtension,
+    _Out_ XDP_EXTENSION **FragmentExtension
+    );
+
+XDP_BINDING_HANDLE
+XdpRxQueueGetBinding(
+    _In_ XDP_RX_QUEUE *RxQueue
+    );
+
+const XDP_HOOK_ID *
+XdpRxQueueGetHookId(
+    _In_ XDP_RX_QUEUE *RxQueue
+    );
+
+UINT32
+XdpRxQueueGetQueueId(
+    _In_ XDP_RX_QUEUE *RxQueue
+    );
+
 LIST_ENTRY *
 XdpRxQueueGetProgramBindingList(
     _In_ XDP_RX_QUEUE *RxQueue
@@ -103,11 +195,21 @@ XdpRxQueueGetProgram(
     _In_ XDP_RX_QUEUE *RxQueue
     );
 
+XDP_INSPECTION_CONTEXT *
+XdpRxQueueGetInspectionContext(
+    _In_ XDP_RX_QUEUE *RxQueue
+    );
+
 NDIS_HANDLE
 XdpRxQueueGetInterfacePollHandle(
     _In_ XDP_RX_QUEUE *RxQueue
     );
 
+ULONG
+XdpRxQueueGetNumaNode(
+    _In_ XDP_RX_QUEUE *RxQueue
+    );
+
 XDP_RX_QUEUE_CONFIG_ACTIVATE
 XdpRxQueueGetConfig(
     _In_ XDP_RX_QUEUE *RxQueue
@@ -118,21 +220,77 @@ XdpRxQueueGetMaximumFragments(
     _In_ XDP_RX_QUEUE_CONFIG_ACTIVATE RxQueueConfig
     );
 
+BOOLEAN
+XdpRxQueueIsTimestampEnabled(
+    _In_ XDP_RX_QUEUE_CONFIG_ACTIVATE RxQueueConfig
+    );
+
+BOOLEAN
+XdpRxQueueIsRxMetadataEnabled(
+    _In_ XDP_RX_QUEUE_CONFIG_ACTIVATE RxQueueConfig
+    );
+
 BOOLEAN
 XdpRxQueueIsTxActionSupported(
     _In_ XDP_RX_QUEUE_CONFIG_ACTIVATE RxQueueConfig
     );
 
+BOOLEAN
+XdpRxQueueIsHeaderSplit(
+    _In_ XDP_RX_QUEUE_CONFIG_ACTIVATE RxQueueConfig
+    );
+
+BOOLEAN
+XdpRxQueueIsBackpressureSupported(
+    _In_ XDP_RX_QUEUE_CONFIG_ACTIVATE RxQueueConfig
+    );
+
 XDP_PCW_RX_QUEUE *
 XdpRxQueueGetStats(
     _In_ XDP_RX_QUEUE *RxQueue
     );
 
+#ifdef XDP_PERF_STAGES
+XDP_PCW_RX_QUEUE_STAGES *
+XdpRxQueueGetStageStats(
+    _In_ XDP_RX_QUEUE *RxQueue
+    );
+#endif
+
 XDP_PCW_RX_QUEUE *
 XdpRxQueueGetStatsFromInspectionContext(
     _In_ const XDP_INSPECTION_CONTEXT *Context
     );
 
+//
+// Reasons a receive queue drops (or truncates) frames. Each reason has a
+// dedicated perf counter, and drops are reported via a sampled ETW event.
+//
+typedef enum _XDP_DROP_REASON {
+    XdpDropReasonFillRingEmpty,
+    XdpDropReasonRxRingFull,
+    XdpDropReasonTruncated,
+    XdpDropReasonInvalidDescriptor,
+    XdpDropReasonRule,
+    XdpDropReasonEbpfFailure,
+    XdpDropReasonBounceFailure,
+    XdpDropReasonLowResources,
+} XDP_DROP_REASON;
+
+//
+// Emits an ETW event for one in every XdpRxDropSampleRate drops on the queue.
+// If a frame is provided, the event carries its leading bytes.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpRxQueueSampleDrop(
+    _In_ XDP_PCW_RX_QUEUE *RxQueueStats,
+    _In_ XDP_DROP_REASON Reason,
+    _In_ UINT32 DropCount,
+    _In_opt_ XDP_FRAME *Frame,
+    _In_opt_ XDP_EXTENSION *VirtualAddressExtension
+    );
+
 NTSTATUS
 XdpRxStart(
     VOID
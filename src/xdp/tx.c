@@ -14,6 +14,13 @@ static XDP_REG_WATCHER_CLIENT_ENTRY XdpTxRegWatcherEntry;
 
 #define XDP_DEFAULT_TX_RING_SIZE 32
 static UINT32 XdpTxRingSize = XDP_DEFAULT_TX_RING_SIZE;
+static UINT32 XdpTxLatencySampleRate = XDP_DEFAULT_LATENCY_SAMPLE_RATE;
+
+//
+// The number of frames each datapath client may fill per unit of weight on
+// each deficit round-robin visit.
+//
+#define XDP_TX_QUEUE_QUANTUM 8
 
 typedef struct _XDP_TX_QUEUE_KEY {
     XDP_HOOK_ID HookId;
@@ -31,13 +38,19 @@ typedef struct _XDP_TX_QUEUE {
     XDP_REFERENCE_COUNT ReferenceCount;
     XDP_BINDING_HANDLE Binding;
     XDP_TX_QUEUE_KEY Key;
+    UINT32 IfIndex;
     XDP_TX_QUEUE_STATE State;
     XDP_BINDING_CLIENT_ENTRY BindingClientEntry;
     LIST_ENTRY NotifyClients;
     PCW_INSTANCE *PcwInstance;
+    PCW_INSTANCE *PcwLatencyInstance;
+#ifdef XDP_PERF_STAGES
+    PCW_INSTANCE *PcwStageInstance;
+#endif
 
     XDP_TX_CAPABILITIES InterfaceTxCapabilities;
     XDP_DMA_CAPABILITIES InterfaceDmaCapabilities;
+    ULONG NumaNode;
 
     NDIS_HANDLE InterfacePollHandle;
 
@@ -64,8 +77,22 @@ typedef struct _XDP_TX_QUEUE {
     XDP_EXTENSION_SET *TxFrameCompletionExtensionSet;
     XDP_EXTENSION TxCompletionContextExtension;
     XDP_PCW_TX_QUEUE PcwStats;
+    XDP_PCW_TX_QUEUE_LATENCY PcwLatencyStats;
+#ifdef XDP_PERF_STAGES
+    XDP_PCW_TX_QUEUE_STAGES PcwStageStats;
+#endif
+    UINT32 LatencySampleCount;
+    BOOLEAN CompletionSamplePending;
+    UINT32 CompletionSampleIndex;
+    INT64 CompletionSampleQpc;
     LIST_ENTRY ClientList;
     LIST_ENTRY *FillEntry;
+    //
+    // See XDP_TX_QUEUE_CREATE_GET_BUFFER_MDL_GENERATION.
+    //
+    UINT32 BufferMdlGeneration;
+    UINT32 LastBufferMdlGeneration;
+    UINT32 TxTargetClientCount;
     XDP_TX_QUEUE_DISPATCH Dispatch;
     XDP_QUEUE_SYNC Sync;
 #if DBG
@@ -89,6 +116,49 @@ XdpTxQueueInvokeInterfaceNotify(
     TxQueue->InterfaceTxDispatch->InterfaceNotifyQueue(TxQueue->InterfaceTxQueue, Flags);
 }
 
+static
+FORCEINLINE
+UINT32
+XdpTxQueueClientFill(
+    _In_ XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *ClientEntry,
+    _In_ UINT32 FrameQuota
+    )
+{
+    if (ClientEntry->Type == XDP_TX_QUEUE_DATAPATH_CLIENT_TYPE_TX_TARGET) {
+        return XdpTxTargetFillTx(ClientEntry, FrameQuota);
+    }
+
+    return XskFillTx(ClientEntry, FrameQuota);
+}
+
+static
+FORCEINLINE
+BOOLEAN
+XdpTxQueueClientFillCompletion(
+    _In_ XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *ClientEntry
+    )
+{
+    if (ClientEntry->Type == XDP_TX_QUEUE_DATAPATH_CLIENT_TYPE_TX_TARGET) {
+        return XdpTxTargetFillTxCompletion(ClientEntry);
+    }
+
+    return XskFillTxCompletion(ClientEntry);
+}
+
+static
+FORCEINLINE
+VOID
+XdpTxQueueClientFlushCompletion(
+    _In_ XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *ClientEntry
+    )
+{
+    if (ClientEntry->Type == XDP_TX_QUEUE_DATAPATH_CLIENT_TYPE_TX_TARGET) {
+        XdpTxTargetFlushTxCompletion(ClientEntry);
+    } else {
+        XskFlushTxCompletion(ClientEntry);
+    }
+}
+
 static
 _IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
@@ -97,12 +167,15 @@ XdpTxQueueDatapathComplete(
     )
 {
     XDP_TX_FRAME_COMPLETION_CONTEXT *CompletionContext;
+    XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *ClientEntry;
+    XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *CompletionList = NULL;
+    UINT32 CompletedIndex;
 
     //
-    // Review: This algorithm is somewhat naive: depending on the number of XSKs
-    // bound to the queue, it may be advantageous to pre-sort completions to
-    // enable better batching, and/or to defer the XSK completion epilogues to
-    // the end of this routine.
+    // Completions from multiple clients are interleaved on the queue's rings.
+    // Each client consumes its runs contiguously as they are encountered, and
+    // the clients with pending completions are chained together so each
+    // publishes its completions and runs the epilogue once, at the end.
     //
 
     if (TxQueue->CompletionRing == NULL) {
@@ -118,8 +191,14 @@ XdpTxQueueDatapathComplete(
             //
             // Consumes one or more completions via the completion ring.
             //
-            XskFillTxCompletion(CompletionContext->Context);
+            ClientEntry = CompletionContext->Context;
+            if (XdpTxQueueClientFillCompletion(ClientEntry)) {
+                ClientEntry->NextCompletion = CompletionList;
+                CompletionList = ClientEntry;
+            }
         }
+
+        CompletedIndex = FrameRing->Reserved;
     } else {
         XDP_RING *CompletionRing = TxQueue->CompletionRing;
         XDP_TX_FRAME_COMPLETION *FrameCompletion;
@@ -135,8 +214,32 @@ XdpTxQueueDatapathComplete(
             //
             // Consumes one or more completions via the frame ring.
             //
-            XskFillTxCompletion(CompletionContext->Context);
+            ClientEntry = CompletionContext->Context;
+            if (XdpTxQueueClientFillCompletion(ClientEntry)) {
+                ClientEntry->NextCompletion = CompletionList;
+                CompletionList = ClientEntry;
+            }
         }
+
+        CompletedIndex = CompletionRing->ConsumerIndex;
+    }
+
+    //
+    // The sampled frame is complete once the running completion count reaches
+    // its frame ring index. With out-of-order completions this measures the
+    // completion of an equivalent frame rather than the sampled frame itself.
+    //
+    if (TxQueue->CompletionSamplePending &&
+        (INT32)(CompletedIndex - TxQueue->CompletionSampleIndex) >= 0) {
+        XdpQueueLatencyRecord(
+            &TxQueue->PcwLatencyStats.Completion, TxQueue->CompletionSampleQpc);
+        TxQueue->CompletionSamplePending = FALSE;
+    }
+
+    while (CompletionList != NULL) {
+        ClientEntry = CompletionList;
+        CompletionList = ClientEntry->NextCompletion;
+        XdpTxQueueClientFlushCompletion(ClientEntry);
     }
 }
 
@@ -151,6 +254,7 @@ XdpTxQueueDatapathFill(
     XDP_RING *FrameRing = TxQueue->FrameRing;
     UINT32 TxLimit = FrameRing->Mask + 1;
     UINT32 TxAvailable;
+    BOOLEAN RoundFilled = FALSE;
 
     if (TxQueue->CompletionRing == NULL) {
         TxAvailable = TxLimit - (FrameRing->ProducerIndex - FrameRing->Reserved);
@@ -159,27 +263,56 @@ XdpTxQueueDatapathFill(
         TxAvailable = TxLimit - XdpRingCount(FrameRing);
     }
 
+    //
+    // Share the frame ring between clients with deficit round-robin: each visit
+    // credits a client with a quantum proportional to its weight, and the
+    // client fills at most its accumulated credit. Clients that run out of
+    // frames forfeit their remaining credit. Continue visiting clients until
+    // the frame ring is full or a full round fills no frames.
+    //
     while (TxAvailable > 0) {
+        XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *Client;
+        UINT32 Quantum;
+        UINT32 FrameQuota;
         UINT32 FrameCount;
 
         if (TxQueue->FillEntry == &TxQueue->ClientList) {
             goto NextEntry;
         }
 
-        FrameCount =
-            XskFillTx(
-                CONTAINING_RECORD(TxQueue->FillEntry, XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY, Link),
-                TxAvailable);
+        Client = CONTAINING_RECORD(TxQueue->FillEntry, XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY, Link);
+        Quantum = ReadUInt32NoFence(&Client->Weight) * XDP_TX_QUEUE_QUANTUM;
+        Client->Deficit = min(Client->Deficit + Quantum, 2 * Quantum);
+        FrameQuota = min(Client->Deficit, TxAvailable);
+
+        FrameCount = XdpTxQueueClientFill(Client, FrameQuota);
 
-        ASSERT(FrameCount <= TxAvailable);
+        ASSERT(FrameCount <= FrameQuota);
         TxAvailable -= FrameCount;
+        Client->FramesFilled += FrameCount;
+
+        if (FrameCount < FrameQuota) {
+            Client->Deficit = 0;
+        } else {
+            Client->Deficit -= FrameCount;
+
+            if (Client->Deficit == 0) {
+                Client->QuantumExhausted++;
+            }
+        }
+
+        RoundFilled |= FrameCount > 0;
 
 NextEntry:
 
         TxQueue->FillEntry = TxQueue->FillEntry->Flink;
 
         if (TxQueue->FillEntry == FirstEntry) {
-            break;
+            if (!RoundFilled) {
+                break;
+            }
+
+            RoundFilled = FALSE;
         }
     }
 
@@ -193,12 +326,58 @@ XdpFlushTransmit(
     )
 {
     XDP_TX_QUEUE *TxQueue = CONTAINING_RECORD(XdpTxQueue, XDP_TX_QUEUE, Dispatch);
+    XDP_RING *FrameRing = TxQueue->FrameRing;
+    INT64 FlushQpc = 0;
+    INT64 FillQpc;
+    UINT32 FillIndex;
+    UINT32 ProducerIndex;
 
     XdbgEnterQueueEc(TxQueue);
     STAT_INC(XdpTxQueueGetStats(TxQueue), InjectionBatches);
 
+    if (XdpQueueLatencyShouldSample(
+            &TxQueue->LatencySampleCount, ReadUInt32NoFence(&XdpTxLatencySampleRate))) {
+        FlushQpc = KeQueryPerformanceCounter(NULL).QuadPart;
+    }
+
+    STAGE_START(CompletionTsc);
+
     XdpTxQueueDatapathComplete(TxQueue);
-    XdpTxQueueDatapathFill(TxQueue);
+
+    STAGE_END(&TxQueue->PcwStageStats, CompletionCycles, CompletionTsc);
+
+    ProducerIndex = FrameRing->ProducerIndex;
+    STAGE_START(FillTsc);
+
+    if (FlushQpc != 0 && !TxQueue->CompletionSamplePending) {
+        FillQpc = KeQueryPerformanceCounter(NULL).QuadPart;
+        FillIndex = FrameRing->ProducerIndex;
+
+        XdpTxQueueDatapathFill(TxQueue);
+
+        //
+        // Track the completion of the first frame consumed by this fill.
+        //
+        if (FrameRing->ProducerIndex != FillIndex) {
+            TxQueue->CompletionSampleIndex = FillIndex + 1;
+            TxQueue->CompletionSampleQpc = FillQpc;
+            TxQueue->CompletionSamplePending = TRUE;
+        }
+    } else {
+        XdpTxQueueDatapathFill(TxQueue);
+    }
+
+    STAGE_END(&TxQueue->PcwStageStats, FillCycles, FillTsc);
+    STAGE_ADD(&TxQueue->PcwStageStats, Frames, FrameRing->ProducerIndex - ProducerIndex);
+
+    if (FlushQpc != 0) {
+        XdpQueueLatencyRecord(&TxQueue->PcwLatencyStats.Flush, FlushQpc);
+    }
+
+    XdpFlightRecord(
+        XDP_FLIGHT_RECORD_EVENT_TX_FLUSH, TxQueue->IfIndex, TxQueue->Key.QueueId,
+        FrameRing->ProducerIndex, FrameRing->ConsumerIndex,
+        FrameRing->ProducerIndex - ProducerIndex, 0);
 
     XdpQueueDatapathSync(&TxQueue->Sync);
 
@@ -258,6 +437,7 @@ static const XDP_EXTENSION_REGISTRATION XdpTxFrameExtensions[] = {
         .Info.ExtensionType     = XDP_EXTENSION_TYPE_FRAME,
         .Size                   = sizeof(XDP_TX_FRAME_COMPLETION_CONTEXT),
         .Alignment              = __alignof(XDP_TX_FRAME_COMPLETION_CONTEXT),
+        .Hot                    = TRUE,
     },
     {
         .Info.ExtensionName     = XDP_FRAME_EXTENSION_INTERFACE_CONTEXT_NAME,
@@ -266,6 +446,34 @@ static const XDP_EXTENSION_REGISTRATION XdpTxFrameExtensions[] = {
         .Size                   = 0,
         .Alignment              = __alignof(UCHAR),
     },
+    {
+        .Info.ExtensionName     = XDP_FRAME_EXTENSION_TIMESTAMP_NAME,
+        .Info.ExtensionVersion  = XDP_FRAME_EXTENSION_TIMESTAMP_VERSION_1,
+        .Info.ExtensionType     = XDP_EXTENSION_TYPE_FRAME,
+        .Size                   = sizeof(XDP_FRAME_TIMESTAMP),
+        .Alignment              = __alignof(XDP_FRAME_TIMESTAMP),
+    },
+    {
+        .Info.ExtensionName     = XDP_FRAME_EXTENSION_GSO_NAME,
+        .Info.ExtensionVersion  = XDP_FRAME_EXTENSION_GSO_VERSION_1,
+        .Info.ExtensionType     = XDP_EXTENSION_TYPE_FRAME,
+        .Size                   = sizeof(XDP_FRAME_GSO),
+        .Alignment              = __alignof(XDP_FRAME_GSO),
+    },
+    {
+        .Info.ExtensionName     = XDP_FRAME_EXTENSION_LAYOUT_NAME,
+        .Info.ExtensionVersion  = XDP_FRAME_EXTENSION_LAYOUT_VERSION_1,
+        .Info.ExtensionType     = XDP_EXTENSION_TYPE_FRAME,
+        .Size                   = sizeof(XDP_FRAME_LAYOUT),
+        .Alignment              = __alignof(XDP_FRAME_LAYOUT),
+    },
+    {
+        .Info.ExtensionName     = XDP_FRAME_EXTENSION_CHECKSUM_NAME,
+        .Info.ExtensionVersion  = XDP_FRAME_EXTENSION_CHECKSUM_VERSION_1,
+        .Info.ExtensionType     = XDP_EXTENSION_TYPE_FRAME,
+        .Size                   = sizeof(XDP_FRAME_CHECKSUM),
+        .Alignment              = __alignof(XDP_FRAME_CHECKSUM),
+    },
 };
 
 static const XDP_EXTENSION_REGISTRATION XdpTxBufferExtensions[] = {
@@ -275,6 +483,7 @@ static const XDP_EXTENSION_REGISTRATION XdpTxBufferExtensions[] = {
         .Info.ExtensionType     = XDP_EXTENSION_TYPE_BUFFER,
         .Size                   = sizeof(XDP_BUFFER_VIRTUAL_ADDRESS),
         .Alignment              = __alignof(XDP_BUFFER_VIRTUAL_ADDRESS),
+        .Hot                    = TRUE,
     },
     {
         .Info.ExtensionName     = XDP_BUFFER_EXTENSION_LOGICAL_ADDRESS_NAME,
@@ -282,6 +491,7 @@ static const XDP_EXTENSION_REGISTRATION XdpTxBufferExtensions[] = {
         .Info.ExtensionType     = XDP_EXTENSION_TYPE_BUFFER,
         .Size                   = sizeof(XDP_BUFFER_LOGICAL_ADDRESS),
         .Alignment              = __alignof(XDP_BUFFER_LOGICAL_ADDRESS),
+        .Hot                    = TRUE,
     },
     {
         .Info.ExtensionName     = XDP_BUFFER_EXTENSION_MDL_NAME,
@@ -289,6 +499,7 @@ static const XDP_EXTENSION_REGISTRATION XdpTxBufferExtensions[] = {
         .Info.ExtensionType     = XDP_EXTENSION_TYPE_BUFFER,
         .Size                   = sizeof(XDP_BUFFER_MDL),
         .Alignment              = __alignof(XDP_BUFFER_MDL),
+        .Hot                    = TRUE,
     },
     {
         .Info.ExtensionName     = XDP_BUFFER_EXTENSION_INTERFACE_CONTEXT_NAME,
@@ -307,6 +518,13 @@ static const XDP_EXTENSION_REGISTRATION XdpTxFrameCompletionExtensions[] = {
         .Size                   = sizeof(XDP_TX_FRAME_COMPLETION_CONTEXT),
         .Alignment              = __alignof(XDP_TX_FRAME_COMPLETION_CONTEXT),
     },
+    {
+        .Info.ExtensionName     = XDP_FRAME_EXTENSION_TIMESTAMP_NAME,
+        .Info.ExtensionVersion  = XDP_FRAME_EXTENSION_TIMESTAMP_VERSION_1,
+        .Info.ExtensionType     = XDP_EXTENSION_TYPE_TX_FRAME_COMPLETION,
+        .Size                   = sizeof(XDP_FRAME_TIMESTAMP),
+        .Alignment              = __alignof(XDP_FRAME_TIMESTAMP),
+    },
 };
 
 static
@@ -378,7 +596,20 @@ XdpTxQueueSetCapabilities(
         Capabilities->MdlEnabled ||
         Capabilities->DmaCapabilities != NULL);
 
-    TxQueue->InterfaceTxCapabilities = *Capabilities;
+    //
+    // Interfaces built against older headers register smaller structures.
+    //
+    RtlZeroMemory(&TxQueue->InterfaceTxCapabilities, sizeof(TxQueue->InterfaceTxCapabilities));
+    RtlCopyMemory(
+        &TxQueue->InterfaceTxCapabilities, Capabilities,
+        min(Capabilities->Header.Size, sizeof(TxQueue->InterfaceTxCapabilities)));
+
+    TxQueue->NumaNode = MM_ANY_NODE_OK;
+    if (Capabilities->Header.Revision >= XDP_TX_CAPABILITIES_REVISION_2 &&
+        Capabilities->Header.Size >= XDP_SIZEOF_TX_CAPABILITIES_REVISION_2 &&
+        Capabilities->IdealProcessorValid) {
+        TxQueue->NumaNode = XdpGetProcessorNodeNumber(&Capabilities->IdealProcessor);
+    }
 
     if (Capabilities->VirtualAddressEnabled) {
         XdpExtensionSetEnableEntry(TxQueue->BufferExtensionSet, XDP_BUFFER_EXTENSION_VIRTUAL_ADDRESS_NAME);
@@ -416,6 +647,34 @@ XdpTxQueueRegisterExtensionVersion(
         ExtensionInfo->ExtensionType);
 
     XdpExtensionSetRegisterEntry(Set, ExtensionInfo);
+
+    //
+    // Timestamps are provided only by interfaces that register the extension.
+    // In-order interfaces stamp TX frames; out-of-order interfaces stamp TX
+    // completions.
+    //
+    if (wcscmp(ExtensionInfo->ExtensionName, XDP_FRAME_EXTENSION_TIMESTAMP_NAME) == 0) {
+        XdpExtensionSetEnableEntry(Set, XDP_FRAME_EXTENSION_TIMESTAMP_NAME);
+    }
+
+    //
+    // Likewise, segmentation offload is requested only from interfaces that
+    // register the extension.
+    //
+    if (wcscmp(ExtensionInfo->ExtensionName, XDP_FRAME_EXTENSION_GSO_NAME) == 0) {
+        XdpExtensionSetEnableEntry(Set, XDP_FRAME_EXTENSION_GSO_NAME);
+    }
+
+    //
+    // Checksum offload requires both the layout and checksum extensions.
+    //
+    if (wcscmp(ExtensionInfo->ExtensionName, XDP_FRAME_EXTENSION_LAYOUT_NAME) == 0) {
+        XdpExtensionSetEnableEntry(Set, XDP_FRAME_EXTENSION_LAYOUT_NAME);
+    }
+
+    if (wcscmp(ExtensionInfo->ExtensionName, XDP_FRAME_EXTENSION_CHECKSUM_NAME) == 0) {
+        XdpExtensionSetEnableEntry(Set, XDP_FRAME_EXTENSION_CHECKSUM_NAME);
+    }
 }
 
 VOID
@@ -531,6 +790,45 @@ XdpTxQueueIsTxCompletionContextEnabled(
             TxQueue->FrameExtensionSet, XDP_TX_FRAME_COMPLETION_CONTEXT_EXTENSION_NAME);
 }
 
+BOOLEAN
+XdpTxQueueIsTimestampEnabled(
+    _In_ XDP_TX_QUEUE_CONFIG_ACTIVATE TxQueueConfig
+    )
+{
+    XDP_TX_QUEUE *TxQueue = XdpTxQueueFromConfigActivate(TxQueueConfig);
+    XDP_EXTENSION_SET *Set =
+        TxQueue->InterfaceTxCapabilities.OutOfOrderCompletionEnabled ?
+            TxQueue->TxFrameCompletionExtensionSet : TxQueue->FrameExtensionSet;
+
+    return XdpExtensionSetIsExtensionEnabled(Set, XDP_FRAME_EXTENSION_TIMESTAMP_NAME);
+}
+
+BOOLEAN
+XdpTxQueueIsGsoEnabled(
+    _In_ XDP_TX_QUEUE_CONFIG_ACTIVATE TxQueueConfig
+    )
+{
+    XDP_TX_QUEUE *TxQueue = XdpTxQueueFromConfigActivate(TxQueueConfig);
+
+    return
+        XdpExtensionSetIsExtensionEnabled(
+            TxQueue->FrameExtensionSet, XDP_FRAME_EXTENSION_GSO_NAME);
+}
+
+BOOLEAN
+XdpTxQueueIsChecksumEnabled(
+    _In_ XDP_TX_QUEUE_CONFIG_ACTIVATE TxQueueConfig
+    )
+{
+    XDP_TX_QUEUE *TxQueue = XdpTxQueueFromConfigActivate(TxQueueConfig);
+
+    return
+        XdpExtensionSetIsExtensionEnabled(
+            TxQueue->FrameExtensionSet, XDP_FRAME_EXTENSION_LAYOUT_NAME) &&
+        XdpExtensionSetIsExtensionEnabled(
+            TxQueue->FrameExtensionSet, XDP_FRAME_EXTENSION_CHECKSUM_NAME);
+}
+
 BOOLEAN
 XdpTxQueueIsFragmentationEnabled(
     _In_ XDP_TX_QUEUE_CONFIG_ACTIVATE TxQueueConfig
@@ -573,6 +871,17 @@ XdppTxQueueGetNotifyHandle(
     return (XDP_TX_QUEUE_NOTIFY_HANDLE)&TxQueue->NotifyDetails;
 }
 
+static
+CONST UINT32 *
+XdppTxQueueGetBufferMdlGeneration(
+    _In_ XDP_TX_QUEUE_CONFIG_CREATE TxQueueConfig
+    )
+{
+    XDP_TX_QUEUE *TxQueue = XdpTxQueueFromConfigCreate(TxQueueConfig);
+
+    return &TxQueue->BufferMdlGeneration;
+}
+
 static
 XDP_TX_QUEUE *
 XdpTxQueueFromNotify(
@@ -652,11 +961,12 @@ XdpTxQueueNotify(
 
 static const XDP_TX_QUEUE_CONFIG_RESERVED XdpTxConfigReservedDispatch = {
     .Header                         = {
-        .Revision                   = XDP_TX_QUEUE_CONFIG_RESERVED_REVISION_1,
-        .Size                       = XDP_SIZEOF_TX_QUEUE_CONFIG_RESERVED_REVISION_1
+        .Revision                   = XDP_TX_QUEUE_CONFIG_RESERVED_REVISION_2,
+        .Size                       = XDP_SIZEOF_TX_QUEUE_CONFIG_RESERVED_REVISION_2
     },
     .GetHookId                      = XdppTxQueueGetHookId,
     .GetNotifyHandle                = XdppTxQueueGetNotifyHandle,
+    .GetBufferMdlGeneration         = XdppTxQueueGetBufferMdlGeneration,
 };
 
 static const XDP_TX_QUEUE_CONFIG_CREATE_DISPATCH XdpTxConfigCreateDispatch = {
@@ -792,12 +1102,15 @@ XdpTxQueueCreate(
     XdpInitializeReferenceCount(&TxQueue->ReferenceCount);
     TxQueue->Binding = Binding;
     TxQueue->Key = Key;
+    TxQueue->IfIndex = XdpIfGetIfIndex(Binding);
     TxQueue->State = XdpTxQueueStateCreated;
     XdpIfInitializeClientEntry(&TxQueue->BindingClientEntry);
     InitializeListHead(&TxQueue->NotifyClients);
     XdpInitializeQueueInfo(&TxQueue->QueueInfo, XDP_QUEUE_TYPE_DEFAULT_RSS, QueueId);
     InitializeListHead(&TxQueue->ClientList);
     TxQueue->FillEntry = &TxQueue->ClientList;
+    TxQueue->BufferMdlGeneration = 1;
+    TxQueue->LastBufferMdlGeneration = 1;
     XdpQueueSyncInitialize(&TxQueue->Sync);
     XdbgInitializeQueueEc(TxQueue);
 
@@ -825,6 +1138,21 @@ XdpTxQueueCreate(
         goto Exit;
     }
 
+    Status =
+        XdpPcwCreateTxQueueLatency(
+            &TxQueue->PcwLatencyInstance, &Name, &TxQueue->PcwLatencyStats);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+#ifdef XDP_PERF_STAGES
+    Status =
+        XdpPcwCreateTxQueueStages(&TxQueue->PcwStageInstance, &Name, &TxQueue->PcwStageStats);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+#endif
+
     Status =
         XdpExtensionSetCreate(
             XDP_EXTENSION_TYPE_FRAME, XdpTxFrameExtensions, RTL_NUMBER_OF(XdpTxFrameExtensions),
@@ -910,11 +1238,16 @@ XdpTxQueueCreate(
         goto Exit;
     }
 
-    Status = XdpRingAllocate(FrameSize, FrameCount, FrameAlignment, &TxQueue->FrameRing);
+    Status =
+        XdpRingAllocate(
+            FrameSize, FrameCount, FrameAlignment, TxQueue->NumaNode, &TxQueue->FrameRing);
     if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
 
+    STAT_SET(
+        &TxQueue->PcwStats, RingMemoryBytes, XdpRingGetAllocationSize(TxQueue->FrameRing));
+
     if (TxQueue->InterfaceTxCapabilities.OutOfOrderCompletionEnabled) {
         Status =
             XdpExtensionSetAssignLayout(
@@ -926,11 +1259,16 @@ XdpTxQueueCreate(
 
         Status =
             XdpRingAllocate(
-                TxCompletionSize, FrameCount, TxCompletionAlignment, &TxQueue->CompletionRing);
+                TxCompletionSize, FrameCount, TxCompletionAlignment, TxQueue->NumaNode,
+                &TxQueue->CompletionRing);
         if (!NT_SUCCESS(Status)) {
             goto Exit;
         }
 
+        STAT_ADD(
+            &TxQueue->PcwStats, RingMemoryBytes,
+            XdpRingGetAllocationSize(TxQueue->CompletionRing));
+
         XdpInitializeExtensionInfo(
             &ExtensionInfo, XDP_TX_FRAME_COMPLETION_CONTEXT_EXTENSION_NAME,
             XDP_TX_FRAME_COMPLETION_CONTEXT_EXTENSION_VERSION_1,
@@ -1047,18 +1385,19 @@ XdpTxQueueDeregisterNotifications(
 }
 
 VOID
-XdpTxQueueSync(
+XdpTxQueueSyncStart(
     _In_ XDP_TX_QUEUE *TxQueue,
+    _Out_ XDP_QUEUE_BLOCKING_SYNC_CONTEXT *SyncEntry,
     _In_ XDP_QUEUE_SYNC_CALLBACK *Callback,
     _In_opt_ VOID *CallbackContext
     )
 {
-    XDP_QUEUE_BLOCKING_SYNC_CONTEXT SyncEntry = {0};
     XDP_NOTIFY_QUEUE_FLAGS NotifyFlags = XDP_NOTIFY_QUEUE_FLAG_TX_FLUSH;
 
     //
     // Serialize a callback with the datapath execution context. This routine
-    // must be called from the interface binding thread.
+    // must be called from the interface binding thread, and the sync must be
+    // completed with XdpTxQueueSyncWait before the binding work item returns.
     //
 
     if (TxQueue->State != XdpTxQueueStateActive) {
@@ -1066,15 +1405,64 @@ XdpTxQueueSync(
         // If the TX queue is not active (i.e. the XDP data path cannot be
         // invoked by interfaces), simply invoke the callback.
         //
-        Callback(CallbackContext);
+        XdpQueueBlockingSyncInvoke(SyncEntry, Callback, CallbackContext);
         return;
     }
 
-    XdpQueueBlockingSyncInsert(&TxQueue->Sync, &SyncEntry, Callback, CallbackContext);
+    //
+    // Syncs started back to back share a single data path flush: only the
+    // first insertion into an empty pending list notifies the interface.
+    //
+    if (XdpQueueBlockingSyncInsert(&TxQueue->Sync, SyncEntry, Callback, CallbackContext)) {
+        XdpTxQueueInvokeInterfaceNotify(TxQueue, NotifyFlags);
+    }
+}
 
-    XdpTxQueueInvokeInterfaceNotify(TxQueue, NotifyFlags);
+VOID
+XdpTxQueueSyncWait(
+    _In_ XDP_QUEUE_BLOCKING_SYNC_CONTEXT *SyncEntry
+    )
+{
+    XdpQueueBlockingSyncWait(SyncEntry);
+}
 
-    KeWaitForSingleObject(&SyncEntry.Event, Executive, KernelMode, FALSE, NULL);
+VOID
+XdpTxQueueSync(
+    _In_ XDP_TX_QUEUE *TxQueue,
+    _In_ XDP_QUEUE_SYNC_CALLBACK *Callback,
+    _In_opt_ VOID *CallbackContext
+    )
+{
+    XDP_QUEUE_BLOCKING_SYNC_CONTEXT SyncEntry = {0};
+
+    XdpTxQueueSyncStart(TxQueue, &SyncEntry, Callback, CallbackContext);
+    XdpTxQueueSyncWait(&SyncEntry);
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpTxQueueAdvanceBufferMdlGeneration(
+    _Inout_ XDP_TX_QUEUE *TxQueue
+    )
+{
+    //
+    // TX targets transmit RX frames, whose buffer MDLs are recycled by the RX
+    // interface with arbitrary contents, so disallow any reuse of buffer MDL
+    // state while a TX target is attached. Otherwise, skip zero on wrap.
+    //
+    if (TxQueue->TxTargetClientCount > 0) {
+        WriteUInt32NoFence(&TxQueue->BufferMdlGeneration, 0);
+    } else {
+        UINT32 Generation = TxQueue->LastBufferMdlGeneration + 1;
+
+        if (Generation == 0) {
+            Generation = 1;
+        }
+
+        TxQueue->LastBufferMdlGeneration = Generation;
+        WriteUInt32NoFence(&TxQueue->BufferMdlGeneration, Generation);
+    }
 }
 
 typedef struct _XDP_TX_QUEUE_SYNC_ADD_CLIENT {
@@ -1093,7 +1481,14 @@ XdpTxQueueSyncAddDatapathClient(
 
     ASSERT(Params != NULL);
 
+    Params->TxClientEntry->Deficit = 0;
     InsertTailList(&Params->TxQueue->ClientList, &Params->TxClientEntry->Link);
+
+    if (Params->TxClientEntry->Type == XDP_TX_QUEUE_DATAPATH_CLIENT_TYPE_TX_TARGET) {
+        Params->TxQueue->TxTargetClientCount++;
+    }
+
+    XdpTxQueueAdvanceBufferMdlGeneration(Params->TxQueue);
 }
 
 NTSTATUS
@@ -1108,8 +1503,10 @@ XdpTxQueueAddDatapathClient(
 
     TraceEnter(TRACE_CORE, "TxQueue=%p TxClientEntry=%p", TxQueue, TxClientEntry);
 
-    ASSERT(TxClientType == XDP_TX_QUEUE_DATAPATH_CLIENT_TYPE_XSK);
-    UNREFERENCED_PARAMETER(TxClientType);
+    ASSERT(
+        TxClientType == XDP_TX_QUEUE_DATAPATH_CLIENT_TYPE_XSK ||
+        TxClientType == XDP_TX_QUEUE_DATAPATH_CLIENT_TYPE_TX_TARGET);
+    TxClientEntry->Type = TxClientType;
 
     if (TxQueue->State == XdpTxQueueStateCreated) {
         Status =
@@ -1162,6 +1559,13 @@ XdpTxQueueSyncRemoveDatapathClient(
 
     RemoveEntryList(&Params->TxClientEntry->Link);
     InitializeListHead(&Params->TxClientEntry->Link);
+
+    if (Params->TxClientEntry->Type == XDP_TX_QUEUE_DATAPATH_CLIENT_TYPE_TX_TARGET) {
+        ASSERT(Params->TxQueue->TxTargetClientCount > 0);
+        Params->TxQueue->TxTargetClientCount--;
+    }
+
+    XdpTxQueueAdvanceBufferMdlGeneration(Params->TxQueue);
 }
 
 VOID
@@ -1205,6 +1609,14 @@ XdpTxQueueGetInterfacePollHandle(
     return TxQueue->InterfacePollHandle;
 }
 
+ULONG
+XdpTxQueueGetNumaNode(
+    _In_ XDP_TX_QUEUE *TxQueue
+    )
+{
+    return TxQueue->NumaNode;
+}
+
 XDP_TX_QUEUE_CONFIG_ACTIVATE
 XdpTxQueueGetConfig(
     _In_ XDP_TX_QUEUE *TxQueue
@@ -1273,6 +1685,12 @@ XdpTxQueueDelete(
 
     TxQueue->State = XdpTxQueueStateDeleted;
 
+    //
+    // The interface no longer invokes the data path, so complete any syncs
+    // that were started but not yet flushed.
+    //
+    XdpQueueDatapathSync(&TxQueue->Sync);
+
     if (TxQueue->CompletionRing != NULL) {
         XdpRingFreeRing(TxQueue->CompletionRing);
     }
@@ -1294,6 +1712,18 @@ XdpTxQueueDelete(
         TxQueue->PcwInstance = NULL;
     }
 
+    if (TxQueue->PcwLatencyInstance != NULL) {
+        PcwCloseInstance(TxQueue->PcwLatencyInstance);
+        TxQueue->PcwLatencyInstance = NULL;
+    }
+
+#ifdef XDP_PERF_STAGES
+    if (TxQueue->PcwStageInstance != NULL) {
+        PcwCloseInstance(TxQueue->PcwStageInstance);
+        TxQueue->PcwStageInstance = NULL;
+    }
+#endif
+
     XdpIfDeregisterClient(TxQueue->Binding, &TxQueue->BindingClientEntry);
 
     XdpTxQueueInterlockedDereference(TxQueue);
@@ -1325,6 +1755,13 @@ XdpTxRegistryUpdate(
     } else {
         XdpTxRingSize = XDP_DEFAULT_TX_RING_SIZE;
     }
+
+    Status = XdpRegQueryDwordValue(XDP_PARAMETERS_KEY, L"XdpTxLatencySampleRate", &Value);
+    if (NT_SUCCESS(Status)) {
+        XdpTxLatencySampleRate = Value;
+    } else {
+        XdpTxLatencySampleRate = XDP_DEFAULT_LATENCY_SAMPLE_RATE;
+    }
 }
 
 NTSTATUS
@@ -1343,6 +1780,18 @@ XdpTxStart(
         goto Exit;
     }
 
+    Status = XdpPcwRegisterTxQueueLatency(NULL, NULL);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+#ifdef XDP_PERF_STAGES
+    Status = XdpPcwRegisterTxQueueStages(NULL, NULL);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+#endif
+
 Exit:
 
     TraceExitStatus(TRACE_CORE);
@@ -1361,6 +1810,18 @@ XdpTxStop(
         XdpPcwTxQueue = NULL;
     }
 
+    if (XdpPcwTxQueueLatency != NULL) {
+        PcwUnregister(XdpPcwTxQueueLatency);
+        XdpPcwTxQueueLatency = NULL;
+    }
+
+#ifdef XDP_PERF_STAGES
+    if (XdpPcwTxQueueStages != NULL) {
+        PcwUnregister(XdpPcwTxQueueStages);
+        XdpPcwTxQueueStages = NULL;
+    }
+#endif
+
     XdpRegWatcherRemoveClient(XdpRegWatcher, &XdpTxRegWatcherEntry);
 
     TraceExitSuccess(TRACE_CORE);
@@ -71,10 +71,27 @@ XdpTxQueueDeregisterNotifications(
 
 typedef enum _XDP_TX_QUEUE_DATAPATH_CLIENT_TYPE {
     XDP_TX_QUEUE_DATAPATH_CLIENT_TYPE_XSK,
+    XDP_TX_QUEUE_DATAPATH_CLIENT_TYPE_TX_TARGET,
 } XDP_TX_QUEUE_DATAPATH_CLIENT_TYPE;
 
 typedef struct _XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY {
     LIST_ENTRY Link;
+    struct _XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *NextCompletion;
+    XDP_TX_QUEUE_DATAPATH_CLIENT_TYPE Type;
+
+    //
+    // The client's deficit round-robin weight, which must be nonzero. The
+    // client may update its weight at any time.
+    //
+    UINT32 Weight;
+    UINT32 Deficit;
+
+    //
+    // Frames filled by the client, and the number of visits on which the client
+    // consumed its entire credit.
+    //
+    UINT64 FramesFilled;
+    UINT64 QuantumExhausted;
 } XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY;
 
 NTSTATUS
@@ -97,6 +114,23 @@ XdpTxQueueSync(
     _In_opt_ VOID *CallbackContext
     );
 
+//
+// Split form of XdpTxQueueSync, allowing a binding worker to start syncs on
+// many queues (or many syncs on one queue) before waiting for any of them.
+//
+VOID
+XdpTxQueueSyncStart(
+    _In_ XDP_TX_QUEUE *TxQueue,
+    _Out_ XDP_QUEUE_BLOCKING_SYNC_CONTEXT *SyncEntry,
+    _In_ XDP_QUEUE_SYNC_CALLBACK *Callback,
+    _In_opt_ VOID *CallbackContext
+    );
+
+VOID
+XdpTxQueueSyncWait(
+    _In_ XDP_QUEUE_BLOCKING_SYNC_CONTEXT *SyncEntry
+    );
+
 CONST XDP_TX_CAPABILITIES *
 XdpTxQueueGetCapabilities(
     _In_ XDP_TX_QUEUE *TxQueue
@@ -112,6 +146,11 @@ XdpTxQueueGetInterfacePollHandle(
     _In_ XDP_TX_QUEUE *TxQueue
     );
 
+ULONG
+XdpTxQueueGetNumaNode(
+    _In_ XDP_TX_QUEUE *TxQueue
+    );
+
 XDP_TX_QUEUE_CONFIG_ACTIVATE
 XdpTxQueueGetConfig(
     _In_ XDP_TX_QUEUE *TxQueue
@@ -132,6 +171,21 @@ XdpTxQueueIsMdlEnabled(
     _In_ XDP_TX_QUEUE_CONFIG_ACTIVATE TxQueueConfig
     );
 
+BOOLEAN
+XdpTxQueueIsTimestampEnabled(
+    _In_ XDP_TX_QUEUE_CONFIG_ACTIVATE TxQueueConfig
+    );
+
+BOOLEAN
+XdpTxQueueIsGsoEnabled(
+    _In_ XDP_TX_QUEUE_CONFIG_ACTIVATE TxQueueConfig
+    );
+
+BOOLEAN
+XdpTxQueueIsChecksumEnabled(
+    _In_ XDP_TX_QUEUE_CONFIG_ACTIVATE TxQueueConfig
+    );
+
 NTSTATUS
 XdpTxStart(
     VOID
@@ -0,0 +1,879 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+//
+// This module implements interface TX queue redirect targets.
+//
+// RX buffers are returned to the receiving interface at the end of each
+// receive batch, so redirected frames cannot be transmitted in place. Instead,
+// each target owns a pool of single-frame buffers: the RX data path copies
+// redirected frames into free buffers and pends them on the target, and the TX
+// data path posts pending frames to the TX queue as a datapath client. Buffers
+// return to the pool when their frames complete. If the TX queue requires
+// logical addresses, the pool is allocated as a DMA common buffer of the TX
+// queue's device.
+//
+
+#include "precomp.h"
+#include "txtarget.tmh"
+
+//
+// The number of buffers in each target's pool, which bounds the number of
+// frames pending and outstanding on the TX queue.
+//
+#define XDP_TX_TARGET_BUFFER_COUNT 512
+
+//
+// Frames larger than a buffer are dropped.
+//
+#define XDP_TX_TARGET_MAX_BUFFER_SIZE 2048
+
+//
+// The deficit round-robin weight of the target on the TX queue, equal to the
+// default weight of an XDP socket.
+//
+#define XDP_TX_TARGET_WEIGHT 1
+
+C_ASSERT(RTL_IS_POWER_OF_TWO(XDP_TX_TARGET_BUFFER_COUNT));
+
+typedef struct _XDP_TX_TARGET_FRAME {
+    UINT32 BufferIndex;
+    UINT32 Length;
+} XDP_TX_TARGET_FRAME;
+
+typedef struct _XDP_TX_TARGET {
+    XDP_HOOK_ID HookId;
+    UINT32 QueueId;
+
+    //
+    // Synchronizes the buffer pool and pending frames between the RX and TX
+    // data paths, and the queue state and interface handle with the control
+    // path.
+    //
+    KSPIN_LOCK Lock;
+    BOOLEAN QueueActive;
+    XDP_BINDING_HANDLE IfHandle;
+
+    XDP_TX_QUEUE *Queue;
+    XDP_TX_QUEUE_NOTIFICATION_ENTRY QueueNotificationEntry;
+    XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY DatapathClientEntry;
+    XDP_BINDING_WORKITEM DeleteWorkItem;
+
+    struct {
+        BOOLEAN QueueInserted : 1;
+        BOOLEAN OutOfOrderCompletion : 1;
+        BOOLEAN VirtualAddressExt : 1;
+        BOOLEAN LogicalAddressExt : 1;
+        BOOLEAN MdlExt : 1;
+        BOOLEAN GsoExt : 1;
+        BOOLEAN ChecksumExt : 1;
+    } Flags;
+
+    XDP_RING *FrameRing;
+    XDP_RING *CompletionRing;
+    XDP_EXTENSION VaExtension;
+    XDP_EXTENSION LaExtension;
+    XDP_EXTENSION MdlExtension;
+    XDP_EXTENSION FrameTxCompletionExtension;
+    XDP_EXTENSION TxCompletionExtension;
+    XDP_EXTENSION GsoExtension;
+    XDP_EXTENSION LayoutExtension;
+    XDP_EXTENSION ChecksumExtension;
+
+    //
+    // TX data path state.
+    //
+    UINT32 OutstandingFrames;
+    UINT32 PendingCompletions;
+    BOOLEAN RundownStarted;
+    KEVENT OutstandingFlushComplete;
+
+    //
+    // The buffer pool.
+    //
+    UINT32 BufferSize;
+    UCHAR *BufferVa;
+    PHYSICAL_ADDRESS BufferLa;
+    MDL *BufferMdl;
+    DMA_ADAPTER *DmaAdapter;
+
+    UINT32 FreeCount;
+    UINT32 PendingProducer;
+    UINT32 PendingConsumer;
+    UINT32 FreeBuffers[XDP_TX_TARGET_BUFFER_COUNT];
+    XDP_TX_TARGET_FRAME Pending[XDP_TX_TARGET_BUFFER_COUNT];
+} XDP_TX_TARGET;
+
+typedef struct _XDP_TX_TARGET_BINDING_WORKITEM {
+    XDP_BINDING_WORKITEM IfWorkItem;
+    XDP_TX_TARGET *Target;
+    KEVENT CompletionEvent;
+    NTSTATUS CompletionStatus;
+} XDP_TX_TARGET_BINDING_WORKITEM;
+
+//
+// Data path routines.
+//
+
+static
+UINT32
+XdpTxTargetCopyFrame(
+    _In_ XDP_TX_TARGET *Target,
+    _In_ UINT32 BufferIndex,
+    _In_ XDP_RING *FrameRing,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ XDP_EXTENSION *FragmentExtension,
+    _In_ const XDP_REDIRECT_FRAME *RedirectFrame
+    )
+{
+    XDP_FRAME *Frame = XdpRingGetElement(FrameRing, RedirectFrame->FrameIndex);
+    UCHAR *Destination = Target->BufferVa + (SIZE_T)BufferIndex * Target->BufferSize;
+    XDP_BUFFER *Buffer = &Frame->Buffer;
+    UINT32 FragmentCount = 0;
+    UINT32 Length = 0;
+
+    if (FragmentRing != NULL) {
+        FragmentCount = XdpGetFragmentExtension(Frame, FragmentExtension)->FragmentBufferCount;
+    }
+
+    for (UINT32 Index = 0; Index <= FragmentCount; Index++) {
+        XDP_BUFFER_VIRTUAL_ADDRESS *Va;
+
+        if (Index > 0) {
+            Buffer =
+                XdpRingGetElement(
+                    FragmentRing, (RedirectFrame->FragmentIndex + Index - 1) & FragmentRing->Mask);
+        }
+
+        if (Buffer->DataLength > Target->BufferSize - Length) {
+            return 0;
+        }
+
+        Va = XdpGetVirtualAddressExtension(Buffer, VirtualAddressExtension);
+        RtlCopyMemory(
+            Destination + Length, Va->VirtualAddress + Buffer->DataOffset, Buffer->DataLength);
+        Length += Buffer->DataLength;
+    }
+
+    return Length;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpTxTargetReceive(
+    _In_ XDP_REDIRECT_BATCH *Batch
+    )
+{
+    XDP_TX_TARGET *Target = Batch->Target;
+    XDP_RING *FrameRing;
+    XDP_RING *FragmentRing;
+    XDP_EXTENSION *VirtualAddressExtension;
+    XDP_EXTENSION *FragmentExtension;
+    UINT32 FrameCount = 0;
+    KIRQL OldIrql;
+
+    XdpRxQueueGetFrameRings(
+        Batch->RxQueue, &FrameRing, &FragmentRing, &VirtualAddressExtension,
+        &FragmentExtension);
+
+    //
+    // Copy the frames under the lock, so the buffer pool cannot be released by
+    // a concurrent deactivation.
+    //
+    KeAcquireSpinLock(&Target->Lock, &OldIrql);
+
+    if (!Target->QueueActive) {
+        goto Exit;
+    }
+
+    for (UINT32 Index = 0; Index < Batch->Count && Target->FreeCount > 0; Index++) {
+        XDP_TX_TARGET_FRAME *Pending;
+        UINT32 BufferIndex = Target->FreeBuffers[Target->FreeCount - 1];
+        UINT32 Length =
+            XdpTxTargetCopyFrame(
+                Target, BufferIndex, FrameRing, FragmentRing, VirtualAddressExtension,
+                FragmentExtension, &Batch->FrameIndexes[Index]);
+
+        if (Length == 0) {
+            continue;
+        }
+
+        Target->FreeCount--;
+        Pending =
+            &Target->Pending[Target->PendingProducer++ & (XDP_TX_TARGET_BUFFER_COUNT - 1)];
+        Pending->BufferIndex = BufferIndex;
+        Pending->Length = Length;
+        FrameCount++;
+    }
+
+    if (FrameCount > 0) {
+        XdpTxQueueInvokeInterfaceNotify(Target->Queue, XDP_NOTIFY_QUEUE_FLAG_TX);
+    }
+
+Exit:
+
+    KeReleaseSpinLock(&Target->Lock, OldIrql);
+
+    if (FrameCount < Batch->Count) {
+        XdpRxQueueSampleDrop(
+            XdpRxQueueGetStats(Batch->RxQueue), XdpDropReasonLowResources,
+            Batch->Count - FrameCount, NULL, NULL);
+    }
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+UINT32
+XdpTxTargetFillTx(
+    _In_ XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *DatapathClientEntry,
+    _In_ UINT32 FrameQuota
+    )
+{
+    XDP_TX_TARGET *Target =
+        CONTAINING_RECORD(DatapathClientEntry, XDP_TX_TARGET, DatapathClientEntry);
+    XDP_RING *FrameRing = Target->FrameRing;
+    UINT32 Count;
+    KIRQL OldIrql;
+
+    if (!ReadBooleanNoFence(&Target->QueueActive)) {
+        return 0;
+    }
+
+    KeAcquireSpinLock(&Target->Lock, &OldIrql);
+
+    Count = min(FrameQuota, Target->PendingProducer - Target->PendingConsumer);
+
+    for (UINT32 Index = 0; Index < Count; Index++) {
+        const XDP_TX_TARGET_FRAME *Pending =
+            &Target->Pending[(Target->PendingConsumer + Index) & (XDP_TX_TARGET_BUFFER_COUNT - 1)];
+        XDP_FRAME *Frame =
+            XdpRingGetElement(FrameRing, FrameRing->ProducerIndex & FrameRing->Mask);
+        XDP_BUFFER *Buffer = &Frame->Buffer;
+        UINT32 Offset = Pending->BufferIndex * Target->BufferSize;
+        XDP_TX_FRAME_COMPLETION_CONTEXT *CompletionContext;
+
+        Buffer->DataOffset = 0;
+        Buffer->DataLength = Pending->Length;
+        Buffer->BufferLength = Target->BufferSize;
+
+        if (Target->Flags.VirtualAddressExt) {
+            XDP_BUFFER_VIRTUAL_ADDRESS *Va;
+            Va = XdpGetVirtualAddressExtension(Buffer, &Target->VaExtension);
+            Va->VirtualAddress = Target->BufferVa + Offset;
+        }
+        if (Target->Flags.LogicalAddressExt) {
+            XDP_BUFFER_LOGICAL_ADDRESS *La;
+            La = XdpGetLogicalAddressExtension(Buffer, &Target->LaExtension);
+            La->LogicalAddress = Target->BufferLa.QuadPart + Offset;
+        }
+        if (Target->Flags.MdlExt) {
+            XDP_BUFFER_MDL *Mdl;
+            Mdl = XdpGetMdlExtension(Buffer, &Target->MdlExtension);
+            Mdl->Mdl = Target->BufferMdl;
+            Mdl->MdlOffset = Offset;
+        }
+        if (Target->Flags.GsoExt) {
+            RtlZeroMemory(
+                XdpGetFrameGsoExtension(Frame, &Target->GsoExtension), sizeof(XDP_FRAME_GSO));
+        }
+        if (Target->Flags.ChecksumExt) {
+            RtlZeroMemory(
+                XdpGetFrameLayoutExtension(Frame, &Target->LayoutExtension),
+                sizeof(XDP_FRAME_LAYOUT));
+            RtlZeroMemory(
+                XdpGetFrameChecksumExtension(Frame, &Target->ChecksumExtension),
+                sizeof(XDP_FRAME_CHECKSUM));
+        }
+
+        CompletionContext =
+            XdpGetFrameTxCompletionContextExtension(Frame, &Target->FrameTxCompletionExtension);
+        CompletionContext->Context = &Target->DatapathClientEntry;
+
+        FrameRing->ProducerIndex++;
+    }
+
+    Target->PendingConsumer += Count;
+
+    KeReleaseSpinLock(&Target->Lock, OldIrql);
+
+    Target->OutstandingFrames += Count;
+
+    return Count;
+}
+
+static
+FORCEINLINE
+UINT32
+XdpTxTargetGetBufferIndex(
+    _In_ const XDP_TX_TARGET *Target,
+    _In_ UINT64 BufferAddress
+    )
+{
+    UINT64 Offset;
+
+    if (Target->Flags.VirtualAddressExt) {
+        Offset = BufferAddress - (UINT64)Target->BufferVa;
+    } else if (Target->Flags.LogicalAddressExt) {
+        Offset = BufferAddress - Target->BufferLa.QuadPart;
+    } else {
+        ASSERT(Target->Flags.MdlExt);
+        Offset = BufferAddress;
+    }
+
+    ASSERT(Offset / Target->BufferSize < XDP_TX_TARGET_BUFFER_COUNT);
+    return (UINT32)(Offset / Target->BufferSize);
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+XdpTxTargetFillTxCompletion(
+    _In_ XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *DatapathClientEntry
+    )
+{
+    XDP_TX_TARGET *Target =
+        CONTAINING_RECORD(DatapathClientEntry, XDP_TX_TARGET, DatapathClientEntry);
+    UINT32 PendingCompletions = Target->PendingCompletions;
+    XDP_TX_FRAME_COMPLETION_CONTEXT *CompletionContext;
+    UINT64 BufferAddress;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&Target->Lock, &OldIrql);
+
+    if (Target->Flags.OutOfOrderCompletion) {
+        XDP_RING *XdpRing = Target->CompletionRing;
+        XDP_TX_FRAME_COMPLETION *Completion;
+
+        ASSERT(XdpRingCount(XdpRing) > 0);
+        do {
+            Completion = XdpRingGetElement(XdpRing, XdpRing->ConsumerIndex & XdpRing->Mask);
+            CompletionContext =
+                XdpGetTxCompletionContextExtension(Completion, &Target->TxCompletionExtension);
+            if (CompletionContext->Context != &Target->DatapathClientEntry) {
+                break;
+            }
+
+            Target->FreeBuffers[Target->FreeCount++] =
+                XdpTxTargetGetBufferIndex(Target, Completion->BufferAddress);
+            Target->PendingCompletions++;
+            XdpRing->ConsumerIndex++;
+        } while (XdpRingCount(XdpRing) > 0);
+    } else {
+        XDP_RING *XdpRing = Target->FrameRing;
+        XDP_FRAME *Frame;
+
+        ASSERT((XdpRing->ConsumerIndex - XdpRing->Reserved) > 0);
+        do {
+            Frame = XdpRingGetElement(XdpRing, XdpRing->Reserved & XdpRing->Mask);
+            CompletionContext =
+                XdpGetFrameTxCompletionContextExtension(
+                    Frame, &Target->FrameTxCompletionExtension);
+            if (CompletionContext->Context != &Target->DatapathClientEntry) {
+                break;
+            }
+
+            if (Target->Flags.VirtualAddressExt) {
+                BufferAddress =
+                    (UINT64)XdpGetVirtualAddressExtension(
+                        &Frame->Buffer, &Target->VaExtension)->VirtualAddress;
+            } else if (Target->Flags.LogicalAddressExt) {
+                BufferAddress =
+                    XdpGetLogicalAddressExtension(
+                        &Frame->Buffer, &Target->LaExtension)->LogicalAddress;
+            } else {
+                BufferAddress =
+                    XdpGetMdlExtension(&Frame->Buffer, &Target->MdlExtension)->MdlOffset;
+            }
+
+            Target->FreeBuffers[Target->FreeCount++] =
+                XdpTxTargetGetBufferIndex(Target, BufferAddress);
+            Target->PendingCompletions++;
+        } while ((XdpRing->ConsumerIndex - ++XdpRing->Reserved) > 0);
+    }
+
+    KeReleaseSpinLock(&Target->Lock, OldIrql);
+
+    ASSERT(Target->PendingCompletions > PendingCompletions);
+
+    return PendingCompletions == 0;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpTxTargetFlushTxCompletion(
+    _In_ XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *DatapathClientEntry
+    )
+{
+    XDP_TX_TARGET *Target =
+        CONTAINING_RECORD(DatapathClientEntry, XDP_TX_TARGET, DatapathClientEntry);
+
+    ASSERT(Target->OutstandingFrames >= Target->PendingCompletions);
+    Target->OutstandingFrames -= Target->PendingCompletions;
+    Target->PendingCompletions = 0;
+
+    if (Target->RundownStarted && Target->OutstandingFrames == 0) {
+        KeSetEvent(&Target->OutstandingFlushComplete, 0, FALSE);
+    }
+}
+
+//
+// Control path routines.
+//
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpTxTargetStartRundown(
+    _In_opt_ VOID *Context
+    )
+{
+    XDP_TX_TARGET *Target = Context;
+
+    ASSERT(Target != NULL);
+
+    Target->RundownStarted = TRUE;
+
+    if (Target->OutstandingFrames == 0) {
+        KeSetEvent(&Target->OutstandingFlushComplete, 0, FALSE);
+    }
+}
+
+static
+NTSTATUS
+XdpTxTargetAllocateBuffers(
+    _In_ XDP_TX_TARGET *Target
+    )
+{
+    const XDP_DMA_CAPABILITIES *DmaCapabilities;
+    DEVICE_DESCRIPTION DeviceDescription = {0};
+    ULONG NumberOfMapRegisters = 0;
+    ULONG PoolSize = XDP_TX_TARGET_BUFFER_COUNT * Target->BufferSize;
+
+    if (Target->Flags.LogicalAddressExt) {
+        DmaCapabilities = XdpTxQueueGetDmaCapabilities(Target->Queue);
+        ASSERT(DmaCapabilities->PhysicalDeviceObject != NULL);
+
+        DeviceDescription.Version = DEVICE_DESCRIPTION_VERSION3;
+        DeviceDescription.Master = TRUE;
+        DeviceDescription.ScatterGather = TRUE;
+        DeviceDescription.InterfaceType = InterfaceTypeUndefined;
+        DeviceDescription.MaximumLength = XDP_TX_TARGET_MAX_BUFFER_SIZE;
+        DeviceDescription.DmaAddressWidth = 64;
+
+        Target->DmaAdapter =
+            IoGetDmaAdapter(
+                DmaCapabilities->PhysicalDeviceObject, &DeviceDescription,
+                &NumberOfMapRegisters);
+        if (Target->DmaAdapter == NULL) {
+            TraceError(TRACE_CORE, "Target=%p Failed to get DMA adapter", Target);
+            return STATUS_NO_MEMORY;
+        }
+
+        Target->BufferVa =
+            Target->DmaAdapter->DmaOperations->AllocateCommonBuffer(
+                Target->DmaAdapter, PoolSize, &Target->BufferLa, TRUE);
+    } else {
+        Target->BufferVa = ExAllocatePoolZero(NonPagedPoolNx, PoolSize, XDP_POOLTAG_TX_TARGET);
+    }
+
+    if (Target->BufferVa == NULL) {
+        TraceError(TRACE_CORE, "Target=%p Failed to allocate buffers", Target);
+        return STATUS_NO_MEMORY;
+    }
+
+    if (Target->Flags.MdlExt) {
+        Target->BufferMdl = IoAllocateMdl(Target->BufferVa, PoolSize, FALSE, FALSE, NULL);
+        if (Target->BufferMdl == NULL) {
+            return STATUS_NO_MEMORY;
+        }
+
+        MmBuildMdlForNonPagedPool(Target->BufferMdl);
+    }
+
+    for (UINT32 Index = 0; Index < XDP_TX_TARGET_BUFFER_COUNT; Index++) {
+        Target->FreeBuffers[Index] = Index;
+    }
+    Target->FreeCount = XDP_TX_TARGET_BUFFER_COUNT;
+
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+XdpTxTargetFreeBuffers(
+    _In_ XDP_TX_TARGET *Target
+    )
+{
+    if (Target->BufferMdl != NULL) {
+        IoFreeMdl(Target->BufferMdl);
+        Target->BufferMdl = NULL;
+    }
+
+    if (Target->BufferVa != NULL) {
+        if (Target->DmaAdapter != NULL) {
+            Target->DmaAdapter->DmaOperations->FreeCommonBuffer(
+                Target->DmaAdapter, XDP_TX_TARGET_BUFFER_COUNT * Target->BufferSize,
+                Target->BufferLa, Target->BufferVa, TRUE);
+        } else {
+            ExFreePoolWithTag(Target->BufferVa, XDP_POOLTAG_TX_TARGET);
+        }
+        Target->BufferVa = NULL;
+    }
+
+    if (Target->DmaAdapter != NULL) {
+        Target->DmaAdapter->DmaOperations->PutDmaAdapter(Target->DmaAdapter);
+        Target->DmaAdapter = NULL;
+    }
+
+    Target->FreeCount = 0;
+    Target->PendingProducer = 0;
+    Target->PendingConsumer = 0;
+}
+
+static
+VOID
+XdpTxTargetDeactivate(
+    _In_ XDP_TX_TARGET *Target
+    )
+{
+    KIRQL OldIrql;
+
+    //
+    // Stop the RX data paths from pending frames and the TX data path from
+    // posting them.
+    //
+    KeAcquireSpinLock(&Target->Lock, &OldIrql);
+    Target->QueueActive = FALSE;
+    KeReleaseSpinLock(&Target->Lock, OldIrql);
+
+    if (Target->Flags.QueueInserted) {
+        //
+        // Wait for all outstanding TX frames to complete before releasing
+        // their buffers.
+        //
+        XdpTxQueueSync(Target->Queue, XdpTxTargetStartRundown, Target);
+        KeWaitForSingleObject(
+            &Target->OutstandingFlushComplete, Executive, KernelMode, FALSE, NULL);
+        ASSERT(Target->OutstandingFrames == 0);
+
+        XdpTxQueueRemoveDatapathClient(Target->Queue, &Target->DatapathClientEntry);
+        Target->Flags.QueueInserted = FALSE;
+    }
+
+    XdpTxTargetFreeBuffers(Target);
+}
+
+static
+VOID
+XdpTxTargetDetach(
+    _In_ XDP_TX_TARGET *Target
+    )
+{
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_CORE, "Target=%p", Target);
+
+    if (Target->Queue != NULL) {
+        XdpTxTargetDeactivate(Target);
+        XdpTxQueueDeregisterNotifications(Target->Queue, &Target->QueueNotificationEntry);
+        XdpTxQueueDereference(Target->Queue);
+        Target->Queue = NULL;
+    }
+
+    if (Target->IfHandle != NULL) {
+        XdpIfDereferenceBinding(Target->IfHandle);
+
+        //
+        // Synchronize with deletion while clearing the interface handle.
+        //
+        KeAcquireSpinLock(&Target->Lock, &OldIrql);
+        Target->IfHandle = NULL;
+        KeReleaseSpinLock(&Target->Lock, OldIrql);
+    }
+
+    TraceExitSuccess(TRACE_CORE);
+}
+
+static
+VOID
+XdpTxTargetNotifyTxQueue(
+    _In_ XDP_TX_QUEUE_NOTIFICATION_ENTRY *NotificationEntry,
+    _In_ XDP_TX_QUEUE_NOTIFICATION_TYPE NotificationType
+    )
+{
+    XDP_TX_TARGET *Target =
+        CONTAINING_RECORD(NotificationEntry, XDP_TX_TARGET, QueueNotificationEntry);
+
+    if (NotificationType != XDP_TX_QUEUE_NOTIFICATION_DETACH) {
+        return;
+    }
+
+    //
+    // Frames redirected to a detached target are dropped until the target is
+    // deleted.
+    //
+    XdpTxTargetDetach(Target);
+}
+
+static
+VOID
+XdpTxTargetBind(
+    _In_ XDP_BINDING_WORKITEM *Item
+    )
+{
+    XDP_TX_TARGET_BINDING_WORKITEM *WorkItem = (XDP_TX_TARGET_BINDING_WORKITEM *)Item;
+    XDP_TX_TARGET *Target = WorkItem->Target;
+    XDP_TX_QUEUE_CONFIG_ACTIVATE Config;
+    const XDP_TX_CAPABILITIES *InterfaceCapabilities;
+    XDP_EXTENSION_INFO ExtensionInfo;
+    KIRQL OldIrql;
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_CORE, "Target=%p", Target);
+
+    ASSERT(Target->IfHandle == NULL);
+    Target->IfHandle = WorkItem->IfWorkItem.BindingHandle;
+
+    Status =
+        XdpTxQueueFindOrCreate(
+            Target->IfHandle, &Target->HookId, Target->QueueId, &Target->Queue);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    XdpTxQueueRegisterNotifications(
+        Target->Queue, &Target->QueueNotificationEntry, XdpTxTargetNotifyTxQueue);
+
+    InterfaceCapabilities = XdpTxQueueGetCapabilities(Target->Queue);
+    Target->BufferSize =
+        min(min(InterfaceCapabilities->MaximumBufferSize, InterfaceCapabilities->MaximumFrameSize),
+            XDP_TX_TARGET_MAX_BUFFER_SIZE);
+
+    Config = XdpTxQueueGetConfig(Target->Queue);
+
+    Target->Flags.OutOfOrderCompletion = XdpTxQueueIsOutOfOrderCompletionEnabled(Config);
+    Target->FrameRing = XdpTxQueueGetFrameRing(Config);
+
+    //
+    // TX queues always enable completion contexts, which identify the client
+    // of each completed frame.
+    //
+    ASSERT(XdpTxQueueIsTxCompletionContextEnabled(Config));
+    XdpInitializeExtensionInfo(
+        &ExtensionInfo, XDP_TX_FRAME_COMPLETION_CONTEXT_EXTENSION_NAME,
+        XDP_TX_FRAME_COMPLETION_CONTEXT_EXTENSION_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+    XdpTxQueueGetExtension(Config, &ExtensionInfo, &Target->FrameTxCompletionExtension);
+
+    if (Target->Flags.OutOfOrderCompletion) {
+        Target->CompletionRing = XdpTxQueueGetCompletionRing(Config);
+
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_TX_FRAME_COMPLETION_CONTEXT_EXTENSION_NAME,
+            XDP_TX_FRAME_COMPLETION_CONTEXT_EXTENSION_VERSION_1,
+            XDP_EXTENSION_TYPE_TX_FRAME_COMPLETION);
+        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Target->TxCompletionExtension);
+    }
+
+    Target->Flags.VirtualAddressExt = XdpTxQueueIsVirtualAddressEnabled(Config);
+    if (Target->Flags.VirtualAddressExt) {
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_BUFFER_EXTENSION_VIRTUAL_ADDRESS_NAME,
+            XDP_BUFFER_EXTENSION_VIRTUAL_ADDRESS_VERSION_1, XDP_EXTENSION_TYPE_BUFFER);
+        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Target->VaExtension);
+    }
+
+    Target->Flags.LogicalAddressExt = XdpTxQueueIsLogicalAddressEnabled(Config);
+    if (Target->Flags.LogicalAddressExt) {
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_BUFFER_EXTENSION_LOGICAL_ADDRESS_NAME,
+            XDP_BUFFER_EXTENSION_LOGICAL_ADDRESS_VERSION_1, XDP_EXTENSION_TYPE_BUFFER);
+        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Target->LaExtension);
+    }
+
+    Target->Flags.MdlExt = XdpTxQueueIsMdlEnabled(Config);
+    if (Target->Flags.MdlExt) {
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_BUFFER_EXTENSION_MDL_NAME,
+            XDP_BUFFER_EXTENSION_MDL_VERSION_1, XDP_EXTENSION_TYPE_BUFFER);
+        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Target->MdlExtension);
+    }
+
+    Target->Flags.GsoExt = XdpTxQueueIsGsoEnabled(Config);
+    if (Target->Flags.GsoExt) {
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_FRAME_EXTENSION_GSO_NAME,
+            XDP_FRAME_EXTENSION_GSO_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Target->GsoExtension);
+    }
+
+    Target->Flags.ChecksumExt = XdpTxQueueIsChecksumEnabled(Config);
+    if (Target->Flags.ChecksumExt) {
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_FRAME_EXTENSION_LAYOUT_NAME,
+            XDP_FRAME_EXTENSION_LAYOUT_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Target->LayoutExtension);
+
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_FRAME_EXTENSION_CHECKSUM_NAME,
+            XDP_FRAME_EXTENSION_CHECKSUM_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Target->ChecksumExtension);
+    }
+
+    Status = XdpTxTargetAllocateBuffers(Target);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status =
+        XdpTxQueueAddDatapathClient(
+            Target->Queue, &Target->DatapathClientEntry,
+            XDP_TX_QUEUE_DATAPATH_CLIENT_TYPE_TX_TARGET);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Target->Flags.QueueInserted = TRUE;
+
+    KeAcquireSpinLock(&Target->Lock, &OldIrql);
+    Target->QueueActive = TRUE;
+    KeReleaseSpinLock(&Target->Lock, OldIrql);
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        XdpTxTargetDetach(Target);
+    }
+
+    TraceExitStatus(TRACE_CORE);
+
+    WorkItem->CompletionStatus = Status;
+    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+}
+
+static
+VOID
+XdpTxTargetFree(
+    _In_ XDP_TX_TARGET *Target
+    )
+{
+    ASSERT(Target->Queue == NULL);
+    ASSERT(Target->IfHandle == NULL);
+
+    ExFreePoolWithTag(Target, XDP_POOLTAG_TX_TARGET);
+}
+
+static
+VOID
+XdpTxTargetDeleteWorker(
+    _In_ XDP_BINDING_WORKITEM *Item
+    )
+{
+    XDP_TX_TARGET *Target = CONTAINING_RECORD(Item, XDP_TX_TARGET, DeleteWorkItem);
+    KIRQL OldIrql;
+
+    XdpTxTargetDetach(Target);
+
+    //
+    // Wait for XdpTxTargetDelete to release the lock it queued this work item
+    // under.
+    //
+    KeAcquireSpinLock(&Target->Lock, &OldIrql);
+    KeReleaseSpinLock(&Target->Lock, OldIrql);
+
+    XdpTxTargetFree(Target);
+}
+
+NTSTATUS
+XdpTxTargetCreate(
+    _In_ const XDP_INTERFACE_TX_TARGET *Params,
+    _Out_ XDP_TX_TARGET **Target
+    )
+{
+    XDP_TX_TARGET_BINDING_WORKITEM WorkItem = {0};
+    XDP_TX_TARGET *NewTarget;
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_CORE, "IfIndex=%u QueueId=%u", Params->IfIndex, Params->QueueId);
+
+    *Target = NULL;
+
+    NewTarget = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*NewTarget), XDP_POOLTAG_TX_TARGET);
+    if (NewTarget == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    KeInitializeSpinLock(&NewTarget->Lock);
+    KeInitializeEvent(&NewTarget->OutstandingFlushComplete, NotificationEvent, FALSE);
+    NewTarget->HookId.Layer = XDP_HOOK_L2;
+    NewTarget->HookId.Direction = XDP_HOOK_TX;
+    NewTarget->HookId.SubLayer = XDP_HOOK_INJECT;
+    NewTarget->QueueId = Params->QueueId;
+    NewTarget->DatapathClientEntry.Weight = XDP_TX_TARGET_WEIGHT;
+
+    WorkItem.IfWorkItem.BindingHandle =
+        XdpIfFindAndReferenceBinding(Params->IfIndex, &NewTarget->HookId, 1, NULL);
+    if (WorkItem.IfWorkItem.BindingHandle == NULL) {
+        Status = STATUS_NOT_FOUND;
+        goto Exit;
+    }
+
+    KeInitializeEvent(&WorkItem.CompletionEvent, SynchronizationEvent, FALSE);
+    WorkItem.Target = NewTarget;
+    WorkItem.IfWorkItem.WorkRoutine = XdpTxTargetBind;
+    XdpIfQueueWorkItem(&WorkItem.IfWorkItem);
+    KeWaitForSingleObject(&WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
+
+    Status = WorkItem.CompletionStatus;
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    *Target = NewTarget;
+    NewTarget = NULL;
+
+Exit:
+
+    if (NewTarget != NULL) {
+        XdpTxTargetFree(NewTarget);
+    }
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+VOID
+XdpTxTargetDelete(
+    _In_ XDP_TX_TARGET *Target
+    )
+{
+    BOOLEAN DeleteQueued = FALSE;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_CORE, "Target=%p", Target);
+
+    KeAcquireSpinLock(&Target->Lock, &OldIrql);
+
+    if (Target->IfHandle != NULL) {
+        //
+        // Detach on the interface's work queue, which also serializes with
+        // interface detach notifications.
+        //
+        Target->DeleteWorkItem.BindingHandle = Target->IfHandle;
+        Target->DeleteWorkItem.WorkRoutine = XdpTxTargetDeleteWorker;
+        XdpIfQueueWorkItem(&Target->DeleteWorkItem);
+        DeleteQueued = TRUE;
+    }
+
+    KeReleaseSpinLock(&Target->Lock, OldIrql);
+
+    if (!DeleteQueued) {
+        XdpTxTargetFree(Target);
+    }
+
+    TraceExitSuccess(TRACE_CORE);
+}
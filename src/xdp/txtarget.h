@@ -0,0 +1,59 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+//
+// An interface TX queue redirect target. Frames redirected to the target are
+// copied into XDP-owned buffers and transmitted on the TX queue as a datapath
+// client, alongside any XDP sockets bound to the same queue.
+//
+typedef struct _XDP_TX_TARGET XDP_TX_TARGET;
+
+NTSTATUS
+XdpTxTargetCreate(
+    _In_ const XDP_INTERFACE_TX_TARGET *Params,
+    _Out_ XDP_TX_TARGET **Target
+    );
+
+//
+// Deletes the target. The target detaches from its TX queue asynchronously
+// once all transmitted frames complete, so this routine does not block and may
+// be invoked from an interface binding worker.
+//
+VOID
+XdpTxTargetDelete(
+    _In_ XDP_TX_TARGET *Target
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpTxTargetReceive(
+    _In_ XDP_REDIRECT_BATCH *Batch
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+UINT32
+XdpTxTargetFillTx(
+    _In_ XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *DatapathClientEntry,
+    _In_ UINT32 FrameQuota
+    );
+
+//
+// Returns buffers of a run of completions to the target. Returns TRUE if the
+// target had no pending completions, in which case the caller must invoke
+// XdpTxTargetFlushTxCompletion once all runs are consumed.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+XdpTxTargetFillTxCompletion(
+    _In_ XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *DatapathClientEntry
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpTxTargetFlushTxCompletion(
+    _In_ XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *DatapathClientEntry
+    );
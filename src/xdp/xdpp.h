@@ -15,20 +15,38 @@
 // Internal definitions.
 //
 
+#define XDP_POOLTAG_CONNTRACK           'tCdX' // XdCt
 #define XDP_POOLTAG_CPU_CONTEXT         'CpdX' // XdpC
 #define XDP_POOLTAG_EBPF_NMR            'epdX' // Xdpe
+#define XDP_POOLTAG_ENCAP               'nEdX' // XdEn
 #define XDP_POOLTAG_EXTENSION           'EpdX' // XdpE
+#define XDP_POOLTAG_FLIGHT_RECORDER     'rFdX' // XdFr
 #define XDP_POOLTAG_IF                  'IpdX' // XdpI
 #define XDP_POOLTAG_IF_OFFLOAD          'opdX' // Xdpo
 #define XDP_POOLTAG_IFSET               'ipdX' // Xdpi
 #define XDP_POOLTAG_INTERFACE           'fIdX' // XdIf
+#define XDP_POOLTAG_LOAD_BALANCER       'bLdX' // XdLb
+#define XDP_POOLTAG_LPM                 'LpdX' // XdpL
 #define XDP_POOLTAG_MAP                 'MpdX' // XdpM
 #define XDP_POOLTAG_NMR                 'NpdX' // XdpN
+#define XDP_POOLTAG_OFFLOAD_FLOW        'FodX' // XdoF
 #define XDP_POOLTAG_OFFLOAD_QEO         'QodX' // XdoQ
+#define XDP_POOLTAG_PAYLOAD_PATTERN     'tPdX' // XdPt
+#define XDP_POOLTAG_POLICER             'lPdX' // XdPl
+#define XDP_POOLTAG_PORT_RANGE          'gPdX' // XdPg
 #define XDP_POOLTAG_PROGRAM             'PpdX' // XdpP
 #define XDP_POOLTAG_PROGRAM_OBJECT      'OpdX' // XdpO
 #define XDP_POOLTAG_PROGRAM_BINDING     'bPdX' // XdPb
+#define XDP_POOLTAG_PROGRAM_COUNTERS    'cPdX' // XdPc
+#define XDP_POOLTAG_PROGRAM_PERSISTED   'pPdX' // XdPp
+#define XDP_POOLTAG_PROGRAM_RULES       'rPdX' // XdPr
+#define XDP_POOLTAG_PROGRAM_SET         'sPdX' // XdPs
+#define XDP_POOLTAG_QUIC_LB             'lQdX' // XdQl
 #define XDP_POOLTAG_RING                'rpdX' // Xdpr
 #define XDP_POOLTAG_RXQUEUE             'RpdX' // XdpR
+#define XDP_POOLTAG_SYN_COOKIE          'cSdX' // XdSc
+#define XDP_POOLTAG_TUPLE_TABLE         'uTdX' // XdTu
 #define XDP_POOLTAG_TXQUEUE             'TpdX' // XdpT
+#define XDP_POOLTAG_TX_TARGET           'gTdX' // XdTg
+#define XDP_POOLTAG_XSK_MAP             'XpdX' // XdpX
 #define XDP_POOLTAG_PROGRAM_CONTEXT     'cpdX' // Xdpc
@@ -8,6 +8,10 @@
 #include <afxdp_helper.h>
 #include <afxdp_experimental.h>
 
+#if defined(_M_AMD64) || defined(_M_IX86)
+#include <emmintrin.h>
+#endif
+
 typedef enum _XSK_STATE {
     XskUnbound,
     XskBinding,
@@ -18,10 +22,16 @@ typedef enum _XSK_STATE {
     XskClosing,
 } XSK_STATE;
 
+//
+// The producer and consumer of a shared ring typically run on different
+// processors, so each index is written on its own cache line. The flags are
+// also separated from both, since the kernel updates them regardless of which
+// side of the ring it is on. The layout is reported via XSK_RING_INFO offsets.
+//
 typedef struct _XSK_SHARED_RING {
-    UINT32 ProducerIndex;
-    UINT32 ConsumerIndex;
-    UINT32 Flags;
+    DECLSPEC_CACHEALIGN UINT32 ProducerIndex;
+    DECLSPEC_CACHEALIGN UINT32 ConsumerIndex;
+    DECLSPEC_CACHEALIGN UINT32 Flags;
     UINT32 Reserved;
     //
     // Followed by power-of-two array of ring elements, starting on 8-byte alignment.
@@ -32,9 +42,26 @@ typedef struct _XSK_SHARED_RING {
 typedef struct _XSK_KERNEL_RING {
     XSK_SHARED_RING *Shared;
     MDL *Mdl;
+    //
+    // Large page rings are allocated directly from physical pages and mapped
+    // into system space with a reserved mapping; NULL for pool allocations.
+    //
+    VOID *ReservedMapping;
     UINT32 Size;
     UINT32 Mask;
     UINT32 ElementStride;
+    //
+    // The last observed value of the remote side's index. The remote index is
+    // only read from the shared cache line once the cached view is exhausted.
+    //
+    UINT32 CachedProducerIndex;
+    UINT32 CachedConsumerIndex;
+    //
+    // The highest occupancy sampled when either cached index was refreshed.
+    // Samples are taken from multiple contexts without synchronization, so an
+    // update may occasionally be lost. See XSK_SOCKOPT_RING_OCCUPANCY.
+    //
+    UINT32 HighWater;
     VOID *UserVa;
     VOID *OwningProcess;
     UINT32 IdealProcessor;
@@ -47,11 +74,37 @@ typedef struct _UMEM_MAPPING {
     DMA_LOGICAL_ADDRESS DmaAddress;
 } UMEM_MAPPING;
 
+//
+// A memory region added to a live UMEM. Descriptors refer to the region by its
+// ID in the high bits of the UMEM-relative address; region 0 is the registered
+// UMEM itself and is described by the UMEM's mapping.
+//
+typedef struct _UMEM_REGION {
+    UMEM_MAPPING Mapping;
+    //
+    // The size of the region, or zero if the region is absent. The RX data path
+    // holds run-down protection on the region while using its mapping.
+    //
+    UINT32 Size;
+    EX_RUNDOWN_REF Rundown;
+} UMEM_REGION;
+
+#define XSK_UMEM_REGION_OFFSET_MASK ((1ui64 << XSK_UMEM_REGION_SHIFT) - 1)
+
 typedef struct _UMEM {
     XSK_UMEM_REG Reg;
     UMEM_MAPPING Mapping;
     VOID *ReservedMapping;
     XDP_REFERENCE_COUNT ReferenceCount;
+    //
+    // The UMEM was allocated by XDP (see XSK_SOCKOPT_UMEM_ALLOC) rather than
+    // locked from the address space of the registering process.
+    //
+    BOOLEAN KernelAllocated;
+    BOOLEAN AlignedChunks;
+    UINT8 ChunkShift;
+    EX_PUSH_LOCK RegionLock;
+    UMEM_REGION Regions[XSK_UMEM_MAX_REGIONS];
 } UMEM;
 
 typedef enum _ALLOCATION_SOURCE {
@@ -66,6 +119,15 @@ typedef struct _UMEM_BOUNCE {
     ALLOCATION_SOURCE AllocationSource;
 } UMEM_BOUNCE;
 
+//
+// A mapping of socket memory into the address space of a single process.
+//
+typedef struct _XSK_USER_MAPPING {
+    MDL *Mdl;
+    VOID *UserVa;
+    VOID *OwningProcess;
+} XSK_USER_MAPPING;
+
 typedef enum _XSK_IO_WAIT_FLAGS {
     XSK_IO_WAIT_FLAG_POLL_MODE_SOCKET = 0x1,
 } XSK_IO_WAIT_FLAGS;
@@ -79,10 +141,17 @@ typedef struct _XSK_RX_XDP {
     XDP_EXTENSION VaExtension;
     XDP_EXTENSION FragmentExtension;
     XDP_EXTENSION RxActionExtension;
+    XDP_EXTENSION TimestampExtension;
+    XDP_EXTENSION RxMetadataExtension;
     NDIS_POLL_BACKCHANNEL *PollHandle;
     struct {
         UINT8 NotificationsRegistered : 1;
         UINT8 DatapathAttached : 1;
+        UINT8 TimestampExt : 1;
+        UINT8 RxMetadataExt : 1;
+        UINT8 EbpfMapInserted : 1;
+        UINT8 HeaderSplit : 1;
+        UINT8 Backpressure : 1;
     } Flags;
 
     //
@@ -92,12 +161,110 @@ typedef struct _XSK_RX_XDP {
     XDP_HOOK_ID HookId;
     XDP_RX_QUEUE *Queue;
     XDP_RX_QUEUE_NOTIFICATION_ENTRY QueueNotificationEntry;
+    //
+    // A detach sync started by a binding work item's prepare routine and
+    // completed by the detach itself.
+    //
+    XDP_QUEUE_BLOCKING_SYNC_CONTEXT DetachSync;
+    BOOLEAN DetachSyncStarted;
 } XSK_RX_XDP;
 
+#define XSK_RX_COALESCE_MAX_SEGMENTS 64
+
+//
+// The protocol headers of a single-buffer TCP or UDP frame.
+//
+typedef struct _XSK_RX_SEGMENT {
+    const UCHAR *Headers;
+    UINT32 Layer4Offset;
+    UINT32 HeaderLength;
+    UINT32 PayloadLength;
+    BOOLEAN Ipv6;
+    BOOLEAN Tcp;
+} XSK_RX_SEGMENT;
+
+//
+// A run of consecutive RX frames of one flow, delivered as a single frame
+// consisting of the first segment followed by the payloads of the others.
+//
+typedef struct _XSK_RX_COALESCE {
+    XSK_RX_SEGMENT Head;
+    UINT32 SegmentCount;
+    UINT32 FrameLength;
+    UINT32 NextSequence;
+    BOOLEAN Closed;
+    XDP_FRAME *Segments[XSK_RX_COALESCE_MAX_SEGMENTS];
+} XSK_RX_COALESCE;
+
+//
+// A fill ring shared by sockets on a shared UMEM. Each sharing socket holds a
+// copy of the ring descriptor and claims fill descriptors from the shared
+// ring into a private cache of at most XSK_RX_FILL_CACHE_SIZE entries, so
+// buffers flow to whichever socket receives traffic.
+//
+typedef struct _XSK_SHARED_FILL_RING {
+    XDP_REFERENCE_COUNT ReferenceCount;
+    XSK_KERNEL_RING Ring;
+} XSK_SHARED_FILL_RING;
+
+//
+// An RX ring produced by several sockets, each bound to a different RX queue,
+// so an application can consume many queues from a single ring. Sockets
+// reserve disjoint ranges of ring entries, fill them, and publish them in
+// reservation order. The waits and I/O completions of the socket that created
+// the ring are signaled on behalf of every sharing socket.
+//
+typedef struct _XSK_SHARED_RX_RING {
+    XDP_REFERENCE_COUNT ReferenceCount;
+    XSK_KERNEL_RING Ring;
+    struct _XSK *Owner;
+    EX_RUNDOWN_REF OwnerRundown;
+    //
+    // The end of the entries reserved by the sharing sockets.
+    //
+    DECLSPEC_CACHEALIGN UINT32 ReserveIndex;
+} XSK_SHARED_RX_RING;
+
+#define XSK_RX_FILL_CACHE_SIZE 256
+#define XSK_RX_FILL_POOL_MAX_CAPACITY 0x100000
+
 typedef struct _XSK_RX {
     XSK_KERNEL_RING Ring;
     XSK_KERNEL_RING FillRing;
+    //
+    // Receives frames redirected to XDP_REDIRECT_TARGET_TYPE_XSK_PRIORITY.
+    //
+    XSK_KERNEL_RING PriorityRing;
     XSK_RX_XDP Xdp;
+    BOOLEAN ZeroCopy;
+    BOOLEAN MultiBuffer;
+    BOOLEAN Timestamp;
+    BOOLEAN Metadata;
+    BOOLEAN Backpressure;
+    BOOLEAN EbpfMapKeyValid;
+    UINT32 HeaderSplitLength;
+    UINT32 CoalesceLength;
+    UINT32 NonTemporalCopyLength;
+    UINT32 EbpfMapKey;
+    UINT32 EbpfMetadataSize;
+    UINT32 QueueId;
+    XSK_RX_COALESCE Coalesce;
+    XSK_SHARED_RX_RING *SharedRx;
+    XSK_SHARED_FILL_RING *SharedFill;
+    //
+    // Fill descriptors claimed from a shared fill ring, or the kernel-managed
+    // pool of RX buffers (see XSK_SOCKOPT_RX_FILL_POOL).
+    //
+    UINT64 *FillCache;
+    UINT32 FillCacheMask;
+    UINT32 FillCacheHead;
+    UINT32 FillCacheCount;
+    BOOLEAN FillPool;
+    //
+    // A mask of the added UMEM regions protected from removal by the current
+    // receive batch.
+    //
+    UINT64 HeldUmemRegions;
 } XSK_RX;
 
 typedef struct _XSK_TX_XDP {
@@ -111,7 +278,13 @@ typedef struct _XSK_TX_XDP {
     XDP_EXTENSION MdlExtension;
     XDP_EXTENSION FrameTxCompletionExtension;
     XDP_EXTENSION TxCompletionExtension;
+    XDP_EXTENSION TimestampExtension;
+    XDP_EXTENSION GsoExtension;
+    XDP_EXTENSION LayoutExtension;
+    XDP_EXTENSION ChecksumExtension;
     UINT32 OutstandingFrames;
+    UINT32 PendingCompletions;
+    UINT32 DeferredCompletions;
     UINT32 MaxBufferLength;
     UINT32 MaxFrameLength;
     struct {
@@ -122,6 +295,9 @@ typedef struct _XSK_TX_XDP {
         BOOLEAN OutOfOrderCompletion : 1;
         BOOLEAN QueueInserted : 1;
         BOOLEAN QueueActive : 1;
+        BOOLEAN TimestampExt : 1;
+        BOOLEAN GsoExt : 1;
+        BOOLEAN ChecksumExt : 1;
     } Flags;
     NDIS_POLL_BACKCHANNEL *PollHandle;
     XDP_TX_QUEUE *Queue;
@@ -134,34 +310,267 @@ typedef struct _XSK_TX_XDP {
     XDP_TX_QUEUE_NOTIFICATION_ENTRY QueueNotificationEntry;
     XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY DatapathClientEntry;
     KEVENT OutstandingFlushComplete;
+    //
+    // A rundown sync started by a binding work item's prepare routine and
+    // completed by the deactivation itself.
+    //
+    XDP_QUEUE_BLOCKING_SYNC_CONTEXT RundownSync;
+    BOOLEAN RundownSyncStarted;
 } XSK_TX_XDP;
 
+//
+// Token bucket pacing the TX path. Token counts are scaled by the QPC
+// frequency so refills accumulate fractional tokens without rounding loss. The
+// bucket is configured before activation and otherwise is only accessed
+// within the TX queue's datapath execution context.
+//
+typedef struct _XSK_TX_RATE_LIMITER {
+    XSK_TX_RATE_LIMIT Settings;
+    BOOLEAN Enabled;
+    INT64 FrequencyQpc;
+    INT64 MaxElapsedQpc;
+    INT64 LastQpc;
+    INT64 BitsPerSecond;
+    INT64 BitDepth;
+    INT64 BitTokens;
+    INT64 FramesPerSecond;
+    INT64 FrameDepth;
+    INT64 FrameTokens;
+} XSK_TX_RATE_LIMITER;
+
+typedef struct _XSK_TX_REORDER_ENTRY {
+    UINT64 Address;
+    BOOLEAN Completed;
+} XSK_TX_REORDER_ENTRY;
+
+//
+// Returns out-of-order TX completions in TX ring order. The entries hold the
+// addresses of frames posted to the TX queue, oldest first, from Head to Tail.
+// Except for configuration, the reorder buffer is only accessed within the TX
+// queue's datapath execution context.
+//
+typedef struct _XSK_TX_REORDER {
+    BOOLEAN Enabled;
+    XSK_TX_REORDER_ENTRY *Entries;
+    UINT32 Mask;
+    UINT32 Head;
+    UINT32 Tail;
+    UINT32 DepthMax;
+    UINT64 Reordered;
+} XSK_TX_REORDER;
+
 typedef struct _XSK_TX {
     XSK_KERNEL_RING Ring;
     XSK_KERNEL_RING CompletionRing;
     UMEM_BOUNCE Bounce;
+    //
+    // The UMEM mapping for this socket's TX path. The DMA address is owned by
+    // this socket, since a shared UMEM may be transmitted on many interfaces.
+    //
+    UMEM_MAPPING UmemMapping;
     XSK_TX_XDP Xdp;
+    XSK_TX_RATE_LIMITER RateLimit;
+    //
+    // The pacing timer pokes the TX queue while the rate limiter or launch
+    // times hold frames in the TX ring.
+    //
+    XDP_TIMER *PaceTimer;
+    BOOLEAN PaceHeld;
     DMA_ADAPTER *DmaAdapter;
+    BOOLEAN ZeroCopyRequested;
+    BOOLEAN Timestamp;
+    BOOLEAN LaunchTime;
+    UINT32 SegmentSize;
+    UINT32 ChecksumOffloads;
+    //
+    // While the TX path lingers after going idle, the pacing timer pokes the
+    // TX queue instead of the application. IdleQpc is only accessed within the
+    // TX queue's datapath execution context.
+    //
+    UINT32 PokeLingerMs;
+    INT64 PokeLingerQpc;
+    UINT32 CompletionBatch;
+    INT64 IdleQpc;
+    XSK_TX_REORDER Reorder;
 } XSK_TX;
 
+//
+// Extended statistics, kept per processor to avoid contention on the data path.
+//
+typedef struct DECLSPEC_CACHEALIGN _XSK_PROCESSOR_STATISTICS {
+    UINT64 RxFrames;
+    UINT64 RxBytes;
+    UINT64 TxFrames;
+    UINT64 TxBytes;
+    UINT64 TxBounceFrames;
+    UINT64 RxFillRingEmpty;
+    UINT64 RxRingFull;
+    UINT64 RxFillNeedPoke;
+    UINT64 TxNeedPoke;
+    UINT64 RxPokes;
+    UINT64 TxPokes;
+    UINT64 TxBounceFailures;
+} XSK_PROCESSOR_STATISTICS;
+
+//
+// The per-processor statistics are mapped to applications as
+// XSK_STATISTICS_PAGE_PROCESSOR.
+//
+#define XSK_ASSERT_PAGE_PROCESSOR_FIELD(Field) \
+    C_ASSERT( \
+        FIELD_OFFSET(XSK_PROCESSOR_STATISTICS, Field) == \
+            FIELD_OFFSET(XSK_STATISTICS_PAGE_PROCESSOR, Field))
+XSK_ASSERT_PAGE_PROCESSOR_FIELD(RxFrames);
+XSK_ASSERT_PAGE_PROCESSOR_FIELD(RxBytes);
+XSK_ASSERT_PAGE_PROCESSOR_FIELD(TxFrames);
+XSK_ASSERT_PAGE_PROCESSOR_FIELD(TxBytes);
+XSK_ASSERT_PAGE_PROCESSOR_FIELD(TxBounceFrames);
+XSK_ASSERT_PAGE_PROCESSOR_FIELD(RxFillRingEmpty);
+XSK_ASSERT_PAGE_PROCESSOR_FIELD(RxRingFull);
+XSK_ASSERT_PAGE_PROCESSOR_FIELD(RxFillNeedPoke);
+XSK_ASSERT_PAGE_PROCESSOR_FIELD(TxNeedPoke);
+XSK_ASSERT_PAGE_PROCESSOR_FIELD(RxPokes);
+XSK_ASSERT_PAGE_PROCESSOR_FIELD(TxPokes);
+XSK_ASSERT_PAGE_PROCESSOR_FIELD(TxBounceFailures);
+C_ASSERT(sizeof(XSK_STATISTICS_PAGE_PROCESSOR) <= sizeof(XSK_PROCESSOR_STATISTICS));
+
+typedef enum _XSK_MEMORY_TYPE {
+    XskMemoryRing,
+    XskMemoryBounce,
+    XskMemoryOther,
+    XskMemoryTypeMax,
+} XSK_MEMORY_TYPE;
+
+//
+// The memory of all user mode sockets created by a process, which is limited
+// by the optional process memory limit.
+//
+typedef struct _XSK_PROCESS_MEMORY {
+    LIST_ENTRY Link;
+    PEPROCESS Process;
+    UINT32 SocketCount;
+    UINT64 Bytes;
+} XSK_PROCESS_MEMORY;
+
 typedef struct _XSK {
     XDP_FILE_OBJECT_HEADER Header;
-    XDP_REFERENCE_COUNT ReferenceCount;
+    XDP_SHARDED_REFERENCE_COUNT ReferenceCount;
     XSK_STATE State;
     UMEM *Umem;
+    //
+    // The socket's mapping of a kernel allocated UMEM (see
+    // XSK_SOCKOPT_UMEM_MAPPING).
+    //
+    XSK_USER_MAPPING UmemUserMapping;
+    //
+    // Serializes XSK_SOCKOPT_HANDOFF requests.
+    //
+    BOOLEAN HandoffInProgress;
     XSK_RX Rx;
     XSK_TX Tx;
     KSPIN_LOCK Lock;
+    BOOLEAN LargePages;
+    BOOLEAN AlignedChunks;
     UINT32 IoWaitFlags;
     XSK_IO_WAIT_FLAGS IoWaitInternalFlags;
     KEVENT IoWaitEvent;
     IRP *IoWaitIrp;
-    XSK_STATISTICS Statistics;
+    //
+    // See XSK_SOCKOPT_WAKE_PARAMETERS. The processor and performance counter
+    // of the last RX wait signal are protected by the lock.
+    //
+    struct {
+        UINT32 PriorityIncrement;
+        UINT32 Flags;
+        UINT32 RxSignalProcessor;
+        INT64 RxSignalQpc;
+    } Wake;
+    struct {
+        UINT32 MinFrames;
+        UINT32 MaxDelayUs;
+        BOOLEAN TimerArmed;
+        KTIMER Timer;
+        KDPC Dpc;
+    } NotifyModeration;
+    struct {
+        VOID *Port;
+        VOID *Key;
+        VOID *Context;
+        UINT32 Flags;
+        //
+        // Kernel mode clients are notified via a routine instead of a port.
+        // The rundown lets socket close wait for in-flight invocations.
+        //
+        XSK_KERNEL_NOTIFY_ROUTINE *Routine;
+        EX_RUNDOWN_REF Rundown;
+    } IoCompletion;
+    //
+    // The statistics are allocated in whole pages, which can be mapped into
+    // the address space of a process (see XSK_SOCKOPT_STATISTICS_PAGE).
+    // Statistics and ProcessorStatistics point into the pages.
+    //
+    struct {
+        XSK_STATISTICS_PAGE *Page;
+        UINT32 Size;
+        XSK_USER_MAPPING UserMapping;
+    } StatisticsPage;
+    XSK_STATISTICS *Statistics;
+    XSK_PROCESSOR_STATISTICS *ProcessorStatistics;
+    UINT32 ProcessorCount;
+    //
+    // Active sockets are linked into the global PCW list so their statistics
+    // can be collected as per-socket counter instances.
+    //
+    LIST_ENTRY PcwLink;
+    UINT32 PcwIfIndex;
+    UINT32 PcwId;
     EX_PUSH_LOCK PollLock;
+    //
+    // The poll mode and parameters are published with a sequence number so
+    // they can be read without the poll lock. The sequence is odd while a
+    // transition is in progress.
+    //
+    LONG PollSequence;
     XSK_POLL_MODE PollMode;
     BOOLEAN PollBusy;
+    BOOLEAN PollBusyIdle;
+    BOOLEAN PollBusyActive;
+    UINT32 PollBudget;
+    UINT32 PollBusyIdleTimeoutMs;
+    XDP_TIMER *PollBusyIdleTimer;
     ULONG PollWaiters;
     KEVENT PollRequested;
+    //
+    // Moving average of the time XSK_NOTIFY_FLAG_WAIT_SPIN waits took to
+    // become ready, in QPC ticks, used to size the spin before blocking.
+    //
+    INT64 NotifySpinAverageQpc;
+    //
+    // Native/generic mode failover. Migrating is set while the socket's data
+    // path is moved between interfaces; the timer performs the move and, while
+    // failed over, probes for the native interface.
+    //
+    struct {
+        BOOLEAN Enabled;
+        BOOLEAN Rx;
+        BOOLEAN Tx;
+        BOOLEAN Migrating;
+        BOOLEAN DetachPending;
+        BOOLEAN FailedOver;
+        UINT32 IfIndex;
+        UINT32 QueueId;
+        EX_PUSH_LOCK Lock;
+        XDP_TIMER *Timer;
+    } Failover;
+    //
+    // Non-paged memory allocated on behalf of the socket. Rings and fill
+    // caches are charged until the socket is closed, the TX bounce buffer and
+    // reorder buffer until the TX path is deactivated.
+    //
+    struct {
+        UINT64 Bytes[XskMemoryTypeMax];
+        XSK_PROCESS_MEMORY *Process;
+    } Memory;
 } XSK;
 
 typedef struct _XSK_BINDING_WORKITEM {
@@ -175,8 +584,42 @@ typedef struct _XSK_BINDING_WORKITEM {
 typedef struct _XSK_GLOBALS {
     BOOLEAN DisableTxBounce;
     BOOLEAN RxZeroCopy;
+    EX_PUSH_LOCK PcwLock;
+    LIST_ENTRY PcwSockets;
+    UINT32 PcwNextId;
+    HANDLE KernelNpiProvider;
+    KSPIN_LOCK ProcessMemoryLock;
+    LIST_ENTRY ProcessMemory;
+    UINT64 ProcessMemoryLimit;
 } XSK_GLOBALS;
 
+C_ASSERT(XSK_RX_CHECKSUM_NOT_CHECKED == XdpFrameRxChecksumEvaluationNotChecked);
+C_ASSERT(XSK_RX_CHECKSUM_SUCCEEDED == XdpFrameRxChecksumEvaluationSucceeded);
+C_ASSERT(XSK_RX_CHECKSUM_FAILED == XdpFrameRxChecksumEvaluationFailed);
+C_ASSERT(XSK_RX_CHECKSUM_INVALID == XdpFrameRxChecksumEvaluationInvalid);
+C_ASSERT(XSK_NOTIFY_SOCKETS_MAXIMUM <= MAXIMUM_WAIT_OBJECTS);
+C_ASSERT(XSK_EBPF_MAP_MAX_KEYS == XDP_EBPF_XSK_MAP_SIZE);
+C_ASSERT(XSK_EBPF_METADATA_MAX_SIZE == XDP_EBPF_METADATA_MAX_LENGTH);
+
+//
+// Checksum offloads enabled on a socket's TX path.
+//
+#define XSK_TX_CHECKSUM_OFFLOAD_IPV4 0x1
+#define XSK_TX_CHECKSUM_OFFLOAD_TCP 0x2
+#define XSK_TX_CHECKSUM_OFFLOAD_UDP 0x4
+
+//
+// If any checksum offload is enabled, each TX descriptor is followed by the
+// XDP_FRAME_LAYOUT and XDP_FRAME_CHECKSUM descriptor extensions.
+//
+#define XSK_TX_LAYOUT_EXTENSION_OFFSET sizeof(XSK_FRAME_DESCRIPTOR)
+#define XSK_TX_CHECKSUM_EXTENSION_OFFSET \
+    (XSK_TX_LAYOUT_EXTENSION_OFFSET + sizeof(XDP_FRAME_LAYOUT))
+#define XSK_TX_CHECKSUM_DESCRIPTOR_SIZE \
+    RTL_NUM_ALIGN_UP( \
+        XSK_TX_CHECKSUM_EXTENSION_OFFSET + sizeof(XDP_FRAME_CHECKSUM), \
+        __alignof(XSK_FRAME_DESCRIPTOR))
+
 static
 NTSTATUS
 XskPoke(
@@ -185,11 +628,38 @@ XskPoke(
     _In_ UINT32 TimeoutMs
     );
 
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XskPublishTxCompletion(
+    _In_ XSK *Xsk,
+    _In_ UINT32 Count
+    );
+
 #define POOLTAG_BOUNCE 'BksX' // XskB
+#define POOLTAG_CLIENT 'CksX' // XskC
+#define POOLTAG_FILL   'FksX' // XskF
+#define POOLTAG_MEMORY 'MksX' // XskM
+#define POOLTAG_NOTIFY 'NksX' // XskN
 #define POOLTAG_RING   'RksX' // XskR
+#define POOLTAG_SOCKOPT 'OksX' // XskO
+#define POOLTAG_STATS  'SksX' // XskS
+#define POOLTAG_TX_REORDER 'TksX' // XskT
 #define POOLTAG_UMEM   'UksX' // XskU
 #define POOLTAG_XSK    'kksX' // Xskk
 #define INFINITE 0xFFFFFFFF
+#define XSK_POLL_DEFAULT_BUDGET 256
+#define XSK_TX_PACE_TIMER_MS 1
+#define XSK_LARGE_PAGE_SIZE (2 * 1024 * 1024)
+#define XSK_LARGE_PAGE_PFNS (XSK_LARGE_PAGE_SIZE / PAGE_SIZE)
+#define XSK_NOTIFY_SPIN_MAX_US 50
+#define XSK_TX_POKE_LINGER_MAX_MS 1000
+#define XSK_NOTIFY_MODERATION_MAX_DELAY_US 1000000
+#define XSK_FAILOVER_PROBE_INTERVAL_MS 1000
+#define IP4_FRAGMENT_MASK 0x3FFF
+#define XSK_NOTIFY_VALID_FLAGS \
+    (XSK_NOTIFY_FLAG_POKE_RX | XSK_NOTIFY_FLAG_POKE_TX | \
+        XSK_NOTIFY_FLAG_WAIT_RX | XSK_NOTIFY_FLAG_WAIT_TX)
 
 static XSK_GLOBALS XskGlobals;
 static XDP_REG_WATCHER_CLIENT_ENTRY XskRegWatcherEntry;
@@ -208,7 +678,204 @@ XskReference(
     _In_ XSK* Xsk
     )
 {
-    XdpIncrementReferenceCount(&Xsk->ReferenceCount);
+    XdpIncrementShardedReferenceCount(&Xsk->ReferenceCount);
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+XskProcessMemoryReference(
+    _Inout_ XSK *Xsk
+    )
+{
+    XSK_PROCESS_MEMORY *NewEntry;
+    XSK_PROCESS_MEMORY *Entry = NULL;
+    PEPROCESS Process = PsGetCurrentProcess();
+    KIRQL OldIrql;
+
+    //
+    // Allocate an entry up front, since it cannot be allocated while holding
+    // the process memory lock, and discard it if the process already has one.
+    //
+    NewEntry = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*NewEntry), POOLTAG_MEMORY);
+    if (NewEntry == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    KeAcquireSpinLock(&XskGlobals.ProcessMemoryLock, &OldIrql);
+
+    for (LIST_ENTRY *Link = XskGlobals.ProcessMemory.Flink;
+        Link != &XskGlobals.ProcessMemory;
+        Link = Link->Flink) {
+        XSK_PROCESS_MEMORY *Candidate = CONTAINING_RECORD(Link, XSK_PROCESS_MEMORY, Link);
+
+        if (Candidate->Process == Process) {
+            Entry = Candidate;
+            break;
+        }
+    }
+
+    if (Entry == NULL) {
+        //
+        // The entry holds a process reference so the process object cannot be
+        // reused by another process while the entry exists.
+        //
+        ObReferenceObject(Process);
+        NewEntry->Process = Process;
+        InsertTailList(&XskGlobals.ProcessMemory, &NewEntry->Link);
+        Entry = NewEntry;
+        NewEntry = NULL;
+    }
+
+    Entry->SocketCount++;
+    Xsk->Memory.Process = Entry;
+
+    KeReleaseSpinLock(&XskGlobals.ProcessMemoryLock, OldIrql);
+
+    if (NewEntry != NULL) {
+        ExFreePoolWithTag(NewEntry, POOLTAG_MEMORY);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+XskProcessMemoryDereference(
+    _Inout_ XSK *Xsk
+    )
+{
+    XSK_PROCESS_MEMORY *Entry = Xsk->Memory.Process;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&XskGlobals.ProcessMemoryLock, &OldIrql);
+
+    if (--Entry->SocketCount == 0) {
+        ASSERT(Entry->Bytes == 0);
+        RemoveEntryList(&Entry->Link);
+    } else {
+        Entry = NULL;
+    }
+
+    KeReleaseSpinLock(&XskGlobals.ProcessMemoryLock, OldIrql);
+
+    if (Entry != NULL) {
+        ObDereferenceObject(Entry->Process);
+        ExFreePoolWithTag(Entry, POOLTAG_MEMORY);
+    }
+
+    Xsk->Memory.Process = NULL;
+}
+
+//
+// Charges memory allocated on behalf of the socket to the socket and, for user
+// mode sockets, to the owning process. Fails if the charge would exceed the
+// process memory limit. Callers charge memory before allocating it.
+//
+static
+NTSTATUS
+XskChargeMemory(
+    _Inout_ XSK *Xsk,
+    _In_ XSK_MEMORY_TYPE Type,
+    _In_ SIZE_T Size
+    )
+{
+    XSK_PROCESS_MEMORY *Entry = Xsk->Memory.Process;
+    NTSTATUS Status = STATUS_SUCCESS;
+    KIRQL OldIrql;
+
+    if (Entry != NULL) {
+        UINT64 Limit = ReadUInt64NoFence(&XskGlobals.ProcessMemoryLimit);
+
+        KeAcquireSpinLock(&XskGlobals.ProcessMemoryLock, &OldIrql);
+
+        if (Limit != 0 && (Size > Limit || Entry->Bytes > Limit - Size)) {
+            Status = STATUS_QUOTA_EXCEEDED;
+        } else {
+            Entry->Bytes += Size;
+        }
+
+        KeReleaseSpinLock(&XskGlobals.ProcessMemoryLock, OldIrql);
+
+        if (!NT_SUCCESS(Status)) {
+            TraceWarn(
+                TRACE_XSK, "Xsk=%p Process memory limit exceeded Size=%Iu Limit=%llu",
+                Xsk, Size, Limit);
+            return Status;
+        }
+    }
+
+    InterlockedExchangeAdd64((INT64 *)&Xsk->Memory.Bytes[Type], Size);
+
+    return Status;
+}
+
+static
+VOID
+XskUnchargeMemory(
+    _Inout_ XSK *Xsk,
+    _In_ XSK_MEMORY_TYPE Type,
+    _In_ SIZE_T Size
+    )
+{
+    XSK_PROCESS_MEMORY *Entry = Xsk->Memory.Process;
+    KIRQL OldIrql;
+
+    ASSERT(ReadUInt64NoFence(&Xsk->Memory.Bytes[Type]) >= Size);
+    InterlockedExchangeAdd64((INT64 *)&Xsk->Memory.Bytes[Type], -(INT64)Size);
+
+    if (Entry != NULL) {
+        KeAcquireSpinLock(&XskGlobals.ProcessMemoryLock, &OldIrql);
+        ASSERT(Entry->Bytes >= Size);
+        Entry->Bytes -= Size;
+        KeReleaseSpinLock(&XskGlobals.ProcessMemoryLock, OldIrql);
+    }
+}
+
+//
+// Uncharges all memory of the given type.
+//
+static
+VOID
+XskReleaseMemory(
+    _Inout_ XSK *Xsk,
+    _In_ XSK_MEMORY_TYPE Type
+    )
+{
+    XskUnchargeMemory(Xsk, Type, (SIZE_T)ReadUInt64NoFence(&Xsk->Memory.Bytes[Type]));
+}
+
+static
+UINT64
+XskGetMemoryBytes(
+    _In_ const XSK *Xsk
+    )
+{
+    UINT64 Bytes = 0;
+
+    for (UINT32 Type = 0; Type < XskMemoryTypeMax; Type++) {
+        Bytes += ReadUInt64NoFence(&Xsk->Memory.Bytes[Type]);
+    }
+
+    return Bytes;
+}
+
+static
+VOID
+XskFree(
+    _In_ XSK* Xsk
+    )
+{
+    if (Xsk->Memory.Process != NULL) {
+        XskProcessMemoryDereference(Xsk);
+    }
+    ASSERT(Xsk->StatisticsPage.UserMapping.Mdl == NULL);
+    ASSERT(Xsk->UmemUserMapping.Mdl == NULL);
+    if (Xsk->StatisticsPage.Page != NULL) {
+        ExFreePoolWithTag(Xsk->StatisticsPage.Page, POOLTAG_STATS);
+    }
+    XdpCleanupShardedReferenceCount(&Xsk->ReferenceCount);
+    ExFreePoolWithTag(Xsk, POOLTAG_XSK);
 }
 
 static
@@ -217,11 +884,37 @@ XskDereference(
     _In_ XSK* Xsk
     )
 {
-    if (XdpDecrementReferenceCount(&Xsk->ReferenceCount)) {
-        ExFreePoolWithTag(Xsk, POOLTAG_XSK);
+    if (XdpDecrementShardedReferenceCount(&Xsk->ReferenceCount)) {
+        XskFree(Xsk);
+    }
+}
+
+//
+// Releases the initial reference, held by the socket's file object. Programs
+// and timers reference the socket from many processors, so the reference
+// count is sharded until the socket is closed.
+//
+static
+VOID
+XskDereferenceInitial(
+    _In_ XSK* Xsk
+    )
+{
+    if (XdpDrainShardedReferenceCount(&Xsk->ReferenceCount)) {
+        XskFree(Xsk);
     }
 }
 
+static
+FORCEINLINE
+XSK_PROCESSOR_STATISTICS *
+XskGetProcessorStatistics(
+    _In_ XSK *Xsk
+    )
+{
+    return &Xsk->ProcessorStatistics[KeGetCurrentProcessorIndex()];
+}
+
 static
 UINT32
 XskWaitInFlagsToOutFlags(
@@ -256,11 +949,17 @@ XskSignalReadyIo(
 {
     KIRQL OldIrql;
     IRP *Irp = NULL;
+    CCHAR PriorityIncrement = (CCHAR)ReadUInt32NoFence(&Xsk->Wake.PriorityIncrement);
 
     ASSERT((ReadyFlags & (XSK_NOTIFY_FLAG_WAIT_RX | XSK_NOTIFY_FLAG_WAIT_TX)) == ReadyFlags);
 
     KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
     if ((Xsk->IoWaitFlags & ReadyFlags) != 0) {
+        if (Xsk->IoWaitFlags & ReadyFlags & XSK_NOTIFY_FLAG_WAIT_RX) {
+            Xsk->Wake.RxSignalProcessor = KeGetCurrentProcessorIndex();
+            Xsk->Wake.RxSignalQpc = KeQueryPerformanceCounter(NULL).QuadPart;
+        }
+
         if (Xsk->IoWaitIrp != NULL) {
             Irp = Xsk->IoWaitIrp;
             Irp->IoStatus.Information = XskWaitInFlagsToOutFlags(Xsk->IoWaitFlags & ReadyFlags);
@@ -276,4219 +975,13104 @@ XskSignalReadyIo(
                 Irp = NULL;
             }
         } else {
-            (VOID)KeSetEvent(&Xsk->IoWaitEvent, IO_NETWORK_INCREMENT, FALSE);
+            (VOID)KeSetEvent(&Xsk->IoWaitEvent, PriorityIncrement, FALSE);
         }
     }
     KeReleaseSpinLock(&Xsk->Lock, OldIrql);
 
     if (Irp != NULL) {
         EventWriteXskNotifyAsyncComplete(&MICROSOFT_XDP_PROVIDER, Xsk, Irp, Irp->IoStatus.Status);
-        IoCompleteRequest(Irp, IO_NETWORK_INCREMENT);
+        IoCompleteRequest(Irp, PriorityIncrement);
     }
 }
 
 static
-UINT32
-XskRingProdReserve(
-    _Inout_ XSK_KERNEL_RING *Ring,
-    _In_ UINT32 Count
+VOID
+XskPostIoCompletion(
+    _In_ XSK *Xsk,
+    _In_ UINT32 ReadyFlags
     )
 {
-    UINT32 Available =
-        Ring->Size - (ReadUInt32NoFence(&Ring->Shared->ProducerIndex) -
-            ReadUInt32NoFence(&Ring->Shared->ConsumerIndex));
-    return min(Available, Count);
-}
+    NTSTATUS Status;
+    XSK_KERNEL_NOTIFY_ROUTINE *Routine = Xsk->IoCompletion.Routine;
 
-static
-UINT32
-XskRingConsPeek(
-    _Inout_ XSK_KERNEL_RING *Ring,
-    _In_ UINT32 Count
-    )
-{
-    UINT32 Available =
-        ReadUInt32Acquire(&Ring->Shared->ProducerIndex) -
-            ReadUInt32NoFence(&Ring->Shared->ConsumerIndex);
-    return min(Available, Count);
+    if (Routine != NULL) {
+        if (ExAcquireRundownProtection(&Xsk->IoCompletion.Rundown)) {
+            Routine(Xsk->IoCompletion.Context, XskWaitInFlagsToOutFlags(ReadyFlags));
+            ExReleaseRundownProtection(&Xsk->IoCompletion.Rundown);
+        }
+        return;
+    }
+
+    Status =
+        IoSetIoCompletion(
+            Xsk->IoCompletion.Port, Xsk->IoCompletion.Key, Xsk->IoCompletion.Context,
+            STATUS_SUCCESS, XskWaitInFlagsToOutFlags(ReadyFlags), FALSE);
+    if (!NT_SUCCESS(Status)) {
+        //
+        // The completion packet could not be allocated. The application
+        // recovers on its next ring transition or explicit wait.
+        //
+        TraceWarn(
+            TRACE_XSK, "Xsk=%p IoSetIoCompletion failed Status=%!STATUS!", Xsk, Status);
+    }
 }
 
 static
+FORCEINLINE
 VOID
-XskRingProdSubmit(
-    _Inout_ XSK_KERNEL_RING *Ring,
-    _In_ UINT32 Count
+XskCheckIoCompletion(
+    _In_ XSK *Xsk,
+    _In_ XSK_KERNEL_RING *Ring,
+    _In_ UINT32 Produced,
+    _In_ UINT32 ReadyFlag
     )
 {
-    WriteUInt32Release(&Ring->Shared->ProducerIndex, Ring->Shared->ProducerIndex + Count);
+    //
+    // Queue a completion packet only if the application had drained the ring
+    // before this batch was produced, i.e. on an empty to non-empty transition.
+    // This coalesces completions until the application catches up, without
+    // requiring the application to re-arm anything.
+    //
+    // N.B. The caller must issue a memory barrier between submitting the
+    // produced entries and calling this routine. See comment in XskNotify.
+    //
+    if ((ReadUInt32NoFence(&Xsk->IoCompletion.Flags) & ReadyFlag) &&
+        ReadUInt32NoFence(&Ring->Shared->ConsumerIndex) ==
+            ReadUInt32NoFence(&Ring->Shared->ProducerIndex) - Produced) {
+        XskPostIoCompletion(Xsk, ReadyFlag);
+    }
 }
 
 static
 VOID
-XskRingConsRelease(
+XskKernelRingSampleOccupancy(
     _Inout_ XSK_KERNEL_RING *Ring,
-    _In_ UINT32 Count
+    _In_ UINT32 Occupancy
     )
 {
-    Ring->Shared->ConsumerIndex += Count;
+    //
+    // The application writes one of the ring indexes, so bound the occupancy to
+    // the ring size.
+    //
+    if (Occupancy > ReadUInt32NoFence(&Ring->HighWater)) {
+        WriteUInt32NoFence(&Ring->HighWater, min(Occupancy, Ring->Size));
+    }
 }
 
 static
-VOID *
-XskKernelRingGetElement(
-    _In_ XSK_KERNEL_RING *Ring,
-    _In_ UINT32 Index
+UINT32
+XskRingProdReserve(
+    _Inout_ XSK_KERNEL_RING *Ring,
+    _In_ UINT32 Count
     )
 {
-    ASSERT(Index <= Ring->Mask);
-    return (UCHAR *)&Ring->Shared[1] + (SIZE_T)Index * Ring->ElementStride;
+    UINT32 ProducerIndex = ReadUInt32NoFence(&Ring->Shared->ProducerIndex);
+    UINT32 Available = Ring->Size - (ProducerIndex - Ring->CachedConsumerIndex);
+
+    if (Available < Count) {
+        Ring->CachedConsumerIndex = ReadUInt32NoFence(&Ring->Shared->ConsumerIndex);
+        XskKernelRingSampleOccupancy(Ring, ProducerIndex - Ring->CachedConsumerIndex);
+        Available = Ring->Size - (ProducerIndex - Ring->CachedConsumerIndex);
+    }
+
+    return min(Available, Count);
 }
 
 static
-VOID
-XskKernelRingSetError(
+UINT32
+XskRingConsPeek(
     _Inout_ XSK_KERNEL_RING *Ring,
-    _In_ XSK_ERROR Error
+    _In_ UINT32 Count
     )
 {
-    if (InterlockedCompareExchange((LONG *)&Ring->Error, Error, XSK_NO_ERROR) == XSK_NO_ERROR) {
-        if (Ring->Shared != NULL) {
-            InterlockedOr((LONG *)&Ring->Shared->Flags, XSK_RING_FLAG_ERROR);
-        }
+    UINT32 ConsumerIndex = ReadUInt32NoFence(&Ring->Shared->ConsumerIndex);
+    UINT32 Available = Ring->CachedProducerIndex - ConsumerIndex;
+
+    if (Available < Count) {
+        Ring->CachedProducerIndex = ReadUInt32Acquire(&Ring->Shared->ProducerIndex);
+        Available = Ring->CachedProducerIndex - ConsumerIndex;
+        XskKernelRingSampleOccupancy(Ring, Available);
     }
+
+    return min(Available, Count);
 }
 
 static
-VOID
-XskKernelRingUpdateIdealProcessor(
-    _Inout_ XSK_KERNEL_RING *Ring
+UINT32
+XskQueryReadyIoThreshold(
+    _In_ XSK* Xsk,
+    _In_ UINT32 InFlags,
+    _In_ UINT32 MinFrames
     )
 {
-    UINT32 CurrentProcessor = KeGetCurrentProcessorIndex();
-
-    ASSERT(Ring->Size > 0);
+    UINT32 SatisfiedFlags = 0;
 
+    if (InFlags & XSK_NOTIFY_FLAG_WAIT_TX &&
+        XskRingConsPeek(&Xsk->Tx.CompletionRing, MinFrames) >= MinFrames) {
+        SatisfiedFlags |= XSK_NOTIFY_FLAG_WAIT_TX;
+    }
     //
-    // Set the ideal processor to the current processor. For queues that are not
-    // strongly affinitized (e.g. RSS disabled, not supported, plain buggy) we
-    // might need to add a heuristic to avoid indicating flapping CPUs up to
-    // applications.
+    // Any frame on the priority RX ring satisfies an RX wait, regardless of
+    // notification moderation.
     //
-
-    if (Ring->IdealProcessor != CurrentProcessor) {
-        Ring->IdealProcessor = CurrentProcessor;
-        InterlockedOr((LONG *)&Ring->Shared->Flags, XSK_RING_FLAG_AFFINITY_CHANGED);
+    if (InFlags & XSK_NOTIFY_FLAG_WAIT_RX &&
+        (XskRingConsPeek(&Xsk->Rx.Ring, MinFrames) >= MinFrames ||
+            (Xsk->Rx.PriorityRing.Size != 0 && XskRingConsPeek(&Xsk->Rx.PriorityRing, 1) > 0))) {
+        SatisfiedFlags |= XSK_NOTIFY_FLAG_WAIT_RX;
     }
+
+    return SatisfiedFlags;
 }
 
 static
-UMEM_MAPPING *
-XskGetTxMapping(
-    _In_ XSK *Xsk
+UINT32
+XskQueryReadyIo(
+    _In_ XSK* Xsk,
+    _In_ UINT32 InFlags
     )
 {
-    return
-        (Xsk->Tx.Bounce.Tracker != NULL)
-            ? &Xsk->Tx.Bounce.Mapping : &Xsk->Umem->Mapping;
+    return XskQueryReadyIoThreshold(Xsk, InFlags, 1);
 }
 
+//
+// Returns the wait flags satisfied under the socket's notification
+// moderation, i.e. whose rings hold at least the moderation frame count.
+//
 static
-BOOLEAN
-XskRequiresTxBounceBuffer(
-    XSK *Xsk
+UINT32
+XskQueryModeratedReadyIo(
+    _In_ XSK* Xsk,
+    _In_ UINT32 InFlags
     )
 {
-    //
-    // Only the NDIS6 data path requires immutable buffers.
-    // In the future, TX inspection programs may have similar requirements.
-    //
     return
-        !XskGlobals.DisableTxBounce &&
-        (XdpIfGetCapabilities(Xsk->Tx.Xdp.IfHandle)->Mode == XDP_INTERFACE_MODE_GENERIC);
+        XskQueryReadyIoThreshold(
+            Xsk, InFlags, max(1, ReadUInt32NoFence(&Xsk->NotifyModeration.MinFrames)));
 }
 
 static
+_Function_class_(KDEFERRED_ROUTINE)
+_IRQL_requires_(DISPATCH_LEVEL)
+_IRQL_requires_same_
 VOID
-XskReleaseBounceBuffer(
-    _In_ UMEM *Umem,
-    _In_ UMEM_BOUNCE *Bounce,
-    _In_ UINT64 RelativeAddress
+XskNotifyModerationTimeout(
+    _In_ struct _KDPC *Dpc,
+    _In_opt_ VOID *DeferredContext,
+    _In_opt_ VOID *SystemArgument1,
+    _In_opt_ VOID *SystemArgument2
     )
 {
-    SIZE_T ChunkIndex;
+    XSK *Xsk = DeferredContext;
+    UINT32 ReadyFlags;
 
-    if (Bounce->Tracker == NULL) {
-        //
-        // No debounce is required.
-        //
-        return;
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+    ASSERT(DeferredContext != NULL);
+
+    //
+    // Disarm before checking the rings, so frames produced after the check
+    // re-arm the timer.
+    //
+    InterlockedExchange8((CHAR *)&Xsk->NotifyModeration.TimerArmed, FALSE);
+    KeMemoryBarrier();
+
+    //
+    // The delay has elapsed, so satisfy the wait with any ready IO.
+    //
+    ReadyFlags = XskQueryReadyIo(Xsk, ReadUInt32NoFence(&Xsk->IoWaitFlags));
+    if (ReadyFlags != 0) {
+        XskSignalReadyIo(Xsk, ReadyFlags);
     }
 
-    ChunkIndex = RelativeAddress / Umem->Reg.ChunkSize;
-    Bounce->Tracker[ChunkIndex]--;
+    //
+    // Release the reference taken when the timer was armed.
+    //
+    XskDereference(Xsk);
 }
 
+//
+// Starts the moderation timer, unless it is already running. The delay is
+// measured from the first deferred notification, so later frames do not
+// extend it.
+//
 static
-_Success_(return != FALSE)
-BOOLEAN
-XskBounceBuffer(
-    _In_ UMEM *Umem,
-    _In_ UMEM_BOUNCE *Bounce,
-    _In_ XDP_BUFFER *Buffer,
-    _In_ UINT64 RelativeAddress,
-    _Out_ UMEM_MAPPING **Mapping
+VOID
+XskStartNotifyModerationTimer(
+    _In_ XSK *Xsk
     )
 {
-    SIZE_T ChunkIndex;
-
-    if (Bounce->Tracker == NULL) {
-        //
-        // No bounce is required.
-        //
-        *Mapping = &Umem->Mapping;
-        return TRUE;
-    }
+    LARGE_INTEGER DueTime;
 
-    ChunkIndex = RelativeAddress / Umem->Reg.ChunkSize;
-    if (ChunkIndex != (RelativeAddress + Buffer->BufferLength - 1) / Umem->Reg.ChunkSize) {
-        //
-        // The entire buffer must fit within a chunk.
-        //
-        return FALSE;
+    if (InterlockedExchange8((CHAR *)&Xsk->NotifyModeration.TimerArmed, TRUE)) {
+        return;
     }
 
-    if (Bounce->Tracker[ChunkIndex]++ == 0) {
+    XskReference(Xsk);
+    DueTime.QuadPart = -(INT64)ReadUInt32NoFence(&Xsk->NotifyModeration.MaxDelayUs) * 10;
+    if (KeSetTimer(&Xsk->NotifyModeration.Timer, DueTime, &Xsk->NotifyModeration.Dpc)) {
         //
-        // It is legal for an app to post the same buffer for multiple IOs, but
-        // behavior is undefined if the buffer is modified while IO is
-        // outstanding. Ignore any writes to the buffer once an IO is in flight.
+        // The timer was still queued with its own reference.
         //
-        RtlCopyMemory(
-            Bounce->Mapping.SystemAddress + RelativeAddress + Buffer->DataOffset,
-            Umem->Mapping.SystemAddress + RelativeAddress + Buffer->DataOffset,
-            Buffer->DataLength);
+        XskDereference(Xsk);
     }
-
-    *Mapping = &Bounce->Mapping;
-    return TRUE;
 }
 
+//
+// Signals a waiter on a ring the data path produced to, unless notification
+// moderation defers the signal until more frames arrive or the delay elapses.
+//
+// N.B. The caller must issue a memory barrier between submitting the
+// produced entries and calling this routine. See comment in XskNotify.
+//
 static
-NTSTATUS
-XskAllocateTxBounceBuffer(
-    _Inout_ XSK *Xsk
+VOID
+XskSignalReadyIoModerated(
+    _In_ XSK *Xsk,
+    _In_ UINT32 ReadyFlag
     )
 {
-    NTSTATUS Status;
-    SIZE_T BounceTrackerSize;
-    UMEM_BOUNCE *Bounce = &Xsk->Tx.Bounce;
-
-    if (Bounce->AllocationSource == AllocatedByDma) {
-        //
-        // DMA setup resulted in a bounce buffer being allocated.
-        //
-        ASSERT(Bounce->Mapping.DmaAddress.QuadPart != 0);
-        ASSERT(Bounce->Mapping.SystemAddress != 0);
-        ASSERT(Bounce->Mapping.Mdl == 0);
-    } else if (XskRequiresTxBounceBuffer(Xsk)) {
-        //
-        // Policy still requires we have a bounce buffer, so create one now.
-        //
-        ASSERT(Bounce->AllocationSource == NotAllocated);
-        Bounce->Mapping.SystemAddress =
-            ExAllocatePoolUninitialized(NonPagedPoolNx, Xsk->Umem->Reg.TotalSize, POOLTAG_BOUNCE);
-        if (Bounce->Mapping.SystemAddress == NULL) {
-            Status = STATUS_NO_MEMORY;
-            goto Exit;
+    if ((Xsk->IoWaitFlags & ReadyFlag) &&
+        (KeReadStateEvent(&Xsk->IoWaitEvent) == 0 || Xsk->IoWaitIrp != NULL)) {
+        if (XskQueryModeratedReadyIo(Xsk, ReadyFlag) != 0) {
+            XskSignalReadyIo(Xsk, ReadyFlag);
+        } else {
+            XskStartNotifyModerationTimer(Xsk);
         }
-        Bounce->AllocationSource = AllocatedByMm;
-    } else {
-        //
-        // We don't have or need a bounce buffer.
-        //
-        Status = STATUS_SUCCESS;
-        goto Exit;
-    }
-
-    ASSERT(Xsk->Umem->Reg.TotalSize <= ULONG_MAX);
-    Bounce->Mapping.Mdl =
-        IoAllocateMdl(
-            Bounce->Mapping.SystemAddress, (ULONG)Xsk->Umem->Reg.TotalSize, FALSE, FALSE, NULL);
-    if (Bounce->Mapping.Mdl == NULL) {
-        Status = STATUS_NO_MEMORY;
-        goto Exit;
-    }
-    MmBuildMdlForNonPagedPool(Bounce->Mapping.Mdl);
-
-    Status =
-        RtlSizeTMult(
-            Xsk->Umem->Reg.TotalSize / Xsk->Umem->Reg.ChunkSize, sizeof(SIZE_T),
-            &BounceTrackerSize);
-    if (!NT_SUCCESS(Status)) {
-        goto Exit;
-    }
-
-    Bounce->Tracker = ExAllocatePoolZero(NonPagedPoolNx, BounceTrackerSize, POOLTAG_BOUNCE);
-    if (Bounce->Tracker == NULL) {
-        Status = STATUS_NO_MEMORY;
-        goto Exit;
     }
-
-    Status = STATUS_SUCCESS;
-
-Exit:
-
-    return Status;
 }
 
+//
+// Signals ready IO to a newly armed wait, or starts the moderation timer if the
+// ready IO does not yet satisfy the socket's notification moderation.
+//
 static
 VOID
-XskFreeBounceBuffer(
-    _Inout_ UMEM_BOUNCE *Bounce
+XskCheckReadyIoModerated(
+    _In_ XSK *Xsk,
+    _In_ UINT32 InFlags
     )
 {
-    if (Bounce->Tracker != NULL) {
-        ExFreePoolWithTag(Bounce->Tracker, POOLTAG_BOUNCE);
-        Bounce->Tracker = NULL;
-    }
-
-    if (Bounce->Mapping.Mdl != NULL) {
-        IoFreeMdl(Bounce->Mapping.Mdl);
-        Bounce->Mapping.Mdl = NULL;
-    }
+    UINT32 ReadyFlags = XskQueryModeratedReadyIo(Xsk, InFlags);
 
-    if (Bounce->Mapping.SystemAddress != NULL && Bounce->AllocationSource == AllocatedByMm) {
-        ExFreePoolWithTag(Bounce->Mapping.SystemAddress, POOLTAG_BOUNCE);
-        Bounce->Mapping.SystemAddress = NULL;
-        Bounce->AllocationSource = NotAllocated;
+    if (ReadyFlags != 0) {
+        XskSignalReadyIo(Xsk, ReadyFlags);
+    } else if (XskQueryReadyIo(Xsk, InFlags) != 0) {
+        XskStartNotifyModerationTimer(Xsk);
     }
 }
 
 static
-FORCEINLINE
-UINT32
-XskGetAvailableTxCompletion(
-    _In_ XSK *Xsk
+VOID
+XskRingProdSubmit(
+    _Inout_ XSK_KERNEL_RING *Ring,
+    _In_ UINT32 Count
     )
 {
-    UINT32 XskCompletionAvailable = XskRingProdReserve(&Xsk->Tx.CompletionRing, MAXUINT32);
+    WriteUInt32Release(&Ring->Shared->ProducerIndex, Ring->Shared->ProducerIndex + Count);
+}
+
+static
+VOID
+XskRingConsRelease(
+    _Inout_ XSK_KERNEL_RING *Ring,
+    _In_ UINT32 Count
+    )
+{
+    Ring->Shared->ConsumerIndex += Count;
+}
+
+static
+VOID *
+XskKernelRingGetElement(
+    _In_ XSK_KERNEL_RING *Ring,
+    _In_ UINT32 Index
+    )
+{
+    ASSERT(Index <= Ring->Mask);
+    return (UCHAR *)&Ring->Shared[1] + (SIZE_T)Index * Ring->ElementStride;
+}
+
+//
+// Claims up to Count descriptors from a shared fill ring, or a fill ring
+// returning chunks to the socket's fill pool, into the socket's fill cache.
+// Sockets sharing the ring race to advance its consumer index with an
+// interlocked compare-exchange, so each descriptor is claimed by one socket.
+//
+static
+VOID
+XskRxFillCacheRefill(
+    _Inout_ XSK *Xsk,
+    _In_ UINT32 Count
+    )
+{
+    XSK_KERNEL_RING *Ring = &Xsk->Rx.FillRing;
+    UINT32 ConsumerIndex;
+    UINT32 Available;
+
+    Count = min(Count, Xsk->Rx.FillCacheMask + 1 - Xsk->Rx.FillCacheCount);
+
+    do {
+        ConsumerIndex = ReadUInt32Acquire(&Ring->Shared->ConsumerIndex);
+        Available = ReadUInt32Acquire(&Ring->Shared->ProducerIndex) - ConsumerIndex;
+        XskKernelRingSampleOccupancy(Ring, Available);
 
-    if (!NT_VERIFY(XskCompletionAvailable >= Xsk->Tx.Xdp.OutstandingFrames)) {
         //
-        // If the above condition does not hold, the XSK TX completion ring is
-        // no longer valid. This implies an application programming error.
+        // The producer index is written by the application, so bound the
+        // number of entries to the ring size.
         //
-        XskKernelRingSetError(&Xsk->Tx.CompletionRing, XSK_ERROR_INVALID_RING);
-        return 0;
-    }
+        Available = min(min(Available, Ring->Size), Count);
 
-    return XskCompletionAvailable - Xsk->Tx.Xdp.OutstandingFrames;
+        if (Available == 0) {
+            return;
+        }
+
+        for (UINT32 i = 0; i < Available; i++) {
+            UINT32 CacheIndex =
+                (Xsk->Rx.FillCacheHead + Xsk->Rx.FillCacheCount + i) & Xsk->Rx.FillCacheMask;
+            UINT64 *Element = XskKernelRingGetElement(Ring, (ConsumerIndex + i) & Ring->Mask);
+
+            Xsk->Rx.FillCache[CacheIndex] = ReadUInt64NoFence(Element);
+        }
+    } while (
+        (UINT32)InterlockedCompareExchange(
+            (LONG *)&Ring->Shared->ConsumerIndex, ConsumerIndex + Available, ConsumerIndex) !=
+                ConsumerIndex);
+
+    Xsk->Rx.FillCacheCount += Available;
 }
 
-_IRQL_requires_max_(DISPATCH_LEVEL)
+static
 UINT32
-XskFillTx(
-    _In_ XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *DatapathClientEntry,
-    _In_ UINT32 XdpTxAvailable
+XskRxFillPeek(
+    _Inout_ XSK *Xsk,
+    _In_ UINT32 Count
     )
 {
-    XSK *Xsk = CONTAINING_RECORD(DatapathClientEntry, XSK, Tx.Xdp.DatapathClientEntry);
-    NTSTATUS Status;
-    ULONGLONG Result;
-    XSK_FRAME_DESCRIPTOR *XskFrame;
-    XSK_BUFFER_DESCRIPTOR *XskBuffer;
-    UINT32 Count;
-    UINT32 FrameCount = 0;
-    UINT32 TxIndex;
-    UINT32 XskCompletionAvailable;
-    UINT32 XskTxAvailable;
-    XDP_RING *FrameRing = Xsk->Tx.Xdp.FrameRing;
-
-    if (Xsk->State != XskActive) {
-        return 0;
+    if (Xsk->Rx.FillCache == NULL) {
+        return XskRingConsPeek(&Xsk->Rx.FillRing, Count);
     }
 
-    //
-    // The need poke flag is cleared when a poke request is submitted. If no
-    // input is available and no packets are outstanding, or if the TX queue is
-    // blocked by a full TX completion queue, set the need poke flag and then
-    // re-check for available TX/completion.
-    //
-    if (Xsk->Tx.Xdp.PollHandle == NULL &&
-        ((XskRingConsPeek(&Xsk->Tx.Ring, 1) == 0 && Xsk->Tx.Xdp.OutstandingFrames == 0) ||
-         (XskGetAvailableTxCompletion(Xsk) == 0))) {
-        InterlockedOr((LONG *)&Xsk->Tx.Ring.Shared->Flags, XSK_RING_FLAG_NEED_POKE);
+    if (Xsk->Rx.FillPool) {
+        //
+        // Move every returned chunk into the pool, so the application can
+        // return chunks in bulk without keeping the fill ring stocked.
+        //
+        XskRxFillCacheRefill(Xsk, MAXUINT32);
+    } else if (Xsk->Rx.FillCacheCount < Count) {
+        XskRxFillCacheRefill(Xsk, Count - Xsk->Rx.FillCacheCount);
     }
 
-    //
-    // Number of buffers we can move from the XSK TX ring to the XDP TX ring is
-    // the minimum of these values:
-    //
-    // 1) XDP TX frames available for production
-    // 2) XSK TX descriptors available for consumption
-    // 3) XSK TX completion descriptors available for production
-    //    - XSK TX operations outstanding
-    //
+    return min(Xsk->Rx.FillCacheCount, Count);
+}
 
-    XskTxAvailable = XskRingConsPeek(&Xsk->Tx.Ring, MAXUINT32);
+//
+// Returns the number of fill descriptors available to the socket, up to Count,
+// without claiming descriptors from a shared fill ring or a fill pool's ring.
+//
+static
+UINT32
+XskRxFillAvailable(
+    _Inout_ XSK *Xsk,
+    _In_ UINT32 Count
+    )
+{
+    UINT32 Available = XskRingConsPeek(&Xsk->Rx.FillRing, Count);
 
-    XskCompletionAvailable = XskGetAvailableTxCompletion(Xsk);
+    if (Xsk->Rx.FillCache != NULL) {
+        Available += min(Count - Available, ReadUInt32NoFence(&Xsk->Rx.FillCacheCount));
+    }
 
-    Count = min(min(XdpTxAvailable, XskTxAvailable), XskCompletionAvailable);
+    return Available;
+}
 
-    for (ULONG i = 0; i < Count; i++) {
-        XDP_FRAME *Frame;
-        XDP_BUFFER *Buffer;
-        XSK_BUFFER_ADDRESS AddressDescriptor;
-        UMEM_MAPPING *Mapping;
-        XDP_TX_FRAME_COMPLETION_CONTEXT *CompletionContext;
+//
+// Returns the fill descriptor at Offset from the first unconsumed descriptor.
+// The offset must be less than the count returned by XskRxFillPeek.
+//
+static
+UINT64
+XskRxFillGet(
+    _In_ XSK *Xsk,
+    _In_ UINT32 Offset
+    )
+{
+    XSK_KERNEL_RING *Ring = &Xsk->Rx.FillRing;
+    UINT32 RingIndex;
 
-        TxIndex =
-            (ReadUInt32NoFence(&Xsk->Tx.Ring.Shared->ConsumerIndex) + i) & (Xsk->Tx.Ring.Mask);
-        XskFrame = XskKernelRingGetElement(&Xsk->Tx.Ring, TxIndex);
-        XskBuffer = &XskFrame->Buffer;
+    if (Xsk->Rx.FillCache != NULL) {
+        ASSERT(Offset < Xsk->Rx.FillCacheCount);
+        return Xsk->Rx.FillCache[(Xsk->Rx.FillCacheHead + Offset) & Xsk->Rx.FillCacheMask];
+    }
 
-        Frame = XdpRingGetElement(FrameRing, FrameRing->ProducerIndex & FrameRing->Mask);
-        Buffer = &Frame->Buffer;
+    RingIndex = (ReadUInt32NoFence(&Ring->Shared->ConsumerIndex) + Offset) & Ring->Mask;
+    return *(UINT64 *)XskKernelRingGetElement(Ring, RingIndex);
+}
 
-        AddressDescriptor.AddressAndOffset =
-            ReadUInt64NoFence(&XskBuffer->Address.AddressAndOffset);
-        Buffer->DataOffset = (UINT32)AddressDescriptor.Offset;
-        Buffer->DataLength = ReadUInt32NoFence(&XskBuffer->Length);
-        Buffer->BufferLength = Buffer->DataLength + Buffer->DataOffset;
+static
+VOID
+XskRxFillRelease(
+    _Inout_ XSK *Xsk,
+    _In_ UINT32 Count
+    )
+{
+    if (Xsk->Rx.FillCache == NULL) {
+        XskRingConsRelease(&Xsk->Rx.FillRing, Count);
+        return;
+    }
 
-        Status = RtlUInt64Add(AddressDescriptor.BaseAddress, Buffer->DataLength, &Result);
-        Status |= RtlUInt64Add(Buffer->DataOffset, Result, &Result);
-        if (Result > Xsk->Umem->Reg.TotalSize ||
-            Buffer->DataLength == 0 ||
-            Status != STATUS_SUCCESS) {
-            Xsk->Statistics.TxInvalidDescriptors++;
-            STAT_INC(XdpTxQueueGetStats(Xsk->Tx.Xdp.Queue), XskInvalidDescriptors);
-            continue;
-        }
+    ASSERT(Count <= Xsk->Rx.FillCacheCount);
+    Xsk->Rx.FillCacheHead = (Xsk->Rx.FillCacheHead + Count) & Xsk->Rx.FillCacheMask;
+    WriteUInt32NoFence(&Xsk->Rx.FillCacheCount, Xsk->Rx.FillCacheCount - Count);
+}
 
-        if (Buffer->DataLength > min(Xsk->Tx.Xdp.MaxBufferLength, Xsk->Tx.Xdp.MaxFrameLength)) {
-            Xsk->Statistics.TxInvalidDescriptors++;
-            STAT_INC(XdpTxQueueGetStats(Xsk->Tx.Xdp.Queue), XskInvalidDescriptors);
-            continue;
-        }
+//
+// Reserves up to Count entries of an RX ring, and returns the producer index of
+// the first. Sockets sharing an RX ring race to advance its reservation index
+// with an interlocked compare-exchange, so each entry is reserved by one
+// socket. The caller must fill and submit every reserved entry.
+//
+static
+UINT32
+XskRxRingReserve(
+    _Inout_ XSK *Xsk,
+    _Inout_ XSK_KERNEL_RING *RxRing,
+    _In_ UINT32 Count,
+    _Out_ UINT32 *ProducerIndex
+    )
+{
+    XSK_SHARED_RX_RING *SharedRx = Xsk->Rx.SharedRx;
+    UINT32 ReserveIndex;
+    UINT32 Used;
+    UINT32 Available;
 
-        if (!XskBounceBuffer(
-                Xsk->Umem, &Xsk->Tx.Bounce, Buffer, AddressDescriptor.BaseAddress, &Mapping)) {
-            Xsk->Statistics.TxInvalidDescriptors++;
-            STAT_INC(XdpTxQueueGetStats(Xsk->Tx.Xdp.Queue), XskInvalidDescriptors);
-            continue;
-        }
+    if (SharedRx == NULL || RxRing != &Xsk->Rx.Ring) {
+        *ProducerIndex = ReadUInt32NoFence(&RxRing->Shared->ProducerIndex);
+        return XskRingProdReserve(RxRing, Count);
+    }
 
-        if (Xsk->Tx.Xdp.Flags.VirtualAddressExt) {
-            XDP_BUFFER_VIRTUAL_ADDRESS *Va;
-            Va = XdpGetVirtualAddressExtension(Buffer, &Xsk->Tx.Xdp.VaExtension);
-            Va->VirtualAddress = &Mapping->SystemAddress[AddressDescriptor.BaseAddress];
-        }
-        if (Xsk->Tx.Xdp.Flags.LogicalAddressExt) {
-            XDP_BUFFER_LOGICAL_ADDRESS *La;
-            La = XdpGetLogicalAddressExtension(Buffer, &Xsk->Tx.Xdp.LaExtension);
-            La->LogicalAddress = Mapping->DmaAddress.QuadPart + AddressDescriptor.BaseAddress;
-        }
-        if (Xsk->Tx.Xdp.Flags.MdlExt) {
-            XDP_BUFFER_MDL *Mdl;
-            Mdl = XdpGetMdlExtension(Buffer, &Xsk->Tx.Xdp.MdlExtension);
-            Mdl->Mdl = Mapping->Mdl;
-            Mdl->MdlOffset = AddressDescriptor.BaseAddress;
-        }
-        if (Xsk->Tx.Xdp.Flags.CompletionContext) {
-            CompletionContext =
-                XdpGetFrameTxCompletionContextExtension(
-                    Frame, &Xsk->Tx.Xdp.FrameTxCompletionExtension);
-            CompletionContext->Context = &Xsk->Tx.Xdp.DatapathClientEntry;
-        }
+    do {
+        ReserveIndex = ReadUInt32NoFence(&SharedRx->ReserveIndex);
+        Used = ReserveIndex - ReadUInt32Acquire(&RxRing->Shared->ConsumerIndex);
+        XskKernelRingSampleOccupancy(RxRing, Used);
 
-        EventWriteXskTxEnqueue(
-            &MICROSOFT_XDP_PROVIDER, Xsk, Xsk->Tx.Ring.Shared->ConsumerIndex + i,
-            FrameRing->ProducerIndex);
+        //
+        // The consumer index is written by the application, so bound the
+        // number of used entries to the ring size.
+        //
+        Available = (Used < RxRing->Size) ? min(RxRing->Size - Used, Count) : 0;
 
-        FrameRing->ProducerIndex++;
-        FrameCount++;
-    }
+        if (Available == 0) {
+            break;
+        }
+    } while (
+        (UINT32)InterlockedCompareExchange(
+            (LONG *)&SharedRx->ReserveIndex, ReserveIndex + Available, ReserveIndex) !=
+                ReserveIndex);
 
-    if (Count > 0) {
-        XskRingConsRelease(&Xsk->Tx.Ring, Count);
-        XskKernelRingUpdateIdealProcessor(&Xsk->Tx.Ring);
-    }
+    *ProducerIndex = ReserveIndex;
+    return Available;
+}
 
-    Xsk->Tx.Xdp.OutstandingFrames += FrameCount;
+//
+// Publishes Count RX ring entries reserved at ProducerIndex.
+//
+static
+VOID
+XskRxRingSubmit(
+    _Inout_ XSK *Xsk,
+    _Inout_ XSK_KERNEL_RING *RxRing,
+    _In_ UINT32 ProducerIndex,
+    _In_ UINT32 Count
+    )
+{
+    if (Xsk->Rx.SharedRx == NULL || RxRing != &Xsk->Rx.Ring) {
+        XskRingProdSubmit(RxRing, Count);
+        return;
+    }
 
     //
-    // If input was processed, clear the need poke flag.
+    // Wait for the sockets that reserved the preceding entries to publish them.
+    // Sharing sockets produce at DISPATCH_LEVEL, so the wait is bounded by the
+    // time to fill a single batch.
     //
-    if (Xsk->Tx.Xdp.PollHandle == NULL && Xsk->Tx.Xdp.OutstandingFrames > 0 &&
-        (Xsk->Tx.Ring.Shared->Flags & XSK_RING_FLAG_NEED_POKE)) {
-        InterlockedAnd((LONG *)&Xsk->Tx.Ring.Shared->Flags, ~XSK_RING_FLAG_NEED_POKE);
+    while (ReadUInt32Acquire(&RxRing->Shared->ProducerIndex) != ProducerIndex) {
+        YieldProcessor();
     }
 
-    return FrameCount;
+    WriteUInt32Release(&RxRing->Shared->ProducerIndex, ProducerIndex + Count);
 }
 
+//
+// Signals the owner of a shared RX ring that entries were published at
+// ProducerIndex. Completion ports are notified if the application had drained
+// the ring up to the published entries, regardless of entries other sockets
+// published since.
+//
 static
 VOID
-XskWriteUmemTxCompletion(
-    _In_ XSK *Xsk,
-    _In_ UINT32 Index,
-    _In_ UINT64 RelativeAddress
+XskRxRingNotifyShared(
+    _In_ XSK_SHARED_RX_RING *SharedRx,
+    _In_ UINT32 ProducerIndex
     )
 {
-    UINT64 *XskCompletion;
+    XSK *Owner = SharedRx->Owner;
 
-    XskReleaseBounceBuffer(Xsk->Umem, &Xsk->Tx.Bounce, RelativeAddress);
-    XskCompletion =
-        XskKernelRingGetElement(
-            &Xsk->Tx.CompletionRing, Index & (Xsk->Tx.CompletionRing.Mask));
-    *XskCompletion = RelativeAddress;
+    if (!ExAcquireRundownProtection(&SharedRx->OwnerRundown)) {
+        return;
+    }
+
+    XskSignalReadyIoModerated(Owner, XSK_NOTIFY_FLAG_WAIT_RX);
+
+    if ((ReadUInt32NoFence(&Owner->IoCompletion.Flags) & XSK_NOTIFY_FLAG_WAIT_RX) &&
+        ReadUInt32NoFence(&SharedRx->Ring.Shared->ConsumerIndex) == ProducerIndex) {
+        XskPostIoCompletion(Owner, XSK_NOTIFY_FLAG_WAIT_RX);
+    }
+
+    ExReleaseRundownProtection(&SharedRx->OwnerRundown);
 }
 
 static
-_IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
-XskTxCompleteRundown(
-    _In_ XSK *Xsk
+XskKernelRingSetError(
+    _Inout_ XSK_KERNEL_RING *Ring,
+    _In_ XSK_ERROR Error
     )
 {
-    if (Xsk->State > XskActive) {
-        if (Xsk->Tx.Xdp.OutstandingFrames == 0) {
-            KeSetEvent(&Xsk->Tx.Xdp.OutstandingFlushComplete, 0, FALSE);
+    if (InterlockedCompareExchange((LONG *)&Ring->Error, Error, XSK_NO_ERROR) == XSK_NO_ERROR) {
+        if (Ring->Shared != NULL) {
+            InterlockedOr((LONG *)&Ring->Shared->Flags, XSK_RING_FLAG_ERROR);
         }
     }
 }
 
-_IRQL_requires_max_(DISPATCH_LEVEL)
+static
 VOID
-XskFillTxCompletion(
-    _In_ XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *DatapathClientEntry
+XskKernelRingUpdateIdealProcessor(
+    _Inout_ XSK_KERNEL_RING *Ring
     )
 {
-    XSK *Xsk = CONTAINING_RECORD(DatapathClientEntry, XSK, Tx.Xdp.DatapathClientEntry);
-    XSK_SHARED_RING *Ring = Xsk->Tx.CompletionRing.Shared;
-    UINT32 ProducerIndex = ReadUInt32NoFence(&Ring->ProducerIndex);
-    UINT32 OriginalProducerIndex = ProducerIndex;
-    UINT32 Count;
-    UINT64 RelativeAddress;
-    UMEM_MAPPING *Mapping = XskGetTxMapping(Xsk);
-    XDP_TX_FRAME_COMPLETION_CONTEXT *CompletionContext;
+    UINT32 CurrentProcessor = KeGetCurrentProcessorIndex();
 
-    if (Xsk->Tx.Xdp.Flags.OutOfOrderCompletion) {
-        XDP_RING *XdpRing = Xsk->Tx.Xdp.CompletionRing;
-        XDP_TX_FRAME_COMPLETION *Completion;
+    ASSERT(Ring->Size > 0);
 
-        //
-        // Move all entries from the XDP TX completion ring to the XSK TX completion
-        // ring. We have ensured sufficient XSK TX completion ring space when we
-        // consumed from the XSK TX ring.
-        //
-        ASSERT(XdpRingCount(XdpRing) > 0);
-        do {
-            Completion = XdpRingGetElement(XdpRing, XdpRing->ConsumerIndex & XdpRing->Mask);
-
-            if (Xsk->Tx.Xdp.Flags.CompletionContext) {
-                CompletionContext =
-                    XdpGetTxCompletionContextExtension(
-                        Completion, &Xsk->Tx.Xdp.TxCompletionExtension);
-                if (CompletionContext->Context != &Xsk->Tx.Xdp.DatapathClientEntry) {
-                    //
-                    // We must have completed at least the first frame.
-                    //
-                    ASSERT((ProducerIndex - OriginalProducerIndex) > 0);
-                    break;
-                }
-            }
-
-            if (Xsk->Tx.Xdp.Flags.VirtualAddressExt) {
-                RelativeAddress = Completion->BufferAddress - (UINT64)Mapping->SystemAddress;
-            } else if (Xsk->Tx.Xdp.Flags.LogicalAddressExt) {
-                RelativeAddress = Completion->BufferAddress - Mapping->DmaAddress.QuadPart;
-            } else if (Xsk->Tx.Xdp.Flags.MdlExt) {
-                RelativeAddress = Completion->BufferAddress;
-            } else {
-                //
-                // One of the above extensions must have be enabled.
-                //
-                ASSERT(FALSE);
-                RelativeAddress = 0;
-            }
-
-            XskWriteUmemTxCompletion(Xsk, ProducerIndex++, RelativeAddress);
-            XdpRing->ConsumerIndex++;
-        } while (XdpRingCount(XdpRing) > 0);
-    } else {
-        XDP_RING *XdpRing = Xsk->Tx.Xdp.FrameRing;
-        XDP_FRAME *Frame;
+    //
+    // Set the ideal processor to the current processor. For queues that are not
+    // strongly affinitized (e.g. RSS disabled, not supported, plain buggy) we
+    // might need to add a heuristic to avoid indicating flapping CPUs up to
+    // applications.
+    //
 
-        //
-        // Move all completed entries from the XDP TX ring to the XSK TX completion
-        // ring. We have ensured sufficient XSK TX completion ring space when we
-        // consumed from the XSK TX ring.
-        //
+    if (Ring->IdealProcessor != CurrentProcessor) {
+        Ring->IdealProcessor = CurrentProcessor;
+        InterlockedOr((LONG *)&Ring->Shared->Flags, XSK_RING_FLAG_AFFINITY_CHANGED);
+    }
+}
 
-        ASSERT((XdpRing->ConsumerIndex - XdpRing->Reserved) > 0);
-        do {
-            Frame = XdpRingGetElement(XdpRing, XdpRing->Reserved & XdpRing->Mask);
+static
+UMEM_MAPPING *
+XskGetTxMapping(
+    _In_ XSK *Xsk
+    )
+{
+    return
+        (Xsk->Tx.Bounce.Tracker != NULL)
+            ? &Xsk->Tx.Bounce.Mapping : &Xsk->Tx.UmemMapping;
+}
 
-            if (Xsk->Tx.Xdp.Flags.CompletionContext) {
-                CompletionContext =
-                    XdpGetFrameTxCompletionContextExtension(
-                        Frame, &Xsk->Tx.Xdp.FrameTxCompletionExtension);
-                if (CompletionContext->Context != &Xsk->Tx.Xdp.DatapathClientEntry) {
-                    //
-                    // We must have completed at least the first frame.
-                    //
-                    ASSERT((ProducerIndex - OriginalProducerIndex) > 0);
-                    break;
-                }
-            }
+static
+UINT32
+XskRxMetadataHeadroom(
+    _In_ BOOLEAN Timestamp,
+    _In_ BOOLEAN Metadata,
+    _In_ UINT32 EbpfMetadataSize
+    )
+{
+    //
+    // RX timestamps immediately precede the frame data, RX metadata precedes
+    // the timestamp, and eBPF metadata precedes the RX metadata.
+    //
+    return
+        (Timestamp ? sizeof(XDP_FRAME_TIMESTAMP) : 0) + (Metadata ? sizeof(XSK_RX_METADATA) : 0) +
+        EbpfMetadataSize;
+}
 
-            if (Xsk->Tx.Xdp.Flags.VirtualAddressExt) {
-                XDP_BUFFER_VIRTUAL_ADDRESS *Va;
-                Va = XdpGetVirtualAddressExtension(&Frame->Buffer, &Xsk->Tx.Xdp.VaExtension);
-                RelativeAddress = Va->VirtualAddress - Mapping->SystemAddress;
-            } else if (Xsk->Tx.Xdp.Flags.LogicalAddressExt) {
-                XDP_BUFFER_LOGICAL_ADDRESS *La;
-                La = XdpGetLogicalAddressExtension(&Frame->Buffer, &Xsk->Tx.Xdp.LaExtension);
-                RelativeAddress = La->LogicalAddress - Mapping->DmaAddress.QuadPart;
-            } else if (Xsk->Tx.Xdp.Flags.MdlExt) {
-                XDP_BUFFER_MDL *Mdl;
-                Mdl = XdpGetMdlExtension(&Frame->Buffer, &Xsk->Tx.Xdp.MdlExtension);
-                RelativeAddress = Mdl->MdlOffset;
-            } else {
-                //
-                // One of the above extensions must have be enabled.
-                //
-                ASSERT(FALSE);
-                RelativeAddress = 0;
-            }
+static
+BOOLEAN
+XskRequiresTxBounceBuffer(
+    XSK *Xsk
+    )
+{
+    //
+    // Only the NDIS6 data path requires immutable buffers.
+    // In the future, TX inspection programs may have similar requirements.
+    //
+    // Sockets requesting zero-copy TX transmit directly from the locked UMEM
+    // pages instead, and promise not to modify buffers while they are posted.
+    // Each descriptor is still validated against the UMEM chunk bounds.
+    //
+    return
+        !XskGlobals.DisableTxBounce &&
+        !Xsk->Tx.ZeroCopyRequested &&
+        (XdpIfGetCapabilities(Xsk->Tx.Xdp.IfHandle)->Mode == XDP_INTERFACE_MODE_GENERIC);
+}
 
-            XskWriteUmemTxCompletion(Xsk, ProducerIndex++, RelativeAddress);
-        } while ((XdpRing->ConsumerIndex - ++XdpRing->Reserved) > 0);
+static
+FORCEINLINE
+UINT64
+XskUmemChunkIndex(
+    _In_ const UMEM *Umem,
+    _In_ UINT64 RelativeAddress
+    )
+{
+    if (Umem->AlignedChunks) {
+        return RelativeAddress >> Umem->ChunkShift;
     }
 
-    Count = ProducerIndex - OriginalProducerIndex;
-
-    if (Count > 0) {
-        Xsk->Tx.Xdp.OutstandingFrames -= Count;
+    return RelativeAddress / Umem->Reg.ChunkSize;
+}
 
+//
+// Returns the UMEM-relative address of the chunk an RX fill descriptor refers
+// to.
+//
+static
+FORCEINLINE
+UINT64
+XskUmemFillChunkAddress(
+    _In_ const UMEM *Umem,
+    _In_ UINT64 RelativeAddress
+    )
+{
+    if (Umem->AlignedChunks) {
         //
-        // If the below condition does not hold, the XSK TX completion ring is
-        // no longer valid. This implies an application programming error.
+        // Any address within a chunk refers to the whole chunk.
         //
-        if (NT_VERIFY(XskRingProdReserve(&Xsk->Tx.CompletionRing, Count) == Count)) {
-            XskRingProdSubmit(&Xsk->Tx.CompletionRing, Count);
-            EventWriteXskTxCompleteBatch(
-                &MICROSOFT_XDP_PROVIDER, Xsk, OriginalProducerIndex, Count);
-        } else {
-            XskKernelRingSetError(&Xsk->Tx.CompletionRing, XSK_ERROR_INVALID_RING);
-        }
+        return RelativeAddress & ~((UINT64)Umem->Reg.ChunkSize - 1);
+    }
 
-        //
-        // N.B. See comment in XskNotify.
-        //
-        KeMemoryBarrier();
+    return RelativeAddress;
+}
 
-        if ((Xsk->IoWaitFlags & XSK_NOTIFY_FLAG_WAIT_TX) &&
-            (KeReadStateEvent(&Xsk->IoWaitEvent) == 0 || Xsk->IoWaitIrp != NULL)) {
-            XskSignalReadyIo(Xsk, XSK_NOTIFY_FLAG_WAIT_TX);
-        }
+//
+// Validates the address of an RX fill descriptor, and returns the UMEM-relative
+// address of the chunk it refers to.
+//
+static
+FORCEINLINE
+BOOLEAN
+XskUmemValidateFillAddress(
+    _In_ const UMEM *Umem,
+    _Inout_ UINT64 *RelativeAddress
+    )
+{
+    *RelativeAddress = XskUmemFillChunkAddress(Umem, *RelativeAddress);
 
-        XskTxCompleteRundown(Xsk);
+    if (Umem->AlignedChunks) {
+        return *RelativeAddress < Umem->Reg.TotalSize;
     }
+
+    return *RelativeAddress <= Umem->Reg.TotalSize - Umem->Reg.ChunkSize;
 }
 
-NTSTATUS
-XskReferenceDatapathHandle(
-    _In_ KPROCESSOR_MODE RequestorMode,
-    _In_ const VOID *HandleBuffer,
-    _In_ BOOLEAN HandleBounced,
-    _Out_ HANDLE *XskHandle
+//
+// Validates the address of an RX fill descriptor referring to an added UMEM
+// region. The region is protected from removal until the receive batch is
+// submitted.
+//
+static
+BOOLEAN
+XskRxValidateRegionFillAddress(
+    _Inout_ XSK *Xsk,
+    _Inout_ UINT64 *RelativeAddress
     )
 {
-    NTSTATUS Status;
-    FILE_OBJECT *FileObject = NULL;
-    HANDLE TargetHandle;
-    XSK *Xsk = NULL;
+    UMEM *Umem = Xsk->Umem;
+    UINT64 RegionId = *RelativeAddress >> XSK_UMEM_REGION_SHIFT;
+    UMEM_REGION *Region;
+    UINT64 Offset;
 
-    if (RequestorMode != KernelMode && !HandleBounced) {
-        __try {
-            ProbeForRead((VOID *)HandleBuffer, sizeof(HANDLE), PROBE_ALIGNMENT(HANDLE));
-            TargetHandle = ReadHandleNoFence((volatile const HANDLE *)HandleBuffer);
-        } __except (EXCEPTION_EXECUTE_HANDLER) {
-            Status = GetExceptionCode();
-            goto Exit;
-        }
-    } else {
-        TargetHandle = *(HANDLE *)HandleBuffer;
+    if (RegionId >= RTL_NUMBER_OF(Umem->Regions)) {
+        return FALSE;
     }
 
-    Status =
-        XdpReferenceObjectByHandle(
-            TargetHandle, XDP_OBJECT_TYPE_XSK, RequestorMode, FILE_GENERIC_WRITE, &FileObject);
-    if (!NT_SUCCESS(Status)) {
-        goto Exit;
+    Region = &Umem->Regions[RegionId];
+
+    if ((Xsk->Rx.HeldUmemRegions & (1ui64 << RegionId)) == 0) {
+        if (!ExAcquireRundownProtection(&Region->Rundown)) {
+            return FALSE;
+        }
+        Xsk->Rx.HeldUmemRegions |= 1ui64 << RegionId;
     }
 
-    Xsk = FileObject->FsContext;
-    XskReference(Xsk);
-    *XskHandle = (HANDLE)Xsk;
-    Status = STATUS_SUCCESS;
+    *RelativeAddress = XskUmemFillChunkAddress(Umem, *RelativeAddress);
+    Offset = *RelativeAddress & XSK_UMEM_REGION_OFFSET_MASK;
 
-Exit:
+    if (Umem->AlignedChunks) {
+        return Offset < Region->Size;
+    }
 
-    TraceInfo(TRACE_XSK, "Xsk=%p Status=%!STATUS!", Xsk, Status);
+    return Offset <= Region->Size - Umem->Reg.ChunkSize;
+}
 
-    if (FileObject != NULL) {
-        ObDereferenceObject(FileObject);
+static
+FORCEINLINE
+BOOLEAN
+XskRxValidateFillAddress(
+    _Inout_ XSK *Xsk,
+    _Inout_ UINT64 *RelativeAddress
+    )
+{
+    if ((*RelativeAddress >> XSK_UMEM_REGION_SHIFT) != 0) {
+        return XskRxValidateRegionFillAddress(Xsk, RelativeAddress);
     }
 
-    return Status;
+    return XskUmemValidateFillAddress(Xsk->Umem, RelativeAddress);
 }
 
+static
 VOID
-XskDereferenceDatapathHandle(
-    _In_ HANDLE XskHandle
+XskRxReleaseUmemRegions(
+    _Inout_ XSK *Xsk
     )
 {
-    XSK *Xsk = XskHandle;
+    while (Xsk->Rx.HeldUmemRegions != 0) {
+        CCHAR RegionId = RtlFindLeastSignificantBit(Xsk->Rx.HeldUmemRegions);
 
-    TraceInfo(TRACE_XSK, "Xsk=%p", Xsk);
-
-    XskDereference(Xsk);
+        ExReleaseRundownProtection(&Xsk->Umem->Regions[RegionId].Rundown);
+        Xsk->Rx.HeldUmemRegions &= ~(1ui64 << RegionId);
+    }
 }
 
-_IRQL_requires_max_(PASSIVE_LEVEL)
-_IRQL_requires_same_
-NTSTATUS
-XskIrpCreateSocket(
-    _Inout_ IRP* Irp,
-    _Inout_ IO_STACK_LOCATION* IrpSp,
-    _In_ UCHAR Disposition,
-    _In_ VOID* InputBuffer,
-    _In_ SIZE_T InputBufferLength
+//
+// Returns the system address of a validated RX chunk.
+//
+static
+FORCEINLINE
+UCHAR *
+XskUmemRxChunk(
+    _In_ const UMEM *Umem,
+    _In_ UINT64 RelativeAddress
     )
 {
-    NTSTATUS Status = STATUS_SUCCESS;
-    XSK *Xsk = NULL;
+    UINT64 RegionId = RelativeAddress >> XSK_UMEM_REGION_SHIFT;
 
-    UNREFERENCED_PARAMETER(Irp);
-    UNREFERENCED_PARAMETER(Disposition);
-    UNREFERENCED_PARAMETER(InputBuffer);
-    UNREFERENCED_PARAMETER(InputBufferLength);
+    if (RegionId == 0) {
+        return Umem->Mapping.SystemAddress + RelativeAddress;
+    }
 
-    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+    return
+        Umem->Regions[RegionId].Mapping.SystemAddress +
+            (RelativeAddress & XSK_UMEM_REGION_OFFSET_MASK);
+}
 
-    Xsk = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Xsk), POOLTAG_XSK);
-    if (Xsk == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Exit;
+//
+// Validates that a TX buffer lies within the UMEM.
+//
+static
+FORCEINLINE
+BOOLEAN
+XskUmemValidateTxBuffer(
+    _In_ const UMEM *Umem,
+    _In_ UINT64 BaseAddress,
+    _In_ UINT32 Offset,
+    _In_ UINT32 Length
+    )
+{
+    NTSTATUS Status;
+    UINT64 Result;
+
+    if (Umem->AlignedChunks) {
+        //
+        // The buffer must lie within a single chunk. The total size is a whole
+        // number of chunks, and the sum cannot overflow.
+        //
+        return
+            BaseAddress < Umem->Reg.TotalSize &&
+            (BaseAddress & ((UINT64)Umem->Reg.ChunkSize - 1)) + Offset + Length <=
+                Umem->Reg.ChunkSize;
     }
 
-    Xsk->Header.ObjectType = XDP_OBJECT_TYPE_XSK;
-    Xsk->Header.Dispatch = &XskFileDispatch;
-    XdpInitializeReferenceCount(&Xsk->ReferenceCount);
-    Xsk->State = XskUnbound;
-    Xsk->Rx.Xdp.HookId.Layer = XDP_HOOK_L2;
-    Xsk->Rx.Xdp.HookId.Direction = XDP_HOOK_RX;
-    Xsk->Rx.Xdp.HookId.SubLayer = XDP_HOOK_INSPECT;
-    Xsk->Tx.Xdp.HookId.Layer = XDP_HOOK_L2;
-    Xsk->Tx.Xdp.HookId.Direction = XDP_HOOK_TX;
-    Xsk->Tx.Xdp.HookId.SubLayer = XDP_HOOK_INJECT;
-    KeInitializeSpinLock(&Xsk->Lock);
-    KeInitializeEvent(&Xsk->IoWaitEvent, NotificationEvent, TRUE);
-    KeInitializeEvent(&Xsk->PollRequested, SynchronizationEvent, FALSE);
-    KeInitializeEvent(&Xsk->Tx.Xdp.OutstandingFlushComplete, NotificationEvent, FALSE);
-
-    IrpSp->FileObject->FsContext = Xsk;
-
-    EventWriteXskCreateSocket(
-        &MICROSOFT_XDP_PROVIDER, Xsk, PsGetCurrentProcessId());
+    Status = RtlUInt64Add(BaseAddress, Length, &Result);
+    Status |= RtlUInt64Add(Offset, Result, &Result);
 
-Exit:
+    return Status == STATUS_SUCCESS && Result <= Umem->Reg.TotalSize;
+}
 
-    TraceInfo(TRACE_XSK, "Xsk=%p Status=%!STATUS!", Xsk, Status);
-    TraceExitStatus(TRACE_XSK);
+#define XSK_TX_BATCH_SIZE 8
 
-    return Status;
-}
+//
+// A snapshot of a run of TX descriptors. The descriptors are read once, so the
+// values validated are the values used even if the application rewrites the
+// shared ring concurrently.
+//
+typedef struct _XSK_TX_BATCH {
+    UINT64 AddressAndOffset[XSK_TX_BATCH_SIZE];
+    UINT32 Length[XSK_TX_BATCH_SIZE];
+    UINT32 ValidMask;
+} XSK_TX_BATCH;
 
+//
+// Validates the buffers of a TX batch, returning a mask of the descriptors that
+// pass the checks of XskUmemValidateTxBuffer and have a nonzero length. Unused
+// lanes must be zeroed; they fail validation.
+//
 static
-_IRQL_requires_max_(DISPATCH_LEVEL)
-VOID
-XskPollSocketNotify(
-    _In_ VOID *NotifyContext
+FORCEINLINE
+UINT32
+XskUmemValidateTxBatch(
+    _In_ const UMEM *Umem,
+    _In_ const XSK_TX_BATCH *Batch
     )
 {
-    XSK *Xsk = NotifyContext;
-
+#if defined(_M_AMD64) || defined(_M_IX86)
     //
-    // This routine is invoked by the NDIS polling backchannel when an interface
-    // requests a poll.
+    // Each buffer is valid if its base address is within the UMEM and its end,
+    // relative to its chunk in aligned mode and to the UMEM otherwise, does not
+    // exceed the limit. The UMEM size fits in 32 bits and each operand is well
+    // below 2^63, so a sum exceeds its bound exactly when the 64-bit difference
+    // is negative. SSE2 has no 64-bit compare, so the sign bits of the
+    // differences are collected instead.
     //
-
-    KeSetEvent(&Xsk->PollRequested, 0, FALSE);
+    const __m128i BaseMask = _mm_set1_epi64x(0x0000FFFFFFFFFFFFui64);
+    const __m128i AddressMask =
+        _mm_set1_epi64x(Umem->AlignedChunks ? (Umem->Reg.ChunkSize - 1) : MAXUINT64);
+    const __m128i Limit =
+        _mm_set1_epi64x(Umem->AlignedChunks ? Umem->Reg.ChunkSize : Umem->Reg.TotalSize);
+    const __m128i LastAddress = _mm_set1_epi64x(Umem->Reg.TotalSize - 1);
+    const __m128i One = _mm_set1_epi64x(1);
+    UINT32 InvalidMask = 0;
+
+    for (UINT32 i = 0; i < XSK_TX_BATCH_SIZE; i += 2) {
+        __m128i Address = _mm_loadu_si128((const __m128i *)&Batch->AddressAndOffset[i]);
+        __m128i Base = _mm_and_si128(Address, BaseMask);
+        __m128i Length =
+            _mm_unpacklo_epi32(
+                _mm_loadl_epi64((const __m128i *)&Batch->Length[i]), _mm_setzero_si128());
+        __m128i End =
+            _mm_add_epi64(
+                _mm_add_epi64(_mm_and_si128(Base, AddressMask), _mm_srli_epi64(Address, 48)),
+                Length);
+        __m128i Invalid =
+            _mm_or_si128(
+                _mm_or_si128(_mm_sub_epi64(Limit, End), _mm_sub_epi64(LastAddress, Base)),
+                _mm_sub_epi64(Length, One));
+
+        InvalidMask |= (UINT32)_mm_movemask_pd(_mm_castsi128_pd(Invalid)) << i;
+    }
+
+    return ~InvalidMask & ((1ui32 << XSK_TX_BATCH_SIZE) - 1);
+#else
+    UINT32 ValidMask = 0;
+
+    for (UINT32 i = 0; i < XSK_TX_BATCH_SIZE; i++) {
+        XSK_BUFFER_ADDRESS Address;
+
+        Address.AddressAndOffset = Batch->AddressAndOffset[i];
+        ValidMask |=
+            (UINT32)(Batch->Length[i] != 0 &&
+                XskUmemValidateTxBuffer(
+                    Umem, Address.BaseAddress, (UINT32)Address.Offset, Batch->Length[i])) << i;
+    }
+
+    return ValidMask;
+#endif
 }
 
 static
 VOID
-XskAcquirePollLock(
-    _In_ XSK *Xsk
+XskReleaseBounceBuffer(
+    _In_ UMEM *Umem,
+    _In_ UMEM_BOUNCE *Bounce,
+    _In_ UINT64 RelativeAddress
     )
 {
-    InterlockedIncrement((LONG *)&Xsk->PollWaiters);
-    XskPollSocketNotify(Xsk);
-    RtlAcquirePushLockExclusive(&Xsk->PollLock);
-    InterlockedDecrement((LONG *)&Xsk->PollWaiters);
-}
+    SIZE_T ChunkIndex;
 
-static
-VOID
-XskReleasePollLock(
-    _In_ XSK *Xsk
-    )
-{
-    RtlReleasePushLockExclusive(&Xsk->PollLock);
+    if (Bounce->Tracker == NULL) {
+        //
+        // No debounce is required.
+        //
+        return;
+    }
+
+    ChunkIndex = (SIZE_T)XskUmemChunkIndex(Umem, RelativeAddress);
+    Bounce->Tracker[ChunkIndex]--;
 }
 
 static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
-VOID
-XskReleasePollModeSocket(
-    _In_ XSK *Xsk
+_Success_(return != FALSE)
+BOOLEAN
+XskBounceBuffer(
+    _In_ UMEM *Umem,
+    _In_ UMEM_MAPPING *UmemMapping,
+    _In_ UMEM_BOUNCE *Bounce,
+    _In_ XDP_BUFFER *Buffer,
+    _In_ UINT64 RelativeAddress,
+    _In_ BOOLEAN ZeroCopy,
+    _Out_ UMEM_MAPPING **Mapping
     )
 {
-    KIRQL OldIrql;
+    SIZE_T ChunkIndex;
 
-    //
-    // Release control of any NDIS polling backchannels for a socket.
-    //
+    if (Bounce->Tracker == NULL && !ZeroCopy) {
+        //
+        // No bounce is required.
+        //
+        *Mapping = UmemMapping;
+        return TRUE;
+    }
 
-    if (Xsk->Tx.Xdp.PollHandle != NULL) {
-        if (Xsk->Tx.Xdp.PollHandle != Xsk->Rx.Xdp.PollHandle) {
-            //
-            // If the interface uses the same polling handle for RX and TX, only
-            // one reference was acquired.
-            //
-            XdpPollReleaseExclusive(Xsk->Tx.Xdp.PollHandle);
-            XdpPollDeleteBackchannel(Xsk->Tx.Xdp.PollHandle);
-        }
-        Xsk->Tx.Xdp.PollHandle = NULL;
-        ASSERT(Xsk->Tx.Ring.Shared->Flags & XSK_RING_FLAG_NEED_POKE);
+    ChunkIndex = (SIZE_T)XskUmemChunkIndex(Umem, RelativeAddress);
+    if (!Umem->AlignedChunks &&
+        ChunkIndex != (RelativeAddress + Buffer->BufferLength - 1) / Umem->Reg.ChunkSize) {
+        //
+        // The entire buffer must fit within a chunk. Buffers of aligned chunks
+        // were already validated to do so.
+        //
+        return FALSE;
     }
 
-    if (Xsk->Rx.Xdp.PollHandle != NULL) {
-        Xsk->Rx.FillRing.Shared->Flags &= ~XSK_RING_FLAG_NEED_POKE;
-        XdpPollReleaseExclusive(Xsk->Rx.Xdp.PollHandle);
-        XdpPollDeleteBackchannel(Xsk->Rx.Xdp.PollHandle);
-        Xsk->Rx.Xdp.PollHandle = NULL;
+    if (Bounce->Tracker == NULL) {
+        //
+        // Zero-copy buffers are transmitted directly from the UMEM.
+        //
+        *Mapping = UmemMapping;
+        return TRUE;
     }
 
-    //
-    // Reset the IO wait flag for socket polling mode.
-    //
-    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
-    Xsk->IoWaitInternalFlags &= ~XSK_IO_WAIT_FLAG_POLL_MODE_SOCKET;
-    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
-}
+    if (Bounce->Tracker[ChunkIndex]++ == 0) {
+        //
+        // It is legal for an app to post the same buffer for multiple IOs, but
+        // behavior is undefined if the buffer is modified while IO is
+        // outstanding. Ignore any writes to the buffer once an IO is in flight.
+        //
+        RtlCopyMemory(
+            Bounce->Mapping.SystemAddress + RelativeAddress + Buffer->DataOffset,
+            Umem->Mapping.SystemAddress + RelativeAddress + Buffer->DataOffset,
+            Buffer->DataLength);
+    }
 
-static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
-VOID
-XskExitPollModeSocket(
-    _In_ XSK *Xsk
-    )
-{
-    Xsk->PollMode = XSK_POLL_MODE_DEFAULT;
-    XskReleasePollModeSocket(Xsk);
+    *Mapping = &Bounce->Mapping;
+    return TRUE;
 }
 
 static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
 NTSTATUS
-XskAcquirePollModeSocketRx(
-    _In_ XSK *Xsk
+XskAllocateTxBounceBuffer(
+    _Inout_ XSK *Xsk
     )
 {
-    NDIS_HANDLE InterfaceRxPollHandle;
-    NDIS_POLL_BACKCHANNEL *Backchannel = NULL;
     NTSTATUS Status;
+    SIZE_T BounceTrackerSize;
+    UMEM_BOUNCE *Bounce = &Xsk->Tx.Bounce;
+    ULONG NumaNode = XdpTxQueueGetNumaNode(Xsk->Tx.Xdp.Queue);
 
-    ASSERT(Xsk->Rx.Xdp.PollHandle == NULL);
+    if (Bounce->AllocationSource == AllocatedByDma) {
+        //
+        // DMA setup resulted in a bounce buffer being allocated.
+        //
+        ASSERT(Bounce->Mapping.DmaAddress.QuadPart != 0);
+        ASSERT(Bounce->Mapping.SystemAddress != 0);
+        ASSERT(Bounce->Mapping.Mdl == 0);
+    } else if (XskRequiresTxBounceBuffer(Xsk)) {
+        //
+        // Policy still requires we have a bounce buffer, so create one now.
+        //
+        ASSERT(Bounce->AllocationSource == NotAllocated);
 
-    if (Xsk->Rx.Xdp.Queue == NULL) {
-        Status = STATUS_NOT_SUPPORTED;
+        Status = XskChargeMemory(Xsk, XskMemoryBounce, Xsk->Umem->Reg.TotalSize);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        //
+        // The bounce buffer is copied into on the TX data path, so place it on
+        // the TX queue's NUMA node.
+        //
+        Bounce->Mapping.SystemAddress =
+            XdpAllocatePoolOnNode(
+                POOL_FLAG_NON_PAGED | POOL_FLAG_UNINITIALIZED, Xsk->Umem->Reg.TotalSize,
+                POOLTAG_BOUNCE, NumaNode);
+        if (Bounce->Mapping.SystemAddress == NULL) {
+            Status = STATUS_NO_MEMORY;
+            goto Exit;
+        }
+        Bounce->AllocationSource = AllocatedByMm;
+    } else {
+        //
+        // We don't have or need a bounce buffer.
+        //
+        Status = STATUS_SUCCESS;
         goto Exit;
     }
 
-    InterfaceRxPollHandle = XdpRxQueueGetInterfacePollHandle(Xsk->Rx.Xdp.Queue);
-    if (InterfaceRxPollHandle == NULL) {
-        Status = STATUS_NOT_SUPPORTED;
+    ASSERT(Xsk->Umem->Reg.TotalSize <= ULONG_MAX);
+    Bounce->Mapping.Mdl =
+        IoAllocateMdl(
+            Bounce->Mapping.SystemAddress, (ULONG)Xsk->Umem->Reg.TotalSize, FALSE, FALSE, NULL);
+    if (Bounce->Mapping.Mdl == NULL) {
+        Status = STATUS_NO_MEMORY;
         goto Exit;
     }
+    MmBuildMdlForNonPagedPool(Bounce->Mapping.Mdl);
 
-    Status = XdpPollCreateBackchannel(InterfaceRxPollHandle, &Backchannel);
+    Status =
+        RtlSizeTMult(
+            Xsk->Umem->Reg.TotalSize / Xsk->Umem->Reg.ChunkSize, sizeof(SIZE_T),
+            &BounceTrackerSize);
     if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
 
-    Status = XdpPollAcquireExclusive(Backchannel, XskPollSocketNotify, Xsk);
+    Status = XskChargeMemory(Xsk, XskMemoryBounce, BounceTrackerSize);
     if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
 
-    //
-    // Review: handling of multiple sockets sharing a queue.
-    //
-    Xsk->Rx.FillRing.Shared->Flags |= XSK_RING_FLAG_NEED_POKE;
+    Bounce->Tracker =
+        XdpAllocatePoolOnNode(POOL_FLAG_NON_PAGED, BounceTrackerSize, POOLTAG_BOUNCE, NumaNode);
+    if (Bounce->Tracker == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
 
-    Xsk->Rx.Xdp.PollHandle = Backchannel;
     Status = STATUS_SUCCESS;
 
 Exit:
 
-    if (!NT_SUCCESS(Status)) {
-        if (Backchannel != NULL) {
-            XdpPollDeleteBackchannel(Backchannel);
-        }
-    }
-
     return Status;
 }
 
 static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
-NTSTATUS
-XskAcquirePollModeSocketTx(
-    _In_ XSK *Xsk
+VOID
+XskFreeBounceBuffer(
+    _Inout_ UMEM_BOUNCE *Bounce
     )
 {
-    NTSTATUS Status;
-    NDIS_HANDLE InterfaceTxPollHandle;
-    NDIS_POLL_BACKCHANNEL *Backchannel = NULL;
+    if (Bounce->Tracker != NULL) {
+        ExFreePoolWithTag(Bounce->Tracker, POOLTAG_BOUNCE);
+        Bounce->Tracker = NULL;
+    }
 
-    if (Xsk->Tx.Xdp.Queue == NULL) {
-        Status = STATUS_NOT_SUPPORTED;
-        goto Exit;
+    if (Bounce->Mapping.Mdl != NULL) {
+        IoFreeMdl(Bounce->Mapping.Mdl);
+        Bounce->Mapping.Mdl = NULL;
     }
 
-    InterfaceTxPollHandle = XdpTxQueueGetInterfacePollHandle(Xsk->Tx.Xdp.Queue);
-    if (InterfaceTxPollHandle == NULL) {
-        Status = STATUS_NOT_SUPPORTED;
-        goto Exit;
+    if (Bounce->Mapping.SystemAddress != NULL && Bounce->AllocationSource == AllocatedByMm) {
+        ExFreePoolWithTag(Bounce->Mapping.SystemAddress, POOLTAG_BOUNCE);
+        Bounce->Mapping.SystemAddress = NULL;
+        Bounce->AllocationSource = NotAllocated;
     }
+}
 
-    if (Xsk->Rx.Ring.Size > 0 &&
-        InterfaceTxPollHandle == XdpRxQueueGetInterfacePollHandle(Xsk->Rx.Xdp.Queue)) {
+static
+FORCEINLINE
+UINT32
+XskGetAvailableTxCompletion(
+    _In_ XSK *Xsk
+    )
+{
+    UINT32 XskCompletionAvailable = XskRingProdReserve(&Xsk->Tx.CompletionRing, MAXUINT32);
+
+    if (!NT_VERIFY(XskCompletionAvailable >= Xsk->Tx.Xdp.OutstandingFrames)) {
         //
-        // The interface uses the same polling context for RX and TX, and this
-        // socket has already captured the RX handle. Use that for TX, too.
+        // If the above condition does not hold, the XSK TX completion ring is
+        // no longer valid. This implies an application programming error.
         //
-        ASSERT(Xsk->Rx.Xdp.PollHandle != NULL);
-        Xsk->Tx.Xdp.PollHandle = Xsk->Rx.Xdp.PollHandle;
-        Status = STATUS_SUCCESS;
-    } else {
-        Status = XdpPollCreateBackchannel(InterfaceTxPollHandle, &Backchannel);
-        if (!NT_SUCCESS(Status)) {
-            goto Exit;
-        }
-
-        Status = XdpPollAcquireExclusive(Backchannel, XskPollSocketNotify, Xsk);
-        if (!NT_SUCCESS(Status)) {
-            goto Exit;
-        }
-        Xsk->Tx.Xdp.PollHandle = Backchannel;
-        Status = STATUS_SUCCESS;
+        XskKernelRingSetError(&Xsk->Tx.CompletionRing, XSK_ERROR_INVALID_RING);
+        return 0;
     }
 
-    Xsk->Tx.Ring.Shared->Flags |= XSK_RING_FLAG_NEED_POKE;
-
-Exit:
+    return XskCompletionAvailable - Xsk->Tx.Xdp.OutstandingFrames;
+}
 
-    if (!NT_SUCCESS(Status)) {
-        if (Backchannel != NULL) {
-            XdpPollDeleteBackchannel(Backchannel);
-        }
-    }
+static
+FORCEINLINE
+VOID
+XskTxReorderPost(
+    _Inout_ XSK *Xsk,
+    _In_ UINT64 Address
+    )
+{
+    XSK_TX_REORDER *Reorder = &Xsk->Tx.Reorder;
+    XSK_TX_REORDER_ENTRY *Entry = &Reorder->Entries[Reorder->Tail++ & Reorder->Mask];
 
-    return Status;
+    ASSERT(Reorder->Tail - Reorder->Head <= Reorder->Mask + 1);
+    Entry->Address = Address;
+    Entry->Completed = FALSE;
 }
 
 static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
+FORCEINLINE
 VOID
-XskAcquirePollModeSocket(
+XskPollBusyActivity(
     _In_ XSK *Xsk
     )
 {
-    NTSTATUS Status;
-    KIRQL OldIrql;
-    UINT32 NotifyFlags = 0;
-
-    if (Xsk->Rx.Ring.Size > 0 && Xsk->Rx.Xdp.PollHandle == NULL) {
-        Status = XskAcquirePollModeSocketRx(Xsk);
-        if (!NT_SUCCESS(Status)) {
-            goto Exit;
-        }
-        NotifyFlags |= XSK_NOTIFY_FLAG_WAIT_RX;
-    }
-
-    if (Xsk->Tx.Ring.Size > 0 && Xsk->Tx.Xdp.PollHandle == NULL) {
-        Status = XskAcquirePollModeSocketTx(Xsk);
-        if (!NT_SUCCESS(Status)) {
-            goto Exit;
-        }
-        NotifyFlags |= XSK_NOTIFY_FLAG_WAIT_TX;
-    }
-
     //
-    // Invalidate the internal notification state and cancel any outstanding
-    // wait on the socket. We must ensure the data path thread makes forward
-    // progress if poll modes are modified on another thread.
+    // Record datapath progress for the busy polling idle timer. Avoid dirtying
+    // the cache line if the idle timer is disabled or progress is recorded.
     //
-
-    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
-    Xsk->IoWaitInternalFlags |= XSK_IO_WAIT_FLAG_POLL_MODE_SOCKET;
-    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
-
-    XskSignalReadyIo(Xsk, NotifyFlags);
-
-    Status = STATUS_SUCCESS;
-
-Exit:
-
-    if (!NT_SUCCESS(Status)) {
-        XskReleasePollModeSocket(Xsk);
+    if (Xsk->PollBusyIdleTimeoutMs > 0 && !Xsk->PollBusyActive) {
+        Xsk->PollBusyActive = TRUE;
     }
 }
 
 static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
-NTSTATUS
-XskEnterPollModeSocket(
-    _In_ XSK *Xsk
+FORCEINLINE
+VOID
+XskTxRateLimitRefill(
+    _Inout_ XSK_TX_RATE_LIMITER *Limiter
     )
 {
-    Xsk->PollMode = XSK_POLL_MODE_SOCKET;
+    INT64 CurrentQpc = KeQueryPerformanceCounter(NULL).QuadPart;
+    INT64 ElapsedQpc;
 
     //
-    // Polling mode is merely a hint to AF_XDP, so it's fine to silently fail if
-    // socket polling is not available. The XSK might be attached to an RX queue
-    // via XskNotifyAttachRxQueue whenever a new RX program is attached, so try
-    // again then.
+    // The bucket starts full, so the first refill only records the time.
+    // Elapsed time is clamped to keep the products below in range.
     //
-    XskAcquirePollModeSocket(Xsk);
+    if (Limiter->LastQpc == 0) {
+        Limiter->LastQpc = CurrentQpc;
+        return;
+    }
 
-    return STATUS_SUCCESS;
+    ElapsedQpc = min(CurrentQpc - Limiter->LastQpc, Limiter->MaxElapsedQpc);
+    Limiter->LastQpc = CurrentQpc;
+
+    Limiter->BitTokens =
+        min(Limiter->BitTokens + ElapsedQpc * Limiter->BitsPerSecond, Limiter->BitDepth);
+    Limiter->FrameTokens =
+        min(Limiter->FrameTokens + ElapsedQpc * Limiter->FramesPerSecond, Limiter->FrameDepth);
 }
 
 static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
-VOID
-XskReleasePollModeBusyTx(
-    _In_ XSK *Xsk
+BOOLEAN
+XskFillTxChecksum(
+    _In_ XSK *Xsk,
+    _In_ XSK_FRAME_DESCRIPTOR *XskFrame,
+    _Inout_ XDP_FRAME *Frame
     )
 {
-    if (Xsk->Tx.Xdp.PollHandle != NULL) {
-        XdpPollReleaseBusyReference(Xsk->Tx.Xdp.PollHandle);
-        XdpPollDeleteBackchannel(Xsk->Tx.Xdp.PollHandle);
-        Xsk->Tx.Xdp.PollHandle = NULL;
+    XDP_FRAME_LAYOUT *Layout = XdpGetFrameLayoutExtension(Frame, &Xsk->Tx.Xdp.LayoutExtension);
+    XDP_FRAME_CHECKSUM *Checksum =
+        XdpGetFrameChecksumExtension(Frame, &Xsk->Tx.Xdp.ChecksumExtension);
+    UINT32 Offloads = Xsk->Tx.ChecksumOffloads;
+
+    if (Offloads == 0) {
+        RtlZeroMemory(Layout, sizeof(*Layout));
+        RtlZeroMemory(Checksum, sizeof(*Checksum));
+        return TRUE;
+    }
 
-        //
-        // Ensure the XSK ring need poke flag is set after releasing the busy
-        // reference.
-        //
-        if (Xsk->Tx.Xdp.Flags.QueueActive) {
-            XDP_NOTIFY_QUEUE_FLAGS NotifyFlags = XDP_NOTIFY_QUEUE_FLAG_TX;
+    //
+    // The descriptor extensions are in shared memory, so copy them into the
+    // XDP frame before validating them.
+    //
+    RtlCopyVolatileMemory(
+        Layout, (UCHAR *)XskFrame + XSK_TX_LAYOUT_EXTENSION_OFFSET, sizeof(*Layout));
+    RtlCopyVolatileMemory(
+        Checksum, (UCHAR *)XskFrame + XSK_TX_CHECKSUM_EXTENSION_OFFSET, sizeof(*Checksum));
+
+    if (Checksum->Layer3 > XdpFrameTxChecksumActionRequired ||
+        Checksum->Layer4 > XdpFrameTxChecksumActionRequired ||
+        Checksum->Reserved != 0) {
+        return FALSE;
+    }
 
-            XdpTxQueueInvokeInterfaceNotify(Xsk->Tx.Xdp.Queue, NotifyFlags);
+    if (Checksum->Layer3 == XdpFrameTxChecksumActionRequired &&
+        (!(Offloads & XSK_TX_CHECKSUM_OFFLOAD_IPV4) ||
+            Layout->Layer3Type < XdpFrameLayer3TypeIPv4UnspecifiedOptions ||
+            Layout->Layer3Type > XdpFrameLayer3TypeIPv4NoOptions)) {
+        return FALSE;
+    }
+
+    if (Checksum->Layer4 == XdpFrameTxChecksumActionRequired) {
+        if (Layout->Layer4Type == XdpFrameLayer4TypeTcp) {
+            return !!(Offloads & XSK_TX_CHECKSUM_OFFLOAD_TCP);
+        } else if (Layout->Layer4Type == XdpFrameLayer4TypeUdp) {
+            return !!(Offloads & XSK_TX_CHECKSUM_OFFLOAD_UDP);
+        } else {
+            return FALSE;
         }
     }
+
+    return TRUE;
 }
 
+//
+// Returns TRUE if the TX path should keep watching the TX ring from the pacing
+// timer rather than asking the application to poke it.
+//
 static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
-VOID
-XskReleasePollModeBusyRx(
+BOOLEAN
+XskTxPokeLinger(
     _In_ XSK *Xsk
     )
 {
-    if (Xsk->Rx.Xdp.PollHandle != NULL) {
-        XdpPollReleaseBusyReference(Xsk->Rx.Xdp.PollHandle);
-        XdpPollDeleteBackchannel(Xsk->Rx.Xdp.PollHandle);
-        Xsk->Rx.Xdp.PollHandle = NULL;
+    INT64 CurrentQpc;
 
-        ASSERT((Xsk->Rx.FillRing.Shared->Flags & XSK_RING_FLAG_NEED_POKE) == 0);
+    if (Xsk->Tx.PokeLingerQpc == 0) {
+        return FALSE;
     }
-}
 
-static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
-VOID
-XskExitPollModeBusy(
-    _In_ XSK *Xsk
-    )
-{
-    Xsk->PollMode = XSK_POLL_MODE_DEFAULT;
-    XskReleasePollModeBusyTx(Xsk);
-    XskReleasePollModeBusyRx(Xsk);
+    CurrentQpc = KeQueryPerformanceCounter(NULL).QuadPart;
+    if (Xsk->Tx.IdleQpc == 0) {
+        Xsk->Tx.IdleQpc = CurrentQpc;
+    }
+
+    if (CurrentQpc - Xsk->Tx.IdleQpc >= Xsk->Tx.PokeLingerQpc) {
+        return FALSE;
+    }
+
+    WriteBooleanNoFence(&Xsk->Tx.PaceHeld, TRUE);
+
+    return TRUE;
 }
 
-static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
-VOID
-XskAcquirePollModeBusyRx(
-    _In_ XSK *Xsk
+_IRQL_requires_max_(DISPATCH_LEVEL)
+UINT32
+XskFillTx(
+    _In_ XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *DatapathClientEntry,
+    _In_ UINT32 XdpTxAvailable
     )
 {
-    NDIS_HANDLE InterfaceRxPollHandle;
-    NDIS_POLL_BACKCHANNEL *Backchannel = NULL;
-    NTSTATUS Status;
-
-    ASSERT(Xsk->Rx.Xdp.PollHandle == NULL);
-
-    if (Xsk->Rx.Xdp.Queue == NULL) {
-        Status = STATUS_NOT_SUPPORTED;
-        goto Exit;
-    }
+    XSK *Xsk = CONTAINING_RECORD(DatapathClientEntry, XSK, Tx.Xdp.DatapathClientEntry);
+    XSK_FRAME_DESCRIPTOR *XskFrame;
+    XSK_BUFFER_DESCRIPTOR *XskBuffer;
+    UINT32 Count;
+    UINT32 FrameCount = 0;
+    UINT32 TxIndex;
+    UINT32 XskCompletionAvailable;
+    UINT32 XskTxAvailable;
+    UINT32 UnpacedCount;
+    UINT64 CurrentQpc = 0;
+    XDP_RING *FrameRing = Xsk->Tx.Xdp.FrameRing;
+    XSK_TX_RATE_LIMITER *Limiter = &Xsk->Tx.RateLimit;
+    XSK_TX_BATCH TxBatch;
+    UINT32 TxBatchEnd = 0;
 
-    InterfaceRxPollHandle = XdpRxQueueGetInterfacePollHandle(Xsk->Rx.Xdp.Queue);
-    if (InterfaceRxPollHandle == NULL) {
-        Status = STATUS_NOT_SUPPORTED;
-        goto Exit;
+    if (Xsk->State != XskActive || ReadBooleanNoFence(&Xsk->Failover.Migrating)) {
+        return 0;
     }
 
-    Status = XdpPollCreateBackchannel(InterfaceRxPollHandle, &Backchannel);
-    if (!NT_SUCCESS(Status)) {
-        goto Exit;
+    if (Xsk->Tx.Xdp.DeferredCompletions > 0) {
+        //
+        // Publish completions deferred by the previous flush at least once per
+        // TX poll.
+        //
+        XskPublishTxCompletion(Xsk, Xsk->Tx.Xdp.DeferredCompletions);
+        Xsk->Tx.Xdp.DeferredCompletions = 0;
     }
 
-    Status = XdpPollAddBusyReference(Backchannel);
-    if (!NT_SUCCESS(Status)) {
-        goto Exit;
+    //
+    // The need poke flag is cleared when a poke request is submitted. If no
+    // input is available and no packets are outstanding, or if the TX queue is
+    // blocked by a full TX completion queue, set the need poke flag and then
+    // re-check for available TX/completion.
+    //
+    if (Xsk->Tx.Xdp.PollHandle == NULL &&
+        ((XskRingConsPeek(&Xsk->Tx.Ring, 1) == 0 && Xsk->Tx.Xdp.OutstandingFrames == 0) ||
+         (XskGetAvailableTxCompletion(Xsk) == 0)) &&
+        !XskTxPokeLinger(Xsk)) {
+        if ((InterlockedOr((LONG *)&Xsk->Tx.Ring.Shared->Flags, XSK_RING_FLAG_NEED_POKE) &
+                XSK_RING_FLAG_NEED_POKE) == 0) {
+            STAT_INC(XskGetProcessorStatistics(Xsk), TxNeedPoke);
+        }
     }
 
     //
-    // Review: handling of multiple sockets sharing a queue.
+    // Number of buffers we can move from the XSK TX ring to the XDP TX ring is
+    // the minimum of these values:
+    //
+    // 1) XDP TX frames available for production
+    // 2) XSK TX descriptors available for consumption
+    // 3) XSK TX completion descriptors available for production
+    //    - XSK TX operations outstanding
     //
-    Xsk->Rx.FillRing.Shared->Flags &= ~XSK_RING_FLAG_NEED_POKE;
-    Xsk->Rx.Xdp.PollHandle = Backchannel;
-    Status = STATUS_SUCCESS;
-
-Exit:
 
-    if (!NT_SUCCESS(Status)) {
-        if (Backchannel != NULL) {
-            XdpPollDeleteBackchannel(Backchannel);
-        }
-    }
-}
+    XskTxAvailable = XskRingConsPeek(&Xsk->Tx.Ring, MAXUINT32);
 
-static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
-VOID
-XskAcquirePollModeBusyTx(
-    _In_ XSK *Xsk
-    )
-{
-    NTSTATUS Status;
-    NDIS_HANDLE InterfaceTxPollHandle;
-    NDIS_POLL_BACKCHANNEL *Backchannel = NULL;
+    XskCompletionAvailable = XskGetAvailableTxCompletion(Xsk);
 
-    if (Xsk->Tx.Xdp.Queue == NULL) {
-        Status = STATUS_NOT_SUPPORTED;
-        goto Exit;
-    }
+    Count = min(min(XdpTxAvailable, XskTxAvailable), XskCompletionAvailable);
 
-    InterfaceTxPollHandle = XdpTxQueueGetInterfacePollHandle(Xsk->Tx.Xdp.Queue);
-    if (InterfaceTxPollHandle == NULL) {
-        Status = STATUS_NOT_SUPPORTED;
-        goto Exit;
+    if (Xsk->PollBudget > 0 && Xsk->Tx.Xdp.PollHandle != NULL) {
+        //
+        // Bound the frames posted per poll iteration so a busy polling TX
+        // socket does not monopolize its poll context.
+        //
+        Count = min(Count, Xsk->PollBudget);
     }
 
-    Status = XdpPollCreateBackchannel(InterfaceTxPollHandle, &Backchannel);
-    if (!NT_SUCCESS(Status)) {
-        goto Exit;
-    }
+    UnpacedCount = Count;
 
-    Status = XdpPollAddBusyReference(Backchannel);
-    if (!NT_SUCCESS(Status)) {
-        goto Exit;
+    if (Xsk->Tx.LaunchTime && Count > 0) {
+        CurrentQpc = KeQueryPerformanceCounter(NULL).QuadPart;
     }
 
-    Xsk->Tx.Ring.Shared->Flags &= ~XSK_RING_FLAG_NEED_POKE;
-    Xsk->Tx.Xdp.PollHandle = Backchannel;
-    Status = STATUS_SUCCESS;
-
-Exit:
+    if (Limiter->Enabled && Count > 0) {
+        XskTxRateLimitRefill(Limiter);
 
-    if (!NT_SUCCESS(Status)) {
-        if (Backchannel != NULL) {
-            XdpPollDeleteBackchannel(Backchannel);
+        if (Limiter->FramesPerSecond > 0) {
+            Count = (UINT32)min(Count, Limiter->FrameTokens / Limiter->FrequencyQpc);
         }
     }
-}
 
-static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
-VOID
-XskAcquirePollModeBusy(
-    _In_ XSK *Xsk
-    )
-{
-    if (Xsk->Rx.Ring.Size > 0 && Xsk->Rx.Xdp.PollHandle == NULL) {
-        XskAcquirePollModeBusyRx(Xsk);
+    for (ULONG i = 0; i < Count; i++) {
+        XDP_FRAME *Frame;
+        XDP_BUFFER *Buffer;
+        XSK_BUFFER_ADDRESS AddressDescriptor;
+        UMEM_MAPPING *Mapping;
+        XDP_TX_FRAME_COMPLETION_CONTEXT *CompletionContext;
 
-    }
+        if (Limiter->BitsPerSecond > 0 && Limiter->BitTokens <= 0) {
+            //
+            // The bit bucket may be overdrawn by the last admitted frame; stop
+            // consuming descriptors until it refills.
+            //
+            Count = i;
+            break;
+        }
 
-    if (Xsk->Tx.Ring.Size > 0 && Xsk->Tx.Xdp.PollHandle == NULL) {
-        XskAcquirePollModeBusyTx(Xsk);
-    }
-}
+        if (i == TxBatchEnd) {
+            //
+            // Snapshot and validate the next run of descriptors together, so
+            // the per-frame path only re-checks descriptors that failed.
+            //
+            RtlZeroMemory(&TxBatch, sizeof(TxBatch));
+            TxBatchEnd = i + min(Count - i, XSK_TX_BATCH_SIZE);
+
+            for (UINT32 j = 0; i + j < TxBatchEnd; j++) {
+                TxIndex =
+                    (ReadUInt32NoFence(&Xsk->Tx.Ring.Shared->ConsumerIndex) + i + j) &
+                        (Xsk->Tx.Ring.Mask);
+                XskFrame = XskKernelRingGetElement(&Xsk->Tx.Ring, TxIndex);
+                XskBuffer = &XskFrame->Buffer;
+                TxBatch.AddressAndOffset[j] =
+                    ReadUInt64NoFence(&XskBuffer->Address.AddressAndOffset);
+                TxBatch.Length[j] = ReadUInt32NoFence(&XskBuffer->Length);
+            }
 
-static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
-NTSTATUS
-XskEnterPollModeBusy(
-    _In_ XSK *Xsk
-    )
-{
-    Xsk->PollMode = XSK_POLL_MODE_BUSY;
+            TxBatch.ValidMask = XskUmemValidateTxBatch(Xsk->Umem, &TxBatch);
+        }
 
-    //
-    // Polling mode is merely a hint to AF_XDP, so it's fine to silently fail if
-    // socket polling is not available. The XSK might be attached to an RX queue
-    // via XskNotifyAttachRxQueue whenever a new RX program is attached, so try
-    // again then.
-    //
-    XskAcquirePollModeBusy(Xsk);
+        TxIndex =
+            (ReadUInt32NoFence(&Xsk->Tx.Ring.Shared->ConsumerIndex) + i) & (Xsk->Tx.Ring.Mask);
+        XskFrame = XskKernelRingGetElement(&Xsk->Tx.Ring, TxIndex);
 
-    return STATUS_SUCCESS;
-}
+        Frame = XdpRingGetElement(FrameRing, FrameRing->ProducerIndex & FrameRing->Mask);
+        Buffer = &Frame->Buffer;
 
-static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
-NTSTATUS
-XskSetPollMode(
-    _In_ XSK *Xsk,
-    _In_ XSK_POLL_MODE PollMode
-    )
-{
-    NTSTATUS Status = STATUS_SUCCESS;
+        AddressDescriptor.AddressAndOffset =
+            TxBatch.AddressAndOffset[i % XSK_TX_BATCH_SIZE];
+        Buffer->DataOffset = (UINT32)AddressDescriptor.Offset;
+        Buffer->DataLength = TxBatch.Length[i % XSK_TX_BATCH_SIZE];
+        Buffer->BufferLength = Buffer->DataLength + Buffer->DataOffset;
 
-    if (Xsk->State != XskActive && PollMode != XSK_POLL_MODE_DEFAULT) {
-        Status = STATUS_INVALID_DEVICE_STATE;
-        goto Exit;
-    }
+        if ((TxBatch.ValidMask & (1ui32 << (i % XSK_TX_BATCH_SIZE))) == 0 &&
+            (Buffer->DataLength == 0 ||
+                !XskUmemValidateTxBuffer(
+                    Xsk->Umem, AddressDescriptor.BaseAddress, Buffer->DataOffset,
+                    Buffer->DataLength))) {
+            Xsk->Statistics->TxInvalidDescriptors++;
+            STAT_INC(XdpTxQueueGetStats(Xsk->Tx.Xdp.Queue), XskInvalidDescriptors);
+            continue;
+        }
 
-    //
-    // Exit the old polling mode and return to the default state.
-    //
-    switch (Xsk->PollMode) {
+        if (Buffer->DataLength > Xsk->Tx.Xdp.MaxBufferLength ||
+            (Buffer->DataLength > Xsk->Tx.Xdp.MaxFrameLength &&
+                (Xsk->Tx.SegmentSize == 0 || !Xsk->Tx.Xdp.Flags.GsoExt))) {
+            Xsk->Statistics->TxInvalidDescriptors++;
+            STAT_INC(XdpTxQueueGetStats(Xsk->Tx.Xdp.Queue), XskInvalidDescriptors);
+            continue;
+        }
 
-    case XSK_POLL_MODE_DEFAULT:
-        // Nothing to do.
-        break;
+        if ((Xsk->Tx.Timestamp || Xsk->Tx.LaunchTime) && Buffer->DataOffset < sizeof(UINT64)) {
+            //
+            // The TX timestamp and launch time are stored in front of the frame
+            // data.
+            //
+            Xsk->Statistics->TxInvalidDescriptors++;
+            STAT_INC(XdpTxQueueGetStats(Xsk->Tx.Xdp.Queue), XskInvalidDescriptors);
+            continue;
+        }
 
-    case XSK_POLL_MODE_BUSY:
-        XskExitPollModeBusy(Xsk);
-        break;
+        if (Xsk->Tx.LaunchTime &&
+            *(volatile UINT64 UNALIGNED *)
+                (Xsk->Umem->Mapping.SystemAddress + AddressDescriptor.BaseAddress) >
+                CurrentQpc) {
+            //
+            // Descriptors are transmitted in ring order, so hold this and all
+            // subsequent descriptors until the launch time arrives.
+            //
+            Count = i;
+            break;
+        }
 
-    case XSK_POLL_MODE_SOCKET:
-        XskExitPollModeSocket(Xsk);
-        break;
+        if (Xsk->Tx.Xdp.Flags.ChecksumExt &&
+            !XskFillTxChecksum(Xsk, XskFrame, Frame)) {
+            Xsk->Statistics->TxInvalidDescriptors++;
+            STAT_INC(XdpTxQueueGetStats(Xsk->Tx.Xdp.Queue), XskInvalidDescriptors);
+            continue;
+        }
 
-    default:
-        ASSERT(FALSE);
-    }
+        if (!XskBounceBuffer(
+                Xsk->Umem, &Xsk->Tx.UmemMapping, &Xsk->Tx.Bounce, Buffer,
+                AddressDescriptor.BaseAddress, Xsk->Tx.ZeroCopyRequested, &Mapping)) {
+            Xsk->Statistics->TxInvalidDescriptors++;
+            STAT_INC(XskGetProcessorStatistics(Xsk), TxBounceFailures);
+            STAT_INC(XdpTxQueueGetStats(Xsk->Tx.Xdp.Queue), XskBounceFailures);
+            STAT_INC(XdpTxQueueGetStats(Xsk->Tx.Xdp.Queue), XskInvalidDescriptors);
+            continue;
+        }
 
-    ASSERT(Xsk->PollMode == XSK_POLL_MODE_DEFAULT);
+        if (Mapping == &Xsk->Tx.Bounce.Mapping) {
+            STAT_INC(XskGetProcessorStatistics(Xsk), TxBounceFrames);
+        }
 
-    //
-    // Enter the new polling mode.
-    //
-    switch (PollMode) {
+        if (Xsk->Tx.Xdp.Flags.VirtualAddressExt) {
+            XDP_BUFFER_VIRTUAL_ADDRESS *Va;
+            Va = XdpGetVirtualAddressExtension(Buffer, &Xsk->Tx.Xdp.VaExtension);
+            Va->VirtualAddress = &Mapping->SystemAddress[AddressDescriptor.BaseAddress];
+        }
+        if (Xsk->Tx.Xdp.Flags.LogicalAddressExt) {
+            XDP_BUFFER_LOGICAL_ADDRESS *La;
+            La = XdpGetLogicalAddressExtension(Buffer, &Xsk->Tx.Xdp.LaExtension);
+            La->LogicalAddress = Mapping->DmaAddress.QuadPart + AddressDescriptor.BaseAddress;
+        }
+        if (Xsk->Tx.Xdp.Flags.MdlExt) {
+            XDP_BUFFER_MDL *Mdl;
+            Mdl = XdpGetMdlExtension(Buffer, &Xsk->Tx.Xdp.MdlExtension);
+            Mdl->Mdl = Mapping->Mdl;
+            Mdl->MdlOffset = AddressDescriptor.BaseAddress;
+        }
+        if (Xsk->Tx.Xdp.Flags.CompletionContext) {
+            CompletionContext =
+                XdpGetFrameTxCompletionContextExtension(
+                    Frame, &Xsk->Tx.Xdp.FrameTxCompletionExtension);
+            CompletionContext->Context = &Xsk->Tx.Xdp.DatapathClientEntry;
+        }
+        if (Xsk->Tx.Xdp.Flags.GsoExt) {
+            XDP_FRAME_GSO *Gso = XdpGetFrameGsoExtension(Frame, &Xsk->Tx.Xdp.GsoExtension);
 
-    case XSK_POLL_MODE_DEFAULT:
-        // Nothing to do.
-        break;
+            //
+            // Only frames exceeding the MTU are segmented.
+            //
+            RtlZeroMemory(Gso, sizeof(*Gso));
+            if (Buffer->DataLength > Xsk->Tx.Xdp.MaxFrameLength) {
+                Gso->UDP.Mss = Xsk->Tx.SegmentSize;
+            }
+        }
 
-    case XSK_POLL_MODE_BUSY:
-        Status = XskEnterPollModeBusy(Xsk);
-        if (!NT_SUCCESS(Status)) {
-            goto Exit;
+        EventWriteXskTxEnqueue(
+            &MICROSOFT_XDP_PROVIDER, Xsk, Xsk->Tx.Ring.Shared->ConsumerIndex + i,
+            FrameRing->ProducerIndex);
+
+        if (Limiter->BitsPerSecond > 0) {
+            Limiter->BitTokens -= (INT64)Buffer->DataLength * 8 * Limiter->FrequencyQpc;
+        }
+        if (Limiter->FramesPerSecond > 0) {
+            Limiter->FrameTokens -= Limiter->FrequencyQpc;
         }
-        goto Exit;
 
-    case XSK_POLL_MODE_SOCKET:
-        Status = XskEnterPollModeSocket(Xsk);
-        if (!NT_SUCCESS(Status)) {
-            goto Exit;
+        STAT_ADD(XskGetProcessorStatistics(Xsk), TxBytes, Buffer->DataLength);
+
+        if (Xsk->Tx.Reorder.Entries != NULL) {
+            XskTxReorderPost(Xsk, AddressDescriptor.BaseAddress);
         }
-        break;
 
-    default:
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
+        FrameRing->ProducerIndex++;
+        FrameCount++;
     }
 
-Exit:
+    if (Count < UnpacedCount) {
+        //
+        // Pacing held back descriptors; the pacing timer pokes the TX queue
+        // to retry them.
+        //
+        WriteBooleanNoFence(&Xsk->Tx.PaceHeld, TRUE);
+    }
 
-    return Status;
+    if (Count > 0) {
+        XskRingConsRelease(&Xsk->Tx.Ring, Count);
+        XskKernelRingUpdateIdealProcessor(&Xsk->Tx.Ring);
+    }
+
+    Xsk->Tx.Xdp.OutstandingFrames += FrameCount;
+
+    if (FrameCount > 0) {
+        STAT_ADD(XskGetProcessorStatistics(Xsk), TxFrames, FrameCount);
+        XskPollBusyActivity(Xsk);
+        Xsk->Tx.IdleQpc = 0;
+    }
+
+    //
+    // If input was processed, clear the need poke flag.
+    //
+    if (Xsk->Tx.Xdp.PollHandle == NULL && Xsk->Tx.Xdp.OutstandingFrames > 0 &&
+        (Xsk->Tx.Ring.Shared->Flags & XSK_RING_FLAG_NEED_POKE)) {
+        InterlockedAnd((LONG *)&Xsk->Tx.Ring.Shared->Flags, ~XSK_RING_FLAG_NEED_POKE);
+    }
+
+    return FrameCount;
 }
 
 static
 VOID
-XskNotifyDetachRxQueue(
-    _In_ XSK *Xsk
+XskWriteUmemTxTimestamp(
+    _In_ XSK *Xsk,
+    _In_ UINT64 RelativeAddress,
+    _In_opt_ const XDP_FRAME_TIMESTAMP *Timestamp
     )
 {
-    XskAcquirePollLock(Xsk);
-
     //
-    // This socket is being unbound from an RX queue, so release all polling
-    // backchannels and deactivate the current polling mode.
+    // The timestamp is written to the start of the buffer, which the TX path
+    // ensures is in front of the frame data. Always write into the UMEM, even
+    // if the frame was bounced.
     //
-    switch (Xsk->PollMode) {
-
-    case XSK_POLL_MODE_BUSY:
-        XskReleasePollModeBusyRx(Xsk);
-        break;
-
-    case XSK_POLL_MODE_SOCKET:
-        XskReleasePollModeSocket(Xsk);
-        break;
-
-    }
-
-    XskReleasePollLock(Xsk);
+    *(UINT64 UNALIGNED *)(Xsk->Umem->Mapping.SystemAddress + RelativeAddress) =
+        (Timestamp != NULL) ? Timestamp->Timestamp : 0;
 }
 
 static
 VOID
-XskNotifyDetachRxQueueComplete(
-    _In_ XSK *Xsk
+XskWriteUmemTxCompletion(
+    _In_ XSK *Xsk,
+    _In_ UINT32 Index,
+    _In_ UINT64 RelativeAddress
     )
 {
-    Xsk->Rx.Xdp.FrameRing = NULL;
-    Xsk->Rx.Xdp.FragmentRing = NULL;
-    RtlZeroMemory(&Xsk->Rx.Xdp.VaExtension, sizeof(Xsk->Rx.Xdp.VaExtension));
-    RtlZeroMemory(&Xsk->Rx.Xdp.FragmentExtension, sizeof(Xsk->Rx.Xdp.FragmentExtension));
-    RtlZeroMemory(&Xsk->Rx.Xdp.RxActionExtension, sizeof(Xsk->Rx.Xdp.RxActionExtension));
+    UINT64 *XskCompletion;
+
+    XskReleaseBounceBuffer(Xsk->Umem, &Xsk->Tx.Bounce, RelativeAddress);
+    XskCompletion =
+        XskKernelRingGetElement(
+            &Xsk->Tx.CompletionRing, Index & (Xsk->Tx.CompletionRing.Mask));
+    *XskCompletion = RelativeAddress;
 }
 
+//
+// Marks the oldest in-flight frame with the completed address as complete.
+// Frames sharing an address are indistinguishable to the application, so any
+// of them may be matched. Interfaces complete most frames close to the oldest
+// in-flight frame, so the search is short in practice.
+//
 static
-VOID
-XskNotifyAttachRxQueue(
-    _In_ XSK *Xsk
+BOOLEAN
+XskTxReorderComplete(
+    _Inout_ XSK *Xsk,
+    _In_ UINT64 Address
     )
 {
-    XDP_RX_QUEUE_CONFIG_ACTIVATE Config = XdpRxQueueGetConfig(Xsk->Rx.Xdp.Queue);
-    XDP_EXTENSION_INFO ExtensionInfo;
+    XSK_TX_REORDER *Reorder = &Xsk->Tx.Reorder;
 
-    Xsk->Rx.Xdp.FrameRing = XdpRxQueueGetFrameRing(Config);
+    for (UINT32 Index = Reorder->Head; Index != Reorder->Tail; Index++) {
+        XSK_TX_REORDER_ENTRY *Entry = &Reorder->Entries[Index & Reorder->Mask];
 
-    ASSERT(XdpRxQueueIsVirtualAddressEnabled(Config));
-    XdpInitializeExtensionInfo(
-        &ExtensionInfo, XDP_BUFFER_EXTENSION_VIRTUAL_ADDRESS_NAME,
-        XDP_BUFFER_EXTENSION_VIRTUAL_ADDRESS_VERSION_1, XDP_EXTENSION_TYPE_BUFFER);
-    XdpRxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Rx.Xdp.VaExtension);
+        if (!Entry->Completed && Entry->Address == Address) {
+            UINT32 Depth = Index - Reorder->Head;
 
-    XdpInitializeExtensionInfo(
-        &ExtensionInfo, XDP_FRAME_EXTENSION_RX_ACTION_NAME,
-        XDP_FRAME_EXTENSION_RX_ACTION_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
-    XdpRxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Rx.Xdp.RxActionExtension);
+            Entry->Completed = TRUE;
 
-    if (XdpRxQueueGetMaximumFragments(Config) > 1) {
-        Xsk->Rx.Xdp.FragmentRing = XdpRxQueueGetFragmentRing(Config);
+            if (Depth > 0) {
+                Reorder->Reordered++;
+                Reorder->DepthMax = max(Reorder->DepthMax, Depth);
+            }
 
-        XdpInitializeExtensionInfo(
-            &ExtensionInfo, XDP_FRAME_EXTENSION_FRAGMENT_NAME,
-            XDP_FRAME_EXTENSION_FRAGMENT_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
-        XdpRxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Rx.Xdp.FragmentExtension);
+            return TRUE;
+        }
     }
 
-    XskAcquirePollLock(Xsk);
-
-    if (Xsk->State == XskActive) {
-        //
-        // Now that this socket is bound to an RX queue, attempt to acquire the
-        // polling backchannel(s) and activate the appropriate polling mode.
-        //
-        switch (Xsk->PollMode) {
+    return FALSE;
+}
 
-        case XSK_POLL_MODE_BUSY:
-            XskAcquirePollModeBusyRx(Xsk);
-            break;
+//
+// Writes the completed frames at the head of the reorder buffer to the XSK TX
+// completion ring and returns the updated producer index.
+//
+static
+UINT32
+XskTxReorderRelease(
+    _Inout_ XSK *Xsk,
+    _In_ UINT32 ProducerIndex
+    )
+{
+    XSK_TX_REORDER *Reorder = &Xsk->Tx.Reorder;
 
-        case XSK_POLL_MODE_SOCKET:
-            XskAcquirePollModeSocket(Xsk);
-            break;
+    while (Reorder->Head != Reorder->Tail) {
+        XSK_TX_REORDER_ENTRY *Entry = &Reorder->Entries[Reorder->Head & Reorder->Mask];
 
+        if (!Entry->Completed) {
+            break;
         }
-    }
 
-    XskReleasePollLock(Xsk);
+        XskWriteUmemTxCompletion(Xsk, ProducerIndex++, Entry->Address);
+        Reorder->Head++;
+    }
 
-    Xsk->Rx.Xdp.Flags.DatapathAttached = TRUE;
+    return ProducerIndex;
 }
 
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
-XskNotifyRxQueue(
-    _In_ XDP_RX_QUEUE_NOTIFICATION_ENTRY *NotificationEntry,
-    _In_ XDP_RX_QUEUE_NOTIFICATION_TYPE NotificationType
+XskTxCompleteRundown(
+    _In_ XSK *Xsk
     )
 {
-    XSK *Xsk = CONTAINING_RECORD(NotificationEntry, XSK, Rx.Xdp.QueueNotificationEntry);
+    if (Xsk->State > XskActive || ReadBooleanNoFence(&Xsk->Failover.Migrating)) {
+        if (Xsk->Tx.Xdp.OutstandingFrames == 0) {
+            KeSetEvent(&Xsk->Tx.Xdp.OutstandingFlushComplete, 0, FALSE);
+        }
+    }
+}
 
-    TraceInfo(TRACE_XSK, "Xsk=%p NotificationType=%u", Xsk, NotificationType);
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+XskFillTxCompletion(
+    _In_ XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *DatapathClientEntry
+    )
+{
+    XSK *Xsk = CONTAINING_RECORD(DatapathClientEntry, XSK, Tx.Xdp.DatapathClientEntry);
+    XSK_SHARED_RING *Ring = Xsk->Tx.CompletionRing.Shared;
+    UINT32 PendingCompletions = Xsk->Tx.Xdp.PendingCompletions;
+    UINT32 ProducerIndex =
+        ReadUInt32NoFence(&Ring->ProducerIndex) + Xsk->Tx.Xdp.DeferredCompletions +
+            PendingCompletions;
+    UINT32 OriginalProducerIndex = ProducerIndex;
+    UINT64 RelativeAddress;
+    UMEM_MAPPING *Mapping = XskGetTxMapping(Xsk);
+    XDP_TX_FRAME_COMPLETION_CONTEXT *CompletionContext;
 
-    switch (NotificationType) {
+    if (Xsk->Tx.Xdp.Flags.OutOfOrderCompletion) {
+        XDP_RING *XdpRing = Xsk->Tx.Xdp.CompletionRing;
+        UINT32 FirstConsumerIndex = XdpRing->ConsumerIndex;
+        XDP_TX_FRAME_COMPLETION *Completion;
 
-    case XDP_RX_QUEUE_NOTIFICATION_ATTACH:
-        XskNotifyAttachRxQueue(Xsk);
-        break;
+        //
+        // Move all entries from the XDP TX completion ring to the XSK TX completion
+        // ring. We have ensured sufficient XSK TX completion ring space when we
+        // consumed from the XSK TX ring.
+        //
+        ASSERT(XdpRingCount(XdpRing) > 0);
+        do {
+            Completion = XdpRingGetElement(XdpRing, XdpRing->ConsumerIndex & XdpRing->Mask);
 
-    case XDP_RX_QUEUE_NOTIFICATION_DETACH:
-        XskNotifyDetachRxQueue(Xsk);
-        break;
+            if (Xsk->Tx.Xdp.Flags.CompletionContext) {
+                CompletionContext =
+                    XdpGetTxCompletionContextExtension(
+                        Completion, &Xsk->Tx.Xdp.TxCompletionExtension);
+                if (CompletionContext->Context != &Xsk->Tx.Xdp.DatapathClientEntry) {
+                    //
+                    // We must have completed at least the first frame.
+                    //
+                    ASSERT(XdpRing->ConsumerIndex != FirstConsumerIndex);
+                    break;
+                }
+            }
 
-    case XDP_RX_QUEUE_NOTIFICATION_DETACH_COMPLETE:
-        XskNotifyDetachRxQueueComplete(Xsk);
-        break;
+            if (Xsk->Tx.Xdp.Flags.VirtualAddressExt) {
+                RelativeAddress = Completion->BufferAddress - (UINT64)Mapping->SystemAddress;
+            } else if (Xsk->Tx.Xdp.Flags.LogicalAddressExt) {
+                RelativeAddress = Completion->BufferAddress - Mapping->DmaAddress.QuadPart;
+            } else if (Xsk->Tx.Xdp.Flags.MdlExt) {
+                RelativeAddress = Completion->BufferAddress;
+            } else {
+                //
+                // One of the above extensions must have be enabled.
+                //
+                ASSERT(FALSE);
+                RelativeAddress = 0;
+            }
 
-    }
-}
+            if (Xsk->Tx.Timestamp) {
+                XskWriteUmemTxTimestamp(
+                    Xsk, RelativeAddress,
+                    Xsk->Tx.Xdp.Flags.TimestampExt ?
+                        XdpGetTxCompletionTimestampExtension(
+                            Completion, &Xsk->Tx.Xdp.TimestampExtension) : NULL);
+            }
 
-NTSTATUS
-XskValidateDatapathHandle(
-    _In_ HANDLE XskHandle
-    )
-{
-    XSK *Xsk = (XSK *)XskHandle;
+            if (Xsk->Tx.Reorder.Entries == NULL ||
+                !NT_VERIFY(XskTxReorderComplete(Xsk, RelativeAddress))) {
+                XskWriteUmemTxCompletion(Xsk, ProducerIndex++, RelativeAddress);
+            }
+            XdpRing->ConsumerIndex++;
+        } while (XdpRingCount(XdpRing) > 0);
 
-    if (Xsk->State < XskBound) {
-        return STATUS_INVALID_DEVICE_STATE;
-    }
+        if (Xsk->Tx.Reorder.Entries != NULL) {
+            ProducerIndex = XskTxReorderRelease(Xsk, ProducerIndex);
+        }
+    } else {
+        XDP_RING *XdpRing = Xsk->Tx.Xdp.FrameRing;
+        XDP_FRAME *Frame;
 
-    if (Xsk->Rx.Xdp.Queue == NULL) {
-        return STATUS_NOT_SUPPORTED;
+        //
+        // Move all completed entries from the XDP TX ring to the XSK TX completion
+        // ring. We have ensured sufficient XSK TX completion ring space when we
+        // consumed from the XSK TX ring.
+        //
+
+        ASSERT((XdpRing->ConsumerIndex - XdpRing->Reserved) > 0);
+        do {
+            Frame = XdpRingGetElement(XdpRing, XdpRing->Reserved & XdpRing->Mask);
+
+            if (Xsk->Tx.Xdp.Flags.CompletionContext) {
+                CompletionContext =
+                    XdpGetFrameTxCompletionContextExtension(
+                        Frame, &Xsk->Tx.Xdp.FrameTxCompletionExtension);
+                if (CompletionContext->Context != &Xsk->Tx.Xdp.DatapathClientEntry) {
+                    //
+                    // We must have completed at least the first frame.
+                    //
+                    ASSERT((ProducerIndex - OriginalProducerIndex) > 0);
+                    break;
+                }
+            }
+
+            if (Xsk->Tx.Xdp.Flags.VirtualAddressExt) {
+                XDP_BUFFER_VIRTUAL_ADDRESS *Va;
+                Va = XdpGetVirtualAddressExtension(&Frame->Buffer, &Xsk->Tx.Xdp.VaExtension);
+                RelativeAddress = Va->VirtualAddress - Mapping->SystemAddress;
+            } else if (Xsk->Tx.Xdp.Flags.LogicalAddressExt) {
+                XDP_BUFFER_LOGICAL_ADDRESS *La;
+                La = XdpGetLogicalAddressExtension(&Frame->Buffer, &Xsk->Tx.Xdp.LaExtension);
+                RelativeAddress = La->LogicalAddress - Mapping->DmaAddress.QuadPart;
+            } else if (Xsk->Tx.Xdp.Flags.MdlExt) {
+                XDP_BUFFER_MDL *Mdl;
+                Mdl = XdpGetMdlExtension(&Frame->Buffer, &Xsk->Tx.Xdp.MdlExtension);
+                RelativeAddress = Mdl->MdlOffset;
+            } else {
+                //
+                // One of the above extensions must have be enabled.
+                //
+                ASSERT(FALSE);
+                RelativeAddress = 0;
+            }
+
+            if (Xsk->Tx.Timestamp) {
+                XskWriteUmemTxTimestamp(
+                    Xsk, RelativeAddress,
+                    Xsk->Tx.Xdp.Flags.TimestampExt ?
+                        XdpGetFrameTimestampExtension(Frame, &Xsk->Tx.Xdp.TimestampExtension) :
+                        NULL);
+            }
+
+            XskWriteUmemTxCompletion(Xsk, ProducerIndex++, RelativeAddress);
+        } while ((XdpRing->ConsumerIndex - ++XdpRing->Reserved) > 0);
     }
 
-    return STATUS_SUCCESS;
+    //
+    // Defer publishing the completions until every run in this flush has been
+    // written, so each XSK runs its completion epilogue once per flush.
+    //
+    Xsk->Tx.Xdp.PendingCompletions += ProducerIndex - OriginalProducerIndex;
+
+    return PendingCompletions == 0 && Xsk->Tx.Xdp.PendingCompletions > 0;
 }
 
-BOOLEAN
-XskCanBypass(
-    _In_ HANDLE XskHandle,
-    _In_ XDP_RX_QUEUE *RxQueue
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XskPublishTxCompletion(
+    _In_ XSK *Xsk,
+    _In_ UINT32 Count
     )
 {
-    XSK *Xsk = (XSK *)XskHandle;
+    UINT32 OriginalProducerIndex =
+        ReadUInt32NoFence(&Xsk->Tx.CompletionRing.Shared->ProducerIndex);
+
+    Xsk->Tx.Xdp.OutstandingFrames -= Count;
 
     //
-    // Allow XSKs that are terminally disconnected to bypass on any queue since
-    // the receive path becomes a NOP.
+    // If the below condition does not hold, the XSK TX completion ring is
+    // no longer valid. This implies an application programming error.
     //
-    if (Xsk->State > XskActive && !Xsk->Rx.Xdp.Flags.DatapathAttached) {
-        return TRUE;
+    if (NT_VERIFY(XskRingProdReserve(&Xsk->Tx.CompletionRing, Count) == Count)) {
+        XskRingProdSubmit(&Xsk->Tx.CompletionRing, Count);
+        EventWriteXskTxCompleteBatch(
+            &MICROSOFT_XDP_PROVIDER, Xsk, OriginalProducerIndex, Count);
+    } else {
+        XskKernelRingSetError(&Xsk->Tx.CompletionRing, XSK_ERROR_INVALID_RING);
     }
 
-    if (Xsk->Rx.Xdp.Queue != RxQueue) {
-        return FALSE;
-    }
+    //
+    // N.B. See comment in XskNotify.
+    //
+    KeMemoryBarrier();
 
-    return TRUE;
+    XskSignalReadyIoModerated(Xsk, XSK_NOTIFY_FLAG_WAIT_TX);
+
+    XskCheckIoCompletion(Xsk, &Xsk->Tx.CompletionRing, Count, XSK_NOTIFY_FLAG_WAIT_TX);
+
+    XskTxCompleteRundown(Xsk);
 }
 
+//
+// Returns whether written completions must be published now, rather than
+// deferred to amortize updates of the shared producer index.
+//
 static
-_IRQL_requires_max_(PASSIVE_LEVEL)
-_IRQL_requires_same_
-NTSTATUS
-XskIrpCleanup(
-    _Inout_ IRP* Irp,
-    _Inout_ IO_STACK_LOCATION* IrpSp
+FORCEINLINE
+BOOLEAN
+XskTxCompletionPublishDue(
+    _In_ XSK *Xsk,
+    _In_ UINT32 Count
     )
 {
-    XSK *Xsk;
-    KIRQL OldIrql;
-    UINT32 IoWaitFlags;
-
-    UNREFERENCED_PARAMETER(Irp);
+    UINT32 Batch = ReadUInt32NoFence(&Xsk->Tx.CompletionBatch);
+    XSK_SHARED_RING *Ring = Xsk->Tx.CompletionRing.Shared;
 
-    Xsk = IrpSp->FileObject->FsContext;
-    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+    if (Batch <= 1 || Count >= Batch || Count >= Xsk->Tx.CompletionRing.Size / 2) {
+        return TRUE;
+    }
 
     //
-    // Synchronize the polling execution context with socket cleanup: the socket
-    // is protected from cleanup as long as the polling lock is held.
+    // No further completions arrive once every outstanding frame completes, so
+    // deferring would strand them.
     //
-    XskAcquirePollLock(Xsk);
-
-    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
-    Xsk->State = XskClosing;
-    IoWaitFlags = Xsk->IoWaitFlags;
-    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    if (Count == Xsk->Tx.Xdp.OutstandingFrames || Xsk->State != XskActive ||
+        ReadBooleanNoFence(&Xsk->Failover.Migrating)) {
+        return TRUE;
+    }
 
     //
-    // Revert any polling mode state set by this socket.
+    // Don't keep a waiting consumer waiting.
     //
-    NT_VERIFY(XskSetPollMode(Xsk, XSK_POLL_MODE_DEFAULT) == STATUS_SUCCESS);
-
-    XskReleasePollLock(Xsk);
-
-    if (IoWaitFlags != 0) {
-        XskSignalReadyIo(Xsk, IoWaitFlags);
+    if ((ReadUInt32NoFence(&Xsk->IoWaitFlags) & XSK_NOTIFY_FLAG_WAIT_TX) ||
+        ((ReadUInt32NoFence(&Xsk->IoCompletion.Flags) & XSK_NOTIFY_FLAG_WAIT_TX) &&
+            ReadUInt32NoFence(&Ring->ConsumerIndex) == ReadUInt32NoFence(&Ring->ProducerIndex))) {
+        return TRUE;
     }
 
-    TraceInfo(TRACE_XSK, "Xsk=%p Status=%!STATUS!", Xsk, STATUS_SUCCESS);
-
-    TraceExitSuccess(TRACE_XSK);
-
-    return STATUS_SUCCESS;
+    return FALSE;
 }
 
-static
+_IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
-XskFreeRing(
-    XSK_KERNEL_RING *Ring
+XskFlushTxCompletion(
+    _In_ XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *DatapathClientEntry
     )
 {
-    ASSERT(
-        (Ring->Size != 0 && Ring->Mdl != NULL && Ring->Shared != NULL) ||
-        (Ring->Size == 0 && Ring->Mdl == NULL && Ring->Shared == NULL));
-
-    if (Ring->UserVa != NULL) {
-        VOID *CurrentProcess = PsGetCurrentProcess();
-        KAPC_STATE ApcState;
-
-        ASSERT(Ring->OwningProcess != NULL);
+    XSK *Xsk = CONTAINING_RECORD(DatapathClientEntry, XSK, Tx.Xdp.DatapathClientEntry);
+    UINT32 Count = Xsk->Tx.Xdp.DeferredCompletions + Xsk->Tx.Xdp.PendingCompletions;
 
-        if (CurrentProcess != Ring->OwningProcess) {
-            KeStackAttachProcess(Ring->OwningProcess, &ApcState);
-        }
+    Xsk->Tx.Xdp.PendingCompletions = 0;
 
-        ASSERT(Ring->Mdl);
-        MmUnmapLockedPages(Ring->UserVa, Ring->Mdl);
+    if (Count > 0 && !XskTxCompletionPublishDue(Xsk, Count)) {
+        Xsk->Tx.Xdp.DeferredCompletions = Count;
+        return;
+    }
 
-        if (CurrentProcess != Ring->OwningProcess) {
-#pragma prefast(suppress:6001, "ApcState is correctly initialized in KeStackAttachProcess above.")
-            KeUnstackDetachProcess(&ApcState);
-        }
+    Xsk->Tx.Xdp.DeferredCompletions = 0;
 
-        ObDereferenceObject(Ring->OwningProcess);
-        Ring->OwningProcess = NULL;
-    }
-    if (Ring->Mdl != NULL) {
-        IoFreeMdl(Ring->Mdl);
-    }
-    if (Ring->Shared != NULL) {
-        ExFreePoolWithTag(Ring->Shared, POOLTAG_RING);
+    if (Count > 0) {
+        XskPublishTxCompletion(Xsk, Count);
     }
 }
 
-static
 NTSTATUS
-XskSetupDma(
-    _In_ XSK *Xsk
-    )
+XskReferenceDatapathHandle(
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _In_ const VOID *HandleBuffer,
+    _In_ BOOLEAN HandleBounced,
+    _Out_ HANDLE *XskHandle
+    )
 {
     NTSTATUS Status;
-    DEVICE_DESCRIPTION DeviceDescription = {0};
-    ULONG NumberOfMapRegisters = 0;
-    UMEM_MAPPING *Mapping;
-    const XDP_DMA_CAPABILITIES *DmaCapabilities =
-        XdpTxQueueGetDmaCapabilities(Xsk->Tx.Xdp.Queue);
-    const DMA_OPERATIONS *DmaOperations;
-
-    ASSERT(DmaCapabilities->PhysicalDeviceObject != NULL);
-
-    DeviceDescription.Version = DEVICE_DESCRIPTION_VERSION3;
-    DeviceDescription.Master = TRUE;
-    DeviceDescription.ScatterGather = TRUE;
-    DeviceDescription.InterfaceType = InterfaceTypeUndefined;
-    DeviceDescription.MaximumLength = ((ULONG)(1 << 17)); // 128 KB
-    DeviceDescription.DmaAddressWidth = 64;
-
-    Xsk->Tx.DmaAdapter =
-        IoGetDmaAdapter(
-            DmaCapabilities->PhysicalDeviceObject, &DeviceDescription, &NumberOfMapRegisters);
-    if (Xsk->Tx.DmaAdapter == NULL) {
-        TraceError(TRACE_XSK, "Xsk=%p Failed to get DMA adapter", Xsk);
-        return STATUS_NO_MEMORY;
-    }
-
-    DmaOperations = (DMA_OPERATIONS*)Xsk->Tx.DmaAdapter->DmaOperations;
+    FILE_OBJECT *FileObject = NULL;
+    HANDLE TargetHandle;
+    XSK *Xsk = NULL;
 
-    //
-    // Try to map the UMEM directly to hardware if policy allows and the DMA
-    // adapter supports it.
-    //
-    if (!XskRequiresTxBounceBuffer(Xsk) &&
-        RTL_CONTAINS_FIELD(DmaOperations, DmaOperations->Size, CreateCommonBufferFromMdl)) {
-        Mapping = &Xsk->Umem->Mapping;
-        Status =
-            DmaOperations->CreateCommonBufferFromMdl(
-                Xsk->Tx.DmaAdapter, Mapping->Mdl, NULL, 0, &Mapping->DmaAddress);
-        if (Status == STATUS_SUCCESS) {
-            TraceInfo(TRACE_XSK, "Xsk=%p Successfully created common buffer", Xsk);
-            return STATUS_SUCCESS;
+    if (RequestorMode != KernelMode && !HandleBounced) {
+        __try {
+            ProbeForRead((VOID *)HandleBuffer, sizeof(HANDLE), PROBE_ALIGNMENT(HANDLE));
+            TargetHandle = ReadHandleNoFence((volatile const HANDLE *)HandleBuffer);
+        } __except (EXCEPTION_EXECUTE_HANDLER) {
+            Status = GetExceptionCode();
+            goto Exit;
         }
+    } else {
+        TargetHandle = *(HANDLE *)HandleBuffer;
     }
 
-    //
-    // Fall-back to allocating a bounce buffer that can be mapped to hardware.
-    //
-    Mapping = &Xsk->Tx.Bounce.Mapping;
-    Mapping->SystemAddress =
-        DmaOperations->AllocateCommonBuffer(
-            Xsk->Tx.DmaAdapter, (ULONG)Xsk->Umem->Reg.TotalSize, &Mapping->DmaAddress, TRUE);
-    if (Mapping->SystemAddress == NULL) {
-        TraceWarn(TRACE_XSK, "Xsk=%p Failed to allocate common buffer", Xsk);
-        return STATUS_NO_MEMORY;
+    Status =
+        XdpReferenceObjectByHandle(
+            TargetHandle, XDP_OBJECT_TYPE_XSK, RequestorMode, FILE_GENERIC_WRITE, &FileObject);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
     }
-    Xsk->Tx.Bounce.AllocationSource = AllocatedByDma;
-
-    TraceInfo(TRACE_XSK, "Xsk=%p Successfully allocated common buffer", Xsk);
 
-    return STATUS_SUCCESS;
-}
+    Xsk = FileObject->FsContext;
+    XskReference(Xsk);
+    *XskHandle = (HANDLE)Xsk;
+    Status = STATUS_SUCCESS;
 
-static
-VOID
-XskCleanupDma(
-    XSK *Xsk
-    )
-{
-    if (Xsk->Umem != NULL) {
-        UMEM_MAPPING *Mapping = XskGetTxMapping(Xsk);
+Exit:
 
-        if (Mapping->DmaAddress.QuadPart != 0) {
-            Xsk->Tx.DmaAdapter->DmaOperations->FreeCommonBuffer(
-                Xsk->Tx.DmaAdapter,
-                Mapping->Mdl->ByteCount,
-                Mapping->DmaAddress,
-                Mapping->SystemAddress,
-                TRUE);
-            Mapping->DmaAddress.QuadPart = 0;
+    TraceInfo(TRACE_XSK, "Xsk=%p Status=%!STATUS!", Xsk, Status);
 
-            if (Xsk->Tx.Bounce.AllocationSource == AllocatedByDma) {
-                ASSERT(&Xsk->Tx.Bounce.Mapping == Mapping);
-                Mapping->SystemAddress = NULL;
-                Xsk->Tx.Bounce.AllocationSource = NotAllocated;
-            }
-        }
+    if (FileObject != NULL) {
+        ObDereferenceObject(FileObject);
     }
 
-    if (Xsk->Tx.DmaAdapter != NULL) {
-        Xsk->Tx.DmaAdapter->DmaOperations->PutDmaAdapter(Xsk->Tx.DmaAdapter);
-        Xsk->Tx.DmaAdapter = NULL;
-    }
+    return Status;
 }
 
-static
-_IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
-XskRxSyncDetach(
-    _In_opt_ VOID *Context
+XskDereferenceDatapathHandle(
+    _In_ HANDLE XskHandle
     )
 {
-    XSK *Xsk = Context;
-    ASSERT(Xsk);
-    Xsk->Rx.Xdp.Flags.DatapathAttached = FALSE;
+    XSK *Xsk = XskHandle;
+
+    TraceInfo(TRACE_XSK, "Xsk=%p", Xsk);
+
+    XskDereference(Xsk);
 }
 
 static
-VOID
-XskDetachRxIf(
-    _In_ XSK *Xsk
+NTSTATUS
+XskAllocateStatisticsPage(
+    _Inout_ XSK *Xsk
     )
 {
-    KIRQL OldIrql;
+    XSK_STATISTICS_PAGE *Page;
+    UINT32 ProcessorOffset;
+    UINT32 Size;
+    NTSTATUS Status;
 
-    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+    ProcessorOffset = ALIGN_UP_BY(sizeof(*Page), SYSTEM_CACHE_ALIGNMENT_SIZE);
 
-    if (Xsk->Rx.Xdp.Queue != NULL) {
-        if (Xsk->Rx.Xdp.Flags.NotificationsRegistered) {
-            XdpRxQueueSync(Xsk->Rx.Xdp.Queue, XskRxSyncDetach, Xsk);
-            XdpRxQueueDeregisterNotifications(Xsk->Rx.Xdp.Queue, &Xsk->Rx.Xdp.QueueNotificationEntry);
-            Xsk->Rx.Xdp.Flags.NotificationsRegistered = FALSE;
-        }
+    Status = RtlUInt32Mult(sizeof(*Xsk->ProcessorStatistics), Xsk->ProcessorCount, &Size);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
 
-        XskNotifyDetachRxQueue(Xsk);
-        XskNotifyDetachRxQueueComplete(Xsk);
-        XdpRxQueueDereference(Xsk->Rx.Xdp.Queue);
-        Xsk->Rx.Xdp.Queue = NULL;
+    Status = RtlUInt32Add(Size, ProcessorOffset, &Size);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
     }
 
-    if (Xsk->Rx.Xdp.IfHandle != NULL) {
-        XdpIfDereferenceBinding(Xsk->Rx.Xdp.IfHandle);
+    //
+    // Pool allocations of whole pages are page aligned, and pages mapped into
+    // user space must not be shared with other allocations.
+    //
+    Size = ALIGN_UP_BY(Size, PAGE_SIZE);
 
-        //
-        // Synchronize with non-binding-workers while clearing the interface
-        // handle.
-        //
-        KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
-        Xsk->Rx.Xdp.IfHandle = NULL;
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    Page = ExAllocatePoolZero(NonPagedPoolNx, Size, POOLTAG_STATS);
+    if (Page == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Exit;
     }
 
-    if (Xsk->State >= XskActive) {
-        XskKernelRingSetError(&Xsk->Rx.Ring, XSK_ERROR_INTERFACE_DETACH);
-        XskKernelRingSetError(&Xsk->Rx.FillRing, XSK_ERROR_INTERFACE_DETACH);
-    }
+    Page->Header.Revision = XSK_STATISTICS_PAGE_REVISION_1;
+    Page->Header.Size = XSK_SIZEOF_STATISTICS_PAGE_REVISION_1;
+    Page->ProcessorCount = Xsk->ProcessorCount;
+    Page->ProcessorOffset = ProcessorOffset;
+    Page->ProcessorStride = sizeof(*Xsk->ProcessorStatistics);
 
-    TraceExitSuccess(TRACE_XSK);
+    Xsk->StatisticsPage.Page = Page;
+    Xsk->StatisticsPage.Size = Size;
+    Xsk->Statistics = &Page->Statistics;
+    Xsk->ProcessorStatistics =
+        (XSK_PROCESSOR_STATISTICS *)RTL_PTR_ADD(Page, ProcessorOffset);
+
+Exit:
+
+    return Status;
 }
 
+//
+// Unmaps a user mapping of an MDL from the given process and releases the
+// mapping's process reference.
+//
 static
 VOID
-XskDeactivateTxIf(
-    _In_ XSK *Xsk
+XskUnmapFromProcess(
+    _In_ VOID *UserVa,
+    _In_ MDL *Mdl,
+    _In_ VOID *OwningProcess
     )
 {
-    if (Xsk->Tx.Xdp.Flags.QueueActive) {
-        //
-        // Wait for all outstanding TX frames to complete. We need to
-        // synchronize with the data path: if there are frames outstanding,
-        // then the OutstandingFlushComplete event will be set as part of
-        // the regular data path. If no frames are outstanding, to ensure
-        // the OutstandingFrames count is compared to zero within the data
-        // path's execution context, an extra callback is required.
-        //
-        ASSERT(Xsk->State > XskActive);
-        XdpTxQueueSync(Xsk->Tx.Xdp.Queue, XskTxCompleteRundown, Xsk);
-        KeWaitForSingleObject(
-            &Xsk->Tx.Xdp.OutstandingFlushComplete, Executive, KernelMode, FALSE, NULL);
-        ASSERT(Xsk->Tx.Xdp.OutstandingFrames == 0);
+    VOID *CurrentProcess = PsGetCurrentProcess();
+    KAPC_STATE ApcState;
 
-        RtlAcquirePushLockExclusive(&Xsk->PollLock);
-        Xsk->Tx.Xdp.Flags.QueueActive = FALSE;
-        RtlReleasePushLockExclusive(&Xsk->PollLock);
+    if (CurrentProcess != OwningProcess) {
+        KeStackAttachProcess(OwningProcess, &ApcState);
     }
 
-    if (Xsk->Tx.Xdp.Flags.QueueInserted) {
-        XdpTxQueueRemoveDatapathClient(Xsk->Tx.Xdp.Queue, &Xsk->Tx.Xdp.DatapathClientEntry);
-        Xsk->Tx.Xdp.Flags.QueueInserted = FALSE;
+    MmUnmapLockedPages(UserVa, Mdl);
+
+    if (CurrentProcess != OwningProcess) {
+#pragma prefast(suppress:6001, "ApcState is correctly initialized in KeStackAttachProcess above.")
+        KeUnstackDetachProcess(&ApcState);
     }
 
-    XskCleanupDma(Xsk);
-    XskFreeBounceBuffer(&Xsk->Tx.Bounce);
+    ObDereferenceObject(OwningProcess);
 }
 
+//
+// Maps nonpaged socket memory into the requestor's process the first time it
+// is requested, and returns the address of the mapping. Later requests from the
+// same process return the existing mapping, and requests from other processes
+// fail. Kernel mode requestors access the memory via its system address. If
+// SourceMdl is provided, it describes the memory; otherwise, the memory is
+// allocated from nonpaged pool.
+//
 static
-VOID
-XskDetachTxIf(
-    _In_ XSK *Xsk
+NTSTATUS
+XskMapUserMapping(
+    _In_ XSK *Xsk,
+    _Inout_ XSK_USER_MAPPING *Mapping,
+    _In_ VOID *SystemAddress,
+    _In_ UINT32 Size,
+    _In_opt_ MDL *SourceMdl,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Out_ VOID **Address
     )
 {
-    KIRQL OldIrql;
+    NTSTATUS Status;
+    KIRQL OldIrql = {0};
+    BOOLEAN IsLockHeld = FALSE;
+    MDL *Mdl = NULL;
+    VOID *UserVa = NULL;
 
-    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+    *Address = NULL;
 
-    if (Xsk->Tx.Xdp.Queue != NULL) {
-        XskDeactivateTxIf(Xsk);
-        XdpTxQueueDeregisterNotifications(Xsk->Tx.Xdp.Queue, &Xsk->Tx.Xdp.QueueNotificationEntry);
-        XdpTxQueueDereference(Xsk->Tx.Xdp.Queue);
-        Xsk->Tx.Xdp.Queue = NULL;
-    }
+    if (RequestorMode != KernelMode && ReadPointerNoFence((VOID **)&Mapping->Mdl) == NULL) {
+        VOID *MdlAddress =
+            (SourceMdl != NULL) ? MmGetMdlVirtualAddress(SourceMdl) : SystemAddress;
 
-    if (Xsk->Tx.Xdp.IfHandle != NULL) {
-        XdpIfDereferenceBinding(Xsk->Tx.Xdp.IfHandle);
+        Mdl =
+            IoAllocateMdl(
+                MdlAddress,
+                Size,
+                FALSE, // SecondaryBuffer
+                FALSE, // ChargeQuota
+                NULL); // Irp
+        if (Mdl == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
 
-        //
-        // Synchronize with non-binding-workers while clearing the interface
-        // handle.
-        //
-        KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
-        Xsk->Tx.Xdp.IfHandle = NULL;
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
-    }
+        if (SourceMdl != NULL) {
+            IoBuildPartialMdl(SourceMdl, Mdl, MdlAddress, Size);
+        } else {
+            MmBuildMdlForNonPagedPool(Mdl);
+        }
 
-    if (Xsk->State >= XskActive) {
-        XskKernelRingSetError(&Xsk->Tx.Ring, XSK_ERROR_INTERFACE_DETACH);
-        XskKernelRingSetError(&Xsk->Tx.CompletionRing, XSK_ERROR_INTERFACE_DETACH);
+        __try {
+            UserVa =
+                MmMapLockedPagesSpecifyCache(
+                    Mdl,
+                    RequestorMode,
+                    MmCached,
+                    NULL, // RequestedAddress
+                    FALSE,// BugCheckOnFailure
+                    NormalPagePriority | MdlMappingNoExecute);
+            if (UserVa == NULL) {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                goto Exit;
+            }
+        } __except (EXCEPTION_EXECUTE_HANDLER) {
+            Status = GetExceptionCode();
+            goto Exit;
+        }
     }
 
-    TraceExitSuccess(TRACE_XSK);
-}
-
-VOID
-XskNotifyTxQueue(
-    _In_ XDP_TX_QUEUE_NOTIFICATION_ENTRY *NotificationEntry,
-    _In_ XDP_TX_QUEUE_NOTIFICATION_TYPE NotificationType
-    )
-{
-    XSK *Xsk = CONTAINING_RECORD(NotificationEntry, XSK, Tx.Xdp.QueueNotificationEntry);
-    KIRQL OldIrql;
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    IsLockHeld = TRUE;
 
-    if (NotificationType != XDP_TX_QUEUE_NOTIFICATION_DETACH) {
-        return;
+    if (Xsk->State == XskClosing) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
     }
 
-    //
-    // Set the state to detached, except when socket closure has raced this
-    // detach event.
-    //
-    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
-    if (Xsk->State != XskClosing) {
-        ASSERT(Xsk->State >= XskBinding && Xsk->State <= XskActive);
-        Xsk->State = XskDetached;
+    if (RequestorMode == KernelMode) {
+        *Address = SystemAddress;
+    } else {
+        if (Mapping->Mdl == NULL && UserVa != NULL) {
+            Mapping->Mdl = Mdl;
+            Mapping->UserVa = UserVa;
+            Mapping->OwningProcess = PsGetCurrentProcess();
+            ObReferenceObject(Mapping->OwningProcess);
+            Mdl = NULL;
+            UserVa = NULL;
+        }
+
+        if (Mapping->OwningProcess != PsGetCurrentProcess()) {
+            Status = STATUS_INVALID_DEVICE_STATE;
+            goto Exit;
+        }
+
+        *Address = Mapping->UserVa;
     }
-    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
 
-    //
-    // This detach event is executing in the context of XDP binding work queue
-    // processing on the TX queue, so it is synchronized with other detach
-    // instances that also utilize the XDP binding work queue (detach during
-    // bind failure and detach during socket closure).
-    //
-    XskDetachTxIf(Xsk);
-}
+    Status = STATUS_SUCCESS;
 
-static
-VOID
-XskDetachRxIfWorker(
-    _In_ XDP_BINDING_WORKITEM *Item
-    )
-{
-    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
-    XSK *Xsk = WorkItem->Xsk;
+Exit:
 
-    XskDetachRxIf(Xsk);
+    if (IsLockHeld) {
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    }
+    if (UserVa != NULL) {
+        MmUnmapLockedPages(UserVa, Mdl);
+    }
+    if (Mdl != NULL) {
+        IoFreeMdl(Mdl);
+    }
 
-    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+    return Status;
 }
 
+//
+// Unmaps socket memory from the process it was mapped into. The data path
+// keeps accessing the memory via its system address until it is freed.
+//
 static
 VOID
-XskDetachTxIfWorker(
-    _In_ XDP_BINDING_WORKITEM *Item
+XskUnmapUserMapping(
+    _Inout_ XSK_USER_MAPPING *Mapping
     )
 {
-    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
-    XSK *Xsk = WorkItem->Xsk;
+    if (Mapping->Mdl == NULL) {
+        return;
+    }
 
-    XskDetachTxIf(Xsk);
+    ASSERT(Mapping->UserVa != NULL);
+    ASSERT(Mapping->OwningProcess != NULL);
 
-    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+    XskUnmapFromProcess(Mapping->UserVa, Mapping->Mdl, Mapping->OwningProcess);
+    Mapping->OwningProcess = NULL;
+    Mapping->UserVa = NULL;
+
+    IoFreeMdl(Mapping->Mdl);
+    Mapping->Mdl = NULL;
 }
 
-static
-VOID
-XskBindRxIf(
-    _In_ XDP_BINDING_WORKITEM *Item
+_IRQL_requires_max_(PASSIVE_LEVEL)
+_IRQL_requires_same_
+NTSTATUS
+XskIrpCreateSocket(
+    _Inout_ IRP* Irp,
+    _Inout_ IO_STACK_LOCATION* IrpSp,
+    _In_ UCHAR Disposition,
+    _In_ VOID* InputBuffer,
+    _In_ SIZE_T InputBufferLength
     )
 {
-    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
-    XSK *Xsk = WorkItem->Xsk;
-    NTSTATUS Status;
+    NTSTATUS Status = STATUS_SUCCESS;
+    XSK *Xsk = NULL;
+
+    UNREFERENCED_PARAMETER(Disposition);
+    UNREFERENCED_PARAMETER(InputBuffer);
+    UNREFERENCED_PARAMETER(InputBufferLength);
 
     TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
 
-    ASSERT(Xsk->Rx.Xdp.IfHandle == NULL);
-    Xsk->Rx.Xdp.IfHandle = WorkItem->IfWorkItem.BindingHandle;
+    Xsk = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Xsk), POOLTAG_XSK);
+    if (Xsk == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Exit;
+    }
 
-    Status =
-        XdpRxQueueFindOrCreate(
-            Xsk->Rx.Xdp.IfHandle, &Xsk->Rx.Xdp.HookId, WorkItem->QueueId, &Xsk->Rx.Xdp.Queue);
+    Xsk->Header.ObjectType = XDP_OBJECT_TYPE_XSK;
+    Xsk->Header.Dispatch = &XskFileDispatch;
+    Status = XdpInitializeShardedReferenceCount(&Xsk->ReferenceCount);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+    Xsk->State = XskUnbound;
+    Xsk->Rx.Xdp.HookId.Layer = XDP_HOOK_L2;
+    Xsk->Rx.Xdp.HookId.Direction = XDP_HOOK_RX;
+    Xsk->Rx.Xdp.HookId.SubLayer = XDP_HOOK_INSPECT;
+    Xsk->Tx.Xdp.HookId.Layer = XDP_HOOK_L2;
+    Xsk->Tx.Xdp.HookId.Direction = XDP_HOOK_TX;
+    Xsk->Tx.Xdp.HookId.SubLayer = XDP_HOOK_INJECT;
+    Xsk->Tx.Xdp.DatapathClientEntry.Weight = XSK_TX_WEIGHT_DEFAULT;
+    KeInitializeSpinLock(&Xsk->Lock);
+    KeInitializeEvent(&Xsk->IoWaitEvent, NotificationEvent, TRUE);
+    Xsk->Wake.PriorityIncrement = IO_NETWORK_INCREMENT;
+    Xsk->Wake.RxSignalProcessor = INVALID_PROCESSOR_INDEX;
+    ExInitializeRundownProtection(&Xsk->IoCompletion.Rundown);
+    KeInitializeTimer(&Xsk->NotifyModeration.Timer);
+    KeInitializeDpc(&Xsk->NotifyModeration.Dpc, XskNotifyModerationTimeout, Xsk);
+    KeInitializeEvent(&Xsk->PollRequested, SynchronizationEvent, FALSE);
+    KeInitializeEvent(&Xsk->Tx.Xdp.OutstandingFlushComplete, NotificationEvent, FALSE);
+    InitializeListHead(&Xsk->PcwLink);
+    ExInitializePushLock(&Xsk->Failover.Lock);
+
+    Xsk->ProcessorCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    Status = XskAllocateStatisticsPage(Xsk);
     if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
 
-    Status = STATUS_SUCCESS;
+    //
+    // Memory of user mode sockets is also accounted to the creating process.
+    //
+    if (Irp->RequestorMode != KernelMode) {
+        Status = XskProcessMemoryReference(Xsk);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    IrpSp->FileObject->FsContext = Xsk;
+
+    EventWriteXskCreateSocket(
+        &MICROSOFT_XDP_PROVIDER, Xsk, PsGetCurrentProcessId());
 
 Exit:
 
-    if (!NT_SUCCESS(Status)) {
-        XskDetachRxIf(Xsk);
+    if (!NT_SUCCESS(Status) && Xsk != NULL) {
+        XskDereferenceInitial(Xsk);
+        Xsk = NULL;
     }
 
+    TraceInfo(TRACE_XSK, "Xsk=%p Status=%!STATUS!", Xsk, Status);
     TraceExitStatus(TRACE_XSK);
 
-    WorkItem->CompletionStatus = Status;
-    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+    return Status;
 }
 
 static
+_IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
-XskActivateCommitRxIf(
-    _In_ XDP_BINDING_WORKITEM *Item
+XskPollSocketNotify(
+    _In_ VOID *NotifyContext
     )
 {
-    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
-    XSK *Xsk = WorkItem->Xsk;
-    NTSTATUS Status;
+    XSK *Xsk = NotifyContext;
 
-    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+    //
+    // This routine is invoked by the NDIS polling backchannel when an interface
+    // requests a poll.
+    //
 
-    if (Xsk->Rx.Xdp.IfHandle == NULL) {
-        ASSERT(Xsk->State > XskActive);
-        Status = STATUS_DELETE_PENDING;
-        goto Exit;
-    }
+    KeSetEvent(&Xsk->PollRequested, 0, FALSE);
+}
 
-    XdpRxQueueRegisterNotifications(
-        Xsk->Rx.Xdp.Queue, &Xsk->Rx.Xdp.QueueNotificationEntry, XskNotifyRxQueue);
-    Xsk->Rx.Xdp.Flags.NotificationsRegistered = TRUE;
+static
+BOOLEAN
+XskTryReadPollState(
+    _In_ XSK *Xsk,
+    _Out_ XSK_POLL_PARAMETERS *Parameters
+    )
+{
+    LONG Sequence;
 
-    Status = STATUS_SUCCESS;
+    //
+    // Take a consistent snapshot of the published poll state without the poll
+    // lock. Fails if a transition is in progress or completes concurrently.
+    //
+    Sequence = ReadAcquire(&Xsk->PollSequence);
+    if (Sequence & 1) {
+        return FALSE;
+    }
 
-Exit:
+    Parameters->PollMode = ReadNoFence((LONG *)&Xsk->PollMode);
+    Parameters->Budget = ReadULongNoFence((ULONG *)&Xsk->PollBudget);
+    Parameters->IdleTimeoutMs = ReadULongNoFence((ULONG *)&Xsk->PollBusyIdleTimeoutMs);
 
-    TraceExitStatus(TRACE_XSK);
+    KeMemoryBarrier();
 
-    WorkItem->CompletionStatus = Status;
-    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+    return ReadNoFence(&Xsk->PollSequence) == Sequence;
 }
 
 static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
 VOID
-XskBindTxIf(
-    _In_ XDP_BINDING_WORKITEM *Item
+XskBeginPollTransition(
+    _In_ XSK *Xsk
     )
 {
-    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
-    XSK *Xsk = WorkItem->Xsk;
-    XDP_TX_QUEUE_CONFIG_ACTIVATE Config;
-    const XDP_TX_CAPABILITIES *InterfaceCapabilities;
-    XDP_EXTENSION_INFO ExtensionInfo;
-    NTSTATUS Status;
+    ASSERT((Xsk->PollSequence & 1) == 0);
+    InterlockedIncrement(&Xsk->PollSequence);
+}
 
-    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+VOID
+XskEndPollTransition(
+    _In_ XSK *Xsk
+    )
+{
+    ASSERT((Xsk->PollSequence & 1) != 0);
+    InterlockedIncrement(&Xsk->PollSequence);
+}
 
-    ASSERT(Xsk->Tx.Xdp.IfHandle == NULL);
-    Xsk->Tx.Xdp.IfHandle = WorkItem->IfWorkItem.BindingHandle;
+static
+VOID
+XskAcquirePollLock(
+    _In_ XSK *Xsk
+    )
+{
+    InterlockedIncrement((LONG *)&Xsk->PollWaiters);
 
-    Status =
-        XdpTxQueueFindOrCreate(
-            Xsk->Tx.Xdp.IfHandle, &Xsk->Tx.Xdp.HookId, WorkItem->QueueId, &Xsk->Tx.Xdp.Queue);
-    if (!NT_SUCCESS(Status)) {
-        goto Exit;
+    //
+    // Only a socket polling thread holds the poll lock indefinitely, and the
+    // poll mode cannot change while it does, so skip waking the poller
+    // otherwise. A stale wakeup would cut short the poller's next wait.
+    //
+    if (ReadNoFence((LONG *)&Xsk->PollMode) == XSK_POLL_MODE_SOCKET) {
+        XskPollSocketNotify(Xsk);
     }
 
-    XdpTxQueueRegisterNotifications(
-        Xsk->Tx.Xdp.Queue, &Xsk->Tx.Xdp.QueueNotificationEntry, XskNotifyTxQueue);
-
-    InterfaceCapabilities = XdpTxQueueGetCapabilities(Xsk->Tx.Xdp.Queue);
-    Xsk->Tx.Xdp.MaxBufferLength = InterfaceCapabilities->MaximumBufferSize;
-    Xsk->Tx.Xdp.MaxFrameLength = InterfaceCapabilities->MaximumFrameSize;
+    RtlAcquirePushLockExclusive(&Xsk->PollLock);
+    InterlockedDecrement((LONG *)&Xsk->PollWaiters);
+}
 
-    Config = XdpTxQueueGetConfig(Xsk->Tx.Xdp.Queue);
+static
+VOID
+XskReleasePollLock(
+    _In_ XSK *Xsk
+    )
+{
+    RtlReleasePushLockExclusive(&Xsk->PollLock);
+}
 
-    Xsk->Tx.Xdp.Flags.OutOfOrderCompletion = XdpTxQueueIsOutOfOrderCompletionEnabled(Config);
-    Xsk->Tx.Xdp.Flags.CompletionContext = XdpTxQueueIsTxCompletionContextEnabled(Config);
+static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+VOID
+XskReleasePollModeSocket(
+    _In_ XSK *Xsk
+    )
+{
+    KIRQL OldIrql;
 
-    Xsk->Tx.Xdp.FrameRing = XdpTxQueueGetFrameRing(Config);
+    //
+    // Release control of any NDIS polling backchannels for a socket.
+    //
 
-    if (Xsk->Tx.Xdp.Flags.CompletionContext) {
-        XdpInitializeExtensionInfo(
-            &ExtensionInfo, XDP_TX_FRAME_COMPLETION_CONTEXT_EXTENSION_NAME,
-            XDP_TX_FRAME_COMPLETION_CONTEXT_EXTENSION_VERSION_1,
-            XDP_EXTENSION_TYPE_FRAME);
-        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Tx.Xdp.FrameTxCompletionExtension);
+    if (Xsk->Tx.Xdp.PollHandle != NULL) {
+        if (Xsk->Tx.Xdp.PollHandle != Xsk->Rx.Xdp.PollHandle) {
+            //
+            // If the interface uses the same polling handle for RX and TX, only
+            // one reference was acquired.
+            //
+            XdpPollReleaseExclusive(Xsk->Tx.Xdp.PollHandle);
+            XdpPollDeleteBackchannel(Xsk->Tx.Xdp.PollHandle);
+        }
+        Xsk->Tx.Xdp.PollHandle = NULL;
+        ASSERT(Xsk->Tx.Ring.Shared->Flags & XSK_RING_FLAG_NEED_POKE);
     }
 
-    if (Xsk->Tx.Xdp.Flags.OutOfOrderCompletion) {
-        Xsk->Tx.Xdp.CompletionRing = XdpTxQueueGetCompletionRing(Config);
-
-        if (Xsk->Tx.Xdp.Flags.CompletionContext) {
-            XdpInitializeExtensionInfo(
-                &ExtensionInfo, XDP_TX_FRAME_COMPLETION_CONTEXT_EXTENSION_NAME,
-                XDP_TX_FRAME_COMPLETION_CONTEXT_EXTENSION_VERSION_1,
-                XDP_EXTENSION_TYPE_TX_FRAME_COMPLETION);
-            XdpTxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Tx.Xdp.TxCompletionExtension);
-        }
+    if (Xsk->Rx.Xdp.PollHandle != NULL) {
+        Xsk->Rx.FillRing.Shared->Flags &= ~XSK_RING_FLAG_NEED_POKE;
+        XdpPollReleaseExclusive(Xsk->Rx.Xdp.PollHandle);
+        XdpPollDeleteBackchannel(Xsk->Rx.Xdp.PollHandle);
+        Xsk->Rx.Xdp.PollHandle = NULL;
     }
 
-    Xsk->Tx.Xdp.Flags.VirtualAddressExt = XdpTxQueueIsVirtualAddressEnabled(Config);
-    if (Xsk->Tx.Xdp.Flags.VirtualAddressExt) {
-        XdpInitializeExtensionInfo(
-            &ExtensionInfo, XDP_BUFFER_EXTENSION_VIRTUAL_ADDRESS_NAME,
-            XDP_BUFFER_EXTENSION_VIRTUAL_ADDRESS_VERSION_1, XDP_EXTENSION_TYPE_BUFFER);
-        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Tx.Xdp.VaExtension);
+    //
+    // Reset the IO wait flag for socket polling mode.
+    //
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    Xsk->IoWaitInternalFlags &= ~XSK_IO_WAIT_FLAG_POLL_MODE_SOCKET;
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+}
+
+static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+VOID
+XskExitPollModeSocket(
+    _In_ XSK *Xsk
+    )
+{
+    Xsk->PollMode = XSK_POLL_MODE_DEFAULT;
+    XskReleasePollModeSocket(Xsk);
+}
+
+static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+NTSTATUS
+XskAcquirePollModeSocketRx(
+    _In_ XSK *Xsk
+    )
+{
+    NDIS_HANDLE InterfaceRxPollHandle;
+    NDIS_POLL_BACKCHANNEL *Backchannel = NULL;
+    NTSTATUS Status;
+
+    ASSERT(Xsk->Rx.Xdp.PollHandle == NULL);
+
+    if (Xsk->Rx.Xdp.Queue == NULL) {
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
     }
 
-    Xsk->Tx.Xdp.Flags.LogicalAddressExt = XdpTxQueueIsLogicalAddressEnabled(Config);
-    if (Xsk->Tx.Xdp.Flags.LogicalAddressExt) {
-        XdpInitializeExtensionInfo(
-            &ExtensionInfo, XDP_BUFFER_EXTENSION_LOGICAL_ADDRESS_NAME,
-            XDP_BUFFER_EXTENSION_LOGICAL_ADDRESS_VERSION_1, XDP_EXTENSION_TYPE_BUFFER);
-        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Tx.Xdp.LaExtension);
+    InterfaceRxPollHandle = XdpRxQueueGetInterfacePollHandle(Xsk->Rx.Xdp.Queue);
+    if (InterfaceRxPollHandle == NULL) {
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
     }
 
-    Xsk->Tx.Xdp.Flags.MdlExt = XdpTxQueueIsMdlEnabled(Config);
-    if (Xsk->Tx.Xdp.Flags.MdlExt) {
-        XdpInitializeExtensionInfo(
-            &ExtensionInfo, XDP_BUFFER_EXTENSION_MDL_NAME,
-            XDP_BUFFER_EXTENSION_MDL_VERSION_1, XDP_EXTENSION_TYPE_BUFFER);
-        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Tx.Xdp.MdlExtension);
+    Status = XdpPollCreateBackchannel(InterfaceRxPollHandle, &Backchannel);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = XdpPollAcquireExclusive(Backchannel, XskPollSocketNotify, Xsk);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
     }
 
+    //
+    // Review: handling of multiple sockets sharing a queue.
+    //
+    if ((Xsk->Rx.FillRing.Shared->Flags & XSK_RING_FLAG_NEED_POKE) == 0) {
+        InterlockedIncrement64((LONG64 *)&XskGetProcessorStatistics(Xsk)->RxFillNeedPoke);
+    }
+    Xsk->Rx.FillRing.Shared->Flags |= XSK_RING_FLAG_NEED_POKE;
+
+    Xsk->Rx.Xdp.PollHandle = Backchannel;
     Status = STATUS_SUCCESS;
 
 Exit:
 
     if (!NT_SUCCESS(Status)) {
-        XskDetachTxIf(Xsk);
+        if (Backchannel != NULL) {
+            XdpPollDeleteBackchannel(Backchannel);
+        }
     }
 
-    TraceExitStatus(TRACE_XSK);
-
-    WorkItem->CompletionStatus = Status;
-    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+    return Status;
 }
 
 static
-VOID
-XskActivateTxIf(
-    _In_ XDP_BINDING_WORKITEM *Item
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+NTSTATUS
+XskAcquirePollModeSocketTx(
+    _In_ XSK *Xsk
     )
 {
-    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
-    XSK *Xsk = WorkItem->Xsk;
     NTSTATUS Status;
-
-    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
-
-    ASSERT(Xsk->Tx.Ring.Size > 0);
+    NDIS_HANDLE InterfaceTxPollHandle;
+    NDIS_POLL_BACKCHANNEL *Backchannel = NULL;
 
     if (Xsk->Tx.Xdp.Queue == NULL) {
-        ASSERT(Xsk->State > XskActive);
-        Status = STATUS_DELETE_PENDING;
+        Status = STATUS_NOT_SUPPORTED;
         goto Exit;
     }
 
-    if (Xsk->Tx.Xdp.Flags.LogicalAddressExt) {
-        Status = XskSetupDma(Xsk);
+    InterfaceTxPollHandle = XdpTxQueueGetInterfacePollHandle(Xsk->Tx.Xdp.Queue);
+    if (InterfaceTxPollHandle == NULL) {
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    if (Xsk->Rx.Ring.Size > 0 &&
+        InterfaceTxPollHandle == XdpRxQueueGetInterfacePollHandle(Xsk->Rx.Xdp.Queue)) {
+        //
+        // The interface uses the same polling context for RX and TX, and this
+        // socket has already captured the RX handle. Use that for TX, too.
+        //
+        ASSERT(Xsk->Rx.Xdp.PollHandle != NULL);
+        Xsk->Tx.Xdp.PollHandle = Xsk->Rx.Xdp.PollHandle;
+        Status = STATUS_SUCCESS;
+    } else {
+        Status = XdpPollCreateBackchannel(InterfaceTxPollHandle, &Backchannel);
         if (!NT_SUCCESS(Status)) {
             goto Exit;
         }
-    }
 
-    Status = XskAllocateTxBounceBuffer(Xsk);
-    if (!NT_SUCCESS(Status)) {
-        goto Exit;
+        Status = XdpPollAcquireExclusive(Backchannel, XskPollSocketNotify, Xsk);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        Xsk->Tx.Xdp.PollHandle = Backchannel;
+        Status = STATUS_SUCCESS;
     }
 
-    Status =
-        XdpTxQueueAddDatapathClient(
-            Xsk->Tx.Xdp.Queue, &Xsk->Tx.Xdp.DatapathClientEntry,
-            XDP_TX_QUEUE_DATAPATH_CLIENT_TYPE_XSK);
-    if (!NT_SUCCESS(Status)) {
-        goto Exit;
+    if ((Xsk->Tx.Ring.Shared->Flags & XSK_RING_FLAG_NEED_POKE) == 0) {
+        InterlockedIncrement64((LONG64 *)&XskGetProcessorStatistics(Xsk)->TxNeedPoke);
     }
-
-    Xsk->Tx.Xdp.Flags.QueueInserted = TRUE;
-
-    Status = STATUS_SUCCESS;
+    Xsk->Tx.Ring.Shared->Flags |= XSK_RING_FLAG_NEED_POKE;
 
 Exit:
 
     if (!NT_SUCCESS(Status)) {
-        XskDeactivateTxIf(Xsk);
+        if (Backchannel != NULL) {
+            XdpPollDeleteBackchannel(Backchannel);
+        }
     }
 
-    TraceExitStatus(TRACE_XSK);
-
-    WorkItem->CompletionStatus = Status;
-    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+    return Status;
 }
 
 static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
 VOID
-XskActivateCommitTxIf(
-    _In_ XDP_BINDING_WORKITEM *Item
+XskAcquirePollModeSocket(
+    _In_ XSK *Xsk
     )
 {
-    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
-    XSK *Xsk = WorkItem->Xsk;
     NTSTATUS Status;
+    KIRQL OldIrql;
+    UINT32 NotifyFlags = 0;
 
-    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
-
-    ASSERT(Xsk->Tx.Ring.Size > 0);
+    if (Xsk->Rx.Ring.Size > 0 && Xsk->Rx.Xdp.PollHandle == NULL) {
+        Status = XskAcquirePollModeSocketRx(Xsk);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        NotifyFlags |= XSK_NOTIFY_FLAG_WAIT_RX;
+    }
 
-    if (Xsk->Tx.Xdp.Queue == NULL) {
-        ASSERT(Xsk->State > XskActive);
-        Status = STATUS_DELETE_PENDING;
-        goto Exit;
+    if (Xsk->Tx.Ring.Size > 0 && Xsk->Tx.Xdp.PollHandle == NULL) {
+        Status = XskAcquirePollModeSocketTx(Xsk);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        NotifyFlags |= XSK_NOTIFY_FLAG_WAIT_TX;
     }
 
-    RtlAcquirePushLockExclusive(&Xsk->PollLock);
-    Xsk->Tx.Xdp.Flags.QueueActive = TRUE;
-    RtlReleasePushLockExclusive(&Xsk->PollLock);
+    //
+    // Invalidate the internal notification state and cancel any outstanding
+    // wait on the socket. We must ensure the data path thread makes forward
+    // progress if poll modes are modified on another thread.
+    //
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    Xsk->IoWaitInternalFlags |= XSK_IO_WAIT_FLAG_POLL_MODE_SOCKET;
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    XskSignalReadyIo(Xsk, NotifyFlags);
 
     Status = STATUS_SUCCESS;
 
 Exit:
 
-    TraceExitStatus(TRACE_XSK);
-
-    WorkItem->CompletionStatus = Status;
-    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+    if (!NT_SUCCESS(Status)) {
+        XskReleasePollModeSocket(Xsk);
+    }
 }
 
 static
-VOID
-XskReferenceUmem(
-    UMEM *Umem
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+NTSTATUS
+XskEnterPollModeSocket(
+    _In_ XSK *Xsk
     )
 {
-    XdpIncrementReferenceCount(&Umem->ReferenceCount);
+    Xsk->PollMode = XSK_POLL_MODE_SOCKET;
+
+    //
+    // Polling mode is merely a hint to AF_XDP, so it's fine to silently fail if
+    // socket polling is not available. The XSK might be attached to an RX queue
+    // via XskNotifyAttachRxQueue whenever a new RX program is attached, so try
+    // again then.
+    //
+    XskAcquirePollModeSocket(Xsk);
+
+    return STATUS_SUCCESS;
 }
 
 static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
 VOID
-XskDereferenceUmem(
-    UMEM *Umem
+XskExitPollModeInline(
+    _In_ XSK *Xsk
     )
 {
-    if (XdpDecrementReferenceCount(&Umem->ReferenceCount)) {
-        TraceInfo(TRACE_XSK, "Destroying Umem=%p", Umem);
+    Xsk->PollMode = XSK_POLL_MODE_DEFAULT;
 
-        if (Umem->Mapping.Mdl != NULL) {
-            if (Umem->ReservedMapping != NULL) {
-                if (Umem->Mapping.SystemAddress != NULL) {
-                    MmUnmapReservedMapping(Umem->ReservedMapping, POOLTAG_UMEM, Umem->Mapping.Mdl);
-                }
-                MmFreeMappingAddress(Umem->ReservedMapping, POOLTAG_UMEM);
-            }
-            if (Umem->Mapping.Mdl->MdlFlags & MDL_PAGES_LOCKED) {
-                MmUnlockPages(Umem->Mapping.Mdl);
-            }
-            IoFreeMdl(Umem->Mapping.Mdl);
-        }
-        ExFreePoolWithTag(Umem, POOLTAG_UMEM);
+    if (Xsk->Tx.Xdp.PollHandle != NULL) {
+        XdpPollDeleteBackchannel(Xsk->Tx.Xdp.PollHandle);
+        Xsk->Tx.Xdp.PollHandle = NULL;
     }
 }
 
 static
-_IRQL_requires_max_(PASSIVE_LEVEL)
-_IRQL_requires_same_
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
 NTSTATUS
-XskIrpClose(
-    _Inout_ IRP* Irp,
-    _Inout_ IO_STACK_LOCATION* IrpSp
+XskEnterPollModeInline(
+    _In_ XSK *Xsk
     )
 {
-    XSK *Xsk = IrpSp->FileObject->FsContext;
-    KIRQL OldIrql;
+    NDIS_HANDLE InterfaceTxPollHandle;
+    NDIS_POLL_BACKCHANNEL *Backchannel;
 
-    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
-    EventWriteXskCloseSocketStart(&MICROSOFT_XDP_PROVIDER, Xsk);
+    Xsk->PollMode = XSK_POLL_MODE_INLINE;
 
-    UNREFERENCED_PARAMETER(Irp);
+    //
+    // Polling mode is merely a hint to AF_XDP, so TX pokes silently fall back
+    // to notifying the interface if its TX queue cannot be polled. Unlike the
+    // other polling modes, the socket neither owns nor keeps busy the poll
+    // context; it only borrows the poll context while the interface is idle.
+    //
+    if (Xsk->Tx.Ring.Size == 0 || Xsk->Tx.Xdp.Queue == NULL) {
+        return STATUS_SUCCESS;
+    }
 
-    ASSERT(Xsk->State == XskClosing);
+    InterfaceTxPollHandle = XdpTxQueueGetInterfacePollHandle(Xsk->Tx.Xdp.Queue);
+    if (InterfaceTxPollHandle != NULL &&
+        NT_SUCCESS(XdpPollCreateBackchannel(InterfaceTxPollHandle, &Backchannel))) {
+        Xsk->Tx.Xdp.PollHandle = Backchannel;
+    }
 
-    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
-
-    if (Xsk->Tx.Xdp.IfHandle != NULL) {
-        XSK_BINDING_WORKITEM WorkItem = {0};
-
-        KeInitializeEvent(&WorkItem.CompletionEvent, NotificationEvent, FALSE);
-        WorkItem.Xsk = Xsk;
-        WorkItem.IfWorkItem.BindingHandle = Xsk->Tx.Xdp.IfHandle;
-        WorkItem.IfWorkItem.WorkRoutine = XskDetachTxIfWorker;
-        XdpIfQueueWorkItem(&WorkItem.IfWorkItem);
-
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    return STATUS_SUCCESS;
+}
 
-        KeWaitForSingleObject(
-            &WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
-        ASSERT(Xsk->Tx.Xdp.IfHandle == NULL);
+static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+BOOLEAN
+XskPollInlineTx(
+    _In_ XSK *Xsk
+    )
+{
+    NDIS_POLL_BACKCHANNEL_INVOKE_DATA InvokeData = {0};
+    UINT32 Budget = (Xsk->PollBudget > 0) ? Xsk->PollBudget : XSK_POLL_DEFAULT_BUDGET;
 
-        KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    //
+    // Transmit on this thread if the interface's poll context is idle, saving
+    // the scheduling hop to the interface's execution context. Since only a
+    // poll that transmitted frames is known to have flushed the TX queue, fall
+    // back to notifying the interface otherwise.
+    //
+    InvokeData.TxQuota = XskRingConsPeek(&Xsk->Tx.Ring, Budget);
+    InvokeData.TxQuota = XskRingProdReserve(&Xsk->Tx.CompletionRing, InvokeData.TxQuota);
+    if (InvokeData.TxQuota == 0) {
+        return FALSE;
     }
 
-    if (Xsk->Rx.Xdp.IfHandle != NULL) {
-        XSK_BINDING_WORKITEM WorkItem = {0};
-
-        KeInitializeEvent(&WorkItem.CompletionEvent, NotificationEvent, FALSE);
-        WorkItem.Xsk = Xsk;
-        WorkItem.IfWorkItem.BindingHandle = Xsk->Rx.Xdp.IfHandle;
-        WorkItem.IfWorkItem.WorkRoutine = XskDetachRxIfWorker;
-        XdpIfQueueWorkItem(&WorkItem.IfWorkItem);
+    return XdpPollTryInvoke(Xsk->Tx.Xdp.PollHandle, &InvokeData) && InvokeData.TxCompleted > 0;
+}
 
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+VOID
+XskReleasePollModeBusyTx(
+    _In_ XSK *Xsk
+    )
+{
+    if (Xsk->Tx.Xdp.PollHandle != NULL) {
+        XdpPollReleaseBusyReference(Xsk->Tx.Xdp.PollHandle);
+        XdpPollDeleteBackchannel(Xsk->Tx.Xdp.PollHandle);
+        Xsk->Tx.Xdp.PollHandle = NULL;
 
-        KeWaitForSingleObject(
-            &WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
-        ASSERT(Xsk->Tx.Xdp.IfHandle == NULL);
+        //
+        // Ensure the XSK ring need poke flag is set after releasing the busy
+        // reference.
+        //
+        if (Xsk->Tx.Xdp.Flags.QueueActive) {
+            XDP_NOTIFY_QUEUE_FLAGS NotifyFlags = XDP_NOTIFY_QUEUE_FLAG_TX;
 
-        KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+            XdpTxQueueInvokeInterfaceNotify(Xsk->Tx.Xdp.Queue, NotifyFlags);
+        }
     }
+}
 
-    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+VOID
+XskReleasePollModeBusyRx(
+    _In_ XSK *Xsk
+    )
+{
+    if (Xsk->Rx.Xdp.PollHandle != NULL) {
+        XdpPollReleaseBusyReference(Xsk->Rx.Xdp.PollHandle);
+        XdpPollDeleteBackchannel(Xsk->Rx.Xdp.PollHandle);
+        Xsk->Rx.Xdp.PollHandle = NULL;
 
-    if (Xsk->Umem != NULL) {
-        XskDereferenceUmem(Xsk->Umem);
+        ASSERT((Xsk->Rx.FillRing.Shared->Flags & XSK_RING_FLAG_NEED_POKE) == 0);
     }
+}
 
-    XskFreeRing(&Xsk->Rx.Ring);
-    XskFreeRing(&Xsk->Rx.FillRing);
-    XskFreeRing(&Xsk->Tx.Ring);
-    XskFreeRing(&Xsk->Tx.CompletionRing);
-
-    XskDereference(Xsk);
+static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+VOID
+XskExitPollModeBusy(
+    _In_ XSK *Xsk
+    )
+{
+    Xsk->PollMode = XSK_POLL_MODE_DEFAULT;
 
-    EventWriteXskCloseSocketStop(&MICROSOFT_XDP_PROVIDER, Xsk);
-    TraceInfo(TRACE_XSK, "Xsk=%p Status=%!STATUS!", Xsk, STATUS_SUCCESS);
-    TraceExitSuccess(TRACE_XSK);
+    if (Xsk->PollBusyIdleTimer != NULL) {
+        (VOID)XdpTimerCancel(Xsk->PollBusyIdleTimer);
+    }
 
-    return STATUS_SUCCESS;
+    Xsk->PollBusyIdle = FALSE;
+    XskReleasePollModeBusyTx(Xsk);
+    XskReleasePollModeBusyRx(Xsk);
 }
 
 static
-NTSTATUS
-XskIrpBindSocket(
-    _In_ IRP *Irp,
-    _In_ IO_STACK_LOCATION *IrpSp
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+VOID
+XskAcquirePollModeBusyRx(
+    _In_ XSK *Xsk
     )
 {
-    NTSTATUS Status = STATUS_SUCCESS;
-    XSK *Xsk = IrpSp->FileObject->FsContext;
-    XSK_BIND_IN Bind = {0};
-    XSK_BINDING_WORKITEM WorkItem = {0};
-    KIRQL OldIrql;
-    XDP_INTERFACE_MODE *ModeFilter = NULL;
-    XDP_INTERFACE_MODE RequiredMode;
-    BOOLEAN BindIfInitiated = FALSE;
-    const UINT32 ValidFlags = XSK_BIND_FLAG_RX | XSK_BIND_FLAG_TX | XSK_BIND_FLAG_GENERIC | XSK_BIND_FLAG_NATIVE;
+    NDIS_HANDLE InterfaceRxPollHandle;
+    NDIS_POLL_BACKCHANNEL *Backchannel = NULL;
+    NTSTATUS Status;
 
-    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(XSK_BIND_IN)) {
-        Status = STATUS_INVALID_PARAMETER;
+    ASSERT(Xsk->Rx.Xdp.PollHandle == NULL);
+
+    if (Xsk->Rx.Xdp.Queue == NULL) {
+        Status = STATUS_NOT_SUPPORTED;
         goto Exit;
     }
 
-    Bind = *(XSK_BIND_IN*)Irp->AssociatedIrp.SystemBuffer;
-
-    TraceEnter(
-        TRACE_XSK, "Xsk=%p IfIndex=%u QueueId=%u Flags=%x",
-        Xsk, Bind.IfIndex, Bind.QueueId, Bind.Flags);
+    InterfaceRxPollHandle = XdpRxQueueGetInterfacePollHandle(Xsk->Rx.Xdp.Queue);
+    if (InterfaceRxPollHandle == NULL) {
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
 
-    if ((Bind.Flags & ~ValidFlags) ||
-        !RTL_IS_CLEAR_OR_SINGLE_FLAG(Bind.Flags, XSK_BIND_FLAG_GENERIC | XSK_BIND_FLAG_NATIVE) ||
-        (Bind.Flags & (XSK_BIND_FLAG_RX | XSK_BIND_FLAG_TX)) == 0) {
-        Status = STATUS_INVALID_PARAMETER;
+    Status = XdpPollCreateBackchannel(InterfaceRxPollHandle, &Backchannel);
+    if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
 
-    if (Bind.Flags & XSK_BIND_FLAG_GENERIC) {
-        RequiredMode = XDP_INTERFACE_MODE_GENERIC;
-        ModeFilter = &RequiredMode;
+    Status = XdpPollAddBusyReference(Backchannel);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
     }
 
-    if (Bind.Flags & XSK_BIND_FLAG_NATIVE) {
-        RequiredMode = XDP_INTERFACE_MODE_NATIVE;
-        ModeFilter = &RequiredMode;
+    //
+    // Review: handling of multiple sockets sharing a queue.
+    //
+    Xsk->Rx.FillRing.Shared->Flags &= ~XSK_RING_FLAG_NEED_POKE;
+    Xsk->Rx.Xdp.PollHandle = Backchannel;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        if (Backchannel != NULL) {
+            XdpPollDeleteBackchannel(Backchannel);
+        }
     }
+}
 
-    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+VOID
+XskAcquirePollModeBusyTx(
+    _In_ XSK *Xsk
+    )
+{
+    NTSTATUS Status;
+    NDIS_HANDLE InterfaceTxPollHandle;
+    NDIS_POLL_BACKCHANNEL *Backchannel = NULL;
 
-    if (Xsk->State != XskUnbound) {
-        Status = STATUS_INVALID_DEVICE_STATE;
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    if (Xsk->Tx.Xdp.Queue == NULL) {
+        Status = STATUS_NOT_SUPPORTED;
         goto Exit;
     }
 
-    Xsk->State = XskBinding;
-    BindIfInitiated = TRUE;
+    InterfaceTxPollHandle = XdpTxQueueGetInterfacePollHandle(Xsk->Tx.Xdp.Queue);
+    if (InterfaceTxPollHandle == NULL) {
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
 
-    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    Status = XdpPollCreateBackchannel(InterfaceTxPollHandle, &Backchannel);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
 
-    KeInitializeEvent(&WorkItem.CompletionEvent, SynchronizationEvent, FALSE);
+    Status = XdpPollAddBusyReference(Backchannel);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
 
-    if (Bind.Flags & XSK_BIND_FLAG_RX) {
-        WorkItem.Xsk = Xsk;
-        WorkItem.QueueId = Bind.QueueId;
-        WorkItem.IfWorkItem.WorkRoutine = XskBindRxIf;
-        WorkItem.IfWorkItem.BindingHandle =
-            XdpIfFindAndReferenceBinding(Bind.IfIndex, &Xsk->Rx.Xdp.HookId, 1, ModeFilter);
-        if (WorkItem.IfWorkItem.BindingHandle == NULL) {
-            Status = STATUS_NOT_FOUND;
-            goto Exit;
-        }
+    Xsk->Tx.Ring.Shared->Flags &= ~XSK_RING_FLAG_NEED_POKE;
+    Xsk->Tx.Xdp.PollHandle = Backchannel;
+    Status = STATUS_SUCCESS;
 
-        XdpIfQueueWorkItem(&WorkItem.IfWorkItem);
+Exit:
 
-        KeWaitForSingleObject(&WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
-        Status = WorkItem.CompletionStatus;
-        if (!NT_SUCCESS(Status)) {
-            goto Exit;
+    if (!NT_SUCCESS(Status)) {
+        if (Backchannel != NULL) {
+            XdpPollDeleteBackchannel(Backchannel);
         }
     }
+}
 
-    if (Bind.Flags & XSK_BIND_FLAG_TX) {
-        WorkItem.Xsk = Xsk;
-        WorkItem.QueueId = Bind.QueueId;
-        WorkItem.IfWorkItem.WorkRoutine = XskBindTxIf;
-        WorkItem.IfWorkItem.BindingHandle =
-            XdpIfFindAndReferenceBinding(Bind.IfIndex, &Xsk->Tx.Xdp.HookId, 1, ModeFilter);
-        if (WorkItem.IfWorkItem.BindingHandle == NULL) {
-            Status = STATUS_NOT_FOUND;
-            goto Exit;
-        }
+static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+VOID
+XskAcquirePollModeBusy(
+    _In_ XSK *Xsk
+    )
+{
+    if (Xsk->Rx.Ring.Size > 0 && Xsk->Rx.Xdp.PollHandle == NULL) {
+        XskAcquirePollModeBusyRx(Xsk);
 
-        XdpIfQueueWorkItem(&WorkItem.IfWorkItem);
+    }
 
-        KeWaitForSingleObject(&WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
-        Status = WorkItem.CompletionStatus;
-        if (!NT_SUCCESS(Status)) {
-            goto Exit;
-        }
+    if (Xsk->Tx.Ring.Size > 0 && Xsk->Tx.Xdp.PollHandle == NULL) {
+        XskAcquirePollModeBusyTx(Xsk);
     }
+}
 
-Exit:
+static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+VOID
+XskSuspendPollModeBusy(
+    _In_ XSK *Xsk
+    )
+{
+    TraceInfo(TRACE_XSK, "Xsk=%p Suspending idle busy polling", Xsk);
 
-    if (!NT_SUCCESS(Status) && BindIfInitiated) {
-        KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    //
+    // Release the busy references so the interfaces revert to interrupts, but
+    // remain in busy polling mode so polling can be resumed.
+    //
+    Xsk->PollBusyIdle = TRUE;
+    XskReleasePollModeBusyTx(Xsk);
+    XskReleasePollModeBusyRx(Xsk);
+}
 
-        if (Xsk->Tx.Xdp.IfHandle != NULL) {
-            WorkItem.Xsk = Xsk;
-            WorkItem.QueueId = Bind.QueueId;
-            WorkItem.IfWorkItem.WorkRoutine = XskDetachTxIfWorker;
-            WorkItem.IfWorkItem.BindingHandle = Xsk->Tx.Xdp.IfHandle;
-            XdpIfQueueWorkItem(&WorkItem.IfWorkItem);
+static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+VOID
+XskResumePollModeBusy(
+    _In_ XSK *Xsk
+    )
+{
+    TraceInfo(TRACE_XSK, "Xsk=%p Resuming busy polling", Xsk);
 
-            KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    Xsk->PollBusyIdle = FALSE;
+    Xsk->PollBusyActive = TRUE;
+    XskAcquirePollModeBusy(Xsk);
+}
 
-            KeWaitForSingleObject(&WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
-            ASSERT(Xsk->Tx.Xdp.IfHandle == NULL);
+static WORKER_THREAD_ROUTINE XskPollBusyIdleTimeout;
 
-            KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
-        }
+static
+_Use_decl_annotations_
+VOID
+XskPollBusyIdleTimeout(
+    VOID *Context
+    )
+{
+    XSK *Xsk = Context;
+    BOOLEAN Active;
 
-        if (Xsk->Rx.Xdp.IfHandle != NULL) {
-            WorkItem.Xsk = Xsk;
-            WorkItem.QueueId = Bind.QueueId;
-            WorkItem.IfWorkItem.WorkRoutine = XskDetachRxIfWorker;
-            WorkItem.IfWorkItem.BindingHandle = Xsk->Rx.Xdp.IfHandle;
-            XdpIfQueueWorkItem(&WorkItem.IfWorkItem);
-
-            KeReleaseSpinLock(&Xsk->Lock, OldIrql);
-
-            KeWaitForSingleObject(&WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
-            ASSERT(Xsk->Rx.Xdp.IfHandle == NULL);
+    //
+    // The idle timer is shut down during socket cleanup, so the socket remains
+    // valid for the duration of this routine. Busy polling exits by cancelling
+    // the timer, so a stale expiration needs no lock to be discarded.
+    //
+    if (ReadNoFence((LONG *)&Xsk->PollMode) != XSK_POLL_MODE_BUSY) {
+        return;
+    }
 
-            KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
-        }
+    XskAcquirePollLock(Xsk);
 
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    if (Xsk->State != XskActive || Xsk->PollMode != XSK_POLL_MODE_BUSY) {
+        goto Exit;
     }
 
-    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    Active = Xsk->PollBusyActive;
+    Xsk->PollBusyActive = FALSE;
 
-    if (BindIfInitiated) {
+    if (!Xsk->PollBusyIdle && !Active) {
         //
-        // N.B. Current synchronization allows the socket to be closed and state
-        // set to XskClosing while the bind is in progress. This is OK as socket
-        // cleanup will happen after all file object references are released and
-        // we currently are holding a reference to service this IOCTL. Do not
-        // overwrite the state in this case.
+        // No frames were moved for an entire idle interval, so stop spinning
+        // until the socket is poked or traffic resumes.
         //
-        if (Xsk->State == XskBinding) {
-            if (NT_SUCCESS(Status)) {
-                Xsk->State = XskBound;
-            } else {
-                Xsk->State = XskUnbound;
-            }
-        }
+        XskSuspendPollModeBusy(Xsk);
+    } else if (Xsk->PollBusyIdle && Active) {
+        //
+        // Frames arrived via interrupts while suspended.
+        //
+        XskResumePollModeBusy(Xsk);
     }
 
-    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
-
-    TraceInfo(
-        TRACE_XSK, "Xsk=%p IfIndex=%u QueueId=%u Flags=%x Status=%!STATUS!",
-        Xsk, Bind.IfIndex, Bind.QueueId, Bind.Flags, Status);
+    (VOID)XdpTimerStart(Xsk->PollBusyIdleTimer, Xsk->PollBusyIdleTimeoutMs, NULL);
 
-    TraceExitStatus(TRACE_XSK);
+Exit:
 
-    return Status;
+    XskReleasePollLock(Xsk);
 }
 
 static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
 NTSTATUS
-XskIrpActivateSocket(
-    _In_ IRP *Irp,
-    _In_ IO_STACK_LOCATION *IrpSp
+XskEnterPollModeBusy(
+    _In_ XSK *Xsk
     )
 {
-    NTSTATUS Status = STATUS_SUCCESS;
-    XSK *Xsk = IrpSp->FileObject->FsContext;
-    XSK_ACTIVATE_IN Activate = {0};
-    XSK_BINDING_WORKITEM RxWorkItem = {0}, TxWorkItem = {0};
-    KIRQL OldIrql;
-    BOOLEAN ActivateIfInitiated = FALSE;
-    BOOLEAN ActivateIfCommitted = FALSE;
+    NTSTATUS Status;
 
-    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(Activate)) {
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
+    if (Xsk->PollBusyIdleTimeoutMs > 0 && Xsk->PollBusyIdleTimer == NULL) {
+        Xsk->PollBusyIdleTimer =
+            XdpTimerCreate(XskPollBusyIdleTimeout, Xsk, XdpDriverObject, NULL);
+        if (Xsk->PollBusyIdleTimer == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
     }
 
-    Activate = *(XSK_ACTIVATE_IN *)Irp->AssociatedIrp.SystemBuffer;
+    Xsk->PollMode = XSK_POLL_MODE_BUSY;
 
-    TraceEnter(TRACE_XSK, "Xsk=%p Flags=%x", Xsk, Activate.Flags);
+    //
+    // Polling mode is merely a hint to AF_XDP, so it's fine to silently fail if
+    // socket polling is not available. The XSK might be attached to an RX queue
+    // via XskNotifyAttachRxQueue whenever a new RX program is attached, so try
+    // again then.
+    //
+    XskAcquirePollModeBusy(Xsk);
 
-    if (Activate.Flags != 0) {
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
+    if (Xsk->PollBusyIdleTimeoutMs > 0) {
+        //
+        // Grant a full idle interval before the first idle check.
+        //
+        Xsk->PollBusyActive = TRUE;
+        (VOID)XdpTimerStart(Xsk->PollBusyIdleTimer, Xsk->PollBusyIdleTimeoutMs, NULL);
     }
 
-    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    Status = STATUS_SUCCESS;
 
-    if (Xsk->Umem == NULL) {
-        Status = STATUS_INVALID_DEVICE_STATE;
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
-        goto Exit;
-    }
-    if (Xsk->State != XskBound) {
-        Status = STATUS_INVALID_DEVICE_STATE;
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
-        goto Exit;
-    }
-    if (Xsk->Rx.Xdp.Queue != NULL &&
-        (Xsk->Rx.Ring.Size == 0 || Xsk->Rx.FillRing.Size == 0)) {
-        Status = STATUS_INVALID_DEVICE_STATE;
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
-        goto Exit;
-    }
-    if (Xsk->Tx.Xdp.Queue != NULL &&
-        (Xsk->Tx.Ring.Size == 0 || Xsk->Tx.CompletionRing.Size == 0)) {
+Exit:
+
+    return Status;
+}
+
+static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+NTSTATUS
+XskSetPollMode(
+    _In_ XSK *Xsk,
+    _In_ XSK_POLL_MODE PollMode,
+    _In_ UINT32 Budget,
+    _In_ UINT32 IdleTimeoutMs
+    )
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    BOOLEAN InTransition = FALSE;
+
+    if (Xsk->State != XskActive && PollMode != XSK_POLL_MODE_DEFAULT) {
         Status = STATUS_INVALID_DEVICE_STATE;
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
         goto Exit;
     }
 
-    Xsk->State = XskActivating;
-    ActivateIfInitiated = TRUE;
+    XskBeginPollTransition(Xsk);
+    InTransition = TRUE;
 
-    KeInitializeEvent(&RxWorkItem.CompletionEvent, SynchronizationEvent, FALSE);
-    KeInitializeEvent(&TxWorkItem.CompletionEvent, SynchronizationEvent, FALSE);
+    //
+    // Exit the old polling mode and return to the default state.
+    //
+    switch (Xsk->PollMode) {
 
-    if (Xsk->Tx.Xdp.IfHandle != NULL) {
-        TxWorkItem.Xsk = Xsk;
-        TxWorkItem.IfWorkItem.WorkRoutine = XskActivateTxIf;
-        TxWorkItem.IfWorkItem.BindingHandle = Xsk->Tx.Xdp.IfHandle;
+    case XSK_POLL_MODE_DEFAULT:
+        // Nothing to do.
+        break;
 
-        XdpIfQueueWorkItem(&TxWorkItem.IfWorkItem);
+    case XSK_POLL_MODE_BUSY:
+        XskExitPollModeBusy(Xsk);
+        break;
 
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    case XSK_POLL_MODE_SOCKET:
+        XskExitPollModeSocket(Xsk);
+        break;
 
-        KeWaitForSingleObject(&TxWorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
-        Status = TxWorkItem.CompletionStatus;
-        if (!NT_SUCCESS(Status)) {
-            goto Exit;
-        }
+    case XSK_POLL_MODE_INLINE:
+        XskExitPollModeInline(Xsk);
+        break;
 
-        KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    default:
+        ASSERT(FALSE);
     }
 
+    ASSERT(Xsk->PollMode == XSK_POLL_MODE_DEFAULT);
+
+    Xsk->PollBudget = Budget;
+    Xsk->PollBusyIdleTimeoutMs = IdleTimeoutMs;
+
     //
-    // The RX and TX queues have been configured as far as possible without
-    // observably activating the data path. We are now committed to activation
-    // or terminal failure; the XSK can no longer be reverted to XskBound state.
+    // Enter the new polling mode.
     //
+    switch (PollMode) {
 
-    ActivateIfCommitted = TRUE;
+    case XSK_POLL_MODE_DEFAULT:
+        // Nothing to do.
+        break;
 
-    if (Xsk->State != XskActivating) {
-        Status = STATUS_DELETE_PENDING;
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    case XSK_POLL_MODE_BUSY:
+        Status = XskEnterPollModeBusy(Xsk);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
         goto Exit;
-    }
 
-    if (Xsk->Tx.Xdp.IfHandle != NULL) {
-        TxWorkItem.Xsk = Xsk;
-        TxWorkItem.IfWorkItem.WorkRoutine = XskActivateCommitTxIf;
-        TxWorkItem.IfWorkItem.BindingHandle = Xsk->Tx.Xdp.IfHandle;
-
-        XdpIfQueueWorkItem(&TxWorkItem.IfWorkItem);
-    } else {
-        TxWorkItem.CompletionStatus = STATUS_SUCCESS;
-        KeSetEvent(&TxWorkItem.CompletionEvent, 0, FALSE);
-    }
+    case XSK_POLL_MODE_SOCKET:
+        Status = XskEnterPollModeSocket(Xsk);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
 
-    if (Xsk->Rx.Xdp.IfHandle != NULL) {
-        RxWorkItem.Xsk = Xsk;
-        RxWorkItem.IfWorkItem.WorkRoutine = XskActivateCommitRxIf;
-        RxWorkItem.IfWorkItem.BindingHandle = Xsk->Rx.Xdp.IfHandle;
+    case XSK_POLL_MODE_INLINE:
+        Status = XskEnterPollModeInline(Xsk);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
 
-        XdpIfQueueWorkItem(&RxWorkItem.IfWorkItem);
-    } else {
-        RxWorkItem.CompletionStatus = STATUS_SUCCESS;
-        KeSetEvent(&RxWorkItem.CompletionEvent, 0, FALSE);
+    default:
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
     }
 
-    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+Exit:
 
-    KeWaitForSingleObject(&TxWorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
-    if (!NT_SUCCESS(TxWorkItem.CompletionStatus)) {
-        Status = TxWorkItem.CompletionStatus;
+    if (InTransition) {
+        XskEndPollTransition(Xsk);
     }
 
-    KeWaitForSingleObject(&RxWorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
-    if (!NT_SUCCESS(RxWorkItem.CompletionStatus)) {
-        Status = RxWorkItem.CompletionStatus;
-    }
+    return Status;
+}
 
-Exit:
+static
+VOID
+XskNotifyDetachRxQueue(
+    _In_ XSK *Xsk
+    )
+{
+    XskAcquirePollLock(Xsk);
 
-    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    //
+    // The RX poke routine notifies the interface only while backpressure is
+    // enabled, so disable it under the poll lock.
+    //
+    Xsk->Rx.Xdp.Flags.Backpressure = FALSE;
 
     //
-    // Once we committed to XSK activation, any failure to activate implies the
-    // socket is already in a terminal state.
+    // This socket is being unbound from an RX queue, so release all polling
+    // backchannels and deactivate the current polling mode.
     //
-    if (ActivateIfCommitted) {
-        ASSERT(NT_SUCCESS(Status) || Xsk->State > XskActive);
-    }
+    switch (Xsk->PollMode) {
 
-    if (ActivateIfInitiated) {
-        //
-        // N.B. XSK synchronization allows the socket to be closed and state set
-        // to XskClosing while activation is in progress. This is OK as socket
-        // cleanup will happen after all file object references are released and
-        // we currently are holding a reference to service this IOCTL. Do not
-        // overwrite the state in this case.
-        //
+    case XSK_POLL_MODE_BUSY:
+        XskReleasePollModeBusyRx(Xsk);
+        break;
 
-        if (Xsk->State == XskActivating) {
-            if (NT_SUCCESS(Status)) {
-                Xsk->State = XskActive;
-            } else {
-                Xsk->State = XskBound;
-            }
-        }
-    }
+    case XSK_POLL_MODE_SOCKET:
+        XskReleasePollModeSocket(Xsk);
+        break;
 
-    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    }
 
-    TraceInfo(TRACE_XSK, "Xsk=%p Flags=%x Status=%!STATUS!", Xsk, Activate.Flags, Status);
+    XskReleasePollLock(Xsk);
+}
 
-    TraceExitStatus(TRACE_XSK);
-
-    return Status;
+static
+VOID
+XskNotifyDetachRxQueueComplete(
+    _In_ XSK *Xsk
+    )
+{
+    Xsk->Rx.Xdp.FrameRing = NULL;
+    Xsk->Rx.Xdp.FragmentRing = NULL;
+    RtlZeroMemory(&Xsk->Rx.Xdp.VaExtension, sizeof(Xsk->Rx.Xdp.VaExtension));
+    RtlZeroMemory(&Xsk->Rx.Xdp.FragmentExtension, sizeof(Xsk->Rx.Xdp.FragmentExtension));
+    RtlZeroMemory(&Xsk->Rx.Xdp.RxActionExtension, sizeof(Xsk->Rx.Xdp.RxActionExtension));
+    RtlZeroMemory(&Xsk->Rx.Xdp.TimestampExtension, sizeof(Xsk->Rx.Xdp.TimestampExtension));
+    RtlZeroMemory(&Xsk->Rx.Xdp.RxMetadataExtension, sizeof(Xsk->Rx.Xdp.RxMetadataExtension));
+    Xsk->Rx.Xdp.Flags.TimestampExt = FALSE;
+    Xsk->Rx.Xdp.Flags.RxMetadataExt = FALSE;
+    Xsk->Rx.Xdp.Flags.HeaderSplit = FALSE;
 }
 
 static
-NTSTATUS
-XskSockoptGetStatistics(
-    _In_ XSK *Xsk,
-    _In_ IRP *Irp,
-    _In_ IO_STACK_LOCATION *IrpSp
+VOID
+XskNotifyAttachRxQueue(
+    _In_ XSK *Xsk
     )
 {
-    NTSTATUS Status;
-    XSK_STATISTICS *Statistics;
+    XDP_RX_QUEUE_CONFIG_ACTIVATE Config = XdpRxQueueGetConfig(Xsk->Rx.Xdp.Queue);
+    XDP_EXTENSION_INFO ExtensionInfo;
 
-    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+    Xsk->Rx.Xdp.FrameRing = XdpRxQueueGetFrameRing(Config);
 
-    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(XSK_STATISTICS)) {
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
+    ASSERT(XdpRxQueueIsVirtualAddressEnabled(Config));
+    XdpInitializeExtensionInfo(
+        &ExtensionInfo, XDP_BUFFER_EXTENSION_VIRTUAL_ADDRESS_NAME,
+        XDP_BUFFER_EXTENSION_VIRTUAL_ADDRESS_VERSION_1, XDP_EXTENSION_TYPE_BUFFER);
+    XdpRxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Rx.Xdp.VaExtension);
+
+    XdpInitializeExtensionInfo(
+        &ExtensionInfo, XDP_FRAME_EXTENSION_RX_ACTION_NAME,
+        XDP_FRAME_EXTENSION_RX_ACTION_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+    XdpRxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Rx.Xdp.RxActionExtension);
+
+    if (XdpRxQueueGetMaximumFragments(Config) > 1) {
+        Xsk->Rx.Xdp.FragmentRing = XdpRxQueueGetFragmentRing(Config);
+
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_FRAME_EXTENSION_FRAGMENT_NAME,
+            XDP_FRAME_EXTENSION_FRAGMENT_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+        XdpRxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Rx.Xdp.FragmentExtension);
     }
 
-    Statistics = (XSK_STATISTICS*)Irp->AssociatedIrp.SystemBuffer;
-    RtlZeroMemory(Statistics, sizeof(*Statistics));
+    if (XdpRxQueueIsTimestampEnabled(Config)) {
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_FRAME_EXTENSION_TIMESTAMP_NAME,
+            XDP_FRAME_EXTENSION_TIMESTAMP_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+        XdpRxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Rx.Xdp.TimestampExtension);
+        Xsk->Rx.Xdp.Flags.TimestampExt = TRUE;
+    }
 
-    *Statistics = Xsk->Statistics;
+    if (XdpRxQueueIsRxMetadataEnabled(Config)) {
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_FRAME_EXTENSION_RX_METADATA_NAME,
+            XDP_FRAME_EXTENSION_RX_METADATA_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+        XdpRxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Rx.Xdp.RxMetadataExtension);
+        Xsk->Rx.Xdp.Flags.RxMetadataExt = TRUE;
+    }
 
-    Status = STATUS_SUCCESS;
-    Irp->IoStatus.Information = sizeof(*Statistics);
+    if (Xsk->Rx.Xdp.FragmentRing != NULL && XdpRxQueueIsHeaderSplit(Config)) {
+        Xsk->Rx.Xdp.Flags.HeaderSplit = TRUE;
+    }
 
-Exit:
+    XskAcquirePollLock(Xsk);
 
-    TraceExitStatus(TRACE_XSK);
+    //
+    // Frames are left in the interface only for single-buffer sockets, which
+    // know up front how many frames fit in their rings.
+    //
+    Xsk->Rx.Xdp.Flags.Backpressure =
+        Xsk->Rx.Backpressure && !Xsk->Rx.MultiBuffer &&
+        XdpRxQueueIsBackpressureSupported(Config);
 
-    return Status;
+    if (Xsk->State == XskActive) {
+        //
+        // Now that this socket is bound to an RX queue, attempt to acquire the
+        // polling backchannel(s) and activate the appropriate polling mode.
+        //
+        switch (Xsk->PollMode) {
+
+        case XSK_POLL_MODE_BUSY:
+            if (!Xsk->PollBusyIdle) {
+                XskAcquirePollModeBusyRx(Xsk);
+            }
+            break;
+
+        case XSK_POLL_MODE_SOCKET:
+            XskAcquirePollModeSocket(Xsk);
+            break;
+
+        }
+    }
+
+    XskReleasePollLock(Xsk);
+
+    Xsk->Rx.Xdp.Flags.DatapathAttached = TRUE;
 }
 
 static
 VOID
-XskFillRingInfo(
-    _In_ XSK_KERNEL_RING *Ring,
-    _Out_ XSK_RING_INFO *Info
+XskFailoverArmTimer(
+    _In_ XSK *Xsk,
+    _In_ UINT32 DueTimeInMs
     )
 {
-    ASSERT(Ring->Mdl != NULL);
-    ASSERT(Ring->Shared != NULL);
-    ASSERT(Ring->Size != 0);
-    ASSERT(Ring->UserVa != NULL);
-
-    Info->Ring = Ring->UserVa;
-    Info->DescriptorsOffset = sizeof(XSK_SHARED_RING);
-    Info->ProducerIndexOffset = FIELD_OFFSET(XSK_SHARED_RING, ProducerIndex);
-    Info->ConsumerIndexOffset = FIELD_OFFSET(XSK_SHARED_RING, ConsumerIndex);
-    Info->FlagsOffset = FIELD_OFFSET(XSK_SHARED_RING, Flags);
-    Info->Size = Ring->Size;
-    Info->ElementStride = Ring->ElementStride;
+    RtlAcquirePushLockShared(&Xsk->Failover.Lock);
+    if (Xsk->Failover.Timer != NULL) {
+        (VOID)XdpTimerStart(Xsk->Failover.Timer, DueTimeInMs, NULL);
+    }
+    RtlReleasePushLockShared(&Xsk->Failover.Lock);
 }
 
 static
-NTSTATUS
-XskSockoptGetRingInfo(
+BOOLEAN
+XskFailoverStart(
     _In_ XSK *Xsk,
-    _In_ IRP *Irp,
-    _In_ IO_STACK_LOCATION *IrpSp
+    _In_opt_ XDP_BINDING_HANDLE BindingHandle
     )
 {
-    NTSTATUS Status;
-    KIRQL OldIrql = {0};
-    BOOLEAN IsLockHeld = FALSE;
-    XSK_RING_INFO_SET *InfoSet = Irp->AssociatedIrp.SystemBuffer;
-
-    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+    BOOLEAN Started = FALSE;
+    KIRQL OldIrql;
 
-    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(XSK_RING_INFO_SET)) {
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
+    //
+    // Only native interfaces fail over: there is nothing to fall back to when
+    // the generic interface detaches.
+    //
+    if (!Xsk->Failover.Enabled || BindingHandle == NULL ||
+        XdpIfGetCapabilities(BindingHandle)->Mode != XDP_INTERFACE_MODE_NATIVE) {
+        return FALSE;
     }
 
-    RtlZeroMemory(InfoSet, sizeof(*InfoSet));
-
     KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
-    IsLockHeld = TRUE;
-
-    if (Xsk->State == XskClosing) {
-        Status = STATUS_INVALID_DEVICE_STATE;
-        goto Exit;
-    }
-
-    if (Xsk->Rx.Ring.Size != 0) {
-        XskFillRingInfo(&Xsk->Rx.Ring, &InfoSet->Rx);
-    }
-    if (Xsk->Rx.FillRing.Size != 0) {
-        XskFillRingInfo(&Xsk->Rx.FillRing, &InfoSet->Fill);
-    }
-    if (Xsk->Tx.Ring.Size != 0) {
-        XskFillRingInfo(&Xsk->Tx.Ring, &InfoSet->Tx);
-    }
-    if (Xsk->Tx.CompletionRing.Size != 0) {
-        XskFillRingInfo(&Xsk->Tx.CompletionRing, &InfoSet->Completion);
+    if (Xsk->State == XskActive) {
+        Xsk->Failover.Migrating = TRUE;
+        Xsk->Failover.DetachPending = TRUE;
+        Started = TRUE;
     }
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
 
-    Status = STATUS_SUCCESS;
-    Irp->IoStatus.Information = sizeof(*InfoSet);
-
-Exit:
-
-    if (IsLockHeld) {
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    if (Started) {
+        TraceInfo(TRACE_XSK, "Xsk=%p native interface detached, failing over", Xsk);
+        XskFailoverArmTimer(Xsk, 0);
     }
 
-    TraceExitStatus(TRACE_XSK);
-
-    return Status;
+    return Started;
 }
 
-static
-NTSTATUS
-XskSockoptSetUmem(
-    _In_ XSK *Xsk,
-    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
-    _In_ KPROCESSOR_MODE RequestorMode
+VOID
+XskNotifyRxQueue(
+    _In_ XDP_RX_QUEUE_NOTIFICATION_ENTRY *NotificationEntry,
+    _In_ XDP_RX_QUEUE_NOTIFICATION_TYPE NotificationType
     )
 {
-    NTSTATUS Status;
-    const VOID *SockoptInputBuffer;
-    UINT32 SockoptInputBufferLength;
-    UMEM *Umem = NULL;
-    KIRQL OldIrql = {0};
-    BOOLEAN IsLockHeld = FALSE;
+    XSK *Xsk = CONTAINING_RECORD(NotificationEntry, XSK, Rx.Xdp.QueueNotificationEntry);
 
-    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+    TraceInfo(TRACE_XSK, "Xsk=%p NotificationType=%u", Xsk, NotificationType);
 
-    //
-    // This is a nested buffer not copied by IO manager, so it needs special care.
-    //
-    SockoptInputBuffer = Sockopt->InputBuffer;
-    SockoptInputBufferLength = Sockopt->InputBufferLength;
+    switch (NotificationType) {
 
-    if (SockoptInputBufferLength < sizeof(XSK_UMEM_REG)) {
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
-    }
+    case XDP_RX_QUEUE_NOTIFICATION_ATTACH:
+        XskNotifyAttachRxQueue(Xsk);
+        break;
 
-    Umem = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Umem), POOLTAG_UMEM);
-    if (Umem == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Exit;
-    }
+    case XDP_RX_QUEUE_NOTIFICATION_DETACH:
+        XskNotifyDetachRxQueue(Xsk);
+        break;
 
-    XdpInitializeReferenceCount(&Umem->ReferenceCount);
+    case XDP_RX_QUEUE_NOTIFICATION_DETACH_COMPLETE:
+        XskNotifyDetachRxQueueComplete(Xsk);
+        break;
 
-    __try {
-        if (RequestorMode != KernelMode) {
-            ProbeForRead(
-                (VOID*)SockoptInputBuffer, SockoptInputBufferLength,
-                PROBE_ALIGNMENT(XSK_UMEM_REG));
-        }
-        RtlCopyVolatileMemory(&Umem->Reg, SockoptInputBuffer, sizeof(XSK_UMEM_REG));
-    } __except (EXCEPTION_EXECUTE_HANDLER) {
-        Status = GetExceptionCode();
-        goto Exit;
-    }
+    case XDP_RX_QUEUE_NOTIFICATION_DELETE:
+        //
+        // The RX queue's interface is detaching. The queue itself remains
+        // until this socket releases it, so only failover needs to react.
+        //
+        (VOID)XskFailoverStart(Xsk, Xsk->Rx.Xdp.IfHandle);
+        break;
 
-    if (Umem->Reg.TotalSize == 0 || Umem->Reg.TotalSize > MAXULONG) {
-        // TODO: support up to MAXUINT64?
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
-    }
-    if (Umem->Reg.Headroom > MAXUINT16 ||
-        Umem->Reg.Headroom > Umem->Reg.ChunkSize ||
-        Umem->Reg.ChunkSize > Umem->Reg.TotalSize ||
-        Umem->Reg.ChunkSize == 0) {
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
     }
+}
 
-    //
-    // If support is needed for kernel mode AF_XDP sockets, UMEM MDL setup
-    // needs more thought.
-    //
-    ASSERT(RequestorMode == UserMode);
+NTSTATUS
+XskValidateDatapathHandle(
+    _In_ HANDLE XskHandle
+    )
+{
+    XSK *Xsk = (XSK *)XskHandle;
 
-    Umem->Mapping.Mdl =
-        IoAllocateMdl(
-            Umem->Reg.Address,
-            (ULONG)Umem->Reg.TotalSize,
-            FALSE, // SecondaryBuffer
-            FALSE, // ChargeQuota
-            NULL); // Irp
-    if (Umem->Mapping.Mdl == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Exit;
+    if (Xsk->State < XskBound) {
+        return STATUS_INVALID_DEVICE_STATE;
     }
 
-    __try {
-        MmProbeAndLockPages(Umem->Mapping.Mdl, RequestorMode, IoWriteAccess);
-    } __except (EXCEPTION_EXECUTE_HANDLER) {
-        Status = GetExceptionCode();
-        goto Exit;
+    if (Xsk->Rx.Xdp.Queue == NULL) {
+        return STATUS_NOT_SUPPORTED;
     }
 
+    return STATUS_SUCCESS;
+}
+
+BOOLEAN
+XskCanBypass(
+    _In_ HANDLE XskHandle,
+    _In_ XDP_RX_QUEUE *RxQueue
+    )
+{
+    XSK *Xsk = (XSK *)XskHandle;
+
     //
-    // MmGetSystemAddressForMdlSafe and MmMapLockedPagesSpecifyCache do not
-    // preserve large pages in system address mappings. Use the reserved MDL
-    // mapping routines to ensure large pages are propagated into the kernel.
-    // Note that the reserved mapping allocates the mapping size based on best-
-    // case page-aligned buffers, so account for the MDL offset, too.
+    // Allow XSKs that are terminally disconnected to bypass on any queue since
+    // the receive path becomes a NOP.
     //
-    Umem->ReservedMapping =
-        MmAllocateMappingAddress(
-            BYTE_OFFSET(Umem->Reg.Address) + Umem->Reg.TotalSize, POOLTAG_UMEM);
-    if (Umem->ReservedMapping == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Exit;
+    if (Xsk->State > XskActive && !Xsk->Rx.Xdp.Flags.DatapathAttached) {
+        return TRUE;
     }
 
-    Umem->Mapping.SystemAddress =
-        MmMapLockedPagesWithReservedMapping(
-            Umem->ReservedMapping, POOLTAG_UMEM, Umem->Mapping.Mdl, MmCached);
-    if (Umem->Mapping.SystemAddress == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Exit;
+    if (Xsk->Rx.Xdp.Queue != RxQueue) {
+        return FALSE;
     }
 
-    if (Umem->Reg.TotalSize % Umem->Reg.ChunkSize != 0) {
-        //
-        // The final chunk is truncated, which might be required for alignment
-        // reasons. Ignore the final chunk.
-        //
-        ASSERT(Umem->Reg.TotalSize > Umem->Reg.ChunkSize);
-        Umem->Reg.TotalSize -= (Umem->Reg.TotalSize % Umem->Reg.ChunkSize);
-    }
+    return TRUE;
+}
 
-    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
-    IsLockHeld = TRUE;
+static
+VOID
+XskPcwInsertSocket(
+    _In_ XSK *Xsk
+    )
+{
+    RtlAcquirePushLockExclusive(&XskGlobals.PcwLock);
+    Xsk->PcwId = XskGlobals.PcwNextId++;
+    InsertTailList(&XskGlobals.PcwSockets, &Xsk->PcwLink);
+    RtlReleasePushLockExclusive(&XskGlobals.PcwLock);
+}
 
-    if (Xsk->State != XskUnbound) {
-        Status = STATUS_INVALID_DEVICE_STATE;
-        goto Exit;
-    }
-    if (Xsk->Umem != NULL) {
-        Status = STATUS_INVALID_DEVICE_STATE;
-        goto Exit;
-    }
+static
+VOID
+XskPcwRemoveSocket(
+    _In_ XSK *Xsk
+    )
+{
+    RtlAcquirePushLockExclusive(&XskGlobals.PcwLock);
+    RemoveEntryList(&Xsk->PcwLink);
+    InitializeListHead(&Xsk->PcwLink);
+    RtlReleasePushLockExclusive(&XskGlobals.PcwLock);
+}
 
-    TraceInfo(
-        TRACE_XSK, "Xsk=%p Set Umem=%p TotalSize=%llu ChunkSize=%llu Headroom=%u",
-        Xsk, Umem, Umem->Reg.TotalSize, Umem->Reg.ChunkSize, Umem->Reg.Headroom);
+static
+VOID
+XskPcwReadStatistics(
+    _In_ const XSK *Xsk,
+    _Out_ XDP_PCW_XSK *Values
+    )
+{
+    RtlZeroMemory(Values, sizeof(*Values));
+
+    Values->RxDropped = ReadUInt64NoFence(&Xsk->Statistics->RxDropped);
+    Values->RxTruncated = ReadUInt64NoFence(&Xsk->Statistics->RxTruncated);
+    Values->RxInvalidDescriptors = ReadUInt64NoFence(&Xsk->Statistics->RxInvalidDescriptors);
+    Values->TxInvalidDescriptors = ReadUInt64NoFence(&Xsk->Statistics->TxInvalidDescriptors);
+
+    for (UINT32 Index = 0; Index < Xsk->ProcessorCount; Index++) {
+        const XSK_PROCESSOR_STATISTICS *Processor = &Xsk->ProcessorStatistics[Index];
+
+        Values->RxFrames += ReadUInt64NoFence(&Processor->RxFrames);
+        Values->RxBytes += ReadUInt64NoFence(&Processor->RxBytes);
+        Values->RxFillRingEmpty += ReadUInt64NoFence(&Processor->RxFillRingEmpty);
+        Values->RxRingFull += ReadUInt64NoFence(&Processor->RxRingFull);
+        Values->RxFillNeedPoke += ReadUInt64NoFence(&Processor->RxFillNeedPoke);
+        Values->RxPokes += ReadUInt64NoFence(&Processor->RxPokes);
+        Values->TxFrames += ReadUInt64NoFence(&Processor->TxFrames);
+        Values->TxBytes += ReadUInt64NoFence(&Processor->TxBytes);
+        Values->TxBounceFrames += ReadUInt64NoFence(&Processor->TxBounceFrames);
+        Values->TxBounceFailures += ReadUInt64NoFence(&Processor->TxBounceFailures);
+        Values->TxNeedPoke += ReadUInt64NoFence(&Processor->TxNeedPoke);
+        Values->TxPokes += ReadUInt64NoFence(&Processor->TxPokes);
+    }
+
+    Values->MemoryBytes = XskGetMemoryBytes(Xsk);
+}
 
-    Status = STATUS_SUCCESS;
-    Xsk->Umem = Umem;
-    Umem = NULL;
+static
+NTSTATUS
+XskPcwCallback(
+    _In_ PCW_CALLBACK_TYPE Type,
+    _In_ PCW_CALLBACK_INFORMATION *Info,
+    _In_opt_ VOID *Context
+    )
+{
+    PCW_BUFFER *Buffer;
+    NTSTATUS Status = STATUS_SUCCESS;
+    DECLARE_UNICODE_STRING_SIZE(Name, ARRAYSIZE("if_" MAXUINT32_STR "_xsk_" MAXUINT32_STR));
 
-Exit:
+    UNREFERENCED_PARAMETER(Context);
 
-    if (IsLockHeld) {
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    switch (Type) {
+    case PcwCallbackEnumerateInstances:
+        Buffer = Info->EnumerateInstances.Buffer;
+        break;
+    case PcwCallbackCollectData:
+        Buffer = Info->CollectData.Buffer;
+        break;
+    default:
+        return STATUS_SUCCESS;
     }
-    if (Umem != NULL) {
-        XskDereferenceUmem(Umem);
+
+    //
+    // Socket counters are accumulated per processor on the data path, so sum
+    // them on demand rather than maintaining a shared PCW instance buffer.
+    //
+    RtlAcquirePushLockShared(&XskGlobals.PcwLock);
+
+    for (LIST_ENTRY *Entry = XskGlobals.PcwSockets.Flink;
+        Entry != &XskGlobals.PcwSockets;
+        Entry = Entry->Flink) {
+        XSK *Xsk = CONTAINING_RECORD(Entry, XSK, PcwLink);
+        XDP_PCW_XSK Values;
+
+        Status = RtlUnicodeStringPrintf(&Name, L"if_%u_xsk_%u", Xsk->PcwIfIndex, Xsk->PcwId);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        XskPcwReadStatistics(Xsk, &Values);
+
+        Status = XdpPcwAddXsk(Buffer, &Name, Xsk->PcwId, &Values);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
     }
 
-    TraceExitStatus(TRACE_XSK);
+Exit:
+
+    RtlReleasePushLockShared(&XskGlobals.PcwLock);
 
     return Status;
 }
 
 static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+_IRQL_requires_same_
 NTSTATUS
-XskSockoptSetRingSize(
-    _In_ XSK *Xsk,
-    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
-    _In_ KPROCESSOR_MODE RequestorMode
+XskIrpCleanup(
+    _Inout_ IRP* Irp,
+    _Inout_ IO_STACK_LOCATION* IrpSp
     )
 {
-    NTSTATUS Status;
-    const VOID *SockoptInputBuffer;
-    UINT32 SockoptInputBufferLength;
-    XSK_SHARED_RING *Shared = NULL;
-    MDL *Mdl = NULL;
-    VOID *UserVa = NULL;
-    XSK_KERNEL_RING *Ring = NULL;
-    UINT32 NumDescriptors;
-    ULONG DescriptorSize;
-    ULONG AllocationSize;
-    KIRQL OldIrql = {0};
-    BOOLEAN IsLockHeld = FALSE;
+    XSK *Xsk;
+    KIRQL OldIrql;
+    UINT32 IoWaitFlags;
+    XSK_SHARED_RX_RING *SharedRx;
+
+    UNREFERENCED_PARAMETER(Irp);
 
+    Xsk = IrpSp->FileObject->FsContext;
     TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
 
     //
-    // This is a nested buffer not copied by IO manager, so it needs special care.
+    // Synchronize the polling execution context with socket cleanup: the socket
+    // is protected from cleanup as long as the polling lock is held.
     //
-    SockoptInputBuffer = Sockopt->InputBuffer;
-    SockoptInputBufferLength = Sockopt->InputBufferLength;
+    XskAcquirePollLock(Xsk);
 
-    if (SockoptInputBufferLength < sizeof(UINT32)) {
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    Xsk->State = XskClosing;
+    IoWaitFlags = Xsk->IoWaitFlags;
+    WriteUInt32NoFence(&Xsk->IoCompletion.Flags, 0);
+    SharedRx = Xsk->Rx.SharedRx;
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    if (SharedRx != NULL && SharedRx->Owner == Xsk) {
+        //
+        // Wait for the sockets sharing this socket's RX ring to finish
+        // signaling it. The ring itself remains in use until they close.
+        //
+        ExWaitForRundownProtectionRelease(&SharedRx->OwnerRundown);
     }
 
-    __try {
-        if (RequestorMode != KernelMode) {
-            ProbeForRead((VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(UINT32));
-        }
-        NumDescriptors = ReadUInt32NoFence(SockoptInputBuffer);
-    } __except (EXCEPTION_EXECUTE_HANDLER) {
-        Status = GetExceptionCode();
-        goto Exit;
+    //
+    // Revert any polling mode state set by this socket.
+    //
+    NT_VERIFY(XskSetPollMode(Xsk, XSK_POLL_MODE_DEFAULT, 0, 0) == STATUS_SUCCESS);
+
+    XskReleasePollLock(Xsk);
+
+    if (Xsk->PollBusyIdleTimer != NULL) {
+        //
+        // Wait for any idle timer routine to finish referencing the socket.
+        //
+        XdpTimerShutdown(Xsk->PollBusyIdleTimer, TRUE, TRUE);
+        Xsk->PollBusyIdleTimer = NULL;
     }
 
-    if (NumDescriptors > MAXUINT32 || !RTL_IS_POWER_OF_TWO(NumDescriptors)) {
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
+    if (Xsk->Tx.PaceTimer != NULL) {
+        //
+        // Wait for any pacing timer routine to finish referencing the socket.
+        //
+        XdpTimerShutdown(Xsk->Tx.PaceTimer, TRUE, TRUE);
+        Xsk->Tx.PaceTimer = NULL;
     }
 
-    switch (Sockopt->Option) {
-    case XSK_SOCKOPT_RX_RING_SIZE:
-    case XSK_SOCKOPT_TX_RING_SIZE:
-        DescriptorSize = sizeof(XSK_FRAME_DESCRIPTOR);
-        break;
-    case XSK_SOCKOPT_RX_FILL_RING_SIZE:
-    case XSK_SOCKOPT_TX_COMPLETION_RING_SIZE:
-        DescriptorSize = sizeof(UINT64);
-        break;
-    default:
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
+    if (Xsk->Failover.Timer != NULL) {
+        XDP_TIMER *Timer;
+
+        //
+        // Detach notifications may still arm the failover timer, so unpublish
+        // it before waiting for any failover to finish.
+        //
+        RtlAcquirePushLockExclusive(&Xsk->Failover.Lock);
+        Timer = Xsk->Failover.Timer;
+        Xsk->Failover.Timer = NULL;
+        RtlReleasePushLockExclusive(&Xsk->Failover.Lock);
+
+        XdpTimerShutdown(Timer, TRUE, TRUE);
     }
 
-    Status = RtlULongMult(NumDescriptors, DescriptorSize, &AllocationSize);
-    if (Status != STATUS_SUCCESS) {
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
+    if (KeCancelTimer(&Xsk->NotifyModeration.Timer)) {
+        //
+        // The moderation timer holds a socket reference until it expires.
+        //
+        XskDereference(Xsk);
     }
-    Status = RtlULongAdd(AllocationSize, sizeof(*Shared), &AllocationSize);
-    if (Status != STATUS_SUCCESS) {
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
+
+    if (IoWaitFlags != 0) {
+        XskSignalReadyIo(Xsk, IoWaitFlags);
     }
 
-    //
-    // Pool allocations mapped into user space must consume entire pages.
-    // TODO: Group all XSK rings into a single allocation?
-    //
-    AllocationSize = RTL_NUM_ALIGN_UP(AllocationSize, PAGE_SIZE);
-    if (AllocationSize < PAGE_SIZE) {
-        Status = STATUS_INVALID_PARAMETER;
+    TraceInfo(TRACE_XSK, "Xsk=%p Status=%!STATUS!", Xsk, STATUS_SUCCESS);
+
+    TraceExitSuccess(TRACE_XSK);
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XskAllocateLargePageRing(
+    _In_ ULONG AllocationSize,
+    _Out_ XSK_SHARED_RING **Shared,
+    _Out_ MDL **Mdl,
+    _Out_ VOID **ReservedMapping
+    )
+{
+    NTSTATUS Status;
+    PHYSICAL_ADDRESS LowAddress = {0};
+    PHYSICAL_ADDRESS HighAddress = {0};
+    PHYSICAL_ADDRESS SkipBytes = {0};
+    MDL *LargePageMdl = NULL;
+    VOID *Mapping = NULL;
+    XSK_SHARED_RING *SystemAddress = NULL;
+
+    ASSERT(AllocationSize % XSK_LARGE_PAGE_SIZE == 0);
+
+    HighAddress.QuadPart = MAXLONG64;
+
+    LargePageMdl =
+        MmAllocatePagesForMdlEx(
+            LowAddress, HighAddress, SkipBytes, AllocationSize, MmCached,
+            MM_ALLOCATE_FULLY_REQUIRED | MM_ALLOCATE_FAST_LARGE_PAGES);
+    if (LargePageMdl == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
         goto Exit;
     }
 
-    Shared = ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, POOLTAG_RING);
-    if (Shared == NULL) {
+    //
+    // MmGetSystemAddressForMdlSafe does not preserve large pages in system
+    // address mappings, so use a reserved mapping as UMEM registration does.
+    //
+    Mapping = MmAllocateMappingAddress(AllocationSize, POOLTAG_RING);
+    if (Mapping == NULL) {
         Status = STATUS_INSUFFICIENT_RESOURCES;
         goto Exit;
     }
 
-    Mdl =
-        IoAllocateMdl(
-            Shared,
-            AllocationSize,
-            FALSE, // SecondaryBuffer
-            FALSE, // ChargeQuota
-            NULL); // Irp
-    if (Mdl == NULL) {
+    SystemAddress =
+        MmMapLockedPagesWithReservedMapping(Mapping, POOLTAG_RING, LargePageMdl, MmCached);
+    if (SystemAddress == NULL) {
         Status = STATUS_INSUFFICIENT_RESOURCES;
         goto Exit;
     }
-    MmBuildMdlForNonPagedPool(Mdl);
 
-    __try {
-        UserVa =
-            MmMapLockedPagesSpecifyCache(
-                Mdl,
-                RequestorMode,
-                MmCached,
-                NULL, // RequestedAddress
-                FALSE,// BugCheckOnFailure
-                NormalPagePriority | MdlMappingNoExecute);
-        if (UserVa == NULL) {
-            Status = STATUS_INSUFFICIENT_RESOURCES;
-            goto Exit;
-        }
-    } __except (EXCEPTION_EXECUTE_HANDLER) {
-        Status = GetExceptionCode();
-        goto Exit;
+    RtlZeroMemory(SystemAddress, AllocationSize);
+
+    *Shared = SystemAddress;
+    *Mdl = LargePageMdl;
+    *ReservedMapping = Mapping;
+    LargePageMdl = NULL;
+    Mapping = NULL;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (Mapping != NULL) {
+        MmFreeMappingAddress(Mapping, POOLTAG_RING);
+    }
+    if (LargePageMdl != NULL) {
+        MmFreePagesFromMdl(LargePageMdl);
+        ExFreePool(LargePageMdl);
     }
 
-    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
-    IsLockHeld = TRUE;
+    return Status;
+}
 
-    if (Xsk->State >= XskActivating) {
-        Status = STATUS_INVALID_DEVICE_STATE;
-        goto Exit;
+static
+VOID
+XskFreeRingAllocation(
+    _In_opt_ XSK_SHARED_RING *Shared,
+    _In_opt_ MDL *Mdl,
+    _In_opt_ VOID *ReservedMapping
+    )
+{
+    if (ReservedMapping != NULL) {
+        ASSERT(Shared != NULL && Mdl != NULL);
+        MmUnmapReservedMapping(ReservedMapping, POOLTAG_RING, Mdl);
+        MmFreeMappingAddress(ReservedMapping, POOLTAG_RING);
+        MmFreePagesFromMdl(Mdl);
+        ExFreePool(Mdl);
+        return;
     }
 
-    switch (Sockopt->Option) {
-    case XSK_SOCKOPT_RX_RING_SIZE:
-        Ring = &Xsk->Rx.Ring;
-        break;
-    case XSK_SOCKOPT_RX_FILL_RING_SIZE:
-        Ring = &Xsk->Rx.FillRing;
-        break;
-    case XSK_SOCKOPT_TX_RING_SIZE:
-        Ring = &Xsk->Tx.Ring;
-        Shared->Flags = XSK_RING_FLAG_NEED_POKE;
-        break;
-    case XSK_SOCKOPT_TX_COMPLETION_RING_SIZE:
-        Ring = &Xsk->Tx.CompletionRing;
-        break;
-    default:
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
+    if (Mdl != NULL) {
+        IoFreeMdl(Mdl);
+    }
+    if (Shared != NULL) {
+        ExFreePoolWithTag(Shared, POOLTAG_RING);
     }
+}
 
+static
+VOID
+XskFreeRing(
+    XSK_KERNEL_RING *Ring
+    )
+{
     ASSERT(
         (Ring->Size != 0 && Ring->Mdl != NULL && Ring->Shared != NULL) ||
         (Ring->Size == 0 && Ring->Mdl == NULL && Ring->Shared == NULL));
 
-    if (Ring->Size != 0) {
-        Status = STATUS_INVALID_DEVICE_STATE;
-        goto Exit;
-    }
+    if (Ring->UserVa != NULL) {
+        ASSERT(Ring->OwningProcess != NULL);
+        ASSERT(Ring->Mdl);
+        XskUnmapFromProcess(Ring->UserVa, Ring->Mdl, Ring->OwningProcess);
+        Ring->OwningProcess = NULL;
+    }
+
+    ASSERT(Ring->OwningProcess == NULL);
+
+    XskFreeRingAllocation(Ring->Shared, Ring->Mdl, Ring->ReservedMapping);
+}
+
+static
+NTSTATUS
+XskSetupDma(
+    _In_ XSK *Xsk
+    )
+{
+    NTSTATUS Status;
+    DEVICE_DESCRIPTION DeviceDescription = {0};
+    ULONG NumberOfMapRegisters = 0;
+    UMEM_MAPPING *Mapping;
+    const XDP_DMA_CAPABILITIES *DmaCapabilities =
+        XdpTxQueueGetDmaCapabilities(Xsk->Tx.Xdp.Queue);
+    const DMA_OPERATIONS *DmaOperations;
+
+    ASSERT(DmaCapabilities->PhysicalDeviceObject != NULL);
+
+    DeviceDescription.Version = DEVICE_DESCRIPTION_VERSION3;
+    DeviceDescription.Master = TRUE;
+    DeviceDescription.ScatterGather = TRUE;
+    DeviceDescription.InterfaceType = InterfaceTypeUndefined;
+    DeviceDescription.MaximumLength = ((ULONG)(1 << 17)); // 128 KB
+    DeviceDescription.DmaAddressWidth = 64;
+
+    Xsk->Tx.DmaAdapter =
+        IoGetDmaAdapter(
+            DmaCapabilities->PhysicalDeviceObject, &DeviceDescription, &NumberOfMapRegisters);
+    if (Xsk->Tx.DmaAdapter == NULL) {
+        TraceError(TRACE_XSK, "Xsk=%p Failed to get DMA adapter", Xsk);
+        return STATUS_NO_MEMORY;
+    }
+
+    DmaOperations = (DMA_OPERATIONS*)Xsk->Tx.DmaAdapter->DmaOperations;
+
+    //
+    // Try to map the UMEM directly to hardware if policy allows and the DMA
+    // adapter supports it.
+    //
+    if (!XskRequiresTxBounceBuffer(Xsk) &&
+        RTL_CONTAINS_FIELD(DmaOperations, DmaOperations->Size, CreateCommonBufferFromMdl)) {
+        Mapping = &Xsk->Tx.UmemMapping;
+        Status =
+            DmaOperations->CreateCommonBufferFromMdl(
+                Xsk->Tx.DmaAdapter, Mapping->Mdl, NULL, 0, &Mapping->DmaAddress);
+        if (Status == STATUS_SUCCESS) {
+            TraceInfo(TRACE_XSK, "Xsk=%p Successfully created common buffer", Xsk);
+            return STATUS_SUCCESS;
+        }
+    }
+
+    //
+    // Fall-back to allocating a bounce buffer that can be mapped to hardware.
+    //
+    Mapping = &Xsk->Tx.Bounce.Mapping;
+    Mapping->SystemAddress =
+        DmaOperations->AllocateCommonBuffer(
+            Xsk->Tx.DmaAdapter, (ULONG)Xsk->Umem->Reg.TotalSize, &Mapping->DmaAddress, TRUE);
+    if (Mapping->SystemAddress == NULL) {
+        TraceWarn(TRACE_XSK, "Xsk=%p Failed to allocate common buffer", Xsk);
+        return STATUS_NO_MEMORY;
+    }
+    Xsk->Tx.Bounce.AllocationSource = AllocatedByDma;
+
+    TraceInfo(TRACE_XSK, "Xsk=%p Successfully allocated common buffer", Xsk);
+
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+XskCleanupDma(
+    XSK *Xsk
+    )
+{
+    if (Xsk->Umem != NULL) {
+        UMEM_MAPPING *Mapping = XskGetTxMapping(Xsk);
+
+        if (Mapping->DmaAddress.QuadPart != 0) {
+            Xsk->Tx.DmaAdapter->DmaOperations->FreeCommonBuffer(
+                Xsk->Tx.DmaAdapter,
+                Mapping->Mdl->ByteCount,
+                Mapping->DmaAddress,
+                Mapping->SystemAddress,
+                TRUE);
+            Mapping->DmaAddress.QuadPart = 0;
+
+            if (Xsk->Tx.Bounce.AllocationSource == AllocatedByDma) {
+                ASSERT(&Xsk->Tx.Bounce.Mapping == Mapping);
+                Mapping->SystemAddress = NULL;
+                Xsk->Tx.Bounce.AllocationSource = NotAllocated;
+            }
+        }
+    }
+
+    if (Xsk->Tx.DmaAdapter != NULL) {
+        Xsk->Tx.DmaAdapter->DmaOperations->PutDmaAdapter(Xsk->Tx.DmaAdapter);
+        Xsk->Tx.DmaAdapter = NULL;
+    }
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XskRxSyncDetach(
+    _In_opt_ VOID *Context
+    )
+{
+    XSK *Xsk = Context;
+    ASSERT(Xsk);
+    Xsk->Rx.Xdp.Flags.DatapathAttached = FALSE;
+}
+
+static
+VOID
+XskDetachRxIf(
+    _In_ XSK *Xsk
+    )
+{
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (Xsk->Rx.Xdp.Queue != NULL) {
+        if (Xsk->Rx.Xdp.Flags.EbpfMapInserted) {
+            XdpRxQueueRemoveEbpfXsk(Xsk->Rx.Xdp.Queue, Xsk->Rx.EbpfMapKey, (HANDLE)Xsk);
+            Xsk->Rx.Xdp.Flags.EbpfMapInserted = FALSE;
+        }
+
+        if (Xsk->Rx.Xdp.Flags.NotificationsRegistered) {
+            if (!Xsk->Rx.Xdp.DetachSyncStarted) {
+                XdpRxQueueSyncStart(
+                    Xsk->Rx.Xdp.Queue, &Xsk->Rx.Xdp.DetachSync, XskRxSyncDetach, Xsk);
+            }
+            XdpRxQueueSyncWait(&Xsk->Rx.Xdp.DetachSync);
+            Xsk->Rx.Xdp.DetachSyncStarted = FALSE;
+            XdpRxQueueDeregisterNotifications(Xsk->Rx.Xdp.Queue, &Xsk->Rx.Xdp.QueueNotificationEntry);
+            Xsk->Rx.Xdp.Flags.NotificationsRegistered = FALSE;
+        }
+
+        XskNotifyDetachRxQueue(Xsk);
+        XskNotifyDetachRxQueueComplete(Xsk);
+        XdpRxQueueDereference(Xsk->Rx.Xdp.Queue);
+        Xsk->Rx.Xdp.Queue = NULL;
+    }
+
+    if (Xsk->Rx.Xdp.IfHandle != NULL) {
+        XdpIfDereferenceBinding(Xsk->Rx.Xdp.IfHandle);
+
+        //
+        // Synchronize with non-binding-workers while clearing the interface
+        // handle.
+        //
+        KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+        Xsk->Rx.Xdp.IfHandle = NULL;
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    }
+
+    if (Xsk->State >= XskActive && !Xsk->Failover.Migrating) {
+        XskKernelRingSetError(&Xsk->Rx.PriorityRing, XSK_ERROR_INTERFACE_DETACH);
+
+        //
+        // A shared RX or fill ring remains in use by the other sharing sockets.
+        //
+        if (Xsk->Rx.SharedRx == NULL) {
+            XskKernelRingSetError(&Xsk->Rx.Ring, XSK_ERROR_INTERFACE_DETACH);
+        }
+        if (Xsk->Rx.SharedFill == NULL) {
+            XskKernelRingSetError(&Xsk->Rx.FillRing, XSK_ERROR_INTERFACE_DETACH);
+        }
+    }
+
+    TraceExitSuccess(TRACE_XSK);
+}
+
+static
+VOID
+XskDeactivateTxIf(
+    _In_ XSK *Xsk
+    )
+{
+    if (Xsk->Tx.Xdp.Flags.QueueActive) {
+        //
+        // Wait for all outstanding TX frames to complete. We need to
+        // synchronize with the data path: if there are frames outstanding,
+        // then the OutstandingFlushComplete event will be set as part of
+        // the regular data path. If no frames are outstanding, to ensure
+        // the OutstandingFrames count is compared to zero within the data
+        // path's execution context, an extra callback is required.
+        //
+        ASSERT(Xsk->State > XskActive || Xsk->Failover.Migrating);
+        if (!Xsk->Tx.Xdp.RundownSyncStarted) {
+            //
+            // A previous failover may have left the event signaled.
+            //
+            KeClearEvent(&Xsk->Tx.Xdp.OutstandingFlushComplete);
+            XdpTxQueueSyncStart(
+                Xsk->Tx.Xdp.Queue, &Xsk->Tx.Xdp.RundownSync, XskTxCompleteRundown, Xsk);
+        }
+        XdpTxQueueSyncWait(&Xsk->Tx.Xdp.RundownSync);
+        Xsk->Tx.Xdp.RundownSyncStarted = FALSE;
+        KeWaitForSingleObject(
+            &Xsk->Tx.Xdp.OutstandingFlushComplete, Executive, KernelMode, FALSE, NULL);
+        ASSERT(Xsk->Tx.Xdp.OutstandingFrames == 0);
+
+        RtlAcquirePushLockExclusive(&Xsk->PollLock);
+        Xsk->Tx.Xdp.Flags.QueueActive = FALSE;
+        RtlReleasePushLockExclusive(&Xsk->PollLock);
+    }
+
+    if (Xsk->Tx.Xdp.Flags.QueueInserted) {
+        XdpTxQueueRemoveDatapathClient(Xsk->Tx.Xdp.Queue, &Xsk->Tx.Xdp.DatapathClientEntry);
+        Xsk->Tx.Xdp.Flags.QueueInserted = FALSE;
+    }
+
+    XskCleanupDma(Xsk);
+    XskFreeBounceBuffer(&Xsk->Tx.Bounce);
+    XskReleaseMemory(Xsk, XskMemoryBounce);
+
+    if (Xsk->Tx.Reorder.Entries != NULL) {
+        ExFreePoolWithTag(Xsk->Tx.Reorder.Entries, POOLTAG_TX_REORDER);
+        Xsk->Tx.Reorder.Entries = NULL;
+        XskUnchargeMemory(
+            Xsk, XskMemoryOther,
+            sizeof(*Xsk->Tx.Reorder.Entries) * (Xsk->Tx.Reorder.Mask + 1));
+    }
+}
+
+static
+VOID
+XskDetachTxIf(
+    _In_ XSK *Xsk
+    )
+{
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (Xsk->Tx.Xdp.Queue != NULL) {
+        XskDeactivateTxIf(Xsk);
+        XdpTxQueueDeregisterNotifications(Xsk->Tx.Xdp.Queue, &Xsk->Tx.Xdp.QueueNotificationEntry);
+        XdpTxQueueDereference(Xsk->Tx.Xdp.Queue);
+        Xsk->Tx.Xdp.Queue = NULL;
+    }
+
+    if (Xsk->Tx.Xdp.IfHandle != NULL) {
+        XdpIfDereferenceBinding(Xsk->Tx.Xdp.IfHandle);
+
+        //
+        // Synchronize with non-binding-workers while clearing the interface
+        // handle.
+        //
+        KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+        Xsk->Tx.Xdp.IfHandle = NULL;
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    }
+
+    if (Xsk->State >= XskActive && !Xsk->Failover.Migrating) {
+        XskKernelRingSetError(&Xsk->Tx.Ring, XSK_ERROR_INTERFACE_DETACH);
+        XskKernelRingSetError(&Xsk->Tx.CompletionRing, XSK_ERROR_INTERFACE_DETACH);
+    }
+
+    TraceExitSuccess(TRACE_XSK);
+}
+
+VOID
+XskNotifyTxQueue(
+    _In_ XDP_TX_QUEUE_NOTIFICATION_ENTRY *NotificationEntry,
+    _In_ XDP_TX_QUEUE_NOTIFICATION_TYPE NotificationType
+    )
+{
+    XSK *Xsk = CONTAINING_RECORD(NotificationEntry, XSK, Tx.Xdp.QueueNotificationEntry);
+    KIRQL OldIrql;
+
+    if (NotificationType != XDP_TX_QUEUE_NOTIFICATION_DETACH) {
+        return;
+    }
+
+    //
+    // Set the state to detached, except when socket closure has raced this
+    // detach event, or the socket fails over to another interface.
+    //
+    if (!XskFailoverStart(Xsk, Xsk->Tx.Xdp.IfHandle)) {
+        KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+        if (Xsk->State != XskClosing) {
+            ASSERT(Xsk->State >= XskBinding && Xsk->State <= XskDetached);
+            Xsk->State = XskDetached;
+        }
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    }
+
+    //
+    // This detach event is executing in the context of XDP binding work queue
+    // processing on the TX queue, so it is synchronized with other detach
+    // instances that also utilize the XDP binding work queue (detach during
+    // bind failure and detach during socket closure).
+    //
+    XskDetachTxIf(Xsk);
+}
+
+static
+VOID
+XskDetachRxIfPrepare(
+    _In_ XDP_BINDING_WORKITEM *Item
+    )
+{
+    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
+    XSK *Xsk = WorkItem->Xsk;
+
+    //
+    // Start the data path detach now so it is flushed together with the other
+    // sockets detaching in this batch; XskDetachRxIf waits for it.
+    //
+    if (Xsk->Rx.Xdp.Queue != NULL && Xsk->Rx.Xdp.Flags.NotificationsRegistered &&
+        !Xsk->Rx.Xdp.DetachSyncStarted) {
+        XdpRxQueueSyncStart(Xsk->Rx.Xdp.Queue, &Xsk->Rx.Xdp.DetachSync, XskRxSyncDetach, Xsk);
+        Xsk->Rx.Xdp.DetachSyncStarted = TRUE;
+    }
+}
+
+static
+VOID
+XskDetachRxIfWorker(
+    _In_ XDP_BINDING_WORKITEM *Item
+    )
+{
+    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
+    XSK *Xsk = WorkItem->Xsk;
+
+    XskDetachRxIf(Xsk);
+
+    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+}
+
+static
+VOID
+XskDetachTxIfPrepare(
+    _In_ XDP_BINDING_WORKITEM *Item
+    )
+{
+    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
+    XSK *Xsk = WorkItem->Xsk;
+
+    //
+    // Start the rundown sync now so it is flushed together with the other
+    // sockets detaching in this batch; XskDeactivateTxIf waits for it.
+    //
+    if (Xsk->Tx.Xdp.Queue != NULL && Xsk->Tx.Xdp.Flags.QueueActive &&
+        !Xsk->Tx.Xdp.RundownSyncStarted) {
+        ASSERT(Xsk->State > XskActive || Xsk->Failover.Migrating);
+        KeClearEvent(&Xsk->Tx.Xdp.OutstandingFlushComplete);
+        XdpTxQueueSyncStart(
+            Xsk->Tx.Xdp.Queue, &Xsk->Tx.Xdp.RundownSync, XskTxCompleteRundown, Xsk);
+        Xsk->Tx.Xdp.RundownSyncStarted = TRUE;
+    }
+}
+
+static
+VOID
+XskDetachTxIfWorker(
+    _In_ XDP_BINDING_WORKITEM *Item
+    )
+{
+    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
+    XSK *Xsk = WorkItem->Xsk;
+
+    XskDetachTxIf(Xsk);
+
+    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+}
+
+static
+FORCEINLINE
+BOOLEAN
+XskRxHeaderSplitEnabled(
+    _In_ const XSK *Xsk
+    )
+{
+    //
+    // Header split only applies to frames delivered across multiple chunks.
+    //
+    return Xsk->Rx.MultiBuffer && Xsk->Rx.HeaderSplitLength > 0;
+}
+
+static
+FORCEINLINE
+BOOLEAN
+XskRxCoalesceEnabled(
+    _In_ const XSK *Xsk
+    )
+{
+    //
+    // Coalesced frames are delivered across multiple chunks.
+    //
+    return Xsk->Rx.MultiBuffer && Xsk->Rx.CoalesceLength > 0;
+}
+
+static
+VOID
+XskBindRxIf(
+    _In_ XDP_BINDING_WORKITEM *Item
+    )
+{
+    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
+    XSK *Xsk = WorkItem->Xsk;
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    ASSERT(Xsk->Rx.Xdp.IfHandle == NULL);
+    Xsk->Rx.Xdp.IfHandle = WorkItem->IfWorkItem.BindingHandle;
+    Xsk->Rx.QueueId = WorkItem->QueueId;
+
+    Status =
+        XdpRxQueueFindOrCreate(
+            Xsk->Rx.Xdp.IfHandle, &Xsk->Rx.Xdp.HookId, WorkItem->QueueId, &Xsk->Rx.Xdp.Queue);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        XskDetachRxIf(Xsk);
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    WorkItem->CompletionStatus = Status;
+    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+}
+
+static
+VOID
+XskActivateCommitRxIf(
+    _In_ XDP_BINDING_WORKITEM *Item
+    )
+{
+    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
+    XSK *Xsk = WorkItem->Xsk;
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (Xsk->Rx.Xdp.IfHandle == NULL) {
+        ASSERT(Xsk->State > XskActive || Xsk->Failover.Migrating);
+        Status = STATUS_DELETE_PENDING;
+        goto Exit;
+    }
+
+    //
+    // Select the RX mode before the data path is attached. The XskRxZeroCopy
+    // test setting skips copying frame data into UMEM, unless header split or
+    // coalescing rearranges frames across chunks.
+    //
+    Xsk->Rx.ZeroCopy =
+        !XskRxHeaderSplitEnabled(Xsk) && !XskRxCoalesceEnabled(Xsk) && XskGlobals.RxZeroCopy;
+
+    if (Xsk->Rx.EbpfMapKeyValid) {
+        Status =
+            XdpRxQueueInsertEbpfXsk(Xsk->Rx.Xdp.Queue, Xsk->Rx.EbpfMapKey, (HANDLE)Xsk);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        Xsk->Rx.Xdp.Flags.EbpfMapInserted = TRUE;
+    }
+
+    XdpRxQueueRegisterNotifications(
+        Xsk->Rx.Xdp.Queue, &Xsk->Rx.Xdp.QueueNotificationEntry, XskNotifyRxQueue);
+    Xsk->Rx.Xdp.Flags.NotificationsRegistered = TRUE;
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    WorkItem->CompletionStatus = Status;
+    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+}
+
+static
+VOID
+XskBindTxIf(
+    _In_ XDP_BINDING_WORKITEM *Item
+    )
+{
+    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
+    XSK *Xsk = WorkItem->Xsk;
+    XDP_TX_QUEUE_CONFIG_ACTIVATE Config;
+    const XDP_TX_CAPABILITIES *InterfaceCapabilities;
+    XDP_EXTENSION_INFO ExtensionInfo;
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    ASSERT(Xsk->Tx.Xdp.IfHandle == NULL);
+    Xsk->Tx.Xdp.IfHandle = WorkItem->IfWorkItem.BindingHandle;
+
+    Status =
+        XdpTxQueueFindOrCreate(
+            Xsk->Tx.Xdp.IfHandle, &Xsk->Tx.Xdp.HookId, WorkItem->QueueId, &Xsk->Tx.Xdp.Queue);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    XdpTxQueueRegisterNotifications(
+        Xsk->Tx.Xdp.Queue, &Xsk->Tx.Xdp.QueueNotificationEntry, XskNotifyTxQueue);
+
+    InterfaceCapabilities = XdpTxQueueGetCapabilities(Xsk->Tx.Xdp.Queue);
+    Xsk->Tx.Xdp.MaxBufferLength = InterfaceCapabilities->MaximumBufferSize;
+    Xsk->Tx.Xdp.MaxFrameLength = InterfaceCapabilities->MaximumFrameSize;
+
+    Config = XdpTxQueueGetConfig(Xsk->Tx.Xdp.Queue);
+
+    Xsk->Tx.Xdp.Flags.OutOfOrderCompletion = XdpTxQueueIsOutOfOrderCompletionEnabled(Config);
+    Xsk->Tx.Xdp.Flags.CompletionContext = XdpTxQueueIsTxCompletionContextEnabled(Config);
+
+    Xsk->Tx.Xdp.FrameRing = XdpTxQueueGetFrameRing(Config);
+
+    if (Xsk->Tx.Xdp.Flags.CompletionContext) {
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_TX_FRAME_COMPLETION_CONTEXT_EXTENSION_NAME,
+            XDP_TX_FRAME_COMPLETION_CONTEXT_EXTENSION_VERSION_1,
+            XDP_EXTENSION_TYPE_FRAME);
+        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Tx.Xdp.FrameTxCompletionExtension);
+    }
+
+    if (Xsk->Tx.Xdp.Flags.OutOfOrderCompletion) {
+        Xsk->Tx.Xdp.CompletionRing = XdpTxQueueGetCompletionRing(Config);
+
+        if (Xsk->Tx.Xdp.Flags.CompletionContext) {
+            XdpInitializeExtensionInfo(
+                &ExtensionInfo, XDP_TX_FRAME_COMPLETION_CONTEXT_EXTENSION_NAME,
+                XDP_TX_FRAME_COMPLETION_CONTEXT_EXTENSION_VERSION_1,
+                XDP_EXTENSION_TYPE_TX_FRAME_COMPLETION);
+            XdpTxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Tx.Xdp.TxCompletionExtension);
+        }
+    }
+
+    Xsk->Tx.Xdp.Flags.VirtualAddressExt = XdpTxQueueIsVirtualAddressEnabled(Config);
+    if (Xsk->Tx.Xdp.Flags.VirtualAddressExt) {
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_BUFFER_EXTENSION_VIRTUAL_ADDRESS_NAME,
+            XDP_BUFFER_EXTENSION_VIRTUAL_ADDRESS_VERSION_1, XDP_EXTENSION_TYPE_BUFFER);
+        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Tx.Xdp.VaExtension);
+    }
+
+    Xsk->Tx.Xdp.Flags.LogicalAddressExt = XdpTxQueueIsLogicalAddressEnabled(Config);
+    if (Xsk->Tx.Xdp.Flags.LogicalAddressExt) {
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_BUFFER_EXTENSION_LOGICAL_ADDRESS_NAME,
+            XDP_BUFFER_EXTENSION_LOGICAL_ADDRESS_VERSION_1, XDP_EXTENSION_TYPE_BUFFER);
+        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Tx.Xdp.LaExtension);
+    }
+
+    Xsk->Tx.Xdp.Flags.MdlExt = XdpTxQueueIsMdlEnabled(Config);
+    if (Xsk->Tx.Xdp.Flags.MdlExt) {
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_BUFFER_EXTENSION_MDL_NAME,
+            XDP_BUFFER_EXTENSION_MDL_VERSION_1, XDP_EXTENSION_TYPE_BUFFER);
+        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Tx.Xdp.MdlExtension);
+    }
+
+    Xsk->Tx.Xdp.Flags.TimestampExt = XdpTxQueueIsTimestampEnabled(Config);
+    if (Xsk->Tx.Xdp.Flags.TimestampExt) {
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_FRAME_EXTENSION_TIMESTAMP_NAME,
+            XDP_FRAME_EXTENSION_TIMESTAMP_VERSION_1,
+            Xsk->Tx.Xdp.Flags.OutOfOrderCompletion ?
+                XDP_EXTENSION_TYPE_TX_FRAME_COMPLETION : XDP_EXTENSION_TYPE_FRAME);
+        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Tx.Xdp.TimestampExtension);
+    }
+
+    Xsk->Tx.Xdp.Flags.GsoExt = XdpTxQueueIsGsoEnabled(Config);
+    if (Xsk->Tx.Xdp.Flags.GsoExt) {
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_FRAME_EXTENSION_GSO_NAME,
+            XDP_FRAME_EXTENSION_GSO_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Tx.Xdp.GsoExtension);
+    }
+
+    Xsk->Tx.Xdp.Flags.ChecksumExt = XdpTxQueueIsChecksumEnabled(Config);
+    if (Xsk->Tx.Xdp.Flags.ChecksumExt) {
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_FRAME_EXTENSION_LAYOUT_NAME,
+            XDP_FRAME_EXTENSION_LAYOUT_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Tx.Xdp.LayoutExtension);
+
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_FRAME_EXTENSION_CHECKSUM_NAME,
+            XDP_FRAME_EXTENSION_CHECKSUM_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+        XdpTxQueueGetExtension(Config, &ExtensionInfo, &Xsk->Tx.Xdp.ChecksumExtension);
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        XskDetachTxIf(Xsk);
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    WorkItem->CompletionStatus = Status;
+    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+}
+
+static
+VOID
+XskActivateTxIf(
+    _In_ XDP_BINDING_WORKITEM *Item
+    )
+{
+    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
+    XSK *Xsk = WorkItem->Xsk;
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    ASSERT(Xsk->Tx.Ring.Size > 0);
+
+    if (Xsk->Tx.Xdp.Queue == NULL) {
+        ASSERT(Xsk->State > XskActive || Xsk->Failover.Migrating);
+        Status = STATUS_DELETE_PENDING;
+        goto Exit;
+    }
+
+    if (Xsk->Tx.Xdp.Flags.LogicalAddressExt) {
+        Status = XskSetupDma(Xsk);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    Status = XskAllocateTxBounceBuffer(Xsk);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    if (Xsk->Tx.Reorder.Enabled && Xsk->Tx.Xdp.Flags.OutOfOrderCompletion) {
+        //
+        // Frames are only posted while the completion ring has room for them,
+        // so the completion ring size bounds the frames in flight.
+        //
+        SIZE_T ReorderSize = sizeof(*Xsk->Tx.Reorder.Entries) * Xsk->Tx.CompletionRing.Size;
+
+        Status = XskChargeMemory(Xsk, XskMemoryOther, ReorderSize);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        Xsk->Tx.Reorder.Entries =
+            ExAllocatePoolZero(NonPagedPoolNx, ReorderSize, POOLTAG_TX_REORDER);
+        if (Xsk->Tx.Reorder.Entries == NULL) {
+            XskUnchargeMemory(Xsk, XskMemoryOther, ReorderSize);
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
+        Xsk->Tx.Reorder.Mask = Xsk->Tx.CompletionRing.Mask;
+        Xsk->Tx.Reorder.Head = 0;
+        Xsk->Tx.Reorder.Tail = 0;
+    }
+
+    Status =
+        XdpTxQueueAddDatapathClient(
+            Xsk->Tx.Xdp.Queue, &Xsk->Tx.Xdp.DatapathClientEntry,
+            XDP_TX_QUEUE_DATAPATH_CLIENT_TYPE_XSK);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Xsk->Tx.Xdp.Flags.QueueInserted = TRUE;
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        XskDeactivateTxIf(Xsk);
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    WorkItem->CompletionStatus = Status;
+    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+}
+
+static
+VOID
+XskActivateCommitTxIf(
+    _In_ XDP_BINDING_WORKITEM *Item
+    )
+{
+    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
+    XSK *Xsk = WorkItem->Xsk;
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    ASSERT(Xsk->Tx.Ring.Size > 0);
+
+    if (Xsk->Tx.Xdp.Queue == NULL) {
+        ASSERT(Xsk->State > XskActive || Xsk->Failover.Migrating);
+        Status = STATUS_DELETE_PENDING;
+        goto Exit;
+    }
+
+    RtlAcquirePushLockExclusive(&Xsk->PollLock);
+    Xsk->Tx.Xdp.Flags.QueueActive = TRUE;
+    RtlReleasePushLockExclusive(&Xsk->PollLock);
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    WorkItem->CompletionStatus = Status;
+    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+}
+
+static
+VOID
+XskUmemInitializeRegions(
+    _Inout_ UMEM *Umem
+    )
+{
+    ExInitializePushLock(&Umem->RegionLock);
+
+    for (UINT32 RegionId = 1; RegionId < RTL_NUMBER_OF(Umem->Regions); RegionId++) {
+        //
+        // Regions are absent until added, so start with run-down completed.
+        //
+        ExInitializeRundownProtection(&Umem->Regions[RegionId].Rundown);
+        ExWaitForRundownProtectionRelease(&Umem->Regions[RegionId].Rundown);
+        ExRundownCompleted(&Umem->Regions[RegionId].Rundown);
+    }
+}
+
+static
+VOID
+XskUmemFreeRegionMapping(
+    _Inout_ UMEM_REGION *Region
+    )
+{
+    MmUnlockPages(Region->Mapping.Mdl);
+    IoFreeMdl(Region->Mapping.Mdl);
+    RtlZeroMemory(&Region->Mapping, sizeof(Region->Mapping));
+    Region->Size = 0;
+}
+
+static
+VOID
+XskReferenceUmem(
+    UMEM *Umem
+    )
+{
+    XdpIncrementReferenceCount(&Umem->ReferenceCount);
+}
+
+static
+VOID
+XskDereferenceUmem(
+    UMEM *Umem
+    )
+{
+    if (XdpDecrementReferenceCount(&Umem->ReferenceCount)) {
+        TraceInfo(TRACE_XSK, "Destroying Umem=%p", Umem);
+
+        for (UINT32 RegionId = 1; RegionId < RTL_NUMBER_OF(Umem->Regions); RegionId++) {
+            if (Umem->Regions[RegionId].Size != 0) {
+                XskUmemFreeRegionMapping(&Umem->Regions[RegionId]);
+            }
+        }
+
+        if (Umem->KernelAllocated) {
+            if (Umem->Mapping.SystemAddress != NULL) {
+                MmUnmapLockedPages(Umem->Mapping.SystemAddress, Umem->Mapping.Mdl);
+            }
+            MmFreePagesFromMdl(Umem->Mapping.Mdl);
+            ExFreePool(Umem->Mapping.Mdl);
+        } else if (Umem->Mapping.Mdl != NULL) {
+            if (Umem->ReservedMapping != NULL) {
+                if (Umem->Mapping.SystemAddress != NULL) {
+                    MmUnmapReservedMapping(Umem->ReservedMapping, POOLTAG_UMEM, Umem->Mapping.Mdl);
+                }
+                MmFreeMappingAddress(Umem->ReservedMapping, POOLTAG_UMEM);
+            }
+            if (Umem->Mapping.Mdl->MdlFlags & MDL_PAGES_LOCKED) {
+                MmUnlockPages(Umem->Mapping.Mdl);
+            }
+            IoFreeMdl(Umem->Mapping.Mdl);
+        }
+        ExFreePoolWithTag(Umem, POOLTAG_UMEM);
+    }
+}
+
+static
+VOID
+XskReferenceSharedFillRing(
+    XSK_SHARED_FILL_RING *SharedFill
+    )
+{
+    XdpIncrementReferenceCount(&SharedFill->ReferenceCount);
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+XskDereferenceSharedFillRing(
+    XSK_SHARED_FILL_RING *SharedFill
+    )
+{
+    if (XdpDecrementReferenceCount(&SharedFill->ReferenceCount)) {
+        TraceInfo(TRACE_XSK, "Destroying SharedFill=%p", SharedFill);
+        XskFreeRing(&SharedFill->Ring);
+        ExFreePoolWithTag(SharedFill, POOLTAG_FILL);
+    }
+}
+
+static
+VOID
+XskReferenceSharedRxRing(
+    XSK_SHARED_RX_RING *SharedRx
+    )
+{
+    XdpIncrementReferenceCount(&SharedRx->ReferenceCount);
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+XskDereferenceSharedRxRing(
+    XSK_SHARED_RX_RING *SharedRx
+    )
+{
+    if (XdpDecrementReferenceCount(&SharedRx->ReferenceCount)) {
+        TraceInfo(TRACE_XSK, "Destroying SharedRx=%p", SharedRx);
+        XskFreeRing(&SharedRx->Ring);
+        ExFreePoolWithTag(SharedRx, POOLTAG_RING);
+    }
+}
+
+static
+VOID
+XskSetUmemMapping(
+    _Inout_ XSK *Xsk,
+    _In_ UMEM *Umem
+    )
+{
+    //
+    // Take ownership of the caller's UMEM reference.
+    //
+    Xsk->Umem = Umem;
+    Xsk->Tx.UmemMapping.Mdl = Umem->Mapping.Mdl;
+    Xsk->Tx.UmemMapping.SystemAddress = Umem->Mapping.SystemAddress;
+}
+
+//
+// Returns a reference to the socket's UMEM, or NULL if the socket has none.
+//
+static
+UMEM *
+XskReferenceSocketUmem(
+    _In_ XSK *Xsk
+    )
+{
+    UMEM *Umem;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    Umem = Xsk->Umem;
+    if (Umem != NULL) {
+        XskReferenceUmem(Umem);
+    }
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    return Umem;
+}
+
+static
+VOID
+XskDetachIf(
+    _In_ XSK *Xsk
+    )
+{
+    XSK_BINDING_WORKITEM TxWorkItem = {0};
+    XSK_BINDING_WORKITEM RxWorkItem = {0};
+    BOOLEAN TxDetachQueued = FALSE;
+    BOOLEAN RxDetachQueued = FALSE;
+    KIRQL OldIrql;
+
+    //
+    // Queue the TX and RX detach work items together so their data path syncs
+    // are started in the same binding worker batch, then wait for both.
+    //
+    KeInitializeEvent(&TxWorkItem.CompletionEvent, NotificationEvent, FALSE);
+    KeInitializeEvent(&RxWorkItem.CompletionEvent, NotificationEvent, FALSE);
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (Xsk->Tx.Xdp.IfHandle != NULL) {
+        TxWorkItem.Xsk = Xsk;
+        TxWorkItem.IfWorkItem.BindingHandle = Xsk->Tx.Xdp.IfHandle;
+        TxWorkItem.IfWorkItem.PrepareRoutine = XskDetachTxIfPrepare;
+        TxWorkItem.IfWorkItem.WorkRoutine = XskDetachTxIfWorker;
+        XdpIfQueueWorkItem(&TxWorkItem.IfWorkItem);
+        TxDetachQueued = TRUE;
+    }
+
+    if (Xsk->Rx.Xdp.IfHandle != NULL) {
+        RxWorkItem.Xsk = Xsk;
+        RxWorkItem.IfWorkItem.BindingHandle = Xsk->Rx.Xdp.IfHandle;
+        RxWorkItem.IfWorkItem.PrepareRoutine = XskDetachRxIfPrepare;
+        RxWorkItem.IfWorkItem.WorkRoutine = XskDetachRxIfWorker;
+        XdpIfQueueWorkItem(&RxWorkItem.IfWorkItem);
+        RxDetachQueued = TRUE;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    if (TxDetachQueued) {
+        KeWaitForSingleObject(
+            &TxWorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
+        ASSERT(Xsk->Tx.Xdp.IfHandle == NULL);
+    }
+
+    if (RxDetachQueued) {
+        KeWaitForSingleObject(
+            &RxWorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
+        ASSERT(Xsk->Rx.Xdp.IfHandle == NULL);
+    }
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+_IRQL_requires_same_
+NTSTATUS
+XskIrpClose(
+    _Inout_ IRP* Irp,
+    _Inout_ IO_STACK_LOCATION* IrpSp
+    )
+{
+    XSK *Xsk = IrpSp->FileObject->FsContext;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+    EventWriteXskCloseSocketStart(&MICROSOFT_XDP_PROVIDER, Xsk);
+
+    UNREFERENCED_PARAMETER(Irp);
+
+    ASSERT(Xsk->State == XskClosing);
+
+    XskDetachIf(Xsk);
+
+    XskPcwRemoveSocket(Xsk);
+
+    XskUnmapUserMapping(&Xsk->UmemUserMapping);
+    if (Xsk->Umem != NULL) {
+        XskDereferenceUmem(Xsk->Umem);
+    }
+
+    if (Xsk->Rx.SharedRx != NULL) {
+        XskDereferenceSharedRxRing(Xsk->Rx.SharedRx);
+    } else {
+        XskFreeRing(&Xsk->Rx.Ring);
+    }
+    XskFreeRing(&Xsk->Rx.PriorityRing);
+    if (Xsk->Rx.SharedFill != NULL) {
+        XskDereferenceSharedFillRing(Xsk->Rx.SharedFill);
+    } else {
+        XskFreeRing(&Xsk->Rx.FillRing);
+    }
+    if (Xsk->Rx.FillCache != NULL) {
+        ExFreePoolWithTag(Xsk->Rx.FillCache, POOLTAG_FILL);
+    }
+    XskFreeRing(&Xsk->Tx.Ring);
+    XskFreeRing(&Xsk->Tx.CompletionRing);
+    XskUnmapUserMapping(&Xsk->StatisticsPage.UserMapping);
+
+    //
+    // A shared fill ring or kernel allocated UMEM remains charged to the socket
+    // that created it until that socket is closed, even if other sockets still
+    // share it.
+    //
+    XskReleaseMemory(Xsk, XskMemoryRing);
+    XskReleaseMemory(Xsk, XskMemoryOther);
+    ASSERT(XskGetMemoryBytes(Xsk) == 0);
+
+    XskDereferenceInitial(Xsk);
+
+    EventWriteXskCloseSocketStop(&MICROSOFT_XDP_PROVIDER, Xsk);
+    TraceInfo(TRACE_XSK, "Xsk=%p Status=%!STATUS!", Xsk, STATUS_SUCCESS);
+    TraceExitSuccess(TRACE_XSK);
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XskIrpBindSocket(
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    XSK *Xsk = IrpSp->FileObject->FsContext;
+    XSK_BIND_IN Bind = {0};
+    XSK_BINDING_WORKITEM WorkItem = {0};
+    XSK_BINDING_WORKITEM RxWorkItem = {0}, TxWorkItem = {0};
+    KIRQL OldIrql;
+    XDP_INTERFACE_MODE *ModeFilter = NULL;
+    XDP_INTERFACE_MODE RequiredMode;
+    BOOLEAN BindIfInitiated = FALSE;
+    const UINT32 ValidFlags = XSK_BIND_FLAG_RX | XSK_BIND_FLAG_TX | XSK_BIND_FLAG_GENERIC | XSK_BIND_FLAG_NATIVE;
+
+    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(XSK_BIND_IN)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Bind = *(XSK_BIND_IN*)Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(
+        TRACE_XSK, "Xsk=%p IfIndex=%u QueueId=%u Flags=%x",
+        Xsk, Bind.IfIndex, Bind.QueueId, Bind.Flags);
+
+    if ((Bind.Flags & ~ValidFlags) ||
+        !RTL_IS_CLEAR_OR_SINGLE_FLAG(Bind.Flags, XSK_BIND_FLAG_GENERIC | XSK_BIND_FLAG_NATIVE) ||
+        (Bind.Flags & (XSK_BIND_FLAG_RX | XSK_BIND_FLAG_TX)) == 0) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    if (Bind.Flags & XSK_BIND_FLAG_GENERIC) {
+        RequiredMode = XDP_INTERFACE_MODE_GENERIC;
+        ModeFilter = &RequiredMode;
+    }
+
+    if (Bind.Flags & XSK_BIND_FLAG_NATIVE) {
+        RequiredMode = XDP_INTERFACE_MODE_NATIVE;
+        ModeFilter = &RequiredMode;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (Xsk->State != XskUnbound) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+        goto Exit;
+    }
+
+    Xsk->State = XskBinding;
+    BindIfInitiated = TRUE;
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    KeInitializeEvent(&WorkItem.CompletionEvent, SynchronizationEvent, FALSE);
+    KeInitializeEvent(&RxWorkItem.CompletionEvent, SynchronizationEvent, FALSE);
+    KeInitializeEvent(&TxWorkItem.CompletionEvent, SynchronizationEvent, FALSE);
+
+    //
+    // Resolve both interfaces before queueing any work, so the RX and TX
+    // queues are created in parallel: the bind work items are queued together
+    // and execute back-to-back on a shared interface worker, or concurrently
+    // if RX and TX resolve to different interfaces.
+    //
+    if (Bind.Flags & XSK_BIND_FLAG_RX) {
+        RxWorkItem.IfWorkItem.BindingHandle =
+            XdpIfFindAndReferenceBinding(Bind.IfIndex, &Xsk->Rx.Xdp.HookId, 1, ModeFilter);
+        if (RxWorkItem.IfWorkItem.BindingHandle == NULL) {
+            Status = STATUS_NOT_FOUND;
+            goto Exit;
+        }
+    }
+
+    if (Bind.Flags & XSK_BIND_FLAG_TX) {
+        TxWorkItem.IfWorkItem.BindingHandle =
+            XdpIfFindAndReferenceBinding(Bind.IfIndex, &Xsk->Tx.Xdp.HookId, 1, ModeFilter);
+        if (TxWorkItem.IfWorkItem.BindingHandle == NULL) {
+            if (RxWorkItem.IfWorkItem.BindingHandle != NULL) {
+                XdpIfDereferenceBinding(RxWorkItem.IfWorkItem.BindingHandle);
+            }
+            Status = STATUS_NOT_FOUND;
+            goto Exit;
+        }
+    }
+
+    if (RxWorkItem.IfWorkItem.BindingHandle != NULL) {
+        RxWorkItem.Xsk = Xsk;
+        RxWorkItem.QueueId = Bind.QueueId;
+        RxWorkItem.IfWorkItem.WorkRoutine = XskBindRxIf;
+        XdpIfQueueWorkItem(&RxWorkItem.IfWorkItem);
+    } else {
+        RxWorkItem.CompletionStatus = STATUS_SUCCESS;
+        KeSetEvent(&RxWorkItem.CompletionEvent, 0, FALSE);
+    }
+
+    if (TxWorkItem.IfWorkItem.BindingHandle != NULL) {
+        TxWorkItem.Xsk = Xsk;
+        TxWorkItem.QueueId = Bind.QueueId;
+        TxWorkItem.IfWorkItem.WorkRoutine = XskBindTxIf;
+        XdpIfQueueWorkItem(&TxWorkItem.IfWorkItem);
+    } else {
+        TxWorkItem.CompletionStatus = STATUS_SUCCESS;
+        KeSetEvent(&TxWorkItem.CompletionEvent, 0, FALSE);
+    }
+
+    KeWaitForSingleObject(&RxWorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
+    if (!NT_SUCCESS(RxWorkItem.CompletionStatus)) {
+        Status = RxWorkItem.CompletionStatus;
+    }
+
+    KeWaitForSingleObject(&TxWorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
+    if (NT_SUCCESS(Status) && !NT_SUCCESS(TxWorkItem.CompletionStatus)) {
+        Status = TxWorkItem.CompletionStatus;
+    }
+
+    if (NT_SUCCESS(Status)) {
+        //
+        // Record the binding so failover can rebind the socket in another mode.
+        //
+        Xsk->Failover.IfIndex = Bind.IfIndex;
+        Xsk->Failover.QueueId = Bind.QueueId;
+        Xsk->Failover.Rx = !!(Bind.Flags & XSK_BIND_FLAG_RX);
+        Xsk->Failover.Tx = !!(Bind.Flags & XSK_BIND_FLAG_TX);
+    }
+
+Exit:
+
+    if (!NT_SUCCESS(Status) && BindIfInitiated) {
+        KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+        if (Xsk->Tx.Xdp.IfHandle != NULL) {
+            WorkItem.Xsk = Xsk;
+            WorkItem.QueueId = Bind.QueueId;
+            WorkItem.IfWorkItem.WorkRoutine = XskDetachTxIfWorker;
+            WorkItem.IfWorkItem.BindingHandle = Xsk->Tx.Xdp.IfHandle;
+            XdpIfQueueWorkItem(&WorkItem.IfWorkItem);
+
+            KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+            KeWaitForSingleObject(&WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
+            ASSERT(Xsk->Tx.Xdp.IfHandle == NULL);
+
+            KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+        }
+
+        if (Xsk->Rx.Xdp.IfHandle != NULL) {
+            WorkItem.Xsk = Xsk;
+            WorkItem.QueueId = Bind.QueueId;
+            WorkItem.IfWorkItem.WorkRoutine = XskDetachRxIfWorker;
+            WorkItem.IfWorkItem.BindingHandle = Xsk->Rx.Xdp.IfHandle;
+            XdpIfQueueWorkItem(&WorkItem.IfWorkItem);
+
+            KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+            KeWaitForSingleObject(&WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
+            ASSERT(Xsk->Rx.Xdp.IfHandle == NULL);
+
+            KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+        }
+
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (BindIfInitiated) {
+        //
+        // N.B. Current synchronization allows the socket to be closed and state
+        // set to XskClosing while the bind is in progress. This is OK as socket
+        // cleanup will happen after all file object references are released and
+        // we currently are holding a reference to service this IOCTL. Do not
+        // overwrite the state in this case.
+        //
+        if (Xsk->State == XskBinding) {
+            if (NT_SUCCESS(Status)) {
+                Xsk->State = XskBound;
+            } else {
+                Xsk->State = XskUnbound;
+            }
+        }
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    TraceInfo(
+        TRACE_XSK, "Xsk=%p IfIndex=%u QueueId=%u Flags=%x Status=%!STATUS!",
+        Xsk, Bind.IfIndex, Bind.QueueId, Bind.Flags, Status);
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskIrpActivateSocket(
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    XSK *Xsk = IrpSp->FileObject->FsContext;
+    XSK_ACTIVATE_IN Activate = {0};
+    XSK_BINDING_WORKITEM RxWorkItem = {0}, TxWorkItem = {0};
+    KIRQL OldIrql;
+    BOOLEAN ActivateIfInitiated = FALSE;
+    BOOLEAN ActivateIfCommitted = FALSE;
+
+    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(Activate)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Activate = *(XSK_ACTIVATE_IN *)Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p Flags=%x", Xsk, Activate.Flags);
+
+    if (Activate.Flags != 0) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (Xsk->Umem == NULL) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+        goto Exit;
+    }
+    if (Xsk->State != XskBound) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+        goto Exit;
+    }
+    if (Xsk->Rx.Xdp.Queue != NULL &&
+        (Xsk->Rx.Ring.Size == 0 || Xsk->Rx.FillRing.Size == 0)) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+        goto Exit;
+    }
+    if (Xsk->Rx.SharedRx != NULL && Xsk->Rx.MultiBuffer) {
+        //
+        // Multi-buffer frames reserve RX ring entries as they are received,
+        // which sharing sockets cannot do.
+        //
+        Status = STATUS_NOT_SUPPORTED;
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+        goto Exit;
+    }
+    if (Xsk->Tx.Xdp.Queue != NULL &&
+        (Xsk->Tx.Ring.Size == 0 || Xsk->Tx.CompletionRing.Size == 0)) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+        goto Exit;
+    }
+
+    Xsk->State = XskActivating;
+    ActivateIfInitiated = TRUE;
+
+    KeInitializeEvent(&RxWorkItem.CompletionEvent, SynchronizationEvent, FALSE);
+    KeInitializeEvent(&TxWorkItem.CompletionEvent, SynchronizationEvent, FALSE);
+
+    if (Xsk->Tx.Xdp.IfHandle != NULL) {
+        TxWorkItem.Xsk = Xsk;
+        TxWorkItem.IfWorkItem.WorkRoutine = XskActivateTxIf;
+        TxWorkItem.IfWorkItem.BindingHandle = Xsk->Tx.Xdp.IfHandle;
+
+        XdpIfQueueWorkItem(&TxWorkItem.IfWorkItem);
+
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+        KeWaitForSingleObject(&TxWorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
+        Status = TxWorkItem.CompletionStatus;
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    }
+
+    //
+    // The RX and TX queues have been configured as far as possible without
+    // observably activating the data path. We are now committed to activation
+    // or terminal failure; the XSK can no longer be reverted to XskBound state.
+    //
+
+    ActivateIfCommitted = TRUE;
+
+    if (Xsk->State != XskActivating) {
+        Status = STATUS_DELETE_PENDING;
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+        goto Exit;
+    }
+
+    if (Xsk->Tx.Xdp.IfHandle != NULL) {
+        TxWorkItem.Xsk = Xsk;
+        TxWorkItem.IfWorkItem.WorkRoutine = XskActivateCommitTxIf;
+        TxWorkItem.IfWorkItem.BindingHandle = Xsk->Tx.Xdp.IfHandle;
+
+        XdpIfQueueWorkItem(&TxWorkItem.IfWorkItem);
+    } else {
+        TxWorkItem.CompletionStatus = STATUS_SUCCESS;
+        KeSetEvent(&TxWorkItem.CompletionEvent, 0, FALSE);
+    }
+
+    if (Xsk->Rx.Xdp.IfHandle != NULL) {
+        RxWorkItem.Xsk = Xsk;
+        RxWorkItem.IfWorkItem.WorkRoutine = XskActivateCommitRxIf;
+        RxWorkItem.IfWorkItem.BindingHandle = Xsk->Rx.Xdp.IfHandle;
+
+        XdpIfQueueWorkItem(&RxWorkItem.IfWorkItem);
+    } else {
+        RxWorkItem.CompletionStatus = STATUS_SUCCESS;
+        KeSetEvent(&RxWorkItem.CompletionEvent, 0, FALSE);
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    KeWaitForSingleObject(&TxWorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
+    if (!NT_SUCCESS(TxWorkItem.CompletionStatus)) {
+        Status = TxWorkItem.CompletionStatus;
+    }
+
+    KeWaitForSingleObject(&RxWorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
+    if (!NT_SUCCESS(RxWorkItem.CompletionStatus)) {
+        Status = RxWorkItem.CompletionStatus;
+    }
+
+Exit:
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    //
+    // Once we committed to XSK activation, any failure to activate implies the
+    // socket is already in a terminal state.
+    //
+    if (ActivateIfCommitted) {
+        ASSERT(NT_SUCCESS(Status) || Xsk->State > XskActive);
+    }
+
+    if (ActivateIfInitiated) {
+        //
+        // N.B. XSK synchronization allows the socket to be closed and state set
+        // to XskClosing while activation is in progress. This is OK as socket
+        // cleanup will happen after all file object references are released and
+        // we currently are holding a reference to service this IOCTL. Do not
+        // overwrite the state in this case.
+        //
+
+        if (Xsk->State == XskActivating) {
+            if (NT_SUCCESS(Status)) {
+                Xsk->State = XskActive;
+            } else {
+                Xsk->State = XskBound;
+            }
+        }
+    }
+
+    if (NT_SUCCESS(Status)) {
+        if (Xsk->Rx.Xdp.IfHandle != NULL) {
+            Xsk->PcwIfIndex = XdpIfGetIfIndex(Xsk->Rx.Xdp.IfHandle);
+        } else if (Xsk->Tx.Xdp.IfHandle != NULL) {
+            Xsk->PcwIfIndex = XdpIfGetIfIndex(Xsk->Tx.Xdp.IfHandle);
+        }
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    if (NT_SUCCESS(Status)) {
+        XskPcwInsertSocket(Xsk);
+    }
+
+    if (NT_SUCCESS(Status) &&
+        (Xsk->Tx.RateLimit.Enabled || Xsk->Tx.LaunchTime || Xsk->Tx.PokeLingerQpc > 0)) {
+        //
+        // Pacing options are fixed once activation begins, so start pacing.
+        //
+        (VOID)XdpTimerStart(Xsk->Tx.PaceTimer, XSK_TX_PACE_TIMER_MS, NULL);
+    }
+
+    TraceInfo(TRACE_XSK, "Xsk=%p Flags=%x Status=%!STATUS!", Xsk, Activate.Flags, Status);
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+VOID
+XskFailoverHoldWorker(
+    _In_ XDP_BINDING_WORKITEM *Item
+    )
+{
+    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
+
+    WorkItem->CompletionStatus = XdpIfReferenceProvider(Item->BindingHandle);
+    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+}
+
+static
+VOID
+XskFailoverReleaseWorker(
+    _In_ XDP_BINDING_WORKITEM *Item
+    )
+{
+    XSK_BINDING_WORKITEM *WorkItem = (XSK_BINDING_WORKITEM *)Item;
+
+    XdpIfDereferenceProvider(Item->BindingHandle);
+    WorkItem->CompletionStatus = STATUS_SUCCESS;
+    KeSetEvent(&WorkItem->CompletionEvent, 0, FALSE);
+}
+
+static
+NTSTATUS
+XskFailoverInvoke(
+    _In_ XSK *Xsk,
+    _In_ XDP_BINDING_HANDLE BindingHandle,
+    _In_ XDP_BINDING_WORK_ROUTINE *WorkRoutine
+    )
+{
+    XSK_BINDING_WORKITEM WorkItem = {0};
+
+    KeInitializeEvent(&WorkItem.CompletionEvent, NotificationEvent, FALSE);
+    WorkItem.Xsk = Xsk;
+    WorkItem.QueueId = Xsk->Failover.QueueId;
+    WorkItem.IfWorkItem.BindingHandle = BindingHandle;
+    WorkItem.IfWorkItem.WorkRoutine = WorkRoutine;
+    XdpIfQueueWorkItem(&WorkItem.IfWorkItem);
+
+    KeWaitForSingleObject(&WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
+
+    return WorkItem.CompletionStatus;
+}
+
+static
+NTSTATUS
+XskFailoverMigrate(
+    _In_ XSK *Xsk,
+    _In_ XDP_INTERFACE_MODE Mode
+    )
+{
+    NTSTATUS Status;
+    XDP_BINDING_HANDLE RxBinding = NULL;
+    XDP_BINDING_HANDLE TxBinding = NULL;
+    BOOLEAN RxHeld = FALSE;
+    BOOLEAN TxHeld = FALSE;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p Mode=%!XDP_MODE!", Xsk, Mode);
+
+    //
+    // Hold the target interfaces open before leaving the current ones, so a
+    // probe for an absent interface does not disturb the data path.
+    //
+    if (Xsk->Failover.Rx) {
+        RxBinding =
+            XdpIfFindAndReferenceBinding(
+                Xsk->Failover.IfIndex, &Xsk->Rx.Xdp.HookId, 1, &Mode);
+        if (RxBinding == NULL) {
+            Status = STATUS_NOT_FOUND;
+            goto Exit;
+        }
+
+        Status = XskFailoverInvoke(Xsk, RxBinding, XskFailoverHoldWorker);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        RxHeld = TRUE;
+    }
+
+    if (Xsk->Failover.Tx) {
+        TxBinding =
+            XdpIfFindAndReferenceBinding(
+                Xsk->Failover.IfIndex, &Xsk->Tx.Xdp.HookId, 1, &Mode);
+        if (TxBinding == NULL) {
+            Status = STATUS_NOT_FOUND;
+            goto Exit;
+        }
+
+        Status = XskFailoverInvoke(Xsk, TxBinding, XskFailoverHoldWorker);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        TxHeld = TRUE;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    if (Xsk->State != XskActive) {
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+        Status = STATUS_DELETE_PENDING;
+        goto Exit;
+    }
+    Xsk->Failover.Migrating = TRUE;
+    Xsk->Failover.DetachPending = FALSE;
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    XskDetachIf(Xsk);
+
+    //
+    // The bind routines consume a binding reference, even on failure.
+    //
+    if (RxBinding != NULL) {
+        XdpIfReferenceBinding(RxBinding);
+        Status = XskFailoverInvoke(Xsk, RxBinding, XskBindRxIf);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    if (TxBinding != NULL) {
+        XdpIfReferenceBinding(TxBinding);
+        Status = XskFailoverInvoke(Xsk, TxBinding, XskBindTxIf);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        Status = XskFailoverInvoke(Xsk, TxBinding, XskActivateTxIf);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        Status = XskFailoverInvoke(Xsk, TxBinding, XskActivateCommitTxIf);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    if (RxBinding != NULL) {
+        Status = XskFailoverInvoke(Xsk, RxBinding, XskActivateCommitRxIf);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    //
+    // Keep migrating if an interface detached while the socket was moving:
+    // the detach notification has already rearmed the failover timer.
+    //
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    if (!Xsk->Failover.DetachPending) {
+        Xsk->Failover.Migrating = FALSE;
+    }
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (TxHeld) {
+        (VOID)XskFailoverInvoke(Xsk, TxBinding, XskFailoverReleaseWorker);
+    }
+
+    if (TxBinding != NULL) {
+        XdpIfDereferenceBinding(TxBinding);
+    }
+
+    if (RxHeld) {
+        (VOID)XskFailoverInvoke(Xsk, RxBinding, XskFailoverReleaseWorker);
+    }
+
+    if (RxBinding != NULL) {
+        XdpIfDereferenceBinding(RxBinding);
+    }
+
+    TraceInfo(TRACE_XSK, "Xsk=%p Mode=%!XDP_MODE! Status=%!STATUS!", Xsk, Mode, Status);
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+VOID
+XskFailoverAbort(
+    _In_ XSK *Xsk
+    )
+{
+    KIRQL OldIrql;
+
+    TraceInfo(TRACE_XSK, "Xsk=%p failover failed", Xsk);
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    if (Xsk->State == XskActive) {
+        Xsk->State = XskDetached;
+    }
+    Xsk->Failover.Migrating = FALSE;
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    XskDetachIf(Xsk);
+
+    //
+    // Handles released during the failed migration did not set ring errors.
+    //
+    if (Xsk->Failover.Rx) {
+        XskKernelRingSetError(&Xsk->Rx.PriorityRing, XSK_ERROR_INTERFACE_DETACH);
+        if (Xsk->Rx.SharedRx == NULL) {
+            XskKernelRingSetError(&Xsk->Rx.Ring, XSK_ERROR_INTERFACE_DETACH);
+        }
+        if (Xsk->Rx.SharedFill == NULL) {
+            XskKernelRingSetError(&Xsk->Rx.FillRing, XSK_ERROR_INTERFACE_DETACH);
+        }
+    }
+
+    if (Xsk->Failover.Tx) {
+        XskKernelRingSetError(&Xsk->Tx.Ring, XSK_ERROR_INTERFACE_DETACH);
+        XskKernelRingSetError(&Xsk->Tx.CompletionRing, XSK_ERROR_INTERFACE_DETACH);
+    }
+}
+
+static WORKER_THREAD_ROUTINE XskFailoverTimeout;
+
+static
+_Use_decl_annotations_
+VOID
+XskFailoverTimeout(
+    VOID *Context
+    )
+{
+    XSK *Xsk = Context;
+    NTSTATUS Status;
+
+    if (ReadNoFence((LONG *)&Xsk->State) != XskActive) {
+        return;
+    }
+
+    if (ReadBooleanNoFence(&Xsk->Failover.Migrating)) {
+        //
+        // The native interface detached, so move to the generic interface.
+        //
+        Status = XskFailoverMigrate(Xsk, XDP_INTERFACE_MODE_GENERIC);
+        if (!NT_SUCCESS(Status)) {
+            XskFailoverAbort(Xsk);
+            return;
+        }
+
+        Xsk->Failover.FailedOver = TRUE;
+    } else if (Xsk->Failover.FailedOver) {
+        //
+        // Probe for the native interface. The probe leaves the generic data
+        // path untouched unless the native interface can be opened.
+        //
+        Status = XskFailoverMigrate(Xsk, XDP_INTERFACE_MODE_NATIVE);
+        if (NT_SUCCESS(Status)) {
+            Xsk->Failover.FailedOver = FALSE;
+        } else if (ReadBooleanNoFence(&Xsk->Failover.Migrating)) {
+            Status = XskFailoverMigrate(Xsk, XDP_INTERFACE_MODE_GENERIC);
+            if (!NT_SUCCESS(Status)) {
+                XskFailoverAbort(Xsk);
+                return;
+            }
+        }
+    }
+
+    if (Xsk->Failover.FailedOver && !ReadBooleanNoFence(&Xsk->Failover.Migrating)) {
+        XskFailoverArmTimer(Xsk, XSK_FAILOVER_PROBE_INTERVAL_MS);
+    }
+}
+
+static
+NTSTATUS
+XskSockoptGetStatistics(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    XSK_STATISTICS *Statistics;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(XSK_STATISTICS)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Statistics = (XSK_STATISTICS*)Irp->AssociatedIrp.SystemBuffer;
+    RtlZeroMemory(Statistics, sizeof(*Statistics));
+
+    *Statistics = *Xsk->Statistics;
+
+    Status = STATUS_SUCCESS;
+    Irp->IoStatus.Information = sizeof(*Statistics);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+UINT32
+XskKernelRingGetUsed(
+    _In_ const XSK_KERNEL_RING *Ring
+    )
+{
+    if (Ring->Shared == NULL) {
+        return 0;
+    }
+
+    //
+    // The application controls one of the indexes, so clamp the result.
+    //
+    return
+        min(
+            Ring->Size,
+            ReadUInt32NoFence(&Ring->Shared->ProducerIndex) -
+                ReadUInt32NoFence(&Ring->Shared->ConsumerIndex));
+}
+
+static
+NTSTATUS
+XskSockoptGetStatisticsEx(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    XSK_STATISTICS_EX *Statistics;
+    UINT32 OutputBufferLength = IrpSp->Parameters.DeviceIoControl.OutputBufferLength;
+    UINT32 Revision;
+    UINT32 Size;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (OutputBufferLength >= XSK_SIZEOF_STATISTICS_EX_REVISION_3) {
+        Revision = XSK_STATISTICS_EX_REVISION_3;
+        Size = XSK_SIZEOF_STATISTICS_EX_REVISION_3;
+    } else if (OutputBufferLength >= XSK_SIZEOF_STATISTICS_EX_REVISION_2) {
+        Revision = XSK_STATISTICS_EX_REVISION_2;
+        Size = XSK_SIZEOF_STATISTICS_EX_REVISION_2;
+    } else if (OutputBufferLength >= XSK_SIZEOF_STATISTICS_EX_REVISION_1) {
+        Revision = XSK_STATISTICS_EX_REVISION_1;
+        Size = XSK_SIZEOF_STATISTICS_EX_REVISION_1;
+    } else {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Statistics = (XSK_STATISTICS_EX*)Irp->AssociatedIrp.SystemBuffer;
+    RtlZeroMemory(Statistics, Size);
+
+    Statistics->Header.Revision = Revision;
+    Statistics->Header.Size = Size;
+    Statistics->Statistics = *Xsk->Statistics;
+
+    for (UINT32 Index = 0; Index < Xsk->ProcessorCount; Index++) {
+        const XSK_PROCESSOR_STATISTICS *Processor = &Xsk->ProcessorStatistics[Index];
+
+        Statistics->RxFillRingEmpty += ReadUInt64NoFence(&Processor->RxFillRingEmpty);
+        Statistics->RxRingFull += ReadUInt64NoFence(&Processor->RxRingFull);
+        Statistics->RxFillNeedPoke += ReadUInt64NoFence(&Processor->RxFillNeedPoke);
+        Statistics->TxNeedPoke += ReadUInt64NoFence(&Processor->TxNeedPoke);
+        Statistics->RxPokes += ReadUInt64NoFence(&Processor->RxPokes);
+        Statistics->TxPokes += ReadUInt64NoFence(&Processor->TxPokes);
+        Statistics->TxBounceFailures += ReadUInt64NoFence(&Processor->TxBounceFailures);
+    }
+
+    Statistics->RxRingUsed = XskKernelRingGetUsed(&Xsk->Rx.Ring);
+    Statistics->RxFillRingUsed = XskKernelRingGetUsed(&Xsk->Rx.FillRing);
+    Statistics->TxRingUsed = XskKernelRingGetUsed(&Xsk->Tx.Ring);
+    Statistics->TxCompletionRingUsed = XskKernelRingGetUsed(&Xsk->Tx.CompletionRing);
+
+    if (Revision >= XSK_STATISTICS_EX_REVISION_2) {
+        Statistics->TxFramesScheduled =
+            ReadUInt64NoFence(&Xsk->Tx.Xdp.DatapathClientEntry.FramesFilled);
+        Statistics->TxQuantumExhausted =
+            ReadUInt64NoFence(&Xsk->Tx.Xdp.DatapathClientEntry.QuantumExhausted);
+    }
+
+    if (Revision >= XSK_STATISTICS_EX_REVISION_3) {
+        Statistics->TxCompletionsReordered = ReadUInt64NoFence(&Xsk->Tx.Reorder.Reordered);
+        Statistics->TxCompletionReorderDepthMax = ReadUInt32NoFence(&Xsk->Tx.Reorder.DepthMax);
+    }
+
+    Status = STATUS_SUCCESS;
+    Irp->IoStatus.Information = Size;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+VOID
+XskFillRingInfo(
+    _In_ XSK_KERNEL_RING *Ring,
+    _Out_ XSK_RING_INFO *Info
+    )
+{
+    ASSERT(Ring->Mdl != NULL);
+    ASSERT(Ring->Shared != NULL);
+    ASSERT(Ring->Size != 0);
+
+    //
+    // Kernel mode sockets access their rings via the system address.
+    //
+    Info->Ring = (Ring->UserVa != NULL) ? Ring->UserVa : (BYTE *)Ring->Shared;
+    Info->DescriptorsOffset = sizeof(XSK_SHARED_RING);
+    Info->ProducerIndexOffset = FIELD_OFFSET(XSK_SHARED_RING, ProducerIndex);
+    Info->ConsumerIndexOffset = FIELD_OFFSET(XSK_SHARED_RING, ConsumerIndex);
+    Info->FlagsOffset = FIELD_OFFSET(XSK_SHARED_RING, Flags);
+    Info->Size = Ring->Size;
+    Info->ElementStride = Ring->ElementStride;
+}
+
+static
+NTSTATUS
+XskSockoptGetRingInfo(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    KIRQL OldIrql = {0};
+    BOOLEAN IsLockHeld = FALSE;
+    XSK_RING_INFO_SET *InfoSet = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(XSK_RING_INFO_SET)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    RtlZeroMemory(InfoSet, sizeof(*InfoSet));
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    IsLockHeld = TRUE;
+
+    if (Xsk->State == XskClosing) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    if (Xsk->Rx.Ring.Size != 0) {
+        XskFillRingInfo(&Xsk->Rx.Ring, &InfoSet->Rx);
+    }
+    if (Xsk->Rx.FillRing.Size != 0) {
+        XskFillRingInfo(&Xsk->Rx.FillRing, &InfoSet->Fill);
+    }
+    if (Xsk->Tx.Ring.Size != 0) {
+        XskFillRingInfo(&Xsk->Tx.Ring, &InfoSet->Tx);
+    }
+    if (Xsk->Tx.CompletionRing.Size != 0) {
+        XskFillRingInfo(&Xsk->Tx.CompletionRing, &InfoSet->Completion);
+    }
+
+    Status = STATUS_SUCCESS;
+    Irp->IoStatus.Information = sizeof(*InfoSet);
+
+Exit:
+
+    if (IsLockHeld) {
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetRxPriorityRingInfo(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    KIRQL OldIrql;
+    XSK_RING_INFO *Info = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Info)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    RtlZeroMemory(Info, sizeof(*Info));
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (Xsk->State == XskClosing || Xsk->Rx.PriorityRing.Size == 0) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        XskFillRingInfo(&Xsk->Rx.PriorityRing, Info);
+        Irp->IoStatus.Information = sizeof(*Info);
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetStatisticsPage(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    XSK_STATISTICS_PAGE_INFO *Info = Irp->AssociatedIrp.SystemBuffer;
+    VOID *Page;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Info)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    RtlZeroMemory(Info, sizeof(*Info));
+
+    Status =
+        XskMapUserMapping(
+            Xsk, &Xsk->StatisticsPage.UserMapping, Xsk->StatisticsPage.Page,
+            Xsk->StatisticsPage.Size, NULL, Irp->RequestorMode, &Page);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Info->Page = Page;
+    Info->Size = Xsk->StatisticsPage.Size;
+
+    Irp->IoStatus.Information = sizeof(*Info);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetUmemMapping(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    VOID **Address = Irp->AssociatedIrp.SystemBuffer;
+    UMEM *Umem = NULL;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Address)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    //
+    // UMEMs registered from application memory are already mapped into the
+    // registering process.
+    //
+    Umem = XskReferenceSocketUmem(Xsk);
+    if (Umem == NULL || !Umem->KernelAllocated) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    Status =
+        XskMapUserMapping(
+            Xsk, &Xsk->UmemUserMapping, Umem->Mapping.SystemAddress,
+            MmGetMdlByteCount(Umem->Mapping.Mdl), Umem->Mapping.Mdl, Irp->RequestorMode,
+            Address);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Irp->IoStatus.Information = sizeof(*Address);
+
+Exit:
+
+    if (Umem != NULL) {
+        XskDereferenceUmem(Umem);
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+BOOLEAN
+XskIsLargePageMdl(
+    _In_ MDL *Mdl
+    )
+{
+    PFN_NUMBER *Pfns = MmGetMdlPfnArray(Mdl);
+    SIZE_T PageCount =
+        ADDRESS_AND_SIZE_TO_SPAN_PAGES(MmGetMdlVirtualAddress(Mdl), MmGetMdlByteCount(Mdl));
+
+    //
+    // Each large page is a naturally aligned, physically contiguous run of
+    // small pages.
+    //
+    for (SIZE_T Index = 0; Index < PageCount; Index++) {
+        if (Index % XSK_LARGE_PAGE_PFNS == 0) {
+            if (Pfns[Index] % XSK_LARGE_PAGE_PFNS != 0) {
+                return FALSE;
+            }
+        } else if (Pfns[Index] != Pfns[Index - 1] + 1) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static
+NTSTATUS
+XskSockoptSetUmem(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _In_ BOOLEAN Allocate
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    UMEM *Umem = NULL;
+    BOOLEAN LargePages = Xsk->LargePages;
+    BOOLEAN AlignedChunks = Xsk->AlignedChunks;
+    KIRQL OldIrql = {0};
+    BOOLEAN IsLockHeld = FALSE;
+    SIZE_T ChargedSize = 0;
+    PHYSICAL_ADDRESS LowAddress = {0};
+    PHYSICAL_ADDRESS HighAddress;
+    PHYSICAL_ADDRESS SkipBytes = {0};
+
+    TraceEnter(TRACE_XSK, "Xsk=%p Allocate=%!BOOLEAN!", Xsk, Allocate);
+
+    HighAddress.QuadPart = MAXLONG64;
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(XSK_UMEM_REG)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Umem = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Umem), POOLTAG_UMEM);
+    if (Umem == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Exit;
+    }
+
+    XdpInitializeReferenceCount(&Umem->ReferenceCount);
+    XskUmemInitializeRegions(Umem);
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength,
+                PROBE_ALIGNMENT(XSK_UMEM_REG));
+        }
+        RtlCopyVolatileMemory(&Umem->Reg, SockoptInputBuffer, sizeof(XSK_UMEM_REG));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if (Umem->Reg.TotalSize == 0 || Umem->Reg.TotalSize > MAXULONG) {
+        // TODO: support up to MAXUINT64?
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+    if (Allocate && (Umem->Reg.Address != NULL || LargePages)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+    if (Umem->Reg.Headroom > MAXUINT16 ||
+        Umem->Reg.Headroom > Umem->Reg.ChunkSize ||
+        Umem->Reg.ChunkSize > Umem->Reg.TotalSize ||
+        Umem->Reg.ChunkSize == 0) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+    if (AlignedChunks &&
+        (!RTL_IS_POWER_OF_TWO(Umem->Reg.ChunkSize) ||
+            (ULONG_PTR)Umem->Reg.Address % Umem->Reg.ChunkSize != 0)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+    if (LargePages &&
+        ((ULONG_PTR)Umem->Reg.Address % XSK_LARGE_PAGE_SIZE != 0 ||
+            Umem->Reg.TotalSize % XSK_LARGE_PAGE_SIZE != 0)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    if (Allocate) {
+        //
+        // Charge the memory before allocating it. The charge is released when
+        // the socket is closed.
+        //
+        Status = XskChargeMemory(Xsk, XskMemoryOther, (SIZE_T)Umem->Reg.TotalSize);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        ChargedSize = (SIZE_T)Umem->Reg.TotalSize;
+
+        Umem->Mapping.Mdl =
+            MmAllocatePagesForMdlEx(
+                LowAddress, HighAddress, SkipBytes, (SIZE_T)Umem->Reg.TotalSize, MmCached,
+                MM_ALLOCATE_FULLY_REQUIRED);
+        if (Umem->Mapping.Mdl == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
+        Umem->KernelAllocated = TRUE;
+
+        Umem->Mapping.SystemAddress =
+            MmMapLockedPagesSpecifyCache(
+                Umem->Mapping.Mdl,
+                KernelMode,
+                MmCached,
+                NULL, // RequestedAddress
+                FALSE,// BugCheckOnFailure
+                NormalPagePriority | MdlMappingNoExecute);
+        if (Umem->Mapping.SystemAddress == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
+    } else {
+        Umem->Mapping.Mdl =
+            IoAllocateMdl(
+                Umem->Reg.Address,
+                (ULONG)Umem->Reg.TotalSize,
+                FALSE, // SecondaryBuffer
+                FALSE, // ChargeQuota
+                NULL); // Irp
+        if (Umem->Mapping.Mdl == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
+
+        __try {
+            MmProbeAndLockPages(Umem->Mapping.Mdl, RequestorMode, IoWriteAccess);
+        } __except (EXCEPTION_EXECUTE_HANDLER) {
+            Status = GetExceptionCode();
+            goto Exit;
+        }
+
+        if (LargePages && !XskIsLargePageMdl(Umem->Mapping.Mdl)) {
+            TraceError(TRACE_XSK, "Xsk=%p UMEM is not backed by large pages", Xsk);
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+
+        //
+        // MmGetSystemAddressForMdlSafe and MmMapLockedPagesSpecifyCache do not
+        // preserve large pages in system address mappings. Use the reserved MDL
+        // mapping routines to ensure large pages are propagated into the kernel.
+        // Note that the reserved mapping allocates the mapping size based on best-
+        // case page-aligned buffers, so account for the MDL offset, too.
+        //
+        Umem->ReservedMapping =
+            MmAllocateMappingAddress(
+                BYTE_OFFSET(Umem->Reg.Address) + Umem->Reg.TotalSize, POOLTAG_UMEM);
+        if (Umem->ReservedMapping == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
+
+        Umem->Mapping.SystemAddress =
+            MmMapLockedPagesWithReservedMapping(
+                Umem->ReservedMapping, POOLTAG_UMEM, Umem->Mapping.Mdl, MmCached);
+        if (Umem->Mapping.SystemAddress == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
+    }
+
+    if (Umem->Reg.TotalSize % Umem->Reg.ChunkSize != 0) {
+        //
+        // The final chunk is truncated, which might be required for alignment
+        // reasons. Ignore the final chunk.
+        //
+        ASSERT(Umem->Reg.TotalSize > Umem->Reg.ChunkSize);
+        Umem->Reg.TotalSize -= (Umem->Reg.TotalSize % Umem->Reg.ChunkSize);
+    }
+
+    if (AlignedChunks) {
+        Umem->AlignedChunks = TRUE;
+        Umem->ChunkShift = (UINT8)RtlFindMostSignificantBit(Umem->Reg.ChunkSize);
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    IsLockHeld = TRUE;
+
+    if (Xsk->State != XskUnbound) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+    if (Xsk->Umem != NULL || Xsk->LargePages != LargePages ||
+        Xsk->AlignedChunks != AlignedChunks) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    TraceInfo(
+        TRACE_XSK, "Xsk=%p Set Umem=%p TotalSize=%llu ChunkSize=%llu Headroom=%u",
+        Xsk, Umem, Umem->Reg.TotalSize, Umem->Reg.ChunkSize, Umem->Reg.Headroom);
+
+    Status = STATUS_SUCCESS;
+    XskSetUmemMapping(Xsk, Umem);
+    Umem = NULL;
+
+Exit:
+
+    if (IsLockHeld) {
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    }
+    if (Umem != NULL) {
+        XskDereferenceUmem(Umem);
+        if (ChargedSize != 0) {
+            XskUnchargeMemory(Xsk, XskMemoryOther, ChargedSize);
+        }
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetSharedUmem(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    HANDLE SharedHandle;
+    FILE_OBJECT *FileObject = NULL;
+    XSK *SharedXsk;
+    UMEM *Umem = NULL;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(SharedHandle)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(HANDLE));
+        }
+        RtlCopyVolatileMemory(&SharedHandle, SockoptInputBuffer, sizeof(SharedHandle));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    Status =
+        XdpReferenceObjectByHandle(
+            SharedHandle, XDP_OBJECT_TYPE_XSK, RequestorMode, FILE_GENERIC_WRITE, &FileObject);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    SharedXsk = FileObject->FsContext;
+    if (SharedXsk == Xsk) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&SharedXsk->Lock, &OldIrql);
+    Umem = SharedXsk->Umem;
+    if (Umem != NULL) {
+        XskReferenceUmem(Umem);
+    }
+    KeReleaseSpinLock(&SharedXsk->Lock, OldIrql);
+
+    if (Umem == NULL) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (Xsk->State != XskUnbound || Xsk->Umem != NULL) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        TraceInfo(
+            TRACE_XSK, "Xsk=%p Set shared Umem=%p SharedXsk=%p", Xsk, Umem, SharedXsk);
+
+        XskSetUmemMapping(Xsk, Umem);
+        Umem = NULL;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    if (Umem != NULL) {
+        XskDereferenceUmem(Umem);
+    }
+    if (FileObject != NULL) {
+        ObDereferenceObject(FileObject);
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+//
+// Transfers the socket's process-bound state to the calling process. The rings
+// are mapped into the caller and unmapped from the previous owner; their
+// contents, and therefore the producer and consumer indexes, are preserved.
+// The data path keeps running throughout.
+//
+static
+NTSTATUS
+XskSockoptSetHandoff(
+    _In_ XSK *Xsk,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    XSK_KERNEL_RING *Rings[] = {
+        &Xsk->Rx.Ring, &Xsk->Rx.FillRing, &Xsk->Rx.PriorityRing, &Xsk->Tx.Ring,
+        &Xsk->Tx.CompletionRing
+    };
+    MDL *Mdls[RTL_NUMBER_OF(Rings)] = {0};
+    VOID *UserVas[RTL_NUMBER_OF(Rings)] = {0};
+    VOID *OldProcesses[RTL_NUMBER_OF(Rings)] = {0};
+    XSK_USER_MAPPING OldStatisticsMapping = {0};
+    XSK_USER_MAPPING OldUmemMapping = {0};
+    VOID *CurrentProcess = PsGetCurrentProcess();
+    KIRQL OldIrql;
+    BOOLEAN HandoffStarted = FALSE;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (RequestorMode == KernelMode) {
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    //
+    // Only state that is independent of the previous owner's address space can
+    // be transferred: a UMEM registered from application memory, or an RX or
+    // fill ring shared with another socket, remains bound to its process.
+    //
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    if (Xsk->State == XskClosing || Xsk->HandoffInProgress || Xsk->Rx.SharedFill != NULL ||
+        Xsk->Rx.SharedRx != NULL || (Xsk->Umem != NULL && !Xsk->Umem->KernelAllocated)) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Rings); Index++) {
+            if (Rings[Index]->OwningProcess != CurrentProcess) {
+                Mdls[Index] = Rings[Index]->Mdl;
+            }
+        }
+        Xsk->HandoffInProgress = TRUE;
+        HandoffStarted = TRUE;
+        Status = STATUS_SUCCESS;
+    }
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Rings); Index++) {
+        if (Mdls[Index] == NULL) {
+            continue;
+        }
+
+        __try {
+            UserVas[Index] =
+                MmMapLockedPagesSpecifyCache(
+                    Mdls[Index],
+                    RequestorMode,
+                    MmCached,
+                    NULL, // RequestedAddress
+                    FALSE,// BugCheckOnFailure
+                    NormalPagePriority | MdlMappingNoExecute);
+            if (UserVas[Index] == NULL) {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                goto Exit;
+            }
+        } __except (EXCEPTION_EXECUTE_HANDLER) {
+            Status = GetExceptionCode();
+            goto Exit;
+        }
+    }
+
+    //
+    // Swap in the new mappings. The statistics and UMEM mappings are remapped
+    // on demand by the new owner.
+    //
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (Xsk->State == XskClosing) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Rings); Index++) {
+            VOID *NewUserVa = UserVas[Index];
+
+            if (NewUserVa == NULL) {
+                continue;
+            }
+
+            ASSERT(Rings[Index]->Mdl == Mdls[Index]);
+            UserVas[Index] = Rings[Index]->UserVa;
+            OldProcesses[Index] = Rings[Index]->OwningProcess;
+            Rings[Index]->UserVa = NewUserVa;
+            Rings[Index]->OwningProcess = CurrentProcess;
+            ObReferenceObject(CurrentProcess);
+        }
+
+        if (Xsk->StatisticsPage.UserMapping.OwningProcess != CurrentProcess) {
+            OldStatisticsMapping = Xsk->StatisticsPage.UserMapping;
+            RtlZeroMemory(
+                &Xsk->StatisticsPage.UserMapping, sizeof(Xsk->StatisticsPage.UserMapping));
+        }
+        if (Xsk->UmemUserMapping.OwningProcess != CurrentProcess) {
+            OldUmemMapping = Xsk->UmemUserMapping;
+            RtlZeroMemory(&Xsk->UmemUserMapping, sizeof(Xsk->UmemUserMapping));
+        }
+
+        TraceInfo(TRACE_XSK, "Xsk=%p Handed off to Process=%p", Xsk, CurrentProcess);
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    //
+    // Unmap the previous owner's mappings, or the new mappings on failure.
+    //
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Rings); Index++) {
+        if (OldProcesses[Index] != NULL) {
+            XskUnmapFromProcess(UserVas[Index], Mdls[Index], OldProcesses[Index]);
+        } else if (UserVas[Index] != NULL) {
+            MmUnmapLockedPages(UserVas[Index], Mdls[Index]);
+        }
+    }
+    XskUnmapUserMapping(&OldStatisticsMapping);
+    XskUnmapUserMapping(&OldUmemMapping);
+
+    if (HandoffStarted) {
+        KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+        Xsk->HandoffInProgress = FALSE;
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetSharedFillRing(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    HANDLE SharedHandle;
+    FILE_OBJECT *FileObject = NULL;
+    XSK *SharedXsk;
+    XSK_SHARED_FILL_RING *NewSharedFill = NULL;
+    XSK_SHARED_FILL_RING *SharedFill = NULL;
+    UINT64 *SharedFillCache = NULL;
+    UINT64 *FillCache = NULL;
+    const SIZE_T FillCacheSize = XSK_RX_FILL_CACHE_SIZE * sizeof(*FillCache);
+    BOOLEAN Charged = FALSE;
+    BOOLEAN Allocated = FALSE;
+    XSK_KERNEL_RING Ring = {0};
+    UMEM *Umem = NULL;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(SharedHandle)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(HANDLE));
+        }
+        RtlCopyVolatileMemory(&SharedHandle, SockoptInputBuffer, sizeof(SharedHandle));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    Status =
+        XdpReferenceObjectByHandle(
+            SharedHandle, XDP_OBJECT_TYPE_XSK, RequestorMode, FILE_GENERIC_WRITE, &FileObject);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    SharedXsk = FileObject->FsContext;
+    if (SharedXsk == Xsk) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    //
+    // Allocate the shared fill ring and the fill caches of both sockets up
+    // front, since they cannot be allocated while holding the socket locks.
+    // All are charged to this socket, and uncharged below if unused.
+    //
+    Status = XskChargeMemory(Xsk, XskMemoryOther, sizeof(*NewSharedFill) + 2 * FillCacheSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+    Charged = TRUE;
+
+    NewSharedFill = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*NewSharedFill), POOLTAG_FILL);
+    SharedFillCache = ExAllocatePoolZero(NonPagedPoolNx, FillCacheSize, POOLTAG_FILL);
+    FillCache = ExAllocatePoolZero(NonPagedPoolNx, FillCacheSize, POOLTAG_FILL);
+    if (NewSharedFill == NULL || SharedFillCache == NULL || FillCache == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+    Allocated = TRUE;
+
+    KeAcquireSpinLock(&SharedXsk->Lock, &OldIrql);
+
+    if (SharedXsk->State == XskClosing || SharedXsk->Rx.FillRing.Size == 0 ||
+        SharedXsk->Umem == NULL || SharedXsk->Rx.FillPool ||
+        SharedXsk->Rx.FillRing.OwningProcess !=
+            ((RequestorMode == KernelMode) ? NULL : PsGetCurrentProcess()) ||
+        (SharedXsk->Rx.SharedFill == NULL && SharedXsk->State >= XskActivating)) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        if (SharedXsk->Rx.SharedFill == NULL) {
+            //
+            // Move ownership of the other socket's fill ring into a shared
+            // fill ring, which is freed once every sharing socket is closed.
+            //
+            XdpInitializeReferenceCount(&NewSharedFill->ReferenceCount);
+            NewSharedFill->Ring = SharedXsk->Rx.FillRing;
+            SharedXsk->Rx.FillCache = SharedFillCache;
+            SharedXsk->Rx.FillCacheMask = XSK_RX_FILL_CACHE_SIZE - 1;
+            SharedXsk->Rx.SharedFill = NewSharedFill;
+            SharedFillCache = NULL;
+            NewSharedFill = NULL;
+        }
+
+        SharedFill = SharedXsk->Rx.SharedFill;
+        XskReferenceSharedFillRing(SharedFill);
+        Ring = SharedXsk->Rx.FillRing;
+        Umem = SharedXsk->Umem;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&SharedXsk->Lock, OldIrql);
+
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if ((Xsk->State != XskUnbound && Xsk->State != XskBound) || Xsk->Umem != Umem ||
+        Xsk->Rx.FillRing.Size != 0) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        TraceInfo(
+            TRACE_XSK, "Xsk=%p Set shared fill ring SharedFill=%p SharedXsk=%p",
+            Xsk, SharedFill, SharedXsk);
+
+        //
+        // Each sharing socket holds a copy of the ring descriptor; only the
+        // shared fill ring frees the ring.
+        //
+        Xsk->Rx.FillRing = Ring;
+        Xsk->Rx.FillRing.Error = XSK_NO_ERROR;
+        Xsk->Rx.FillCache = FillCache;
+        Xsk->Rx.FillCacheMask = XSK_RX_FILL_CACHE_SIZE - 1;
+        Xsk->Rx.SharedFill = SharedFill;
+        FillCache = NULL;
+        SharedFill = NULL;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    if (SharedFill != NULL) {
+        XskDereferenceSharedFillRing(SharedFill);
+    }
+    if (Charged) {
+        //
+        // Uncharge allocations that failed or were not consumed.
+        //
+        if (!Allocated || FillCache != NULL) {
+            XskUnchargeMemory(Xsk, XskMemoryOther, FillCacheSize);
+        }
+        if (!Allocated || SharedFillCache != NULL) {
+            XskUnchargeMemory(Xsk, XskMemoryOther, FillCacheSize);
+        }
+        if (!Allocated || NewSharedFill != NULL) {
+            XskUnchargeMemory(Xsk, XskMemoryOther, sizeof(*NewSharedFill));
+        }
+    }
+    if (FillCache != NULL) {
+        ExFreePoolWithTag(FillCache, POOLTAG_FILL);
+    }
+    if (SharedFillCache != NULL) {
+        ExFreePoolWithTag(SharedFillCache, POOLTAG_FILL);
+    }
+    if (NewSharedFill != NULL) {
+        ExFreePoolWithTag(NewSharedFill, POOLTAG_FILL);
+    }
+    if (FileObject != NULL) {
+        ObDereferenceObject(FileObject);
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetSharedRxRing(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    HANDLE SharedHandle;
+    FILE_OBJECT *FileObject = NULL;
+    XSK *SharedXsk;
+    XSK_SHARED_RX_RING *NewSharedRx = NULL;
+    XSK_SHARED_RX_RING *SharedRx = NULL;
+    BOOLEAN Charged = FALSE;
+    BOOLEAN Allocated = FALSE;
+    XSK_KERNEL_RING Ring = {0};
+    UMEM *Umem = NULL;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(SharedHandle)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(HANDLE));
+        }
+        RtlCopyVolatileMemory(&SharedHandle, SockoptInputBuffer, sizeof(SharedHandle));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    Status =
+        XdpReferenceObjectByHandle(
+            SharedHandle, XDP_OBJECT_TYPE_XSK, RequestorMode, FILE_GENERIC_WRITE, &FileObject);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    SharedXsk = FileObject->FsContext;
+    if (SharedXsk == Xsk) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    //
+    // Allocate the shared RX ring up front, since it cannot be allocated while
+    // holding the socket locks. It is charged to this socket, and uncharged
+    // below if unused.
+    //
+    Status = XskChargeMemory(Xsk, XskMemoryOther, sizeof(*NewSharedRx));
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+    Charged = TRUE;
+
+    NewSharedRx = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*NewSharedRx), POOLTAG_RING);
+    if (NewSharedRx == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+    Allocated = TRUE;
+
+    KeAcquireSpinLock(&SharedXsk->Lock, &OldIrql);
+
+    if (SharedXsk->State == XskClosing || SharedXsk->Rx.Ring.Size == 0 ||
+        SharedXsk->Umem == NULL ||
+        SharedXsk->Rx.Ring.OwningProcess !=
+            ((RequestorMode == KernelMode) ? NULL : PsGetCurrentProcess()) ||
+        (SharedXsk->Rx.SharedRx == NULL && SharedXsk->State >= XskActivating)) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        if (SharedXsk->Rx.SharedRx == NULL) {
+            //
+            // Move ownership of the other socket's RX ring into a shared RX
+            // ring, which is freed once every sharing socket is closed.
+            //
+            XdpInitializeReferenceCount(&NewSharedRx->ReferenceCount);
+            ExInitializeRundownProtection(&NewSharedRx->OwnerRundown);
+            NewSharedRx->Ring = SharedXsk->Rx.Ring;
+            NewSharedRx->Owner = SharedXsk;
+            NewSharedRx->ReserveIndex = NewSharedRx->Ring.Shared->ProducerIndex;
+            SharedXsk->Rx.SharedRx = NewSharedRx;
+            NewSharedRx = NULL;
+        }
+
+        SharedRx = SharedXsk->Rx.SharedRx;
+        XskReferenceSharedRxRing(SharedRx);
+        Ring = SharedXsk->Rx.Ring;
+        Umem = SharedXsk->Umem;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&SharedXsk->Lock, OldIrql);
+
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if ((Xsk->State != XskUnbound && Xsk->State != XskBound) || Xsk->Umem != Umem ||
+        Xsk->Rx.Ring.Size != 0) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        TraceInfo(
+            TRACE_XSK, "Xsk=%p Set shared RX ring SharedRx=%p SharedXsk=%p",
+            Xsk, SharedRx, SharedXsk);
+
+        //
+        // Each sharing socket holds a copy of the ring descriptor; only the
+        // shared RX ring frees the ring.
+        //
+        Xsk->Rx.Ring = Ring;
+        Xsk->Rx.Ring.Error = XSK_NO_ERROR;
+        Xsk->Rx.SharedRx = SharedRx;
+        SharedRx = NULL;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    if (SharedRx != NULL) {
+        XskDereferenceSharedRxRing(SharedRx);
+    }
+    if (Charged && (!Allocated || NewSharedRx != NULL)) {
+        //
+        // Uncharge the allocation if it failed or was not consumed.
+        //
+        XskUnchargeMemory(Xsk, XskMemoryOther, sizeof(*NewSharedRx));
+    }
+    if (NewSharedRx != NULL) {
+        ExFreePoolWithTag(NewSharedRx, POOLTAG_RING);
+    }
+    if (FileObject != NULL) {
+        ObDereferenceObject(FileObject);
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetRxFillPool(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    XSK_RX_FILL_POOL FillPool;
+    UINT64 *FillCache = NULL;
+    SIZE_T FillCacheSize = 0;
+    BOOLEAN Charged = FALSE;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(FillPool)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(UINT32));
+        }
+        RtlCopyVolatileMemory(&FillPool, SockoptInputBuffer, sizeof(FillPool));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if (FillPool.Capacity == 0 || !RTL_IS_POWER_OF_TWO(FillPool.Capacity) ||
+        FillPool.Capacity > XSK_RX_FILL_POOL_MAX_CAPACITY ||
+        FillPool.InitialChunkCount > FillPool.Capacity) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    FillCacheSize = (SIZE_T)FillPool.Capacity * sizeof(*FillCache);
+    Status = XskChargeMemory(Xsk, XskMemoryOther, FillCacheSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+    Charged = TRUE;
+
+    FillCache = ExAllocatePoolZero(NonPagedPoolNx, FillCacheSize, POOLTAG_FILL);
+    if (FillCache == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if ((Xsk->State != XskUnbound && Xsk->State != XskBound) || Xsk->Umem == NULL ||
+        Xsk->Rx.FillRing.Size == 0 || Xsk->Rx.FillCache != NULL) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else if (FillPool.InitialChunkCount > Xsk->Umem->Reg.TotalSize / Xsk->Umem->Reg.ChunkSize) {
+        Status = STATUS_INVALID_PARAMETER;
+    } else {
+        TraceInfo(
+            TRACE_XSK, "Xsk=%p Set RX fill pool Capacity=%u InitialChunkCount=%u",
+            Xsk, FillPool.Capacity, FillPool.InitialChunkCount);
+
+        for (UINT32 i = 0; i < FillPool.InitialChunkCount; i++) {
+            FillCache[i] = (UINT64)i * Xsk->Umem->Reg.ChunkSize;
+        }
+
+        Xsk->Rx.FillCache = FillCache;
+        Xsk->Rx.FillCacheMask = FillPool.Capacity - 1;
+        Xsk->Rx.FillCacheHead = 0;
+        Xsk->Rx.FillCacheCount = FillPool.InitialChunkCount;
+        Xsk->Rx.FillPool = TRUE;
+        FillCache = NULL;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    if (FillCache != NULL) {
+        ExFreePoolWithTag(FillCache, POOLTAG_FILL);
+        XskUnchargeMemory(Xsk, XskMemoryOther, FillCacheSize);
+    } else if (Charged && !NT_SUCCESS(Status)) {
+        XskUnchargeMemory(Xsk, XskMemoryOther, FillCacheSize);
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptAddUmemRegion(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    XSK_UMEM_REGION RegionReg;
+    UMEM *Umem = NULL;
+    UMEM_REGION *Region;
+    MDL *Mdl = NULL;
+    UCHAR *SystemAddress;
+    UINT64 Size;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(RegionReg)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength,
+                PROBE_ALIGNMENT(XSK_UMEM_REGION));
+        }
+        RtlCopyVolatileMemory(&RegionReg, SockoptInputBuffer, sizeof(RegionReg));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    Umem = XskReferenceSocketUmem(Xsk);
+    if (Umem == NULL) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    //
+    // Regions are locked from the registering process, so they would bind a
+    // kernel allocated UMEM to that process.
+    //
+    if (Umem->KernelAllocated) {
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    if (RegionReg.RegionId == 0 || RegionReg.RegionId >= RTL_NUMBER_OF(Umem->Regions) ||
+        RegionReg.TotalSize > MAXULONG || RegionReg.TotalSize < Umem->Reg.ChunkSize) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+    if (Umem->AlignedChunks && (ULONG_PTR)RegionReg.Address % Umem->Reg.ChunkSize != 0) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Mdl = IoAllocateMdl(RegionReg.Address, (ULONG)RegionReg.TotalSize, FALSE, FALSE, NULL);
+    if (Mdl == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Exit;
+    }
+
+    __try {
+        MmProbeAndLockPages(Mdl, RequestorMode, IoWriteAccess);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    SystemAddress = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority | MdlMappingNoExecute);
+    if (SystemAddress == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Exit;
+    }
+
+    //
+    // Ignore a truncated final chunk.
+    //
+    Size = RegionReg.TotalSize - (RegionReg.TotalSize % Umem->Reg.ChunkSize);
+
+    RtlAcquirePushLockExclusive(&Umem->RegionLock);
+
+    Region = &Umem->Regions[RegionReg.RegionId];
+
+    if (Region->Size != 0) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        TraceInfo(
+            TRACE_XSK, "Xsk=%p Add Umem=%p RegionId=%u Size=%llu",
+            Xsk, Umem, RegionReg.RegionId, Size);
+
+        Region->Mapping.Mdl = Mdl;
+        Region->Mapping.SystemAddress = SystemAddress;
+        Region->Size = (UINT32)Size;
+        ExReInitializeRundownProtection(&Region->Rundown);
+        Mdl = NULL;
+        Status = STATUS_SUCCESS;
+    }
+
+    RtlReleasePushLockExclusive(&Umem->RegionLock);
+
+Exit:
+
+    if (Mdl != NULL) {
+        if (Mdl->MdlFlags & MDL_PAGES_LOCKED) {
+            MmUnlockPages(Mdl);
+        }
+        IoFreeMdl(Mdl);
+    }
+    if (Umem != NULL) {
+        XskDereferenceUmem(Umem);
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptRemoveUmemRegion(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    UINT32 RegionId;
+    UMEM *Umem = NULL;
+    UMEM_REGION *Region;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(RegionId)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(UINT32));
+        }
+        RtlCopyVolatileMemory(&RegionId, SockoptInputBuffer, sizeof(RegionId));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    Umem = XskReferenceSocketUmem(Xsk);
+    if (Umem == NULL) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    if (RegionId == 0 || RegionId >= RTL_NUMBER_OF(Umem->Regions)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    RtlAcquirePushLockExclusive(&Umem->RegionLock);
+
+    Region = &Umem->Regions[RegionId];
+
+    if (Region->Size == 0) {
+        Status = STATUS_NOT_FOUND;
+    } else {
+        TraceInfo(TRACE_XSK, "Xsk=%p Remove Umem=%p RegionId=%u", Xsk, Umem, RegionId);
+
+        //
+        // Wait for receive batches using the region to be submitted. New fill
+        // descriptors referring to the region fail validation from now on.
+        //
+        ExWaitForRundownProtectionRelease(&Region->Rundown);
+        ExRundownCompleted(&Region->Rundown);
+        XskUmemFreeRegionMapping(Region);
+        Status = STATUS_SUCCESS;
+    }
+
+    RtlReleasePushLockExclusive(&Umem->RegionLock);
+
+Exit:
+
+    if (Umem != NULL) {
+        XskDereferenceUmem(Umem);
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetRingSize(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    XSK_SHARED_RING *Shared = NULL;
+    MDL *Mdl = NULL;
+    VOID *ReservedMapping = NULL;
+    VOID *UserVa = NULL;
+    XSK_KERNEL_RING *Ring = NULL;
+    BOOLEAN LargePages = Xsk->LargePages;
+    UINT32 ChecksumOffloads = ReadUInt32NoFence(&Xsk->Tx.ChecksumOffloads);
+    UINT32 NumDescriptors;
+    ULONG DescriptorSize;
+    ULONG AllocationSize;
+    ULONG ChargedSize = 0;
+    KIRQL OldIrql = {0};
+    BOOLEAN IsLockHeld = FALSE;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(UINT32)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead((VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(UINT32));
+        }
+        NumDescriptors = ReadUInt32NoFence(SockoptInputBuffer);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if (NumDescriptors > MAXUINT32 || !RTL_IS_POWER_OF_TWO(NumDescriptors)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    switch (Sockopt->Option) {
+    case XSK_SOCKOPT_RX_RING_SIZE:
+    case XSK_SOCKOPT_RX_PRIORITY_RING_SIZE:
+        DescriptorSize = sizeof(XSK_FRAME_DESCRIPTOR);
+        break;
+    case XSK_SOCKOPT_TX_RING_SIZE:
+        DescriptorSize =
+            (ChecksumOffloads != 0) ?
+                XSK_TX_CHECKSUM_DESCRIPTOR_SIZE : sizeof(XSK_FRAME_DESCRIPTOR);
+        break;
+    case XSK_SOCKOPT_RX_FILL_RING_SIZE:
+    case XSK_SOCKOPT_TX_COMPLETION_RING_SIZE:
+        DescriptorSize = sizeof(UINT64);
+        break;
+    default:
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Status = RtlULongMult(NumDescriptors, DescriptorSize, &AllocationSize);
+    if (Status != STATUS_SUCCESS) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+    Status = RtlULongAdd(AllocationSize, sizeof(*Shared), &AllocationSize);
+    if (Status != STATUS_SUCCESS) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    //
+    // Pool allocations mapped into user space must consume entire pages.
+    // TODO: Group all XSK rings into a single allocation?
+    //
+    AllocationSize = RTL_NUM_ALIGN_UP(AllocationSize, PAGE_SIZE);
+    if (AllocationSize < PAGE_SIZE) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    if (LargePages) {
+        //
+        // Large page rings consume entire large pages. The user mode mapping
+        // still uses small pages, but the kernel side of the ring is mapped
+        // with large pages.
+        //
+        Status = RtlULongAdd(AllocationSize, XSK_LARGE_PAGE_SIZE - 1, &AllocationSize);
+        if (Status != STATUS_SUCCESS) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+        AllocationSize = RTL_NUM_ALIGN_DOWN(AllocationSize, XSK_LARGE_PAGE_SIZE);
+    }
+
+    Status = XskChargeMemory(Xsk, XskMemoryRing, AllocationSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+    ChargedSize = AllocationSize;
+
+    if (LargePages) {
+        Status = XskAllocateLargePageRing(AllocationSize, &Shared, &Mdl, &ReservedMapping);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    } else {
+        Shared = ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, POOLTAG_RING);
+        if (Shared == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
+
+        Mdl =
+            IoAllocateMdl(
+                Shared,
+                AllocationSize,
+                FALSE, // SecondaryBuffer
+                FALSE, // ChargeQuota
+                NULL); // Irp
+        if (Mdl == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
+        MmBuildMdlForNonPagedPool(Mdl);
+    }
+
+    //
+    // Kernel mode sockets access the ring via its system address.
+    //
+    if (RequestorMode != KernelMode) {
+        __try {
+            UserVa =
+                MmMapLockedPagesSpecifyCache(
+                    Mdl,
+                    RequestorMode,
+                    MmCached,
+                    NULL, // RequestedAddress
+                    FALSE,// BugCheckOnFailure
+                    NormalPagePriority | MdlMappingNoExecute);
+            if (UserVa == NULL) {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                goto Exit;
+            }
+        } __except (EXCEPTION_EXECUTE_HANDLER) {
+            Status = GetExceptionCode();
+            goto Exit;
+        }
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    IsLockHeld = TRUE;
+
+    if (Xsk->State >= XskActivating || Xsk->LargePages != LargePages ||
+        Xsk->Tx.ChecksumOffloads != ChecksumOffloads) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    switch (Sockopt->Option) {
+    case XSK_SOCKOPT_RX_RING_SIZE:
+        Ring = &Xsk->Rx.Ring;
+        break;
+    case XSK_SOCKOPT_RX_FILL_RING_SIZE:
+        Ring = &Xsk->Rx.FillRing;
+        break;
+    case XSK_SOCKOPT_RX_PRIORITY_RING_SIZE:
+        Ring = &Xsk->Rx.PriorityRing;
+        break;
+    case XSK_SOCKOPT_TX_RING_SIZE:
+        Ring = &Xsk->Tx.Ring;
+        Shared->Flags = XSK_RING_FLAG_NEED_POKE;
+        break;
+    case XSK_SOCKOPT_TX_COMPLETION_RING_SIZE:
+        Ring = &Xsk->Tx.CompletionRing;
+        break;
+    default:
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    ASSERT(
+        (Ring->Size != 0 && Ring->Mdl != NULL && Ring->Shared != NULL) ||
+        (Ring->Size == 0 && Ring->Mdl == NULL && Ring->Shared == NULL));
+
+    if (Ring->Size != 0) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    TraceInfo(
+        TRACE_XSK, "Xsk=%p Set ring Type=%u Size=%u",
+        Xsk, Sockopt->Option, NumDescriptors);
+
+    Status = STATUS_SUCCESS;
+
+    Ring->Shared = Shared;
+    Ring->Mdl = Mdl;
+    Ring->ReservedMapping = ReservedMapping;
+    Ring->UserVa = UserVa;
+    Ring->Size = NumDescriptors;
+    Ring->Mask = NumDescriptors - 1;
+    Ring->ElementStride = DescriptorSize;
+    Ring->IdealProcessor = INVALID_PROCESSOR_INDEX;
+    if (UserVa != NULL) {
+        Ring->OwningProcess = PsGetCurrentProcess();
+        ObReferenceObject(Ring->OwningProcess);
+    }
+
+    Shared = NULL;
+    Mdl = NULL;
+    ReservedMapping = NULL;
+    UserVa = NULL;
+    ChargedSize = 0;
+
+Exit:
+
+    if (IsLockHeld) {
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    }
+    if (UserVa != NULL) {
+        MmUnmapLockedPages(UserVa, Mdl);
+    }
+    XskFreeRingAllocation(Shared, Mdl, ReservedMapping);
+    if (ChargedSize != 0) {
+        XskUnchargeMemory(Xsk, XskMemoryRing, ChargedSize);
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetHookId(
+    _In_ XSK *Xsk,
+    _In_ UINT32 Option,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    XDP_HOOK_ID *HookId = Irp->AssociatedIrp.SystemBuffer;
+    KIRQL OldIrql = {0};
+    BOOLEAN IsLockHeld = FALSE;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*HookId)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    IsLockHeld = TRUE;
+
+    switch (Option) {
+    case XSK_SOCKOPT_RX_HOOK_ID:
+        *HookId = Xsk->Rx.Xdp.HookId;
+        break;
+
+    case XSK_SOCKOPT_TX_HOOK_ID:
+        *HookId = Xsk->Tx.Xdp.HookId;
+        break;
+
+    default:
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    Status = STATUS_SUCCESS;
+    Irp->IoStatus.Information = sizeof(*HookId);
+
+Exit:
+
+    if (IsLockHeld) {
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetHookId(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptIn;
+    UINT32 SockoptInSize;
+    XDP_HOOK_ID HookId;
+    KIRQL OldIrql = {0};
+    BOOLEAN IsLockHeld = FALSE;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptIn = Sockopt->InputBuffer;
+    SockoptInSize = Sockopt->InputBufferLength;
+
+    if (SockoptInSize < sizeof(HookId)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead((VOID*)SockoptIn, SockoptInSize, PROBE_ALIGNMENT(XDP_HOOK_ID));
+        }
+        RtlCopyVolatileMemory(&HookId, SockoptIn, sizeof(XDP_HOOK_ID));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    IsLockHeld = TRUE;
+
+    if (Xsk->State != XskUnbound) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    switch (Sockopt->Option) {
+    case XSK_SOCKOPT_RX_HOOK_ID:
+        TraceInfo(
+            TRACE_XSK,
+            "Xsk=%p Set XSK_SOCKOPT_RX_HOOK_ID Hook={%!HOOK_LAYER!, %!HOOK_DIR!, %!HOOK_SUBLAYER!}",
+            Xsk, HookId.Layer, HookId.Direction, HookId.SubLayer);
+        Xsk->Rx.Xdp.HookId = HookId;
+        break;
+
+    case XSK_SOCKOPT_TX_HOOK_ID:
+        TraceInfo(
+            TRACE_XSK,
+            "Xsk=%p Set XSK_SOCKOPT_TX_HOOK_ID Hook={%!HOOK_LAYER!, %!HOOK_DIR!, %!HOOK_SUBLAYER!}",
+            Xsk, HookId.Layer, HookId.Direction, HookId.SubLayer);
+        Xsk->Tx.Xdp.HookId = HookId;
+        break;
+
+    default:
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (IsLockHeld) {
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetDatapathMode(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    BOOLEAN Enable;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(Enable)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(BOOLEAN));
+        }
+        RtlCopyVolatileMemory(&Enable, SockoptInputBuffer, sizeof(Enable));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (Xsk->State != XskUnbound && Xsk->State != XskBound) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else if (Sockopt->Option == XSK_SOCKOPT_RX_MULTI_BUFFER) {
+        Xsk->Rx.MultiBuffer = !!Enable;
+        Status = STATUS_SUCCESS;
+    } else if (Sockopt->Option == XSK_SOCKOPT_RX_METADATA) {
+        //
+        // The metadata is written into the UMEM headroom.
+        //
+        if (Enable && Xsk->Umem == NULL) {
+            Status = STATUS_INVALID_DEVICE_STATE;
+        } else if (Enable &&
+            Xsk->Umem->Reg.Headroom <
+                XskRxMetadataHeadroom(Xsk->Rx.Timestamp, TRUE, Xsk->Rx.EbpfMetadataSize)) {
+            Status = STATUS_INVALID_PARAMETER;
+        } else {
+            Xsk->Rx.Metadata = !!Enable;
+            Status = STATUS_SUCCESS;
+        }
+    } else {
+        ASSERT(Sockopt->Option == XSK_SOCKOPT_TX_ZERO_COPY);
+        Xsk->Tx.ZeroCopyRequested = !!Enable;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetDatapathMode(
+    _In_ XSK *Xsk,
+    _In_ UINT32 Option,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    BOOLEAN *Enabled = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Enabled)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    switch (Option) {
+    case XSK_SOCKOPT_RX_MULTI_BUFFER:
+        *Enabled = Xsk->Rx.MultiBuffer;
+        break;
+
+    case XSK_SOCKOPT_RX_METADATA:
+        //
+        // Interface metadata support is known once the socket is activated.
+        //
+        if (Xsk->State != XskActive || Xsk->Rx.Xdp.Queue == NULL) {
+            Status = STATUS_INVALID_DEVICE_STATE;
+            goto Exit;
+        }
+        *Enabled = Xsk->Rx.Metadata && Xsk->Rx.Xdp.Flags.RxMetadataExt;
+        break;
+
+    case XSK_SOCKOPT_TX_ZERO_COPY:
+        //
+        // The bounce buffer, if any, is allocated during activation.
+        //
+        if (Xsk->State != XskActive || Xsk->Tx.Xdp.Queue == NULL) {
+            Status = STATUS_INVALID_DEVICE_STATE;
+            goto Exit;
+        }
+        *Enabled =
+            Xsk->Tx.Bounce.Tracker == NULL &&
+            Xsk->Tx.Bounce.AllocationSource != AllocatedByDma;
+        break;
+
+    default:
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    Irp->IoStatus.Information = sizeof(*Enabled);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetTimestamps(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    UINT32 Flags;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(Flags)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(UINT32));
+        }
+        RtlCopyVolatileMemory(&Flags, SockoptInputBuffer, sizeof(Flags));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if ((Flags & ~(XSK_TIMESTAMP_FLAG_RX | XSK_TIMESTAMP_FLAG_TX)) != 0) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if ((Xsk->State != XskUnbound && Xsk->State != XskBound) || Xsk->Umem == NULL) {
+        //
+        // The UMEM headroom must be known before enabling RX timestamps.
+        //
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else if ((Flags & XSK_TIMESTAMP_FLAG_RX) &&
+        Xsk->Umem->Reg.Headroom <
+            XskRxMetadataHeadroom(TRUE, Xsk->Rx.Metadata, Xsk->Rx.EbpfMetadataSize)) {
+        Status = STATUS_INVALID_PARAMETER;
+    } else {
+        Xsk->Rx.Timestamp = !!(Flags & XSK_TIMESTAMP_FLAG_RX);
+        Xsk->Tx.Timestamp = !!(Flags & XSK_TIMESTAMP_FLAG_TX);
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetTimestamps(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    UINT32 *Flags = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Flags)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    //
+    // Interface timestamp support is known once the socket is activated.
+    //
+    if (Xsk->State != XskActive) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    *Flags = 0;
+
+    if (Xsk->Rx.Timestamp && Xsk->Rx.Xdp.Flags.TimestampExt) {
+        *Flags |= XSK_TIMESTAMP_FLAG_RX;
+    }
+
+    if (Xsk->Tx.Timestamp && Xsk->Tx.Xdp.Flags.TimestampExt) {
+        *Flags |= XSK_TIMESTAMP_FLAG_TX;
+    }
+
+    Irp->IoStatus.Information = sizeof(*Flags);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static WORKER_THREAD_ROUTINE XskTxPaceTimeout;
+
+_Use_decl_annotations_
+VOID
+XskTxPaceTimeout(
+    VOID *Context
+    )
+{
+    XSK *Xsk = Context;
+
+    //
+    // The pacing timer is shut down during socket cleanup, so the socket
+    // remains valid for the duration of this routine.
+    //
+    XskAcquirePollLock(Xsk);
+
+    if (Xsk->State > XskActive) {
+        goto Exit;
+    }
+
+    //
+    // If the data path held back frames, poke the TX queue so it retries them.
+    //
+    if (InterlockedExchange8((CHAR *)&Xsk->Tx.PaceHeld, FALSE) &&
+        Xsk->Tx.Xdp.Flags.QueueActive) {
+        XdpTxQueueInvokeInterfaceNotify(Xsk->Tx.Xdp.Queue, XDP_NOTIFY_QUEUE_FLAG_TX);
+    }
+
+    (VOID)XdpTimerStart(Xsk->Tx.PaceTimer, XSK_TX_PACE_TIMER_MS, NULL);
+
+Exit:
+
+    XskReleasePollLock(Xsk);
+}
+
+static
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XskCreateTxPaceTimer(
+    _In_ XSK *Xsk
+    )
+{
+    XDP_TIMER *Timer;
+
+    if (ReadPointerAcquire(&Xsk->Tx.PaceTimer) != NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    Timer = XdpTimerCreate(XskTxPaceTimeout, Xsk, XdpDriverObject, NULL);
+    if (Timer == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    //
+    // Pacing options may be set concurrently; keep the first timer installed.
+    //
+    if (InterlockedCompareExchangePointer(&Xsk->Tx.PaceTimer, Timer, NULL) != NULL) {
+        XdpTimerShutdown(Timer, TRUE, TRUE);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XskSockoptSetTxLaunchTime(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    BOOLEAN LaunchTime;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(LaunchTime)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(BOOLEAN));
+        }
+        RtlCopyVolatileMemory(&LaunchTime, SockoptInputBuffer, sizeof(LaunchTime));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if (LaunchTime) {
+        Status = XskCreateTxPaceTimer(Xsk);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (Xsk->State != XskUnbound && Xsk->State != XskBound) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        Xsk->Tx.LaunchTime = !!LaunchTime;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetTxPokeLinger(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    UINT32 LingerMs;
+    LARGE_INTEGER FrequencyQpc;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(LingerMs)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(UINT32));
+        }
+        RtlCopyVolatileMemory(&LingerMs, SockoptInputBuffer, sizeof(LingerMs));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if (LingerMs > XSK_TX_POKE_LINGER_MAX_MS) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    if (LingerMs > 0) {
+        //
+        // The pacing timer watches the TX ring while the TX path lingers.
+        //
+        Status = XskCreateTxPaceTimer(Xsk);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    KeQueryPerformanceCounter(&FrequencyQpc);
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (Xsk->State != XskUnbound && Xsk->State != XskBound) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        Xsk->Tx.PokeLingerMs = LingerMs;
+        Xsk->Tx.PokeLingerQpc = FrequencyQpc.QuadPart * LingerMs / 1000;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetTxPokeLinger(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    UINT32 *LingerMs = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*LingerMs)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    *LingerMs = Xsk->Tx.PokeLingerMs;
+
+    Irp->IoStatus.Information = sizeof(*LingerMs);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetRxHeaderSplit(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    UINT32 HeaderLength;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(HeaderLength)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(UINT32));
+        }
+        RtlCopyVolatileMemory(&HeaderLength, SockoptInputBuffer, sizeof(HeaderLength));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (Xsk->State != XskUnbound && Xsk->State != XskBound) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        Xsk->Rx.HeaderSplitLength = HeaderLength;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetRxHeaderSplit(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    UINT32 *HeaderLength = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*HeaderLength)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    *HeaderLength = Xsk->Rx.HeaderSplitLength;
+
+    Irp->IoStatus.Information = sizeof(*HeaderLength);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetRxCoalesce(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    UINT32 CoalesceLength;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(CoalesceLength)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(UINT32));
+        }
+        RtlCopyVolatileMemory(&CoalesceLength, SockoptInputBuffer, sizeof(CoalesceLength));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (Xsk->State != XskUnbound && Xsk->State != XskBound) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        Xsk->Rx.CoalesceLength = CoalesceLength;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetRxCoalesce(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    UINT32 *CoalesceLength = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*CoalesceLength)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    *CoalesceLength = Xsk->Rx.CoalesceLength;
+
+    Irp->IoStatus.Information = sizeof(*CoalesceLength);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetLargePages(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    BOOLEAN LargePages;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(LargePages)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(BOOLEAN));
+        }
+        RtlCopyVolatileMemory(&LargePages, SockoptInputBuffer, sizeof(LargePages));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    //
+    // The UMEM and rings are validated and allocated according to this option,
+    // so it cannot change once any of them exist.
+    //
+    if (Xsk->State != XskUnbound || Xsk->Umem != NULL ||
+        Xsk->Rx.Ring.Size != 0 || Xsk->Rx.FillRing.Size != 0 ||
+        Xsk->Tx.Ring.Size != 0 || Xsk->Tx.CompletionRing.Size != 0) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        Xsk->LargePages = !!LargePages;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetLargePages(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    BOOLEAN *LargePages = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*LargePages)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    *LargePages = Xsk->LargePages;
+
+    Irp->IoStatus.Information = sizeof(*LargePages);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetModeFailover(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    BOOLEAN Enabled;
+    XDP_TIMER *Timer = NULL;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(Enabled)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(BOOLEAN));
+        }
+        RtlCopyVolatileMemory(&Enabled, SockoptInputBuffer, sizeof(Enabled));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if (Enabled) {
+        Timer = XdpTimerCreate(XskFailoverTimeout, Xsk, XdpDriverObject, NULL);
+        if (Timer == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    //
+    // Failover is driven by detach notifications, which are only handled once
+    // the socket is active, so the timer is installed before binding and only
+    // removed by socket cleanup.
+    //
+    if (Xsk->State != XskUnbound) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        Xsk->Failover.Enabled = !!Enabled;
+        if (Timer != NULL && Xsk->Failover.Timer == NULL) {
+            Xsk->Failover.Timer = Timer;
+            Timer = NULL;
+        }
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    if (Timer != NULL) {
+        XdpTimerShutdown(Timer, TRUE, TRUE);
+    }
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetModeFailover(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    BOOLEAN *Enabled = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Enabled)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    *Enabled = Xsk->Failover.Enabled;
+
+    Irp->IoStatus.Information = sizeof(*Enabled);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetUmemAlignedChunks(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    BOOLEAN AlignedChunks;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(AlignedChunks)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(BOOLEAN));
+        }
+        RtlCopyVolatileMemory(&AlignedChunks, SockoptInputBuffer, sizeof(AlignedChunks));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    //
+    // The UMEM is validated according to this option, so it cannot change once
+    // the UMEM exists.
+    //
+    if (Xsk->State != XskUnbound || Xsk->Umem != NULL) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        Xsk->AlignedChunks = !!AlignedChunks;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetUmemAlignedChunks(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    BOOLEAN *AlignedChunks = Irp->AssociatedIrp.SystemBuffer;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*AlignedChunks)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    //
+    // A shared UMEM keeps the mode it was registered with.
+    //
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    *AlignedChunks = (Xsk->Umem != NULL) ? Xsk->Umem->AlignedChunks : Xsk->AlignedChunks;
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    Irp->IoStatus.Information = sizeof(*AlignedChunks);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetRxNonTemporalCopy(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    UINT32 NonTemporalCopyLength;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(NonTemporalCopyLength)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(UINT32));
+        }
+        RtlCopyVolatileMemory(
+            &NonTemporalCopyLength, SockoptInputBuffer, sizeof(NonTemporalCopyLength));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    //
+    // The RX path reads the length once per copy, so it may change at any time.
+    //
+    WriteUInt32NoFence(&Xsk->Rx.NonTemporalCopyLength, NonTemporalCopyLength);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetRxNonTemporalCopy(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    UINT32 *NonTemporalCopyLength = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*NonTemporalCopyLength)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    *NonTemporalCopyLength = ReadUInt32NoFence(&Xsk->Rx.NonTemporalCopyLength);
+
+    Irp->IoStatus.Information = sizeof(*NonTemporalCopyLength);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetNotifyModeration(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    XSK_NOTIFY_MODERATION Moderation;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(Moderation)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(UINT32));
+        }
+        RtlCopyVolatileMemory(&Moderation, SockoptInputBuffer, sizeof(Moderation));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if ((Moderation.MinFrames > 1 && Moderation.MaxDelayUs == 0) ||
+        Moderation.MaxDelayUs > XSK_NOTIFY_MODERATION_MAX_DELAY_US) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    //
+    // The lock keeps the two values consistent for readers of the option; the
+    // data path reads each value once per notification.
+    //
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    WriteUInt32NoFence(&Xsk->NotifyModeration.MaxDelayUs, Moderation.MaxDelayUs);
+    WriteUInt32NoFence(&Xsk->NotifyModeration.MinFrames, Moderation.MinFrames);
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetNotifyModeration(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    XSK_NOTIFY_MODERATION *Moderation = Irp->AssociatedIrp.SystemBuffer;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Moderation)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    Moderation->MinFrames = Xsk->NotifyModeration.MinFrames;
+    Moderation->MaxDelayUs = Xsk->NotifyModeration.MaxDelayUs;
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    Irp->IoStatus.Information = sizeof(*Moderation);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetWakeParameters(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    XSK_WAKE_PARAMETERS Parameters;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(Parameters)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(UINT32));
+        }
+        RtlCopyVolatileMemory(&Parameters, SockoptInputBuffer, sizeof(Parameters));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if (Parameters.PriorityIncrement > XSK_WAKE_MAX_PRIORITY_INCREMENT ||
+        (Parameters.Flags & ~XSK_WAKE_FLAG_RX_PROCESSOR) != 0) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    WriteUInt32NoFence(&Xsk->Wake.PriorityIncrement, Parameters.PriorityIncrement);
+    WriteUInt32NoFence(&Xsk->Wake.Flags, Parameters.Flags);
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetWakeParameters(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    XSK_WAKE_PARAMETERS *Parameters = Irp->AssociatedIrp.SystemBuffer;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Parameters)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    Parameters->PriorityIncrement = Xsk->Wake.PriorityIncrement;
+    Parameters->Flags = Xsk->Wake.Flags;
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    Irp->IoStatus.Information = sizeof(*Parameters);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetTxCompletionBatch(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    UINT32 CompletionBatch;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(CompletionBatch)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(UINT32));
+        }
+        RtlCopyVolatileMemory(&CompletionBatch, SockoptInputBuffer, sizeof(CompletionBatch));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    //
+    // The TX completion path reads the batch size once per flush, so it may
+    // change at any time.
+    //
+    WriteUInt32NoFence(&Xsk->Tx.CompletionBatch, CompletionBatch);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetTxCompletionBatch(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    UINT32 *CompletionBatch = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*CompletionBatch)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    *CompletionBatch = ReadUInt32NoFence(&Xsk->Tx.CompletionBatch);
+
+    Irp->IoStatus.Information = sizeof(*CompletionBatch);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetRxBackpressure(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    BOOLEAN Backpressure;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(Backpressure)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(BOOLEAN));
+        }
+        RtlCopyVolatileMemory(&Backpressure, SockoptInputBuffer, sizeof(Backpressure));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    //
+    // Backpressure is enabled when the socket attaches to its RX queue.
+    //
+    if (Xsk->State != XskUnbound) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        Xsk->Rx.Backpressure = !!Backpressure;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetRxBackpressure(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    BOOLEAN *Backpressure = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Backpressure)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    *Backpressure = Xsk->Rx.Backpressure;
+
+    Irp->IoStatus.Information = sizeof(*Backpressure);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetTxCompletionInOrder(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    BOOLEAN InOrder;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(InOrder)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(BOOLEAN));
+        }
+        RtlCopyVolatileMemory(&InOrder, SockoptInputBuffer, sizeof(InOrder));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    //
+    // The reorder buffer is allocated when the TX path is activated.
+    //
+    if (Xsk->State != XskUnbound && Xsk->State != XskBound) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        Xsk->Tx.Reorder.Enabled = !!InOrder;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetTxCompletionInOrder(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    BOOLEAN *InOrder = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*InOrder)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    *InOrder = Xsk->Tx.Reorder.Enabled;
+
+    Irp->IoStatus.Information = sizeof(*InOrder);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetMemoryUsage(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    XSK_MEMORY_USAGE *Usage = Irp->AssociatedIrp.SystemBuffer;
+    XSK_PROCESS_MEMORY *Entry = Xsk->Memory.Process;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Usage)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    RtlZeroMemory(Usage, sizeof(*Usage));
+    Usage->RingBytes = ReadUInt64NoFence(&Xsk->Memory.Bytes[XskMemoryRing]);
+    Usage->BounceBytes = ReadUInt64NoFence(&Xsk->Memory.Bytes[XskMemoryBounce]);
+    Usage->OtherBytes = ReadUInt64NoFence(&Xsk->Memory.Bytes[XskMemoryOther]);
+
+    if (Entry != NULL) {
+        KeAcquireSpinLock(&XskGlobals.ProcessMemoryLock, &OldIrql);
+        Usage->ProcessBytes = Entry->Bytes;
+        KeReleaseSpinLock(&XskGlobals.ProcessMemoryLock, OldIrql);
+        Usage->ProcessLimitBytes = ReadUInt64NoFence(&XskGlobals.ProcessMemoryLimit);
+    }
+
+    Irp->IoStatus.Information = sizeof(*Usage);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+UINT32
+XskRingRecommendSize(
+    _In_ UINT32 Size,
+    _In_ UINT32 HighWater
+    )
+{
+    UINT32 RecommendedSize = 1;
+
+    if (HighWater == 0) {
+        return Size;
+    }
+
+    if (HighWater >= Size) {
+        return (Size <= MAXUINT32 / 2) ? Size * 2 : Size;
+    }
+
+    //
+    // Ring sizes are powers of two, so this terminates at or below Size.
+    //
+    while (RecommendedSize < HighWater) {
+        RecommendedSize *= 2;
+    }
+
+    return (RecommendedSize <= MAXUINT32 / 2) ? RecommendedSize * 2 : RecommendedSize;
+}
+
+static
+VOID
+XskGetRingOccupancy(
+    _In_ XSK_KERNEL_RING *Ring,
+    _Out_ XSK_RING_OCCUPANCY_ENTRY *Entry
+    )
+{
+    Entry->Size = Ring->Size;
+    Entry->HighWater = ReadUInt32NoFence(&Ring->HighWater);
+    Entry->RecommendedSize = XskRingRecommendSize(Entry->Size, Entry->HighWater);
+}
+
+static
+NTSTATUS
+XskSockoptGetRingOccupancy(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    XSK_RING_OCCUPANCY *Occupancy = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Occupancy)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    RtlZeroMemory(Occupancy, sizeof(*Occupancy));
+    XskGetRingOccupancy(&Xsk->Rx.Ring, &Occupancy->Rx);
+    XskGetRingOccupancy(&Xsk->Rx.FillRing, &Occupancy->RxFill);
+    XskGetRingOccupancy(&Xsk->Tx.Ring, &Occupancy->Tx);
+    XskGetRingOccupancy(&Xsk->Tx.CompletionRing, &Occupancy->TxCompletion);
+    XskGetRingOccupancy(&Xsk->Rx.PriorityRing, &Occupancy->RxPriority);
+
+    //
+    // A full fill ring only means the application posted buffers in advance,
+    // so size the fill ring for the RX ring instead.
+    //
+    if (Occupancy->RxFill.Size != 0 && Occupancy->Rx.Size != 0) {
+        Occupancy->RxFill.RecommendedSize = Occupancy->Rx.RecommendedSize;
+    }
+
+    Irp->IoStatus.Information = sizeof(*Occupancy);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetTxLaunchTime(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    BOOLEAN *LaunchTime = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*LaunchTime)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    *LaunchTime = Xsk->Tx.LaunchTime;
+
+    Irp->IoStatus.Information = sizeof(*LaunchTime);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetTxSegmentation(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    UINT32 SegmentSize;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(SegmentSize)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(UINT32));
+        }
+        RtlCopyVolatileMemory(&SegmentSize, SockoptInputBuffer, sizeof(SegmentSize));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    //
+    // The segment size must fit the XDP_FRAME_GSO MSS field.
+    //
+    if (SegmentSize >= (1ui32 << 20)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (Xsk->State != XskUnbound && Xsk->State != XskBound) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        Xsk->Tx.SegmentSize = SegmentSize;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetTxWeight(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    UINT32 Weight;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(Weight)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(UINT32));
+        }
+        RtlCopyVolatileMemory(&Weight, SockoptInputBuffer, sizeof(Weight));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if (Weight == 0 || Weight > XSK_TX_WEIGHT_MAX) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    //
+    // The TX queue reads the weight on each scheduling visit, so the new weight
+    // takes effect without synchronizing with the data path.
+    //
+    WriteUInt32NoFence(&Xsk->Tx.Xdp.DatapathClientEntry.Weight, Weight);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetTxRateLimit(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    XSK_TX_RATE_LIMIT RateLimit;
+    XSK_TX_RATE_LIMITER Limiter = {0};
+    LARGE_INTEGER FrequencyQpc;
+    INT64 BurstQpc;
+    INT64 MaxRate;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(RateLimit)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength,
+                PROBE_ALIGNMENT(XSK_TX_RATE_LIMIT));
+        }
+        RtlCopyVolatileMemory(&RateLimit, SockoptInputBuffer, sizeof(RateLimit));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if (RateLimit.BurstMs == 0) {
+        RateLimit.BurstMs = XSK_TX_RATE_LIMIT_BURST_MS_DEFAULT;
+    }
+
+    //
+    // Token counts are scaled by the QPC frequency and refills are clamped to
+    // one second, so bound the rates to keep the bucket arithmetic in range.
+    //
+    KeQueryPerformanceCounter(&FrequencyQpc);
+    MaxRate = MAXINT64 / 4 / FrequencyQpc.QuadPart;
+
+    if (RateLimit.BurstMs > XSK_TX_RATE_LIMIT_BURST_MS_MAX ||
+        RateLimit.BitsPerSecond > (UINT64)MaxRate ||
+        RateLimit.FramesPerSecond > (UINT64)MaxRate) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    BurstQpc = max(1, (RateLimit.BurstMs * FrequencyQpc.QuadPart) / 1000);
+
+    Limiter.Settings = RateLimit;
+    Limiter.Enabled = RateLimit.BitsPerSecond > 0 || RateLimit.FramesPerSecond > 0;
+    Limiter.FrequencyQpc = FrequencyQpc.QuadPart;
+    Limiter.MaxElapsedQpc = FrequencyQpc.QuadPart;
+    Limiter.BitsPerSecond = (INT64)RateLimit.BitsPerSecond;
+    Limiter.BitDepth = Limiter.BitsPerSecond * BurstQpc;
+    Limiter.BitTokens = Limiter.BitDepth;
+    Limiter.FramesPerSecond = (INT64)RateLimit.FramesPerSecond;
+    Limiter.FrameDepth = max(Limiter.FramesPerSecond * BurstQpc, FrequencyQpc.QuadPart);
+    Limiter.FrameTokens = Limiter.FrameDepth;
+
+    if (Limiter.Enabled) {
+        Status = XskCreateTxPaceTimer(Xsk);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (Xsk->State != XskUnbound && Xsk->State != XskBound) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        Xsk->Tx.RateLimit = Limiter;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetEbpfMapKey(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    UINT32 Key;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(Key)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(UINT32));
+        }
+        RtlCopyVolatileMemory(&Key, SockoptInputBuffer, sizeof(Key));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if (Key >= XSK_EBPF_MAP_MAX_KEYS) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (Xsk->State != XskUnbound && Xsk->State != XskBound) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        Xsk->Rx.EbpfMapKey = Key;
+        Xsk->Rx.EbpfMapKeyValid = TRUE;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetEbpfMetadata(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    UINT32 Size;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(Size)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(UINT32));
+        }
+        RtlCopyVolatileMemory(&Size, SockoptInputBuffer, sizeof(Size));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if (Size > XSK_EBPF_METADATA_MAX_SIZE || (Size & 0x3) != 0) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if ((Xsk->State != XskUnbound && Xsk->State != XskBound) || Xsk->Umem == NULL) {
+        //
+        // The UMEM headroom must be known before enabling eBPF metadata.
+        //
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else if (
+        Xsk->Umem->Reg.Headroom <
+            XskRxMetadataHeadroom(Xsk->Rx.Timestamp, Xsk->Rx.Metadata, Size)) {
+        Status = STATUS_INVALID_PARAMETER;
+    } else {
+        Xsk->Rx.EbpfMetadataSize = Size;
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetTxSegmentation(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    UINT32 *SegmentSize = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*SegmentSize)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    //
+    // Interface segmentation support is known once the socket is activated.
+    //
+    if (Xsk->State != XskActive || Xsk->Tx.Ring.Size == 0) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    *SegmentSize = Xsk->Tx.Xdp.Flags.GsoExt ? Xsk->Tx.SegmentSize : 0;
+
+    Irp->IoStatus.Information = sizeof(*SegmentSize);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+UINT32
+XskChecksumOffloadFromSockopt(
+    _In_ UINT32 Option
+    )
+{
+    switch (Option) {
+    case XSK_SOCKOPT_OFFLOAD_IPV4_CHECKSUM_TX:
+    case XSK_SOCKOPT_OFFLOAD_IPV4_CHECKSUM_TX_CAPABILITIES:
+        return XSK_TX_CHECKSUM_OFFLOAD_IPV4;
+    case XSK_SOCKOPT_OFFLOAD_TCP_CHECKSUM_TX:
+    case XSK_SOCKOPT_OFFLOAD_TCP_CHECKSUM_TX_CAPABILITIES:
+        return XSK_TX_CHECKSUM_OFFLOAD_TCP;
+    default:
+        ASSERT(
+            Option == XSK_SOCKOPT_OFFLOAD_UDP_CHECKSUM_TX ||
+            Option == XSK_SOCKOPT_OFFLOAD_UDP_CHECKSUM_TX_CAPABILITIES);
+        return XSK_TX_CHECKSUM_OFFLOAD_UDP;
+    }
+}
+
+static
+NTSTATUS
+XskSockoptSetChecksumOffload(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    UINT32 Offload = XskChecksumOffloadFromSockopt(Sockopt->Option);
+    BOOLEAN Enable;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(Enable)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(BOOLEAN));
+        }
+        RtlCopyVolatileMemory(&Enable, SockoptInputBuffer, sizeof(Enable));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    //
+    // The TX descriptor size depends on the enabled offloads, so they cannot
+    // change after the TX ring is created.
+    //
+    if (Xsk->State != XskBound || Xsk->Tx.Xdp.Queue == NULL || Xsk->Tx.Ring.Size != 0) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else if (!Xsk->Tx.Xdp.Flags.ChecksumExt) {
+        Status = STATUS_NOT_SUPPORTED;
+    } else {
+        if (Enable) {
+            Xsk->Tx.ChecksumOffloads |= Offload;
+        } else {
+            Xsk->Tx.ChecksumOffloads &= ~Offload;
+        }
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetChecksumOffloadCapabilities(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    //
+    // The capabilities of each checksum offload share a common layout.
+    //
+    XSK_OFFLOAD_UDP_CHECKSUM_TX_CAPABILITIES *Capabilities = Irp->AssociatedIrp.SystemBuffer;
+
+    C_ASSERT(
+        sizeof(XSK_OFFLOAD_TCP_CHECKSUM_TX_CAPABILITIES) ==
+            sizeof(XSK_OFFLOAD_UDP_CHECKSUM_TX_CAPABILITIES));
+    C_ASSERT(
+        sizeof(XSK_OFFLOAD_IPV4_CHECKSUM_TX_CAPABILITIES) ==
+            sizeof(XSK_OFFLOAD_UDP_CHECKSUM_TX_CAPABILITIES));
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Capabilities)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    //
+    // Interface checksum support is known once the socket is bound.
+    //
+    if (Xsk->State < XskBound || Xsk->State > XskActive || Xsk->Tx.Xdp.Queue == NULL) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    //
+    // Interfaces supporting checksum offload support all three checksums.
+    //
+    RtlZeroMemory(Capabilities, sizeof(*Capabilities));
+    Capabilities->Supported = Xsk->Tx.Xdp.Flags.ChecksumExt;
+
+    Irp->IoStatus.Information = sizeof(*Capabilities);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetTxDescriptorExtension(
+    _In_ XSK *Xsk,
+    _In_ UINT32 Option,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    XDP_EXTENSION *Extension = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Extension)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    if (Xsk->State < XskBound || Xsk->Tx.Ring.Size == 0 || Xsk->Tx.ChecksumOffloads == 0) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    if (Option == XSK_SOCKOPT_TX_FRAME_LAYOUT_EXTENSION) {
+        Extension->Reserved = XSK_TX_LAYOUT_EXTENSION_OFFSET;
+    } else {
+        ASSERT(Option == XSK_SOCKOPT_TX_FRAME_CHECKSUM_EXTENSION);
+        Extension->Reserved = XSK_TX_CHECKSUM_EXTENSION_OFFSET;
+    }
+
+    Irp->IoStatus.Information = sizeof(*Extension);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetTxWeight(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    UINT32 *Weight = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Weight)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    *Weight = ReadUInt32NoFence(&Xsk->Tx.Xdp.DatapathClientEntry.Weight);
+
+    Irp->IoStatus.Information = sizeof(*Weight);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetTxRateLimit(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    XSK_TX_RATE_LIMIT *RateLimit = Irp->AssociatedIrp.SystemBuffer;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*RateLimit)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    *RateLimit = Xsk->Tx.RateLimit.Settings;
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    Irp->IoStatus.Information = sizeof(*RateLimit);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetNumaNode(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    XSK_NUMA_NODE_INFO *NumaNodeInfo = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*NumaNodeInfo)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    //
+    // Queue memory is placed when the socket is activated.
+    //
+    if (Xsk->State != XskActive) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    NumaNodeInfo->Rx = XSK_NUMA_NODE_UNSPECIFIED;
+    NumaNodeInfo->Tx = XSK_NUMA_NODE_UNSPECIFIED;
+
+    if (Xsk->Rx.Xdp.Queue != NULL &&
+        XdpRxQueueGetNumaNode(Xsk->Rx.Xdp.Queue) != MM_ANY_NODE_OK) {
+        NumaNodeInfo->Rx = XdpRxQueueGetNumaNode(Xsk->Rx.Xdp.Queue);
+    }
+
+    if (Xsk->Tx.Xdp.Queue != NULL &&
+        XdpTxQueueGetNumaNode(Xsk->Tx.Xdp.Queue) != MM_ANY_NODE_OK) {
+        NumaNodeInfo->Tx = XdpTxQueueGetNumaNode(Xsk->Tx.Xdp.Queue);
+    }
+
+    Irp->IoStatus.Information = sizeof(*NumaNodeInfo);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetError(
+    _In_ XSK *Xsk,
+    _In_ UINT32 Option,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    XSK_ERROR *XskError = Irp->AssociatedIrp.SystemBuffer;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*XskError)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    switch (Option) {
+    case XSK_SOCKOPT_RX_ERROR:
+        *XskError = Xsk->Rx.Ring.Error;
+        break;
+
+    case XSK_SOCKOPT_RX_FILL_ERROR:
+        *XskError = Xsk->Rx.FillRing.Error;
+        break;
+
+    case XSK_SOCKOPT_TX_ERROR:
+        *XskError = Xsk->Tx.Ring.Error;
+        break;
+
+    case XSK_SOCKOPT_TX_COMPLETION_ERROR:
+        *XskError = Xsk->Tx.CompletionRing.Error;
+        break;
+
+    default:
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    Status = STATUS_SUCCESS;
+    Irp->IoStatus.Information = sizeof(*XskError);
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+BOOLEAN
+XskPollInvoke(
+    _In_ XSK *Xsk,
+    _In_ UINT32 RxQuota,
+    _In_ UINT32 TxQuota,
+    _Out_ BOOLEAN *WorkRemaining
+    )
+{
+    NDIS_POLL_BACKCHANNEL_INVOKE_DATA InvokeData = {0};
+    UINT32 RxCompleted = 0;
+    UINT32 TxCompleted = 0;
+    BOOLEAN MoreData = FALSE;
+
+    ASSERT(Xsk->Rx.Xdp.PollHandle != NULL || Xsk->Tx.Xdp.PollHandle != NULL);
+
+    //
+    // The quotas are sized to the socket's demand, and the backchannel reports
+    // how much of that demand the poll satisfied.
+    //
+    InvokeData.RxQuota = RxQuota;
+    InvokeData.TxQuota = TxQuota;
+
+    if (Xsk->Rx.Xdp.PollHandle == Xsk->Tx.Xdp.PollHandle) {
+        //
+        // Typically the RX and TX poll contexts are the same.
+        //
+        MoreData = XdpPollInvokeEx(Xsk->Rx.Xdp.PollHandle, &InvokeData);
+        RxCompleted = InvokeData.RxCompleted;
+        TxCompleted = InvokeData.TxCompleted;
+    } else {
+        if (Xsk->Rx.Xdp.PollHandle != NULL) {
+            MoreData |= XdpPollInvokeEx(Xsk->Rx.Xdp.PollHandle, &InvokeData);
+            RxCompleted += InvokeData.RxCompleted;
+            TxCompleted += InvokeData.TxCompleted;
+        }
+        if (Xsk->Tx.Xdp.PollHandle != NULL) {
+            InvokeData.RxCompleted = 0;
+            InvokeData.TxCompleted = 0;
+            MoreData |= XdpPollInvokeEx(Xsk->Tx.Xdp.PollHandle, &InvokeData);
+            RxCompleted += InvokeData.RxCompleted;
+            TxCompleted += InvokeData.TxCompleted;
+        }
+    }
+
+    //
+    // A poll that stopped short of its quotas drained the interface queues.
+    //
+    *WorkRemaining =
+        MoreData &&
+        ((RxQuota > 0 && RxCompleted >= RxQuota) || (TxQuota > 0 && TxCompleted >= TxQuota));
+
+    return MoreData;
+}
+
+static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+VOID
+XskPollSetNotifications(
+    _In_ XSK *Xsk,
+    _In_ BOOLEAN EnableNotifications
+    )
+{
+    ASSERT(Xsk->Rx.Xdp.PollHandle != NULL || Xsk->Tx.Xdp.PollHandle != NULL);
+
+    if (Xsk->Rx.Xdp.PollHandle == Xsk->Tx.Xdp.PollHandle) {
+        //
+        // Typically the RX and TX poll contexts are the same.
+        //
+        XdpPollSetNotifications(Xsk->Rx.Xdp.PollHandle, EnableNotifications);
+    } else {
+        if (Xsk->Rx.Xdp.PollHandle != NULL) {
+            XdpPollSetNotifications(Xsk->Rx.Xdp.PollHandle, EnableNotifications);
+        }
+        if (Xsk->Tx.Xdp.PollHandle != NULL) {
+            XdpPollSetNotifications(Xsk->Tx.Xdp.PollHandle, EnableNotifications);
+        }
+    }
+}
+
+static
+_Requires_exclusive_lock_held_(&Xsk->PollLock)
+NTSTATUS
+XskPollSocket(
+    _In_ XSK *Xsk,
+    _In_ UINT32 Flags,
+    _In_ UINT32 TimeoutMs
+    )
+{
+    NTSTATUS Status;
+    BOOLEAN MoreData;
+    BOOLEAN WorkRemaining;
+    UINT32 WaitFlags;
+    BOOLEAN NotificationsArmed = FALSE;
+    UINT64 DueTime = 0;
+    UINT64 CurrentTime;
+    LARGE_INTEGER WaitTime;
+    LARGE_INTEGER *WaitTimePtr = NULL;
+    UINT32 Budget = (Xsk->PollBudget > 0) ? Xsk->PollBudget : XSK_POLL_DEFAULT_BUDGET;
+
+    WaitFlags = Flags & (XSK_NOTIFY_FLAG_WAIT_RX | XSK_NOTIFY_FLAG_WAIT_TX);
+
+    if (TimeoutMs != INFINITE) {
+        WaitTimePtr = &WaitTime;
+        DueTime = KeQueryInterruptTime();
+        DueTime += RTL_MILLISEC_TO_100NANOSEC(TimeoutMs);
+    }
+
+    while (TRUE) {
+        UINT32 RxQuota = Budget;
+        UINT32 TxQuota = Budget;
+
+        if (ReadULongNoFence(&Xsk->PollWaiters) > 0) {
+            //
+            // Give the control path a chance to acquire the poll lock.
+            //
+            RtlReleasePushLockExclusive(&Xsk->PollLock);
+            RtlAcquirePushLockExclusive(&Xsk->PollLock);
+
+            if (Xsk->PollMode != XSK_POLL_MODE_SOCKET ||
+                (Xsk->Rx.Xdp.PollHandle == NULL && Xsk->Tx.Xdp.PollHandle == NULL)) {
+                return STATUS_SUCCESS;
+            }
+        }
+
+        //
+        // TODO: Optimize common case where RX and TX share a poll handle.
+        //
+        if (Xsk->Rx.Xdp.PollHandle != NULL) {
+            RxQuota = XskRxFillAvailable(Xsk, RxQuota);
+            RxQuota = XskRingProdReserve(&Xsk->Rx.Ring, RxQuota);
+        }
+        if (Xsk->Tx.Xdp.PollHandle != NULL) {
+            TxQuota = XskRingConsPeek(&Xsk->Tx.Ring, TxQuota);
+            TxQuota = XskRingProdReserve(&Xsk->Tx.CompletionRing, TxQuota);
+        }
+
+        MoreData = XskPollInvoke(Xsk, RxQuota, TxQuota, &WorkRemaining);
+
+        //
+        // TODO: Optimize return conditions: should we try to completely fill
+        // all buffers, or return as soon as a single buffer is available, or
+        // something in between?
+        //
+        if (!WaitFlags || XskQueryReadyIo(Xsk, WaitFlags)) {
+            return STATUS_SUCCESS;
+        }
+
+        //
+        // Check if the wait interval has timed out.
+        // Review: should we use a higher precision time source?
+        //
+        if (TimeoutMs != INFINITE) {
+            CurrentTime = KeQueryInterruptTime();
+            if (CurrentTime >= DueTime) {
+                return STATUS_TIMEOUT;
+            }
+
+            WaitTime.QuadPart = -(LONG64)(DueTime - CurrentTime);
+        }
+
+        //
+        // If no data is available, attempt to arm notifications and enter
+        // the waiting state.
+        //
+        if (!MoreData && !Xsk->PollBusy) {
+            if (!NotificationsArmed) {
+                XskPollSetNotifications(Xsk, TRUE);
+                NotificationsArmed = TRUE;
+            } else {
+                Status =
+                    KeWaitForSingleObject(
+                        &Xsk->PollRequested, UserRequest, UserMode, FALSE, WaitTimePtr);
+                if (Status != STATUS_SUCCESS) {
+                    return Status;
+                }
+                MoreData = TRUE;
+            }
+        }
+
+        if (MoreData) {
+            NotificationsArmed = FALSE;
+
+            if (!WorkRemaining && !Xsk->PollBusy) {
+                //
+                // The interfaces are drained, so arm notifications now rather
+                // than spending another poll to discover there is no data.
+                // The next poll then closes the race with newly arrived data.
+                //
+                XskPollSetNotifications(Xsk, TRUE);
+                NotificationsArmed = TRUE;
+            }
+        }
+    }
+}
+
+static
+NTSTATUS
+XskSockoptSetPollMode(
+    _In_ XSK *Xsk,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    XSK_POLL_PARAMETERS Parameters = {0};
+    XSK_POLL_PARAMETERS Current;
+    UINT32 ParametersLength;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(XSK_POLL_MODE)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    //
+    // Accept either a bare poll mode or the full set of poll parameters.
+    //
+    ParametersLength =
+        (SockoptInputBufferLength >= sizeof(Parameters)) ?
+            sizeof(Parameters) : sizeof(Parameters.PollMode);
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(XSK_POLL_MODE));
+        }
+        RtlCopyVolatileMemory(&Parameters, SockoptInputBuffer, ParametersLength);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    //
+    // Setting the current poll mode and parameters again is common for
+    // applications that switch modes frequently, so complete redundant
+    // transitions without interrupting a socket polling thread. The current
+    // mode continues to acquire polling backchannels as queues are attached.
+    //
+    if (XskTryReadPollState(Xsk, &Current) &&
+        Current.PollMode == Parameters.PollMode &&
+        Current.Budget == Parameters.Budget &&
+        Current.IdleTimeoutMs == Parameters.IdleTimeoutMs &&
+        (Parameters.PollMode == XSK_POLL_MODE_DEFAULT ||
+            ReadNoFence((LONG *)&Xsk->State) == XskActive)) {
+        Status = STATUS_SUCCESS;
+        goto Exit;
+    }
+
+    XskAcquirePollLock(Xsk);
+    Status =
+        XskSetPollMode(
+            Xsk, Parameters.PollMode, Parameters.Budget, Parameters.IdleTimeoutMs);
+    XskReleasePollLock(Xsk);
+
+    if (NT_SUCCESS(Status)) {
+        TraceInfo(
+            TRACE_XSK, "Xsk=%p Set poll mode PollMode=%u Budget=%u IdleTimeoutMs=%u",
+            Xsk, Parameters.PollMode, Parameters.Budget, Parameters.IdleTimeoutMs);
+    }
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptGetPollMode(
+    _In_ XSK *Xsk,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    XSK_POLL_PARAMETERS *Parameters = Irp->AssociatedIrp.SystemBuffer;
+    XSK_POLL_PARAMETERS Current;
+    UINT32 OutputBufferLength = IrpSp->Parameters.DeviceIoControl.OutputBufferLength;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (OutputBufferLength < sizeof(Parameters->PollMode)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    //
+    // Read the published poll state without the poll lock, unless a transition
+    // is in progress.
+    //
+    if (!XskTryReadPollState(Xsk, &Current)) {
+        XskAcquirePollLock(Xsk);
+        Current.PollMode = Xsk->PollMode;
+        Current.Budget = Xsk->PollBudget;
+        Current.IdleTimeoutMs = Xsk->PollBusyIdleTimeoutMs;
+        XskReleasePollLock(Xsk);
+    }
+
+    Parameters->PollMode = Current.PollMode;
+
+    if (OutputBufferLength >= sizeof(*Parameters)) {
+        Parameters->Budget = Current.Budget;
+        Parameters->IdleTimeoutMs = Current.IdleTimeoutMs;
+        Irp->IoStatus.Information = sizeof(*Parameters);
+    } else {
+        Irp->IoStatus.Information = sizeof(Parameters->PollMode);
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskSockoptSetNotifyCompletionPort(
+    _In_ XSK *Xsk,
+    _In_ FILE_OBJECT *FileObject,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status;
+    const VOID *SockoptInputBuffer;
+    UINT32 SockoptInputBufferLength;
+    XSK_NOTIFY_COMPLETION_PORT Completion;
+    UINT32 ReadyFlags = 0;
+    KIRQL OldIrql;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    //
+    // This is a nested buffer not copied by IO manager, so it needs special care.
+    //
+    SockoptInputBuffer = Sockopt->InputBuffer;
+    SockoptInputBufferLength = Sockopt->InputBufferLength;
+
+    if (SockoptInputBufferLength < sizeof(Completion)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)SockoptInputBuffer, SockoptInputBufferLength,
+                PROBE_ALIGNMENT(XSK_NOTIFY_COMPLETION_PORT));
+        }
+        RtlCopyVolatileMemory(&Completion, SockoptInputBuffer, sizeof(Completion));
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if (Completion.Flags & ~(XSK_NOTIFY_FLAG_WAIT_RX | XSK_NOTIFY_FLAG_WAIT_TX)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (Xsk->State != XskActive ||
+        (Completion.Flags & XSK_NOTIFY_FLAG_WAIT_RX && Xsk->Rx.Ring.Size == 0) ||
+        (Completion.Flags & XSK_NOTIFY_FLAG_WAIT_TX && Xsk->Tx.Ring.Size == 0)) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else if (Completion.Flags != 0 && FileObject->CompletionContext == NULL) {
+        //
+        // The socket handle must be associated with a completion port.
+        //
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        //
+        // Disable completions while the target is updated. Once associated,
+        // the file object's completion port cannot change and remains valid
+        // until the file object is closed.
+        //
+        WriteUInt32NoFence(&Xsk->IoCompletion.Flags, 0);
+
+        if (Completion.Flags != 0) {
+            Xsk->IoCompletion.Port = FileObject->CompletionContext->Port;
+            Xsk->IoCompletion.Key = FileObject->CompletionContext->Key;
+            Xsk->IoCompletion.Context = Completion.Context;
+            Xsk->IoCompletion.Routine = NULL;
+            WriteUInt32Release(&Xsk->IoCompletion.Flags, Completion.Flags);
+
+            //
+            // Rings that are already non-empty will not transition, so queue
+            // their completion now.
+            //
+            KeMemoryBarrier();
+            ReadyFlags = XskQueryReadyIo(Xsk, Completion.Flags);
+        }
+
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    if (ReadyFlags != 0) {
+        XskPostIoCompletion(Xsk, ReadyFlags);
+    }
+
+    if (NT_SUCCESS(Status)) {
+        TraceInfo(
+            TRACE_XSK, "Xsk=%p Set notify completion port Flags=0x%x Context=%p",
+            Xsk, Completion.Flags, Completion.Context);
+    }
+
+Exit:
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskGetSockopt(
+    _In_ XSK *Xsk,
+    _In_ UINT32 Option,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    switch (Option) {
+    case XSK_SOCKOPT_RING_INFO:
+        Status = XskSockoptGetRingInfo(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_RX_PRIORITY_RING_INFO:
+        Status = XskSockoptGetRxPriorityRingInfo(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_STATISTICS:
+        Status = XskSockoptGetStatistics(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_STATISTICS_EX:
+        Status = XskSockoptGetStatisticsEx(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_STATISTICS_PAGE:
+        Status = XskSockoptGetStatisticsPage(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_UMEM_MAPPING:
+        Status = XskSockoptGetUmemMapping(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_RX_HOOK_ID:
+    case XSK_SOCKOPT_TX_HOOK_ID:
+        Status = XskSockoptGetHookId(Xsk, Option, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_RX_ERROR:
+    case XSK_SOCKOPT_RX_FILL_ERROR:
+    case XSK_SOCKOPT_TX_ERROR:
+    case XSK_SOCKOPT_TX_COMPLETION_ERROR:
+        Status = XskSockoptGetError(Xsk, Option, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_RX_MULTI_BUFFER:
+    case XSK_SOCKOPT_TX_ZERO_COPY:
+    case XSK_SOCKOPT_RX_METADATA:
+        Status = XskSockoptGetDatapathMode(Xsk, Option, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_TIMESTAMPS:
+        Status = XskSockoptGetTimestamps(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_TX_SEGMENTATION:
+        Status = XskSockoptGetTxSegmentation(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_TX_FRAME_LAYOUT_EXTENSION:
+    case XSK_SOCKOPT_TX_FRAME_CHECKSUM_EXTENSION:
+        Status = XskSockoptGetTxDescriptorExtension(Xsk, Option, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_OFFLOAD_UDP_CHECKSUM_TX_CAPABILITIES:
+    case XSK_SOCKOPT_OFFLOAD_TCP_CHECKSUM_TX_CAPABILITIES:
+    case XSK_SOCKOPT_OFFLOAD_IPV4_CHECKSUM_TX_CAPABILITIES:
+        Status = XskSockoptGetChecksumOffloadCapabilities(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_NUMA_NODE:
+        Status = XskSockoptGetNumaNode(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_TX_WEIGHT:
+        Status = XskSockoptGetTxWeight(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_TX_RATE_LIMIT:
+        Status = XskSockoptGetTxRateLimit(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_TX_LAUNCH_TIME:
+        Status = XskSockoptGetTxLaunchTime(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_TX_POKE_LINGER:
+        Status = XskSockoptGetTxPokeLinger(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_RX_HEADER_SPLIT:
+        Status = XskSockoptGetRxHeaderSplit(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_RX_COALESCE:
+        Status = XskSockoptGetRxCoalesce(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_LARGE_PAGES:
+        Status = XskSockoptGetLargePages(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_UMEM_ALIGNED_CHUNKS:
+        Status = XskSockoptGetUmemAlignedChunks(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_RX_NONTEMPORAL_COPY:
+        Status = XskSockoptGetRxNonTemporalCopy(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_NOTIFY_MODERATION:
+        Status = XskSockoptGetNotifyModeration(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_WAKE_PARAMETERS:
+        Status = XskSockoptGetWakeParameters(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_TX_COMPLETION_BATCH:
+        Status = XskSockoptGetTxCompletionBatch(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_MODE_FAILOVER:
+        Status = XskSockoptGetModeFailover(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_TX_COMPLETION_IN_ORDER:
+        Status = XskSockoptGetTxCompletionInOrder(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_RX_BACKPRESSURE:
+        Status = XskSockoptGetRxBackpressure(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_MEMORY_USAGE:
+        Status = XskSockoptGetMemoryUsage(Xsk, Irp, IrpSp);
+        break;
+    case XSK_SOCKOPT_RING_OCCUPANCY:
+        Status = XskSockoptGetRingOccupancy(Xsk, Irp, IrpSp);
+        break;
+#if !defined(XDP_OFFICIAL_BUILD)
+    case XSK_SOCKOPT_POLL_MODE:
+        Status = XskSockoptGetPollMode(Xsk, Irp, IrpSp);
+        break;
+#endif // !defined(XDP_OFFICIAL_BUILD)
+    default:
+        Status = STATUS_NOT_SUPPORTED;
+        break;
+    }
+
+    TraceInfo(TRACE_XSK, "Xsk=%p Option=%u Status=%!STATUS!", Xsk, Option, Status);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskIrpGetSockopt(
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    XSK *Xsk;
+    UINT32 Option = 0;
+
+    Xsk = IrpSp->FileObject->FsContext;
+
+    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(Option)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    Option = *(UINT32 *)Irp->AssociatedIrp.SystemBuffer;
+
+    return XskGetSockopt(Xsk, Option, Irp, IrpSp);
+}
+
+static
+_Success_(NT_SUCCESS(IoStatus->Status))
+VOID
+XskGetIdealProcessor(
+    _In_ XSK *Xsk,
+    _Inout_ XSK_KERNEL_RING *Ring,
+    _In_ KPROCESSOR_MODE PreviousMode,
+    _Out_ VOID *OutputBuffer,
+    _In_ UINT32 OutputBufferLength,
+    _Out_ IO_STATUS_BLOCK *IoStatus
+    )
+{
+    UINT32 ProcIndex;
+    PROCESSOR_NUMBER ProcNumber;
+
+    //
+    // N.B. This function must be called within a try/catch block.
+    //
+
+    if (ReadUInt32Acquire((UINT32 *)&Xsk->State) < XskActive || Ring->Size == 0) {
+        IoStatus->Status = STATUS_INVALID_DEVICE_STATE;
+        return;
+    }
+
+    if (OutputBufferLength < sizeof(PROCESSOR_NUMBER)) {
+        IoStatus->Status = STATUS_BUFFER_TOO_SMALL;
+        return;
+    }
+
+    if (PreviousMode != KernelMode) {
+        #pragma prefast(suppress:6001) // Using uninitialized memory '*OutputBuffer'
+        ProbeForWrite(
+            OutputBuffer, sizeof(PROCESSOR_NUMBER), PROBE_ALIGNMENT(PROCESSOR_NUMBER));
+    }
+
+    //
+    // Reset the affinity flag before reading the affinity value.
+    //
+    InterlockedAnd((LONG *)&Ring->Shared->Flags, ~XSK_RING_FLAG_AFFINITY_CHANGED);
+
+    ProcIndex = ReadUInt32NoFence(&Ring->IdealProcessor);
+    if (ProcIndex == INVALID_PROCESSOR_INDEX) {
+        IoStatus->Status = STATUS_DEVICE_NOT_READY;
+        return;
+    }
+
+    NT_VERIFY(NT_SUCCESS(KeGetProcessorNumberFromIndex(ProcIndex, &ProcNumber)));
+
+    *(PROCESSOR_NUMBER *)OutputBuffer = ProcNumber;
+    IoStatus->Information = sizeof(PROCESSOR_NUMBER);
+    IoStatus->Status = STATUS_SUCCESS;
+}
+
+#pragma warning(push)
+#pragma warning(disable:6101) // We don't set OutputBuffer in some paths
+static
+BOOLEAN
+XskFastGetSockopt(
+    _In_ XDP_FILE_OBJECT_HEADER *FileObjectHeader,
+    _In_opt_ VOID *InputBuffer,
+    _In_ UINT32 InputBufferLength,
+    _Out_opt_ VOID *OutputBuffer,
+    _In_ UINT32 OutputBufferLength,
+    _Out_ IO_STATUS_BLOCK *IoStatus
+    )
+{
+    XSK *Xsk = (XSK *)FileObjectHeader;
+    const KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
+    UINT32 Option = 0;
+
+    __try {
+        #pragma prefast(push)
+        #pragma prefast(disable:6011) // Dereferencing NULL pointer is safe within try/catch.
+        #pragma prefast(disable:6387) // Dereferencing NULL pointer is safe within try/catch.
+
+        if (InputBufferLength < sizeof(Option)) {
+            IoStatus->Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+
+        if (PreviousMode != KernelMode) {
+            ProbeForRead(
+                (VOID *)InputBuffer, InputBufferLength, PROBE_ALIGNMENT(UINT32));
+        }
+
+        Option = ReadUInt32NoFence(InputBuffer);
+
+        switch (Option) {
+        case XSK_SOCKOPT_RX_PROCESSOR_AFFINITY:
+            XskGetIdealProcessor(
+                Xsk, &Xsk->Rx.Ring, PreviousMode, OutputBuffer, OutputBufferLength, IoStatus);
+            break;
+
+        case XSK_SOCKOPT_TX_PROCESSOR_AFFINITY:
+            XskGetIdealProcessor(
+                Xsk, &Xsk->Tx.Ring, PreviousMode, OutputBuffer, OutputBufferLength, IoStatus);
+            break;
+
+        default:
+            //
+            // Fall back to the IRP-based socket option path.
+            //
+            return FALSE;
+        }
+
+        #pragma prefast(pop)
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        IoStatus->Status = GetExceptionCode();
+        goto Exit;
+    }
+
+Exit:
+
+    return TRUE;
+}
+#pragma warning(pop)
+
+static
+NTSTATUS
+XskSetSockopt(
+    _In_ XSK *Xsk,
+    _In_ FILE_OBJECT *FileObject,
+    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
+    _In_ KPROCESSOR_MODE RequestorMode
+    )
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    switch (Sockopt->Option) {
+    case XSK_SOCKOPT_UMEM_REG:
+        Status = XskSockoptSetUmem(Xsk, Sockopt, RequestorMode, FALSE);
+        break;
+    case XSK_SOCKOPT_UMEM_ALLOC:
+        Status = XskSockoptSetUmem(Xsk, Sockopt, RequestorMode, TRUE);
+        break;
+    case XSK_SOCKOPT_HANDOFF:
+        Status = XskSockoptSetHandoff(Xsk, RequestorMode);
+        break;
+    case XSK_SOCKOPT_SHARED_UMEM:
+        Status = XskSockoptSetSharedUmem(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_TX_RING_SIZE:
+    case XSK_SOCKOPT_RX_RING_SIZE:
+    case XSK_SOCKOPT_RX_FILL_RING_SIZE:
+    case XSK_SOCKOPT_TX_COMPLETION_RING_SIZE:
+    case XSK_SOCKOPT_RX_PRIORITY_RING_SIZE:
+        Status = XskSockoptSetRingSize(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_RX_HOOK_ID:
+    case XSK_SOCKOPT_TX_HOOK_ID:
+        Status = XskSockoptSetHookId(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_RX_MULTI_BUFFER:
+    case XSK_SOCKOPT_TX_ZERO_COPY:
+    case XSK_SOCKOPT_RX_METADATA:
+        Status = XskSockoptSetDatapathMode(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_TIMESTAMPS:
+        Status = XskSockoptSetTimestamps(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_TX_SEGMENTATION:
+        Status = XskSockoptSetTxSegmentation(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_OFFLOAD_UDP_CHECKSUM_TX:
+    case XSK_SOCKOPT_OFFLOAD_TCP_CHECKSUM_TX:
+    case XSK_SOCKOPT_OFFLOAD_IPV4_CHECKSUM_TX:
+        Status = XskSockoptSetChecksumOffload(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_EBPF_MAP_KEY:
+        Status = XskSockoptSetEbpfMapKey(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_EBPF_METADATA:
+        Status = XskSockoptSetEbpfMetadata(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_TX_WEIGHT:
+        Status = XskSockoptSetTxWeight(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_TX_RATE_LIMIT:
+        Status = XskSockoptSetTxRateLimit(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_TX_LAUNCH_TIME:
+        Status = XskSockoptSetTxLaunchTime(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_TX_POKE_LINGER:
+        Status = XskSockoptSetTxPokeLinger(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_RX_HEADER_SPLIT:
+        Status = XskSockoptSetRxHeaderSplit(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_RX_COALESCE:
+        Status = XskSockoptSetRxCoalesce(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_LARGE_PAGES:
+        Status = XskSockoptSetLargePages(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_UMEM_ALIGNED_CHUNKS:
+        Status = XskSockoptSetUmemAlignedChunks(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_RX_NONTEMPORAL_COPY:
+        Status = XskSockoptSetRxNonTemporalCopy(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_NOTIFY_MODERATION:
+        Status = XskSockoptSetNotifyModeration(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_WAKE_PARAMETERS:
+        Status = XskSockoptSetWakeParameters(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_TX_COMPLETION_BATCH:
+        Status = XskSockoptSetTxCompletionBatch(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_SHARED_FILL_RING:
+        Status = XskSockoptSetSharedFillRing(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_RX_FILL_POOL:
+        Status = XskSockoptSetRxFillPool(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_SHARED_RX_RING:
+        Status = XskSockoptSetSharedRxRing(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_UMEM_ADD_REGION:
+        Status = XskSockoptAddUmemRegion(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_UMEM_REMOVE_REGION:
+        Status = XskSockoptRemoveUmemRegion(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_MODE_FAILOVER:
+        Status = XskSockoptSetModeFailover(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_TX_COMPLETION_IN_ORDER:
+        Status = XskSockoptSetTxCompletionInOrder(Xsk, Sockopt, RequestorMode);
+        break;
+    case XSK_SOCKOPT_RX_BACKPRESSURE:
+        Status = XskSockoptSetRxBackpressure(Xsk, Sockopt, RequestorMode);
+        break;
+#if !defined(XDP_OFFICIAL_BUILD)
+    case XSK_SOCKOPT_POLL_MODE:
+        Status = XskSockoptSetPollMode(Xsk, Sockopt, RequestorMode);
+        break;
+#endif // !defined(XDP_OFFICIAL_BUILD)
+    case XSK_SOCKOPT_NOTIFY_COMPLETION_PORT:
+        Status =
+            XskSockoptSetNotifyCompletionPort(
+                Xsk, FileObject, Sockopt, RequestorMode);
+        break;
+    default:
+        Status = STATUS_NOT_SUPPORTED;
+        break;
+    }
+
+    TraceInfo(
+        TRACE_XSK, "Xsk=%p Option=%u Status=%!STATUS! Value=%!HEXDUMP!",
+        Xsk, Sockopt->Option, Status, WppHexDump(Sockopt->InputBuffer, Sockopt->InputBufferLength));
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskIrpSetSockopt(
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    XSK *Xsk;
+    XSK_SET_SOCKOPT_IN *Sockopt = NULL;
+
+    Xsk = IrpSp->FileObject->FsContext;
+
+    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(XSK_SET_SOCKOPT_IN)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    Sockopt = Irp->AssociatedIrp.SystemBuffer;
+
+    return XskSetSockopt(Xsk, IrpSp->FileObject, Sockopt, Irp->RequestorMode);
+}
+
+static
+NTSTATUS
+XskSockoptsGet(
+    _In_ XSK *Xsk,
+    _Inout_ XSK_SOCKOPT_ENTRY *Entry,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    VOID *OptionValue = NULL;
+    VOID *OldSystemBuffer = Irp->AssociatedIrp.SystemBuffer;
+    ULONG OldOutputBufferLength = IrpSp->Parameters.DeviceIoControl.OutputBufferLength;
+
+    //
+    // The get handlers write their output into the IRP system buffer, so stage
+    // the option value in a kernel buffer and present it as a buffered request.
+    //
+    if (Entry->OptionLength > 0) {
+        OptionValue = ExAllocatePoolZero(NonPagedPoolNx, Entry->OptionLength, POOLTAG_SOCKOPT);
+        if (OptionValue == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
+    }
+
+    Irp->AssociatedIrp.SystemBuffer = OptionValue;
+    IrpSp->Parameters.DeviceIoControl.OutputBufferLength = Entry->OptionLength;
+    Irp->IoStatus.Information = 0;
+
+    Status = XskGetSockopt(Xsk, Entry->OptionName, Irp, IrpSp);
+
+    Irp->AssociatedIrp.SystemBuffer = OldSystemBuffer;
+    IrpSp->Parameters.DeviceIoControl.OutputBufferLength = OldOutputBufferLength;
+
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    ASSERT(Irp->IoStatus.Information <= Entry->OptionLength);
+    Entry->OptionLength = (UINT32)Irp->IoStatus.Information;
+    Irp->IoStatus.Information = 0;
+
+    __try {
+        if (Irp->RequestorMode != KernelMode) {
+            ProbeForWrite(Entry->OptionValue, Entry->OptionLength, sizeof(UCHAR));
+        }
+        RtlCopyVolatileMemory(Entry->OptionValue, OptionValue, Entry->OptionLength);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+Exit:
+
+    if (OptionValue != NULL) {
+        ExFreePoolWithTag(OptionValue, POOLTAG_SOCKOPT);
+    }
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskIrpSockopts(
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    XSK *Xsk = IrpSp->FileObject->FsContext;
+    XSK_SOCKOPTS_IN Params = {0};
+    UINT32 *CompletedCount = Irp->UserBuffer;
+    UINT32 Index = 0;
+
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+
+    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(Params) ||
+        IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*CompletedCount)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    __try {
+        if (Irp->RequestorMode != KernelMode) {
+            ProbeForRead(
+                IrpSp->Parameters.DeviceIoControl.Type3InputBuffer, sizeof(Params),
+                PROBE_ALIGNMENT(XSK_SOCKOPTS_IN));
+            ProbeForWrite(
+                CompletedCount, sizeof(*CompletedCount), PROBE_ALIGNMENT(UINT32));
+        }
+        RtlCopyVolatileMemory(
+            &Params, IrpSp->Parameters.DeviceIoControl.Type3InputBuffer, sizeof(Params));
+        *CompletedCount = 0;
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    if (Params.OptionCount == 0 || Params.OptionCount > XSK_SOCKOPTS_MAXIMUM) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    //
+    // Process the options in order, stopping at the first failure. Each option
+    // is validated against the socket state by its own handler, exactly as if
+    // it were issued individually.
+    //
+    for (; Index < Params.OptionCount; Index++) {
+        XSK_SOCKOPT_ENTRY Entry;
+
+        __try {
+            if (Irp->RequestorMode != KernelMode) {
+                ProbeForWrite(
+                    &Params.Options[Index], sizeof(Entry), PROBE_ALIGNMENT(XSK_SOCKOPT_ENTRY));
+            }
+            RtlCopyVolatileMemory(&Entry, &Params.Options[Index], sizeof(Entry));
+        } __except (EXCEPTION_EXECUTE_HANDLER) {
+            Status = GetExceptionCode();
+            goto Exit;
+        }
+
+        if (Entry.Flags & ~XSK_SOCKOPT_ENTRY_FLAG_GET) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+
+        if (Entry.Flags & XSK_SOCKOPT_ENTRY_FLAG_GET) {
+            Status = XskSockoptsGet(Xsk, &Entry, Irp, IrpSp);
+        } else {
+            XSK_SET_SOCKOPT_IN Sockopt = {0};
+
+            Sockopt.Option = Entry.OptionName;
+            Sockopt.InputBufferLength = Entry.OptionLength;
+            Sockopt.InputBuffer = Entry.OptionValue;
+
+            Status = XskSetSockopt(Xsk, IrpSp->FileObject, &Sockopt, Irp->RequestorMode);
+        }
+
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        __try {
+            WriteUInt32NoFence(&Params.Options[Index].OptionLength, Entry.OptionLength);
+            *CompletedCount = Index + 1;
+        } __except (EXCEPTION_EXECUTE_HANDLER) {
+            Status = GetExceptionCode();
+            goto Exit;
+        }
+    }
+
+Exit:
+
+    TraceInfo(
+        TRACE_XSK, "Xsk=%p OptionCount=%u Completed=%u Status=%!STATUS!",
+        Xsk, Params.OptionCount, Index, Status);
+
+    TraceExitStatus(TRACE_XSK);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskNotifyValidateFlags(
+    _In_ XSK *Xsk,
+    _In_ UINT32 InFlags,
+    _In_ UINT32 ValidFlags
+    )
+{
+    if (InFlags == 0 || InFlags & ~ValidFlags) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if ((InFlags & XSK_NOTIFY_FLAG_WAIT_SPIN) &&
+        (InFlags & (XSK_NOTIFY_FLAG_WAIT_RX | XSK_NOTIFY_FLAG_WAIT_TX)) == 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if ((InFlags & (XSK_NOTIFY_FLAG_POKE_RX | XSK_NOTIFY_FLAG_WAIT_RX) && Xsk->Rx.Ring.Size == 0) ||
+        (InFlags & (XSK_NOTIFY_FLAG_POKE_TX | XSK_NOTIFY_FLAG_WAIT_TX) && Xsk->Tx.Ring.Size == 0)) {
+        return STATUS_INVALID_DEVICE_STATE;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XskNotifyValidateParams(
+    _In_ XSK *Xsk,
+    _In_opt_ VOID *InputBuffer,
+    _In_ ULONG InputBufferLength,
+    _In_ UINT32 ValidFlags,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Out_ PUINT32 TimeoutMilliseconds,
+    _Out_ PUINT32 InFlags
+    )
+{
+    if (Xsk->State != XskActive){
+        return STATUS_INVALID_DEVICE_STATE;
+    }
+
+    if (InputBufferLength < sizeof(XSK_NOTIFY_IN)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    __try {
+        ASSERT(InputBuffer);
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID*)InputBuffer, InputBufferLength, PROBE_ALIGNMENT(XSK_NOTIFY_IN));
+        }
+
+        *InFlags = ReadUInt32NoFence((UINT32 *)&((XSK_NOTIFY_IN *)InputBuffer)->Flags);
+        *TimeoutMilliseconds =
+            ReadUInt32NoFence(&((XSK_NOTIFY_IN *)InputBuffer)->WaitTimeoutMilliseconds);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        return GetExceptionCode();
+    }
+
+    return XskNotifyValidateFlags(Xsk, *InFlags, ValidFlags);
+}
+
+static
+NTSTATUS
+XskPoke(
+    _In_ XSK *Xsk,
+    _In_ UINT32 Flags,
+    _In_ UINT32 TimeoutMs
+    )
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    EventWriteXskNotifyPokeStart(&MICROSOFT_XDP_PROVIDER, Xsk, Flags);
+
+    if (Flags & XSK_NOTIFY_FLAG_POKE_RX) {
+        InterlockedIncrement64((LONG64 *)&XskGetProcessorStatistics(Xsk)->RxPokes);
+    }
+    if (Flags & XSK_NOTIFY_FLAG_POKE_TX) {
+        InterlockedIncrement64((LONG64 *)&XskGetProcessorStatistics(Xsk)->TxPokes);
+    }
+
+    RtlAcquirePushLockExclusive(&Xsk->PollLock);
+
+    if (Xsk->PollMode == XSK_POLL_MODE_BUSY && Xsk->PollBusyIdle) {
+        //
+        // The application is active again, so resume idle busy polling.
+        //
+        XskResumePollModeBusy(Xsk);
+    }
+
+    if (Xsk->PollMode == XSK_POLL_MODE_SOCKET &&
+        (Xsk->Rx.Xdp.PollHandle != NULL || Xsk->Tx.Xdp.PollHandle != NULL)) {
+        //
+        // Socket polling mode is active, so poll the interfaces synchronously.
+        //
+        Status = XskPollSocket(Xsk, Flags, TimeoutMs);
+    } else {
+        //
+        // Notify the underlying interfaces that data is available.
+        //
+
+        if (Flags & XSK_NOTIFY_FLAG_POKE_RX) {
+            ASSERT(Xsk->Rx.Ring.Size > 0);
+            ASSERT(Xsk->Rx.FillRing.Size > 0);
+            //
+            // TODO: Driver poke routine for zero copy RX.
+            //
+            ASSERT(Status == STATUS_SUCCESS);
+
+            if (Xsk->Rx.Xdp.Flags.Backpressure) {
+                //
+                // The interface may hold frames left under backpressure, so
+                // have it receive them now that the application made space.
+                // Clear the need poke flag first, so any frames left again
+                // set it again.
+                //
+                InterlockedAnd(
+                    (LONG *)&Xsk->Rx.FillRing.Shared->Flags, ~XSK_RING_FLAG_NEED_POKE);
+                XdpRxQueueInvokeInterfaceNotify(Xsk->Rx.Xdp.Queue, XDP_NOTIFY_QUEUE_FLAG_RX);
+            }
+        }
+
+        if (Flags & XSK_NOTIFY_FLAG_POKE_TX) {
+            XDP_NOTIFY_QUEUE_FLAGS NotifyFlags = XDP_NOTIFY_QUEUE_FLAG_TX;
+            //
+            // Before invoking the poke routine, atomically clear the need poke
+            // flag on the TX ring. The poke routine is required to execute a
+            // FlushTransmit, which guarantees the need poke flag can be set.
+            //
+            InterlockedAnd((LONG *)&Xsk->Tx.Ring.Shared->Flags, ~XSK_RING_FLAG_NEED_POKE);
+
+            if (Xsk->Tx.Xdp.Flags.QueueActive) {
+                if (Xsk->PollMode != XSK_POLL_MODE_INLINE || Xsk->Tx.Xdp.PollHandle == NULL ||
+                    !XskPollInlineTx(Xsk)) {
+                    XdpTxQueueInvokeInterfaceNotify(Xsk->Tx.Xdp.Queue, NotifyFlags);
+                }
+            } else {
+                Status = STATUS_DEVICE_REMOVED;
+            }
+        }
+    }
+
+    RtlReleasePushLockExclusive(&Xsk->PollLock);
+
+    EventWriteXskNotifyPokeStop(&MICROSOFT_XDP_PROVIDER, Xsk, Flags);
+
+    return Status;
+}
+
+static DRIVER_CANCEL XskCancelNotify;
+
+static
+_Use_decl_annotations_
+VOID
+XskCancelNotify(
+    DEVICE_OBJECT *DeviceObject,
+    IRP *Irp
+    )
+{
+    XSK *Xsk;
+    IO_STACK_LOCATION *IrpSp;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    IoReleaseCancelSpinLock(DISPATCH_LEVEL);
+
+    IrpSp = IoGetCurrentIrpStackLocation(Irp);
+    Xsk = IrpSp->FileObject->FsContext;
 
-    TraceInfo(
-        TRACE_XSK, "Xsk=%p Set ring Type=%u Size=%u",
-        Xsk, Sockopt->Option, NumDescriptors);
+    KeAcquireSpinLockAtDpcLevel(&Xsk->Lock);
 
-    Status = STATUS_SUCCESS;
+    //
+    // If the data path hasn't already dropped the IRP, reset the wait state
+    // here.
+    //
 
-    Ring->Shared = Shared;
-    Ring->Mdl = Mdl;
-    Ring->UserVa = UserVa;
-    Ring->Size = NumDescriptors;
-    Ring->Mask = NumDescriptors - 1;
-    Ring->ElementStride = DescriptorSize;
-    Ring->OwningProcess = PsGetCurrentProcess();
-    Ring->IdealProcessor = INVALID_PROCESSOR_INDEX;
-    ObReferenceObject(Ring->OwningProcess);
+    if (Xsk->IoWaitIrp == Irp) {
+        Xsk->IoWaitFlags = 0;
+        Xsk->IoWaitIrp = NULL;
+    }
 
-    Shared = NULL;
-    Mdl = NULL;
-    UserVa = NULL;
+    KeReleaseSpinLock(&Xsk->Lock, Irp->CancelIrql);
 
-Exit:
+    Irp->IoStatus.Status = STATUS_CANCELLED;
 
-    if (IsLockHeld) {
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    EventWriteXskNotifyAsyncComplete(&MICROSOFT_XDP_PROVIDER, Xsk, Irp, Irp->IoStatus.Status);
+    IoCompleteRequest(Irp, IO_NETWORK_INCREMENT);
+}
+
+//
+// Restricts the waiting thread to the processor that last signaled the RX
+// wait, if requested, so the thread wakes where the received frames are
+// cache-hot. Returns whether the caller must revert the thread's affinity.
+//
+static
+BOOLEAN
+XskSetWakeAffinity(
+    _In_ XSK *Xsk,
+    _In_ UINT32 InFlags,
+    _Out_ GROUP_AFFINITY *OldAffinity
+    )
+{
+    GROUP_AFFINITY Affinity = {0};
+    PROCESSOR_NUMBER ProcNumber;
+    UINT32 ProcIndex;
+
+    if ((InFlags & XSK_NOTIFY_FLAG_WAIT_RX) == 0 ||
+        (ReadUInt32NoFence(&Xsk->Wake.Flags) & XSK_WAKE_FLAG_RX_PROCESSOR) == 0) {
+        return FALSE;
     }
-    if (UserVa != NULL) {
-        MmUnmapLockedPages(UserVa, Mdl);
+
+    ProcIndex = ReadUInt32NoFence(&Xsk->Wake.RxSignalProcessor);
+    if (ProcIndex == INVALID_PROCESSOR_INDEX ||
+        !NT_SUCCESS(KeGetProcessorNumberFromIndex(ProcIndex, &ProcNumber))) {
+        return FALSE;
     }
-    if (Mdl != NULL) {
-        IoFreeMdl(Mdl);
+
+    Affinity.Group = ProcNumber.Group;
+    Affinity.Mask = AFFINITY_MASK(ProcNumber.Number);
+    KeSetSystemGroupAffinityThread(&Affinity, OldAffinity);
+
+    return TRUE;
+}
+
+static
+VOID
+XskTraceNotifyWakeup(
+    _In_ XSK *Xsk,
+    _In_ UINT32 SignalProcessor,
+    _In_ INT64 SignalQpc
+    )
+{
+    LARGE_INTEGER FrequencyQpc;
+    INT64 LatencyQpc = KeQueryPerformanceCounter(&FrequencyQpc).QuadPart - SignalQpc;
+    INT64 LatencyUs = max(0, LatencyQpc) * 1000000 / FrequencyQpc.QuadPart;
+
+    EventWriteXskNotifyWakeup(
+        &MICROSOFT_XDP_PROVIDER, Xsk, (UINT32)min(LatencyUs, MAXUINT32), SignalProcessor,
+        KeGetCurrentProcessorIndex());
+}
+
+static
+INT64
+XskNotifySpinLimitQpc(
+    _In_ INT64 FrequencyQpc
+    )
+{
+    return FrequencyQpc * XSK_NOTIFY_SPIN_MAX_US / 1000000;
+}
+
+static
+UINT32
+XskNotifySpin(
+    _In_ XSK *Xsk,
+    _In_ UINT32 InFlags,
+    _In_ UINT32 TimeoutMilliseconds,
+    _In_ INT64 StartQpc,
+    _In_ INT64 FrequencyQpc
+    )
+{
+    INT64 AverageQpc = ReadNoFence64(&Xsk->NotifySpinAverageQpc);
+    INT64 LimitQpc = XskNotifySpinLimitQpc(FrequencyQpc);
+    INT64 SpinQpc;
+    UINT32 ReadyFlags;
+
+    //
+    // Spin for up to twice the time recent waits took to become ready. If IO
+    // typically takes longer than the spin limit, spinning only burns CPU
+    // before blocking anyway, so block immediately.
+    //
+    if (AverageQpc > LimitQpc) {
+        return 0;
     }
-    if (Shared != NULL) {
-        ExFreePoolWithTag(Shared, POOLTAG_RING);
+
+    SpinQpc = min(AverageQpc * 2, LimitQpc);
+    if (TimeoutMilliseconds != INFINITE) {
+        SpinQpc = min(SpinQpc, FrequencyQpc * TimeoutMilliseconds / 1000);
     }
 
-    TraceExitStatus(TRACE_XSK);
+    do {
+        YieldProcessor();
+        ReadyFlags = XskQueryReadyIo(Xsk, InFlags);
+    } while (ReadyFlags == 0 && KeQueryPerformanceCounter(NULL).QuadPart - StartQpc < SpinQpc);
 
-    return Status;
+    return ReadyFlags;
+}
+
+static
+VOID
+XskNotifySpinUpdate(
+    _In_ XSK *Xsk,
+    _In_ INT64 StartQpc,
+    _In_ INT64 FrequencyQpc
+    )
+{
+    INT64 AverageQpc = ReadNoFence64(&Xsk->NotifySpinAverageQpc);
+    INT64 ElapsedQpc = KeQueryPerformanceCounter(NULL).QuadPart - StartQpc;
+
+    //
+    // Bound each sample so a long idle period does not prevent spinning from
+    // resuming promptly once IO arrives at a high rate again.
+    //
+    ElapsedQpc = min(ElapsedQpc, XskNotifySpinLimitQpc(FrequencyQpc) * 2);
+    WriteNoFence64(&Xsk->NotifySpinAverageQpc, AverageQpc + (ElapsedQpc - AverageQpc) / 8);
 }
 
 static
+_Success_(return == STATUS_SUCCESS)
 NTSTATUS
-XskSockoptGetHookId(
+XskNotify(
     _In_ XSK *Xsk,
-    _In_ UINT32 Option,
-    _In_ IRP *Irp,
-    _In_ IO_STACK_LOCATION *IrpSp
+    _In_opt_ VOID *InputBuffer,
+    _In_ ULONG InputBufferLength,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Out_ ULONG_PTR *Information,
+    _Inout_opt_ IRP *Irp
     )
 {
+    UINT32 TimeoutMilliseconds;
+    UINT32 ReadyFlags;
+    UINT32 InFlags;
+    UINT32 OutFlags = 0;
+    KIRQL OldIrql;
+    LARGE_INTEGER Timeout;
     NTSTATUS Status;
-    XDP_HOOK_ID *HookId = Irp->AssociatedIrp.SystemBuffer;
-    KIRQL OldIrql = {0};
-    BOOLEAN IsLockHeld = FALSE;
+    XSK_IO_WAIT_FLAGS InternalFlags;
+    LARGE_INTEGER FrequencyQpc = {0};
+    INT64 StartQpc = 0;
+    UINT32 SignalProcessor;
+    INT64 SignalQpc;
+    const UINT32 WaitMask = (XSK_NOTIFY_FLAG_WAIT_RX | XSK_NOTIFY_FLAG_WAIT_TX);
 
-    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+    //
+    // Asynchronous requests cannot spin without blocking the caller.
+    //
+    Status =
+        XskNotifyValidateParams(
+            Xsk, InputBuffer, InputBufferLength,
+            (Irp == NULL) ?
+                (XSK_NOTIFY_VALID_FLAGS | XSK_NOTIFY_FLAG_WAIT_SPIN) : XSK_NOTIFY_VALID_FLAGS,
+            RequestorMode, &TimeoutMilliseconds, &InFlags);
+    if (Status != STATUS_SUCCESS) {
+        TraceError(TRACE_XSK, "Xsk=%p Notify failed: Invalid params", Xsk);
+        goto Exit;
+    }
+
+    EventWriteXskNotifyStart(&MICROSOFT_XDP_PROVIDER, Xsk, Irp, InFlags, TimeoutMilliseconds);
+
+    //
+    // Snap the XSK notification state before performing the poke and/or wait.
+    //
+    InternalFlags = ReadULongAcquire((ULONG *)&Xsk->IoWaitInternalFlags);
+
+    if (InFlags & (XSK_NOTIFY_FLAG_POKE_RX | XSK_NOTIFY_FLAG_POKE_TX)) {
+        Status = XskPoke(Xsk, InFlags, TimeoutMilliseconds);
+        if (Status != STATUS_SUCCESS) {
+            TraceError(
+                TRACE_XSK, "Xsk=%p Notify failed: Poke failed Status=%!STATUS!",
+                Xsk, Status);
+            goto Exit;
+        }
+    }
+
+    if ((InFlags & (XSK_NOTIFY_FLAG_WAIT_RX | XSK_NOTIFY_FLAG_WAIT_TX)) == 0) {
+        //
+        // Not interested in waiting for IO.
+        //
+        ASSERT(Status == STATUS_SUCCESS);
+        goto Exit;
+    }
+
+    //
+    // Opportunistic check for ready IO to avoid setting up a wait context.
+    //
+    ReadyFlags = XskQueryModeratedReadyIo(Xsk, InFlags);
+    if (ReadyFlags != 0) {
+        OutFlags |= XskWaitInFlagsToOutFlags(ReadyFlags);
+        ASSERT(Status == STATUS_SUCCESS);
+        goto Exit;
+    }
+
+    if (InFlags & XSK_NOTIFY_FLAG_WAIT_SPIN) {
+        StartQpc = KeQueryPerformanceCounter(&FrequencyQpc).QuadPart;
+
+        ReadyFlags =
+            XskNotifySpin(Xsk, InFlags, TimeoutMilliseconds, StartQpc, FrequencyQpc.QuadPart);
+        if (ReadyFlags != 0) {
+            XskNotifySpinUpdate(Xsk, StartQpc, FrequencyQpc.QuadPart);
+            OutFlags |= XskWaitInFlagsToOutFlags(ReadyFlags);
+            ASSERT(Status == STATUS_SUCCESS);
+            goto Exit;
+        }
+    }
+
+    //
+    // Set up the wait context.
+    //
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+    if (Xsk->State != XskActive) {
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+        TraceInfo(TRACE_XSK, "Xsk=%p Notify wait failed: XSK not bound", Xsk);
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+    if (Xsk->IoWaitFlags != 0) {
+        //
+        // There is currently a wait active. Only a single wait is allowed.
+        //
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+        TraceError(TRACE_XSK, "Xsk=%p Notify wait failed: Wait already active", Xsk);
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+    Xsk->IoWaitFlags = InFlags & WaitMask;
+    Xsk->Wake.RxSignalQpc = 0;
+    if (Irp != NULL) {
+        Xsk->IoWaitIrp = Irp;
+
+        //
+        // Mark the IRP as pending prior to enabling cancellation; once we mark
+        // an IRP as pending, we must return STATUS_PENDING to the IO manager.
+        //
+        IoMarkIrpPending(Irp);
+        Status = STATUS_PENDING;
+
+        //
+        // Enable cancellation and synchronize with the IO manager.
+        //
+        IoSetCancelRoutine(Irp, XskCancelNotify);
+        if (Irp->Cancel) {
+            if (IoSetCancelRoutine(Irp, NULL) != NULL) {
+                //
+                // The cancellation routine will not run; cancel the IRP here
+                // and bail.
+                //
+                Xsk->IoWaitIrp = NULL;
+                Xsk->IoWaitFlags = 0;
+                KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+                Irp->IoStatus.Status = STATUS_CANCELLED;
+                EventWriteXskNotifyAsyncComplete(
+                    &MICROSOFT_XDP_PROVIDER, Xsk, Irp, Irp->IoStatus.Status);
+                IoCompleteRequest(Irp, IO_NETWORK_INCREMENT);
+            } else {
+                //
+                // The cancellation routine will run; bail.
+                //
+                KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+            }
+
+            goto Exit;
+        }
+    } else {
+        KeClearEvent(&Xsk->IoWaitEvent);
+    }
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    //
+    // N.B. A memory barrier between the write of the wait event and the read of
+    // completed IO is needed in order to prevent a race condition when these
+    // operations are re-ordered. The race is between this thread and a thread
+    // completing IO. Memory barriers are also needed to protect against a
+    // similar race condition when the inverse of these operations are done
+    // during IO completion.
+    //
+    KeMemoryBarrier();
+
+    //
+    // Check for ready IO.
+    //
+    XskCheckReadyIoModerated(Xsk, InFlags);
+
+    //
+    // If the notification state changed while processing this request, abandon
+    // the wait and allow the application to re-examine the shared ring flags.
+    //
+    if (InternalFlags != Xsk->IoWaitInternalFlags) {
+        XskSignalReadyIo(Xsk, InFlags & WaitMask);
+    }
+
+    if (Irp == NULL) {
+        GROUP_AFFINITY OldAffinity;
+        BOOLEAN AffinitySet = XskSetWakeAffinity(Xsk, InFlags, &OldAffinity);
+
+        //
+        // Wait for IO.
+        //
+        Timeout.QuadPart = -1 * RTL_MILLISEC_TO_100NANOSEC(TimeoutMilliseconds);
+        Status =
+            KeWaitForSingleObject(
+                &Xsk->IoWaitEvent, UserRequest, UserMode, FALSE,
+                (TimeoutMilliseconds == INFINITE) ? NULL : &Timeout);
 
-    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*HookId)) {
-        Status = STATUS_INVALID_PARAMETER;
+        if (AffinitySet) {
+            KeRevertToUserGroupAffinityThread(&OldAffinity);
+        }
+    } else {
+        ASSERT(Status == STATUS_PENDING);
         goto Exit;
     }
 
     KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
-    IsLockHeld = TRUE;
-
-    switch (Option) {
-    case XSK_SOCKOPT_RX_HOOK_ID:
-        *HookId = Xsk->Rx.Xdp.HookId;
-        break;
+    Xsk->IoWaitFlags = 0;
+    SignalProcessor = Xsk->Wake.RxSignalProcessor;
+    SignalQpc = Xsk->Wake.RxSignalQpc;
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
 
-    case XSK_SOCKOPT_TX_HOOK_ID:
-        *HookId = Xsk->Tx.Xdp.HookId;
-        break;
+    if (SignalQpc != 0) {
+        XskTraceNotifyWakeup(Xsk, SignalProcessor, SignalQpc);
+    }
 
-    default:
-        Status = STATUS_NOT_SUPPORTED;
-        goto Exit;
+    //
+    // Re-query ready IO regardless of the wait status.
+    //
+    ReadyFlags = XskQueryReadyIo(Xsk, InFlags);
+    if (ReadyFlags != 0) {
+        Status = STATUS_SUCCESS;
+        OutFlags |= XskWaitInFlagsToOutFlags(ReadyFlags);
     }
 
-    Status = STATUS_SUCCESS;
-    Irp->IoStatus.Information = sizeof(*HookId);
+    if (InFlags & XSK_NOTIFY_FLAG_WAIT_SPIN) {
+        XskNotifySpinUpdate(Xsk, StartQpc, FrequencyQpc.QuadPart);
+    }
 
 Exit:
 
-    if (IsLockHeld) {
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+    //
+    // This IOCTL is assumed to never pend for fast IO, and code elsewhere takes
+    // advantage of this assumption.
+    //
+    ASSERT(Irp != NULL || Status != STATUS_PENDING);
+
+    if (Status != STATUS_PENDING) {
+        *Information = OutFlags;
     }
 
-    TraceExitStatus(TRACE_XSK);
+    EventWriteXskNotifyStop(&MICROSOFT_XDP_PROVIDER, Xsk, Irp, OutFlags, Status);
 
     return Status;
 }
 
+typedef struct _XSK_NOTIFY_SOCKET_WAIT {
+    FILE_OBJECT *FileObject;
+    XSK *Xsk;
+    UINT32 InFlags;
+    XSK_IO_WAIT_FLAGS InternalFlags;
+    BOOLEAN WaitArmed;
+} XSK_NOTIFY_SOCKET_WAIT;
+
+static
+VOID
+XskNotifySocketsDisarm(
+    _Inout_ XSK_NOTIFY_SOCKET_WAIT *Wait
+    )
+{
+    KIRQL OldIrql;
+
+    if (Wait->WaitArmed) {
+        KeAcquireSpinLock(&Wait->Xsk->Lock, &OldIrql);
+        Wait->Xsk->IoWaitFlags = 0;
+        KeReleaseSpinLock(&Wait->Xsk->Lock, OldIrql);
+        Wait->WaitArmed = FALSE;
+    }
+}
+
 static
+_Success_(return == STATUS_SUCCESS)
 NTSTATUS
-XskSockoptSetHookId(
-    _In_ XSK *Xsk,
-    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
-    _In_ KPROCESSOR_MODE RequestorMode
+XskNotifySockets(
+    _In_opt_ VOID *InputBuffer,
+    _In_ ULONG InputBufferLength,
+    _Out_ ULONG_PTR *Information
     )
 {
+    XSK_NOTIFY_SOCKETS_IN Params;
+    XSK_NOTIFY_SOCKET_WAIT *Waits = NULL;
+    VOID **WaitObjects;
+    KWAIT_BLOCK *WaitBlocks;
+    SIZE_T AllocationSize;
+    UINT32 SocketCount = 0;
+    UINT32 WaitObjectCount = 0;
+    UINT32 ReadyCount = 0;
+    UINT32 ReadyFlags;
+    KIRQL OldIrql;
+    LARGE_INTEGER Timeout;
     NTSTATUS Status;
-    const VOID *SockoptIn;
-    UINT32 SockoptInSize;
-    XDP_HOOK_ID HookId;
-    KIRQL OldIrql = {0};
-    BOOLEAN IsLockHeld = FALSE;
-
-    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+    KPROCESSOR_MODE RequestorMode = ExGetPreviousMode();
+    const UINT32 WaitMask = (XSK_NOTIFY_FLAG_WAIT_RX | XSK_NOTIFY_FLAG_WAIT_TX);
+    const UINT32 PokeMask = (XSK_NOTIFY_FLAG_POKE_RX | XSK_NOTIFY_FLAG_POKE_TX);
 
-    //
-    // This is a nested buffer not copied by IO manager, so it needs special care.
-    //
-    SockoptIn = Sockopt->InputBuffer;
-    SockoptInSize = Sockopt->InputBufferLength;
+    *Information = 0;
 
-    if (SockoptInSize < sizeof(HookId)) {
-        Status = STATUS_BUFFER_TOO_SMALL;
+    if (InputBufferLength < sizeof(Params)) {
+        Status = STATUS_INVALID_PARAMETER;
         goto Exit;
     }
 
     __try {
+        ASSERT(InputBuffer);
         if (RequestorMode != KernelMode) {
-            ProbeForRead((VOID*)SockoptIn, SockoptInSize, PROBE_ALIGNMENT(XDP_HOOK_ID));
+            ProbeForRead(InputBuffer, sizeof(Params), PROBE_ALIGNMENT(XSK_NOTIFY_SOCKETS_IN));
         }
-        RtlCopyVolatileMemory(&HookId, SockoptIn, sizeof(XDP_HOOK_ID));
+        RtlCopyVolatileMemory(&Params, InputBuffer, sizeof(Params));
     } __except (EXCEPTION_EXECUTE_HANDLER) {
         Status = GetExceptionCode();
         goto Exit;
     }
 
-    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
-    IsLockHeld = TRUE;
+    if (Params.SocketCount == 0 || Params.SocketCount > XSK_NOTIFY_SOCKETS_MAXIMUM) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
 
-    if (Xsk->State != XskUnbound) {
-        Status = STATUS_INVALID_DEVICE_STATE;
+    //
+    // Allocate the per-socket wait state, wait objects, and wait blocks in a
+    // single allocation. The socket count is small, so this cannot overflow.
+    //
+    AllocationSize =
+        (SIZE_T)Params.SocketCount *
+            (sizeof(*Waits) + sizeof(*WaitObjects) + sizeof(*WaitBlocks));
+    Waits = ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, POOLTAG_NOTIFY);
+    if (Waits == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
         goto Exit;
     }
+    WaitBlocks = (KWAIT_BLOCK *)&Waits[Params.SocketCount];
+    WaitObjects = (VOID **)&WaitBlocks[Params.SocketCount];
 
-    switch (Sockopt->Option) {
-    case XSK_SOCKOPT_RX_HOOK_ID:
-        TraceInfo(
-            TRACE_XSK,
-            "Xsk=%p Set XSK_SOCKOPT_RX_HOOK_ID Hook={%!HOOK_LAYER!, %!HOOK_DIR!, %!HOOK_SUBLAYER!}",
-            Xsk, HookId.Layer, HookId.Direction, HookId.SubLayer);
-        Xsk->Rx.Xdp.HookId = HookId;
-        break;
+    //
+    // Reference each socket's file object for the duration of the request and
+    // validate its notification flags.
+    //
+    for (; SocketCount < Params.SocketCount; SocketCount++) {
+        XSK_NOTIFY_SOCKET_WAIT *Wait = &Waits[SocketCount];
+        XSK_NOTIFY_SOCKET_ENTRY Entry;
 
-    case XSK_SOCKOPT_TX_HOOK_ID:
-        TraceInfo(
-            TRACE_XSK,
-            "Xsk=%p Set XSK_SOCKOPT_TX_HOOK_ID Hook={%!HOOK_LAYER!, %!HOOK_DIR!, %!HOOK_SUBLAYER!}",
-            Xsk, HookId.Layer, HookId.Direction, HookId.SubLayer);
-        Xsk->Tx.Xdp.HookId = HookId;
-        break;
+        __try {
+            if (RequestorMode != KernelMode) {
+                ProbeForWrite(
+                    &Params.Sockets[SocketCount], sizeof(Entry),
+                    PROBE_ALIGNMENT(XSK_NOTIFY_SOCKET_ENTRY));
+            }
+            RtlCopyVolatileMemory(&Entry, &Params.Sockets[SocketCount], sizeof(Entry));
+        } __except (EXCEPTION_EXECUTE_HANDLER) {
+            Status = GetExceptionCode();
+            goto Exit;
+        }
 
-    default:
-        Status = STATUS_NOT_SUPPORTED;
-        goto Exit;
+        Status =
+            XdpReferenceObjectByHandle(
+                Entry.Socket, XDP_OBJECT_TYPE_XSK, RequestorMode, FILE_GENERIC_WRITE,
+                &Wait->FileObject);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        Wait->Xsk = Wait->FileObject->FsContext;
+        Wait->InFlags = Entry.Flags;
+
+        if (Wait->Xsk->State != XskActive) {
+            Status = STATUS_INVALID_DEVICE_STATE;
+            SocketCount++;
+            goto Exit;
+        }
+
+        Status = XskNotifyValidateFlags(Wait->Xsk, Wait->InFlags, XSK_NOTIFY_VALID_FLAGS);
+        if (!NT_SUCCESS(Status)) {
+            SocketCount++;
+            goto Exit;
+        }
+    }
+
+    //
+    // Perform all pokes and opportunistically check for ready IO before setting
+    // up any wait context.
+    //
+    for (UINT32 Index = 0; Index < SocketCount; Index++) {
+        XSK_NOTIFY_SOCKET_WAIT *Wait = &Waits[Index];
+
+        Wait->InternalFlags = ReadULongAcquire((ULONG *)&Wait->Xsk->IoWaitInternalFlags);
+
+        if (Wait->InFlags & PokeMask) {
+            //
+            // Never block on an individual socket: waits are performed below.
+            //
+            Status = XskPoke(Wait->Xsk, Wait->InFlags & PokeMask, 0);
+            if (Status != STATUS_SUCCESS) {
+                goto Exit;
+            }
+        }
+
+        if (XskQueryModeratedReadyIo(Wait->Xsk, Wait->InFlags) != 0) {
+            ReadyCount++;
+        }
     }
 
     Status = STATUS_SUCCESS;
 
-Exit:
+    if (ReadyCount > 0) {
+        goto Complete;
+    }
 
-    if (IsLockHeld) {
+    //
+    // Set up a wait context on each socket requesting a wait.
+    //
+    for (UINT32 Index = 0; Index < SocketCount; Index++) {
+        XSK_NOTIFY_SOCKET_WAIT *Wait = &Waits[Index];
+        XSK *Xsk = Wait->Xsk;
+
+        if ((Wait->InFlags & WaitMask) == 0) {
+            continue;
+        }
+
+        KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+        if (Xsk->State != XskActive || Xsk->IoWaitFlags != 0) {
+            //
+            // Only a single wait is allowed per socket.
+            //
+            KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+            TraceError(TRACE_XSK, "Xsk=%p Notify sockets wait failed", Xsk);
+            Status = STATUS_INVALID_DEVICE_STATE;
+            goto Exit;
+        }
+        Xsk->IoWaitFlags = Wait->InFlags & WaitMask;
+        KeClearEvent(&Xsk->IoWaitEvent);
         KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+        Wait->WaitArmed = TRUE;
+        WaitObjects[WaitObjectCount++] = &Xsk->IoWaitEvent;
     }
 
-    TraceExitStatus(TRACE_XSK);
+    if (WaitObjectCount == 0) {
+        goto Complete;
+    }
 
-    return Status;
-}
+    //
+    // N.B. See comment in XskNotify.
+    //
+    KeMemoryBarrier();
 
-static
-NTSTATUS
-XskSockoptGetError(
-    _In_ XSK *Xsk,
-    _In_ UINT32 Option,
-    _In_ IRP *Irp,
-    _In_ IO_STACK_LOCATION *IrpSp
-    )
-{
-    NTSTATUS Status;
-    XSK_ERROR *XskError = Irp->AssociatedIrp.SystemBuffer;
+    for (UINT32 Index = 0; Index < SocketCount; Index++) {
+        XSK_NOTIFY_SOCKET_WAIT *Wait = &Waits[Index];
 
-    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
+        if (!Wait->WaitArmed) {
+            continue;
+        }
 
-    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*XskError)) {
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
+        XskCheckReadyIoModerated(Wait->Xsk, Wait->InFlags);
+
+        if (Wait->InternalFlags != Wait->Xsk->IoWaitInternalFlags) {
+            XskSignalReadyIo(Wait->Xsk, Wait->InFlags & WaitMask);
+        }
     }
 
-    switch (Option) {
-    case XSK_SOCKOPT_RX_ERROR:
-        *XskError = Xsk->Rx.Ring.Error;
-        break;
+    Timeout.QuadPart = -1 * RTL_MILLISEC_TO_100NANOSEC(Params.WaitTimeoutMilliseconds);
+    Status =
+        KeWaitForMultipleObjects(
+            WaitObjectCount, WaitObjects, WaitAny, UserRequest, UserMode, FALSE,
+            (Params.WaitTimeoutMilliseconds == INFINITE) ? NULL : &Timeout, WaitBlocks);
+    if (Status >= STATUS_WAIT_0 && Status < (NTSTATUS)(STATUS_WAIT_0 + WaitObjectCount)) {
+        Status = STATUS_SUCCESS;
+    }
 
-    case XSK_SOCKOPT_RX_FILL_ERROR:
-        *XskError = Xsk->Rx.FillRing.Error;
-        break;
+Complete:
 
-    case XSK_SOCKOPT_TX_ERROR:
-        *XskError = Xsk->Tx.Ring.Error;
-        break;
+    for (UINT32 Index = 0; Index < SocketCount; Index++) {
+        XskNotifySocketsDisarm(&Waits[Index]);
+    }
 
-    case XSK_SOCKOPT_TX_COMPLETION_ERROR:
-        *XskError = Xsk->Tx.CompletionRing.Error;
-        break;
+    //
+    // Re-query ready IO regardless of the wait status and return the results.
+    //
+    ReadyCount = 0;
 
-    default:
-        Status = STATUS_NOT_SUPPORTED;
+    __try {
+        for (UINT32 Index = 0; Index < SocketCount; Index++) {
+            XSK_NOTIFY_SOCKET_WAIT *Wait = &Waits[Index];
+            UINT32 OutFlags;
+
+            ReadyFlags = XskQueryReadyIo(Wait->Xsk, Wait->InFlags);
+            OutFlags = XskWaitInFlagsToOutFlags(ReadyFlags);
+            if (OutFlags != 0) {
+                ReadyCount++;
+            }
+
+            WriteUInt32NoFence(
+                (UINT32 *)&Params.Sockets[Index].Result, OutFlags);
+        }
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
         goto Exit;
     }
 
-    Status = STATUS_SUCCESS;
-    Irp->IoStatus.Information = sizeof(*XskError);
+    if (ReadyCount > 0) {
+        Status = STATUS_SUCCESS;
+    }
+
+    *Information = ReadyCount;
+
+Exit:
+
+    if (Waits != NULL) {
+        for (UINT32 Index = 0; Index < SocketCount; Index++) {
+            XskNotifySocketsDisarm(&Waits[Index]);
+
+            if (Waits[Index].FileObject != NULL) {
+                ObDereferenceObject(Waits[Index].FileObject);
+            }
+        }
+
+        ExFreePoolWithTag(Waits, POOLTAG_NOTIFY);
+    }
+
+    TraceInfo(
+        TRACE_XSK, "SocketCount=%u ReadyCount=%u Status=%!STATUS!",
+        SocketCount, ReadyCount, Status);
+
+    return Status;
+}
+
+#pragma warning(push)
+#pragma warning(disable:6101) // We don't set OutputBuffer in some paths
+BOOLEAN
+XskFastIo(
+    _In_ XDP_FILE_OBJECT_HEADER *FileObjectHeader,
+    _In_opt_ VOID *InputBuffer,
+    _In_ ULONG InputBufferLength,
+    _Out_opt_ VOID *OutputBuffer,
+    _In_ ULONG OutputBufferLength,
+    _In_ ULONG IoControlCode,
+    _Out_ IO_STATUS_BLOCK *IoStatus
+    )
+{
+    XSK *Xsk = CONTAINING_RECORD(FileObjectHeader, XSK, Header);
+
+    switch (IoControlCode) {
+    case IOCTL_XSK_NOTIFY:
+        IoStatus->Status =
+            XskNotify(
+                Xsk, InputBuffer, InputBufferLength, ExGetPreviousMode(),
+                &IoStatus->Information, NULL);
+        return TRUE;
 
-Exit:
+    case IOCTL_XSK_NOTIFY_SOCKETS:
+        IoStatus->Status =
+            XskNotifySockets(InputBuffer, InputBufferLength, &IoStatus->Information);
+        return TRUE;
 
-    TraceExitStatus(TRACE_XSK);
+    case IOCTL_XSK_GET_SOCKOPT:
+        return
+            XskFastGetSockopt(
+                FileObjectHeader, InputBuffer, InputBufferLength, OutputBuffer,
+                OutputBufferLength, IoStatus);
+    }
 
-    return Status;
+    return FALSE;
 }
+#pragma warning(pop)
 
 static
-UINT32
-XskQueryReadyIo(
-    _In_ XSK* Xsk,
-    _In_ UINT32 InFlags
+FORCEINLINE
+VOID
+XskWriteUmemRxTimestamp(
+    _In_ XSK *Xsk,
+    _In_ XDP_FRAME *Frame,
+    _In_ UCHAR *UmemChunk
     )
 {
-    UINT32 SatisfiedFlags = 0;
+    UINT64 Timestamp = 0;
 
-    if (InFlags & XSK_NOTIFY_FLAG_WAIT_TX && XskRingConsPeek(&Xsk->Tx.CompletionRing, 1) > 0) {
-        SatisfiedFlags |= XSK_NOTIFY_FLAG_WAIT_TX;
-    }
-    if (InFlags & XSK_NOTIFY_FLAG_WAIT_RX && XskRingConsPeek(&Xsk->Rx.Ring, 1) > 0) {
-        SatisfiedFlags |= XSK_NOTIFY_FLAG_WAIT_RX;
+    if (Xsk->Rx.Xdp.Flags.TimestampExt) {
+        Timestamp =
+            XdpGetFrameTimestampExtension(Frame, &Xsk->Rx.Xdp.TimestampExtension)->Timestamp;
     }
 
-    return SatisfiedFlags;
+    //
+    // The timestamp immediately precedes the frame data in the UMEM headroom.
+    //
+    ASSERT(Xsk->Umem->Reg.Headroom >= sizeof(Timestamp));
+    *(UINT64 UNALIGNED *)(UmemChunk + Xsk->Umem->Reg.Headroom - sizeof(Timestamp)) = Timestamp;
 }
 
 static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
-BOOLEAN
-XskPollInvoke(
+FORCEINLINE
+VOID
+XskWriteUmemRxMetadata(
     _In_ XSK *Xsk,
-    _In_ UINT32 RxQuota,
-    _In_ UINT32 TxQuota
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ const XSK_RX_COALESCE *Coalesce,
+    _In_ UCHAR *UmemChunk
     )
 {
-    BOOLEAN MoreData = FALSE;
+    XSK_RX_METADATA Metadata = {0};
 
-    ASSERT(Xsk->Rx.Xdp.PollHandle != NULL || Xsk->Tx.Xdp.PollHandle != NULL);
+    Metadata.QueueId = Xsk->Rx.QueueId;
 
-    if (Xsk->Rx.Xdp.PollHandle == Xsk->Tx.Xdp.PollHandle) {
+    if (Xsk->Rx.Xdp.Flags.RxMetadataExt) {
+        XDP_FRAME_RX_METADATA *RxMetadata =
+            XdpGetRxMetadataExtension(Frame, &Xsk->Rx.Xdp.RxMetadataExtension);
+
+        Metadata.RssHash = RxMetadata->RssHash;
+        Metadata.RssHashType = RxMetadata->RssHashType;
+        Metadata.Layer3Checksum = RxMetadata->Layer3Checksum;
+        Metadata.Layer4Checksum = RxMetadata->Layer4Checksum;
+        Metadata.CoalescedSegmentCount = RxMetadata->CoalescedSegmentCount;
+    }
+
+    if (Coalesce != NULL) {
         //
-        // Typically the RX and TX poll contexts are the same.
+        // The checksums of every coalesced segment were validated.
         //
-        MoreData = XdpPollInvoke(Xsk->Rx.Xdp.PollHandle, RxQuota, TxQuota);
-    } else {
-        if (Xsk->Rx.Xdp.PollHandle != NULL) {
-            MoreData |= XdpPollInvoke(Xsk->Rx.Xdp.PollHandle, RxQuota, TxQuota);
-        }
-        if (Xsk->Tx.Xdp.PollHandle != NULL) {
-            MoreData |= XdpPollInvoke(Xsk->Tx.Xdp.PollHandle, RxQuota, TxQuota);
+        if (!Coalesce->Head.Ipv6) {
+            Metadata.Layer3Checksum = XSK_RX_CHECKSUM_SUCCEEDED;
         }
+        Metadata.Layer4Checksum = XSK_RX_CHECKSUM_SUCCEEDED;
+        Metadata.CoalescedSegmentCount = (UINT16)Coalesce->SegmentCount;
     }
 
-    return MoreData;
+    ASSERT(Xsk->Umem->Reg.Headroom >= XskRxMetadataHeadroom(Xsk->Rx.Timestamp, TRUE, 0));
+    RtlCopyMemory(
+        UmemChunk + Xsk->Umem->Reg.Headroom - XskRxMetadataHeadroom(Xsk->Rx.Timestamp, TRUE, 0),
+        &Metadata, sizeof(Metadata));
 }
 
+//
+// Copies frame data into the UMEM. Copies of at least the socket's
+// non-temporal copy length use streaming stores, which bypass this processor's
+// caches; the caller must invoke XskRxCopyFlush before producing the copied
+// frames to the application.
+//
 static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
+FORCEINLINE
 VOID
-XskPollSetNotifications(
-    _In_ XSK *Xsk,
-    _In_ BOOLEAN EnableNotifications
+XskRxCopy(
+    _In_ const XSK *Xsk,
+    _Out_writes_bytes_(Length) UCHAR *Destination,
+    _In_reads_bytes_(Length) const UCHAR *Source,
+    _In_ UINT32 Length
     )
 {
-    ASSERT(Xsk->Rx.Xdp.PollHandle != NULL || Xsk->Tx.Xdp.PollHandle != NULL);
+#if defined(_M_AMD64) || defined(_M_IX86)
+    UINT32 NonTemporalLength = ReadUInt32NoFence(&Xsk->Rx.NonTemporalCopyLength);
 
-    if (Xsk->Rx.Xdp.PollHandle == Xsk->Tx.Xdp.PollHandle) {
+    if (NonTemporalLength > 0 && Length >= NonTemporalLength && Length >= 64) {
         //
-        // Typically the RX and TX poll contexts are the same.
+        // Streaming stores require 16-byte aligned destinations, so copy the
+        // unaligned head and the partial tail with regular stores.
         //
-        XdpPollSetNotifications(Xsk->Rx.Xdp.PollHandle, EnableNotifications);
-    } else {
-        if (Xsk->Rx.Xdp.PollHandle != NULL) {
-            XdpPollSetNotifications(Xsk->Rx.Xdp.PollHandle, EnableNotifications);
-        }
-        if (Xsk->Tx.Xdp.PollHandle != NULL) {
-            XdpPollSetNotifications(Xsk->Tx.Xdp.PollHandle, EnableNotifications);
+        UINT32 HeadLength = (UINT32)(-(ULONG_PTR)Destination & 15);
+        UINT32 BodyLength = (Length - HeadLength) & ~15ui32;
+
+        RtlCopyMemory(Destination, Source, HeadLength);
+
+        for (UINT32 Offset = HeadLength; Offset < HeadLength + BodyLength; Offset += 16) {
+            _mm_stream_si128(
+                (__m128i *)(Destination + Offset),
+                _mm_loadu_si128((const __m128i *)(Source + Offset)));
         }
+
+        RtlCopyMemory(
+            Destination + HeadLength + BodyLength, Source + HeadLength + BodyLength,
+            Length - HeadLength - BodyLength);
+        return;
     }
+#endif
+
+    RtlCopyMemory(Destination, Source, Length);
 }
 
+//
+// Orders non-temporal RX copies before subsequent stores.
+//
 static
-_Requires_exclusive_lock_held_(&Xsk->PollLock)
-NTSTATUS
-XskPollSocket(
+FORCEINLINE
+VOID
+XskRxCopyFlush(
+    _In_ const XSK *Xsk
+    )
+{
+#if defined(_M_AMD64) || defined(_M_IX86)
+    if (ReadUInt32NoFence(&Xsk->Rx.NonTemporalCopyLength) > 0) {
+        _mm_sfence();
+    }
+#else
+    UNREFERENCED_PARAMETER(Xsk);
+#endif
+}
+
+static
+FORCEINLINE
+VOID
+XskWriteUmemRxEbpfMetadata(
     _In_ XSK *Xsk,
-    _In_ UINT32 Flags,
-    _In_ UINT32 TimeoutMs
+    _In_ XDP_BUFFER *Buffer,
+    _In_ XDP_BUFFER_VIRTUAL_ADDRESS *Va,
+    _In_ UINT32 MetadataLength,
+    _In_ UCHAR *UmemChunk
     )
 {
-    NTSTATUS Status;
-    BOOLEAN MoreData;
-    UINT32 WaitFlags;
-    BOOLEAN NotificationsArmed = FALSE;
-    UINT64 DueTime = 0;
-    UINT64 CurrentTime;
-    LARGE_INTEGER WaitTime;
-    LARGE_INTEGER *WaitTimePtr = NULL;
+    UINT32 Size = Xsk->Rx.EbpfMetadataSize;
+    UINT32 CopyLength = min(MetadataLength, Size);
+    UCHAR *Area;
 
-    WaitFlags = Flags & (XSK_NOTIFY_FLAG_WAIT_RX | XSK_NOTIFY_FLAG_WAIT_TX);
+    ASSERT(MetadataLength <= Buffer->DataOffset);
+    ASSERT(
+        Xsk->Umem->Reg.Headroom >=
+            XskRxMetadataHeadroom(Xsk->Rx.Timestamp, Xsk->Rx.Metadata, Size));
 
-    if (TimeoutMs != INFINITE) {
-        WaitTimePtr = &WaitTime;
-        DueTime = KeQueryInterruptTime();
-        DueTime += RTL_MILLISEC_TO_100NANOSEC(TimeoutMs);
-    }
+    //
+    // The metadata ends where the frame data begins in the XDP buffer, and at
+    // the end of the area in the UMEM headroom. With zero copy, the two may
+    // overlap, so this must precede writing the RX metadata and timestamp.
+    //
+    Area =
+        UmemChunk + Xsk->Umem->Reg.Headroom -
+            XskRxMetadataHeadroom(Xsk->Rx.Timestamp, Xsk->Rx.Metadata, Size);
+    RtlMoveMemory(
+        Area + Size - CopyLength, Va->VirtualAddress + Buffer->DataOffset - CopyLength,
+        CopyLength);
+    RtlZeroMemory(Area, Size - CopyLength);
+}
 
-    while (TRUE) {
-        UINT32 RxQuota = 256;
-        UINT32 TxQuota = 256;
+static
+FORCEINLINE
+VOID
+XskReceiveSingleFrame(
+    _In_ XSK *Xsk,
+    _In_ XSK_KERNEL_RING *RxRing,
+    _In_ UINT32 RxProducerIndex,
+    _In_ UINT32 FrameIndex,
+    _In_ UINT32 FragmentIndex,
+    _In_ UINT32 MetadataLength,
+    _In_ UINT32 FillOffset,
+    _Inout_ UINT32 *CompletionOffset
+    )
+{
+    XDP_RING *FragmentRing = Xsk->Rx.Xdp.FragmentRing;
+    XDP_FRAME *Frame = XdpRingGetElement(Xsk->Rx.Xdp.FrameRing, FrameIndex);
+    XDP_FRAME_FRAGMENT *Fragment;
+    XDP_BUFFER *Buffer = &Frame->Buffer;
+    XDP_BUFFER_VIRTUAL_ADDRESS *Va = XdpGetVirtualAddressExtension(Buffer, &Xsk->Rx.Xdp.VaExtension);
+    UCHAR *UmemChunk;
+    UINT64 UmemAddress;
+    UINT32 UmemOffset;
+    UINT32 CopyLength;
+    UINT32 RingIndex;
 
-        if (ReadULongNoFence(&Xsk->PollWaiters) > 0) {
-            //
-            // Give the control path a chance to acquire the poll lock.
-            //
-            RtlReleasePushLockExclusive(&Xsk->PollLock);
-            RtlAcquirePushLockExclusive(&Xsk->PollLock);
+    XSK_FRAME_DESCRIPTOR *XskFrame;
+    XSK_BUFFER_DESCRIPTOR *XskBuffer;
 
-            if (Xsk->PollMode != XSK_POLL_MODE_SOCKET ||
-                (Xsk->Rx.Xdp.PollHandle == NULL && Xsk->Tx.Xdp.PollHandle == NULL)) {
-                return STATUS_SUCCESS;
-            }
-        }
+    UmemAddress = XskRxFillGet(Xsk, FillOffset);
 
+    if (!XskRxValidateFillAddress(Xsk, &UmemAddress)) {
         //
-        // TODO: Optimize RX and TX quotas.
-        // TODO: Optimize common case where RX and TX share a poll handle.
+        // Invalid FILL descriptor.
         //
-        if (Xsk->Rx.Xdp.PollHandle != NULL) {
-            RxQuota = XskRingConsPeek(&Xsk->Rx.FillRing, RxQuota);
-            RxQuota = XskRingProdReserve(&Xsk->Rx.Ring, RxQuota);
-        }
-        if (Xsk->Tx.Xdp.PollHandle != NULL) {
-            TxQuota = XskRingConsPeek(&Xsk->Tx.Ring, TxQuota);
-            TxQuota = XskRingProdReserve(&Xsk->Tx.CompletionRing, TxQuota);
-        }
+        Xsk->Statistics->RxInvalidDescriptors++;
+        STAT_INC(XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XskInvalidDescriptors);
+        XdpRxQueueSampleDrop(
+            XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XdpDropReasonInvalidDescriptor, 1, Frame,
+            &Xsk->Rx.Xdp.VaExtension);
+        return;
+    }
 
-        MoreData = XskPollInvoke(Xsk, RxQuota, TxQuota);
+    UmemChunk = XskUmemRxChunk(Xsk->Umem, UmemAddress);
+    UmemOffset = Xsk->Umem->Reg.Headroom;
+    CopyLength = min(Buffer->DataLength, Xsk->Umem->Reg.ChunkSize - UmemOffset);
 
+    if (Xsk->Rx.EbpfMetadataSize > 0) {
+        XskWriteUmemRxEbpfMetadata(Xsk, Buffer, Va, MetadataLength, UmemChunk);
+    }
+    if (!Xsk->Rx.ZeroCopy) {
+        XskRxCopy(
+            Xsk, UmemChunk + UmemOffset, Va->VirtualAddress + Buffer->DataOffset, CopyLength);
+    }
+    if (Xsk->Rx.Timestamp) {
+        XskWriteUmemRxTimestamp(Xsk, Frame, UmemChunk);
+    }
+    if (Xsk->Rx.Metadata) {
+        XskWriteUmemRxMetadata(Xsk, Frame, NULL, UmemChunk);
+    }
+    if (CopyLength < Buffer->DataLength) {
         //
-        // TODO: Optimize return conditions: should we try to completely fill
-        // all buffers, or return as soon as a single buffer is available, or
-        // something in between?
+        // Not enough available space in Umem.
         //
-        if (!WaitFlags || XskQueryReadyIo(Xsk, WaitFlags)) {
-            return STATUS_SUCCESS;
-        }
+        Xsk->Statistics->RxTruncated++;
+        STAT_INC(XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XskFramesTruncated);
+        XdpRxQueueSampleDrop(
+            XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XdpDropReasonTruncated, 1, Frame,
+            &Xsk->Rx.Xdp.VaExtension);
+    } else if (FragmentRing != NULL) {
+        Fragment = XdpGetFragmentExtension(Frame, &Xsk->Rx.Xdp.FragmentExtension);
 
-        //
-        // Check if the wait interval has timed out.
-        // Review: should we use a higher precision time source?
-        //
-        if (TimeoutMs != INFINITE) {
-            CurrentTime = KeQueryInterruptTime();
-            if (CurrentTime >= DueTime) {
-                return STATUS_TIMEOUT;
-            }
+        for (UINT32 Index = 0; Index < Fragment->FragmentBufferCount; Index++) {
+            Buffer = XdpRingGetElement(FragmentRing, (FragmentIndex + Index) & FragmentRing->Mask);
+            Va = XdpGetVirtualAddressExtension(Buffer, &Xsk->Rx.Xdp.VaExtension);
 
-            WaitTime.QuadPart = -(LONG64)(DueTime - CurrentTime);
-        }
+            UmemOffset += CopyLength;
+            CopyLength = min(Buffer->DataLength, Xsk->Umem->Reg.ChunkSize - UmemOffset);
 
-        //
-        // If no data is available, attempt to arm notifications and enter
-        // the waiting state.
-        //
-        if (!MoreData && !Xsk->PollBusy) {
-            if (!NotificationsArmed) {
-                XskPollSetNotifications(Xsk, TRUE);
-                NotificationsArmed = TRUE;
-            } else {
-                Status =
-                    KeWaitForSingleObject(
-                        &Xsk->PollRequested, UserRequest, UserMode, FALSE, WaitTimePtr);
-                if (Status != STATUS_SUCCESS) {
-                    return Status;
-                }
-                MoreData = TRUE;
+            if (!Xsk->Rx.ZeroCopy) {
+                XskRxCopy(
+                    Xsk, UmemChunk + UmemOffset, Va->VirtualAddress + Buffer->DataOffset,
+                    CopyLength);
             }
-        }
 
-        if (MoreData) {
-            NotificationsArmed = FALSE;
+            if (CopyLength < Buffer->DataLength) {
+                //
+                // Not enough available space in Umem.
+                //
+                Xsk->Statistics->RxTruncated++;
+                STAT_INC(XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XskFramesTruncated);
+                XdpRxQueueSampleDrop(
+                    XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XdpDropReasonTruncated, 1, Frame,
+                    &Xsk->Rx.Xdp.VaExtension);
+                break;
+            }
         }
     }
+
+    RingIndex = (RxProducerIndex + *CompletionOffset) & RxRing->Mask;
+    XskFrame = XskKernelRingGetElement(RxRing, RingIndex);
+    XskBuffer = &XskFrame->Buffer;
+    XskBuffer->Address.BaseAddress = UmemAddress;
+    ASSERT(Xsk->Umem->Reg.Headroom <= MAXUINT16);
+    XskBuffer->Address.Offset = (UINT16)Xsk->Umem->Reg.Headroom;
+    XskBuffer->Length = UmemOffset - Xsk->Umem->Reg.Headroom + CopyLength;
+    STAT_ADD(XskGetProcessorStatistics(Xsk), RxBytes, XskBuffer->Length);
+
+    ++*CompletionOffset;
 }
 
 static
-NTSTATUS
-XskSockoptSetPollMode(
-    _In_ XSK *Xsk,
-    _In_ XSK_SET_SOCKOPT_IN *Sockopt,
-    _In_ KPROCESSOR_MODE RequestorMode
+FORCEINLINE
+UINT32
+XskGetRxHeaderSplitLength(
+    _In_ const XSK *Xsk,
+    _In_ const XDP_FRAME *Frame,
+    _In_ UINT32 FragmentCount,
+    _In_ UINT32 FrameLength,
+    _In_ UINT32 ChunkCapacity
     )
-{
-    NTSTATUS Status;
-    const VOID *SockoptInputBuffer;
-    UINT32 SockoptInputBufferLength;
-    XSK_POLL_MODE PollMode;
-
-    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
-
-    //
-    // This is a nested buffer not copied by IO manager, so it needs special care.
-    //
-    SockoptInputBuffer = Sockopt->InputBuffer;
-    SockoptInputBufferLength = Sockopt->InputBufferLength;
-
-    if (SockoptInputBufferLength < sizeof(XSK_POLL_MODE)) {
-        Status = STATUS_INVALID_PARAMETER;
-        goto Exit;
-    }
-
-    __try {
-        if (RequestorMode != KernelMode) {
-            ProbeForRead(
-                (VOID*)SockoptInputBuffer, SockoptInputBufferLength, PROBE_ALIGNMENT(XSK_POLL_MODE));
-        }
-        RtlCopyVolatileMemory(&PollMode, SockoptInputBuffer, sizeof(XSK_POLL_MODE));
-    } __except (EXCEPTION_EXECUTE_HANDLER) {
-        Status = GetExceptionCode();
-        goto Exit;
-    }
-
-    XskAcquirePollLock(Xsk);
-    Status = XskSetPollMode(Xsk, PollMode);
-    XskReleasePollLock(Xsk);
+{
+    UINT32 HeaderLength = min(Xsk->Rx.HeaderSplitLength, ChunkCapacity);
 
-    if (NT_SUCCESS(Status)) {
-        TraceInfo(TRACE_XSK, "Xsk=%p Set poll mode PollMode=%u", Xsk, PollMode);
+    if (Xsk->Rx.Xdp.Flags.HeaderSplit && FragmentCount > 0 &&
+        Frame->Buffer.DataLength > 0 && Frame->Buffer.DataLength <= HeaderLength) {
+        //
+        // The interface placed exactly the protocol headers in the first
+        // buffer, so split where the interface did.
+        //
+        HeaderLength = Frame->Buffer.DataLength;
     }
 
-Exit:
-
-    TraceExitStatus(TRACE_XSK);
-
-    return Status;
+    return min(HeaderLength, FrameLength);
 }
 
 static
-NTSTATUS
-XskIrpGetSockopt(
-    _In_ IRP *Irp,
-    _In_ IO_STACK_LOCATION *IrpSp
+UINT32
+XskChecksumAccumulate(
+    _In_ UINT32 Sum,
+    _In_reads_bytes_(Length) const UCHAR *Buffer,
+    _In_ UINT32 Length
     )
 {
-    NTSTATUS Status = STATUS_SUCCESS;
-    XSK *Xsk;
-    UINT32 Option = 0;
-
-    Xsk = IrpSp->FileObject->FsContext;
+    while (Length > 1) {
+        Sum += ((UINT32)Buffer[0] << 8) | Buffer[1];
+        Buffer += 2;
+        Length -= 2;
+    }
 
-    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(Option)) {
-        return STATUS_INVALID_PARAMETER;
+    if (Length > 0) {
+        Sum += (UINT32)Buffer[0] << 8;
     }
 
-    Option = *(UINT32 *)Irp->AssociatedIrp.SystemBuffer;
+    return Sum;
+}
 
-    switch (Option) {
-    case XSK_SOCKOPT_RING_INFO:
-        Status = XskSockoptGetRingInfo(Xsk, Irp, IrpSp);
-        break;
-    case XSK_SOCKOPT_STATISTICS:
-        Status = XskSockoptGetStatistics(Xsk, Irp, IrpSp);
-        break;
-    case XSK_SOCKOPT_RX_HOOK_ID:
-    case XSK_SOCKOPT_TX_HOOK_ID:
-        Status = XskSockoptGetHookId(Xsk, Option, Irp, IrpSp);
-        break;
-    case XSK_SOCKOPT_RX_ERROR:
-    case XSK_SOCKOPT_RX_FILL_ERROR:
-    case XSK_SOCKOPT_TX_ERROR:
-    case XSK_SOCKOPT_TX_COMPLETION_ERROR:
-        Status = XskSockoptGetError(Xsk, Option, Irp, IrpSp);
-        break;
-    default:
-        Status = STATUS_NOT_SUPPORTED;
-        break;
+static
+UINT16
+XskChecksumFold(
+    _In_ UINT32 Sum
+    )
+{
+    while (Sum >> 16) {
+        Sum = (Sum & 0xFFFF) + (Sum >> 16);
     }
 
-    TraceInfo(TRACE_XSK, "Xsk=%p Option=%u Status=%!STATUS!", Xsk, Option, Status);
-
-    return Status;
+    return (UINT16)Sum;
 }
 
+//
+// Parses the headers of an RX frame eligible for coalescing.
+//
 static
-_Success_(NT_SUCCESS(IoStatus->Status))
-VOID
-XskGetIdealProcessor(
+BOOLEAN
+XskRxParseSegment(
     _In_ XSK *Xsk,
-    _Inout_ XSK_KERNEL_RING *Ring,
-    _In_ KPROCESSOR_MODE PreviousMode,
-    _Out_ VOID *OutputBuffer,
-    _In_ UINT32 OutputBufferLength,
-    _Out_ IO_STATUS_BLOCK *IoStatus
+    _In_ XDP_FRAME *Frame,
+    _Out_ XSK_RX_SEGMENT *Segment
     )
 {
-    UINT32 ProcIndex;
-    PROCESSOR_NUMBER ProcNumber;
-
-    //
-    // N.B. This function must be called within a try/catch block.
-    //
+    XDP_BUFFER *Buffer = &Frame->Buffer;
+    const UCHAR *Va;
+    UINT32 Layer4Length;
+    UINT8 Protocol;
 
-    if (ReadUInt32Acquire((UINT32 *)&Xsk->State) < XskActive || Ring->Size == 0) {
-        IoStatus->Status = STATUS_INVALID_DEVICE_STATE;
-        return;
+    if (Xsk->Rx.Xdp.FragmentRing != NULL &&
+        XdpGetFragmentExtension(Frame, &Xsk->Rx.Xdp.FragmentExtension)->FragmentBufferCount > 0) {
+        return FALSE;
     }
 
-    if (OutputBufferLength < sizeof(PROCESSOR_NUMBER)) {
-        IoStatus->Status = STATUS_BUFFER_TOO_SMALL;
-        return;
+    if (Buffer->DataLength < sizeof(ETHERNET_HEADER) + sizeof(IPV4_HEADER)) {
+        return FALSE;
     }
 
-    if (PreviousMode != KernelMode) {
-        #pragma prefast(suppress:6001) // Using uninitialized memory '*OutputBuffer'
-        ProbeForWrite(
-            OutputBuffer, sizeof(PROCESSOR_NUMBER), PROBE_ALIGNMENT(PROCESSOR_NUMBER));
+    Va =
+        XdpGetVirtualAddressExtension(Buffer, &Xsk->Rx.Xdp.VaExtension)->VirtualAddress +
+            Buffer->DataOffset;
+    Segment->Headers = Va;
+    Segment->Layer4Offset = sizeof(ETHERNET_HEADER);
+
+    if (((const ETHERNET_HEADER *)Va)->Type == htons(ETHERNET_TYPE_IPV4)) {
+        const IPV4_HEADER *Ipv4 = (const IPV4_HEADER *)(Va + sizeof(ETHERNET_HEADER));
+
+        if (Ipv4->Version != 4 || Ipv4->HeaderLength != sizeof(*Ipv4) / sizeof(UINT32) ||
+            (ntohs(Ipv4->FlagsAndOffset) & IP4_FRAGMENT_MASK) != 0 ||
+            ntohs(Ipv4->TotalLength) != Buffer->DataLength - sizeof(ETHERNET_HEADER)) {
+            return FALSE;
+        }
+
+        Segment->Ipv6 = FALSE;
+        Segment->Layer4Offset += sizeof(*Ipv4);
+        Protocol = Ipv4->Protocol;
+    } else if (
+        ((const ETHERNET_HEADER *)Va)->Type == htons(ETHERNET_TYPE_IPV6) &&
+        Buffer->DataLength >= sizeof(ETHERNET_HEADER) + sizeof(IPV6_HEADER)) {
+        const IPV6_HEADER *Ipv6 = (const IPV6_HEADER *)(Va + sizeof(ETHERNET_HEADER));
+
+        if ((*(const UCHAR *)Ipv6 >> 4) != 6 ||
+            ntohs(Ipv6->PayloadLength) !=
+                Buffer->DataLength - sizeof(ETHERNET_HEADER) - sizeof(*Ipv6)) {
+            return FALSE;
+        }
+
+        Segment->Ipv6 = TRUE;
+        Segment->Layer4Offset += sizeof(*Ipv6);
+        Protocol = Ipv6->NextHeader;
+    } else {
+        return FALSE;
     }
 
-    //
-    // Reset the affinity flag before reading the affinity value.
-    //
-    InterlockedAnd((LONG *)&Ring->Shared->Flags, ~XSK_RING_FLAG_AFFINITY_CHANGED);
+    Layer4Length = Buffer->DataLength - Segment->Layer4Offset;
 
-    ProcIndex = ReadUInt32NoFence(&Ring->IdealProcessor);
-    if (ProcIndex == INVALID_PROCESSOR_INDEX) {
-        IoStatus->Status = STATUS_DEVICE_NOT_READY;
-        return;
+    if (Protocol == IPPROTO_TCP) {
+        const TCP_HDR *Tcp = (const TCP_HDR *)(Va + Segment->Layer4Offset);
+
+        if (Layer4Length < sizeof(*Tcp) ||
+            TCP_HDR_LEN_TO_BYTES(Tcp->th_len) < sizeof(*Tcp) ||
+            TCP_HDR_LEN_TO_BYTES(Tcp->th_len) > Layer4Length ||
+            (Tcp->th_flags & ~TH_PSH) != TH_ACK) {
+            return FALSE;
+        }
+
+        Segment->Tcp = TRUE;
+        Segment->HeaderLength = Segment->Layer4Offset + (UINT32)TCP_HDR_LEN_TO_BYTES(Tcp->th_len);
+    } else if (Protocol == IPPROTO_UDP) {
+        const UDP_HDR *Udp = (const UDP_HDR *)(Va + Segment->Layer4Offset);
+
+        if (Layer4Length < sizeof(*Udp) || ntohs(Udp->uh_ulen) != Layer4Length) {
+            return FALSE;
+        }
+
+        Segment->Tcp = FALSE;
+        Segment->HeaderLength = Segment->Layer4Offset + sizeof(*Udp);
+    } else {
+        return FALSE;
     }
 
-    NT_VERIFY(NT_SUCCESS(KeGetProcessorNumberFromIndex(ProcIndex, &ProcNumber)));
+    Segment->PayloadLength = Buffer->DataLength - Segment->HeaderLength;
 
-    *(PROCESSOR_NUMBER *)OutputBuffer = ProcNumber;
-    IoStatus->Information = sizeof(PROCESSOR_NUMBER);
-    IoStatus->Status = STATUS_SUCCESS;
+    return Segment->PayloadLength > 0;
 }
 
-#pragma warning(push)
-#pragma warning(disable:6101) // We don't set OutputBuffer in some paths
+//
+// Returns whether a segment belongs to the same flow as the first segment of a
+// coalesced frame, and has headers identical but for lengths, checksums, IPv4
+// identification, and TCP sequence number, which are not delivered.
+//
 static
 BOOLEAN
-XskFastGetSockopt(
-    _In_ XDP_FILE_OBJECT_HEADER *FileObjectHeader,
-    _In_opt_ VOID *InputBuffer,
-    _In_ UINT32 InputBufferLength,
-    _Out_opt_ VOID *OutputBuffer,
-    _In_ UINT32 OutputBufferLength,
-    _Out_ IO_STATUS_BLOCK *IoStatus
+XskRxSegmentMatches(
+    _In_ const XSK_RX_SEGMENT *Head,
+    _In_ const XSK_RX_SEGMENT *Segment
     )
 {
-    XSK *Xsk = (XSK *)FileObjectHeader;
-    const KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
-    UINT32 Option = 0;
+    const UCHAR *HeadIp = Head->Headers + sizeof(ETHERNET_HEADER);
+    const UCHAR *Ip = Segment->Headers + sizeof(ETHERNET_HEADER);
 
-    __try {
-        #pragma prefast(push)
-        #pragma prefast(disable:6011) // Dereferencing NULL pointer is safe within try/catch.
-        #pragma prefast(disable:6387) // Dereferencing NULL pointer is safe within try/catch.
+    if (Segment->Ipv6 != Head->Ipv6 || Segment->Tcp != Head->Tcp ||
+        Segment->HeaderLength != Head->HeaderLength ||
+        !RtlEqualMemory(Segment->Headers, Head->Headers, sizeof(ETHERNET_HEADER))) {
+        return FALSE;
+    }
 
-        if (InputBufferLength < sizeof(Option)) {
-            IoStatus->Status = STATUS_INVALID_PARAMETER;
-            goto Exit;
+    if (Head->Ipv6) {
+        const IPV6_HEADER *HeadIpv6 = (const IPV6_HEADER *)HeadIp;
+        const IPV6_HEADER *Ipv6 = (const IPV6_HEADER *)Ip;
+
+        if (Ipv6->VersionClassFlow != HeadIpv6->VersionClassFlow ||
+            Ipv6->NextHeader != HeadIpv6->NextHeader || Ipv6->HopLimit != HeadIpv6->HopLimit ||
+            !RtlEqualMemory(
+                &Ipv6->SourceAddress, &HeadIpv6->SourceAddress,
+                sizeof(Ipv6->SourceAddress) + sizeof(Ipv6->DestinationAddress))) {
+            return FALSE;
+        }
+    } else {
+        const IPV4_HEADER *HeadIpv4 = (const IPV4_HEADER *)HeadIp;
+        const IPV4_HEADER *Ipv4 = (const IPV4_HEADER *)Ip;
+
+        if (Ipv4->TypeOfServiceAndEcnField != HeadIpv4->TypeOfServiceAndEcnField ||
+            Ipv4->FlagsAndOffset != HeadIpv4->FlagsAndOffset ||
+            Ipv4->TimeToLive != HeadIpv4->TimeToLive || Ipv4->Protocol != HeadIpv4->Protocol ||
+            !RtlEqualMemory(
+                &Ipv4->SourceAddress, &HeadIpv4->SourceAddress,
+                sizeof(Ipv4->SourceAddress) + sizeof(Ipv4->DestinationAddress))) {
+            return FALSE;
         }
+    }
 
-        if (PreviousMode != KernelMode) {
-            ProbeForRead(
-                (VOID *)InputBuffer, InputBufferLength, PROBE_ALIGNMENT(UINT32));
+    if (Head->Tcp) {
+        const TCP_HDR *HeadTcp = (const TCP_HDR *)(Head->Headers + Head->Layer4Offset);
+        const TCP_HDR *Tcp = (const TCP_HDR *)(Segment->Headers + Segment->Layer4Offset);
+
+        //
+        // The TCP options, such as timestamps, must also be identical.
+        //
+        return
+            Tcp->th_sport == HeadTcp->th_sport && Tcp->th_dport == HeadTcp->th_dport &&
+            Tcp->th_ack == HeadTcp->th_ack && Tcp->th_win == HeadTcp->th_win &&
+            RtlEqualMemory(
+                Tcp + 1, HeadTcp + 1,
+                Head->HeaderLength - Head->Layer4Offset - sizeof(*Tcp));
+    } else {
+        const UDP_HDR *HeadUdp = (const UDP_HDR *)(Head->Headers + Head->Layer4Offset);
+        const UDP_HDR *Udp = (const UDP_HDR *)(Segment->Headers + Segment->Layer4Offset);
+
+        return Udp->uh_sport == HeadUdp->uh_sport && Udp->uh_dport == HeadUdp->uh_dport;
+    }
+}
+
+//
+// Validates the checksums of a segment, unless the interface already did.
+//
+static
+BOOLEAN
+XskRxValidateSegmentChecksums(
+    _In_ XSK *Xsk,
+    _In_ XDP_FRAME *Frame,
+    _In_ const XSK_RX_SEGMENT *Segment
+    )
+{
+    const UCHAR *Ip = Segment->Headers + sizeof(ETHERNET_HEADER);
+    const UCHAR *Layer4 = Segment->Headers + Segment->Layer4Offset;
+    UINT32 Layer4Length = Segment->HeaderLength - Segment->Layer4Offset + Segment->PayloadLength;
+    UINT32 Sum;
+
+    if (Xsk->Rx.Xdp.Flags.RxMetadataExt) {
+        const XDP_FRAME_RX_METADATA *RxMetadata =
+            XdpGetRxMetadataExtension(Frame, &Xsk->Rx.Xdp.RxMetadataExtension);
+
+        if (RxMetadata->Layer4Checksum == XdpFrameRxChecksumEvaluationSucceeded &&
+            (Segment->Ipv6 ||
+                RxMetadata->Layer3Checksum == XdpFrameRxChecksumEvaluationSucceeded)) {
+            return TRUE;
         }
+    }
 
-        Option = ReadUInt32NoFence(InputBuffer);
+    if (Segment->Ipv6) {
+        const IPV6_HEADER *Ipv6 = (const IPV6_HEADER *)Ip;
 
-        switch (Option) {
-        case XSK_SOCKOPT_RX_PROCESSOR_AFFINITY:
-            XskGetIdealProcessor(
-                Xsk, &Xsk->Rx.Ring, PreviousMode, OutputBuffer, OutputBufferLength, IoStatus);
-            break;
+        Sum =
+            XskChecksumAccumulate(
+                0, (const UCHAR *)&Ipv6->SourceAddress,
+                sizeof(Ipv6->SourceAddress) + sizeof(Ipv6->DestinationAddress));
+    } else {
+        const IPV4_HEADER *Ipv4 = (const IPV4_HEADER *)Ip;
 
-        case XSK_SOCKOPT_TX_PROCESSOR_AFFINITY:
-            XskGetIdealProcessor(
-                Xsk, &Xsk->Tx.Ring, PreviousMode, OutputBuffer, OutputBufferLength, IoStatus);
-            break;
+        if (XskChecksumFold(XskChecksumAccumulate(0, Ip, sizeof(*Ipv4))) != 0xFFFF) {
+            return FALSE;
+        }
 
-        default:
+        if (!Segment->Tcp && ((const UDP_HDR *)Layer4)->uh_sum == 0) {
             //
-            // Fall back to the IRP-based socket option path.
+            // The sender did not compute a UDP checksum.
             //
-            return FALSE;
+            return TRUE;
         }
 
-        #pragma prefast(pop)
-    } __except (EXCEPTION_EXECUTE_HANDLER) {
-        IoStatus->Status = GetExceptionCode();
-        goto Exit;
+        Sum =
+            XskChecksumAccumulate(
+                0, (const UCHAR *)&Ipv4->SourceAddress,
+                sizeof(Ipv4->SourceAddress) + sizeof(Ipv4->DestinationAddress));
     }
 
-Exit:
+    Sum += (Segment->Tcp ? IPPROTO_TCP : IPPROTO_UDP) + Layer4Length;
 
-    return TRUE;
+    return XskChecksumFold(XskChecksumAccumulate(Sum, Layer4, Layer4Length)) == 0xFFFF;
 }
-#pragma warning(pop)
 
+//
+// Starts a coalesced frame with the given frame. Returns FALSE if the frame is
+// not eligible for coalescing.
+//
 static
-NTSTATUS
-XskIrpSetSockopt(
-    _In_ IRP *Irp,
-    _In_ IO_STACK_LOCATION *IrpSp
+BOOLEAN
+XskRxCoalesceStart(
+    _In_ XSK *Xsk,
+    _In_ XDP_FRAME *Frame
     )
 {
-    NTSTATUS Status = STATUS_SUCCESS;
-    XSK *Xsk;
-    XSK_SET_SOCKOPT_IN *Sockopt = NULL;
-
-    Xsk = IrpSp->FileObject->FsContext;
+    XSK_RX_COALESCE *Coalesce = &Xsk->Rx.Coalesce;
 
-    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(XSK_SET_SOCKOPT_IN)) {
-        return STATUS_INVALID_PARAMETER;
+    if (!XskRxParseSegment(Xsk, Frame, &Coalesce->Head)) {
+        return FALSE;
     }
 
-    Sockopt = Irp->AssociatedIrp.SystemBuffer;
+    Coalesce->Segments[0] = Frame;
+    Coalesce->SegmentCount = 1;
+    Coalesce->FrameLength = Frame->Buffer.DataLength;
+    Coalesce->Closed = FALSE;
 
-    switch (Sockopt->Option) {
-    case XSK_SOCKOPT_UMEM_REG:
-        Status = XskSockoptSetUmem(Xsk, Sockopt, Irp->RequestorMode);
-        break;
-    case XSK_SOCKOPT_TX_RING_SIZE:
-    case XSK_SOCKOPT_RX_RING_SIZE:
-    case XSK_SOCKOPT_RX_FILL_RING_SIZE:
-    case XSK_SOCKOPT_TX_COMPLETION_RING_SIZE:
-        Status = XskSockoptSetRingSize(Xsk, Sockopt, Irp->RequestorMode);
-        break;
-    case XSK_SOCKOPT_RX_HOOK_ID:
-    case XSK_SOCKOPT_TX_HOOK_ID:
-        Status = XskSockoptSetHookId(Xsk, Sockopt, Irp->RequestorMode);
-        break;
-#if !defined(XDP_OFFICIAL_BUILD)
-    case XSK_SOCKOPT_POLL_MODE:
-        Status = XskSockoptSetPollMode(Xsk, Sockopt, Irp->RequestorMode);
-        break;
-#endif // !defined(XDP_OFFICIAL_BUILD)
-    default:
-        Status = STATUS_NOT_SUPPORTED;
-        break;
-    }
+    if (Coalesce->Head.Tcp) {
+        const TCP_HDR *Tcp =
+            (const TCP_HDR *)(Coalesce->Head.Headers + Coalesce->Head.Layer4Offset);
 
-    TraceInfo(
-        TRACE_XSK, "Xsk=%p Option=%u Status=%!STATUS! Value=%!HEXDUMP!",
-        Xsk, Sockopt->Option, Status, WppHexDump(Sockopt->InputBuffer, Sockopt->InputBufferLength));
+        Coalesce->NextSequence = ntohl(Tcp->th_seq) + Coalesce->Head.PayloadLength;
+        Coalesce->Closed = (Tcp->th_flags & TH_PSH) != 0;
+    }
 
-    return Status;
+    return TRUE;
 }
 
+//
+// Appends the given frame to the coalesced frame, if the frame continues it.
+//
 static
-NTSTATUS
-XskNotifyValidateParams(
+BOOLEAN
+XskRxCoalesceAppend(
     _In_ XSK *Xsk,
-    _In_opt_ VOID *InputBuffer,
-    _In_ ULONG InputBufferLength,
-    _Out_ PUINT32 TimeoutMilliseconds,
-    _Out_ PUINT32 InFlags
+    _In_ XDP_FRAME *Frame
     )
 {
-    if (Xsk->State != XskActive){
-        return STATUS_INVALID_DEVICE_STATE;
+    XSK_RX_COALESCE *Coalesce = &Xsk->Rx.Coalesce;
+    XSK_RX_SEGMENT Segment;
+
+    if (Coalesce->Closed || Coalesce->SegmentCount == RTL_NUMBER_OF(Coalesce->Segments) ||
+        !XskRxParseSegment(Xsk, Frame, &Segment) ||
+        Segment.PayloadLength > Coalesce->Head.PayloadLength ||
+        Coalesce->FrameLength + Segment.PayloadLength > Xsk->Rx.CoalesceLength ||
+        !XskRxSegmentMatches(&Coalesce->Head, &Segment)) {
+        return FALSE;
     }
 
-    if (InputBufferLength < sizeof(XSK_NOTIFY_IN)) {
-        return STATUS_INVALID_PARAMETER;
-    }
+    if (Segment.Tcp) {
+        const TCP_HDR *Tcp = (const TCP_HDR *)(Segment.Headers + Segment.Layer4Offset);
 
-    __try {
-        ASSERT(InputBuffer);
-        if (ExGetPreviousMode() != KernelMode) {
-            ProbeForRead(
-                (VOID*)InputBuffer, InputBufferLength, PROBE_ALIGNMENT(XSK_NOTIFY_IN));
+        if (ntohl(Tcp->th_seq) != Coalesce->NextSequence) {
+            return FALSE;
         }
 
-        *InFlags = ReadUInt32NoFence((UINT32 *)&((XSK_NOTIFY_IN *)InputBuffer)->Flags);
-        *TimeoutMilliseconds =
-            ReadUInt32NoFence(&((XSK_NOTIFY_IN *)InputBuffer)->WaitTimeoutMilliseconds);
-    } __except (EXCEPTION_EXECUTE_HANDLER) {
-        return GetExceptionCode();
+        Coalesce->Closed = (Tcp->th_flags & TH_PSH) != 0;
+    }
+
+    //
+    // Only the first segment's headers are delivered, so the checksums of
+    // every segment are validated here. The first segment is validated only
+    // once another segment joins it.
+    //
+    if (!XskRxValidateSegmentChecksums(Xsk, Frame, &Segment) ||
+        (Coalesce->SegmentCount == 1 &&
+            !XskRxValidateSegmentChecksums(Xsk, Coalesce->Segments[0], &Coalesce->Head))) {
+        Coalesce->Closed = TRUE;
+        return FALSE;
     }
 
-    if (*InFlags == 0 || *InFlags &
-            ~(XSK_NOTIFY_FLAG_POKE_RX | XSK_NOTIFY_FLAG_POKE_TX | XSK_NOTIFY_FLAG_WAIT_RX | XSK_NOTIFY_FLAG_WAIT_TX)) {
-        return STATUS_INVALID_PARAMETER;
-    }
+    Coalesce->Segments[Coalesce->SegmentCount++] = Frame;
+    Coalesce->FrameLength += Segment.PayloadLength;
+    Coalesce->NextSequence += Segment.PayloadLength;
 
-    if ((*InFlags & (XSK_NOTIFY_FLAG_POKE_RX | XSK_NOTIFY_FLAG_WAIT_RX) && Xsk->Rx.Ring.Size == 0) ||
-        (*InFlags & (XSK_NOTIFY_FLAG_POKE_TX | XSK_NOTIFY_FLAG_WAIT_TX) && Xsk->Tx.Ring.Size == 0)) {
-        return STATUS_INVALID_DEVICE_STATE;
+    //
+    // A short segment ends the coalesced frame.
+    //
+    if (Segment.PayloadLength < Coalesce->Head.PayloadLength) {
+        Coalesce->Closed = TRUE;
     }
 
-    return STATUS_SUCCESS;
+    return TRUE;
 }
 
 static
-NTSTATUS
-XskPoke(
+BOOLEAN
+XskReceiveMultiBufferFrame(
     _In_ XSK *Xsk,
-    _In_ UINT32 Flags,
-    _In_ UINT32 TimeoutMs
+    _In_ XSK_KERNEL_RING *RxRing,
+    _In_ UINT32 FrameIndex,
+    _In_ UINT32 FragmentIndex,
+    _In_ UINT32 MetadataLength,
+    _In_opt_ const XSK_RX_COALESCE *Coalesce,
+    _In_ UINT32 FillAvailable,
+    _In_ UINT32 RxAvailable,
+    _Inout_ UINT32 *FillOffset,
+    _Inout_ UINT32 *RxOffset
     )
 {
-    NTSTATUS Status = STATUS_SUCCESS;
+    XDP_RING *FragmentRing = Xsk->Rx.Xdp.FragmentRing;
+    XDP_FRAME *Frame = XdpRingGetElement(Xsk->Rx.Xdp.FrameRing, FrameIndex);
+    XDP_BUFFER *Buffer = &Frame->Buffer;
+    XDP_BUFFER_VIRTUAL_ADDRESS *Va;
+    UINT32 FragmentCount = 0;
+    UINT32 BufferIndex = 0;
+    UINT32 BufferOffset = 0;
+    UINT32 SegmentIndex = 1;
+    UINT32 FrameLength = Buffer->DataLength;
+    UINT32 ChunkCapacity = Xsk->Umem->Reg.ChunkSize - Xsk->Umem->Reg.Headroom;
+    UINT32 HeaderLength = 0;
+    UINT32 ChunkCount;
+    UINT32 Chunk;
+    UINT32 RxProducerIndex = ReadUInt32NoFence(&RxRing->Shared->ProducerIndex);
+
+    if (Coalesce != NULL) {
+        //
+        // Coalesced segments are single-buffer frames.
+        //
+        FrameLength = Coalesce->FrameLength;
+    } else if (FragmentRing != NULL) {
+        FragmentCount =
+            XdpGetFragmentExtension(Frame, &Xsk->Rx.Xdp.FragmentExtension)->FragmentBufferCount;
 
-    EventWriteXskNotifyPokeStart(&MICROSOFT_XDP_PROVIDER, Xsk, Flags);
+        for (UINT32 Index = 0; Index < FragmentCount; Index++) {
+            XDP_BUFFER *Fragment =
+                XdpRingGetElement(FragmentRing, (FragmentIndex + Index) & FragmentRing->Mask);
+            FrameLength += Fragment->DataLength;
+        }
+    }
 
-    RtlAcquirePushLockExclusive(&Xsk->PollLock);
+    if (XskRxHeaderSplitEnabled(Xsk) && ChunkCapacity > 0) {
+        HeaderLength =
+            XskGetRxHeaderSplitLength(Xsk, Frame, FragmentCount, FrameLength, ChunkCapacity);
+    }
 
-    if (Xsk->PollMode == XSK_POLL_MODE_SOCKET &&
-        (Xsk->Rx.Xdp.PollHandle != NULL || Xsk->Tx.Xdp.PollHandle != NULL)) {
+    if (HeaderLength > 0) {
         //
-        // Socket polling mode is active, so poll the interfaces synchronously.
+        // The headers fill the first chunk after the headroom, and the payload
+        // fills whole chunks from their start.
         //
-        Status = XskPollSocket(Xsk, Flags, TimeoutMs);
-    } else {
+        ChunkCount =
+            1 + (FrameLength - HeaderLength + Xsk->Umem->Reg.ChunkSize - 1) /
+                Xsk->Umem->Reg.ChunkSize;
+    } else if (ChunkCapacity == 0) {
         //
-        // Notify the underlying interfaces that data is available.
+        // The headroom fills each chunk: only an empty frame can be delivered.
         //
+        ChunkCount = 1;
+    } else {
+        ChunkCount = max(1, (FrameLength + ChunkCapacity - 1) / ChunkCapacity);
+    }
 
-        if (Flags & XSK_NOTIFY_FLAG_POKE_RX) {
-            ASSERT(Xsk->Rx.Ring.Size > 0);
-            ASSERT(Xsk->Rx.FillRing.Size > 0);
-            //
-            // TODO: Driver poke routine for zero copy RX.
-            //
-            ASSERT(Status == STATUS_SUCCESS);
+    //
+    // Find a run of valid FILL descriptors for every chunk of the frame,
+    // consuming any invalid descriptors along the way.
+    //
+    for (;;) {
+        if (ChunkCount > FillAvailable - *FillOffset || ChunkCount > RxAvailable - *RxOffset) {
+            return FALSE;
         }
 
-        if (Flags & XSK_NOTIFY_FLAG_POKE_TX) {
-            XDP_NOTIFY_QUEUE_FLAGS NotifyFlags = XDP_NOTIFY_QUEUE_FLAG_TX;
-            //
-            // Before invoking the poke routine, atomically clear the need poke
-            // flag on the TX ring. The poke routine is required to execute a
-            // FlushTransmit, which guarantees the need poke flag can be set.
-            //
-            InterlockedAnd((LONG *)&Xsk->Tx.Ring.Shared->Flags, ~XSK_RING_FLAG_NEED_POKE);
+        for (Chunk = 0; Chunk < ChunkCount; Chunk++) {
+            UINT64 UmemAddress = XskRxFillGet(Xsk, *FillOffset + Chunk);
 
-            if (Xsk->Tx.Xdp.Flags.QueueActive) {
-                XdpTxQueueInvokeInterfaceNotify(Xsk->Tx.Xdp.Queue, NotifyFlags);
-            } else {
-                Status = STATUS_DEVICE_REMOVED;
+            if (!XskRxValidateFillAddress(Xsk, &UmemAddress)) {
+                //
+                // Invalid FILL descriptor.
+                //
+                Xsk->Statistics->RxInvalidDescriptors++;
+                STAT_INC(XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XskInvalidDescriptors);
+                XdpRxQueueSampleDrop(
+                    XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XdpDropReasonInvalidDescriptor, 1,
+                    Frame, &Xsk->Rx.Xdp.VaExtension);
+                *FillOffset += Chunk + 1;
+                break;
             }
         }
+
+        if (Chunk == ChunkCount) {
+            break;
+        }
     }
 
-    RtlReleasePushLockExclusive(&Xsk->PollLock);
+    if (ChunkCapacity == 0 && FrameLength > 0) {
+        Xsk->Statistics->RxTruncated++;
+        STAT_INC(XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XskFramesTruncated);
+        XdpRxQueueSampleDrop(
+            XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XdpDropReasonTruncated, 1, Frame,
+            &Xsk->Rx.Xdp.VaExtension);
+    }
 
-    EventWriteXskNotifyPokeStop(&MICROSOFT_XDP_PROVIDER, Xsk, Flags);
+    Va = XdpGetVirtualAddressExtension(Buffer, &Xsk->Rx.Xdp.VaExtension);
 
-    return Status;
-}
+    if (Xsk->Rx.EbpfMetadataSize > 0) {
+        UINT64 UmemAddress = XskUmemFillChunkAddress(Xsk->Umem, XskRxFillGet(Xsk, *FillOffset));
 
-static DRIVER_CANCEL XskCancelNotify;
+        XskWriteUmemRxEbpfMetadata(
+            Xsk, Buffer, Va, MetadataLength, XskUmemRxChunk(Xsk->Umem, UmemAddress));
+    }
 
-static
-_Use_decl_annotations_
-VOID
-XskCancelNotify(
-    DEVICE_OBJECT *DeviceObject,
-    IRP *Irp
-    )
-{
-    XSK *Xsk;
-    IO_STACK_LOCATION *IrpSp;
+    for (Chunk = 0; Chunk < ChunkCount; Chunk++) {
+        UINT64 UmemAddress =
+            XskUmemFillChunkAddress(Xsk->Umem, XskRxFillGet(Xsk, *FillOffset + Chunk));
+        UINT32 ChunkOffset = Xsk->Umem->Reg.Headroom;
+        UINT32 ChunkLimit = ChunkCapacity;
+        UCHAR *UmemChunk;
+        UINT32 ChunkLength = 0;
+        XSK_FRAME_DESCRIPTOR *XskFrame;
+        XSK_BUFFER_DESCRIPTOR *XskBuffer;
 
-    UNREFERENCED_PARAMETER(DeviceObject);
+        if (HeaderLength > 0) {
+            if (Chunk == 0) {
+                ChunkLimit = HeaderLength;
+            } else {
+                ChunkOffset = 0;
+                ChunkLimit = Xsk->Umem->Reg.ChunkSize;
+            }
+        }
 
-    IoReleaseCancelSpinLock(DISPATCH_LEVEL);
+        UmemChunk = XskUmemRxChunk(Xsk->Umem, UmemAddress) + ChunkOffset;
 
-    IrpSp = IoGetCurrentIrpStackLocation(Irp);
-    Xsk = IrpSp->FileObject->FsContext;
+        //
+        // Fill the chunk from as many frame buffers as it spans.
+        //
+        while (ChunkLength < ChunkLimit && Buffer != NULL) {
+            UINT32 CopyLength =
+                min(Buffer->DataLength - BufferOffset, ChunkLimit - ChunkLength);
+
+            if (!Xsk->Rx.ZeroCopy) {
+                XskRxCopy(
+                    Xsk, UmemChunk + ChunkLength,
+                    Va->VirtualAddress + Buffer->DataOffset + BufferOffset, CopyLength);
+            }
 
-    KeAcquireSpinLockAtDpcLevel(&Xsk->Lock);
+            ChunkLength += CopyLength;
+            BufferOffset += CopyLength;
+
+            if (BufferOffset == Buffer->DataLength) {
+                if (BufferIndex < FragmentCount) {
+                    Buffer =
+                        XdpRingGetElement(
+                            FragmentRing, (FragmentIndex + BufferIndex) & FragmentRing->Mask);
+                    Va = XdpGetVirtualAddressExtension(Buffer, &Xsk->Rx.Xdp.VaExtension);
+                    BufferIndex++;
+                    BufferOffset = 0;
+                } else if (Coalesce != NULL && SegmentIndex < Coalesce->SegmentCount) {
+                    //
+                    // Continue with the payload of the next coalesced segment.
+                    //
+                    Buffer = &Coalesce->Segments[SegmentIndex++]->Buffer;
+                    Va = XdpGetVirtualAddressExtension(Buffer, &Xsk->Rx.Xdp.VaExtension);
+                    BufferOffset = Coalesce->Head.HeaderLength;
+                } else {
+                    Buffer = NULL;
+                }
+            }
+        }
 
-    //
-    // If the data path hasn't already dropped the IRP, reset the wait state
-    // here.
-    //
+        if (Chunk == 0 && Xsk->Rx.Timestamp) {
+            XskWriteUmemRxTimestamp(Xsk, Frame, XskUmemRxChunk(Xsk->Umem, UmemAddress));
+        }
+        if (Chunk == 0 && Xsk->Rx.Metadata) {
+            XskWriteUmemRxMetadata(
+                Xsk, Frame, Coalesce, XskUmemRxChunk(Xsk->Umem, UmemAddress));
+        }
 
-    if (Xsk->IoWaitIrp == Irp) {
-        Xsk->IoWaitFlags = 0;
-        Xsk->IoWaitIrp = NULL;
+        RingIndex = (RxProducerIndex + *RxOffset + Chunk) & RxRing->Mask;
+        XskFrame = XskKernelRingGetElement(RxRing, RingIndex);
+        XskBuffer = &XskFrame->Buffer;
+        XskBuffer->Address.BaseAddress = UmemAddress;
+        ASSERT(ChunkOffset <= MAXUINT16);
+        XskBuffer->Address.Offset = (UINT16)ChunkOffset;
+        XskBuffer->Length = ChunkLength;
+        XskBuffer->Reserved = (Chunk + 1 < ChunkCount) ? XSK_BUFFER_FLAG_CONTINUATION : 0;
+        STAT_ADD(XskGetProcessorStatistics(Xsk), RxBytes, ChunkLength);
     }
 
-    KeReleaseSpinLock(&Xsk->Lock, Irp->CancelIrql);
-
-    Irp->IoStatus.Status = STATUS_CANCELLED;
+    *FillOffset += ChunkCount;
+    *RxOffset += ChunkCount;
 
-    EventWriteXskNotifyAsyncComplete(&MICROSOFT_XDP_PROVIDER, Xsk, Irp, Irp->IoStatus.Status);
-    IoCompleteRequest(Irp, IO_NETWORK_INCREMENT);
+    return TRUE;
 }
 
 static
-_Success_(return == STATUS_SUCCESS)
-NTSTATUS
-XskNotify(
+VOID
+XskReceiveSubmitBatch(
     _In_ XSK *Xsk,
-    _In_opt_ VOID *InputBuffer,
-    _In_ ULONG InputBufferLength,
-    _Out_ ULONG_PTR *Information,
-    _Inout_opt_ IRP *Irp
+    _In_ XSK_KERNEL_RING *RxRing,
+    _In_ UINT32 RxProducerIndex,
+    _In_ UINT32 BatchCount,
+    _In_ UINT32 FrameCount,
+    _In_ UINT32 RxFillConsumed,
+    _In_ UINT32 RxProduced
     )
 {
-    UINT32 TimeoutMilliseconds;
-    UINT32 ReadyFlags;
-    UINT32 InFlags;
-    UINT32 OutFlags = 0;
-    KIRQL OldIrql;
-    LARGE_INTEGER Timeout;
-    NTSTATUS Status;
-    XSK_IO_WAIT_FLAGS InternalFlags;
-    const UINT32 WaitMask = (XSK_NOTIFY_FLAG_WAIT_RX | XSK_NOTIFY_FLAG_WAIT_TX);
-
-    Status =
-        XskNotifyValidateParams(
-            Xsk, InputBuffer, InputBufferLength, &TimeoutMilliseconds, &InFlags);
-    if (Status != STATUS_SUCCESS) {
-        TraceError(TRACE_XSK, "Xsk=%p Notify failed: Invalid params", Xsk);
-        goto Exit;
-    }
-
-    EventWriteXskNotifyStart(&MICROSOFT_XDP_PROVIDER, Xsk, Irp, InFlags, TimeoutMilliseconds);
-
-    //
-    // Snap the XSK notification state before performing the poke and/or wait.
-    //
-    InternalFlags = ReadULongAcquire((ULONG *)&Xsk->IoWaitInternalFlags);
-
-    if (InFlags & (XSK_NOTIFY_FLAG_POKE_RX | XSK_NOTIFY_FLAG_POKE_TX)) {
-        Status = XskPoke(Xsk, InFlags, TimeoutMilliseconds);
-        if (Status != STATUS_SUCCESS) {
-            TraceError(
-                TRACE_XSK, "Xsk=%p Notify failed: Poke failed Status=%!STATUS!",
-                Xsk, Status);
-            goto Exit;
-        }
-    }
+    STAGE_START(PublishTsc);
 
-    if ((InFlags & (XSK_NOTIFY_FLAG_WAIT_RX | XSK_NOTIFY_FLAG_WAIT_TX)) == 0) {
+    if (FrameCount < BatchCount) {
         //
-        // Not interested in waiting for IO.
+        // Dropped packets.
         //
-        ASSERT(Status == STATUS_SUCCESS);
-        goto Exit;
-    }
-
-    //
-    // Opportunistic check for ready IO to avoid setting up a wait context.
-    //
-    ReadyFlags = XskQueryReadyIo(Xsk, InFlags);
-    if (ReadyFlags != 0) {
-        OutFlags |= XskWaitInFlagsToOutFlags(ReadyFlags);
-        ASSERT(Status == STATUS_SUCCESS);
-        goto Exit;
-    }
+        UINT32 Dropped = BatchCount - FrameCount;
+        XDP_DROP_REASON Reason;
+        Xsk->Statistics->RxDropped += Dropped;
+        STAT_ADD(XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XskFramesDropped, Dropped);
 
-    //
-    // Set up the wait context.
-    //
-    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
-    if (Xsk->State != XskActive) {
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
-        TraceInfo(TRACE_XSK, "Xsk=%p Notify wait failed: XSK not bound", Xsk);
-        Status = STATUS_INVALID_DEVICE_STATE;
-        goto Exit;
-    }
-    if (Xsk->IoWaitFlags != 0) {
         //
-        // There is currently a wait active. Only a single wait is allowed.
+        // Attribute the drops to fill ring starvation if this batch consumed
+        // every fill descriptor, otherwise to a full RX ring.
         //
-        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
-        TraceError(TRACE_XSK, "Xsk=%p Notify wait failed: Wait already active", Xsk);
-        Status = STATUS_INVALID_DEVICE_STATE;
-        goto Exit;
+        if (XskRxFillPeek(Xsk, RxFillConsumed + 1) <= RxFillConsumed) {
+            STAT_INC(XskGetProcessorStatistics(Xsk), RxFillRingEmpty);
+            STAT_ADD(XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XskDropsFillRingEmpty, Dropped);
+            Reason = XdpDropReasonFillRingEmpty;
+        } else {
+            STAT_INC(XskGetProcessorStatistics(Xsk), RxRingFull);
+            STAT_ADD(XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XskDropsRxRingFull, Dropped);
+            Reason = XdpDropReasonRxRingFull;
+        }
+
+        XdpRxQueueSampleDrop(XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), Reason, Dropped, NULL, NULL);
     }
-    Xsk->IoWaitFlags = InFlags & WaitMask;
-    if (Irp != NULL) {
-        Xsk->IoWaitIrp = Irp;
 
-        //
-        // Mark the IRP as pending prior to enabling cancellation; once we mark
-        // an IRP as pending, we must return STATUS_PENDING to the IO manager.
-        //
-        IoMarkIrpPending(Irp);
-        Status = STATUS_PENDING;
+    XskRxFillRelease(Xsk, RxFillConsumed);
+
+    XskKernelRingUpdateIdealProcessor(RxRing);
+
+    if (RxProduced > 0) {
+        XskRxCopyFlush(Xsk);
+        XskRxRingSubmit(Xsk, RxRing, RxProducerIndex, RxProduced);
+
+        EventWriteXskRxPostBatch(&MICROSOFT_XDP_PROVIDER, Xsk, RxProducerIndex, RxProduced);
+        STAT_ADD(XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XskFramesDelivered, FrameCount);
+        STAT_ADD(XskGetProcessorStatistics(Xsk), RxFrames, FrameCount);
+        XskPollBusyActivity(Xsk);
 
         //
-        // Enable cancellation and synchronize with the IO manager.
+        // N.B. See comment in XskNotify.
         //
-        IoSetCancelRoutine(Irp, XskCancelNotify);
-        if (Irp->Cancel) {
-            if (IoSetCancelRoutine(Irp, NULL) != NULL) {
-                //
-                // The cancellation routine will not run; cancel the IRP here
-                // and bail.
-                //
-                Xsk->IoWaitIrp = NULL;
-                Xsk->IoWaitFlags = 0;
-                KeReleaseSpinLock(&Xsk->Lock, OldIrql);
-                Irp->IoStatus.Status = STATUS_CANCELLED;
-                EventWriteXskNotifyAsyncComplete(
-                    &MICROSOFT_XDP_PROVIDER, Xsk, Irp, Irp->IoStatus.Status);
-                IoCompleteRequest(Irp, IO_NETWORK_INCREMENT);
-            } else {
-                //
-                // The cancellation routine will run; bail.
-                //
-                KeReleaseSpinLock(&Xsk->Lock, OldIrql);
-            }
+        KeMemoryBarrier();
 
-            goto Exit;
+        if (Xsk->Rx.SharedRx != NULL && RxRing == &Xsk->Rx.Ring) {
+            XskRxRingNotifyShared(Xsk->Rx.SharedRx, RxProducerIndex);
+        } else {
+            XskSignalReadyIoModerated(Xsk, XSK_NOTIFY_FLAG_WAIT_RX);
+
+            XskCheckIoCompletion(Xsk, RxRing, RxProduced, XSK_NOTIFY_FLAG_WAIT_RX);
         }
-    } else {
-        KeClearEvent(&Xsk->IoWaitEvent);
     }
-    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
 
-    //
-    // N.B. A memory barrier between the write of the wait event and the read of
-    // completed IO is needed in order to prevent a race condition when these
-    // operations are re-ordered. The race is between this thread and a thread
-    // completing IO. Memory barriers are also needed to protect against a
-    // similar race condition when the inverse of these operations are done
-    // during IO completion.
-    //
-    KeMemoryBarrier();
+    if (Xsk->Rx.HeldUmemRegions != 0) {
+        XskRxReleaseUmemRegions(Xsk);
+    }
+
+    STAGE_END(XdpRxQueueGetStageStats(Xsk->Rx.Xdp.Queue), XskPublishCycles, PublishTsc);
+    STAGE_ADD(XdpRxQueueGetStageStats(Xsk->Rx.Xdp.Queue), XskFrames, BatchCount);
+}
+
+VOID
+XskReceive(
+    _In_ XDP_REDIRECT_BATCH *Batch
+    )
+{
+    XSK *Xsk = Batch->Target;
+    XSK_KERNEL_RING *RxRing = &Xsk->Rx.Ring;
+    UINT32 RxProducerIndex;
+    UINT32 ReservedCount;
+    UINT32 RxCount = 0;
+    KIRQL OldIrql;
+
+    if (!Xsk->Rx.Xdp.Flags.DatapathAttached || Xsk->Rx.Xdp.Queue != Batch->RxQueue) {
+        return;
+    }
 
     //
-    // Check for ready IO.
+    // Priority frames are batched separately from the socket's other frames,
+    // and fall back to the RX ring if the socket has no priority RX ring.
     //
-    ReadyFlags = XskQueryReadyIo(Xsk, InFlags);
-    if (ReadyFlags != 0) {
-        XskSignalReadyIo(Xsk, ReadyFlags);
+    if (Batch->TargetType == XDP_REDIRECT_TARGET_TYPE_XSK_PRIORITY &&
+        Xsk->Rx.PriorityRing.Size != 0) {
+        RxRing = &Xsk->Rx.PriorityRing;
     }
 
     //
-    // If the notification state changed while processing this request, abandon
-    // the wait and allow the application to re-examine the shared ring flags.
+    // Sockets sharing an RX ring wait for each other's reserved entries, so
+    // reserve and submit entries without being preempted.
     //
-    if (InternalFlags != Xsk->IoWaitInternalFlags) {
-        XskSignalReadyIo(Xsk, InFlags & WaitMask);
-    }
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+
+    STAGE_START(CopyTsc);
+
+    if (Xsk->Rx.MultiBuffer) {
+        UINT32 RxAvailable = XskRingProdReserve(RxRing, MAXUINT32);
+        UINT32 FillAvailable = XskRxFillPeek(Xsk, MAXUINT32);
+        UINT32 FillCount = 0;
+        UINT32 FrameCount = 0;
+
+        ASSERT(Xsk->Rx.SharedRx == NULL);
+        RxProducerIndex = ReadUInt32NoFence(&RxRing->Shared->ProducerIndex);
+
+        for (UINT32 Index = 0; Index < Batch->Count; Index++) {
+            const XDP_REDIRECT_FRAME *RedirectFrame = &Batch->FrameIndexes[Index];
+            const XSK_RX_COALESCE *Coalesce = NULL;
+
+            if (XskRxCoalesceEnabled(Xsk) &&
+                XskRxCoalesceStart(
+                    Xsk, XdpRingGetElement(Xsk->Rx.Xdp.FrameRing, RedirectFrame->FrameIndex))) {
+                while (Index + 1 < Batch->Count &&
+                    XskRxCoalesceAppend(
+                        Xsk,
+                        XdpRingGetElement(
+                            Xsk->Rx.Xdp.FrameRing, Batch->FrameIndexes[Index + 1].FrameIndex))) {
+                    Index++;
+                }
 
-    if (Irp == NULL) {
-        //
-        // Wait for IO.
-        //
-        Timeout.QuadPart = -1 * RTL_MILLISEC_TO_100NANOSEC(TimeoutMilliseconds);
-        Status =
-            KeWaitForSingleObject(
-                &Xsk->IoWaitEvent, UserRequest, UserMode, FALSE,
-                (TimeoutMilliseconds == INFINITE) ? NULL : &Timeout);
-    } else {
-        ASSERT(Status == STATUS_PENDING);
+                if (Xsk->Rx.Coalesce.SegmentCount > 1) {
+                    Coalesce = &Xsk->Rx.Coalesce;
+                }
+            }
+
+            if (XskReceiveMultiBufferFrame(
+                    Xsk, RxRing, RedirectFrame->FrameIndex, RedirectFrame->FragmentIndex,
+                    RedirectFrame->MetadataLength, Coalesce, FillAvailable, RxAvailable,
+                    &FillCount, &RxCount)) {
+                FrameCount += (Coalesce != NULL) ? Coalesce->SegmentCount : 1;
+            }
+        }
+
+        STAGE_END(XdpRxQueueGetStageStats(Xsk->Rx.Xdp.Queue), XskCopyCycles, CopyTsc);
+        XskReceiveSubmitBatch(
+            Xsk, RxRing, RxProducerIndex, Batch->Count, FrameCount, FillCount, RxCount);
         goto Exit;
     }
 
-    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
-    Xsk->IoWaitFlags = 0;
-    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
-
     //
-    // Re-query ready IO regardless of the wait status.
+    // Every reserved RX ring entry must be filled, so reserve only as many
+    // entries as there are fill descriptors.
     //
-    ReadyFlags = XskQueryReadyIo(Xsk, InFlags);
-    if (ReadyFlags != 0) {
-        Status = STATUS_SUCCESS;
-        OutFlags |= XskWaitInFlagsToOutFlags(ReadyFlags);
+    ReservedCount = XskRxFillPeek(Xsk, Batch->Count);
+    ReservedCount = XskRxRingReserve(Xsk, RxRing, ReservedCount, &RxProducerIndex);
+
+    for (UINT32 FillIndex = 0; FillIndex < ReservedCount; FillIndex++) {
+        XskReceiveSingleFrame(
+            Xsk, RxRing, RxProducerIndex, Batch->FrameIndexes[RxCount].FrameIndex,
+            Batch->FrameIndexes[RxCount].FragmentIndex,
+            Batch->FrameIndexes[RxCount].MetadataLength, FillIndex, &RxCount);
     }
 
+    STAGE_END(XdpRxQueueGetStageStats(Xsk->Rx.Xdp.Queue), XskCopyCycles, CopyTsc);
+    XskReceiveSubmitBatch(
+        Xsk, RxRing, RxProducerIndex, Batch->Count, RxCount, ReservedCount, RxCount);
+
 Exit:
 
+    KeLowerIrql(OldIrql);
+}
+
+BOOLEAN
+XskReceiveBatchedExclusive(
+    _In_ VOID *Target
+    )
+{
+    XSK *Xsk = Target;
+    XDP_RING *FrameRing = Xsk->Rx.Xdp.FrameRing;
+    XDP_RING *FragmentRing = Xsk->Rx.Xdp.FragmentRing;
+    UINT32 BatchCount;
+    UINT32 ReservedCount;
+    UINT32 RxProducerIndex;
+    UINT32 RxAvailable = 0;
+    UINT32 FillAvailable = 0;
+    UINT32 FrameCount = 0;
+    UINT32 RxCount = 0;
+    UINT32 BackpressureCount = 0;
+    KIRQL OldIrql;
+
+    if (!Xsk->Rx.Xdp.Flags.DatapathAttached) {
+        return FALSE;
+    }
+
+    BatchCount = FrameRing->ProducerIndex - FrameRing->ConsumerIndex;
+
     //
-    // This IOCTL is assumed to never pend for fast IO, and code elsewhere takes
-    // advantage of this assumption.
+    // See XskReceive.
     //
-    ASSERT(Irp != NULL || Status != STATUS_PENDING);
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
 
-    if (Status != STATUS_PENDING) {
-        *Information = OutFlags;
+    STAGE_START(CopyTsc);
+
+    if (Xsk->Rx.MultiBuffer) {
+        ASSERT(Xsk->Rx.SharedRx == NULL);
+        RxProducerIndex = ReadUInt32NoFence(&Xsk->Rx.Ring.Shared->ProducerIndex);
+        RxAvailable = XskRingProdReserve(&Xsk->Rx.Ring, MAXUINT32);
+        FillAvailable = XskRxFillPeek(Xsk, MAXUINT32);
+        ReservedCount = 0;
+    } else {
+        ReservedCount = XskRxFillPeek(Xsk, BatchCount);
+        ReservedCount = XskRxRingReserve(Xsk, &Xsk->Rx.Ring, ReservedCount, &RxProducerIndex);
+
+        if (Xsk->Rx.Xdp.Flags.Backpressure && ReservedCount < BatchCount) {
+            //
+            // Leave the frames the socket has no space for in the frame ring
+            // instead of dropping them, and ask the application to poke RX
+            // once it makes space, so the interface resumes receiving.
+            //
+            BackpressureCount = BatchCount - ReservedCount;
+            BatchCount = ReservedCount;
+
+            if ((InterlockedOr(
+                    (LONG *)&Xsk->Rx.FillRing.Shared->Flags, XSK_RING_FLAG_NEED_POKE) &
+                    XSK_RING_FLAG_NEED_POKE) == 0) {
+                STAT_INC(XskGetProcessorStatistics(Xsk), RxFillNeedPoke);
+            }
+            STAT_ADD(
+                XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XskFramesBackpressured,
+                BackpressureCount);
+        }
     }
 
-    EventWriteXskNotifyStop(&MICROSOFT_XDP_PROVIDER, Xsk, Irp, OutFlags, Status);
+    for (UINT32 Index = 0; Index < BatchCount; Index++) {
+        UINT32 FrameIndex = FrameRing->ConsumerIndex & FrameRing->Mask;
+        UINT32 FragmentIndex = 0;
+        XDP_FRAME *Frame;
+        XDP_FRAME_FRAGMENT *Fragment;
+        XDP_FRAME_RX_ACTION *RxAction;
+
+        Frame = XdpRingGetElement(FrameRing, FrameIndex);
+
+        RxAction = XdpGetRxActionExtension(Frame, &Xsk->Rx.Xdp.RxActionExtension);
+        RxAction->RxAction = XDP_RX_ACTION_DROP;
+
+        if (FragmentRing != NULL) {
+            FragmentIndex = FragmentRing->ConsumerIndex;
+        }
+
+        if (Xsk->Rx.MultiBuffer) {
+            const XSK_RX_COALESCE *Coalesce = NULL;
+
+            if (XskRxCoalesceEnabled(Xsk) && XskRxCoalesceStart(Xsk, Frame)) {
+                //
+                // Coalesced segments follow the first in the frame ring, and
+                // have no fragment buffers.
+                //
+                while (Index + 1 < BatchCount) {
+                    XDP_FRAME *NextFrame =
+                        XdpRingGetElement(
+                            FrameRing, (FrameRing->ConsumerIndex + 1) & FrameRing->Mask);
+
+                    if (!XskRxCoalesceAppend(Xsk, NextFrame)) {
+                        break;
+                    }
+
+                    XdpGetRxActionExtension(
+                        NextFrame, &Xsk->Rx.Xdp.RxActionExtension)->RxAction =
+                            XDP_RX_ACTION_DROP;
+                    FrameRing->ConsumerIndex++;
+                    Index++;
+                }
+
+                if (Xsk->Rx.Coalesce.SegmentCount > 1) {
+                    Coalesce = &Xsk->Rx.Coalesce;
+                }
+            }
+
+            if (XskReceiveMultiBufferFrame(
+                    Xsk, &Xsk->Rx.Ring, FrameIndex, FragmentIndex, 0, Coalesce, FillAvailable,
+                    RxAvailable, &ReservedCount, &RxCount)) {
+                FrameCount += (Coalesce != NULL) ? Coalesce->SegmentCount : 1;
+            }
+        } else if (Index < ReservedCount) {
+            XskReceiveSingleFrame(
+                Xsk, &Xsk->Rx.Ring, RxProducerIndex, FrameIndex, FragmentIndex, 0, Index,
+                &RxCount);
+            FrameCount = RxCount;
+        }
+
+        FrameRing->ConsumerIndex++;
+
+        if (FragmentRing != NULL) {
+            Fragment = XdpGetFragmentExtension(Frame, &Xsk->Rx.Xdp.FragmentExtension);
+            FragmentRing->ConsumerIndex += Fragment->FragmentBufferCount;
+        }
+    }
+
+    STAGE_END(XdpRxQueueGetStageStats(Xsk->Rx.Xdp.Queue), XskCopyCycles, CopyTsc);
+    XskReceiveSubmitBatch(
+        Xsk, &Xsk->Rx.Ring, RxProducerIndex, BatchCount, FrameCount, ReservedCount, RxCount);
+
+    KeLowerIrql(OldIrql);
+
+    return TRUE;
+}
+
+_Use_decl_annotations_
+NTSTATUS
+XskIrpDeviceIoControl(
+    IRP *Irp,
+    IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+
+    Irp->IoStatus.Information = 0;
+
+    switch (IrpSp->Parameters.DeviceIoControl.IoControlCode) {
+    case IOCTL_XSK_BIND:
+        Status = XskIrpBindSocket(Irp, IrpSp);
+        break;
+    case IOCTL_XSK_ACTIVATE:
+        Status = XskIrpActivateSocket(Irp, IrpSp);
+        break;
+    case IOCTL_XSK_GET_SOCKOPT:
+        Status = XskIrpGetSockopt(Irp, IrpSp);
+        break;
+    case IOCTL_XSK_SET_SOCKOPT:
+        Status = XskIrpSetSockopt(Irp, IrpSp);
+        break;
+    case IOCTL_XSK_SOCKOPTS:
+        Status = XskIrpSockopts(Irp, IrpSp);
+        break;
+    case IOCTL_XSK_NOTIFY_ASYNC:
+        Status =
+            XskNotify(
+                IrpSp->FileObject->FsContext, IrpSp->Parameters.DeviceIoControl.Type3InputBuffer,
+                IrpSp->Parameters.DeviceIoControl.InputBufferLength, Irp->RequestorMode,
+                &Irp->IoStatus.Information, Irp);
+        break;
+    default:
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+Exit:
 
     return Status;
 }
 
-#pragma warning(push)
-#pragma warning(disable:6101) // We don't set OutputBuffer in some paths
-BOOLEAN
-XskFastIo(
-    _In_ XDP_FILE_OBJECT_HEADER *FileObjectHeader,
-    _In_opt_ VOID *InputBuffer,
+//
+// Kernel mode clients attach to the XSK NPI and drive sockets through the
+// routines below. The control path reuses the socket IOCTLs on a kernel
+// handle, while notifications bypass the IO manager entirely.
+//
+
+struct _XSK_KERNEL_SOCKET {
+    HANDLE Handle;
+    FILE_OBJECT *FileObject;
+    XSK *Xsk;
+};
+
+static XSK_KERNEL_CREATE XskKernelCreate;
+static XSK_KERNEL_CLOSE XskKernelClose;
+static XSK_KERNEL_BIND XskKernelBind;
+static XSK_KERNEL_ACTIVATE XskKernelActivate;
+static XSK_KERNEL_SET_SOCKOPT XskKernelSetSockopt;
+static XSK_KERNEL_GET_SOCKOPT XskKernelGetSockopt;
+static XSK_KERNEL_NOTIFY XskKernelNotify;
+static XSK_KERNEL_SET_NOTIFY_ROUTINE XskKernelSetNotifyRoutine;
+static XSK_KERNEL_GET_HANDLE XskKernelGetHandle;
+static XSK_KERNEL_CREATE_PROGRAM XskKernelCreateProgram;
+
+static
+NTSTATUS
+XskKernelIoctl(
+    _In_ XSK_KERNEL_SOCKET *Socket,
+    _In_ ULONG IoControlCode,
+    _In_reads_bytes_opt_(InputBufferLength) VOID *InputBuffer,
     _In_ ULONG InputBufferLength,
-    _Out_opt_ VOID *OutputBuffer,
+    _Out_writes_bytes_opt_(OutputBufferLength) VOID *OutputBuffer,
     _In_ ULONG OutputBufferLength,
-    _In_ ULONG IoControlCode,
-    _Out_ IO_STATUS_BLOCK *IoStatus
+    _Out_opt_ ULONG_PTR *BytesReturned
     )
 {
-    XSK *Xsk = CONTAINING_RECORD(FileObjectHeader, XSK, Header);
+    NTSTATUS Status;
+    IO_STATUS_BLOCK IoStatusBlock = {0};
 
-    switch (IoControlCode) {
-    case IOCTL_XSK_NOTIFY:
-        IoStatus->Status =
-            XskNotify(Xsk, InputBuffer, InputBufferLength, &IoStatus->Information, NULL);
-        return TRUE;
+    //
+    // The handle is opened for synchronous IO, so the request has completed
+    // once the system service returns.
+    //
+    Status =
+        ZwDeviceIoControlFile(
+            Socket->Handle, NULL, NULL, NULL, &IoStatusBlock, IoControlCode,
+            InputBuffer, InputBufferLength, OutputBuffer, OutputBufferLength);
+    ASSERT(Status != STATUS_PENDING);
 
-    case IOCTL_XSK_GET_SOCKOPT:
-        return
-            XskFastGetSockopt(
-                FileObjectHeader, InputBuffer, InputBufferLength, OutputBuffer,
-                OutputBufferLength, IoStatus);
+    if (BytesReturned != NULL) {
+        *BytesReturned = IoStatusBlock.Information;
     }
 
-    return FALSE;
+    return Status;
 }
-#pragma warning(pop)
 
-static
-FORCEINLINE
+_Use_decl_annotations_
 VOID
-XskReceiveSingleFrame(
-    _In_ XSK *Xsk,
-    _In_ UINT32 FrameIndex,
-    _In_ UINT32 FragmentIndex,
-    _In_ UINT32 FillOffset,
-    _Inout_ UINT32 *CompletionOffset
+XskKernelClose(
+    XSK_KERNEL_SOCKET *Socket
     )
 {
-    XDP_RING *FragmentRing = Xsk->Rx.Xdp.FragmentRing;
-    XDP_FRAME *Frame = XdpRingGetElement(Xsk->Rx.Xdp.FrameRing, FrameIndex);
-    XDP_FRAME_FRAGMENT *Fragment;
-    XDP_BUFFER *Buffer = &Frame->Buffer;
-    XDP_BUFFER_VIRTUAL_ADDRESS *Va = XdpGetVirtualAddressExtension(Buffer, &Xsk->Rx.Xdp.VaExtension);
-    UCHAR *UmemChunk;
-    UINT64 UmemAddress;
-    UINT32 UmemOffset;
-    UINT32 CopyLength;
-    UINT32 RingIndex;
+    TraceEnter(TRACE_XSK, "Socket=%p", Socket);
 
-    XSK_FRAME_DESCRIPTOR *XskFrame;
-    XSK_BUFFER_DESCRIPTOR *XskBuffer;
+    if (Socket->FileObject != NULL) {
+        XSK *Xsk = Socket->Xsk;
+        KIRQL OldIrql;
 
-    RingIndex =
-        (ReadUInt32NoFence(&Xsk->Rx.FillRing.Shared->ConsumerIndex) + FillOffset) &
-            Xsk->Rx.FillRing.Mask;
-    UmemAddress = *(UINT64 *)XskKernelRingGetElement(&Xsk->Rx.FillRing, RingIndex);
-
-    if (UmemAddress > Xsk->Umem->Reg.TotalSize - Xsk->Umem->Reg.ChunkSize) {
         //
-        // Invalid FILL descriptor.
+        // The socket itself may outlive the handle, so disarm the notify
+        // routine and wait for in-flight invocations before the client is
+        // allowed to tear down the routine's context.
         //
-        Xsk->Statistics.RxInvalidDescriptors++;
-        STAT_INC(XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XskInvalidDescriptors);
-        return;
+        KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+        WriteUInt32NoFence(&Xsk->IoCompletion.Flags, 0);
+        KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+        ExWaitForRundownProtectionRelease(&Xsk->IoCompletion.Rundown);
+
+        ObDereferenceObject(Socket->FileObject);
     }
 
-    UmemChunk = Xsk->Umem->Mapping.SystemAddress + UmemAddress;
-    UmemOffset = Xsk->Umem->Reg.Headroom;
-    CopyLength = min(Buffer->DataLength, Xsk->Umem->Reg.ChunkSize - UmemOffset);
+    if (Socket->Handle != NULL) {
+        ZwClose(Socket->Handle);
+    }
+
+    ExFreePoolWithTag(Socket, POOLTAG_CLIENT);
+
+    TraceExitSuccess(TRACE_XSK);
+}
+
+//
+// Opens an XDP object on a kernel handle, as XdpOpen does in user mode.
+//
+static
+NTSTATUS
+XskKernelOpen(
+    _In_ XDP_OBJECT_TYPE ObjectType,
+    _In_reads_bytes_opt_(ParamsLength) const VOID *Params,
+    _In_ UINT32 ParamsLength,
+    _Out_ HANDLE *Handle
+    )
+{
+    NTSTATUS Status;
+    UNICODE_STRING DeviceName;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    DECLSPEC_ALIGN(MEMORY_ALLOCATION_ALIGNMENT) UCHAR EaBuffer[
+        sizeof(FILE_FULL_EA_INFORMATION) + sizeof(XDP_OPEN_PACKET_NAME) +
+        sizeof(XDP_OPEN_PACKET) + sizeof(XDP_PROGRAM_OPEN)];
+    FILE_FULL_EA_INFORMATION *EaHeader = (FILE_FULL_EA_INFORMATION *)EaBuffer;
+    XDP_OPEN_PACKET *OpenPacket;
+    const UINT32 EaLength =
+        sizeof(FILE_FULL_EA_INFORMATION) + sizeof(XDP_OPEN_PACKET_NAME) +
+        sizeof(XDP_OPEN_PACKET) + ParamsLength;
+
+    ASSERT(EaLength <= sizeof(EaBuffer));
+
+    RtlZeroMemory(EaBuffer, sizeof(EaBuffer));
+    EaHeader->EaNameLength = sizeof(XDP_OPEN_PACKET_NAME) - 1;
+    RtlCopyMemory(EaHeader->EaName, XDP_OPEN_PACKET_NAME, sizeof(XDP_OPEN_PACKET_NAME));
+    EaHeader->EaValueLength = (USHORT)(sizeof(*OpenPacket) + ParamsLength);
+    OpenPacket = (XDP_OPEN_PACKET *)(EaHeader->EaName + sizeof(XDP_OPEN_PACKET_NAME));
+    OpenPacket->MajorVersion = 1;
+    OpenPacket->MinorVersion = 0;
+    OpenPacket->ObjectType = ObjectType;
+    if (ParamsLength > 0) {
+        RtlCopyMemory(OpenPacket + 1, Params, ParamsLength);
+    }
+
+    RtlInitUnicodeString(&DeviceName, XDP_DEVICE_NAME);
+    InitializeObjectAttributes(
+        &ObjectAttributes, &DeviceName, OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE, NULL, NULL);
+
+    Status =
+        ZwCreateFile(
+            Handle, GENERIC_READ | GENERIC_WRITE | SYNCHRONIZE,
+            &ObjectAttributes, &IoStatusBlock, NULL, 0L, FILE_SHARE_READ | FILE_SHARE_WRITE,
+            FILE_CREATE, FILE_SYNCHRONOUS_IO_NONALERT, EaBuffer, EaLength);
+    if (!NT_SUCCESS(Status)) {
+        *Handle = NULL;
+    }
+
+    return Status;
+}
+
+_Use_decl_annotations_
+NTSTATUS
+XskKernelCreate(
+    XSK_KERNEL_SOCKET **Socket
+    )
+{
+    NTSTATUS Status;
+    XSK_KERNEL_SOCKET *KernelSocket;
+
+    TraceEnter(TRACE_XSK, "-");
+
+    KernelSocket = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*KernelSocket), POOLTAG_CLIENT);
+    if (KernelSocket == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Exit;
+    }
+
+    Status = XskKernelOpen(XDP_OBJECT_TYPE_XSK, NULL, 0, &KernelSocket->Handle);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
 
-    if (!XskGlobals.RxZeroCopy) {
-        RtlCopyMemory(UmemChunk + UmemOffset, Va->VirtualAddress + Buffer->DataOffset, CopyLength);
+    Status =
+        XdpReferenceObjectByHandle(
+            KernelSocket->Handle, XDP_OBJECT_TYPE_XSK, KernelMode, FILE_GENERIC_WRITE,
+            &KernelSocket->FileObject);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
     }
-    if (CopyLength < Buffer->DataLength) {
-        //
-        // Not enough available space in Umem.
-        //
-        Xsk->Statistics.RxTruncated++;
-        STAT_INC(XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XskFramesTruncated);
-    } else if (FragmentRing != NULL) {
-        Fragment = XdpGetFragmentExtension(Frame, &Xsk->Rx.Xdp.FragmentExtension);
 
-        for (UINT32 Index = 0; Index < Fragment->FragmentBufferCount; Index++) {
-            Buffer = XdpRingGetElement(FragmentRing, (FragmentIndex + Index) & FragmentRing->Mask);
-            Va = XdpGetVirtualAddressExtension(Buffer, &Xsk->Rx.Xdp.VaExtension);
+    KernelSocket->Xsk = KernelSocket->FileObject->FsContext;
 
-            UmemOffset += CopyLength;
-            CopyLength = min(Buffer->DataLength, Xsk->Umem->Reg.ChunkSize - UmemOffset);
+    TraceInfo(TRACE_XSK, "Xsk=%p Created kernel socket=%p", KernelSocket->Xsk, KernelSocket);
 
-            if (!XskGlobals.RxZeroCopy) {
-                RtlCopyMemory(
-                    UmemChunk + UmemOffset, Va->VirtualAddress + Buffer->DataOffset, CopyLength);
-            }
+    *Socket = KernelSocket;
+    KernelSocket = NULL;
 
-            if (CopyLength < Buffer->DataLength) {
-                //
-                // Not enough available space in Umem.
-                //
-                Xsk->Statistics.RxTruncated++;
-                STAT_INC(XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XskFramesTruncated);
-                break;
-            }
-        }
+Exit:
+
+    if (KernelSocket != NULL) {
+        XskKernelClose(KernelSocket);
     }
 
-    RingIndex =
-        (ReadUInt32NoFence(&Xsk->Rx.Ring.Shared->ProducerIndex) + *CompletionOffset) &
-            Xsk->Rx.Ring.Mask;
-    XskFrame = XskKernelRingGetElement(&Xsk->Rx.Ring, RingIndex);
-    XskBuffer = &XskFrame->Buffer;
-    XskBuffer->Address.BaseAddress = UmemAddress;
-    ASSERT(Xsk->Umem->Reg.Headroom <= MAXUINT16);
-    XskBuffer->Address.Offset = (UINT16)Xsk->Umem->Reg.Headroom;
-    XskBuffer->Length = UmemOffset - Xsk->Umem->Reg.Headroom + CopyLength;
+    TraceExitStatus(TRACE_XSK);
 
-    ++*CompletionOffset;
+    return Status;
 }
 
-static
-VOID
-XskReceiveSubmitBatch(
-    _In_ XSK *Xsk,
-    _In_ UINT32 BatchCount,
-    _In_ UINT32 RxFillConsumed,
-    _In_ UINT32 RxProduced
+_Use_decl_annotations_
+HANDLE
+XskKernelGetHandle(
+    XSK_KERNEL_SOCKET *Socket
     )
 {
-    if (RxProduced < BatchCount) {
-        //
-        // Dropped packets.
-        //
-        UINT32 Dropped = BatchCount - RxProduced;
-        Xsk->Statistics.RxDropped += Dropped;
-        STAT_ADD(XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XskFramesDropped, Dropped);
-    }
+    return Socket->Handle;
+}
 
-    XskRingConsRelease(&Xsk->Rx.FillRing, RxFillConsumed);
+_Use_decl_annotations_
+NTSTATUS
+XskKernelCreateProgram(
+    UINT32 IfIndex,
+    const XDP_HOOK_ID *HookId,
+    UINT32 QueueId,
+    XDP_CREATE_PROGRAM_FLAGS Flags,
+    const XDP_RULE *Rules,
+    UINT32 RuleCount,
+    HANDLE *Program
+    )
+{
+    NTSTATUS Status;
+    XDP_PROGRAM_OPEN ProgramOpen = {0};
 
-    XskKernelRingUpdateIdealProcessor(&Xsk->Rx.Ring);
+    TraceEnter(TRACE_XSK, "IfIndex=%u QueueId=%u", IfIndex, QueueId);
 
-    if (RxProduced > 0) {
-        XskRingProdSubmit(&Xsk->Rx.Ring, RxProduced);
+    ProgramOpen.IfIndex = IfIndex;
+    ProgramOpen.HookId = *HookId;
+    ProgramOpen.QueueId = QueueId;
+    ProgramOpen.Flags = Flags;
+    ProgramOpen.RuleCount = RuleCount;
+    ProgramOpen.Rules = Rules;
 
-        EventWriteXskRxPostBatch(
-            &MICROSOFT_XDP_PROVIDER, Xsk,
-            Xsk->Rx.Ring.Shared->ProducerIndex - RxProduced, RxProduced);
-        STAT_ADD(XdpRxQueueGetStats(Xsk->Rx.Xdp.Queue), XskFramesDelivered, RxProduced);
+    //
+    // The program is created in the context of a kernel mode request, so the
+    // rules' redirect targets are resolved as kernel handles.
+    //
+    Status = XskKernelOpen(XDP_OBJECT_TYPE_PROGRAM, &ProgramOpen, sizeof(ProgramOpen), Program);
 
-        //
-        // N.B. See comment in XskNotify.
-        //
-        KeMemoryBarrier();
+    TraceExitStatus(TRACE_XSK);
 
-        if ((Xsk->IoWaitFlags & XSK_NOTIFY_FLAG_WAIT_RX) &&
-            (KeReadStateEvent(&Xsk->IoWaitEvent) == 0 || Xsk->IoWaitIrp != NULL)) {
-            XskSignalReadyIo(Xsk, XSK_NOTIFY_FLAG_WAIT_RX);
-        }
-    }
+    return Status;
 }
 
-VOID
-XskReceive(
-    _In_ XDP_REDIRECT_BATCH *Batch
+_Use_decl_annotations_
+NTSTATUS
+XskKernelBind(
+    XSK_KERNEL_SOCKET *Socket,
+    UINT32 IfIndex,
+    UINT32 QueueId,
+    XSK_BIND_FLAGS Flags
     )
 {
-    XSK *Xsk = Batch->Target;
-    UINT32 ReservedCount;
-    UINT32 RxCount = 0;
+    XSK_BIND_IN Bind = {0};
 
-    if (!Xsk->Rx.Xdp.Flags.DatapathAttached || Xsk->Rx.Xdp.Queue != Batch->RxQueue) {
-        goto Exit;
-    }
+    Bind.IfIndex = IfIndex;
+    Bind.QueueId = QueueId;
+    Bind.Flags = Flags;
 
-    ReservedCount = XskRingProdReserve(&Xsk->Rx.Ring, Batch->Count);
-    ReservedCount = XskRingConsPeek(&Xsk->Rx.FillRing, ReservedCount);
+    return XskKernelIoctl(Socket, IOCTL_XSK_BIND, &Bind, sizeof(Bind), NULL, 0, NULL);
+}
 
-    for (UINT32 FillIndex = 0; FillIndex < ReservedCount; FillIndex++) {
-        XskReceiveSingleFrame(
-            Xsk, Batch->FrameIndexes[RxCount].FrameIndex,
-            Batch->FrameIndexes[RxCount].FragmentIndex, FillIndex, &RxCount);
-    }
+_Use_decl_annotations_
+NTSTATUS
+XskKernelActivate(
+    XSK_KERNEL_SOCKET *Socket,
+    XSK_ACTIVATE_FLAGS Flags
+    )
+{
+    XSK_ACTIVATE_IN Activate = {0};
 
-    XskReceiveSubmitBatch(Xsk, Batch->Count, ReservedCount, RxCount);
+    Activate.Flags = Flags;
 
-Exit:
-    return;
+    return
+        XskKernelIoctl(Socket, IOCTL_XSK_ACTIVATE, &Activate, sizeof(Activate), NULL, 0, NULL);
 }
 
-BOOLEAN
-XskReceiveBatchedExclusive(
-    _In_ VOID *Target
+_Use_decl_annotations_
+NTSTATUS
+XskKernelSetSockopt(
+    XSK_KERNEL_SOCKET *Socket,
+    UINT32 OptionName,
+    const VOID *OptionValue,
+    UINT32 OptionLength
     )
 {
-    XSK *Xsk = Target;
-    XDP_RING *FrameRing = Xsk->Rx.Xdp.FrameRing;
-    XDP_RING *FragmentRing = Xsk->Rx.Xdp.FragmentRing;
-    UINT32 BatchCount;
-    UINT32 ReservedCount;
-    UINT32 RxCount = 0;
-
-    if (!Xsk->Rx.Xdp.Flags.DatapathAttached) {
-        return FALSE;
-    }
-
-    BatchCount = FrameRing->ProducerIndex - FrameRing->ConsumerIndex;
+    XSK_SET_SOCKOPT_IN Sockopt = {0};
 
-    ReservedCount = XskRingProdReserve(&Xsk->Rx.Ring, BatchCount);
-    ReservedCount = XskRingConsPeek(&Xsk->Rx.FillRing, ReservedCount);
+    Sockopt.Option = OptionName;
+    Sockopt.InputBufferLength = OptionLength;
+    Sockopt.InputBuffer = OptionValue;
 
-    for (UINT32 Index = 0; Index < BatchCount; Index++) {
-        UINT32 FrameIndex = FrameRing->ConsumerIndex & FrameRing->Mask;
-        UINT32 FragmentIndex = 0;
-        XDP_FRAME *Frame;
-        XDP_FRAME_FRAGMENT *Fragment;
-        XDP_FRAME_RX_ACTION *RxAction;
+    return
+        XskKernelIoctl(
+            Socket, IOCTL_XSK_SET_SOCKOPT, &Sockopt, sizeof(Sockopt), NULL, 0, NULL);
+}
 
-        Frame = XdpRingGetElement(FrameRing, FrameIndex);
+_Use_decl_annotations_
+NTSTATUS
+XskKernelGetSockopt(
+    XSK_KERNEL_SOCKET *Socket,
+    UINT32 OptionName,
+    VOID *OptionValue,
+    UINT32 *OptionLength
+    )
+{
+    NTSTATUS Status;
+    ULONG_PTR BytesReturned = 0;
 
-        RxAction = XdpGetRxActionExtension(Frame, &Xsk->Rx.Xdp.RxActionExtension);
-        RxAction->RxAction = XDP_RX_ACTION_DROP;
+    Status =
+        XskKernelIoctl(
+            Socket, IOCTL_XSK_GET_SOCKOPT, &OptionName, sizeof(OptionName),
+            OptionValue, *OptionLength, &BytesReturned);
+    if (NT_SUCCESS(Status)) {
+        *OptionLength = (UINT32)BytesReturned;
+    }
 
-        if (FragmentRing != NULL) {
-            FragmentIndex = FragmentRing->ConsumerIndex;
-        }
+    return Status;
+}
 
-        if (Index < ReservedCount) {
-            XskReceiveSingleFrame(Xsk, FrameIndex, FragmentIndex, Index, &RxCount);
-        }
+_Use_decl_annotations_
+NTSTATUS
+XskKernelNotify(
+    XSK_KERNEL_SOCKET *Socket,
+    XSK_NOTIFY_FLAGS Flags,
+    UINT32 WaitTimeoutMilliseconds,
+    XSK_NOTIFY_RESULT_FLAGS *Result
+    )
+{
+    NTSTATUS Status;
+    XSK_NOTIFY_IN Notify = {0};
+    ULONG_PTR Information = 0;
 
-        FrameRing->ConsumerIndex++;
+    Notify.Flags = Flags;
+    Notify.WaitTimeoutMilliseconds = WaitTimeoutMilliseconds;
 
-        if (FragmentRing != NULL) {
-            Fragment = XdpGetFragmentExtension(Frame, &Xsk->Rx.Xdp.FragmentExtension);
-            FragmentRing->ConsumerIndex += Fragment->FragmentBufferCount;
-        }
-    }
+    Status =
+        XskNotify(Socket->Xsk, &Notify, sizeof(Notify), KernelMode, &Information, NULL);
 
-    XskReceiveSubmitBatch(Xsk, BatchCount, ReservedCount, RxCount);
+    *Result = (XSK_NOTIFY_RESULT_FLAGS)Information;
 
-    return TRUE;
+    return Status;
 }
 
 _Use_decl_annotations_
 NTSTATUS
-XskIrpDeviceIoControl(
-    IRP *Irp,
-    IO_STACK_LOCATION *IrpSp
+XskKernelSetNotifyRoutine(
+    XSK_KERNEL_SOCKET *Socket,
+    XSK_NOTIFY_FLAGS Flags,
+    XSK_KERNEL_NOTIFY_ROUTINE *NotifyRoutine,
+    VOID *NotifyContext
     )
 {
     NTSTATUS Status;
+    XSK *Xsk = Socket->Xsk;
+    UINT32 ReadyFlags = 0;
+    KIRQL OldIrql;
 
-    Irp->IoStatus.Information = 0;
+    TraceEnter(TRACE_XSK, "Xsk=%p", Xsk);
 
-    switch (IrpSp->Parameters.DeviceIoControl.IoControlCode) {
-    case IOCTL_XSK_BIND:
-        Status = XskIrpBindSocket(Irp, IrpSp);
-        break;
-    case IOCTL_XSK_ACTIVATE:
-        Status = XskIrpActivateSocket(Irp, IrpSp);
-        break;
-    case IOCTL_XSK_GET_SOCKOPT:
-        Status = XskIrpGetSockopt(Irp, IrpSp);
-        break;
-    case IOCTL_XSK_SET_SOCKOPT:
-        Status = XskIrpSetSockopt(Irp, IrpSp);
-        break;
-    case IOCTL_XSK_NOTIFY_ASYNC:
-        Status =
-            XskNotify(
-                IrpSp->FileObject->FsContext, IrpSp->Parameters.DeviceIoControl.Type3InputBuffer,
-                IrpSp->Parameters.DeviceIoControl.InputBufferLength,
-                &Irp->IoStatus.Information, Irp);
-        break;
-    default:
-        Status = STATUS_NOT_SUPPORTED;
+    if ((Flags & ~(XSK_NOTIFY_FLAG_WAIT_RX | XSK_NOTIFY_FLAG_WAIT_TX)) ||
+        (Flags != 0 && NotifyRoutine == NULL)) {
+        Status = STATUS_INVALID_PARAMETER;
         goto Exit;
     }
 
+    KeAcquireSpinLock(&Xsk->Lock, &OldIrql);
+
+    if (Xsk->State != XskActive ||
+        (Flags & XSK_NOTIFY_FLAG_WAIT_RX && Xsk->Rx.Ring.Size == 0) ||
+        (Flags & XSK_NOTIFY_FLAG_WAIT_TX && Xsk->Tx.Ring.Size == 0)) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+    } else {
+        //
+        // Disable notifications while the routine is updated, as is done for
+        // completion ports; the routine replaces any completion port.
+        //
+        WriteUInt32NoFence(&Xsk->IoCompletion.Flags, 0);
+
+        if (Flags != 0) {
+            Xsk->IoCompletion.Port = NULL;
+            Xsk->IoCompletion.Key = NULL;
+            Xsk->IoCompletion.Routine = NotifyRoutine;
+            Xsk->IoCompletion.Context = NotifyContext;
+            WriteUInt32Release(&Xsk->IoCompletion.Flags, Flags);
+
+            //
+            // Rings that are already non-empty will not transition, so notify
+            // them now.
+            //
+            KeMemoryBarrier();
+            ReadyFlags = XskQueryReadyIo(Xsk, Flags);
+        }
+
+        Status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&Xsk->Lock, OldIrql);
+
+    if (ReadyFlags != 0) {
+        XskPostIoCompletion(Xsk, ReadyFlags);
+    }
+
+    if (NT_SUCCESS(Status)) {
+        TraceInfo(
+            TRACE_XSK, "Xsk=%p Set kernel notify routine Flags=0x%x Context=%p",
+            Xsk, Flags, NotifyContext);
+    }
+
 Exit:
 
+    TraceExitStatus(TRACE_XSK);
+
     return Status;
 }
 
+static const XSK_KERNEL_DISPATCH XskKernelDispatch = {
+    .Header = {
+        .Revision = XSK_KERNEL_DISPATCH_REVISION_2,
+        .Size = XSK_KERNEL_DISPATCH_REVISION_2_SIZE,
+    },
+    .Create = XskKernelCreate,
+    .Close = XskKernelClose,
+    .Bind = XskKernelBind,
+    .Activate = XskKernelActivate,
+    .SetSockopt = XskKernelSetSockopt,
+    .GetSockopt = XskKernelGetSockopt,
+    .Notify = XskKernelNotify,
+    .SetNotifyRoutine = XskKernelSetNotifyRoutine,
+    .GetHandle = XskKernelGetHandle,
+    .CreateProgram = XskKernelCreateProgram,
+};
+
+static
+NTSTATUS
+XskKernelNpiAttachClient(
+    _In_ HANDLE NmrBindingHandle,
+    _In_ const VOID *ProviderContext,
+    _In_ const NPI_REGISTRATION_INSTANCE *ClientRegistrationInstance,
+    _In_ const VOID *ClientBindingContext,
+    _In_ const VOID *ClientNpiDispatch,
+    _Outptr_ VOID **ProviderBindingContext,
+    _Outptr_result_maybenull_ const VOID **ProviderDispatch
+    )
+{
+    UNREFERENCED_PARAMETER(ProviderContext);
+    UNREFERENCED_PARAMETER(ClientBindingContext);
+    UNREFERENCED_PARAMETER(ClientNpiDispatch);
+
+    TraceInfo(
+        TRACE_XSK, "Attach kernel client ModuleId=%!GUID!",
+        &ClientRegistrationInstance->ModuleId->Guid);
+
+    //
+    // Sockets are file objects with their own lifetime, so there is no
+    // per-client state.
+    //
+    *ProviderBindingContext = NmrBindingHandle;
+    *ProviderDispatch = &XskKernelDispatch;
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XskKernelNpiDetachClient(
+    _In_ const VOID *ProviderBindingContext
+    )
+{
+    UNREFERENCED_PARAMETER(ProviderBindingContext);
+
+    return STATUS_SUCCESS;
+}
+
+static const NPI_MODULEID XskKernelNpiModuleId = {
+    .Length = sizeof(NPI_MODULEID),
+    .Type = MIT_GUID,
+    .Guid = { /* 3f2c8a0d-5b7e-4e19-a6c4-2d9b1e7f4a53 */
+        0x3f2c8a0d,
+        0x5b7e,
+        0x4e19,
+        {0xa6, 0xc4, 0x2d, 0x9b, 0x1e, 0x7f, 0x4a, 0x53}
+    },
+};
+
+static const NPI_PROVIDER_CHARACTERISTICS XskKernelNpiCharacteristics = {
+    .Length = sizeof(NPI_PROVIDER_CHARACTERISTICS),
+    .ProviderAttachClient = XskKernelNpiAttachClient,
+    .ProviderDetachClient = XskKernelNpiDetachClient,
+    .ProviderRegistrationInstance = {
+        .Size = sizeof(NPI_REGISTRATION_INSTANCE),
+        .NpiId = &XSK_KERNEL_NPI_ID,
+        .ModuleId = &XskKernelNpiModuleId,
+    },
+};
+
 _IRQL_requires_(PASSIVE_LEVEL)
 VOID
 XskRegistryUpdate(
@@ -4511,6 +14095,17 @@ XskRegistryUpdate(
     } else {
         XskGlobals.RxZeroCopy = FALSE;
     }
+
+    //
+    // The limit is configured in megabytes; zero disables the limit. Lowering
+    // the limit does not affect memory already charged.
+    //
+    Status = XdpRegQueryDwordValue(XDP_PARAMETERS_KEY, L"XskProcessMemoryLimitMb", &Value);
+    if (NT_SUCCESS(Status)) {
+        WriteUInt64NoFence(&XskGlobals.ProcessMemoryLimit, (UINT64)Value * 1024 * 1024);
+    } else {
+        WriteUInt64NoFence(&XskGlobals.ProcessMemoryLimit, 0);
+    }
 }
 
 NTSTATUS
@@ -4518,9 +14113,33 @@ XskStart(
     VOID
     )
 {
+    NTSTATUS Status;
+
     RtlZeroMemory(&XskGlobals, sizeof(XskGlobals));
+    ExInitializePushLock(&XskGlobals.PcwLock);
+    InitializeListHead(&XskGlobals.PcwSockets);
+    KeInitializeSpinLock(&XskGlobals.ProcessMemoryLock);
+    InitializeListHead(&XskGlobals.ProcessMemory);
     XdpRegWatcherAddClient(XdpRegWatcher, XskRegistryUpdate, &XskRegWatcherEntry);
-    return STATUS_SUCCESS;
+
+    Status = XdpPcwRegisterXsk(XskPcwCallback, NULL);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status =
+        NmrRegisterProvider(
+            (NPI_PROVIDER_CHARACTERISTICS *)&XskKernelNpiCharacteristics, NULL,
+            &XskGlobals.KernelNpiProvider);
+    if (!NT_SUCCESS(Status)) {
+        TraceError(TRACE_XSK, "NmrRegisterProvider failed Status=%!STATUS!", Status);
+        XskGlobals.KernelNpiProvider = NULL;
+        goto Exit;
+    }
+
+Exit:
+
+    return Status;
 }
 
 VOID
@@ -4528,5 +14147,20 @@ XskStop(
     VOID
     )
 {
+    if (XskGlobals.KernelNpiProvider != NULL) {
+        //
+        // Deregistration detaches all clients, which close their sockets.
+        //
+        if (NmrDeregisterProvider(XskGlobals.KernelNpiProvider) == STATUS_PENDING) {
+            NmrWaitForProviderDeregisterComplete(XskGlobals.KernelNpiProvider);
+        }
+        XskGlobals.KernelNpiProvider = NULL;
+    }
+
+    if (XdpPcwXsk != NULL) {
+        PcwUnregister(XdpPcwXsk);
+        XdpPcwXsk = NULL;
+    }
+
     XdpRegWatcherRemoveClient(XdpRegWatcher, &XskRegWatcherEntry);
 }
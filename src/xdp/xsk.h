@@ -15,12 +15,23 @@ XskReceiveBatchedExclusive(
     _In_ VOID *Target
     );
 
+//
+// Writes a run of completions to the XSK completion ring without publishing
+// them. Returns TRUE if the XSK had no unpublished completions, in which case
+// the caller must invoke XskFlushTxCompletion once all runs are written.
+//
 _IRQL_requires_max_(DISPATCH_LEVEL)
-VOID
+BOOLEAN
 XskFillTxCompletion(
     _In_ XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *DatapathClientEntry
     );
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XskFlushTxCompletion(
+    _In_ XDP_TX_QUEUE_DATAPATH_CLIENT_ENTRY *DatapathClientEntry
+    );
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 UINT32
 XskFillTx(
@@ -244,6 +244,86 @@ XskNotifyAsync(
     return S_OK;
 }
 
+HRESULT
+XskNotifySockets(
+    _Inout_updates_(SocketCount) XSK_NOTIFY_SOCKET_ENTRY *Sockets,
+    _In_ UINT32 SocketCount,
+    _In_ UINT32 WaitTimeoutMilliseconds,
+    _Out_ UINT32 *ReadyCount
+    )
+{
+    BOOL Res;
+    DWORD BytesReturned;
+    XSK_NOTIFY_SOCKETS_IN Notify = {0};
+
+    *ReadyCount = 0;
+
+    if (SocketCount == 0) {
+        return E_INVALIDARG;
+    }
+
+    Notify.Sockets = Sockets;
+    Notify.SocketCount = SocketCount;
+    Notify.WaitTimeoutMilliseconds = WaitTimeoutMilliseconds;
+
+    //
+    // The request may be issued on any socket handle; use the first.
+    //
+    Res =
+        XdpIoctl(
+            Sockets[0].Socket,
+            IOCTL_XSK_NOTIFY_SOCKETS,
+            &Notify,
+            sizeof(Notify),
+            NULL,
+            0,
+            &BytesReturned,
+            NULL,
+            FALSE);
+    if (Res == 0) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    *ReadyCount = BytesReturned;
+
+    return S_OK;
+}
+
+HRESULT
+XskSockopts(
+    _In_ HANDLE Socket,
+    _Inout_updates_(OptionCount) XSK_SOCKOPT_ENTRY *Options,
+    _In_ UINT32 OptionCount,
+    _Out_ UINT32 *CompletedCount
+    )
+{
+    BOOL Res;
+    DWORD BytesReturned;
+    XSK_SOCKOPTS_IN Sockopts = {0};
+
+    *CompletedCount = 0;
+
+    Sockopts.Options = Options;
+    Sockopts.OptionCount = OptionCount;
+
+    Res =
+        XdpIoctl(
+            Socket,
+            IOCTL_XSK_SOCKOPTS,
+            &Sockopts,
+            sizeof(Sockopts),
+            CompletedCount,
+            sizeof(*CompletedCount),
+            &BytesReturned,
+            NULL,
+            FALSE);
+    if (Res == 0) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
 HRESULT
 XskGetNotifyAsyncResult(
     _In_ OVERLAPPED *Overlapped,
@@ -8,6 +8,7 @@
 #define XDPAPI __declspec(dllexport)
 
 #include <windows.h>
+#include <iphlpapi.h>
 #include <winioctl.h>
 #include <winternl.h>
 #include <crtdbg.h>
@@ -29,7 +29,20 @@ XSK_IOCTL_FN XskIoctl;
 XDP_RSS_GET_CAPABILITIES_FN XdpRssGetCapabilities;
 XDP_RSS_SET_FN XdpRssSet;
 XDP_RSS_GET_FN XdpRssGet;
+XDP_RSS_SET_QUEUE_PROCESSOR_FN XdpRssSetQueueProcessor;
 XDP_QEO_SET_FN XdpQeoSet;
+XDP_FLOW_STEERING_SET_FN XdpFlowSteeringSet;
+XDP_FLOW_STEERING_GET_FN XdpFlowSteeringGet;
+XDP_PROGRAM_UPDATE_RULES_FN XdpProgramUpdateRules;
+XDP_PROGRAM_GET_RULE_COUNTERS_FN XdpProgramGetRuleCounters;
+XSK_NOTIFY_SOCKETS_FN XskNotifySockets;
+XSK_SOCKOPTS_FN XskSockopts;
+XDP_FLIGHT_RECORDER_GET_FN XdpFlightRecorderGet;
+XDP_INTERFACE_SET_TUNING_FN XdpInterfaceSetTuning;
+XDP_TEAM_GET_QUEUES_FN XdpTeamGetQueues;
+XDP_TEAM_CREATE_PROGRAM_FN XdpTeamCreateProgram;
+XDP_PERSIST_PROGRAM_FN XdpPersistProgram;
+XDP_DELETE_PERSISTED_PROGRAM_FN XdpDeletePersistedProgram;
 
 typedef struct _XDP_API_ROUTINE {
     _Null_terminated_ const CHAR *RoutineName;
@@ -57,7 +70,20 @@ static const XDP_API_ROUTINE XdpApiRoutines[] = {
     { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XdpRssGetCapabilities, XDP_RSS_GET_CAPABILITIES_FN_NAME) },
     { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XdpRssSet, XDP_RSS_SET_FN_NAME) },
     { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XdpRssGet, XDP_RSS_GET_FN_NAME) },
+    { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XdpRssSetQueueProcessor, XDP_RSS_SET_QUEUE_PROCESSOR_FN_NAME) },
     { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XdpQeoSet, XDP_QEO_SET_FN_NAME) },
+    { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XdpFlowSteeringSet, XDP_FLOW_STEERING_SET_FN_NAME) },
+    { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XdpFlowSteeringGet, XDP_FLOW_STEERING_GET_FN_NAME) },
+    { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XdpProgramUpdateRules, XDP_PROGRAM_UPDATE_RULES_FN_NAME) },
+    { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XdpProgramGetRuleCounters, XDP_PROGRAM_GET_RULE_COUNTERS_FN_NAME) },
+    { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XskNotifySockets, XSK_NOTIFY_SOCKETS_FN_NAME) },
+    { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XskSockopts, XSK_SOCKOPTS_FN_NAME) },
+    { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XdpFlightRecorderGet, XDP_FLIGHT_RECORDER_GET_FN_NAME) },
+    { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XdpInterfaceSetTuning, XDP_INTERFACE_SET_TUNING_FN_NAME) },
+    { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XdpTeamGetQueues, XDP_TEAM_GET_QUEUES_FN_NAME) },
+    { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XdpTeamCreateProgram, XDP_TEAM_CREATE_PROGRAM_FN_NAME) },
+    { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XdpPersistProgram, XDP_PERSIST_PROGRAM_FN_NAME) },
+    { DECLARE_EXPERIMENTAL_XDP_API_ROUTINE(XdpDeletePersistedProgram, XDP_DELETE_PERSISTED_PROGRAM_FN_NAME) },
 };
 
 static const XDP_API_TABLE XdpApiTableV1 = {
@@ -225,6 +251,97 @@ XdpRssGet(
     return S_OK;
 }
 
+HRESULT
+XdpRssSetQueueProcessor(
+    _In_ HANDLE InterfaceHandle,
+    _In_ HANDLE Socket,
+    _In_ const PROCESSOR_NUMBER *Processor
+    )
+{
+    HRESULT Result;
+    PROCESSOR_NUMBER QueueProcessor;
+    UINT32 OptionLength = sizeof(QueueProcessor);
+    XDP_RSS_CONFIGURATION *RssConfiguration = NULL;
+    UINT32 RssConfigurationSize = 0;
+    PROCESSOR_NUMBER *IndirectionTable;
+    BOOLEAN Updated = FALSE;
+
+    //
+    // The queue's indirection entries are those targeting the processor its
+    // receive processing currently runs on.
+    //
+    Result =
+        XskGetSockopt(
+            Socket, XSK_SOCKOPT_RX_PROCESSOR_AFFINITY, &QueueProcessor, &OptionLength);
+    if (FAILED(Result)) {
+        goto Exit;
+    }
+
+    if (QueueProcessor.Group == Processor->Group &&
+        QueueProcessor.Number == Processor->Number) {
+        Result = S_OK;
+        goto Exit;
+    }
+
+    Result = XdpRssGet(InterfaceHandle, NULL, &RssConfigurationSize);
+    if (Result != HRESULT_FROM_WIN32(ERROR_MORE_DATA)) {
+        if (SUCCEEDED(Result)) {
+            Result = E_UNEXPECTED;
+        }
+        goto Exit;
+    }
+
+    RssConfiguration = HeapAlloc(GetProcessHeap(), 0, RssConfigurationSize);
+    if (RssConfiguration == NULL) {
+        Result = E_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    Result = XdpRssGet(InterfaceHandle, RssConfiguration, &RssConfigurationSize);
+    if (FAILED(Result)) {
+        goto Exit;
+    }
+
+    if ((RssConfiguration->Flags & XDP_RSS_FLAG_DISABLED) ||
+        RssConfiguration->IndirectionTableSize == 0 ||
+        (UINT32)RssConfiguration->IndirectionTableOffset +
+            RssConfiguration->IndirectionTableSize > RssConfigurationSize) {
+        Result = HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+        goto Exit;
+    }
+
+    IndirectionTable =
+        (PROCESSOR_NUMBER *)RTL_PTR_ADD(RssConfiguration, RssConfiguration->IndirectionTableOffset);
+
+    for (UINT32 Index = 0;
+        Index < RssConfiguration->IndirectionTableSize / sizeof(*IndirectionTable);
+        Index++) {
+        if (IndirectionTable[Index].Group == QueueProcessor.Group &&
+            IndirectionTable[Index].Number == QueueProcessor.Number) {
+            IndirectionTable[Index].Group = Processor->Group;
+            IndirectionTable[Index].Number = Processor->Number;
+            IndirectionTable[Index].Reserved = 0;
+            Updated = TRUE;
+        }
+    }
+
+    if (!Updated) {
+        Result = HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+        goto Exit;
+    }
+
+    RssConfiguration->Flags = XDP_RSS_FLAG_SET_INDIRECTION_TABLE;
+    Result = XdpRssSet(InterfaceHandle, RssConfiguration, RssConfigurationSize);
+
+Exit:
+
+    if (RssConfiguration != NULL) {
+        HeapFree(GetProcessHeap(), 0, RssConfiguration);
+    }
+
+    return Result;
+}
+
 HRESULT
 XdpQeoSet(
     _In_ HANDLE InterfaceHandle,
@@ -245,6 +362,407 @@ XdpQeoSet(
     return S_OK;
 }
 
+HRESULT
+XdpFlowSteeringSet(
+    _In_ HANDLE InterfaceHandle,
+    _Inout_ XDP_FLOW_STEERING_FILTER *FlowSteeringFilters,
+    _In_ UINT32 FlowSteeringFiltersSize
+    )
+{
+    BOOL Success =
+        XdpIoctl(
+            InterfaceHandle, IOCTL_INTERFACE_OFFLOAD_FLOW_STEERING_SET,
+            FlowSteeringFilters, FlowSteeringFiltersSize,
+            FlowSteeringFilters, FlowSteeringFiltersSize,
+            (ULONG *)&FlowSteeringFiltersSize, NULL, TRUE);
+    if (!Success) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
+HRESULT
+XdpFlowSteeringGet(
+    _In_ HANDLE InterfaceHandle,
+    _Out_writes_bytes_opt_(*FlowSteeringFiltersSize) XDP_FLOW_STEERING_FILTER *FlowSteeringFilters,
+    _Inout_ UINT32 *FlowSteeringFiltersSize
+    )
+{
+    BOOL Success =
+        XdpIoctl(
+            InterfaceHandle, IOCTL_INTERFACE_OFFLOAD_FLOW_STEERING_GET, NULL, 0,
+            FlowSteeringFilters, *FlowSteeringFiltersSize, (ULONG *)FlowSteeringFiltersSize,
+            NULL, TRUE);
+    if (!Success) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
+HRESULT
+XdpProgramUpdateRules(
+    _In_ HANDLE ProgramHandle,
+    _In_ UINT32 RuleIndex,
+    _In_ UINT32 DeleteRuleCount,
+    _In_reads_opt_(InsertRuleCount) const XDP_RULE *Rules,
+    _In_ UINT32 InsertRuleCount
+    )
+{
+    XDP_PROGRAM_UPDATE_RULES_IN Params = {0};
+
+    Params.RuleIndex = RuleIndex;
+    Params.DeleteRuleCount = DeleteRuleCount;
+    Params.InsertRuleCount = InsertRuleCount;
+    Params.Rules = Rules;
+
+    BOOL Success =
+        XdpIoctl(
+            ProgramHandle, IOCTL_PROGRAM_UPDATE_RULES, &Params, sizeof(Params),
+            NULL, 0, NULL, NULL, TRUE);
+    if (!Success) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
+HRESULT
+XdpProgramGetRuleCounters(
+    _In_ HANDLE ProgramHandle,
+    _Out_writes_bytes_opt_(*RuleCountersSize) XDP_RULE_COUNTERS *RuleCounters,
+    _Inout_ UINT32 *RuleCountersSize
+    )
+{
+    BOOL Success =
+        XdpIoctl(
+            ProgramHandle, IOCTL_PROGRAM_GET_RULE_COUNTERS, NULL, 0, RuleCounters,
+            *RuleCountersSize, (ULONG *)RuleCountersSize, NULL, TRUE);
+    if (!Success) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
+HRESULT
+XdpFlightRecorderGet(
+    _In_ HANDLE InterfaceHandle,
+    _Out_writes_bytes_opt_(*FlightRecordsSize) XDP_FLIGHT_RECORD *FlightRecords,
+    _Inout_ UINT32 *FlightRecordsSize
+    )
+{
+    BOOL Success =
+        XdpIoctl(
+            InterfaceHandle, IOCTL_INTERFACE_FLIGHT_RECORDER_GET, NULL, 0, FlightRecords,
+            *FlightRecordsSize, (ULONG *)FlightRecordsSize, NULL, TRUE);
+    if (!Success) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
+HRESULT
+XdpInterfaceSetTuning(
+    _In_ HANDLE InterfaceHandle,
+    _In_reads_(SettingCount) const XDP_TUNING_SETTING *Settings,
+    _In_ UINT32 SettingCount
+    )
+{
+    BOOL Success;
+
+    if (SettingCount > MAXUINT32 / sizeof(*Settings)) {
+        return E_INVALIDARG;
+    }
+
+    Success =
+        XdpIoctl(
+            InterfaceHandle, IOCTL_INTERFACE_TUNING_SET, (XDP_TUNING_SETTING *)Settings,
+            SettingCount * sizeof(*Settings), NULL, 0, NULL, NULL, TRUE);
+    if (!Success) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
+//
+// Returns the members of a team in ascending interface index order. The caller
+// frees the member array with HeapFree.
+//
+static
+HRESULT
+XdpTeamGetMembers(
+    _In_ UINT32 TeamIfIndex,
+    _Out_ UINT32 **Members,
+    _Out_ UINT32 *MemberCount
+    )
+{
+    HRESULT Result;
+    MIB_IFSTACK_TABLE *StackTable = NULL;
+    UINT32 Count = 0;
+    DWORD Error;
+
+    *Members = NULL;
+    *MemberCount = 0;
+
+    Error = GetIfStackTable(&StackTable);
+    if (Error != NO_ERROR) {
+        Result = HRESULT_FROM_WIN32(Error);
+        goto Exit;
+    }
+
+    *Members = HeapAlloc(GetProcessHeap(), 0, (StackTable->NumEntries + 1) * sizeof(**Members));
+    if (*Members == NULL) {
+        Result = E_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    for (UINT32 Index = 0; Index < StackTable->NumEntries; Index++) {
+        const MIB_IFSTACK_ROW *Row = &StackTable->Table[Index];
+        UINT32 Position;
+
+        if (Row->HigherLayerInterfaceIndex != TeamIfIndex ||
+            Row->LowerLayerInterfaceIndex == 0) {
+            continue;
+        }
+
+        //
+        // Insert in ascending order, so logical queue IDs do not depend on
+        // the order of the interface stack table.
+        //
+        for (Position = Count;
+            Position > 0 && (*Members)[Position - 1] > Row->LowerLayerInterfaceIndex;
+            Position--) {
+            (*Members)[Position] = (*Members)[Position - 1];
+        }
+
+        (*Members)[Position] = Row->LowerLayerInterfaceIndex;
+        Count++;
+    }
+
+    if (Count == 0) {
+        (*Members)[Count++] = TeamIfIndex;
+    }
+
+    *MemberCount = Count;
+    Result = S_OK;
+
+Exit:
+
+    if (FAILED(Result) && *Members != NULL) {
+        HeapFree(GetProcessHeap(), 0, *Members);
+        *Members = NULL;
+    }
+
+    if (StackTable != NULL) {
+        FreeMibTable(StackTable);
+    }
+
+    return Result;
+}
+
+static
+HRESULT
+XdpTeamGetMemberQueueCount(
+    _In_ UINT32 IfIndex,
+    _Out_ UINT32 *QueueCount
+    )
+{
+    HRESULT Result;
+    HANDLE InterfaceHandle;
+    XDP_RSS_CAPABILITIES RssCapabilities;
+    UINT32 RssCapabilitiesSize = sizeof(RssCapabilities);
+
+    Result = XdpInterfaceOpen(IfIndex, &InterfaceHandle);
+    if (FAILED(Result)) {
+        return Result;
+    }
+
+    //
+    // Members without RSS receive on a single queue.
+    //
+    *QueueCount = 1;
+
+    Result = XdpRssGetCapabilities(InterfaceHandle, &RssCapabilities, &RssCapabilitiesSize);
+    if (SUCCEEDED(Result) &&
+        RssCapabilitiesSize >= XDP_SIZEOF_RSS_CAPABILITIES_REVISION_1 &&
+        RssCapabilities.HashTypes != 0 &&
+        RssCapabilities.NumberOfReceiveQueues > 0) {
+        *QueueCount = RssCapabilities.NumberOfReceiveQueues;
+    }
+
+    CloseHandle(InterfaceHandle);
+
+    return S_OK;
+}
+
+HRESULT
+XdpTeamGetQueues(
+    _In_ UINT32 TeamIfIndex,
+    _Out_writes_opt_(*QueueCount) XDP_TEAM_QUEUE *Queues,
+    _Inout_ UINT32 *QueueCount
+    )
+{
+    HRESULT Result;
+    UINT32 *Members;
+    UINT32 MemberCount;
+    UINT32 Count = 0;
+
+    Result = XdpTeamGetMembers(TeamIfIndex, &Members, &MemberCount);
+    if (FAILED(Result)) {
+        return Result;
+    }
+
+    for (UINT32 MemberIndex = 0; MemberIndex < MemberCount; MemberIndex++) {
+        UINT32 MemberQueueCount;
+
+        Result = XdpTeamGetMemberQueueCount(Members[MemberIndex], &MemberQueueCount);
+        if (FAILED(Result)) {
+            goto Exit;
+        }
+
+        for (UINT32 QueueId = 0; QueueId < MemberQueueCount; QueueId++) {
+            if (Queues != NULL && Count < *QueueCount) {
+                Queues[Count].IfIndex = Members[MemberIndex];
+                Queues[Count].QueueId = QueueId;
+            }
+
+            Count++;
+        }
+    }
+
+    if (Queues == NULL || Count > *QueueCount) {
+        Result = HRESULT_FROM_WIN32(ERROR_MORE_DATA);
+    }
+
+    *QueueCount = Count;
+
+Exit:
+
+    HeapFree(GetProcessHeap(), 0, Members);
+
+    return Result;
+}
+
+HRESULT
+XdpTeamCreateProgram(
+    _In_ UINT32 TeamIfIndex,
+    _In_ const XDP_HOOK_ID *HookId,
+    _In_ XDP_CREATE_PROGRAM_FLAGS Flags,
+    _In_reads_(RuleCount) const XDP_RULE *Rules,
+    _In_ UINT32 RuleCount,
+    _Out_writes_opt_(*ProgramCount) HANDLE *Programs,
+    _Inout_ UINT32 *ProgramCount
+    )
+{
+    HRESULT Result;
+    UINT32 *Members;
+    UINT32 MemberCount;
+    UINT32 Created = 0;
+
+    Result = XdpTeamGetMembers(TeamIfIndex, &Members, &MemberCount);
+    if (FAILED(Result)) {
+        return Result;
+    }
+
+    if (Programs == NULL || MemberCount > *ProgramCount) {
+        *ProgramCount = MemberCount;
+        Result = HRESULT_FROM_WIN32(ERROR_MORE_DATA);
+        goto Exit;
+    }
+
+    for (; Created < MemberCount; Created++) {
+        Result =
+            XdpCreateProgram(
+                Members[Created], HookId, 0, Flags | XDP_CREATE_PROGRAM_FLAG_ALL_QUEUES,
+                Rules, RuleCount, &Programs[Created]);
+        if (FAILED(Result)) {
+            goto Exit;
+        }
+    }
+
+    *ProgramCount = MemberCount;
+
+Exit:
+
+    if (FAILED(Result)) {
+        while (Created > 0) {
+            CloseHandle(Programs[--Created]);
+        }
+    }
+
+    HeapFree(GetProcessHeap(), 0, Members);
+
+    return Result;
+}
+
+HRESULT
+XdpPersistProgram(
+    _In_z_ const WCHAR *Name,
+    _In_ UINT32 IfIndex,
+    _In_ const XDP_HOOK_ID *HookId,
+    _In_ XDP_CREATE_PROGRAM_FLAGS Flags,
+    _In_reads_(RuleCount) const XDP_RULE *Rules,
+    _In_ UINT32 RuleCount
+    )
+{
+    HRESULT Result;
+    XDP_PERSISTED_PROGRAM *Program = NULL;
+    SIZE_T ProgramSize;
+    LSTATUS Error;
+    const XDP_CREATE_PROGRAM_FLAGS ValidFlags =
+        XDP_CREATE_PROGRAM_FLAG_GENERIC |
+        XDP_CREATE_PROGRAM_FLAG_NATIVE |
+        XDP_CREATE_PROGRAM_FLAG_RULE_COUNTERS;
+
+    if ((Flags & ~ValidFlags) || RuleCount == 0 ||
+        RuleCount > (MAXDWORD - sizeof(*Program)) / sizeof(*Rules)) {
+        Result = E_INVALIDARG;
+        goto Exit;
+    }
+
+    ProgramSize = sizeof(*Program) + (SIZE_T)RuleCount * sizeof(*Rules);
+    Program = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, ProgramSize);
+    if (Program == NULL) {
+        Result = E_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    Program->Version = XDP_PERSISTED_PROGRAM_VERSION;
+    Program->IfIndex = IfIndex;
+    Program->HookId = *HookId;
+    Program->Flags = Flags;
+    Program->RuleCount = RuleCount;
+    CopyMemory(Program + 1, Rules, RuleCount * sizeof(*Rules));
+
+    Error =
+        RegSetKeyValueW(
+            HKEY_LOCAL_MACHINE, XDP_PERSISTED_PROGRAMS_KEY, Name, REG_BINARY, Program,
+            (DWORD)ProgramSize);
+    Result = HRESULT_FROM_WIN32(Error);
+
+Exit:
+
+    if (Program != NULL) {
+        HeapFree(GetProcessHeap(), 0, Program);
+    }
+
+    return Result;
+}
+
+HRESULT
+XdpDeletePersistedProgram(
+    _In_z_ const WCHAR *Name
+    )
+{
+    return
+        HRESULT_FROM_WIN32(
+            RegDeleteKeyValueW(HKEY_LOCAL_MACHINE, XDP_PERSISTED_PROGRAMS_KEY, Name));
+}
+
 BOOL
 WINAPI
 DllMain(
@@ -4,6 +4,7 @@
 //
 
 #include <windows.h>
+#include <pdh.h>
 #include <setupapi.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,11 +18,21 @@ Usage(
     )
 {
     fprintf(stderr,
-        "Usage: xdpcfg.exe <SetDeviceSddl> [OPTIONS ...]\n"
+        "Usage: xdpcfg.exe <SetDeviceSddl|SetTuning|Top> [OPTIONS ...]\n"
         "\n"
         "OPTIONS:\n"
         "\n"
-        "    SetDeviceSddl <SDDL>\n");
+        "    SetDeviceSddl <SDDL>\n"
+        "    SetTuning <IfIndex> <Parameter>=<Value> [<Parameter>=<Value> ...]\n"
+        "    Top <IfIndex> [IntervalMs] [Samples]\n"
+        "        Prints per-queue and per-socket rates every IntervalMs\n"
+        "        (default 1000) until Samples (default 0: unlimited) are printed\n"
+        "\n"
+        "TUNING PARAMETERS:\n"
+        "\n"
+        "    RxCloneCacheLimit    Generic RX forwarding clone cache limit (0-4096)\n"
+        "    EcBudget             Generic execution context poll budget (1-65536)\n"
+        "    TxInspectBatchSize   Generic TX inspection batch size (1-1024)\n");
     exit(EXIT_FAILURE);
 }
 
@@ -54,6 +65,477 @@ SetDeviceSddl(
     return EXIT_SUCCESS;
 }
 
+static const struct {
+    const WCHAR *Name;
+    XDP_TUNING_PARAMETER Parameter;
+} TuningParameters[] = {
+    { L"RxCloneCacheLimit", XDP_TUNING_PARAMETER_GENERIC_RX_CLONE_CACHE_LIMIT },
+    { L"EcBudget", XDP_TUNING_PARAMETER_GENERIC_EC_BUDGET },
+    { L"TxInspectBatchSize", XDP_TUNING_PARAMETER_GENERIC_TX_INSPECT_BATCH_SIZE },
+};
+
+static
+BOOLEAN
+ParseTuningSetting(
+    _In_ WCHAR *Arg,
+    _Out_ XDP_TUNING_SETTING *Setting
+    )
+{
+    WCHAR *Value;
+    WCHAR *End;
+    ULONG Number;
+
+    Value = wcschr(Arg, L'=');
+    if (Value == NULL) {
+        return FALSE;
+    }
+    *Value++ = UNICODE_NULL;
+
+    Number = wcstoul(Value, &End, 0);
+    if (End == Value || *End != UNICODE_NULL) {
+        return FALSE;
+    }
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(TuningParameters); Index++) {
+        if (!_wcsicmp(Arg, TuningParameters[Index].Name)) {
+            Setting->Parameter = TuningParameters[Index].Parameter;
+            Setting->Value = Number;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static
+INT
+SetTuning(
+    _In_ INT ArgC,
+    _In_ WCHAR **ArgV
+    )
+{
+    INT ExitCode = EXIT_FAILURE;
+    HRESULT Result;
+    XDP_LOAD_API_CONTEXT XdpLoadApiContext = NULL;
+    const XDP_API_TABLE *XdpApi = NULL;
+    XDP_INTERFACE_SET_TUNING_FN *XdpInterfaceSetTuning;
+    HANDLE InterfaceHandle = NULL;
+    XDP_TUNING_SETTING *Settings = NULL;
+    UINT32 SettingCount;
+    UINT32 IfIndex;
+
+    if (ArgC < 4) {
+        Usage();
+    }
+
+    IfIndex = wcstoul(ArgV[2], NULL, 0);
+    SettingCount = ArgC - 3;
+
+    Settings = calloc(SettingCount, sizeof(*Settings));
+    if (Settings == NULL) {
+        fprintf(stderr, "Failed to allocate tuning settings\n");
+        goto Exit;
+    }
+
+    for (UINT32 Index = 0; Index < SettingCount; Index++) {
+        if (!ParseTuningSetting(ArgV[3 + Index], &Settings[Index])) {
+            Usage();
+        }
+    }
+
+    Result = XdpLoadApi(XDP_API_VERSION_1, &XdpLoadApiContext, &XdpApi);
+    if (FAILED(Result)) {
+        fprintf(stderr, "XdpLoadApi failed: 0x%x\n", Result);
+        goto Exit;
+    }
+
+    XdpInterfaceSetTuning =
+        (XDP_INTERFACE_SET_TUNING_FN *)XdpApi->XdpGetRoutine(XDP_INTERFACE_SET_TUNING_FN_NAME);
+    if (XdpInterfaceSetTuning == NULL) {
+        fprintf(stderr, "XdpGetRoutine(%s) failed\n", XDP_INTERFACE_SET_TUNING_FN_NAME);
+        goto Exit;
+    }
+
+    Result = XdpApi->XdpInterfaceOpen(IfIndex, &InterfaceHandle);
+    if (FAILED(Result)) {
+        fprintf(stderr, "XdpInterfaceOpen failed: 0x%x\n", Result);
+        goto Exit;
+    }
+
+    Result = XdpInterfaceSetTuning(InterfaceHandle, Settings, SettingCount);
+    if (FAILED(Result)) {
+        fprintf(stderr, "XdpInterfaceSetTuning failed: 0x%x\n", Result);
+        goto Exit;
+    }
+
+    ExitCode = EXIT_SUCCESS;
+
+Exit:
+
+    if (InterfaceHandle != NULL) {
+        CloseHandle(InterfaceHandle);
+    }
+    if (XdpApi != NULL) {
+        XdpUnloadApi(XdpLoadApiContext, XdpApi);
+    }
+    if (Settings != NULL) {
+        free(Settings);
+    }
+
+    return ExitCode;
+}
+
+//
+// The live monitor samples the XDP performance counter sets and prints the
+// per-second rate of each counter for every instance of the interface.
+//
+
+typedef struct _TOP_COLUMN {
+    const WCHAR *CounterName;
+    const CHAR *Title;
+
+    //
+    // Gauges are printed as sampled; all other counters as per-second rates.
+    //
+    BOOLEAN Gauge;
+} TOP_COLUMN;
+
+typedef struct _TOP_SAMPLE {
+    PDH_RAW_COUNTER_ITEM_W *Items;
+    DWORD ItemCount;
+    DWORD BufferSize;
+} TOP_SAMPLE;
+
+#define TOP_MAX_COLUMNS 8
+
+typedef struct _TOP_TABLE {
+    const WCHAR *CounterSetName;
+    const CHAR *Title;
+    UINT32 ColumnCount;
+    TOP_COLUMN Columns[TOP_MAX_COLUMNS];
+
+    //
+    // For RX inspection tables, the first four columns are the passed,
+    // dropped, redirected and forwarded frame counts, which are summed into
+    // the total frame rate and redirect percentage.
+    //
+    BOOLEAN InspectionSummary;
+
+    PDH_HCOUNTER Counters[TOP_MAX_COLUMNS];
+    TOP_SAMPLE Current[TOP_MAX_COLUMNS];
+    TOP_SAMPLE Previous[TOP_MAX_COLUMNS];
+} TOP_TABLE;
+
+static TOP_TABLE TopTables[] = {
+    {
+        L"XDP Receive Queue", "RX queues", 8,
+        {
+            { L"Inspection Frames Passed", "Pass/s" },
+            { L"Inspection Frames Dropped", "Drop/s" },
+            { L"Inspection Frames Redirected", "Redir/s" },
+            { L"Inspection Frames Forwarded", "Fwd/s" },
+            { L"Inspection Drops Rule", "DropRule/s" },
+            { L"Inspection Drops eBPF Failure", "DropBpf/s" },
+            { L"AF_XDP Drops Fill Ring Empty", "DropFill/s" },
+            { L"AF_XDP Drops RX Ring Full", "DropRx/s" },
+        },
+        TRUE,
+    },
+    {
+        L"XDP LWF Receive Queue", "Generic RX queues", 5,
+        {
+            { L"Forwarding Failures", "FwdFail/s" },
+            { L"Forwarding Low Resources", "FwdLowRes/s" },
+            { L"Low Resources Frames", "LowRes/s" },
+            { L"Mapping Failures", "MapFail/s" },
+            { L"TX Inspect EC Budget Exhausted", "TxInspBudget/s" },
+        },
+    },
+    {
+        L"XDP Transmit Queue", "TX queues", 3,
+        {
+            { L"Injection Batches", "Batches/s" },
+            { L"AF_XDP Invalid Descriptors", "Invalid/s" },
+            { L"Queue Depth", "Depth", TRUE },
+        },
+    },
+    {
+        L"XDP LWF Transmit Queue", "Generic TX queues", 5,
+        {
+            { L"Inline Frames", "InlineFrames/s" },
+            { L"Inline Polls", "InlinePolls/s" },
+            { L"EC Polls", "EcPolls/s" },
+            { L"Frames Dropped (NDIS Pause)", "DropPause/s" },
+            { L"Frames Dropped (NIC Failure)", "DropNic/s" },
+        },
+    },
+    {
+        L"XDP Socket", "Sockets", 6,
+        {
+            { L"RX Frames", "RxFrames/s" },
+            { L"RX Dropped", "RxDrop/s" },
+            { L"RX Fill Ring Empty", "FillEmpty/s" },
+            { L"RX Ring Full", "RxFull/s" },
+            { L"TX Frames", "TxFrames/s" },
+            { L"TX Invalid Descriptors", "TxInvalid/s" },
+        },
+    },
+};
+
+static
+BOOLEAN
+TopCollectSample(
+    _In_ PDH_HCOUNTER Counter,
+    _Inout_ TOP_SAMPLE *Sample
+    )
+{
+    PDH_STATUS Status;
+    DWORD BufferSize;
+
+    for (;;) {
+        BufferSize = Sample->BufferSize;
+        Status = PdhGetRawCounterArrayW(Counter, &BufferSize, &Sample->ItemCount, Sample->Items);
+        if (Status != PDH_MORE_DATA) {
+            break;
+        }
+
+        free(Sample->Items);
+        Sample->Items = malloc(BufferSize);
+        Sample->BufferSize = (Sample->Items != NULL) ? BufferSize : 0;
+        if (Sample->Items == NULL) {
+            fprintf(stderr, "Failed to allocate counter sample\n");
+            return FALSE;
+        }
+    }
+
+    if (Status != ERROR_SUCCESS) {
+        //
+        // The counter set has no instances, e.g. no sockets are bound.
+        //
+        Sample->ItemCount = 0;
+    }
+
+    return TRUE;
+}
+
+static
+BOOLEAN
+TopFindValue(
+    _In_ const TOP_SAMPLE *Sample,
+    _In_ const WCHAR *InstanceName,
+    _Out_ LONGLONG *Value
+    )
+{
+    for (DWORD Index = 0; Index < Sample->ItemCount; Index++) {
+        if (!wcscmp(Sample->Items[Index].szName, InstanceName)) {
+            *Value = Sample->Items[Index].RawValue.FirstValue;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static
+VOID
+TopPrintTable(
+    _In_ const TOP_TABLE *Table,
+    _In_ const WCHAR *InstancePrefix,
+    _In_ double Seconds
+    )
+{
+    const TOP_SAMPLE *Instances = &Table->Current[0];
+
+    printf("%s\n%-24s", Table->Title, "Instance");
+    if (Table->InspectionSummary) {
+        printf(" %14s %8s", "Frames/s", "Redir%");
+    }
+    for (UINT32 Column = 0; Column < Table->ColumnCount; Column++) {
+        printf(" %14s", Table->Columns[Column].Title);
+    }
+    printf("\n");
+
+    for (DWORD Index = 0; Index < Instances->ItemCount; Index++) {
+        const WCHAR *InstanceName = Instances->Items[Index].szName;
+        double Rates[TOP_MAX_COLUMNS];
+
+        if (wcsncmp(InstanceName, InstancePrefix, wcslen(InstancePrefix))) {
+            continue;
+        }
+
+        for (UINT32 Column = 0; Column < Table->ColumnCount; Column++) {
+            LONGLONG Current = 0;
+            LONGLONG Previous;
+
+            TopFindValue(&Table->Current[Column], InstanceName, &Current);
+
+            if (Table->Columns[Column].Gauge) {
+                Rates[Column] = (double)Current;
+            } else if (TopFindValue(&Table->Previous[Column], InstanceName, &Previous) &&
+                Current >= Previous) {
+                Rates[Column] = (Current - Previous) / Seconds;
+            } else {
+                //
+                // The instance is new since the last sample.
+                //
+                Rates[Column] = 0;
+            }
+        }
+
+        printf("%-24ls", InstanceName + wcslen(InstancePrefix));
+        if (Table->InspectionSummary) {
+            double Total = Rates[0] + Rates[1] + Rates[2] + Rates[3];
+            printf(" %14.0f %7.1f%%", Total, (Total > 0) ? Rates[2] * 100 / Total : 0);
+        }
+        for (UINT32 Column = 0; Column < Table->ColumnCount; Column++) {
+            printf(" %14.0f", Rates[Column]);
+        }
+        printf("\n");
+    }
+
+    printf("\n");
+}
+
+static
+INT
+Top(
+    _In_ INT ArgC,
+    _In_ WCHAR **ArgV
+    )
+{
+    INT ExitCode = EXIT_FAILURE;
+    PDH_STATUS Status;
+    PDH_HQUERY Query = NULL;
+    WCHAR InstancePrefix[32];
+    WCHAR CounterPath[256];
+    UINT32 IfIndex;
+    UINT32 IntervalMs = 1000;
+    UINT32 SampleCount = 0;
+    LARGE_INTEGER Frequency;
+    LARGE_INTEGER LastTime;
+
+    if (ArgC < 3) {
+        Usage();
+    }
+
+    IfIndex = wcstoul(ArgV[2], NULL, 0);
+    if (ArgC > 3) {
+        IntervalMs = wcstoul(ArgV[3], NULL, 0);
+    }
+    if (ArgC > 4) {
+        SampleCount = wcstoul(ArgV[4], NULL, 0);
+    }
+    if (IntervalMs == 0) {
+        Usage();
+    }
+
+    //
+    // Every queue and socket instance name starts with its interface index.
+    //
+    swprintf_s(InstancePrefix, RTL_NUMBER_OF(InstancePrefix), L"if_%u_", IfIndex);
+
+    Status = PdhOpenQueryW(NULL, 0, &Query);
+    if (Status != ERROR_SUCCESS) {
+        fprintf(stderr, "PdhOpenQueryW failed: 0x%x\n", Status);
+        goto Exit;
+    }
+
+    for (UINT32 TableIndex = 0; TableIndex < RTL_NUMBER_OF(TopTables); TableIndex++) {
+        TOP_TABLE *Table = &TopTables[TableIndex];
+
+        for (UINT32 Column = 0; Column < Table->ColumnCount; Column++) {
+            swprintf_s(
+                CounterPath, RTL_NUMBER_OF(CounterPath), L"\\%ls(*)\\%ls",
+                Table->CounterSetName, Table->Columns[Column].CounterName);
+
+            Status = PdhAddEnglishCounterW(Query, CounterPath, 0, &Table->Counters[Column]);
+            if (Status != ERROR_SUCCESS) {
+                fprintf(stderr, "PdhAddEnglishCounterW(%ls) failed: 0x%x\n", CounterPath, Status);
+                goto Exit;
+            }
+        }
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&LastTime);
+
+    Status = PdhCollectQueryData(Query);
+    if (Status != ERROR_SUCCESS) {
+        fprintf(stderr, "PdhCollectQueryData failed: 0x%x\n", Status);
+        goto Exit;
+    }
+
+    for (UINT32 TableIndex = 0; TableIndex < RTL_NUMBER_OF(TopTables); TableIndex++) {
+        TOP_TABLE *Table = &TopTables[TableIndex];
+
+        for (UINT32 Column = 0; Column < Table->ColumnCount; Column++) {
+            if (!TopCollectSample(Table->Counters[Column], &Table->Current[Column])) {
+                goto Exit;
+            }
+        }
+    }
+
+    for (UINT32 Sample = 0; SampleCount == 0 || Sample < SampleCount; Sample++) {
+        LARGE_INTEGER Now;
+        SYSTEMTIME Time;
+        double Seconds;
+
+        Sleep(IntervalMs);
+
+        Status = PdhCollectQueryData(Query);
+        if (Status != ERROR_SUCCESS) {
+            fprintf(stderr, "PdhCollectQueryData failed: 0x%x\n", Status);
+            goto Exit;
+        }
+
+        QueryPerformanceCounter(&Now);
+        Seconds = (double)(Now.QuadPart - LastTime.QuadPart) / Frequency.QuadPart;
+        LastTime = Now;
+
+        GetLocalTime(&Time);
+        printf(
+            "IfIndex %u at %02u:%02u:%02u.%03u\n\n", IfIndex,
+            Time.wHour, Time.wMinute, Time.wSecond, Time.wMilliseconds);
+
+        for (UINT32 TableIndex = 0; TableIndex < RTL_NUMBER_OF(TopTables); TableIndex++) {
+            TOP_TABLE *Table = &TopTables[TableIndex];
+
+            for (UINT32 Column = 0; Column < Table->ColumnCount; Column++) {
+                TOP_SAMPLE Swap = Table->Previous[Column];
+
+                Table->Previous[Column] = Table->Current[Column];
+                Table->Current[Column] = Swap;
+
+                if (!TopCollectSample(Table->Counters[Column], &Table->Current[Column])) {
+                    goto Exit;
+                }
+            }
+
+            TopPrintTable(Table, InstancePrefix, Seconds);
+        }
+
+        fflush(stdout);
+    }
+
+    ExitCode = EXIT_SUCCESS;
+
+Exit:
+
+    for (UINT32 TableIndex = 0; TableIndex < RTL_NUMBER_OF(TopTables); TableIndex++) {
+        TOP_TABLE *Table = &TopTables[TableIndex];
+
+        for (UINT32 Column = 0; Column < Table->ColumnCount; Column++) {
+            free(Table->Current[Column].Items);
+            free(Table->Previous[Column].Items);
+        }
+    }
+    if (Query != NULL) {
+        PdhCloseQuery(Query);
+    }
+
+    return ExitCode;
+}
+
 INT
 __cdecl
 wmain(
@@ -67,6 +549,10 @@ wmain(
 
     if (!_wcsicmp(ArgV[1], L"SetDeviceSddl")) {
         return SetDeviceSddl(ArgC, ArgV);
+    } else if (!_wcsicmp(ArgV[1], L"SetTuning")) {
+        return SetTuning(ArgC, ArgV);
+    } else if (!_wcsicmp(ArgV[1], L"Top")) {
+        return Top(ArgC, ArgV);
     } else {
         Usage();
     }
@@ -16,6 +16,8 @@ namespace XdpEtw.DataModel.ETW
         Rx              = 0x0000000000000002ul,
         Xsk             = 0x0000000000000004ul,
         Generic         = 0x0000000000000008ul,
+        Ec              = 0x0000000000000010ul,
+        Ebpf            = 0x0000000000000020ul,
     }
 
     internal enum XdpEtwEventOpcode : byte
@@ -23,6 +25,8 @@ namespace XdpEtw.DataModel.ETW
         Xsk             = 11,
         GenericTxQueue  = 12,
         GenericRxFilter = 13,
+        ExecutionContext = 14,
+        RxQueue         = 15,
     }
 
     internal static class XdpEtwEvent
@@ -43,6 +47,30 @@ namespace XdpEtw.DataModel.ETW
 
             switch (id)
             {
+                case XdpEventId.XskNotifyPokeStart:
+                case XdpEventId.XskNotifyPokeStop:
+                    return new XdpXskNotifyPokeEvent(id, timestamp, processor, processId, threadId, pointerSize, data.ReadPointer(), data.ReadUInt());
+                case XdpEventId.XskTxEnqueue:
+                    return new XdpXskTxEnqueueEvent(timestamp, processor, processId, threadId, pointerSize, data.ReadPointer(), data.ReadUInt(), data.ReadUInt());
+                case XdpEventId.GenericTxPostBatchStart:
+                case XdpEventId.GenericTxPostBatchStop:
+                    return new XdpBatchEvent(id, XdpObjectType.GenericTxQueue, timestamp, processor, processId, threadId, pointerSize, data.ReadPointer(), data.ReadULong(), 0);
+                case XdpEventId.GenericRxInspectStart:
+                case XdpEventId.GenericRxInspectStop:
+                    return new XdpEvent(id, XdpObjectType.GenericRxFilter, timestamp, processor, processId, threadId, pointerSize, data.ReadPointer());
+                case XdpEventId.XskRxPostBatch:
+                case XdpEventId.XskTxCompleteBatch:
+                    return new XdpBatchEvent(id, XdpObjectType.Xsk, timestamp, processor, processId, threadId, pointerSize, data.ReadPointer(), data.ReadUInt(), data.ReadUInt());
+                case XdpEventId.GenericTxCompleteBatch:
+                    return new XdpBatchEvent(id, XdpObjectType.GenericTxQueue, timestamp, processor, processId, threadId, pointerSize, data.ReadPointer(), 0, data.ReadULong());
+                case XdpEventId.EcStateChange:
+                    return new XdpEcStateChangeEvent(timestamp, processor, processId, threadId, pointerSize, data.ReadPointer(), (XdpEcState)data.ReadUInt());
+                case XdpEventId.XskNotifyStart:
+                    return new XdpXskNotifyEvent(id, timestamp, processor, processId, threadId, pointerSize, data.ReadPointer(), data.ReadPointer(), data.ReadUInt(), 0);
+                case XdpEventId.XskNotifyStop:
+                    return new XdpXskNotifyEvent(id, timestamp, processor, processId, threadId, pointerSize, data.ReadPointer(), data.ReadPointer(), data.ReadUInt(), data.ReadUInt());
+                case XdpEventId.XskNotifyAsyncComplete:
+                    return new XdpXskNotifyEvent(id, timestamp, processor, processId, threadId, pointerSize, data.ReadPointer(), data.ReadPointer(), 0, data.ReadUInt());
                 default:
                     return null;
             }
@@ -22,6 +22,8 @@ namespace XdpEtw.DataModel
         Xsk,
         GenericTxQueue,
         GenericRxFilter,
+        ExecutionContext,
+        RxQueue,
     }
 
     public enum XdpEventId : ushort
@@ -39,6 +41,14 @@ namespace XdpEtw.DataModel
         GenericRxInspectStart   = 11,
         GenericRxInspectStop    = 12,
         XskRxPostBatch          = 13,
+        GenericTxCompleteBatch  = 14,
+        XskTxCompleteBatch      = 15,
+        EcStateChange           = 16,
+        XskNotifyStart          = 17,
+        XskNotifyStop           = 18,
+        XskNotifyAsyncComplete  = 19,
+        EbpfProgramFailure      = 20,
+        RxDrop                  = 21,
     }
 
     //
@@ -92,6 +102,8 @@ namespace XdpEtw.DataModel
             " xsk",
             "gxtq",
             "gxrf",
+            "  ec",
+            " rxq",
         };
 
         internal XdpEvent(XdpEventId id, XdpObjectType objectType, Timestamp timestamp, ushort processor, uint processId, uint threadId, int pointerSize, ulong objectPointer = 0)
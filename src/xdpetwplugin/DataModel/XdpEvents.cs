@@ -0,0 +1,116 @@
+﻿//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+using Microsoft.Performance.SDK;
+
+#pragma warning disable CA1305 // Specify IFormatProvider
+
+namespace XdpEtw.DataModel
+{
+    //
+    // Matches XDP_EC_STATE in xdplwf.
+    //
+    public enum XdpEcState : uint
+    {
+        Idle,
+        CleanedUp,
+        PassiveWait,
+        PassiveWake,
+        PassiveQueue,
+        Poll,
+        DpcQueueMigrate,
+        Passive,
+        DpcQueue,
+        DpcArm,
+        DpcDequeue,
+        Disarm,
+        EnterInline,
+        ExitInline,
+    }
+
+    public class XdpXskNotifyPokeEvent : XdpEvent
+    {
+        public uint Flags { get; }
+
+        public override string PayloadString => string.Format("[{0}] Flags={1:X}", EventId, Flags);
+
+        internal XdpXskNotifyPokeEvent(XdpEventId id, Timestamp timestamp, ushort processor, uint processId, uint threadId, int pointerSize, ulong xsk, uint flags) :
+            base(id, XdpObjectType.Xsk, timestamp, processor, processId, threadId, pointerSize, xsk)
+        {
+            Flags = flags;
+        }
+    }
+
+    public class XdpXskTxEnqueueEvent : XdpEvent
+    {
+        public uint XskTxIndex { get; }
+
+        public uint XdpTxIndex { get; }
+
+        public override string PayloadString =>
+            string.Format("[{0}] XskTxIndex={1:X} XdpTxIndex={2:X}", EventId, XskTxIndex, XdpTxIndex);
+
+        internal XdpXskTxEnqueueEvent(Timestamp timestamp, ushort processor, uint processId, uint threadId, int pointerSize, ulong xsk, uint xskTxIndex, uint xdpTxIndex) :
+            base(XdpEventId.XskTxEnqueue, XdpObjectType.Xsk, timestamp, processor, processId, threadId, pointerSize, xsk)
+        {
+            XskTxIndex = xskTxIndex;
+            XdpTxIndex = xdpTxIndex;
+        }
+    }
+
+    //
+    // A batch posted or completed by a queue or socket. Index is the ring or
+    // NBL batch index of the first element, if the event carries one.
+    //
+    public class XdpBatchEvent : XdpEvent
+    {
+        public ulong Index { get; }
+
+        public ulong BatchSize { get; }
+
+        public override string PayloadString =>
+            string.Format("[{0}] Index={1:X} BatchSize={2}", EventId, Index, BatchSize);
+
+        internal XdpBatchEvent(XdpEventId id, XdpObjectType objectType, Timestamp timestamp, ushort processor, uint processId, uint threadId, int pointerSize, ulong objectPointer, ulong index, ulong batchSize) :
+            base(id, objectType, timestamp, processor, processId, threadId, pointerSize, objectPointer)
+        {
+            Index = index;
+            BatchSize = batchSize;
+        }
+    }
+
+    public class XdpEcStateChangeEvent : XdpEvent
+    {
+        public XdpEcState NewState { get; }
+
+        public override string PayloadString => string.Format("[{0}] NewState={1}", EventId, NewState);
+
+        internal XdpEcStateChangeEvent(Timestamp timestamp, ushort processor, uint processId, uint threadId, int pointerSize, ulong ec, XdpEcState newState) :
+            base(XdpEventId.EcStateChange, XdpObjectType.ExecutionContext, timestamp, processor, processId, threadId, pointerSize, ec)
+        {
+            NewState = newState;
+        }
+    }
+
+    public class XdpXskNotifyEvent : XdpEvent
+    {
+        public ulong Irp { get; }
+
+        public uint Flags { get; }
+
+        public uint Status { get; }
+
+        public override string PayloadString =>
+            string.Format("[{0}] Irp={1:X} Flags={2:X} Status={3:X}", EventId, Irp, Flags, Status);
+
+        internal XdpXskNotifyEvent(XdpEventId id, Timestamp timestamp, ushort processor, uint processId, uint threadId, int pointerSize, ulong xsk, ulong irp, uint flags, uint status) :
+            base(id, XdpObjectType.Xsk, timestamp, processor, processId, threadId, pointerSize, xsk)
+        {
+            Irp = irp;
+            Flags = flags;
+            Status = status;
+        }
+    }
+}
@@ -0,0 +1,115 @@
+﻿//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+using System;
+using System.Collections.Generic;
+using System.Runtime.InteropServices;
+
+#pragma warning disable CA1305 // Specify IFormatProvider
+
+namespace XdpEtw.DataModel
+{
+    public enum XdpFlightRecordEvent : byte
+    {
+        RxBatch = 1,
+        RxDrop  = 2,
+        TxFlush = 3,
+    }
+
+    //
+    // A datapath flight recorder event. Matches XDP_FLIGHT_RECORD.
+    //
+    [StructLayout(LayoutKind.Sequential, Pack = 1)]
+    public readonly struct XdpFlightRecord
+    {
+        public readonly ulong Timestamp;
+        public readonly uint IfIndex;
+        public readonly uint QueueId;
+        public readonly uint ProducerIndex;
+        public readonly uint ConsumerIndex;
+        public readonly uint Count;
+        public readonly ushort Processor;
+        public readonly XdpFlightRecordEvent Event;
+        public readonly byte Action;
+
+        public override string ToString()
+        {
+            return string.Format("[{0,2}][{1}][if {2} q {3}] {4} Count={5} Producer={6} Consumer={7} Action={8}",
+                Processor, Timestamp, IfIndex, QueueId, Event, Count, ProducerIndex, ConsumerIndex, Action);
+        }
+    }
+
+    //
+    // Decodes the flight recorder output of XdpFlightRecorderGet and the
+    // flight recorder secondary crash dump data.
+    //
+    public static class XdpFlightRecorder
+    {
+        //
+        // The secondary dump data GUID of the flight recorder.
+        //
+        public static readonly Guid DumpGuid = new Guid("d109fbcd-dd47-4cbc-b6e9-f7179198a5b3");
+
+        private const uint DumpSignature = 0x72466458; // 'rFdX'
+
+        [StructLayout(LayoutKind.Sequential, Pack = 1)]
+        private readonly struct DumpHeader
+        {
+            public readonly uint Signature;
+            public readonly uint HeaderSize;
+            public readonly uint RecordSize;
+            public readonly uint RecordOffset;
+            public readonly uint RecordCount;
+            public readonly uint ProcessorCount;
+            public readonly uint ProcessorStride;
+        }
+
+        //
+        // Decodes the records returned by XdpFlightRecorderGet.
+        //
+        public static IList<XdpFlightRecord> ParseRecords(ReadOnlySpan<byte> data)
+        {
+            return MemoryMarshal.Cast<byte, XdpFlightRecord>(data).ToArray();
+        }
+
+        //
+        // Decodes flight recorder dump data, returning records oldest first within
+        // each processor. Truncated dumps yield the records of complete blocks.
+        //
+        public static IList<XdpFlightRecord> ParseDump(ReadOnlySpan<byte> data)
+        {
+            var records = new List<XdpFlightRecord>();
+            var header = MemoryMarshal.Read<DumpHeader>(data);
+
+            if (header.Signature != DumpSignature || header.RecordSize != Marshal.SizeOf<XdpFlightRecord>())
+            {
+                throw new FormatException("Invalid XDP flight recorder dump header");
+            }
+
+            for (uint processor = 0; processor < header.ProcessorCount; processor++)
+            {
+                long blockOffset = header.HeaderSize + (long)processor * header.ProcessorStride;
+                if (blockOffset + header.ProcessorStride > data.Length)
+                {
+                    break;
+                }
+
+                var block = data.Slice((int)blockOffset, (int)header.ProcessorStride);
+                uint nextIndex = MemoryMarshal.Read<uint>(block);
+                uint count = Math.Min(nextIndex, header.RecordCount);
+                var blockRecords =
+                    MemoryMarshal.Cast<byte, XdpFlightRecord>(
+                        block.Slice((int)header.RecordOffset, (int)(header.RecordCount * header.RecordSize)));
+
+                for (uint index = nextIndex - count; index != nextIndex; index++)
+                {
+                    records.Add(blockRecords[(int)(index & (header.RecordCount - 1))]);
+                }
+            }
+
+            return records;
+        }
+    }
+}
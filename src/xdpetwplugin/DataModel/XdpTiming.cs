@@ -0,0 +1,252 @@
+﻿//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+using System.Collections.Generic;
+using Microsoft.Performance.SDK;
+
+namespace XdpEtw.DataModel
+{
+    public enum XdpPollType
+    {
+        EcPoll,
+        GenericRxInspect,
+        GenericTxPost,
+        XskPoke,
+    }
+
+    public enum XdpBatchType
+    {
+        XskRxPost,
+        XskTxComplete,
+        GenericTxComplete,
+    }
+
+    //
+    // A span of time a queue, execution context or socket spent processing.
+    //
+    public readonly struct XdpPoll
+    {
+        public XdpPollType Type { get; }
+        public XdpObjectType ObjectType { get; }
+        public ulong ObjectPointer { get; }
+        public ushort Processor { get; }
+        public Timestamp TimeStamp { get; }
+        public TimestampDelta Duration { get; }
+
+        internal XdpPoll(XdpPollType type, XdpEvent start, Timestamp stop)
+        {
+            Type = type;
+            ObjectType = start.ObjectType;
+            ObjectPointer = start.ObjectPointer;
+            Processor = start.Processor;
+            TimeStamp = start.TimeStamp;
+            Duration = new TimestampDelta(stop.ToNanoseconds - start.TimeStamp.ToNanoseconds);
+        }
+    }
+
+    public readonly struct XdpBatch
+    {
+        public XdpBatchType Type { get; }
+        public XdpObjectType ObjectType { get; }
+        public ulong ObjectPointer { get; }
+        public ushort Processor { get; }
+        public Timestamp TimeStamp { get; }
+        public ulong BatchSize { get; }
+
+        internal XdpBatch(XdpBatchType type, XdpBatchEvent evt)
+        {
+            Type = type;
+            ObjectType = evt.ObjectType;
+            ObjectPointer = evt.ObjectPointer;
+            Processor = evt.Processor;
+            TimeStamp = evt.TimeStamp;
+            BatchSize = evt.BatchSize;
+        }
+    }
+
+    //
+    // The time from an XSK notify request to its completion. Pended requests
+    // complete when the socket is woken up.
+    //
+    public readonly struct XdpNotify
+    {
+        public ulong Xsk { get; }
+        public ulong Irp { get; }
+        public uint InFlags { get; }
+        public uint Status { get; }
+        public bool Pended { get; }
+        public ushort Processor { get; }
+        public ushort CompletionProcessor { get; }
+        public Timestamp TimeStamp { get; }
+        public TimestampDelta Latency { get; }
+
+        internal XdpNotify(XdpXskNotifyEvent start, XdpXskNotifyEvent stop, bool pended)
+        {
+            Xsk = start.ObjectPointer;
+            Irp = start.Irp;
+            InFlags = start.Flags;
+            Status = stop.Status;
+            Pended = pended;
+            Processor = start.Processor;
+            CompletionProcessor = stop.Processor;
+            TimeStamp = start.TimeStamp;
+            Latency = new TimestampDelta(stop.TimeStamp.ToNanoseconds - start.TimeStamp.ToNanoseconds);
+        }
+    }
+
+    //
+    // The time from an XSK TX descriptor being consumed by XDP to its
+    // completion being posted to the socket.
+    //
+    public readonly struct XdpTxCompletion
+    {
+        public ulong Xsk { get; }
+        public uint XskTxIndex { get; }
+        public ushort Processor { get; }
+        public ushort CompletionProcessor { get; }
+        public Timestamp TimeStamp { get; }
+        public TimestampDelta Latency { get; }
+
+        internal XdpTxCompletion(XdpXskTxEnqueueEvent enqueue, XdpBatchEvent complete)
+        {
+            Xsk = enqueue.ObjectPointer;
+            XskTxIndex = enqueue.XskTxIndex;
+            Processor = enqueue.Processor;
+            CompletionProcessor = complete.Processor;
+            TimeStamp = enqueue.TimeStamp;
+            Latency = new TimestampDelta(complete.TimeStamp.ToNanoseconds - enqueue.TimeStamp.ToNanoseconds);
+        }
+    }
+
+    //
+    // Computes datapath timing from a time-ordered stream of events.
+    //
+    public sealed class XdpTimingState
+    {
+        private const uint StatusPending = 0x103;
+
+        public List<XdpPoll> Polls { get; } = new List<XdpPoll>();
+
+        public List<XdpBatch> Batches { get; } = new List<XdpBatch>();
+
+        public List<XdpNotify> Notifies { get; } = new List<XdpNotify>();
+
+        public List<XdpTxCompletion> TxCompletions { get; } = new List<XdpTxCompletion>();
+
+        private readonly Dictionary<(XdpObjectType, ulong), XdpEvent> pendingPolls = new Dictionary<(XdpObjectType, ulong), XdpEvent>();
+
+        private readonly Dictionary<ulong, XdpXskNotifyEvent> pendingNotifies = new Dictionary<ulong, XdpXskNotifyEvent>();
+
+        private readonly Dictionary<ulong, XdpXskNotifyEvent> pendedNotifies = new Dictionary<ulong, XdpXskNotifyEvent>();
+
+        private readonly Dictionary<(ulong, uint), XdpXskTxEnqueueEvent> pendingTx = new Dictionary<(ulong, uint), XdpXskTxEnqueueEvent>();
+
+        public void AddEvent(XdpEvent evt)
+        {
+            switch (evt.EventId)
+            {
+                case XdpEventId.EcStateChange:
+                    //
+                    // A poll lasts until the execution context's next state change.
+                    //
+                    StopPoll(XdpPollType.EcPoll, evt);
+                    if (((XdpEcStateChangeEvent)evt).NewState == XdpEcState.Poll)
+                    {
+                        StartPoll(evt);
+                    }
+                    break;
+                case XdpEventId.GenericRxInspectStart:
+                case XdpEventId.GenericTxPostBatchStart:
+                case XdpEventId.XskNotifyPokeStart:
+                    StartPoll(evt);
+                    break;
+                case XdpEventId.GenericRxInspectStop:
+                    StopPoll(XdpPollType.GenericRxInspect, evt);
+                    break;
+                case XdpEventId.GenericTxPostBatchStop:
+                    StopPoll(XdpPollType.GenericTxPost, evt);
+                    break;
+                case XdpEventId.XskNotifyPokeStop:
+                    StopPoll(XdpPollType.XskPoke, evt);
+                    break;
+                case XdpEventId.XskRxPostBatch:
+                    Batches.Add(new XdpBatch(XdpBatchType.XskRxPost, (XdpBatchEvent)evt));
+                    break;
+                case XdpEventId.GenericTxCompleteBatch:
+                    Batches.Add(new XdpBatch(XdpBatchType.GenericTxComplete, (XdpBatchEvent)evt));
+                    break;
+                case XdpEventId.XskTxCompleteBatch:
+                    var complete = (XdpBatchEvent)evt;
+                    Batches.Add(new XdpBatch(XdpBatchType.XskTxComplete, complete));
+                    for (ulong i = 0; i < complete.BatchSize; i++)
+                    {
+                        var key = (complete.ObjectPointer, (uint)(complete.Index + i));
+                        if (pendingTx.TryGetValue(key, out var enqueue))
+                        {
+                            pendingTx.Remove(key);
+                            TxCompletions.Add(new XdpTxCompletion(enqueue, complete));
+                        }
+                    }
+                    break;
+                case XdpEventId.XskTxEnqueue:
+                    var tx = (XdpXskTxEnqueueEvent)evt;
+                    pendingTx[(tx.ObjectPointer, tx.XskTxIndex)] = tx;
+                    break;
+                case XdpEventId.XskNotifyStart:
+                    var notify = (XdpXskNotifyEvent)evt;
+                    pendingNotifies[notify.Irp] = notify;
+                    break;
+                case XdpEventId.XskNotifyStop:
+                    var stop = (XdpXskNotifyEvent)evt;
+                    if (pendingNotifies.TryGetValue(stop.Irp, out var start))
+                    {
+                        pendingNotifies.Remove(stop.Irp);
+                        if (stop.Status == StatusPending)
+                        {
+                            pendedNotifies[stop.Irp] = start;
+                        }
+                        else
+                        {
+                            Notifies.Add(new XdpNotify(start, stop, false));
+                        }
+                    }
+                    break;
+                case XdpEventId.XskNotifyAsyncComplete:
+                    var asyncComplete = (XdpXskNotifyEvent)evt;
+                    if (pendedNotifies.TryGetValue(asyncComplete.Irp, out var pended))
+                    {
+                        pendedNotifies.Remove(asyncComplete.Irp);
+                        Notifies.Add(new XdpNotify(pended, asyncComplete, true));
+                    }
+                    else if (pendingNotifies.TryGetValue(asyncComplete.Irp, out pended))
+                    {
+                        //
+                        // The wake raced with the request pending.
+                        //
+                        pendingNotifies.Remove(asyncComplete.Irp);
+                        Notifies.Add(new XdpNotify(pended, asyncComplete, true));
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        private void StartPoll(XdpEvent evt)
+        {
+            pendingPolls[(evt.ObjectType, evt.ObjectPointer)] = evt;
+        }
+
+        private void StopPoll(XdpPollType type, XdpEvent evt)
+        {
+            var key = (evt.ObjectType, evt.ObjectPointer);
+            if (pendingPolls.TryGetValue(key, out var start))
+            {
+                pendingPolls.Remove(key);
+                Polls.Add(new XdpPoll(type, start, evt.TimeStamp));
+            }
+        }
+    }
+}
@@ -0,0 +1,77 @@
+﻿//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using Microsoft.Performance.SDK.Extensibility;
+using Microsoft.Performance.SDK.Processing;
+using XdpEtw.DataModel;
+
+namespace XdpEtw.Tables
+{
+    [Table]
+    public sealed class XdpBatchTable
+    {
+        public static readonly TableDescriptor TableDescriptor = new TableDescriptor(
+            Guid.Parse("{cc17dc36-8abd-49b6-854d-95c2a60be5ba}"),
+            "XDP Batch Sizes",
+            "Sizes of XSK RX post and TX completion batches",
+            category: "XDP",
+            requiredDataCookers: new List<DataCookerPath> { XdpEventCooker.CookerPath });
+
+        private static readonly ColumnConfiguration BatchSize =
+            new ColumnConfiguration(
+                new ColumnMetadata(new Guid("{abb3e48e-d79b-4407-ab8f-e6436628e8e9}"), "Batch Size"),
+                new UIHints { AggregationMode = AggregationMode.Average });
+
+        public static bool IsDataAvailable(IDataExtensionRetrieval tableData)
+        {
+            var timing = XdpColumns.QueryTiming(tableData);
+            return timing != null && timing.Batches.Count > 0;
+        }
+
+        public static void BuildTable(ITableBuilder tableBuilder, IDataExtensionRetrieval tableData)
+        {
+            Debug.Assert(!(tableBuilder is null) && !(tableData is null));
+
+            var timing = XdpColumns.QueryTiming(tableData);
+            if (timing == null)
+            {
+                return;
+            }
+
+            var batches = timing.Batches;
+            var table = tableBuilder.SetRowCount(batches.Count);
+            var dataProjection = Projection.Index(batches);
+
+            table.AddColumn(XdpColumns.Type, dataProjection.Compose(x => x.Type));
+            table.AddColumn(XdpColumns.ObjectType, dataProjection.Compose(x => x.ObjectType));
+            table.AddColumn(XdpColumns.ObjectPointer, dataProjection.Compose(x => x.ObjectPointer));
+            table.AddColumn(XdpColumns.Processor, dataProjection.Compose(x => x.Processor));
+            table.AddColumn(XdpColumns.Count, Projection.Constant(1));
+            table.AddColumn(XdpColumns.Time, dataProjection.Compose(x => x.TimeStamp));
+            table.AddColumn(BatchSize, dataProjection.Compose(x => x.BatchSize));
+
+            var tableConfig = new TableConfiguration("Per Queue")
+            {
+                Columns = new[]
+                {
+                    XdpColumns.Type,
+                    XdpColumns.ObjectPointer,
+                    TableConfiguration.PivotColumn,
+                    XdpColumns.Processor,
+                    XdpColumns.Count,
+                    BatchSize,
+                    TableConfiguration.GraphColumn,
+                    XdpColumns.Time,
+                },
+            };
+            tableConfig.AddColumnRole(ColumnRole.StartTime, XdpColumns.Time);
+
+            tableBuilder.AddTableConfiguration(tableConfig).SetDefaultTableConfiguration(tableConfig);
+        }
+    }
+}
@@ -0,0 +1,71 @@
+﻿//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using Microsoft.Performance.SDK.Extensibility;
+using Microsoft.Performance.SDK.Processing;
+using XdpEtw.DataModel;
+
+namespace XdpEtw.Tables
+{
+    //
+    // Columns shared by the XDP timing tables.
+    //
+    internal static class XdpColumns
+    {
+        internal static readonly ColumnConfiguration Type =
+            new ColumnConfiguration(
+                new ColumnMetadata(new Guid("{9eebe858-e3d6-4162-a8b9-ee80165e2aba}"), "Type"),
+                new UIHints { AggregationMode = AggregationMode.UniqueCount });
+
+        internal static readonly ColumnConfiguration ObjectType =
+            new ColumnConfiguration(
+                new ColumnMetadata(new Guid("{5f355de5-c025-4c8b-90cc-6199942ed1e4}"), "Object Type"),
+                new UIHints { AggregationMode = AggregationMode.UniqueCount });
+
+        internal static readonly ColumnConfiguration ObjectPointer =
+            new ColumnConfiguration(
+                new ColumnMetadata(new Guid("{99a4f2ff-4d64-4749-a0d5-2c21d8ab5bb7}"), "Object"),
+                new UIHints { AggregationMode = AggregationMode.UniqueCount, CellFormat = "X" });
+
+        internal static readonly ColumnConfiguration Processor =
+            new ColumnConfiguration(
+                new ColumnMetadata(new Guid("{01828a38-8457-4dee-86a7-0075222bd6c7}"), "Processor"),
+                new UIHints { AggregationMode = AggregationMode.UniqueCount });
+
+        internal static readonly ColumnConfiguration CompletionProcessor =
+            new ColumnConfiguration(
+                new ColumnMetadata(new Guid("{9c883ea3-511a-48a5-834a-c048f27d37d3}"), "Completion Processor"),
+                new UIHints { AggregationMode = AggregationMode.UniqueCount });
+
+        internal static readonly ColumnConfiguration Time =
+            new ColumnConfiguration(
+                new ColumnMetadata(new Guid("{ab0ed62d-6884-4d78-b1f3-82fc946fe9f3}"), "Time"),
+                new UIHints { AggregationMode = AggregationMode.Max });
+
+        internal static readonly ColumnConfiguration Duration =
+            new ColumnConfiguration(
+                new ColumnMetadata(new Guid("{619a81f8-8fcc-4814-893b-da18e4740e60}"), "Duration"),
+                new UIHints { AggregationMode = AggregationMode.Sum });
+
+        internal static readonly ColumnConfiguration Latency =
+            new ColumnConfiguration(
+                new ColumnMetadata(new Guid("{d3b4b0f3-91d5-4a6a-9f33-b38800c33bb8}"), "Latency"),
+                new UIHints { AggregationMode = AggregationMode.Average });
+
+        internal static readonly ColumnConfiguration Count =
+            new ColumnConfiguration(
+                new ColumnMetadata(new Guid("{e7368c6a-2848-48c2-bb2a-3286609a3713}"), "Count"),
+                new UIHints { AggregationMode = AggregationMode.Count });
+
+        internal static XdpTimingState? QueryTiming(IDataExtensionRetrieval tableData)
+        {
+            Debug.Assert(!(tableData is null));
+            return tableData.QueryOutput<XdpTimingState>(new DataOutputPath(XdpEventCooker.CookerPath, "Timing"));
+        }
+    }
+}
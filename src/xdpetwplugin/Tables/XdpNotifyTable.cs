@@ -0,0 +1,99 @@
+﻿//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using Microsoft.Performance.SDK.Extensibility;
+using Microsoft.Performance.SDK.Processing;
+using XdpEtw.DataModel;
+
+namespace XdpEtw.Tables
+{
+    [Table]
+    public sealed class XdpNotifyTable
+    {
+        public static readonly TableDescriptor TableDescriptor = new TableDescriptor(
+            Guid.Parse("{4f8a9169-fbef-44b9-9f04-a7d790054601}"),
+            "XDP Socket Notify Latency",
+            "Time from each XSK notify request to its completion or wake",
+            category: "XDP",
+            requiredDataCookers: new List<DataCookerPath> { XdpEventCooker.CookerPath });
+
+        private static readonly ColumnConfiguration Irp =
+            new ColumnConfiguration(
+                new ColumnMetadata(new Guid("{8cfcf249-15c9-4083-98bf-0626ae0d3d68}"), "Irp"),
+                new UIHints { AggregationMode = AggregationMode.UniqueCount, CellFormat = "X" });
+
+        private static readonly ColumnConfiguration InFlags =
+            new ColumnConfiguration(
+                new ColumnMetadata(new Guid("{8a17e0a3-72da-444e-aa8e-500ee842c856}"), "In Flags"),
+                new UIHints { AggregationMode = AggregationMode.UniqueCount, CellFormat = "X" });
+
+        private static readonly ColumnConfiguration Pended =
+            new ColumnConfiguration(
+                new ColumnMetadata(new Guid("{fbbc4c49-7cdf-4e4a-97ab-40bdfc3870d9}"), "Pended"),
+                new UIHints { AggregationMode = AggregationMode.UniqueCount });
+
+        private static readonly ColumnConfiguration Status =
+            new ColumnConfiguration(
+                new ColumnMetadata(new Guid("{a4ba5257-37d0-49fc-a1c4-79fcf824f001}"), "Status"),
+                new UIHints { AggregationMode = AggregationMode.UniqueCount, CellFormat = "X" });
+
+        public static bool IsDataAvailable(IDataExtensionRetrieval tableData)
+        {
+            var timing = XdpColumns.QueryTiming(tableData);
+            return timing != null && timing.Notifies.Count > 0;
+        }
+
+        public static void BuildTable(ITableBuilder tableBuilder, IDataExtensionRetrieval tableData)
+        {
+            Debug.Assert(!(tableBuilder is null) && !(tableData is null));
+
+            var timing = XdpColumns.QueryTiming(tableData);
+            if (timing == null)
+            {
+                return;
+            }
+
+            var notifies = timing.Notifies;
+            var table = tableBuilder.SetRowCount(notifies.Count);
+            var dataProjection = Projection.Index(notifies);
+
+            table.AddColumn(XdpColumns.ObjectPointer, dataProjection.Compose(x => x.Xsk));
+            table.AddColumn(Irp, dataProjection.Compose(x => x.Irp));
+            table.AddColumn(InFlags, dataProjection.Compose(x => x.InFlags));
+            table.AddColumn(Pended, dataProjection.Compose(x => x.Pended));
+            table.AddColumn(Status, dataProjection.Compose(x => x.Status));
+            table.AddColumn(XdpColumns.Processor, dataProjection.Compose(x => x.Processor));
+            table.AddColumn(XdpColumns.CompletionProcessor, dataProjection.Compose(x => x.CompletionProcessor));
+            table.AddColumn(XdpColumns.Count, Projection.Constant(1));
+            table.AddColumn(XdpColumns.Time, dataProjection.Compose(x => x.TimeStamp));
+            table.AddColumn(XdpColumns.Latency, dataProjection.Compose(x => x.Latency));
+
+            var tableConfig = new TableConfiguration("Per Socket")
+            {
+                Columns = new[]
+                {
+                    XdpColumns.ObjectPointer,
+                    Pended,
+                    TableConfiguration.PivotColumn,
+                    XdpColumns.Processor,
+                    XdpColumns.CompletionProcessor,
+                    InFlags,
+                    Status,
+                    XdpColumns.Count,
+                    XdpColumns.Latency,
+                    TableConfiguration.GraphColumn,
+                    XdpColumns.Time,
+                },
+            };
+            tableConfig.AddColumnRole(ColumnRole.StartTime, XdpColumns.Time);
+            tableConfig.AddColumnRole(ColumnRole.Duration, XdpColumns.Latency);
+
+            tableBuilder.AddTableConfiguration(tableConfig).SetDefaultTableConfiguration(tableConfig);
+        }
+    }
+}
@@ -0,0 +1,73 @@
+﻿//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using Microsoft.Performance.SDK.Extensibility;
+using Microsoft.Performance.SDK.Processing;
+using XdpEtw.DataModel;
+
+namespace XdpEtw.Tables
+{
+    [Table]
+    public sealed class XdpPollTable
+    {
+        public static readonly TableDescriptor TableDescriptor = new TableDescriptor(
+            Guid.Parse("{11ddf50a-643c-49ed-8364-4cd0764b9692}"),
+            "XDP Poll Durations",
+            "Time spent in each execution context poll, RX inspection, TX post and XSK poke",
+            category: "XDP",
+            requiredDataCookers: new List<DataCookerPath> { XdpEventCooker.CookerPath });
+
+        public static bool IsDataAvailable(IDataExtensionRetrieval tableData)
+        {
+            var timing = XdpColumns.QueryTiming(tableData);
+            return timing != null && timing.Polls.Count > 0;
+        }
+
+        public static void BuildTable(ITableBuilder tableBuilder, IDataExtensionRetrieval tableData)
+        {
+            Debug.Assert(!(tableBuilder is null) && !(tableData is null));
+
+            var timing = XdpColumns.QueryTiming(tableData);
+            if (timing == null)
+            {
+                return;
+            }
+
+            var polls = timing.Polls;
+            var table = tableBuilder.SetRowCount(polls.Count);
+            var dataProjection = Projection.Index(polls);
+
+            table.AddColumn(XdpColumns.Type, dataProjection.Compose(x => x.Type));
+            table.AddColumn(XdpColumns.ObjectType, dataProjection.Compose(x => x.ObjectType));
+            table.AddColumn(XdpColumns.ObjectPointer, dataProjection.Compose(x => x.ObjectPointer));
+            table.AddColumn(XdpColumns.Processor, dataProjection.Compose(x => x.Processor));
+            table.AddColumn(XdpColumns.Count, Projection.Constant(1));
+            table.AddColumn(XdpColumns.Time, dataProjection.Compose(x => x.TimeStamp));
+            table.AddColumn(XdpColumns.Duration, dataProjection.Compose(x => x.Duration));
+
+            var tableConfig = new TableConfiguration("Per Queue")
+            {
+                Columns = new[]
+                {
+                    XdpColumns.Type,
+                    XdpColumns.ObjectPointer,
+                    TableConfiguration.PivotColumn,
+                    XdpColumns.Processor,
+                    XdpColumns.Count,
+                    XdpColumns.Duration,
+                    TableConfiguration.GraphColumn,
+                    XdpColumns.Time,
+                },
+            };
+            tableConfig.AddColumnRole(ColumnRole.StartTime, XdpColumns.Time);
+            tableConfig.AddColumnRole(ColumnRole.Duration, XdpColumns.Duration);
+
+            tableBuilder.AddTableConfiguration(tableConfig).SetDefaultTableConfiguration(tableConfig);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+﻿//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using Microsoft.Performance.SDK.Extensibility;
+using Microsoft.Performance.SDK.Processing;
+using XdpEtw.DataModel;
+
+namespace XdpEtw.Tables
+{
+    [Table]
+    public sealed class XdpTxCompletionTable
+    {
+        public static readonly TableDescriptor TableDescriptor = new TableDescriptor(
+            Guid.Parse("{89a2dda9-5029-4c7b-a16b-92c0caef369d}"),
+            "XDP Socket TX Completion Latency",
+            "Time from each XSK TX frame being consumed to its completion",
+            category: "XDP",
+            requiredDataCookers: new List<DataCookerPath> { XdpEventCooker.CookerPath });
+
+        private static readonly ColumnConfiguration XskTxIndex =
+            new ColumnConfiguration(
+                new ColumnMetadata(new Guid("{0c85eee4-4a6f-4709-a2b0-c041706b25b6}"), "XSK TX Index"),
+                new UIHints { AggregationMode = AggregationMode.Count, CellFormat = "X" });
+
+        public static bool IsDataAvailable(IDataExtensionRetrieval tableData)
+        {
+            var timing = XdpColumns.QueryTiming(tableData);
+            return timing != null && timing.TxCompletions.Count > 0;
+        }
+
+        public static void BuildTable(ITableBuilder tableBuilder, IDataExtensionRetrieval tableData)
+        {
+            Debug.Assert(!(tableBuilder is null) && !(tableData is null));
+
+            var timing = XdpColumns.QueryTiming(tableData);
+            if (timing == null)
+            {
+                return;
+            }
+
+            var completions = timing.TxCompletions;
+            var table = tableBuilder.SetRowCount(completions.Count);
+            var dataProjection = Projection.Index(completions);
+
+            table.AddColumn(XdpColumns.ObjectPointer, dataProjection.Compose(x => x.Xsk));
+            table.AddColumn(XskTxIndex, dataProjection.Compose(x => x.XskTxIndex));
+            table.AddColumn(XdpColumns.Processor, dataProjection.Compose(x => x.Processor));
+            table.AddColumn(XdpColumns.CompletionProcessor, dataProjection.Compose(x => x.CompletionProcessor));
+            table.AddColumn(XdpColumns.Count, Projection.Constant(1));
+            table.AddColumn(XdpColumns.Time, dataProjection.Compose(x => x.TimeStamp));
+            table.AddColumn(XdpColumns.Latency, dataProjection.Compose(x => x.Latency));
+
+            var tableConfig = new TableConfiguration("Per Socket")
+            {
+                Columns = new[]
+                {
+                    XdpColumns.ObjectPointer,
+                    TableConfiguration.PivotColumn,
+                    XdpColumns.Processor,
+                    XdpColumns.CompletionProcessor,
+                    XdpColumns.Count,
+                    XdpColumns.Latency,
+                    TableConfiguration.GraphColumn,
+                    XdpColumns.Time,
+                },
+            };
+            tableConfig.AddColumnRole(ColumnRole.StartTime, XdpColumns.Time);
+            tableConfig.AddColumnRole(ColumnRole.Duration, XdpColumns.Latency);
+
+            tableBuilder.AddTableConfiguration(tableConfig).SetDefaultTableConfiguration(tableConfig);
+        }
+    }
+}
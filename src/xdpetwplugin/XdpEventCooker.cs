@@ -34,6 +34,9 @@ namespace XdpEtw
 
         public SourceDataCookerOptions Options => SourceDataCookerOptions.ReceiveAllDataElements;
 
+        [DataOutput]
+        public XdpTimingState Timing { get; } = new XdpTimingState();
+
         public XdpEventCooker() : base(CookerPath)
         {
         }
@@ -45,6 +48,7 @@ namespace XdpEtw
         public DataProcessingResult CookDataElement(XdpEvent data, object context, CancellationToken cancellationToken)
         {
             Debug.Assert(!(data is null));
+            Timing.AddEvent(data);
             return DataProcessingResult.Processed;
         }
 
@@ -36,6 +36,7 @@ namespace XdpEtw
 
         public override void ProcessSource(ISourceDataProcessor<XdpEvent, object, Guid> dataProcessor, ILogger logger, IProgress<int> progress, CancellationToken cancellationToken)
         {
+            ProcessEtwSource(dataProcessor, progress, cancellationToken);
         }
 
         #region ETW
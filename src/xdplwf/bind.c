@@ -191,7 +191,7 @@ XdpLwfFilterAttach(
     Status =
         XdpGenericAttachInterface(
             &Filter->Generic, Filter, Filter->NdisFilterHandle, Filter->MiniportIfIndex,
-            &AddIf[Index]);
+            AttachParameters->DefaultOffloadConfiguration, &AddIf[Index]);
     if (NT_SUCCESS(Status)) {
         IfCount++;
         Index++;
@@ -279,6 +279,7 @@ XdpLwfFilterPause(
     Filter->NdisState = FilterPausing;
 
     XdpGenericPause(&Filter->Generic);
+    XdpLwfOffloadPause(Filter);
 
     Filter->NdisState = FilterPaused;
 
@@ -296,6 +297,7 @@ XdpLwfFilterRestart(
 
     ASSERT(Filter->NdisState == FilterPaused);
 
+    XdpLwfOffloadRestart(Filter);
     XdpGenericRestart(&Filter->Generic, RestartParameters);
 
     Filter->NdisState = FilterRunning;
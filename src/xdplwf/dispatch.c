@@ -29,6 +29,8 @@ XdpLwfRegistryUpdate(
         XdpLwfFaultInjectEnabled = FALSE;
     }
 #endif
+
+    XdpLwfOffloadRssRegistryUpdate();
 }
 
 NTSTATUS
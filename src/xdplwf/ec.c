@@ -11,6 +11,14 @@
 //
 #define MAX_ITERATIONS_PER_DPC 8
 
+//
+// The default priority of the passive thread, the same as the DelayedWorkQueue.
+//
+#define EC_DEFAULT_PASSIVE_PRIORITY 12
+
+static BOOLEAN EcPassivePoll = FALSE;
+static KPRIORITY EcPassivePriority = EC_DEFAULT_PASSIVE_PRIORITY;
+
 typedef enum _XDP_EC_STATE {
     EcIdle,
     EcCleanedUp,
@@ -36,6 +44,43 @@ XdpEcNotifyEx(
     _In_ BOOLEAN CanInline
     );
 
+static
+_IRQL_requires_(DISPATCH_LEVEL)
+BOOLEAN
+XdpEcPollQuantum(
+    _In_ XDP_EC *Ec
+    );
+
+static
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpEcPassivePoll(
+    _In_ XDP_EC *Ec
+    )
+{
+    BOOLEAN NeedPoll;
+
+    EventWriteEcStateChange(&MICROSOFT_XDP_PROVIDER, Ec, EcPoll);
+
+    do {
+        KIRQL OldIrql = KeRaiseIrqlToDpcLevel();
+
+        ASSERT(Ec->OwningProcessor == KeGetCurrentProcessorIndex());
+        NeedPoll = XdpEcPollQuantum(Ec);
+
+        KeLowerIrql(OldIrql);
+
+        if (NeedPoll) {
+            //
+            // Drop to passive level between quanta so other threads, DPCs, and
+            // the DPC watchdog all observe a preemptible processor.
+            //
+            STAT_INC(Ec->PcwStats, Yields);
+            ZwYieldExecution();
+        }
+    } while (NeedPoll);
+}
+
 static
 _IRQL_requires_same_
 _Function_class_(KSTART_ROUTINE)
@@ -58,10 +103,7 @@ XdpEcPassiveWorker(
     Affinity.Mask = AFFINITY_MASK(ProcessorNumber.Number);
     KeSetSystemGroupAffinityThread(&Affinity, &OldAffinity);
 
-    //
-    // Set the thread priority to the same priority as the DelayedWorkQueue.
-    //
-    KeSetPriorityThread(KeGetCurrentThread(), 12);
+    KeSetPriorityThread(KeGetCurrentThread(), Ec->PassivePriority);
 
     while (TRUE) {
         EventWriteEcStateChange(&MICROSOFT_XDP_PROVIDER, Ec, EcPassiveWait);
@@ -73,6 +115,14 @@ XdpEcPassiveWorker(
 
         EventWriteEcStateChange(&MICROSOFT_XDP_PROVIDER, Ec, EcPassiveWake);
 
+        if (Ec->PassivePoll) {
+            //
+            // The passive thread owns the EC outright, so follow the ideal
+            // processor directly rather than migrating via the DPC.
+            //
+            WriteULongNoFence(&Ec->OwningProcessor, ReadULongNoFence(Ec->IdealProcessor));
+        }
+
         if (CurrentProcessor != Ec->OwningProcessor) {
             CurrentProcessor = Ec->OwningProcessor;
             KeGetProcessorNumberFromIndex(CurrentProcessor, &ProcessorNumber);
@@ -81,8 +131,12 @@ XdpEcPassiveWorker(
             KeSetSystemGroupAffinityThread(&Affinity, NULL);
         }
 
-        EventWriteEcStateChange(&MICROSOFT_XDP_PROVIDER, Ec, EcPassiveQueue);
-        KeInsertQueueDpc(&Ec->Dpc, NULL, NULL);
+        if (Ec->PassivePoll) {
+            XdpEcPassivePoll(Ec);
+        } else {
+            EventWriteEcStateChange(&MICROSOFT_XDP_PROVIDER, Ec, EcPassiveQueue);
+            KeInsertQueueDpc(&Ec->Dpc, NULL, NULL);
+        }
     }
 
     KeRevertToUserGroupAffinityThread(&OldAffinity);
@@ -92,19 +146,94 @@ static
 _IRQL_requires_(DISPATCH_LEVEL)
 BOOLEAN
 XdpEcInvokePoll(
-    _In_ XDP_EC *Ec
+    _In_ XDP_EC *Ec,
+    _Inout_ UINT32 *Budget
     )
 {
     BOOLEAN NeedPoll;
+    UINT32 WorkDone = 0;
 
     ASSERT(!Ec->InPoll);
+    ASSERT(*Budget > 0);
     Ec->InPoll = TRUE;
 
-    NeedPoll = Ec->Poll(Ec->PollContext);
+    NeedPoll = Ec->Poll(Ec->PollContext, *Budget, &WorkDone);
+    STAT_INC(Ec->PcwStats, Polls);
 
     ASSERT(Ec->InPoll);
     Ec->InPoll = FALSE;
 
+    ASSERT(WorkDone <= *Budget);
+    *Budget -= min(WorkDone, *Budget);
+
+    return NeedPoll;
+}
+
+static
+_IRQL_requires_(DISPATCH_LEVEL)
+BOOLEAN
+XdpEcPollQuantum(
+    _In_ XDP_EC *Ec
+    )
+{
+    BOOLEAN NeedPoll = FALSE;
+    UINT32 Iteration = 0;
+    UINT32 Budget = ReadUInt32NoFence(&Ec->Budget);
+
+    do {
+        NeedPoll = XdpEcInvokePoll(Ec, &Budget);
+    } while (NeedPoll && Budget > 0 && ++Iteration < MAX_ITERATIONS_PER_DPC);
+
+    if (NeedPoll) {
+        if (Budget == 0) {
+            STAT_INC(Ec->PcwStats, BudgetExhausted);
+        }
+    } else {
+        //
+        // No more work. Re-arm the EC and re-check the poll callback.
+        //
+        EventWriteEcStateChange(&MICROSOFT_XDP_PROVIDER, Ec, EcDpcArm);
+        InterlockedExchange8((CHAR *)&Ec->Armed, TRUE);
+
+        //
+        // The re-check only picks up work that raced with re-arming the EC;
+        // ensure it makes progress even if this DPC consumed its budget.
+        //
+        Budget = max(Budget, 1);
+
+        if (XdpEcInvokePoll(Ec, &Budget)) {
+            //
+            // There is more work, after all.
+            //
+            XdpEcNotifyEx(Ec, FALSE);
+        } else if (Ec->CleanupComplete != NULL) {
+            //
+            // Perform a final disarm of the EC to trigger cleanup completion.
+            //
+            if (InterlockedExchange8((CHAR *)&Ec->Armed, FALSE)) {
+                //
+                // The EC has successfully been shut down; any further
+                // notifications are ignored, and the poll callback will never
+                // be invoked.
+                //
+                KeSetEvent(Ec->CleanupComplete, 0, FALSE);
+            } else {
+                //
+                // A notification disarmed the EC after this routine re-armed
+                // the EC. That notification has in turn queued a DPC or woken
+                // the passive thread, so fall through and do nothing here;
+                // that poll will continue where this routine left off.
+                //
+                // Since it is illegal for external notifications to occur or
+                // for polling callbacks to request another poll after cleanup
+                // is initiated, the notification that won the disarm race must
+                // have been triggered by the cleanup routine itself, and so the
+                // EC cannot fall through this path more than once.
+                //
+            }
+        }
+    }
+
     return NeedPoll;
 }
 
@@ -115,10 +244,8 @@ XdpEcPoll(
     _In_ XDP_EC *Ec
     )
 {
-    BOOLEAN NeedPoll = FALSE;
     BOOLEAN NeedYieldCheck;
     LARGE_INTEGER CurrentTick;
-    UINT32 Iteration = 0;
 
     EventWriteEcStateChange(&MICROSOFT_XDP_PROVIDER, Ec, EcPoll);
 
@@ -159,6 +286,7 @@ XdpEcPoll(
                 // starvation can occur in the degenerate case.
                 //
                 Ec->SkipYieldCheck = TRUE;
+                STAT_INC(Ec->PcwStats, Yields);
                 EventWriteEcStateChange(&MICROSOFT_XDP_PROVIDER, Ec, EcPassive);
                 KeSetEvent(&Ec->PassiveEvent, 0, FALSE);
                 return;
@@ -166,51 +294,13 @@ XdpEcPoll(
         }
     }
 
-    do {
-        NeedPoll = XdpEcInvokePoll(Ec);
-    } while (NeedPoll && ++Iteration < MAX_ITERATIONS_PER_DPC);
-
-    if (NeedPoll) {
-        EventWriteEcStateChange(&MICROSOFT_XDP_PROVIDER, Ec, EcDpcQueue);
-        KeInsertQueueDpc(&Ec->Dpc, NULL, NULL);
-    } else {
+    if (XdpEcPollQuantum(Ec)) {
         //
-        // No more work. Re-arm the EC and re-check the poll callback.
+        // Requeue the DPC at the tail of the processor's DPC queue, allowing
+        // any other ECs on this processor to poll before this EC resumes.
         //
-        EventWriteEcStateChange(&MICROSOFT_XDP_PROVIDER, Ec, EcDpcArm);
-        InterlockedExchange8((CHAR *)&Ec->Armed, TRUE);
-
-        if (XdpEcInvokePoll(Ec)) {
-            //
-            // There is more work, after all.
-            //
-            XdpEcNotifyEx(Ec, FALSE);
-        } else if (Ec->CleanupComplete != NULL) {
-            //
-            // Perform a final disarm of the EC to trigger cleanup completion.
-            //
-            if (InterlockedExchange8((CHAR *)&Ec->Armed, FALSE)) {
-                //
-                // The EC has successfully been shut down; any further
-                // notifications are ignored, and the poll callback will never
-                // be invoked.
-                //
-                KeSetEvent(Ec->CleanupComplete, 0, FALSE);
-            } else {
-                //
-                // A notification disarmed the EC after this routine re-armed
-                // the EC. That notification has in turn queued a DPC, so fall
-                // through and do nothing here; that queued DPC will continue
-                // where this routine left off.
-                //
-                // Since it is illegal for external notifications to occur or
-                // for polling callbacks to request another poll after cleanup
-                // is initiated, the notification that won the disarm race must
-                // have been triggered by the cleanup routine itself, and so the
-                // EC cannot fall through this path more than once.
-                //
-            }
-        }
+        EventWriteEcStateChange(&MICROSOFT_XDP_PROVIDER, Ec, EcDpcQueue);
+        KeInsertQueueDpc(&Ec->Dpc, NULL, NULL);
     }
 }
 
@@ -264,6 +354,12 @@ XdpEcNotifyEx(
     if (InterlockedExchange8((CHAR *)&Ec->Armed, FALSE)) {
         EventWriteEcStateChange(&MICROSOFT_XDP_PROVIDER, Ec, EcDisarm);
 
+        if (Ec->PassivePoll) {
+            EventWriteEcStateChange(&MICROSOFT_XDP_PROVIDER, Ec, EcPassive);
+            KeSetEvent(&Ec->PassiveEvent, 0, FALSE);
+            return;
+        }
+
         KIRQL OldIrql = KeRaiseIrqlToDpcLevel();
         ULONG CurrentProcessor = KeGetCurrentProcessorIndex();
 
@@ -296,7 +392,10 @@ XdpEcEnterInline(
     _In_ ULONG CurrentProcessor
     )
 {
-    if (XdpEcIsSerializable(Ec, CurrentProcessor)) {
+    //
+    // All work on a passive-poll EC runs on its passive thread.
+    //
+    if (!Ec->PassivePoll && XdpEcIsSerializable(Ec, CurrentProcessor)) {
         Ec->InPoll = TRUE;
         EventWriteEcStateChange(&MICROSOFT_XDP_PROVIDER, Ec, EcEnterInline);
         return TRUE;
@@ -317,6 +416,22 @@ XdpEcExitInline(
     EventWriteEcStateChange(&MICROSOFT_XDP_PROVIDER, Ec, EcExitInline);
 }
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpEcSetBudget(
+    _In_ XDP_EC *Ec,
+    _In_ UINT32 Budget
+    )
+{
+    ASSERT(Budget > 0);
+
+    //
+    // The poll quantum samples the budget once, so a concurrent update is
+    // picked up at the next quantum without further synchronization.
+    //
+    WriteUInt32NoFence(&Ec->Budget, Budget);
+}
+
 _IRQL_requires_(PASSIVE_LEVEL)
 VOID
 XdpEcCleanup(
@@ -352,7 +467,9 @@ XdpEcInitialize(
     _Inout_ XDP_EC *Ec,
     _In_ XDP_EC_POLL_ROUTINE *Poll,
     _In_ VOID *PollContext,
-    _In_ ULONG *IdealProcessor
+    _In_ ULONG *IdealProcessor,
+    _In_ UINT32 Budget,
+    _In_ XDP_PCW_LWF_EC *PcwStats
     )
 {
     NTSTATUS Status;
@@ -364,8 +481,14 @@ XdpEcInitialize(
     Ec->PollContext = PollContext;
     Ec->IdealProcessor = IdealProcessor;
     Ec->OwningProcessor = ReadULongNoFence(IdealProcessor);
+    Ec->Budget = Budget;
+    Ec->PcwStats = PcwStats;
+    Ec->PassivePoll = ReadBooleanNoFence(&EcPassivePoll);
+    Ec->PassivePriority = ReadNoFence((LONG *)&EcPassivePriority);
     Ec->Armed = TRUE;
 
+    ASSERT(Budget > 0);
+
     KeInitializeDpc(&Ec->Dpc, XdpEcDpcThunk, Ec);
     KeGetProcessorNumberFromIndex(Ec->OwningProcessor, &ProcessorNumber);
     KeSetTargetProcessorDpcEx(&Ec->Dpc, &ProcessorNumber);
@@ -406,3 +529,26 @@ Exit:
 
     return Status;
 }
+
+VOID
+XdpEcRegistryUpdate(
+    VOID
+    )
+{
+    NTSTATUS Status;
+    DWORD Value;
+
+    Status = XdpRegQueryDwordValue(XDP_LWF_PARAMETERS_KEY, L"GenericPassivePoll", &Value);
+    if (NT_SUCCESS(Status)) {
+        WriteBooleanNoFence(&EcPassivePoll, !!Value);
+    } else {
+        WriteBooleanNoFence(&EcPassivePoll, FALSE);
+    }
+
+    Status = XdpRegQueryDwordValue(XDP_LWF_PARAMETERS_KEY, L"GenericPassivePriority", &Value);
+    if (NT_SUCCESS(Status) && Value > LOW_PRIORITY && Value <= LOW_REALTIME_PRIORITY) {
+        WriteNoFence((LONG *)&EcPassivePriority, (LONG)Value);
+    } else {
+        WriteNoFence((LONG *)&EcPassivePriority, EC_DEFAULT_PASSIVE_PRIORITY);
+    }
+}
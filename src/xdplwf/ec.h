@@ -6,14 +6,24 @@
 #pragma once
 
 //
-// Poll callback performs a quantum of work and returns whether more work
-// can be performed.
+// The default number of frames an EC may process in a single DPC before it
+// requeues itself behind other DPCs on the same processor.
+//
+#define XDP_EC_DEFAULT_BUDGET 256
+#define XDP_EC_MAX_BUDGET 65536
+
+//
+// Poll callback performs a quantum of work, processing no more than Budget
+// frames, and returns whether more work can be performed. The number of frames
+// processed is returned in WorkDone.
 //
 typedef
 _IRQL_requires_(DISPATCH_LEVEL)
 BOOLEAN
 XDP_EC_POLL_ROUTINE(
-    _In_ VOID *Context
+    _In_ VOID *Context,
+    _In_ UINT32 Budget,
+    _Out_ UINT32 *WorkDone
     );
 
 typedef struct _XDP_EC {
@@ -25,6 +35,10 @@ typedef struct _XDP_EC {
     BOOLEAN CleanupPassiveThread;
     ULONG *IdealProcessor;
     ULONG OwningProcessor;
+    UINT32 Budget;
+    XDP_PCW_LWF_EC *PcwStats;
+    BOOLEAN PassivePoll;
+    KPRIORITY PassivePriority;
     LARGE_INTEGER LastYieldTick;
     KDPC Dpc;
     PKTHREAD PassiveThread;
@@ -39,13 +53,40 @@ typedef struct _XDP_EC {
 // tends to execute at dispatch level. The IdealProcessor parameter allows
 // the EC to follow the target RSS processor as the indirection table changes.
 //
+// Each DPC processes at most Budget frames. An EC with work remaining after
+// exhausting its budget is requeued at the tail of its processor's DPC queue,
+// so ECs sharing a processor are serviced in round-robin order.
+//
 _IRQL_requires_(PASSIVE_LEVEL)
 NTSTATUS
 XdpEcInitialize(
     _Inout_ XDP_EC *Ec,
     _In_ XDP_EC_POLL_ROUTINE *Poll,
     _In_ VOID *PollContext,
-    _In_ ULONG *IdealProcessor
+    _In_ ULONG *IdealProcessor,
+    _In_ UINT32 Budget,
+    _In_ XDP_PCW_LWF_EC *PcwStats
+    );
+
+//
+// Refresh the EC registry configuration. ECs initialized afterwards poll
+// entirely on their affinitized passive thread, rather than in DPCs, when
+// GenericPassivePoll is nonzero; GenericPassivePriority sets the priority of
+// the passive thread.
+//
+VOID
+XdpEcRegistryUpdate(
+    VOID
+    );
+
+//
+// Updates the EC budget. The new budget takes effect at the next poll quantum.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpEcSetBudget(
+    _In_ XDP_EC *Ec,
+    _In_ UINT32 Budget
     );
 
 //
@@ -40,6 +40,7 @@ typedef struct _XDP_LWF_FILTER {
 #define POOLTAG_NATIVE              'NfdX'      // XdfN
 #define POOLTAG_OID                 'OfdX'      // XdfO
 #define POOLTAG_OFFLOAD             'ofdX'      // Xdfo
+#define POOLTAG_QEO                 'QfdX'      // XdfQ
 #define POOLTAG_RECV                'rfdX'      // Xdfr
 #define POOLTAG_RECV_TX             'TfdX'      // XdfT
 #define POOLTAG_RSS                 'RfdX'      // XdfR
@@ -179,6 +179,8 @@ XdpGenericRegistryUpdate(
     }
 
     XdpGenericReceiveRegistryUpdate();
+    XdpGenericQeoRegistryUpdate();
+    XdpEcRegistryUpdate();
 }
 
 VOID
@@ -506,6 +508,98 @@ Exit:
     return Status;
 }
 
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XdpGenericSetTuning(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ const XDP_OFFLOAD_PARAMS_TUNING *TuningParams,
+    _In_ UINT32 TuningParamsSize
+    )
+{
+    NTSTATUS Status;
+    XDP_LWF_GENERIC_TUNING Tuning;
+
+    TraceEnter(TRACE_GENERIC, "IfIndex=%u", Generic->IfIndex);
+
+    if (TuningParamsSize != sizeof(*TuningParams)) {
+        ASSERT(FALSE);
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    RtlAcquirePushLockExclusive(&Generic->Lock);
+
+    //
+    // Validate every setting against a copy of the current tuning before
+    // committing any of them.
+    //
+    Tuning = Generic->Tuning;
+
+    for (UINT32 Index = 0; Index < TuningParams->SettingCount; Index++) {
+        const XDP_TUNING_SETTING *Setting = &TuningParams->Settings[Index];
+
+        switch (Setting->Parameter) {
+        case XDP_TUNING_PARAMETER_GENERIC_RX_CLONE_CACHE_LIMIT:
+            if (Setting->Value > RECV_MAX_MAX_TX_BUFFERS) {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+            Tuning.RxCloneCacheLimitSet = TRUE;
+            Tuning.RxCloneCacheLimit = Setting->Value;
+            Status = STATUS_SUCCESS;
+            break;
+
+        case XDP_TUNING_PARAMETER_GENERIC_EC_BUDGET:
+            if (Setting->Value == 0 || Setting->Value > XDP_EC_MAX_BUDGET) {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+            Tuning.EcBudget = Setting->Value;
+            Status = STATUS_SUCCESS;
+            break;
+
+        case XDP_TUNING_PARAMETER_GENERIC_TX_INSPECT_BATCH_SIZE:
+            if (Setting->Value == 0 || Setting->Value > RECV_MAX_TX_INSPECT_BATCH_SIZE) {
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+            Tuning.TxInspectBatchSize = Setting->Value;
+            Status = STATUS_SUCCESS;
+            break;
+
+        default:
+            Status = STATUS_NOT_SUPPORTED;
+            break;
+        }
+
+        if (!NT_SUCCESS(Status)) {
+            TraceError(
+                TRACE_GENERIC, "IfIndex=%u Invalid tuning setting Parameter=%u Value=%u",
+                Generic->IfIndex, Setting->Parameter, Setting->Value);
+            RtlReleasePushLockExclusive(&Generic->Lock);
+            goto Exit;
+        }
+
+        TraceInfo(
+            TRACE_GENERIC, "IfIndex=%u Tuning Parameter=%u Value=%u",
+            Generic->IfIndex, Setting->Parameter, Setting->Value);
+    }
+
+    Generic->Tuning = Tuning;
+    XdpGenericRxApplyTuning(Generic);
+    XdpGenericTxApplyTuning(Generic);
+
+    RtlReleasePushLockExclusive(&Generic->Lock);
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_GENERIC);
+
+    return Status;
+}
+
 _IRQL_requires_(PASSIVE_LEVEL)
 VOID
 XdpGenericRequestRestart(
@@ -605,6 +699,7 @@ XdpGenericCleanupInterface(
     _In_ XDP_LWF_GENERIC *Generic
     )
 {
+    XdpGenericQeoCleanup(Generic);
     XdpGenericCleanupDatapath(Generic, &Generic->Tx.Datapath);
     XdpGenericCleanupDatapath(Generic, &Generic->Rx.Datapath);
 
@@ -631,6 +726,7 @@ XdpGenericAttachInterface(
     _In_ XDP_LWF_FILTER *Filter,
     _In_ NDIS_HANDLE NdisFilterHandle,
     _In_ NET_IFINDEX IfIndex,
+    _In_opt_ const NDIS_OFFLOAD *DefaultOffload,
     _Out_ XDP_ADD_INTERFACE *AddIf
     )
 {
@@ -654,6 +750,7 @@ XdpGenericAttachInterface(
     KeInitializeEvent(&Generic->Tx.Datapath.ReadyEvent, NotificationEvent, FALSE);
     KeInitializeEvent(&Generic->Rx.Datapath.ReadyEvent, NotificationEvent, FALSE);
     XdpInitializeReferenceCount(&Generic->ReferenceCount);
+    XdpGenericQeoInitialize(Generic);
     Generic->Filter = Filter;
     Generic->NdisFilterHandle = NdisFilterHandle;
     Generic->IfIndex = IfIndex;
@@ -664,6 +761,19 @@ XdpGenericAttachInterface(
     Generic->InternalCapabilities.CapabilitiesEx = &Generic->Capabilities.CapabilitiesEx;
     Generic->InternalCapabilities.CapabilitiesSize = sizeof(Generic->Capabilities);
 
+    if (DefaultOffload != NULL &&
+        DefaultOffload->Header.Revision >= NDIS_OFFLOAD_REVISION_1 &&
+        DefaultOffload->Header.Size >= NDIS_SIZEOF_NDIS_OFFLOAD_REVISION_1) {
+        Generic->Tx.Checksum = DefaultOffload->Checksum;
+        Generic->Tx.LargeSend = DefaultOffload->LsoV2;
+    }
+
+    if (DefaultOffload != NULL &&
+        DefaultOffload->Header.Revision >= NDIS_OFFLOAD_REVISION_6 &&
+        DefaultOffload->Header.Size >= NDIS_SIZEOF_NDIS_OFFLOAD_REVISION_6) {
+        Generic->Tx.UdpSegmentation = DefaultOffload->UdpSegmentation;
+    }
+
     Generic->Rx.Datapath.DelayDetachTimer =
         XdpTimerCreate(
             XdpGenericDelayDereferenceDatapath,
@@ -751,9 +861,13 @@ XdpGenericStart(
     VOID
     )
 {
+    XdpGenericQeoStart();
     XdpRegWatcherAddClient(XdpLwfRegWatcher, XdpGenericRegistryUpdate, &GenericRegWatcher);
     XdpPcwRegisterLwfRxQueue(NULL, NULL);
     XdpPcwRegisterLwfTxQueue(NULL, NULL);
+#ifdef XDP_PERF_STAGES
+    XdpPcwRegisterLwfRxQueueStages(NULL, NULL);
+#endif
 
     return STATUS_SUCCESS;
 }
@@ -763,6 +877,12 @@ XdpGenericStop(
     VOID
     )
 {
+#ifdef XDP_PERF_STAGES
+    if (XdpPcwLwfRxQueueStages != NULL) {
+        PcwUnregister(XdpPcwLwfRxQueueStages);
+        XdpPcwLwfRxQueueStages = NULL;
+    }
+#endif
     if (XdpPcwLwfTxQueue != NULL) {
         PcwUnregister(XdpPcwLwfTxQueue);
         XdpPcwLwfTxQueue = NULL;
@@ -772,4 +892,5 @@ XdpGenericStop(
         XdpPcwLwfRxQueue = NULL;
     }
     XdpRegWatcherRemoveClient(XdpLwfRegWatcher, &GenericRegWatcher);
+    XdpGenericQeoStop();
 }
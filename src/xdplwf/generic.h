@@ -7,6 +7,7 @@
 
 #include <xdprefcount.h>
 
+#include "qeo.h"
 #include "rss.h"
 #include "send.h"
 
@@ -24,6 +25,18 @@ typedef struct _XDP_LWF_DATAPATH_BYPASS {
     XDP_TIMER *DelayDetachTimer;
 } XDP_LWF_DATAPATH_BYPASS;
 
+//
+// Runtime tuning overrides, applied to existing and future queues. Zero-valued
+// fields use the registry or built-in defaults; the clone cache limit has an
+// explicit flag since zero is a valid limit.
+//
+typedef struct _XDP_LWF_GENERIC_TUNING {
+    BOOLEAN RxCloneCacheLimitSet;
+    UINT32 RxCloneCacheLimit;
+    UINT32 EcBudget;
+    UINT32 TxInspectBatchSize;
+} XDP_LWF_GENERIC_TUNING;
+
 typedef struct _XDP_LWF_GENERIC {
     XDP_LWF_FILTER *Filter;
     NDIS_HANDLE NdisFilterHandle;
@@ -43,6 +56,8 @@ typedef struct _XDP_LWF_GENERIC {
     } Flags;
 
     XDP_LWF_GENERIC_RSS Rss;
+    XDP_LWF_GENERIC_QEO Qeo;
+    XDP_LWF_GENERIC_TUNING Tuning;
 
     struct {
         XDP_LWF_DATAPATH_BYPASS Datapath;
@@ -53,6 +68,14 @@ typedef struct _XDP_LWF_GENERIC {
         XDP_LWF_DATAPATH_BYPASS Datapath;
         LIST_ENTRY Queues;
         UINT32 Mtu;
+
+        //
+        // The miniport's checksum and segmentation offload capabilities,
+        // captured from its default offload configuration at attach time.
+        //
+        NDIS_TCP_IP_CHECKSUM_OFFLOAD Checksum;
+        NDIS_TCP_LARGE_SEND_OFFLOAD_V2 LargeSend;
+        NDIS_UDP_SEGMENTATION_OFFLOAD UdpSegmentation;
     } Tx;
 } XDP_LWF_GENERIC;
 
@@ -84,6 +107,7 @@ XdpGenericAttachInterface(
     _In_ XDP_LWF_FILTER *Filter,
     _In_ NDIS_HANDLE NdisFilterHandle,
     _In_ NET_IFINDEX IfIndex,
+    _In_opt_ const NDIS_OFFLOAD *DefaultOffload,
     _Out_ XDP_ADD_INTERFACE *AddIf
     );
 
@@ -157,6 +181,14 @@ XdpGenericDetachDatapath(
     _In_ BOOLEAN TxDatapath
     );
 
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XdpGenericSetTuning(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ const XDP_OFFLOAD_PARAMS_TUNING *TuningParams,
+    _In_ UINT32 TuningParamsSize
+    );
+
 NTSTATUS
 XdpGenericStart(
     VOID
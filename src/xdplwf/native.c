@@ -19,8 +19,37 @@ XDP_HOOK_ID NativeHooks[] = {
         .Direction  = XDP_HOOK_TX,
         .SubLayer   = XDP_HOOK_INJECT,
     },
+    //
+    // Optional hooks follow; see XdpNativeGetHookCount.
+    //
+    {
+        .Layer      = XDP_HOOK_L2,
+        .Direction  = XDP_HOOK_TX,
+        .SubLayer   = XDP_HOOK_INSPECT,
+    },
 };
 
+static
+UINT32
+XdpNativeGetHookCount(
+    _In_ const XDP_CAPABILITIES_EX *CapabilitiesEx,
+    _In_ UINT32 CapabilitiesSize
+    )
+{
+    //
+    // The TX inspect hook is the last entry, and is only exposed if the
+    // interface presents outgoing frames to XDP.
+    //
+    if (CapabilitiesEx->Header.Revision >= XDP_CAPABILITIES_EX_REVISION_2 &&
+        CapabilitiesEx->Header.Size >= XDP_SIZEOF_CAPABILITIES_EX_REVISION_2 &&
+        CapabilitiesSize >= XDP_SIZEOF_CAPABILITIES_EX_REVISION_2 &&
+        CapabilitiesEx->TxInspectSupported) {
+        return RTL_NUMBER_OF(NativeHooks);
+    }
+
+    return RTL_NUMBER_OF(NativeHooks) - 1;
+}
+
 _IRQL_requires_max_(PASSIVE_LEVEL)
 VOID
 XdpNativeRemoveInterfaceComplete(
@@ -86,7 +115,6 @@ XdpNativeAttachInterface(
 
     Native->Capabilities.Mode = XDP_INTERFACE_MODE_NATIVE;
     Native->Capabilities.Hooks = NativeHooks;
-    Native->Capabilities.HookCount = RTL_NUMBER_OF(NativeHooks);
     Native->Capabilities.CapabilitiesEx = CapabilitiesEx;
 
     Status =
@@ -104,6 +132,7 @@ XdpNativeAttachInterface(
     }
 
     Native->Capabilities.CapabilitiesSize = BytesReturned;
+    Native->Capabilities.HookCount = XdpNativeGetHookCount(CapabilitiesEx, BytesReturned);
 
     RtlZeroMemory(AddIf, sizeof(*AddIf));
     AddIf->InterfaceCapabilities = &Native->Capabilities;
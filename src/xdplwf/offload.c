@@ -199,6 +199,11 @@ XdpLwfGetInterfaceOffload(
         ASSERT(OffloadParams != NULL);
         Status = XdpLwfOffloadRssGet(Filter, OffloadContext, OffloadParams, OffloadParamsSize);
         break;
+    case XdpOffloadDropFilter:
+        ASSERT(OffloadParams != NULL);
+        Status =
+            XdpLwfOffloadDropFilterGet(Filter, OffloadContext, OffloadParams, OffloadParamsSize);
+        break;
     default:
         TraceError(TRACE_LWF, "OffloadContext=%p Unsupported offload", OffloadContext);
         Status = STATUS_NOT_SUPPORTED;
@@ -232,6 +237,18 @@ XdpLwfSetInterfaceOffload(
     case XdpOffloadQeo:
         Status = XdpLwfOffloadQeoSet(Filter, OffloadContext, OffloadParams, OffloadParamsSize);
         break;
+    case XdpOffloadFlowSteering:
+        Status =
+            XdpLwfOffloadFlowSteeringSet(
+                Filter, OffloadContext, OffloadParams, OffloadParamsSize);
+        break;
+    case XdpOffloadTuning:
+        Status = XdpGenericSetTuning(&Filter->Generic, OffloadParams, OffloadParamsSize);
+        break;
+    case XdpOffloadDropFilter:
+        Status =
+            XdpLwfOffloadDropFilterSet(Filter, OffloadContext, OffloadParams, OffloadParamsSize);
+        break;
     default:
         TraceError(TRACE_LWF, "OffloadContext=%p Unsupported offload", OffloadContext);
         Status = STATUS_NOT_SUPPORTED;
@@ -311,12 +328,13 @@ VOID
 XdpLwfOffloadTransformNbls(
     _In_ XDP_LWF_FILTER *Filter,
     _Inout_ NBL_COUNTED_QUEUE *NblList,
-    _In_ UINT32 XdpInspectFlags
+    _In_ NDIS_PORT_NUMBER PortNumber,
+    _In_ ULONG ReceiveFlags
     )
 {
     KIRQL OldIrql = DISPATCH_LEVEL;
 
-    if (!(XdpInspectFlags & XDP_LWF_GENERIC_INSPECT_FLAG_DISPATCH)) {
+    if (!NDIS_TEST_RECEIVE_AT_DISPATCH_LEVEL(ReceiveFlags)) {
         OldIrql = KeRaiseIrqlToDpcLevel();
     }
 
@@ -326,9 +344,7 @@ XdpLwfOffloadTransformNbls(
     // stack.
     //
     if (ReadPointerNoFence(&Filter->Offload.LowerEdge.Rss) != NULL) {
-        for (NET_BUFFER_LIST *Nbl = NblList->Queue.First; Nbl != NULL; Nbl = Nbl->Next) {
-            XdpLwfOffloadRssNblTransform(Filter, Nbl);
-        }
+        XdpLwfOffloadRssTransformNbls(Filter, NblList, PortNumber, ReceiveFlags);
     }
 
     if (OldIrql != DISPATCH_LEVEL) {
@@ -336,6 +352,14 @@ XdpLwfOffloadTransformNbls(
     }
 }
 
+BOOLEAN
+XdpLwfOffloadNeedTransformNbls(
+    _In_ XDP_LWF_FILTER *Filter
+    )
+{
+    return ReadPointerNoFence(&Filter->Offload.LowerEdge.Rss) != NULL;
+}
+
 typedef struct _XDP_LWF_OFFLOAD_DEACTIVATE {
     _In_ XDP_LWF_OFFLOAD_WORKITEM WorkItem;
     _Inout_ KEVENT Event;
@@ -380,6 +404,30 @@ XdpLwfOffloadDeactivate(
     TraceExitSuccess(TRACE_LWF);
 }
 
+VOID
+XdpLwfOffloadPause(
+    _In_ XDP_LWF_FILTER *Filter
+    )
+{
+    TraceEnter(TRACE_LWF, "Filter=%p", Filter);
+
+    XdpLwfOffloadRssPause(Filter);
+
+    TraceExitSuccess(TRACE_LWF);
+}
+
+VOID
+XdpLwfOffloadRestart(
+    _In_ XDP_LWF_FILTER *Filter
+    )
+{
+    TraceEnter(TRACE_LWF, "Filter=%p", Filter);
+
+    XdpLwfOffloadRssRestart(Filter);
+
+    TraceExitSuccess(TRACE_LWF);
+}
+
 NTSTATUS
 XdpLwfOffloadStart(
     _In_ XDP_LWF_FILTER *Filter
@@ -396,7 +444,10 @@ XdpLwfOffloadStart(
         goto Exit;
     }
 
-    Status = STATUS_SUCCESS;
+    Status = XdpLwfOffloadRssStart(Filter);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
 
 Exit:
 
@@ -417,5 +468,7 @@ XdpLwfOffloadUnInitialize(
         Filter->Offload.WorkQueue = NULL;
     }
 
+    XdpLwfOffloadRssUnInitialize(Filter);
+
     TraceExitSuccess(TRACE_LWF);
 }
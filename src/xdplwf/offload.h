@@ -20,6 +20,82 @@ typedef struct _XDP_LWF_INTERFACE_OFFLOAD_SETTINGS {
     XDP_LWF_OFFLOAD_SETTING_RSS *Rss;
 } XDP_LWF_INTERFACE_OFFLOAD_SETTINGS;
 
+typedef struct _XDP_LWF_OFFLOAD_WORKITEM XDP_LWF_OFFLOAD_WORKITEM;
+
+//
+// Annotate routines that must be invoked from the serialized offload work
+// queue.
+//
+#define _Offload_work_routine_
+#define _Requires_offload_rundown_ref_
+
+typedef
+_Offload_work_routine_
+VOID
+XDP_LWF_OFFLOAD_WORK_ROUTINE(
+    _In_ XDP_LWF_OFFLOAD_WORKITEM *WorkItem
+    );
+
+typedef struct _XDP_LWF_OFFLOAD_WORKITEM {
+    SINGLE_LIST_ENTRY Link;
+    XDP_LWF_FILTER *Filter;
+    XDP_LWF_OFFLOAD_WORK_ROUTINE *WorkRoutine;
+} XDP_LWF_OFFLOAD_WORKITEM;
+
+typedef struct _XDP_LWF_OFFLOAD_RSS_REBALANCE_QUEUE {
+    UINT64 LastLoad;
+    UINT64 Load;
+    ULONG Processor;
+    BOOLEAN Eligible;
+} XDP_LWF_OFFLOAD_RSS_REBALANCE_QUEUE;
+
+//
+// Optional RSS rebalancer state. The rebalancer periodically samples the load
+// on each generic RSS queue and moves indirection table entries from the
+// hottest queue to the coolest queue.
+//
+typedef struct _XDP_LWF_OFFLOAD_RSS_REBALANCE {
+    XDP_TIMER *Timer;
+    XDP_LWF_OFFLOAD_WORKITEM WorkItem;
+    XDP_LWF_GENERIC_RSS_QUEUE *SampledQueues;
+    ULONG SampledQueueCount;
+    XDP_LWF_OFFLOAD_RSS_REBALANCE_QUEUE *Queues;
+    UINT32 HoldoffIntervals;
+
+    //
+    // The most recently programmed parameters, if valid. Otherwise the upper
+    // edge parameters are in effect.
+    //
+    BOOLEAN ParamsValid;
+    XDP_OFFLOAD_PARAMS_RSS Params;
+} XDP_LWF_OFFLOAD_RSS_REBALANCE;
+
+//
+// A per processor queue of received NBLs steered to the processor by the upper
+// edge RSS indirection table, indicated to the stack by a DPC targeting the
+// processor.
+//
+typedef struct DECLSPEC_CACHEALIGN _XDP_LWF_OFFLOAD_RSS_STEERING_QUEUE {
+    KSPIN_LOCK Lock;
+    NBL_COUNTED_QUEUE Nbls;
+    KDPC Dpc;
+    XDP_LWF_FILTER *Filter;
+} XDP_LWF_OFFLOAD_RSS_STEERING_QUEUE;
+
+//
+// Software RSS steering state. While XDP owns the lower edge RSS settings,
+// frames passed to the stack are re-hashed with the upper edge settings and
+// indicated on the upper edge RSS processors.
+//
+typedef struct _XDP_LWF_OFFLOAD_RSS_STEERING {
+    //
+    // Protects queueing NBLs while the filter is running.
+    //
+    EX_RUNDOWN_REF_CACHE_AWARE *Rundown;
+    XDP_LWF_OFFLOAD_RSS_STEERING_QUEUE *Queues;
+    ULONG QueueCount;
+} XDP_LWF_OFFLOAD_RSS_STEERING;
+
 //
 // Per LWF filter state.
 //
@@ -42,6 +118,9 @@ typedef struct _XDP_LWF_OFFLOAD {
     //
     XDP_LWF_INTERFACE_OFFLOAD_SETTINGS UpperEdge;
     XDP_LWF_INTERFACE_OFFLOAD_SETTINGS LowerEdge;
+
+    XDP_LWF_OFFLOAD_RSS_REBALANCE RssRebalance;
+    XDP_LWF_OFFLOAD_RSS_STEERING RssSteering;
 } XDP_LWF_OFFLOAD;
 
 typedef enum {
@@ -64,28 +143,6 @@ typedef struct _XDP_LWF_INTERFACE_OFFLOAD_CONTEXT {
     XDP_LWF_INTERFACE_OFFLOAD_SETTINGS Settings;
 } XDP_LWF_INTERFACE_OFFLOAD_CONTEXT;
 
-typedef struct _XDP_LWF_OFFLOAD_WORKITEM XDP_LWF_OFFLOAD_WORKITEM;
-
-//
-// Annotate routines that must be invoked from the serialized offload work
-// queue.
-//
-#define _Offload_work_routine_
-#define _Requires_offload_rundown_ref_
-
-typedef
-_Offload_work_routine_
-VOID
-XDP_LWF_OFFLOAD_WORK_ROUTINE(
-    _In_ XDP_LWF_OFFLOAD_WORKITEM *WorkItem
-    );
-
-typedef struct _XDP_LWF_OFFLOAD_WORKITEM {
-    SINGLE_LIST_ENTRY Link;
-    XDP_LWF_FILTER *Filter;
-    XDP_LWF_OFFLOAD_WORK_ROUTINE *WorkRoutine;
-} XDP_LWF_OFFLOAD_WORKITEM;
-
 VOID
 XdpLwfOffloadQueueWorkItem(
     _In_ XDP_LWF_FILTER *Filter,
@@ -100,11 +157,24 @@ XdpLwfOffloadInspectOidRequest(
     _In_ XDP_OID_INSPECT_COMPLETE *InspectComplete
     );
 
+//
+// Transforms NBLs passed to the stack. NBLs steered to other processors are
+// removed from the list and indicated asynchronously.
+//
 VOID
 XdpLwfOffloadTransformNbls(
     _In_ XDP_LWF_FILTER *Filter,
     _Inout_ NBL_COUNTED_QUEUE *NblList,
-    _In_ UINT32 XdpInspectFlags
+    _In_ NDIS_PORT_NUMBER PortNumber,
+    _In_ ULONG ReceiveFlags
+    );
+
+//
+// Returns whether NBLs passed to the stack require transformation.
+//
+BOOLEAN
+XdpLwfOffloadNeedTransformNbls(
+    _In_ XDP_LWF_FILTER *Filter
     );
 
 VOID
@@ -112,6 +182,16 @@ XdpLwfOffloadDeactivate(
     _In_ XDP_LWF_FILTER *Filter
     );
 
+VOID
+XdpLwfOffloadPause(
+    _In_ XDP_LWF_FILTER *Filter
+    );
+
+VOID
+XdpLwfOffloadRestart(
+    _In_ XDP_LWF_FILTER *Filter
+    );
+
 NTSTATUS
 XdpLwfOffloadStart(
     _In_ XDP_LWF_FILTER *Filter
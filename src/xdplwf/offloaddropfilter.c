@@ -0,0 +1,88 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#include "precomp.h"
+#include "offloaddropfilter.tmh"
+
+NTSTATUS
+XdpLwfOffloadDropFilterSet(
+    _In_ XDP_LWF_FILTER *Filter,
+    _In_ XDP_LWF_INTERFACE_OFFLOAD_CONTEXT *OffloadContext,
+    _In_ const XDP_OFFLOAD_PARAMS_DROP_FILTER *XdpDropFilterParams,
+    _In_ UINT32 XdpDropFilterParamsSize
+    )
+{
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_LWF, "Filter=%p OffloadContext=%p", Filter, OffloadContext);
+
+    if (XdpDropFilterParamsSize != sizeof(*XdpDropFilterParams) ||
+        XdpDropFilterParams->FilterCount > XDP_LWF_GENERIC_DROP_FILTER_MAX_FILTERS ||
+        (XdpDropFilterParams->FilterCount > 0 && XdpDropFilterParams->Filters == NULL)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    for (UINT32 Index = 0; Index < XdpDropFilterParams->FilterCount; Index++) {
+        const XDP_OFFLOAD_DROP_FILTER *DropFilter = &XdpDropFilterParams->Filters[Index];
+
+        if ((DropFilter->IpProtocol != IPPROTO_UDP && DropFilter->IpProtocol != IPPROTO_TCP) ||
+            (DropFilter->IpProtocol == IPPROTO_TCP && DropFilter->DestinationPort == 0)) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+    }
+
+    if (OffloadContext->Edge != XdpOffloadEdgeLower) {
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    //
+    // NDIS does not expose NIC flow tables with a drop action to filter
+    // drivers, so drop filters are not programmed into hardware. Instead,
+    // emulate them at the top of the generic receive path, ahead of RSS
+    // queue selection and XDP inspection.
+    //
+    Status = XdpGenericRssSetDropFilters(&Filter->Generic, XdpDropFilterParams);
+
+Exit:
+
+    TraceExitStatus(TRACE_LWF);
+
+    return Status;
+}
+
+NTSTATUS
+XdpLwfOffloadDropFilterGet(
+    _In_ XDP_LWF_FILTER *Filter,
+    _In_ XDP_LWF_INTERFACE_OFFLOAD_CONTEXT *OffloadContext,
+    _Inout_ XDP_OFFLOAD_PARAMS_DROP_FILTER *XdpDropFilterParams,
+    _Inout_ UINT32 *XdpDropFilterParamsSize
+    )
+{
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_LWF, "Filter=%p OffloadContext=%p", Filter, OffloadContext);
+
+    if (*XdpDropFilterParamsSize != sizeof(*XdpDropFilterParams) ||
+        XdpDropFilterParams->Hits == NULL) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    if (OffloadContext->Edge != XdpOffloadEdgeLower) {
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    Status = XdpGenericRssGetDropFilterHits(&Filter->Generic, XdpDropFilterParams);
+
+Exit:
+
+    TraceExitStatus(TRACE_LWF);
+
+    return Status;
+}
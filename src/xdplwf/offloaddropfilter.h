@@ -0,0 +1,24 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+#include "offload.h"
+
+NTSTATUS
+XdpLwfOffloadDropFilterSet(
+    _In_ XDP_LWF_FILTER *Filter,
+    _In_ XDP_LWF_INTERFACE_OFFLOAD_CONTEXT *OffloadContext,
+    _In_ const XDP_OFFLOAD_PARAMS_DROP_FILTER *XdpDropFilterParams,
+    _In_ UINT32 XdpDropFilterParamsSize
+    );
+
+NTSTATUS
+XdpLwfOffloadDropFilterGet(
+    _In_ XDP_LWF_FILTER *Filter,
+    _In_ XDP_LWF_INTERFACE_OFFLOAD_CONTEXT *OffloadContext,
+    _Inout_ XDP_OFFLOAD_PARAMS_DROP_FILTER *XdpDropFilterParams,
+    _Inout_ UINT32 *XdpDropFilterParamsSize
+    );
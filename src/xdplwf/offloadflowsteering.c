@@ -0,0 +1,44 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#include "precomp.h"
+#include "offloadflowsteering.tmh"
+
+NTSTATUS
+XdpLwfOffloadFlowSteeringSet(
+    _In_ XDP_LWF_FILTER *Filter,
+    _In_ XDP_LWF_INTERFACE_OFFLOAD_CONTEXT *OffloadContext,
+    _In_ const XDP_OFFLOAD_PARAMS_FLOW_STEERING *XdpFlowSteeringParams,
+    _In_ UINT32 XdpFlowSteeringParamsSize
+    )
+{
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_LWF, "Filter=%p OffloadContext=%p", Filter, OffloadContext);
+
+    if (XdpFlowSteeringParamsSize != sizeof(*XdpFlowSteeringParams) ||
+        XdpFlowSteeringParams->FilterCount == 0) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    if (OffloadContext->Edge != XdpOffloadEdgeLower) {
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    //
+    // NDIS receive filters steer flows to VMQ queues rather than RSS queues,
+    // so hardware n-tuple filters are not programmed. Instead, emulate flow
+    // steering in the generic RSS layer.
+    //
+    Status = XdpGenericRssSetFlowSteering(&Filter->Generic, XdpFlowSteeringParams);
+
+Exit:
+
+    TraceExitStatus(TRACE_LWF);
+
+    return Status;
+}
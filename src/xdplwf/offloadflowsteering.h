@@ -0,0 +1,16 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+#include "offload.h"
+
+NTSTATUS
+XdpLwfOffloadFlowSteeringSet(
+    _In_ XDP_LWF_FILTER *Filter,
+    _In_ XDP_LWF_INTERFACE_OFFLOAD_CONTEXT *OffloadContext,
+    _In_ const XDP_OFFLOAD_PARAMS_FLOW_STEERING *XdpFlowSteeringParams,
+    _In_ UINT32 XdpFlowSteeringParamsSize
+    );
@@ -213,6 +213,17 @@ RetryWithPrototypeOid:
             goto RetryWithPrototypeOid;
         }
 
+        if (Status == NDIS_STATUS_NOT_SUPPORTED) {
+            //
+            // The miniport does not support QEO, so fall back to the generic
+            // data path's software implementation, if enabled.
+            //
+            Status = XdpGenericQeoSet(&Filter->Generic, XdpQeoParams);
+            if (Status != STATUS_NOT_SUPPORTED) {
+                goto Exit;
+            }
+        }
+
         TraceError(
             TRACE_LWF,
             "OffloadContext=%p Failed OID=%x Status=%!STATUS!",
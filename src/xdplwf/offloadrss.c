@@ -8,6 +8,19 @@
 
 #define RSS_HASH_SECRET_KEY_MAX_SIZE NDIS_RSS_HASH_SECRET_KEY_MAX_SIZE_REVISION_2
 
+//
+// The RSS rebalancer is disabled by default. When enabled, the indirection
+// table is reprogrammed at most once per holdoff period, and only if the
+// hottest eligible queue has at least the minimum load and twice the load of
+// the coolest eligible queue.
+//
+#define RSS_REBALANCE_DEFAULT_INTERVAL_MS 0
+#define RSS_REBALANCE_MIN_INTERVAL_MS 100
+#define RSS_REBALANCE_HOLDOFF_INTERVALS 4
+#define RSS_REBALANCE_MIN_LOAD 1000
+
+static UINT32 RssRebalanceIntervalMs = RSS_REBALANCE_DEFAULT_INTERVAL_MS;
+
 static
 BOOLEAN
 XdpLwfOffloadIsNdisRssEnabled(
@@ -227,6 +240,17 @@ CreateNdisRssParamsFromXdpRssParams(
     UINT32 NdisRssParamsLength;
     UINT32 ExtraLength;
 
+    if (XdpRssParams->State == XdpOffloadStateEnabled &&
+        (XdpRssParams->Flags & XDP_RSS_FLAG_SYMMETRIC_HASH) &&
+        !XdpGenericRssIsSymmetricHashSecretKey(
+            XdpRssParams->HashSecretKey, XdpRssParams->HashSecretKeySize)) {
+        TraceError(
+            TRACE_LWF, "Hash secret key is not symmetric HashSecretKeySize=%u",
+            XdpRssParams->HashSecretKeySize);
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
     ExtraLength = XdpRssParams->IndirectionTableSize + XdpRssParams->HashSecretKeySize;
 
     //
@@ -522,6 +546,11 @@ XdpLwfOffloadRssGetWorker(
     } else {
         RtlCopyMemory(
             Request->RssParams, &CurrentRssSetting->Params, sizeof(CurrentRssSetting->Params));
+        if (Request->RssParams->State == XdpOffloadStateEnabled &&
+            XdpGenericRssIsSymmetricHashSecretKey(
+                Request->RssParams->HashSecretKey, Request->RssParams->HashSecretKeySize)) {
+            Request->RssParams->Flags |= XDP_RSS_FLAG_SYMMETRIC_HASH;
+        }
         *Request->RssParamsLength = sizeof(CurrentRssSetting->Params);
         Request->Status = STATUS_SUCCESS;
     }
@@ -641,6 +670,7 @@ RemoveLowerEdgeRssSetting(
     }
 
     XdpGenericRssApplyIndirection(&Filter->Generic, &Indirection);
+    Filter->Offload.RssRebalance.ParamsValid = FALSE;
 
 Exit:
 
@@ -883,6 +913,17 @@ XdpLwfOffloadRssSetWorker(
     XdpInitializeReferenceCount(&RssSetting->ReferenceCount);
     RtlCopyMemory(&RssSetting->Params, RssParams, Request->RssParamsLength);
 
+    //
+    // Generate a symmetric key if a symmetric hash is requested without a key.
+    //
+    if ((RssSetting->Params.Flags & XDP_RSS_FLAG_SYMMETRIC_HASH) &&
+        !(RssSetting->Params.Flags & XDP_RSS_FLAG_SET_HASH_SECRET_KEY)) {
+        RssSetting->Params.HashSecretKeySize = RSS_HASH_SECRET_KEY_MAX_SIZE;
+        XdpGenericRssGenerateSymmetricHashSecretKey(
+            RssSetting->Params.HashSecretKey, RssSetting->Params.HashSecretKeySize);
+        RssSetting->Params.Flags |= XDP_RSS_FLAG_SET_HASH_SECRET_KEY;
+    }
+
     //
     // Inherit unspecified parameters from the current RSS settings.
     //
@@ -931,6 +972,7 @@ XdpLwfOffloadRssSetWorker(
     Filter->Offload.LowerEdge.Rss = RssSetting;
     Request->OffloadContext->Settings.Rss = RssSetting;
     RssSetting = NULL;
+    Filter->Offload.RssRebalance.ParamsValid = FALSE;
 
     if (OldRssSetting == NULL) {
         Request->AttachRxDatapath = TRUE;
@@ -1040,6 +1082,11 @@ XdpLwfOffloadRssUpdate(
     RssSetting = NULL;
     Status = STATUS_SUCCESS;
 
+    //
+    // The upper edge settings replace any rebalanced indirection table.
+    //
+    Filter->Offload.RssRebalance.ParamsValid = FALSE;
+
     TraceInfo(TRACE_LWF, "Filter=%p updated upper edge RSS settings", Filter);
 
 Exit:
@@ -1057,6 +1104,392 @@ Exit:
     return Status;
 }
 
+static
+_Offload_work_routine_
+BOOLEAN
+XdpLwfOffloadRssRebalanceSample(
+    _In_ XDP_LWF_FILTER *Filter
+    )
+{
+    XDP_LWF_OFFLOAD_RSS_REBALANCE *Rebalance = &Filter->Offload.RssRebalance;
+    XDP_LWF_GENERIC *Generic = &Filter->Generic;
+    XDP_LWF_GENERIC_RSS *Rss = &Generic->Rss;
+    BOOLEAN Valid;
+
+    //
+    // Sample the load on each RSS queue since the previous interval. The
+    // first sample after the RSS queues are (re)created only sets a baseline.
+    //
+
+    RtlAcquirePushLockShared(&Generic->Lock);
+
+    Valid =
+        Rss->Queues != NULL && Rss->Queues == Rebalance->SampledQueues &&
+        Rss->QueueCount == Rebalance->SampledQueueCount;
+
+    for (ULONG Index = 0; Index < Rss->QueueCount; Index++) {
+        XDP_LWF_GENERIC_RSS_QUEUE *RssQueue = &Rss->Queues[Index];
+        XDP_LWF_OFFLOAD_RSS_REBALANCE_QUEUE *Queue = &Rebalance->Queues[Index];
+        UINT64 Load = ReadULong64NoFence(&RssQueue->ReceiveLoad);
+
+        Queue->Load = Valid ? Load - Queue->LastLoad : 0;
+        Queue->LastLoad = Load;
+        Queue->Processor = RssQueue->IdealProcessor;
+
+        //
+        // Queues with an attached XDP receive queue are bound to sockets that
+        // expect their flows to remain on the queue's processor.
+        //
+        Queue->Eligible = ReadPointerNoFence(&RssQueue->RxQueue) == NULL;
+    }
+
+    Rebalance->SampledQueues = Rss->Queues;
+    Rebalance->SampledQueueCount = Rss->QueueCount;
+
+    RtlReleasePushLockShared(&Generic->Lock);
+
+    return Valid;
+}
+
+static
+_Offload_work_routine_
+NTSTATUS
+XdpLwfOffloadRssRebalanceProgram(
+    _In_ XDP_LWF_FILTER *Filter,
+    _In_ const XDP_OFFLOAD_PARAMS_RSS *Params
+    )
+{
+    NTSTATUS Status;
+    NDIS_RECEIVE_SCALE_PARAMETERS *NdisRssParams = NULL;
+    UINT32 NdisRssParamsLength;
+    ULONG BytesReturned;
+    XDP_LWF_GENERIC_INDIRECTION_STORAGE Indirection = {0};
+
+    Status = CreateNdisRssParamsFromXdpRssParams(Params, &NdisRssParams, &NdisRssParamsLength);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status =
+        XdpGenericRssCreateIndirection(
+            &Filter->Generic, NdisRssParams, NdisRssParamsLength, &Indirection);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status =
+        XdpLwfOidInternalRequest(
+            Filter->NdisFilterHandle, XDP_OID_REQUEST_INTERFACE_REGULAR, NdisRequestSetInformation,
+            OID_GEN_RECEIVE_SCALE_PARAMETERS, NdisRssParams, NdisRssParamsLength, 0, 0,
+            &BytesReturned);
+    if (!NT_SUCCESS(Status)) {
+        TraceError(
+            TRACE_LWF,
+            "Filter=%p Failed OID_GEN_RECEIVE_SCALE_PARAMETERS Status=%!STATUS!",
+            Filter, Status);
+        goto Exit;
+    }
+
+    XdpGenericRssApplyIndirection(&Filter->Generic, &Indirection);
+
+Exit:
+
+    if (NdisRssParams != NULL) {
+        ExFreePoolWithTag(NdisRssParams, POOLTAG_OFFLOAD);
+    }
+
+    XdpGenericRssFreeIndirection(&Indirection);
+
+    return Status;
+}
+
+static
+_Offload_work_routine_
+VOID
+XdpLwfOffloadRssRebalance(
+    _In_ XDP_LWF_FILTER *Filter
+    )
+{
+    NTSTATUS Status;
+    XDP_LWF_OFFLOAD_RSS_REBALANCE *Rebalance = &Filter->Offload.RssRebalance;
+    XDP_OFFLOAD_PARAMS_RSS *Params = &Rebalance->Params;
+    const XDP_LWF_OFFLOAD_RSS_REBALANCE_QUEUE *HotQueue = NULL;
+    const XDP_LWF_OFFLOAD_RSS_REBALANCE_QUEUE *ColdQueue = NULL;
+    UINT32 EntryCount;
+    UINT32 HotEntryCount = 0;
+    UINT32 FirstHotIndex = MAXUINT32;
+    UINT32 FirstColdIndex = MAXUINT32;
+    UINT32 MoveCount;
+    UINT32 MovedCount = 0;
+
+    if (!XdpLwfOffloadRssRebalanceSample(Filter)) {
+        return;
+    }
+
+    if (Rebalance->HoldoffIntervals > 0) {
+        Rebalance->HoldoffIntervals--;
+        return;
+    }
+
+    //
+    // Do not override RSS settings owned by an XDP interface offload handle,
+    // and wait for the upper edge to configure RSS before reprogramming it.
+    //
+    if (Filter->Offload.LowerEdge.Rss != NULL ||
+        Filter->Offload.UpperEdge.Rss == NULL ||
+        Filter->Offload.UpperEdge.Rss->Params.State != XdpOffloadStateEnabled) {
+        Rebalance->ParamsValid = FALSE;
+        return;
+    }
+
+    for (ULONG Index = 0; Index < Rebalance->SampledQueueCount; Index++) {
+        const XDP_LWF_OFFLOAD_RSS_REBALANCE_QUEUE *Queue = &Rebalance->Queues[Index];
+
+        if (!Queue->Eligible) {
+            continue;
+        }
+
+        if (HotQueue == NULL || Queue->Load > HotQueue->Load) {
+            HotQueue = Queue;
+        }
+
+        if (ColdQueue == NULL || Queue->Load < ColdQueue->Load) {
+            ColdQueue = Queue;
+        }
+    }
+
+    if (HotQueue == NULL || HotQueue == ColdQueue ||
+        HotQueue->Load < RSS_REBALANCE_MIN_LOAD ||
+        HotQueue->Load < 2 * ColdQueue->Load) {
+        return;
+    }
+
+    if (!Rebalance->ParamsValid) {
+        RtlCopyMemory(Params, &Filter->Offload.UpperEdge.Rss->Params, sizeof(*Params));
+        Rebalance->ParamsValid = TRUE;
+    }
+
+    EntryCount = Params->IndirectionTableSize / sizeof(Params->IndirectionTable[0]);
+
+    for (UINT32 Index = 0; Index < EntryCount; Index++) {
+        ULONG Processor = KeGetProcessorIndexFromNumber(&Params->IndirectionTable[Index]);
+
+        if (Processor == HotQueue->Processor) {
+            HotEntryCount++;
+            FirstHotIndex = min(FirstHotIndex, Index);
+        } else if (Processor == ColdQueue->Processor) {
+            FirstColdIndex = min(FirstColdIndex, Index);
+        }
+    }
+
+    if (HotEntryCount < 2 || FirstColdIndex == MAXUINT32) {
+        return;
+    }
+
+    //
+    // Assuming the load is spread evenly across the hot queue's entries, move
+    // enough entries to equalize the hot and cold queues.
+    //
+    MoveCount =
+        (UINT32)((HotEntryCount * (HotQueue->Load - ColdQueue->Load)) / (2 * HotQueue->Load));
+    MoveCount = max(1, min(MoveCount, HotEntryCount - 1));
+
+    //
+    // Generic RSS assigns queue IDs in order of each processor's first entry
+    // in the indirection table, so leave every first entry in place to keep
+    // queue IDs stable.
+    //
+    for (UINT32 Index = EntryCount - 1; Index > FirstColdIndex && MovedCount < MoveCount; Index--) {
+        if (Index != FirstHotIndex &&
+            KeGetProcessorIndexFromNumber(&Params->IndirectionTable[Index]) ==
+                HotQueue->Processor) {
+            KeGetProcessorNumberFromIndex(ColdQueue->Processor, &Params->IndirectionTable[Index]);
+            MovedCount++;
+        }
+    }
+
+    if (MovedCount == 0) {
+        return;
+    }
+
+    Status = XdpLwfOffloadRssRebalanceProgram(Filter, Params);
+    if (!NT_SUCCESS(Status)) {
+        //
+        // Leave the parameters valid: an earlier rebalanced table may still be
+        // in effect, and must be replaced when the rebalancer stops.
+        //
+        return;
+    }
+
+    Rebalance->HoldoffIntervals = RSS_REBALANCE_HOLDOFF_INTERVALS;
+
+    TraceInfo(
+        TRACE_LWF,
+        "Filter=%p rebalanced RSS HotProcessor=%u HotLoad=%llu ColdProcessor=%u "
+        "ColdLoad=%llu MovedEntries=%u",
+        Filter, HotQueue->Processor, HotQueue->Load, ColdQueue->Processor, ColdQueue->Load,
+        MovedCount);
+}
+
+static
+_Offload_work_routine_
+VOID
+XdpLwfOffloadRssRebalanceRestore(
+    _In_ XDP_LWF_FILTER *Filter
+    )
+{
+    XDP_LWF_OFFLOAD_RSS_REBALANCE *Rebalance = &Filter->Offload.RssRebalance;
+    NTSTATUS Status;
+
+    if (!Rebalance->ParamsValid) {
+        return;
+    }
+
+    Rebalance->ParamsValid = FALSE;
+
+    //
+    // The rebalanced parameters are only valid while the upper edge owns the
+    // RSS settings, so plumb the upper edge indirection table back to the
+    // lower edge.
+    //
+    ASSERT(Filter->Offload.LowerEdge.Rss == NULL);
+    ASSERT(Filter->Offload.UpperEdge.Rss != NULL);
+
+    Status = XdpLwfOffloadRssRebalanceProgram(Filter, &Filter->Offload.UpperEdge.Rss->Params);
+
+    TraceInfo(TRACE_LWF, "Filter=%p restored upper edge RSS Status=%!STATUS!", Filter, Status);
+}
+
+static
+_Offload_work_routine_
+VOID
+XdpLwfOffloadRssRebalanceWorker(
+    _In_ XDP_LWF_OFFLOAD_WORKITEM *WorkItem
+    )
+{
+    XDP_LWF_FILTER *Filter = WorkItem->Filter;
+    XDP_LWF_OFFLOAD_RSS_REBALANCE *Rebalance = &Filter->Offload.RssRebalance;
+    UINT32 IntervalMs = ReadULongNoFence((ULONG *)&RssRebalanceIntervalMs);
+
+    if (Rebalance->Timer == NULL) {
+        //
+        // The rebalancer was shut down after this work item was queued.
+        //
+        return;
+    }
+
+    if (IntervalMs == 0) {
+        //
+        // The rebalancer was disabled via the registry.
+        //
+        WriteBooleanNoFence(&Filter->Generic.Rss.TrackLoad, FALSE);
+        XdpLwfOffloadRssRebalanceRestore(Filter);
+        return;
+    }
+
+    WriteBooleanNoFence(&Filter->Generic.Rss.TrackLoad, TRUE);
+
+    XdpLwfOffloadRssRebalance(Filter);
+
+    (VOID)XdpTimerStart(Rebalance->Timer, IntervalMs, NULL);
+}
+
+static
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpLwfOffloadRssRebalanceTimeout(
+    _In_ VOID *Context
+    )
+{
+    XDP_LWF_FILTER *Filter = Context;
+
+    XdpLwfOffloadQueueWorkItem(
+        Filter, &Filter->Offload.RssRebalance.WorkItem, XdpLwfOffloadRssRebalanceWorker);
+}
+
+static
+_Offload_work_routine_
+VOID
+XdpLwfOffloadRssRebalanceStart(
+    _In_ XDP_LWF_FILTER *Filter
+    )
+{
+    XDP_LWF_OFFLOAD_RSS_REBALANCE *Rebalance = &Filter->Offload.RssRebalance;
+    UINT32 IntervalMs = ReadULongNoFence((ULONG *)&RssRebalanceIntervalMs);
+
+    if (IntervalMs == 0) {
+        return;
+    }
+
+    ASSERT(Rebalance->Timer == NULL);
+
+    Rebalance->Queues =
+        ExAllocatePoolZero(
+            PagedPool,
+            sizeof(*Rebalance->Queues) * KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS),
+            POOLTAG_OFFLOAD);
+    if (Rebalance->Queues == NULL) {
+        TraceError(TRACE_LWF, "Filter=%p Failed to allocate RSS rebalance queues", Filter);
+        return;
+    }
+
+    Rebalance->Timer =
+        XdpTimerCreate(XdpLwfOffloadRssRebalanceTimeout, Filter, XdpLwfDriverObject, NULL);
+    if (Rebalance->Timer == NULL) {
+        TraceError(TRACE_LWF, "Filter=%p Failed to create RSS rebalance timer", Filter);
+        ExFreePoolWithTag(Rebalance->Queues, POOLTAG_OFFLOAD);
+        Rebalance->Queues = NULL;
+        return;
+    }
+
+    TraceInfo(TRACE_LWF, "Filter=%p RSS rebalancer IntervalMs=%u", Filter, IntervalMs);
+
+    (VOID)XdpTimerStart(Rebalance->Timer, IntervalMs, NULL);
+}
+
+static
+_Offload_work_routine_
+VOID
+XdpLwfOffloadRssRebalanceStop(
+    _In_ XDP_LWF_FILTER *Filter
+    )
+{
+    XDP_LWF_OFFLOAD_RSS_REBALANCE *Rebalance = &Filter->Offload.RssRebalance;
+
+    if (Rebalance->Timer == NULL) {
+        return;
+    }
+
+    //
+    // Wait for any in-flight timer callback. A rebalance work item queued by
+    // the final callback runs after this routine and observes the NULL timer.
+    //
+    XdpTimerShutdown(Rebalance->Timer, TRUE, TRUE);
+    Rebalance->Timer = NULL;
+
+    WriteBooleanNoFence(&Filter->Generic.Rss.TrackLoad, FALSE);
+    XdpLwfOffloadRssRebalanceRestore(Filter);
+
+    ExFreePoolWithTag(Rebalance->Queues, POOLTAG_OFFLOAD);
+    Rebalance->Queues = NULL;
+}
+
+VOID
+XdpLwfOffloadRssRegistryUpdate(
+    VOID
+    )
+{
+    NTSTATUS Status;
+    DWORD Value;
+
+    Status = XdpRegQueryDwordValue(XDP_LWF_PARAMETERS_KEY, L"RssRebalanceIntervalMs", &Value);
+    if (NT_SUCCESS(Status) && (Value == 0 || Value >= RSS_REBALANCE_MIN_INTERVAL_MS)) {
+        WriteULongNoFence((ULONG *)&RssRebalanceIntervalMs, Value);
+    } else {
+        WriteULongNoFence((ULONG *)&RssRebalanceIntervalMs, RSS_REBALANCE_DEFAULT_INTERVAL_MS);
+    }
+}
+
 typedef struct _XDP_LWF_OFFLOAD_RSS_INITIALIZE {
     _In_ XDP_LWF_OFFLOAD_WORKITEM WorkItem;
     _Inout_ KEVENT Event;
@@ -1148,6 +1581,8 @@ XdpLwfOffloadRssInitializeWorker(
         goto Exit;
     }
 
+    XdpLwfOffloadRssRebalanceStart(Filter);
+
 Exit:
 
     if (NdisRssParams != NULL) {
@@ -1184,6 +1619,8 @@ XdpLwfOffloadRssDeactivate(
 {
     XDP_LWF_OFFLOAD_SETTING_RSS *OldRssSetting;
 
+    XdpLwfOffloadRssRebalanceStop(Filter);
+
     //
     // All offload handles should be closed, and therefore the lower edge should
     // already be cleaned up.
@@ -1360,20 +1797,274 @@ Exit:
     return Status;
 }
 
+//
+// Receive flags that permit deferring the indication of an NBL. Hints about the
+// indicated chain are dropped when the NBLs are indicated by a DPC.
+//
+#define XDP_LWF_OFFLOAD_RSS_STEERING_RECEIVE_FLAGS \
+    (NDIS_RECEIVE_FLAGS_DISPATCH_LEVEL | NDIS_RECEIVE_FLAGS_SINGLE_ETHER_TYPE | \
+        NDIS_RECEIVE_FLAGS_SINGLE_VLAN | NDIS_RECEIVE_FLAGS_PERFECT_FILTERED | \
+        NDIS_RECEIVE_FLAGS_SINGLE_QUEUE | NDIS_RECEIVE_FLAGS_MORE_NBLS)
+
+static
+_Function_class_(KDEFERRED_ROUTINE)
+_IRQL_requires_max_(DISPATCH_LEVEL)
+_IRQL_requires_min_(DISPATCH_LEVEL)
+_IRQL_requires_(DISPATCH_LEVEL)
+_IRQL_requires_same_
+VOID
+XdpLwfOffloadRssSteeringDpc(
+    _In_ struct _KDPC *Dpc,
+    _In_opt_ VOID *DeferredContext,
+    _In_opt_ VOID *SystemArgument1,
+    _In_opt_ VOID *SystemArgument2
+    )
+{
+    XDP_LWF_OFFLOAD_RSS_STEERING_QUEUE *Queue = DeferredContext;
+    NBL_COUNTED_QUEUE NblList;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+    ASSERT(DeferredContext != NULL);
+
+    NdisInitializeNblCountedQueue(&NblList);
+
+    KeAcquireSpinLockAtDpcLevel(&Queue->Lock);
+    NdisAppendNblCountedQueueToNblCountedQueueFast(&NblList, &Queue->Nbls);
+    KeReleaseSpinLockFromDpcLevel(&Queue->Lock);
+
+    if (!NdisIsNblCountedQueueEmpty(&NblList)) {
+        NdisFIndicateReceiveNetBufferLists(
+            Queue->Filter->NdisFilterHandle, NdisGetNblChainFromNblCountedQueue(&NblList),
+            NDIS_DEFAULT_PORT_NUMBER, (ULONG)NblList.NblCount,
+            NDIS_RECEIVE_FLAGS_DISPATCH_LEVEL);
+    }
+}
+
+static
+_IRQL_requires_(DISPATCH_LEVEL)
 VOID
-XdpLwfOffloadRssNblTransform(
+XdpLwfOffloadRssSteerNbls(
+    _In_ XDP_LWF_OFFLOAD_RSS_STEERING_QUEUE *Queue,
+    _Inout_ NBL_COUNTED_QUEUE *NblList
+    )
+{
+    KeAcquireSpinLockAtDpcLevel(&Queue->Lock);
+    NdisAppendNblCountedQueueToNblCountedQueueFast(&Queue->Nbls, NblList);
+    KeReleaseSpinLockFromDpcLevel(&Queue->Lock);
+
+    KeInsertQueueDpc(&Queue->Dpc, NULL, NULL);
+}
+
+NTSTATUS
+XdpLwfOffloadRssStart(
+    _In_ XDP_LWF_FILTER *Filter
+    )
+{
+    XDP_LWF_OFFLOAD_RSS_STEERING *Steering = &Filter->Offload.RssSteering;
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_LWF, "Filter=%p", Filter);
+
+    Steering->Rundown = ExAllocateCacheAwareRundownProtection(NonPagedPoolNx, POOLTAG_OFFLOAD);
+    if (Steering->Rundown == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    //
+    // The filter attaches in the paused state, so start with the rundown
+    // completed; restarting the filter re-initializes it.
+    //
+    ExWaitForRundownProtectionReleaseCacheAware(Steering->Rundown);
+
+    Steering->QueueCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    Steering->Queues =
+        ExAllocatePoolZero(
+            NonPagedPoolNxCacheAligned, sizeof(*Steering->Queues) * Steering->QueueCount,
+            POOLTAG_OFFLOAD);
+    if (Steering->Queues == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    for (ULONG Index = 0; Index < Steering->QueueCount; Index++) {
+        XDP_LWF_OFFLOAD_RSS_STEERING_QUEUE *Queue = &Steering->Queues[Index];
+        PROCESSOR_NUMBER ProcessorNumber;
+
+        KeInitializeSpinLock(&Queue->Lock);
+        NdisInitializeNblCountedQueue(&Queue->Nbls);
+        Queue->Filter = Filter;
+        KeInitializeDpc(&Queue->Dpc, XdpLwfOffloadRssSteeringDpc, Queue);
+        FRE_ASSERT(NT_SUCCESS(KeGetProcessorNumberFromIndex(Index, &ProcessorNumber)));
+        KeSetTargetProcessorDpcEx(&Queue->Dpc, &ProcessorNumber);
+
+        //
+        // Like the default importance, append the DPC to the tail of the
+        // target's DPC queue, but also drain the queue promptly even when it
+        // is queued from another processor.
+        //
+        KeSetImportanceDpc(&Queue->Dpc, MediumHighImportance);
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_LWF);
+
+    return Status;
+}
+
+VOID
+XdpLwfOffloadRssUnInitialize(
+    _In_ XDP_LWF_FILTER *Filter
+    )
+{
+    XDP_LWF_OFFLOAD_RSS_STEERING *Steering = &Filter->Offload.RssSteering;
+
+    if (Steering->Queues != NULL) {
+        for (ULONG Index = 0; Index < Steering->QueueCount; Index++) {
+            ASSERT(NdisIsNblCountedQueueEmpty(&Steering->Queues[Index].Nbls));
+        }
+
+        ExFreePoolWithTag(Steering->Queues, POOLTAG_OFFLOAD);
+        Steering->Queues = NULL;
+    }
+
+    if (Steering->Rundown != NULL) {
+        ExFreeCacheAwareRundownProtection(Steering->Rundown);
+        Steering->Rundown = NULL;
+    }
+}
+
+VOID
+XdpLwfOffloadRssPause(
+    _In_ XDP_LWF_FILTER *Filter
+    )
+{
+    XDP_LWF_OFFLOAD_RSS_STEERING *Steering = &Filter->Offload.RssSteering;
+
+    //
+    // Stop steering NBLs to other processors, then wait for the steering DPCs
+    // to indicate the NBLs already steered, since the filter must not indicate
+    // NBLs once paused.
+    //
+    ExWaitForRundownProtectionReleaseCacheAware(Steering->Rundown);
+    KeFlushQueuedDpcs();
+}
+
+VOID
+XdpLwfOffloadRssRestart(
+    _In_ XDP_LWF_FILTER *Filter
+    )
+{
+    ExReInitializeRundownProtectionCacheAware(Filter->Offload.RssSteering.Rundown);
+}
+
+_IRQL_requires_(DISPATCH_LEVEL)
+VOID
+XdpLwfOffloadRssTransformNbls(
     _In_ XDP_LWF_FILTER *Filter,
-    _Inout_ NET_BUFFER_LIST *Nbl
+    _Inout_ NBL_COUNTED_QUEUE *NblList,
+    _In_ NDIS_PORT_NUMBER PortNumber,
+    _In_ ULONG ReceiveFlags
     )
 {
+    XDP_LWF_OFFLOAD_RSS_STEERING *Steering = &Filter->Offload.RssSteering;
+    XDP_LWF_OFFLOAD_SETTING_RSS *UpperEdgeRss = ReadPointerNoFence(&Filter->Offload.UpperEdge.Rss);
+    const XDP_OFFLOAD_PARAMS_RSS *Params = NULL;
+    XDP_LWF_OFFLOAD_RSS_STEERING_QUEUE *SteeringQueue = NULL;
+    NBL_COUNTED_QUEUE SteeringList;
+    NET_BUFFER_LIST *Nbl;
+    ULONG CurrentProcessor = KeGetCurrentProcessorIndex();
+    ULONG NdisHashTypes = 0;
+    UINT32 IndirectionEntryCount = 0;
+    BOOLEAN Steer = FALSE;
+
+    //
+    // The lower edge RSS settings are owned by XDP, so re-hash the NBLs with
+    // the upper edge settings and indicate each NBL on the processor the upper
+    // edge indirection table selects, as the NIC would have. NBLs steered to
+    // another processor are queued to a DPC on that processor, in batches of
+    // consecutive NBLs steered to the same processor, which preserves the
+    // order of each flow. The upper edge settings are freed only after all
+    // processors have passed through DISPATCH_LEVEL.
     //
-    // Ideally the transformation would be to re-hash and schedule the NBLs onto
-    // the appropriate RSS processors according to the upper edge RSS settings.
-    // As a minimal effort transformation that should still work, clear the hash
-    // OOB fields.
+    // NBLs that cannot be re-hashed have their hash OOB fields cleared, and
+    // are indicated on the current processor.
     //
-    UNREFERENCED_PARAMETER(Filter);
-    NET_BUFFER_LIST_SET_HASH_FUNCTION(Nbl, 0);
-    NET_BUFFER_LIST_SET_HASH_TYPE(Nbl, 0);
-    NET_BUFFER_LIST_SET_HASH_VALUE(Nbl, 0);
+
+    if (UpperEdgeRss != NULL &&
+        UpperEdgeRss->Params.State == XdpOffloadStateEnabled &&
+        UpperEdgeRss->Params.HashType != 0) {
+        Params = &UpperEdgeRss->Params;
+        NdisHashTypes = XdpToNdisRssHashType(Params->HashType);
+        IndirectionEntryCount = Params->IndirectionTableSize / sizeof(*Params->IndirectionTable);
+
+        Steer =
+            RTL_IS_POWER_OF_TWO(IndirectionEntryCount) &&
+            PortNumber == NDIS_DEFAULT_PORT_NUMBER &&
+            (ReceiveFlags & ~XDP_LWF_OFFLOAD_RSS_STEERING_RECEIVE_FLAGS) == 0 &&
+            ExAcquireRundownProtectionCacheAware(Steering->Rundown);
+    }
+
+    Nbl = NdisGetNblChainFromNblCountedQueue(NblList);
+    NdisInitializeNblCountedQueue(NblList);
+    NdisInitializeNblCountedQueue(&SteeringList);
+
+    while (Nbl != NULL) {
+        NET_BUFFER_LIST *NextNbl = Nbl->Next;
+        ULONG Processor = CurrentProcessor;
+        ULONG HashType;
+        UINT32 Hash;
+
+        Nbl->Next = NULL;
+
+        if (Params != NULL &&
+            XdpGenericRssComputeHash(
+                NdisHashTypes, Params->HashSecretKey, Params->HashSecretKeySize, Nbl, &Hash,
+                &HashType)) {
+            NET_BUFFER_LIST_SET_HASH_FUNCTION(Nbl, NdisHashFunctionToeplitz);
+            NET_BUFFER_LIST_SET_HASH_TYPE(Nbl, HashType);
+            NET_BUFFER_LIST_SET_HASH_VALUE(Nbl, Hash);
+
+            if (Steer) {
+                Processor =
+                    KeGetProcessorIndexFromNumber(
+                        &Params->IndirectionTable[Hash & (IndirectionEntryCount - 1)]);
+                if (Processor >= Steering->QueueCount) {
+                    Processor = CurrentProcessor;
+                }
+            }
+        } else {
+            NET_BUFFER_LIST_SET_HASH_FUNCTION(Nbl, 0);
+            NET_BUFFER_LIST_SET_HASH_TYPE(Nbl, 0);
+            NET_BUFFER_LIST_SET_HASH_VALUE(Nbl, 0);
+        }
+
+        if (Processor == CurrentProcessor) {
+            NdisAppendSingleNblToNblCountedQueue(NblList, Nbl);
+        } else {
+            if (SteeringQueue != &Steering->Queues[Processor]) {
+                if (SteeringQueue != NULL) {
+                    XdpLwfOffloadRssSteerNbls(SteeringQueue, &SteeringList);
+                }
+                SteeringQueue = &Steering->Queues[Processor];
+            }
+
+            NdisAppendSingleNblToNblCountedQueue(&SteeringList, Nbl);
+        }
+
+        Nbl = NextNbl;
+    }
+
+    if (SteeringQueue != NULL) {
+        XdpLwfOffloadRssSteerNbls(SteeringQueue, &SteeringList);
+    }
+
+    if (Steer) {
+        ExReleaseRundownProtectionCacheAware(Steering->Rundown);
+    }
 }
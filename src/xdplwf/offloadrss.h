@@ -30,6 +30,11 @@ XdpLwfOffloadRssSet(
     _In_ UINT32 RssParamsLength
     );
 
+VOID
+XdpLwfOffloadRssRegistryUpdate(
+    VOID
+    );
+
 VOID
 XdpLwfOffloadRssInitialize(
     _In_ XDP_LWF_FILTER *Filter
@@ -56,8 +61,31 @@ XdpLwfOffloadRssInspectOidRequest(
     _Out_ NDIS_STATUS *CompletionStatus
     );
 
+NTSTATUS
+XdpLwfOffloadRssStart(
+    _In_ XDP_LWF_FILTER *Filter
+    );
+
+VOID
+XdpLwfOffloadRssUnInitialize(
+    _In_ XDP_LWF_FILTER *Filter
+    );
+
+VOID
+XdpLwfOffloadRssPause(
+    _In_ XDP_LWF_FILTER *Filter
+    );
+
+VOID
+XdpLwfOffloadRssRestart(
+    _In_ XDP_LWF_FILTER *Filter
+    );
+
+_IRQL_requires_(DISPATCH_LEVEL)
 VOID
-XdpLwfOffloadRssNblTransform(
+XdpLwfOffloadRssTransformNbls(
     _In_ XDP_LWF_FILTER *Filter,
-    _Inout_ NET_BUFFER_LIST *Nbl
+    _Inout_ NBL_COUNTED_QUEUE *NblList,
+    _In_ NDIS_PORT_NUMBER PortNumber,
+    _In_ ULONG ReceiveFlags
     );
@@ -13,6 +13,7 @@
 #include <ntintsafe.h>
 #include <ntstrsafe.h>
 #include <ndis.h>
+#include <bcrypt.h>
 #include <ndis/ndl/nblqueue.h>
 #include <ndis/ndl/nblclassify.h>
 #include <netiodef.h>
@@ -28,9 +29,13 @@
 #include <xdp/buffervirtualaddress.h>
 #include <xdp/control.h>
 #include <xdp/datapath.h>
+#include <xdp/framechecksum.h>
 #include <xdp/framefragment.h>
+#include <xdp/framegso.h>
 #include <xdp/frameinterfacecontext.h>
+#include <xdp/framelayout.h>
 #include <xdp/framerxaction.h>
+#include <xdp/framerxmetadata.h>
 #include <xdp/hookid.h>
 #include <xdp/ndis6.h>
 #include <xdp/txframecompletioncontext.h>
@@ -43,9 +48,9 @@
 #include <xdppcw.h>
 #include <xdpregistry.h>
 #include <xdprtl.h>
-#include <xdprxqueue_internal.h>
 #include <xdpstatusconvert.h>
 #include <xdptimer.h>
+#include <xdptimerwheel.h>
 #include <xdptxqueue_internal.h>
 #include <xdptrace.h>
 #include <xdpworkqueue.h>
@@ -65,8 +70,11 @@ C_ASSERT(!"NDIS_RUNTIME_VERSION_688 has been publicly defined. Remove redundant
 #include "generic.h"
 #include "native.h"
 #include "offload.h"
+#include "offloaddropfilter.h"
+#include "offloadflowsteering.h"
 #include "offloadqeo.h"
 #include "offloadrss.h"
 #include "oid.h"
+#include "qeo.h"
 #include "recv.h"
 #include "send.h"
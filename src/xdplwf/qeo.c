@@ -0,0 +1,1238 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+//
+// Software QUIC encryption offload (QEO) for the generic data path.
+//
+// When the miniport does not support QEO and the software fallback is enabled
+// via the registry, the generic data path performs QUIC v1 packet protection
+// (RFC 9001) for offloaded connections: short header packets are protected in
+// place as XDP transmits them, and unprotected in place before XDP inspects
+// them on receive. The cryptography runs on the processor executing the queue,
+// which is typically the RSS processor owning the flow.
+//
+// Only the AES-GCM cipher suites are supported, since CNG does not expose the
+// raw ChaCha20 stream cipher required for ChaCha20 header protection.
+//
+
+#include "precomp.h"
+#include "qeo.tmh"
+
+#define QEO_MAX_CONNECTIONS 16384
+
+#define QEO_LONG_HEADER 0x80
+#define QEO_SHORT_HEADER_PROTECTED_BITS 0x1F
+#define QEO_KEY_PHASE_BIT 0x04
+#define QEO_PN_LENGTH_MASK 0x03
+#define QEO_MAX_PN_LENGTH 4
+#define QEO_SAMPLE_OFFSET 4
+#define QEO_SAMPLE_LENGTH 16
+#define QEO_TAG_LENGTH 16
+#define QEO_IV_LENGTH 12
+#define QEO_MAX_PN ((1ui64 << 62) - 1)
+
+//
+// Receive connections configured to continue on decryption failure must pass
+// the original ciphertext up the stack, so they decrypt into a per-processor
+// scratch buffer. Larger payloads are passed up without decryption.
+//
+#define QEO_SCRATCH_SIZE 2048
+
+#define IP4_FRAGMENT_MASK 0x3FFF
+
+typedef struct _XDP_LWF_GENERIC_QEO_CONNECTION {
+    LIST_ENTRY Link;
+    UINT32 AllocationSize;
+    UINT8 Direction;
+    UINT8 DecryptFailureAction;
+    UINT8 KeyPhase;
+    UINT8 ConnectionIdLength;
+    XDP_QUIC_ADDRESS_FAMILY AddressFamily;
+    UINT16 UdpPort;
+    UINT8 Address[16];
+    UINT8 ConnectionId[20];
+    UINT8 PayloadIv[QEO_IV_LENGTH];
+    INT64 NextPacketNumber;
+    BCRYPT_KEY_HANDLE PayloadKey;
+    BCRYPT_KEY_HANDLE HeaderKey;
+    DECLSPEC_ALIGN(MEMORY_ALLOCATION_ALIGNMENT) UCHAR KeyObjects[0];
+} XDP_LWF_GENERIC_QEO_CONNECTION;
+
+typedef struct _XDP_LWF_GENERIC_QEO_DATAGRAM {
+    XDP_QUIC_ADDRESS_FAMILY AddressFamily;
+    const UINT8 *DestinationAddress;
+    UINT16 DestinationPort;
+    UCHAR *Payload;
+    UINT32 PayloadLength;
+} XDP_LWF_GENERIC_QEO_DATAGRAM;
+
+typedef enum _XDP_LWF_GENERIC_QEO_RX_RESULT {
+    QeoRxSkipped,
+    QeoRxDecrypted,
+    QeoRxFailed,
+} XDP_LWF_GENERIC_QEO_RX_RESULT;
+
+static BOOLEAN GenericQeoSoftwareFallback = FALSE;
+
+//
+// CNG providers and scratch buffers are created on first use and destroyed
+// when the driver stops.
+//
+static EX_PUSH_LOCK GenericQeoProviderLock;
+static BCRYPT_ALG_HANDLE GenericQeoAesGcm;
+static BCRYPT_ALG_HANDLE GenericQeoAesEcb;
+static ULONG GenericQeoAesGcmObjectLength;
+static ULONG GenericQeoAesEcbObjectLength;
+static UCHAR *GenericQeoScratch;
+static ULONG GenericQeoScratchProcessorCount;
+
+static
+UINT32
+XdpGenericQeoAddressLength(
+    _In_ XDP_QUIC_ADDRESS_FAMILY AddressFamily
+    )
+{
+    return AddressFamily == XDP_QUIC_ADDRESS_FAMILY_INET4 ? sizeof(IN_ADDR) : sizeof(IN6_ADDR);
+}
+
+static
+UINT32
+XdpGenericQeoHash(
+    _In_ UINT8 Direction,
+    _In_ XDP_QUIC_ADDRESS_FAMILY AddressFamily,
+    _In_ UINT16 UdpPort,
+    _In_ const UINT8 *Address
+    )
+{
+    UINT32 Hash = 2166136261ui32;
+    UINT32 AddressLength = XdpGenericQeoAddressLength(AddressFamily);
+
+    //
+    // FNV-1a over the connection's destination. The connection ID is compared
+    // after lookup, since its length is not encoded in short header packets.
+    //
+    Hash = (Hash ^ Direction) * 16777619ui32;
+    Hash = (Hash ^ (UINT8)UdpPort) * 16777619ui32;
+    Hash = (Hash ^ (UINT8)(UdpPort >> 8)) * 16777619ui32;
+
+    for (UINT32 Index = 0; Index < AddressLength; Index++) {
+        Hash = (Hash ^ Address[Index]) * 16777619ui32;
+    }
+
+    return Hash;
+}
+
+static
+BOOLEAN
+XdpGenericQeoMatchConnection(
+    _In_ const XDP_LWF_GENERIC_QEO_CONNECTION *Connection,
+    _In_ const XDP_QUIC_CONNECTION *Params
+    )
+{
+    return
+        Connection->Direction == Params->Direction &&
+        Connection->AddressFamily == Params->AddressFamily &&
+        Connection->UdpPort == Params->UdpPort &&
+        Connection->ConnectionIdLength == Params->ConnectionIdLength &&
+        RtlEqualMemory(
+            Connection->Address, Params->Address,
+            XdpGenericQeoAddressLength(Connection->AddressFamily)) &&
+        RtlEqualMemory(
+            Connection->ConnectionId, Params->ConnectionId, Connection->ConnectionIdLength);
+}
+
+static
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XdpGenericQeoOpenProvider(
+    _In_ const WCHAR *ChainingMode,
+    _Out_ BCRYPT_ALG_HANDLE *Algorithm,
+    _Out_ ULONG *ObjectLength
+    )
+{
+    NTSTATUS Status;
+    ULONG Result;
+
+    Status =
+        BCryptOpenAlgorithmProvider(Algorithm, BCRYPT_AES_ALGORITHM, NULL, BCRYPT_PROV_DISPATCH);
+    if (!NT_SUCCESS(Status)) {
+        *Algorithm = NULL;
+        goto Exit;
+    }
+
+    Status =
+        BCryptSetProperty(
+            *Algorithm, BCRYPT_CHAINING_MODE, (UCHAR *)ChainingMode,
+            (ULONG)((wcslen(ChainingMode) + 1) * sizeof(WCHAR)), 0);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status =
+        BCryptGetProperty(
+            *Algorithm, BCRYPT_OBJECT_LENGTH, (UCHAR *)ObjectLength, sizeof(*ObjectLength),
+            &Result, 0);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+Exit:
+
+    if (!NT_SUCCESS(Status) && *Algorithm != NULL) {
+        BCryptCloseAlgorithmProvider(*Algorithm, 0);
+        *Algorithm = NULL;
+    }
+
+    return Status;
+}
+
+static
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XdpGenericQeoOpenProviders(
+    VOID
+    )
+{
+    NTSTATUS Status;
+    SIZE_T ScratchSize;
+
+    RtlAcquirePushLockExclusive(&GenericQeoProviderLock);
+
+    if (GenericQeoScratch != NULL) {
+        Status = STATUS_SUCCESS;
+        goto Exit;
+    }
+
+    if (GenericQeoAesGcm == NULL) {
+        Status =
+            XdpGenericQeoOpenProvider(
+                BCRYPT_CHAIN_MODE_GCM, &GenericQeoAesGcm, &GenericQeoAesGcmObjectLength);
+        if (!NT_SUCCESS(Status)) {
+            TraceError(TRACE_GENERIC, "Failed to open AES-GCM provider Status=%!STATUS!", Status);
+            goto Exit;
+        }
+    }
+
+    if (GenericQeoAesEcb == NULL) {
+        Status =
+            XdpGenericQeoOpenProvider(
+                BCRYPT_CHAIN_MODE_ECB, &GenericQeoAesEcb, &GenericQeoAesEcbObjectLength);
+        if (!NT_SUCCESS(Status)) {
+            TraceError(TRACE_GENERIC, "Failed to open AES-ECB provider Status=%!STATUS!", Status);
+            goto Exit;
+        }
+    }
+
+    GenericQeoScratchProcessorCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+    Status = RtlSIZETMult(GenericQeoScratchProcessorCount, QEO_SCRATCH_SIZE, &ScratchSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    GenericQeoScratch = ExAllocatePoolZero(NonPagedPoolNx, ScratchSize, POOLTAG_QEO);
+    if (GenericQeoScratch == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    RtlReleasePushLockExclusive(&GenericQeoProviderLock);
+
+    return Status;
+}
+
+static
+VOID
+XdpGenericQeoFreeConnection(
+    _In_ XDP_LWF_GENERIC_QEO_CONNECTION *Connection
+    )
+{
+    if (Connection->PayloadKey != NULL) {
+        BCryptDestroyKey(Connection->PayloadKey);
+    }
+
+    if (Connection->HeaderKey != NULL) {
+        BCryptDestroyKey(Connection->HeaderKey);
+    }
+
+    RtlSecureZeroMemory(Connection, Connection->AllocationSize);
+    ExFreePoolWithTag(Connection, POOLTAG_QEO);
+}
+
+static
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XdpGenericQeoCreateConnection(
+    _In_ const XDP_QUIC_CONNECTION *Params,
+    _Out_ XDP_LWF_GENERIC_QEO_CONNECTION **NewConnection
+    )
+{
+    NTSTATUS Status;
+    XDP_LWF_GENERIC_QEO_CONNECTION *Connection = NULL;
+    ULONG PayloadKeyObjectLength;
+    ULONG KeyLength;
+    UINT32 AllocationSize;
+
+    switch (Params->CipherType) {
+    case XDP_QUIC_CIPHER_TYPE_AEAD_AES_128_GCM:
+        KeyLength = 16;
+        break;
+    case XDP_QUIC_CIPHER_TYPE_AEAD_AES_256_GCM:
+        KeyLength = 32;
+        break;
+    default:
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    if ((Params->AddressFamily != XDP_QUIC_ADDRESS_FAMILY_INET4 &&
+            Params->AddressFamily != XDP_QUIC_ADDRESS_FAMILY_INET6) ||
+        Params->ConnectionIdLength > sizeof(Params->ConnectionId) ||
+        Params->NextPacketNumber > QEO_MAX_PN) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    PayloadKeyObjectLength =
+        ALIGN_UP_BY(GenericQeoAesGcmObjectLength, MEMORY_ALLOCATION_ALIGNMENT);
+
+    Status = RtlUInt32Add(sizeof(*Connection), PayloadKeyObjectLength, &AllocationSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = RtlUInt32Add(AllocationSize, GenericQeoAesEcbObjectLength, &AllocationSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Connection = ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, POOLTAG_QEO);
+    if (Connection == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Connection->AllocationSize = AllocationSize;
+    Connection->Direction = (UINT8)Params->Direction;
+    Connection->DecryptFailureAction = (UINT8)Params->DecryptFailureAction;
+    Connection->KeyPhase = (UINT8)Params->KeyPhase;
+    Connection->ConnectionIdLength = Params->ConnectionIdLength;
+    Connection->AddressFamily = Params->AddressFamily;
+    Connection->UdpPort = Params->UdpPort;
+    Connection->NextPacketNumber = (INT64)Params->NextPacketNumber;
+    RtlCopyMemory(Connection->Address, Params->Address, sizeof(Connection->Address));
+    RtlCopyMemory(
+        Connection->ConnectionId, Params->ConnectionId, Connection->ConnectionIdLength);
+    RtlCopyMemory(Connection->PayloadIv, Params->PayloadIv, sizeof(Connection->PayloadIv));
+
+    //
+    // Key objects are allocated from non-paged pool so the keys can be used at
+    // dispatch level.
+    //
+    Status =
+        BCryptGenerateSymmetricKey(
+            GenericQeoAesGcm, &Connection->PayloadKey, Connection->KeyObjects,
+            GenericQeoAesGcmObjectLength, (UCHAR *)Params->PayloadKey, KeyLength, 0);
+    if (!NT_SUCCESS(Status)) {
+        Connection->PayloadKey = NULL;
+        goto Exit;
+    }
+
+    Status =
+        BCryptGenerateSymmetricKey(
+            GenericQeoAesEcb, &Connection->HeaderKey,
+            Connection->KeyObjects + PayloadKeyObjectLength, GenericQeoAesEcbObjectLength,
+            (UCHAR *)Params->HeaderKey, KeyLength, 0);
+    if (!NT_SUCCESS(Status)) {
+        Connection->HeaderKey = NULL;
+        goto Exit;
+    }
+
+    *NewConnection = Connection;
+    Connection = NULL;
+
+Exit:
+
+    if (Connection != NULL) {
+        XdpGenericQeoFreeConnection(Connection);
+    }
+
+    return Status;
+}
+
+static
+VOID
+XdpGenericQeoFreeLifetimeTable(
+    _In_ XDP_LIFETIME_ENTRY *Entry
+    )
+{
+    XDP_LWF_GENERIC_QEO_TABLE *Table =
+        CONTAINING_RECORD(Entry, XDP_LWF_GENERIC_QEO_TABLE, DeleteEntry);
+
+    while (!IsListEmpty(&Table->RetiredConnections)) {
+        XDP_LWF_GENERIC_QEO_CONNECTION *Connection =
+            CONTAINING_RECORD(
+                RemoveHeadList(&Table->RetiredConnections), XDP_LWF_GENERIC_QEO_CONNECTION,
+                Link);
+
+        XdpGenericQeoFreeConnection(Connection);
+    }
+
+    ExFreePoolWithTag(Table, POOLTAG_QEO);
+}
+
+static
+VOID
+XdpGenericQeoRetireConnections(
+    _In_opt_ XDP_LWF_GENERIC_QEO_TABLE *Table,
+    _Inout_ LIST_ENTRY *Connections
+    )
+{
+    if (Table != NULL) {
+        //
+        // The data path may still reference these connections through the
+        // table, so free them along with the table.
+        //
+        while (!IsListEmpty(Connections)) {
+            InsertTailList(&Table->RetiredConnections, RemoveHeadList(Connections));
+        }
+
+        XdpLifetimeDelete(XdpGenericQeoFreeLifetimeTable, &Table->DeleteEntry);
+    } else {
+        while (!IsListEmpty(Connections)) {
+            XdpGenericQeoFreeConnection(
+                CONTAINING_RECORD(
+                    RemoveHeadList(Connections), XDP_LWF_GENERIC_QEO_CONNECTION, Link));
+        }
+    }
+}
+
+static
+XDP_LWF_GENERIC_QEO_CONNECTION *
+XdpGenericQeoFindConnection(
+    _In_ XDP_LWF_GENERIC_QEO *Qeo,
+    _In_ const XDP_QUIC_CONNECTION *Params
+    )
+{
+    for (LIST_ENTRY *Entry = Qeo->Connections.Flink;
+        Entry != &Qeo->Connections;
+        Entry = Entry->Flink) {
+        XDP_LWF_GENERIC_QEO_CONNECTION *Connection =
+            CONTAINING_RECORD(Entry, XDP_LWF_GENERIC_QEO_CONNECTION, Link);
+
+        if (XdpGenericQeoMatchConnection(Connection, Params)) {
+            return Connection;
+        }
+    }
+
+    return NULL;
+}
+
+static
+VOID
+XdpGenericQeoFillTable(
+    _In_ XDP_LWF_GENERIC_QEO *Qeo,
+    _Inout_ XDP_LWF_GENERIC_QEO_TABLE *Table
+    )
+{
+    for (LIST_ENTRY *Entry = Qeo->Connections.Flink;
+        Entry != &Qeo->Connections;
+        Entry = Entry->Flink) {
+        XDP_LWF_GENERIC_QEO_CONNECTION *Connection =
+            CONTAINING_RECORD(Entry, XDP_LWF_GENERIC_QEO_CONNECTION, Link);
+        UINT32 Index =
+            XdpGenericQeoHash(
+                Connection->Direction, Connection->AddressFamily, Connection->UdpPort,
+                Connection->Address);
+
+        //
+        // The table is sized to at least twice the connection count, so linear
+        // probing always terminates at an empty bucket.
+        //
+        Index &= Table->BucketMask;
+        while (Table->Buckets[Index] != NULL) {
+            Index = (Index + 1) & Table->BucketMask;
+        }
+
+        Table->Buckets[Index] = Connection;
+
+        if (Connection->Direction == XDP_QUIC_DIRECTION_TRANSMIT) {
+            Table->TxConnectionCount++;
+        } else {
+            Table->RxConnectionCount++;
+        }
+    }
+}
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XdpGenericQeoSet(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ const XDP_OFFLOAD_PARAMS_QEO *QeoParams
+    )
+{
+    NTSTATUS Status;
+    XDP_LWF_GENERIC_QEO *Qeo = &Generic->Qeo;
+    XDP_LWF_GENERIC_QEO_TABLE *OldTable;
+    XDP_LWF_GENERIC_QEO_TABLE *NewTable = NULL;
+    BOOLEAN FallbackEnabled = ReadBooleanNoFence(&GenericQeoSoftwareFallback);
+    BOOLEAN NeedRxDatapath;
+    LIST_ENTRY RetiredConnections;
+    UINT32 MaxConnectionCount;
+    UINT32 BucketCount;
+    UINT32 TableSize;
+
+    TraceEnter(TRACE_GENERIC, "IfIndex=%u", Generic->IfIndex);
+
+    InitializeListHead(&RetiredConnections);
+
+    RtlAcquirePushLockExclusive(&Qeo->Lock);
+
+    if (!FallbackEnabled && IsListEmpty(&Qeo->Connections)) {
+        //
+        // Software QEO is disabled and there are no connections to remove.
+        //
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    if (FallbackEnabled) {
+        Status = XdpGenericQeoOpenProviders();
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    //
+    // Build a new immutable table from the current connections and the
+    // requested changes, then atomically replace the data path's table.
+    //
+    MaxConnectionCount =
+        min(QEO_MAX_CONNECTIONS, Qeo->ConnectionCount + QeoParams->ConnectionCount);
+
+    BucketCount = 1;
+    while (BucketCount < MaxConnectionCount * 2) {
+        BucketCount <<= 1;
+    }
+
+    Status = RtlUInt32Mult(BucketCount, sizeof(NewTable->Buckets[0]), &TableSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = RtlUInt32Add(TableSize, sizeof(*NewTable), &TableSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    NewTable = ExAllocatePoolZero(NonPagedPoolNx, TableSize, POOLTAG_QEO);
+    if (NewTable == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    InitializeListHead(&NewTable->RetiredConnections);
+    NewTable->BucketMask = BucketCount - 1;
+
+    for (LIST_ENTRY *Entry = QeoParams->Connections.Flink;
+        Entry != &QeoParams->Connections;
+        Entry = Entry->Flink) {
+        XDP_OFFLOAD_PARAMS_QEO_CONNECTION *OffloadConnection =
+            CONTAINING_RECORD(Entry, XDP_OFFLOAD_PARAMS_QEO_CONNECTION, TransactionEntry);
+        XDP_QUIC_CONNECTION *Params = &OffloadConnection->Params;
+        XDP_LWF_GENERIC_QEO_CONNECTION *Existing = XdpGenericQeoFindConnection(Qeo, Params);
+        XDP_LWF_GENERIC_QEO_CONNECTION *Connection;
+        NTSTATUS ConnectionStatus;
+
+        switch (Params->Operation) {
+        case XDP_QUIC_OPERATION_ADD:
+            if (!FallbackEnabled) {
+                ConnectionStatus = STATUS_NOT_SUPPORTED;
+                break;
+            }
+
+            if (Existing == NULL && Qeo->ConnectionCount >= MaxConnectionCount) {
+                ConnectionStatus = STATUS_QUOTA_EXCEEDED;
+                break;
+            }
+
+            ConnectionStatus = XdpGenericQeoCreateConnection(Params, &Connection);
+            if (!NT_SUCCESS(ConnectionStatus)) {
+                break;
+            }
+
+            if (Existing != NULL) {
+                //
+                // Adding an existing connection replaces its keys and state.
+                //
+                RemoveEntryList(&Existing->Link);
+                InsertTailList(&RetiredConnections, &Existing->Link);
+                Qeo->ConnectionCount--;
+            }
+
+            InsertTailList(&Qeo->Connections, &Connection->Link);
+            Qeo->ConnectionCount++;
+            break;
+
+        case XDP_QUIC_OPERATION_REMOVE:
+            //
+            // Removing an absent connection succeeds so offload reverts are
+            // idempotent.
+            //
+            if (Existing != NULL) {
+                RemoveEntryList(&Existing->Link);
+                InsertTailList(&RetiredConnections, &Existing->Link);
+                Qeo->ConnectionCount--;
+            }
+            ConnectionStatus = STATUS_SUCCESS;
+            break;
+
+        default:
+            ASSERT(FALSE);
+            ConnectionStatus = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        Params->Status = HRESULT_FROM_WIN32(RtlNtStatusToDosErrorNoTeb(ConnectionStatus));
+    }
+
+    XdpGenericQeoFillTable(Qeo, NewTable);
+
+    if (Qeo->ConnectionCount == 0) {
+        ExFreePoolWithTag(NewTable, POOLTAG_QEO);
+        NewTable = NULL;
+    }
+
+    //
+    // Software decryption requires the LWF receive data path to be inserted,
+    // even if no XDP program or socket is attached to the interface.
+    //
+    NeedRxDatapath = NewTable != NULL && NewTable->RxConnectionCount > 0;
+    if (NeedRxDatapath && !Qeo->RxDatapathAttached) {
+        XdpGenericAttachDatapath(Generic, TRUE, FALSE);
+        Qeo->RxDatapathAttached = TRUE;
+    }
+
+    OldTable = Qeo->Table;
+    WritePointerRelease(&Qeo->Table, NewTable);
+    NewTable = NULL;
+
+    XdpGenericQeoRetireConnections(OldTable, &RetiredConnections);
+
+    if (!NeedRxDatapath && Qeo->RxDatapathAttached) {
+        XdpGenericDetachDatapath(Generic, TRUE, FALSE);
+        Qeo->RxDatapathAttached = FALSE;
+    }
+
+    TraceInfo(
+        TRACE_GENERIC, "IfIndex=%u software QEO ConnectionCount=%u",
+        Generic->IfIndex, Qeo->ConnectionCount);
+
+Exit:
+
+    RtlReleasePushLockExclusive(&Qeo->Lock);
+
+    if (NewTable != NULL) {
+        ExFreePoolWithTag(NewTable, POOLTAG_QEO);
+    }
+
+    TraceExitStatus(TRACE_GENERIC);
+
+    return Status;
+}
+
+static
+BOOLEAN
+XdpGenericQeoParseDatagram(
+    _In_reads_bytes_(FrameLength) UCHAR *Frame,
+    _In_ UINT32 FrameLength,
+    _In_ BOOLEAN ValidateUdpLength,
+    _Out_ XDP_LWF_GENERIC_QEO_DATAGRAM *Datagram
+    )
+{
+    const ETHERNET_HEADER *Ethernet = (const ETHERNET_HEADER *)Frame;
+    const UDP_HDR *Udp;
+    UINT32 Offset = sizeof(*Ethernet);
+
+    if (FrameLength < Offset) {
+        return FALSE;
+    }
+
+    if (Ethernet->Type == htons(ETHERNET_TYPE_IPV4)) {
+        const IPV4_HEADER *Ipv4 = (const IPV4_HEADER *)(Frame + Offset);
+
+        if (FrameLength < Offset + sizeof(*Ipv4) ||
+            Ipv4->HeaderLength < sizeof(*Ipv4) / sizeof(UINT32) ||
+            (ntohs(Ipv4->FlagsAndOffset) & IP4_FRAGMENT_MASK) != 0 ||
+            Ipv4->Protocol != IPPROTO_UDP) {
+            return FALSE;
+        }
+
+        Datagram->AddressFamily = XDP_QUIC_ADDRESS_FAMILY_INET4;
+        Datagram->DestinationAddress = (const UINT8 *)&Ipv4->DestinationAddress;
+        Offset += Ipv4->HeaderLength * sizeof(UINT32);
+    } else if (Ethernet->Type == htons(ETHERNET_TYPE_IPV6)) {
+        const IPV6_HEADER *Ipv6 = (const IPV6_HEADER *)(Frame + Offset);
+
+        //
+        // IPv6 extension headers are not supported.
+        //
+        if (FrameLength < Offset + sizeof(*Ipv6) || Ipv6->NextHeader != IPPROTO_UDP) {
+            return FALSE;
+        }
+
+        Datagram->AddressFamily = XDP_QUIC_ADDRESS_FAMILY_INET6;
+        Datagram->DestinationAddress = (const UINT8 *)&Ipv6->DestinationAddress;
+        Offset += sizeof(*Ipv6);
+    } else {
+        return FALSE;
+    }
+
+    if (FrameLength < Offset + sizeof(*Udp)) {
+        return FALSE;
+    }
+
+    Udp = (const UDP_HDR *)(Frame + Offset);
+    Offset += sizeof(*Udp);
+
+    //
+    // Received datagrams must be exactly described by the UDP header; this
+    // excludes coalesced and padded frames.
+    //
+    if (ValidateUdpLength && ntohs(Udp->uh_ulen) != FrameLength - Offset + sizeof(*Udp)) {
+        return FALSE;
+    }
+
+    Datagram->DestinationPort = Udp->uh_dport;
+    Datagram->Payload = Frame + Offset;
+    Datagram->PayloadLength = FrameLength - Offset;
+
+    return Datagram->PayloadLength > 0;
+}
+
+static
+XDP_LWF_GENERIC_QEO_CONNECTION *
+XdpGenericQeoLookup(
+    _In_ const XDP_LWF_GENERIC_QEO_TABLE *Table,
+    _In_ UINT8 Direction,
+    _In_ const XDP_LWF_GENERIC_QEO_DATAGRAM *Datagram
+    )
+{
+    XDP_LWF_GENERIC_QEO_CONNECTION *Connection;
+    UINT32 AddressLength = XdpGenericQeoAddressLength(Datagram->AddressFamily);
+    UINT32 Index;
+
+    Index =
+        XdpGenericQeoHash(
+            Direction, Datagram->AddressFamily, Datagram->DestinationPort,
+            Datagram->DestinationAddress);
+    Index &= Table->BucketMask;
+
+    while ((Connection = Table->Buckets[Index]) != NULL) {
+        //
+        // The destination connection ID immediately follows the first byte of
+        // a short header packet.
+        //
+        if (Connection->Direction == Direction &&
+            Connection->AddressFamily == Datagram->AddressFamily &&
+            Connection->UdpPort == Datagram->DestinationPort &&
+            RtlEqualMemory(Connection->Address, Datagram->DestinationAddress, AddressLength) &&
+            Datagram->PayloadLength > 1ui32 + Connection->ConnectionIdLength &&
+            RtlEqualMemory(
+                Connection->ConnectionId, Datagram->Payload + 1,
+                Connection->ConnectionIdLength)) {
+            return Connection;
+        }
+
+        Index = (Index + 1) & Table->BucketMask;
+    }
+
+    return NULL;
+}
+
+static
+UINT64
+XdpGenericQeoDecodePacketNumber(
+    _In_ UINT64 ExpectedPacketNumber,
+    _In_ UINT64 TruncatedPacketNumber,
+    _In_ UINT32 PacketNumberLength
+    )
+{
+    UINT64 Window = 1ui64 << (PacketNumberLength * 8);
+    UINT64 HalfWindow = Window / 2;
+    UINT64 Candidate = (ExpectedPacketNumber & ~(Window - 1)) | TruncatedPacketNumber;
+
+    //
+    // RFC 9000 appendix A.3.
+    //
+    if (Candidate + HalfWindow <= ExpectedPacketNumber && Candidate <= QEO_MAX_PN - Window) {
+        return Candidate + Window;
+    }
+
+    if (Candidate > ExpectedPacketNumber + HalfWindow && Candidate >= Window) {
+        return Candidate - Window;
+    }
+
+    return Candidate;
+}
+
+static
+VOID
+XdpGenericQeoAdvancePacketNumber(
+    _Inout_ XDP_LWF_GENERIC_QEO_CONNECTION *Connection,
+    _In_ UINT64 PacketNumber
+    )
+{
+    INT64 Next = ReadNoFence64(&Connection->NextPacketNumber);
+
+    //
+    // Packets of a connection may be processed concurrently by multiple
+    // queues, so only ever advance the next packet number.
+    //
+    while ((UINT64)Next <= PacketNumber) {
+        INT64 Previous =
+            InterlockedCompareExchange64(
+                &Connection->NextPacketNumber, (INT64)(PacketNumber + 1), Next);
+        if (Previous == Next) {
+            break;
+        }
+        Next = Previous;
+    }
+}
+
+static
+BOOLEAN
+XdpGenericQeoHeaderMask(
+    _In_ const XDP_LWF_GENERIC_QEO_CONNECTION *Connection,
+    _In_reads_bytes_(QEO_SAMPLE_LENGTH) const UCHAR *Sample,
+    _Out_writes_bytes_(QEO_SAMPLE_LENGTH) UCHAR *Mask
+    )
+{
+    ULONG Result;
+
+    return
+        NT_SUCCESS(BCryptEncrypt(
+            Connection->HeaderKey, (UCHAR *)Sample, QEO_SAMPLE_LENGTH, NULL, NULL, 0, Mask,
+            QEO_SAMPLE_LENGTH, &Result, 0));
+}
+
+static
+VOID
+XdpGenericQeoInitializeAuthInfo(
+    _In_ const XDP_LWF_GENERIC_QEO_CONNECTION *Connection,
+    _In_ UINT64 PacketNumber,
+    _Out_writes_bytes_(QEO_IV_LENGTH) UCHAR *Nonce,
+    _In_reads_bytes_(HeaderLength) UCHAR *Header,
+    _In_ UINT32 HeaderLength,
+    _In_reads_bytes_(QEO_TAG_LENGTH) UCHAR *Tag,
+    _Out_ BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO *AuthInfo
+    )
+{
+    //
+    // The nonce is the IV XORed with the packet number in network byte order.
+    //
+    RtlCopyMemory(Nonce, Connection->PayloadIv, QEO_IV_LENGTH);
+    for (UINT32 Index = 0; Index < sizeof(PacketNumber); Index++) {
+        Nonce[QEO_IV_LENGTH - 1 - Index] ^= (UCHAR)(PacketNumber >> (Index * 8));
+    }
+
+    BCRYPT_INIT_AUTH_MODE_INFO(*AuthInfo);
+    AuthInfo->pbNonce = Nonce;
+    AuthInfo->cbNonce = QEO_IV_LENGTH;
+    AuthInfo->pbAuthData = Header;
+    AuthInfo->cbAuthData = HeaderLength;
+    AuthInfo->pbTag = Tag;
+    AuthInfo->cbTag = QEO_TAG_LENGTH;
+}
+
+static
+BOOLEAN
+XdpGenericQeoProtectPacket(
+    _Inout_ XDP_LWF_GENERIC_QEO_CONNECTION *Connection,
+    _Inout_updates_bytes_(PacketLength) UCHAR *Packet,
+    _In_ UINT32 PacketLength
+    )
+{
+    BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO AuthInfo;
+    UCHAR Nonce[QEO_IV_LENGTH];
+    UCHAR Mask[QEO_SAMPLE_LENGTH];
+    UINT32 PnOffset = 1 + Connection->ConnectionIdLength;
+    UINT32 PnLength = (Packet[0] & QEO_PN_LENGTH_MASK) + 1;
+    UINT32 HeaderLength = PnOffset + PnLength;
+    UINT32 PayloadLength;
+    UINT64 PacketNumber = 0;
+    ULONG Result;
+
+    //
+    // The application reserves trailing space for the AEAD tag, and pads the
+    // packet so the header protection sample is present; since the packet
+    // number is at most four bytes, the latter implies the former.
+    //
+    C_ASSERT(QEO_SAMPLE_OFFSET + QEO_SAMPLE_LENGTH >= QEO_MAX_PN_LENGTH + QEO_TAG_LENGTH);
+    if (PacketLength < PnOffset + QEO_SAMPLE_OFFSET + QEO_SAMPLE_LENGTH) {
+        return FALSE;
+    }
+
+    //
+    // Never transmit a packet in the clear: packets for a key phase other than
+    // the offloaded one are dropped.
+    //
+    if (!!(Packet[0] & QEO_KEY_PHASE_BIT) != Connection->KeyPhase) {
+        return FALSE;
+    }
+
+    for (UINT32 Index = 0; Index < PnLength; Index++) {
+        PacketNumber = (PacketNumber << 8) | Packet[PnOffset + Index];
+    }
+
+    PacketNumber =
+        XdpGenericQeoDecodePacketNumber(
+            ReadNoFence64(&Connection->NextPacketNumber), PacketNumber, PnLength);
+
+    PayloadLength = PacketLength - HeaderLength - QEO_TAG_LENGTH;
+
+    XdpGenericQeoInitializeAuthInfo(
+        Connection, PacketNumber, Nonce, Packet, HeaderLength,
+        Packet + PacketLength - QEO_TAG_LENGTH, &AuthInfo);
+
+    if (!NT_SUCCESS(BCryptEncrypt(
+            Connection->PayloadKey, Packet + HeaderLength, PayloadLength, &AuthInfo, NULL, 0,
+            Packet + HeaderLength, PayloadLength, &Result, 0))) {
+        return FALSE;
+    }
+
+    if (!XdpGenericQeoHeaderMask(Connection, Packet + PnOffset + QEO_SAMPLE_OFFSET, Mask)) {
+        return FALSE;
+    }
+
+    Packet[0] ^= Mask[0] & QEO_SHORT_HEADER_PROTECTED_BITS;
+    for (UINT32 Index = 0; Index < PnLength; Index++) {
+        Packet[PnOffset + Index] ^= Mask[1 + Index];
+    }
+
+    XdpGenericQeoAdvancePacketNumber(Connection, PacketNumber);
+
+    return TRUE;
+}
+
+static
+XDP_LWF_GENERIC_QEO_RX_RESULT
+XdpGenericQeoUnprotectPacket(
+    _Inout_ XDP_LWF_GENERIC_QEO_CONNECTION *Connection,
+    _Inout_updates_bytes_(PacketLength) UCHAR *Packet,
+    _In_ UINT32 PacketLength
+    )
+{
+    BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO AuthInfo;
+    UCHAR Header[1 + RTL_FIELD_SIZE(XDP_QUIC_CONNECTION, ConnectionId) + QEO_MAX_PN_LENGTH];
+    UCHAR Nonce[QEO_IV_LENGTH];
+    UCHAR Mask[QEO_SAMPLE_LENGTH];
+    UINT32 PnOffset = 1 + Connection->ConnectionIdLength;
+    UINT32 PnLength;
+    UINT32 HeaderLength;
+    UINT32 PayloadLength;
+    UINT64 PacketNumber = 0;
+    UCHAR *Output;
+    ULONG Result;
+
+    if (PacketLength < PnOffset + QEO_SAMPLE_OFFSET + QEO_SAMPLE_LENGTH) {
+        return QeoRxFailed;
+    }
+
+    if (!XdpGenericQeoHeaderMask(Connection, Packet + PnOffset + QEO_SAMPLE_OFFSET, Mask)) {
+        return QeoRxFailed;
+    }
+
+    //
+    // Remove header protection into a copy of the header, so the packet is
+    // only modified once it has been authenticated.
+    //
+    Header[0] = Packet[0] ^ (Mask[0] & QEO_SHORT_HEADER_PROTECTED_BITS);
+
+    //
+    // Packets using another key phase are left for the application, which
+    // drives key updates.
+    //
+    if (!!(Header[0] & QEO_KEY_PHASE_BIT) != Connection->KeyPhase) {
+        return QeoRxSkipped;
+    }
+
+    PnLength = (Header[0] & QEO_PN_LENGTH_MASK) + 1;
+    HeaderLength = PnOffset + PnLength;
+    RtlCopyMemory(Header + 1, Packet + 1, Connection->ConnectionIdLength);
+
+    for (UINT32 Index = 0; Index < PnLength; Index++) {
+        Header[PnOffset + Index] = Packet[PnOffset + Index] ^ Mask[1 + Index];
+        PacketNumber = (PacketNumber << 8) | Header[PnOffset + Index];
+    }
+
+    PacketNumber =
+        XdpGenericQeoDecodePacketNumber(
+            ReadNoFence64(&Connection->NextPacketNumber), PacketNumber, PnLength);
+
+    PayloadLength = PacketLength - HeaderLength - QEO_TAG_LENGTH;
+
+    if (Connection->DecryptFailureAction == XDP_QUIC_DECRYPT_FAILURE_ACTION_CONTINUE) {
+        if (PayloadLength > QEO_SCRATCH_SIZE) {
+            return QeoRxSkipped;
+        }
+
+        Output =
+            GenericQeoScratch + (SIZE_T)KeGetCurrentProcessorIndex() * QEO_SCRATCH_SIZE;
+    } else {
+        Output = Packet + HeaderLength;
+    }
+
+    XdpGenericQeoInitializeAuthInfo(
+        Connection, PacketNumber, Nonce, Header, HeaderLength,
+        Packet + PacketLength - QEO_TAG_LENGTH, &AuthInfo);
+
+    if (!NT_SUCCESS(BCryptDecrypt(
+            Connection->PayloadKey, Packet + HeaderLength, PayloadLength, &AuthInfo, NULL, 0,
+            Output, PayloadLength, &Result, 0))) {
+        return QeoRxFailed;
+    }
+
+    if (Output != Packet + HeaderLength) {
+        RtlCopyMemory(Packet + HeaderLength, Output, PayloadLength);
+    }
+
+    RtlCopyMemory(Packet, Header, HeaderLength);
+
+    XdpGenericQeoAdvancePacketNumber(Connection, PacketNumber);
+
+    return QeoRxDecrypted;
+}
+
+_IRQL_requires_(DISPATCH_LEVEL)
+BOOLEAN
+XdpGenericQeoTransmit(
+    _In_ XDP_LWF_GENERIC_QEO_TABLE *Table,
+    _Inout_updates_bytes_(FrameLength) UCHAR *Frame,
+    _In_ UINT32 FrameLength,
+    _In_ UINT32 Mss
+    )
+{
+    XDP_LWF_GENERIC_QEO_DATAGRAM Datagram;
+    XDP_LWF_GENERIC_QEO_CONNECTION *Connection;
+    UINT32 Offset = 0;
+
+    if (!XdpGenericQeoParseDatagram(Frame, FrameLength, FALSE, &Datagram) ||
+        (Datagram.Payload[0] & QEO_LONG_HEADER)) {
+        return TRUE;
+    }
+
+    Connection = XdpGenericQeoLookup(Table, XDP_QUIC_DIRECTION_TRANSMIT, &Datagram);
+    if (Connection == NULL) {
+        return TRUE;
+    }
+
+    //
+    // Each segment of a GSO frame is a separate QUIC packet of the same
+    // connection. Long header packets are never offloaded.
+    //
+    if (Mss == 0) {
+        Mss = Datagram.PayloadLength;
+    }
+
+    while (Offset < Datagram.PayloadLength) {
+        UCHAR *Packet = Datagram.Payload + Offset;
+        UINT32 PacketLength = min(Mss, Datagram.PayloadLength - Offset);
+
+        if (!(Packet[0] & QEO_LONG_HEADER) &&
+            !XdpGenericQeoProtectPacket(Connection, Packet, PacketLength)) {
+            return FALSE;
+        }
+
+        Offset += PacketLength;
+    }
+
+    return TRUE;
+}
+
+static
+_IRQL_requires_(DISPATCH_LEVEL)
+BOOLEAN
+XdpGenericQeoReceiveNbl(
+    _In_ XDP_LWF_GENERIC_QEO_TABLE *Table,
+    _In_ NET_BUFFER_LIST *Nbl
+    )
+{
+    //
+    // NDIS components may request that packets sent locally be looped back
+    // on the receive path; those were never protected.
+    //
+    if (NdisTestNblFlag(Nbl, NDIS_NBL_FLAGS_IS_LOOPBACK_PACKET)) {
+        return TRUE;
+    }
+
+    for (NET_BUFFER *Nb = NET_BUFFER_LIST_FIRST_NB(Nbl); Nb != NULL; Nb = NET_BUFFER_NEXT_NB(Nb)) {
+        XDP_LWF_GENERIC_QEO_DATAGRAM Datagram;
+        XDP_LWF_GENERIC_QEO_CONNECTION *Connection;
+        MDL *Mdl = NET_BUFFER_CURRENT_MDL(Nb);
+        UINT32 MdlOffset = NET_BUFFER_CURRENT_MDL_OFFSET(Nb);
+        UCHAR *Frame;
+
+        //
+        // Only frames contained within a single MDL are decrypted.
+        //
+        if (NET_BUFFER_DATA_LENGTH(Nb) > Mdl->ByteCount - MdlOffset) {
+            continue;
+        }
+
+        Frame = MmGetSystemAddressForMdlSafe(Mdl, LowPagePriority | MdlMappingNoExecute);
+        if (Frame == NULL) {
+            continue;
+        }
+        Frame += MdlOffset;
+
+        if (!XdpGenericQeoParseDatagram(Frame, NET_BUFFER_DATA_LENGTH(Nb), TRUE, &Datagram) ||
+            (Datagram.Payload[0] & QEO_LONG_HEADER)) {
+            continue;
+        }
+
+        Connection = XdpGenericQeoLookup(Table, XDP_QUIC_DIRECTION_RECEIVE, &Datagram);
+        if (Connection == NULL) {
+            continue;
+        }
+
+        if (XdpGenericQeoUnprotectPacket(
+                Connection, Datagram.Payload, Datagram.PayloadLength) == QeoRxFailed &&
+            Connection->DecryptFailureAction == XDP_QUIC_DECRYPT_FAILURE_ACTION_DROP) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+_IRQL_requires_(DISPATCH_LEVEL)
+NET_BUFFER_LIST *
+XdpGenericQeoReceive(
+    _In_ XDP_LWF_GENERIC_QEO_TABLE *Table,
+    _In_ NET_BUFFER_LIST *NetBufferLists,
+    _In_ BOOLEAN CanPend,
+    _Inout_ NBL_QUEUE *DropList
+    )
+{
+    NET_BUFFER_LIST *PassHead = NULL;
+    NET_BUFFER_LIST **PassTail = &PassHead;
+
+    while (NetBufferLists != NULL) {
+        NET_BUFFER_LIST *Nbl = NetBufferLists;
+        NetBufferLists = Nbl->Next;
+        Nbl->Next = NULL;
+
+        //
+        // Low resources indications must be returned as a single chain, so
+        // frames failing decryption are passed up rather than dropped.
+        //
+        if (!XdpGenericQeoReceiveNbl(Table, Nbl) && CanPend) {
+            NdisAppendSingleNblToNblQueue(DropList, Nbl);
+        } else {
+            *PassTail = Nbl;
+            PassTail = &Nbl->Next;
+        }
+    }
+
+    return PassHead;
+}
+
+VOID
+XdpGenericQeoInitialize(
+    _Inout_ XDP_LWF_GENERIC *Generic
+    )
+{
+    ExInitializePushLock(&Generic->Qeo.Lock);
+    InitializeListHead(&Generic->Qeo.Connections);
+}
+
+VOID
+XdpGenericQeoCleanup(
+    _In_ XDP_LWF_GENERIC *Generic
+    )
+{
+    XDP_LWF_GENERIC_QEO *Qeo = &Generic->Qeo;
+    XDP_LWF_GENERIC_QEO_TABLE *Table;
+    LIST_ENTRY Connections;
+
+    InitializeListHead(&Connections);
+
+    RtlAcquirePushLockExclusive(&Qeo->Lock);
+
+    Table = Qeo->Table;
+    Qeo->Table = NULL;
+
+    while (!IsListEmpty(&Qeo->Connections)) {
+        InsertTailList(&Connections, RemoveHeadList(&Qeo->Connections));
+    }
+    Qeo->ConnectionCount = 0;
+
+    if (Qeo->RxDatapathAttached) {
+        //
+        // Since we are in the teardown path, there's no need to request the
+        // NDIS data path restart: it will be rejected by NDIS anyways.
+        //
+        RtlAcquirePushLockExclusive(&Generic->Lock);
+        (VOID)XdpGenericDereferenceDatapath(Generic, &Generic->Rx.Datapath);
+        RtlReleasePushLockExclusive(&Generic->Lock);
+        Qeo->RxDatapathAttached = FALSE;
+    }
+
+    RtlReleasePushLockExclusive(&Qeo->Lock);
+
+    XdpGenericQeoRetireConnections(Table, &Connections);
+}
+
+VOID
+XdpGenericQeoRegistryUpdate(
+    VOID
+    )
+{
+    NTSTATUS Status;
+    DWORD Value;
+
+    Status =
+        XdpRegQueryDwordValue(
+            XDP_LWF_PARAMETERS_KEY, L"GenericQeoSoftwareFallback", &Value);
+    if (NT_SUCCESS(Status)) {
+        WriteBooleanNoFence(&GenericQeoSoftwareFallback, !!Value);
+    } else {
+        WriteBooleanNoFence(&GenericQeoSoftwareFallback, FALSE);
+    }
+}
+
+VOID
+XdpGenericQeoStart(
+    VOID
+    )
+{
+    ExInitializePushLock(&GenericQeoProviderLock);
+}
+
+VOID
+XdpGenericQeoStop(
+    VOID
+    )
+{
+    if (GenericQeoScratch != NULL) {
+        ExFreePoolWithTag(GenericQeoScratch, POOLTAG_QEO);
+        GenericQeoScratch = NULL;
+    }
+
+    if (GenericQeoAesEcb != NULL) {
+        BCryptCloseAlgorithmProvider(GenericQeoAesEcb, 0);
+        GenericQeoAesEcb = NULL;
+    }
+
+    if (GenericQeoAesGcm != NULL) {
+        BCryptCloseAlgorithmProvider(GenericQeoAesGcm, 0);
+        GenericQeoAesGcm = NULL;
+    }
+}
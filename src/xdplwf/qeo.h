@@ -0,0 +1,81 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+typedef struct _XDP_LWF_GENERIC XDP_LWF_GENERIC;
+typedef struct _XDP_LWF_GENERIC_QEO_CONNECTION XDP_LWF_GENERIC_QEO_CONNECTION;
+
+//
+// Immutable snapshot of the QUIC connections protected in software. The table
+// is replaced in its entirety whenever the connection set changes; connections
+// removed from the table are freed along with the last table referencing them.
+//
+typedef struct _XDP_LWF_GENERIC_QEO_TABLE {
+    XDP_LIFETIME_ENTRY DeleteEntry;
+    LIST_ENTRY RetiredConnections;
+    UINT32 TxConnectionCount;
+    UINT32 RxConnectionCount;
+    UINT32 BucketMask;
+    XDP_LWF_GENERIC_QEO_CONNECTION *Buckets[0];
+} XDP_LWF_GENERIC_QEO_TABLE;
+
+typedef struct _XDP_LWF_GENERIC_QEO {
+    EX_PUSH_LOCK Lock;
+    LIST_ENTRY Connections;
+    UINT32 ConnectionCount;
+    BOOLEAN RxDatapathAttached;
+    XDP_LWF_GENERIC_QEO_TABLE *Table;
+} XDP_LWF_GENERIC_QEO;
+
+VOID
+XdpGenericQeoInitialize(
+    _Inout_ XDP_LWF_GENERIC *Generic
+    );
+
+VOID
+XdpGenericQeoCleanup(
+    _In_ XDP_LWF_GENERIC *Generic
+    );
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+XdpGenericQeoSet(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ const XDP_OFFLOAD_PARAMS_QEO *QeoParams
+    );
+
+_IRQL_requires_(DISPATCH_LEVEL)
+BOOLEAN
+XdpGenericQeoTransmit(
+    _In_ XDP_LWF_GENERIC_QEO_TABLE *Table,
+    _Inout_updates_bytes_(FrameLength) UCHAR *Frame,
+    _In_ UINT32 FrameLength,
+    _In_ UINT32 Mss
+    );
+
+_IRQL_requires_(DISPATCH_LEVEL)
+NET_BUFFER_LIST *
+XdpGenericQeoReceive(
+    _In_ XDP_LWF_GENERIC_QEO_TABLE *Table,
+    _In_ NET_BUFFER_LIST *NetBufferLists,
+    _In_ BOOLEAN CanPend,
+    _Inout_ NBL_QUEUE *DropList
+    );
+
+VOID
+XdpGenericQeoRegistryUpdate(
+    VOID
+    );
+
+VOID
+XdpGenericQeoStart(
+    VOID
+    );
+
+VOID
+XdpGenericQeoStop(
+    VOID
+    );
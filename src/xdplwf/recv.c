@@ -9,7 +9,9 @@
 #define RECV_MAX_FRAGMENTS 64
 #define RECV_TX_INSPECT_BATCH_SIZE 64
 #define RECV_DEFAULT_MAX_TX_BUFFERS 256
-#define RECV_MAX_MAX_TX_BUFFERS 4096
+#define RECV_COPY_BUFFER_COUNT 32
+#define RECV_COPY_BUFFER_SIZE 2048
+#define RECV_PREFETCH_DEPTH 4
 //
 // Rather than tracking the current lookaside via OIDs, which is subject to
 // theoretical race conditions, simply set the minimum lookahead for forwarding
@@ -24,9 +26,22 @@ typedef struct _XDP_LWF_GENERIC_RX_FRAME_CONTEXT {
     NET_BUFFER *Nb;
 } XDP_LWF_GENERIC_RX_FRAME_CONTEXT;
 
+//
+// The NBLs following the NBL being converted into XDP frames. Each NBL is one
+// pipeline stage further ahead, and each stage prefetches the structure that
+// the next stage dereferences: the NBL, then its first NB, then the NB's
+// current MDL, and finally the frame's headers. The NBL chain is walked
+// serially, so this hides the latency of each dependent cache miss behind the
+// processing of the preceding frames.
+//
+typedef struct _XDP_LWF_GENERIC_RX_PREFETCH {
+    NET_BUFFER_LIST *Nbl[RECV_PREFETCH_DEPTH];
+} XDP_LWF_GENERIC_RX_PREFETCH;
+
 typedef struct _NBL_RX_TX_CONTEXT {
     XDP_LWF_GENERIC_RX_QUEUE *RxQueue;
     XDP_LWF_GENERIC_INJECTION_TYPE InjectionType;
+    XDP_LWF_GENERIC_RX_COPY_BUFFER *CopyBuffer;
 } NBL_RX_TX_CONTEXT;
 
 C_ASSERT(
@@ -36,7 +51,7 @@ C_ASSERT(
     FIELD_OFFSET(NBL_RX_TX_CONTEXT, InjectionType) ==
     FIELD_OFFSET(XDP_LWF_GENERIC_INJECTION_CONTEXT, InjectionType));
 
-#define RX_TX_CONTEXT_SIZE sizeof(NBL_RX_TX_CONTEXT)
+#define RX_TX_CONTEXT_SIZE ALIGN_UP_BY(sizeof(NBL_RX_TX_CONTEXT), MEMORY_ALLOCATION_ALIGNMENT)
 C_ASSERT(RX_TX_CONTEXT_SIZE % MEMORY_ALLOCATION_ALIGNMENT == 0);
 
 static UINT32 RxMaxTxBuffers = RECV_DEFAULT_MAX_TX_BUFFERS;
@@ -54,6 +69,19 @@ NblRxTxContext(
     return (NBL_RX_TX_CONTEXT *)NET_BUFFER_LIST_CONTEXT_DATA_START(NetBufferList);
 }
 
+static
+VOID
+XdpGenericRxClearNblCloneData(
+    _Inout_ NET_BUFFER_LIST *Nbl
+    )
+{
+    Nbl->FirstNetBuffer->MdlChain = NULL;
+    Nbl->FirstNetBuffer->CurrentMdl = NULL;
+    Nbl->FirstNetBuffer->DataLength = 0;
+    Nbl->FirstNetBuffer->DataOffset = 0;
+    Nbl->FirstNetBuffer->CurrentMdlOffset = 0;
+}
+
 static
 UINT32
 XdpGenericRecvInjectReturnNbls(
@@ -78,6 +106,11 @@ XdpGenericRecvInjectReturnNbls(
             if (InterlockedDecrement((LONG *)&Nbl->ParentNetBufferList->ChildRefCount) == 0) {
                 NdisAppendSingleNblToNblQueue(&ReturnList, Nbl->ParentNetBufferList);
             }
+        } else if (NblRxTxContext(Nbl)->CopyBuffer != NULL) {
+            InterlockedPushEntrySList(
+                &RxQueue->CopyBufferSList, &NblRxTxContext(Nbl)->CopyBuffer->Link);
+            NblRxTxContext(Nbl)->CopyBuffer = NULL;
+            XdpGenericRxClearNblCloneData(Nbl);
         } else {
             NdisAdvanceNetBufferListDataStart(Nbl, Nbl->FirstNetBuffer->DataLength, TRUE, NULL);
         }
@@ -96,8 +129,13 @@ XdpGenericRecvInjectReturnNbls(
     NDIS_ASSERT_VALID_NBL_COUNTED_QUEUE(Queue);
     ASSERT(Queue->Queue.First != NULL);
 
+    //
+    // Return the clones to the current processor's magazine; the processor
+    // index only provides locality, so preemption here is harmless.
+    //
     InterlockedPushListSList(
-        &RxQueue->TxCloneNblSList,
+        &RxQueue->TxCloneMagazines[
+            KeGetCurrentProcessorIndex() % RxQueue->TxCloneMagazineCount].NblSList,
         (SLIST_ENTRY *)&Queue->Queue.First->Next,
         (SLIST_ENTRY *)Queue->Queue.Last,
         (ULONG)Queue->NblCount);
@@ -147,6 +185,34 @@ XdpGenericReturnNetBufferLists(
     }
 }
 
+static
+VOID
+XdpGenericFlushHairpin(
+    _In_ XDP_LWF_GENERIC_RX_QUEUE *RxQueue,
+    _Inout_ NBL_COUNTED_QUEUE *TxList
+    )
+{
+    NBL_COUNTED_QUEUE *HairpinList = &RxQueue->HairpinNblQueue;
+
+    if (NdisIsNblCountedQueueEmpty(HairpinList)) {
+        return;
+    }
+
+    //
+    // Forwarded NBLs hold references on their RX queue, released per NBL by
+    // the completion path, so acquire them once for the entire hairpin chain
+    // accumulated during this EC ownership.
+    //
+    if (!ExAcquireRundownProtectionEx(&RxQueue->NblRundown, (ULONG)HairpinList->NblCount)) {
+        XdpGenericRecvInjectReturnNbls(RxQueue, HairpinList);
+    } else {
+        STAT_INC(&RxQueue->PcwStats, HairpinBatches);
+        NdisAppendNblCountedQueueToNblCountedQueueFast(TxList, HairpinList);
+    }
+
+    ASSERT(NdisIsNblCountedQueueEmpty(HairpinList));
+}
+
 static
 VOID
 XdpGenericFlushReceive(
@@ -154,6 +220,12 @@ XdpGenericFlushReceive(
     _In_ XDP_RX_QUEUE_HANDLE XdpRxQueue
     )
 {
+    //
+    // The data path hands off its hairpin chain before releasing the EC, so
+    // no forwarded frames can be pending when the EC is flushed.
+    //
+    ASSERT(NdisIsNblCountedQueueEmpty(&RxQueue->HairpinNblQueue));
+
     XdpFlushReceive(XdpRxQueue);
     RxQueue->FragmentBufferInUse = FALSE;
 }
@@ -255,6 +327,7 @@ XdpGenericReceiveEnterEc(
     _In_ ULONG CurrentProcessor,
     _In_ BOOLEAN TxInspect,
     _In_ BOOLEAN TxWorker,
+    _In_opt_ XDP_LWF_GENERIC_RSS_QUEUE *SteeredRssQueue,
     _Out_ XDP_LWF_GENERIC_RSS_QUEUE **RssQueue,
     _Out_ XDP_LWF_GENERIC_RX_QUEUE **RxQueue,
     _Out_ XDP_RX_QUEUE_HANDLE *XdpRxQueue,
@@ -269,9 +342,15 @@ XdpGenericReceiveEnterEc(
     *XdpRxQueue = NULL;
 
     //
-    // Find the target RSS queue based on the first NBL's RSS hash.
+    // Find the target RSS queue based on the flow steering filters, if any,
+    // otherwise based on the first NBL's RSS hash.
     //
-    *RssQueue = XdpGenericRssGetQueue(Generic, CurrentProcessor, TxInspect, RssHash);
+    if (SteeredRssQueue != NULL) {
+        ASSERT(!TxInspect);
+        *RssQueue = SteeredRssQueue;
+    } else {
+        *RssQueue = XdpGenericRssGetQueue(Generic, CurrentProcessor, TxInspect, RssHash);
+    }
     if (*RssQueue == NULL) {
         //
         // RSS is uninitialized, so pass the NBLs through. Note that the XDP
@@ -432,25 +511,18 @@ XdpGenericReceiveExpandFragmentBuffer(
 
 static
 BOOLEAN
-XdpGenericReceiveLinearizeNb(
+XdpGenericReceiveLinearizeMdls(
     _In_ XDP_LWF_GENERIC_RX_QUEUE *RxQueue,
-    _In_ NET_BUFFER *Nb
+    _In_ MDL *Mdl,
+    _In_ UINT32 MdlOffset,
+    _In_ UINT32 DataLength,
+    _Out_ XDP_BUFFER *Buffer
     )
 {
-    XDP_RING *FrameRing = RxQueue->FrameRing;
-    XDP_FRAME *Frame;
-    XDP_BUFFER *Buffer;
-    MDL *Mdl = NET_BUFFER_CURRENT_MDL(Nb);
-    UINT32 MdlOffset = NET_BUFFER_CURRENT_MDL_OFFSET(Nb);
-    UINT32 DataLength = NET_BUFFER_DATA_LENGTH(Nb);
     XDP_BUFFER_VIRTUAL_ADDRESS *SystemVa;
 
     ASSERT(RxQueue->FragmentBufferInUse == FALSE);
 
-    ASSERT(XdpRingFree(FrameRing) > 0);
-    Frame = XdpRingGetElement(FrameRing, FrameRing->ProducerIndex & FrameRing->Mask);
-
-    Buffer = &Frame->Buffer;
     Buffer->DataLength = 0;
 
     //
@@ -501,16 +573,22 @@ XdpGenericReceiveLinearizeNb(
 }
 
 static
-VOID
-XdpGenericRxClearNblCloneData(
-    _Inout_ NET_BUFFER_LIST *Nbl
+BOOLEAN
+XdpGenericReceiveLinearizeNb(
+    _In_ XDP_LWF_GENERIC_RX_QUEUE *RxQueue,
+    _In_ NET_BUFFER *Nb
     )
 {
-    Nbl->FirstNetBuffer->MdlChain = NULL;
-    Nbl->FirstNetBuffer->CurrentMdl = NULL;
-    Nbl->FirstNetBuffer->DataLength = 0;
-    Nbl->FirstNetBuffer->DataOffset = 0;
-    Nbl->FirstNetBuffer->CurrentMdlOffset = 0;
+    XDP_RING *FrameRing = RxQueue->FrameRing;
+    XDP_FRAME *Frame;
+
+    ASSERT(XdpRingFree(FrameRing) > 0);
+    Frame = XdpRingGetElement(FrameRing, FrameRing->ProducerIndex & FrameRing->Mask);
+
+    return
+        XdpGenericReceiveLinearizeMdls(
+            RxQueue, NET_BUFFER_CURRENT_MDL(Nb), NET_BUFFER_CURRENT_MDL_OFFSET(Nb),
+            NET_BUFFER_DATA_LENGTH(Nb), &Frame->Buffer);
 }
 
 static
@@ -530,6 +608,37 @@ XdpGenericRxFreeNblCloneCache(
     }
 }
 
+static
+NET_BUFFER_LIST *
+XdpGenericRxFlushNblCloneMagazines(
+    _In_ XDP_LWF_GENERIC_RX_QUEUE *RxQueue,
+    _In_ BOOLEAN AllMagazines
+    )
+{
+    UINT32 Index = RxQueue->TxCloneMagazineIndex;
+    UINT32 Count = AllMagazines ? RxQueue->TxCloneMagazineCount : 1;
+
+    //
+    // Completions for a queue tend to land on the same processor(s), so start
+    // with the magazine that most recently refilled the cache.
+    //
+    for (UINT32 i = 0; i < Count; i++) {
+        NET_BUFFER_LIST *NblChain =
+            (NET_BUFFER_LIST *)InterlockedFlushSList(&RxQueue->TxCloneMagazines[Index].NblSList);
+
+        if (NblChain != NULL) {
+            RxQueue->TxCloneMagazineIndex = Index;
+            return NblChain;
+        }
+
+        if (++Index == RxQueue->TxCloneMagazineCount) {
+            Index = 0;
+        }
+    }
+
+    return NULL;
+}
+
 static
 VOID
 XdpGenericReceiveEnqueueTxNb(
@@ -537,12 +646,15 @@ XdpGenericReceiveEnqueueTxNb(
     _Inout_ NBL_COUNTED_QUEUE *TxList,
     _In_ NET_BUFFER_LIST *Nbl,
     _In_ NET_BUFFER *Nb,
+    _In_ UINT32 HeadLength,
+    _In_ UINT32 DataLength,
     _In_ BOOLEAN CanPend
     )
 {
     NET_BUFFER *OriginalFirstNb = Nbl->FirstNetBuffer;
     NET_BUFFER *OriginalNextNb = Nb->Next;
     NET_BUFFER_LIST *TxNbl;
+    XDP_LWF_GENERIC_RX_COPY_BUFFER *CopyBuffer = NULL;
 
     Nbl->FirstNetBuffer = Nb;
     Nbl->FirstNetBuffer->Next = NULL;
@@ -552,25 +664,43 @@ XdpGenericReceiveEnqueueTxNb(
     // TODO: Perform any software offloads required.
     //
 
+    //
+    // Refill the private clone list from the most recently used magazine. Only
+    // search every processor's magazine once the cache has reached its limit
+    // and no more clones can be allocated.
+    //
     if (RxQueue->TxCloneNblList == NULL) {
-        RxQueue->TxCloneNblList =
-            (NET_BUFFER_LIST *)InterlockedFlushSList(&RxQueue->TxCloneNblSList);
+        RxQueue->TxCloneNblList = XdpGenericRxFlushNblCloneMagazines(RxQueue, FALSE);
+
+        if (RxQueue->TxCloneNblList == NULL &&
+            RxQueue->TxCloneCacheCount >= ReadUInt32NoFence(&RxQueue->TxCloneCacheLimit)) {
+            RxQueue->TxCloneNblList = XdpGenericRxFlushNblCloneMagazines(RxQueue, TRUE);
+        }
     }
 
     if (RxQueue->TxCloneNblList != NULL) {
         TxNbl = RxQueue->TxCloneNblList;
         RxQueue->TxCloneNblList = TxNbl->Next;
-    } else if (RxQueue->TxCloneCacheCount < RxQueue->TxCloneCacheLimit) {
+        STAT_INC(&RxQueue->PcwStats, TxCloneCacheHits);
+    } else if (RxQueue->TxCloneCacheCount < ReadUInt32NoFence(&RxQueue->TxCloneCacheLimit)) {
+        STAT_INC(&RxQueue->PcwStats, TxCloneCacheMisses);
         TxNbl =
             NdisAllocateNetBufferAndNetBufferList(
                 RxQueue->TxCloneNblPool, RX_TX_CONTEXT_SIZE, 0, NULL, 0, 0);
         if (TxNbl == NULL) {
             STAT_INC(&RxQueue->PcwStats, ForwardingFailures);
+            STAT_INC(&RxQueue->PcwStats, ForwardingLowResources);
             goto Exit;
         }
 
         RxQueue->TxCloneCacheCount++;
     } else {
+        //
+        // Every clone is awaiting send completion, so the TX path is not
+        // keeping up with the forwarding rate.
+        //
+        STAT_INC(&RxQueue->PcwStats, TxCloneCacheMisses);
+        STAT_INC(&RxQueue->PcwStats, HairpinBackpressure);
         STAT_INC(&RxQueue->PcwStats, ForwardingFailures);
         goto Exit;
     }
@@ -584,40 +714,79 @@ XdpGenericReceiveEnqueueTxNb(
     // local RX path and the frame is potentially discontiguous within L2 or L3
     // headers.
     //
+    // Headers prepended by XDP programs lie in the current MDL, immediately
+    // before the NB's data.
+    //
+    ASSERT(HeadLength <= Nb->CurrentMdlOffset);
+
     if (CanPend &&
             (!RxQueue->Flags.TxInspect ||
                 Nb->CurrentMdl->ByteCount - Nb->CurrentMdlOffset >= RECV_TX_INSPECT_LOOKAHEAD)) {
         TxNbl->FirstNetBuffer->MdlChain = Nb->MdlChain;
         TxNbl->FirstNetBuffer->CurrentMdl = Nb->CurrentMdl;
-        TxNbl->FirstNetBuffer->DataLength = Nb->DataLength;
-        TxNbl->FirstNetBuffer->DataOffset = Nb->DataOffset;
-        TxNbl->FirstNetBuffer->CurrentMdlOffset = Nb->CurrentMdlOffset;
+        TxNbl->FirstNetBuffer->DataLength = DataLength;
+        TxNbl->FirstNetBuffer->DataOffset = Nb->DataOffset - HeadLength;
+        TxNbl->FirstNetBuffer->CurrentMdlOffset = Nb->CurrentMdlOffset - HeadLength;
         TxNbl->ParentNetBufferList = Nbl;
         Nbl->ChildRefCount++;
     } else {
         NDIS_STATUS NdisStatus;
         ULONG BytesCopied;
+        ULONG OriginalDataLength = Nb->DataLength;
+        ULONG OriginalDataOffset = Nb->DataOffset;
+        ULONG OriginalCurrentMdlOffset = Nb->CurrentMdlOffset;
 
         XdpGenericRxClearNblCloneData(TxNbl);
+        STAT_INC(&RxQueue->PcwStats, ForwardingCopies);
 
-        NdisStatus =
-            NdisRetreatNetBufferListDataStart(TxNbl, Nb->DataLength, Nb->DataOffset, NULL, NULL);
-        if (NdisStatus != NDIS_STATUS_SUCCESS) {
-            TxNbl->Next = RxQueue->TxCloneNblList;
-            RxQueue->TxCloneNblList = TxNbl;
-            goto Exit;
+        //
+        // Copy into a preallocated buffer if the frame fits one, sparing NDIS
+        // from allocating a buffer and MDL for the copy.
+        //
+        if (DataLength <= RECV_COPY_BUFFER_SIZE) {
+            CopyBuffer =
+                (XDP_LWF_GENERIC_RX_COPY_BUFFER *)
+                    InterlockedPopEntrySList(&RxQueue->CopyBufferSList);
+        }
+
+        if (CopyBuffer != NULL) {
+            TxNbl->FirstNetBuffer->MdlChain = CopyBuffer->Mdl;
+            TxNbl->FirstNetBuffer->CurrentMdl = CopyBuffer->Mdl;
+            TxNbl->FirstNetBuffer->DataLength = DataLength;
+        } else {
+            STAT_INC(&RxQueue->PcwStats, ForwardingCopyPoolMisses);
+
+            NdisStatus =
+                NdisRetreatNetBufferListDataStart(TxNbl, DataLength, Nb->DataOffset, NULL, NULL);
+            if (NdisStatus != NDIS_STATUS_SUCCESS) {
+                TxNbl->Next = RxQueue->TxCloneNblList;
+                RxQueue->TxCloneNblList = TxNbl;
+                goto Exit;
+            }
         }
 
+        //
+        // A frame grown by its XDP program extends into its final MDL or the
+        // headroom of its current MDL, so temporarily extend the NB to copy
+        // the whole frame.
+        //
+        Nb->DataOffset = OriginalDataOffset - HeadLength;
+        Nb->CurrentMdlOffset = OriginalCurrentMdlOffset - HeadLength;
+        Nb->DataLength = max(OriginalDataLength + HeadLength, DataLength);
         NdisStatus =
             NdisCopyFromNetBufferToNetBuffer(
-                TxNbl->FirstNetBuffer, 0, Nb->DataLength, Nb, 0, &BytesCopied);
+                TxNbl->FirstNetBuffer, 0, DataLength, Nb, 0, &BytesCopied);
+        Nb->DataLength = OriginalDataLength;
+        Nb->CurrentMdlOffset = OriginalCurrentMdlOffset;
+        Nb->DataOffset = OriginalDataOffset;
         ASSERT(NdisStatus == NDIS_STATUS_SUCCESS);
-        ASSERT(BytesCopied == Nb->DataLength);
+        ASSERT(BytesCopied == DataLength);
 
         TxNbl->ParentNetBufferList = NULL;
     }
 
     ASSERT(TxNbl != NULL);
+    NblRxTxContext(TxNbl)->CopyBuffer = CopyBuffer;
     NblRxTxContext(TxNbl)->RxQueue = RxQueue;
     NblRxTxContext(TxNbl)->InjectionType = XDP_LWF_GENERIC_INJECTION_RECV;
     TxNbl->SourceHandle = RxQueue->Generic->NdisFilterHandle;
@@ -637,13 +806,19 @@ XdpGenericReceiveEnqueueTxNbl(
     _Inout_ NBL_COUNTED_QUEUE *TxList,
     _Inout_ NBL_QUEUE *DropList,
     _In_ NET_BUFFER_LIST *Nbl,
+    _In_ UINT32 FirstNbHeadLength,
+    _In_ UINT32 FirstNbDataLength,
     _In_ BOOLEAN CanPend
     )
 {
     Nbl->ChildRefCount = 0;
 
     for (NET_BUFFER *Nb = Nbl->FirstNetBuffer; Nb != NULL; Nb = Nb->Next) {
-        XdpGenericReceiveEnqueueTxNb(RxQueue, TxList, Nbl, Nb, CanPend);
+        BOOLEAN IsFirstNb = (Nb == Nbl->FirstNetBuffer);
+
+        XdpGenericReceiveEnqueueTxNb(
+            RxQueue, TxList, Nbl, Nb, IsFirstNb ? FirstNbHeadLength : 0,
+            IsFirstNb ? FirstNbDataLength : Nb->DataLength, CanPend);
     }
 
     ASSERT(CanPend || Nbl->ChildRefCount == 0);
@@ -653,11 +828,163 @@ XdpGenericReceiveEnqueueTxNbl(
     }
 }
 
+static
+UINT16
+XdpGenericReceiveCoalescedSegmentCount(
+    _In_ const XDP_LWF_GENERIC_RX_QUEUE *RxQueue,
+    _In_ NET_BUFFER_LIST *Nbl
+    )
+{
+    NDIS_RSC_NBL_INFO RscInfo;
+
+    if (RxQueue->Flags.TxInspect) {
+        return 0;
+    }
+
+    RscInfo.Value = NET_BUFFER_LIST_INFO(Nbl, TcpRecvSegCoalesceInfo);
+    return RscInfo.Info.CoalescedSegCount;
+}
+
+static
+XDP_FRAME_RX_CHECKSUM_EVALUATION
+XdpGenericReceiveChecksumEvaluation(
+    _In_ BOOLEAN Succeeded,
+    _In_ BOOLEAN Failed
+    )
+{
+    if (Succeeded && Failed) {
+        return XdpFrameRxChecksumEvaluationInvalid;
+    } else if (Succeeded) {
+        return XdpFrameRxChecksumEvaluationSucceeded;
+    } else if (Failed) {
+        return XdpFrameRxChecksumEvaluationFailed;
+    } else {
+        return XdpFrameRxChecksumEvaluationNotChecked;
+    }
+}
+
+static
+VOID
+XdpGenericReceiveSetRxMetadata(
+    _In_ XDP_LWF_GENERIC_RX_QUEUE *RxQueue,
+    _In_ NET_BUFFER_LIST *Nbl,
+    _Out_ XDP_FRAME_RX_METADATA *RxMetadata
+    )
+{
+    NDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO Checksum;
+
+    RtlZeroMemory(RxMetadata, sizeof(*RxMetadata));
+
+    if (RxQueue->Flags.TxInspect) {
+        //
+        // The NBL OOB fields describe send offloads on the TX path.
+        //
+        return;
+    }
+
+    RxMetadata->RssHashType = NET_BUFFER_LIST_GET_HASH_TYPE(Nbl);
+    if (RxMetadata->RssHashType != 0) {
+        RxMetadata->RssHash = NET_BUFFER_LIST_GET_HASH_VALUE(Nbl);
+    }
+
+    Checksum.Value = NET_BUFFER_LIST_INFO(Nbl, TcpIpChecksumNetBufferListInfo);
+    RxMetadata->Layer3Checksum =
+        (UINT8)XdpGenericReceiveChecksumEvaluation(
+            !!Checksum.Receive.IpChecksumSucceeded, !!Checksum.Receive.IpChecksumFailed);
+    RxMetadata->Layer4Checksum =
+        (UINT8)XdpGenericReceiveChecksumEvaluation(
+            Checksum.Receive.TcpChecksumSucceeded || Checksum.Receive.UdpChecksumSucceeded,
+            Checksum.Receive.TcpChecksumFailed || Checksum.Receive.UdpChecksumFailed);
+
+    RxMetadata->CoalescedSegmentCount = XdpGenericReceiveCoalescedSegmentCount(RxQueue, Nbl);
+}
+
+static
+VOID
+XdpGenericReceivePrefetchStages(
+    _In_ const XDP_LWF_GENERIC_RX_PREFETCH *Prefetch
+    )
+{
+    NET_BUFFER *Nb;
+    MDL *Mdl;
+
+    C_ASSERT(RECV_PREFETCH_DEPTH == 4);
+
+    if (Prefetch->Nbl[0] != NULL) {
+        //
+        // Mapping MDLs may fail, so the frame's headers are prefetched only if
+        // the MDL is already mapped, which is the common case for receive
+        // buffers. The mapping itself is performed when the frame is queued.
+        //
+        Nb = NET_BUFFER_LIST_FIRST_NB(Prefetch->Nbl[0]);
+        Mdl = NET_BUFFER_CURRENT_MDL(Nb);
+        if (Mdl->MdlFlags & (MDL_MAPPED_TO_SYSTEM_VA | MDL_SOURCE_IS_NONPAGED_POOL)) {
+            PreFetchCacheLine(
+                PF_TEMPORAL_LEVEL_1,
+                (UCHAR *)Mdl->MappedSystemVa + NET_BUFFER_CURRENT_MDL_OFFSET(Nb));
+        }
+    }
+
+    if (Prefetch->Nbl[1] != NULL) {
+        Nb = NET_BUFFER_LIST_FIRST_NB(Prefetch->Nbl[1]);
+        PreFetchCacheLine(PF_TEMPORAL_LEVEL_1, NET_BUFFER_CURRENT_MDL(Nb));
+    }
+
+    if (Prefetch->Nbl[2] != NULL) {
+        PreFetchCacheLine(PF_TEMPORAL_LEVEL_1, NET_BUFFER_LIST_FIRST_NB(Prefetch->Nbl[2]));
+    }
+
+    if (Prefetch->Nbl[3] != NULL) {
+        PreFetchCacheLine(PF_TEMPORAL_LEVEL_1, Prefetch->Nbl[3]);
+    }
+}
+
+//
+// Primes the pipeline with the NBLs following the first NBL of a chain.
+//
+static
+VOID
+XdpGenericReceivePrefetchInitialize(
+    _Out_ XDP_LWF_GENERIC_RX_PREFETCH *Prefetch,
+    _In_ NET_BUFFER_LIST *Nbl
+    )
+{
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Prefetch->Nbl); Index++) {
+        Nbl = (Nbl != NULL) ? NET_BUFFER_LIST_NEXT_NBL(Nbl) : NULL;
+        Prefetch->Nbl[Index] = Nbl;
+    }
+
+    XdpGenericReceivePrefetchStages(Prefetch);
+}
+
+//
+// Advances the pipeline once the walk moves to the NBL at the head of the
+// pipeline.
+//
+static
+VOID
+XdpGenericReceivePrefetchAdvance(
+    _Inout_ XDP_LWF_GENERIC_RX_PREFETCH *Prefetch
+    )
+{
+    NET_BUFFER_LIST *Tail = Prefetch->Nbl[RECV_PREFETCH_DEPTH - 1];
+
+    for (UINT32 Index = 0; Index < RECV_PREFETCH_DEPTH - 1; Index++) {
+        Prefetch->Nbl[Index] = Prefetch->Nbl[Index + 1];
+    }
+
+    Prefetch->Nbl[RECV_PREFETCH_DEPTH - 1] =
+        (Tail != NULL) ? NET_BUFFER_LIST_NEXT_NBL(Tail) : NULL;
+
+    XdpGenericReceivePrefetchStages(Prefetch);
+}
+
 static
 VOID
 XdpGenericReceivePreInspectNbs(
     _In_ XDP_LWF_GENERIC_RX_QUEUE *RxQueue,
     _In_ BOOLEAN CanPend,
+    _Inout_ XDP_LWF_GENERIC_RX_PREFETCH *Prefetch,
     _Inout_ NET_BUFFER_LIST **Nbl,
     _Inout_ NET_BUFFER **Nb
     )
@@ -672,6 +999,7 @@ XdpGenericReceivePreInspectNbs(
     XDP_BUFFER_VIRTUAL_ADDRESS *SystemVa;
     UINT32 DataLength;
     XDP_LWF_GENERIC_RX_FRAME_CONTEXT *InterfaceExtension;
+    XDP_FRAME_RX_METADATA *RxMetadata;
     UINT32 FrameRingReservedCount;
 
     //
@@ -717,6 +1045,36 @@ XdpGenericReceivePreInspectNbs(
         // ignore those, but allow trailing bytes in the final buffer.
         //
         for (Mdl = Mdl->Next; Mdl != NULL && DataLength > 0; Mdl = Mdl->Next) {
+            //
+            // If this MDL would occupy the final XDP fragment but more MDLs
+            // follow, copy only the remainder of the MDL chain into the
+            // contiguous buffer and use it as the final fragment. The leading
+            // MDLs, which contain the headers inspected by XDP programs, remain
+            // in place and only the tail of large (e.g. RSC) frames is copied.
+            //
+            if (FragmentCount + 1ui32 == RxQueue->FragmentLimit && DataLength > Mdl->ByteCount) {
+                if (RxQueue->FragmentBufferInUse) {
+                    return;
+                }
+
+                if (++FragmentCount > XdpRingFree(FragmentRing)) {
+                    return;
+                }
+
+                Buffer =
+                    XdpRingGetElement(
+                        FragmentRing,
+                        (FragmentRing->ProducerIndex + FragmentCount - 1) & FragmentRing->Mask);
+
+                if (!XdpGenericReceiveLinearizeMdls(RxQueue, Mdl, 0, DataLength, Buffer)) {
+                    STAT_INC(&RxQueue->PcwStats, LinearizationFailures);
+                    goto Next;
+                }
+
+                DataLength = 0;
+                break;
+            }
+
             //
             // Check if the number of MDLs exceeds the maximum XDP fragments. If so,
             // attempt to convert the MDL chain to a single flat buffer.
@@ -786,6 +1144,18 @@ XdpGenericReceivePreInspectNbs(
             XdpGetFrameInterfaceContextExtension(Frame, &RxQueue->FrameInterfaceContextExtension);
         InterfaceExtension->Nb = *Nb;
 
+        //
+        // An RSC NBL carries a single NB whose headers describe every coalesced
+        // segment, so the frame is inspected once and its action applies to
+        // all of the segments. The coalesced segment count is reported via RX
+        // metadata; XSKs receive the frame whole as a multi-buffer frame.
+        //
+        RxMetadata = XdpGetRxMetadataExtension(Frame, &RxQueue->RxMetadataExtension);
+        XdpGenericReceiveSetRxMetadata(RxQueue, *Nbl, RxMetadata);
+        if (RxMetadata->CoalescedSegmentCount > 0) {
+            STAT_INC(&RxQueue->PcwStats, CoalescedFrames);
+        }
+
         //
         // The NB has successfully been converted to XDP descriptors, so commit
         // the descriptors to the XDP rings.
@@ -802,6 +1172,7 @@ Next:
 
             if (*Nbl != NULL) {
                 *Nb = NET_BUFFER_LIST_FIRST_NB(*Nbl);
+                XdpGenericReceivePrefetchAdvance(Prefetch);
             }
         }
     } while (*Nb != NULL && XdpRingFree(FrameRing) > FrameRingReservedCount);
@@ -823,17 +1194,31 @@ XdpGenericReceivePostInspectNbs(
     )
 {
     XDP_RING *FrameRing = RxQueue->FrameRing;
+    XDP_RING *FragmentRing = RxQueue->FragmentRing;
+    UINT32 FragmentIndex = FragmentRing->ProducerIndex;
 
     //
     // XDP must have inspected and returned all frames in the ring.
     //
     ASSERT(FrameRing->ConsumerIndex == FrameRing->ProducerIndex);
 
+    //
+    // Find the fragments of the first frame not yet posted.
+    //
+    for (UINT32 Index = FrameRing->InterfaceReserved; Index != FrameRing->ProducerIndex; Index++) {
+        XDP_FRAME *Frame = XdpRingGetElement(FrameRing, Index & FrameRing->Mask);
+
+        FragmentIndex -=
+            XdpGetFragmentExtension(Frame, &RxQueue->FragmentExtension)->FragmentBufferCount;
+    }
+
     while (NbHead != NbTail) {
         XDP_FRAME *Frame;
         XDP_RX_ACTION XdpRxAction;
         XDP_LWF_GENERIC_RX_FRAME_CONTEXT *InterfaceExtension;
         NET_BUFFER_LIST *ActionNbl = NULL;
+        UINT32 DataLength = NET_BUFFER_DATA_LENGTH(NbHead);
+        UINT32 HeadLength = 0;
 
         ASSERT(NblHead != NULL);
         ASSERT(NbHead != NULL);
@@ -843,8 +1228,30 @@ XdpGenericReceivePostInspectNbs(
 
         if (FrameRing->InterfaceReserved != FrameRing->ProducerIndex &&
             NbHead == InterfaceExtension->Nb) {
+            UINT8 FragmentCount =
+                XdpGetFragmentExtension(Frame, &RxQueue->FragmentExtension)->FragmentBufferCount;
+
             XdpRxAction = XdpGetRxActionExtension(Frame, &RxQueue->RxActionExtension)->RxAction;
             FrameRing->InterfaceReserved++;
+
+            //
+            // XDP programs may have adjusted the frame length, and may have
+            // prepended headers into the headroom of the frame's first MDL.
+            // Frames copied into the contiguous buffer have no headroom.
+            //
+            if (XdpGetVirtualAddressExtension(
+                    &Frame->Buffer, &RxQueue->BufferVaExtension)->VirtualAddress !=
+                        RxQueue->FragmentBuffer &&
+                Frame->Buffer.DataOffset < NET_BUFFER_CURRENT_MDL_OFFSET(NbHead)) {
+                HeadLength = NET_BUFFER_CURRENT_MDL_OFFSET(NbHead) - Frame->Buffer.DataOffset;
+            }
+
+            DataLength = Frame->Buffer.DataLength;
+            for (UINT32 Index = 0; Index < FragmentCount; Index++) {
+                DataLength +=
+                    ((XDP_BUFFER *)XdpRingGetElement(
+                        FragmentRing, FragmentIndex++ & FragmentRing->Mask))->DataLength;
+            }
         } else {
             //
             // This NB's action was decided prior to XDP inspection.
@@ -857,9 +1264,9 @@ XdpGenericReceivePostInspectNbs(
         }
 
         //
-        // Currently XDP does not advance/retreat buffers, so there's no need to
-        // explicitly update the NB; however, the payload data may have already
-        // been rewritten.
+        // XDP does not advance/retreat the NB itself; however, the payload data
+        // may have already been rewritten, and the frame length adjusted or
+        // headers prepended. The adjusted frame is applied to forwarded frames.
         //
 
         //
@@ -900,7 +1307,18 @@ XdpGenericReceivePostInspectNbs(
                 break;
 
             case XDP_RX_ACTION_TX:
-                XdpGenericReceiveEnqueueTxNbl(RxQueue, TxList, DropList, ActionNbl, CanPend);
+                //
+                // Coalesced frames exceed the MTU and cannot be transmitted
+                // without resegmentation, so drop them instead.
+                //
+                if (XdpGenericReceiveCoalescedSegmentCount(RxQueue, ActionNbl) > 0) {
+                    STAT_INC(&RxQueue->PcwStats, ForwardingFailures);
+                    NdisAppendSingleNblToNblQueue(DropList, ActionNbl);
+                    break;
+                }
+
+                XdpGenericReceiveEnqueueTxNbl(
+                    RxQueue, TxList, DropList, ActionNbl, HeadLength, DataLength, CanPend);
                 break;
 
             case XDP_RX_ACTION_DROP:
@@ -913,6 +1331,8 @@ XdpGenericReceivePostInspectNbs(
         }
 
         if (!CanPend) {
+            STAT_INC(&RxQueue->PcwStats, LowResourcesFrames);
+
             //
             // Enforce NDIS low resources constraints on pass and return lists.
             // N.B. This releases and reacquires the EC spinlock.
@@ -944,21 +1364,32 @@ XdpGenericReceiveInspect(
     NBL_QUEUE LowResourcesList;
     NET_BUFFER_LIST *NblHead, *NextNbl;
     NET_BUFFER *NbHead, *NextNb;
+    XDP_LWF_GENERIC_RX_PREFETCH Prefetch;
 
     ASSERT(NetBufferListChain != NULL);
 
     NdisInitializeNblQueue(&LowResourcesList);
     NextNbl = NetBufferListChain;
+    XdpGenericReceivePrefetchInitialize(&Prefetch, NextNbl);
+
+    if (!CanPend) {
+        STAT_INC(&RxQueue->PcwStats, LowResourcesIndications);
+    }
     NextNb = NET_BUFFER_LIST_FIRST_NB(NextNbl);
 
     do {
         NblHead = NextNbl;
         NbHead = NextNb;
+        STAGE_START(FillTsc);
 
         //
         // Queue a batch of NBLs into the XDP receive ring for inspection.
         //
-        XdpGenericReceivePreInspectNbs(RxQueue, CanPend, &NextNbl, &NextNb);
+        XdpGenericReceivePreInspectNbs(RxQueue, CanPend, &Prefetch, &NextNbl, &NextNb);
+
+        STAGE_END(&RxQueue->PcwStageStats, FillCycles, FillTsc);
+        STAGE_ADD(&RxQueue->PcwStageStats, Frames, XdpRingCount(RxQueue->FrameRing));
+        STAGE_START(InspectTsc);
 
         //
         // Invoke XDP inspection. Use the dispatch table (indirect call) rather
@@ -966,47 +1397,49 @@ XdpGenericReceiveInspect(
         //
         XdpReceiveThunk(XdpRxQueue);
 
+        STAGE_END(&RxQueue->PcwStageStats, InspectCycles, InspectTsc);
+        STAGE_START(ApplyTsc);
+
         //
         // Apply XDP actions from the XDP receive ring to the NBL chain.
         //
         XdpGenericReceivePostInspectNbs(
             RxQueue, PortNumber, CanPend, NblHead, NbHead, NextNb, PassList, DropList, TxList,
             &LowResourcesList);
+
+        STAGE_END(&RxQueue->PcwStageStats, ApplyCycles, ApplyTsc);
     } while (NextNb != NULL);
 }
 
+static
+_IRQL_requires_(DISPATCH_LEVEL)
 VOID
-XdpGenericReceive(
+XdpGenericReceiveBatch(
     _In_ XDP_LWF_GENERIC *Generic,
     _In_ NET_BUFFER_LIST *NetBufferLists,
+    _In_opt_ XDP_LWF_GENERIC_RSS_QUEUE *SteeredRssQueue,
     _In_ NDIS_PORT_NUMBER PortNumber,
-    _Out_ NBL_COUNTED_QUEUE *PassList,
-    _Out_ NBL_QUEUE *DropList,
-    _Out_ NBL_COUNTED_QUEUE *TxList,
-    _In_ UINT32 XdpInspectFlags
+    _In_ ULONG Processor,
+    _In_ UINT32 XdpInspectFlags,
+    _Inout_ NBL_COUNTED_QUEUE *PassList,
+    _Inout_ NBL_QUEUE *DropList,
+    _Inout_ NBL_COUNTED_QUEUE *TxList
     )
 {
-    KIRQL OldIrql = DISPATCH_LEVEL;
-    ULONG Processor;
     BOOLEAN CanPend = !(XdpInspectFlags & XDP_LWF_GENERIC_INSPECT_FLAG_RESOURCES);
     BOOLEAN TxInspect = XdpInspectFlags & XDP_LWF_GENERIC_INSPECT_FLAG_TX;
     BOOLEAN TxWorker = XdpInspectFlags & XDP_LWF_GENERIC_INSPECT_FLAG_TX_WORKER;
     XDP_LWF_GENERIC_RSS_QUEUE *RssQueue = NULL;
     XDP_LWF_GENERIC_RX_QUEUE *RxQueue = NULL;
     XDP_RX_QUEUE_HANDLE XdpRxQueue = NULL;
+    UINT64 NblCount = 0;
 
-    EventWriteGenericRxInspectStart(&MICROSOFT_XDP_PROVIDER, Generic);
-
-    NdisInitializeNblCountedQueue(PassList);
-    NdisInitializeNblQueue(DropList);
-    NdisInitializeNblCountedQueue(TxList);
-
-    if (!(XdpInspectFlags & XDP_LWF_GENERIC_INSPECT_FLAG_DISPATCH)) {
-        OldIrql = KeRaiseIrqlToDpcLevel();
+    if (!TxInspect && ReadBooleanNoFence(&Generic->Rss.TrackLoad)) {
+        for (NET_BUFFER_LIST *Nbl = NetBufferLists; Nbl != NULL; Nbl = Nbl->Next) {
+            NblCount++;
+        }
     }
 
-    Processor = KeGetCurrentProcessorIndex();
-
     //
     // Attempt to enter the RX queue's EC for the implicit RSS queue. Either we
     // successfully enter the EC and are provided with an XDP queue and NBLs to
@@ -1014,19 +1447,29 @@ XdpGenericReceive(
     // redirected).
     //
     XdpGenericReceiveEnterEc(
-        Generic, &NetBufferLists, Processor, TxInspect, TxWorker, &RssQueue, &RxQueue,
-        &XdpRxQueue, PassList);
+        Generic, &NetBufferLists, Processor, TxInspect, TxWorker, SteeredRssQueue, &RssQueue,
+        &RxQueue, &XdpRxQueue, PassList);
     ASSERT((NetBufferLists != NULL) == (XdpRxQueue != NULL));
 
+    if (RssQueue != NULL && NblCount > 0) {
+        RssQueue->ReceiveLoad += NblCount;
+    }
+
     if (NetBufferLists != NULL) {
         //
         // Perform XDP inspection on each frame within the NBL chain.
         //
         XdpGenericReceiveInspect(
-            RxQueue, XdpRxQueue, NetBufferLists, PortNumber, CanPend, PassList, DropList, TxList);
+            RxQueue, XdpRxQueue, NetBufferLists, PortNumber, CanPend, PassList, DropList,
+            &RxQueue->HairpinNblQueue);
     }
 
     if (XdpRxQueue != NULL) {
+        //
+        // Hand off every frame forwarded while the EC was owned as a single
+        // chain, which the caller sends once per indication.
+        //
+        XdpGenericFlushHairpin(RxQueue, TxList);
         XdpGenericReceiveExitEc(RxQueue, TxWorker, PassList);
     }
 
@@ -1038,14 +1481,144 @@ XdpGenericReceive(
         //
         XdpGenericTxFlushRss(RssQueue, Processor);
     }
+}
+
+static
+_IRQL_requires_(DISPATCH_LEVEL)
+XDP_LWF_GENERIC_RSS_QUEUE *
+XdpGenericReceiveClassify(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_opt_ XDP_LWF_GENERIC_FLOW_STEERING_TABLE *FlowSteeringTable,
+    _In_opt_ XDP_LWF_GENERIC_RSS_HASH *SoftwareHash,
+    _In_ NET_BUFFER_LIST *NetBufferList
+    )
+{
+    XDP_LWF_GENERIC_RSS_QUEUE *RssQueue = NULL;
+
+    if (FlowSteeringTable != NULL) {
+        RssQueue = XdpGenericRssSteerFlow(Generic, FlowSteeringTable, NetBufferList);
+    }
 
-    if (!NdisIsNblCountedQueueEmpty(TxList)) {
-        if (!ExAcquireRundownProtectionEx(&RxQueue->NblRundown, (ULONG)TxList->NblCount)) {
-            XdpGenericRecvInjectReturnNbls(RxQueue, TxList);
-            ASSERT(NdisIsNblCountedQueueEmpty(TxList));
+    //
+    // NICs hash with the configured key, so only hash in software if the NIC
+    // did not provide an RSS hash.
+    //
+    if (RssQueue == NULL && SoftwareHash != NULL &&
+        NET_BUFFER_LIST_GET_HASH_VALUE(NetBufferList) == 0) {
+        RssQueue = XdpGenericRssHashFlow(Generic, SoftwareHash, NetBufferList);
+    }
+
+    return RssQueue;
+}
+
+VOID
+XdpGenericReceive(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ NET_BUFFER_LIST *NetBufferLists,
+    _In_ NDIS_PORT_NUMBER PortNumber,
+    _Out_ NBL_COUNTED_QUEUE *PassList,
+    _Out_ NBL_QUEUE *DropList,
+    _Out_ NBL_COUNTED_QUEUE *TxList,
+    _In_ UINT32 XdpInspectFlags
+    )
+{
+    KIRQL OldIrql = DISPATCH_LEVEL;
+    ULONG Processor;
+    BOOLEAN CanPend = !(XdpInspectFlags & XDP_LWF_GENERIC_INSPECT_FLAG_RESOURCES);
+    BOOLEAN TxInspect = XdpInspectFlags & XDP_LWF_GENERIC_INSPECT_FLAG_TX;
+    XDP_LWF_GENERIC_FLOW_STEERING_TABLE *FlowSteeringTable;
+    XDP_LWF_GENERIC_DROP_FILTER_TABLE *DropFilterTable;
+    XDP_LWF_GENERIC_RSS_HASH *SoftwareHash;
+    XDP_LWF_GENERIC_QEO_TABLE *QeoTable;
+
+    EventWriteGenericRxInspectStart(&MICROSOFT_XDP_PROVIDER, Generic);
+
+    NdisInitializeNblCountedQueue(PassList);
+    NdisInitializeNblQueue(DropList);
+    NdisInitializeNblCountedQueue(TxList);
+
+    if (!(XdpInspectFlags & XDP_LWF_GENERIC_INSPECT_FLAG_DISPATCH)) {
+        OldIrql = KeRaiseIrqlToDpcLevel();
+    }
+
+    Processor = KeGetCurrentProcessorIndex();
+
+    QeoTable = ReadPointerNoFence(&Generic->Qeo.Table);
+    if (QeoTable != NULL && QeoTable->RxConnectionCount > 0 && !TxInspect) {
+        //
+        // Decrypt offloaded QUIC packets before XDP inspection, as a QEO
+        // capable NIC would.
+        //
+        NetBufferLists = XdpGenericQeoReceive(QeoTable, NetBufferLists, CanPend, DropList);
+        if (NetBufferLists == NULL) {
+            goto Exit;
+        }
+    }
+
+    FlowSteeringTable = ReadPointerNoFence(&Generic->Rss.FlowSteeringTable);
+    SoftwareHash = ReadPointerNoFence(&Generic->Rss.SoftwareHash);
+    DropFilterTable = ReadPointerNoFence(&Generic->Rss.DropFilterTable);
+
+    if (DropFilterTable != NULL && !TxInspect && CanPend) {
+        //
+        // Drop filtered frames before RSS and XDP inspection, as a NIC flow
+        // table would. Low resources indications are left to inspection.
+        //
+        NetBufferLists =
+            XdpGenericRssDropFlows(
+                Generic, DropFilterTable, FlowSteeringTable, Processor, NetBufferLists,
+                DropList);
+        if (NetBufferLists == NULL) {
+            goto Exit;
         }
     }
 
+    if ((FlowSteeringTable == NULL && SoftwareHash == NULL) || TxInspect || !CanPend) {
+        //
+        // Flow steering and software hashing apply to the receive path only,
+        // and low resources indications must be returned as a single,
+        // unmodified chain.
+        //
+        XdpGenericReceiveBatch(
+            Generic, NetBufferLists, NULL, PortNumber, Processor, XdpInspectFlags, PassList,
+            DropList, TxList);
+    } else {
+        //
+        // Split the chain into runs of consecutive NBLs steered to the same RSS
+        // queue, preserving order within each flow. NBLs matching no filter
+        // fall back to RSS hash lookup.
+        //
+        XDP_LWF_GENERIC_RSS_QUEUE *NextRssQueue =
+            XdpGenericReceiveClassify(Generic, FlowSteeringTable, SoftwareHash, NetBufferLists);
+
+        while (NetBufferLists != NULL) {
+            XDP_LWF_GENERIC_RSS_QUEUE *SteeredRssQueue = NextRssQueue;
+            NET_BUFFER_LIST *BatchTail = NetBufferLists;
+            NET_BUFFER_LIST *NextNbl;
+
+            while (BatchTail->Next != NULL) {
+                NextRssQueue =
+                    XdpGenericReceiveClassify(
+                        Generic, FlowSteeringTable, SoftwareHash, BatchTail->Next);
+                if (NextRssQueue != SteeredRssQueue) {
+                    break;
+                }
+                BatchTail = BatchTail->Next;
+            }
+
+            NextNbl = BatchTail->Next;
+            BatchTail->Next = NULL;
+
+            XdpGenericReceiveBatch(
+                Generic, NetBufferLists, SteeredRssQueue, PortNumber, Processor,
+                XdpInspectFlags, PassList, DropList, TxList);
+
+            NetBufferLists = NextNbl;
+        }
+    }
+
+Exit:
+
     if (OldIrql != DISPATCH_LEVEL) {
         KeLowerIrql(OldIrql);
     }
@@ -1053,6 +1626,54 @@ XdpGenericReceive(
     EventWriteGenericRxInspectStop(&MICROSOFT_XDP_PROVIDER, Generic);
 }
 
+//
+// Returns whether an RX indication can skip XDP entirely. Interface-wide
+// receive features must not need to see the NBLs, and the indication's RSS
+// queue must have neither an active XDP RX queue nor a TX queue to poll
+// inline. Queues without XDP clients then run at near-native speed while XDP
+// is attached to other queues of the same interface.
+//
+static
+_IRQL_requires_(DISPATCH_LEVEL)
+BOOLEAN
+XdpGenericReceiveCanBypass(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ NET_BUFFER_LIST *NetBufferLists
+    )
+{
+    XDP_LWF_GENERIC_QEO_TABLE *QeoTable = ReadPointerNoFence(&Generic->Qeo.Table);
+    XDP_LWF_GENERIC_RSS_QUEUE *RssQueue;
+    XDP_LWF_GENERIC_RX_QUEUE *RxQueue;
+
+    if ((QeoTable != NULL && QeoTable->RxConnectionCount > 0) ||
+        ReadPointerNoFence(&Generic->Rss.FlowSteeringTable) != NULL ||
+        ReadPointerNoFence(&Generic->Rss.SoftwareHash) != NULL ||
+        ReadPointerNoFence(&Generic->Rss.DropFilterTable) != NULL ||
+        ReadBooleanNoFence(&Generic->Rss.TrackLoad) ||
+        XdpLwfOffloadNeedTransformNbls(Generic->Filter)) {
+        return FALSE;
+    }
+
+    //
+    // Resolve the RSS queue the same way as inspection does, from the first
+    // NBL's hash and the indirection table.
+    //
+    RssQueue =
+        XdpGenericRssGetQueue(
+            Generic, KeGetCurrentProcessorIndex(), FALSE,
+            NET_BUFFER_LIST_GET_HASH_VALUE(NetBufferLists));
+    if (RssQueue == NULL) {
+        return FALSE;
+    }
+
+    RxQueue = ReadPointerAcquire(&RssQueue->RxQueue);
+
+    return
+        (RxQueue == NULL || ReadPointerAcquire(&RxQueue->XdpRxQueue) == NULL) &&
+        ReadPointerNoFence(&RssQueue->TxQueue) == NULL &&
+        ReadPointerNoFence(&RssQueue->RxInjectQueue) == NULL;
+}
+
 _Use_decl_annotations_
 VOID
 XdpGenericReceiveNetBufferLists(
@@ -1069,15 +1690,22 @@ XdpGenericReceiveNetBufferLists(
     NBL_QUEUE DropList;
     NBL_COUNTED_QUEUE TxList;
 
-    UNREFERENCED_PARAMETER(NumberOfNetBufferLists);
+    if (AtDispatch && XdpGenericReceiveCanBypass(Generic, NetBufferLists)) {
+        NdisFIndicateReceiveNetBufferLists(
+            Generic->NdisFilterHandle, NetBufferLists, PortNumber, NumberOfNetBufferLists,
+            ReceiveFlags);
+        return;
+    }
 
     XdpGenericReceive(
         Generic, NetBufferLists, PortNumber, &PassList, &DropList, &TxList,
         ReceiveFlags & XDP_LWF_GENERIC_INSPECT_NDIS_RX_MASK);
 
     if (!NdisIsNblCountedQueueEmpty(&PassList)) {
-        XdpLwfOffloadTransformNbls(
-            Generic->Filter, &PassList, ReceiveFlags & XDP_LWF_GENERIC_INSPECT_NDIS_RX_MASK);
+        XdpLwfOffloadTransformNbls(Generic->Filter, &PassList, PortNumber, ReceiveFlags);
+    }
+
+    if (!NdisIsNblCountedQueueEmpty(&PassList)) {
         NdisFIndicateReceiveNetBufferLists(
             Generic->NdisFilterHandle, NdisGetNblChainFromNblCountedQueue(&PassList), PortNumber,
             (ULONG)PassList.NblCount, ReceiveFlags);
@@ -1100,7 +1728,9 @@ static
 _IRQL_requires_(DISPATCH_LEVEL)
 BOOLEAN
 XdpGenericReceiveTxInspectPoll(
-    _In_ VOID *Context
+    _In_ VOID *Context,
+    _In_ UINT32 Budget,
+    _Out_ UINT32 *WorkDone
     )
 {
     XDP_LWF_GENERIC_RX_QUEUE *RxQueue = Context;
@@ -1111,7 +1741,9 @@ XdpGenericReceiveTxInspectPoll(
     NBL_QUEUE NblBatch;
     BOOLEAN PollDidWork = FALSE;
     XDP_RX_QUEUE_HANDLE XdpRxQueue;
+    UINT32 BatchSize = min(ReadUInt32NoFence(&RxQueue->TxInspectBatchSize), Budget);
 
+    *WorkDone = 0;
     NdisInitializeNblQueue(&NblBatch);
 
     //
@@ -1147,13 +1779,14 @@ XdpGenericReceiveTxInspectPoll(
     //
     // Produce a batch of NBLs from the poll-owned NBL queue.
     //
-    for (UINT32 Index = 0; Index < RECV_TX_INSPECT_BATCH_SIZE; Index++) {
+    for (UINT32 Index = 0; Index < BatchSize; Index++) {
         if (NdisIsNblQueueEmpty(&RxQueue->TxInspectPollNblQueue)) {
             break;
         }
 
         NdisAppendSingleNblToNblQueue(
             &NblBatch, NdisPopFirstNblFromNblQueue(&RxQueue->TxInspectPollNblQueue));
+        (*WorkDone)++;
     }
 
     //
@@ -1297,6 +1930,60 @@ XdpGenericRxRestart(
     TraceExitSuccess(TRACE_GENERIC);
 }
 
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+_Requires_exclusive_lock_held_(&Generic->Lock)
+VOID
+XdpGenericRxApplyQueueTuning(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _Inout_ XDP_LWF_GENERIC_RX_QUEUE *RxQueue
+    )
+{
+    const XDP_LWF_GENERIC_TUNING *Tuning = &Generic->Tuning;
+
+    //
+    // The data path samples each value once per poll, so updates take effect
+    // at the next poll without pausing the queue. Lowering the clone cache
+    // limit does not free clones already cached; they are reused until the
+    // queue is deleted.
+    //
+    WriteUInt32NoFence(
+        &RxQueue->TxCloneCacheLimit,
+        Tuning->RxCloneCacheLimitSet ? Tuning->RxCloneCacheLimit : RxMaxTxBuffers);
+    WriteUInt32NoFence(
+        &RxQueue->TxInspectBatchSize,
+        Tuning->TxInspectBatchSize != 0 ?
+            Tuning->TxInspectBatchSize : RECV_TX_INSPECT_BATCH_SIZE);
+
+    if (RxQueue->Flags.TxInspect) {
+        XdpEcSetBudget(
+            &RxQueue->TxInspectEc,
+            Tuning->EcBudget != 0 ? Tuning->EcBudget : XDP_EC_DEFAULT_BUDGET);
+    }
+}
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+_Requires_exclusive_lock_held_(&Generic->Lock)
+VOID
+XdpGenericRxApplyTuning(
+    _In_ XDP_LWF_GENERIC *Generic
+    )
+{
+    LIST_ENTRY *Entry = Generic->Rx.Queues.Flink;
+
+    TraceEnter(TRACE_GENERIC, "IfIndex=%u", Generic->IfIndex);
+
+    while (Entry != &Generic->Rx.Queues) {
+        XDP_LWF_GENERIC_RX_QUEUE *RxQueue =
+            CONTAINING_RECORD(Entry, XDP_LWF_GENERIC_RX_QUEUE, Link);
+        Entry = Entry->Flink;
+
+        XdpGenericRxApplyQueueTuning(Generic, RxQueue);
+    }
+
+    TraceExitSuccess(TRACE_GENERIC);
+}
+
 _IRQL_requires_(PASSIVE_LEVEL)
 NTSTATUS
 XdpGenericRxCreateQueue(
@@ -1327,7 +2014,7 @@ XdpGenericRxCreateQueue(
 
     QueueInfo = XdpRxQueueGetTargetQueueInfo(Config);
 
-    QueueHookId = XdpRxQueueGetHookId(Config);
+    QueueHookId = XdpRxQueueGetHookIdThunk(Config);
     if (QueueHookId != NULL) {
         HookId = *QueueHookId;
     }
@@ -1371,10 +2058,28 @@ XdpGenericRxCreateQueue(
     RxQueue->QueueId = QueueInfo->QueueId;
     RxQueue->Generic = Generic;
     ExInitializeRundownProtection(&RxQueue->NblRundown);
-    InitializeSListHead(&RxQueue->TxCloneNblSList);
-    RxQueue->TxCloneCacheLimit = RxMaxTxBuffers;
+    NdisInitializeNblCountedQueue(&RxQueue->HairpinNblQueue);
     RxQueue->Flags.TxInspect = (HookId.Direction == XDP_HOOK_TX);
 
+    RxQueue->TxCloneMagazineCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    RxQueue->TxCloneMagazines =
+        ExAllocatePoolZero(
+            NonPagedPoolNxCacheAligned,
+            sizeof(*RxQueue->TxCloneMagazines) * RxQueue->TxCloneMagazineCount, POOLTAG_RECV);
+    if (RxQueue->TxCloneMagazines == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    for (UINT32 Index = 0; Index < RxQueue->TxCloneMagazineCount; Index++) {
+        InitializeSListHead(&RxQueue->TxCloneMagazines[Index].NblSList);
+    }
+
+    Status = XdpGenericRxCreateCopyBuffers(RxQueue);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
     Status =
         RtlUnicodeStringPrintf(
             &Name, L"if_%u_queue_%u%s", Generic->IfIndex, QueueInfo->QueueId, DirectionString);
@@ -1387,6 +2092,15 @@ XdpGenericRxCreateQueue(
         goto Exit;
     }
 
+#ifdef XDP_PERF_STAGES
+    Status =
+        XdpPcwCreateLwfRxQueueStages(
+            &RxQueue->PcwStageInstance, &Name, &RxQueue->PcwStageStats);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+#endif
+
     PoolParams.Header.Type = NDIS_OBJECT_TYPE_DEFAULT;
     PoolParams.Header.Revision = NET_BUFFER_LIST_POOL_PARAMETERS_REVISION_1;
     PoolParams.Header.Size = sizeof(PoolParams);
@@ -1409,7 +2123,8 @@ XdpGenericRxCreateQueue(
         Status =
             XdpEcInitialize(
                 &RxQueue->TxInspectEc, XdpGenericReceiveTxInspectPoll, RxQueue,
-                &RssQueue->IdealProcessor);
+                &RssQueue->IdealProcessor, XDP_EC_DEFAULT_BUDGET,
+                &RxQueue->PcwStats.TxInspectEc);
         if (!NT_SUCCESS(Status)) {
             goto Exit;
         }
@@ -1417,6 +2132,7 @@ XdpGenericRxCreateQueue(
 
     RtlAcquirePushLockExclusive(&Generic->Lock);
     RxQueue->Flags.Paused = Generic->Flags.Paused;
+    XdpGenericRxApplyQueueTuning(Generic, RxQueue);
     InsertTailList(&Generic->Rx.Queues, &RxQueue->Link);
     RtlReleasePushLockExclusive(&Generic->Lock);
 
@@ -1452,11 +2168,20 @@ XdpGenericRxCreateQueue(
         XDP_FRAME_EXTENSION_INTERFACE_CONTEXT_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
     XdpRxQueueRegisterExtensionVersion(Config, &ExtensionInfo);
 
+    XdpInitializeExtensionInfo(
+        &ExtensionInfo, XDP_FRAME_EXTENSION_RX_METADATA_NAME,
+        XDP_FRAME_EXTENSION_RX_METADATA_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+    XdpRxQueueRegisterExtensionVersion(Config, &ExtensionInfo);
+
     RxQueue->FragmentLimit = RECV_MAX_FRAGMENTS;
 
     XdpInitializeRxCapabilitiesDriverVa(&RxCapabilities);
     RxCapabilities.MaximumFragments = RxQueue->FragmentLimit;
     RxCapabilities.TxActionSupported = TRUE;
+    RxCapabilities.IdealProcessorValid =
+        NT_SUCCESS(
+            KeGetProcessorNumberFromIndex(
+                ReadULongNoFence(&RssQueue->IdealProcessor), &RxCapabilities.IdealProcessor));
     XdpRxQueueSetCapabilities(Config, &RxCapabilities);
 
     XdpInitializeRxDescriptorContexts(&DescriptorContexts);
@@ -1479,6 +2204,15 @@ Exit:
             if (RxQueue->PcwInstance != NULL) {
                 PcwCloseInstance(RxQueue->PcwInstance);
             }
+#ifdef XDP_PERF_STAGES
+            if (RxQueue->PcwStageInstance != NULL) {
+                PcwCloseInstance(RxQueue->PcwStageInstance);
+            }
+#endif
+            if (RxQueue->TxCloneMagazines != NULL) {
+                ExFreePoolWithTag(RxQueue->TxCloneMagazines, POOLTAG_RECV);
+            }
+            XdpGenericRxFreeCopyBuffers(RxQueue);
             ExFreePoolWithTag(RxQueue, POOLTAG_RECV);
         }
     }
@@ -1525,11 +2259,79 @@ XdpGenericRxActivateQueue(
         XDP_FRAME_EXTENSION_INTERFACE_CONTEXT_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
     XdpRxQueueGetExtension(Config, &ExtensionInfo, &RxQueue->FrameInterfaceContextExtension);
 
+    XdpInitializeExtensionInfo(
+        &ExtensionInfo, XDP_FRAME_EXTENSION_RX_METADATA_NAME,
+        XDP_FRAME_EXTENSION_RX_METADATA_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+    XdpRxQueueGetExtension(Config, &ExtensionInfo, &RxQueue->RxMetadataExtension);
+
     WritePointerRelease(&RxQueue->XdpRxQueue, XdpRxQueue);
 
     return STATUS_SUCCESS;
 }
 
+static
+VOID
+XdpGenericRxFreeCopyBuffers(
+    _In_ XDP_LWF_GENERIC_RX_QUEUE *RxQueue
+    )
+{
+    if (RxQueue->CopyBuffers != NULL) {
+        for (UINT32 Index = 0; Index < RECV_COPY_BUFFER_COUNT; Index++) {
+            if (RxQueue->CopyBuffers[Index].Mdl != NULL) {
+                IoFreeMdl(RxQueue->CopyBuffers[Index].Mdl);
+            }
+        }
+        ExFreePoolWithTag(RxQueue->CopyBuffers, POOLTAG_RECV);
+        RxQueue->CopyBuffers = NULL;
+    }
+
+    if (RxQueue->CopyBufferData != NULL) {
+        ExFreePoolWithTag(RxQueue->CopyBufferData, POOLTAG_RECV);
+        RxQueue->CopyBufferData = NULL;
+    }
+}
+
+static
+NTSTATUS
+XdpGenericRxCreateCopyBuffers(
+    _In_ XDP_LWF_GENERIC_RX_QUEUE *RxQueue
+    )
+{
+    InitializeSListHead(&RxQueue->CopyBufferSList);
+
+    RxQueue->CopyBuffers =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, sizeof(*RxQueue->CopyBuffers) * RECV_COPY_BUFFER_COUNT,
+            POOLTAG_RECV);
+    if (RxQueue->CopyBuffers == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    RxQueue->CopyBufferData =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, RECV_COPY_BUFFER_SIZE * RECV_COPY_BUFFER_COUNT, POOLTAG_RECV);
+    if (RxQueue->CopyBufferData == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    for (UINT32 Index = 0; Index < RECV_COPY_BUFFER_COUNT; Index++) {
+        XDP_LWF_GENERIC_RX_COPY_BUFFER *CopyBuffer = &RxQueue->CopyBuffers[Index];
+
+        CopyBuffer->Mdl =
+            IoAllocateMdl(
+                RxQueue->CopyBufferData + Index * RECV_COPY_BUFFER_SIZE,
+                RECV_COPY_BUFFER_SIZE, FALSE, FALSE, NULL);
+        if (CopyBuffer->Mdl == NULL) {
+            return STATUS_NO_MEMORY;
+        }
+
+        MmBuildMdlForNonPagedPool(CopyBuffer->Mdl);
+        InterlockedPushEntrySList(&RxQueue->CopyBufferSList, &CopyBuffer->Link);
+    }
+
+    return STATUS_SUCCESS;
+}
+
 static
 VOID
 XdpGenericRxDeleteQueueEntry(
@@ -1542,13 +2344,23 @@ XdpGenericRxDeleteQueueEntry(
     if (RxQueue->FragmentBuffer != NULL) {
         ExFreePoolWithTag(RxQueue->FragmentBuffer, POOLTAG_RECV);
     }
-    XdpGenericRxFreeNblCloneCache(
-        (NET_BUFFER_LIST *)InterlockedFlushSList(&RxQueue->TxCloneNblSList));
+    for (UINT32 Index = 0; Index < RxQueue->TxCloneMagazineCount; Index++) {
+        XdpGenericRxFreeNblCloneCache(
+            (NET_BUFFER_LIST *)InterlockedFlushSList(
+                &RxQueue->TxCloneMagazines[Index].NblSList));
+    }
+    ExFreePoolWithTag(RxQueue->TxCloneMagazines, POOLTAG_RECV);
+    RxQueue->TxCloneMagazines = NULL;
     XdpGenericRxFreeNblCloneCache(RxQueue->TxCloneNblList);
     RxQueue->TxCloneNblList = NULL;
+    XdpGenericRxFreeCopyBuffers(RxQueue);
     NdisFreeNetBufferListPool(RxQueue->TxCloneNblPool);
     XdpPcwCloseLwfRxQueue(RxQueue->PcwInstance);
     RxQueue->PcwInstance = NULL;
+#ifdef XDP_PERF_STAGES
+    XdpPcwCloseLwfRxQueueStages(RxQueue->PcwStageInstance);
+    RxQueue->PcwStageInstance = NULL;
+#endif
     KeSetEvent(RxQueue->DeleteComplete, 0, FALSE);
     ExFreePoolWithTag(RxQueue, POOLTAG_RECV);
 }
@@ -1575,16 +2387,20 @@ XdpGenericRxDeleteQueue(
 {
     XDP_LWF_GENERIC_RX_QUEUE *RxQueue = (XDP_LWF_GENERIC_RX_QUEUE *)InterfaceRxQueue;
     XDP_LWF_GENERIC *Generic = RxQueue->Generic;
+    XDP_LWF_GENERIC_RSS_QUEUE *RssQueue;
     KEVENT DeleteComplete;
 
     TraceEnter(TRACE_GENERIC, "IfIndex=%u QueueId=%u", Generic->IfIndex, RxQueue->QueueId);
 
+    RssQueue = XdpGenericRssGetQueueById(Generic, RxQueue->QueueId);
+    ASSERT(RssQueue != NULL);
+
     if (RxQueue->Flags.TxInspect) {
         #pragma warning(suppress:6387) // WritePointerRelease second parameter is not _In_opt_
-        WritePointerRelease(&Generic->Rss.Queues[RxQueue->QueueId].TxInspectQueue, NULL);
+        WritePointerRelease(&RssQueue->TxInspectQueue, NULL);
     } else {
         #pragma warning(suppress:6387) // WritePointerRelease second parameter is not _In_opt_
-        WritePointerRelease(&Generic->Rss.Queues[RxQueue->QueueId].RxQueue, NULL);
+        WritePointerRelease(&RssQueue->RxQueue, NULL);
     }
 
     RtlAcquirePushLockExclusive(&Generic->Lock);
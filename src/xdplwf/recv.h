@@ -7,6 +7,29 @@
 
 #include "ec.h"
 
+#define RECV_MAX_MAX_TX_BUFFERS 4096
+#define RECV_MAX_TX_INSPECT_BATCH_SIZE 1024
+
+//
+// A per-processor magazine of clone NBLs returned after RX-to-TX forwarding.
+// Completions push onto the magazine of the processor they complete on, and
+// the data path refills its private list by flushing entire magazines, so
+// producers on different processors never contend on a single list head.
+//
+typedef struct DECLSPEC_CACHEALIGN _XDP_LWF_GENERIC_RX_CLONE_MAGAZINE {
+    SLIST_HEADER NblSList;
+} XDP_LWF_GENERIC_RX_CLONE_MAGAZINE;
+
+//
+// A preallocated buffer for a forwarded frame that must be copied rather than
+// cloned, e.g. a frame of a low resources indication, whose NBL is returned
+// before the forwarded frame completes.
+//
+typedef struct _XDP_LWF_GENERIC_RX_COPY_BUFFER {
+    SLIST_ENTRY Link;
+    MDL *Mdl;
+} XDP_LWF_GENERIC_RX_COPY_BUFFER;
+
 typedef struct _XDP_LWF_GENERIC_RX_QUEUE {
     XDP_RX_QUEUE_HANDLE XdpRxQueue;
     XDP_RING *FrameRing;
@@ -15,12 +38,22 @@ typedef struct _XDP_LWF_GENERIC_RX_QUEUE {
     XDP_EXTENSION RxActionExtension;
     XDP_EXTENSION FragmentExtension;
     XDP_EXTENSION FrameInterfaceContextExtension;
+    XDP_EXTENSION RxMetadataExtension;
     XDP_PCW_LWF_RX_QUEUE PcwStats;
+#ifdef XDP_PERF_STAGES
+    XDP_PCW_LWF_RX_QUEUE_STAGES PcwStageStats;
+#endif
     NDIS_HANDLE TxCloneNblPool;
     UINT32 TxCloneCacheLimit;
+    UINT32 TxInspectBatchSize;
     UINT32 TxCloneCacheCount;
-    SLIST_HEADER TxCloneNblSList;
+    UINT32 TxCloneMagazineCount;
+    UINT32 TxCloneMagazineIndex;
+    XDP_LWF_GENERIC_RX_CLONE_MAGAZINE *TxCloneMagazines;
     NET_BUFFER_LIST *TxCloneNblList;
+    SLIST_HEADER CopyBufferSList;
+    XDP_LWF_GENERIC_RX_COPY_BUFFER *CopyBuffers;
+    UCHAR *CopyBufferData;
     EX_RUNDOWN_REF NblRundown;
 
     //
@@ -35,6 +68,13 @@ typedef struct _XDP_LWF_GENERIC_RX_QUEUE {
     UINT8 FragmentLimit;
     UINT8 FragmentBufferInUse;
 
+    //
+    // Frames forwarded by the TX action accumulate on the hairpin queue while
+    // the data path owns the EC, and are handed off as a single chain before
+    // the EC is released.
+    //
+    NBL_COUNTED_QUEUE HairpinNblQueue;
+
     KSPIN_LOCK EcLock;
 
     //
@@ -70,6 +110,9 @@ typedef struct _XDP_LWF_GENERIC_RX_QUEUE {
     UINT32 QueueId;
     LIST_ENTRY Link;
     PCW_INSTANCE *PcwInstance;
+#ifdef XDP_PERF_STAGES
+    PCW_INSTANCE *PcwStageInstance;
+#endif
     XDP_LIFETIME_ENTRY DeleteEntry;
     KEVENT *DeleteComplete;
 } XDP_LWF_GENERIC_RX_QUEUE;
@@ -128,6 +171,13 @@ XdpGenericRxRestart(
     _In_ UINT32 NewMtu
     );
 
+_IRQL_requires_max_(PASSIVE_LEVEL)
+_Requires_exclusive_lock_held_(&Generic->Lock)
+VOID
+XdpGenericRxApplyTuning(
+    _In_ XDP_LWF_GENERIC *Generic
+    );
+
 VOID
 XdpGenericReceiveRegistryUpdate(
     VOID
@@ -6,6 +6,50 @@
 #include "precomp.h"
 #include "rss.tmh"
 
+//
+// The maximum number of flow steering filters emulated by generic RSS. Filters
+// are matched with a linear scan on the receive path, so keep this small.
+//
+#define XDP_LWF_GENERIC_FLOW_STEERING_MAX_FILTERS 256
+
+//
+// The IPv4 more-fragments flag and fragment offset, in host byte order.
+//
+#define IP4_FRAGMENT_MASK 0x3FFF
+
+//
+// The L2 through L4 port headers required to match a flow steering filter.
+//
+#define XDP_LWF_GENERIC_FLOW_STEERING_LOOKAHEAD \
+    (sizeof(ETHERNET_HEADER) + (0xF * sizeof(UINT32)) + sizeof(IPV6_HEADER) + \
+        (2 * sizeof(UINT16)))
+
+//
+// A symmetric hash secret key repeats with a 16-bit period, so swapping the
+// source and destination addresses or ports does not change the Toeplitz hash.
+//
+#define XDP_LWF_GENERIC_SYMMETRIC_KEY_PERIOD 2
+
+//
+// The largest Toeplitz hash input: IPv6 source and destination addresses
+// followed by the source and destination ports.
+//
+#define XDP_LWF_GENERIC_RSS_HASH_INPUT_MAX (2 * sizeof(IN6_ADDR) + 2 * sizeof(UINT16))
+
+typedef struct _XDP_LWF_GENERIC_RSS_TUPLE {
+    XDP_FLOW_STEERING_ADDRESS_FAMILY AddressFamily;
+    UINT8 IpProto;
+    UINT32 AddressLength;
+    const UINT8 *SourceAddress;
+    const UINT8 *DestinationAddress;
+
+    //
+    // The source and destination ports of unfragmented TCP and UDP frames, or
+    // NULL otherwise.
+    //
+    const UINT16 *Ports;
+} XDP_LWF_GENERIC_RSS_TUPLE;
+
 static
 VOID
 XdpGenericRssFreeLifetimeIndirection(
@@ -18,6 +62,18 @@ XdpGenericRssFreeLifetimeIndirection(
     ExFreePoolWithTag(IndirectionTable, POOLTAG_RSS);
 }
 
+static
+VOID
+XdpGenericRssFreeLifetimeSoftwareHash(
+    _In_ XDP_LIFETIME_ENTRY *Entry
+    )
+{
+    XDP_LWF_GENERIC_RSS_HASH *SoftwareHash =
+        CONTAINING_RECORD(Entry, XDP_LWF_GENERIC_RSS_HASH, DeleteEntry);
+
+    ExFreePoolWithTag(SoftwareHash, POOLTAG_RSS);
+}
+
 VOID
 XdpGenericRssFreeIndirection(
     _Inout_ XDP_LWF_GENERIC_INDIRECTION_STORAGE *Indirection
@@ -32,6 +88,212 @@ XdpGenericRssFreeIndirection(
         ExFreePoolWithTag(Indirection->NewQueues, POOLTAG_RSS);
         Indirection->NewQueues = NULL;
     }
+
+    if (Indirection->NewSoftwareHash != NULL) {
+        ExFreePoolWithTag(Indirection->NewSoftwareHash, POOLTAG_RSS);
+        Indirection->NewSoftwareHash = NULL;
+    }
+
+    if (Indirection->NewSendHash != NULL) {
+        ExFreePoolWithTag(Indirection->NewSendHash, POOLTAG_RSS);
+        Indirection->NewSendHash = NULL;
+    }
+}
+
+BOOLEAN
+XdpGenericRssIsSymmetricHashSecretKey(
+    _In_reads_bytes_(HashSecretKeySize) const UCHAR *HashSecretKey,
+    _In_ UINT32 HashSecretKeySize
+    )
+{
+    if (HashSecretKeySize < sizeof(UINT32) ||
+        HashSecretKeySize % XDP_LWF_GENERIC_SYMMETRIC_KEY_PERIOD != 0) {
+        return FALSE;
+    }
+
+    for (UINT32 Index = XDP_LWF_GENERIC_SYMMETRIC_KEY_PERIOD; Index < HashSecretKeySize; Index++) {
+        if (HashSecretKey[Index] != HashSecretKey[Index - XDP_LWF_GENERIC_SYMMETRIC_KEY_PERIOD]) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+VOID
+XdpGenericRssGenerateSymmetricHashSecretKey(
+    _Out_writes_bytes_(HashSecretKeySize) UCHAR *HashSecretKey,
+    _In_ UINT32 HashSecretKeySize
+    )
+{
+    //
+    // The well-known 0x6D5A pattern yields a symmetric hash with a similar
+    // distribution to the default Microsoft RSS key.
+    //
+    static const UCHAR Pattern[XDP_LWF_GENERIC_SYMMETRIC_KEY_PERIOD] = { 0x6D, 0x5A };
+
+    for (UINT32 Index = 0; Index < HashSecretKeySize; Index++) {
+        HashSecretKey[Index] = Pattern[Index % RTL_NUMBER_OF(Pattern)];
+    }
+}
+
+static
+XDP_LWF_GENERIC_RSS_HASH *
+XdpGenericRssAllocateHash(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ NDIS_RECEIVE_SCALE_PARAMETERS *RssParams,
+    _In_reads_bytes_(RssParams->HashSecretKeySize) const UCHAR *HashSecretKey
+    )
+{
+    XDP_LWF_GENERIC_RSS_HASH *Hash;
+
+    Hash = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Hash), POOLTAG_RSS);
+    if (Hash == NULL) {
+        TraceError(TRACE_LWF, "IfIndex=%u Failed to allocate RSS hash", Generic->IfIndex);
+        return NULL;
+    }
+
+    Hash->HashType = NDIS_RSS_HASH_TYPE_FROM_HASH_INFO(RssParams->HashInformation);
+    Hash->HashSecretKeySize = RssParams->HashSecretKeySize;
+    RtlCopyMemory(Hash->HashSecretKey, HashSecretKey, RssParams->HashSecretKeySize);
+
+    return Hash;
+}
+
+static
+NTSTATUS
+XdpGenericRssCreateSoftwareHash(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ NDIS_RECEIVE_SCALE_PARAMETERS *RssParams,
+    _In_ ULONG RssParamsLength,
+    _In_ BOOLEAN RssEnabled,
+    _Inout_ XDP_LWF_GENERIC_INDIRECTION_STORAGE *Indirection
+    )
+{
+    XDP_LWF_GENERIC_RSS_HASH *SoftwareHash;
+    const UCHAR *HashSecretKey;
+
+    if (RssEnabled &&
+        (RssParams->Flags &
+            (NDIS_RSS_PARAM_FLAG_HASH_INFO_UNCHANGED | NDIS_RSS_PARAM_FLAG_HASH_KEY_UNCHANGED))) {
+        //
+        // Keep the current software hash unless both the hash type and key
+        // are specified.
+        //
+        return STATUS_SUCCESS;
+    }
+
+    Indirection->SoftwareHashChanged = TRUE;
+
+    if (!RssEnabled ||
+        RssParams->HashSecretKeySize > sizeof(SoftwareHash->HashSecretKey) ||
+        (ULONG)RssParams->HashSecretKeyOffset + RssParams->HashSecretKeySize > RssParamsLength) {
+        return STATUS_SUCCESS;
+    }
+
+    HashSecretKey = RTL_PTR_ADD(RssParams, RssParams->HashSecretKeyOffset);
+
+    Indirection->NewSendHash = XdpGenericRssAllocateHash(Generic, RssParams, HashSecretKey);
+    if (Indirection->NewSendHash == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    if (!XdpGenericRssIsSymmetricHashSecretKey(HashSecretKey, RssParams->HashSecretKeySize)) {
+        return STATUS_SUCCESS;
+    }
+
+    SoftwareHash = XdpGenericRssAllocateHash(Generic, RssParams, HashSecretKey);
+    if (SoftwareHash == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    Indirection->NewSoftwareHash = SoftwareHash;
+
+    return STATUS_SUCCESS;
+}
+
+//
+// Attempts to express an indirection table update as a patch of the current
+// table. Updates that only move entries between processors already owning RSS
+// queues, such as those of the RSS rebalancer, need neither a new table nor new
+// queue assignments. Returns FALSE if the update changes the table size, or the
+// processor or first entry of any RSS queue.
+//
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+BOOLEAN
+XdpGenericRssCreateIndirectionPatch(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_reads_(EntryCount) const PROCESSOR_NUMBER *RssTable,
+    _In_ ULONG EntryCount,
+    _Inout_ XDP_LWF_GENERIC_INDIRECTION_STORAGE *Indirection
+    )
+{
+    XDP_LWF_GENERIC_RSS *Rss = &Generic->Rss;
+    XDP_LWF_GENERIC_INDIRECTION_TABLE *IndirectionTable;
+    ULONG AssignedQueues = 0;
+    BOOLEAN Patched = FALSE;
+
+    if (EntryCount > RTL_NUMBER_OF(Indirection->PatchEntries)) {
+        return FALSE;
+    }
+
+    RtlAcquirePushLockShared(&Generic->Lock);
+
+    IndirectionTable = Rss->IndirectionTable;
+    if (IndirectionTable == NULL || IndirectionTable->IndirectionMask + 1 != EntryCount) {
+        goto Exit;
+    }
+
+    Indirection->PatchCount = 0;
+
+    for (ULONG Index = 0; Index < EntryCount; Index++) {
+        ULONG TargetProcessor = KeGetProcessorIndexFromNumber(&RssTable[Index]);
+        ULONG QueueIndex;
+
+        for (QueueIndex = 0; QueueIndex < AssignedQueues; QueueIndex++) {
+            if (Rss->Queues[QueueIndex].IdealProcessor == TargetProcessor) {
+                break;
+            }
+        }
+
+        if (QueueIndex == AssignedQueues) {
+            //
+            // Queues are assigned in order of each processor's first entry, so
+            // a full update would assign this processor the next queue. That
+            // queue must already belong to the processor, from the same entry.
+            //
+            if (QueueIndex >= IndirectionTable->AssignedQueues ||
+                Rss->Queues[QueueIndex].IdealProcessor != TargetProcessor ||
+                Rss->Queues[QueueIndex].RssHash != Index) {
+                goto Exit;
+            }
+
+            AssignedQueues++;
+        }
+
+        if (IndirectionTable->Entries[Index].QueueIndex != QueueIndex) {
+            XDP_LWF_GENERIC_INDIRECTION_PATCH *Patch =
+                &Indirection->PatchEntries[Indirection->PatchCount++];
+
+            Patch->Index = (UINT16)Index;
+            Patch->QueueIndex = (UINT16)QueueIndex;
+        }
+    }
+
+    if (AssignedQueues != IndirectionTable->AssignedQueues) {
+        goto Exit;
+    }
+
+    Indirection->Patch = TRUE;
+    Indirection->PatchGeneration = Rss->IndirectionGeneration;
+    Patched = TRUE;
+
+Exit:
+
+    RtlReleasePushLockShared(&Generic->Lock);
+
+    return Patched;
 }
 
 NTSTATUS
@@ -50,6 +312,7 @@ XdpGenericRssCreateIndirection(
     ULONG MaxProcessors = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
     PROCESSOR_NUMBER *RssTable;
     PROCESSOR_NUMBER DisabledRssTable;
+    BOOLEAN RssEnabled;
 
     //
     // XdpGenericRssCreateIndirection preallocates all data structures needed to
@@ -92,8 +355,11 @@ XdpGenericRssCreateIndirection(
         goto Exit;
     }
 
-    if (NDIS_RSS_HASH_FUNC_FROM_HASH_INFO(RssParams->HashInformation) != 0 &&
-        (RssParams->Flags & NDIS_RSS_PARAM_FLAG_DISABLE_RSS) == 0) {
+    RssEnabled =
+        NDIS_RSS_HASH_FUNC_FROM_HASH_INFO(RssParams->HashInformation) != 0 &&
+        (RssParams->Flags & NDIS_RSS_PARAM_FLAG_DISABLE_RSS) == 0;
+
+    if (RssEnabled) {
         EntryCount = RssParams->IndirectionTableSize / sizeof(PROCESSOR_NUMBER);
         RssTable = (PROCESSOR_NUMBER *)
             (((UCHAR *)RssParams) + RssParams->IndirectionTableOffset);
@@ -103,6 +369,13 @@ XdpGenericRssCreateIndirection(
         RssTable = &DisabledRssTable;
     }
 
+    Status =
+        XdpGenericRssCreateSoftwareHash(
+            Generic, RssParams, RssParamsLength, RssEnabled, Indirection);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
     if ((RssParams->Flags & NDIS_RSS_PARAM_FLAG_ITABLE_UNCHANGED) != 0) {
         //
         // Don't update the indirection table if it is not changing.
@@ -111,6 +384,14 @@ XdpGenericRssCreateIndirection(
         goto Exit;
     }
 
+    if (XdpGenericRssCreateIndirectionPatch(Generic, RssTable, EntryCount, Indirection)) {
+        TraceInfo(
+            TRACE_GENERIC, "IfIndex=%u PatchCount=%u",
+            Generic->IfIndex, Indirection->PatchCount);
+        Status = STATUS_SUCCESS;
+        goto Exit;
+    }
+
     NewQueues =
         ExAllocatePoolZero(
             PagedPool, sizeof(*NewQueues) * MaxProcessors, POOLTAG_RSS);
@@ -123,7 +404,7 @@ XdpGenericRssCreateIndirection(
         ExAllocatePoolZero(
             NonPagedPoolNxCacheAligned,
             sizeof(*NewIndirectionTable) +
-                EntryCount * sizeof(NewIndirectionTable->Entries[0]),
+                (EntryCount + MaxProcessors) * sizeof(NewIndirectionTable->Entries[0]),
             POOLTAG_RSS);
     if (NewIndirectionTable == NULL) {
         Status = STATUS_NO_MEMORY;
@@ -131,6 +412,8 @@ XdpGenericRssCreateIndirection(
     }
 
     NewIndirectionTable->IndirectionMask = EntryCount - 1;
+    NewIndirectionTable->ProcessorCount = MaxProcessors;
+    NewIndirectionTable->ProcessorEntries = &NewIndirectionTable->Entries[EntryCount];
 
     //
     // Figure out the new queue processor affinities.
@@ -163,6 +446,16 @@ XdpGenericRssCreateIndirection(
         NewIndirectionTable->Entries[Index].QueueIndex = QueueIndex;
     }
 
+    //
+    // Processors without an RSS queue resolve to the queue at index 0, which
+    // the zero-initialized processor entries already specify.
+    //
+    for (ULONG QueueIndex = 0; QueueIndex < AssignedQueues; QueueIndex++) {
+        NewIndirectionTable->ProcessorEntries[NewQueues[QueueIndex].IdealProcessor].QueueIndex =
+            QueueIndex;
+    }
+
+    NewIndirectionTable->AssignedQueues = AssignedQueues;
     Indirection->AssignedQueues = AssignedQueues;
     Indirection->NewIndirectionTable = NewIndirectionTable;
     Indirection->NewQueues = NewQueues;
@@ -198,10 +491,61 @@ XdpGenericRssApplyIndirection(
     XDP_LWF_GENERIC_INDIRECTION_TABLE *OldIndirectionTable;
 
     //
-    // Applies an indirection table created by XdpGenericRssCreateIndirection.
-    // This procedure cannot fail unless the RSS queue count becomes out of sync.
+    // Applies an indirection table or patch created by
+    // XdpGenericRssCreateIndirection. This procedure cannot fail unless the RSS
+    // queue count becomes out of sync, or another update raced with a patch.
     //
 
+    if (Indirection->SoftwareHashChanged) {
+        XDP_LWF_GENERIC_RSS_HASH *OldSoftwareHash;
+        XDP_LWF_GENERIC_RSS_HASH *OldSendHash;
+
+        RtlAcquirePushLockExclusive(&Generic->Lock);
+        OldSoftwareHash = Rss->SoftwareHash;
+        WritePointerRelease(&Rss->SoftwareHash, Indirection->NewSoftwareHash);
+        Indirection->NewSoftwareHash = NULL;
+        OldSendHash = Rss->SendHash;
+        WritePointerRelease(&Rss->SendHash, Indirection->NewSendHash);
+        Indirection->NewSendHash = NULL;
+        RtlReleasePushLockExclusive(&Generic->Lock);
+
+        if (OldSoftwareHash != NULL) {
+            XdpLifetimeDelete(
+                XdpGenericRssFreeLifetimeSoftwareHash, &OldSoftwareHash->DeleteEntry);
+        }
+
+        if (OldSendHash != NULL) {
+            XdpLifetimeDelete(XdpGenericRssFreeLifetimeSoftwareHash, &OldSendHash->DeleteEntry);
+        }
+    }
+
+    if (Indirection->Patch) {
+        RtlAcquirePushLockExclusive(&Generic->Lock);
+
+        if (Rss->IndirectionGeneration != Indirection->PatchGeneration) {
+            TraceError(
+                TRACE_LWF,
+                "IfIndex=%u Indirection table changed since the patch was created",
+                Generic->IfIndex);
+        } else {
+            //
+            // The data path reads entries without synchronization, so write
+            // each entry atomically; entries are independent of each other.
+            //
+            for (UINT32 Index = 0; Index < Indirection->PatchCount; Index++) {
+                const XDP_LWF_GENERIC_INDIRECTION_PATCH *Patch = &Indirection->PatchEntries[Index];
+
+                WriteUInt32NoFence(
+                    &Rss->IndirectionTable->Entries[Patch->Index].QueueIndex, Patch->QueueIndex);
+            }
+
+            Rss->IndirectionGeneration++;
+        }
+
+        RtlReleasePushLockExclusive(&Generic->Lock);
+        goto Exit;
+    }
+
     if (Indirection->NewIndirectionTable == NULL) {
         ASSERT(Indirection->AssignedQueues == 0);
         goto Exit;
@@ -233,6 +577,7 @@ XdpGenericRssApplyIndirection(
     OldIndirectionTable = Rss->IndirectionTable;
     Rss->IndirectionTable = Indirection->NewIndirectionTable;
     Indirection->NewIndirectionTable = NULL;
+    Rss->IndirectionGeneration++;
 
     RtlReleasePushLockExclusive(&Generic->Lock);
 
@@ -254,6 +599,14 @@ XdpGenericRssGetQueueById(
     _In_ UINT32 QueueId
     )
 {
+    if (QueueId >= XDP_DEDICATED_QUEUE_ID_BASE) {
+        if (QueueId - XDP_DEDICATED_QUEUE_ID_BASE >= RTL_NUMBER_OF(Generic->Rss.DedicatedQueues)) {
+            return NULL;
+        }
+
+        return &Generic->Rss.DedicatedQueues[QueueId - XDP_DEDICATED_QUEUE_ID_BASE];
+    }
+
     if (QueueId >= Generic->Rss.QueueCount) {
         return NULL;
     }
@@ -283,30 +636,23 @@ XdpGenericRssGetQueue(
     if (IndirectionTable == NULL || Queues == NULL) {
         return NULL;
     } else if (RssHash == 0 && IndirectionTable->IndirectionMask > 0 && !TxInspect) {
-        Queue = NULL;
-
         //
         // Some NIC vendors support RSS, but do not fill out the hash OOB fields.
-        // In this case, infer the queue from the current processor. For TX
-        // inspect, do not use the current CPU to infer the RSS queue ID since
-        // the NDIS send path is not RSS-affinitized.
+        // In this case, trust the hardware to have indicated the NBLs on the
+        // RSS queue's processor and infer the queue from the current
+        // processor. For TX inspect, do not use the current CPU to infer the
+        // RSS queue ID since the NDIS send path is not RSS-affinitized.
         //
-        // TODO: Optimize with (CPU -> queue) index.
+        // Assign to queue at index 0 if the processor has no RSS queue.
         //
-        for (IndirectionIndex = 0;
-            IndirectionIndex <= IndirectionTable->IndirectionMask;
-            IndirectionIndex++) {
-            IndirectionEntry = &IndirectionTable->Entries[IndirectionIndex];
-            Queue = &Queues[IndirectionEntry->QueueIndex];
-            if (Queue->IdealProcessor == CurrentProcessor) {
-                return Queue;
-            }
+        if (CurrentProcessor >= IndirectionTable->ProcessorCount) {
+            return &Queues[0];
         }
 
-        //
-        // Assign to queue at index 0 if appropriate queue was not found.
-        //
-        return &Queues[0];
+        IndirectionEntry = &IndirectionTable->ProcessorEntries[CurrentProcessor];
+        Queue = &Queues[IndirectionEntry->QueueIndex];
+
+        return Queue;
     } else {
         //
         // Normal case where RSS is supported and hash OOB is filled out.
@@ -319,6 +665,684 @@ XdpGenericRssGetQueue(
     }
 }
 
+static
+VOID
+XdpGenericRssFreeLifetimeFlowSteering(
+    _In_ XDP_LIFETIME_ENTRY *Entry
+    )
+{
+    XDP_LWF_GENERIC_FLOW_STEERING_TABLE *FlowSteeringTable =
+        CONTAINING_RECORD(Entry, XDP_LWF_GENERIC_FLOW_STEERING_TABLE, DeleteEntry);
+
+    ExFreePoolWithTag(FlowSteeringTable, POOLTAG_RSS);
+}
+
+static
+VOID
+XdpGenericRssFreeLifetimeDropFilter(
+    _In_ XDP_LIFETIME_ENTRY *Entry
+    )
+{
+    XDP_LWF_GENERIC_DROP_FILTER_TABLE *DropFilterTable =
+        CONTAINING_RECORD(Entry, XDP_LWF_GENERIC_DROP_FILTER_TABLE, DeleteEntry);
+
+    ExFreePoolWithTag(DropFilterTable, POOLTAG_RSS);
+}
+
+static
+BOOLEAN
+XdpGenericRssFlowSteeringEqualFilters(
+    _In_ const XDP_FLOW_STEERING_FILTER *A,
+    _In_ const XDP_FLOW_STEERING_FILTER *B
+    )
+{
+    return
+        A->AddressFamily == B->AddressFamily &&
+        A->Protocol == B->Protocol &&
+        A->SourcePort == B->SourcePort &&
+        A->DestinationPort == B->DestinationPort &&
+        RtlEqualMemory(A->SourceAddress, B->SourceAddress, sizeof(A->SourceAddress)) &&
+        RtlEqualMemory(
+            A->DestinationAddress, B->DestinationAddress, sizeof(A->DestinationAddress));
+}
+
+static
+BOOLEAN
+XdpGenericRssFlowSteeringMatchAddress(
+    _In_reads_bytes_(AddressLength) const UINT8 *FilterAddress,
+    _In_reads_bytes_(AddressLength) const UINT8 *FrameAddress,
+    _In_ UINT32 AddressLength,
+    _In_ BOOLEAN AllowWildcard
+    )
+{
+    static const UINT8 WildcardAddress[RTL_FIELD_SIZE(XDP_FLOW_STEERING_FILTER, SourceAddress)];
+
+    ASSERT(AddressLength <= sizeof(WildcardAddress));
+
+    if (AllowWildcard && RtlEqualMemory(FilterAddress, WildcardAddress, AddressLength)) {
+        return TRUE;
+    }
+
+    return RtlEqualMemory(FilterAddress, FrameAddress, AddressLength);
+}
+
+static
+BOOLEAN
+XdpGenericRssParseFrame(
+    _In_ NET_BUFFER *NetBuffer,
+    _Out_writes_bytes_(XDP_LWF_GENERIC_FLOW_STEERING_LOOKAHEAD) UCHAR *Storage,
+    _Out_ XDP_LWF_GENERIC_RSS_TUPLE *Tuple
+    )
+{
+    const UCHAR *Frame;
+    const ETHERNET_HEADER *Ethernet;
+    UINT32 FrameLength;
+    UINT32 PortOffset;
+    BOOLEAN Fragment = FALSE;
+
+    //
+    // Parse the IP addresses and, for unfragmented TCP and UDP frames, the
+    // ports. IPv6 extension headers are not parsed, so such frames yield only
+    // their addresses.
+    //
+
+    RtlZeroMemory(Tuple, sizeof(*Tuple));
+
+    FrameLength =
+        min(NET_BUFFER_DATA_LENGTH(NetBuffer), XDP_LWF_GENERIC_FLOW_STEERING_LOOKAHEAD);
+    Frame = NdisGetDataBuffer(NetBuffer, FrameLength, Storage, 1, 0);
+    if (Frame == NULL || FrameLength < sizeof(*Ethernet)) {
+        return FALSE;
+    }
+
+    Ethernet = (const ETHERNET_HEADER *)Frame;
+
+    if (Ethernet->Type == htons(ETHERNET_TYPE_IPV4)) {
+        const IPV4_HEADER *Ipv4 = (const IPV4_HEADER *)(Ethernet + 1);
+
+        if (FrameLength < sizeof(*Ethernet) + sizeof(*Ipv4) ||
+            Ipv4->HeaderLength < sizeof(*Ipv4) / sizeof(UINT32)) {
+            return FALSE;
+        }
+
+        Tuple->AddressFamily = XDP_FLOW_STEERING_ADDRESS_FAMILY_INET4;
+        Tuple->AddressLength = sizeof(Ipv4->SourceAddress);
+        Tuple->SourceAddress = (const UINT8 *)&Ipv4->SourceAddress;
+        Tuple->DestinationAddress = (const UINT8 *)&Ipv4->DestinationAddress;
+        Tuple->IpProto = Ipv4->Protocol;
+        PortOffset = sizeof(*Ethernet) + Ipv4->HeaderLength * sizeof(UINT32);
+        Fragment = (ntohs(Ipv4->FlagsAndOffset) & IP4_FRAGMENT_MASK) != 0;
+    } else if (Ethernet->Type == htons(ETHERNET_TYPE_IPV6)) {
+        const IPV6_HEADER *Ipv6 = (const IPV6_HEADER *)(Ethernet + 1);
+
+        if (FrameLength < sizeof(*Ethernet) + sizeof(*Ipv6)) {
+            return FALSE;
+        }
+
+        Tuple->AddressFamily = XDP_FLOW_STEERING_ADDRESS_FAMILY_INET6;
+        Tuple->AddressLength = sizeof(Ipv6->SourceAddress);
+        Tuple->SourceAddress = (const UINT8 *)&Ipv6->SourceAddress;
+        Tuple->DestinationAddress = (const UINT8 *)&Ipv6->DestinationAddress;
+        Tuple->IpProto = Ipv6->NextHeader;
+        PortOffset = sizeof(*Ethernet) + sizeof(*Ipv6);
+    } else {
+        return FALSE;
+    }
+
+    if (!Fragment &&
+        (Tuple->IpProto == IPPROTO_UDP || Tuple->IpProto == IPPROTO_TCP) &&
+        FrameLength >= PortOffset + 2 * sizeof(*Tuple->Ports)) {
+        Tuple->Ports = (const UINT16 *)(Frame + PortOffset);
+    }
+
+    return TRUE;
+}
+
+_IRQL_requires_(DISPATCH_LEVEL)
+XDP_LWF_GENERIC_RSS_QUEUE *
+XdpGenericRssSteerFlow(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ XDP_LWF_GENERIC_FLOW_STEERING_TABLE *FlowSteeringTable,
+    _In_ NET_BUFFER_LIST *NetBufferList
+    )
+{
+    XDP_LWF_GENERIC_RSS *Rss = &Generic->Rss;
+    UCHAR Storage[XDP_LWF_GENERIC_FLOW_STEERING_LOOKAHEAD];
+    XDP_LWF_GENERIC_RSS_TUPLE Tuple;
+    XDP_FLOW_STEERING_PROTOCOL Protocol;
+    XDP_LWF_GENERIC_RSS_QUEUE *Queues;
+
+    //
+    // Match the first NB's 5-tuple against the programmed filters. Frames that
+    // cannot be parsed, including IP fragments and IPv6 frames with extension
+    // headers, are not steered.
+    //
+
+    if (!XdpGenericRssParseFrame(NET_BUFFER_LIST_FIRST_NB(NetBufferList), Storage, &Tuple) ||
+        Tuple.Ports == NULL) {
+        return NULL;
+    }
+
+    Protocol =
+        (Tuple.IpProto == IPPROTO_UDP) ?
+            XDP_FLOW_STEERING_PROTOCOL_UDP : XDP_FLOW_STEERING_PROTOCOL_TCP;
+
+    for (UINT32 Index = 0; Index < FlowSteeringTable->FilterCount; Index++) {
+        const XDP_FLOW_STEERING_FILTER *Filter = &FlowSteeringTable->Filters[Index];
+
+        if (Filter->AddressFamily != Tuple.AddressFamily ||
+            Filter->Protocol != Protocol ||
+            Filter->DestinationPort != Tuple.Ports[1] ||
+            (Filter->SourcePort != 0 && Filter->SourcePort != Tuple.Ports[0]) ||
+            !XdpGenericRssFlowSteeringMatchAddress(
+                Filter->DestinationAddress, Tuple.DestinationAddress, Tuple.AddressLength,
+                FALSE) ||
+            !XdpGenericRssFlowSteeringMatchAddress(
+                Filter->SourceAddress, Tuple.SourceAddress, Tuple.AddressLength, TRUE)) {
+            continue;
+        }
+
+        if (Filter->QueueId >= XDP_DEDICATED_QUEUE_ID_BASE) {
+            return XdpGenericRssGetQueueById(Generic, Filter->QueueId);
+        }
+
+        //
+        // The RSS queue count may have shrunk since the filter was programmed.
+        //
+        Queues = ReadPointerNoFence(&Rss->Queues);
+        if (Queues == NULL || Filter->QueueId >= ReadULongNoFence(&Rss->QueueCount)) {
+            return NULL;
+        }
+
+        return &Queues[Filter->QueueId];
+    }
+
+    return NULL;
+}
+
+static
+_IRQL_requires_(DISPATCH_LEVEL)
+BOOLEAN
+XdpGenericRssDropFlow(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ XDP_LWF_GENERIC_DROP_FILTER_TABLE *DropFilterTable,
+    _In_opt_ XDP_LWF_GENERIC_FLOW_STEERING_TABLE *FlowSteeringTable,
+    _In_ ULONG Processor,
+    _In_ NET_BUFFER_LIST *NetBufferList
+    )
+{
+    XDP_LWF_GENERIC_RSS *Rss = &Generic->Rss;
+    UCHAR Storage[XDP_LWF_GENERIC_FLOW_STEERING_LOOKAHEAD];
+    XDP_LWF_GENERIC_RSS_TUPLE Tuple;
+    XDP_LWF_GENERIC_RSS_QUEUE *SteeredQueue;
+    UINT64 *Hits;
+    UINT32 Index;
+
+    //
+    // Frames that cannot be parsed are left to XDP inspection, which matches
+    // a superset of the frames parsed here.
+    //
+    if (!XdpGenericRssParseFrame(NET_BUFFER_LIST_FIRST_NB(NetBufferList), Storage, &Tuple) ||
+        Tuple.Ports == NULL) {
+        return FALSE;
+    }
+
+    for (Index = 0; Index < DropFilterTable->FilterCount; Index++) {
+        const XDP_OFFLOAD_DROP_FILTER *Filter = &DropFilterTable->Filters[Index];
+
+        if (Filter->IpProtocol == Tuple.IpProto &&
+            (Filter->DestinationPort == 0 || Filter->DestinationPort == Tuple.Ports[1])) {
+            break;
+        }
+    }
+
+    if (Index == DropFilterTable->FilterCount) {
+        return FALSE;
+    }
+
+    //
+    // Drop filters apply to the RSS queues only; flows steered to a dedicated
+    // queue are inspected there.
+    //
+    if (FlowSteeringTable != NULL) {
+        SteeredQueue = XdpGenericRssSteerFlow(Generic, FlowSteeringTable, NetBufferList);
+        if (SteeredQueue >= &Rss->DedicatedQueues[0] &&
+            SteeredQueue < &Rss->DedicatedQueues[RTL_NUMBER_OF(Rss->DedicatedQueues)]) {
+            return FALSE;
+        }
+    }
+
+    ASSERT(Processor < DropFilterTable->ProcessorCount);
+    Hits = (UINT64 *)(DropFilterTable->Hits + Processor * DropFilterTable->ProcessorStride);
+    Hits[Index]++;
+
+    return TRUE;
+}
+
+_IRQL_requires_(DISPATCH_LEVEL)
+NET_BUFFER_LIST *
+XdpGenericRssDropFlows(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ XDP_LWF_GENERIC_DROP_FILTER_TABLE *DropFilterTable,
+    _In_opt_ XDP_LWF_GENERIC_FLOW_STEERING_TABLE *FlowSteeringTable,
+    _In_ ULONG Processor,
+    _In_ NET_BUFFER_LIST *NetBufferLists,
+    _Inout_ NBL_QUEUE *DropList
+    )
+{
+    NET_BUFFER_LIST *PassHead = NULL;
+    NET_BUFFER_LIST **PassTail = &PassHead;
+
+    while (NetBufferLists != NULL) {
+        NET_BUFFER_LIST *Nbl = NetBufferLists;
+        NetBufferLists = Nbl->Next;
+        Nbl->Next = NULL;
+
+        if (XdpGenericRssDropFlow(Generic, DropFilterTable, FlowSteeringTable, Processor, Nbl)) {
+            NdisAppendSingleNblToNblQueue(DropList, Nbl);
+        } else {
+            *PassTail = Nbl;
+            PassTail = &Nbl->Next;
+        }
+    }
+
+    return PassHead;
+}
+
+static
+UINT32
+XdpGenericRssToeplitzHash(
+    _In_reads_bytes_(HashSecretKeySize) const UCHAR *HashSecretKey,
+    _In_ UINT32 HashSecretKeySize,
+    _In_reads_bytes_(InputLength) const UCHAR *Input,
+    _In_ UINT32 InputLength
+    )
+{
+    UINT32 Hash = 0;
+    UINT32 Window = 0;
+    UINT32 KeyIndex;
+
+    //
+    // Key bytes beyond the end of the key are treated as zero.
+    //
+    for (KeyIndex = 0; KeyIndex < sizeof(Window); KeyIndex++) {
+        Window <<= 8;
+        if (KeyIndex < HashSecretKeySize) {
+            Window |= HashSecretKey[KeyIndex];
+        }
+    }
+
+    for (UINT32 Index = 0; Index < InputLength; Index++, KeyIndex++) {
+        UCHAR NextKeyByte = (KeyIndex < HashSecretKeySize) ? HashSecretKey[KeyIndex] : 0;
+
+        for (UINT32 Bit = 0; Bit < 8; Bit++) {
+            if (Input[Index] & (0x80 >> Bit)) {
+                Hash ^= Window;
+            }
+
+            Window = (Window << 1) | ((NextKeyByte >> (7 - Bit)) & 1);
+        }
+    }
+
+    return Hash;
+}
+
+_IRQL_requires_(DISPATCH_LEVEL)
+BOOLEAN
+XdpGenericRssComputeHash(
+    _In_ ULONG HashTypes,
+    _In_reads_bytes_(HashSecretKeySize) const UCHAR *HashSecretKey,
+    _In_ UINT32 HashSecretKeySize,
+    _In_ NET_BUFFER_LIST *NetBufferList,
+    _Out_ UINT32 *Hash,
+    _Out_ ULONG *HashType
+    )
+{
+    UCHAR Storage[XDP_LWF_GENERIC_FLOW_STEERING_LOOKAHEAD];
+    UCHAR Input[XDP_LWF_GENERIC_RSS_HASH_INPUT_MAX];
+    XDP_LWF_GENERIC_RSS_TUPLE Tuple;
+    UINT32 InputLength;
+    ULONG PortHashTypes = 0;
+    ULONG AddressHashTypes;
+
+    //
+    // Compute the Toeplitz hash of the first NB as the NIC would have, hashing
+    // the ports if the hash types include the frame's transport protocol.
+    //
+
+    *Hash = 0;
+    *HashType = 0;
+
+    if (!XdpGenericRssParseFrame(NET_BUFFER_LIST_FIRST_NB(NetBufferList), Storage, &Tuple)) {
+        return FALSE;
+    }
+
+    if (Tuple.AddressFamily == XDP_FLOW_STEERING_ADDRESS_FAMILY_INET4) {
+        if (Tuple.IpProto == IPPROTO_TCP) {
+            PortHashTypes = HashTypes & NDIS_HASH_TCP_IPV4;
+        } else if (Tuple.IpProto == IPPROTO_UDP) {
+            PortHashTypes = HashTypes & NDIS_HASH_UDP_IPV4;
+        }
+        AddressHashTypes = HashTypes & NDIS_HASH_IPV4;
+    } else {
+        if (Tuple.IpProto == IPPROTO_TCP) {
+            PortHashTypes = HashTypes & (NDIS_HASH_TCP_IPV6 | NDIS_HASH_TCP_IPV6_EX);
+        } else if (Tuple.IpProto == IPPROTO_UDP) {
+            PortHashTypes = HashTypes & (NDIS_HASH_UDP_IPV6 | NDIS_HASH_UDP_IPV6_EX);
+        }
+        AddressHashTypes = HashTypes & (NDIS_HASH_IPV6 | NDIS_HASH_IPV6_EX);
+    }
+
+    if (Tuple.Ports == NULL) {
+        PortHashTypes = 0;
+    }
+
+    if (PortHashTypes == 0 && AddressHashTypes == 0) {
+        return FALSE;
+    }
+
+    RtlCopyMemory(Input, Tuple.SourceAddress, Tuple.AddressLength);
+    RtlCopyMemory(Input + Tuple.AddressLength, Tuple.DestinationAddress, Tuple.AddressLength);
+    InputLength = 2 * Tuple.AddressLength;
+
+    if (PortHashTypes != 0) {
+        RtlCopyMemory(Input + InputLength, Tuple.Ports, 2 * sizeof(*Tuple.Ports));
+        InputLength += 2 * sizeof(*Tuple.Ports);
+    }
+
+    *Hash = XdpGenericRssToeplitzHash(HashSecretKey, HashSecretKeySize, Input, InputLength);
+
+    //
+    // Report the lowest matching hash type, which prefers the variants
+    // without IPv6 extension headers.
+    //
+    *HashType = (PortHashTypes != 0) ? PortHashTypes : AddressHashTypes;
+    *HashType &= ~(*HashType - 1);
+
+    return TRUE;
+}
+
+_IRQL_requires_(DISPATCH_LEVEL)
+XDP_LWF_GENERIC_RSS_QUEUE *
+XdpGenericRssHashFlow(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ XDP_LWF_GENERIC_RSS_HASH *SoftwareHash,
+    _In_ NET_BUFFER_LIST *NetBufferList
+    )
+{
+    XDP_LWF_GENERIC_RSS *Rss = &Generic->Rss;
+    XDP_LWF_GENERIC_INDIRECTION_TABLE *IndirectionTable;
+    XDP_LWF_GENERIC_RSS_QUEUE *Queues;
+    ULONG HashType;
+    UINT32 Hash;
+
+    //
+    // Compute the hash as the NIC would have with the configured symmetric
+    // key, and resolve the RSS queue from the hash.
+    //
+
+    if (!XdpGenericRssComputeHash(
+            SoftwareHash->HashType, SoftwareHash->HashSecretKey,
+            SoftwareHash->HashSecretKeySize, NetBufferList, &Hash, &HashType)) {
+        return NULL;
+    }
+
+    IndirectionTable = ReadPointerNoFence(&Rss->IndirectionTable);
+    Queues = ReadPointerNoFence(&Rss->Queues);
+
+    if (IndirectionTable == NULL || Queues == NULL) {
+        return NULL;
+    }
+
+    return &Queues[IndirectionTable->Entries[Hash & IndirectionTable->IndirectionMask].QueueIndex];
+}
+
+NTSTATUS
+XdpGenericRssSetFlowSteering(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ const XDP_OFFLOAD_PARAMS_FLOW_STEERING *FlowSteeringParams
+    )
+{
+    NTSTATUS Status;
+    XDP_LWF_GENERIC_RSS *Rss = &Generic->Rss;
+    XDP_LWF_GENERIC_FLOW_STEERING_TABLE *OldTable;
+    XDP_LWF_GENERIC_FLOW_STEERING_TABLE *NewTable = NULL;
+    UINT32 MaxFilterCount;
+    UINT32 TableSize;
+    LIST_ENTRY *Entry;
+
+    TraceEnter(TRACE_GENERIC, "IfIndex=%u", Generic->IfIndex);
+
+    RtlAcquirePushLockExclusive(&Generic->Lock);
+
+    OldTable = Rss->FlowSteeringTable;
+
+    //
+    // Build a new immutable table from the current filters and the requested
+    // changes, then atomically replace the data path's table.
+    //
+    MaxFilterCount =
+        min(
+            XDP_LWF_GENERIC_FLOW_STEERING_MAX_FILTERS,
+            (OldTable != NULL ? OldTable->FilterCount : 0) + FlowSteeringParams->FilterCount);
+
+    Status =
+        RtlUInt32Mult(MaxFilterCount, sizeof(NewTable->Filters[0]), &TableSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = RtlUInt32Add(TableSize, sizeof(*NewTable), &TableSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    NewTable = ExAllocatePoolZero(NonPagedPoolNx, TableSize, POOLTAG_RSS);
+    if (NewTable == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    if (OldTable != NULL) {
+        ASSERT(OldTable->FilterCount <= MaxFilterCount);
+        RtlCopyMemory(
+            NewTable->Filters, OldTable->Filters,
+            OldTable->FilterCount * sizeof(NewTable->Filters[0]));
+        NewTable->FilterCount = OldTable->FilterCount;
+    }
+
+    for (Entry = FlowSteeringParams->Filters.Flink;
+        Entry != &FlowSteeringParams->Filters;
+        Entry = Entry->Flink) {
+        XDP_OFFLOAD_PARAMS_FLOW_STEERING_FILTER *OffloadFilter =
+            CONTAINING_RECORD(Entry, XDP_OFFLOAD_PARAMS_FLOW_STEERING_FILTER, TransactionEntry);
+        XDP_FLOW_STEERING_FILTER *Filter = &OffloadFilter->Params;
+        NTSTATUS FilterStatus = STATUS_SUCCESS;
+        UINT32 Index;
+
+        for (Index = 0; Index < NewTable->FilterCount; Index++) {
+            if (XdpGenericRssFlowSteeringEqualFilters(&NewTable->Filters[Index], Filter)) {
+                break;
+            }
+        }
+
+        switch (Filter->Operation) {
+        case XDP_FLOW_STEERING_OPERATION_ADD:
+            //
+            // The queue ID is validated on the data path, since the RSS queue
+            // count may change after the filter is added.
+            //
+            if (Index < NewTable->FilterCount) {
+                FilterStatus = STATUS_DUPLICATE_OBJECTID;
+            } else if (NewTable->FilterCount >= MaxFilterCount) {
+                FilterStatus = STATUS_QUOTA_EXCEEDED;
+            } else {
+                NewTable->Filters[NewTable->FilterCount++] = *Filter;
+            }
+            break;
+
+        case XDP_FLOW_STEERING_OPERATION_REMOVE:
+            //
+            // Removing an absent filter succeeds so offload reverts are
+            // idempotent.
+            //
+            if (Index < NewTable->FilterCount) {
+                RtlMoveMemory(
+                    &NewTable->Filters[Index], &NewTable->Filters[Index + 1],
+                    (NewTable->FilterCount - Index - 1) * sizeof(NewTable->Filters[0]));
+                NewTable->FilterCount--;
+            }
+            break;
+
+        default:
+            ASSERT(FALSE);
+            FilterStatus = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        Filter->Status = HRESULT_FROM_WIN32(RtlNtStatusToDosErrorNoTeb(FilterStatus));
+    }
+
+    if (NewTable->FilterCount == 0) {
+        ExFreePoolWithTag(NewTable, POOLTAG_RSS);
+        NewTable = NULL;
+    }
+
+    WritePointerRelease(&Rss->FlowSteeringTable, NewTable);
+    NewTable = NULL;
+
+    if (OldTable != NULL) {
+        XdpLifetimeDelete(XdpGenericRssFreeLifetimeFlowSteering, &OldTable->DeleteEntry);
+    }
+
+Exit:
+
+    RtlReleasePushLockExclusive(&Generic->Lock);
+
+    if (NewTable != NULL) {
+        ExFreePoolWithTag(NewTable, POOLTAG_RSS);
+    }
+
+    TraceExitStatus(TRACE_GENERIC);
+
+    return Status;
+}
+
+NTSTATUS
+XdpGenericRssSetDropFilters(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ const XDP_OFFLOAD_PARAMS_DROP_FILTER *DropFilterParams
+    )
+{
+    NTSTATUS Status;
+    XDP_LWF_GENERIC_RSS *Rss = &Generic->Rss;
+    XDP_LWF_GENERIC_DROP_FILTER_TABLE *OldTable;
+    XDP_LWF_GENERIC_DROP_FILTER_TABLE *NewTable = NULL;
+    UINT32 FilterCount = DropFilterParams->FilterCount;
+    UINT32 ProcessorCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    SIZE_T HitsOffset;
+    SIZE_T ProcessorStride;
+    SIZE_T TableSize;
+
+    TraceEnter(TRACE_GENERIC, "IfIndex=%u FilterCount=%u", Generic->IfIndex, FilterCount);
+
+    ASSERT(FilterCount <= XDP_LWF_GENERIC_DROP_FILTER_MAX_FILTERS);
+
+    if (FilterCount > 0) {
+        //
+        // Each processor counts hits in its own cache-aligned slice.
+        //
+        HitsOffset =
+            ALIGN_UP_BY(
+                sizeof(*NewTable) + FilterCount * sizeof(NewTable->Filters[0]),
+                SYSTEM_CACHE_ALIGNMENT_SIZE);
+        ProcessorStride = ALIGN_UP_BY(FilterCount * sizeof(UINT64), SYSTEM_CACHE_ALIGNMENT_SIZE);
+
+        Status = RtlSizeTMult(ProcessorStride, ProcessorCount, &TableSize);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        Status = RtlSizeTAdd(TableSize, HitsOffset, &TableSize);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        NewTable = ExAllocatePoolZero(NonPagedPoolNxCacheAligned, TableSize, POOLTAG_RSS);
+        if (NewTable == NULL) {
+            Status = STATUS_NO_MEMORY;
+            goto Exit;
+        }
+
+        NewTable->FilterCount = FilterCount;
+        NewTable->ProcessorCount = ProcessorCount;
+        NewTable->ProcessorStride = ProcessorStride;
+        NewTable->Hits = (UCHAR *)NewTable + HitsOffset;
+        RtlCopyMemory(
+            NewTable->Filters, DropFilterParams->Filters,
+            FilterCount * sizeof(NewTable->Filters[0]));
+    }
+
+    RtlAcquirePushLockExclusive(&Generic->Lock);
+    OldTable = Rss->DropFilterTable;
+    WritePointerRelease(&Rss->DropFilterTable, NewTable);
+    RtlReleasePushLockExclusive(&Generic->Lock);
+
+    if (OldTable != NULL) {
+        XdpLifetimeDelete(XdpGenericRssFreeLifetimeDropFilter, &OldTable->DeleteEntry);
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_GENERIC);
+
+    return Status;
+}
+
+NTSTATUS
+XdpGenericRssGetDropFilterHits(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _Inout_ XDP_OFFLOAD_PARAMS_DROP_FILTER *DropFilterParams
+    )
+{
+    NTSTATUS Status;
+    XDP_LWF_GENERIC_DROP_FILTER_TABLE *Table;
+
+    TraceEnter(TRACE_GENERIC, "IfIndex=%u", Generic->IfIndex);
+
+    RtlAcquirePushLockShared(&Generic->Lock);
+
+    Table = Generic->Rss.DropFilterTable;
+    if (Table == NULL || Table->FilterCount != DropFilterParams->FilterCount) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    for (UINT32 Index = 0; Index < Table->FilterCount; Index++) {
+        UINT64 Total = 0;
+
+        for (UINT32 Processor = 0; Processor < Table->ProcessorCount; Processor++) {
+            const UINT64 *Hits =
+                (const UINT64 *)(Table->Hits + Processor * Table->ProcessorStride);
+            Total += ReadUInt64NoFence(&Hits[Index]);
+        }
+
+        DropFilterParams->Hits[Index] = Total;
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    RtlReleasePushLockShared(&Generic->Lock);
+
+    TraceExitStatus(TRACE_GENERIC);
+
+    return Status;
+}
+
 NDIS_STATUS
 XdpGenericRssInspectOidRequest(
     _In_ XDP_LWF_GENERIC *Generic,
@@ -380,6 +1404,14 @@ XdpGenericRssInitialize(
 
     QueueCount = 1;
 
+    //
+    // Spread the dedicated queues' execution contexts across processors.
+    //
+    for (ULONG Index = 0; Index < RTL_NUMBER_OF(Rss->DedicatedQueues); Index++) {
+        Rss->DedicatedQueues[Index].IdealProcessor =
+            Index % KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    }
+
     if (NT_SUCCESS(Status) &&
         BytesReturned >= NDIS_SIZEOF_RECEIVE_SCALE_CAPABILITIES_REVISION_1 &&
         RssCaps.Header.Type == NDIS_OBJECT_TYPE_RSS_CAPABILITIES &&
@@ -541,6 +1573,10 @@ XdpGenericRssCleanup(
     XDP_LWF_GENERIC_RSS *Rss = &Generic->Rss;
     XDP_LWF_GENERIC_INDIRECTION_TABLE *IndirectionTable = NULL;
     XDP_LWF_GENERIC_RSS_CLEANUP *QueueCleanup = NULL;
+    XDP_LWF_GENERIC_FLOW_STEERING_TABLE *FlowSteeringTable = NULL;
+    XDP_LWF_GENERIC_DROP_FILTER_TABLE *DropFilterTable = NULL;
+    XDP_LWF_GENERIC_RSS_HASH *SoftwareHash = NULL;
+    XDP_LWF_GENERIC_RSS_HASH *SendHash = NULL;
 
     RtlAcquirePushLockExclusive(&Generic->Lock);
 
@@ -556,6 +1592,26 @@ XdpGenericRssCleanup(
         Rss->IndirectionTable = NULL;
     }
 
+    if (Rss->FlowSteeringTable != NULL) {
+        FlowSteeringTable = Rss->FlowSteeringTable;
+        Rss->FlowSteeringTable = NULL;
+    }
+
+    if (Rss->DropFilterTable != NULL) {
+        DropFilterTable = Rss->DropFilterTable;
+        Rss->DropFilterTable = NULL;
+    }
+
+    if (Rss->SoftwareHash != NULL) {
+        SoftwareHash = Rss->SoftwareHash;
+        Rss->SoftwareHash = NULL;
+    }
+
+    if (Rss->SendHash != NULL) {
+        SendHash = Rss->SendHash;
+        Rss->SendHash = NULL;
+    }
+
     RtlReleasePushLockExclusive(&Generic->Lock);
 
     if (QueueCleanup != NULL) {
@@ -565,4 +1621,21 @@ XdpGenericRssCleanup(
     if (IndirectionTable != NULL) {
         XdpLifetimeDelete(XdpGenericRssFreeLifetimeIndirection, &IndirectionTable->DeleteEntry);
     }
+
+    if (FlowSteeringTable != NULL) {
+        XdpLifetimeDelete(
+            XdpGenericRssFreeLifetimeFlowSteering, &FlowSteeringTable->DeleteEntry);
+    }
+
+    if (DropFilterTable != NULL) {
+        XdpLifetimeDelete(XdpGenericRssFreeLifetimeDropFilter, &DropFilterTable->DeleteEntry);
+    }
+
+    if (SoftwareHash != NULL) {
+        XdpLifetimeDelete(XdpGenericRssFreeLifetimeSoftwareHash, &SoftwareHash->DeleteEntry);
+    }
+
+    if (SendHash != NULL) {
+        XdpLifetimeDelete(XdpGenericRssFreeLifetimeSoftwareHash, &SendHash->DeleteEntry);
+    }
 }
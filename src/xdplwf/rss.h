@@ -16,6 +16,13 @@ typedef struct _XDP_LWF_GENERIC_RSS_QUEUE {
     XDP_LWF_GENERIC_TX_QUEUE *TxQueue;
     XDP_LWF_GENERIC_RX_QUEUE *TxInspectQueue;
     XDP_LWF_GENERIC_TX_QUEUE *RxInjectQueue;
+
+    //
+    // The number of NBLs received on this queue, counted only while the RSS
+    // rebalancer is sampling. Updates are not atomic; the count is a load
+    // estimate, not an exact statistic.
+    //
+    UINT64 ReceiveLoad;
 } XDP_LWF_GENERIC_RSS_QUEUE;
 
 typedef struct _RSS_INDIRECTION_ENTRY {
@@ -25,6 +32,20 @@ typedef struct _RSS_INDIRECTION_ENTRY {
 typedef struct _XDP_LWF_GENERIC_INDIRECTION_TABLE {
     ULONG IndirectionMask;
     XDP_LIFETIME_ENTRY DeleteEntry;
+
+    //
+    // The number of RSS queues the entries were assigned to. Entries may be
+    // patched in place, but only to move them between assigned queues.
+    //
+    ULONG AssignedQueues;
+
+    //
+    // Resolves the RSS queue affinitized to each processor index, for NBLs
+    // indicated without an RSS hash. Stored after the indirection entries.
+    //
+    ULONG ProcessorCount;
+    RSS_INDIRECTION_ENTRY *ProcessorEntries;
+
     RSS_INDIRECTION_ENTRY Entries[0];
 } XDP_LWF_GENERIC_INDIRECTION_TABLE;
 
@@ -33,11 +54,75 @@ typedef struct _XDP_LWF_GENERIC_RSS_CLEANUP {
     XDP_LWF_GENERIC_RSS_QUEUE *Queues;
 } XDP_LWF_GENERIC_RSS_CLEANUP;
 
+//
+// Immutable snapshot of the flow steering filters programmed on the interface.
+// The table is replaced in its entirety whenever the filter set changes.
+//
+typedef struct _XDP_LWF_GENERIC_FLOW_STEERING_TABLE {
+    XDP_LIFETIME_ENTRY DeleteEntry;
+    UINT32 FilterCount;
+    XDP_FLOW_STEERING_FILTER Filters[0];
+} XDP_LWF_GENERIC_FLOW_STEERING_TABLE;
+
+//
+// The maximum number of drop filters emulated by generic RSS. Filters are
+// matched with a linear scan on the receive path, so keep this small.
+//
+#define XDP_LWF_GENERIC_DROP_FILTER_MAX_FILTERS 64
+
+//
+// Immutable snapshot of the drop filters programmed on the interface, followed
+// by per-processor hit counters. The table is replaced in its entirety
+// whenever the filter set changes.
+//
+typedef struct _XDP_LWF_GENERIC_DROP_FILTER_TABLE {
+    XDP_LIFETIME_ENTRY DeleteEntry;
+    UINT32 FilterCount;
+    UINT32 ProcessorCount;
+    SIZE_T ProcessorStride;
+    UCHAR *Hits;
+    XDP_OFFLOAD_DROP_FILTER Filters[0];
+} XDP_LWF_GENERIC_DROP_FILTER_TABLE;
+
+//
+// Immutable snapshot of a symmetric RSS hash configuration. Generic RSS uses
+// the configuration to hash frames indicated without an RSS hash in software,
+// so both directions of a flow resolve to the same RSS queue.
+//
+typedef struct _XDP_LWF_GENERIC_RSS_HASH {
+    XDP_LIFETIME_ENTRY DeleteEntry;
+    ULONG HashType;
+    UINT32 HashSecretKeySize;
+    UCHAR HashSecretKey[NDIS_RSS_HASH_SECRET_KEY_MAX_SIZE_REVISION_2];
+} XDP_LWF_GENERIC_RSS_HASH;
+
 typedef struct _XDP_LWF_GENERIC_RSS {
     XDP_LWF_GENERIC_RSS_QUEUE *Queues;
     XDP_LWF_GENERIC_INDIRECTION_TABLE *IndirectionTable;
     ULONG QueueCount;
     XDP_LWF_GENERIC_RSS_CLEANUP *QueueCleanup;
+    XDP_LWF_GENERIC_FLOW_STEERING_TABLE *FlowSteeringTable;
+    XDP_LWF_GENERIC_DROP_FILTER_TABLE *DropFilterTable;
+    XDP_LWF_GENERIC_RSS_HASH *SoftwareHash;
+
+    //
+    // The interface's RSS hash configuration, symmetric or not. Generic TX
+    // hashes its frames with it as the NIC would hash them on receive.
+    //
+    XDP_LWF_GENERIC_RSS_HASH *SendHash;
+    BOOLEAN TrackLoad;
+
+    //
+    // Incremented by every indirection update, under the generic lock, to
+    // detect updates racing with a patch created from an older table.
+    //
+    UINT32 IndirectionGeneration;
+
+    //
+    // Queues outside the indirection table, which receive only steered flows.
+    // Unlike the RSS queues, they live as long as the generic interface.
+    //
+    XDP_LWF_GENERIC_RSS_QUEUE DedicatedQueues[XDP_DEDICATED_QUEUE_COUNT];
 } XDP_LWF_GENERIC_RSS;
 
 XDP_LWF_GENERIC_RSS_QUEUE *
@@ -55,16 +140,112 @@ XdpGenericRssGetQueue(
     _In_ UINT32 RssHash
     );
 
+_IRQL_requires_(DISPATCH_LEVEL)
+XDP_LWF_GENERIC_RSS_QUEUE *
+XdpGenericRssSteerFlow(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ XDP_LWF_GENERIC_FLOW_STEERING_TABLE *FlowSteeringTable,
+    _In_ NET_BUFFER_LIST *NetBufferList
+    );
+
+//
+// Removes frames matching a drop filter from the chain and appends them to the
+// drop list. Returns the remaining chain.
+//
+_IRQL_requires_(DISPATCH_LEVEL)
+NET_BUFFER_LIST *
+XdpGenericRssDropFlows(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ XDP_LWF_GENERIC_DROP_FILTER_TABLE *DropFilterTable,
+    _In_opt_ XDP_LWF_GENERIC_FLOW_STEERING_TABLE *FlowSteeringTable,
+    _In_ ULONG Processor,
+    _In_ NET_BUFFER_LIST *NetBufferLists,
+    _Inout_ NBL_QUEUE *DropList
+    );
+
+//
+// Computes the Toeplitz hash of a frame for the given NDIS hash types. Returns
+// FALSE if the frame cannot be parsed or no hash type applies to it.
+//
+_IRQL_requires_(DISPATCH_LEVEL)
+BOOLEAN
+XdpGenericRssComputeHash(
+    _In_ ULONG HashTypes,
+    _In_reads_bytes_(HashSecretKeySize) const UCHAR *HashSecretKey,
+    _In_ UINT32 HashSecretKeySize,
+    _In_ NET_BUFFER_LIST *NetBufferList,
+    _Out_ UINT32 *Hash,
+    _Out_ ULONG *HashType
+    );
+
+_IRQL_requires_(DISPATCH_LEVEL)
+XDP_LWF_GENERIC_RSS_QUEUE *
+XdpGenericRssHashFlow(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ XDP_LWF_GENERIC_RSS_HASH *SoftwareHash,
+    _In_ NET_BUFFER_LIST *NetBufferList
+    );
+
+BOOLEAN
+XdpGenericRssIsSymmetricHashSecretKey(
+    _In_reads_bytes_(HashSecretKeySize) const UCHAR *HashSecretKey,
+    _In_ UINT32 HashSecretKeySize
+    );
+
+VOID
+XdpGenericRssGenerateSymmetricHashSecretKey(
+    _Out_writes_bytes_(HashSecretKeySize) UCHAR *HashSecretKey,
+    _In_ UINT32 HashSecretKeySize
+    );
+
+NTSTATUS
+XdpGenericRssSetFlowSteering(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ const XDP_OFFLOAD_PARAMS_FLOW_STEERING *FlowSteeringParams
+    );
+
+NTSTATUS
+XdpGenericRssSetDropFilters(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _In_ const XDP_OFFLOAD_PARAMS_DROP_FILTER *DropFilterParams
+    );
+
+NTSTATUS
+XdpGenericRssGetDropFilterHits(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _Inout_ XDP_OFFLOAD_PARAMS_DROP_FILTER *DropFilterParams
+    );
+
 NDIS_STATUS
 XdpGenericRssInspectOidRequest(
     _In_ XDP_LWF_GENERIC *Generic,
     _In_ NDIS_OID_REQUEST *Request
     );
 
+#define XDP_LWF_GENERIC_RSS_MAX_INDIRECTION_ENTRIES \
+    (NDIS_RSS_INDIRECTION_TABLE_MAX_SIZE_REVISION_2 / sizeof(PROCESSOR_NUMBER))
+
+typedef struct _XDP_LWF_GENERIC_INDIRECTION_PATCH {
+    UINT16 Index;
+    UINT16 QueueIndex;
+} XDP_LWF_GENERIC_INDIRECTION_PATCH;
+
 typedef struct _XDP_LWF_GENERIC_INDIRECTION_STORAGE {
     XDP_LWF_GENERIC_INDIRECTION_TABLE *NewIndirectionTable;
     XDP_LWF_GENERIC_RSS_QUEUE *NewQueues;
     ULONG AssignedQueues;
+    XDP_LWF_GENERIC_RSS_HASH *NewSoftwareHash;
+    XDP_LWF_GENERIC_RSS_HASH *NewSendHash;
+    BOOLEAN SoftwareHashChanged;
+
+    //
+    // Updates that only move entries between the current RSS queues patch the
+    // current indirection table in place rather than replacing it.
+    //
+    BOOLEAN Patch;
+    UINT32 PatchGeneration;
+    UINT32 PatchCount;
+    XDP_LWF_GENERIC_INDIRECTION_PATCH PatchEntries[XDP_LWF_GENERIC_RSS_MAX_INDIRECTION_ENTRIES];
 } XDP_LWF_GENERIC_INDIRECTION_STORAGE;
 
 VOID
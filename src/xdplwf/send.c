@@ -9,6 +9,12 @@
 #define MAX_TX_BUFFER_LENGTH 65536
 #define DEFAULT_TX_FRAME_COUNT 32
 #define MAX_TX_FRAME_COUNT 8096
+#define GENERIC_TX_INLINE_BUDGET_MIN 8
+
+//
+// The IPv4 more-fragments flag and fragment offset, in host byte order.
+//
+#define IP4_FRAGMENT_MASK 0x3FFF
 
 _IRQL_requires_max_(PASSIVE_LEVEL)
 VOID
@@ -34,6 +40,23 @@ typedef struct _NBL_TX_CONTEXT {
     XDP_LWF_GENERIC_INJECTION_TYPE InjectionType;
     UINT64 BufferAddress;
     XDP_TX_FRAME_COMPLETION_CONTEXT CompletionContext;
+
+    //
+    // The NBL's own NET_BUFFER, which is replaced by a chain of segment
+    // NET_BUFFERs while a software-segmented frame is outstanding.
+    //
+    NET_BUFFER *NetBuffer;
+
+    //
+    // The source MDL region the NBL's partial MDL currently describes, and
+    // the TX queue's buffer MDL generation at the time it was built. The
+    // partial MDL is rebuilt when a frame targets a different region or the
+    // generation has changed.
+    //
+    MDL *BoundMdl;
+    UCHAR *BoundVa;
+    UINT32 BoundLength;
+    UINT32 BoundGeneration;
 } NBL_TX_CONTEXT;
 
 C_ASSERT(
@@ -150,7 +173,668 @@ XdpGenericTxGetNbls(
     return TxQueue->FrameCount - TxQueue->OutstandingCount;
 }
 
+//
+// The TCP flags that are set only on the first or last segment of a segmented
+// TCP frame.
+//
+#define TCP_FIRST_SEGMENT_FLAGS TH_CWR
+#define TCP_LAST_SEGMENT_FLAGS (TH_FIN | TH_PSH)
+
+typedef struct _XDP_LWF_GENERIC_SEGMENT_LAYOUT {
+    UINT32 IpOffset;
+    UINT32 Layer4Offset;
+    UINT32 HeaderLength;
+    BOOLEAN Ipv6;
+    BOOLEAN Tcp;
+} XDP_LWF_GENERIC_SEGMENT_LAYOUT;
+
+static
+BOOLEAN
+XdpGenericTxParseSegmentFrame(
+    _In_reads_bytes_(FrameLength) const UCHAR *Frame,
+    _In_ UINT32 FrameLength,
+    _Out_ XDP_LWF_GENERIC_SEGMENT_LAYOUT *Layout
+    )
+{
+    const ETHERNET_HEADER *Ethernet = (const ETHERNET_HEADER *)Frame;
+    UINT8 IpProto;
+
+    Layout->IpOffset = sizeof(*Ethernet);
+
+    if (FrameLength < Layout->IpOffset) {
+        return FALSE;
+    }
+
+    if (Ethernet->Type == htons(ETHERNET_TYPE_IPV4)) {
+        const IPV4_HEADER *Ipv4 = (const IPV4_HEADER *)(Frame + Layout->IpOffset);
+
+        if (FrameLength < Layout->IpOffset + sizeof(*Ipv4) ||
+            Ipv4->HeaderLength < sizeof(*Ipv4) / sizeof(UINT32) ||
+            (ntohs(Ipv4->FlagsAndOffset) & IP4_FRAGMENT_MASK) != 0) {
+            //
+            // IP fragments cannot be segmented.
+            //
+            return FALSE;
+        }
+
+        IpProto = Ipv4->Protocol;
+        Layout->Layer4Offset = Layout->IpOffset + Ipv4->HeaderLength * sizeof(UINT32);
+        Layout->Ipv6 = FALSE;
+    } else if (Ethernet->Type == htons(ETHERNET_TYPE_IPV6)) {
+        const IPV6_HEADER *Ipv6 = (const IPV6_HEADER *)(Frame + Layout->IpOffset);
+
+        if (FrameLength < Layout->IpOffset + sizeof(*Ipv6)) {
+            return FALSE;
+        }
+
+        //
+        // IPv6 extension headers are not supported.
+        //
+        IpProto = Ipv6->NextHeader;
+        Layout->Layer4Offset = Layout->IpOffset + sizeof(*Ipv6);
+        Layout->Ipv6 = TRUE;
+    } else {
+        return FALSE;
+    }
+
+    if (IpProto == IPPROTO_UDP) {
+        Layout->HeaderLength = Layout->Layer4Offset + sizeof(UDP_HDR);
+        Layout->Tcp = FALSE;
+    } else if (IpProto == IPPROTO_TCP) {
+        const TCP_HDR *Tcp = (const TCP_HDR *)(Frame + Layout->Layer4Offset);
+
+        if (FrameLength < Layout->Layer4Offset + sizeof(*Tcp) ||
+            Tcp->th_len < sizeof(*Tcp) / sizeof(UINT32)) {
+            return FALSE;
+        }
+
+        Layout->HeaderLength = Layout->Layer4Offset + Tcp->th_len * sizeof(UINT32);
+        Layout->Tcp = TRUE;
+    } else {
+        return FALSE;
+    }
+
+    return FrameLength > Layout->HeaderLength;
+}
+
+static
+UINT32
+XdpGenericChecksumAccumulate(
+    _In_ UINT32 Sum,
+    _In_reads_bytes_(Length) const UCHAR *Buffer,
+    _In_ UINT32 Length
+    )
+{
+    while (Length > 1) {
+        Sum += ((UINT32)Buffer[0] << 8) | Buffer[1];
+        Buffer += 2;
+        Length -= 2;
+    }
+
+    if (Length > 0) {
+        Sum += (UINT32)Buffer[0] << 8;
+    }
+
+    return Sum;
+}
+
+static
+UINT16
+XdpGenericChecksumFold(
+    _In_ UINT32 Sum
+    )
+{
+    while (Sum >> 16) {
+        Sum = (Sum & 0xFFFF) + (Sum >> 16);
+    }
+
+    return (UINT16)Sum;
+}
+
+//
+// Returns the unfolded sum of the pseudo-header addresses and protocol,
+// excluding the upper-layer length.
+//
+static
+UINT32
+XdpGenericPseudoHeaderSum(
+    _In_ const UCHAR *IpHeader,
+    _In_ BOOLEAN Ipv6,
+    _In_ UINT8 Protocol
+    )
+{
+    UINT32 Sum;
+
+    if (Ipv6) {
+        const IPV6_HEADER *Ipv6Header = (const IPV6_HEADER *)IpHeader;
+        Sum =
+            XdpGenericChecksumAccumulate(
+                0, (const UCHAR *)&Ipv6Header->SourceAddress,
+                sizeof(Ipv6Header->SourceAddress) + sizeof(Ipv6Header->DestinationAddress));
+    } else {
+        const IPV4_HEADER *Ipv4Header = (const IPV4_HEADER *)IpHeader;
+        Sum =
+            XdpGenericChecksumAccumulate(
+                0, (const UCHAR *)&Ipv4Header->SourceAddress,
+                sizeof(Ipv4Header->SourceAddress) + sizeof(Ipv4Header->DestinationAddress));
+    }
+
+    return Sum + Protocol;
+}
+
+static
+UINT32
+XdpGenericSegmentPseudoHeaderSum(
+    _In_ const UCHAR *Frame,
+    _In_ const XDP_LWF_GENERIC_SEGMENT_LAYOUT *Layout
+    )
+{
+    return
+        XdpGenericPseudoHeaderSum(
+            Frame + Layout->IpOffset, Layout->Ipv6, Layout->Tcp ? IPPROTO_TCP : IPPROTO_UDP);
+}
+
+static
+BOOLEAN
+XdpGenericTxCanOffloadUdpSegmentation(
+    _In_ const XDP_LWF_GENERIC_TX_QUEUE *TxQueue,
+    _In_ const XDP_LWF_GENERIC_SEGMENT_LAYOUT *Layout,
+    _In_ UINT32 FrameLength,
+    _In_ UINT32 Mss
+    )
+{
+    const NDIS_UDP_SEGMENTATION_OFFLOAD *Uso = &TxQueue->Generic->Tx.UdpSegmentation;
+    UINT32 PayloadLength = FrameLength - Layout->HeaderLength;
+    ULONG Encapsulation;
+    ULONG MaxOffLoadSize;
+    ULONG MinSegmentCount;
+    ULONG SubMssFinalSegmentSupported;
+
+    if (Layout->Ipv6) {
+        Encapsulation = Uso->IPv6.Encapsulation;
+        MaxOffLoadSize = Uso->IPv6.MaxOffLoadSize;
+        MinSegmentCount = Uso->IPv6.MinSegmentCount;
+        SubMssFinalSegmentSupported = Uso->IPv6.SubMssFinalSegmentSupported;
+    } else {
+        Encapsulation = Uso->IPv4.Encapsulation;
+        MaxOffLoadSize = Uso->IPv4.MaxOffLoadSize;
+        MinSegmentCount = Uso->IPv4.MinSegmentCount;
+        SubMssFinalSegmentSupported = Uso->IPv4.SubMssFinalSegmentSupported;
+    }
+
+    return
+        (Encapsulation & NDIS_ENCAPSULATION_IEEE_802_3) &&
+        Layout->Layer4Offset < (1 << 10) &&
+        FrameLength <= MaxOffLoadSize &&
+        (PayloadLength + Mss - 1) / Mss >= MinSegmentCount &&
+        (SubMssFinalSegmentSupported || PayloadLength % Mss == 0);
+}
+
+static
+BOOLEAN
+XdpGenericTxCanOffloadTcpSegmentation(
+    _In_ const XDP_LWF_GENERIC_TX_QUEUE *TxQueue,
+    _In_ const XDP_LWF_GENERIC_SEGMENT_LAYOUT *Layout,
+    _In_ UINT32 FrameLength,
+    _In_ UINT32 Mss
+    )
+{
+    const NDIS_TCP_LARGE_SEND_OFFLOAD_V2 *Lso = &TxQueue->Generic->Tx.LargeSend;
+    UINT32 PayloadLength = FrameLength - Layout->HeaderLength;
+    BOOLEAN TcpOptions = Layout->HeaderLength - Layout->Layer4Offset > sizeof(TCP_HDR);
+    ULONG Encapsulation;
+    ULONG MaxOffLoadSize;
+    ULONG MinSegmentCount;
+
+    if (Layout->Ipv6) {
+        if (TcpOptions && Lso->IPv6.TcpOptionsSupported != NDIS_OFFLOAD_SUPPORTED) {
+            return FALSE;
+        }
+
+        Encapsulation = Lso->IPv6.Encapsulation;
+        MaxOffLoadSize = Lso->IPv6.MaxOffLoadSize;
+        MinSegmentCount = Lso->IPv6.MinSegmentCount;
+    } else {
+        Encapsulation = Lso->IPv4.Encapsulation;
+        MaxOffLoadSize = Lso->IPv4.MaxOffLoadSize;
+        MinSegmentCount = Lso->IPv4.MinSegmentCount;
+    }
+
+    return
+        (Encapsulation & NDIS_ENCAPSULATION_IEEE_802_3) &&
+        Layout->Layer4Offset < (1 << 10) &&
+        PayloadLength <= MaxOffLoadSize &&
+        (PayloadLength + Mss - 1) / Mss >= MinSegmentCount;
+}
+
+static
 VOID
+XdpGenericTxFreeSegments(
+    _In_ NET_BUFFER_LIST *Nbl
+    )
+{
+    NET_BUFFER *Nb = NET_BUFFER_LIST_FIRST_NB(Nbl);
+
+    while (Nb != NULL) {
+        NET_BUFFER *Segment = Nb;
+        Nb = Nb->Next;
+        NdisFreeNetBuffer(Segment);
+    }
+
+    NET_BUFFER_LIST_FIRST_NB(Nbl) = NblTxContext(Nbl)->NetBuffer;
+}
+
+static
+BOOLEAN
+XdpGenericTxSegment(
+    _In_ XDP_LWF_GENERIC_TX_QUEUE *TxQueue,
+    _In_reads_bytes_(FrameLength) const UCHAR *Frame,
+    _In_ UINT32 FrameLength,
+    _In_ const XDP_LWF_GENERIC_SEGMENT_LAYOUT *Layout,
+    _In_ UINT32 Mss,
+    _Inout_ NET_BUFFER_LIST *Nbl
+    )
+{
+    NET_BUFFER **Tail = &NET_BUFFER_LIST_FIRST_NB(Nbl);
+    UINT32 PseudoHeaderSum = XdpGenericSegmentPseudoHeaderSum(Frame, Layout);
+    UINT32 PayloadOffset = Layout->HeaderLength;
+    UINT16 Identification = 0;
+    UINT32 Sequence = 0;
+
+    if (!Layout->Ipv6) {
+        Identification = ntohs(((const IPV4_HEADER *)(Frame + Layout->IpOffset))->Identification);
+    }
+
+    if (Layout->Tcp) {
+        Sequence = ntohl(((const TCP_HDR *)(Frame + Layout->Layer4Offset))->th_seq);
+    }
+
+    //
+    // Build one NET_BUFFER per segment, each with a copy of the frame headers
+    // followed by up to one MSS of the layer 4 payload.
+    //
+    *Tail = NULL;
+
+    while (PayloadOffset < FrameLength) {
+        UINT32 PayloadLength = min(Mss, FrameLength - PayloadOffset);
+        UINT16 Layer4Length =
+            (UINT16)(Layout->HeaderLength - Layout->Layer4Offset + PayloadLength);
+        NET_BUFFER *Nb;
+        UCHAR *Segment;
+        UINT16 *Layer4Checksum;
+        UINT16 Checksum;
+
+        Nb = NdisAllocateNetBufferMdlAndData(TxQueue->SegmentNbPool);
+        if (Nb == NULL) {
+            goto Failure;
+        }
+
+        *Tail = Nb;
+        Tail = &Nb->Next;
+        *Tail = NULL;
+
+        Segment =
+            MmGetSystemAddressForMdlSafe(
+                NET_BUFFER_CURRENT_MDL(Nb), LowPagePriority | MdlMappingNoExecute);
+        if (Segment == NULL) {
+            goto Failure;
+        }
+        Segment += NET_BUFFER_CURRENT_MDL_OFFSET(Nb);
+
+        RtlCopyMemory(Segment, Frame, Layout->HeaderLength);
+        RtlCopyMemory(
+            Segment + Layout->HeaderLength, Frame + PayloadOffset, PayloadLength);
+        NET_BUFFER_DATA_LENGTH(Nb) = Layout->HeaderLength + PayloadLength;
+
+        if (Layout->Ipv6) {
+            IPV6_HEADER *Ipv6 = (IPV6_HEADER *)(Segment + Layout->IpOffset);
+            Ipv6->PayloadLength = htons(Layer4Length);
+        } else {
+            IPV4_HEADER *Ipv4 = (IPV4_HEADER *)(Segment + Layout->IpOffset);
+            UINT32 IpHeaderLength = Layout->Layer4Offset - Layout->IpOffset;
+
+            Ipv4->TotalLength = htons((UINT16)(IpHeaderLength + Layer4Length));
+            Ipv4->Identification = htons(Identification++);
+            Ipv4->HeaderChecksum = 0;
+            Ipv4->HeaderChecksum =
+                htons(
+                    (UINT16)~XdpGenericChecksumFold(
+                        XdpGenericChecksumAccumulate(0, (UCHAR *)Ipv4, IpHeaderLength)));
+        }
+
+        if (Layout->Tcp) {
+            TCP_HDR *Tcp = (TCP_HDR *)(Segment + Layout->Layer4Offset);
+
+            //
+            // Each segment continues the sequence space of the previous one.
+            // Flags ending the stream apply only to the last segment, and the
+            // congestion window reduced flag only to the first.
+            //
+            Tcp->th_seq = htonl(Sequence + (PayloadOffset - Layout->HeaderLength));
+            if (PayloadOffset != Layout->HeaderLength) {
+                Tcp->th_flags &= (UINT8)~TCP_FIRST_SEGMENT_FLAGS;
+            }
+            if (PayloadOffset + PayloadLength < FrameLength) {
+                Tcp->th_flags &= (UINT8)~TCP_LAST_SEGMENT_FLAGS;
+            }
+            Layer4Checksum = &Tcp->th_sum;
+        } else {
+            UDP_HDR *Udp = (UDP_HDR *)(Segment + Layout->Layer4Offset);
+            Udp->uh_ulen = htons(Layer4Length);
+            Layer4Checksum = &Udp->uh_sum;
+        }
+
+        *Layer4Checksum = 0;
+        Checksum =
+            (UINT16)~XdpGenericChecksumFold(
+                XdpGenericChecksumAccumulate(
+                    PseudoHeaderSum + Layer4Length, Segment + Layout->Layer4Offset,
+                    Layer4Length));
+        if (Checksum == 0 && !Layout->Tcp) {
+            Checksum = 0xFFFF;
+        }
+        *Layer4Checksum = htons(Checksum);
+
+        PayloadOffset += PayloadLength;
+    }
+
+    return TRUE;
+
+Failure:
+
+    XdpGenericTxFreeSegments(Nbl);
+
+    return FALSE;
+}
+
+static
+BOOLEAN
+XdpGenericTxSegmentNbl(
+    _In_ XDP_LWF_GENERIC_TX_QUEUE *TxQueue,
+    _In_ XDP_BUFFER *Buffer,
+    _In_ XDP_BUFFER_MDL *BufferMdl,
+    _In_ UINT32 Mss,
+    _Inout_ NET_BUFFER_LIST *Nbl
+    )
+{
+    XDP_LWF_GENERIC_SEGMENT_LAYOUT Layout;
+    UCHAR *Frame;
+    UINT16 PseudoHeaderChecksum;
+
+    //
+    // XDP maps each buffer MDL into system address space.
+    //
+    Frame = MmGetSystemAddressForMdlSafe(BufferMdl->Mdl, LowPagePriority | MdlMappingNoExecute);
+    if (Frame == NULL) {
+        return FALSE;
+    }
+    Frame += BufferMdl->MdlOffset + Buffer->DataOffset;
+
+    if (!XdpGenericTxParseSegmentFrame(Frame, Buffer->DataLength, &Layout) ||
+        Layout.HeaderLength + Mss > TxQueue->SegmentBufferSize) {
+        return FALSE;
+    }
+
+    if (Layout.Tcp ?
+            !XdpGenericTxCanOffloadTcpSegmentation(TxQueue, &Layout, Buffer->DataLength, Mss) :
+            !XdpGenericTxCanOffloadUdpSegmentation(TxQueue, &Layout, Buffer->DataLength, Mss)) {
+        //
+        // The miniport cannot segment this frame, so segment it in software.
+        //
+        return XdpGenericTxSegment(TxQueue, Frame, Buffer->DataLength, &Layout, Mss, Nbl);
+    }
+
+    //
+    // The miniport segments the frame and computes each segment's checksum from
+    // the pseudo-header checksum, which excludes the layer 4 length.
+    //
+    PseudoHeaderChecksum =
+        htons(XdpGenericChecksumFold(XdpGenericSegmentPseudoHeaderSum(Frame, &Layout)));
+
+    if (Layout.Tcp) {
+        NDIS_TCP_LARGE_SEND_OFFLOAD_NET_BUFFER_LIST_INFO LsoInfo = {0};
+
+        ((TCP_HDR *)(Frame + Layout.Layer4Offset))->th_sum = PseudoHeaderChecksum;
+
+        LsoInfo.LsoV2Transmit.Type = NDIS_TCP_LARGE_SEND_OFFLOAD_V2_TYPE;
+        LsoInfo.LsoV2Transmit.TcpHeaderOffset = Layout.Layer4Offset;
+        LsoInfo.LsoV2Transmit.MSS = Mss;
+        LsoInfo.LsoV2Transmit.IPVersion =
+            Layout.Ipv6 ? NDIS_TCP_LARGE_SEND_OFFLOAD_IPv6 : NDIS_TCP_LARGE_SEND_OFFLOAD_IPv4;
+        NET_BUFFER_LIST_INFO(Nbl, TcpLargeSendNetBufferListInfo) = LsoInfo.Value;
+    } else {
+        NDIS_UDP_SEGMENTATION_OFFLOAD_NET_BUFFER_LIST_INFO UsoInfo = {0};
+
+        ((UDP_HDR *)(Frame + Layout.Layer4Offset))->uh_sum = PseudoHeaderChecksum;
+
+        UsoInfo.Transmit.MSS = Mss;
+        UsoInfo.Transmit.UdpHeaderOffset = Layout.Layer4Offset;
+        UsoInfo.Transmit.IPVersion =
+            Layout.Ipv6 ? NDIS_UDP_SEGMENTATION_OFFLOAD_IPV6 : NDIS_UDP_SEGMENTATION_OFFLOAD_IPV4;
+        NET_BUFFER_LIST_INFO(Nbl, UdpSegmentationOffloadInfo) = UsoInfo.Value;
+    }
+
+    return TRUE;
+}
+
+static
+BOOLEAN
+XdpGenericTxCanOffloadChecksum(
+    _In_ const XDP_LWF_GENERIC_TX_QUEUE *TxQueue,
+    _In_ const XDP_FRAME_LAYOUT *Layout,
+    _In_ const XDP_FRAME_CHECKSUM *Checksum,
+    _In_ BOOLEAN Ipv6
+    )
+{
+    const NDIS_TCP_IP_CHECKSUM_OFFLOAD *Offload = &TxQueue->Generic->Tx.Checksum;
+    BOOLEAN Layer4Required = Checksum->Layer4 == XdpFrameTxChecksumActionRequired;
+    BOOLEAN Tcp = Layout->Layer4Type == XdpFrameLayer4TypeTcp;
+    BOOLEAN TcpOptions = Tcp && Layout->Layer4HeaderLength > sizeof(TCP_HDR);
+    ULONG Encapsulation;
+    ULONG IpOptionsSupported;
+    ULONG TcpOptionsSupported;
+    ULONG TcpChecksum;
+    ULONG UdpChecksum;
+    ULONG IpChecksum;
+
+    //
+    // Frames injected on the receive path never reach the miniport.
+    //
+    if (TxQueue->Flags.RxInject || Layout->Layer2Type != XdpFrameLayer2TypeEthernet) {
+        return FALSE;
+    }
+
+    if (Ipv6) {
+        Encapsulation = Offload->IPv6Transmit.Encapsulation;
+        IpOptionsSupported = Offload->IPv6Transmit.IpExtensionHeadersSupported;
+        TcpOptionsSupported = Offload->IPv6Transmit.TcpOptionsSupported;
+        TcpChecksum = Offload->IPv6Transmit.TcpChecksum;
+        UdpChecksum = Offload->IPv6Transmit.UdpChecksum;
+        IpChecksum = NDIS_OFFLOAD_NOT_SUPPORTED;
+    } else {
+        Encapsulation = Offload->IPv4Transmit.Encapsulation;
+        IpOptionsSupported = Offload->IPv4Transmit.IpOptionsSupported;
+        TcpOptionsSupported = Offload->IPv4Transmit.TcpOptionsSupported;
+        TcpChecksum = Offload->IPv4Transmit.TcpChecksum;
+        UdpChecksum = Offload->IPv4Transmit.UdpChecksum;
+        IpChecksum = Offload->IPv4Transmit.IpChecksum;
+    }
+
+    return
+        (Encapsulation & NDIS_ENCAPSULATION_IEEE_802_3) &&
+        (Layout->Layer3Type == XdpFrameLayer3TypeIPv4NoOptions ||
+            Layout->Layer3Type == XdpFrameLayer3TypeIPv6NoExtensions ||
+            IpOptionsSupported == NDIS_OFFLOAD_SUPPORTED) &&
+        (Checksum->Layer3 != XdpFrameTxChecksumActionRequired ||
+            IpChecksum == NDIS_OFFLOAD_SUPPORTED) &&
+        (!Layer4Required ||
+            (Tcp ?
+                TcpChecksum == NDIS_OFFLOAD_SUPPORTED &&
+                    (!TcpOptions || TcpOptionsSupported == NDIS_OFFLOAD_SUPPORTED) :
+                UdpChecksum == NDIS_OFFLOAD_SUPPORTED));
+}
+
+static
+BOOLEAN
+XdpGenericTxChecksumNbl(
+    _In_ XDP_LWF_GENERIC_TX_QUEUE *TxQueue,
+    _In_ XDP_FRAME *Frame,
+    _In_ XDP_BUFFER *Buffer,
+    _In_ XDP_BUFFER_MDL *BufferMdl,
+    _Inout_ NET_BUFFER_LIST *Nbl
+    )
+{
+    const XDP_FRAME_LAYOUT *Layout = XdpGetFrameLayoutExtension(Frame, &TxQueue->LayoutExtension);
+    const XDP_FRAME_CHECKSUM *Checksum =
+        XdpGetFrameChecksumExtension(Frame, &TxQueue->ChecksumExtension);
+    BOOLEAN Layer3Required = Checksum->Layer3 == XdpFrameTxChecksumActionRequired;
+    BOOLEAN Layer4Required = Checksum->Layer4 == XdpFrameTxChecksumActionRequired;
+    BOOLEAN Tcp = Layout->Layer4Type == XdpFrameLayer4TypeTcp;
+    BOOLEAN Ipv6;
+    UINT32 IpOffset = Layout->Layer2HeaderLength;
+    UINT32 Layer4Offset = IpOffset + Layout->Layer3HeaderLength;
+    UINT32 Layer4Length;
+    UINT16 *Layer4Checksum = NULL;
+    UINT32 Sum = 0;
+    UCHAR *Va;
+
+    if (!Layer3Required && !Layer4Required) {
+        return TRUE;
+    }
+
+    if (Layout->Layer3Type >= XdpFrameLayer3TypeIPv4UnspecifiedOptions &&
+        Layout->Layer3Type <= XdpFrameLayer3TypeIPv4NoOptions) {
+        Ipv6 = FALSE;
+    } else if (
+        Layout->Layer3Type >= XdpFrameLayer3TypeIPv6UnspecifiedExtensions &&
+        Layout->Layer3Type <= XdpFrameLayer3TypeIPv6NoExtensions &&
+        !Layer3Required) {
+        Ipv6 = TRUE;
+    } else {
+        return FALSE;
+    }
+
+    if (Layout->Layer3HeaderLength < (Ipv6 ? sizeof(IPV6_HEADER) : sizeof(IPV4_HEADER)) ||
+        Layer4Offset +
+            (Layer4Required ? (Tcp ? sizeof(TCP_HDR) : sizeof(UDP_HDR)) : 0) >
+                Buffer->DataLength ||
+        (Layer4Required && !Tcp && Layout->Layer4Type != XdpFrameLayer4TypeUdp)) {
+        return FALSE;
+    }
+
+    Va = MmGetSystemAddressForMdlSafe(BufferMdl->Mdl, LowPagePriority | MdlMappingNoExecute);
+    if (Va == NULL) {
+        return FALSE;
+    }
+    Va += BufferMdl->MdlOffset + Buffer->DataOffset;
+
+    Layer4Length = Buffer->DataLength - Layer4Offset;
+
+    if (Layer4Required) {
+        if (Tcp) {
+            Layer4Checksum = &((TCP_HDR *)(Va + Layer4Offset))->th_sum;
+        } else {
+            Layer4Checksum = &((UDP_HDR *)(Va + Layer4Offset))->uh_sum;
+        }
+
+        Sum =
+            XdpGenericPseudoHeaderSum(
+                Va + IpOffset, Ipv6, Tcp ? IPPROTO_TCP : IPPROTO_UDP) + Layer4Length;
+    }
+
+    if (XdpGenericTxCanOffloadChecksum(TxQueue, Layout, Checksum, Ipv6)) {
+        NDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO ChecksumInfo = {0};
+
+        //
+        // The miniport computes the checksums, seeded with the pseudo-header
+        // checksum as the TCP/IP stack would provide.
+        //
+        if (Layer4Checksum != NULL) {
+            *Layer4Checksum = htons(XdpGenericChecksumFold(Sum));
+        }
+
+        ChecksumInfo.Transmit.IsIPv4 = !Ipv6;
+        ChecksumInfo.Transmit.IsIPv6 = Ipv6;
+        ChecksumInfo.Transmit.IpHeaderChecksum = Layer3Required;
+        ChecksumInfo.Transmit.TcpChecksum = Layer4Required && Tcp;
+        ChecksumInfo.Transmit.UdpChecksum = Layer4Required && !Tcp;
+        ChecksumInfo.Transmit.TcpHeaderOffset = Layer4Offset;
+        NET_BUFFER_LIST_INFO(Nbl, TcpIpChecksumNetBufferListInfo) = ChecksumInfo.Value;
+
+        return TRUE;
+    }
+
+    //
+    // The miniport cannot compute the checksums, so compute them in software.
+    //
+    if (Layer3Required) {
+        IPV4_HEADER *Ipv4 = (IPV4_HEADER *)(Va + IpOffset);
+
+        Ipv4->HeaderChecksum = 0;
+        Ipv4->HeaderChecksum =
+            htons(
+                (UINT16)~XdpGenericChecksumFold(
+                    XdpGenericChecksumAccumulate(
+                        0, (UCHAR *)Ipv4, Layout->Layer3HeaderLength)));
+    }
+
+    if (Layer4Checksum != NULL) {
+        UINT16 Result;
+
+        *Layer4Checksum = 0;
+        Result =
+            (UINT16)~XdpGenericChecksumFold(
+                XdpGenericChecksumAccumulate(Sum, Va + Layer4Offset, Layer4Length));
+        *Layer4Checksum = htons((Result == 0 && !Tcp) ? 0xFFFF : Result);
+    }
+
+    if (TxQueue->Flags.RxInject) {
+        NDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO ChecksumInfo = {0};
+
+        //
+        // The checksums were just computed, so report them as validated to
+        // spare the receiving stack from verifying them again.
+        //
+        ChecksumInfo.Receive.IpChecksumSucceeded = Layer3Required;
+        ChecksumInfo.Receive.TcpChecksumSucceeded = Layer4Required && Tcp;
+        ChecksumInfo.Receive.UdpChecksumSucceeded = Layer4Required && !Tcp;
+        NET_BUFFER_LIST_INFO(Nbl, TcpIpChecksumNetBufferListInfo) = ChecksumInfo.Value;
+    }
+
+    return TRUE;
+}
+
+static
+BOOLEAN
+XdpGenericTxProtectQeo(
+    _In_ XDP_LWF_GENERIC_TX_QUEUE *TxQueue,
+    _In_ XDP_LWF_GENERIC_QEO_TABLE *QeoTable,
+    _In_ XDP_FRAME *Frame,
+    _In_ XDP_BUFFER *Buffer,
+    _In_ XDP_BUFFER_MDL *BufferMdl
+    )
+{
+    UCHAR *Va;
+    UINT32 Mss = 0;
+
+    if (TxQueue->Flags.GsoEnabled) {
+        Mss = XdpGetFrameGsoExtension(Frame, &TxQueue->GsoExtension)->UDP.Mss;
+    }
+
+    Va = MmGetSystemAddressForMdlSafe(BufferMdl->Mdl, LowPagePriority | MdlMappingNoExecute);
+    if (Va == NULL) {
+        return FALSE;
+    }
+    Va += BufferMdl->MdlOffset + Buffer->DataOffset;
+
+    //
+    // Packets are protected in place, before any segmentation, so each segment
+    // carries its own QUIC packet.
+    //
+    return XdpGenericQeoTransmit(QeoTable, Va, Buffer->DataLength, Mss);
+}
+
+BOOLEAN
 XdpGenericBuildTxNbl(
     _In_ XDP_LWF_GENERIC_TX_QUEUE *TxQueue,
     _In_ XDP_FRAME *Frame,
@@ -161,28 +845,120 @@ XdpGenericBuildTxNbl(
 {
     NET_BUFFER *Nb = NET_BUFFER_LIST_FIRST_NB(Nbl);
     MDL *Mdl = NET_BUFFER_FIRST_MDL(Nb);
-    IoBuildPartialMdl(
-        BufferMdl->Mdl, Mdl,
+    NBL_TX_CONTEXT *TxContext = NblTxContext(Nbl);
+    XDP_LWF_GENERIC_QEO_TABLE *QeoTable;
+    XDP_LWF_GENERIC_RSS_HASH *SendHash;
+    UINT32 Mss = 0;
+    UINT32 Generation;
+    UINT32 Hash;
+    ULONG HashType;
+    UCHAR *Va =
         (UCHAR *)MmGetMdlVirtualAddress(BufferMdl->Mdl)
             + BufferMdl->MdlOffset
-            + Buffer->DataOffset,
-        Buffer->DataLength);
-    // work around KDNIC bug: it touches the user StartVa in a system context.
-    Mdl->StartVa = (UCHAR *)Mdl->MappedSystemVa - Mdl->ByteOffset;
+            + Buffer->DataOffset;
+
+    NET_BUFFER_LIST_INFO(Nbl, UdpSegmentationOffloadInfo) = NULL;
+    NET_BUFFER_LIST_INFO(Nbl, TcpLargeSendNetBufferListInfo) = NULL;
+    NET_BUFFER_LIST_INFO(Nbl, TcpIpChecksumNetBufferListInfo) = NULL;
+
+    QeoTable = ReadPointerNoFence(&TxQueue->Generic->Qeo.Table);
+    if (QeoTable != NULL && QeoTable->TxConnectionCount > 0 && !TxQueue->Flags.RxInject &&
+        !XdpGenericTxProtectQeo(TxQueue, QeoTable, Frame, Buffer, BufferMdl)) {
+        return FALSE;
+    }
+
+    if (TxQueue->Flags.GsoEnabled) {
+        Mss = XdpGetFrameGsoExtension(Frame, &TxQueue->GsoExtension)->UDP.Mss;
+    }
+
+    //
+    // Segmentation computes the checksums of each segment, so checksum requests
+    // apply only to frames that are not segmented.
+    //
+    if (Mss != 0) {
+        if (!XdpGenericTxSegmentNbl(TxQueue, Buffer, BufferMdl, Mss, Nbl)) {
+            return FALSE;
+        }
+
+        if (NET_BUFFER_LIST_FIRST_NB(Nbl) != Nb) {
+            //
+            // The frame was segmented in software into new NET_BUFFERs.
+            //
+            goto Finish;
+        }
+    } else if (
+        TxQueue->Flags.ChecksumEnabled &&
+        !XdpGenericTxChecksumNbl(TxQueue, Frame, Buffer, BufferMdl, Nbl)) {
+        return FALSE;
+    }
+
+    //
+    // Applications typically recycle a fixed set of UMEM chunks, so the NBL's
+    // partial MDL frequently already describes the frame's buffer. Since the
+    // partial MDL is never mapped by the memory manager (see
+    // XdpGenericCompleteTx) it remains valid across sends.
+    //
+    // Multiple clients share this queue and a detached client's MDLs may be
+    // freed and their addresses reused by another client, so the partial MDL
+    // is valid only within the buffer MDL generation it was built in. A zero
+    // generation disallows reuse entirely.
+    //
+    Generation =
+        (TxQueue->BufferMdlGeneration != NULL) ?
+            ReadUInt32NoFence(TxQueue->BufferMdlGeneration) : 0;
+
+    if (Generation == 0 ||
+        TxContext->BoundGeneration != Generation ||
+        TxContext->BoundMdl != BufferMdl->Mdl ||
+        TxContext->BoundVa != Va ||
+        TxContext->BoundLength != Buffer->DataLength) {
+        IoBuildPartialMdl(BufferMdl->Mdl, Mdl, Va, Buffer->DataLength);
+        // work around KDNIC bug: it touches the user StartVa in a system context.
+        Mdl->StartVa = (UCHAR *)Mdl->MappedSystemVa - Mdl->ByteOffset;
+
+        TxContext->BoundMdl = BufferMdl->Mdl;
+        TxContext->BoundVa = Va;
+        TxContext->BoundLength = Buffer->DataLength;
+        TxContext->BoundGeneration = Generation;
+    }
+
     NET_BUFFER_DATA_LENGTH(Nb) = Buffer->DataLength;
     NET_BUFFER_DATA_OFFSET(Nb) = 0;
     NET_BUFFER_CURRENT_MDL_OFFSET(Nb) = 0;
+
+Finish:
+
     NET_BUFFER_LIST_SET_HASH_VALUE(Nbl, TxQueue->RssQueue->RssHash);
+    NET_BUFFER_LIST_INFO(Nbl, NetBufferListHashInfo) = NULL;
+
+    //
+    // Miniports with multiple TX queues may select the hardware queue from a
+    // valid NBL hash, so hash IP frames as the NIC would hash them on receive.
+    // Other frames keep the queue's hash value without a hash type, which
+    // lower drivers must not trust as a flow hash.
+    //
+    SendHash = ReadPointerNoFence(&TxQueue->Generic->Rss.SendHash);
+    if (TxQueue->Flags.SendHash && SendHash != NULL &&
+        XdpGenericRssComputeHash(
+            SendHash->HashType, SendHash->HashSecretKey, SendHash->HashSecretKeySize, Nbl,
+            &Hash, &HashType)) {
+        NET_BUFFER_LIST_SET_HASH_VALUE(Nbl, Hash);
+        NET_BUFFER_LIST_INFO(Nbl, NetBufferListHashInfo) =
+            (VOID *)(ULONG_PTR)NDIS_RSS_HASH_INFO_FROM_TYPE_AND_FUNC(
+                HashType, NdisHashFunctionToeplitz);
+    }
     NET_BUFFER_LIST_STATUS(Nbl) = NDIS_STATUS_SUCCESS;
-    NblTxContext(Nbl)->TxQueue = TxQueue;
-    NblTxContext(Nbl)->InjectionType = XDP_LWF_GENERIC_INJECTION_SEND;
-    NblTxContext(Nbl)->BufferAddress = BufferMdl->MdlOffset;
+    TxContext->TxQueue = TxQueue;
+    TxContext->InjectionType = XDP_LWF_GENERIC_INJECTION_SEND;
+    TxContext->BufferAddress = BufferMdl->MdlOffset;
 
     if (TxQueue->Flags.TxCompletionContextEnabled) {
-        NblTxContext(Nbl)->CompletionContext =
+        TxContext->CompletionContext =
             *XdpGetFrameTxCompletionContextExtension(
                 Frame, &TxQueue->FrameTxCompletionContextExtension);
     }
+
+    return TRUE;
 }
 
 VOID
@@ -221,6 +997,10 @@ XdpGenericCompleteTx(
             *CompletionContext = NblTxContext(Nbl)->CompletionContext;
         }
 
+        if (NET_BUFFER_LIST_FIRST_NB(Nbl) != NblTxContext(Nbl)->NetBuffer) {
+            XdpGenericTxFreeSegments(Nbl);
+        }
+
         //
         // In lieu of calling MmPrepareMdlForReuse, assert our MDL did not get
         // mapped by the memory manager: the original MDL should have been
@@ -229,7 +1009,9 @@ XdpGenericCompleteTx(
         //
         ASSERT(Nbl->FirstNetBuffer->Next == NULL);
         ASSERT(Nbl->FirstNetBuffer->MdlChain->Next == NULL);
-        ASSERT(Nbl->FirstNetBuffer->MdlChain->MdlFlags & MDL_PARTIAL);
+        ASSERT(
+            (Nbl->FirstNetBuffer->MdlChain->MdlFlags & MDL_PARTIAL) ||
+            NblTxContext(Nbl)->BoundMdl == NULL);
         ASSERT((Nbl->FirstNetBuffer->MdlChain->MdlFlags & MDL_PARTIAL_HAS_BEEN_MAPPED) == 0);
 
         if (Nbl->Status != NDIS_STATUS_SUCCESS) {
@@ -253,12 +1035,17 @@ XdpGenericCompleteTx(
 
 BOOLEAN
 XdpGenericInitiateTx(
-    _In_ XDP_LWF_GENERIC_TX_QUEUE *TxQueue
+    _In_ XDP_LWF_GENERIC_TX_QUEUE *TxQueue,
+    _In_ UINT32 Budget,
+    _Out_ UINT32 *WorkDone
     )
 {
     NBL_COUNTED_QUEUE Nbls;
     XDP_RING *FrameRing;
     ULONG NblsAvailable;
+    ULONG NblsDropped = 0;
+
+    *WorkDone = 0;
 
     if (ReadPointerAcquire(&TxQueue->XdpTxQueue) == NULL) {
         return FALSE;
@@ -266,7 +1053,7 @@ XdpGenericInitiateTx(
 
     FrameRing = TxQueue->FrameRing;
 
-    NblsAvailable = XdpGenericTxGetNbls(TxQueue);
+    NblsAvailable = min(XdpGenericTxGetNbls(TxQueue), Budget);
     if (NblsAvailable == 0) {
         return FALSE;
     }
@@ -281,21 +1068,47 @@ XdpGenericInitiateTx(
 
     NdisInitializeNblCountedQueue(&Nbls);
 
-    while (Nbls.NblCount < NblsAvailable && XdpRingCount(FrameRing) > 0) {
+    while (Nbls.NblCount + NblsDropped < NblsAvailable) {
         NET_BUFFER_LIST *Nbl;
         XDP_FRAME *Frame;
         XDP_BUFFER *Buffer;
         XDP_BUFFER_MDL *BufferMdl;
 
+        if (XdpRingCount(FrameRing) == 0) {
+            //
+            // Each receive indication traverses the entire upper stack, so
+            // refill the frame ring to indicate as large a chain as the budget
+            // and NBL pool allow, rather than one chain per ring's worth.
+            //
+            if (!TxQueue->Flags.RxInject) {
+                break;
+            }
+
+            XdpFlushTransmit(TxQueue->XdpTxQueue);
+
+            if (XdpRingCount(FrameRing) == 0) {
+                break;
+            }
+        }
+
         Frame = XdpRingGetElement(FrameRing, FrameRing->ConsumerIndex & FrameRing->Mask);
         Buffer = &Frame->Buffer;
         BufferMdl = XdpGetMdlExtension(Buffer, &TxQueue->BufferMdlExtension);
 
         Nbl = TxQueue->FreeNbls;
         TxQueue->FreeNbls = TxQueue->FreeNbls->Next;
-        XdpGenericBuildTxNbl(TxQueue, Frame, Buffer, BufferMdl, Nbl);
 
-        NdisAppendSingleNblToNblCountedQueue(&Nbls, Nbl);
+        if (XdpGenericBuildTxNbl(TxQueue, Frame, Buffer, BufferMdl, Nbl)) {
+            NdisAppendSingleNblToNblCountedQueue(&Nbls, Nbl);
+        } else {
+            //
+            // The frame could not be segmented: complete it without posting it
+            // to NDIS.
+            //
+            NET_BUFFER_LIST_STATUS(Nbl) = NDIS_STATUS_INVALID_PACKET;
+            InterlockedPushEntrySList(&TxQueue->NblComplete, (SLIST_ENTRY *)&Nbl->Next);
+            NblsDropped++;
+        }
 
         EventWriteGenericTxEnqueue(
             &MICROSOFT_XDP_PROVIDER, TxQueue, FrameRing->ConsumerIndex,
@@ -304,9 +1117,17 @@ XdpGenericInitiateTx(
         FrameRing->ConsumerIndex++;
     }
 
-    ASSERT(Nbls.NblCount > 0);
+    TxQueue->OutstandingCount += (ULONG)Nbls.NblCount + NblsDropped;
+    *WorkDone = (UINT32)Nbls.NblCount + NblsDropped;
 
-    TxQueue->OutstandingCount += (ULONG)Nbls.NblCount;
+    if (Nbls.NblCount == 0) {
+        //
+        // Only dropped frames are pending completion; poll again to complete
+        // them.
+        //
+        ASSERT(NblsDropped > 0);
+        return TRUE;
+    }
 
     EventWriteGenericTxPostBatchStart(
         &MICROSOFT_XDP_PROVIDER, TxQueue, TxQueue->Stats.BatchesPosted);
@@ -326,20 +1147,26 @@ XdpGenericInitiateTx(
 
     TxQueue->Stats.BatchesPosted++;
 
-    return XdpGenericTxGetNbls(TxQueue) > 0 && XdpRingCount(FrameRing) > 0;
+    return
+        NblsDropped > 0 ||
+        (XdpGenericTxGetNbls(TxQueue) > 0 && XdpRingCount(FrameRing) > 0);
 }
 
 static
 _IRQL_requires_(DISPATCH_LEVEL)
 BOOLEAN
 XdpGenericDropTx(
-    _In_ XDP_LWF_GENERIC_TX_QUEUE *TxQueue
+    _In_ XDP_LWF_GENERIC_TX_QUEUE *TxQueue,
+    _In_ UINT32 Budget,
+    _Out_ UINT32 *WorkDone
     )
 {
     XDP_RING *FrameRing;
     XDP_RING *CompletionRing;
     UINT32 Drops;
-    const UINT32 MaxDrops = 1024;
+    const UINT32 MaxDrops = min(1024, Budget);
+
+    *WorkDone = 0;
 
     if (ReadPointerAcquire(&TxQueue->XdpTxQueue) == NULL) {
         return FALSE;
@@ -388,6 +1215,7 @@ XdpGenericDropTx(
     }
 
     STAT_ADD(&TxQueue->PcwStats, FramesDroppedPause, Drops);
+    *WorkDone = Drops;
 
     return XdpRingCount(FrameRing) > 0;
 }
@@ -396,11 +1224,15 @@ static
 _IRQL_requires_(DISPATCH_LEVEL)
 BOOLEAN
 XdpGenericTxPoll(
-    _In_ VOID *PollContext
+    _In_ VOID *PollContext,
+    _In_ UINT32 Budget,
+    _Out_ UINT32 *WorkDone
     )
 {
     XDP_LWF_GENERIC_TX_QUEUE *TxQueue = PollContext;
 
+    *WorkDone = 0;
+
     if (TxQueue->NeedFlush) {
         TxQueue->NeedFlush = FALSE;
         XdpFlushTransmit(TxQueue->XdpTxQueue);
@@ -424,10 +1256,54 @@ XdpGenericTxPoll(
         // Drop TX frames and complete them while pausing/paused so XDP doesn't
         // wait on outstanding TX forever during interface detach.
         //
-        return XdpGenericDropTx(TxQueue);
+        return XdpGenericDropTx(TxQueue, Budget, WorkDone);
+    }
+
+    return XdpGenericInitiateTx(TxQueue, Budget, WorkDone);
+}
+
+//
+// Polls the TX queue from the RX path if this processor can enter its EC. The
+// RX path only lends its cycles, so each inline poll is bounded by an adaptive
+// budget: it doubles, up to the EC budget, while inline polls exhaust it with
+// frames still pending, and halves while inline polls find little to do,
+// leaving the remainder of the TX work to the EC's scheduled polls.
+//
+static
+_IRQL_requires_(DISPATCH_LEVEL)
+VOID
+XdpGenericTxPollInline(
+    _In_ XDP_LWF_GENERIC_TX_QUEUE *TxQueue,
+    _In_ ULONG CurrentProcessor
+    )
+{
+    UINT32 EcBudget;
+    UINT32 Budget;
+    UINT32 WorkDone;
+    BOOLEAN NeedPoll;
+
+    if (!XdpEcEnterInline(&TxQueue->Ec, CurrentProcessor)) {
+        return;
     }
 
-    return XdpGenericInitiateTx(TxQueue);
+    //
+    // The inline budget is protected by EC ownership.
+    //
+    EcBudget = ReadUInt32NoFence(&TxQueue->Ec.Budget);
+    Budget = min(TxQueue->InlineBudget, EcBudget);
+
+    NeedPoll = XdpGenericTxPoll(TxQueue, Budget, &WorkDone);
+
+    STAT_INC(&TxQueue->PcwStats, InlinePolls);
+    STAT_ADD(&TxQueue->PcwStats, InlineFrames, WorkDone);
+
+    if (NeedPoll && WorkDone >= Budget) {
+        TxQueue->InlineBudget = min(Budget * 2, EcBudget);
+    } else if (WorkDone < Budget / 4) {
+        TxQueue->InlineBudget = max(Budget / 2, GENERIC_TX_INLINE_BUDGET_MIN);
+    }
+
+    XdpEcExitInline(&TxQueue->Ec);
 }
 
 _IRQL_requires_(DISPATCH_LEVEL)
@@ -440,20 +1316,18 @@ XdpGenericTxFlushRss(
     XDP_LWF_GENERIC_TX_QUEUE *TxQueue = ReadPointerNoFence(&Queue->TxQueue);
     XDP_LWF_GENERIC_TX_QUEUE *RxInjectQueue = ReadPointerNoFence(&Queue->RxInjectQueue);
 
-    if (TxQueue != NULL && XdpEcEnterInline(&TxQueue->Ec, CurrentProcessor)) {
+    if (TxQueue != NULL) {
         //
         // Steal some RX cycles for TX.
         //
-        (VOID)XdpGenericTxPoll(TxQueue);
-        XdpEcExitInline(&TxQueue->Ec);
+        XdpGenericTxPollInline(TxQueue, CurrentProcessor);
     }
 
-    if (RxInjectQueue != NULL && XdpEcEnterInline(&RxInjectQueue->Ec, CurrentProcessor)) {
+    if (RxInjectQueue != NULL) {
         //
         // Steal some RX cycles for RX-injection.
         //
-        (VOID)XdpGenericTxPoll(RxInjectQueue);
-        XdpEcExitInline(&RxInjectQueue->Ec);
+        XdpGenericTxPollInline(RxInjectQueue, CurrentProcessor);
     }
 }
 
@@ -564,6 +1438,42 @@ XdpGenericTxRestart(
     TraceExitSuccess(TRACE_GENERIC);
 }
 
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+_Requires_exclusive_lock_held_(&Generic->Lock)
+VOID
+XdpGenericTxApplyQueueTuning(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _Inout_ XDP_LWF_GENERIC_TX_QUEUE *TxQueue
+    )
+{
+    XdpEcSetBudget(
+        &TxQueue->Ec,
+        Generic->Tuning.EcBudget != 0 ? Generic->Tuning.EcBudget : XDP_EC_DEFAULT_BUDGET);
+}
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+_Requires_exclusive_lock_held_(&Generic->Lock)
+VOID
+XdpGenericTxApplyTuning(
+    _In_ XDP_LWF_GENERIC *Generic
+    )
+{
+    LIST_ENTRY *Entry = Generic->Tx.Queues.Flink;
+
+    TraceEnter(TRACE_GENERIC, "IfIndex=%u", Generic->IfIndex);
+
+    while (Entry != &Generic->Tx.Queues) {
+        XDP_LWF_GENERIC_TX_QUEUE *TxQueue =
+            CONTAINING_RECORD(Entry, XDP_LWF_GENERIC_TX_QUEUE, Link);
+        Entry = Entry->Flink;
+
+        XdpGenericTxApplyQueueTuning(Generic, TxQueue);
+    }
+
+    TraceExitSuccess(TRACE_GENERIC);
+}
+
 _IRQL_requires_max_(PASSIVE_LEVEL)
 VOID
 XdpGenericTxNotify(
@@ -612,6 +1522,7 @@ XdpGenericTxCreateQueue(
     const XDP_HOOK_ID *QueueHookId;
     NTSTATUS Status;
     NET_BUFFER_LIST_POOL_PARAMETERS PoolParams = {0};
+    NET_BUFFER_POOL_PARAMETERS NbPoolParams = {0};
     SIZE_T MdlSize;
     XDP_TX_CAPABILITIES TxCapabilities;
     XDP_EXTENSION_INFO ExtensionInfo;
@@ -707,6 +1618,8 @@ XdpGenericTxCreateQueue(
         goto Exit;
     }
 
+    TxQueue->BufferMdlGeneration = XdpTxQueueGetBufferMdlGeneration(Config);
+
     // NBL context only aligns at void*. Ensure our packed structs are aligned.
     C_ASSERT(__alignof(NBL_TX_CONTEXT) <= __alignof(VOID *));
     C_ASSERT(__alignof(MDL) <= __alignof(NBL_TX_CONTEXT));
@@ -718,6 +1631,26 @@ XdpGenericTxCreateQueue(
         goto Exit;
     }
 
+    if (HookId.Direction == XDP_HOOK_TX) {
+        //
+        // Software UDP segmentation copies each segment into an MTU-sized
+        // NET_BUFFER from this pool.
+        //
+        NbPoolParams.Header.Type = NDIS_OBJECT_TYPE_DEFAULT;
+        NbPoolParams.Header.Revision = NET_BUFFER_POOL_PARAMETERS_REVISION_1;
+        NbPoolParams.Header.Size = NDIS_SIZEOF_NET_BUFFER_POOL_PARAMETERS_REVISION_1;
+        NbPoolParams.PoolTag = POOLTAG_BUFFER;
+        NbPoolParams.DataSize = Generic->Tx.Mtu;
+
+        TxQueue->SegmentNbPool =
+            NdisAllocateNetBufferPool(Generic->NdisFilterHandle, &NbPoolParams);
+        if (TxQueue->SegmentNbPool == NULL) {
+            Status = STATUS_NO_MEMORY;
+            goto Exit;
+        }
+        TxQueue->SegmentBufferSize = Generic->Tx.Mtu;
+    }
+
     Status =
         XdpRegQueryDwordValue(
             XDP_LWF_PARAMETERS_KEY, L"GenericTxFrameCount", &TxQueue->FrameCount);
@@ -744,7 +1677,10 @@ XdpGenericTxCreateQueue(
         Nbl->SourceHandle = Generic->NdisFilterHandle;
         Mdl = (MDL *)(NET_BUFFER_LIST_CONTEXT_DATA_START(Nbl) + sizeof(NBL_TX_CONTEXT));
         MmInitializeMdl(Mdl, (VOID *)(PAGE_SIZE - 1), MAX_TX_BUFFER_LENGTH);
+        NblTxContext(Nbl)->BoundMdl = NULL;
+        NblTxContext(Nbl)->BoundGeneration = 0;
         Nb = NET_BUFFER_LIST_FIRST_NB(Nbl);
+        NblTxContext(Nbl)->NetBuffer = Nb;
         NET_BUFFER_FIRST_MDL(Nb) = Mdl;
         NET_BUFFER_CURRENT_MDL(Nb) = Mdl;
         Nbl->Next = TxQueue->FreeNbls;
@@ -759,9 +1695,16 @@ XdpGenericTxCreateQueue(
 
     TxQueue->Flags.RxInject = (HookId.Direction == XDP_HOOK_RX);
 
+    //
+    // Injected RX frames keep the hash of the RSS queue they are indicated on.
+    //
+    TxQueue->Flags.SendHash = !TxQueue->Flags.RxInject;
+    TxQueue->InlineBudget = GENERIC_TX_INLINE_BUDGET_MIN;
+
     Status =
         XdpEcInitialize(
-            &TxQueue->Ec, XdpGenericTxPoll, TxQueue, &TxQueue->RssQueue->IdealProcessor);
+            &TxQueue->Ec, XdpGenericTxPoll, TxQueue, &TxQueue->RssQueue->IdealProcessor,
+            XDP_EC_DEFAULT_BUDGET, &TxQueue->PcwStats.Ec);
     if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
@@ -774,6 +1717,7 @@ XdpGenericTxCreateQueue(
         TxQueue->Flags.Pause = Generic->Flags.Paused;
     }
 
+    XdpGenericTxApplyQueueTuning(Generic, TxQueue);
     InsertTailList(&Generic->Tx.Queues, &TxQueue->Link);
 
     XdpInitializeExtensionInfo(
@@ -792,10 +1736,32 @@ XdpGenericTxCreateQueue(
         XDP_EXTENSION_TYPE_TX_FRAME_COMPLETION);
     XdpTxQueueRegisterExtensionVersion(Config, &ExtensionInfo);
 
+    if (!TxQueue->Flags.RxInject) {
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_FRAME_EXTENSION_GSO_NAME,
+            XDP_FRAME_EXTENSION_GSO_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+        XdpTxQueueRegisterExtensionVersion(Config, &ExtensionInfo);
+    }
+
+    XdpInitializeExtensionInfo(
+        &ExtensionInfo, XDP_FRAME_EXTENSION_LAYOUT_NAME,
+        XDP_FRAME_EXTENSION_LAYOUT_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+    XdpTxQueueRegisterExtensionVersion(Config, &ExtensionInfo);
+
+    XdpInitializeExtensionInfo(
+        &ExtensionInfo, XDP_FRAME_EXTENSION_CHECKSUM_NAME,
+        XDP_FRAME_EXTENSION_CHECKSUM_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+    XdpTxQueueRegisterExtensionVersion(Config, &ExtensionInfo);
+
     XdpInitializeTxCapabilitiesSystemMdl(&TxCapabilities);
     TxCapabilities.OutOfOrderCompletionEnabled = TRUE;
     TxCapabilities.MaximumBufferSize = MAX_TX_BUFFER_LENGTH;
     TxCapabilities.MaximumFrameSize = Generic->Tx.Mtu;
+    TxCapabilities.IdealProcessorValid =
+        NT_SUCCESS(
+            KeGetProcessorNumberFromIndex(
+                ReadULongNoFence(&TxQueue->RssQueue->IdealProcessor),
+                &TxCapabilities.IdealProcessor));
     XdpTxQueueSetCapabilities(Config, &TxCapabilities);
 
     *InterfaceTxQueue = (XDP_INTERFACE_HANDLE)TxQueue;
@@ -836,6 +1802,10 @@ Exit:
                 NdisFreeNetBufferListPool(TxQueue->NblPool);
                 TxQueue->NblPool = NULL;
             }
+            if (TxQueue->SegmentNbPool != NULL) {
+                NdisFreeNetBufferPool(TxQueue->SegmentNbPool);
+                TxQueue->SegmentNbPool = NULL;
+            }
             if (TxQueue->PcwInstance != NULL) {
                 PcwCloseInstance(TxQueue->PcwInstance);
             }
@@ -888,6 +1858,25 @@ XdpGenericTxActivateQueue(
         XdpTxQueueGetExtension(Config, &ExtensionInfo, &TxQueue->TxCompletionContextExtension);
     }
 
+    if (!TxQueue->Flags.RxInject) {
+        XdpInitializeExtensionInfo(
+            &ExtensionInfo, XDP_FRAME_EXTENSION_GSO_NAME,
+            XDP_FRAME_EXTENSION_GSO_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+        XdpTxQueueGetExtension(Config, &ExtensionInfo, &TxQueue->GsoExtension);
+        TxQueue->Flags.GsoEnabled = TRUE;
+    }
+
+    XdpInitializeExtensionInfo(
+        &ExtensionInfo, XDP_FRAME_EXTENSION_LAYOUT_NAME,
+        XDP_FRAME_EXTENSION_LAYOUT_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+    XdpTxQueueGetExtension(Config, &ExtensionInfo, &TxQueue->LayoutExtension);
+
+    XdpInitializeExtensionInfo(
+        &ExtensionInfo, XDP_FRAME_EXTENSION_CHECKSUM_NAME,
+        XDP_FRAME_EXTENSION_CHECKSUM_VERSION_1, XDP_EXTENSION_TYPE_FRAME);
+    XdpTxQueueGetExtension(Config, &ExtensionInfo, &TxQueue->ChecksumExtension);
+    TxQueue->Flags.ChecksumEnabled = TRUE;
+
     WritePointerRelease(&TxQueue->XdpTxQueue, XdpTxQueue);
 
     RtlReleasePushLockExclusive(&Generic->Lock);
@@ -944,6 +1933,10 @@ XdpGenericTxDeleteQueue(
     }
     NdisFreeNetBufferListPool(TxQueue->NblPool);
     TxQueue->NblPool = NULL;
+    if (TxQueue->SegmentNbPool != NULL) {
+        NdisFreeNetBufferPool(TxQueue->SegmentNbPool);
+        TxQueue->SegmentNbPool = NULL;
+    }
 
     RemoveEntryList(&TxQueue->Link);
 
@@ -18,6 +18,7 @@ typedef struct _XDP_LWF_GENERIC_TX_QUEUE {
     LIST_ENTRY Link;
     XDP_LWF_GENERIC *Generic;
     XDP_TX_QUEUE_NOTIFY_HANDLE XdpNotifyHandle;
+    CONST UINT32 *BufferMdlGeneration;
 
     NDIS_HANDLE NdisFilterHandle;
     XDP_TX_QUEUE_HANDLE XdpTxQueue;
@@ -26,9 +27,13 @@ typedef struct _XDP_LWF_GENERIC_TX_QUEUE {
     XDP_EXTENSION BufferMdlExtension;
     XDP_EXTENSION FrameTxCompletionContextExtension;
     XDP_EXTENSION TxCompletionContextExtension;
+    XDP_EXTENSION GsoExtension;
+    XDP_EXTENSION LayoutExtension;
+    XDP_EXTENSION ChecksumExtension;
 
     XDP_LWF_GENERIC_RSS_QUEUE *RssQueue;
     XDP_EC Ec;
+    UINT32 InlineBudget;
 
     XDP_PCW_LWF_TX_QUEUE PcwStats;
 
@@ -36,6 +41,9 @@ typedef struct _XDP_LWF_GENERIC_TX_QUEUE {
         BOOLEAN Pause : 1;
         BOOLEAN RxInject : 1;
         BOOLEAN TxCompletionContextEnabled : 1;
+        BOOLEAN GsoEnabled : 1;
+        BOOLEAN ChecksumEnabled : 1;
+        BOOLEAN SendHash : 1;
     } Flags;
 
     KEVENT *PauseComplete;
@@ -47,6 +55,8 @@ typedef struct _XDP_LWF_GENERIC_TX_QUEUE {
     SLIST_HEADER NblComplete;
     NET_BUFFER_LIST *FreeNbls;
     NDIS_HANDLE NblPool;
+    NDIS_HANDLE SegmentNbPool;
+    UINT32 SegmentBufferSize;
     PCW_INSTANCE *PcwInstance;
     XDP_LIFETIME_ENTRY DeleteEntry;
     KEVENT *DeleteComplete;
@@ -83,6 +93,13 @@ XdpGenericTxRestart(
     _In_ UINT32 NewMtu
     );
 
+_IRQL_requires_max_(PASSIVE_LEVEL)
+_Requires_exclusive_lock_held_(&Generic->Lock)
+VOID
+XdpGenericTxApplyTuning(
+    _In_ XDP_LWF_GENERIC *Generic
+    );
+
 XDP_CREATE_TX_QUEUE XdpGenericTxCreateQueue;
 XDP_ACTIVATE_TX_QUEUE XdpGenericTxActivateQueue;
 XDP_DELETE_TX_QUEUE XdpGenericTxDeleteQueue;
@@ -20,29 +20,148 @@ typedef struct _XDP_PCW_RX_QUEUE {
     UINT64 InspectFramesRedirected;
     UINT64 InspectFramesForwarded;
     UINT64 InspectFramesDiscontiguous;
+    UINT64 InspectFramesFlowCacheHits;
+    UINT64 XskDropsFillRingEmpty;
+    UINT64 XskDropsRxRingFull;
+    UINT64 InspectDropsRule;
+    UINT64 InspectDropsEbpfFailure;
+    UINT64 RingMemoryBytes;
+    UINT64 XskFramesBackpressured;
 } XDP_PCW_RX_QUEUE;
 
+typedef struct _XDP_PCW_LWF_EC {
+    UINT64 Polls;
+    UINT64 Yields;
+    UINT64 BudgetExhausted;
+} XDP_PCW_LWF_EC;
+
 typedef struct _XDP_PCW_LWF_RX_QUEUE {
     UINT64 MappingFailures;
     UINT64 LinearizationFailures;
     UINT64 ForwardingFailures;
+    UINT64 CoalescedFrames;
+    UINT64 TxCloneCacheHits;
+    UINT64 TxCloneCacheMisses;
+    UINT64 HairpinBatches;
+    UINT64 HairpinBackpressure;
+    UINT64 ForwardingLowResources;
+    UINT64 LowResourcesIndications;
+    UINT64 LowResourcesFrames;
+    UINT64 ForwardingCopies;
+    UINT64 ForwardingCopyPoolMisses;
+    XDP_PCW_LWF_EC TxInspectEc;
 } XDP_PCW_LWF_RX_QUEUE;
 
 typedef struct _XDP_PCW_TX_QUEUE {
     UINT64 XskInvalidDescriptors;
     UINT64 InjectionBatches;
     UINT64 QueueDepth;
+    UINT64 XskBounceFailures;
+    UINT64 RingMemoryBytes;
 } XDP_PCW_TX_QUEUE;
 
 typedef struct _XDP_PCW_LWF_TX_QUEUE {
     UINT64 FramesDroppedPause;
     UINT64 FramesDroppedNic;
+    XDP_PCW_LWF_EC Ec;
+    UINT64 InlinePolls;
+    UINT64 InlineFrames;
 } XDP_PCW_LWF_TX_QUEUE;
 
+//
+// Latency histograms use log2 microsecond buckets: bucket 0 counts samples
+// under 1us, bucket N counts samples in [2^(N-1), 2^N) us, and the last bucket
+// counts everything at or above 2^(XDP_PCW_LATENCY_BUCKETS - 2) us.
+//
+#define XDP_PCW_LATENCY_BUCKETS 16
+
+typedef struct _XDP_PCW_LATENCY_HISTOGRAM {
+    UINT64 Samples;
+    UINT64 Buckets[XDP_PCW_LATENCY_BUCKETS];
+} XDP_PCW_LATENCY_HISTOGRAM;
+
+typedef struct _XDP_PCW_RX_QUEUE_LATENCY {
+    XDP_PCW_LATENCY_HISTOGRAM Receive;
+} XDP_PCW_RX_QUEUE_LATENCY;
+
+typedef struct _XDP_PCW_TX_QUEUE_LATENCY {
+    XDP_PCW_LATENCY_HISTOGRAM Completion;
+    XDP_PCW_LATENCY_HISTOGRAM Flush;
+} XDP_PCW_TX_QUEUE_LATENCY;
+
+//
+// Per-stage data path cycle counters, populated only by perf-instrumented
+// (XDP_PERF_STAGES) builds. Each cycle counter is averaged over the frame
+// count of its stage.
+//
+typedef struct _XDP_PCW_RX_QUEUE_STAGES {
+    UINT32 Frames;
+    UINT32 XskFrames;
+    UINT64 InspectCycles;
+    UINT64 FlushRedirectCycles;
+    UINT64 XskCopyCycles;
+    UINT64 XskPublishCycles;
+} XDP_PCW_RX_QUEUE_STAGES;
+
+typedef struct _XDP_PCW_TX_QUEUE_STAGES {
+    UINT32 Frames;
+    UINT32 Reserved;
+    UINT64 CompletionCycles;
+    UINT64 FillCycles;
+} XDP_PCW_TX_QUEUE_STAGES;
+
+typedef struct _XDP_PCW_LWF_RX_QUEUE_STAGES {
+    UINT32 Frames;
+    UINT32 Reserved;
+    UINT64 FillCycles;
+    UINT64 InspectCycles;
+    UINT64 ApplyCycles;
+} XDP_PCW_LWF_RX_QUEUE_STAGES;
+
+typedef struct _XDP_PCW_XSK {
+    UINT64 RxFrames;
+    UINT64 RxBytes;
+    UINT64 RxDropped;
+    UINT64 RxTruncated;
+    UINT64 RxInvalidDescriptors;
+    UINT64 RxFillRingEmpty;
+    UINT64 RxRingFull;
+    UINT64 RxFillNeedPoke;
+    UINT64 RxPokes;
+    UINT64 TxFrames;
+    UINT64 TxBytes;
+    UINT64 TxInvalidDescriptors;
+    UINT64 TxBounceFrames;
+    UINT64 TxBounceFailures;
+    UINT64 TxNeedPoke;
+    UINT64 TxPokes;
+    UINT64 MemoryBytes;
+} XDP_PCW_XSK;
+
+typedef struct _XDP_PCW_PROGRAM_RULE {
+    UINT64 Hits;
+    UINT64 LastHitTime;
+} XDP_PCW_PROGRAM_RULE;
+
 #define STAT_INC(_Stats, _Field) (((_Stats)->_Field)++)
 #define STAT_ADD(_Stats, _Field, _Bias) (((_Stats)->_Field) += (_Bias))
 #define STAT_SET(_Stats, _Field, _Value) (((_Stats)->_Field) = (_Value))
 
+//
+// Stage timers read the timestamp counter at the start of a data path stage
+// and add the elapsed cycles to a stage counter at its end. They compile to
+// nothing unless XDP_PERF_STAGES is defined.
+//
+#ifdef XDP_PERF_STAGES
+#define STAGE_START(_Tsc) UINT64 _Tsc = ReadTimeStampCounter()
+#define STAGE_END(_Stats, _Field, _Tsc) STAT_ADD(_Stats, _Field, ReadTimeStampCounter() - (_Tsc))
+#define STAGE_ADD(_Stats, _Field, _Bias) STAT_ADD(_Stats, _Field, _Bias)
+#else
+#define STAGE_START(_Tsc)
+#define STAGE_END(_Stats, _Field, _Tsc)
+#define STAGE_ADD(_Stats, _Field, _Bias)
+#endif
+
 #ifdef KERNEL_MODE
 //
 // Before including the autogenerated PCW helpers, set the PCW version macro to
@@ -0,0 +1,28 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#include "bpf_endian.h"
+#include "bpf_helpers.h"
+#include "xdpebpf_experimental.h"
+
+//
+// The number of bytes the program trims from the end of each frame.
+//
+#define ADJUST_TAIL_TX_TRIM 8
+
+SEC("xdp/adjust_tail_tx")
+int
+adjust_tail_tx(xdp_md_t *ctx)
+{
+    //
+    // Trim the end of each frame and forward the rest, or drop frames too
+    // short to be trimmed.
+    //
+    if (bpf_xdp_adjust_tail(ctx, -ADJUST_TAIL_TX_TRIM) < 0) {
+        return XDP_DROP;
+    }
+
+    return XDP_TX;
+}
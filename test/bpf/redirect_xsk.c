@@ -0,0 +1,19 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#include "bpf_endian.h"
+#include "bpf_helpers.h"
+#include "xdpebpf_experimental.h"
+
+SEC("xdp/redirect_xsk")
+int
+redirect_xsk(xdp_md_t *ctx)
+{
+    //
+    // Redirect all frames to the socket at key 0, or pass them if there is no
+    // such socket.
+    //
+    return bpf_xdp_redirect_xsk(ctx, 0, XDP_PASS);
+}
@@ -0,0 +1,37 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#include "bpf_endian.h"
+#include "bpf_helpers.h"
+#include "xdpebpf_experimental.h"
+
+//
+// The value the program writes into the metadata area of each frame.
+//
+#define REDIRECT_XSK_META_VALUE 0x1234ABCD
+
+SEC("xdp/redirect_xsk_meta")
+int
+redirect_xsk_meta(xdp_md_t *ctx)
+{
+    uint32_t *meta;
+
+    //
+    // Place a 4-byte value in front of the frame data, then redirect the frame
+    // to the socket at key 0.
+    //
+    if (bpf_xdp_adjust_meta(ctx, -(int)sizeof(*meta)) < 0) {
+        return XDP_DROP;
+    }
+
+    meta = (uint32_t *)ctx->data_meta;
+    if ((char *)(meta + 1) > (char *)ctx->data) {
+        return XDP_DROP;
+    }
+
+    *meta = REDIRECT_XSK_META_VALUE;
+
+    return bpf_xdp_redirect_xsk(ctx, 0, XDP_DROP);
+}
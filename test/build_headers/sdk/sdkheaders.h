@@ -7,4 +7,5 @@
 #include <afxdp.h>
 #include <afxdp_experimental.h>
 #include <afxdp_helper.h>
+#include <afxdp_poller.h>
 #include <xdpapi.h>
@@ -0,0 +1,32 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+//
+// The RX replay file format loaded by XDPMP. The pcapcmd tool converts packet
+// captures into this format, which XDPMP can load into non-paged memory
+// without parsing capture-specific headers. A file consists of a header
+// followed by FrameCount records. Each record is a record header followed by
+// the frame's Ethernet bytes, padded to XDPMP_REPLAY_RECORD_ALIGNMENT.
+//
+
+#define XDPMP_REPLAY_MAGIC 0x52504D58 // "XMPR"
+#define XDPMP_REPLAY_VERSION 1
+#define XDPMP_REPLAY_RECORD_ALIGNMENT 8
+#define XDPMP_REPLAY_MIN_FRAME_LENGTH 14
+#define XDPMP_REPLAY_MAX_FRAME_LENGTH 65536
+
+typedef struct _XDPMP_REPLAY_HEADER {
+    UINT32 Magic;
+    UINT32 Version;
+    UINT32 FrameCount;
+    UINT32 Reserved;
+} XDPMP_REPLAY_HEADER;
+
+typedef struct _XDPMP_REPLAY_RECORD {
+    UINT32 FrameLength;
+    UINT32 Reserved;
+} XDPMP_REPLAY_RECORD;
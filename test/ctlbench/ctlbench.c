@@ -0,0 +1,775 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#include <windows.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <afxdp_helper.h>
+#include <xdpapi.h>
+#include <xdpapi_experimental.h>
+
+#define SHALLOW_STR_OF(x) #x
+#define STR_OF(x) SHALLOW_STR_OF(x)
+
+#define DEFAULT_QUEUE_ID 0
+#define DEFAULT_ITERATIONS 100
+#define DEFAULT_RING_SIZE 512
+#define DEFAULT_UMEM_SIZE 65536
+#define DEFAULT_UMEM_CHUNK_SIZE 4096
+#define MAX_COUNT_LIST 16
+
+CHAR *HELP =
+"ctlbench.exe -i <ifindex> [OPTIONS]\n"
+"\n"
+"Measures XDP control plane operation latency and throughput: XSK\n"
+"create/bind/activate/close, XdpCreateProgram vs. rule count, XdpRssSet, and\n"
+"QEO connection add/remove vs. connection count.\n"
+"\n"
+"OPTIONS: \n"
+"   -q <queueid>       The queue ID to bind sockets and programs to\n"
+"                      Default: " STR_OF(DEFAULT_QUEUE_ID) "\n"
+"   -xdp_mode <mode>   The XDP interface provider\n"
+"                      - system: system default\n"
+"                      - generic: generic XDP\n"
+"                      - native: native XDP\n"
+"                      Default: system\n"
+"   -n <iterations>    The number of iterations of each measured operation\n"
+"                      Default: " STR_OF(DEFAULT_ITERATIONS) "\n"
+"   -rules <n,n,...>   The program rule counts to measure\n"
+"                      Default: 1,16,256,4096\n"
+"   -qeo <n,n,...>     The QEO connection counts to measure\n"
+"                      Default: 1000,10000,100000\n"
+"   -skip <tests>      Comma-separated tests to skip: xsk,program,rss,qeo\n"
+"                      Default: none\n"
+"   -output <format>   Output format\n"
+"                      - text: human-readable output\n"
+"                      - json: one JSON object per record\n"
+"                      - csv: one CSV line per metric\n"
+"                      Default: text\n"
+"   -v                 Verbose logging\n"
+"                      Default: off\n"
+"\n"
+"Examples\n"
+"   ctlbench.exe -i 6\n"
+"   ctlbench.exe -i 6 -xdp_mode generic -rules 1,1024 -skip rss,qeo -output csv\n"
+;
+
+#define printf_error(...) \
+    fprintf(stderr, __VA_ARGS__)
+
+#define printf_verbose(format, ...) \
+    if (verbose) { LARGE_INTEGER Qpc; QueryPerformanceCounter(&Qpc); printf("Qpc=%llu " format, Qpc.QuadPart, __VA_ARGS__); }
+
+#define ABORT(...) \
+    printf_error(__VA_ARGS__); exit(1)
+
+#define ASSERT_FRE(expr) \
+    if (!(expr)) { ABORT("(%s) failed line %d\n", #expr, __LINE__);}
+
+#if DBG
+#define VERIFY(expr) assert(expr)
+#else
+#define VERIFY(expr) (expr)
+#endif
+
+#define Usage() PrintUsage(__LINE__)
+
+typedef enum {
+    XdpModeSystem,
+    XdpModeGeneric,
+    XdpModeNative,
+} XDP_MODE;
+
+typedef enum {
+    OutputText,
+    OutputJson,
+    OutputCsv,
+} OUTPUT_FORMAT;
+
+typedef struct {
+    UINT32 Count;
+    UINT32 Values[MAX_COUNT_LIST];
+} COUNT_LIST;
+
+//
+// Per-iteration samples of a single operation, in QPC ticks.
+//
+typedef struct {
+    UINT32 Count;
+    INT64 *Qpc;
+} SAMPLES;
+
+const XDP_API_TABLE *XdpApi;
+XDP_RSS_GET_FN *XdpRssGet;
+XDP_RSS_SET_FN *XdpRssSet;
+XDP_QEO_SET_FN *XdpQeoSet;
+
+INT ifindex = -1;
+UINT32 queueId = DEFAULT_QUEUE_ID;
+XDP_MODE xdpMode = XdpModeSystem;
+CHAR *modestr = "system";
+UINT32 iterations = DEFAULT_ITERATIONS;
+COUNT_LIST ruleCounts = { 4, { 1, 16, 256, 4096 } };
+COUNT_LIST qeoCounts = { 3, { 1000, 10000, 100000 } };
+BOOLEAN skipXsk = FALSE;
+BOOLEAN skipProgram = FALSE;
+BOOLEAN skipRss = FALSE;
+BOOLEAN skipQeo = FALSE;
+OUTPUT_FORMAT outputFormat = OutputText;
+BOOLEAN verbose = FALSE;
+LARGE_INTEGER freqQpc;
+
+VOID
+PrintUsage(
+    INT Line
+    )
+{
+    printf_error("Line:%d\n", Line);
+    ABORT(HELP);
+}
+
+VOID
+BeginRecord(
+    CONST CHAR *Record,
+    INT Id
+    )
+{
+    if (outputFormat == OutputJson) {
+        printf("{\"record\":\"%s\",\"mode\":\"%s\",\"id\":%d", Record, modestr, Id);
+    }
+}
+
+VOID
+RecordMetric(
+    CONST CHAR *Record,
+    INT Id,
+    CONST CHAR *Metric,
+    double Value
+    )
+{
+    if (outputFormat == OutputJson) {
+        printf(",\"%s\":%.3f", Metric, Value);
+    } else if (outputFormat == OutputCsv) {
+        printf("%s,%s,%d,%s,%.3f\n", Record, modestr, Id, Metric, Value);
+    }
+}
+
+VOID
+EndRecord(
+    VOID
+    )
+{
+    if (outputFormat == OutputJson) {
+        printf("}\n");
+    }
+}
+
+double
+QpcToUs(
+    INT64 Qpc
+    )
+{
+    return (double)Qpc * 1000000.0 / (double)freqQpc.QuadPart;
+}
+
+INT64
+QpcNow(
+    VOID
+    )
+{
+    LARGE_INTEGER Qpc;
+    VERIFY(QueryPerformanceCounter(&Qpc));
+    return Qpc.QuadPart;
+}
+
+VOID
+SamplesInitialize(
+    SAMPLES *Samples,
+    UINT32 Capacity
+    )
+{
+    Samples->Count = 0;
+    Samples->Qpc = calloc(Capacity, sizeof(*Samples->Qpc));
+    ASSERT_FRE(Samples->Qpc != NULL);
+}
+
+VOID
+SamplesCleanup(
+    SAMPLES *Samples
+    )
+{
+    free(Samples->Qpc);
+    Samples->Qpc = NULL;
+}
+
+INT
+__cdecl
+CompareInt64(
+    const VOID *A,
+    const VOID *B
+    )
+{
+    INT64 ValueA = *(const INT64 *)A;
+    INT64 ValueB = *(const INT64 *)B;
+
+    return (ValueA > ValueB) - (ValueA < ValueB);
+}
+
+//
+// Records the average, median, P99 and maximum of an operation's samples as
+// <Prefix>AvgUs, <Prefix>P50Us, etc.
+//
+VOID
+RecordSamples(
+    CONST CHAR *Record,
+    INT Id,
+    CONST CHAR *Prefix,
+    SAMPLES *Samples
+    )
+{
+    CHAR metric[64];
+    INT64 total = 0;
+    double avg;
+    double p50;
+    double p99;
+    double max;
+
+    if (Samples->Count == 0) {
+        return;
+    }
+
+    qsort(Samples->Qpc, Samples->Count, sizeof(*Samples->Qpc), CompareInt64);
+
+    for (UINT32 i = 0; i < Samples->Count; i++) {
+        total += Samples->Qpc[i];
+    }
+
+    avg = QpcToUs(total) / Samples->Count;
+    p50 = QpcToUs(Samples->Qpc[Samples->Count / 2]);
+    p99 = QpcToUs(Samples->Qpc[(UINT32)(((UINT64)Samples->Count * 99) / 100)]);
+    max = QpcToUs(Samples->Qpc[Samples->Count - 1]);
+
+    if (outputFormat == OutputText) {
+        printf(
+            "%-8s[%6d] %-10s avg=%10.3f P50=%10.3f P99=%10.3f max=%10.3f us (%u samples)\n",
+            Record, Id, Prefix, avg, p50, p99, max, Samples->Count);
+        return;
+    }
+
+    sprintf_s(metric, sizeof(metric), "%sAvgUs", Prefix);
+    RecordMetric(Record, Id, metric, avg);
+    sprintf_s(metric, sizeof(metric), "%sP50Us", Prefix);
+    RecordMetric(Record, Id, metric, p50);
+    sprintf_s(metric, sizeof(metric), "%sP99Us", Prefix);
+    RecordMetric(Record, Id, metric, p99);
+    sprintf_s(metric, sizeof(metric), "%sMaxUs", Prefix);
+    RecordMetric(Record, Id, metric, max);
+}
+
+VOID
+RecordValue(
+    CONST CHAR *Record,
+    INT Id,
+    CONST CHAR *Metric,
+    double Value
+    )
+{
+    if (outputFormat == OutputText) {
+        printf("%-8s[%6d] %-10s %.3f\n", Record, Id, Metric, Value);
+        return;
+    }
+
+    RecordMetric(Record, Id, Metric, Value);
+}
+
+VOID
+BenchXsk(
+    VOID
+    )
+{
+    SAMPLES createSamples;
+    SAMPLES bindSamples;
+    SAMPLES activateSamples;
+    SAMPLES closeSamples;
+    XSK_UMEM_REG umemReg = {0};
+    UINT32 ringSize = DEFAULT_RING_SIZE;
+    UINT32 bindFlags = XSK_BIND_FLAG_RX;
+    INT64 startQpc;
+    INT64 totalQpc;
+
+    SamplesInitialize(&createSamples, iterations);
+    SamplesInitialize(&bindSamples, iterations);
+    SamplesInitialize(&activateSamples, iterations);
+    SamplesInitialize(&closeSamples, iterations);
+
+    if (xdpMode == XdpModeGeneric) {
+        bindFlags |= XSK_BIND_FLAG_GENERIC;
+    } else if (xdpMode == XdpModeNative) {
+        bindFlags |= XSK_BIND_FLAG_NATIVE;
+    }
+
+    umemReg.TotalSize = DEFAULT_UMEM_SIZE;
+    umemReg.ChunkSize = DEFAULT_UMEM_CHUNK_SIZE;
+    umemReg.Address =
+        VirtualAlloc(NULL, umemReg.TotalSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    ASSERT_FRE(umemReg.Address != NULL);
+
+    totalQpc = QpcNow();
+
+    for (UINT32 i = 0; i < iterations; i++) {
+        HANDLE sock;
+        HRESULT res;
+
+        startQpc = QpcNow();
+        res = XdpApi->XskCreate(&sock);
+        createSamples.Qpc[createSamples.Count++] = QpcNow() - startQpc;
+        if (FAILED(res)) {
+            ABORT("err: XskCreate returned 0x%x\n", res);
+        }
+
+        res = XdpApi->XskSetSockopt(sock, XSK_SOCKOPT_UMEM_REG, &umemReg, sizeof(umemReg));
+        ASSERT_FRE(res == S_OK);
+        res =
+            XdpApi->XskSetSockopt(
+                sock, XSK_SOCKOPT_RX_FILL_RING_SIZE, &ringSize, sizeof(ringSize));
+        ASSERT_FRE(res == S_OK);
+        res =
+            XdpApi->XskSetSockopt(
+                sock, XSK_SOCKOPT_TX_COMPLETION_RING_SIZE, &ringSize, sizeof(ringSize));
+        ASSERT_FRE(res == S_OK);
+        res = XdpApi->XskSetSockopt(sock, XSK_SOCKOPT_RX_RING_SIZE, &ringSize, sizeof(ringSize));
+        ASSERT_FRE(res == S_OK);
+
+        startQpc = QpcNow();
+        res = XdpApi->XskBind(sock, ifindex, queueId, bindFlags);
+        bindSamples.Qpc[bindSamples.Count++] = QpcNow() - startQpc;
+        if (FAILED(res)) {
+            ABORT("err: XskBind returned 0x%x\n", res);
+        }
+
+        startQpc = QpcNow();
+        res = XdpApi->XskActivate(sock, 0);
+        activateSamples.Qpc[activateSamples.Count++] = QpcNow() - startQpc;
+        if (FAILED(res)) {
+            ABORT("err: XskActivate returned 0x%x\n", res);
+        }
+
+        startQpc = QpcNow();
+        VERIFY(CloseHandle(sock));
+        closeSamples.Qpc[closeSamples.Count++] = QpcNow() - startQpc;
+
+        printf_verbose("xsk iteration %u complete\n", i);
+    }
+
+    totalQpc = QpcNow() - totalQpc;
+
+    BeginRecord("xsk", queueId);
+    RecordSamples("xsk", queueId, "create", &createSamples);
+    RecordSamples("xsk", queueId, "bind", &bindSamples);
+    RecordSamples("xsk", queueId, "activate", &activateSamples);
+    RecordSamples("xsk", queueId, "close", &closeSamples);
+    RecordValue("xsk", queueId, "cyclesPerSec", iterations * 1000000.0 / QpcToUs(totalQpc));
+    EndRecord();
+
+    VERIFY(VirtualFree(umemReg.Address, 0, MEM_RELEASE));
+    SamplesCleanup(&createSamples);
+    SamplesCleanup(&bindSamples);
+    SamplesCleanup(&activateSamples);
+    SamplesCleanup(&closeSamples);
+}
+
+VOID
+BenchProgram(
+    UINT32 RuleCount
+    )
+{
+    SAMPLES createSamples;
+    SAMPLES closeSamples;
+    XDP_RULE *rules;
+    XDP_HOOK_ID hookId = {0};
+    XDP_CREATE_PROGRAM_FLAGS flags = XDP_CREATE_PROGRAM_FLAG_NONE;
+
+    SamplesInitialize(&createSamples, iterations);
+    SamplesInitialize(&closeSamples, iterations);
+
+    hookId.Layer = XDP_HOOK_L2;
+    hookId.Direction = XDP_HOOK_RX;
+    hookId.SubLayer = XDP_HOOK_INSPECT;
+
+    if (xdpMode == XdpModeGeneric) {
+        flags |= XDP_CREATE_PROGRAM_FLAG_GENERIC;
+    } else if (xdpMode == XdpModeNative) {
+        flags |= XDP_CREATE_PROGRAM_FLAG_NATIVE;
+    }
+
+    //
+    // Distinct exact-match rules that pass all traffic, so the program is
+    // representative of a large filter set without perturbing the interface.
+    //
+    rules = calloc(RuleCount, sizeof(*rules));
+    ASSERT_FRE(rules != NULL);
+
+    for (UINT32 i = 0; i < RuleCount; i++) {
+        rules[i].Match = XDP_MATCH_UDP_DST;
+        rules[i].Pattern.Port = _byteswap_ushort((UINT16)(i + 1));
+        rules[i].Action = XDP_PROGRAM_ACTION_PASS;
+    }
+
+    for (UINT32 i = 0; i < iterations; i++) {
+        HANDLE program;
+        HRESULT res;
+        INT64 startQpc;
+
+        startQpc = QpcNow();
+        res = XdpApi->XdpCreateProgram(ifindex, &hookId, queueId, flags, rules, RuleCount, &program);
+        createSamples.Qpc[createSamples.Count++] = QpcNow() - startQpc;
+        if (FAILED(res)) {
+            ABORT("err: XdpCreateProgram(%u rules) returned 0x%x\n", RuleCount, res);
+        }
+
+        startQpc = QpcNow();
+        VERIFY(CloseHandle(program));
+        closeSamples.Qpc[closeSamples.Count++] = QpcNow() - startQpc;
+    }
+
+    BeginRecord("program", RuleCount);
+    RecordSamples("program", RuleCount, "create", &createSamples);
+    RecordSamples("program", RuleCount, "close", &closeSamples);
+    EndRecord();
+
+    free(rules);
+    SamplesCleanup(&createSamples);
+    SamplesCleanup(&closeSamples);
+}
+
+VOID
+BenchRss(
+    HANDLE InterfaceHandle
+    )
+{
+    SAMPLES setSamples;
+    XDP_RSS_CONFIGURATION *rssConfig;
+    PROCESSOR_NUMBER *indirectionTable;
+    UINT32 entryCount;
+    UINT32 size = 0;
+    HRESULT res;
+
+    if (XdpRssGet == NULL || XdpRssSet == NULL) {
+        printf_error("RSS APIs unavailable, skipping\n");
+        return;
+    }
+
+    res = XdpRssGet(InterfaceHandle, NULL, &size);
+    if (res != HRESULT_FROM_WIN32(ERROR_MORE_DATA)) {
+        printf_error("XdpRssGet returned 0x%x, skipping RSS\n", res);
+        return;
+    }
+
+    rssConfig = malloc(size);
+    ASSERT_FRE(rssConfig != NULL);
+    res = XdpRssGet(InterfaceHandle, rssConfig, &size);
+    ASSERT_FRE(res == S_OK);
+
+    if (rssConfig->Flags & XDP_RSS_FLAG_DISABLED) {
+        printf_error("RSS is disabled, skipping RSS\n");
+        free(rssConfig);
+        return;
+    }
+
+    indirectionTable =
+        (PROCESSOR_NUMBER *)((UCHAR *)rssConfig + rssConfig->IndirectionTableOffset);
+    entryCount = rssConfig->IndirectionTableSize / sizeof(*indirectionTable);
+
+    rssConfig->Flags =
+        XDP_RSS_FLAG_SET_HASH_TYPE | XDP_RSS_FLAG_SET_HASH_SECRET_KEY |
+        XDP_RSS_FLAG_SET_INDIRECTION_TABLE;
+
+    SamplesInitialize(&setSamples, iterations);
+
+    for (UINT32 i = 0; i < iterations; i++) {
+        INT64 startQpc;
+
+        //
+        // Rotate the indirection table so each set is a real reconfiguration.
+        //
+        if (entryCount > 1) {
+            PROCESSOR_NUMBER first = indirectionTable[0];
+            MoveMemory(
+                &indirectionTable[0], &indirectionTable[1],
+                (entryCount - 1) * sizeof(*indirectionTable));
+            indirectionTable[entryCount - 1] = first;
+        }
+
+        startQpc = QpcNow();
+        res = XdpRssSet(InterfaceHandle, rssConfig, size);
+        setSamples.Qpc[setSamples.Count++] = QpcNow() - startQpc;
+        if (FAILED(res)) {
+            ABORT("err: XdpRssSet returned 0x%x\n", res);
+        }
+    }
+
+    BeginRecord("rss", entryCount);
+    RecordSamples("rss", entryCount, "set", &setSamples);
+    EndRecord();
+
+    free(rssConfig);
+    SamplesCleanup(&setSamples);
+}
+
+VOID
+BenchQeo(
+    HANDLE InterfaceHandle,
+    UINT32 ConnectionCount
+    )
+{
+    XDP_QUIC_CONNECTION *connections;
+    UINT32 connectionsSize;
+    INT64 addQpc;
+    INT64 removeQpc;
+    HRESULT res;
+
+    if (XdpQeoSet == NULL) {
+        printf_error("QEO API unavailable, skipping\n");
+        return;
+    }
+
+    connectionsSize = ConnectionCount * sizeof(*connections);
+    connections = malloc(connectionsSize);
+    ASSERT_FRE(connections != NULL);
+
+    for (UINT32 i = 0; i < ConnectionCount; i++) {
+        XDP_QUIC_CONNECTION *connection = &connections[i];
+
+        XdpInitializeQuicConnection(connection, sizeof(*connection));
+        connection->Operation = XDP_QUIC_OPERATION_ADD;
+        connection->Direction = XDP_QUIC_DIRECTION_RECEIVE;
+        connection->DecryptFailureAction = XDP_QUIC_DECRYPT_FAILURE_ACTION_CONTINUE;
+        connection->CipherType = XDP_QUIC_CIPHER_TYPE_AEAD_AES_128_GCM;
+        connection->AddressFamily = XDP_QUIC_ADDRESS_FAMILY_INET4;
+        connection->UdpPort = _byteswap_ushort(4433);
+        connection->Address[0] = 192;
+        connection->Address[1] = 0;
+        connection->Address[2] = 2;
+        connection->Address[3] = 1;
+        connection->ConnectionIdLength = 8;
+        *(UINT32 *)&connection->ConnectionId[0] = i;
+        *(UINT32 *)&connection->ConnectionId[4] = 0x62746c63; // "ctlb"
+        connection->PayloadKey[0] = (UINT8)i;
+        connection->HeaderKey[0] = (UINT8)i;
+    }
+
+    addQpc = QpcNow();
+    res = XdpQeoSet(InterfaceHandle, connections, connectionsSize);
+    addQpc = QpcNow() - addQpc;
+    if (FAILED(res)) {
+        printf_error("XdpQeoSet(%u adds) returned 0x%x, skipping QEO\n", ConnectionCount, res);
+        free(connections);
+        return;
+    }
+
+    for (UINT32 i = 0; i < ConnectionCount; i++) {
+        connections[i].Operation = XDP_QUIC_OPERATION_REMOVE;
+    }
+
+    removeQpc = QpcNow();
+    res = XdpQeoSet(InterfaceHandle, connections, connectionsSize);
+    removeQpc = QpcNow() - removeQpc;
+    if (FAILED(res)) {
+        ABORT("err: XdpQeoSet(%u removes) returned 0x%x\n", ConnectionCount, res);
+    }
+
+    BeginRecord("qeo", ConnectionCount);
+    RecordValue("qeo", ConnectionCount, "addUs", QpcToUs(addQpc));
+    RecordValue("qeo", ConnectionCount, "removeUs", QpcToUs(removeQpc));
+    RecordValue(
+        "qeo", ConnectionCount, "addPerSec", ConnectionCount * 1000000.0 / QpcToUs(addQpc));
+    RecordValue(
+        "qeo", ConnectionCount, "removePerSec",
+        ConnectionCount * 1000000.0 / QpcToUs(removeQpc));
+    EndRecord();
+
+    free(connections);
+}
+
+VOID
+ParseCountList(
+    COUNT_LIST *List,
+    CHAR *Arg
+    )
+{
+    CHAR *context = NULL;
+    CHAR *token;
+
+    List->Count = 0;
+
+    for (token = strtok_s(Arg, ",", &context); token != NULL;
+            token = strtok_s(NULL, ",", &context)) {
+        if (List->Count == RTL_NUMBER_OF(List->Values)) {
+            Usage();
+        }
+        List->Values[List->Count] = strtoul(token, NULL, 0);
+        if (List->Values[List->Count] == 0) {
+            Usage();
+        }
+        List->Count++;
+    }
+}
+
+VOID
+ParseSkipList(
+    CHAR *Arg
+    )
+{
+    CHAR *context = NULL;
+    CHAR *token;
+
+    for (token = strtok_s(Arg, ",", &context); token != NULL;
+            token = strtok_s(NULL, ",", &context)) {
+        if (!_stricmp(token, "xsk")) {
+            skipXsk = TRUE;
+        } else if (!_stricmp(token, "program")) {
+            skipProgram = TRUE;
+        } else if (!_stricmp(token, "rss")) {
+            skipRss = TRUE;
+        } else if (!_stricmp(token, "qeo")) {
+            skipQeo = TRUE;
+        } else {
+            Usage();
+        }
+    }
+}
+
+VOID
+ParseArgs(
+    INT argc,
+    CHAR **argv
+    )
+{
+    for (INT i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-i")) {
+            if (++i >= argc) {
+                Usage();
+            }
+            ifindex = atoi(argv[i]);
+        } else if (!strcmp(argv[i], "-q")) {
+            if (++i >= argc) {
+                Usage();
+            }
+            queueId = atoi(argv[i]);
+        } else if (!_stricmp(argv[i], "-xdp_mode")) {
+            if (++i >= argc) {
+                Usage();
+            }
+            if (!_stricmp(argv[i], "system")) {
+                xdpMode = XdpModeSystem;
+            } else if (!_stricmp(argv[i], "generic")) {
+                xdpMode = XdpModeGeneric;
+            } else if (!_stricmp(argv[i], "native")) {
+                xdpMode = XdpModeNative;
+            } else {
+                Usage();
+            }
+            modestr = argv[i];
+        } else if (!strcmp(argv[i], "-n")) {
+            if (++i >= argc) {
+                Usage();
+            }
+            iterations = atoi(argv[i]);
+        } else if (!_stricmp(argv[i], "-rules")) {
+            if (++i >= argc) {
+                Usage();
+            }
+            ParseCountList(&ruleCounts, argv[i]);
+        } else if (!_stricmp(argv[i], "-qeo")) {
+            if (++i >= argc) {
+                Usage();
+            }
+            ParseCountList(&qeoCounts, argv[i]);
+        } else if (!_stricmp(argv[i], "-skip")) {
+            if (++i >= argc) {
+                Usage();
+            }
+            ParseSkipList(argv[i]);
+        } else if (!_stricmp(argv[i], "-output")) {
+            if (++i >= argc) {
+                Usage();
+            }
+            if (!_stricmp(argv[i], "text")) {
+                outputFormat = OutputText;
+            } else if (!_stricmp(argv[i], "json")) {
+                outputFormat = OutputJson;
+            } else if (!_stricmp(argv[i], "csv")) {
+                outputFormat = OutputCsv;
+            } else {
+                Usage();
+            }
+        } else if (!strcmp(argv[i], "-v")) {
+            verbose = TRUE;
+        } else {
+            Usage();
+        }
+    }
+
+    if (ifindex == -1 || iterations == 0) {
+        Usage();
+    }
+}
+
+INT
+__cdecl
+main(
+    INT argc,
+    CHAR **argv
+    )
+{
+    HANDLE interfaceHandle = NULL;
+
+    ParseArgs(argc, argv);
+
+    VERIFY(QueryPerformanceFrequency(&freqQpc));
+    ASSERT_FRE(SUCCEEDED(XdpOpenApi(XDP_API_VERSION_1, &XdpApi)));
+
+    XdpRssGet = (XDP_RSS_GET_FN *)XdpApi->XdpGetRoutine(XDP_RSS_GET_FN_NAME);
+    XdpRssSet = (XDP_RSS_SET_FN *)XdpApi->XdpGetRoutine(XDP_RSS_SET_FN_NAME);
+    XdpQeoSet = (XDP_QEO_SET_FN *)XdpApi->XdpGetRoutine(XDP_QEO_SET_FN_NAME);
+
+    if (outputFormat == OutputCsv) {
+        printf("record,mode,id,metric,value\n");
+    }
+
+    if (!skipXsk) {
+        BenchXsk();
+    }
+
+    if (!skipProgram) {
+        for (UINT32 i = 0; i < ruleCounts.Count; i++) {
+            BenchProgram(ruleCounts.Values[i]);
+        }
+    }
+
+    if (!skipRss || !skipQeo) {
+        ASSERT_FRE(SUCCEEDED(XdpApi->XdpInterfaceOpen(ifindex, &interfaceHandle)));
+
+        if (!skipRss) {
+            BenchRss(interfaceHandle);
+        }
+
+        if (!skipQeo) {
+            for (UINT32 i = 0; i < qeoCounts.Count; i++) {
+                BenchQeo(interfaceHandle, qeoCounts.Values[i]);
+            }
+        }
+
+        //
+        // Closing the interface handle reverts the RSS and QEO settings.
+        //
+        VERIFY(CloseHandle(interfaceHandle));
+    }
+
+    XdpCloseApi(XdpApi);
+
+    return 0;
+}
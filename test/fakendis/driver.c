@@ -25,6 +25,7 @@ static const FNDIS_EXPORT_ENTRY FndisExports[] = {
 #pragma warning(pop)
 
 PDEVICE_OBJECT FndisDeviceObject;
+static WCHAR FndisParametersKey[256];
 
 _IRQL_requires_(PASSIVE_LEVEL)
 PVOID
@@ -127,6 +128,24 @@ IrpIoDeviceControl(
         break;
     }
 
+    case IOCTL_FNDIS_POLL_GET_COUNTERS:
+    {
+        FNDIS_POLL_COUNTERS *Out;
+
+        if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Out)) {
+            Status = STATUS_BUFFER_TOO_SMALL;
+            break;
+        }
+
+        Out = Irp->AssociatedIrp.SystemBuffer;
+
+        NdisPollCpuGetCounters(Out);
+
+        Irp->IoStatus.Information = sizeof(*Out);
+        Status = STATUS_SUCCESS;
+        break;
+    }
+
     default:
         Status = STATUS_INVALID_DEVICE_REQUEST;
         break;
@@ -146,8 +165,19 @@ DriverUnload(
     _In_ PDRIVER_OBJECT DriverObject
     )
 {
+    FNDIS_POLL_COUNTERS Counters;
+
     TraceEnter(TRACE_CONTROL, "DriverObject=%p", DriverObject);
 
+    NdisPollCpuGetCounters(&Counters);
+    TraceInfo(
+        TRACE_CONTROL,
+        "Notifications=%llu NotificationsWhilePolling=%llu PollPasses=%llu Yields=%llu "
+        "Polls=%llu RxFrames=%llu TxFrames=%llu EmptyPolls=%llu",
+        Counters.Notifications, Counters.NotificationsWhilePolling, Counters.PollPasses,
+        Counters.Yields, Counters.Polls, Counters.RxFrames, Counters.TxFrames,
+        Counters.WorkPerPoll[0]);
+
     NdisPollCpuStop();
     NdisPollStop();
     if (FndisDeviceObject != NULL) {
@@ -172,7 +202,6 @@ DriverEntry(
     NTSTATUS Status;
     UNICODE_STRING DeviceName;
 
-    UNREFERENCED_PARAMETER(RegistryPath);
 #pragma prefast(suppress : __WARNING_BANNED_MEM_ALLOCATION_UNSAFE, "Non executable pool is enabled via -DPOOL_NX_OPTIN_AUTO=1.")
     ExInitializeDriverRuntime(0);
     WPP_INIT_TRACING(DriverObject, RegistryPath);
@@ -180,6 +209,15 @@ DriverEntry(
 
     TraceEnter(TRACE_CONTROL, "DriverObject=%p", DriverObject);
 
+    if (wcscpy_s(
+            FndisParametersKey, RTL_NUMBER_OF(FndisParametersKey),
+            RegistryPath->Buffer) != 0 ||
+        wcscat_s(
+            FndisParametersKey, RTL_NUMBER_OF(FndisParametersKey), L"\\Parameters") != 0) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
     Status =
         IoCreateDevice(
             DriverObject,
@@ -205,7 +243,7 @@ DriverEntry(
         goto Exit;
     }
 
-    Status = NdisPollCpuStart();
+    Status = NdisPollCpuStart(FndisParametersKey);
     if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
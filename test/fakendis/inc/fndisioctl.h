@@ -15,6 +15,9 @@
 #define IOCTL_FNDIS_POLL_GET_ROUTINE_ADDRESS \
     CTL_CODE(FILE_DEVICE_NETWORK, 0x1, METHOD_BUFFERED, FILE_ANY_ACCESS)
 
+#define IOCTL_FNDIS_POLL_GET_COUNTERS \
+    CTL_CODE(FILE_DEVICE_NETWORK, 0x2, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
 typedef struct _FNDIS_POLL_GET_BACKCHANNEL {
     VOID *Dispatch;
 } FNDIS_POLL_GET_BACKCHANNEL;
@@ -26,3 +29,38 @@ typedef struct _FNDIS_POLL_GET_ROUTINE_ADDRESS_IN {
 typedef struct _FNDIS_POLL_GET_ROUTINE_ADDRESS_OUT {
     VOID *Routine;
 } FNDIS_POLL_GET_ROUTINE_ADDRESS_OUT;
+
+//
+// Work per poll is the number of RX and TX frames completed by a single
+// miniport poll. Bucket 0 counts polls without work, bucket N counts polls
+// with [2^(N-1), 2^N) frames, and the last bucket also counts all larger polls.
+//
+#define FNDIS_POLL_WORK_BUCKETS 9
+
+//
+// Cumulative counters of the default NDIS poll emulation, summed over all
+// poll contexts. Returned by IOCTL_FNDIS_POLL_GET_COUNTERS.
+//
+typedef struct _FNDIS_POLL_COUNTERS {
+    //
+    // Poll requests delivered to a poll context, and the subset delivered
+    // while the context was already polling or waiting to poll.
+    //
+    UINT64 Notifications;
+    UINT64 NotificationsWhilePolling;
+
+    //
+    // Invocations of a context's poll loop, and the number of those that
+    // yielded to a passive thread.
+    //
+    UINT64 PollPasses;
+    UINT64 Yields;
+
+    //
+    // Miniport poll invocations and the work they completed.
+    //
+    UINT64 Polls;
+    UINT64 RxFrames;
+    UINT64 TxFrames;
+    UINT64 WorkPerPoll[FNDIS_POLL_WORK_BUCKETS];
+} FNDIS_POLL_COUNTERS;
@@ -79,8 +79,25 @@ NdisPollInvokePoll(
     _In_ ULONG RxQuota,
     _In_ ULONG TxQuota
     )
+{
+    UINT32 RxCompleted;
+    UINT32 TxCompleted;
+
+    return NdisPollInvokePollEx(Q, RxQuota, TxQuota, &RxCompleted, &TxCompleted);
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+NdisPollInvokePollEx(
+    _In_ PNDIS_POLL_QUEUE Q,
+    _In_ ULONG RxQuota,
+    _In_ ULONG TxQuota,
+    _Out_ UINT32 *RxCompleted,
+    _Out_ UINT32 *TxCompleted
+    )
 {
     NDIS_POLL_DATA Poll = {0};
+    UINT32 CompletedNbls = 0;
 
     Poll.Header.Type = NDIS_OBJECT_TYPE_DEFAULT;
     Poll.Header.Revision = NDIS_POLL_DATA_REVISION_1;
@@ -91,6 +108,18 @@ NdisPollInvokePoll(
 
     Q->Poll(Q->MiniportPollContext, &Poll);
 
+    for (NET_BUFFER_LIST *Nbl = Poll.Transmit.CompletedNblChain;
+        Nbl != NULL;
+        Nbl = NET_BUFFER_LIST_NEXT_NBL(Nbl)) {
+        CompletedNbls++;
+    }
+
+    *RxCompleted =
+        Poll.Receive.NumberOfIndicatedNbls + Poll.Receive.Reserved1[RxXdpFramesAbsorbed];
+    *TxCompleted =
+        CompletedNbls + Poll.Transmit.Reserved1[TxXdpFramesCompleted] +
+        Poll.Transmit.Reserved1[TxXdpFramesTransmitted];
+
     if (Poll.Receive.IndicatedNblChain != NULL) {
         NdisMIndicateReceiveNetBufferLists(
             Q->MiniportAdapterHandle, Poll.Receive.IndicatedNblChain,
@@ -109,6 +138,27 @@ NdisPollInvokePoll(
         Poll.Transmit.Reserved1[TxXdpFramesTransmitted] > 0;
 }
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+NdisPollTryInvokePoll(
+    _In_ PNDIS_POLL_QUEUE Q,
+    _In_ ULONG RxQuota,
+    _In_ ULONG TxQuota,
+    _Out_ UINT32 *RxCompleted,
+    _Out_ UINT32 *TxCompleted
+    )
+{
+    //
+    // Only the default EC polls opportunistically; an exclusive owner
+    // serializes all polls itself.
+    //
+    if (ReadPointerNoFence(&Q->Ec) != Q->Reserved) {
+        return FALSE;
+    }
+
+    return NdisPollCpuTryInvokePoll(Q, RxQuota, TxQuota, RxCompleted, TxCompleted);
+}
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
 NdisPollEnableInterrupt(
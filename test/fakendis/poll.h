@@ -23,6 +23,26 @@ NdisPollInvokePoll(
     _In_ ULONG TxQuota
     );
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+NdisPollInvokePollEx(
+    _In_ PNDIS_POLL_QUEUE Q,
+    _In_ ULONG RxQuota,
+    _In_ ULONG TxQuota,
+    _Out_ UINT32 *RxCompleted,
+    _Out_ UINT32 *TxCompleted
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+NdisPollTryInvokePoll(
+    _In_ PNDIS_POLL_QUEUE Q,
+    _In_ ULONG RxQuota,
+    _In_ ULONG TxQuota,
+    _Out_ UINT32 *RxCompleted,
+    _Out_ UINT32 *TxCompleted
+    );
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
 NdisPollEnableInterrupt(
@@ -161,6 +161,32 @@ NdisPollBackchannelInvokePoll(
     return NdisPollInvokePoll(Backchannel->Q, RxQuota, TxQuota);
 }
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+NdisPollBackchannelInvokePollEx(
+    _In_ NDIS_POLL_BACKCHANNEL *Backchannel,
+    _Inout_ NDIS_POLL_BACKCHANNEL_INVOKE_DATA *InvokeData
+    )
+{
+    return
+        NdisPollInvokePollEx(
+            Backchannel->Q, InvokeData->RxQuota, InvokeData->TxQuota,
+            &InvokeData->RxCompleted, &InvokeData->TxCompleted);
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+NdisPollBackchannelTryInvokePoll(
+    _In_ NDIS_POLL_BACKCHANNEL *Backchannel,
+    _Inout_ NDIS_POLL_BACKCHANNEL_INVOKE_DATA *InvokeData
+    )
+{
+    return
+        NdisPollTryInvokePoll(
+            Backchannel->Q, InvokeData->RxQuota, InvokeData->TxQuota,
+            &InvokeData->RxCompleted, &InvokeData->TxCompleted);
+}
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
 NdisPollBackchannelSetNotifications(
@@ -204,6 +230,8 @@ static const NDIS_POLL_BACKCHANNEL_DISPATCH BackchannelDispatch = {
     .SetNotifications       = NdisPollBackchannelSetNotifications,
     .AddBusyReference       = NdisPollBackchannelAddBusyReference,
     .ReleaseBusyReference   = NdisPollBackchannelReleaseBusyReference,
+    .InvokePollEx           = NdisPollBackchannelInvokePollEx,
+    .TryInvokePoll          = NdisPollBackchannelTryInvokePoll,
 };
 
 NTSTATUS
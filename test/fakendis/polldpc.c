@@ -5,8 +5,14 @@
 
 #include "precomp.h"
 
+//
+// Default poll emulation parameters, each of which can be overridden by a
+// REG_DWORD value under the fndis service's Parameters key.
+//
 #define MAX_ITERATIONS_INLINE   1
 #define MAX_ITERATIONS_PER_DPC  16
+#define MAX_CONTEXTS_PER_CPU    8
+#define MAX_INTERRUPT_COALESCE_US 1000000
 
 //
 // The NDIS polling API uses a default thread priority of 10 for affinitized
@@ -30,20 +36,57 @@
 #define TX_QUOTA 64
 #endif
 
+typedef struct _NDIS_POLL_CPU_CONFIG {
+    ULONG RxQuota;
+    ULONG TxQuota;
+    ULONG IterationsInline;
+    ULONG IterationsPerDpc;
+
+    //
+    // The number of independent poll contexts on each processor. Each context
+    // has its own DPC, iteration quota and yield state, and queues are spread
+    // across a processor's contexts round-robin.
+    //
+    ULONG ContextsPerCpu;
+
+    //
+    // If non-zero, emulates interrupt moderation by deferring the poll of an
+    // idle context by this many microseconds after its first notification.
+    // Queues notified meanwhile join the deferred poll. The delay is bounded
+    // below by the system timer resolution.
+    //
+    ULONG InterruptCoalesceUs;
+} NDIS_POLL_CPU_CONFIG;
+
 typedef struct DECLSPEC_CACHEALIGN _NDIS_POLL_CPU {
     KDPC Dpc;
     BOOLEAN DpcActive;
     BOOLEAN MoreData;
+    ULONG ProcessorIndex;
     INT64 LastYieldTick;
     PIO_WORKITEM WorkItem;
     PKEVENT CleanupComplete;
     LIST_ENTRY Queues;
+    KTIMER CoalesceTimer;
+    KDPC CoalesceDpc;
+
+    //
+    // Updated only by the owning processor at DISPATCH_LEVEL.
+    //
+    FNDIS_POLL_COUNTERS Counters;
 } NDIS_POLL_CPU, *PNDIS_POLL_CPU;
 
 typedef struct _NDIS_POLL_CPU_EC {
     LIST_ENTRY Link;
     LONG Armed;
+
+    //
+    // Held while the queue's poll routine runs, serializing the DPC with
+    // opportunistic inline polls on other threads.
+    //
+    LONG InPoll;
     BOOLEAN NeedCleanup;
+    UCHAR OwningContext;
     ULONG OwningCpu;
     PKEVENT CleanupComplete;
 
@@ -69,6 +112,22 @@ NdisPollCpu(
 static
 PNDIS_POLL_CPU PollCpus;
 
+static
+ULONG PollCpuCount;
+
+static
+LONG PollCpuNextContext;
+
+static
+NDIS_POLL_CPU_CONFIG PollCpuConfig = {
+    RX_QUOTA,
+    TX_QUOTA,
+    MAX_ITERATIONS_INLINE,
+    MAX_ITERATIONS_PER_DPC,
+    1,
+    0,
+};
+
 static
 PNDIS_POLL_CPU_EC
 NdisPollCpuGetEc(
@@ -89,8 +148,9 @@ NdisPollCpuEnqueue(
     _In_ ULONG Processor
     )
 {
-    PNDIS_POLL_CPU PollCpu = &PollCpus[Processor];
     PNDIS_POLL_CPU_EC Ec = NdisPollCpuGetEc(Q);
+    PNDIS_POLL_CPU PollCpu =
+        &PollCpus[Processor * PollCpuConfig.ContextsPerCpu + Ec->OwningContext];
     ULONG IdealProcessor = ReadULongNoFence(&Q->IdealProcessor);
 
     // Enqueue the poll request onto the current CPU.
@@ -111,10 +171,21 @@ NdisPollCpuEnqueue(
 
     InsertHeadList(&PollCpu->Queues, &Ec->Link);
     PollCpu->MoreData = TRUE;
+    PollCpu->Counters.Notifications++;
 
     if (!PollCpu->DpcActive) {
         PollCpu->DpcActive = TRUE;
-        NdisPollCpu(PollCpu, MAX_ITERATIONS_INLINE);
+
+        if (PollCpuConfig.InterruptCoalesceUs > 0) {
+            LARGE_INTEGER DueTime;
+
+            DueTime.QuadPart = -(LONGLONG)PollCpuConfig.InterruptCoalesceUs * 10;
+            KeSetTimer(&PollCpu->CoalesceTimer, DueTime, &PollCpu->CoalesceDpc);
+        } else {
+            NdisPollCpu(PollCpu, PollCpuConfig.IterationsInline);
+        }
+    } else {
+        PollCpu->Counters.NotificationsWhilePolling++;
     }
 }
 
@@ -150,7 +221,7 @@ NdisPollCpuPassiveWorker(
     )
 {
     PNDIS_POLL_CPU PollCpu = (PNDIS_POLL_CPU)Context;
-    UINT32 ProcessorIndex = (UINT32)(PollCpu - PollCpus);
+    ULONG ProcessorIndex = PollCpu->ProcessorIndex;
     GROUP_AFFINITY Affinity = {0};
     GROUP_AFFINITY OldAffinity;
     PROCESSOR_NUMBER ProcessorNumber;
@@ -187,7 +258,40 @@ NdisPollCpuDpc(
     UNREFERENCED_PARAMETER(SystemArgument1);
     UNREFERENCED_PARAMETER(SystemArgument2);
 
-    NdisPollCpu(PollCpu, MAX_ITERATIONS_PER_DPC);
+    NdisPollCpu(PollCpu, PollCpuConfig.IterationsPerDpc);
+}
+
+static
+_IRQL_requires_(DISPATCH_LEVEL)
+BOOLEAN
+NdisPollCpuInvokePoll(
+    _In_ PNDIS_POLL_CPU PollCpu,
+    _In_ PNDIS_POLL_QUEUE Q
+    )
+{
+    FNDIS_POLL_COUNTERS *Counters = &PollCpu->Counters;
+    UINT32 RxCompleted;
+    UINT32 TxCompleted;
+    UINT32 Work;
+    ULONG Bucket = 0;
+    BOOLEAN MoreData;
+
+    MoreData =
+        NdisPollInvokePollEx(
+            Q, PollCpuConfig.RxQuota, PollCpuConfig.TxQuota, &RxCompleted, &TxCompleted);
+
+    Work = RxCompleted + TxCompleted;
+    if (Work > 0) {
+        _BitScanReverse(&Bucket, Work);
+        Bucket = min(Bucket + 1, FNDIS_POLL_WORK_BUCKETS - 1);
+    }
+
+    Counters->Polls++;
+    Counters->RxFrames += RxCompleted;
+    Counters->TxFrames += TxCompleted;
+    Counters->WorkPerPoll[Bucket]++;
+
+    return MoreData;
 }
 
 _IRQL_requires_(DISPATCH_LEVEL)
@@ -200,15 +304,19 @@ NdisPollCpu(
     PLIST_ENTRY Entry;
     LARGE_INTEGER CurrentTick;
     ULONG Iteration = 0;
+    BOOLEAN NeedPoll;
 
     //
     // The main poll loop.
     //
 
+    PollCpu->Counters.PollPasses++;
+
     KeQueryTickCount(&CurrentTick);
     if (PollCpu->LastYieldTick < CurrentTick.QuadPart) {
         PollCpu->LastYieldTick = CurrentTick.QuadPart;
         if (KeShouldYieldProcessor()) {
+            PollCpu->Counters.Yields++;
             IoQueueWorkItem(
                 PollCpu->WorkItem, NdisPollCpuPassiveWorker,
                 CustomPriorityWorkQueue + PASSIVE_THREAD_PRIORITY, PollCpu);
@@ -227,13 +335,24 @@ NdisPollCpu(
 
             ASSERT(InterlockedOr(&Ec->Armed, 0) == FALSE);
 
+            if (InterlockedCompareExchange(&Ec->InPoll, TRUE, FALSE) != FALSE) {
+                //
+                // An inline poll raced the notification; poll the queue again
+                // once the inline poll completes.
+                //
+                PollCpu->MoreData = TRUE;
+                continue;
+            }
+
             if (ReadBooleanAcquire(&Ec->NeedCleanup)) {
                 RemoveEntryList(&Ec->Link);
+                InterlockedExchange(&Ec->InPoll, FALSE);
                 KeSetEvent(Ec->CleanupComplete, 0, FALSE);
                 continue;
             }
 
-            if (NdisPollInvokePoll(Q, RX_QUOTA, TX_QUOTA) || Q->BusyReferences > 0) {
+            if (NdisPollCpuInvokePoll(PollCpu, Q) || Q->BusyReferences > 0) {
+                InterlockedExchange(&Ec->InPoll, FALSE);
                 PollCpu->MoreData = TRUE;
                 continue;
             }
@@ -249,11 +368,15 @@ NdisPollCpu(
             NdisPollEnableInterrupt(Q);
 
             if (Ec->NeedCleanup) {
+                InterlockedExchange(&Ec->InPoll, FALSE);
                 NdisPollCpuNotify(Q);
                 continue;
             }
 
-            if (NdisPollInvokePoll(Q, RX_QUOTA, TX_QUOTA)) {
+            NeedPoll = NdisPollCpuInvokePoll(PollCpu, Q);
+            InterlockedExchange(&Ec->InPoll, FALSE);
+
+            if (NeedPoll) {
                 NdisPollCpuNotify(Q);
                 continue;
             }
@@ -272,6 +395,54 @@ NdisPollCpu(
     }
 }
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+NdisPollCpuTryInvokePoll(
+    _In_ PNDIS_POLL_QUEUE Q,
+    _In_ ULONG RxQuota,
+    _In_ ULONG TxQuota,
+    _Out_ UINT32 *RxCompleted,
+    _Out_ UINT32 *TxCompleted
+    )
+{
+    PNDIS_POLL_CPU_EC Ec = (PNDIS_POLL_CPU_EC)&Q->Reserved;
+    KIRQL OldIrql;
+    BOOLEAN NeedPoll;
+
+    //
+    // Poll inline only while the queue is idle, i.e. its notifications are
+    // armed so no poll is scheduled. The DPC re-checks the queue after
+    // re-arming it, so the queue's poll token must be acquired, too.
+    //
+    if (InterlockedCompareExchange(&Ec->InPoll, TRUE, FALSE) != FALSE) {
+        return FALSE;
+    }
+
+    if (!ReadAcquire(&Ec->Armed) || ReadBooleanAcquire(&Ec->NeedCleanup)) {
+        InterlockedExchange(&Ec->InPoll, FALSE);
+        return FALSE;
+    }
+
+    OldIrql = KeRaiseIrqlToDpcLevel();
+
+    NeedPoll = NdisPollInvokePollEx(Q, RxQuota, TxQuota, RxCompleted, TxCompleted);
+    InterlockedExchange(&Ec->InPoll, FALSE);
+
+    //
+    // Notifications remain armed, so the NIC requests a poll for new work. A
+    // poll that exhausted a quota likely left work behind, so leave that to
+    // the queue's regular poll.
+    //
+    if (NeedPoll &&
+        ((RxQuota > 0 && *RxCompleted >= RxQuota) || (TxQuota > 0 && *TxCompleted >= TxQuota))) {
+        NdisPollCpuNotify(Q);
+    }
+
+    KeLowerIrql(OldIrql);
+
+    return TRUE;
+}
+
 _Function_class_(KDEFERRED_ROUTINE)
 _IRQL_requires_max_(DISPATCH_LEVEL)
 _IRQL_requires_min_(DISPATCH_LEVEL)
@@ -311,6 +482,8 @@ NdisPollCpuInsert(
     Q->Notify = NdisPollCpuNotify;
 
     RtlZeroMemory(Ec, sizeof(*Ec));
+    Ec->OwningContext =
+        (UCHAR)((ULONG)InterlockedIncrement(&PollCpuNextContext) % PollCpuConfig.ContextsPerCpu);
     KeInitializeDpc(&Ec->CrossCpuDpc, NdisPollCrossCpuDpc, Q);
     KeSetImportanceDpc(&Ec->CrossCpuDpc, MediumHighImportance);
     KeGetProcessorNumberFromIndex(Ec->OwningCpu, &ProcessorNumber);
@@ -360,14 +533,92 @@ NdisPollCpuCleanup(
     KeWaitForSingleObject(&CleanupComplete, Executive, KernelMode, FALSE, NULL);
 }
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+NdisPollCpuGetCounters(
+    _Out_ FNDIS_POLL_COUNTERS *Counters
+    )
+{
+    RtlZeroMemory(Counters, sizeof(*Counters));
+
+    if (PollCpus == NULL) {
+        return;
+    }
+
+    //
+    // Each context's counters are updated by its processor without
+    // synchronization, so the sum is a best-effort snapshot.
+    //
+    for (ULONG Index = 0; Index < PollCpuCount; Index++) {
+        const FNDIS_POLL_COUNTERS *CpuCounters = &PollCpus[Index].Counters;
+
+        Counters->Notifications += ReadULong64NoFence(&CpuCounters->Notifications);
+        Counters->NotificationsWhilePolling +=
+            ReadULong64NoFence(&CpuCounters->NotificationsWhilePolling);
+        Counters->PollPasses += ReadULong64NoFence(&CpuCounters->PollPasses);
+        Counters->Yields += ReadULong64NoFence(&CpuCounters->Yields);
+        Counters->Polls += ReadULong64NoFence(&CpuCounters->Polls);
+        Counters->RxFrames += ReadULong64NoFence(&CpuCounters->RxFrames);
+        Counters->TxFrames += ReadULong64NoFence(&CpuCounters->TxFrames);
+
+        for (ULONG Bucket = 0; Bucket < FNDIS_POLL_WORK_BUCKETS; Bucket++) {
+            Counters->WorkPerPoll[Bucket] +=
+                ReadULong64NoFence(&CpuCounters->WorkPerPoll[Bucket]);
+        }
+    }
+}
+
+static
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+NdisPollCpuReadConfig(
+    _In_z_ const WCHAR *ParametersKey
+    )
+{
+    ULONG Value;
+
+    if (NT_SUCCESS(XdpRegQueryDwordValue(ParametersKey, L"PollRxQuota", &Value)) && Value > 0) {
+        PollCpuConfig.RxQuota = Value;
+    }
+
+    if (NT_SUCCESS(XdpRegQueryDwordValue(ParametersKey, L"PollTxQuota", &Value)) && Value > 0) {
+        PollCpuConfig.TxQuota = Value;
+    }
+
+    if (NT_SUCCESS(XdpRegQueryDwordValue(ParametersKey, L"PollIterationsInline", &Value)) &&
+        Value > 0) {
+        PollCpuConfig.IterationsInline = Value;
+    }
+
+    if (NT_SUCCESS(XdpRegQueryDwordValue(ParametersKey, L"PollIterationsPerDpc", &Value)) &&
+        Value > 0) {
+        PollCpuConfig.IterationsPerDpc = Value;
+    }
+
+    if (NT_SUCCESS(XdpRegQueryDwordValue(ParametersKey, L"PollContextsPerCpu", &Value)) &&
+        Value > 0 && Value <= MAX_CONTEXTS_PER_CPU) {
+        PollCpuConfig.ContextsPerCpu = Value;
+    }
+
+    if (NT_SUCCESS(XdpRegQueryDwordValue(ParametersKey, L"PollInterruptCoalesceUs", &Value)) &&
+        Value <= MAX_INTERRUPT_COALESCE_US) {
+        PollCpuConfig.InterruptCoalesceUs = Value;
+    }
+}
+
 NTSTATUS
 NdisPollCpuStart(
-    VOID
+    _In_z_ const WCHAR *ParametersKey
     )
 {
     NTSTATUS Status;
-    ULONG Count = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
-    SIZE_T AllocationSize = Count * sizeof(*PollCpus);
+    ULONG ProcessorCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    SIZE_T AllocationSize;
+
+    NdisPollCpuReadConfig(ParametersKey);
+
+    PollCpuCount = ProcessorCount * PollCpuConfig.ContextsPerCpu;
+    AllocationSize = PollCpuCount * sizeof(*PollCpus);
 
     PollCpus = ExAllocatePoolZero(NonPagedPoolNxCacheAligned, AllocationSize, POOLTAG_PERCPU);
     if (PollCpus == NULL) {
@@ -375,14 +626,18 @@ NdisPollCpuStart(
         goto Exit;
     }
 
-    for (ULONG Index = 0; Index < Count; Index++) {
+    for (ULONG Index = 0; Index < PollCpuCount; Index++) {
         PNDIS_POLL_CPU PollCpu = &PollCpus[Index];
         PROCESSOR_NUMBER ProcessorNumber;
 
         InitializeListHead(&PollCpu->Queues);
-        KeGetProcessorNumberFromIndex(Index, &ProcessorNumber);
+        PollCpu->ProcessorIndex = Index / PollCpuConfig.ContextsPerCpu;
+        KeGetProcessorNumberFromIndex(PollCpu->ProcessorIndex, &ProcessorNumber);
         KeInitializeDpc(&PollCpu->Dpc, NdisPollCpuDpc, PollCpu);
         KeSetTargetProcessorDpcEx(&PollCpu->Dpc, &ProcessorNumber);
+        KeInitializeTimer(&PollCpu->CoalesceTimer);
+        KeInitializeDpc(&PollCpu->CoalesceDpc, NdisPollCpuDpc, PollCpu);
+        KeSetTargetProcessorDpcEx(&PollCpu->CoalesceDpc, &ProcessorNumber);
 
         PollCpu->WorkItem = IoAllocateWorkItem(FndisDeviceObject);
         if (PollCpu->WorkItem == NULL) {
@@ -403,18 +658,17 @@ NdisPollCpuStop(
     VOID
     )
 {
-    ULONG Count = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
     ULONG ActiveCount = KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS);
 
     if (PollCpus != NULL) {
-        for (ULONG Index = 0; Index < Count; Index++) {
+        for (ULONG Index = 0; Index < PollCpuCount; Index++) {
             PNDIS_POLL_CPU PollCpu = &PollCpus[Index];
             KEVENT CleanupEvent;
             KIRQL OldIrql;
 
             if (PollCpu->WorkItem != NULL) {
 
-                if (Index < ActiveCount) {
+                if (PollCpu->ProcessorIndex < ActiveCount) {
                     PROCESSOR_NUMBER Number;
                     GROUP_AFFINITY Affinity = {0};
                     GROUP_AFFINITY OldAffinity = {0};
@@ -422,7 +676,7 @@ NdisPollCpuStop(
                     KeInitializeEvent(&CleanupEvent, NotificationEvent, FALSE);
                     WritePointerRelease(&PollCpu->CleanupComplete, &CleanupEvent);
 
-                    KeGetProcessorNumberFromIndex(Index, &Number);
+                    KeGetProcessorNumberFromIndex(PollCpu->ProcessorIndex, &Number);
                     Affinity.Group = Number.Group;
                     Affinity.Mask = 1ui64 << Number.Number;
                     KeSetSystemGroupAffinityThread(&Affinity, &OldAffinity);
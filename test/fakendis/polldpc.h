@@ -25,9 +25,25 @@ NdisPollCpuCleanup(
     _In_ PNDIS_POLL_QUEUE Q
     );
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+NdisPollCpuTryInvokePoll(
+    _In_ PNDIS_POLL_QUEUE Q,
+    _In_ ULONG RxQuota,
+    _In_ ULONG TxQuota,
+    _Out_ UINT32 *RxCompleted,
+    _Out_ UINT32 *TxCompleted
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+NdisPollCpuGetCounters(
+    _Out_ FNDIS_POLL_COUNTERS *Counters
+    );
+
 NTSTATUS
 NdisPollCpuStart(
-    VOID
+    _In_z_ const WCHAR *ParametersKey
     );
 
 VOID
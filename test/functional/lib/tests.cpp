@@ -60,8 +60,10 @@
 
 #include <bpf/bpf.h>
 #include <bpf/libbpf.h>
+#include <ebpf_api.h>
 
 #include "ebpf_nethooks.h"
+#include "xsknpitestioctl.h"
 #include "fnsock.h"
 #include "xdptest.h"
 #include "tests.h"
@@ -77,6 +79,10 @@
 #define FNMP1Q_IPV4_ADDRESS "192.168.201.1"
 #define FNMP1Q_IPV6_ADDRESS "fc00::201:1"
 
+#define XDPMP_IF_DESC "XDPMP"
+#define XDPMP_IPV4_ADDRESS "192.168.100.1"
+#define XDPMP_IPV6_ADDRESS "fc00::100:1"
+
 #define DEFAULT_UMEM_SIZE 65536
 #define DEFAULT_UMEM_CHUNK_SIZE 4096
 #define DEFAULT_UMEM_HEADROOM 0
@@ -139,6 +145,7 @@ template <typename T>
 using unique_malloc_ptr = wistd::unique_ptr<T, wil::function_deleter<decltype(&::free), ::free>>;
 using unique_xdp_api = wistd::unique_ptr<const XDP_API_TABLE, wil::function_deleter<decltype(&::XdpCloseApi), ::XdpCloseApi>>;
 using unique_bpf_object = wistd::unique_ptr<bpf_object, wil::function_deleter<decltype(&::bpf_object__close), ::bpf_object__close>>;
+using unique_bpf_link = wistd::unique_ptr<bpf_link, wil::function_deleter<decltype(&::bpf_link__destroy), ::bpf_link__destroy>>;
 using unique_fnmp_handle = wil::unique_any<FNMP_HANDLE, decltype(::FnMpClose), ::FnMpClose>;
 using unique_fnlwf_handle = wil::unique_any<FNLWF_HANDLE, decltype(::FnLwfClose), ::FnLwfClose>;
 using unique_fnmp_filter_handle = wil::unique_any<FNMP_HANDLE, decltype(::MpTxFilterReset), ::MpTxFilterReset>;
@@ -584,6 +591,7 @@ public:
 
 static TestInterface FnMpIf(FNMP_IF_DESC, FNMP_IPV4_ADDRESS, FNMP_IPV6_ADDRESS);
 static TestInterface FnMp1QIf(FNMP1Q_IF_DESC, FNMP1Q_IPV4_ADDRESS, FNMP1Q_IPV6_ADDRESS);
+static TestInterface XdpMpIf(XDPMP_IF_DESC, XDPMP_IPV4_ADDRESS, XDPMP_IPV6_ADDRESS);
 
 static
 HRESULT
@@ -920,6 +928,44 @@ NotifySocket(
     TEST_HRESULT(TryNotifySocket(Socket, Flags, WaitTimeoutMilliseconds, Result));
 }
 
+static
+HRESULT
+TryNotifySockets(
+    _Inout_updates_(SocketCount) XSK_NOTIFY_SOCKET_ENTRY *Sockets,
+    _In_ UINT32 SocketCount,
+    _In_ UINT32 WaitTimeoutMilliseconds,
+    _Out_ UINT32 *ReadyCount
+    )
+{
+    XSK_NOTIFY_SOCKETS_FN *XskNotifySockets =
+        (XSK_NOTIFY_SOCKETS_FN *)XdpApi->XdpGetRoutine(XSK_NOTIFY_SOCKETS_FN_NAME);
+
+    if (XskNotifySockets == NULL) {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    return XskNotifySockets(Sockets, SocketCount, WaitTimeoutMilliseconds, ReadyCount);
+}
+
+static
+HRESULT
+TrySockopts(
+    _In_ HANDLE Socket,
+    _Inout_updates_(OptionCount) XSK_SOCKOPT_ENTRY *Options,
+    _In_ UINT32 OptionCount,
+    _Out_ UINT32 *CompletedCount
+    )
+{
+    XSK_SOCKOPTS_FN *XskSockopts =
+        (XSK_SOCKOPTS_FN *)XdpApi->XdpGetRoutine(XSK_SOCKOPTS_FN_NAME);
+
+    if (XskSockopts == NULL) {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    return XskSockopts(Socket, Options, OptionCount, CompletedCount);
+}
+
 static
 HRESULT
 TryNotifyAsync(
@@ -1057,6 +1103,105 @@ RssGet(
     TEST_HRESULT(TryRssGet(InterfaceHandle, RssConfiguration, RssConfigurationSize));
 }
 
+static
+HRESULT
+TryRssSetQueueProcessor(
+    _In_ HANDLE InterfaceHandle,
+    _In_ HANDLE Socket,
+    _In_ const PROCESSOR_NUMBER *Processor
+    )
+{
+    XDP_RSS_SET_QUEUE_PROCESSOR_FN *XdpRssSetQueueProcessor =
+        (XDP_RSS_SET_QUEUE_PROCESSOR_FN *)
+            XdpApi->XdpGetRoutine(XDP_RSS_SET_QUEUE_PROCESSOR_FN_NAME);
+
+    if (XdpRssSetQueueProcessor == NULL) {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    return XdpRssSetQueueProcessor(InterfaceHandle, Socket, Processor);
+}
+
+static
+HRESULT
+TryTeamGetQueues(
+    _In_ UINT32 TeamIfIndex,
+    _Out_writes_opt_(*QueueCount) XDP_TEAM_QUEUE *Queues,
+    _Inout_ UINT32 *QueueCount
+    )
+{
+    XDP_TEAM_GET_QUEUES_FN *XdpTeamGetQueues =
+        (XDP_TEAM_GET_QUEUES_FN *)XdpApi->XdpGetRoutine(XDP_TEAM_GET_QUEUES_FN_NAME);
+
+    if (XdpTeamGetQueues == NULL) {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    return XdpTeamGetQueues(TeamIfIndex, Queues, QueueCount);
+}
+
+static
+HRESULT
+TryTeamCreateProgram(
+    _In_ UINT32 TeamIfIndex,
+    _In_ const XDP_HOOK_ID *HookId,
+    _In_ XDP_CREATE_PROGRAM_FLAGS Flags,
+    _In_reads_(RuleCount) const XDP_RULE *Rules,
+    _In_ UINT32 RuleCount,
+    _Out_writes_opt_(*ProgramCount) HANDLE *Programs,
+    _Inout_ UINT32 *ProgramCount
+    )
+{
+    XDP_TEAM_CREATE_PROGRAM_FN *XdpTeamCreateProgram =
+        (XDP_TEAM_CREATE_PROGRAM_FN *)XdpApi->XdpGetRoutine(XDP_TEAM_CREATE_PROGRAM_FN_NAME);
+
+    if (XdpTeamCreateProgram == NULL) {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    return
+        XdpTeamCreateProgram(
+            TeamIfIndex, HookId, Flags, Rules, RuleCount, Programs, ProgramCount);
+}
+
+static
+HRESULT
+TryPersistProgram(
+    _In_z_ const WCHAR *Name,
+    _In_ UINT32 IfIndex,
+    _In_ const XDP_HOOK_ID *HookId,
+    _In_ XDP_CREATE_PROGRAM_FLAGS Flags,
+    _In_reads_(RuleCount) const XDP_RULE *Rules,
+    _In_ UINT32 RuleCount
+    )
+{
+    XDP_PERSIST_PROGRAM_FN *XdpPersistProgram =
+        (XDP_PERSIST_PROGRAM_FN *)XdpApi->XdpGetRoutine(XDP_PERSIST_PROGRAM_FN_NAME);
+
+    if (XdpPersistProgram == NULL) {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    return XdpPersistProgram(Name, IfIndex, HookId, Flags, Rules, RuleCount);
+}
+
+static
+HRESULT
+TryDeletePersistedProgram(
+    _In_z_ const WCHAR *Name
+    )
+{
+    XDP_DELETE_PERSISTED_PROGRAM_FN *XdpDeletePersistedProgram =
+        (XDP_DELETE_PERSISTED_PROGRAM_FN *)
+            XdpApi->XdpGetRoutine(XDP_DELETE_PERSISTED_PROGRAM_FN_NAME);
+
+    if (XdpDeletePersistedProgram == NULL) {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    return XdpDeletePersistedProgram(Name);
+}
+
 static
 HRESULT
 TryQeoSet(
@@ -1074,6 +1219,132 @@ TryQeoSet(
     return XdpQeoSet(InterfaceHandle, QuicConnections, QuicConnectionsSize);
 }
 
+static
+HRESULT
+TryFlowSteeringSet(
+    _In_ HANDLE InterfaceHandle,
+    _Inout_ XDP_FLOW_STEERING_FILTER *FlowSteeringFilters,
+    _In_ UINT32 FlowSteeringFiltersSize
+    )
+{
+    XDP_FLOW_STEERING_SET_FN *XdpFlowSteeringSet =
+        (XDP_FLOW_STEERING_SET_FN *)XdpApi->XdpGetRoutine(XDP_FLOW_STEERING_SET_FN_NAME);
+
+    if (XdpFlowSteeringSet == NULL) {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    return XdpFlowSteeringSet(InterfaceHandle, FlowSteeringFilters, FlowSteeringFiltersSize);
+}
+
+static
+HRESULT
+TryFlowSteeringGet(
+    _In_ HANDLE InterfaceHandle,
+    _Out_opt_ XDP_FLOW_STEERING_FILTER *FlowSteeringFilters,
+    _Inout_ UINT32 *FlowSteeringFiltersSize
+    )
+{
+    XDP_FLOW_STEERING_GET_FN *XdpFlowSteeringGet =
+        (XDP_FLOW_STEERING_GET_FN *)XdpApi->XdpGetRoutine(XDP_FLOW_STEERING_GET_FN_NAME);
+
+    if (XdpFlowSteeringGet == NULL) {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    return XdpFlowSteeringGet(InterfaceHandle, FlowSteeringFilters, FlowSteeringFiltersSize);
+}
+
+static
+HRESULT
+TryProgramUpdateRules(
+    _In_ HANDLE ProgramHandle,
+    _In_ UINT32 RuleIndex,
+    _In_ UINT32 DeleteRuleCount,
+    _In_opt_ const XDP_RULE *Rules,
+    _In_ UINT32 InsertRuleCount
+    )
+{
+    XDP_PROGRAM_UPDATE_RULES_FN *XdpProgramUpdateRules =
+        (XDP_PROGRAM_UPDATE_RULES_FN *)XdpApi->XdpGetRoutine(XDP_PROGRAM_UPDATE_RULES_FN_NAME);
+
+    if (XdpProgramUpdateRules == NULL) {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    return
+        XdpProgramUpdateRules(ProgramHandle, RuleIndex, DeleteRuleCount, Rules, InsertRuleCount);
+}
+
+static
+VOID
+ProgramUpdateRules(
+    _In_ HANDLE ProgramHandle,
+    _In_ UINT32 RuleIndex,
+    _In_ UINT32 DeleteRuleCount,
+    _In_opt_ const XDP_RULE *Rules,
+    _In_ UINT32 InsertRuleCount
+    )
+{
+    TEST_HRESULT(
+        TryProgramUpdateRules(ProgramHandle, RuleIndex, DeleteRuleCount, Rules, InsertRuleCount));
+}
+
+static
+HRESULT
+TryProgramGetRuleCounters(
+    _In_ HANDLE ProgramHandle,
+    _Out_opt_ XDP_RULE_COUNTERS *RuleCounters,
+    _Inout_ UINT32 *RuleCountersSize
+    )
+{
+    XDP_PROGRAM_GET_RULE_COUNTERS_FN *XdpProgramGetRuleCounters =
+        (XDP_PROGRAM_GET_RULE_COUNTERS_FN *)
+            XdpApi->XdpGetRoutine(XDP_PROGRAM_GET_RULE_COUNTERS_FN_NAME);
+
+    if (XdpProgramGetRuleCounters == NULL) {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    return XdpProgramGetRuleCounters(ProgramHandle, RuleCounters, RuleCountersSize);
+}
+
+static
+HRESULT
+TryFlightRecorderGet(
+    _In_ HANDLE InterfaceHandle,
+    _Out_opt_ XDP_FLIGHT_RECORD *FlightRecords,
+    _Inout_ UINT32 *FlightRecordsSize
+    )
+{
+    XDP_FLIGHT_RECORDER_GET_FN *XdpFlightRecorderGet =
+        (XDP_FLIGHT_RECORDER_GET_FN *)XdpApi->XdpGetRoutine(XDP_FLIGHT_RECORDER_GET_FN_NAME);
+
+    if (XdpFlightRecorderGet == NULL) {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    return XdpFlightRecorderGet(InterfaceHandle, FlightRecords, FlightRecordsSize);
+}
+
+static
+HRESULT
+TryInterfaceSetTuning(
+    _In_ HANDLE InterfaceHandle,
+    _In_reads_(SettingCount) const XDP_TUNING_SETTING *Settings,
+    _In_ UINT32 SettingCount
+    )
+{
+    XDP_INTERFACE_SET_TUNING_FN *XdpInterfaceSetTuning =
+        (XDP_INTERFACE_SET_TUNING_FN *)XdpApi->XdpGetRoutine(XDP_INTERFACE_SET_TUNING_FN_NAME);
+
+    if (XdpInterfaceSetTuning == NULL) {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    return XdpInterfaceSetTuning(InterfaceHandle, Settings, SettingCount);
+}
+
 static
 HRESULT
 TryCreateXdpProg(
@@ -1369,7 +1640,7 @@ SocketProduceRxFill(
 {
     UINT32 ProducerIndex;
     TEST_EQUAL(Count, XskRingProducerReserve(&Socket->Rings.Fill, Count, &ProducerIndex));
-    while (Count-- > 0) {
+    for (UINT32 Index = 0; Index < Count; Index++) {
         *SocketGetRxFillDesc(Socket, ProducerIndex++) = SocketFreePop(Socket);
     }
     XskRingProducerSubmit(&Socket->Rings.Fill, Count);
@@ -1626,17 +1897,19 @@ MpTxGetFrame(
     _In_ const unique_fnmp_handle &Handle,
     _In_ UINT32 Index,
     _Inout_ UINT32 *FrameBufferLength,
-    _Out_opt_ DATA_FRAME *Frame
+    _Out_opt_ DATA_FRAME *Frame,
+    _In_ UINT32 SubIndex = 0
     )
 {
-    return FnMpTxGetFrame(Handle.get(), Index, 0, FrameBufferLength, Frame);
+    return FnMpTxGetFrame(Handle.get(), Index, SubIndex, FrameBufferLength, Frame);
 }
 
 static
 unique_malloc_ptr<DATA_FRAME>
 MpTxAllocateAndGetFrame(
     _In_ const unique_fnmp_handle &Handle,
-    _In_ UINT32 Index
+    _In_ UINT32 Index,
+    _In_ UINT32 SubIndex = 0
     )
 {
     unique_malloc_ptr<DATA_FRAME> FrameBuffer;
@@ -1648,7 +1921,7 @@ MpTxAllocateAndGetFrame(
     // Poll FNMP for TX: the driver doesn't support overlapped IO.
     //
     do {
-        Result = MpTxGetFrame(Handle, Index, &FrameLength, NULL);
+        Result = MpTxGetFrame(Handle, Index, &FrameLength, NULL, SubIndex);
         if (Result != HRESULT_FROM_WIN32(ERROR_NOT_FOUND)) {
             break;
         }
@@ -1659,7 +1932,7 @@ MpTxAllocateAndGetFrame(
     FrameBuffer.reset((DATA_FRAME *)malloc(FrameLength));
     TEST_TRUE(FrameBuffer != NULL);
 
-    TEST_HRESULT(MpTxGetFrame(Handle, Index, &FrameLength, FrameBuffer.get()));
+    TEST_HRESULT(MpTxGetFrame(Handle, Index, &FrameLength, FrameBuffer.get(), SubIndex));
 
     return FrameBuffer;
 }
@@ -2476,6 +2749,57 @@ GenericBindingResetAdapter()
     BindingTest(FnMpIf, TRUE);
 }
 
+VOID
+GenericBindingIfIndexAlias()
+{
+    const TestInterface *Interfaces[] = { &FnMpIf, &FnMp1QIf };
+
+    //
+    // XDP indexes interfaces by the low bits of their IfIndex, so indices a
+    // multiple of this apart share a lookup bucket.
+    //
+    const UINT32 IfIndexBucketCount = 64;
+
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_ALL;
+    Rule.Action = XDP_PROGRAM_ACTION_PASS;
+
+    for (UINT32 i = 0; i < RTL_NUMBER_OF(Interfaces); i++) {
+        const TestInterface *If = Interfaces[i];
+
+        auto InterfaceHandle = InterfaceOpen(If->GetIfIndex());
+        wil::unique_handle ProgramHandle =
+            CreateXdpProg(
+                If->GetIfIndex(), &XdpInspectRxL2, If->GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+        //
+        // Verify interface indices sharing the interface's bucket do not
+        // resolve to it.
+        //
+        for (UINT32 Alias = 1; Alias <= 4; Alias++) {
+            NET_IFINDEX AliasIfIndex = If->GetIfIndex() + Alias * IfIndexBucketCount;
+            MIB_IF_ROW2 IfRow = {0};
+
+            IfRow.InterfaceIndex = AliasIfIndex;
+            if (GetIfEntry2(&IfRow) == NO_ERROR) {
+                continue;
+            }
+
+            wil::unique_handle AliasInterfaceHandle;
+            TEST_EQUAL(
+                HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+                TryInterfaceOpen(AliasIfIndex, AliasInterfaceHandle));
+
+            wil::unique_handle AliasProgramHandle;
+            TEST_EQUAL(
+                HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+                TryCreateXdpProg(
+                    AliasProgramHandle, AliasIfIndex, &XdpInspectRxL2, If->GetQueueId(),
+                    XDP_GENERIC, &Rule, 1));
+        }
+    }
+}
+
 VOID
 GenericRxNoPoke()
 {
@@ -2543,1122 +2867,1237 @@ GenericRxSingleFrame()
 }
 
 VOID
-GenericRxBackfillAndTrailer()
+GenericRxMultiBuffer()
 {
-    auto Socket = SetupSocket(FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
-    auto GenericMp = MpOpenGeneric(FnMpIf.GetIfIndex());
+    auto If = FnMpIf;
+    MY_SOCKET Socket;
+    BOOLEAN MultiBuffer = TRUE;
+    UINT32 OptionLength = sizeof(MultiBuffer);
+    const UINT32 FrameLength = 2 * DEFAULT_UMEM_CHUNK_SIZE + 808;
 
-    DATA_BUFFER Buffer = {0};
-    const UCHAR BufferVa[] = "GenericRxBackfillAndTrailer";
+    Socket.Handle = CreateSocket();
+    XskSetupPreBind(&Socket, TRUE, FALSE);
+    SetSockopt(
+        Socket.Handle.get(), XSK_SOCKOPT_RX_MULTI_BUFFER, &MultiBuffer, sizeof(MultiBuffer));
+
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Socket.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Socket.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    XskSetupPostBind(&Socket, TRUE, FALSE);
+
+    MultiBuffer = FALSE;
+    GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_RX_MULTI_BUFFER, &MultiBuffer, &OptionLength);
+    TEST_EQUAL(sizeof(MultiBuffer), OptionLength);
+    TEST_TRUE(MultiBuffer);
+
+    auto ProgramHandle =
+        SocketAttachRxProgram(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Socket.Handle.get());
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
 
     //
-    // Build one NBL and enqueue it in the functional miniport.
+    // Indicate a frame larger than two UMEM chunks, split across two buffers
+    // that do not align with the chunk boundaries.
     //
-    Buffer.DataOffset = 3;
-    Buffer.DataLength = 5;
-    Buffer.BufferLength = sizeof(BufferVa);
-    Buffer.VirtualAddress = BufferVa;
+    std::vector<UCHAR> FrameBuffer(FrameLength);
+    std::generate(FrameBuffer.begin(), FrameBuffer.end(), []{ return (UCHAR)std::rand(); });
+
+    DATA_BUFFER Buffers[2] = {};
+    Buffers[0].DataLength = DEFAULT_UMEM_CHUNK_SIZE + 1000;
+    Buffers[0].BufferLength = Buffers[0].DataLength;
+    Buffers[0].VirtualAddress = &FrameBuffer[0];
+    Buffers[1].DataLength = FrameLength - Buffers[0].DataLength;
+    Buffers[1].BufferLength = Buffers[1].DataLength;
+    Buffers[1].VirtualAddress = &FrameBuffer[Buffers[0].DataLength];
+
+    SocketProduceRxFill(&Socket, 3);
 
     RX_FRAME Frame;
-    RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), &Buffer);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), Buffers, RTL_NUMBER_OF(Buffers));
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
     //
-    // Produce one XSK fill descriptor.
+    // Verify the frame spans three descriptors, all but the last marked as
+    // continued.
     //
-    SocketProduceRxFill(&Socket, 1);
-    TEST_HRESULT(TryMpRxFlush(GenericMp));
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 3);
+    UINT32 Offset = 0;
 
-    UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    for (UINT32 Index = 0; Index < 3; Index++) {
+        auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex++);
+        UINT32 ExpectedLength = min(FrameLength - Offset, DEFAULT_UMEM_CHUNK_SIZE);
+
+        TEST_EQUAL(ExpectedLength, RxDesc->Length);
+        TEST_EQUAL(Index < 2 ? XSK_BUFFER_FLAG_CONTINUATION : 0, RxDesc->Reserved);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+                &FrameBuffer[Offset], ExpectedLength));
+
+        Offset += ExpectedLength;
+    }
+
+    TEST_EQUAL(FrameLength, Offset);
+    XskRingConsumerRelease(&Socket.Rings.Rx, 3);
 
     //
-    // Verify the NBL propagated correctly to XSK.
+    // Verify a frame is dropped rather than truncated if the FILL ring lacks
+    // descriptors for the whole frame.
     //
-    TEST_EQUAL(1, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
-    auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
-    TEST_EQUAL(Buffer.DataLength, RxDesc->Length);
-    TEST_TRUE(
-        RtlEqualMemory(
-            Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
-            Buffer.VirtualAddress + Buffer.DataOffset,
-            Buffer.DataLength));
+    SocketProduceRxFill(&Socket, 2);
+    RxInitializeFrame(&Frame, If.GetQueueId(), Buffers, RTL_NUMBER_OF(Buffers));
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+    XSK_STATISTICS Stats;
+    do {
+        OptionLength = sizeof(Stats);
+        GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_STATISTICS, &Stats, &OptionLength);
+        if (Stats.RxDropped > 0) {
+            break;
+        }
+    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+
+    TEST_EQUAL(1, Stats.RxDropped);
+    TEST_EQUAL(0, Stats.RxTruncated);
+    TEST_EQUAL(0, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
 }
 
 VOID
-GenericRxAllQueueRedirect(
-    _In_ ADDRESS_FAMILY Af
-    )
+GenericRxHeaderSplit()
 {
     auto If = FnMpIf;
-    UINT16 LocalPort;
-    UINT16 RemotePort = htons(1234);
-    ETHERNET_ADDRESS LocalHw, RemoteHw;
-    INET_ADDR LocalIp, RemoteIp;
+    MY_SOCKET Socket;
+    BOOLEAN MultiBuffer = TRUE;
+    UINT32 HeaderLength = 64;
+    UINT32 OptionLength = sizeof(HeaderLength);
+    const UINT32 FrameLength = HeaderLength + DEFAULT_UMEM_CHUNK_SIZE + 100;
 
-    auto Socket = CreateUdpSocket(Af, &If, &LocalPort);
+    Socket.Handle = CreateSocket();
+    XskSetupPreBind(&Socket, TRUE, FALSE);
+    SetSockopt(
+        Socket.Handle.get(), XSK_SOCKOPT_RX_MULTI_BUFFER, &MultiBuffer, sizeof(MultiBuffer));
+    SetSockopt(
+        Socket.Handle.get(), XSK_SOCKOPT_RX_HEADER_SPLIT, &HeaderLength, sizeof(HeaderLength));
+
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Socket.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Socket.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    XskSetupPostBind(&Socket, TRUE, FALSE);
+
+    HeaderLength = 0;
+    GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_RX_HEADER_SPLIT, &HeaderLength, &OptionLength);
+    TEST_EQUAL(sizeof(HeaderLength), OptionLength);
+    TEST_EQUAL(64, HeaderLength);
+
+    auto ProgramHandle =
+        SocketAttachRxProgram(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Socket.Handle.get());
     auto GenericMp = MpOpenGeneric(If.GetIfIndex());
 
-    If.GetHwAddress(&LocalHw);
-    If.GetRemoteHwAddress(&RemoteHw);
-    if (Af == AF_INET) {
-        If.GetIpv4Address(&LocalIp.Ipv4);
-        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
-    } else {
-        If.GetIpv6Address(&LocalIp.Ipv6);
-        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
-    }
-
-    auto Xsk =
-        CreateAndBindSocket(
-            If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+    std::vector<UCHAR> FrameBuffer(FrameLength);
+    std::generate(FrameBuffer.begin(), FrameBuffer.end(), []{ return (UCHAR)std::rand(); });
 
-    XDP_RULE Rule;
-    Rule.Match = XDP_MATCH_UDP_DST;
-    Rule.Pattern.Port = LocalPort;
-    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
-    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
-    Rule.Redirect.Target = Xsk.Handle.get();
-
-    wil::unique_handle ProgramHandle =
-        CreateXdpProg(
-            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1,
-            XDP_CREATE_PROGRAM_FLAG_ALL_QUEUES);
+    DATA_BUFFER Buffer = {};
+    Buffer.DataLength = FrameLength;
+    Buffer.BufferLength = Buffer.DataLength;
+    Buffer.VirtualAddress = &FrameBuffer[0];
 
-    const UCHAR Payload[] = "GenericRxAllQueueRedirect";
-    UINT16 PayloadLength = sizeof(Payload);
-    UCHAR PacketBuffer[UDP_HEADER_STORAGE + sizeof(Payload)];
-    UINT32 PacketBufferLength = sizeof(PacketBuffer);
+    SocketProduceRxFill(&Socket, 3);
 
-    SocketProduceRxFill(&Xsk, 2);
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), &Buffer, 1);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
     //
-    // Indicate a packet on the wrong RX queue.
+    // Verify the headers arrive alone in the first descriptor, and the payload
+    // fills the following chunks from their start.
     //
-    RX_FRAME Frame;
-    TEST_TRUE(
-        PktBuildUdpFrame(
-            PacketBuffer, &PacketBufferLength, Payload, PayloadLength, &LocalHw,
-            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-    RxInitializeFrame(&Frame, If.GetQueueId() + 1, PacketBuffer, PacketBufferLength);
-    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 3);
+    UINT32 Offset = 0;
 
-    Sleep(TEST_TIMEOUT_ASYNC_MS * 2);
+    for (UINT32 Index = 0; Index < 3; Index++) {
+        auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex++);
+        UINT32 ExpectedLength =
+            (Index == 0) ? HeaderLength : min(FrameLength - Offset, DEFAULT_UMEM_CHUNK_SIZE);
 
-    UINT32 ConsumerIndex;
-    TEST_EQUAL(0, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+        TEST_EQUAL(ExpectedLength, RxDesc->Length);
+        TEST_EQUAL(Index < 2 ? XSK_BUFFER_FLAG_CONTINUATION : 0, RxDesc->Reserved);
+        if (Index > 0) {
+            TEST_EQUAL(0, RxDesc->Address.Offset);
+        }
+        TEST_TRUE(
+            RtlEqualMemory(
+                Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+                &FrameBuffer[Offset], ExpectedLength));
 
-    //
-    // Indicate a packet on the right RX queue.
-    //
-    TEST_TRUE(
-        PktBuildUdpFrame(
-            PacketBuffer, &PacketBufferLength, Payload, PayloadLength, &LocalHw,
-            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        Offset += ExpectedLength;
+    }
 
-    //
-    // Verify we get the packet that's indicated on the RX queue the rule's bound to.
-    //
-    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
-    TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
-    auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
-    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
-    TEST_TRUE(
-        RtlEqualMemory(
-            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
-            PacketBuffer,
-            PacketBufferLength));
+    TEST_EQUAL(FrameLength, Offset);
+    XskRingConsumerRelease(&Socket.Rings.Rx, 3);
 }
 
 VOID
-GenericRxTcpControl(
-    _In_ ADDRESS_FAMILY Af
-    )
+GenericRxCoalesce()
 {
-    auto If = FnMp1QIf;
-    UINT16 LocalPort = htons(4321);
-    UINT16 RemotePort = htons(1234);
-    ETHERNET_ADDRESS LocalHw, RemoteHw;
-    INET_ADDR LocalIp, RemoteIp;
+    auto If = FnMpIf;
+    MY_SOCKET Socket;
+    BOOLEAN Enable = TRUE;
+    UINT32 CoalesceLength = 16 * 1024;
+    UINT32 OptionLength = sizeof(CoalesceLength);
+    const UINT32 Headroom = sizeof(XSK_RX_METADATA);
+    const UINT32 SegmentCount = 3;
+    const UINT32 PayloadLength = 100;
 
-    WaitForWfpQuarantine(If);
+    Socket.Handle = CreateSocket();
 
+    Socket.Umem.Buffer = AllocUmemBuffer();
+    InitUmem(&Socket.Umem.Reg, Socket.Umem.Buffer.get());
+    Socket.Umem.Reg.Headroom = Headroom;
+    SetUmem(Socket.Handle.get(), &Socket.Umem.Reg);
+    SetFillRing(Socket.Handle.get());
+    SetCompletionRing(Socket.Handle.get());
+    SetRxRing(Socket.Handle.get());
+
+    SetSockopt(Socket.Handle.get(), XSK_SOCKOPT_RX_MULTI_BUFFER, &Enable, sizeof(Enable));
+    SetSockopt(Socket.Handle.get(), XSK_SOCKOPT_RX_METADATA, &Enable, sizeof(Enable));
+    SetSockopt(
+        Socket.Handle.get(), XSK_SOCKOPT_RX_COALESCE, &CoalesceLength, sizeof(CoalesceLength));
+
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Socket.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Socket.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    XskSetupPostBind(&Socket, TRUE, FALSE);
+
+    TEST_FALSE(
+        SUCCEEDED(
+            TrySetSockopt(
+                Socket.Handle.get(), XSK_SOCKOPT_RX_COALESCE, &CoalesceLength,
+                sizeof(CoalesceLength))));
+
+    CoalesceLength = 0;
+    GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_RX_COALESCE, &CoalesceLength, &OptionLength);
+    TEST_EQUAL(sizeof(CoalesceLength), OptionLength);
+    TEST_EQUAL(16 * 1024, CoalesceLength);
+
+    auto ProgramHandle =
+        SocketAttachRxProgram(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Socket.Handle.get());
     auto GenericMp = MpOpenGeneric(If.GetIfIndex());
 
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
     If.GetHwAddress(&LocalHw);
     If.GetRemoteHwAddress(&RemoteHw);
-    if (Af == AF_INET) {
-        If.GetIpv4Address(&LocalIp.Ipv4);
-        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
-    } else {
-        If.GetIpv6Address(&LocalIp.Ipv6);
-        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    std::vector<UCHAR> Payload(SegmentCount * PayloadLength);
+    std::generate(Payload.begin(), Payload.end(), []{ return (UCHAR)std::rand(); });
+
+    UCHAR Frames[SegmentCount][TCP_HEADER_STORAGE + PayloadLength];
+    UINT32 FrameLength = 0;
+    RX_FRAME RxFrames[SegmentCount];
+
+    //
+    // Enqueue consecutive in-order segments of a TCP flow, and indicate them
+    // to XDP in a single batch.
+    //
+    for (UINT32 Index = 0; Index < SegmentCount; Index++) {
+        FrameLength = sizeof(Frames[Index]);
+        TEST_TRUE(
+            PktBuildTcpFrame(
+                Frames[Index], &FrameLength, &Payload[Index * PayloadLength], PayloadLength,
+                NULL, 0, 1000 + Index * PayloadLength, 1, TH_ACK, 65535, &RemoteHw, &LocalHw,
+                AF_INET, &RemoteIp, &LocalIp, htons(1234), htons(4321)));
+        RxInitializeFrame(&RxFrames[Index], If.GetQueueId(), Frames[Index], FrameLength);
+        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &RxFrames[Index]));
     }
 
-    auto Xsk =
-        CreateAndBindSocket(
-            If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+    SocketProduceRxFill(&Socket, 1);
+    TEST_HRESULT(TryMpRxFlush(GenericMp));
 
-    XDP_RULE Rule;
-    Rule.Match = XDP_MATCH_TCP_CONTROL_DST;
-    Rule.Pattern.Port = LocalPort;
-    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
-    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
-    Rule.Redirect.Target = Xsk.Handle.get();
+    //
+    // Verify the segments arrive as one frame: the first segment, followed by
+    // the payloads of the others.
+    //
+    const UINT32 HeaderLength = FrameLength - PayloadLength;
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+    UCHAR *RxFrame =
+        Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset;
+    XSK_RX_METADATA Metadata;
 
-    wil::unique_handle ProgramHandle =
-        CreateXdpProg(
-            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+    TEST_EQUAL(HeaderLength + SegmentCount * PayloadLength, RxDesc->Length);
+    TEST_EQUAL(0, RxDesc->Reserved);
+    TEST_TRUE(RtlEqualMemory(RxFrame, Frames[0], HeaderLength));
+    TEST_TRUE(RtlEqualMemory(RxFrame + HeaderLength, &Payload[0], Payload.size()));
 
-    const UCHAR Payload[] = "GenericRxTcpControls";
-    UINT16 PayloadLength = sizeof(Payload);
-    UCHAR PacketBuffer[TCP_HEADER_STORAGE + sizeof(Payload)];
-    UINT32 PacketBufferLength = sizeof(PacketBuffer);
+    RtlCopyMemory(&Metadata, RxFrame - Headroom, sizeof(Metadata));
+    TEST_EQUAL(SegmentCount, Metadata.CoalescedSegmentCount);
+    TEST_EQUAL(XSK_RX_CHECKSUM_SUCCEEDED, Metadata.Layer4Checksum);
 
-    SocketProduceRxFill(&Xsk, 6);
+    XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+}
+
+VOID
+GenericXskRingIndexes()
+{
+    auto If = FnMpIf;
+    UCHAR BufferVa[] = "GenericXskRingIndexes#";
+    const UINT32 RoundCount = 4;
+    XSK_RING_INFO_SET InfoSet;
+
+    auto Socket = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
 
     //
-    // Indicate a packet without control flags.
+    // Each ring's producer index, consumer index and flags are written by
+    // different sides of the ring, so each lies on its own cache line.
     //
-    RX_FRAME Frame;
-    TEST_TRUE(
-        PktBuildTcpFrame(
-            PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
-            NULL, 0, 0, 1, TH_ACK, 65535,
-            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
-
-    Sleep(TEST_TIMEOUT_ASYNC_MS * 2);
+    GetRingInfo(Socket.Handle.get(), &InfoSet);
+    const XSK_RING_INFO *RingInfos[] = { &InfoSet.Fill, &InfoSet.Completion, &InfoSet.Rx };
+    for (UINT32 i = 0; i < RTL_NUMBER_OF(RingInfos); i++) {
+        const UINT32 Offsets[] = {
+            RingInfos[i]->ProducerIndexOffset,
+            RingInfos[i]->ConsumerIndexOffset,
+            RingInfos[i]->FlagsOffset,
+        };
 
-    UINT32 ConsumerIndex;
-    TEST_EQUAL(0, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+        for (UINT32 j = 0; j < RTL_NUMBER_OF(Offsets); j++) {
+            for (UINT32 k = j + 1; k < RTL_NUMBER_OF(Offsets); k++) {
+                TEST_TRUE(
+                    (Offsets[j] / SYSTEM_CACHE_ALIGNMENT_SIZE) !=
+                        (Offsets[k] / SYSTEM_CACHE_ALIGNMENT_SIZE));
+            }
+        }
+    }
 
     //
-    // Indicate a SYN packet.
+    // Fill and drain the entire rings several times. After the first round,
+    // both the application and the kernel hold stale cached views of the
+    // remote indexes, which must be refreshed to find the space and frames
+    // made available by the other side.
     //
-    TEST_TRUE(
-        PktBuildTcpFrame(
-            PacketBuffer, &PacketBufferLength, NULL, 0,
-            NULL, 0, 0, 1, TH_SYN, 65535,
-            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    for (UINT32 Round = 0; Round < RoundCount; Round++) {
+        SocketProduceRxFill(&Socket, DEFAULT_RING_SIZE);
 
-    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
-    TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
-    auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
-    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
-    TEST_TRUE(
-        RtlEqualMemory(
-            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
-            PacketBuffer,
-            PacketBufferLength));
-    XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
+        for (UINT32 Index = 0; Index < DEFAULT_RING_SIZE; Index++) {
+            RX_FRAME Frame;
+            BufferVa[sizeof(BufferVa) - 1] = (UCHAR)(Round * DEFAULT_RING_SIZE + Index);
+            RxInitializeFrame(&Frame, If.GetQueueId(), BufferVa, sizeof(BufferVa));
+            TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+        }
+
+        MpRxFlush(GenericMp);
+
+        UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, DEFAULT_RING_SIZE);
+        for (UINT32 Index = 0; Index < DEFAULT_RING_SIZE; Index++) {
+            auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex++);
+            UCHAR *RxFrame =
+                Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset;
+
+            TEST_EQUAL(sizeof(BufferVa), RxDesc->Length);
+            TEST_EQUAL((UCHAR)(Round * DEFAULT_RING_SIZE + Index), RxFrame[sizeof(BufferVa) - 1]);
+        }
+        XskRingConsumerRelease(&Socket.Rings.Rx, DEFAULT_RING_SIZE);
+    }
+}
+
+VOID
+GenericXskUmemAlignedChunks()
+{
+    auto If = FnMpIf;
+    MY_SOCKET Socket;
+    BOOLEAN Enable = TRUE;
+    UINT32 OptionLength = sizeof(Enable);
+    XSK_UMEM_REG UmemReg;
+
+    Socket.Handle = CreateSocket();
+    Socket.Umem.Buffer = AllocUmemBuffer();
+    SetSockopt(Socket.Handle.get(), XSK_SOCKOPT_UMEM_ALIGNED_CHUNKS, &Enable, sizeof(Enable));
 
     //
-    // Indicate a SYN+ACK packet.
+    // Aligned chunks require a power-of-two chunk size.
     //
-    TEST_TRUE(
-        PktBuildTcpFrame(
-            PacketBuffer, &PacketBufferLength, NULL, 0,
-            NULL, 0, 0, 1, TH_SYN | TH_ACK, 65535,
-            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    InitUmem(&UmemReg, Socket.Umem.Buffer.get());
+    UmemReg.ChunkSize = DEFAULT_UMEM_CHUNK_SIZE - 1;
+    TEST_FALSE(
+        SUCCEEDED(
+            TrySetSockopt(Socket.Handle.get(), XSK_SOCKOPT_UMEM_REG, &UmemReg, sizeof(UmemReg))));
 
-    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
-    TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
-    RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
-    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
-    TEST_TRUE(
-        RtlEqualMemory(
-            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
-            PacketBuffer,
-            PacketBufferLength));
-    XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
+    XskSetupPreBind(&Socket, TRUE, FALSE);
 
     //
-    // Indicate a FIN packet.
+    // The mode cannot change once the UMEM is registered.
     //
-    TEST_TRUE(
-        PktBuildTcpFrame(
-            PacketBuffer, &PacketBufferLength, NULL, 0,
-            NULL, 0, 0, 1, TH_FIN, 65535,
-            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_FALSE(
+        SUCCEEDED(
+            TrySetSockopt(
+                Socket.Handle.get(), XSK_SOCKOPT_UMEM_ALIGNED_CHUNKS, &Enable, sizeof(Enable))));
 
-    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
-    TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
-    RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
-    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
-    TEST_TRUE(
-        RtlEqualMemory(
-            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
-            PacketBuffer,
-            PacketBufferLength));
-    XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
+    Enable = FALSE;
+    GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_UMEM_ALIGNED_CHUNKS, &Enable, &OptionLength);
+    TEST_EQUAL(sizeof(Enable), OptionLength);
+    TEST_TRUE(Enable);
+
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Socket.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Socket.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    XskSetupPostBind(&Socket, TRUE, FALSE);
+
+    auto ProgramHandle =
+        SocketAttachRxProgram(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Socket.Handle.get());
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    const UCHAR BufferVa[] = "GenericXskUmemAlignedChunks";
 
     //
-    // Indicate a FIN+ACK packet.
+    // Post a fill descriptor addressing the middle of a chunk, which refers to
+    // the whole chunk.
     //
-    TEST_TRUE(
-        PktBuildTcpFrame(
-            PacketBuffer, &PacketBufferLength, NULL, 0,
-            NULL, 0, 0, 1, TH_FIN | TH_ACK, 65535,
-            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+    UINT64 ChunkAddress = SocketFreePop(&Socket);
+    UINT32 ProducerIndex;
+    TEST_EQUAL(1, XskRingProducerReserve(&Socket.Rings.Fill, 1, &ProducerIndex));
+    *SocketGetRxFillDesc(&Socket, ProducerIndex) = ChunkAddress + DEFAULT_UMEM_CHUNK_SIZE / 2;
+    XskRingProducerSubmit(&Socket.Rings.Fill, 1);
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), BufferVa, sizeof(BufferVa));
     TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
-    TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
-    RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
-    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+    TEST_EQUAL(ChunkAddress, RxDesc->Address.BaseAddress);
+    TEST_EQUAL(DEFAULT_UMEM_HEADROOM, RxDesc->Address.Offset);
+    TEST_EQUAL(sizeof(BufferVa), RxDesc->Length);
     TEST_TRUE(
         RtlEqualMemory(
-            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
-            PacketBuffer,
-            PacketBufferLength));
-    XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
+            Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            BufferVa, sizeof(BufferVa)));
+}
+
+VOID
+GenericXskRxNonTemporalCopy()
+{
+    auto If = FnMpIf;
+    auto Socket = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    UINT32 NonTemporalCopyLength = 256;
+    UINT32 OptionLength = sizeof(NonTemporalCopyLength);
 
     //
-    // Indicate a RST packet.
+    // The option may be set on an active socket.
     //
-    TEST_TRUE(
-        PktBuildTcpFrame(
-            PacketBuffer, &PacketBufferLength, NULL, 0,
-            NULL, 0, 0, 1, TH_RST, 65535,
-            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    SetSockopt(
+        Socket.Handle.get(), XSK_SOCKOPT_RX_NONTEMPORAL_COPY, &NonTemporalCopyLength,
+        sizeof(NonTemporalCopyLength));
 
-    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
-    TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
-    RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
-    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
-    TEST_TRUE(
-        RtlEqualMemory(
-            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
-            PacketBuffer,
-            PacketBufferLength));
-    XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
+    NonTemporalCopyLength = 0;
+    GetSockopt(
+        Socket.Handle.get(), XSK_SOCKOPT_RX_NONTEMPORAL_COPY, &NonTemporalCopyLength,
+        &OptionLength);
+    TEST_EQUAL(sizeof(NonTemporalCopyLength), OptionLength);
+    TEST_EQUAL(256, NonTemporalCopyLength);
 
     //
-    // Indicate a RST+ACK packet.
+    // Verify frames shorter and longer than the non-temporal copy length, with
+    // lengths that are not multiples of the streaming store size, arrive intact.
     //
-    TEST_TRUE(
-        PktBuildTcpFrame(
-            PacketBuffer, &PacketBufferLength, NULL, 0,
-            NULL, 0, 0, 1, TH_RST | TH_ACK, 65535,
-            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    for (UINT32 FrameLength : {37u, 1021u}) {
+        std::vector<UCHAR> FrameData(FrameLength);
+        std::generate(FrameData.begin(), FrameData.end(), []{ return (UCHAR)std::rand(); });
 
-    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
-    TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
-    RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
-    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
-    TEST_TRUE(
-        RtlEqualMemory(
-            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
-            PacketBuffer,
-            PacketBufferLength));
-    XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
+        SocketProduceRxFill(&Socket, 1);
+
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), &FrameData[0], FrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+        auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+        TEST_EQUAL(FrameLength, RxDesc->Length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+                &FrameData[0], FrameLength));
+        XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+    }
 }
 
 VOID
-GenericRxMatch(
-    _In_ ADDRESS_FAMILY Af,
-    _In_ XDP_MATCH_TYPE MatchType,
-    _In_ BOOLEAN IsUdp
-    )
+GenericXskNotifyModeration()
 {
-    auto If = IsUdp ? FnMpIf : FnMp1QIf;
-    UINT16 LocalPort;
-    UINT16 RemotePort = htons(1234);
-    ETHERNET_ADDRESS LocalHw, RemoteHw;
-    INET_ADDR LocalIp, RemoteIp;
-    UINT32 AckNum = 0;
-    UINT32 SeqNum = 1;
-
-    auto Socket =
-        IsUdp ?
-            CreateUdpSocket(Af, &If, &LocalPort) :
-            CreateTcpSocket(Af, &If, &LocalPort, RemotePort, &AckNum);
+    auto If = FnMpIf;
+    auto Socket = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
     auto GenericMp = MpOpenGeneric(If.GetIfIndex());
-    wil::unique_handle ProgramHandle;
-    unique_malloc_ptr<UINT8> PortSet;
+    const UINT32 MaxDelayMs = 200;
+    const UINT32 WaitTimeoutMs = 5000;
+    XSK_NOTIFY_MODERATION Moderation = {0};
+    UINT32 OptionLength = sizeof(Moderation);
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    Stopwatch<std::chrono::milliseconds> Timer;
 
-    If.GetHwAddress(&LocalHw);
-    If.GetRemoteHwAddress(&RemoteHw);
-    if (Af == AF_INET) {
-        If.GetIpv4Address(&LocalIp.Ipv4);
-        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
-    } else {
-        If.GetIpv6Address(&LocalIp.Ipv6);
-        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
-    }
+    //
+    // Moderation requires a bounded delay.
+    //
+    Moderation.MinFrames = 4;
+    TEST_FALSE(
+        SUCCEEDED(
+            TrySetSockopt(
+                Socket.Handle.get(), XSK_SOCKOPT_NOTIFY_MODERATION, &Moderation,
+                sizeof(Moderation))));
+    Moderation.MaxDelayUs = 2 * 1000 * 1000;
+    TEST_FALSE(
+        SUCCEEDED(
+            TrySetSockopt(
+                Socket.Handle.get(), XSK_SOCKOPT_NOTIFY_MODERATION, &Moderation,
+                sizeof(Moderation))));
+
+    Moderation.MaxDelayUs = MaxDelayMs * 1000;
+    SetSockopt(
+        Socket.Handle.get(), XSK_SOCKOPT_NOTIFY_MODERATION, &Moderation, sizeof(Moderation));
+
+    RtlZeroMemory(&Moderation, sizeof(Moderation));
+    GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_NOTIFY_MODERATION, &Moderation, &OptionLength);
+    TEST_EQUAL(sizeof(Moderation), OptionLength);
+    TEST_EQUAL(4, Moderation.MinFrames);
+    TEST_EQUAL(MaxDelayMs * 1000, Moderation.MaxDelayUs);
+
+    UCHAR Payload[] = "GenericXskNotifyModeration";
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
 
-    const UCHAR GenericPayload[] = "GenericRxMatch";
-    const UCHAR QuicLongHdrPayload[40] = {
-        0x80, // IsLongHeader
-        0x01, 0x00, 0x00, 0x00, // Version
-        0x08, // DestCidLength
-        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // DestCid
-        0x08, // SrcCidLength
-        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // SrcCid
-        0x00  // The rest
-    };
-    const UCHAR QuicShortHdrPayload[20] = {
-        0x00, // IsLongHeader
-        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // DestCid
-        0x00 // The rest
-    };
-    const UCHAR CorrectQuicCid[] = {
-        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08
-    };
-    const UCHAR IncorrectQuicCid[] = {
-        0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x00
-    };
+    //
+    // A single frame does not satisfy the wait until the delay elapses.
+    //
+    SocketProduceRxFill(&Socket, 1);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-    CHAR RecvPayload[sizeof(QuicLongHdrPayload)];
-    UCHAR PacketBuffer[TCP_HEADER_STORAGE + sizeof(QuicLongHdrPayload)];
-    const UCHAR* Payload;
-    UINT16 PayloadLength;
-    if (MatchType == XDP_MATCH_QUIC_FLOW_SRC_CID ||
-        MatchType == XDP_MATCH_TCP_QUIC_FLOW_SRC_CID) {
-        Payload = QuicLongHdrPayload;
-        PayloadLength = sizeof(QuicLongHdrPayload);
-    } else if (MatchType == XDP_MATCH_QUIC_FLOW_DST_CID ||
-               MatchType == XDP_MATCH_TCP_QUIC_FLOW_DST_CID) {
-        Payload = QuicShortHdrPayload;
-        PayloadLength = sizeof(QuicShortHdrPayload);
-    } else {
-        Payload = GenericPayload;
-        PayloadLength = sizeof(GenericPayload);
-    }
+    Timer.Reset();
+    NotifySocket(Socket.Handle.get(), XSK_NOTIFY_FLAG_WAIT_RX, WaitTimeoutMs, &NotifyResult);
+    TEST_EQUAL(XSK_NOTIFY_RESULT_FLAG_RX_AVAILABLE, NotifyResult);
+    TEST_TRUE(Timer.Elapsed() < std::chrono::milliseconds(WaitTimeoutMs));
 
-    UINT32 PacketBufferLength = sizeof(PacketBuffer);
-    if (IsUdp) {
-        TEST_TRUE(
-            PktBuildUdpFrame(
-                PacketBuffer, &PacketBufferLength, Payload, PayloadLength, &LocalHw,
-                &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-    } else {
-        TEST_TRUE(
-            PktBuildTcpFrame(
-                PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
-                NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
-                &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    //
+    // Enough frames satisfy the wait immediately.
+    //
+    SocketProduceRxFill(&Socket, 3);
+    for (UINT32 Index = 0; Index < 3; Index++) {
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
     }
 
-    XDP_RULE Rule = {};
-    Rule.Match = MatchType;
-    if (MatchType == XDP_MATCH_UDP_DST ||
-        MatchType == XDP_MATCH_TCP_DST) {
-        Rule.Pattern.Port = LocalPort;
-    } else if (MatchType == XDP_MATCH_IPV4_UDP_TUPLE || MatchType == XDP_MATCH_IPV6_UDP_TUPLE) {
-        Rule.Pattern.Tuple.SourcePort = RemotePort;
-        Rule.Pattern.Tuple.DestinationPort = LocalPort;
-        memcpy(&Rule.Pattern.Tuple.SourceAddress, &RemoteIp, sizeof(INET_ADDR));
-        memcpy(&Rule.Pattern.Tuple.DestinationAddress, &LocalIp, sizeof(INET_ADDR));
-    } else if (MatchType == XDP_MATCH_QUIC_FLOW_SRC_CID ||
-               MatchType == XDP_MATCH_QUIC_FLOW_DST_CID ||
-               MatchType == XDP_MATCH_TCP_QUIC_FLOW_SRC_CID ||
-               MatchType == XDP_MATCH_TCP_QUIC_FLOW_DST_CID) {
-        Rule.Pattern.QuicFlow.UdpPort = LocalPort;
-        Rule.Pattern.QuicFlow.CidOffset = 2; // Some arbitrary offset.
-        Rule.Pattern.QuicFlow.CidLength = 4; // Some arbitrary length.
-        memcpy(
-            Rule.Pattern.QuicFlow.CidData,
-            CorrectQuicCid + Rule.Pattern.QuicFlow.CidOffset,
-            Rule.Pattern.QuicFlow.CidLength);
-    } else if (MatchType == XDP_MATCH_UDP_PORT_SET ||
-               MatchType == XDP_MATCH_IPV4_UDP_PORT_SET ||
-               MatchType == XDP_MATCH_IPV6_UDP_PORT_SET ||
-               MatchType == XDP_MATCH_IPV4_TCP_PORT_SET ||
-               MatchType == XDP_MATCH_IPV6_TCP_PORT_SET) {
-        PortSet.reset((UINT8 *)calloc(XDP_PORT_SET_BUFFER_SIZE, 1));
-        TEST_NOT_NULL(PortSet.get());
-
-        SetBit(PortSet.get(), LocalPort);
+    Timer.Reset();
+    NotifySocket(Socket.Handle.get(), XSK_NOTIFY_FLAG_WAIT_RX, WaitTimeoutMs, &NotifyResult);
+    TEST_EQUAL(XSK_NOTIFY_RESULT_FLAG_RX_AVAILABLE, NotifyResult);
+    TEST_TRUE(Timer.Elapsed() < std::chrono::milliseconds(MaxDelayMs));
+}
 
-        if (MatchType == XDP_MATCH_UDP_PORT_SET) {
-            Rule.Pattern.PortSet.PortSet = PortSet.get();
-        } else {
-            Rule.Pattern.IpPortSet.Address = *(XDP_INET_ADDR *)&LocalIp;
-            Rule.Pattern.IpPortSet.PortSet.PortSet = PortSet.get();
-        }
-    }
+VOID
+GenericXskWakeParameters()
+{
+    auto If = FnMpIf;
+    auto Socket = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    XSK_WAKE_PARAMETERS Parameters = {0};
+    UINT32 OptionLength = sizeof(Parameters);
 
     //
-    // Verify XDP pass action.
+    // Waiters are boosted by the network I/O increment by default.
     //
-    ProgramHandle.reset();
-    Rule.Action = XDP_PROGRAM_ACTION_PASS;
+    GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_WAKE_PARAMETERS, &Parameters, &OptionLength);
+    TEST_EQUAL(sizeof(Parameters), OptionLength);
+    TEST_EQUAL(2, Parameters.PriorityIncrement);
+    TEST_EQUAL(0, Parameters.Flags);
 
-    ProgramHandle =
-        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+    Parameters.PriorityIncrement = XSK_WAKE_MAX_PRIORITY_INCREMENT + 1;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TrySetSockopt(
+            Socket.Handle.get(), XSK_SOCKOPT_WAKE_PARAMETERS, &Parameters, sizeof(Parameters)));
 
-    RX_FRAME Frame;
-    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
-    TEST_EQUAL(PayloadLength, FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-    TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
-    SeqNum += PayloadLength;
+    Parameters.PriorityIncrement = XSK_WAKE_MAX_PRIORITY_INCREMENT;
+    Parameters.Flags = XSK_WAKE_FLAG_RX_PROCESSOR << 1;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TrySetSockopt(
+            Socket.Handle.get(), XSK_SOCKOPT_WAKE_PARAMETERS, &Parameters, sizeof(Parameters)));
 
-    //
-    // Verify XDP drop action.
-    //
-    ProgramHandle.reset();
-    Rule.Action = XDP_PROGRAM_ACTION_DROP;
+    Parameters.Flags = XSK_WAKE_FLAG_RX_PROCESSOR;
+    SetSockopt(
+        Socket.Handle.get(), XSK_SOCKOPT_WAKE_PARAMETERS, &Parameters, sizeof(Parameters));
 
-    ProgramHandle =
-        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+    RtlZeroMemory(&Parameters, sizeof(Parameters));
+    GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_WAKE_PARAMETERS, &Parameters, &OptionLength);
+    TEST_EQUAL(XSK_WAKE_MAX_PRIORITY_INCREMENT, Parameters.PriorityIncrement);
+    TEST_EQUAL(XSK_WAKE_FLAG_RX_PROCESSOR, Parameters.Flags);
 
-    if (!IsUdp) {
-        TEST_TRUE(
-            PktBuildTcpFrame(
-                PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
-                NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
-                &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-    }
-    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
-    TEST_TRUE(FAILED(FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
-    TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+    UCHAR Payload[] = "GenericXskWakeParameters";
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
 
     //
-    // Redirect action is implicitly covered by XSK tests.
+    // The first blocked wait is woken without a known RX processor; the second
+    // is restricted to the processor that signaled the first.
     //
+    for (UINT32 Index = 0; Index < 2; Index++) {
+        SocketProduceRxFill(&Socket, 1);
 
-    if (Rule.Match == XDP_MATCH_UDP_DST || Rule.Match == XDP_MATCH_TCP_DST) {
-        //
-        // Verify default action (when no rules match) is pass. Test only makes sense when
-        // specific port matching is enabled.
-        //
-        ProgramHandle.reset();
-        Rule.Pattern.Port = htons(ntohs(LocalPort) - 1);
-
-        ProgramHandle =
-            CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+        auto AsyncThread = std::async(
+            std::launch::async,
+            [&] {
+                XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+                HRESULT Result =
+                    TryNotifySocket(
+                        Socket.Handle.get(), XSK_NOTIFY_FLAG_WAIT_RX, TEST_TIMEOUT_ASYNC_MS,
+                        &NotifyResult);
+                return SUCCEEDED(Result) ? NotifyResult : XSK_NOTIFY_RESULT_FLAG_NONE;
+            }
+        );
 
-        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+        Sleep(POLL_INTERVAL_MS);
         TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
-        TEST_EQUAL(
-            PayloadLength,
-            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
-        SeqNum += PayloadLength;
-    } else if (Rule.Match == XDP_MATCH_IPV4_UDP_TUPLE || Rule.Match == XDP_MATCH_IPV6_UDP_TUPLE) {
-        //
-        // Verify source port matching.
-        //
-        ProgramHandle.reset();
-        Rule.Pattern.Tuple.SourcePort = htons(ntohs(RemotePort) - 1);
 
-        ProgramHandle =
-            CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+        TEST_EQUAL(AsyncThread.wait_for(TEST_TIMEOUT_ASYNC), std::future_status::ready);
+        TEST_EQUAL(XSK_NOTIFY_RESULT_FLAG_RX_AVAILABLE, AsyncThread.get());
 
-        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
-        TEST_EQUAL(
-            PayloadLength,
-            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
+        UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+        auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+        TEST_EQUAL(sizeof(Payload), RxDesc->Length);
+        XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+    }
+}
 
-        //
-        // Verify destination port matching.
-        //
-        ProgramHandle.reset();
-        Rule.Pattern.Tuple.SourcePort = RemotePort; // Revert previous test change
-        Rule.Pattern.Tuple.DestinationPort = htons(ntohs(LocalPort) - 1);
+VOID
+GenericXskRingConsumerWait()
+{
+#if defined(_M_X64) || defined(_M_IX86)
+    auto If = FnMpIf;
+    auto Socket = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    const UINT64 WaitTsc = 1000 * 1000;
+    XSK_RING_WAITER Waiter;
+    UINT32 ConsumerIndex;
 
-        ProgramHandle =
-            CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+    XskRingWaiterInitialize(&Waiter);
 
-        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
-        TEST_EQUAL(
-            PayloadLength,
-            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
+    //
+    // An idle ring times out.
+    //
+    TEST_EQUAL(0, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+    TEST_FALSE(XskRingConsumerWait(&Waiter, &Socket.Rings.Rx, WaitTsc));
 
-        //
-        // Verify source address matching.
-        //
-        ProgramHandle.reset();
-        Rule.Pattern.Tuple.DestinationPort = LocalPort; // Revert previous test change
-        (*((UCHAR*)&Rule.Pattern.Tuple.SourceAddress))++;
+    UCHAR Payload[] = "GenericXskRingConsumerWait";
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+    SocketProduceRxFill(&Socket, 1);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-        ProgramHandle =
-            CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+    while (!XskRingConsumerWait(&Waiter, &Socket.Rings.Rx, WaitTsc)) {
+        TEST_FALSE(Watchdog.IsExpired());
+    }
 
-        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
-        TEST_EQUAL(
-            PayloadLength,
-            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
+    TEST_EQUAL(1, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+    auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+    TEST_EQUAL(sizeof(Payload), RxDesc->Length);
+    XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+#else
+    TEST_WARNING("Test requires an x86 or x64 processor. Skipping.");
+#endif
+}
 
-        //
-        // Verify destination address matching.
-        //
-        ProgramHandle.reset();
-        (*((UCHAR*)&Rule.Pattern.Tuple.SourceAddress))--; // Revert previous test change
-        (*((UCHAR*)&Rule.Pattern.Tuple.DestinationAddress))++;
+VOID
+GenericXskTimestamps()
+{
+    auto If = FnMpIf;
+    MY_SOCKET Socket;
+    UINT32 Flags = XSK_TIMESTAMP_FLAG_RX | XSK_TIMESTAMP_FLAG_TX;
+    UINT32 OptionLength = sizeof(Flags);
+    const UINT32 Headroom = sizeof(UINT64);
 
-        ProgramHandle =
-            CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+    Socket.Handle = CreateSocket();
 
-        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
-        TEST_EQUAL(
-            PayloadLength,
-            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
-        SeqNum += PayloadLength;
-    } else if (Rule.Match == XDP_MATCH_QUIC_FLOW_SRC_CID ||
-               Rule.Match == XDP_MATCH_QUIC_FLOW_DST_CID ||
-               Rule.Match == XDP_MATCH_TCP_QUIC_FLOW_SRC_CID ||
-               Rule.Match == XDP_MATCH_TCP_QUIC_FLOW_DST_CID) {
-        //
-        // Verify other header QUIC packets don't match.
-        //
-        if (Rule.Match == XDP_MATCH_QUIC_FLOW_SRC_CID ||
-            Rule.Match == XDP_MATCH_TCP_QUIC_FLOW_SRC_CID) {
-            Payload = QuicShortHdrPayload;
-            PayloadLength = sizeof(QuicShortHdrPayload);
-        } else {
-            Payload = QuicLongHdrPayload;
-            PayloadLength = sizeof(QuicLongHdrPayload);
-        }
-        PacketBufferLength = sizeof(PacketBuffer);
-        if (IsUdp) {
-            TEST_TRUE(
-                PktBuildUdpFrame(
-                    PacketBuffer, &PacketBufferLength, Payload, PayloadLength, &LocalHw,
-                    &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-        } else {
-            TEST_TRUE(
-                PktBuildTcpFrame(
-                    PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
-                    NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
-                    &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-        }
+    //
+    // Timestamps require a registered UMEM.
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(Socket.Handle.get(), XSK_SOCKOPT_TIMESTAMPS, &Flags, sizeof(Flags)));
 
-        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
-        TEST_EQUAL(
-            PayloadLength,
-            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
-        SeqNum += PayloadLength;
+    Socket.Umem.Buffer = AllocUmemBuffer();
+    InitUmem(&Socket.Umem.Reg, Socket.Umem.Buffer.get());
+    Socket.Umem.Reg.Headroom = Headroom;
+    SetUmem(Socket.Handle.get(), &Socket.Umem.Reg);
+    SetFillRing(Socket.Handle.get());
+    SetCompletionRing(Socket.Handle.get());
+    SetRxRing(Socket.Handle.get());
 
-        //
-        // Revert UDP payload change from test above.
-        //
-        if (Rule.Match == XDP_MATCH_QUIC_FLOW_SRC_CID ||
-            Rule.Match == XDP_MATCH_TCP_QUIC_FLOW_SRC_CID) {
-            Payload = QuicLongHdrPayload;
-            PayloadLength = sizeof(QuicLongHdrPayload);
-        } else {
-            Payload = QuicShortHdrPayload;
-            PayloadLength = sizeof(QuicShortHdrPayload);
-        }
-        PacketBufferLength = sizeof(PacketBuffer);
-        if (IsUdp) {
-            TEST_TRUE(
-                PktBuildUdpFrame(
-                    PacketBuffer, &PacketBufferLength, Payload, PayloadLength, &LocalHw,
-                    &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-        } else {
-            TEST_TRUE(
-                PktBuildTcpFrame(
-                    PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
-                    NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
-                    &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-        }
+    UINT32 InvalidFlags = 0x80000000;
+    TEST_FALSE(
+        SUCCEEDED(
+            TrySetSockopt(
+                Socket.Handle.get(), XSK_SOCKOPT_TIMESTAMPS, &InvalidFlags,
+                sizeof(InvalidFlags))));
 
-        //
-        // Verify the CID matching part.
-        //
-        ProgramHandle.reset();
-        memcpy(
-            Rule.Pattern.QuicFlow.CidData,
-            IncorrectQuicCid + Rule.Pattern.QuicFlow.CidOffset,
-            Rule.Pattern.QuicFlow.CidLength);
+    SetSockopt(Socket.Handle.get(), XSK_SOCKOPT_TIMESTAMPS, &Flags, sizeof(Flags));
 
-        ProgramHandle =
-            CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Socket.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Socket.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    XskSetupPostBind(&Socket, TRUE, FALSE);
 
-        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
-        TEST_EQUAL(
-            PayloadLength,
-            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
-        SeqNum += PayloadLength;
+    //
+    // Generic XDP interfaces do not provide timestamps.
+    //
+    Flags = MAXUINT32;
+    GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_TIMESTAMPS, &Flags, &OptionLength);
+    TEST_EQUAL(sizeof(Flags), OptionLength);
+    TEST_EQUAL(0, Flags);
 
-        if (!IsUdp) {
-            TEST_TRUE(
-                PktBuildTcpFrame(
-                    PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
-                    NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
-                    &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-        }
+    auto ProgramHandle =
+        SocketAttachRxProgram(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Socket.Handle.get());
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    const UCHAR BufferVa[] = "GenericXskTimestamps";
 
-        //
-        // Verify the port matching part.
-        //
-        ProgramHandle.reset();
-        Rule.Pattern.QuicFlow.UdpPort = htons(ntohs(LocalPort) - 1);
-        memcpy(
-            Rule.Pattern.QuicFlow.CidData,
-            CorrectQuicCid + Rule.Pattern.QuicFlow.CidOffset,
-            Rule.Pattern.QuicFlow.CidLength);
+    //
+    // Verify the metadata preceding the frame is written even if the interface
+    // did not stamp the frame.
+    //
+    std::memset(Socket.Umem.Buffer.get(), 0xFF, Socket.Umem.Reg.TotalSize);
+    SocketProduceRxFill(&Socket, 1);
 
-        ProgramHandle =
-            CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), BufferVa, sizeof(BufferVa));
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
-        TEST_EQUAL(
-            PayloadLength,
-            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
-        SeqNum += PayloadLength;
-    } else if (MatchType == XDP_MATCH_UDP_PORT_SET ||
-               MatchType == XDP_MATCH_IPV4_UDP_PORT_SET ||
-               MatchType == XDP_MATCH_IPV6_UDP_PORT_SET ||
-               MatchType == XDP_MATCH_IPV4_TCP_PORT_SET ||
-               MatchType == XDP_MATCH_IPV6_TCP_PORT_SET) {
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+    UCHAR *RxFrame =
+        Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset;
+    UINT64 Timestamp;
+
+    TEST_EQUAL(Headroom, RxDesc->Address.Offset);
+    TEST_EQUAL(sizeof(BufferVa), RxDesc->Length);
+    TEST_TRUE(RtlEqualMemory(RxFrame, BufferVa, sizeof(BufferVa)));
+    RtlCopyMemory(&Timestamp, RxFrame - sizeof(Timestamp), sizeof(Timestamp));
+    TEST_EQUAL(0, Timestamp);
+}
 
-        //
-        // Verify destination port matching.
-        //
-        TEST_EQUAL(XDP_PROGRAM_ACTION_DROP, Rule.Action);
-        ClearBit(PortSet.get(), LocalPort);
+VOID
+GenericRxMetadata()
+{
+    auto If = FnMpIf;
+    MY_SOCKET Socket;
+    BOOLEAN Enable = TRUE;
+    UINT32 OptionLength = sizeof(Enable);
+    const UINT32 Headroom = sizeof(XSK_RX_METADATA) + sizeof(UINT64);
 
-        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
-        TEST_EQUAL(
-            PayloadLength,
-            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
-        SeqNum += PayloadLength;
+    Socket.Handle = CreateSocket();
 
-        if (!IsUdp) {
-            TEST_TRUE(
-                PktBuildTcpFrame(
-                    PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
-                    NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
-                    &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-        }
-        SetBit(PortSet.get(), LocalPort);
-        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
-        TEST_TRUE(FAILED(FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
-        TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+    Socket.Umem.Buffer = AllocUmemBuffer();
+    InitUmem(&Socket.Umem.Reg, Socket.Umem.Buffer.get());
+    Socket.Umem.Reg.Headroom = Headroom;
+    SetUmem(Socket.Handle.get(), &Socket.Umem.Reg);
+    SetFillRing(Socket.Handle.get());
+    SetCompletionRing(Socket.Handle.get());
+    SetRxRing(Socket.Handle.get());
 
-        if (MatchType == XDP_MATCH_IPV4_UDP_PORT_SET || MatchType == XDP_MATCH_IPV6_UDP_PORT_SET) {
-            //
-            // Verify destination address matching.
-            //
-            ProgramHandle.reset();
-            (*((UCHAR*)&Rule.Pattern.IpPortSet.Address))++;
+    //
+    // Enable both RX metadata and timestamps, which are laid out back-to-back
+    // in front of the frame data.
+    //
+    UINT32 TimestampFlags = XSK_TIMESTAMP_FLAG_RX;
+    SetSockopt(Socket.Handle.get(), XSK_SOCKOPT_RX_METADATA, &Enable, sizeof(Enable));
+    SetSockopt(
+        Socket.Handle.get(), XSK_SOCKOPT_TIMESTAMPS, &TimestampFlags, sizeof(TimestampFlags));
 
-            ProgramHandle =
-                CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Socket.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Socket.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    XskSetupPostBind(&Socket, TRUE, FALSE);
 
-            RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-            TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
-            TEST_EQUAL(
-                PayloadLength,
-                 FnSockRecv(
-                    Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-            TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
-            SeqNum += PayloadLength;
-        }
-    } else {
-        //
-        // TODO - Send and validate some non-UDP traffic.
-        //
-    }
+    TEST_FALSE(
+        SUCCEEDED(
+            TrySetSockopt(Socket.Handle.get(), XSK_SOCKOPT_RX_METADATA, &Enable, sizeof(Enable))));
+
+    //
+    // Generic XDP provides RX metadata from the NBL OOB information.
+    //
+    Enable = FALSE;
+    GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_RX_METADATA, &Enable, &OptionLength);
+    TEST_EQUAL(sizeof(Enable), OptionLength);
+    TEST_TRUE(Enable);
+
+    auto ProgramHandle =
+        SocketAttachRxProgram(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Socket.Handle.get());
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    const UCHAR BufferVa[] = "GenericRxMetadata";
+
+    std::memset(Socket.Umem.Buffer.get(), 0xFF, Socket.Umem.Reg.TotalSize);
+    SocketProduceRxFill(&Socket, 1);
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), BufferVa, sizeof(BufferVa));
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+    UCHAR *RxFrame =
+        Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset;
+    XSK_RX_METADATA Metadata;
+
+    TEST_EQUAL(Headroom, RxDesc->Address.Offset);
+    TEST_EQUAL(sizeof(BufferVa), RxDesc->Length);
+    TEST_TRUE(RtlEqualMemory(RxFrame, BufferVa, sizeof(BufferVa)));
+
+    //
+    // The test frame has no checksum offload information.
+    //
+    RtlCopyMemory(&Metadata, RxFrame - Headroom, sizeof(Metadata));
+    TEST_EQUAL(If.GetQueueId(), Metadata.QueueId);
+    TEST_EQUAL(XSK_RX_CHECKSUM_NOT_CHECKED, Metadata.Layer3Checksum);
+    TEST_EQUAL(XSK_RX_CHECKSUM_NOT_CHECKED, Metadata.Layer4Checksum);
+    TEST_EQUAL(0, Metadata.CoalescedSegmentCount);
 }
 
 VOID
-GenericRxMatchIpPrefix(
-    _In_ ADDRESS_FAMILY Af
-    )
+GenericXskPollParameters()
 {
     auto If = FnMpIf;
-    UINT16 LocalPort, RemotePort;
-    ETHERNET_ADDRESS LocalHw, RemoteHw;
-    XDP_INET_ADDR LocalIp, RemoteIp;
+    XSK_POLL_PARAMETERS Parameters = {0};
+    UINT32 OptionLength = sizeof(Parameters);
 
-    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    //
+    // Non-default poll modes require an activated socket.
+    //
+    {
+        auto UnboundSocket = CreateSocket();
+        Parameters.PollMode = XSK_POLL_MODE_BUSY;
+        TEST_EQUAL(
+            HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+            TrySetSockopt(
+                UnboundSocket.get(), XSK_SOCKOPT_POLL_MODE, &Parameters, sizeof(Parameters)));
+    }
+
+    auto Socket = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
     auto GenericMp = MpOpenGeneric(If.GetIfIndex());
-    wil::unique_handle ProgramHandle;
+    const UCHAR BufferVa[] = "GenericXskPollParameters";
 
-    RemotePort = htons(1234);
-    If.GetHwAddress(&LocalHw);
-    If.GetRemoteHwAddress(&RemoteHw);
-    if (Af == AF_INET) {
-        If.GetIpv4Address(&LocalIp.Ipv4);
-        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
-    } else {
-        If.GetIpv6Address(&LocalIp.Ipv6);
-        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
-    }
+    Parameters.PollMode = XSK_POLL_MODE_BUSY;
+    Parameters.Budget = 16;
+    Parameters.IdleTimeoutMs = 10;
+    SetSockopt(Socket.Handle.get(), XSK_SOCKOPT_POLL_MODE, &Parameters, sizeof(Parameters));
 
-    UCHAR UdpPayload[] = "GenericRxMatchIpPrefix";
-    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
-    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
-    UINT32 UdpFrameLength = sizeof(UdpFrame);
-    TEST_TRUE(
-        PktBuildUdpFrame(
-            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
-            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    RtlZeroMemory(&Parameters, sizeof(Parameters));
+    GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_POLL_MODE, &Parameters, &OptionLength);
+    TEST_EQUAL(sizeof(Parameters), OptionLength);
+    TEST_EQUAL(XSK_POLL_MODE_BUSY, Parameters.PollMode);
+    TEST_EQUAL(16, Parameters.Budget);
+    TEST_EQUAL(10, Parameters.IdleTimeoutMs);
 
-    XDP_RULE Rule;
+    //
+    // Wait for several idle intervals and verify frames are still received.
+    //
+    Sleep(Parameters.IdleTimeoutMs * 5);
+    SocketProduceRxFill(&Socket, 1);
 
-    if (Af == AF_INET) {
-        Rule.Match = XDP_MATCH_IPV4_DST_MASK;
-        TEST_EQUAL(1, inet_pton(Af, "255.192.0.0", &Rule.Pattern.IpMask.Mask));
-    } else {
-        Rule.Match = XDP_MATCH_IPV6_DST_MASK;
-        TEST_EQUAL(1, inet_pton(Af, "FC00::0", &Rule.Pattern.IpMask.Mask));
-    }
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), BufferVa, sizeof(BufferVa));
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-    Rule.Pattern.IpMask.Address = LocalIp;
-    ClearMaskedBits(&Rule.Pattern.IpMask.Address, &Rule.Pattern.IpMask.Mask, Af);
-    Rule.Action = XDP_PROGRAM_ACTION_DROP;
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+    TEST_EQUAL(sizeof(BufferVa), RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            BufferVa, sizeof(BufferVa)));
 
     //
-    // Verify IP prefix match.
+    // Setting a bare poll mode resets the remaining parameters.
     //
-    ProgramHandle =
-        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+    XSK_POLL_MODE PollMode = XSK_POLL_MODE_DEFAULT;
+    SetSockopt(Socket.Handle.get(), XSK_SOCKOPT_POLL_MODE, &PollMode, sizeof(PollMode));
 
-    RX_FRAME Frame;
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
-    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
-    TEST_TRUE(FAILED(FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
-    TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+    OptionLength = sizeof(Parameters);
+    GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_POLL_MODE, &Parameters, &OptionLength);
+    TEST_EQUAL(sizeof(Parameters), OptionLength);
+    TEST_EQUAL(XSK_POLL_MODE_DEFAULT, Parameters.PollMode);
+    TEST_EQUAL(0, Parameters.Budget);
+    TEST_EQUAL(0, Parameters.IdleTimeoutMs);
 
     //
-    // Verify IP prefix mismatch.
+    // Toggle between socket polling and notifications, including redundant
+    // transitions, and verify the socket still receives frames afterwards.
     //
-    ProgramHandle.reset();
-    *(UCHAR *)&Rule.Pattern.IpMask.Address ^= 0xFFu;
+    for (UINT32 Index = 0; Index < 16; Index++) {
+        PollMode = (Index & 2) ? XSK_POLL_MODE_SOCKET : XSK_POLL_MODE_DEFAULT;
+        SetSockopt(Socket.Handle.get(), XSK_SOCKOPT_POLL_MODE, &PollMode, sizeof(PollMode));
 
-    ProgramHandle =
-        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+        OptionLength = sizeof(Parameters);
+        GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_POLL_MODE, &Parameters, &OptionLength);
+        TEST_EQUAL(PollMode, Parameters.PollMode);
+    }
 
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    PollMode = XSK_POLL_MODE_DEFAULT;
+    SetSockopt(Socket.Handle.get(), XSK_SOCKOPT_POLL_MODE, &PollMode, sizeof(PollMode));
+
+    SocketProduceRxFill(&Socket, 1);
     TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
-    TEST_EQUAL(
-        sizeof(UdpPayload),
-        FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+    ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+    TEST_EQUAL(sizeof(BufferVa), RxDesc->Length);
 }
 
 VOID
-GenericRxLowResources()
+GenericXskPollModeInline()
 {
     auto If = FnMpIf;
-    ADDRESS_FAMILY Af = AF_INET6;
-    UINT16 LocalPort, LocalXskPort, RemotePort;
-    ETHERNET_ADDRESS LocalHw, RemoteHw;
-    INET_ADDR LocalIp, RemoteIp;
-
-    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
     auto GenericMp = MpOpenGeneric(If.GetIfIndex());
-    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+    XSK_POLL_PARAMETERS Parameters = {0};
+    UINT32 OptionLength = sizeof(Parameters);
 
-    LocalXskPort = htons(ntohs(LocalPort) + 1);
-    RemotePort = htons(1234);
-    If.GetHwAddress(&LocalHw);
-    If.GetRemoteHwAddress(&RemoteHw);
-    If.GetIpv6Address(&LocalIp.Ipv6);
-    If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    Parameters.PollMode = XSK_POLL_MODE_INLINE;
+    Parameters.Budget = 1;
+    SetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_POLL_MODE, &Parameters, sizeof(Parameters));
 
-    UCHAR UdpMatchPayload[] = "GenericRxLowResourcesMatch";
-    UCHAR UdpMatchFrame[UDP_HEADER_STORAGE + sizeof(UdpMatchPayload)];
-    UINT32 UdpMatchFrameLength = sizeof(UdpMatchFrame);
-    TEST_TRUE(
-        PktBuildUdpFrame(
-            UdpMatchFrame, &UdpMatchFrameLength, UdpMatchPayload, sizeof(UdpMatchPayload), &LocalHw,
-            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalXskPort, RemotePort));
+    RtlZeroMemory(&Parameters, sizeof(Parameters));
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_POLL_MODE, &Parameters, &OptionLength);
+    TEST_EQUAL(XSK_POLL_MODE_INLINE, Parameters.PollMode);
+    TEST_EQUAL(1, Parameters.Budget);
 
-    UCHAR UdpNoMatchPayload[] = "GenericRxLowResourcesNoMatch";
-    UCHAR UdpNoMatchFrame[UDP_HEADER_STORAGE + sizeof(UdpNoMatchPayload)];
-    UINT32 UdpNoMatchFrameLength = sizeof(UdpNoMatchFrame);
-    TEST_TRUE(
-        PktBuildUdpFrame(
-            UdpNoMatchFrame, &UdpNoMatchFrameLength, UdpNoMatchPayload, sizeof(UdpNoMatchPayload),
-            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    UINT64 Pattern = 0xA5CC7729CE99C16Aui64;
+    UINT64 Mask = ~0ui64;
+    auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
 
-    XDP_RULE Rule;
-    Rule.Match = XDP_MATCH_UDP_DST;
-    Rule.Pattern.Port = LocalXskPort;
-    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
-    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
-    Rule.Redirect.Target = Xsk.Handle.get();
+    //
+    // Whether or not the interface can be polled inline, each poke transmits
+    // all frames, even those beyond the inline poll budget.
+    //
+    for (UINT32 Iteration = 0; Iteration < 2; Iteration++) {
+        const UINT32 FrameCount = 2;
+        UINT64 TxBuffers[FrameCount];
+        UINT32 ProducerIndex;
 
-    wil::unique_handle ProgramHandle =
-        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+        TEST_EQUAL(FrameCount, XskRingProducerReserve(&Xsk.Rings.Tx, FrameCount, &ProducerIndex));
+
+        for (UINT32 Index = 0; Index < FrameCount; Index++) {
+            TxBuffers[Index] = SocketFreePop(&Xsk);
+            RtlCopyMemory(Xsk.Umem.Buffer.get() + TxBuffers[Index], &Pattern, sizeof(Pattern));
+
+            XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+            TxDesc->Address.AddressAndOffset = TxBuffers[Index];
+            TxDesc->Length = sizeof(Pattern);
+        }
+
+        XskRingProducerSubmit(&Xsk.Rings.Tx, FrameCount);
+
+        XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+        NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+        TEST_EQUAL(0, NotifyResult);
+
+        for (UINT32 Index = 0; Index < FrameCount; Index++) {
+            auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
+            TEST_EQUAL(sizeof(Pattern), MpTxFrame->Buffers[0].DataLength);
+            MpTxDequeueFrame(GenericMp, 0);
+            MpTxFlush(GenericMp);
+        }
+
+        UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, FrameCount);
+        for (UINT32 Index = 0; Index < FrameCount; Index++) {
+            TEST_EQUAL(TxBuffers[Index], SocketGetTxCompDesc(&Xsk, ConsumerIndex++));
+            Xsk.FreeDescriptors.push(TxBuffers[Index]);
+        }
+        XskRingConsumerRelease(&Xsk.Rings.Completion, FrameCount);
+    }
+}
+
+VOID
+GenericRxBackfillAndTrailer()
+{
+    auto Socket = SetupSocket(FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(FnMpIf.GetIfIndex());
+
+    DATA_BUFFER Buffer = {0};
+    const UCHAR BufferVa[] = "GenericRxBackfillAndTrailer";
 
     //
-    // Low resource handling requires logically splitting a chain of NBLs and
-    // returning the original chain to the caller. The FNMP driver verifies the
-    // NDIS contract, and this test verifies observable behavior.
+    // Build one NBL and enqueue it in the functional miniport.
     //
-    const UINT32 NumMatchFrames = 4;
-    const UINT32 NumNoMatchFrames = 4;
+    Buffer.DataOffset = 3;
+    Buffer.DataLength = 5;
+    Buffer.BufferLength = sizeof(BufferVa);
+    Buffer.VirtualAddress = BufferVa;
 
     RX_FRAME Frame;
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpMatchFrame, UdpMatchFrameLength);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpNoMatchFrame, UdpNoMatchFrameLength);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpNoMatchFrame, UdpNoMatchFrameLength);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpMatchFrame, UdpMatchFrameLength);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpNoMatchFrame, UdpNoMatchFrameLength);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpMatchFrame, UdpMatchFrameLength);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpMatchFrame, UdpMatchFrameLength);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpNoMatchFrame, UdpNoMatchFrameLength);
+    RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), &Buffer);
     TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
 
-    SocketProduceRxFill(&Xsk, NumMatchFrames);
-
-    DATA_FLUSH_OPTIONS FlushOptions = {0};
-    FlushOptions.Flags.LowResources = TRUE;
-    TEST_HRESULT(TryMpRxFlush(GenericMp, &FlushOptions));
-
     //
-    // Verify the match NBLs propagated correctly to XSK.
+    // Produce one XSK fill descriptor.
     //
-    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, NumMatchFrames);
-    TEST_EQUAL(NumMatchFrames, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+    SocketProduceRxFill(&Socket, 1);
+    TEST_HRESULT(TryMpRxFlush(GenericMp));
 
-    for (UINT32 Index = 0; Index < NumMatchFrames; Index++) {
-        auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex++);
-        TEST_EQUAL(UdpMatchFrameLength, RxDesc->Length);
-        TEST_TRUE(
-            RtlEqualMemory(
-                Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
-                UdpMatchFrame,
-                UdpMatchFrameLength));
-    }
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
 
     //
-    // Verify the no-match NBLs propagated past XDP to the local stack.
+    // Verify the NBL propagated correctly to XSK.
     //
-    CHAR RecvPayload[sizeof(UdpNoMatchPayload)];
-    for (UINT32 Index = 0; Index < NumNoMatchFrames; Index++) {
-        TEST_EQUAL(
-            sizeof(UdpNoMatchPayload),
-            FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-        TEST_TRUE(RtlEqualMemory(UdpNoMatchPayload, RecvPayload, sizeof(UdpNoMatchPayload)));
-    }
-
-    TEST_TRUE(FAILED(FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
-    TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+    TEST_EQUAL(1, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+    auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+    TEST_EQUAL(Buffer.DataLength, RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            Buffer.VirtualAddress + Buffer.DataOffset,
+            Buffer.DataLength));
 }
 
 VOID
-GenericRxMultiSocket()
+GenericRxAllQueueRedirect(
+    _In_ ADDRESS_FAMILY Af
+    )
 {
     auto If = FnMpIf;
-    ADDRESS_FAMILY Af = AF_INET;
+    UINT16 LocalPort;
+    UINT16 RemotePort = htons(1234);
     ETHERNET_ADDRESS LocalHw, RemoteHw;
     INET_ADDR LocalIp, RemoteIp;
-    UCHAR UdpMatchPayload[] = "GenericRxMultiSocket";
-    struct {
-        MY_SOCKET Xsk;
-        UINT16 LocalPort;
-        UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpMatchPayload)];
-        UINT32 UdpFrameLength;
-    } Sockets[2];
-    XDP_RULE Rules[RTL_NUMBER_OF(Sockets)] = {};
+
+    auto Socket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
 
     If.GetHwAddress(&LocalHw);
     If.GetRemoteHwAddress(&RemoteHw);
-    If.GetIpv4Address(&LocalIp.Ipv4);
-    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
 
-    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
-        Sockets[Index].Xsk =
-            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
-        Sockets[Index].LocalPort = htons(1000 + Index);
-        Sockets[Index].UdpFrameLength = sizeof(Sockets[Index].UdpFrame);
-        TEST_TRUE(
-            PktBuildUdpFrame(
-                Sockets[Index].UdpFrame, &Sockets[Index].UdpFrameLength, UdpMatchPayload,
-                sizeof(UdpMatchPayload), &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp,
-                Sockets[Index].LocalPort, htons(2000)));
+    auto Xsk =
+        CreateAndBindSocket(
+            If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
 
-        Rules[Index].Match = XDP_MATCH_UDP_DST;
-        Rules[Index].Pattern.Port = Sockets[Index].LocalPort;
-        Rules[Index].Action = XDP_PROGRAM_ACTION_REDIRECT;
-        Rules[Index].Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
-        Rules[Index].Redirect.Target = Sockets[Index].Xsk.Handle.get();
-    }
+    XDP_RULE Rule;
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Redirect.Target = Xsk.Handle.get();
 
     wil::unique_handle ProgramHandle =
         CreateXdpProg(
-            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
-            Rules, RTL_NUMBER_OF(Rules));
-
-    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1,
+            XDP_CREATE_PROGRAM_FLAG_ALL_QUEUES);
 
-    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
-        auto &Socket = Sockets[Index].Xsk;
-        DATA_BUFFER Buffer = {0};
+    const UCHAR Payload[] = "GenericRxAllQueueRedirect";
+    UINT16 PayloadLength = sizeof(Payload);
+    UCHAR PacketBuffer[UDP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 PacketBufferLength = sizeof(PacketBuffer);
 
-        SocketProduceRxFill(&Socket, 1);
+    SocketProduceRxFill(&Xsk, 2);
 
-        Buffer.DataOffset = 0;
-        Buffer.DataLength = Sockets[Index].UdpFrameLength;
-        Buffer.BufferLength = Buffer.DataLength;
-        Buffer.VirtualAddress = Sockets[Index].UdpFrame;
-        RX_FRAME Frame;
-        RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), &Buffer);
-        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    //
+    // Indicate a packet on the wrong RX queue.
+    //
+    RX_FRAME Frame;
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            PacketBuffer, &PacketBufferLength, Payload, PayloadLength, &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    RxInitializeFrame(&Frame, If.GetQueueId() + 1, PacketBuffer, PacketBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-        UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    Sleep(TEST_TIMEOUT_ASYNC_MS * 2);
 
-        //
-        // Verify the NBL propagated correctly to XSK.
-        //
-        TEST_EQUAL(1, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
-        auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
-        TEST_EQUAL(Buffer.DataLength, RxDesc->Length);
-        TEST_TRUE(
-            RtlEqualMemory(
-                Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
-                Buffer.VirtualAddress + Buffer.DataOffset,
-                Buffer.DataLength));
-    }
+    UINT32 ConsumerIndex;
+    TEST_EQUAL(0, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+
+    //
+    // Indicate a packet on the right RX queue.
+    //
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            PacketBuffer, &PacketBufferLength, Payload, PayloadLength, &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    //
+    // Verify we get the packet that's indicated on the RX queue the rule's bound to.
+    //
+    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+    TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+    auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            PacketBuffer,
+            PacketBufferLength));
 }
 
 VOID
-GenericRxMultiProgram()
+GenericRxPersistedProgram()
 {
     auto If = FnMpIf;
-    ADDRESS_FAMILY Af = AF_INET;
+    const WCHAR *ProgramName = L"GenericRxPersistedProgram";
+    const UINT16 DropPort = htons(1234);
+    const UINT16 PassPort = htons(1235);
+    const UINT16 RemotePort = htons(4321);
     ETHERNET_ADDRESS LocalHw, RemoteHw;
     INET_ADDR LocalIp, RemoteIp;
-    UCHAR UdpMatchPayload[] = "GenericRxMultiProgram";
-    struct {
-        MY_SOCKET Xsk;
-        wil::unique_handle ProgramHandle;
-        UINT16 LocalPort;
-        UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpMatchPayload)];
-        UINT32 UdpFrameLength;
-    } Sockets[4];
+    const UCHAR Payload[] = "GenericRxPersistedProgram";
+    UCHAR DropBuffer[UDP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 DropBufferLength = sizeof(DropBuffer);
+    UCHAR PassBuffer[UDP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 PassBufferLength = sizeof(PassBuffer);
+    BOOLEAN Dropped = FALSE;
 
     If.GetHwAddress(&LocalHw);
     If.GetRemoteHwAddress(&RemoteHw);
     If.GetIpv4Address(&LocalIp.Ipv4);
     If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
 
-    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
-        XDP_RULE Rule = {};
-
-        Sockets[Index].Xsk =
-            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
-        Sockets[Index].LocalPort = htons(1000 + Index);
-        Sockets[Index].UdpFrameLength = sizeof(Sockets[Index].UdpFrame);
-        TEST_TRUE(
-            PktBuildUdpFrame(
-                Sockets[Index].UdpFrame, &Sockets[Index].UdpFrameLength, UdpMatchPayload,
-                sizeof(UdpMatchPayload), &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp,
-                Sockets[Index].LocalPort, htons(2000)));
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            DropBuffer, &DropBufferLength, Payload, sizeof(Payload), &LocalHw, &RemoteHw,
+            AF_INET, &LocalIp, &RemoteIp, DropPort, RemotePort));
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            PassBuffer, &PassBufferLength, Payload, sizeof(Payload), &LocalHw, &RemoteHw,
+            AF_INET, &LocalIp, &RemoteIp, PassPort, RemotePort));
 
-        Rule.Match = XDP_MATCH_UDP_DST;
-        Rule.Pattern.Port = Sockets[Index].LocalPort;
-        Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
-        Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
-        Rule.Redirect.Target = Sockets[Index].Xsk.Handle.get();
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = DropPort;
+    Rule.Action = XDP_PROGRAM_ACTION_DROP;
 
-        Sockets[Index].ProgramHandle =
-            CreateXdpProg(
-                If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
-                &Rule, 1);
+    HRESULT Result =
+        TryPersistProgram(
+            ProgramName, If.GetIfIndex(), &XdpInspectRxL2, XDP_CREATE_PROGRAM_FLAG_GENERIC,
+            &Rule, 1);
+    if (Result == HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED)) {
+        TEST_WARNING("Persisted programs not supported");
+        return;
     }
+    TEST_HRESULT(Result);
 
-    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto PersistedScopeGuard = wil::scope_exit([&]
+    {
+        //
+        // Programs created from the deleted persisted program are closed when
+        // the interface is next added.
+        //
+        TEST_HRESULT(TryDeletePersistedProgram(ProgramName));
+        FnMpIf.Restart();
+    });
 
-    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
-        auto &Socket = Sockets[Index].Xsk;
-        DATA_BUFFER Buffer = {0};
-        BOOLEAN Detach = Index & 1;
+    //
+    // Persisted programs are created as the interface is added, without any
+    // application holding a program handle.
+    //
+    FnMpIf.Restart();
 
-        if (Detach) {
-            //
-            // Ensure shared programs are properly detached.
-            //
-            Sockets[Index].ProgramHandle.reset();
-        }
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto FnLwf = LwfOpenDefault(If.GetIfIndex());
 
-        SocketProduceRxFill(&Socket, 1);
+    std::vector<UCHAR> Mask(sizeof(ETHERNET_HEADER), 0xFF);
+    auto LwfFilter = LwfRxFilter(FnLwf, DropBuffer, &Mask[0], (UINT32)Mask.size());
 
-        Buffer.DataOffset = 0;
-        Buffer.DataLength = Sockets[Index].UdpFrameLength;
-        Buffer.BufferLength = Buffer.DataLength;
-        Buffer.VirtualAddress = Sockets[Index].UdpFrame;
+    //
+    // The program is attached asynchronously after the interface is added, so
+    // indicate the dropped frame until it no longer reaches the stack.
+    //
+    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+    do {
         RX_FRAME Frame;
-        RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), &Buffer);
-        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        UINT32 FrameLength = 0;
 
-        //
-        // Verify the NBL propagated correctly to XSK.
-        //
-        if (Detach) {
-            UINT32 ConsumerIndex;
-            Sleep(TEST_TIMEOUT_ASYNC_MS);
-            TEST_EQUAL(0, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
-        } else {
-            UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+        RxInitializeFrame(&Frame, If.GetQueueId(), DropBuffer, DropBufferLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-            TEST_EQUAL(1, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
-            auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
-            TEST_EQUAL(Buffer.DataLength, RxDesc->Length);
-            TEST_TRUE(
-                RtlEqualMemory(
-                    Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
-                    Buffer.VirtualAddress + Buffer.DataOffset,
-                    Buffer.DataLength));
+        if (LwfRxGetFrame(FnLwf, If.GetQueueId(), &FrameLength, NULL) ==
+                HRESULT_FROM_WIN32(ERROR_NOT_FOUND)) {
+            Dropped = TRUE;
+            break;
         }
+
+        LwfRxFlush(FnLwf);
+    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+
+    TEST_TRUE(Dropped);
+
+    //
+    // Verify frames not matching the persisted rule still reach the stack.
+    //
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), PassBuffer, PassBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    auto LwfFrame = LwfRxAllocateAndGetFrame(FnLwf, If.GetQueueId());
+    UINT32 TotalLength = 0;
+    for (UINT32 i = 0; i < LwfFrame->BufferCount; i++) {
+        TotalLength += LwfFrame->Buffers[i].DataLength;
     }
+    TEST_EQUAL(PassBufferLength, TotalLength);
 }
 
+static
 VOID
-GenericRxUdpFragmentQuicShortHeader(
+InsertFrameHeader(
+    _Inout_updates_bytes_(FrameBufferSize) UCHAR *Frame,
+    _In_ UINT32 FrameBufferSize,
+    _Inout_ UINT32 *FrameLength,
+    _In_ UINT32 Offset,
+    _In_reads_bytes_(HeaderLength) const VOID *Header,
+    _In_ UINT32 HeaderLength
+    )
+{
+    TEST_TRUE(*FrameLength + HeaderLength <= FrameBufferSize);
+    TEST_TRUE(Offset <= *FrameLength);
+
+    RtlMoveMemory(Frame + Offset + HeaderLength, Frame + Offset, *FrameLength - Offset);
+    RtlCopyMemory(Frame + Offset, Header, HeaderLength);
+    *FrameLength += HeaderLength;
+}
+
+VOID
+GenericRxMatchVlan(
     _In_ ADDRESS_FAMILY Af
     )
 {
     auto If = FnMpIf;
-    UINT16 LocalPort, RemotePort;
+    UINT16 LocalPort;
+    UINT16 RemotePort = htons(1234);
     ETHERNET_ADDRESS LocalHw, RemoteHw;
     INET_ADDR LocalIp, RemoteIp;
-    UINT32 TotalOffset = 0;
+    const UINT16 VlanId = 100;
 
-    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto Socket = CreateUdpSocket(Af, &If, &LocalPort);
     auto GenericMp = MpOpenGeneric(If.GetIfIndex());
-    wil::unique_handle ProgramHandle;
 
-    RemotePort = htons(1234);
     If.GetHwAddress(&LocalHw);
     If.GetRemoteHwAddress(&RemoteHw);
     if (Af == AF_INET) {
@@ -3669,289 +4108,247 @@ GenericRxUdpFragmentQuicShortHeader(
         If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
     }
 
-    const UCHAR QuicShortHdrUdpPayload[XDP_QUIC_MAX_CID_LENGTH + 10] = { // 21 bytes is a full CID
-        0x00, // IsLongHeader
-        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // DestCid
-        0x00 // The rest
-    };
-    const UCHAR CorrectQuicCid[] = {
-        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08
-    };
-
-    std::vector<DATA_BUFFER> Buffers;
-    DATA_BUFFER Buffer = {0};
+    auto Xsk =
+        CreateAndBindSocket(
+            If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
 
-    XDP_RULE Rules[2];
-    Rules[0].Action = XDP_PROGRAM_ACTION_DROP;
-    Rules[0].Match = XDP_MATCH_QUIC_FLOW_DST_CID;
-    Rules[0].Pattern.QuicFlow.UdpPort = LocalPort;
-    Rules[0].Pattern.QuicFlow.CidOffset = 2; // Some arbitrary offset.
-    Rules[0].Pattern.QuicFlow.CidLength = 4; // Some arbitrary length.
-    memcpy(
-        Rules[0].Pattern.QuicFlow.CidData,
-        CorrectQuicCid + Rules[0].Pattern.QuicFlow.CidOffset,
-        Rules[0].Pattern.QuicFlow.CidLength);
-    Rules[1].Action = XDP_PROGRAM_ACTION_PASS;
-    Rules[1].Match = XDP_MATCH_ALL;
+    const UCHAR Payload[] = "GenericRxMatchVlan";
+    CHAR RecvPayload[sizeof(Payload)];
+    UCHAR PacketBuffer[UDP_HEADER_STORAGE + sizeof(VLAN_TAG) + sizeof(Payload)];
+    UINT32 PacketBufferLength = sizeof(PacketBuffer);
+    UCHAR TaggedBuffer[sizeof(PacketBuffer)];
+    UINT32 TaggedBufferLength;
 
-    ProgramHandle =
-        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules, 2);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            PacketBuffer, &PacketBufferLength, Payload, sizeof(Payload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
 
-    CHAR RecvPayload[sizeof(QuicShortHdrUdpPayload)];
-    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(QuicShortHdrUdpPayload)];
-    const UCHAR* UdpPayload;
-    UINT16 UdpPayloadLength = 0;
-    UdpPayload = QuicShortHdrUdpPayload;
+    //
+    // Build an 802.1Q tagged copy of the frame.
+    //
+    VLAN_TAG VlanTag = {};
+    VlanTag.Tag = htons(VlanId);
+    VlanTag.Type = ((ETHERNET_HEADER *)PacketBuffer)->Type;
+    RtlCopyMemory(TaggedBuffer, PacketBuffer, PacketBufferLength);
+    TaggedBufferLength = PacketBufferLength;
+    ((ETHERNET_HEADER *)TaggedBuffer)->Type = htons(ETHERNET_TYPE_802_1Q);
+    InsertFrameHeader(
+        TaggedBuffer, sizeof(TaggedBuffer), &TaggedBufferLength, sizeof(ETHERNET_HEADER),
+        &VlanTag, sizeof(VlanTag));
 
-    for (; UdpPayloadLength < sizeof(QuicShortHdrUdpPayload); UdpPayloadLength++) {
-        if (UdpPayloadLength ==
-                Rules[0].Pattern.QuicFlow.CidOffset +
-                Rules[0].Pattern.QuicFlow.CidLength + 1) {
-            Rules[0].Action = XDP_PROGRAM_ACTION_PASS;
-            Rules[1].Action = XDP_PROGRAM_ACTION_DROP;
-            ProgramHandle.reset();
-            ProgramHandle =
-                CreateXdpProg(
-                    If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules, 2);
-        }
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_VLAN_ID;
+    Rule.Pattern.VlanId = VlanId;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Redirect.Target = Xsk.Handle.get();
 
-        //
-        // Test a full length buffer
-        //
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
 
-        UINT32 UdpFrameLength = sizeof(UdpFrame);
-        TEST_TRUE(
-            PktBuildUdpFrame(
-                UdpFrame, &UdpFrameLength, UdpPayload, UdpPayloadLength, &LocalHw,
-                &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    SocketProduceRxFill(&Xsk, 2);
 
-        RX_FRAME RxFrame;
-        RxInitializeFrame(&RxFrame, If.GetQueueId(), UdpFrame, UdpFrameLength);
-        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &RxFrame));
-        TEST_EQUAL(
-            UdpPayloadLength,
-            FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-        TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, UdpPayloadLength));
+    //
+    // Verify untagged frames do not match the VLAN ID.
+    //
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(sizeof(Payload), FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+    TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, sizeof(Payload)));
 
-        //
-        // Test Payload Fragmented at all points
-        //
+    //
+    // Verify tagged frames match the VLAN ID.
+    //
+    RxInitializeFrame(&Frame, If.GetQueueId(), TaggedBuffer, TaggedBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-        for (UINT16 FragmentOffset = 0; FragmentOffset < UdpPayloadLength; FragmentOffset++) {
-            Buffers.clear();
-            TotalOffset = 0;
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+    auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+    TEST_EQUAL(TaggedBufferLength, RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            TaggedBuffer, TaggedBufferLength));
 
-            std::memset(&Buffer, 0, sizeof(Buffer));
-            Buffer.DataOffset = 0;
-            Buffer.DataLength = UdpFrameLength - (FragmentOffset + 1);
-            Buffer.BufferLength = Buffer.DataOffset + Buffer.DataLength;
-            Buffer.VirtualAddress = &UdpFrame[0] + TotalOffset;
-            TotalOffset += Buffer.BufferLength;
-            Buffers.push_back(Buffer);
+    //
+    // Verify upper layer headers are parsed beyond the VLAN tag.
+    //
+    ProgramHandle.reset();
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
 
-            std::memset(&Buffer, 0, sizeof(Buffer));
-            Buffer.DataOffset = 0;
-            Buffer.DataLength = (FragmentOffset + 1);
-            Buffer.BufferLength = Buffer.DataOffset + Buffer.DataLength;
-            Buffer.VirtualAddress = &UdpFrame[0] + TotalOffset;
-            TotalOffset += Buffer.BufferLength;
-            Buffers.push_back(Buffer);
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
 
-            RxInitializeFrame(&RxFrame, If.GetQueueId(), Buffers.data(), (UINT16)Buffers.size());
-            TEST_HRESULT(MpRxIndicateFrame(GenericMp, &RxFrame));
-            TEST_EQUAL(
-                UdpPayloadLength,
-                FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-            TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, UdpPayloadLength));
-        }
-    }
+    RxInitializeFrame(&Frame, If.GetQueueId(), TaggedBuffer, TaggedBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+    RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+    TEST_EQUAL(TaggedBufferLength, RxDesc->Length);
+
+    //
+    // Verify invalid VLAN IDs are rejected.
+    //
+    ProgramHandle.reset();
+    Rule.Match = XDP_MATCH_VLAN_ID;
+    Rule.Pattern.VlanId = XDP_VLAN_ID_MAX + 1;
+    TEST_TRUE(
+        FAILED(
+            TryCreateXdpProg(
+                ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(),
+                XDP_GENERIC, &Rule, 1)));
 }
 
 VOID
-GenericRxUdpFragmentQuicLongHeader(
-    _In_ ADDRESS_FAMILY Af,
-    _In_ BOOLEAN IsUdp
-    )
+GenericRxIpv6ExtensionHeaders()
 {
-    auto If = IsUdp ? FnMpIf : FnMp1QIf;
+    auto If = FnMpIf;
     UINT16 LocalPort;
     UINT16 RemotePort = htons(1234);
     ETHERNET_ADDRESS LocalHw, RemoteHw;
     INET_ADDR LocalIp, RemoteIp;
-    UINT32 TotalOffset = 0;
-    UINT32 AckNum = 0;
-    UINT32 SeqNum = 1;
+    const UINT32 Ip6Offset = sizeof(ETHERNET_HEADER);
+    const UINT32 ExtHdrOffset = Ip6Offset + sizeof(IPV6_HEADER);
 
-    auto Socket =
-        IsUdp ?
-            CreateUdpSocket(Af, &If, &LocalPort) :
-            CreateTcpSocket(Af, &If, &LocalPort, RemotePort, &AckNum);
+    auto Socket = CreateUdpSocket(AF_INET6, &If, &LocalPort);
     auto GenericMp = MpOpenGeneric(If.GetIfIndex());
-    wil::unique_handle ProgramHandle;
 
     If.GetHwAddress(&LocalHw);
     If.GetRemoteHwAddress(&RemoteHw);
-    if (Af == AF_INET) {
-        If.GetIpv4Address(&LocalIp.Ipv4);
-        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
-    } else {
-        If.GetIpv6Address(&LocalIp.Ipv6);
-        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
-    }
-
-    const UCHAR QuicLongHdrUdpPayload[40] = {
-        0x80, // IsLongHeader
-        0x01, 0x00, 0x00, 0x00, // Version
-        0x08, // DestCidLength
-        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // DestCid
-        0x08, // SrcCidLength
-        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // SrcCid
-        0x00  // The rest
-    };
-    const UINT16 MinQuicHdrLength = 1 + 4 + 1 + 8 + 1 + 8; // Up to the SrcCid
-    const UCHAR CorrectQuicCid[] = {
-        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08
-    };
-
-    std::vector<DATA_BUFFER> Buffers;
-    DATA_BUFFER Buffer = {0};
+    If.GetIpv6Address(&LocalIp.Ipv6);
+    If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
 
-    XDP_RULE Rules[2];
-    Rules[0].Action = XDP_PROGRAM_ACTION_DROP;
-    Rules[0].Match = (IsUdp ? XDP_MATCH_QUIC_FLOW_SRC_CID : XDP_MATCH_TCP_QUIC_FLOW_SRC_CID);
-    Rules[0].Pattern.QuicFlow.UdpPort = LocalPort;
-    Rules[0].Pattern.QuicFlow.CidOffset = 2; // Some arbitrary offset.
-    Rules[0].Pattern.QuicFlow.CidLength = 4; // Some arbitrary length.
-    memcpy(
-        Rules[0].Pattern.QuicFlow.CidData,
-        CorrectQuicCid + Rules[0].Pattern.QuicFlow.CidOffset,
-        Rules[0].Pattern.QuicFlow.CidLength);
-    Rules[1].Action = XDP_PROGRAM_ACTION_PASS;
-    Rules[1].Match = XDP_MATCH_ALL;
+    auto Xsk =
+        CreateAndBindSocket(
+            If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
 
-    ProgramHandle =
-                CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules, 2);
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Redirect.Target = Xsk.Handle.get();
 
-    CHAR RecvPayload[sizeof(QuicLongHdrUdpPayload)];
-    UCHAR PacketBuffer[TCP_HEADER_STORAGE + sizeof(QuicLongHdrUdpPayload)];
-    const UCHAR* Payload;
-    UINT16 PayloadLength = (IsUdp ? 0 : 1); // zero-payload TCP packets are not data packets.
-    Payload = QuicLongHdrUdpPayload;
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
 
-    for (; PayloadLength < sizeof(QuicLongHdrUdpPayload); PayloadLength++) {
-        if (PayloadLength == MinQuicHdrLength) {
-            Rules[0].Action = XDP_PROGRAM_ACTION_PASS;
-            Rules[1].Action = XDP_PROGRAM_ACTION_DROP;
-            ProgramHandle.reset();
-            ProgramHandle =
-                CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules, 2);
-        }
+    const UCHAR Payload[] = "GenericRxIpv6ExtensionHeaders";
+    UCHAR PacketBuffer[UDP_HEADER_STORAGE + 2 * sizeof(IPV6_FRAGMENT_HEADER) + sizeof(Payload)];
+    UINT32 PacketBufferLength;
+    IPV6_HEADER *Ip6Hdr = (IPV6_HEADER *)&PacketBuffer[Ip6Offset];
 
-        //
-        // Test a full length buffer
-        //
+    //
+    // A hop-by-hop options header containing a single PadN option, followed
+    // by an atomic fragment header. Both precede the UDP header.
+    //
+    const UCHAR HopByHopHdr[8] = { IPPROTO_FRAGMENT, 0, 1, 4, 0, 0, 0, 0 };
+    IPV6_FRAGMENT_HEADER FragmentHdr = {};
+    FragmentHdr.NextHeader = IPPROTO_UDP;
+    FragmentHdr.Id = 0x12345678;
 
-        UINT32 PacketBufferLength = sizeof(PacketBuffer);
-        if (IsUdp) {
-            TEST_TRUE(
-                PktBuildUdpFrame(
-                    PacketBuffer, &PacketBufferLength, Payload, PayloadLength, &LocalHw,
-                    &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-        } else {
-            TEST_TRUE(
-                PktBuildTcpFrame(
-                    PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
-                    NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
-                    &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-        }
+    PacketBufferLength = sizeof(PacketBuffer);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            PacketBuffer, &PacketBufferLength, Payload, sizeof(Payload), &LocalHw,
+            &RemoteHw, AF_INET6, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    InsertFrameHeader(
+        PacketBuffer, sizeof(PacketBuffer), &PacketBufferLength, ExtHdrOffset,
+        &FragmentHdr, sizeof(FragmentHdr));
+    InsertFrameHeader(
+        PacketBuffer, sizeof(PacketBuffer), &PacketBufferLength, ExtHdrOffset,
+        HopByHopHdr, sizeof(HopByHopHdr));
+    Ip6Hdr->NextHeader = IPPROTO_HOPOPTS;
+    Ip6Hdr->PayloadLength =
+        htons(ntohs(Ip6Hdr->PayloadLength) + sizeof(HopByHopHdr) + sizeof(FragmentHdr));
 
-        RX_FRAME RxFrame;
-        RxInitializeFrame(&RxFrame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
-        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &RxFrame));
-        TEST_EQUAL(
-            PayloadLength,
-            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
-        SeqNum += PayloadLength;
+    SocketProduceRxFill(&Xsk, 1);
 
-        //
-        // Test Payload Fragmented at all points
-        //
+    //
+    // Verify the UDP header is found beyond the extension headers.
+    //
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-        for (UINT16 FragmentOffset = 0; FragmentOffset < PayloadLength; FragmentOffset++) {
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+    auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            PacketBuffer, PacketBufferLength));
 
-            Buffers.clear();
-            TotalOffset = 0;
+    //
+    // Verify the first fragment of a fragmented packet is matched on its UDP
+    // header.
+    //
+    FragmentHdr.OffsetAndFlags = htons(1); // More fragments.
+    RtlCopyMemory(
+        &PacketBuffer[ExtHdrOffset + sizeof(HopByHopHdr)], &FragmentHdr, sizeof(FragmentHdr));
 
-            if (!IsUdp) {
-                TEST_TRUE(
-                    PktBuildTcpFrame(
-                        PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
-                        NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
-                        &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-            }
+    SocketProduceRxFill(&Xsk, 1);
+    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-            std::memset(&Buffer, 0, sizeof(Buffer));
-            Buffer.DataOffset = 0;
-            Buffer.DataLength = PacketBufferLength - (FragmentOffset + 1);
-            Buffer.BufferLength = Buffer.DataOffset + Buffer.DataLength;
-            Buffer.VirtualAddress = &PacketBuffer[0] + TotalOffset;
-            TotalOffset += Buffer.BufferLength;
-            Buffers.push_back(Buffer);
+    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+    RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
+}
 
-            std::memset(&Buffer, 0, sizeof(Buffer));
-            Buffer.DataOffset = 0;
-            Buffer.DataLength = (FragmentOffset + 1);
-            Buffer.BufferLength = Buffer.DataOffset + Buffer.DataLength;
-            Buffer.VirtualAddress = &PacketBuffer[0] + TotalOffset;
-            TotalOffset += Buffer.BufferLength;
-            Buffers.push_back(Buffer);
+//
+// Turns a UDP frame built by PktBuildUdpFrame into a fragment of an IP packet.
+// The offset is in units of eight bytes.
+//
+static
+VOID
+FragmentUdpFrame(
+    _Inout_updates_bytes_(FrameBufferSize) UCHAR *Frame,
+    _In_ UINT32 FrameBufferSize,
+    _Inout_ UINT32 *FrameLength,
+    _In_ ADDRESS_FAMILY Af,
+    _In_ UINT32 Id,
+    _In_ UINT16 Offset,
+    _In_ BOOLEAN MoreFragments
+    )
+{
+    if (Af == AF_INET) {
+        IPV4_HEADER *Ip4Hdr = (IPV4_HEADER *)&Frame[sizeof(ETHERNET_HEADER)];
 
-            RxInitializeFrame(&RxFrame, If.GetQueueId(), Buffers.data(), (UINT16)Buffers.size());
-            TEST_HRESULT(MpRxIndicateFrame(GenericMp, &RxFrame));
-            TEST_EQUAL(
-                PayloadLength,
-                FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-            TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
-            SeqNum += PayloadLength;
-        }
+        Ip4Hdr->Identification = htons((UINT16)Id);
+        Ip4Hdr->FlagsAndOffset = htons((UINT16)((MoreFragments ? 0x2000 : 0) | Offset));
+    } else {
+        IPV6_HEADER *Ip6Hdr = (IPV6_HEADER *)&Frame[sizeof(ETHERNET_HEADER)];
+        IPV6_FRAGMENT_HEADER FragmentHdr = {};
+
+        FragmentHdr.NextHeader = Ip6Hdr->NextHeader;
+        FragmentHdr.OffsetAndFlags = htons((UINT16)((Offset << 3) | (MoreFragments ? 1 : 0)));
+        FragmentHdr.Id = Id;
+
+        InsertFrameHeader(
+            Frame, FrameBufferSize, FrameLength, sizeof(ETHERNET_HEADER) + sizeof(*Ip6Hdr),
+            &FragmentHdr, sizeof(FragmentHdr));
+        Ip6Hdr->NextHeader = IPPROTO_FRAGMENT;
+        Ip6Hdr->PayloadLength = htons(ntohs(Ip6Hdr->PayloadLength) + sizeof(FragmentHdr));
     }
 }
 
-typedef struct _GENERIC_RX_UDP_FRAGMENT_PARAMS {
-    _In_ UINT16 PayloadLength;
-    _In_ UINT16 Backfill;
-    _In_ UINT16 Trailer;
-    _In_ UINT16 *SplitIndexes;
-    _In_ UINT16 SplitCount;
-    _In_ BOOLEAN IsUdp;
-    _In_ BOOLEAN IsTxInspect;
-    _In_ BOOLEAN LowResources;
-    _In_ XDP_RULE_ACTION Action;
-} GENERIC_RX_FRAGMENT_PARAMS;
-
-static
 VOID
-GenericRxFragmentBuffer(
-    _In_ ADDRESS_FAMILY Af,
-    _In_ const GENERIC_RX_FRAGMENT_PARAMS *Params
+GenericRxIpFragmentAffinity(
+    _In_ ADDRESS_FAMILY Af
     )
 {
-    UINT16 LocalPort, RemotePort;
+    auto If = FnMpIf;
+    UINT16 LocalPort;
+    UINT16 RemotePort = htons(1234);
     ETHERNET_ADDRESS LocalHw, RemoteHw;
     INET_ADDR LocalIp, RemoteIp;
-    UINT32 PacketBufferOffset = 0;
-    UINT32 TotalOffset = 0;
-    MY_SOCKET Xsk;
-    wil::unique_handle ProgramHandle;
-    unique_fnmp_handle GenericMp;
-    unique_fnlwf_handle FnLwf;
-    const XDP_HOOK_ID *RxHookId = Params->IsTxInspect ? &XdpInspectTxL2 : &XdpInspectRxL2;
 
-    auto If = FnMpIf;
+    auto Socket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
 
-    LocalPort = htons(1234);
-    RemotePort = htons(4321);
     If.GetHwAddress(&LocalHw);
     If.GetRemoteHwAddress(&RemoteHw);
     if (Af == AF_INET) {
@@ -3962,2275 +4359,10399 @@ GenericRxFragmentBuffer(
         If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
     }
 
-    XDP_RULE Rule;
-    Rule.Match = Params->IsUdp ? XDP_MATCH_UDP_DST : XDP_MATCH_TCP_DST;
+    auto Xsk =
+        CreateAndBindSocket(
+            If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_UDP_DST;
     Rule.Pattern.Port = LocalPort;
-    Rule.Action = Params->Action;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Redirect.Target = Xsk.Handle.get();
 
-    if (Params->Action == XDP_PROGRAM_ACTION_REDIRECT) {
-        Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
-        Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
-        Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
-        Rule.Redirect.Target = Xsk.Handle.get();
-    }
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
 
-    ProgramHandle =
-        CreateXdpProg(If.GetIfIndex(), RxHookId, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+    const UCHAR Payload[] = "GenericRxIpFragmentAffinity";
+    UCHAR FirstBuffer[UDP_HEADER_STORAGE + sizeof(IPV6_FRAGMENT_HEADER) + sizeof(Payload)];
+    UINT32 FirstBufferLength = sizeof(FirstBuffer);
+    UCHAR LaterBuffer[sizeof(FirstBuffer)];
+    UINT32 LaterBufferLength = sizeof(LaterBuffer);
 
     //
-    // Allocate UDP payload and initialize to a pattern.
+    // The later fragment's payload begins with bytes resembling a UDP header
+    // that does not match the rule.
     //
-    std::vector<UCHAR> Payload(Params->PayloadLength);
-    std::generate(Payload.begin(), Payload.end(), []{ return (UCHAR)std::rand(); });
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            FirstBuffer, &FirstBufferLength, Payload, sizeof(Payload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            LaterBuffer, &LaterBufferLength, Payload, sizeof(Payload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, RemotePort, RemotePort));
+    FragmentUdpFrame(FirstBuffer, sizeof(FirstBuffer), &FirstBufferLength, Af, 0x1234, 0, TRUE);
+    FragmentUdpFrame(LaterBuffer, sizeof(LaterBuffer), &LaterBufferLength, Af, 0x1234, 4, FALSE);
 
-    std::vector<UCHAR> PacketBuffer(
-        Params->Backfill +
-        (Params->IsUdp ? UDP_HEADER_BACKFILL(Af) : TCP_HEADER_BACKFILL(Af)) +
-        Params->PayloadLength + Params->Trailer);
-    UINT32 ActualPacketLength = (UINT32)PacketBuffer.size() - Params->Backfill - Params->Trailer;
-    if (Params->IsUdp) {
-        TEST_TRUE(
-            PktBuildUdpFrame(
-                &PacketBuffer[0] + Params->Backfill, &ActualPacketLength, &Payload[0],
-                (UINT16)Payload.size(), &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort,
-                RemotePort));
-    } else {
-        TEST_TRUE(
-            PktBuildTcpFrame(
-                &PacketBuffer[0] + Params->Backfill, &ActualPacketLength,
-                &Payload[0], (UINT16)Payload.size(),
-                NULL, 0, 0, 0, TH_SYN, 65535, &LocalHw,
-                &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-    }
+    SocketProduceRxFill(&Xsk, 2);
 
-    std::vector<DATA_BUFFER> Buffers;
+    //
+    // Verify the later fragment is given the verdict of the first fragment.
+    //
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), FirstBuffer, FirstBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), LaterBuffer, LaterBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 2);
+    auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex++);
+    TEST_EQUAL(FirstBufferLength, RxDesc->Length);
+    RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+    TEST_EQUAL(LaterBufferLength, RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            LaterBuffer, LaterBufferLength));
 
     //
-    // Split up the UDP frame into RX fragment buffers.
+    // Verify a later fragment of a different packet is not.
     //
-    for (UINT16 Index = 0; Index < Params->SplitCount; Index++) {
-        DATA_BUFFER Buffer = {0};
+    LaterBufferLength = sizeof(LaterBuffer);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            LaterBuffer, &LaterBufferLength, Payload, sizeof(Payload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, RemotePort, RemotePort));
+    FragmentUdpFrame(LaterBuffer, sizeof(LaterBuffer), &LaterBufferLength, Af, 0x4321, 4, FALSE);
 
-        Buffer.DataOffset = Index == 0 ? Params->Backfill : 0;
-        Buffer.DataLength = Params->SplitIndexes[Index] - PacketBufferOffset;
-        Buffer.BufferLength = Buffer.DataOffset + Buffer.DataLength;
-        Buffer.VirtualAddress = &PacketBuffer[0] + TotalOffset;
+    SocketProduceRxFill(&Xsk, 1);
+    RxInitializeFrame(&Frame, If.GetQueueId(), LaterBuffer, LaterBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-        PacketBufferOffset += Buffer.DataLength;
-        TotalOffset += Buffer.BufferLength;
+    Sleep(TEST_TIMEOUT_ASYNC_MS * 2);
+    TEST_EQUAL(0, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+}
 
-        Buffers.push_back(Buffer);
-    }
+VOID
+GenericRxTcpControl(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMp1QIf;
+    UINT16 LocalPort = htons(4321);
+    UINT16 RemotePort = htons(1234);
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
 
-    //
-    // Produce the final RX fragment buffer.
-    //
-    DATA_BUFFER Buffer = {0};
-    Buffer.DataOffset = Buffers.size() == 0 ? Params->Backfill : 0;
-    Buffer.DataLength = ActualPacketLength - PacketBufferOffset;
-    Buffer.BufferLength = Buffer.DataOffset + Buffer.DataLength + Params->Trailer;
-    Buffer.VirtualAddress = &PacketBuffer[0] + TotalOffset;
-    Buffers.push_back(Buffer);
+    WaitForWfpQuarantine(If);
 
-    RX_FRAME Frame;
-    RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), Buffers.data(), (UINT16)Buffers.size());
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
 
-    if (Params->IsTxInspect) {
-        FnLwf = LwfOpenDefault(If.GetIfIndex());
-        LwfTxEnqueue(FnLwf, &Frame.Frame);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
     } else {
-        GenericMp = MpOpenGeneric(If.GetIfIndex());
-        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
     }
 
-    DATA_FLUSH_OPTIONS RxFlushOptions = {0};
-    RxFlushOptions.Flags.LowResources = Params->LowResources;
-
-    if (Params->Action == XDP_PROGRAM_ACTION_REDIRECT) {
-        //
-        // TODO: TX-inspect to XSK test case not implemented.
-        //
-        TEST_FALSE(Params->IsTxInspect);
+    auto Xsk =
+        CreateAndBindSocket(
+            If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
 
-        //
-        // Produce one XSK fill descriptor.
-        //
-        SocketProduceRxFill(&Xsk, 1);
-        TEST_HRESULT(TryMpRxFlush(GenericMp, &RxFlushOptions));
+    XDP_RULE Rule;
+    Rule.Match = XDP_MATCH_TCP_CONTROL_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Redirect.Target = Xsk.Handle.get();
 
-        UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
 
-        //
-        // Verify the NBL propagated correctly to XSK.
-        //
-        TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
-        auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+    const UCHAR Payload[] = "GenericRxTcpControls";
+    UINT16 PayloadLength = sizeof(Payload);
+    UCHAR PacketBuffer[TCP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 PacketBufferLength = sizeof(PacketBuffer);
 
-        TEST_EQUAL(ActualPacketLength, RxDesc->Length);
-        TEST_TRUE(
-            RtlEqualMemory(
-                Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
-                &PacketBuffer[0] + Params->Backfill,
-                ActualPacketLength));
-    } else if (Params->Action == XDP_PROGRAM_ACTION_L2FWD) {
-        std::vector<UCHAR> L2FwdPacket(
-            PacketBuffer.begin() + Params->Backfill,
-            PacketBuffer.begin() + Params->Backfill + ActualPacketLength);
-        std::vector<UCHAR> Mask(L2FwdPacket.size(), 0xFF);
-        ETHERNET_HEADER *Ethernet = (ETHERNET_HEADER *)&L2FwdPacket[0];
-        ETHERNET_ADDRESS TempAddress;
-        unique_malloc_ptr<DATA_FRAME> TxFrame;
-        UINT32 TotalLength = 0;
+    SocketProduceRxFill(&Xsk, 6);
 
-        //
-        // Set a TX filter that matches the entire packet with the ethernet
-        // source and destination swapped.
-        //
-        TempAddress = Ethernet->Destination;
-        Ethernet->Destination = Ethernet->Source;
-        Ethernet->Source = TempAddress;
+    //
+    // Indicate a packet without control flags.
+    //
+    RX_FRAME Frame;
+    TEST_TRUE(
+        PktBuildTcpFrame(
+            PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
+            NULL, 0, 0, 1, TH_ACK, 65535,
+            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-        unique_fnlwf_filter_handle LwfFilter;
-        unique_fnmp_filter_handle MpFilter;
+    Sleep(TEST_TIMEOUT_ASYNC_MS * 2);
 
-        if (Params->IsTxInspect) {
-            LwfFilter = LwfRxFilter(FnLwf, &L2FwdPacket[0], &Mask[0], (UINT32)L2FwdPacket.size());
-            LwfTxFlush(FnLwf, &RxFlushOptions);
-            TxFrame = LwfRxAllocateAndGetFrame(FnLwf, 0);
-        } else {
-            MpFilter = MpTxFilter(GenericMp, &L2FwdPacket[0], &Mask[0], (UINT32)L2FwdPacket.size());
-            MpRxFlush(GenericMp, &RxFlushOptions);
-            TxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
-        }
+    UINT32 ConsumerIndex;
+    TEST_EQUAL(0, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
 
-        //
-        // Verify the entire packet (and nothing more) was forwarded. The TX
-        // filter verifies the bytes match up to the length of the filter.
-        //
-        for (UINT32 i = 0; i < TxFrame->BufferCount; i++) {
-            TotalLength += TxFrame->Buffers[i].DataLength;
-        }
-        TEST_EQUAL(L2FwdPacket.size(), TotalLength);
+    //
+    // Indicate a SYN packet.
+    //
+    TEST_TRUE(
+        PktBuildTcpFrame(
+            PacketBuffer, &PacketBufferLength, NULL, 0,
+            NULL, 0, 0, 1, TH_SYN, 65535,
+            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-        //
-        // Non-low-resources NBLs should be forwarded without a data copy. We
-        // infer this is true by the TX NBL having the same MDL layout as the
-        // original NBL.
-        //
-        // For TX-inspect NBLs, allow XDP to copy data if the first buffer is
-        // too short to reliably contain all L2 and L3 headers due to NDIS
-        // lookahead requirements.
-        //
-        if (!Params->LowResources &&
-            (!Params->IsTxInspect || Frame.Frame.Buffers[0].DataLength > 128)) {
-            TEST_EQUAL(Buffers.size(), TxFrame->BufferCount);
-        }
+    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+    TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+    auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            PacketBuffer,
+            PacketBufferLength));
+    XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
 
-        //
-        // XDP should preserve the available backfill.
-        //
-        TEST_EQUAL(Params->Backfill, Buffers[0].DataOffset);
+    //
+    // Indicate a SYN+ACK packet.
+    //
+    TEST_TRUE(
+        PktBuildTcpFrame(
+            PacketBuffer, &PacketBufferLength, NULL, 0,
+            NULL, 0, 0, 1, TH_SYN | TH_ACK, 65535,
+            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-        if (Params->IsTxInspect) {
-            LwfRxDequeueFrame(FnLwf, 0);
-            LwfRxFlush(FnLwf);
-        } else {
-            MpTxDequeueFrame(GenericMp, 0);
+    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+    TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+    RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            PacketBuffer,
+            PacketBufferLength));
+    XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
+
+    //
+    // Indicate a FIN packet.
+    //
+    TEST_TRUE(
+        PktBuildTcpFrame(
+            PacketBuffer, &PacketBufferLength, NULL, 0,
+            NULL, 0, 0, 1, TH_FIN, 65535,
+            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+    TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+    RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            PacketBuffer,
+            PacketBufferLength));
+    XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
+
+    //
+    // Indicate a FIN+ACK packet.
+    //
+    TEST_TRUE(
+        PktBuildTcpFrame(
+            PacketBuffer, &PacketBufferLength, NULL, 0,
+            NULL, 0, 0, 1, TH_FIN | TH_ACK, 65535,
+            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+    TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+    RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            PacketBuffer,
+            PacketBufferLength));
+    XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
+
+    //
+    // Indicate a RST packet.
+    //
+    TEST_TRUE(
+        PktBuildTcpFrame(
+            PacketBuffer, &PacketBufferLength, NULL, 0,
+            NULL, 0, 0, 1, TH_RST, 65535,
+            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+    TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+    RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            PacketBuffer,
+            PacketBufferLength));
+    XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
+
+    //
+    // Indicate a RST+ACK packet.
+    //
+    TEST_TRUE(
+        PktBuildTcpFrame(
+            PacketBuffer, &PacketBufferLength, NULL, 0,
+            NULL, 0, 0, 1, TH_RST | TH_ACK, 65535,
+            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+    TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+    RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            PacketBuffer,
+            PacketBufferLength));
+    XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
+}
+
+//
+// Creates a generic RX program with a single rule. If requested, a trailing
+// rule that matches none of the test frames and cannot be compiled into dense
+// ops is appended, so the program is inspected by the generic routine with the
+// same verdicts.
+//
+static
+wil::unique_handle
+CreateGenericRxMatchProg(
+    _In_ const TestInterface &If,
+    _In_ const XDP_RULE *Rule,
+    _In_ BOOLEAN Uncompiled
+    )
+{
+    XDP_RULE Rules[2];
+
+    Rules[0] = *Rule;
+    Rules[1] = {};
+    Rules[1].Match = XDP_MATCH_UDP_DST;
+    Rules[1].Pattern.Port = 0;
+    Rules[1].Action = XDP_PROGRAM_ACTION_L2FWD;
+
+    return
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+            Uncompiled ? 2 : 1);
+}
+
+static
+VOID
+GenericRxMatchProgram(
+    _In_ ADDRESS_FAMILY Af,
+    _In_ XDP_MATCH_TYPE MatchType,
+    _In_ BOOLEAN IsUdp,
+    _In_ BOOLEAN Uncompiled
+    )
+{
+    auto If = IsUdp ? FnMpIf : FnMp1QIf;
+    UINT16 LocalPort;
+    UINT16 RemotePort = htons(1234);
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UINT32 AckNum = 0;
+    UINT32 SeqNum = 1;
+
+    auto Socket =
+        IsUdp ?
+            CreateUdpSocket(Af, &If, &LocalPort) :
+            CreateTcpSocket(Af, &If, &LocalPort, RemotePort, &AckNum);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    wil::unique_handle ProgramHandle;
+    unique_malloc_ptr<UINT8> PortSet;
+    XDP_PORT_RANGE PortRanges[2] = {};
+    XDP_PAYLOAD_PATTERN PayloadPattern = {};
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    const UCHAR GenericPayload[] = "GenericRxMatch";
+    const UCHAR QuicLongHdrPayload[40] = {
+        0x80, // IsLongHeader
+        0x01, 0x00, 0x00, 0x00, // Version
+        0x08, // DestCidLength
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // DestCid
+        0x08, // SrcCidLength
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // SrcCid
+        0x00  // The rest
+    };
+    const UCHAR QuicShortHdrPayload[20] = {
+        0x00, // IsLongHeader
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // DestCid
+        0x00 // The rest
+    };
+    const UCHAR CorrectQuicCid[] = {
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08
+    };
+    const UCHAR IncorrectQuicCid[] = {
+        0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x00
+    };
+
+    CHAR RecvPayload[sizeof(QuicLongHdrPayload)];
+    UCHAR PacketBuffer[TCP_HEADER_STORAGE + sizeof(QuicLongHdrPayload)];
+    const UCHAR* Payload;
+    UINT16 PayloadLength;
+    if (MatchType == XDP_MATCH_QUIC_FLOW_SRC_CID ||
+        MatchType == XDP_MATCH_TCP_QUIC_FLOW_SRC_CID) {
+        Payload = QuicLongHdrPayload;
+        PayloadLength = sizeof(QuicLongHdrPayload);
+    } else if (MatchType == XDP_MATCH_QUIC_FLOW_DST_CID ||
+               MatchType == XDP_MATCH_TCP_QUIC_FLOW_DST_CID) {
+        Payload = QuicShortHdrPayload;
+        PayloadLength = sizeof(QuicShortHdrPayload);
+    } else {
+        Payload = GenericPayload;
+        PayloadLength = sizeof(GenericPayload);
+    }
+
+    UINT32 PacketBufferLength = sizeof(PacketBuffer);
+    if (IsUdp) {
+        TEST_TRUE(
+            PktBuildUdpFrame(
+                PacketBuffer, &PacketBufferLength, Payload, PayloadLength, &LocalHw,
+                &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    } else {
+        TEST_TRUE(
+            PktBuildTcpFrame(
+                PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
+                NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
+                &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    }
+
+    XDP_RULE Rule = {};
+    Rule.Match = MatchType;
+    if (MatchType == XDP_MATCH_UDP_DST ||
+        MatchType == XDP_MATCH_TCP_DST) {
+        Rule.Pattern.Port = LocalPort;
+    } else if (MatchType == XDP_MATCH_IPV4_UDP_TUPLE || MatchType == XDP_MATCH_IPV6_UDP_TUPLE ||
+               MatchType == XDP_MATCH_IPV4_TCP_TUPLE || MatchType == XDP_MATCH_IPV6_TCP_TUPLE) {
+        Rule.Pattern.Tuple.SourcePort = RemotePort;
+        Rule.Pattern.Tuple.DestinationPort = LocalPort;
+        memcpy(&Rule.Pattern.Tuple.SourceAddress, &RemoteIp, sizeof(INET_ADDR));
+        memcpy(&Rule.Pattern.Tuple.DestinationAddress, &LocalIp, sizeof(INET_ADDR));
+    } else if (MatchType == XDP_MATCH_QUIC_FLOW_SRC_CID ||
+               MatchType == XDP_MATCH_QUIC_FLOW_DST_CID ||
+               MatchType == XDP_MATCH_TCP_QUIC_FLOW_SRC_CID ||
+               MatchType == XDP_MATCH_TCP_QUIC_FLOW_DST_CID) {
+        Rule.Pattern.QuicFlow.UdpPort = LocalPort;
+        Rule.Pattern.QuicFlow.CidOffset = 2; // Some arbitrary offset.
+        Rule.Pattern.QuicFlow.CidLength = 4; // Some arbitrary length.
+        memcpy(
+            Rule.Pattern.QuicFlow.CidData,
+            CorrectQuicCid + Rule.Pattern.QuicFlow.CidOffset,
+            Rule.Pattern.QuicFlow.CidLength);
+    } else if (MatchType == XDP_MATCH_UDP_PORT_SET ||
+               MatchType == XDP_MATCH_IPV4_UDP_PORT_SET ||
+               MatchType == XDP_MATCH_IPV6_UDP_PORT_SET ||
+               MatchType == XDP_MATCH_IPV4_TCP_PORT_SET ||
+               MatchType == XDP_MATCH_IPV6_TCP_PORT_SET) {
+        PortSet.reset((UINT8 *)calloc(XDP_PORT_SET_BUFFER_SIZE, 1));
+        TEST_NOT_NULL(PortSet.get());
+
+        SetBit(PortSet.get(), LocalPort);
+
+        if (MatchType == XDP_MATCH_UDP_PORT_SET) {
+            Rule.Pattern.PortSet.PortSet = PortSet.get();
+        } else {
+            Rule.Pattern.IpPortSet.Address = *(XDP_INET_ADDR *)&LocalIp;
+            Rule.Pattern.IpPortSet.PortSet.PortSet = PortSet.get();
+        }
+    } else if (MatchType == XDP_MATCH_UDP_PORT_RANGE ||
+               MatchType == XDP_MATCH_IPV4_UDP_PORT_RANGE ||
+               MatchType == XDP_MATCH_IPV6_UDP_PORT_RANGE ||
+               MatchType == XDP_MATCH_IPV4_TCP_PORT_RANGE ||
+               MatchType == XDP_MATCH_IPV6_TCP_PORT_RANGE) {
+        //
+        // Port ranges are in host order.
+        //
+        PortRanges[0].LowPort = 1;
+        PortRanges[0].HighPort = 2;
+        PortRanges[1].LowPort = ntohs(LocalPort) - 1;
+        PortRanges[1].HighPort = ntohs(LocalPort);
+
+        if (MatchType == XDP_MATCH_UDP_PORT_RANGE) {
+            Rule.Pattern.PortRanges.Ranges = PortRanges;
+            Rule.Pattern.PortRanges.RangeCount = RTL_NUMBER_OF(PortRanges);
+        } else {
+            Rule.Pattern.IpPortRanges.Address = *(XDP_INET_ADDR *)&LocalIp;
+            Rule.Pattern.IpPortRanges.PortRanges.Ranges = PortRanges;
+            Rule.Pattern.IpPortRanges.PortRanges.RangeCount = RTL_NUMBER_OF(PortRanges);
+        }
+    } else if (MatchType == XDP_MATCH_UDP_PAYLOAD || MatchType == XDP_MATCH_TCP_PAYLOAD) {
+        //
+        // Match "RxMatch" within the payload, ignoring the case of its first
+        // letter. The payload ends before a full pattern width past the offset.
+        //
+        PayloadPattern.Offset = sizeof("Generic") - 1;
+        PayloadPattern.Length = sizeof("RxMatch") - 1;
+        memcpy(PayloadPattern.Value, "rxMatch", PayloadPattern.Length);
+        memset(PayloadPattern.Mask, 0xFF, PayloadPattern.Length);
+        PayloadPattern.Mask[0] = (UINT8)~0x20;
+        Rule.Pattern.Payload.Port = LocalPort;
+        Rule.Pattern.Payload.Pattern = &PayloadPattern;
+    }
+
+    //
+    // Verify XDP pass action.
+    //
+    ProgramHandle.reset();
+    Rule.Action = XDP_PROGRAM_ACTION_PASS;
+
+    ProgramHandle = CreateGenericRxMatchProg(If, &Rule, Uncompiled);
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(PayloadLength, FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+    TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
+    SeqNum += PayloadLength;
+
+    //
+    // Verify XDP drop action.
+    //
+    ProgramHandle.reset();
+    Rule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    ProgramHandle = CreateGenericRxMatchProg(If, &Rule, Uncompiled);
+
+    if (!IsUdp) {
+        TEST_TRUE(
+            PktBuildTcpFrame(
+                PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
+                NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
+                &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    }
+    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_TRUE(FAILED(FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
+    TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+
+    //
+    // Redirect action is implicitly covered by XSK tests.
+    //
+
+    if (Rule.Match == XDP_MATCH_UDP_DST || Rule.Match == XDP_MATCH_TCP_DST) {
+        //
+        // Verify default action (when no rules match) is pass. Test only makes sense when
+        // specific port matching is enabled.
+        //
+        ProgramHandle.reset();
+        Rule.Pattern.Port = htons(ntohs(LocalPort) - 1);
+
+        ProgramHandle = CreateGenericRxMatchProg(If, &Rule, Uncompiled);
+
+        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        TEST_EQUAL(
+            PayloadLength,
+            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
+        SeqNum += PayloadLength;
+    } else if (Rule.Match == XDP_MATCH_IPV4_UDP_TUPLE || Rule.Match == XDP_MATCH_IPV6_UDP_TUPLE ||
+               Rule.Match == XDP_MATCH_IPV4_TCP_TUPLE || Rule.Match == XDP_MATCH_IPV6_TCP_TUPLE) {
+        //
+        // Each mismatching tuple passes the frame; TCP frames must carry the
+        // next sequence number for their payload to be received.
+        //
+        auto IndicateAndVerifyPass = [&] {
+            RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+            TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+            TEST_EQUAL(
+                PayloadLength,
+                FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+            TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
+            SeqNum += PayloadLength;
+
+            if (!IsUdp) {
+                PacketBufferLength = sizeof(PacketBuffer);
+                TEST_TRUE(
+                    PktBuildTcpFrame(
+                        PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
+                        NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
+                        &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+            }
+        };
+
+        //
+        // Verify source port matching.
+        //
+        ProgramHandle.reset();
+        Rule.Pattern.Tuple.SourcePort = htons(ntohs(RemotePort) - 1);
+
+        ProgramHandle = CreateGenericRxMatchProg(If, &Rule, Uncompiled);
+
+        IndicateAndVerifyPass();
+
+        //
+        // Verify destination port matching.
+        //
+        ProgramHandle.reset();
+        Rule.Pattern.Tuple.SourcePort = RemotePort; // Revert previous test change
+        Rule.Pattern.Tuple.DestinationPort = htons(ntohs(LocalPort) - 1);
+
+        ProgramHandle = CreateGenericRxMatchProg(If, &Rule, Uncompiled);
+
+        IndicateAndVerifyPass();
+
+        //
+        // Verify source address matching.
+        //
+        ProgramHandle.reset();
+        Rule.Pattern.Tuple.DestinationPort = LocalPort; // Revert previous test change
+        (*((UCHAR*)&Rule.Pattern.Tuple.SourceAddress))++;
+
+        ProgramHandle = CreateGenericRxMatchProg(If, &Rule, Uncompiled);
+
+        IndicateAndVerifyPass();
+
+        //
+        // Verify destination address matching.
+        //
+        ProgramHandle.reset();
+        (*((UCHAR*)&Rule.Pattern.Tuple.SourceAddress))--; // Revert previous test change
+        (*((UCHAR*)&Rule.Pattern.Tuple.DestinationAddress))++;
+
+        ProgramHandle = CreateGenericRxMatchProg(If, &Rule, Uncompiled);
+
+        IndicateAndVerifyPass();
+    } else if (Rule.Match == XDP_MATCH_QUIC_FLOW_SRC_CID ||
+               Rule.Match == XDP_MATCH_QUIC_FLOW_DST_CID ||
+               Rule.Match == XDP_MATCH_TCP_QUIC_FLOW_SRC_CID ||
+               Rule.Match == XDP_MATCH_TCP_QUIC_FLOW_DST_CID) {
+        //
+        // Verify other header QUIC packets don't match.
+        //
+        if (Rule.Match == XDP_MATCH_QUIC_FLOW_SRC_CID ||
+            Rule.Match == XDP_MATCH_TCP_QUIC_FLOW_SRC_CID) {
+            Payload = QuicShortHdrPayload;
+            PayloadLength = sizeof(QuicShortHdrPayload);
+        } else {
+            Payload = QuicLongHdrPayload;
+            PayloadLength = sizeof(QuicLongHdrPayload);
+        }
+        PacketBufferLength = sizeof(PacketBuffer);
+        if (IsUdp) {
+            TEST_TRUE(
+                PktBuildUdpFrame(
+                    PacketBuffer, &PacketBufferLength, Payload, PayloadLength, &LocalHw,
+                    &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+        } else {
+            TEST_TRUE(
+                PktBuildTcpFrame(
+                    PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
+                    NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
+                    &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+        }
+
+        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        TEST_EQUAL(
+            PayloadLength,
+            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
+        SeqNum += PayloadLength;
+
+        //
+        // Revert UDP payload change from test above.
+        //
+        if (Rule.Match == XDP_MATCH_QUIC_FLOW_SRC_CID ||
+            Rule.Match == XDP_MATCH_TCP_QUIC_FLOW_SRC_CID) {
+            Payload = QuicLongHdrPayload;
+            PayloadLength = sizeof(QuicLongHdrPayload);
+        } else {
+            Payload = QuicShortHdrPayload;
+            PayloadLength = sizeof(QuicShortHdrPayload);
+        }
+        PacketBufferLength = sizeof(PacketBuffer);
+        if (IsUdp) {
+            TEST_TRUE(
+                PktBuildUdpFrame(
+                    PacketBuffer, &PacketBufferLength, Payload, PayloadLength, &LocalHw,
+                    &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+        } else {
+            TEST_TRUE(
+                PktBuildTcpFrame(
+                    PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
+                    NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
+                    &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+        }
+
+        //
+        // Verify the CID matching part.
+        //
+        ProgramHandle.reset();
+        memcpy(
+            Rule.Pattern.QuicFlow.CidData,
+            IncorrectQuicCid + Rule.Pattern.QuicFlow.CidOffset,
+            Rule.Pattern.QuicFlow.CidLength);
+
+        ProgramHandle = CreateGenericRxMatchProg(If, &Rule, Uncompiled);
+
+        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        TEST_EQUAL(
+            PayloadLength,
+            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
+        SeqNum += PayloadLength;
+
+        if (!IsUdp) {
+            TEST_TRUE(
+                PktBuildTcpFrame(
+                    PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
+                    NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
+                    &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+        }
+
+        //
+        // Verify the port matching part.
+        //
+        ProgramHandle.reset();
+        Rule.Pattern.QuicFlow.UdpPort = htons(ntohs(LocalPort) - 1);
+        memcpy(
+            Rule.Pattern.QuicFlow.CidData,
+            CorrectQuicCid + Rule.Pattern.QuicFlow.CidOffset,
+            Rule.Pattern.QuicFlow.CidLength);
+
+        ProgramHandle = CreateGenericRxMatchProg(If, &Rule, Uncompiled);
+
+        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        TEST_EQUAL(
+            PayloadLength,
+            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
+        SeqNum += PayloadLength;
+    } else if (MatchType == XDP_MATCH_UDP_PORT_SET ||
+               MatchType == XDP_MATCH_IPV4_UDP_PORT_SET ||
+               MatchType == XDP_MATCH_IPV6_UDP_PORT_SET ||
+               MatchType == XDP_MATCH_IPV4_TCP_PORT_SET ||
+               MatchType == XDP_MATCH_IPV6_TCP_PORT_SET) {
+
+        //
+        // Verify destination port matching.
+        //
+        TEST_EQUAL(XDP_PROGRAM_ACTION_DROP, Rule.Action);
+        ClearBit(PortSet.get(), LocalPort);
+
+        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        TEST_EQUAL(
+            PayloadLength,
+            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
+        SeqNum += PayloadLength;
+
+        if (!IsUdp) {
+            TEST_TRUE(
+                PktBuildTcpFrame(
+                    PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
+                    NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
+                    &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+        }
+        SetBit(PortSet.get(), LocalPort);
+        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        TEST_TRUE(FAILED(FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
+        TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+
+        if (MatchType == XDP_MATCH_IPV4_UDP_PORT_SET || MatchType == XDP_MATCH_IPV6_UDP_PORT_SET) {
+            //
+            // Verify destination address matching.
+            //
+            ProgramHandle.reset();
+            (*((UCHAR*)&Rule.Pattern.IpPortSet.Address))++;
+
+            ProgramHandle = CreateGenericRxMatchProg(If, &Rule, Uncompiled);
+
+            RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+            TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+            TEST_EQUAL(
+                PayloadLength,
+                 FnSockRecv(
+                    Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+            TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
+            SeqNum += PayloadLength;
+        }
+    } else if (MatchType == XDP_MATCH_UDP_PORT_RANGE ||
+               MatchType == XDP_MATCH_IPV4_UDP_PORT_RANGE ||
+               MatchType == XDP_MATCH_IPV6_UDP_PORT_RANGE ||
+               MatchType == XDP_MATCH_IPV4_TCP_PORT_RANGE ||
+               MatchType == XDP_MATCH_IPV6_TCP_PORT_RANGE) {
+        //
+        // Verify destination port matching. Port ranges are captured when the
+        // program is created, so the program must be recreated.
+        //
+        ProgramHandle.reset();
+        PortRanges[1].LowPort = ntohs(LocalPort) - 2;
+        PortRanges[1].HighPort = ntohs(LocalPort) - 1;
+
+        ProgramHandle = CreateGenericRxMatchProg(If, &Rule, Uncompiled);
+
+        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        TEST_EQUAL(
+            PayloadLength,
+            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
+        SeqNum += PayloadLength;
+
+        if (MatchType == XDP_MATCH_IPV4_UDP_PORT_RANGE ||
+            MatchType == XDP_MATCH_IPV6_UDP_PORT_RANGE) {
+            //
+            // Verify destination address matching.
+            //
+            ProgramHandle.reset();
+            PortRanges[1].HighPort = ntohs(LocalPort);
+            (*((UCHAR*)&Rule.Pattern.IpPortRanges.Address))++;
+
+            ProgramHandle = CreateGenericRxMatchProg(If, &Rule, Uncompiled);
+
+            RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+            TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+            TEST_EQUAL(
+                PayloadLength,
+                FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+            TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
+            SeqNum += PayloadLength;
+        }
+
+        //
+        // Verify invalid ranges are rejected.
+        //
+        ProgramHandle.reset();
+        PortRanges[1].LowPort = ntohs(LocalPort);
+        PortRanges[1].HighPort = ntohs(LocalPort) - 1;
+        TEST_TRUE(
+            FAILED(
+                TryCreateXdpProg(
+                    ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(),
+                    XDP_GENERIC, &Rule, 1)));
+    } else if (MatchType == XDP_MATCH_UDP_PAYLOAD || MatchType == XDP_MATCH_TCP_PAYLOAD) {
+        //
+        // The pattern is captured when the program is created, so each
+        // mismatching pattern recreates the program and passes the frame.
+        //
+        auto RecreateAndVerifyPass = [&] {
+            ProgramHandle.reset();
+            ProgramHandle = CreateGenericRxMatchProg(If, &Rule, Uncompiled);
+
+            if (!IsUdp) {
+                PacketBufferLength = sizeof(PacketBuffer);
+                TEST_TRUE(
+                    PktBuildTcpFrame(
+                        PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
+                        NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
+                        &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+            }
+
+            RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+            TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+            TEST_EQUAL(
+                PayloadLength,
+                FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+            TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
+            SeqNum += PayloadLength;
+        };
+
+        //
+        // Verify the masked byte pattern matching part.
+        //
+        PayloadPattern.Value[1] ^= 0x20;
+        RecreateAndVerifyPass();
+        PayloadPattern.Value[1] ^= 0x20;
+
+        //
+        // Verify patterns extending past the end of the payload don't match.
+        //
+        PayloadPattern.Offset = (UINT16)(PayloadLength - PayloadPattern.Length + 1);
+        memcpy(
+            PayloadPattern.Value, Payload + PayloadPattern.Offset,
+            PayloadPattern.Length - 1);
+        RecreateAndVerifyPass();
+        PayloadPattern.Offset = sizeof("Generic") - 1;
+        memcpy(PayloadPattern.Value, "rxMatch", PayloadPattern.Length);
+
+        //
+        // Verify the port matching part.
+        //
+        Rule.Pattern.Payload.Port = htons(ntohs(LocalPort) - 1);
+        RecreateAndVerifyPass();
+        Rule.Pattern.Payload.Port = LocalPort;
+
+        //
+        // Verify empty and oversized patterns are rejected.
+        //
+        ProgramHandle.reset();
+        PayloadPattern.Length = 0;
+        TEST_TRUE(
+            FAILED(
+                TryCreateXdpProg(
+                    ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(),
+                    XDP_GENERIC, &Rule, 1)));
+
+        PayloadPattern.Length = XDP_PAYLOAD_PATTERN_MAX_LENGTH + 1;
+        TEST_TRUE(
+            FAILED(
+                TryCreateXdpProg(
+                    ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(),
+                    XDP_GENERIC, &Rule, 1)));
+    } else {
+        //
+        // TODO - Send and validate some non-UDP traffic.
+        //
+    }
+}
+
+VOID
+GenericRxMatch(
+    _In_ ADDRESS_FAMILY Af,
+    _In_ XDP_MATCH_TYPE MatchType,
+    _In_ BOOLEAN IsUdp
+    )
+{
+    //
+    // Simple drop and pass programs are compiled into dense ops; verify their
+    // verdicts match the generic routine's.
+    //
+    GenericRxMatchProgram(Af, MatchType, IsUdp, FALSE);
+    GenericRxMatchProgram(Af, MatchType, IsUdp, TRUE);
+}
+
+static
+VOID
+GenericRxMatchIpPrefixProgram(
+    _In_ ADDRESS_FAMILY Af,
+    _In_ BOOLEAN Uncompiled
+    )
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    XDP_INET_ADDR LocalIp, RemoteIp;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    wil::unique_handle ProgramHandle;
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    UCHAR UdpPayload[] = "GenericRxMatchIpPrefix";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    XDP_RULE Rule;
+
+    if (Af == AF_INET) {
+        Rule.Match = XDP_MATCH_IPV4_DST_MASK;
+        TEST_EQUAL(1, inet_pton(Af, "255.192.0.0", &Rule.Pattern.IpMask.Mask));
+    } else {
+        Rule.Match = XDP_MATCH_IPV6_DST_MASK;
+        TEST_EQUAL(1, inet_pton(Af, "FC00::0", &Rule.Pattern.IpMask.Mask));
+    }
+
+    Rule.Pattern.IpMask.Address = LocalIp;
+    ClearMaskedBits(&Rule.Pattern.IpMask.Address, &Rule.Pattern.IpMask.Mask, Af);
+    Rule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    //
+    // Verify IP prefix match.
+    //
+    ProgramHandle = CreateGenericRxMatchProg(If, &Rule, Uncompiled);
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_TRUE(FAILED(FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
+    TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+
+    //
+    // Verify IP prefix mismatch.
+    //
+    ProgramHandle.reset();
+    *(UCHAR *)&Rule.Pattern.IpMask.Address ^= 0xFFu;
+
+    ProgramHandle = CreateGenericRxMatchProg(If, &Rule, Uncompiled);
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(
+        sizeof(UdpPayload),
+        FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+}
+
+VOID
+GenericRxMatchIpPrefix(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    GenericRxMatchIpPrefixProgram(Af, FALSE);
+    GenericRxMatchIpPrefixProgram(Af, TRUE);
+}
+
+VOID
+GenericRxMatchIndexedTuple(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    XDP_INET_ADDR LocalIp, RemoteIp;
+    XDP_RULE Rules[64] = {};
+    const UINT32 MatchIndex = RTL_NUMBER_OF(Rules) / 2;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    wil::unique_handle ProgramHandle;
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    UCHAR UdpPayload[] = "GenericRxMatchIndexedTuple";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    //
+    // Build enough consecutive tuple rules for the program to index them,
+    // with two rules matching the frame: the first of them must win.
+    //
+    for (UINT32 i = 0; i < RTL_NUMBER_OF(Rules); i++) {
+        Rules[i].Match = (Af == AF_INET) ? XDP_MATCH_IPV4_UDP_TUPLE : XDP_MATCH_IPV6_UDP_TUPLE;
+        Rules[i].Pattern.Tuple.SourceAddress = RemoteIp;
+        Rules[i].Pattern.Tuple.DestinationAddress = LocalIp;
+        Rules[i].Pattern.Tuple.SourcePort = htons((UINT16)(ntohs(RemotePort) + 1 + i));
+        Rules[i].Pattern.Tuple.DestinationPort = LocalPort;
+        Rules[i].Action = XDP_PROGRAM_ACTION_PASS;
+    }
+
+    Rules[MatchIndex].Pattern.Tuple.SourcePort = RemotePort;
+    Rules[MatchIndex + 1].Pattern.Tuple.SourcePort = RemotePort;
+
+    //
+    // Verify the earlier matching rule takes precedence.
+    //
+    Rules[MatchIndex].Action = XDP_PROGRAM_ACTION_DROP;
+    Rules[MatchIndex + 1].Action = XDP_PROGRAM_ACTION_PASS;
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+            RTL_NUMBER_OF(Rules));
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_TRUE(FAILED(FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
+    TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+
+    ProgramHandle.reset();
+    Rules[MatchIndex].Action = XDP_PROGRAM_ACTION_PASS;
+    Rules[MatchIndex + 1].Action = XDP_PROGRAM_ACTION_DROP;
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+            RTL_NUMBER_OF(Rules));
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(
+        sizeof(UdpPayload),
+        FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+
+    //
+    // Verify a frame matching no indexed rule falls through to the rules
+    // after the index.
+    //
+    ProgramHandle.reset();
+    XDP_RULE TrailingRules[RTL_NUMBER_OF(Rules) + 1];
+    RtlCopyMemory(TrailingRules, Rules, sizeof(Rules));
+    TrailingRules[MatchIndex].Pattern.Tuple.SourcePort = htons(1);
+    TrailingRules[MatchIndex + 1].Pattern.Tuple.SourcePort = htons(2);
+    TrailingRules[RTL_NUMBER_OF(Rules)] = {};
+    TrailingRules[RTL_NUMBER_OF(Rules)].Match = XDP_MATCH_ALL;
+    TrailingRules[RTL_NUMBER_OF(Rules)].Action = XDP_PROGRAM_ACTION_DROP;
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, TrailingRules,
+            RTL_NUMBER_OF(TrailingRules));
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_TRUE(FAILED(FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
+    TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+}
+
+VOID
+GenericRxMatchIndexedQuicCid(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    XDP_INET_ADDR LocalIp, RemoteIp;
+    XDP_RULE Rules[64] = {};
+    const UINT32 MatchIndex = RTL_NUMBER_OF(Rules) / 2;
+
+    //
+    // CID windows exercising each comparison width.
+    //
+    const struct {
+        UCHAR CidOffset;
+        UCHAR CidLength;
+    } Windows[] = {
+        { 0, XDP_QUIC_MAX_CID_LENGTH },
+        { 1, 17 },
+        { 2, 11 },
+        { 3, 5 },
+        { 4, 2 },
+    };
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    wil::unique_handle ProgramHandle;
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    //
+    // A short header QUIC packet with a full length destination CID.
+    //
+    UCHAR QuicPayload[32] = {};
+    for (UINT32 i = 0; i < XDP_QUIC_MAX_CID_LENGTH; i++) {
+        QuicPayload[1 + i] = (UCHAR)(0xA0 + i);
+    }
+    const UCHAR *Cid = &QuicPayload[1];
+
+    CHAR RecvPayload[sizeof(QuicPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(QuicPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, QuicPayload, sizeof(QuicPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    for (UINT32 w = 0; w < RTL_NUMBER_OF(Windows); w++) {
+        const UCHAR CidOffset = Windows[w].CidOffset;
+        const UCHAR CidLength = Windows[w].CidLength;
+
+        //
+        // Build enough CID rules sharing a window for the program to index
+        // them. The rules differ from the frame's CID in their last byte,
+        // except for a single matching rule.
+        //
+        for (UINT32 i = 0; i < RTL_NUMBER_OF(Rules); i++) {
+            Rules[i].Match = XDP_MATCH_QUIC_FLOW_DST_CID;
+            Rules[i].Pattern.QuicFlow.UdpPort = LocalPort;
+            Rules[i].Pattern.QuicFlow.CidOffset = CidOffset;
+            Rules[i].Pattern.QuicFlow.CidLength = CidLength;
+            RtlCopyMemory(Rules[i].Pattern.QuicFlow.CidData, Cid + CidOffset, CidLength);
+            Rules[i].Pattern.QuicFlow.CidData[CidLength - 1] ^= (UCHAR)(i + 1);
+            Rules[i].Action = XDP_PROGRAM_ACTION_PASS;
+        }
+
+        Rules[MatchIndex].Pattern.QuicFlow.CidData[CidLength - 1] = Cid[CidOffset + CidLength - 1];
+        Rules[MatchIndex].Action = XDP_PROGRAM_ACTION_DROP;
+
+        ProgramHandle.reset();
+        ProgramHandle =
+            CreateXdpProg(
+                If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+                RTL_NUMBER_OF(Rules));
+
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        TEST_TRUE(FAILED(FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
+        TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+
+        //
+        // Verify a difference in the first byte of the window is detected.
+        //
+        ProgramHandle.reset();
+        Rules[MatchIndex].Pattern.QuicFlow.CidData[0] ^= 0xFF;
+
+        ProgramHandle =
+            CreateXdpProg(
+                If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+                RTL_NUMBER_OF(Rules));
+
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        TEST_EQUAL(
+            sizeof(QuicPayload),
+            FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+        TEST_TRUE(RtlEqualMemory(QuicPayload, RecvPayload, sizeof(QuicPayload)));
+    }
+}
+
+VOID
+GenericRxMatchLpm(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    XDP_INET_ADDR LocalIp, RemoteIp;
+    XDP_IP_PREFIX Prefixes[3] = {};
+    const UINT8 AddressBits = (Af == AF_INET) ? 32 : 128;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    wil::unique_handle ProgramHandle;
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    UCHAR UdpPayload[] = "GenericRxMatchLpm";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    //
+    // A table with an unrelated default route, a covering prefix applying
+    // the rule's action, and an exact host route.
+    //
+    Prefixes[0].Address = RemoteIp;
+    Prefixes[0].PrefixLength = 0;
+    Prefixes[0].Action = XDP_IP_PREFIX_ACTION_SKIP;
+    Prefixes[1].Address = LocalIp;
+    Prefixes[1].PrefixLength = AddressBits / 2;
+    Prefixes[1].Action = XDP_IP_PREFIX_ACTION_RULE;
+    Prefixes[2].Address = LocalIp;
+    Prefixes[2].PrefixLength = AddressBits;
+    Prefixes[2].Action = XDP_IP_PREFIX_ACTION_RULE;
+
+    XDP_RULE Rule = {};
+    Rule.Match = (Af == AF_INET) ? XDP_MATCH_IPV4_DST_LPM : XDP_MATCH_IPV6_DST_LPM;
+    Rule.Pattern.PrefixTable.Prefixes = Prefixes;
+    Rule.Pattern.PrefixTable.PrefixCount = RTL_NUMBER_OF(Prefixes);
+    Rule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    //
+    // Verify the rule action is applied for a matching prefix.
+    //
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_TRUE(FAILED(FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
+    TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+
+    //
+    // Verify the longest prefix wins: skip the rule for the host route.
+    //
+    ProgramHandle.reset();
+    Prefixes[2].Action = XDP_IP_PREFIX_ACTION_SKIP;
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(
+        sizeof(UdpPayload),
+        FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+
+    //
+    // Verify a per-prefix action overrides the rule action.
+    //
+    ProgramHandle.reset();
+    Prefixes[2].Action = XDP_IP_PREFIX_ACTION_DROP;
+    Rule.Action = XDP_PROGRAM_ACTION_PASS;
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_TRUE(FAILED(FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
+    TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+
+    //
+    // Verify invalid prefix lengths are rejected.
+    //
+    ProgramHandle.reset();
+    Prefixes[2].PrefixLength = AddressBits + 1;
+    TEST_TRUE(
+        FAILED(
+            TryCreateXdpProg(
+                ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(),
+                XDP_GENERIC, &Rule, 1)));
+}
+
+VOID
+GenericRxMatchSource(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    XDP_INET_ADDR LocalIp, RemoteIp;
+    XDP_IP_PREFIX Prefix = {};
+    XDP_MASKED_TUPLE Tuples[2] = {};
+    const UINT32 AddressLength = (Af == AF_INET) ? sizeof(IN_ADDR) : sizeof(IN6_ADDR);
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    wil::unique_handle ProgramHandle;
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    UCHAR UdpPayload[] = "GenericRxMatchSource";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    //
+    // Verify frames from a source prefix are dropped.
+    //
+    Prefix.Address = RemoteIp;
+    Prefix.PrefixLength = (UINT8)(AddressLength * 8);
+    Prefix.Action = XDP_IP_PREFIX_ACTION_RULE;
+
+    XDP_RULE Rule = {};
+    Rule.Match = (Af == AF_INET) ? XDP_MATCH_IPV4_SRC_LPM : XDP_MATCH_IPV6_SRC_LPM;
+    Rule.Pattern.PrefixTable.Prefixes = &Prefix;
+    Rule.Pattern.PrefixTable.PrefixCount = 1;
+    Rule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_TRUE(FAILED(FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
+    TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+
+    //
+    // Verify a masked tuple wildcarding the source port matches, using two
+    // distinct masks.
+    //
+    ProgramHandle.reset();
+    RtlFillMemory(&Tuples[0].Mask.SourceAddress, AddressLength, 0xFF);
+    Tuples[0].Mask.DestinationPort = 0xFFFF;
+    Tuples[0].Mask.Protocol = 0xFF;
+    Tuples[0].Tuple.SourceAddress = RemoteIp;
+    Tuples[0].Tuple.DestinationPort = LocalPort;
+    Tuples[0].Tuple.Protocol = IPPROTO_UDP;
+    Tuples[1].Mask.SourcePort = 0xFFFF;
+    Tuples[1].Tuple.SourcePort = htons(ntohs(RemotePort) + 1);
+
+    Rule = {};
+    Rule.Match = (Af == AF_INET) ? XDP_MATCH_IPV4_MASKED_TUPLE : XDP_MATCH_IPV6_MASKED_TUPLE;
+    Rule.Pattern.TupleSet.Tuples = Tuples;
+    Rule.Pattern.TupleSet.TupleCount = RTL_NUMBER_OF(Tuples);
+    Rule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_TRUE(FAILED(FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
+    TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+
+    //
+    // Verify a masked tuple for another destination port does not match.
+    //
+    ProgramHandle.reset();
+    Tuples[0].Tuple.DestinationPort = htons(ntohs(LocalPort) + 1);
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(
+        sizeof(UdpPayload),
+        FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+
+    //
+    // Verify protocols other than TCP and UDP are rejected.
+    //
+    ProgramHandle.reset();
+    Tuples[0].Tuple.Protocol = IPPROTO_ICMP;
+    TEST_TRUE(
+        FAILED(
+            TryCreateXdpProg(
+                ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(),
+                XDP_GENERIC, &Rule, 1)));
+}
+
+VOID
+GenericRxUpdateRules(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    XDP_RULE DropRule = {};
+    XDP_RULE PassRule = {};
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    UCHAR UdpPayload[] = "GenericRxUpdateRules";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    DropRule.Match = XDP_MATCH_UDP_DST;
+    DropRule.Pattern.Port = LocalPort;
+    DropRule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    PassRule.Match = XDP_MATCH_UDP_DST;
+    PassRule.Pattern.Port = LocalPort;
+    PassRule.Action = XDP_PROGRAM_ACTION_PASS;
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &DropRule, 1);
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_TRUE(FAILED(FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
+    TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+
+    //
+    // Replace the drop rule with a pass rule in a single update.
+    //
+    ProgramUpdateRules(ProgramHandle.get(), 0, 1, &PassRule, 1);
+
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(
+        sizeof(UdpPayload),
+        FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+
+    //
+    // Insert a drop rule ahead of the pass rule; the first match wins.
+    //
+    ProgramUpdateRules(ProgramHandle.get(), 0, 0, &DropRule, 1);
+
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_TRUE(FAILED(FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
+    TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+
+    //
+    // Delete the drop rule, leaving only the pass rule.
+    //
+    ProgramUpdateRules(ProgramHandle.get(), 0, 1, NULL, 0);
+
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(
+        sizeof(UdpPayload),
+        FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+
+    //
+    // Verify out-of-range and emptying updates are rejected and leave the
+    // program unchanged.
+    //
+    TEST_TRUE(FAILED(TryProgramUpdateRules(ProgramHandle.get(), 1, 1, NULL, 0)));
+    TEST_TRUE(FAILED(TryProgramUpdateRules(ProgramHandle.get(), 2, 0, &DropRule, 1)));
+    TEST_TRUE(FAILED(TryProgramUpdateRules(ProgramHandle.get(), 0, 1, NULL, 0)));
+
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(
+        sizeof(UdpPayload),
+        FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+}
+
+VOID
+GenericRxProgramReplace()
+{
+    auto If = FnMpIf;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UCHAR UdpPayload[] = "GenericRxProgramReplace";
+    const UINT32 IterationCount = 16;
+    const UINT16 PortCount = 3;
+    struct {
+        UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+        UINT32 UdpFrameLength;
+    } Frames[PortCount];
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    for (UINT16 Index = 0; Index < PortCount; Index++) {
+        Frames[Index].UdpFrameLength = sizeof(Frames[Index].UdpFrame);
+        TEST_TRUE(
+            PktBuildUdpFrame(
+                Frames[Index].UdpFrame, &Frames[Index].UdpFrameLength, UdpPayload,
+                sizeof(UdpPayload), &LocalHw, &RemoteHw, AF_INET, &LocalIp, &RemoteIp,
+                htons(1000 + Index), htons(2000)));
+    }
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto XskA = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+    auto XskB = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+
+    auto IndicateFrame = [&](UINT16 PortIndex, MY_SOCKET *Socket) {
+        RX_FRAME Frame;
+        SocketProduceRxFill(Socket, 1);
+        RxInitializeFrame(
+            &Frame, If.GetQueueId(), Frames[PortIndex].UdpFrame, Frames[PortIndex].UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    };
+
+    auto VerifyRedirected = [&](UINT16 PortIndex, MY_SOCKET *Socket) {
+        IndicateFrame(PortIndex, Socket);
+
+        UINT32 ConsumerIndex = SocketConsumerReserve(&Socket->Rings.Rx, 1);
+        auto RxDesc = SocketGetAndFreeRxDesc(Socket, ConsumerIndex);
+        TEST_EQUAL(Frames[PortIndex].UdpFrameLength, RxDesc->Length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Socket->Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+                Frames[PortIndex].UdpFrame, Frames[PortIndex].UdpFrameLength));
+        XskRingConsumerRelease(&Socket->Rings.Rx, 1);
+    };
+
+    XDP_RULE RuleA = {};
+    RuleA.Match = XDP_MATCH_UDP_DST;
+    RuleA.Pattern.Port = htons(1000);
+    RuleA.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    RuleA.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    RuleA.Redirect.Target = XskA.Handle.get();
+
+    XDP_RULE RuleB = RuleA;
+    RuleB.Redirect.Target = XskB.Handle.get();
+
+    wil::unique_handle ProgramA =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &RuleA, 1);
+
+    //
+    // Attaching to and updating the rules of a queue that already runs a
+    // program retire the replaced program without waiting for the data path.
+    // Verify every frame indicated after either returns sees the new rules,
+    // while the rules of the program already attached remain in effect.
+    //
+    for (UINT32 Iteration = 0; Iteration < IterationCount; Iteration++) {
+        RuleB.Pattern.Port = htons(1001);
+        wil::unique_handle ProgramB =
+            CreateXdpProg(
+                If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &RuleB, 1);
+
+        VerifyRedirected(1, &XskB);
+        VerifyRedirected(0, &XskA);
+
+        RuleB.Pattern.Port = htons(1002);
+        ProgramUpdateRules(ProgramB.get(), 0, 1, &RuleB, 1);
+
+        VerifyRedirected(2, &XskB);
+        VerifyRedirected(0, &XskA);
+    }
+
+    //
+    // Verify the rules of the detached program no longer apply.
+    //
+    UINT32 ConsumerIndex;
+    IndicateFrame(2, &XskB);
+    Sleep(TEST_TIMEOUT_ASYNC_MS);
+    TEST_EQUAL(0, XskRingConsumerReserve(&XskB.Rings.Rx, MAXUINT32, &ConsumerIndex));
+
+    VerifyRedirected(0, &XskA);
+}
+
+VOID
+GenericRxRuleCounters(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    XDP_RULE Rules[2] = {};
+    XDP_RULE_COUNTERS Counters[3] = {};
+    UINT32 CountersSize;
+    const UINT32 FrameCount = 3;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    UCHAR UdpPayload[] = "GenericRxRuleCounters";
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    //
+    // A rule that never matches, followed by a rule matching every frame.
+    //
+    Rules[0].Match = XDP_MATCH_UDP_DST;
+    Rules[0].Pattern.Port = htons(ntohs(LocalPort) + 1);
+    Rules[0].Action = XDP_PROGRAM_ACTION_PASS;
+    Rules[1].Match = XDP_MATCH_UDP_DST;
+    Rules[1].Pattern.Port = LocalPort;
+    Rules[1].Action = XDP_PROGRAM_ACTION_DROP;
+
+    //
+    // Rule counters are only available when requested.
+    //
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+            RTL_NUMBER_OF(Rules));
+    CountersSize = sizeof(Counters);
+    TEST_TRUE(FAILED(TryProgramGetRuleCounters(ProgramHandle.get(), Counters, &CountersSize)));
+    ProgramHandle.reset();
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+            RTL_NUMBER_OF(Rules), XDP_CREATE_PROGRAM_FLAG_RULE_COUNTERS);
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    for (UINT32 i = 0; i < FrameCount; i++) {
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    }
+
+    CountersSize = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_MORE_DATA),
+        TryProgramGetRuleCounters(ProgramHandle.get(), NULL, &CountersSize));
+    TEST_EQUAL(sizeof(XDP_RULE_COUNTERS) * RTL_NUMBER_OF(Rules), CountersSize);
+
+    TEST_HRESULT(TryProgramGetRuleCounters(ProgramHandle.get(), Counters, &CountersSize));
+    TEST_EQUAL(0, Counters[0].Hits);
+    TEST_EQUAL(0, Counters[0].LastHitTime);
+    TEST_EQUAL(FrameCount, Counters[1].Hits);
+    TEST_NOT_EQUAL(0, Counters[1].LastHitTime);
+
+    //
+    // Counters of retained rules survive rule updates.
+    //
+    ProgramUpdateRules(ProgramHandle.get(), 0, 0, &Rules[0], 1);
+
+    CountersSize = sizeof(Counters);
+    TEST_HRESULT(TryProgramGetRuleCounters(ProgramHandle.get(), Counters, &CountersSize));
+    TEST_EQUAL(sizeof(Counters), CountersSize);
+    TEST_EQUAL(0, Counters[0].Hits);
+    TEST_EQUAL(0, Counters[1].Hits);
+    TEST_EQUAL(FrameCount, Counters[2].Hits);
+}
+
+VOID
+GenericRxAllQueuesDropOffload(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    XDP_RULE Rules[3] = {};
+    XDP_RULE_COUNTERS Counters[3] = {};
+    UINT32 CountersSize;
+    const UINT32 FrameCount = 3;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    //
+    // The leading drop rule is offloaded. The last drop rule follows a pass
+    // rule, so it must run in software.
+    //
+    Rules[0].Match = XDP_MATCH_UDP_DST;
+    Rules[0].Pattern.Port = LocalPort;
+    Rules[0].Action = XDP_PROGRAM_ACTION_DROP;
+    Rules[1].Match = XDP_MATCH_UDP_DST;
+    Rules[1].Pattern.Port = htons(ntohs(LocalPort) + 1);
+    Rules[1].Action = XDP_PROGRAM_ACTION_PASS;
+    Rules[2].Match = XDP_MATCH_UDP_DST;
+    Rules[2].Pattern.Port = htons(ntohs(LocalPort) + 2);
+    Rules[2].Action = XDP_PROGRAM_ACTION_DROP;
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+            RTL_NUMBER_OF(Rules),
+            XDP_CREATE_PROGRAM_FLAG_ALL_QUEUES | XDP_CREATE_PROGRAM_FLAG_RULE_COUNTERS);
+
+    UCHAR UdpPayload[] = "GenericRxAllQueuesDropOffload";
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    RX_FRAME Frame;
+
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    for (UINT32 i = 0; i < FrameCount; i++) {
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    }
+
+    UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, Rules[2].Pattern.Port, RemotePort));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    CountersSize = sizeof(Counters);
+    TEST_HRESULT(TryProgramGetRuleCounters(ProgramHandle.get(), Counters, &CountersSize));
+    TEST_EQUAL(0, Counters[0].Hits);
+    TEST_EQUAL(FrameCount, Counters[0].OffloadedHits);
+    TEST_EQUAL(0, Counters[1].OffloadedHits);
+    TEST_EQUAL(1, Counters[2].Hits);
+    TEST_EQUAL(0, Counters[2].OffloadedHits);
+
+    //
+    // Rules are no longer offloaded once preceded by a pass rule.
+    //
+    ProgramUpdateRules(ProgramHandle.get(), 0, 0, &Rules[1], 1);
+
+    UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    XDP_RULE_COUNTERS UpdatedCounters[4] = {};
+    CountersSize = sizeof(UpdatedCounters);
+    TEST_HRESULT(
+        TryProgramGetRuleCounters(ProgramHandle.get(), UpdatedCounters, &CountersSize));
+    TEST_EQUAL(1, UpdatedCounters[1].Hits);
+    TEST_EQUAL(0, UpdatedCounters[1].OffloadedHits);
+}
+
+VOID
+GenericRxFlightRecorder()
+{
+    auto If = FnMpIf;
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto InterfaceHandle = InterfaceOpen(If.GetIfIndex());
+    const UINT32 FrameCount = 3;
+    UINT32 BatchCount = 0;
+    UINT32 DropCount = 0;
+    UINT32 Size;
+
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_ALL;
+    Rule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    UCHAR Payload[] = "GenericRxFlightRecorder";
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+    for (UINT32 i = 0; i < FrameCount; i++) {
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    }
+
+    Size = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_MORE_DATA),
+        TryFlightRecorderGet(InterfaceHandle.get(), NULL, &Size));
+    TEST_NOT_EQUAL(0, Size);
+    TEST_EQUAL(0, Size % sizeof(XDP_FLIGHT_RECORD));
+
+    UINT32 SmallSize = sizeof(XDP_FLIGHT_RECORD);
+    XDP_FLIGHT_RECORD SmallRecord;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER),
+        TryFlightRecorderGet(InterfaceHandle.get(), &SmallRecord, &SmallSize));
+
+    unique_malloc_ptr<XDP_FLIGHT_RECORD> Records{(XDP_FLIGHT_RECORD *)malloc(Size)};
+    TEST_NOT_NULL(Records.get());
+    TEST_HRESULT(TryFlightRecorderGet(InterfaceHandle.get(), Records.get(), &Size));
+    TEST_EQUAL(0, Size % sizeof(XDP_FLIGHT_RECORD));
+
+    for (UINT32 i = 0; i < Size / sizeof(XDP_FLIGHT_RECORD); i++) {
+        const XDP_FLIGHT_RECORD *Record = &Records.get()[i];
+
+        //
+        // Only the queried interface's events are returned.
+        //
+        TEST_EQUAL(If.GetIfIndex(), Record->IfIndex);
+        TEST_NOT_EQUAL(0, Record->Timestamp);
+
+        if (Record->QueueId != If.GetQueueId()) {
+            continue;
+        }
+
+        if (Record->Event == XDP_FLIGHT_RECORD_EVENT_RX_BATCH) {
+            BatchCount++;
+        } else if (Record->Event == XDP_FLIGHT_RECORD_EVENT_RX_DROP) {
+            DropCount += Record->Count;
+        }
+    }
+
+    TEST_TRUE(BatchCount >= FrameCount);
+    TEST_TRUE(DropCount >= FrameCount);
+}
+
+VOID
+GenericRxTuning()
+{
+    auto If = FnMpIf;
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto InterfaceHandle = InterfaceOpen(If.GetIfIndex());
+    XDP_RULE_COUNTERS Counters;
+    UINT32 CountersSize;
+    const UINT32 FrameCount = 3;
+
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_ALL;
+    Rule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1,
+            XDP_CREATE_PROGRAM_FLAG_RULE_COUNTERS);
+
+    //
+    // Out-of-range values and unknown parameters are rejected, and a batch
+    // containing any invalid setting applies none of them.
+    //
+    XDP_TUNING_SETTING InvalidSettings[] = {
+        { XDP_TUNING_PARAMETER_GENERIC_EC_BUDGET, 0 },
+        { XDP_TUNING_PARAMETER_GENERIC_TX_INSPECT_BATCH_SIZE, 1025 },
+        { XDP_TUNING_PARAMETER_GENERIC_RX_CLONE_CACHE_LIMIT, 4097 },
+    };
+    for (UINT32 i = 0; i < RTL_NUMBER_OF(InvalidSettings); i++) {
+        TEST_EQUAL(
+            HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+            TryInterfaceSetTuning(InterfaceHandle.get(), &InvalidSettings[i], 1));
+    }
+
+    XDP_TUNING_SETTING UnknownSetting = { (XDP_TUNING_PARAMETER)0, 1 };
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED),
+        TryInterfaceSetTuning(InterfaceHandle.get(), &UnknownSetting, 1));
+
+    //
+    // Valid settings apply to the existing queue without restarting it: the
+    // program keeps inspecting frames with the smallest budget.
+    //
+    XDP_TUNING_SETTING Settings[] = {
+        { XDP_TUNING_PARAMETER_GENERIC_EC_BUDGET, 1 },
+        { XDP_TUNING_PARAMETER_GENERIC_TX_INSPECT_BATCH_SIZE, 1 },
+        { XDP_TUNING_PARAMETER_GENERIC_RX_CLONE_CACHE_LIMIT, 0 },
+    };
+    TEST_HRESULT(
+        TryInterfaceSetTuning(InterfaceHandle.get(), Settings, RTL_NUMBER_OF(Settings)));
+
+    UCHAR Payload[] = "GenericRxTuning";
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+    for (UINT32 i = 0; i < FrameCount; i++) {
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    }
+
+    CountersSize = sizeof(Counters);
+    TEST_HRESULT(TryProgramGetRuleCounters(ProgramHandle.get(), &Counters, &CountersSize));
+    TEST_EQUAL(FrameCount, Counters.Hits);
+
+    //
+    // Restore the defaults for subsequent tests.
+    //
+    Settings[0].Value = 256;
+    Settings[1].Value = 64;
+    Settings[2].Value = 256;
+    TEST_HRESULT(
+        TryInterfaceSetTuning(InterfaceHandle.get(), Settings, RTL_NUMBER_OF(Settings)));
+}
+
+VOID
+GenericRxL2FwdCloneCache()
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort = htons(1234);
+    UINT16 RemotePort = htons(4321);
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    const UINT32 ProcessorCount = GetProcessorCount();
+
+    if (ProcessorCount < 2) {
+        TEST_WARNING("Test requires at least 2 logical processors. Skipping.");
+        return;
+    }
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto InterfaceHandle = InterfaceOpen(If.GetIfIndex());
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    //
+    // Limit the queue to a single clone NBL, so every forward after the first
+    // reuses the clone returned by the previous TX completion.
+    //
+    XDP_TUNING_SETTING Setting = { XDP_TUNING_PARAMETER_GENERIC_RX_CLONE_CACHE_LIMIT, 1 };
+    TEST_HRESULT(TryInterfaceSetTuning(InterfaceHandle.get(), &Setting, 1));
+    auto TuningScopeGuard = wil::scope_exit([&]
+    {
+        Setting.Value = 256;
+        TEST_HRESULT(TryInterfaceSetTuning(InterfaceHandle.get(), &Setting, 1));
+    });
+
+    XDP_RULE Rule;
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_L2FWD;
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    const UCHAR Payload[] = "GenericRxL2FwdCloneCache";
+    UCHAR PacketBuffer[UDP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 PacketBufferLength = sizeof(PacketBuffer);
+    UCHAR L2FwdBuffer[sizeof(PacketBuffer)];
+    UINT32 L2FwdLength = sizeof(L2FwdBuffer);
+    UCHAR Mask[sizeof(PacketBuffer)];
+
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            PacketBuffer, &PacketBufferLength, Payload, sizeof(Payload), &LocalHw,
+            &RemoteHw, AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            L2FwdBuffer, &L2FwdLength, Payload, sizeof(Payload), &RemoteHw,
+            &LocalHw, AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    RtlFillMemory(Mask, sizeof(Mask), 0xFF);
+
+    auto MpFilter = MpTxFilter(GenericMp, L2FwdBuffer, Mask, L2FwdLength);
+
+    //
+    // Forward a frame and complete its TX on each processor in turn. Each
+    // completion returns the clone to a different processor's magazine, so
+    // the next forward must find it outside the magazine that refilled the
+    // cache last.
+    //
+    for (UINT32 Index = 0; Index < ProcessorCount * 2; Index++) {
+        GROUP_AFFINITY Affinity = {0};
+        PROCESSOR_NUMBER ProcessorNumber;
+
+        ProcessorIndexToProcessorNumber(Index % ProcessorCount, &ProcessorNumber);
+        Affinity.Group = ProcessorNumber.Group;
+        Affinity.Mask = (KAFFINITY)1 << ProcessorNumber.Number;
+        TEST_TRUE(SetThreadGroupAffinity(GetCurrentThread(), &Affinity, NULL));
+
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        auto TxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
+        UINT32 TotalLength = 0;
+        for (UINT32 i = 0; i < TxFrame->BufferCount; i++) {
+            TotalLength += TxFrame->Buffers[i].DataLength;
+        }
+        TEST_EQUAL(L2FwdLength, TotalLength);
+
+        MpTxDequeueFrame(GenericMp, 0);
+        MpTxFlush(GenericMp);
+    }
+}
+
+VOID
+GenericRxLowResources()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET6;
+    UINT16 LocalPort, LocalXskPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+
+    LocalXskPort = htons(ntohs(LocalPort) + 1);
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv6Address(&LocalIp.Ipv6);
+    If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+
+    UCHAR UdpMatchPayload[] = "GenericRxLowResourcesMatch";
+    UCHAR UdpMatchFrame[UDP_HEADER_STORAGE + sizeof(UdpMatchPayload)];
+    UINT32 UdpMatchFrameLength = sizeof(UdpMatchFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpMatchFrame, &UdpMatchFrameLength, UdpMatchPayload, sizeof(UdpMatchPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalXskPort, RemotePort));
+
+    UCHAR UdpNoMatchPayload[] = "GenericRxLowResourcesNoMatch";
+    UCHAR UdpNoMatchFrame[UDP_HEADER_STORAGE + sizeof(UdpNoMatchPayload)];
+    UINT32 UdpNoMatchFrameLength = sizeof(UdpNoMatchFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpNoMatchFrame, &UdpNoMatchFrameLength, UdpNoMatchPayload, sizeof(UdpNoMatchPayload),
+            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    XDP_RULE Rule;
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalXskPort;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Redirect.Target = Xsk.Handle.get();
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    //
+    // Low resource handling requires logically splitting a chain of NBLs and
+    // returning the original chain to the caller. The FNMP driver verifies the
+    // NDIS contract, and this test verifies observable behavior.
+    //
+    const UINT32 NumMatchFrames = 4;
+    const UINT32 NumNoMatchFrames = 4;
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpMatchFrame, UdpMatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpNoMatchFrame, UdpNoMatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpNoMatchFrame, UdpNoMatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpMatchFrame, UdpMatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpNoMatchFrame, UdpNoMatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpMatchFrame, UdpMatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpMatchFrame, UdpMatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpNoMatchFrame, UdpNoMatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+
+    SocketProduceRxFill(&Xsk, NumMatchFrames);
+
+    DATA_FLUSH_OPTIONS FlushOptions = {0};
+    FlushOptions.Flags.LowResources = TRUE;
+    TEST_HRESULT(TryMpRxFlush(GenericMp, &FlushOptions));
+
+    //
+    // Verify the match NBLs propagated correctly to XSK.
+    //
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, NumMatchFrames);
+    TEST_EQUAL(NumMatchFrames, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+
+    for (UINT32 Index = 0; Index < NumMatchFrames; Index++) {
+        auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex++);
+        TEST_EQUAL(UdpMatchFrameLength, RxDesc->Length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+                UdpMatchFrame,
+                UdpMatchFrameLength));
+    }
+
+    //
+    // Verify the no-match NBLs propagated past XDP to the local stack.
+    //
+    CHAR RecvPayload[sizeof(UdpNoMatchPayload)];
+    for (UINT32 Index = 0; Index < NumNoMatchFrames; Index++) {
+        TEST_EQUAL(
+            sizeof(UdpNoMatchPayload),
+            FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+        TEST_TRUE(RtlEqualMemory(UdpNoMatchPayload, RecvPayload, sizeof(UdpNoMatchPayload)));
+    }
+
+    TEST_TRUE(FAILED(FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0)));
+    TEST_EQUAL(WSAETIMEDOUT, FnSockGetLastError());
+}
+
+//
+// The size of each preallocated buffer generic XDP copies low resources
+// forwards into.
+//
+#define GENERIC_RX_COPY_BUFFER_SIZE 2048
+
+VOID
+GenericRxLowResourcesL2Fwd()
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort = htons(1234);
+    UINT16 RemotePort = htons(4321);
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    const UINT32 FrameCount = 40;
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    XDP_RULE Rule;
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_L2FWD;
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    //
+    // Build frames that fit the copy buffers and frames that do not, and the
+    // frames L2FWD transmits for each.
+    //
+    std::vector<std::vector<UCHAR>> Packets(FrameCount);
+    std::vector<std::vector<UCHAR>> L2FwdPackets(FrameCount);
+
+    for (UINT32 Index = 0; Index < FrameCount; Index++) {
+        std::vector<UCHAR> Payload((Index % 4 == 3) ? GENERIC_RX_COPY_BUFFER_SIZE : 64);
+        UINT32 PacketLength = UDP_HEADER_STORAGE + (UINT32)Payload.size();
+        UINT32 L2FwdLength = PacketLength;
+
+        std::generate(Payload.begin(), Payload.end(), []{ return (UCHAR)std::rand(); });
+        Packets[Index].resize(PacketLength);
+        L2FwdPackets[Index].resize(L2FwdLength);
+
+        TEST_TRUE(
+            PktBuildUdpFrame(
+                &Packets[Index][0], &PacketLength, &Payload[0], (UINT16)Payload.size(),
+                &LocalHw, &RemoteHw, AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+        TEST_TRUE(
+            PktBuildUdpFrame(
+                &L2FwdPackets[Index][0], &L2FwdLength, &Payload[0], (UINT16)Payload.size(),
+                &RemoteHw, &LocalHw, AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+        Packets[Index].resize(PacketLength);
+        L2FwdPackets[Index].resize(L2FwdLength);
+    }
+
+    //
+    // Capture the forwarded frames by their Ethernet header and UDP ports.
+    //
+    const UINT32 PortsOffset = sizeof(ETHERNET_HEADER) + sizeof(IPV4_HEADER);
+    UCHAR Mask[PortsOffset + 2 * sizeof(UINT16)] = {0};
+    RtlFillMemory(Mask, sizeof(ETHERNET_HEADER), 0xFF);
+    RtlFillMemory(Mask + PortsOffset, 2 * sizeof(UINT16), 0xFF);
+
+    auto MpFilter = MpTxFilter(GenericMp, &L2FwdPackets[0][0], Mask, sizeof(Mask));
+
+    //
+    // Forward more frames than there are copy buffers in one low resources
+    // indication, and hold all their sends, so the copies exhaust the buffers
+    // and fall back to NDIS allocations. Repeat after completing the sends to
+    // verify the buffers are returned.
+    //
+    for (UINT32 Round = 0; Round < 2; Round++) {
+        for (UINT32 Index = 0; Index < FrameCount; Index++) {
+            RX_FRAME Frame;
+            RxInitializeFrame(
+                &Frame, If.GetQueueId(), &Packets[Index][0], (UINT32)Packets[Index].size());
+            TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+        }
+
+        DATA_FLUSH_OPTIONS FlushOptions = {0};
+        FlushOptions.Flags.LowResources = TRUE;
+        TEST_HRESULT(TryMpRxFlush(GenericMp, &FlushOptions));
+
+        for (UINT32 Index = 0; Index < FrameCount; Index++) {
+            auto TxFrame = MpTxAllocateAndGetFrame(GenericMp, Index);
+            const std::vector<UCHAR> &L2FwdPacket = L2FwdPackets[Index];
+            UINT32 TotalLength = 0;
+
+            for (UINT32 i = 0; i < TxFrame->BufferCount; i++) {
+                const DATA_BUFFER *Buffer = &TxFrame->Buffers[i];
+                TEST_TRUE(Buffer->DataLength <= L2FwdPacket.size() - TotalLength);
+                TEST_TRUE(
+                    RtlEqualMemory(
+                        Buffer->VirtualAddress + Buffer->DataOffset, &L2FwdPacket[TotalLength],
+                        Buffer->DataLength));
+                TotalLength += Buffer->DataLength;
+            }
+            TEST_EQUAL(L2FwdPacket.size(), TotalLength);
+        }
+
+        for (UINT32 Index = 0; Index < FrameCount; Index++) {
+            MpTxDequeueFrame(GenericMp, 0);
+        }
+        MpTxFlush(GenericMp);
+    }
+}
+
+VOID
+GenericRxMultiSocket()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UCHAR UdpMatchPayload[] = "GenericRxMultiSocket";
+    struct {
+        MY_SOCKET Xsk;
+        UINT16 LocalPort;
+        UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpMatchPayload)];
+        UINT32 UdpFrameLength;
+    } Sockets[2];
+    XDP_RULE Rules[RTL_NUMBER_OF(Sockets)] = {};
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        Sockets[Index].Xsk =
+            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+        Sockets[Index].LocalPort = htons(1000 + Index);
+        Sockets[Index].UdpFrameLength = sizeof(Sockets[Index].UdpFrame);
+        TEST_TRUE(
+            PktBuildUdpFrame(
+                Sockets[Index].UdpFrame, &Sockets[Index].UdpFrameLength, UdpMatchPayload,
+                sizeof(UdpMatchPayload), &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp,
+                Sockets[Index].LocalPort, htons(2000)));
+
+        Rules[Index].Match = XDP_MATCH_UDP_DST;
+        Rules[Index].Pattern.Port = Sockets[Index].LocalPort;
+        Rules[Index].Action = XDP_PROGRAM_ACTION_REDIRECT;
+        Rules[Index].Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+        Rules[Index].Redirect.Target = Sockets[Index].Xsk.Handle.get();
+    }
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            Rules, RTL_NUMBER_OF(Rules));
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        auto &Socket = Sockets[Index].Xsk;
+        DATA_BUFFER Buffer = {0};
+
+        SocketProduceRxFill(&Socket, 1);
+
+        Buffer.DataOffset = 0;
+        Buffer.DataLength = Sockets[Index].UdpFrameLength;
+        Buffer.BufferLength = Buffer.DataLength;
+        Buffer.VirtualAddress = Sockets[Index].UdpFrame;
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), &Buffer);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+
+        //
+        // Verify the NBL propagated correctly to XSK.
+        //
+        TEST_EQUAL(1, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+        auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+        TEST_EQUAL(Buffer.DataLength, RxDesc->Length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+                Buffer.VirtualAddress + Buffer.DataOffset,
+                Buffer.DataLength));
+    }
+}
+
+VOID
+GenericRxMultiSocketInterleaved()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UCHAR UdpMatchPayload[] = "GenericRxMultiSocketInterleaved";
+    const UINT32 FramesPerSocket = 4;
+    struct {
+        MY_SOCKET Xsk;
+        UINT16 LocalPort;
+        UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpMatchPayload)];
+        UINT32 UdpFrameLength;
+    } Sockets[3];
+    XDP_RULE Rules[RTL_NUMBER_OF(Sockets)] = {};
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        Sockets[Index].Xsk =
+            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+        Sockets[Index].LocalPort = htons(1000 + Index);
+        Sockets[Index].UdpFrameLength = sizeof(Sockets[Index].UdpFrame);
+        TEST_TRUE(
+            PktBuildUdpFrame(
+                Sockets[Index].UdpFrame, &Sockets[Index].UdpFrameLength, UdpMatchPayload,
+                sizeof(UdpMatchPayload), &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp,
+                Sockets[Index].LocalPort, htons(2000)));
+
+        Rules[Index].Match = XDP_MATCH_UDP_DST;
+        Rules[Index].Pattern.Port = Sockets[Index].LocalPort;
+        Rules[Index].Action = XDP_PROGRAM_ACTION_REDIRECT;
+        Rules[Index].Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+        Rules[Index].Redirect.Target = Sockets[Index].Xsk.Handle.get();
+
+        SocketProduceRxFill(&Sockets[Index].Xsk, FramesPerSocket);
+    }
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            Rules, RTL_NUMBER_OF(Rules));
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    //
+    // Indicate a single receive batch alternating between every socket.
+    //
+    for (UINT32 FrameIndex = 0; FrameIndex < FramesPerSocket; FrameIndex++) {
+        for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+            RX_FRAME Frame;
+            RxInitializeFrame(
+                &Frame, If.GetQueueId(), Sockets[Index].UdpFrame, Sockets[Index].UdpFrameLength);
+            TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+        }
+    }
+
+    MpRxFlush(GenericMp);
+
+    //
+    // Verify every socket received all of its frames.
+    //
+    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        auto &Socket = Sockets[Index].Xsk;
+        UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, FramesPerSocket);
+
+        for (UINT32 FrameIndex = 0; FrameIndex < FramesPerSocket; FrameIndex++) {
+            auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex++);
+            TEST_EQUAL(Sockets[Index].UdpFrameLength, RxDesc->Length);
+            TEST_TRUE(
+                RtlEqualMemory(
+                    Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress +
+                        RxDesc->Address.Offset,
+                    Sockets[Index].UdpFrame,
+                    Sockets[Index].UdpFrameLength));
+        }
+    }
+}
+
+VOID
+GenericRxBatchFragments()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UCHAR UdpPayload[] = "GenericRxBatchFragments0";
+    const UINT16 MatchPort = htons(1234);
+    const UINT16 FrameCount = 8;
+    struct {
+        UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+        UINT32 UdpFrameLength;
+        DATA_BUFFER Buffers[3];
+        UINT16 BufferCount;
+        BOOLEAN Match;
+    } Frames[FrameCount];
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = MatchPort;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Redirect.Target = Xsk.Handle.get();
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    //
+    // Build a batch alternating between frames redirected to the socket and
+    // frames passed to the stack, where every other pair is split into
+    // fragment buffers within the headers. Each frame's verdict and contents
+    // depend on the batch inspection tracking fragments across frames.
+    //
+    UINT32 MatchCount = 0;
+    for (UINT16 Index = 0; Index < FrameCount; Index++) {
+        auto &Frame = Frames[Index];
+
+        Frame.Match = (Index % 2) == 0;
+        MatchCount += Frame.Match;
+        UdpPayload[sizeof(UdpPayload) - 2] = (UCHAR)('0' + Index);
+        Frame.UdpFrameLength = sizeof(Frame.UdpFrame);
+        TEST_TRUE(
+            PktBuildUdpFrame(
+                Frame.UdpFrame, &Frame.UdpFrameLength, UdpPayload, sizeof(UdpPayload),
+                &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp,
+                Frame.Match ? MatchPort : htons(4321), htons(2000)));
+
+        UINT32 SplitIndexes[] = {
+            sizeof(ETHERNET_HEADER) / 2,
+            sizeof(ETHERNET_HEADER) + sizeof(IPV4_HEADER) + 1,
+        };
+        UINT32 Offset = 0;
+
+        Frame.BufferCount = 0;
+        if ((Index / 2) % 2 == 1) {
+            for (UINT16 Split = 0; Split < RTL_NUMBER_OF(SplitIndexes); Split++) {
+                DATA_BUFFER *Buffer = &Frame.Buffers[Frame.BufferCount++];
+                RtlZeroMemory(Buffer, sizeof(*Buffer));
+                Buffer->DataLength = SplitIndexes[Split] - Offset;
+                Buffer->BufferLength = Buffer->DataLength;
+                Buffer->VirtualAddress = Frame.UdpFrame + Offset;
+                Offset = SplitIndexes[Split];
+            }
+        }
+
+        DATA_BUFFER *Buffer = &Frame.Buffers[Frame.BufferCount++];
+        RtlZeroMemory(Buffer, sizeof(*Buffer));
+        Buffer->DataLength = Frame.UdpFrameLength - Offset;
+        Buffer->BufferLength = Buffer->DataLength;
+        Buffer->VirtualAddress = Frame.UdpFrame + Offset;
+
+        RX_FRAME RxFrame;
+        RxInitializeFrame(&RxFrame, If.GetQueueId(), Frame.Buffers, Frame.BufferCount);
+        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &RxFrame));
+    }
+
+    SocketProduceRxFill(&Xsk, FrameCount);
+    MpRxFlush(GenericMp);
+
+    //
+    // Verify the socket received exactly the matching frames, in order and
+    // intact.
+    //
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, MatchCount);
+    TEST_EQUAL(MatchCount, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+
+    for (UINT16 Index = 0; Index < FrameCount; Index++) {
+        auto &Frame = Frames[Index];
+
+        if (!Frame.Match) {
+            continue;
+        }
+
+        auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex++);
+        TEST_EQUAL(Frame.UdpFrameLength, RxDesc->Length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+                Frame.UdpFrame, Frame.UdpFrameLength));
+    }
+}
+
+VOID
+GenericRxMultiSocketPortSet()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UCHAR UdpMatchPayload[] = "GenericRxMultiSocketPortSet";
+    const UINT32 PortsPerSocket = 2;
+    struct {
+        MY_SOCKET Xsk;
+        unique_malloc_ptr<UINT8> PortSet;
+        UCHAR UdpFrame[PortsPerSocket][UDP_HEADER_STORAGE + sizeof(UdpMatchPayload)];
+        UINT32 UdpFrameLength[PortsPerSocket];
+    } Sockets[3];
+    XDP_RULE Rules[RTL_NUMBER_OF(Sockets)] = {};
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    //
+    // Each socket receives a set of UDP ports, which is steered without the
+    // generic rule inspection.
+    //
+    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        Sockets[Index].Xsk =
+            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+        Sockets[Index].PortSet.reset((UINT8 *)calloc(XDP_PORT_SET_BUFFER_SIZE, 1));
+        TEST_NOT_NULL(Sockets[Index].PortSet.get());
+
+        for (UINT16 PortIndex = 0; PortIndex < PortsPerSocket; PortIndex++) {
+            UINT16 LocalPort = htons(1000 + PortIndex * 100 + Index);
+
+            SetBit(Sockets[Index].PortSet.get(), LocalPort);
+            Sockets[Index].UdpFrameLength[PortIndex] = sizeof(Sockets[Index].UdpFrame[PortIndex]);
+            TEST_TRUE(
+                PktBuildUdpFrame(
+                    Sockets[Index].UdpFrame[PortIndex], &Sockets[Index].UdpFrameLength[PortIndex],
+                    UdpMatchPayload, sizeof(UdpMatchPayload), &LocalHw, &RemoteHw, Af, &LocalIp,
+                    &RemoteIp, LocalPort, htons(2000)));
+        }
+
+        Rules[Index].Match = XDP_MATCH_UDP_PORT_SET;
+        Rules[Index].Pattern.PortSet.PortSet = Sockets[Index].PortSet.get();
+        Rules[Index].Action = XDP_PROGRAM_ACTION_REDIRECT;
+        Rules[Index].Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+        Rules[Index].Redirect.Target = Sockets[Index].Xsk.Handle.get();
+
+        SocketProduceRxFill(&Sockets[Index].Xsk, PortsPerSocket);
+    }
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            Rules, RTL_NUMBER_OF(Rules));
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    //
+    // Indicate a single receive batch alternating between every socket.
+    //
+    for (UINT16 PortIndex = 0; PortIndex < PortsPerSocket; PortIndex++) {
+        for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+            RX_FRAME Frame;
+            RxInitializeFrame(
+                &Frame, If.GetQueueId(), Sockets[Index].UdpFrame[PortIndex],
+                Sockets[Index].UdpFrameLength[PortIndex]);
+            TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+        }
+    }
+
+    MpRxFlush(GenericMp);
+
+    //
+    // Verify every socket received the frames for each of its ports in order.
+    //
+    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        auto &Socket = Sockets[Index].Xsk;
+        UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, PortsPerSocket);
+
+        for (UINT16 PortIndex = 0; PortIndex < PortsPerSocket; PortIndex++) {
+            auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex++);
+            TEST_EQUAL(Sockets[Index].UdpFrameLength[PortIndex], RxDesc->Length);
+            TEST_TRUE(
+                RtlEqualMemory(
+                    Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress +
+                        RxDesc->Address.Offset,
+                    Sockets[Index].UdpFrame[PortIndex],
+                    Sockets[Index].UdpFrameLength[PortIndex]));
+        }
+    }
+}
+
+VOID
+GenericRxXskMapRedirect(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UCHAR UdpPayload[] = "GenericRxXskMapRedirect";
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    const UINT16 LocalPort = htons(1000);
+    const UINT32 FlowCount = 32;
+    MY_SOCKET Sockets[4];
+    HANDLE SocketHandles[RTL_NUMBER_OF(Sockets)];
+    UINT32 FlowSockets[FlowCount];
+    UINT32 SocketFlowCounts[RTL_NUMBER_OF(Sockets)] = {0};
+    XDP_XSK_MAP XskMap;
+    XDP_RULE Rule = {};
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        Sockets[Index] =
+            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+        SocketHandles[Index] = Sockets[Index].Handle.get();
+        SocketProduceRxFill(&Sockets[Index], 1);
+    }
+
+    XskMap.Sockets = SocketHandles;
+    XskMap.SocketCount = RTL_NUMBER_OF(SocketHandles);
+
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK_MAP;
+    Rule.Redirect.XskMap = &XskMap;
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    //
+    // Indicate each flow twice and verify both frames reach the same socket.
+    //
+    for (UINT32 Round = 0; Round < 2; Round++) {
+        for (UINT32 Flow = 0; Flow < FlowCount; Flow++) {
+            UINT32 UdpFrameLength = sizeof(UdpFrame);
+            TEST_TRUE(
+                PktBuildUdpFrame(
+                    UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+                    &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, htons((UINT16)(2000 + Flow))));
+
+            RX_FRAME Frame;
+            RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+            TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+            UINT32 ReceivedIndex = MAXUINT32;
+            UINT32 ConsumerIndex;
+            Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+            do {
+                for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+                    if (XskRingConsumerReserve(&Sockets[Index].Rings.Rx, 1, &ConsumerIndex) == 1) {
+                        ReceivedIndex = Index;
+                        break;
+                    }
+                }
+            } while (ReceivedIndex == MAXUINT32 && !Watchdog.IsExpired());
+
+            TEST_NOT_EQUAL(MAXUINT32, ReceivedIndex);
+            auto &Socket = Sockets[ReceivedIndex];
+            auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+            TEST_EQUAL(UdpFrameLength, RxDesc->Length);
+            TEST_TRUE(
+                RtlEqualMemory(
+                    Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress +
+                        RxDesc->Address.Offset,
+                    UdpFrame, UdpFrameLength));
+            XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+            SocketProduceRxFill(&Socket, 1);
+
+            if (Round == 0) {
+                FlowSockets[Flow] = ReceivedIndex;
+                SocketFlowCounts[ReceivedIndex]++;
+            } else {
+                TEST_EQUAL(FlowSockets[Flow], ReceivedIndex);
+            }
+        }
+    }
+
+    //
+    // Verify the flows were spread across more than one socket.
+    //
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        TEST_TRUE(SocketFlowCounts[Index] < FlowCount);
+    }
+
+    //
+    // Verify empty and oversized socket maps are rejected.
+    //
+    XskMap.SocketCount = 0;
+    TEST_TRUE(
+        FAILED(TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1)));
+
+    XskMap.SocketCount = XDP_XSK_MAP_MAX_SOCKETS + 1;
+    TEST_TRUE(
+        FAILED(TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1)));
+}
+
+VOID
+GenericRxXskFanoutRedirect(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UCHAR UdpPayload[] = "GenericRxXskFanoutRedirect";
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    const UINT16 LocalPort = htons(1000);
+    const UINT32 FrameCount = 4;
+    MY_SOCKET Sockets[3];
+    HANDLE SocketHandles[RTL_NUMBER_OF(Sockets)];
+    XDP_XSK_MAP XskMap;
+    XDP_RULE Rule = {};
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    //
+    // Leave the last socket a single fill buffer, so it misses all but the
+    // first frame while the other sockets receive every frame.
+    //
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        Sockets[Index] =
+            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+        SocketHandles[Index] = Sockets[Index].Handle.get();
+        SocketProduceRxFill(
+            &Sockets[Index], (Index + 1 < RTL_NUMBER_OF(Sockets)) ? FrameCount : 1);
+    }
+
+    XskMap.Sockets = SocketHandles;
+    XskMap.SocketCount = RTL_NUMBER_OF(SocketHandles);
+
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK_FANOUT;
+    Rule.Redirect.XskMap = &XskMap;
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw, &RemoteHw, Af,
+            &LocalIp, &RemoteIp, LocalPort, htons(2000)));
+
+    for (UINT32 Index = 0; Index < FrameCount; Index++) {
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    }
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        auto &Socket = Sockets[Index];
+        const UINT32 ExpectedCount = (Index + 1 < RTL_NUMBER_OF(Sockets)) ? FrameCount : 1;
+
+        for (UINT32 Received = 0; Received < ExpectedCount; Received++) {
+            UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+            auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+            TEST_EQUAL(UdpFrameLength, RxDesc->Length);
+            TEST_TRUE(
+                RtlEqualMemory(
+                    Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress +
+                        RxDesc->Address.Offset,
+                    UdpFrame, UdpFrameLength));
+            XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+        }
+    }
+
+    //
+    // Verify the socket that ran out of fill buffers received nothing more.
+    //
+    UINT32 ConsumerIndex;
+    TEST_EQUAL(
+        0,
+        XskRingConsumerReserve(
+            &Sockets[RTL_NUMBER_OF(Sockets) - 1].Rings.Rx, 1, &ConsumerIndex));
+
+    //
+    // Verify a fanout to the same socket twice is rejected.
+    //
+    SocketHandles[1] = SocketHandles[0];
+    TEST_TRUE(
+        FAILED(TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1)));
+}
+
+VOID
+GenericRxQuicLbRedirect(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UCHAR QuicPayload[32] = {};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(QuicPayload)];
+    const UINT16 LocalPort = htons(443);
+    const UINT8 ConfigId = 2;
+    MY_SOCKET Sockets[3];
+    XDP_QUIC_LB_SERVER Servers[RTL_NUMBER_OF(Sockets)] = {};
+    XDP_QUIC_LB QuicLb = {};
+    XDP_RULE Rule = {};
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        Sockets[Index] =
+            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+        Servers[Index].Socket = Sockets[Index].Handle.get();
+        Servers[Index].ServerId[0] = 0xA0;
+        Servers[Index].ServerId[1] = (UINT8)(0x10 + Index);
+        SocketProduceRxFill(&Sockets[Index], 2);
+    }
+
+    QuicLb.ConfigId = ConfigId;
+    QuicLb.ServerIdLength = 2;
+    QuicLb.Servers = Servers;
+    QuicLb.ServerCount = RTL_NUMBER_OF(Servers);
+
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_QUIC_LB;
+    Rule.Redirect.QuicLb = &QuicLb;
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    //
+    // Indicates a short header packet whose destination CID starts with the
+    // given first byte and server ID, and returns the socket it reached.
+    //
+    auto IndicateAndReceive = [&](UINT8 CidFirstByte, const UINT8 *ServerId) -> UINT32 {
+        UINT32 UdpFrameLength = sizeof(UdpFrame);
+
+        QuicPayload[0] = 0x40;
+        QuicPayload[1] = CidFirstByte;
+        RtlCopyMemory(&QuicPayload[2], ServerId, QuicLb.ServerIdLength);
+        TEST_TRUE(
+            PktBuildUdpFrame(
+                UdpFrame, &UdpFrameLength, QuicPayload, sizeof(QuicPayload), &LocalHw,
+                &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, htons(2000)));
+
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        UINT32 ReceivedIndex = MAXUINT32;
+        UINT32 ConsumerIndex;
+        Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+        do {
+            for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+                if (XskRingConsumerReserve(&Sockets[Index].Rings.Rx, 1, &ConsumerIndex) == 1) {
+                    ReceivedIndex = Index;
+                    break;
+                }
+            }
+        } while (ReceivedIndex == MAXUINT32 && !Watchdog.IsExpired());
+
+        TEST_NOT_EQUAL(MAXUINT32, ReceivedIndex);
+        auto &Socket = Sockets[ReceivedIndex];
+        auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+        TEST_EQUAL(UdpFrameLength, RxDesc->Length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+                UdpFrame, UdpFrameLength));
+        XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+        SocketProduceRxFill(&Socket, 1);
+
+        return ReceivedIndex;
+    };
+
+    //
+    // Verify each server ID steers to its server's socket, regardless of the
+    // low bits of the first CID byte.
+    //
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Servers); Index++) {
+        TEST_EQUAL(
+            Index,
+            IndicateAndReceive((UINT8)((ConfigId << 5) | Index), Servers[Index].ServerId));
+    }
+
+    //
+    // Verify unknown server IDs and unroutable configuration IDs still reach a
+    // socket via the flow hash.
+    //
+    const UINT8 UnknownServerId[XDP_QUIC_LB_MAX_SERVER_ID_LENGTH] = {0xFF, 0xFF};
+    IndicateAndReceive((UINT8)(ConfigId << 5), UnknownServerId);
+    IndicateAndReceive(0xE0, Servers[0].ServerId);
+
+    //
+    // Verify duplicate server IDs are rejected.
+    //
+    Servers[1].ServerId[1] = Servers[0].ServerId[1];
+    TEST_TRUE(
+        FAILED(TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1)));
+    Servers[1].ServerId[1] = (UINT8)(0x10 + 1);
+
+    //
+    // Verify the reserved configuration ID and encrypted configurations whose
+    // server ID and nonce do not fill one block are rejected.
+    //
+    QuicLb.ConfigId = XDP_QUIC_LB_MAX_CONFIG_ID + 1;
+    TEST_TRUE(
+        FAILED(TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1)));
+    QuicLb.ConfigId = ConfigId;
+
+    QuicLb.Flags = XDP_QUIC_LB_FLAG_ENCRYPTED;
+    QuicLb.NonceLength = 8;
+    TEST_TRUE(
+        FAILED(TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1)));
+}
+
+VOID
+GenericRxXskFanoutDistinct()
+{
+    auto If = FnMpIf;
+    MY_SOCKET Sockets[2];
+    HANDLE SocketHandles[RTL_NUMBER_OF(Sockets)];
+    XDP_XSK_MAP XskMap;
+    XDP_RULE Rule = {};
+    UCHAR Payload[] = "GenericRxXskFanoutDistinct";
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        Sockets[Index] =
+            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+        SocketHandles[Index] = Sockets[Index].Handle.get();
+        SocketProduceRxFill(&Sockets[Index], 1);
+    }
+
+    XskMap.Sockets = SocketHandles;
+    XskMap.SocketCount = RTL_NUMBER_OF(SocketHandles);
+
+    Rule.Match = XDP_MATCH_ALL;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK_FANOUT;
+    Rule.Redirect.XskMap = &XskMap;
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    //
+    // Verify a single frame is delivered to each socket in the fanout.
+    //
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        auto &Socket = Sockets[Index];
+        UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+        auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+        TEST_EQUAL(sizeof(Payload), RxDesc->Length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+                Payload, sizeof(Payload)));
+        XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+    }
+
+    //
+    // Verify a fanout to a socket and a duplicate handle to the same socket is
+    // rejected, while a socket map permits it.
+    //
+    HANDLE DuplicateHandleValue;
+    TEST_TRUE(
+        DuplicateHandle(
+            GetCurrentProcess(), SocketHandles[0], GetCurrentProcess(), &DuplicateHandleValue,
+            0, FALSE, DUPLICATE_SAME_ACCESS));
+    wil::unique_handle Duplicate(DuplicateHandleValue);
+    SocketHandles[1] = DuplicateHandleValue;
+
+    TEST_TRUE(
+        FAILED(TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1)));
+
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK_MAP;
+    TEST_HRESULT(
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1));
+}
+
+VOID
+GenericRxSample()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    unique_fnlwf_handle FnLwf;
+    const UCHAR Payload[] = "GenericRxSample";
+    wil::unique_handle ProgramHandle;
+    XDP_RULE Rule = {};
+
+    auto Socket = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+
+    Rule.Match = XDP_MATCH_ALL;
+    Rule.Action = XDP_PROGRAM_ACTION_SAMPLE;
+    Rule.Sample.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Sample.Target = Socket.Handle.get();
+
+    //
+    // Verify a zero sample rate is rejected.
+    //
+    Rule.Sample.Rate = 0;
+    TEST_TRUE(
+        FAILED(TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1)));
+
+    Rule.Sample.Rate = 1;
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+    FnLwf = LwfOpenDefault(If.GetIfIndex());
+
+    std::vector<UCHAR> Mask(sizeof(Payload), 0xFF);
+    auto LwfFilter = LwfRxFilter(FnLwf, Payload, &Mask[0], sizeof(Payload));
+
+    SocketProduceRxFill(&Socket, 1);
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    //
+    // Verify the socket received a copy of the frame and the frame itself
+    // continued up the stack.
+    //
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+    TEST_EQUAL(sizeof(Payload), RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            Payload, sizeof(Payload)));
+    XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+
+    LwfRxAllocateAndGetFrame(FnLwf, If.GetQueueId());
+    LwfRxDequeueFrame(FnLwf, If.GetQueueId());
+    LwfRxFlush(FnLwf);
+}
+
+VOID
+GenericRxPolice()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    const UCHAR Payload[] = "GenericRxPolice";
+    wil::unique_handle ProgramHandle;
+    XDP_RULE Rule = {};
+
+    auto Socket = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+
+    Rule.Match = XDP_MATCH_ALL;
+    Rule.Action = XDP_PROGRAM_ACTION_POLICE;
+    Rule.Police.ConformTarget = Socket.Handle.get();
+
+    //
+    // Verify a policer without any limits is rejected.
+    //
+    TEST_TRUE(
+        FAILED(TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1)));
+
+    Rule.Police.PacketsPerSecond = 1;
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    SocketProduceRxFill(&Socket, 2);
+
+    //
+    // Indicate two frames back to back: the first conforms and is redirected,
+    // and the second exceeds the rate and is dropped.
+    //
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+    TEST_EQUAL(sizeof(Payload), RxDesc->Length);
+    XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+
+    TEST_EQUAL(0, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+}
+
+VOID
+GenericRxConntrack()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    ADDRESS_FAMILY Af = AF_INET;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    const UCHAR Payload[] = "GenericRxConntrack";
+    UCHAR InboundFrame[UDP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 InboundFrameLength = sizeof(InboundFrame);
+    UCHAR OutboundFrame[UDP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 OutboundFrameLength = sizeof(OutboundFrame);
+    wil::unique_handle ProgramHandle;
+    XDP_RULE Rules[2] = {};
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            InboundFrame, &InboundFrameLength, Payload, sizeof(Payload), &LocalHw, &RemoteHw,
+            Af, &LocalIp, &RemoteIp, htons(1234), htons(4321)));
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            OutboundFrame, &OutboundFrameLength, Payload, sizeof(Payload), &RemoteHw, &LocalHw,
+            Af, &RemoteIp, &LocalIp, htons(4321), htons(1234)));
+
+    auto Socket = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+
+    //
+    // Redirect frames of established flows and track, then drop, everything
+    // else.
+    //
+    Rules[0].Match = XDP_MATCH_CONNTRACK_ESTABLISHED;
+    Rules[0].Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rules[0].Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rules[0].Redirect.Target = Socket.Handle.get();
+    Rules[1].Match = XDP_MATCH_CONNTRACK_TRACK;
+    Rules[1].Action = XDP_PROGRAM_ACTION_DROP;
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+            RTL_NUMBER_OF(Rules));
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    SocketProduceRxFill(&Socket, 2);
+
+    //
+    // The first frame has no reverse flow and is tracked and dropped; the
+    // reply to it belongs to an established flow and is redirected.
+    //
+    DATA_BUFFER Buffer = {0};
+    Buffer.DataLength = InboundFrameLength;
+    Buffer.BufferLength = Buffer.DataLength;
+    Buffer.VirtualAddress = InboundFrame;
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), &Buffer);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    UINT32 ConsumerIndex;
+    Sleep(TEST_TIMEOUT_ASYNC_MS);
+    TEST_EQUAL(0, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+
+    Buffer.DataLength = OutboundFrameLength;
+    Buffer.BufferLength = Buffer.DataLength;
+    Buffer.VirtualAddress = OutboundFrame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), &Buffer);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+    TEST_EQUAL(OutboundFrameLength, RxDesc->Length);
+    XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+}
+
+VOID
+GenericRxDecapRedirect()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    ADDRESS_FAMILY Af = AF_INET;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    const UCHAR Payload[] = "GenericRxDecapRedirect";
+    const UINT32 VxlanHeaderLength = 8;
+    UCHAR TunnelPayload[VxlanHeaderLength + UDP_HEADER_STORAGE + sizeof(Payload)] = {0};
+    UINT32 InnerFrameLength = sizeof(TunnelPayload) - VxlanHeaderLength;
+    UCHAR OuterFrame[UDP_HEADER_STORAGE + sizeof(TunnelPayload)];
+    UINT32 OuterFrameLength = sizeof(OuterFrame);
+    XDP_MASKED_TUPLE Tuple = {};
+    wil::unique_handle ProgramHandle;
+    XDP_RULE Rule = {};
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    //
+    // Encapsulate an inner UDP frame in a VXLAN header with the VNI flag set.
+    //
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            TunnelPayload + VxlanHeaderLength, &InnerFrameLength, Payload, sizeof(Payload),
+            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, htons(1234), htons(4321)));
+    TunnelPayload[0] = 0x08;
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            OuterFrame, &OuterFrameLength, TunnelPayload, VxlanHeaderLength + InnerFrameLength,
+            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, htons(XDP_VXLAN_DEFAULT_UDP_PORT),
+            htons(5555)));
+
+    auto Socket = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+
+    Tuple.Mask.DestinationPort = 0xFFFF;
+    Tuple.Mask.Protocol = 0xFF;
+    Tuple.Tuple.DestinationPort = htons(1234);
+    Tuple.Tuple.Protocol = IPPROTO_UDP;
+
+    Rule.Match = XDP_MATCH_TUNNEL_IPV4_MASKED_TUPLE;
+    Rule.Pattern.TunnelTupleSet.Tunnel.Type = XDP_TUNNEL_TYPE_VXLAN;
+    Rule.Pattern.TunnelTupleSet.Tunnel.UdpPort = htons(XDP_VXLAN_DEFAULT_UDP_PORT);
+    Rule.Pattern.TunnelTupleSet.TupleSet.Tuples = &Tuple;
+    Rule.Pattern.TunnelTupleSet.TupleSet.TupleCount = 1;
+    Rule.Action = XDP_PROGRAM_ACTION_DECAP_REDIRECT;
+    Rule.DecapRedirect.Tunnel = Rule.Pattern.TunnelTupleSet.Tunnel;
+    Rule.DecapRedirect.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.DecapRedirect.Redirect.Target = Socket.Handle.get();
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    SocketProduceRxFill(&Socket, 1);
+
+    DATA_BUFFER Buffer = {0};
+    Buffer.DataLength = OuterFrameLength;
+    Buffer.BufferLength = Buffer.DataLength;
+    Buffer.VirtualAddress = OuterFrame;
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), &Buffer);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    //
+    // Verify the socket received only the inner frame.
+    //
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+    TEST_EQUAL(InnerFrameLength, RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            TunnelPayload + VxlanHeaderLength, InnerFrameLength));
+    XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+
+    //
+    // Verify a zero tunnel port is rejected.
+    //
+    ProgramHandle.reset();
+    Rule.DecapRedirect.Tunnel.UdpPort = 0;
+    TEST_TRUE(
+        FAILED(TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1)));
+}
+
+VOID
+GenericRxLoadBalance(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    const UCHAR Payload[] = "GenericRxLoadBalance";
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    UCHAR ExpectedFrame[UDP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 ExpectedFrameLength = sizeof(ExpectedFrame);
+    XDP_LOAD_BALANCER_BACKEND Backend = {};
+    wil::unique_handle ProgramHandle;
+    XDP_RULE Rule = {};
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, Payload, sizeof(Payload), &LocalHw, &RemoteHw, Af,
+            &LocalIp, &RemoteIp, htons(1234), htons(4321)));
+
+    //
+    // The backend is a neighbor of the remote host.
+    //
+    const UINT8 BackendHw[] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x05 };
+    C_ASSERT(sizeof(BackendHw) == sizeof(Backend.EthernetAddress));
+    RtlCopyMemory(Backend.EthernetAddress, BackendHw, sizeof(BackendHw));
+    RtlCopyMemory(&Backend.IpAddress, &RemoteIp, sizeof(Backend.IpAddress));
+    if (Af == AF_INET) {
+        Backend.IpAddress.Ipv4.S_un.S_un_b.s_b4++;
+    } else {
+        Backend.IpAddress.Ipv6.u.Byte[sizeof(Backend.IpAddress.Ipv6) - 1]++;
+    }
+
+    //
+    // A frame built for the backend has checksums computed from scratch, so it
+    // also verifies the incremental checksum updates.
+    //
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            ExpectedFrame, &ExpectedFrameLength, Payload, sizeof(Payload),
+            (const ETHERNET_ADDRESS *)Backend.EthernetAddress, &LocalHw, Af,
+            (const INET_ADDR *)&Backend.IpAddress, &RemoteIp, htons(1234), htons(4321)));
+    TEST_EQUAL(UdpFrameLength, ExpectedFrameLength);
+
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = htons(1234);
+    Rule.Action = XDP_PROGRAM_ACTION_LOAD_BALANCE;
+    Rule.LoadBalance.Backends = &Backend;
+    Rule.LoadBalance.BackendCount = 1;
+    Rule.LoadBalance.Flags = XDP_LOAD_BALANCE_FLAG_REWRITE_IP;
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    std::vector<UCHAR> Mask(ExpectedFrameLength, 0xFF);
+    auto MpFilter = MpTxFilter(GenericMp, ExpectedFrame, &Mask[0], ExpectedFrameLength);
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    //
+    // Verify the frame was forwarded to the backend.
+    //
+    auto TxFrame = MpTxAllocateAndGetFrame(GenericMp, If.GetQueueId());
+    UINT32 TotalLength = 0;
+    for (UINT32 i = 0; i < TxFrame->BufferCount; i++) {
+        TotalLength += TxFrame->Buffers[i].DataLength;
+    }
+    TEST_EQUAL(ExpectedFrameLength, TotalLength);
+    MpTxDequeueFrame(GenericMp, If.GetQueueId());
+    MpTxFlush(GenericMp);
+
+    //
+    // Verify invalid backend sets and flags are rejected.
+    //
+    ProgramHandle.reset();
+    Rule.LoadBalance.BackendCount = 0;
+    TEST_TRUE(
+        FAILED(TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1)));
+
+    Rule.LoadBalance.BackendCount = 1;
+    Rule.LoadBalance.Flags = ~0u;
+    TEST_TRUE(
+        FAILED(TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1)));
+}
+
+VOID
+GenericRxRedirectInterfaceTx()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    const UCHAR Payload[] = "GenericRxRedirectInterfaceTx";
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    wil::unique_handle ProgramHandle;
+    XDP_RULE Rule = {};
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, Payload, sizeof(Payload), &LocalHw, &RemoteHw, AF_INET,
+            &LocalIp, &RemoteIp, htons(1234), htons(4321)));
+
+    //
+    // Redirect to a TX queue of the receiving interface, which exercises the
+    // same data path as forwarding to another interface.
+    //
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = htons(1234);
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_INTERFACE_TX;
+    Rule.Redirect.InterfaceTx.IfIndex = If.GetIfIndex();
+    Rule.Redirect.InterfaceTx.QueueId = If.GetQueueId();
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    std::vector<UCHAR> Mask(UdpFrameLength, 0xFF);
+    auto MpFilter = MpTxFilter(GenericMp, UdpFrame, &Mask[0], UdpFrameLength);
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    //
+    // Verify the frame was transmitted unmodified.
+    //
+    auto TxFrame = MpTxAllocateAndGetFrame(GenericMp, If.GetQueueId());
+    UINT32 TotalLength = 0;
+    for (UINT32 i = 0; i < TxFrame->BufferCount; i++) {
+        TotalLength += TxFrame->Buffers[i].DataLength;
+    }
+    TEST_EQUAL(UdpFrameLength, TotalLength);
+    MpTxDequeueFrame(GenericMp, If.GetQueueId());
+    MpTxFlush(GenericMp);
+
+    //
+    // Verify a nonexistent interface is rejected.
+    //
+    ProgramHandle.reset();
+    Rule.Redirect.InterfaceTx.IfIndex = NET_IFINDEX_UNSPECIFIED;
+    TEST_TRUE(
+        FAILED(TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1)));
+}
+
+VOID
+GenericRxEncap()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    const UCHAR Payload[] = "GenericRxEncap";
+    const UINT32 Headroom = 64;
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    UCHAR RxBuffer[Headroom + sizeof(UdpFrame)] = {};
+    UCHAR OuterHeader[sizeof(ETHERNET_HEADER) + sizeof(IPV4_HEADER)] = {};
+    UCHAR ExpectedFrame[sizeof(OuterHeader) + sizeof(UdpFrame)];
+    UINT32 ExpectedFrameLength;
+    wil::unique_handle ProgramHandle;
+    XDP_RULE Rule = {};
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, Payload, sizeof(Payload), &LocalHw, &RemoteHw, AF_INET,
+            &LocalIp, &RemoteIp, htons(1234), htons(4321)));
+
+    //
+    // Build an IP-in-IP template for a tunnel endpoint beyond the remote host.
+    //
+    ETHERNET_HEADER *OuterEth = (ETHERNET_HEADER *)OuterHeader;
+    IPV4_HEADER *OuterIp = (IPV4_HEADER *)(OuterEth + 1);
+    RtlCopyMemory(&OuterEth->Destination, &RemoteHw, sizeof(OuterEth->Destination));
+    RtlCopyMemory(&OuterEth->Source, &LocalHw, sizeof(OuterEth->Source));
+    OuterEth->Type = htons(ETHERNET_TYPE_IPV4);
+    OuterIp->VersionAndHeaderLength = 0x45;
+    OuterIp->TimeToLive = 64;
+    OuterIp->SourceAddress = LocalIp.Ipv4;
+    OuterIp->DestinationAddress = RemoteIp.Ipv4;
+    OuterIp->DestinationAddress.S_un.S_un_b.s_b4++;
+
+    //
+    // The outer headers replace the inner Ethernet header. The outer IPv4
+    // header checksum is not verified.
+    //
+    RtlCopyMemory(ExpectedFrame, OuterHeader, sizeof(OuterHeader));
+    RtlCopyMemory(
+        ExpectedFrame + sizeof(OuterHeader), UdpFrame + sizeof(ETHERNET_HEADER),
+        UdpFrameLength - sizeof(ETHERNET_HEADER));
+    ExpectedFrameLength = sizeof(OuterHeader) + UdpFrameLength - sizeof(ETHERNET_HEADER);
+    OuterIp = (IPV4_HEADER *)(ExpectedFrame + sizeof(ETHERNET_HEADER));
+    OuterIp->TotalLength = htons((UINT16)(ExpectedFrameLength - sizeof(ETHERNET_HEADER)));
+    OuterIp->Protocol = IPPROTO_IPV4;
+
+    std::vector<UCHAR> Mask(ExpectedFrameLength, 0xFF);
+    Mask[sizeof(ETHERNET_HEADER) + FIELD_OFFSET(IPV4_HEADER, HeaderChecksum)] = 0;
+    Mask[sizeof(ETHERNET_HEADER) + FIELD_OFFSET(IPV4_HEADER, HeaderChecksum) + 1] = 0;
+
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = htons(1234);
+    Rule.Action = XDP_PROGRAM_ACTION_ENCAP;
+    Rule.Encap.Type = XDP_ENCAP_TYPE_IP_IN_IP;
+    Rule.Encap.Header = OuterHeader;
+    Rule.Encap.HeaderLength = sizeof(OuterHeader);
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto MpFilter = MpTxFilter(GenericMp, ExpectedFrame, &Mask[0], ExpectedFrameLength);
+
+    //
+    // The outer headers are written into the headroom of the received buffer.
+    //
+    DATA_BUFFER Buffer = {0};
+    RtlCopyMemory(RxBuffer + Headroom, UdpFrame, UdpFrameLength);
+    Buffer.DataOffset = Headroom;
+    Buffer.DataLength = UdpFrameLength;
+    Buffer.BufferLength = Headroom + UdpFrameLength;
+    Buffer.VirtualAddress = RxBuffer;
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), &Buffer);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    auto TxFrame = MpTxAllocateAndGetFrame(GenericMp, If.GetQueueId());
+    UINT32 TotalLength = 0;
+    for (UINT32 i = 0; i < TxFrame->BufferCount; i++) {
+        TotalLength += TxFrame->Buffers[i].DataLength;
+    }
+    TEST_EQUAL(ExpectedFrameLength, TotalLength);
+    MpTxDequeueFrame(GenericMp, If.GetQueueId());
+    MpTxFlush(GenericMp);
+
+    //
+    // Verify templates not matching the encapsulation type are rejected.
+    //
+    ProgramHandle.reset();
+    Rule.Encap.Type = XDP_ENCAP_TYPE_VXLAN;
+    TEST_TRUE(
+        FAILED(TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1)));
+}
+
+VOID
+GenericRxSynCookie(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    const UINT16 LocalPort = htons(1234);
+    const UINT16 RemotePort = htons(4321);
+    const UINT32 Isn = 0x12345678;
+    const UINT16 Mss = 1400;
+    //
+    // MSS, two NOPs and SACK permitted: client SYNs carry options, which
+    // leave room for the SYN-ACK in the received buffer.
+    //
+    UCHAR SynOptions[] = { 2, 4, 0x05, 0xB4, 1, 1, 4, 2 };
+    UCHAR TcpFrame[TCP_HEADER_STORAGE + sizeof(SynOptions)];
+    UINT32 TcpFrameLength = sizeof(TcpFrame);
+    const UINT32 IpHeaderLength = (Af == AF_INET) ? sizeof(IPV4_HEADER) : sizeof(IPV6_HEADER);
+    wil::unique_handle ProgramHandle;
+    XDP_RULE Rule = {};
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    TEST_TRUE(
+        PktBuildTcpFrame(
+            TcpFrame, &TcpFrameLength, NULL, 0, SynOptions, sizeof(SynOptions), Isn, 0, TH_SYN,
+            65535, &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    Rule.Match = XDP_MATCH_TCP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_SYN_COOKIE;
+    Rule.SynCookie.Mss = Mss;
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    //
+    // Filter on the SYN-ACK's Ethernet header and ports, which precede the
+    // fields set from the cookie.
+    //
+    std::vector<UCHAR> Pattern(sizeof(ETHERNET_HEADER) + IpHeaderLength + 2 * sizeof(UINT16));
+    std::vector<UCHAR> Mask(Pattern.size(), 0);
+    ETHERNET_HEADER *EthHdr = (ETHERNET_HEADER *)&Pattern[0];
+    RtlCopyMemory(&EthHdr->Destination, &RemoteHw, sizeof(EthHdr->Destination));
+    RtlCopyMemory(&EthHdr->Source, &LocalHw, sizeof(EthHdr->Source));
+    EthHdr->Type = htons((Af == AF_INET) ? ETHERNET_TYPE_IPV4 : ETHERNET_TYPE_IPV6);
+    TCP_HDR *TcpHdr = (TCP_HDR *)&Pattern[sizeof(ETHERNET_HEADER) + IpHeaderLength];
+    TcpHdr->th_sport = LocalPort;
+    TcpHdr->th_dport = RemotePort;
+    std::fill(Mask.begin(), Mask.begin() + sizeof(ETHERNET_HEADER), (UCHAR)0xFF);
+    std::fill(Mask.end() - 2 * sizeof(UINT16), Mask.end(), (UCHAR)0xFF);
+    auto MpFilter = MpTxFilter(GenericMp, &Pattern[0], &Mask[0], (UINT32)Pattern.size());
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), TcpFrame, TcpFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    //
+    // Verify the SYN was answered with a SYN-ACK offering only the MSS.
+    //
+    auto TxFrame = MpTxAllocateAndGetFrame(GenericMp, If.GetQueueId());
+    TEST_EQUAL(1, TxFrame->BufferCount);
+    const DATA_BUFFER *TxBuffer = &TxFrame->Buffers[0];
+    TEST_EQUAL(
+        sizeof(ETHERNET_HEADER) + IpHeaderLength + sizeof(TCP_HDR) + 4, TxBuffer->DataLength);
+
+    TCP_HDR *SynAckHdr = NULL;
+    TEST_TRUE(
+        PktParseTcpFrame(
+            TxBuffer->VirtualAddress + TxBuffer->DataOffset, TxBuffer->DataLength, &SynAckHdr,
+            NULL, 0));
+    TEST_EQUAL(TH_SYN | TH_ACK, SynAckHdr->th_flags);
+    TEST_EQUAL(Isn + 1, ntohl(SynAckHdr->th_ack));
+    TEST_EQUAL((sizeof(TCP_HDR) + 4) / 4, SynAckHdr->th_len);
+
+    const UCHAR *SynAckOptions = (const UCHAR *)(SynAckHdr + 1);
+    TEST_EQUAL(2, SynAckOptions[0]);
+    TEST_EQUAL(4, SynAckOptions[1]);
+    TEST_EQUAL(Mss, (SynAckOptions[2] << 8) | SynAckOptions[3]);
+
+    MpTxDequeueFrame(GenericMp, If.GetQueueId());
+    MpTxFlush(GenericMp);
+
+    //
+    // Verify a zero MSS is rejected.
+    //
+    ProgramHandle.reset();
+    Rule.SynCookie.Mss = 0;
+    TEST_TRUE(
+        FAILED(TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1)));
+}
+
+VOID
+GenericRxMultiProgram()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UCHAR UdpMatchPayload[] = "GenericRxMultiProgram";
+    struct {
+        MY_SOCKET Xsk;
+        wil::unique_handle ProgramHandle;
+        UINT16 LocalPort;
+        UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpMatchPayload)];
+        UINT32 UdpFrameLength;
+    } Sockets[4];
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        XDP_RULE Rule = {};
+
+        Sockets[Index].Xsk =
+            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+        Sockets[Index].LocalPort = htons(1000 + Index);
+        Sockets[Index].UdpFrameLength = sizeof(Sockets[Index].UdpFrame);
+        TEST_TRUE(
+            PktBuildUdpFrame(
+                Sockets[Index].UdpFrame, &Sockets[Index].UdpFrameLength, UdpMatchPayload,
+                sizeof(UdpMatchPayload), &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp,
+                Sockets[Index].LocalPort, htons(2000)));
+
+        Rule.Match = XDP_MATCH_UDP_DST;
+        Rule.Pattern.Port = Sockets[Index].LocalPort;
+        Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+        Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+        Rule.Redirect.Target = Sockets[Index].Xsk.Handle.get();
+
+        Sockets[Index].ProgramHandle =
+            CreateXdpProg(
+                If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+                &Rule, 1);
+    }
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        auto &Socket = Sockets[Index].Xsk;
+        DATA_BUFFER Buffer = {0};
+        BOOLEAN Detach = Index & 1;
+
+        if (Detach) {
+            //
+            // Ensure shared programs are properly detached.
+            //
+            Sockets[Index].ProgramHandle.reset();
+        }
+
+        SocketProduceRxFill(&Socket, 1);
+
+        Buffer.DataOffset = 0;
+        Buffer.DataLength = Sockets[Index].UdpFrameLength;
+        Buffer.BufferLength = Buffer.DataLength;
+        Buffer.VirtualAddress = Sockets[Index].UdpFrame;
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), &Buffer);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        //
+        // Verify the NBL propagated correctly to XSK.
+        //
+        if (Detach) {
+            UINT32 ConsumerIndex;
+            Sleep(TEST_TIMEOUT_ASYNC_MS);
+            TEST_EQUAL(0, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+        } else {
+            UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+
+            TEST_EQUAL(1, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+            auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+            TEST_EQUAL(Buffer.DataLength, RxDesc->Length);
+            TEST_TRUE(
+                RtlEqualMemory(
+                    Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+                    Buffer.VirtualAddress + Buffer.DataOffset,
+                    Buffer.DataLength));
+        }
+    }
+}
+
+VOID
+GenericRxUdpFragmentQuicShortHeader(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UINT32 TotalOffset = 0;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    wil::unique_handle ProgramHandle;
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    const UCHAR QuicShortHdrUdpPayload[XDP_QUIC_MAX_CID_LENGTH + 10] = { // 21 bytes is a full CID
+        0x00, // IsLongHeader
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // DestCid
+        0x00 // The rest
+    };
+    const UCHAR CorrectQuicCid[] = {
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08
+    };
+
+    std::vector<DATA_BUFFER> Buffers;
+    DATA_BUFFER Buffer = {0};
+
+    XDP_RULE Rules[2];
+    Rules[0].Action = XDP_PROGRAM_ACTION_DROP;
+    Rules[0].Match = XDP_MATCH_QUIC_FLOW_DST_CID;
+    Rules[0].Pattern.QuicFlow.UdpPort = LocalPort;
+    Rules[0].Pattern.QuicFlow.CidOffset = 2; // Some arbitrary offset.
+    Rules[0].Pattern.QuicFlow.CidLength = 4; // Some arbitrary length.
+    memcpy(
+        Rules[0].Pattern.QuicFlow.CidData,
+        CorrectQuicCid + Rules[0].Pattern.QuicFlow.CidOffset,
+        Rules[0].Pattern.QuicFlow.CidLength);
+    Rules[1].Action = XDP_PROGRAM_ACTION_PASS;
+    Rules[1].Match = XDP_MATCH_ALL;
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules, 2);
+
+    CHAR RecvPayload[sizeof(QuicShortHdrUdpPayload)];
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(QuicShortHdrUdpPayload)];
+    const UCHAR* UdpPayload;
+    UINT16 UdpPayloadLength = 0;
+    UdpPayload = QuicShortHdrUdpPayload;
+
+    for (; UdpPayloadLength < sizeof(QuicShortHdrUdpPayload); UdpPayloadLength++) {
+        if (UdpPayloadLength ==
+                Rules[0].Pattern.QuicFlow.CidOffset +
+                Rules[0].Pattern.QuicFlow.CidLength + 1) {
+            Rules[0].Action = XDP_PROGRAM_ACTION_PASS;
+            Rules[1].Action = XDP_PROGRAM_ACTION_DROP;
+            ProgramHandle.reset();
+            ProgramHandle =
+                CreateXdpProg(
+                    If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules, 2);
+        }
+
+        //
+        // Test a full length buffer
+        //
+
+        UINT32 UdpFrameLength = sizeof(UdpFrame);
+        TEST_TRUE(
+            PktBuildUdpFrame(
+                UdpFrame, &UdpFrameLength, UdpPayload, UdpPayloadLength, &LocalHw,
+                &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+        RX_FRAME RxFrame;
+        RxInitializeFrame(&RxFrame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &RxFrame));
+        TEST_EQUAL(
+            UdpPayloadLength,
+            FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+        TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, UdpPayloadLength));
+
+        //
+        // Test Payload Fragmented at all points
+        //
+
+        for (UINT16 FragmentOffset = 0; FragmentOffset < UdpPayloadLength; FragmentOffset++) {
+            Buffers.clear();
+            TotalOffset = 0;
+
+            std::memset(&Buffer, 0, sizeof(Buffer));
+            Buffer.DataOffset = 0;
+            Buffer.DataLength = UdpFrameLength - (FragmentOffset + 1);
+            Buffer.BufferLength = Buffer.DataOffset + Buffer.DataLength;
+            Buffer.VirtualAddress = &UdpFrame[0] + TotalOffset;
+            TotalOffset += Buffer.BufferLength;
+            Buffers.push_back(Buffer);
+
+            std::memset(&Buffer, 0, sizeof(Buffer));
+            Buffer.DataOffset = 0;
+            Buffer.DataLength = (FragmentOffset + 1);
+            Buffer.BufferLength = Buffer.DataOffset + Buffer.DataLength;
+            Buffer.VirtualAddress = &UdpFrame[0] + TotalOffset;
+            TotalOffset += Buffer.BufferLength;
+            Buffers.push_back(Buffer);
+
+            RxInitializeFrame(&RxFrame, If.GetQueueId(), Buffers.data(), (UINT16)Buffers.size());
+            TEST_HRESULT(MpRxIndicateFrame(GenericMp, &RxFrame));
+            TEST_EQUAL(
+                UdpPayloadLength,
+                FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+            TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, UdpPayloadLength));
+        }
+    }
+}
+
+VOID
+GenericRxUdpFragmentQuicLongHeader(
+    _In_ ADDRESS_FAMILY Af,
+    _In_ BOOLEAN IsUdp
+    )
+{
+    auto If = IsUdp ? FnMpIf : FnMp1QIf;
+    UINT16 LocalPort;
+    UINT16 RemotePort = htons(1234);
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UINT32 TotalOffset = 0;
+    UINT32 AckNum = 0;
+    UINT32 SeqNum = 1;
+
+    auto Socket =
+        IsUdp ?
+            CreateUdpSocket(Af, &If, &LocalPort) :
+            CreateTcpSocket(Af, &If, &LocalPort, RemotePort, &AckNum);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    wil::unique_handle ProgramHandle;
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    const UCHAR QuicLongHdrUdpPayload[40] = {
+        0x80, // IsLongHeader
+        0x01, 0x00, 0x00, 0x00, // Version
+        0x08, // DestCidLength
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // DestCid
+        0x08, // SrcCidLength
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // SrcCid
+        0x00  // The rest
+    };
+    const UINT16 MinQuicHdrLength = 1 + 4 + 1 + 8 + 1 + 8; // Up to the SrcCid
+    const UCHAR CorrectQuicCid[] = {
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08
+    };
+
+    std::vector<DATA_BUFFER> Buffers;
+    DATA_BUFFER Buffer = {0};
+
+    XDP_RULE Rules[2];
+    Rules[0].Action = XDP_PROGRAM_ACTION_DROP;
+    Rules[0].Match = (IsUdp ? XDP_MATCH_QUIC_FLOW_SRC_CID : XDP_MATCH_TCP_QUIC_FLOW_SRC_CID);
+    Rules[0].Pattern.QuicFlow.UdpPort = LocalPort;
+    Rules[0].Pattern.QuicFlow.CidOffset = 2; // Some arbitrary offset.
+    Rules[0].Pattern.QuicFlow.CidLength = 4; // Some arbitrary length.
+    memcpy(
+        Rules[0].Pattern.QuicFlow.CidData,
+        CorrectQuicCid + Rules[0].Pattern.QuicFlow.CidOffset,
+        Rules[0].Pattern.QuicFlow.CidLength);
+    Rules[1].Action = XDP_PROGRAM_ACTION_PASS;
+    Rules[1].Match = XDP_MATCH_ALL;
+
+    ProgramHandle =
+                CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules, 2);
+
+    CHAR RecvPayload[sizeof(QuicLongHdrUdpPayload)];
+    UCHAR PacketBuffer[TCP_HEADER_STORAGE + sizeof(QuicLongHdrUdpPayload)];
+    const UCHAR* Payload;
+    UINT16 PayloadLength = (IsUdp ? 0 : 1); // zero-payload TCP packets are not data packets.
+    Payload = QuicLongHdrUdpPayload;
+
+    for (; PayloadLength < sizeof(QuicLongHdrUdpPayload); PayloadLength++) {
+        if (PayloadLength == MinQuicHdrLength) {
+            Rules[0].Action = XDP_PROGRAM_ACTION_PASS;
+            Rules[1].Action = XDP_PROGRAM_ACTION_DROP;
+            ProgramHandle.reset();
+            ProgramHandle =
+                CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules, 2);
+        }
+
+        //
+        // Test a full length buffer
+        //
+
+        UINT32 PacketBufferLength = sizeof(PacketBuffer);
+        if (IsUdp) {
+            TEST_TRUE(
+                PktBuildUdpFrame(
+                    PacketBuffer, &PacketBufferLength, Payload, PayloadLength, &LocalHw,
+                    &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+        } else {
+            TEST_TRUE(
+                PktBuildTcpFrame(
+                    PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
+                    NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
+                    &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+        }
+
+        RX_FRAME RxFrame;
+        RxInitializeFrame(&RxFrame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &RxFrame));
+        TEST_EQUAL(
+            PayloadLength,
+            FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+        TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
+        SeqNum += PayloadLength;
+
+        //
+        // Test Payload Fragmented at all points
+        //
+
+        for (UINT16 FragmentOffset = 0; FragmentOffset < PayloadLength; FragmentOffset++) {
+
+            Buffers.clear();
+            TotalOffset = 0;
+
+            if (!IsUdp) {
+                TEST_TRUE(
+                    PktBuildTcpFrame(
+                        PacketBuffer, &PacketBufferLength, Payload, PayloadLength,
+                        NULL, 0, SeqNum, AckNum, TH_ACK, 65535,
+                        &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+            }
+
+            std::memset(&Buffer, 0, sizeof(Buffer));
+            Buffer.DataOffset = 0;
+            Buffer.DataLength = PacketBufferLength - (FragmentOffset + 1);
+            Buffer.BufferLength = Buffer.DataOffset + Buffer.DataLength;
+            Buffer.VirtualAddress = &PacketBuffer[0] + TotalOffset;
+            TotalOffset += Buffer.BufferLength;
+            Buffers.push_back(Buffer);
+
+            std::memset(&Buffer, 0, sizeof(Buffer));
+            Buffer.DataOffset = 0;
+            Buffer.DataLength = (FragmentOffset + 1);
+            Buffer.BufferLength = Buffer.DataOffset + Buffer.DataLength;
+            Buffer.VirtualAddress = &PacketBuffer[0] + TotalOffset;
+            TotalOffset += Buffer.BufferLength;
+            Buffers.push_back(Buffer);
+
+            RxInitializeFrame(&RxFrame, If.GetQueueId(), Buffers.data(), (UINT16)Buffers.size());
+            TEST_HRESULT(MpRxIndicateFrame(GenericMp, &RxFrame));
+            TEST_EQUAL(
+                PayloadLength,
+                FnSockRecv(Socket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+            TEST_TRUE(RtlEqualMemory(Payload, RecvPayload, PayloadLength));
+            SeqNum += PayloadLength;
+        }
+    }
+}
+
+typedef struct _GENERIC_RX_UDP_FRAGMENT_PARAMS {
+    _In_ UINT16 PayloadLength;
+    _In_ UINT16 Backfill;
+    _In_ UINT16 Trailer;
+    _In_ UINT16 *SplitIndexes;
+    _In_ UINT16 SplitCount;
+    _In_ BOOLEAN IsUdp;
+    _In_ BOOLEAN IsTxInspect;
+    _In_ BOOLEAN LowResources;
+    _In_ XDP_RULE_ACTION Action;
+} GENERIC_RX_FRAGMENT_PARAMS;
+
+static
+VOID
+GenericRxFragmentBuffer(
+    _In_ ADDRESS_FAMILY Af,
+    _In_ const GENERIC_RX_FRAGMENT_PARAMS *Params
+    )
+{
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UINT32 PacketBufferOffset = 0;
+    UINT32 TotalOffset = 0;
+    MY_SOCKET Xsk;
+    wil::unique_handle ProgramHandle;
+    unique_fnmp_handle GenericMp;
+    unique_fnlwf_handle FnLwf;
+    const XDP_HOOK_ID *RxHookId = Params->IsTxInspect ? &XdpInspectTxL2 : &XdpInspectRxL2;
+
+    auto If = FnMpIf;
+
+    LocalPort = htons(1234);
+    RemotePort = htons(4321);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    XDP_RULE Rule;
+    Rule.Match = Params->IsUdp ? XDP_MATCH_UDP_DST : XDP_MATCH_TCP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = Params->Action;
+
+    if (Params->Action == XDP_PROGRAM_ACTION_REDIRECT) {
+        Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+        Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+        Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+        Rule.Redirect.Target = Xsk.Handle.get();
+    }
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), RxHookId, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    //
+    // Allocate UDP payload and initialize to a pattern.
+    //
+    std::vector<UCHAR> Payload(Params->PayloadLength);
+    std::generate(Payload.begin(), Payload.end(), []{ return (UCHAR)std::rand(); });
+
+    std::vector<UCHAR> PacketBuffer(
+        Params->Backfill +
+        (Params->IsUdp ? UDP_HEADER_BACKFILL(Af) : TCP_HEADER_BACKFILL(Af)) +
+        Params->PayloadLength + Params->Trailer);
+    UINT32 ActualPacketLength = (UINT32)PacketBuffer.size() - Params->Backfill - Params->Trailer;
+    if (Params->IsUdp) {
+        TEST_TRUE(
+            PktBuildUdpFrame(
+                &PacketBuffer[0] + Params->Backfill, &ActualPacketLength, &Payload[0],
+                (UINT16)Payload.size(), &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort,
+                RemotePort));
+    } else {
+        TEST_TRUE(
+            PktBuildTcpFrame(
+                &PacketBuffer[0] + Params->Backfill, &ActualPacketLength,
+                &Payload[0], (UINT16)Payload.size(),
+                NULL, 0, 0, 0, TH_SYN, 65535, &LocalHw,
+                &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    }
+
+    std::vector<DATA_BUFFER> Buffers;
+
+    //
+    // Split up the UDP frame into RX fragment buffers.
+    //
+    for (UINT16 Index = 0; Index < Params->SplitCount; Index++) {
+        DATA_BUFFER Buffer = {0};
+
+        Buffer.DataOffset = Index == 0 ? Params->Backfill : 0;
+        Buffer.DataLength = Params->SplitIndexes[Index] - PacketBufferOffset;
+        Buffer.BufferLength = Buffer.DataOffset + Buffer.DataLength;
+        Buffer.VirtualAddress = &PacketBuffer[0] + TotalOffset;
+
+        PacketBufferOffset += Buffer.DataLength;
+        TotalOffset += Buffer.BufferLength;
+
+        Buffers.push_back(Buffer);
+    }
+
+    //
+    // Produce the final RX fragment buffer.
+    //
+    DATA_BUFFER Buffer = {0};
+    Buffer.DataOffset = Buffers.size() == 0 ? Params->Backfill : 0;
+    Buffer.DataLength = ActualPacketLength - PacketBufferOffset;
+    Buffer.BufferLength = Buffer.DataOffset + Buffer.DataLength + Params->Trailer;
+    Buffer.VirtualAddress = &PacketBuffer[0] + TotalOffset;
+    Buffers.push_back(Buffer);
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), Buffers.data(), (UINT16)Buffers.size());
+
+    if (Params->IsTxInspect) {
+        FnLwf = LwfOpenDefault(If.GetIfIndex());
+        LwfTxEnqueue(FnLwf, &Frame.Frame);
+    } else {
+        GenericMp = MpOpenGeneric(If.GetIfIndex());
+        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    }
+
+    DATA_FLUSH_OPTIONS RxFlushOptions = {0};
+    RxFlushOptions.Flags.LowResources = Params->LowResources;
+
+    if (Params->Action == XDP_PROGRAM_ACTION_REDIRECT) {
+        //
+        // TODO: TX-inspect to XSK test case not implemented.
+        //
+        TEST_FALSE(Params->IsTxInspect);
+
+        //
+        // Produce one XSK fill descriptor.
+        //
+        SocketProduceRxFill(&Xsk, 1);
+        TEST_HRESULT(TryMpRxFlush(GenericMp, &RxFlushOptions));
+
+        UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+
+        //
+        // Verify the NBL propagated correctly to XSK.
+        //
+        TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+        auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+
+        TEST_EQUAL(ActualPacketLength, RxDesc->Length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+                &PacketBuffer[0] + Params->Backfill,
+                ActualPacketLength));
+    } else if (Params->Action == XDP_PROGRAM_ACTION_L2FWD) {
+        std::vector<UCHAR> L2FwdPacket(
+            PacketBuffer.begin() + Params->Backfill,
+            PacketBuffer.begin() + Params->Backfill + ActualPacketLength);
+        std::vector<UCHAR> Mask(L2FwdPacket.size(), 0xFF);
+        ETHERNET_HEADER *Ethernet = (ETHERNET_HEADER *)&L2FwdPacket[0];
+        ETHERNET_ADDRESS TempAddress;
+        unique_malloc_ptr<DATA_FRAME> TxFrame;
+        UINT32 TotalLength = 0;
+
+        //
+        // Set a TX filter that matches the entire packet with the ethernet
+        // source and destination swapped.
+        //
+        TempAddress = Ethernet->Destination;
+        Ethernet->Destination = Ethernet->Source;
+        Ethernet->Source = TempAddress;
+
+        unique_fnlwf_filter_handle LwfFilter;
+        unique_fnmp_filter_handle MpFilter;
+
+        if (Params->IsTxInspect) {
+            LwfFilter = LwfRxFilter(FnLwf, &L2FwdPacket[0], &Mask[0], (UINT32)L2FwdPacket.size());
+            LwfTxFlush(FnLwf, &RxFlushOptions);
+            TxFrame = LwfRxAllocateAndGetFrame(FnLwf, 0);
+        } else {
+            MpFilter = MpTxFilter(GenericMp, &L2FwdPacket[0], &Mask[0], (UINT32)L2FwdPacket.size());
+            MpRxFlush(GenericMp, &RxFlushOptions);
+            TxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
+        }
+
+        //
+        // Verify the entire packet (and nothing more) was forwarded. The TX
+        // filter verifies the bytes match up to the length of the filter.
+        //
+        for (UINT32 i = 0; i < TxFrame->BufferCount; i++) {
+            TotalLength += TxFrame->Buffers[i].DataLength;
+        }
+        TEST_EQUAL(L2FwdPacket.size(), TotalLength);
+
+        //
+        // Non-low-resources NBLs should be forwarded without a data copy. We
+        // infer this is true by the TX NBL having the same MDL layout as the
+        // original NBL.
+        //
+        // For TX-inspect NBLs, allow XDP to copy data if the first buffer is
+        // too short to reliably contain all L2 and L3 headers due to NDIS
+        // lookahead requirements.
+        //
+        if (!Params->LowResources &&
+            (!Params->IsTxInspect || Frame.Frame.Buffers[0].DataLength > 128)) {
+            TEST_EQUAL(Buffers.size(), TxFrame->BufferCount);
+        }
+
+        //
+        // XDP should preserve the available backfill.
+        //
+        TEST_EQUAL(Params->Backfill, Buffers[0].DataOffset);
+
+        if (Params->IsTxInspect) {
+            LwfRxDequeueFrame(FnLwf, 0);
+            LwfRxFlush(FnLwf);
+        } else {
+            MpTxDequeueFrame(GenericMp, 0);
             MpTxFlush(GenericMp);
         }
     }
 }
 
-VOID
-GenericRxFragmentHeaderData(
-    _In_ ADDRESS_FAMILY Af,
-    _In_ BOOLEAN IsUdp
-    )
-{
-    UINT16 SplitIndexes[] = { IsUdp ? UDP_HEADER_BACKFILL(Af) : TCP_HEADER_BACKFILL(Af) };
-    GENERIC_RX_FRAGMENT_PARAMS Params = {0};
-    Params.Action = XDP_PROGRAM_ACTION_REDIRECT;
-    Params.IsUdp = IsUdp;
-    Params.PayloadLength = 23;
-    Params.Backfill = 13;
-    Params.Trailer = 17;
-    Params.SplitIndexes = SplitIndexes;
-    Params.SplitCount = RTL_NUMBER_OF(SplitIndexes);
-    GenericRxFragmentBuffer(Af, &Params);
-}
+VOID
+GenericRxFragmentHeaderData(
+    _In_ ADDRESS_FAMILY Af,
+    _In_ BOOLEAN IsUdp
+    )
+{
+    UINT16 SplitIndexes[] = { IsUdp ? UDP_HEADER_BACKFILL(Af) : TCP_HEADER_BACKFILL(Af) };
+    GENERIC_RX_FRAGMENT_PARAMS Params = {0};
+    Params.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Params.IsUdp = IsUdp;
+    Params.PayloadLength = 23;
+    Params.Backfill = 13;
+    Params.Trailer = 17;
+    Params.SplitIndexes = SplitIndexes;
+    Params.SplitCount = RTL_NUMBER_OF(SplitIndexes);
+    GenericRxFragmentBuffer(Af, &Params);
+}
+
+VOID
+GenericRxTooManyFragments(
+    _In_ ADDRESS_FAMILY Af,
+    _In_ BOOLEAN IsUdp
+    )
+{
+    GENERIC_RX_FRAGMENT_PARAMS Params = {0};
+    Params.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Params.IsUdp = IsUdp;
+    Params.PayloadLength = 512;
+    Params.Backfill = 13;
+    Params.Trailer = 17;
+    std::vector<UINT16> SplitIndexes;
+    for (UINT16 Index = 0; Index < Params.PayloadLength - 1; Index++) {
+        SplitIndexes.push_back(Index + 1);
+    }
+    Params.SplitIndexes = &SplitIndexes[0];
+    Params.SplitCount = (UINT16)SplitIndexes.size();
+    GenericRxFragmentBuffer(Af, &Params);
+}
+
+//
+// The maximum number of fragments in a generic XDP RX frame.
+//
+#define GENERIC_RX_MAX_FRAGMENTS 64
+
+static
+UINT32
+GenericRxFragmentLimitBuildFrame(
+    _In_ const TestInterface &If,
+    _In_ ADDRESS_FAMILY Af,
+    _In_ UINT16 LocalPort,
+    _In_ const std::vector<UCHAR> &Payload,
+    _In_ UINT16 Trailer,
+    _In_ UINT16 BufferCount,
+    _Out_ std::vector<UCHAR> &PacketBuffer,
+    _Out_ std::vector<DATA_BUFFER> &Buffers
+    )
+{
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    PacketBuffer.resize(UDP_HEADER_BACKFILL(Af) + Payload.size() + Trailer);
+    UINT32 PacketLength = (UINT32)PacketBuffer.size() - Trailer;
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            &PacketBuffer[0], &PacketLength, &Payload[0], (UINT16)Payload.size(), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, htons(4321)));
+
+    //
+    // Split the headers across the leading buffers, and the remainder of the
+    // frame evenly across the other buffers.
+    //
+    std::vector<UINT32> SplitIndexes;
+    SplitIndexes.push_back(sizeof(ETHERNET_HEADER) / 2);
+    SplitIndexes.push_back(
+        sizeof(ETHERNET_HEADER) +
+            ((Af == AF_INET) ? sizeof(IPV4_HEADER) : sizeof(IPV6_HEADER)) + 1);
+    const UINT32 TailOffset = SplitIndexes.back();
+    const UINT32 TailCount = BufferCount - (UINT32)SplitIndexes.size();
+    for (UINT32 Index = 1; Index < TailCount; Index++) {
+        SplitIndexes.push_back(TailOffset + (PacketLength - TailOffset) * Index / TailCount);
+    }
+    SplitIndexes.push_back(PacketLength);
+
+    Buffers.clear();
+    UINT32 Offset = 0;
+    for (UINT32 SplitIndex : SplitIndexes) {
+        DATA_BUFFER Buffer = {0};
+        Buffer.DataLength = SplitIndex - Offset;
+        Buffer.BufferLength = Buffer.DataLength;
+        Buffer.VirtualAddress = &PacketBuffer[0] + Offset;
+        Buffers.push_back(Buffer);
+        Offset = SplitIndex;
+    }
+    Buffers.back().BufferLength += Trailer;
+    TEST_EQUAL(BufferCount, Buffers.size());
+
+    return PacketLength;
+}
+
+VOID
+GenericRxFragmentLimit(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    const UINT16 MatchPort = htons(1234);
+    const UINT16 PassPort = htons(1235);
+    const UINT16 Trailer = 17;
+    const UINT16 BufferCounts[] = {
+        GENERIC_RX_MAX_FRAGMENTS, GENERIC_RX_MAX_FRAGMENTS + 1, GENERIC_RX_MAX_FRAGMENTS * 2 + 3,
+    };
+
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = MatchPort;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Redirect.Target = Xsk.Handle.get();
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto FnLwf = LwfOpenDefault(If.GetIfIndex());
+
+    std::vector<UCHAR> Payload(512);
+    std::generate(Payload.begin(), Payload.end(), []{ return (UCHAR)std::rand(); });
+
+    for (UINT16 BufferCount : BufferCounts) {
+        std::vector<UCHAR> MatchPacket, PassPacket;
+        std::vector<DATA_BUFFER> MatchBuffers, PassBuffers;
+        RX_FRAME Frame;
+
+        //
+        // Indicate frames with at least as many MDLs as the fragment limit:
+        // one is redirected to the socket, the other passed to the stack.
+        //
+        UINT32 MatchLength =
+            GenericRxFragmentLimitBuildFrame(
+                If, Af, MatchPort, Payload, Trailer, BufferCount, MatchPacket, MatchBuffers);
+        UINT32 PassLength =
+            GenericRxFragmentLimitBuildFrame(
+                If, Af, PassPort, Payload, Trailer, BufferCount, PassPacket, PassBuffers);
+
+        RxInitializeFrame(&Frame, If.GetQueueId(), MatchBuffers.data(), BufferCount);
+        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+        RxInitializeFrame(&Frame, If.GetQueueId(), PassBuffers.data(), BufferCount);
+        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+
+        std::vector<UCHAR> Mask(PassLength, 0xFF);
+        auto LwfFilter = LwfRxFilter(FnLwf, &PassPacket[0], &Mask[0], PassLength);
+
+        SocketProduceRxFill(&Xsk, 1);
+        MpRxFlush(GenericMp);
+
+        //
+        // The XSK copies the frame as presented to XDP, so the headers were
+        // inspected in place and the MDL tail was presented intact.
+        //
+        UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+        TEST_EQUAL(1, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+        auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+        TEST_EQUAL(MatchLength, RxDesc->Length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+                &MatchPacket[0], MatchLength));
+
+        //
+        // The passed frame reaches the stack with its original MDL chain.
+        //
+        auto LwfFrame = LwfRxAllocateAndGetFrame(FnLwf, 0);
+        TEST_EQUAL(BufferCount, LwfFrame->BufferCount);
+
+        UINT32 TotalLength = 0;
+        for (UINT32 i = 0; i < LwfFrame->BufferCount; i++) {
+            const DATA_BUFFER *Buffer = &LwfFrame->Buffers[i];
+            TEST_TRUE(Buffer->DataLength <= PassLength - TotalLength);
+            TEST_TRUE(
+                RtlEqualMemory(
+                    Buffer->VirtualAddress + Buffer->DataOffset, &PassPacket[TotalLength],
+                    Buffer->DataLength));
+            TotalLength += Buffer->DataLength;
+        }
+        TEST_EQUAL(PassLength, TotalLength);
+
+        LwfRxDequeueFrame(FnLwf, 0);
+        LwfRxFlush(FnLwf);
+    }
+}
+
+VOID
+GenericRxHeaderMultipleFragments(
+    _In_ ADDRESS_FAMILY Af,
+    _In_ XDP_RULE_ACTION ProgramAction,
+    _In_ BOOLEAN IsUdp,
+    _In_ BOOLEAN IsTxInspect,
+    _In_ BOOLEAN IsLowResources
+    )
+{
+    GENERIC_RX_FRAGMENT_PARAMS Params = {0};
+    Params.Action = ProgramAction;
+    Params.IsUdp = IsUdp;
+    Params.PayloadLength = 43;
+    Params.Backfill = 13;
+    Params.Trailer = 17;
+    UINT16 SplitIndexes[5] = { 0 };
+    SplitIndexes[0] = sizeof(ETHERNET_HEADER) / 2;
+    SplitIndexes[1] = SplitIndexes[0] + sizeof(ETHERNET_HEADER);
+    SplitIndexes[2] = SplitIndexes[1] + 1;
+    SplitIndexes[3] = SplitIndexes[2] + ((Af == AF_INET) ? sizeof(IPV4_HEADER) : sizeof(IPV6_HEADER));
+    SplitIndexes[4] = SplitIndexes[3] + (IsUdp ? sizeof(UDP_HDR) : sizeof(TCP_HDR)) / 2;
+
+    for (UINT16 i = 0; i < RTL_NUMBER_OF(SplitIndexes) - 1; i++) {
+        Params.SplitIndexes = &SplitIndexes[i];
+        Params.SplitCount = RTL_NUMBER_OF(SplitIndexes) - i;
+        Params.IsTxInspect = IsTxInspect;
+        Params.LowResources = IsLowResources;
+        GenericRxFragmentBuffer(Af, &Params);
+    }
+}
+
+VOID
+GenericRxHeaderFragments(
+    _In_ ADDRESS_FAMILY Af,
+    _In_ XDP_RULE_ACTION ProgramAction,
+    _In_ BOOLEAN IsUdp,
+    _In_ BOOLEAN IsTxInspect,
+    _In_ BOOLEAN IsLowResources
+    )
+{
+    GENERIC_RX_FRAGMENT_PARAMS Params = {0};
+    Params.Action = ProgramAction;
+    Params.IsUdp = IsUdp;
+    Params.PayloadLength = 43;
+    Params.Backfill = 13;
+    Params.Trailer = 17;
+    UINT16 HeadersLength =
+        sizeof(ETHERNET_HEADER) +
+            ((Af == AF_INET) ? sizeof(IPV4_HEADER) : sizeof(IPV6_HEADER)) +
+            (IsUdp ? sizeof(UDP_HDR) : sizeof(TCP_HDR));
+
+    GenericRxHeaderMultipleFragments(Af, ProgramAction, IsUdp, IsTxInspect, IsLowResources);
+
+    for (UINT16 i = 1; i < HeadersLength; i++) {
+        Params.SplitIndexes = &i;
+        Params.SplitCount = 1;
+        Params.IsTxInspect = IsTxInspect;
+        Params.LowResources = IsLowResources;
+        GenericRxFragmentBuffer(Af, &Params);
+    }
+}
+
+VOID
+GenericRxFromTxInspect(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMp1QIf;
+    UINT16 XskPort;
+    SOCKADDR_INET DestAddr = {};
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &XskPort);
+    auto Xsk =
+        CreateAndBindSocket(
+            If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_UNSPEC, XSK_BIND_FLAG_NONE,
+            &XdpInspectTxL2);
+
+    XskPort = htons(1234);
+
+    XDP_RULE Rule;
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = XskPort;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Redirect.Target = Xsk.Handle.get();
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectTxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    if (Af == AF_INET) {
+        DestAddr.si_family = AF_INET;
+        DestAddr.Ipv4.sin_port = XskPort;
+        If.GetRemoteIpv4Address(&DestAddr.Ipv4.sin_addr);
+    } else {
+        DestAddr.si_family = AF_INET6;
+        DestAddr.Ipv6.sin6_port = XskPort;
+        If.GetRemoteIpv6Address(&DestAddr.Ipv6.sin6_addr);
+    }
+
+    //
+    // Using UDP segmentation offload, build one send with two UDP frames. The
+    // UDP data path should split the send into one NBL chained to two NBs. This
+    // feature is only supported on newer versions of Windows; if USO is not
+    // supported, send a single frame.
+    //
+    UINT32 NumFrames;
+    UINT32 UdpSegmentSize;
+    SIZE_T OptLen = sizeof(UdpSegmentSize);
+    CHAR UdpPayload[] = "GenericRxFromTxInspectPkt1GenericRxFromTxInspectPkt2";
+
+    HRESULT Result =
+        FnSockGetSockOpt(
+            UdpSocket.get(), IPPROTO_UDP, UDP_SEND_MSG_SIZE, (DWORD *)&UdpSegmentSize,
+            &OptLen);
+    if (FAILED(Result)) {
+        TEST_EQUAL(WSAEINVAL, FnSockGetLastError());
+        NumFrames = 1;
+        UdpSegmentSize = sizeof(UdpPayload) - 1;
+    } else {
+        NumFrames = 2;
+        UdpSegmentSize = (UINT32)(strchr(UdpPayload, '1') - UdpPayload + 1);
+        TEST_HRESULT(
+            FnSockSetSockOpt(
+                UdpSocket.get(), IPPROTO_UDP, UDP_SEND_MSG_SIZE, &UdpSegmentSize,
+                sizeof(UdpSegmentSize)));
+    }
+
+    TEST_EQUAL((SIZE_T)NumFrames * (SIZE_T)UdpSegmentSize + 1, sizeof(UdpPayload));
+
+    //
+    // Produce two XSK fill descriptors, one for each UDP frame.
+    //
+    SocketProduceRxFill(&Xsk, NumFrames);
+
+    //
+    // NDIS restarts protocol stacks from the NIC upwards towards protocols, so
+    // XDP completing a bind request does not imply that the TCPIP data path is
+    // restarted. Wait until the send succeeds.
+    //
+    Stopwatch<std::chrono::seconds> Watchdog(std::chrono::seconds(5));
+    INT Bytes;
+    do {
+        Bytes =
+            FnSockSendto(
+                UdpSocket.get(), UdpPayload, NumFrames * UdpSegmentSize, FALSE,
+                0, (SOCKADDR *)&DestAddr, sizeof(DestAddr));
+
+        if (Bytes != -1) {
+            break;
+        }
+        //
+        // TCPIP returns WSAENOBUFS when it cannot reference the data path.
+        //
+        TEST_EQUAL(WSAENOBUFS, FnSockGetLastError());
+    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+
+    TEST_EQUAL(NumFrames * UdpSegmentSize, (UINT32)Bytes);
+
+    //
+    // Verify the NBL propagated correctly to XSK.
+    //
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, NumFrames);
+    TEST_EQUAL(NumFrames, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+
+    for (UINT32 FrameIndex = 0; FrameIndex < NumFrames; FrameIndex++) {
+        auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex++);
+
+        TEST_EQUAL(UDP_HEADER_BACKFILL(Af) + UdpSegmentSize, RxDesc->Length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Xsk.Umem.Buffer.get() + UDP_HEADER_BACKFILL(Af) +
+                    RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+                &UdpPayload[FrameIndex * UdpSegmentSize],
+                UdpSegmentSize));
+    }
+}
+
+static
+VOID
+SendUdpFrames(
+    _In_ const unique_fnsock &Socket,
+    _In_ const TestInterface &If,
+    _In_ UINT16 RemotePort,
+    _In_ UINT32 FrameCount
+    )
+{
+    SOCKADDR_INET DestAddr = {};
+    CHAR UdpPayload[] = "NativeTxInspectDropPass";
+
+    DestAddr.si_family = AF_INET;
+    DestAddr.Ipv4.sin_port = RemotePort;
+    If.GetRemoteIpv4Address(&DestAddr.Ipv4.sin_addr);
+
+    for (UINT32 Index = 0; Index < FrameCount; Index++) {
+        TEST_EQUAL(
+            (INT)sizeof(UdpPayload),
+            FnSockSendto(
+                Socket.get(), UdpPayload, sizeof(UdpPayload), FALSE, 0, (SOCKADDR *)&DestAddr,
+                sizeof(DestAddr)));
+    }
+}
+
+static
+VOID
+WaitForIfCounter(
+    _In_ const TestInterface &If,
+    _In_ ULONG64 MIB_IF_ROW2::*Counter,
+    _In_ ULONG64 Target,
+    _Out_ MIB_IF_ROW2 *IfRow
+    )
+{
+    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+    do {
+        RtlZeroMemory(IfRow, sizeof(*IfRow));
+        IfRow->InterfaceIndex = If.GetIfIndex();
+        TEST_EQUAL(NO_ERROR, GetIfEntry2(IfRow));
+
+        if (IfRow->*Counter >= Target) {
+            break;
+        }
+    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+
+    TEST_TRUE(IfRow->*Counter >= Target);
+}
+
+VOID
+NativeTxInspectDropPass()
+{
+    auto If = XdpMpIf;
+    const UINT32 FrameCount = 8;
+    const UINT16 DropPort = htons(1234);
+    const UINT16 PassPort = htons(1235);
+    UINT16 LocalPort;
+    MIB_IF_ROW2 IfRow;
+
+    //
+    // XDPMP completes NBs dropped by the TX inspect program without posting
+    // them to its hardware ring and counts them as TX discards, whereas passed
+    // NBs are counted as unicast packets once the hardware completes them.
+    //
+    auto UdpSocket = CreateUdpSocket(AF_INET, NULL, &LocalPort);
+
+    XDP_RULE Rule;
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = DropPort;
+    Rule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectTxL2, If.GetQueueId(), XDP_NATIVE, &Rule, 1,
+            XDP_CREATE_PROGRAM_FLAG_ALL_QUEUES);
+
+    WaitForIfCounter(If, &MIB_IF_ROW2::OutDiscards, 0, &IfRow);
+
+    SendUdpFrames(UdpSocket, If, DropPort, FrameCount);
+    WaitForIfCounter(If, &MIB_IF_ROW2::OutDiscards, IfRow.OutDiscards + FrameCount, &IfRow);
+    const ULONG64 OutDiscards = IfRow.OutDiscards;
+
+    SendUdpFrames(UdpSocket, If, PassPort, FrameCount);
+    WaitForIfCounter(If, &MIB_IF_ROW2::OutUcastPkts, IfRow.OutUcastPkts + FrameCount, &IfRow);
+    TEST_EQUAL(OutDiscards, IfRow.OutDiscards);
+}
+
+VOID
+NativeRxBackpressure()
+{
+    auto If = XdpMpIf;
+    MY_SOCKET Socket;
+    BOOLEAN Backpressure = TRUE;
+    const UINT32 FrameCount = 8;
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    XSK_STATISTICS Stats;
+    UINT32 OptionLength;
+    UINT32 ConsumerIndex;
+
+    //
+    // XDPMP continuously receives frames on its first queue and supports
+    // backpressure, so a socket with an empty fill ring leaves the frames in
+    // the interface rather than dropping them.
+    //
+    Socket.Handle = CreateSocket();
+    XskSetupPreBind(&Socket, TRUE, FALSE);
+    SetSockopt(
+        Socket.Handle.get(), XSK_SOCKOPT_RX_BACKPRESSURE, &Backpressure, sizeof(Backpressure));
+
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Socket.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_NATIVE));
+    TEST_HRESULT(XdpApi->XskActivate(Socket.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    XskSetupPostBind(&Socket, TRUE, FALSE);
+
+    auto ProgramHandle =
+        SocketAttachRxProgram(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_NATIVE, Socket.Handle.get());
+
+    //
+    // Verify frames are held: the fill ring requests a poke, and nothing is
+    // dropped or delivered while the interface keeps receiving.
+    //
+    SocketProducerCheckNeedPoke(&Socket.Rings.Fill, TRUE);
+    Sleep(TEST_TIMEOUT_ASYNC_MS);
+
+    OptionLength = sizeof(Stats);
+    GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_STATISTICS, &Stats, &OptionLength);
+    TEST_EQUAL(0, Stats.RxDropped);
+    TEST_EQUAL(0, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+
+    //
+    // Verify the held frames are delivered once the fill ring is refilled and
+    // RX is poked, and the remaining frames are held again.
+    //
+    SocketProduceRxFill(&Socket, FrameCount);
+    NotifySocket(Socket.Handle.get(), XSK_NOTIFY_FLAG_POKE_RX, 0, &NotifyResult);
+
+    ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, FrameCount);
+    for (UINT32 Index = 0; Index < FrameCount; Index++) {
+        auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex++);
+        TEST_TRUE(RxDesc->Length > 0);
+    }
+    XskRingConsumerRelease(&Socket.Rings.Rx, FrameCount);
+
+    SocketProducerCheckNeedPoke(&Socket.Rings.Fill, TRUE);
+
+    OptionLength = sizeof(Stats);
+    GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_STATISTICS, &Stats, &OptionLength);
+    TEST_EQUAL(0, Stats.RxDropped);
+}
+
+static
+VOID
+GenerateTestPassword(
+    _Out_writes_z_(BufferCount) WCHAR *Buffer,
+    _In_ UINT32 BufferCount
+    )
+{
+    TEST_TRUE(BufferCount >= 4);
+    ASSERT(BufferCount >= 4);
+
+    //
+    // Terminate the string and attempt to satisfy complexity requirements with
+    // some hard-coded values.
+    //
+    Buffer[--BufferCount] = L'\0';
+    Buffer[--BufferCount] = L'A';
+    Buffer[--BufferCount] = L'b';
+    Buffer[--BufferCount] = L'#';
+
+    for (UINT32 i = 0; i < BufferCount; i++) {
+        static const WCHAR Characters[] =
+            L"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+            "abcdefghijklmnopqrstuvwxyz"
+            "0123456789";
+
+        unsigned int r;
+        rand_s(&r);
+
+        Buffer[i] = Characters[r % RTL_NUMBER_OF(Characters)];
+    }
+}
+
+VOID
+SecurityAdjustDeviceAcl()
+{
+    PCWSTR UserName = L"xdpfnuser";
+    WCHAR UserPassword[16 + 1];
+    USER_INFO_1 UserInfo = {0};
+    NET_API_STATUS UserStatus;
+    SE_SID UserSid;
+    SID_NAME_USE UserSidUse;
+    auto If = FnMpIf;
+
+    //
+    // Create a standard, non-admin user on the local system and create a logon
+    // session for them.
+    //
+
+    UserInfo.usri1_name = (PWSTR)UserName;
+    UserInfo.usri1_password = (PWSTR)UserPassword;
+    UserInfo.usri1_priv = USER_PRIV_USER;
+    UserInfo.usri1_flags = UF_SCRIPT | UF_PASSWD_NOTREQD | UF_DONT_EXPIRE_PASSWD;
+
+    for (UINT32 i = 0; i < 10; i++) {
+        GenerateTestPassword(UserPassword, RTL_NUMBER_OF(UserPassword));
+
+        UserStatus = NetUserAdd(NULL, 1, (BYTE *)&UserInfo, NULL);
+        if (UserStatus == NERR_Success) {
+            break;
+        }
+    }
+
+    TEST_EQUAL(NERR_Success, UserStatus);
+
+    auto UserRemove = wil::scope_exit([&]
+    {
+        NET_API_STATUS UserStatus = NetUserDel(NULL, UserName);
+
+        if (UserStatus != NERR_Success) {
+            TEST_WARNING("NetUserDel failed: %x", UserStatus);
+        }
+    });
+
+    wil::unique_handle Token;
+    TEST_TRUE(LogonUserW(
+        UserName, L".", UserPassword, LOGON32_LOGON_NETWORK, LOGON32_PROVIDER_DEFAULT, &Token));
+
+    //
+    // As the non-admin user, verify XDP denies access to all handle types.
+    //
+    {
+        TEST_TRUE(ImpersonateLoggedOnUser(Token.get()));
+        auto Unimpersonate = wil::scope_exit([&]
+        {
+            RevertToSelf();
+        });
+
+        wil::unique_handle Socket;
+        TEST_EQUAL(
+            HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED),
+            TryCreateSocket(Socket));
+
+        wil::unique_handle Interface;
+        TEST_EQUAL(
+            HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED),
+            TryInterfaceOpen(If.GetIfIndex(), Interface));
+    }
+
+    //
+    // Grant the test's standard user access to XDP.
+    //
+
+    DWORD SidSize = sizeof(UserSid);
+    WCHAR Domain[256];
+    DWORD DomainSize = RTL_NUMBER_OF(Domain);
+
+    TEST_TRUE(LookupAccountNameW(
+        NULL, UserName, &UserSid.Sid, &SidSize, Domain, &DomainSize, &UserSidUse));
+
+    wil::unique_hlocal_ansistring SidString;
+    TEST_TRUE(ConvertSidToStringSidA(&UserSid.Sid, wil::out_param(SidString)));
+
+    CHAR SddlBuff[256];
+    RtlZeroMemory(SddlBuff, sizeof(SddlBuff));
+    sprintf_s(SddlBuff, DEFAULT_XDP_SDDL "(A;;GA;;;%s)", SidString.get());
+
+    SetDeviceSddl(SddlBuff);
+    auto ResetSddl = wil::scope_exit([&]
+    {
+        SetDeviceSddl(DEFAULT_XDP_SDDL);
+
+        HRESULT Result = TryRestartService(XDP_SERVICE_NAME);
+        if (FAILED(Result)) {
+            TEST_WARNING("TryRestartService(XDP_SERVICE_NAME) failed: %x", Result);
+        }
+    });
+
+    TEST_HRESULT(TryRestartService(XDP_SERVICE_NAME));
+
+    //
+    // As the non-admin user, verify XDP now grants access to all handle types.
+    //
+    {
+        TEST_TRUE(ImpersonateLoggedOnUser(Token.get()));
+        auto Unimpersonate = wil::scope_exit([&]
+        {
+            RevertToSelf();
+        });
+
+        CreateSocket();
+        InterfaceOpen(If.GetIfIndex());
+    }
+}
+
+static
+HRESULT
+TryAttachEbpfXdpProgram(
+    _Out_ unique_bpf_object &BpfObject,
+    _In_ const TestInterface &If,
+    _In_ const CHAR *BpfRelativeFileName,
+    _In_ const CHAR *BpfProgramName,
+    _In_ INT AttachFlags = 0,
+    _In_opt_ const XDP_EBPF_ATTACH_PARAMS *EbpfAttachParams = NULL,
+    _Out_opt_ unique_bpf_link *BpfLink = NULL
+    )
+{
+    HRESULT Result;
+    CHAR Path[MAX_PATH];
+    std::string BpfAbsoluteFileName;
+    bpf_program *Program;
+    int ProgramFd;
+    int ErrnoResult;
+
+    Result = GetCurrentBinaryPath(Path, RTL_NUMBER_OF(Path));
+    if (FAILED(Result)) {
+        goto Exit;
+    }
+
+    BpfAbsoluteFileName = Path;
+    BpfAbsoluteFileName += BpfRelativeFileName;
+
+    BpfObject.reset(bpf_object__open(BpfAbsoluteFileName.c_str()));
+    if (BpfObject.get() == NULL) {
+        TraceError("bpf_object__open failed: %d", errno);
+        Result = E_FAIL;
+        goto Exit;
+    }
+
+    ErrnoResult = bpf_object__load(BpfObject.get());
+    if (ErrnoResult != 0) {
+        TraceError("bpf_object__load failed: %d, errno=%d", ErrnoResult, errno);
+        Result = E_FAIL;
+        goto Exit;
+    }
+
+    Program = bpf_object__find_program_by_name(BpfObject.get(), BpfProgramName);
+    if (Program == NULL) {
+        TraceError("bpf_object__find_program_by_name failed: %d", errno);
+        Result = E_FAIL;
+        goto Exit;
+    }
+
+    ProgramFd = bpf_program__fd(Program);
+    if (ProgramFd < 0) {
+        TraceError("bpf_program__fd failed: %d", errno);
+        Result = E_FAIL;
+        goto Exit;
+    }
+
+    if (EbpfAttachParams != NULL) {
+        XDP_EBPF_ATTACH_PARAMS AttachParams = *EbpfAttachParams;
+        bpf_link *Link = NULL;
+        ebpf_result_t EbpfResult;
+
+        //
+        // The extended attach parameters cannot be supplied via
+        // bpf_xdp_attach.
+        //
+        TEST_NOT_NULL(BpfLink);
+        AttachParams.IfIndex = If.GetIfIndex();
+
+        EbpfResult =
+            ebpf_program_attach_by_fd(
+                ProgramFd, &EBPF_ATTACH_TYPE_XDP, &AttachParams, sizeof(AttachParams), &Link);
+        if (EbpfResult != EBPF_SUCCESS) {
+            TraceError("ebpf_program_attach_by_fd failed: %d", EbpfResult);
+            Result = E_FAIL;
+            goto Exit;
+        }
+
+        BpfLink->reset(Link);
+    } else {
+        ErrnoResult = bpf_xdp_attach(If.GetIfIndex(), ProgramFd, AttachFlags, NULL);
+        if (ErrnoResult != 0) {
+            TraceError("bpf_xdp_attach failed: %d, errno=%d", ErrnoResult, errno);
+            Result = E_FAIL;
+            goto Exit;
+        }
+    }
+
+    Result = S_OK;
+
+Exit:
+
+    if (FAILED(Result)) {
+        BpfObject.reset();
+    }
+
+    return Result;
+}
+
+static
+unique_bpf_object
+AttachEbpfXdpProgram(
+    _In_ const TestInterface &If,
+    _In_ const CHAR *BpfRelativeFileName,
+    _In_ const CHAR *BpfProgramName,
+    _In_ INT AttachFlags = 0,
+    _In_opt_ const XDP_EBPF_ATTACH_PARAMS *EbpfAttachParams = NULL,
+    _Out_opt_ unique_bpf_link *BpfLink = NULL
+    )
+{
+    unique_bpf_object BpfObject;
+    HRESULT Result;
+
+    //
+    // TODO: https://github.com/microsoft/ebpf-for-windows/issues/2133
+    // Workaround till the above issue is fixed (and eBPF returns E_BUSY):
+    // Try a few times to load and attach the program with a sleep in between.
+    //
+    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+    do {
+        Result = TryAttachEbpfXdpProgram(
+            BpfObject, If, BpfRelativeFileName, BpfProgramName, AttachFlags, EbpfAttachParams,
+            BpfLink);
+        if (Result == S_OK) {
+            break;
+        }
+    } while (Sleep(2 * POLL_INTERVAL_MS), !Watchdog.IsExpired());
+
+    TEST_HRESULT(Result);
+
+    return BpfObject;
+}
+
+VOID
+GenericRxEbpfAttach()
+{
+    auto If = FnMpIf;
+
+    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\drop.sys", "drop");
+
+    unique_bpf_object BpfObjectReplacement;
+    TEST_TRUE(FAILED(TryAttachEbpfXdpProgram(BpfObjectReplacement, If, "\\bpf\\pass.sys", "pass")));
+
+    //
+    // eBPF doesn't wait for the pass.sys driver to completely unload after
+    // tearing down the object, so allow some time for that to happen before
+    // retrying with the replace flag.
+    //
+    Sleep(TEST_TIMEOUT_ASYNC_MS);
+    BpfObjectReplacement =
+        AttachEbpfXdpProgram(If, "\\bpf\\pass.sys", "pass", XDP_FLAGS_REPLACE);
+}
+
+VOID
+GenericRxEbpfDrop()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    unique_fnlwf_handle FnLwf;
+    const UCHAR Payload[] = "GenericRxEbpfDrop";
+
+    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\drop.sys", "drop");
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+    FnLwf = LwfOpenDefault(If.GetIfIndex());
+
+    std::vector<UCHAR> Mask(sizeof(Payload), 0xFF);
+    auto LwfFilter = LwfRxFilter(FnLwf, Payload, &Mask[0], sizeof(Payload));
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    Sleep(TEST_TIMEOUT_ASYNC_MS);
+
+    UINT32 FrameLength = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+        LwfRxGetFrame(FnLwf, If.GetQueueId(), &FrameLength, NULL));
+}
+
+VOID
+GenericTxEbpfDrop()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    unique_fnlwf_handle FnLwf;
+    const UCHAR Payload[] = "GenericTxEbpfDrop";
+
+    XDP_EBPF_ATTACH_PARAMS AttachParams = {0};
+    AttachParams.HookId = XdpInspectTxL2;
+    unique_bpf_link BpfLink;
+    unique_bpf_object BpfObject =
+        AttachEbpfXdpProgram(If, "\\bpf\\drop.sys", "drop", 0, &AttachParams, &BpfLink);
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+    FnLwf = LwfOpenDefault(If.GetIfIndex());
+
+    std::vector<UCHAR> Mask(sizeof(Payload), 0xFF);
+    auto MpFilter = MpTxFilter(GenericMp, Payload, &Mask[0], sizeof(Payload));
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+    LwfTxEnqueue(FnLwf, &Frame.Frame);
+    LwfTxFlush(FnLwf);
+
+    Sleep(TEST_TIMEOUT_ASYNC_MS);
+
+    UINT32 FrameLength = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+        MpTxGetFrame(GenericMp, 0, &FrameLength, NULL));
+}
+
+VOID
+GenericRxEbpfPass()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    unique_fnlwf_handle FnLwf;
+    const UCHAR Payload[] = "GenericRxEbpfPass";
+
+    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\pass.sys", "pass");
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+    FnLwf = LwfOpenDefault(If.GetIfIndex());
+
+    std::vector<UCHAR> Mask(sizeof(Payload), 0xFF);
+    auto LwfFilter = LwfRxFilter(FnLwf, Payload, &Mask[0], sizeof(Payload));
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    LwfRxAllocateAndGetFrame(FnLwf, If.GetQueueId());
+    LwfRxDequeueFrame(FnLwf, If.GetQueueId());
+    LwfRxFlush(FnLwf);
+}
+
+VOID
+GenericRxEbpfReplace()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    unique_fnlwf_handle FnLwf;
+    const UCHAR Payload[] = "GenericRxEbpfReplace";
+    UINT32 FrameLength = 0;
+
+    XDP_EBPF_ATTACH_PARAMS AttachParams = {0};
+    AttachParams.HookId = XdpInspectRxL2;
+    unique_bpf_link DropLink;
+    unique_bpf_object DropObject =
+        AttachEbpfXdpProgram(If, "\\bpf\\drop.sys", "drop", 0, &AttachParams, &DropLink);
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+    FnLwf = LwfOpenDefault(If.GetIfIndex());
+
+    std::vector<UCHAR> Mask(sizeof(Payload), 0xFF);
+    auto LwfFilter = LwfRxFilter(FnLwf, Payload, &Mask[0], sizeof(Payload));
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    Sleep(TEST_TIMEOUT_ASYNC_MS);
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+        LwfRxGetFrame(FnLwf, If.GetQueueId(), &FrameLength, NULL));
+
+    //
+    // Without the replace flag, the hook is occupied.
+    //
+    unique_bpf_link PassLink;
+    unique_bpf_object PassObject;
+    TEST_TRUE(
+        FAILED(
+            TryAttachEbpfXdpProgram(
+                PassObject, If, "\\bpf\\pass.sys", "pass", 0, &AttachParams, &PassLink)));
+
+    //
+    // Replace the program while the replaced program's link stays attached.
+    //
+    Sleep(TEST_TIMEOUT_ASYNC_MS);
+    AttachParams.Flags = XDP_EBPF_ATTACH_FLAG_REPLACE;
+    PassObject =
+        AttachEbpfXdpProgram(If, "\\bpf\\pass.sys", "pass", 0, &AttachParams, &PassLink);
+
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    LwfRxAllocateAndGetFrame(FnLwf, If.GetQueueId());
+    LwfRxDequeueFrame(FnLwf, If.GetQueueId());
+    LwfRxFlush(FnLwf);
+
+    //
+    // Detaching the replaced program leaves the replacement attached.
+    //
+    DropLink.reset();
+    DropObject.reset();
+
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    LwfRxAllocateAndGetFrame(FnLwf, If.GetQueueId());
+    LwfRxDequeueFrame(FnLwf, If.GetQueueId());
+    LwfRxFlush(FnLwf);
+}
+
+VOID
+GenericRxEbpfFlowCache()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    unique_fnlwf_handle FnLwf;
+    UINT16 LocalPort = htons(1234);
+    UINT16 RemotePort = htons(4321);
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UCHAR UdpPayload[] = "GenericRxEbpfFlowCache";
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    RX_FRAME Frame;
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw, &RemoteHw,
+            AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+    FnLwf = LwfOpenDefault(If.GetIfIndex());
+
+    std::vector<UCHAR> Mask(UdpFrameLength, 0xFF);
+    auto LwfFilter = LwfRxFilter(FnLwf, UdpFrame, &Mask[0], UdpFrameLength);
+
+    XDP_EBPF_ATTACH_PARAMS AttachParams = {0};
+    AttachParams.HookId = XdpInspectRxL2;
+    AttachParams.Flags = XDP_EBPF_ATTACH_FLAG_FLOW_VERDICT_CACHE;
+
+    {
+        //
+        // Several frames of the same flow are all dropped, whether the verdict
+        // is computed by the program or replayed from the cache.
+        //
+        unique_bpf_link BpfLink;
+        unique_bpf_object BpfObject =
+            AttachEbpfXdpProgram(
+                If, "\\bpf\\drop.sys", "drop", 0, &AttachParams, &BpfLink);
+
+        for (UINT32 i = 0; i < 4; i++) {
+            RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+            TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+            MpRxFlush(GenericMp);
+        }
+
+        Sleep(TEST_TIMEOUT_ASYNC_MS);
+
+        UINT32 FrameLength = 0;
+        TEST_EQUAL(
+            HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+            LwfRxGetFrame(FnLwf, If.GetQueueId(), &FrameLength, NULL));
+    }
+
+    //
+    // eBPF doesn't wait for the drop.sys driver to completely unload after
+    // tearing down the object, so allow some time for that to happen.
+    //
+    Sleep(TEST_TIMEOUT_ASYNC_MS);
+
+    //
+    // Replacing the program invalidates the cached verdicts.
+    //
+    unique_bpf_link BpfLink;
+    unique_bpf_object BpfObject =
+        AttachEbpfXdpProgram(
+            If, "\\bpf\\pass.sys", "pass", 0, &AttachParams, &BpfLink);
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    LwfRxAllocateAndGetFrame(FnLwf, If.GetQueueId());
+    LwfRxDequeueFrame(FnLwf, If.GetQueueId());
+    LwfRxFlush(FnLwf);
+}
+
+VOID
+GenericRxEbpfPrefilter()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    unique_fnlwf_handle FnLwf;
+    UINT16 MatchPort = htons(1234);
+    UINT16 OtherPort = htons(1235);
+    UINT16 RemotePort = htons(4321);
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UCHAR UdpPayload[] = "GenericRxEbpfPrefilter";
+    UCHAR MatchFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 MatchFrameLength = sizeof(MatchFrame);
+    UCHAR OtherFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 OtherFrameLength = sizeof(OtherFrame);
+    RX_FRAME Frame;
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            MatchFrame, &MatchFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw, &RemoteHw,
+            AF_INET, &LocalIp, &RemoteIp, MatchPort, RemotePort));
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            OtherFrame, &OtherFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw, &RemoteHw,
+            AF_INET, &LocalIp, &RemoteIp, OtherPort, RemotePort));
+
+    //
+    // Invoke the drop program only for frames destined to the matching port.
+    //
+    XDP_EBPF_ATTACH_PARAMS AttachParams = {0};
+    AttachParams.HookId = XdpInspectRxL2;
+    AttachParams.PrefilterMatch = XDP_MATCH_UDP_DST;
+    AttachParams.PrefilterPattern.Port = MatchPort;
+    unique_bpf_link BpfLink;
+    unique_bpf_object BpfObject =
+        AttachEbpfXdpProgram(If, "\\bpf\\drop.sys", "drop", 0, &AttachParams, &BpfLink);
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+    FnLwf = LwfOpenDefault(If.GetIfIndex());
+
+    std::vector<UCHAR> Mask(MatchFrameLength, 0xFF);
+    auto LwfFilter = LwfRxFilter(FnLwf, MatchFrame, &Mask[0], MatchFrameLength);
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), MatchFrame, MatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    Sleep(TEST_TIMEOUT_ASYNC_MS);
+
+    UINT32 FrameLength = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+        LwfRxGetFrame(FnLwf, If.GetQueueId(), &FrameLength, NULL));
+
+    //
+    // Frames not matching the prefilter bypass the program and are passed.
+    //
+    LwfFilter.reset();
+    LwfFilter = LwfRxFilter(FnLwf, OtherFrame, &Mask[0], OtherFrameLength);
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), OtherFrame, OtherFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    LwfRxAllocateAndGetFrame(FnLwf, If.GetQueueId());
+    LwfRxDequeueFrame(FnLwf, If.GetQueueId());
+    LwfRxFlush(FnLwf);
+}
+
+VOID
+GenericRxEbpfTx()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    const UCHAR Payload[] = "GenericRxEbpfTx";
+
+    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\l1fwd.sys", "l1fwd");
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    std::vector<UCHAR> Mask(sizeof(Payload), 0xFF);
+    auto MpFilter = MpTxFilter(GenericMp, Payload, &Mask[0], sizeof(Payload));
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    MpTxAllocateAndGetFrame(GenericMp, If.GetQueueId());
+    MpTxDequeueFrame(GenericMp, If.GetQueueId());
+    MpTxFlush(GenericMp);
+}
+
+VOID
+GenericRxEbpfAdjustTail()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    const UINT32 Trim = 8;
+    const UCHAR Payload[] = "GenericRxEbpfAdjustTail and its trailer";
+    const UINT32 TrimmedLength = sizeof(Payload) - Trim;
+    UINT32 TotalLength = 0;
+
+    unique_bpf_object BpfObject =
+        AttachEbpfXdpProgram(If, "\\bpf\\adjust_tail_tx.sys", "adjust_tail_tx");
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    std::vector<UCHAR> Mask(TrimmedLength, 0xFF);
+    auto MpFilter = MpTxFilter(GenericMp, Payload, &Mask[0], TrimmedLength);
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    //
+    // Verify only the trimmed frame was forwarded.
+    //
+    auto TxFrame = MpTxAllocateAndGetFrame(GenericMp, If.GetQueueId());
+    for (UINT32 i = 0; i < TxFrame->BufferCount; i++) {
+        TotalLength += TxFrame->Buffers[i].DataLength;
+    }
+    TEST_EQUAL(TrimmedLength, TotalLength);
+
+    MpTxDequeueFrame(GenericMp, If.GetQueueId());
+    MpTxFlush(GenericMp);
+}
+
+VOID
+GenericRxEbpfRedirectXsk()
+{
+    auto If = FnMpIf;
+    MY_SOCKET Socket;
+    MY_SOCKET DuplicateSocket;
+    const UINT32 Key = 0;
+    const UINT32 InvalidKey = XSK_EBPF_MAP_MAX_KEYS;
+    const UCHAR Payload[] = "GenericRxEbpfRedirectXsk";
+
+    //
+    // Insert a socket into the RX queue's socket map.
+    //
+    Socket.Handle = CreateSocket();
+    XskSetupPreBind(&Socket, TRUE, FALSE);
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TrySetSockopt(
+            Socket.Handle.get(), XSK_SOCKOPT_EBPF_MAP_KEY, &InvalidKey, sizeof(InvalidKey)));
+    SetSockopt(Socket.Handle.get(), XSK_SOCKOPT_EBPF_MAP_KEY, &Key, sizeof(Key));
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Socket.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Socket.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    XskSetupPostBind(&Socket, TRUE, FALSE);
+
+    //
+    // Each key of a queue's socket map holds at most one socket.
+    //
+    DuplicateSocket.Handle = CreateSocket();
+    XskSetupPreBind(&DuplicateSocket, TRUE, FALSE);
+    SetSockopt(DuplicateSocket.Handle.get(), XSK_SOCKOPT_EBPF_MAP_KEY, &Key, sizeof(Key));
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            DuplicateSocket.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_GENERIC));
+    TEST_TRUE(
+        FAILED(XdpApi->XskActivate(DuplicateSocket.Handle.get(), XSK_ACTIVATE_FLAG_NONE)));
+
+    unique_bpf_object BpfObject =
+        AttachEbpfXdpProgram(If, "\\bpf\\redirect_xsk.sys", "redirect_xsk");
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    SocketProduceRxFill(&Socket, 1);
+    TEST_HRESULT(TryMpRxFlush(GenericMp));
+
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+    TEST_EQUAL(sizeof(Payload), RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            Payload, sizeof(Payload)));
+    XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+}
+
+VOID
+GenericRxEbpfMetadata()
+{
+    auto If = FnMpIf;
+    MY_SOCKET Socket;
+    const UINT32 Key = 0;
+    const UINT32 MetadataSize = 2 * sizeof(UINT32);
+    const UINT32 InvalidMetadataSize = MetadataSize + 1;
+    const UINT32 Headroom = MetadataSize;
+    const UINT32 Backfill = 16;
+    const UINT32 MetadataValue = 0x1234ABCD;
+    const UCHAR Payload[] = "GenericRxEbpfMetadata";
+
+    Socket.Handle = CreateSocket();
+
+    Socket.Umem.Buffer = AllocUmemBuffer();
+    InitUmem(&Socket.Umem.Reg, Socket.Umem.Buffer.get());
+    Socket.Umem.Reg.Headroom = Headroom;
+    SetUmem(Socket.Handle.get(), &Socket.Umem.Reg);
+    SetFillRing(Socket.Handle.get());
+    SetCompletionRing(Socket.Handle.get());
+    SetRxRing(Socket.Handle.get());
+
+    //
+    // The metadata area must be 4-byte aligned and fit in the UMEM headroom.
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TrySetSockopt(
+            Socket.Handle.get(), XSK_SOCKOPT_EBPF_METADATA, &InvalidMetadataSize,
+            sizeof(InvalidMetadataSize)));
+    UINT32 LargeMetadataSize = MetadataSize + sizeof(UINT32);
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TrySetSockopt(
+            Socket.Handle.get(), XSK_SOCKOPT_EBPF_METADATA, &LargeMetadataSize,
+            sizeof(LargeMetadataSize)));
+    SetSockopt(Socket.Handle.get(), XSK_SOCKOPT_EBPF_METADATA, &MetadataSize, sizeof(MetadataSize));
+    SetSockopt(Socket.Handle.get(), XSK_SOCKOPT_EBPF_MAP_KEY, &Key, sizeof(Key));
+
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Socket.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Socket.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    XskSetupPostBind(&Socket, TRUE, FALSE);
+
+    unique_bpf_object BpfObject =
+        AttachEbpfXdpProgram(If, "\\bpf\\redirect_xsk_meta.sys", "redirect_xsk_meta");
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    std::memset(Socket.Umem.Buffer.get(), 0xFF, Socket.Umem.Reg.TotalSize);
+    SocketProduceRxFill(&Socket, 1);
+
+    //
+    // The program places its metadata in the frame's backfill.
+    //
+    UCHAR FrameBuffer[Backfill + sizeof(Payload)] = {0};
+    RtlCopyMemory(FrameBuffer + Backfill, Payload, sizeof(Payload));
+
+    RX_FRAME Frame;
+    DATA_BUFFER Buffer = {0};
+    Buffer.DataOffset = Backfill;
+    Buffer.DataLength = sizeof(Payload);
+    Buffer.BufferLength = sizeof(FrameBuffer);
+    Buffer.VirtualAddress = FrameBuffer;
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), &Buffer);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+    UCHAR *RxFrame =
+        Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset;
+    UINT32 Metadata[MetadataSize / sizeof(UINT32)];
+
+    TEST_EQUAL(Headroom, RxDesc->Address.Offset);
+    TEST_EQUAL(sizeof(Payload), RxDesc->Length);
+    TEST_TRUE(RtlEqualMemory(RxFrame, Payload, sizeof(Payload)));
+
+    //
+    // The program's metadata ends where the frame data begins, and the rest of
+    // the area is zeroed.
+    //
+    RtlCopyMemory(Metadata, RxFrame - Headroom, sizeof(Metadata));
+    TEST_EQUAL(0, Metadata[0]);
+    TEST_EQUAL(MetadataValue, Metadata[1]);
+    XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+}
+
+VOID
+GenericRxEbpfPayload()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    unique_fnlwf_handle FnLwf;
+    UINT16 LocalPort = 0, RemotePort = 0;
+    ETHERNET_ADDRESS LocalHw = {}, RemoteHw = {};
+    INET_ADDR LocalIp = {}, RemoteIp = {};
+    const UINT32 Backfill = 13;
+    const UINT32 Trailer = 17;
+    const UCHAR UdpPayload[] = "GenericRxEbpfPayload";
+
+    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\allow_ipv6.sys", "allow_ipv6");
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+    FnLwf = LwfOpenDefault(If.GetIfIndex());
+
+    UCHAR UdpFrame[Backfill + UDP_HEADER_STORAGE + sizeof(UdpPayload) + Trailer];
+    UINT32 UdpFrameLength = sizeof(UdpFrame) - Backfill - Trailer;
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame + Backfill, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, AF_INET6, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    std::vector<UCHAR> Mask(UdpFrameLength, 0xFF);
+    auto LwfFilter = LwfRxFilter(FnLwf, UdpFrame + Backfill, &Mask[0], UdpFrameLength);
+
+    RX_FRAME Frame;
+    DATA_BUFFER Buffer = {0};
+    Buffer.DataOffset = Backfill;
+    Buffer.DataLength = UdpFrameLength;
+    Buffer.BufferLength = Backfill + UdpFrameLength + Trailer;
+    Buffer.VirtualAddress = UdpFrame;
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), &Buffer);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    LwfRxAllocateAndGetFrame(FnLwf, If.GetQueueId());
+    LwfRxDequeueFrame(FnLwf, If.GetQueueId());
+    LwfRxFlush(FnLwf);
+}
+
+VOID
+ProgTestRunRxEbpfPayload()
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort = 0, RemotePort = 0;
+    ETHERNET_ADDRESS LocalHw = {}, RemoteHw = {};
+    INET_ADDR LocalIp = {}, RemoteIp = {};
+    const UCHAR UdpPayload[] = "ProgTestRunRxEbpfPayload";
+    bpf_test_run_opts Opts = {};
+
+    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\allow_ipv6.sys", "allow_ipv6");
+    fd_t ProgFd = bpf_program__fd(bpf_object__find_program_by_name(BpfObject.get(), "allow_ipv6"));
+
+    // Build a v6 packet and verify it is allowed.
+    UCHAR UdpFrameV6[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UCHAR UdpFrameOutV6[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrameV6);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrameV6, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, AF_INET6, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    Opts.data_in = UdpFrameV6;
+    Opts.data_size_in = sizeof(UdpFrameV6);
+    Opts.data_out = UdpFrameOutV6;
+    Opts.data_size_out = sizeof(UdpFrameOutV6);
+    Opts.ctx_in = nullptr;
+    Opts.ctx_size_in = 0;
+    Opts.ctx_out = nullptr;
+    Opts.ctx_size_out = 0;
+
+    TEST_EQUAL(0, bpf_prog_test_run_opts(ProgFd, &Opts));
+    TEST_EQUAL(Opts.retval, XDP_PASS);
+
+    TEST_EQUAL(memcmp(UdpFrameV6, UdpFrameOutV6, sizeof(UdpFrameV6)), 0);
+
+    // Build a v4 packet and verify it is dropped.
+    UCHAR UdpFrameV4[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UCHAR UdpFrameOutV4[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UdpFrameLength = sizeof(UdpFrameV4);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrameV4, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    Opts.data_in = UdpFrameV4;
+    Opts.data_size_in = sizeof(UdpFrameV4);
+    Opts.data_out = UdpFrameOutV4;
+    Opts.data_size_out = sizeof(UdpFrameOutV4);
+    Opts.ctx_in = nullptr;
+    Opts.ctx_size_in = 0;
+    Opts.ctx_out = nullptr;
+    Opts.ctx_size_out = 0;
+
+    TEST_EQUAL(0, bpf_prog_test_run_opts(ProgFd, &Opts));
+    TEST_EQUAL(Opts.retval, XDP_DROP);
+
+    TEST_EQUAL(memcmp(UdpFrameV4, UdpFrameOutV4, sizeof(UdpFrameV4)), 0);
+}
+
+VOID
+ProgTestRunRxEbpfRepeat()
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort = 0, RemotePort = 0;
+    ETHERNET_ADDRESS LocalHw = {}, RemoteHw = {};
+    INET_ADDR LocalIp = {}, RemoteIp = {};
+    const UCHAR UdpPayload[] = "ProgTestRunRxEbpfRepeat";
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UCHAR UdpFrameOut[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    bpf_test_run_opts Opts = {};
+
+    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\allow_ipv6.sys", "allow_ipv6");
+    fd_t ProgFd = bpf_program__fd(bpf_object__find_program_by_name(BpfObject.get(), "allow_ipv6"));
+
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, AF_INET6, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    //
+    // Benchmark the program by invoking it repeatedly on a single context. The
+    // eBPF runtime reports the average duration of each invocation.
+    //
+    Opts.data_in = UdpFrame;
+    Opts.data_size_in = sizeof(UdpFrame);
+    Opts.data_out = UdpFrameOut;
+    Opts.data_size_out = sizeof(UdpFrameOut);
+    Opts.repeat = 10000;
+
+    TEST_EQUAL(0, bpf_prog_test_run_opts(ProgFd, &Opts));
+    TEST_EQUAL(Opts.retval, XDP_PASS);
+    TEST_EQUAL(Opts.data_size_out, sizeof(UdpFrame));
+    TEST_EQUAL(memcmp(UdpFrame, UdpFrameOut, sizeof(UdpFrame)), 0);
+
+    TraceVerbose("allow_ipv6 Repeat=%u Duration=%uns", Opts.repeat, Opts.duration);
+}
+
+VOID
+GenericRxEbpfIfIndex()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    unique_fnlwf_handle FnLwf;
+    const UCHAR Payload[] = "GenericRxEbpfIfIndex";
+    UINT32 Zero = 0;
+
+    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\selective_drop.sys", "selective_drop");
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+    FnLwf = LwfOpenDefault(If.GetIfIndex());
+
+    // Get the interface_map fd.
+    fd_t interface_map_fd = bpf_object__find_map_fd_by_name(BpfObject.get(), "interface_map");
+    TEST_NOT_EQUAL(interface_map_fd, ebpf_fd_invalid);
+
+    // Update the interface_map with the interface index of the test interface.
+    UINT32 IfIndex = If.GetIfIndex();
+    TEST_NOT_EQUAL(IfIndex, IFI_UNSPECIFIED);
+
+    TEST_EQUAL(0, bpf_map_update_elem(interface_map_fd, &Zero, &IfIndex, BPF_ANY));
+
+    std::vector<UCHAR> Mask(sizeof(Payload), 0xFF);
+    auto LwfFilter = LwfRxFilter(FnLwf, Payload, &Mask[0], sizeof(Payload));
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    Sleep(TEST_TIMEOUT_ASYNC_MS);
+
+    UINT32 FrameLength = 0;
+    // Packet should be dropped.
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+        LwfRxGetFrame(FnLwf, If.GetQueueId(), &FrameLength, NULL));
+
+    // Validate that the dropped_packet_map contains a non-0 entry for the IfIndex.
+    fd_t dropped_packet_map_fd = bpf_object__find_map_fd_by_name(BpfObject.get(), "dropped_packet_map");
+    TEST_NOT_EQUAL(dropped_packet_map_fd, ebpf_fd_invalid);
+
+    UINT64 DroppedPacketCount = 0;
+    TEST_EQUAL(0, bpf_map_lookup_elem(dropped_packet_map_fd, &Zero, &DroppedPacketCount));
+    TEST_EQUAL(DroppedPacketCount, 1);
+
+    // Now set the ifIndex to some other value and verify that the packet is not dropped.
+    UINT32 OtherIfIndex = If.GetIfIndex() + 1;
+    TEST_EQUAL(0, bpf_map_update_elem(interface_map_fd, &Zero, &OtherIfIndex, BPF_ANY));
+
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    Sleep(TEST_TIMEOUT_ASYNC_MS);
+
+    // Packet should not be dropped.
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_MORE_DATA),
+        LwfRxGetFrame(FnLwf, If.GetQueueId(), &FrameLength, NULL));
+}
+
+VOID
+GenericRxEbpfFragments()
+{
+    auto If = FnMpIf;
+    unique_fnmp_handle GenericMp;
+    const UINT32 Backfill = 3;
+    const UINT32 Trailer = 4;
+    const UINT32 SplitAt = 4;
+    DATA_BUFFER Buffers[2] = {};
+    const UCHAR Payload[] = "123GenericRxEbpfFragments4321";
+
+    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\l1fwd.sys", "l1fwd");
+
+    GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    Buffers[0].DataLength = SplitAt;
+    Buffers[0].DataOffset = Backfill;
+    Buffers[0].BufferLength = Backfill + SplitAt;
+    Buffers[0].VirtualAddress = Payload;
+    Buffers[1].DataLength = sizeof(Payload) - Buffers[0].BufferLength - Trailer;
+    Buffers[1].DataOffset = 0;
+    Buffers[1].BufferLength = Buffers[1].DataLength + Trailer;
+    Buffers[1].VirtualAddress = Payload + Buffers[0].BufferLength;
+
+    //
+    // XDP-for-Windows has limited eBPF support for fragments: the first buffer
+    // is visible to eBPF programs, and the remaining fragments (if any) are
+    // inaccessible.
+    //
+    // Actions apply to the entire frame, not just to the first fragement.
+    //
+    std::vector<UCHAR> Mask((SIZE_T)Buffers[0].DataLength + Buffers[1].DataLength, 0xFF);
+    auto MpFilter = MpTxFilter(GenericMp, Payload + Backfill, &Mask[0], (ULONG)Mask.size());
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Buffers, RTL_NUMBER_OF(Buffers));
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    MpTxAllocateAndGetFrame(GenericMp, If.GetQueueId());
+    MpTxDequeueFrame(GenericMp, If.GetQueueId());
+    MpTxFlush(GenericMp);
+}
+
+VOID
+GenericRxEbpfUnload()
+{
+    auto If = FnMpIf;
+
+    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\pass.sys", "pass");
+
+    TEST_HRESULT(TryStopService(XDP_SERVICE_NAME));
+    TEST_HRESULT(TryStartService(XDP_SERVICE_NAME));
+}
+
+VOID
+GenericTxToRxInject()
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    XDP_HOOK_ID TxInjectToRxL2 = {};
+
+    TxInjectToRxL2.Layer = XDP_HOOK_L2;
+    TxInjectToRxL2.Direction = XDP_HOOK_RX;
+    TxInjectToRxL2.SubLayer = XDP_HOOK_INJECT;
+
+    auto UdpSocket = CreateUdpSocket(AF_INET, &If, &LocalPort);
+    auto Xsk =
+        CreateAndBindSocket(
+            If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_UNSPEC, XSK_BIND_FLAG_NONE, nullptr,
+            &TxInjectToRxL2);
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    UINT16 FrameOffset = 16;
+    UCHAR UdpPayload[] = "GenericTxToRxInject";
+    CHAR RecvPayload[sizeof(UdpPayload)];
+    UINT64 TxBuffer = SocketFreePop(&Xsk);
+    UCHAR *UdpFrame = Xsk.Umem.Buffer.get() + TxBuffer + FrameOffset;
+    UINT32 UdpFrameLength = Xsk.Umem.Reg.ChunkSize - FrameOffset;
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    UINT32 ProducerIndex;
+    TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+
+    XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+    TxDesc->Address.BaseAddress = TxBuffer;
+    TxDesc->Address.Offset = FrameOffset;
+    TxDesc->Length = UdpFrameLength;
+    XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+
+    TEST_EQUAL(
+        sizeof(UdpPayload),
+        FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+}
+
+VOID
+GenericTxSingleFrame()
+{
+    auto If = FnMpIf;
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    UINT64 Pattern = 0xA5CC7729CE99C16Aui64;
+    UINT64 Mask = ~0ui64;
+
+    auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
+
+    UINT16 FrameOffset = 13;
+    UCHAR Payload[] = "GenericTxSingleFrame";
+    UINT64 TxBuffer = SocketFreePop(&Xsk);
+    UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer + FrameOffset;
+    UINT32 TxFrameLength = sizeof(Pattern) + sizeof(Payload);
+    ASSERT(FrameOffset + TxFrameLength <= Xsk.Umem.Reg.ChunkSize);
+
+    RtlCopyMemory(TxFrame, &Pattern, sizeof(Pattern));
+    RtlCopyMemory(TxFrame + sizeof(Pattern), Payload, sizeof(Payload));
+
+    UINT32 ProducerIndex;
+    TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+
+    XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+    TxDesc->Address.BaseAddress = TxBuffer;
+    TxDesc->Address.Offset = FrameOffset;
+    TxDesc->Length = TxFrameLength;
+    XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+
+    auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
+    TEST_EQUAL(1, MpTxFrame->BufferCount);
+
+    const DATA_BUFFER *MpTxBuffer = &MpTxFrame->Buffers[0];
+    TEST_EQUAL(TxFrameLength, MpTxBuffer->BufferLength);
+#pragma warning(push)
+#pragma warning(disable:6385)  // Reading invalid data from 'TxFrame':  the readable size is '_Old_10`8' bytes, but '29' bytes may be read.
+    TEST_TRUE(
+        RtlEqualMemory(
+            TxFrame, MpTxBuffer->VirtualAddress + MpTxBuffer->DataOffset,
+            TxFrameLength));
+#pragma warning(pop)
+
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxFlush(GenericMp);
+
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 1);
+    TEST_EQUAL(TxBuffer, SocketGetTxCompDesc(&Xsk, ConsumerIndex));
+}
+
+static
+wil::unique_handle
+XskNpiTestOpen()
+{
+    wil::unique_handle Handle(
+        CreateFileW(
+            XSKNPITEST_USER_DEVICE_NAME, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, NULL));
+    TEST_TRUE(Handle.is_valid());
+    return Handle;
+}
+
+static
+UINT32
+XskNpiTestIoctl(
+    _In_ const wil::unique_handle &Handle,
+    _In_ UINT32 IoControlCode,
+    _In_reads_bytes_opt_(InputBufferLength) VOID *InputBuffer,
+    _In_ UINT32 InputBufferLength,
+    _Out_writes_bytes_opt_(OutputBufferLength) VOID *OutputBuffer = NULL,
+    _In_ UINT32 OutputBufferLength = 0
+    )
+{
+    DWORD BytesReturned = 0;
+
+    TEST_TRUE(
+        DeviceIoControl(
+            Handle.get(), IoControlCode, InputBuffer, InputBufferLength, OutputBuffer,
+            OutputBufferLength, &BytesReturned, NULL));
+
+    return BytesReturned;
+}
+
+VOID
+GenericXskKernelNpi()
+{
+    auto If = FnMpIf;
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto XskNpiTest = XskNpiTestOpen();
+
+    //
+    // The test driver attaches to the XSK NPI, creates a kernel mode socket,
+    // and redirects the queue's RX frames to it.
+    //
+    XSKNPITEST_BIND_IN BindIn = {0};
+    BindIn.IfIndex = If.GetIfIndex();
+    BindIn.QueueId = If.GetQueueId();
+    BindIn.Flags = XSK_BIND_FLAG_GENERIC;
+    XskNpiTestIoctl(XskNpiTest, IOCTL_XSKNPITEST_BIND, &BindIn, sizeof(BindIn));
+
+    DATA_BUFFER Buffer = {0};
+    const UCHAR RxPayload[] = "GenericXskKernelNpiRx";
+    Buffer.DataOffset = 0;
+    Buffer.DataLength = sizeof(RxPayload);
+    Buffer.BufferLength = Buffer.DataLength;
+    Buffer.VirtualAddress = RxPayload;
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), &Buffer);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    TEST_HRESULT(TryMpRxFlush(GenericMp));
+
+    //
+    // The receive ioctl's input and output share a buffer, so the output buffer
+    // must hold the wait input as well.
+    //
+    UCHAR RxFrame[sizeof(RxPayload)];
+    C_ASSERT(sizeof(RxFrame) >= sizeof(XSKNPITEST_WAIT_IN));
+    XSKNPITEST_WAIT_IN WaitIn = {0};
+    WaitIn.TimeoutMilliseconds = TEST_TIMEOUT_ASYNC_MS;
+    RtlCopyMemory(RxFrame, &WaitIn, sizeof(WaitIn));
+
+    TEST_EQUAL(
+        sizeof(RxPayload),
+        XskNpiTestIoctl(
+            XskNpiTest, IOCTL_XSKNPITEST_RECEIVE, RxFrame, sizeof(WaitIn), RxFrame,
+            sizeof(RxFrame)));
+    TEST_TRUE(RtlEqualMemory(RxPayload, RxFrame, sizeof(RxPayload)));
+
+    UINT64 Pattern = 0xA5CC7729CE99C16Aui64;
+    UINT64 Mask = ~0ui64;
+    auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
+
+    const UCHAR TxPayload[] = "GenericXskKernelNpiTx";
+    UCHAR TxFrame[sizeof(Pattern) + sizeof(TxPayload)];
+    RtlCopyMemory(TxFrame, &Pattern, sizeof(Pattern));
+    RtlCopyMemory(TxFrame + sizeof(Pattern), TxPayload, sizeof(TxPayload));
+
+    XskNpiTestIoctl(XskNpiTest, IOCTL_XSKNPITEST_SEND, TxFrame, sizeof(TxFrame));
+
+    auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
+    TEST_EQUAL(1, MpTxFrame->BufferCount);
+
+    const DATA_BUFFER *MpTxBuffer = &MpTxFrame->Buffers[0];
+    TEST_EQUAL(sizeof(TxFrame), MpTxBuffer->BufferLength);
+    TEST_TRUE(
+        RtlEqualMemory(
+            TxFrame, MpTxBuffer->VirtualAddress + MpTxBuffer->DataOffset, sizeof(TxFrame)));
+
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxFlush(GenericMp);
+
+    XskNpiTestIoctl(XskNpiTest, IOCTL_XSKNPITEST_COMPLETE_SEND, &WaitIn, sizeof(WaitIn));
+}
+
+VOID
+GenericTxCompletionBatch()
+{
+    auto If = FnMpIf;
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    const UINT32 FrameCount = 4;
+    UINT32 CompletionBatch = 8;
+    UINT32 OptionLength = sizeof(CompletionBatch);
+
+    SetSockopt(
+        Xsk.Handle.get(), XSK_SOCKOPT_TX_COMPLETION_BATCH, &CompletionBatch,
+        sizeof(CompletionBatch));
+
+    CompletionBatch = 0;
+    GetSockopt(
+        Xsk.Handle.get(), XSK_SOCKOPT_TX_COMPLETION_BATCH, &CompletionBatch, &OptionLength);
+    TEST_EQUAL(sizeof(CompletionBatch), OptionLength);
+    TEST_EQUAL(8, CompletionBatch);
+
+    UINT64 Pattern = 0xA5CC7729CE99C16Aui64;
+    UINT64 Mask = ~0ui64;
+    auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
+
+    UINT64 TxBuffers[FrameCount];
+    UINT32 ProducerIndex;
+    TEST_EQUAL(FrameCount, XskRingProducerReserve(&Xsk.Rings.Tx, FrameCount, &ProducerIndex));
+
+    for (UINT32 Index = 0; Index < FrameCount; Index++) {
+        TxBuffers[Index] = SocketFreePop(&Xsk);
+        RtlCopyMemory(Xsk.Umem.Buffer.get() + TxBuffers[Index], &Pattern, sizeof(Pattern));
+
+        XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+        TxDesc->Address.AddressAndOffset = TxBuffers[Index];
+        TxDesc->Length = sizeof(Pattern);
+    }
+    XskRingProducerSubmit(&Xsk.Rings.Tx, FrameCount);
+
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+
+    //
+    // Complete the frames one at a time. Fewer frames than the batch size are
+    // outstanding, so the completions are published no later than when the
+    // last frame completes.
+    //
+    for (UINT32 Index = 0; Index < FrameCount; Index++) {
+        MpTxAllocateAndGetFrame(GenericMp, 0);
+        MpTxDequeueFrame(GenericMp, 0);
+        MpTxFlush(GenericMp);
+    }
+
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, FrameCount);
+    for (UINT32 Index = 0; Index < FrameCount; Index++) {
+        TEST_EQUAL(TxBuffers[Index], SocketGetTxCompDesc(&Xsk, ConsumerIndex++));
+    }
+}
+
+VOID
+GenericTxInlineBudget()
+{
+    auto If = FnMpIf;
+    auto Xsk = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, TRUE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    const UINT32 RoundCount = 4;
+    const UINT32 FrameCount = DEFAULT_RING_SIZE / 2;
+    UCHAR RxPayload[] = "GenericTxInlineBudget";
+
+    UINT64 Pattern = 0xA5CC7729CE99C16Aui64;
+    UINT64 Mask = ~0ui64;
+    auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
+
+    //
+    // Each round queues a TX burst and indicates an RX burst on the queue's
+    // processor, whose RX path polls the TX queue inline with an adaptive
+    // budget. The inline polls must neither delay RX nor strand any TX frames
+    // left to the scheduled polls, whichever way the budget adapts.
+    //
+    for (UINT32 Round = 0; Round < RoundCount; Round++) {
+        UINT64 TxBuffers[FrameCount];
+        UINT32 ProducerIndex;
+
+        TEST_EQUAL(FrameCount, XskRingProducerReserve(&Xsk.Rings.Tx, FrameCount, &ProducerIndex));
+        for (UINT32 Index = 0; Index < FrameCount; Index++) {
+            UCHAR *TxFrame;
+
+            TxBuffers[Index] = SocketFreePop(&Xsk);
+            TxFrame = Xsk.Umem.Buffer.get() + TxBuffers[Index];
+            RtlCopyMemory(TxFrame, &Pattern, sizeof(Pattern));
+            TxFrame[sizeof(Pattern)] = (UCHAR)Index;
+
+            XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+            TxDesc->Address.AddressAndOffset = TxBuffers[Index];
+            TxDesc->Length = sizeof(Pattern) + 1;
+        }
+        XskRingProducerSubmit(&Xsk.Rings.Tx, FrameCount);
+
+        XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+        NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+        TEST_EQUAL(0, NotifyResult);
+
+        SocketProduceRxFill(&Xsk, FrameCount);
+        for (UINT32 Index = 0; Index < FrameCount; Index++) {
+            RX_FRAME Frame;
+            RxInitializeFrame(&Frame, If.GetQueueId(), RxPayload, sizeof(RxPayload));
+            TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+        }
+
+        DATA_FLUSH_OPTIONS FlushOptions = {0};
+        FlushOptions.Flags.RssCpu = TRUE;
+        FlushOptions.RssCpuQueueId = If.GetQueueId();
+        TEST_HRESULT(TryMpRxFlush(GenericMp, &FlushOptions));
+
+        UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, FrameCount);
+        for (UINT32 Index = 0; Index < FrameCount; Index++) {
+            auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex++);
+            TEST_EQUAL(sizeof(RxPayload), RxDesc->Length);
+        }
+        XskRingConsumerRelease(&Xsk.Rings.Rx, FrameCount);
+
+        //
+        // Verify every TX frame was sent, in order, and completed.
+        //
+        for (UINT32 Index = 0; Index < FrameCount; Index++) {
+            auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
+            const DATA_BUFFER *MpTxBuffer = &MpTxFrame->Buffers[0];
+            TEST_EQUAL(
+                (UCHAR)Index,
+                MpTxBuffer->VirtualAddress[MpTxBuffer->DataOffset + sizeof(Pattern)]);
+            MpTxDequeueFrame(GenericMp, 0);
+        }
+        MpTxFlush(GenericMp);
+
+        ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, FrameCount);
+        for (UINT32 Index = 0; Index < FrameCount; Index++) {
+            TEST_EQUAL(TxBuffers[Index], SocketGetTxCompDesc(&Xsk, ConsumerIndex++));
+            Xsk.FreeDescriptors.push(TxBuffers[Index]);
+        }
+        XskRingConsumerRelease(&Xsk.Rings.Completion, FrameCount);
+    }
+}
+
+VOID
+GenericTxZeroCopy()
+{
+    auto If = FnMpIf;
+    MY_SOCKET Xsk;
+    BOOLEAN ZeroCopy = TRUE;
+    UINT32 OptionLength = sizeof(ZeroCopy);
+
+    //
+    // Generic XDP bounces TX frames by default.
+    //
+    {
+        auto BounceXsk =
+            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
+        GetSockopt(BounceXsk.Handle.get(), XSK_SOCKOPT_TX_ZERO_COPY, &ZeroCopy, &OptionLength);
+        TEST_EQUAL(sizeof(ZeroCopy), OptionLength);
+        TEST_FALSE(ZeroCopy);
+    }
+
+    Xsk.Handle = CreateSocket();
+    XskSetupPreBind(&Xsk, FALSE, TRUE);
+
+    ZeroCopy = TRUE;
+    SetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_TX_ZERO_COPY, &ZeroCopy, sizeof(ZeroCopy));
+
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Xsk.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_TX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Xsk.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    XskSetupPostBind(&Xsk, FALSE, TRUE);
+
+    TEST_FALSE(
+        SUCCEEDED(
+            TrySetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_TX_ZERO_COPY, &ZeroCopy, sizeof(ZeroCopy))));
+
+    ZeroCopy = FALSE;
+    OptionLength = sizeof(ZeroCopy);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_TX_ZERO_COPY, &ZeroCopy, &OptionLength);
+    TEST_EQUAL(sizeof(ZeroCopy), OptionLength);
+    TEST_TRUE(ZeroCopy);
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    UINT64 Pattern = 0xA5CC7729CE99C16Aui64;
+    UINT64 Mask = ~0ui64;
+
+    auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
+
+    //
+    // Verify the frame is transmitted from the UMEM.
+    //
+    UCHAR Payload[] = "GenericTxZeroCopy";
+    UINT64 TxBuffer = SocketFreePop(&Xsk);
+    UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
+    UINT32 TxFrameLength = sizeof(Pattern) + sizeof(Payload);
+
+    RtlCopyMemory(TxFrame, &Pattern, sizeof(Pattern));
+    RtlCopyMemory(TxFrame + sizeof(Pattern), Payload, sizeof(Payload));
+
+    UINT32 ProducerIndex;
+    TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+
+    XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+    TxDesc->Address.BaseAddress = TxBuffer;
+    TxDesc->Address.Offset = 0;
+    TxDesc->Length = TxFrameLength;
+    XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+
+    auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
+    TEST_EQUAL(1, MpTxFrame->BufferCount);
+
+    const DATA_BUFFER *MpTxBuffer = &MpTxFrame->Buffers[0];
+    TEST_EQUAL(TxFrameLength, MpTxBuffer->BufferLength);
+    TEST_TRUE(
+        RtlEqualMemory(
+            TxFrame, MpTxBuffer->VirtualAddress + MpTxBuffer->DataOffset, TxFrameLength));
+
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxFlush(GenericMp);
+
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 1);
+    TEST_EQUAL(TxBuffer, SocketGetTxCompDesc(&Xsk, ConsumerIndex));
+    XskRingConsumerRelease(&Xsk.Rings.Completion, 1);
+
+    //
+    // Verify buffers spanning UMEM chunks are rejected.
+    //
+    TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+    TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+    TxDesc->Address.BaseAddress = 0;
+    TxDesc->Address.Offset = (UINT16)(Xsk.Umem.Reg.ChunkSize - sizeof(Pattern));
+    TxDesc->Length = TxFrameLength;
+    XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+
+    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+    XSK_STATISTICS Stats;
+    do {
+        OptionLength = sizeof(Stats);
+        GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS, &Stats, &OptionLength);
+        if (Stats.TxInvalidDescriptors > 0) {
+            break;
+        }
+    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+
+    TEST_EQUAL(1, Stats.TxInvalidDescriptors);
+}
+
+VOID
+GenericTxRebindSocket()
+{
+    auto If = FnMpIf;
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    UINT64 Pattern = 0xA5CC7729CE99C16Aui64;
+    UINT64 Mask = ~0ui64;
+
+    auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
+
+    //
+    // Send identically sized frames from the same UMEM offset through a
+    // sequence of sockets bound to the same generic TX queue. Each socket has
+    // its own UMEM, so any partial MDL built for a previous socket must not
+    // be reused for the next one, even if the UMEM MDL address is recycled.
+    //
+    for (CHAR Iteration = 0; Iteration < 4; Iteration++) {
+        MY_SOCKET Xsk;
+        BOOLEAN ZeroCopy = TRUE;
+
+        Xsk.Handle = CreateSocket();
+        XskSetupPreBind(&Xsk, FALSE, TRUE);
+        SetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_TX_ZERO_COPY, &ZeroCopy, sizeof(ZeroCopy));
+        TEST_HRESULT(
+            XdpApi->XskBind(
+                Xsk.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+                XSK_BIND_FLAG_TX | XSK_BIND_FLAG_GENERIC));
+        TEST_HRESULT(XdpApi->XskActivate(Xsk.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+        XskSetupPostBind(&Xsk, FALSE, TRUE);
+
+        UCHAR Payload[] = "GenericTxRebindSocket_";
+        Payload[sizeof(Payload) - 2] = 'A' + Iteration;
+
+        UINT64 TxBuffer = SocketFreePop(&Xsk);
+        UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
+        UINT32 TxFrameLength = sizeof(Pattern) + sizeof(Payload);
+
+        RtlCopyMemory(TxFrame, &Pattern, sizeof(Pattern));
+        RtlCopyMemory(TxFrame + sizeof(Pattern), Payload, sizeof(Payload));
+
+        UINT32 ProducerIndex;
+        TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+
+        XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+        TxDesc->Address.BaseAddress = TxBuffer;
+        TxDesc->Address.Offset = 0;
+        TxDesc->Length = TxFrameLength;
+        XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+
+        XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+        NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+        TEST_EQUAL(0, NotifyResult);
+
+        auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
+        TEST_EQUAL(1, MpTxFrame->BufferCount);
+
+        const DATA_BUFFER *MpTxBuffer = &MpTxFrame->Buffers[0];
+        TEST_EQUAL(TxFrameLength, MpTxBuffer->BufferLength);
+        TEST_TRUE(
+            RtlEqualMemory(
+                TxFrame, MpTxBuffer->VirtualAddress + MpTxBuffer->DataOffset, TxFrameLength));
+
+        MpTxDequeueFrame(GenericMp, 0);
+        MpTxFlush(GenericMp);
+
+        UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 1);
+        TEST_EQUAL(TxBuffer, SocketGetTxCompDesc(&Xsk, ConsumerIndex));
+    }
+}
+
+VOID
+GenericTxSharedUmem()
+{
+    auto If = FnMpIf;
+    auto RxXsk = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+    MY_SOCKET TxXsk;
+    HANDLE SharedHandle;
+
+    TxXsk.Handle = CreateSocket();
+
+    //
+    // The shared socket must have a UMEM.
+    //
+    {
+        auto EmptySocket = CreateSocket();
+        SharedHandle = EmptySocket.get();
+        TEST_EQUAL(
+            HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+            TrySetSockopt(
+                TxXsk.Handle.get(), XSK_SOCKOPT_SHARED_UMEM, &SharedHandle,
+                sizeof(SharedHandle)));
+    }
+
+    SharedHandle = RxXsk.Handle.get();
+    SetSockopt(TxXsk.Handle.get(), XSK_SOCKOPT_SHARED_UMEM, &SharedHandle, sizeof(SharedHandle));
+
+    //
+    // A socket has at most one UMEM.
+    //
+    XSK_UMEM_REG UmemReg = RxXsk.Umem.Reg;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(TxXsk.Handle.get(), XSK_SOCKOPT_UMEM_REG, &UmemReg, sizeof(UmemReg)));
+
+    SetFillRing(TxXsk.Handle.get());
+    SetCompletionRing(TxXsk.Handle.get());
+    SetTxRing(TxXsk.Handle.get());
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            TxXsk.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_TX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(TxXsk.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+
+    XSK_RING_INFO_SET InfoSet;
+    GetRingInfo(TxXsk.Handle.get(), &InfoSet);
+    XskRingInitialize(&TxXsk.Rings.Completion, &InfoSet.Completion);
+    XskRingInitialize(&TxXsk.Rings.Tx, &InfoSet.Tx);
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    UINT64 Pattern = 0xA5CC7729CE99C16Aui64;
+    UINT64 Mask = ~0ui64;
+    UCHAR Payload[sizeof(Pattern) + sizeof("GenericTxSharedUmem")];
+    RtlCopyMemory(Payload, &Pattern, sizeof(Pattern));
+    RtlCopyMemory(Payload + sizeof(Pattern), "GenericTxSharedUmem", sizeof("GenericTxSharedUmem"));
+
+    auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
+
+    DATA_BUFFER Buffer = {0};
+    Buffer.DataOffset = 0;
+    Buffer.DataLength = sizeof(Payload);
+    Buffer.BufferLength = Buffer.DataLength;
+    Buffer.VirtualAddress = Payload;
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), &Buffer);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    SocketProduceRxFill(&RxXsk, 1);
+    TEST_HRESULT(TryMpRxFlush(GenericMp));
+
+    //
+    // Forward the received descriptor to the other socket without copying.
+    //
+    UINT32 ConsumerIndex = SocketConsumerReserve(&RxXsk.Rings.Rx, 1);
+    XSK_BUFFER_DESCRIPTOR RxDesc = *SocketGetRxDesc(&RxXsk, ConsumerIndex);
+    XskRingConsumerRelease(&RxXsk.Rings.Rx, 1);
+
+    UINT32 ProducerIndex;
+    TEST_EQUAL(1, XskRingProducerReserve(&TxXsk.Rings.Tx, 1, &ProducerIndex));
+    *SocketGetTxDesc(&TxXsk, ProducerIndex) = RxDesc;
+    XskRingProducerSubmit(&TxXsk.Rings.Tx, 1);
+
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    NotifySocket(TxXsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+
+    auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
+    TEST_EQUAL(1, MpTxFrame->BufferCount);
+
+    const DATA_BUFFER *MpTxBuffer = &MpTxFrame->Buffers[0];
+    TEST_EQUAL(sizeof(Payload), MpTxBuffer->BufferLength);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Payload, MpTxBuffer->VirtualAddress + MpTxBuffer->DataOffset, sizeof(Payload)));
+
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxFlush(GenericMp);
+
+    //
+    // The TX socket completes the buffer received by the RX socket.
+    //
+    ConsumerIndex = SocketConsumerReserve(&TxXsk.Rings.Completion, 1);
+    TEST_EQUAL(RxDesc.Address.BaseAddress, SocketGetTxCompDesc(&TxXsk, ConsumerIndex));
+}
+
+VOID
+GenericXskSharedFillRing()
+{
+    auto If = FnMpIf;
+    MY_SOCKET FillXsk;
+    MY_SOCKET RxXsk;
+    HANDLE SharedHandle;
+    XSK_RING_INFO_SET InfoSet;
+    UINT32 RingSize = DEFAULT_RING_SIZE;
+
+    //
+    // The first socket owns the UMEM and the fill ring, and is never bound.
+    //
+    FillXsk.Handle = CreateSocket();
+    FillXsk.Umem.Buffer = AllocUmemBuffer();
+    InitUmem(&FillXsk.Umem.Reg, FillXsk.Umem.Buffer.get());
+    SetUmem(FillXsk.Handle.get(), &FillXsk.Umem.Reg);
+
+    RxXsk.Handle = CreateSocket();
+    SharedHandle = FillXsk.Handle.get();
+    SetSockopt(RxXsk.Handle.get(), XSK_SOCKOPT_SHARED_UMEM, &SharedHandle, sizeof(SharedHandle));
+
+    //
+    // The shared socket must have a fill ring.
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(
+            RxXsk.Handle.get(), XSK_SOCKOPT_SHARED_FILL_RING, &SharedHandle,
+            sizeof(SharedHandle)));
+
+    SetFillRing(FillXsk.Handle.get());
+    SetSockopt(
+        RxXsk.Handle.get(), XSK_SOCKOPT_SHARED_FILL_RING, &SharedHandle, sizeof(SharedHandle));
+
+    //
+    // A socket has at most one fill ring.
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(
+            RxXsk.Handle.get(), XSK_SOCKOPT_RX_FILL_RING_SIZE, &RingSize, sizeof(RingSize)));
+
+    SetRxRing(RxXsk.Handle.get());
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            RxXsk.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(RxXsk.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+
+    GetRingInfo(RxXsk.Handle.get(), &InfoSet);
+    TEST_EQUAL(DEFAULT_RING_SIZE, InfoSet.Fill.Size);
+    XskRingInitialize(&RxXsk.Rings.Rx, &InfoSet.Rx);
+
+    GetRingInfo(FillXsk.Handle.get(), &InfoSet);
+    XskRingInitialize(&FillXsk.Rings.Fill, &InfoSet.Fill);
+
+    UINT64 BufferCount = FillXsk.Umem.Reg.TotalSize / FillXsk.Umem.Reg.ChunkSize;
+    for (UINT64 Offset = 0; BufferCount-- > 0; Offset += FillXsk.Umem.Reg.ChunkSize) {
+        FillXsk.FreeDescriptors.push(Offset);
+    }
+
+    auto RxProgram =
+        SocketAttachRxProgram(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, RxXsk.Handle.get());
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    UCHAR Payload[] = "GenericXskSharedFillRing";
+
+    //
+    // Buffers produced to the first socket's fill ring are received by the
+    // second socket.
+    //
+    for (UINT32 Index = 0; Index < 2; Index++) {
+        SocketProduceRxFill(&FillXsk, 1);
+
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        UINT32 ConsumerIndex = SocketConsumerReserve(&RxXsk.Rings.Rx, 1);
+        auto RxDesc = SocketGetRxDesc(&RxXsk, ConsumerIndex);
+        TEST_EQUAL(sizeof(Payload), RxDesc->Length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                FillXsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+                Payload, sizeof(Payload)));
+        FillXsk.FreeDescriptors.push(RxDesc->Address.BaseAddress);
+        XskRingConsumerRelease(&RxXsk.Rings.Rx, 1);
+    }
+
+    //
+    // Every consumed fill descriptor was released back to the shared ring.
+    //
+    UINT32 ProducerIndex;
+    TEST_EQUAL(
+        DEFAULT_RING_SIZE,
+        XskRingProducerReserve(&FillXsk.Rings.Fill, DEFAULT_RING_SIZE, &ProducerIndex));
+}
+
+VOID
+GenericXskRxFillPool()
+{
+    auto If = FnMpIf;
+    MY_SOCKET Xsk;
+    XSK_RX_FILL_POOL FillPool = {0};
+    XSK_RING_INFO_SET InfoSet;
+    XSK_STATISTICS Stats;
+    UINT32 OptionLength;
+    UINT32 ProducerIndex;
+    UINT32 ConsumerIndex;
+    UINT64 Addresses[2];
+
+    Xsk.Handle = CreateSocket();
+    Xsk.Umem.Buffer = AllocUmemBuffer();
+    InitUmem(&Xsk.Umem.Reg, Xsk.Umem.Buffer.get());
+    SetUmem(Xsk.Handle.get(), &Xsk.Umem.Reg);
+
+    //
+    // The pool requires a fill ring to return buffers.
+    //
+    FillPool.Capacity = 8;
+    FillPool.InitialChunkCount = 2;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_RX_FILL_POOL, &FillPool, sizeof(FillPool)));
+
+    SetFillRing(Xsk.Handle.get());
+
+    //
+    // The capacity must be a power of two that holds the seeded chunks.
+    //
+    FillPool.Capacity = 3;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TrySetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_RX_FILL_POOL, &FillPool, sizeof(FillPool)));
+
+    FillPool.Capacity = 1;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TrySetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_RX_FILL_POOL, &FillPool, sizeof(FillPool)));
+
+    FillPool.Capacity = 8;
+    SetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_RX_FILL_POOL, &FillPool, sizeof(FillPool));
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_RX_FILL_POOL, &FillPool, sizeof(FillPool)));
+
+    SetRxRing(Xsk.Handle.get());
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Xsk.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Xsk.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+
+    GetRingInfo(Xsk.Handle.get(), &InfoSet);
+    XskRingInitialize(&Xsk.Rings.Fill, &InfoSet.Fill);
+    XskRingInitialize(&Xsk.Rings.Rx, &InfoSet.Rx);
+
+    auto RxProgram =
+        SocketAttachRxProgram(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Xsk.Handle.get());
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    UCHAR Payload[] = "GenericXskRxFillPool";
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+
+    //
+    // Frames are received into the seeded chunks without producing to the
+    // fill ring.
+    //
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Addresses); Index++) {
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+        auto RxDesc = SocketGetRxDesc(&Xsk, ConsumerIndex);
+        TEST_EQUAL((UINT64)Index * Xsk.Umem.Reg.ChunkSize, RxDesc->Address.BaseAddress);
+        TEST_EQUAL(sizeof(Payload), RxDesc->Length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+                Payload, sizeof(Payload)));
+        Addresses[Index] = RxDesc->Address.BaseAddress;
+        XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
+    }
+
+    //
+    // Frames are dropped once the pool is empty.
+    //
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+    do {
+        OptionLength = sizeof(Stats);
+        GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS, &Stats, &OptionLength);
+        if (Stats.RxDropped > 0) {
+            break;
+        }
+    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+
+    TEST_EQUAL(1, Stats.RxDropped);
+
+    //
+    // Buffers returned in bulk are drained from the fill ring into the pool by
+    // the next receive, and reused.
+    //
+    TEST_EQUAL(
+        RTL_NUMBER_OF(Addresses),
+        XskRingProducerReserve(&Xsk.Rings.Fill, RTL_NUMBER_OF(Addresses), &ProducerIndex));
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Addresses); Index++) {
+        *SocketGetRxFillDesc(&Xsk, ProducerIndex++) = Addresses[Index];
+    }
+    XskRingProducerSubmit(&Xsk.Rings.Fill, RTL_NUMBER_OF(Addresses));
+
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+    TEST_EQUAL(Addresses[0], SocketGetRxDesc(&Xsk, ConsumerIndex)->Address.BaseAddress);
+    XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
+
+    TEST_EQUAL(
+        DEFAULT_RING_SIZE,
+        XskRingProducerReserve(&Xsk.Rings.Fill, DEFAULT_RING_SIZE, &ProducerIndex));
+}
+
+VOID
+GenericXskRxPriorityRing()
+{
+    auto If = FnMpIf;
+    MY_SOCKET Xsk;
+    XSK_RING_INFO_SET InfoSet;
+    XSK_RING_INFO PriorityInfo;
+    XSK_RING PriorityRing;
+    UINT32 OptionLength;
+    UINT32 RingSize = DEFAULT_RING_SIZE;
+    UINT32 ConsumerIndex;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    const UCHAR Payload[] = "GenericXskRxPriorityRing";
+    UCHAR BulkFrame[UDP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 BulkFrameLength = sizeof(BulkFrame);
+    UCHAR PriorityFrame[UDP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 PriorityFrameLength = sizeof(PriorityFrame);
+    XDP_RULE Rules[2] = {};
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            BulkFrame, &BulkFrameLength, Payload, sizeof(Payload), &LocalHw, &RemoteHw, AF_INET,
+            &LocalIp, &RemoteIp, htons(1234), htons(4321)));
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            PriorityFrame, &PriorityFrameLength, Payload, sizeof(Payload), &LocalHw, &RemoteHw,
+            AF_INET, &LocalIp, &RemoteIp, htons(1235), htons(4321)));
+
+    Xsk.Handle = CreateSocket();
+    Xsk.Umem.Buffer = AllocUmemBuffer();
+    InitUmem(&Xsk.Umem.Reg, Xsk.Umem.Buffer.get());
+    SetUmem(Xsk.Handle.get(), &Xsk.Umem.Reg);
+    SetFillRing(Xsk.Handle.get());
+    SetRxRing(Xsk.Handle.get());
+
+    //
+    // The priority ring is not available until its size is set.
+    //
+    OptionLength = sizeof(PriorityInfo);
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TryGetSockopt(
+            Xsk.Handle.get(), XSK_SOCKOPT_RX_PRIORITY_RING_INFO, &PriorityInfo, &OptionLength));
+
+    SetSockopt(
+        Xsk.Handle.get(), XSK_SOCKOPT_RX_PRIORITY_RING_SIZE, &RingSize, sizeof(RingSize));
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(
+            Xsk.Handle.get(), XSK_SOCKOPT_RX_PRIORITY_RING_SIZE, &RingSize, sizeof(RingSize)));
+
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Xsk.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Xsk.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+
+    GetRingInfo(Xsk.Handle.get(), &InfoSet);
+    XskRingInitialize(&Xsk.Rings.Fill, &InfoSet.Fill);
+    XskRingInitialize(&Xsk.Rings.Rx, &InfoSet.Rx);
+
+    OptionLength = sizeof(PriorityInfo);
+    GetSockopt(
+        Xsk.Handle.get(), XSK_SOCKOPT_RX_PRIORITY_RING_INFO, &PriorityInfo, &OptionLength);
+    TEST_EQUAL(sizeof(PriorityInfo), OptionLength);
+    TEST_EQUAL(DEFAULT_RING_SIZE, PriorityInfo.Size);
+    XskRingInitialize(&PriorityRing, &PriorityInfo);
+
+    UINT64 BufferCount = Xsk.Umem.Reg.TotalSize / Xsk.Umem.Reg.ChunkSize;
+    for (UINT64 Offset = 0; BufferCount-- > 0; Offset += Xsk.Umem.Reg.ChunkSize) {
+        Xsk.FreeDescriptors.push(Offset);
+    }
+    SocketProduceRxFill(&Xsk, 2);
+
+    Rules[0].Match = XDP_MATCH_UDP_DST;
+    Rules[0].Pattern.Port = htons(1235);
+    Rules[0].Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rules[0].Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK_PRIORITY;
+    Rules[0].Redirect.Target = Xsk.Handle.get();
+    Rules[1].Match = XDP_MATCH_ALL;
+    Rules[1].Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rules[1].Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rules[1].Redirect.Target = Xsk.Handle.get();
+
+    auto ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+            RTL_NUMBER_OF(Rules));
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    //
+    // Frames received in the same batch are steered to their rings.
+    //
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), BulkFrame, BulkFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), PriorityFrame, PriorityFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    MpRxFlush(GenericMp);
+
+    ConsumerIndex = SocketConsumerReserve(&PriorityRing, 1);
+    auto RxDesc = (XSK_BUFFER_DESCRIPTOR *)XskRingGetElement(&PriorityRing, ConsumerIndex);
+    TEST_EQUAL(PriorityFrameLength, RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            PriorityFrame, PriorityFrameLength));
+    XskRingConsumerRelease(&PriorityRing, 1);
+
+    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+    RxDesc = SocketGetRxDesc(&Xsk, ConsumerIndex);
+    TEST_EQUAL(BulkFrameLength, RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            BulkFrame, BulkFrameLength));
+    XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
+
+    TEST_EQUAL(0, XskRingConsumerReserve(&PriorityRing, 1, &ConsumerIndex));
+    TEST_EQUAL(0, XskRingConsumerReserve(&Xsk.Rings.Rx, 1, &ConsumerIndex));
+}
+
+VOID
+GenericXskSharedRxRing()
+{
+    auto If = FnMpIf;
+    MY_SOCKET OwnerXsk;
+    MY_SOCKET QueueXsk;
+    HANDLE SharedHandle;
+    XSK_RING_INFO_SET OwnerInfoSet;
+    XSK_RING_INFO_SET QueueInfoSet;
+    const UINT32 QueueIds[] = { If.GetQueueId(), If.GetQueueId() + 1 };
+    UCHAR Payload[] = "GenericXskSharedRxRing";
+
+    //
+    // The first socket owns the UMEM, the fill ring, and the RX ring, and the
+    // second socket shares them from another RX queue.
+    //
+    OwnerXsk.Handle = CreateSocket();
+    OwnerXsk.Umem.Buffer = AllocUmemBuffer();
+    InitUmem(&OwnerXsk.Umem.Reg, OwnerXsk.Umem.Buffer.get());
+    SetUmem(OwnerXsk.Handle.get(), &OwnerXsk.Umem.Reg);
+    SetFillRing(OwnerXsk.Handle.get());
+
+    QueueXsk.Handle = CreateSocket();
+    SharedHandle = OwnerXsk.Handle.get();
+    SetSockopt(
+        QueueXsk.Handle.get(), XSK_SOCKOPT_SHARED_UMEM, &SharedHandle, sizeof(SharedHandle));
+    SetSockopt(
+        QueueXsk.Handle.get(), XSK_SOCKOPT_SHARED_FILL_RING, &SharedHandle,
+        sizeof(SharedHandle));
+
+    //
+    // The shared socket must have an RX ring.
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(
+            QueueXsk.Handle.get(), XSK_SOCKOPT_SHARED_RX_RING, &SharedHandle,
+            sizeof(SharedHandle)));
+
+    SetRxRing(OwnerXsk.Handle.get());
+    SetSockopt(
+        QueueXsk.Handle.get(), XSK_SOCKOPT_SHARED_RX_RING, &SharedHandle, sizeof(SharedHandle));
+
+    //
+    // A socket has at most one RX ring.
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(
+            QueueXsk.Handle.get(), XSK_SOCKOPT_SHARED_RX_RING, &SharedHandle,
+            sizeof(SharedHandle)));
+
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            OwnerXsk.Handle.get(), If.GetIfIndex(), QueueIds[0],
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(OwnerXsk.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            QueueXsk.Handle.get(), If.GetIfIndex(), QueueIds[1],
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(QueueXsk.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+
+    GetRingInfo(OwnerXsk.Handle.get(), &OwnerInfoSet);
+    GetRingInfo(QueueXsk.Handle.get(), &QueueInfoSet);
+    TEST_EQUAL(OwnerInfoSet.Rx.Ring, QueueInfoSet.Rx.Ring);
+    XskRingInitialize(&OwnerXsk.Rings.Fill, &OwnerInfoSet.Fill);
+    XskRingInitialize(&OwnerXsk.Rings.Rx, &OwnerInfoSet.Rx);
+
+    UINT64 BufferCount = OwnerXsk.Umem.Reg.TotalSize / OwnerXsk.Umem.Reg.ChunkSize;
+    for (UINT64 Offset = 0; BufferCount-- > 0; Offset += OwnerXsk.Umem.Reg.ChunkSize) {
+        OwnerXsk.FreeDescriptors.push(Offset);
+    }
+    SocketProduceRxFill(&OwnerXsk, RTL_NUMBER_OF(QueueIds));
+
+    auto OwnerProgram =
+        SocketAttachRxProgram(
+            If.GetIfIndex(), &XdpInspectRxL2, QueueIds[0], XDP_GENERIC, OwnerXsk.Handle.get());
+    auto QueueProgram =
+        SocketAttachRxProgram(
+            If.GetIfIndex(), &XdpInspectRxL2, QueueIds[1], XDP_GENERIC, QueueXsk.Handle.get());
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    //
+    // Frames received on either queue are produced to the owner's RX ring.
+    //
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(QueueIds); Index++) {
+        RX_FRAME Frame;
+        Payload[0] = (UCHAR)Index;
+        RxInitializeFrame(&Frame, QueueIds[Index], Payload, sizeof(Payload));
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        UINT32 ConsumerIndex = SocketConsumerReserve(&OwnerXsk.Rings.Rx, 1);
+        auto RxDesc = SocketGetRxDesc(&OwnerXsk, ConsumerIndex);
+        TEST_EQUAL(sizeof(Payload), RxDesc->Length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                OwnerXsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress +
+                    RxDesc->Address.Offset,
+                Payload, sizeof(Payload)));
+        XskRingConsumerRelease(&OwnerXsk.Rings.Rx, 1);
+    }
+}
+
+VOID
+GenericXskUmemRegions()
+{
+    auto If = FnMpIf;
+    auto Socket = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto RegionBuffer = AllocUmemBuffer();
+    XSK_UMEM_REGION Region = {0};
+    UINT32 RegionId;
+    UCHAR Payload[] = "GenericXskUmemRegions";
+    RX_FRAME Frame;
+    UINT32 ProducerIndex;
+    UINT32 ConsumerIndex;
+    XSK_STATISTICS Stats;
+    UINT32 OptionLength;
+
+    //
+    // Region 0 is the registered UMEM.
+    //
+    Region.TotalSize = DEFAULT_UMEM_SIZE;
+    Region.Address = RegionBuffer.get();
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TrySetSockopt(Socket.Handle.get(), XSK_SOCKOPT_UMEM_ADD_REGION, &Region, sizeof(Region)));
+
+    //
+    // Regions may be added to an active socket's UMEM.
+    //
+    Region.RegionId = 1;
+    SetSockopt(Socket.Handle.get(), XSK_SOCKOPT_UMEM_ADD_REGION, &Region, sizeof(Region));
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(Socket.Handle.get(), XSK_SOCKOPT_UMEM_ADD_REGION, &Region, sizeof(Region)));
+
+    const UINT64 RegionAddress = XSK_UMEM_REGION_ADDRESS(1, DEFAULT_UMEM_CHUNK_SIZE);
+
+    TEST_EQUAL(1, XskRingProducerReserve(&Socket.Rings.Fill, 1, &ProducerIndex));
+    *SocketGetRxFillDesc(&Socket, ProducerIndex) = RegionAddress;
+    XskRingProducerSubmit(&Socket.Rings.Fill, 1);
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    auto RxDesc = SocketGetRxDesc(&Socket, ConsumerIndex);
+    TEST_EQUAL(RegionAddress, RxDesc->Address.BaseAddress);
+    TEST_EQUAL(sizeof(Payload), RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            RegionBuffer.get() + DEFAULT_UMEM_CHUNK_SIZE + RxDesc->Address.Offset, Payload,
+            sizeof(Payload)));
+    XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+
+    //
+    // Fill descriptors referring to a removed region are invalid.
+    //
+    RegionId = 1;
+    SetSockopt(Socket.Handle.get(), XSK_SOCKOPT_UMEM_REMOVE_REGION, &RegionId, sizeof(RegionId));
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+        TrySetSockopt(
+            Socket.Handle.get(), XSK_SOCKOPT_UMEM_REMOVE_REGION, &RegionId, sizeof(RegionId)));
+
+    TEST_EQUAL(1, XskRingProducerReserve(&Socket.Rings.Fill, 1, &ProducerIndex));
+    *SocketGetRxFillDesc(&Socket, ProducerIndex) = RegionAddress;
+    XskRingProducerSubmit(&Socket.Rings.Fill, 1);
+
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+    do {
+        OptionLength = sizeof(Stats);
+        GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_STATISTICS, &Stats, &OptionLength);
+        if (Stats.RxInvalidDescriptors > 0) {
+            break;
+        }
+    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+
+    TEST_EQUAL(1, Stats.RxInvalidDescriptors);
+}
+
+VOID
+GenericTxSegmentation()
+{
+    auto If = FnMpIf;
+    MY_SOCKET Xsk;
+    const UINT32 SegmentSize = 1000;
+    const UINT32 SegmentCount = 3;
+    const UINT16 LocalPort = htons(1234);
+    const UINT16 RemotePort = htons(4321);
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    Xsk.Handle = CreateSocket();
+    XskSetupPreBind(&Xsk, FALSE, TRUE);
+    SetSockopt(
+        Xsk.Handle.get(), XSK_SOCKOPT_TX_SEGMENTATION, &SegmentSize, sizeof(SegmentSize));
+
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Xsk.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_TX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Xsk.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    XskSetupPostBind(&Xsk, FALSE, TRUE);
+
+    //
+    // The segment size cannot be changed once the socket is activated.
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(
+            Xsk.Handle.get(), XSK_SOCKOPT_TX_SEGMENTATION, &SegmentSize, sizeof(SegmentSize)));
+
+    UINT32 EffectiveSegmentSize = 0;
+    UINT32 OptionLength = sizeof(EffectiveSegmentSize);
+    GetSockopt(
+        Xsk.Handle.get(), XSK_SOCKOPT_TX_SEGMENTATION, &EffectiveSegmentSize, &OptionLength);
+    TEST_EQUAL(sizeof(EffectiveSegmentSize), OptionLength);
+    TEST_EQUAL(SegmentSize, EffectiveSegmentSize);
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    UCHAR Mask[sizeof(RemoteHw)];
+    std::memset(Mask, 0xFF, sizeof(Mask));
+    auto MpFilter = MpTxFilter(GenericMp, &RemoteHw, Mask, sizeof(RemoteHw));
+
+    //
+    // Build a UDP super-frame exceeding the MTU, which the generic data path
+    // splits into MTU-sized datagrams.
+    //
+    UCHAR Payload[SegmentSize * (SegmentCount - 1) + SegmentSize / 2];
+    for (UINT32 Index = 0; Index < sizeof(Payload); Index++) {
+        Payload[Index] = (UCHAR)Index;
+    }
+
+    UINT64 TxBuffer = SocketFreePop(&Xsk);
+    UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
+    UINT32 TxFrameLength = Xsk.Umem.Reg.ChunkSize;
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            TxFrame, &TxFrameLength, Payload, sizeof(Payload), &RemoteHw, &LocalHw, AF_INET,
+            &RemoteIp, &LocalIp, RemotePort, LocalPort));
+    TEST_TRUE(TxFrameLength > FNMP_DEFAULT_MTU);
+
+    UINT32 ProducerIndex;
+    TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+
+    XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+    TxDesc->Address.AddressAndOffset = TxBuffer;
+    TxDesc->Length = TxFrameLength;
+    XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+
+    //
+    // The test miniport does not offload UDP segmentation, so each segment is
+    // a separate NET_BUFFER of a single NBL.
+    //
+    for (UINT32 Index = 0; Index < SegmentCount; Index++) {
+        UINT32 PayloadOffset = Index * SegmentSize;
+        UINT32 PayloadLength = min(SegmentSize, (UINT32)sizeof(Payload) - PayloadOffset);
+        auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0, Index);
+        TEST_EQUAL(1, MpTxFrame->BufferCount);
+
+        const DATA_BUFFER *MpTxBuffer = &MpTxFrame->Buffers[0];
+        const UCHAR *Segment = MpTxBuffer->VirtualAddress + MpTxBuffer->DataOffset;
+        TEST_EQUAL(UDP_HEADER_BACKFILL(AF_INET) + PayloadLength, MpTxBuffer->BufferLength);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Segment + UDP_HEADER_BACKFILL(AF_INET), Payload + PayloadOffset, PayloadLength));
+
+        const UDP_HDR *Udp =
+            (const UDP_HDR *)(Segment + sizeof(ETHERNET_HEADER) + sizeof(IPV4_HEADER));
+        TEST_EQUAL(sizeof(*Udp) + PayloadLength, ntohs(Udp->uh_ulen));
+    }
+
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxFlush(GenericMp);
+
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 1);
+    TEST_EQUAL(TxBuffer, SocketGetTxCompDesc(&Xsk, ConsumerIndex));
+
+    XSK_STATISTICS Stats = {0};
+    UINT32 StatsSize = sizeof(Stats);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS, &Stats, &StatsSize);
+    TEST_EQUAL(0, Stats.TxInvalidDescriptors);
+}
+
+VOID
+GenericTxTcpSegmentation()
+{
+    auto If = FnMpIf;
+    MY_SOCKET Xsk;
+    const UINT32 SegmentSize = 1000;
+    const UINT32 SegmentCount = 3;
+    const UINT32 Sequence = 0x12345678;
+    const UINT16 LocalPort = htons(1234);
+    const UINT16 RemotePort = htons(4321);
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    Xsk.Handle = CreateSocket();
+    XskSetupPreBind(&Xsk, FALSE, TRUE);
+    SetSockopt(
+        Xsk.Handle.get(), XSK_SOCKOPT_TX_SEGMENTATION, &SegmentSize, sizeof(SegmentSize));
+
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Xsk.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_TX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Xsk.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    XskSetupPostBind(&Xsk, FALSE, TRUE);
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    UCHAR Mask[sizeof(RemoteHw)];
+    std::memset(Mask, 0xFF, sizeof(Mask));
+    auto MpFilter = MpTxFilter(GenericMp, &RemoteHw, Mask, sizeof(RemoteHw));
+
+    //
+    // Build a TCP super-frame exceeding the MTU, which the generic data path
+    // splits into MSS-sized segments.
+    //
+    UCHAR Payload[SegmentSize * (SegmentCount - 1) + SegmentSize / 2];
+    for (UINT32 Index = 0; Index < sizeof(Payload); Index++) {
+        Payload[Index] = (UCHAR)Index;
+    }
+
+    UINT64 TxBuffer = SocketFreePop(&Xsk);
+    UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
+    UINT32 TxFrameLength = Xsk.Umem.Reg.ChunkSize;
+    TEST_TRUE(
+        PktBuildTcpFrame(
+            TxFrame, &TxFrameLength, Payload, sizeof(Payload), NULL, 0, Sequence, 0,
+            TH_ACK | TH_PSH | TH_FIN | TH_CWR, 65535, &RemoteHw, &LocalHw, AF_INET,
+            &RemoteIp, &LocalIp, RemotePort, LocalPort));
+    TEST_TRUE(TxFrameLength > FNMP_DEFAULT_MTU);
+
+    UINT32 ProducerIndex;
+    TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+
+    XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+    TxDesc->Address.AddressAndOffset = TxBuffer;
+    TxDesc->Length = TxFrameLength;
+    XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+
+    //
+    // The test miniport does not offload TCP segmentation, so each segment is
+    // a separate NET_BUFFER of a single NBL.
+    //
+    for (UINT32 Index = 0; Index < SegmentCount; Index++) {
+        UINT32 PayloadOffset = Index * SegmentSize;
+        UINT32 PayloadLength = min(SegmentSize, (UINT32)sizeof(Payload) - PayloadOffset);
+        auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0, Index);
+        TEST_EQUAL(1, MpTxFrame->BufferCount);
+
+        const DATA_BUFFER *MpTxBuffer = &MpTxFrame->Buffers[0];
+        const UCHAR *Segment = MpTxBuffer->VirtualAddress + MpTxBuffer->DataOffset;
+        TEST_EQUAL(TCP_HEADER_BACKFILL(AF_INET) + PayloadLength, MpTxBuffer->BufferLength);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Segment + TCP_HEADER_BACKFILL(AF_INET), Payload + PayloadOffset, PayloadLength));
+
+        const IPV4_HEADER *Ipv4 = (const IPV4_HEADER *)(Segment + sizeof(ETHERNET_HEADER));
+        TEST_EQUAL(
+            TCP_HEADER_BACKFILL(AF_INET) - sizeof(ETHERNET_HEADER) + PayloadLength,
+            ntohs(Ipv4->TotalLength));
+
+        const TCP_HDR *Tcp = (const TCP_HDR *)(Ipv4 + 1);
+        TEST_EQUAL(Sequence + PayloadOffset, ntohl(Tcp->th_seq));
+        TEST_EQUAL(Index == 0, !!(Tcp->th_flags & TH_CWR));
+        TEST_EQUAL(Index == SegmentCount - 1, !!(Tcp->th_flags & TH_FIN));
+        TEST_EQUAL(Index == SegmentCount - 1, !!(Tcp->th_flags & TH_PSH));
+        TEST_TRUE(Tcp->th_flags & TH_ACK);
+    }
+
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxFlush(GenericMp);
+
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 1);
+    TEST_EQUAL(TxBuffer, SocketGetTxCompDesc(&Xsk, ConsumerIndex));
+}
+
+VOID
+GenericTxChecksumOffload()
+{
+    auto If = FnMpIf;
+    MY_SOCKET Xsk;
+    const UINT16 LocalPort = htons(1234);
+    const UINT16 RemotePort = htons(4321);
+    const BOOLEAN Enable = TRUE;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    Xsk.Handle = CreateSocket();
+    XskSetupPreBind(&Xsk, FALSE, FALSE);
+
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Xsk.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_TX | XSK_BIND_FLAG_GENERIC));
+
+    XSK_OFFLOAD_IPV4_CHECKSUM_TX_CAPABILITIES Ipv4Capabilities = {0};
+    UINT32 OptionLength = sizeof(Ipv4Capabilities);
+    GetSockopt(
+        Xsk.Handle.get(), XSK_SOCKOPT_OFFLOAD_IPV4_CHECKSUM_TX_CAPABILITIES,
+        &Ipv4Capabilities, &OptionLength);
+    TEST_EQUAL(sizeof(Ipv4Capabilities), OptionLength);
+    TEST_TRUE(Ipv4Capabilities.Supported);
+
+    XSK_OFFLOAD_UDP_CHECKSUM_TX_CAPABILITIES UdpCapabilities = {0};
+    OptionLength = sizeof(UdpCapabilities);
+    GetSockopt(
+        Xsk.Handle.get(), XSK_SOCKOPT_OFFLOAD_UDP_CHECKSUM_TX_CAPABILITIES,
+        &UdpCapabilities, &OptionLength);
+    TEST_EQUAL(sizeof(UdpCapabilities), OptionLength);
+    TEST_TRUE(UdpCapabilities.Supported);
+
+    SetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_OFFLOAD_IPV4_CHECKSUM_TX, &Enable, sizeof(Enable));
+    SetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_OFFLOAD_UDP_CHECKSUM_TX, &Enable, sizeof(Enable));
+    SetTxRing(Xsk.Handle.get());
+
+    //
+    // Offloads cannot be changed once the TX ring descriptor size is fixed.
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(
+            Xsk.Handle.get(), XSK_SOCKOPT_OFFLOAD_TCP_CHECKSUM_TX, &Enable, sizeof(Enable)));
+
+    XDP_EXTENSION LayoutExtension;
+    XDP_EXTENSION ChecksumExtension;
+    OptionLength = sizeof(LayoutExtension);
+    GetSockopt(
+        Xsk.Handle.get(), XSK_SOCKOPT_TX_FRAME_LAYOUT_EXTENSION, &LayoutExtension,
+        &OptionLength);
+    OptionLength = sizeof(ChecksumExtension);
+    GetSockopt(
+        Xsk.Handle.get(), XSK_SOCKOPT_TX_FRAME_CHECKSUM_EXTENSION, &ChecksumExtension,
+        &OptionLength);
+
+    TEST_HRESULT(XdpApi->XskActivate(Xsk.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    XskSetupPostBind(&Xsk, FALSE, TRUE);
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    UCHAR Mask[sizeof(RemoteHw)];
+    std::memset(Mask, 0xFF, sizeof(Mask));
+    auto MpFilter = MpTxFilter(GenericMp, &RemoteHw, Mask, sizeof(RemoteHw));
+
+    UCHAR Payload[] = "ChecksumOffload";
+    UINT64 TxBuffer = SocketFreePop(&Xsk);
+    UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
+    UINT32 TxFrameLength = Xsk.Umem.Reg.ChunkSize;
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            TxFrame, &TxFrameLength, Payload, sizeof(Payload), &RemoteHw, &LocalHw, AF_INET,
+            &RemoteIp, &LocalIp, RemotePort, LocalPort));
+
+    //
+    // Clear the checksums built by the test helper; XDP must fill them in.
+    //
+    IPV4_HEADER *Ipv4 = (IPV4_HEADER *)(TxFrame + sizeof(ETHERNET_HEADER));
+    UDP_HDR *Udp = (UDP_HDR *)(Ipv4 + 1);
+    const UINT16 Ipv4Checksum = Ipv4->HeaderChecksum;
+    const UINT16 UdpChecksum = Udp->uh_sum;
+    Ipv4->HeaderChecksum = 0;
+    Udp->uh_sum = 0;
+
+    UINT32 ProducerIndex;
+    TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+
+    XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex);
+    TxDesc->Address.AddressAndOffset = TxBuffer;
+    TxDesc->Length = TxFrameLength;
+
+    XDP_FRAME_LAYOUT *Layout = (XDP_FRAME_LAYOUT *)XdpGetExtensionData(TxDesc, &LayoutExtension);
+    XDP_FRAME_CHECKSUM *Checksum =
+        (XDP_FRAME_CHECKSUM *)XdpGetExtensionData(TxDesc, &ChecksumExtension);
+    RtlZeroMemory(Layout, sizeof(*Layout));
+    Layout->Layer2Type = XdpFrameLayer2TypeEthernet;
+    Layout->Layer2HeaderLength = sizeof(ETHERNET_HEADER);
+    Layout->Layer3Type = XdpFrameLayer3TypeIPv4NoOptions;
+    Layout->Layer3HeaderLength = sizeof(IPV4_HEADER);
+    Layout->Layer4Type = XdpFrameLayer4TypeUdp;
+    Layout->Layer4HeaderLength = sizeof(UDP_HDR);
+    RtlZeroMemory(Checksum, sizeof(*Checksum));
+    Checksum->Layer3 = XdpFrameTxChecksumActionRequired;
+    Checksum->Layer4 = XdpFrameTxChecksumActionRequired;
+    XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+
+    auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
+    TEST_EQUAL(1, MpTxFrame->BufferCount);
+
+    const DATA_BUFFER *MpTxBuffer = &MpTxFrame->Buffers[0];
+    const UCHAR *MpFrame = MpTxBuffer->VirtualAddress + MpTxBuffer->DataOffset;
+    TEST_EQUAL(TxFrameLength, MpTxBuffer->DataLength);
+
+    //
+    // The test miniport does not offload checksums, so the generic data path
+    // computes them in software.
+    //
+    const IPV4_HEADER *MpIpv4 = (const IPV4_HEADER *)(MpFrame + sizeof(ETHERNET_HEADER));
+    const UDP_HDR *MpUdp = (const UDP_HDR *)(MpIpv4 + 1);
+    TEST_EQUAL(Ipv4Checksum, MpIpv4->HeaderChecksum);
+    TEST_EQUAL(UdpChecksum, MpUdp->uh_sum);
+
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxFlush(GenericMp);
+
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 1);
+    TEST_EQUAL(TxBuffer, SocketGetTxCompDesc(&Xsk, ConsumerIndex));
+
+    XSK_STATISTICS Stats = {0};
+    UINT32 StatsSize = sizeof(Stats);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS, &Stats, &StatsSize);
+    TEST_EQUAL(0, Stats.TxInvalidDescriptors);
+}
+
+static
+UINT32
+ToeplitzHash(
+    _In_reads_bytes_(KeySize) const UCHAR *Key,
+    _In_ UINT32 KeySize,
+    _In_reads_bytes_(InputLength) const UCHAR *Input,
+    _In_ UINT32 InputLength
+    )
+{
+    UINT32 Hash = 0;
+
+    //
+    // XOR in the 32 key bits starting at each set input bit.
+    //
+    for (UINT32 Bit = 0; Bit < InputLength * 8; Bit++) {
+        if (Input[Bit / 8] & (0x80 >> (Bit % 8))) {
+            UINT32 Window = 0;
+
+            for (UINT32 KeyBit = Bit; KeyBit < Bit + 32; KeyBit++) {
+                Window <<= 1;
+                if (KeyBit / 8 < KeySize) {
+                    Window |= (Key[KeyBit / 8] >> (7 - (KeyBit % 8))) & 1;
+                }
+            }
+
+            Hash ^= Window;
+        }
+    }
+
+    return Hash;
+}
+
+VOID
+GenericTxSendHash()
+{
+    auto If = FnMpIf;
+    const UINT16 LocalPort = htons(1234);
+    const UINT16 RemotePort = htons(4321);
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig;
+    const UINT16 HashSecretKeySize = 40;
+    const UINT32 RssConfigSize = sizeof(*RssConfig) + HashSecretKeySize;
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    wil::unique_handle InterfaceHandle = InterfaceOpen(If.GetIfIndex());
+
+    //
+    // Wait for TCPIP's RSS configuration, then set a known hash key and the
+    // UDP over IPv4 hash type.
+    //
+    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+    HRESULT CurrentRssResult;
+    do {
+        UINT32 CurrentRssConfigSize = 0;
+        CurrentRssResult = TryRssGet(InterfaceHandle.get(), NULL, &CurrentRssConfigSize);
+        if (CurrentRssResult == HRESULT_FROM_WIN32(ERROR_MORE_DATA)) {
+            break;
+        }
+    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+    TEST_EQUAL(HRESULT_FROM_WIN32(ERROR_MORE_DATA), CurrentRssResult);
+
+    RssConfig.reset((XDP_RSS_CONFIGURATION *)malloc(RssConfigSize));
+    TEST_NOT_NULL(RssConfig.get());
+    XdpInitializeRssConfiguration(RssConfig.get(), RssConfigSize);
+    RssConfig->Flags = XDP_RSS_FLAG_SET_HASH_TYPE | XDP_RSS_FLAG_SET_HASH_SECRET_KEY;
+    RssConfig->HashType = XDP_RSS_HASH_TYPE_IPV4 | XDP_RSS_HASH_TYPE_UDP_IPV4;
+    RssConfig->HashSecretKeySize = HashSecretKeySize;
+    RssConfig->HashSecretKeyOffset = sizeof(*RssConfig);
+
+    UCHAR *HashSecretKey = (UCHAR *)RTL_PTR_ADD(RssConfig.get(), RssConfig->HashSecretKeyOffset);
+    for (UINT32 Index = 0; Index < HashSecretKeySize; Index++) {
+        HashSecretKey[Index] = (UCHAR)(0x6D + 31 * Index);
+    }
+
+    RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
+
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    UCHAR Mask[sizeof(RemoteHw)];
+    std::memset(Mask, 0xFF, sizeof(Mask));
+    auto MpFilter = MpTxFilter(GenericMp, &RemoteHw, Mask, sizeof(RemoteHw));
+
+    //
+    // Send a UDP frame and a frame that is not IP.
+    //
+    UCHAR Payload[] = "GenericTxSendHash";
+    UINT64 TxBuffers[2];
+    UINT32 TxFrameLengths[2];
+
+    TxBuffers[0] = SocketFreePop(&Xsk);
+    TxFrameLengths[0] = Xsk.Umem.Reg.ChunkSize;
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            Xsk.Umem.Buffer.get() + TxBuffers[0], &TxFrameLengths[0], Payload,
+            sizeof(Payload), &RemoteHw, &LocalHw, AF_INET, &RemoteIp, &LocalIp, RemotePort,
+            LocalPort));
+
+    TxBuffers[1] = SocketFreePop(&Xsk);
+    TxFrameLengths[1] = sizeof(ETHERNET_HEADER) + sizeof(Payload);
+    ETHERNET_HEADER *Ethernet = (ETHERNET_HEADER *)(Xsk.Umem.Buffer.get() + TxBuffers[1]);
+    RtlCopyMemory(&Ethernet->Destination, &RemoteHw, sizeof(Ethernet->Destination));
+    RtlCopyMemory(&Ethernet->Source, &LocalHw, sizeof(Ethernet->Source));
+    Ethernet->Type = htons(0x88B5); // IEEE local experimental.
+    RtlCopyMemory(Ethernet + 1, Payload, sizeof(Payload));
+
+    UINT32 ProducerIndex;
+    TEST_EQUAL(2, XskRingProducerReserve(&Xsk.Rings.Tx, 2, &ProducerIndex));
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(TxBuffers); Index++) {
+        XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+        TxDesc->Address.AddressAndOffset = TxBuffers[Index];
+        TxDesc->Length = TxFrameLengths[Index];
+    }
+    XskRingProducerSubmit(&Xsk.Rings.Tx, 2);
+
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+
+    //
+    // The UDP frame carries the Toeplitz hash of its IPv4 addresses and ports,
+    // as the NIC would compute it on receive.
+    //
+    UCHAR HashInput[2 * sizeof(IN_ADDR) + 2 * sizeof(UINT16)];
+    RtlCopyMemory(HashInput, &LocalIp.Ipv4, sizeof(IN_ADDR));
+    RtlCopyMemory(HashInput + sizeof(IN_ADDR), &RemoteIp.Ipv4, sizeof(IN_ADDR));
+    RtlCopyMemory(HashInput + 2 * sizeof(IN_ADDR), &LocalPort, sizeof(LocalPort));
+    RtlCopyMemory(
+        HashInput + 2 * sizeof(IN_ADDR) + sizeof(LocalPort), &RemotePort, sizeof(RemotePort));
+
+    auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
+    TEST_EQUAL(TxFrameLengths[0], MpTxFrame->Buffers[0].DataLength);
+    TEST_EQUAL(
+        ToeplitzHash(HashSecretKey, HashSecretKeySize, HashInput, sizeof(HashInput)),
+        MpTxFrame->Output.RssHash);
+
+    //
+    // The frame that is not IP has no flow hash, so it keeps the hash value
+    // of the first RSS queue's indirection entry.
+    //
+    MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 1);
+    TEST_EQUAL(TxFrameLengths[1], MpTxFrame->Buffers[0].DataLength);
+    TEST_EQUAL(0, MpTxFrame->Output.RssHash);
+
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxFlush(GenericMp);
+
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 2);
+    TEST_EQUAL(TxBuffers[0], SocketGetTxCompDesc(&Xsk, ConsumerIndex++));
+    TEST_EQUAL(TxBuffers[1], SocketGetTxCompDesc(&Xsk, ConsumerIndex++));
+}
+
+VOID
+GenericTxOutOfOrder()
+{
+    auto If = FnMpIf;
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    UINT64 Pattern = 0x2865A18EE4DB02F0ui64;
+    UINT64 Mask = ~0ui64;
+
+    auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
+
+    UINT16 FrameOffset = 13;
+    UCHAR Payload[] = "GenericTxOutOfOrder";
+    UINT64 TxBuffer0 = SocketFreePop(&Xsk);
+    UINT64 TxBuffer1 = SocketFreePop(&Xsk);
+    UCHAR *TxFrame0 = Xsk.Umem.Buffer.get() + TxBuffer0 + FrameOffset;
+    UCHAR *TxFrame1 = Xsk.Umem.Buffer.get() + TxBuffer1 + FrameOffset;
+    UINT32 TxFrameLength = sizeof(Pattern) + sizeof(Payload);
+    ASSERT(FrameOffset + TxFrameLength <= Xsk.Umem.Reg.ChunkSize);
+
+    RtlCopyMemory(TxFrame0, &Pattern, sizeof(Pattern));
+    RtlCopyMemory(TxFrame1, &Pattern, sizeof(Pattern));
+    RtlCopyMemory(TxFrame0 + sizeof(Pattern), Payload, sizeof(Payload));
+    RtlCopyMemory(TxFrame1 + sizeof(Pattern), Payload, sizeof(Payload));
+
+    UINT32 ProducerIndex;
+    TEST_EQUAL(2, XskRingProducerReserve(&Xsk.Rings.Tx, 2, &ProducerIndex));
+
+    XSK_BUFFER_DESCRIPTOR *TxDesc0 = SocketGetTxDesc(&Xsk, ProducerIndex++);
+    TxDesc0->Address.BaseAddress = TxBuffer0;
+    TxDesc0->Address.Offset = FrameOffset;
+    TxDesc0->Length = TxFrameLength;
+    XSK_BUFFER_DESCRIPTOR *TxDesc1 = SocketGetTxDesc(&Xsk, ProducerIndex++);
+    TxDesc1->Address.BaseAddress = TxBuffer1;
+    TxDesc1->Address.Offset = FrameOffset;
+    TxDesc1->Length = TxFrameLength;
+
+    XskRingProducerSubmit(&Xsk.Rings.Tx, 2);
+
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+
+    MpTxDequeueFrame(GenericMp, 1);
+    MpTxFlush(GenericMp);
+
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 1);
+    TEST_EQUAL(TxBuffer1, SocketGetTxCompDesc(&Xsk, ConsumerIndex));
+    XskRingConsumerRelease(&Xsk.Rings.Completion, 1);
+
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxFlush(GenericMp);
+
+    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 1);
+    TEST_EQUAL(TxBuffer0, SocketGetTxCompDesc(&Xsk, ConsumerIndex));
+}
+
+VOID
+GenericTxSharing()
+{
+    auto If = FnMpIf;
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    MY_SOCKET Sockets[4] = {};
+
+    for (UINT32 i = 0; i < RTL_NUMBER_OF(Sockets); i++) {
+        Sockets[i] =
+            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
+    }
+
+    for (UINT32 i = 0; i < RTL_NUMBER_OF(Sockets); i++) {
+        auto &Xsk = Sockets[i];
+        UINT64 Pattern = 0xA5CC7729CE99C16Aui64 + i;
+        UINT64 Mask = ~0ui64;
+
+        auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
+
+        UINT16 FrameOffset = 13;
+        UCHAR Payload[] = "GenericTxSharing";
+        UINT64 TxBuffer = SocketFreePop(&Xsk);
+        UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer + FrameOffset;
+        UINT32 TxFrameLength = sizeof(Pattern) + sizeof(Payload);
+        ASSERT(FrameOffset + TxFrameLength <= Xsk.Umem.Reg.ChunkSize);
+
+        RtlCopyMemory(TxFrame, &Pattern, sizeof(Pattern));
+        RtlCopyMemory(TxFrame + sizeof(Pattern), Payload, sizeof(Payload));
+
+        UINT32 ProducerIndex;
+        TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+
+        XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+        TxDesc->Address.BaseAddress = TxBuffer;
+        TxDesc->Address.Offset = FrameOffset;
+        TxDesc->Length = TxFrameLength;
+        XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+
+        XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+        NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+        TEST_EQUAL(0, NotifyResult);
+
+        auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
+        TEST_EQUAL(1, MpTxFrame->BufferCount);
+
+        const DATA_BUFFER *MpTxBuffer = &MpTxFrame->Buffers[0];
+        TEST_EQUAL(TxFrameLength, MpTxBuffer->BufferLength);
+#pragma warning(push)
+#pragma warning(disable:6385)  // Reading invalid data from 'TxFrame':  the readable size is '_Old_10`8' bytes, but '29' bytes may be read.
+        TEST_TRUE(
+            RtlEqualMemory(
+                TxFrame, MpTxBuffer->VirtualAddress + MpTxBuffer->DataOffset,
+                TxFrameLength));
+#pragma warning(pop)
+
+        MpTxDequeueFrame(GenericMp, 0);
+        MpTxFlush(GenericMp);
+
+        UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 1);
+        TEST_EQUAL(TxBuffer, SocketGetTxCompDesc(&Xsk, ConsumerIndex));
+    }
+}
+
+VOID
+GenericTxPoke()
+{
+    auto If = FnMpIf;
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    UINT64 Pattern = 0x4FA3DF603CC44911ui64;
+    UINT64 Mask = ~0ui64;
+
+    auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
+
+    UINT16 FrameOffset = 13;
+    UCHAR Payload[] = "GenericTxPoke";
+    UINT64 TxBuffer = SocketFreePop(&Xsk);
+    UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer + FrameOffset;
+    UINT32 TxFrameLength = sizeof(Pattern) + sizeof(Payload);
+    ASSERT(FrameOffset + TxFrameLength <= Xsk.Umem.Reg.ChunkSize);
+
+    RtlCopyMemory(TxFrame, &Pattern, sizeof(Pattern));
+    RtlCopyMemory(TxFrame + sizeof(Pattern), Payload, sizeof(Payload));
+
+    UINT32 ProducerIndex;
+    TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+
+    XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+    TxDesc->Address.BaseAddress = TxBuffer;
+    TxDesc->Address.Offset = FrameOffset;
+    TxDesc->Length = TxFrameLength;
+
+    TEST_TRUE(XskRingProducerNeedPoke(&Xsk.Rings.Tx));
+    XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+
+    //
+    // While NBLs are pending in the miniport, XSKs should not require TX pokes.
+    //
+    MpTxAllocateAndGetFrame(GenericMp, 0);
+    TEST_FALSE(XskRingProducerNeedPoke(&Xsk.Rings.Tx));
+
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxFlush(GenericMp);
+
+    //
+    // XSKs require TX pokes when no sends are outstanding.
+    //
+    SocketConsumerReserve(&Xsk.Rings.Completion, 1);
+    SocketProducerCheckNeedPoke(&Xsk.Rings.Tx, TRUE);
+}
+
+VOID
+GenericTxPokeLinger()
+{
+    auto If = FnMpIf;
+    MY_SOCKET Xsk;
+    const UINT32 LingerMs = 500;
+
+    Xsk.Handle = CreateSocket();
+    XskSetupPreBind(&Xsk, FALSE, TRUE);
+    SetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_TX_POKE_LINGER, &LingerMs, sizeof(LingerMs));
+
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Xsk.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_TX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Xsk.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    XskSetupPostBind(&Xsk, FALSE, TRUE);
+
+    //
+    // The linger time cannot be changed once the socket is activated.
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(
+            Xsk.Handle.get(), XSK_SOCKOPT_TX_POKE_LINGER, &LingerMs, sizeof(LingerMs)));
+
+    UINT32 EffectiveLingerMs = 0;
+    UINT32 OptionLength = sizeof(EffectiveLingerMs);
+    GetSockopt(
+        Xsk.Handle.get(), XSK_SOCKOPT_TX_POKE_LINGER, &EffectiveLingerMs, &OptionLength);
+    TEST_EQUAL(sizeof(EffectiveLingerMs), OptionLength);
+    TEST_EQUAL(LingerMs, EffectiveLingerMs);
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    UINT64 Pattern = 0x4FA3DF603CC44911ui64;
+    UINT64 Mask = ~0ui64;
+
+    auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
+
+    UCHAR Payload[] = "GenericTxPokeLinger";
+
+    auto Transmit = [&] {
+        UINT64 TxBuffer = SocketFreePop(&Xsk);
+        UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
+        UINT32 TxFrameLength = sizeof(Pattern) + sizeof(Payload);
+        ASSERT(TxFrameLength <= Xsk.Umem.Reg.ChunkSize);
+
+        RtlCopyMemory(TxFrame, &Pattern, sizeof(Pattern));
+        RtlCopyMemory(TxFrame + sizeof(Pattern), Payload, sizeof(Payload));
+
+        UINT32 ProducerIndex;
+        TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+
+        XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex);
+        TxDesc->Address.AddressAndOffset = TxBuffer;
+        TxDesc->Length = TxFrameLength;
+        XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+
+        return TxBuffer;
+    };
+
+    //
+    // The first frame requires a poke.
+    //
+    TEST_TRUE(XskRingProducerNeedPoke(&Xsk.Rings.Tx));
+    UINT64 TxBuffer = Transmit();
+
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+
+    MpTxAllocateAndGetFrame(GenericMp, 0);
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxFlush(GenericMp);
+
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 1);
+    TEST_EQUAL(TxBuffer, SocketGetTxCompDesc(&Xsk, ConsumerIndex));
+    XskRingConsumerRelease(&Xsk.Rings.Completion, 1);
+
+    //
+    // While the TX path lingers, frames are transmitted without a poke.
+    //
+    TEST_FALSE(XskRingProducerNeedPoke(&Xsk.Rings.Tx));
+    TxBuffer = Transmit();
+
+    MpTxAllocateAndGetFrame(GenericMp, 0);
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxFlush(GenericMp);
 
-VOID
-GenericRxTooManyFragments(
-    _In_ ADDRESS_FAMILY Af,
-    _In_ BOOLEAN IsUdp
-    )
-{
-    GENERIC_RX_FRAGMENT_PARAMS Params = {0};
-    Params.Action = XDP_PROGRAM_ACTION_REDIRECT;
-    Params.IsUdp = IsUdp;
-    Params.PayloadLength = 512;
-    Params.Backfill = 13;
-    Params.Trailer = 17;
-    std::vector<UINT16> SplitIndexes;
-    for (UINT16 Index = 0; Index < Params.PayloadLength - 1; Index++) {
-        SplitIndexes.push_back(Index + 1);
-    }
-    Params.SplitIndexes = &SplitIndexes[0];
-    Params.SplitCount = (UINT16)SplitIndexes.size();
-    GenericRxFragmentBuffer(Af, &Params);
+    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 1);
+    TEST_EQUAL(TxBuffer, SocketGetTxCompDesc(&Xsk, ConsumerIndex));
+
+    //
+    // Once the linger time elapses without TX, pokes are required again.
+    //
+    SocketProducerCheckNeedPoke(&Xsk.Rings.Tx, TRUE);
 }
 
 VOID
-GenericRxHeaderMultipleFragments(
-    _In_ ADDRESS_FAMILY Af,
-    _In_ XDP_RULE_ACTION ProgramAction,
-    _In_ BOOLEAN IsUdp,
-    _In_ BOOLEAN IsTxInspect,
-    _In_ BOOLEAN IsLowResources
-    )
+GenericTxMtu()
 {
-    GENERIC_RX_FRAGMENT_PARAMS Params = {0};
-    Params.Action = ProgramAction;
-    Params.IsUdp = IsUdp;
-    Params.PayloadLength = 43;
-    Params.Backfill = 13;
-    Params.Trailer = 17;
-    UINT16 SplitIndexes[5] = { 0 };
-    SplitIndexes[0] = sizeof(ETHERNET_HEADER) / 2;
-    SplitIndexes[1] = SplitIndexes[0] + sizeof(ETHERNET_HEADER);
-    SplitIndexes[2] = SplitIndexes[1] + 1;
-    SplitIndexes[3] = SplitIndexes[2] + ((Af == AF_INET) ? sizeof(IPV4_HEADER) : sizeof(IPV6_HEADER));
-    SplitIndexes[4] = SplitIndexes[3] + (IsUdp ? sizeof(UDP_HDR) : sizeof(TCP_HDR)) / 2;
+    auto If = FnMpIf;
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto MtuScopeGuard = wil::scope_exit([&]
+    {
+        MpSetMtu(GenericMp, FNMP_DEFAULT_MTU);
+        //
+        // Wait for the MTU changes to quiesce, which may involve a complete NDIS
+        // rebind for filters and protocols.
+        //
+        Sleep(TEST_TIMEOUT_ASYNC_MS);
+        WaitForWfpQuarantine(If);
+    });
 
-    for (UINT16 i = 0; i < RTL_NUMBER_OF(SplitIndexes) - 1; i++) {
-        Params.SplitIndexes = &SplitIndexes[i];
-        Params.SplitCount = RTL_NUMBER_OF(SplitIndexes) - i;
-        Params.IsTxInspect = IsTxInspect;
-        Params.LowResources = IsLowResources;
-        GenericRxFragmentBuffer(Af, &Params);
-    }
-}
+    const UINT32 TestMtu = 2048;
+    C_ASSERT(TestMtu != FNMP_DEFAULT_MTU);
+    C_ASSERT(TestMtu < DEFAULT_UMEM_CHUNK_SIZE);
 
-VOID
-GenericRxHeaderFragments(
-    _In_ ADDRESS_FAMILY Af,
-    _In_ XDP_RULE_ACTION ProgramAction,
-    _In_ BOOLEAN IsUdp,
-    _In_ BOOLEAN IsTxInspect,
-    _In_ BOOLEAN IsLowResources
-    )
-{
-    GENERIC_RX_FRAGMENT_PARAMS Params = {0};
-    Params.Action = ProgramAction;
-    Params.IsUdp = IsUdp;
-    Params.PayloadLength = 43;
-    Params.Backfill = 13;
-    Params.Trailer = 17;
-    UINT16 HeadersLength =
-        sizeof(ETHERNET_HEADER) +
-            ((Af == AF_INET) ? sizeof(IPV4_HEADER) : sizeof(IPV6_HEADER)) +
-            (IsUdp ? sizeof(UDP_HDR) : sizeof(TCP_HDR));
+    MpSetMtu(GenericMp, TestMtu);
 
-    GenericRxHeaderMultipleFragments(Af, ProgramAction, IsUdp, IsTxInspect, IsLowResources);
+    //
+    // The XSK TX path should be torn down after an MTU change.
+    //
+    Stopwatch<std::chrono::milliseconds> Watchdog(MP_RESTART_TIMEOUT);
+    do {
+        if (XskRingError(&Xsk.Rings.Tx)) {
+            break;
+        }
+    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+    TEST_TRUE(XskRingError(&Xsk.Rings.Tx));
 
-    for (UINT16 i = 1; i < HeadersLength; i++) {
-        Params.SplitIndexes = &i;
-        Params.SplitCount = 1;
-        Params.IsTxInspect = IsTxInspect;
-        Params.LowResources = IsLowResources;
-        GenericRxFragmentBuffer(Af, &Params);
-    }
+    //
+    // Wait for the MTU changes to quiesce. If filter or protocol drivers
+    // incompatible with MTU changes are installed, this requires a complete
+    // detach/attach cycle of the entire interface stack.
+    //
+    WaitForNdisDatapath(If, MP_RESTART_TIMEOUT);
+
+    Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
+
+    //
+    // Post a TX of size MTU and verify the packet was completed.
+    //
+
+    UCHAR Payload[] = "GenericTxMtu";
+    UINT64 TxBuffer = SocketFreePop(&Xsk);
+    UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
+    RtlCopyMemory(TxFrame, Payload, sizeof(Payload));
+
+    UINT32 ProducerIndex;
+    TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+
+    XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+    TxDesc->Address.AddressAndOffset = TxBuffer;
+    TxDesc->Length = TestMtu;
+
+    XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+    SocketConsumerReserve(&Xsk.Rings.Completion, 1);
+
+    XSK_STATISTICS Stats = {0};
+    UINT32 StatsSize = sizeof(Stats);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS, &Stats, &StatsSize);
+    TEST_EQUAL(0, Stats.TxInvalidDescriptors);
+
+    //
+    // Post a TX larger than the MTU and verify the packet was dropped.
+    //
+
+    TxBuffer = SocketFreePop(&Xsk);
+    TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
+    RtlCopyMemory(TxFrame, Payload, sizeof(Payload));
+
+    TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+
+    TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+    TxDesc->Address.AddressAndOffset = TxBuffer;
+    TxDesc->Length = TestMtu + 1;
+
+    XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+
+    Watchdog.Reset();
+    do {
+        GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS, &Stats, &StatsSize);
+
+        if (Stats.TxInvalidDescriptors == 1) {
+            break;
+        }
+    } while (!Watchdog.IsExpired());
+    TEST_EQUAL(1, Stats.TxInvalidDescriptors);
 }
 
 VOID
-GenericRxFromTxInspect(
-    _In_ ADDRESS_FAMILY Af
+GenericXskWait(
+    _In_ BOOLEAN Rx,
+    _In_ BOOLEAN Tx,
+    _In_ BOOLEAN Spin
     )
 {
-    auto If = FnMp1QIf;
-    UINT16 XskPort;
-    SOCKADDR_INET DestAddr = {};
+    auto If = FnMpIf;
+    auto Xsk = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, TRUE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    const UINT32 WaitTimeoutMs = 1000;
+    Stopwatch<std::chrono::milliseconds> Timer;
 
-    auto UdpSocket = CreateUdpSocket(Af, &If, &XskPort);
-    auto Xsk =
-        CreateAndBindSocket(
-            If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_UNSPEC, XSK_BIND_FLAG_NONE,
-            &XdpInspectTxL2);
+    UCHAR Payload[] = "GenericXskWait";
 
-    XskPort = htons(1234);
+    auto RxIndicate = [&] {
+        DATA_BUFFER Buffer = {0};
+        Buffer.DataOffset = 0;
+        Buffer.DataLength = sizeof(Payload);
+        Buffer.BufferLength = Buffer.DataLength;
+        Buffer.VirtualAddress = Payload;
 
-    XDP_RULE Rule;
-    Rule.Match = XDP_MATCH_UDP_DST;
-    Rule.Pattern.Port = XskPort;
-    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
-    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
-    Rule.Redirect.Target = Xsk.Handle.get();
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), &Buffer);
+        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+        SocketProduceRxFill(&Xsk, 1);
+        TEST_HRESULT(TryMpRxFlush(GenericMp));
+    };
 
-    wil::unique_handle ProgramHandle =
-        CreateXdpProg(
-            If.GetIfIndex(), &XdpInspectTxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+    auto TxIndicate = [&] {
+        UINT64 TxBuffer = SocketFreePop(&Xsk);
+        UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
+        UINT32 TxFrameLength = sizeof(Payload);
+        ASSERT(TxFrameLength <= Xsk.Umem.Reg.ChunkSize);
+        RtlCopyMemory(TxFrame, Payload, sizeof(Payload));
 
-    if (Af == AF_INET) {
-        DestAddr.si_family = AF_INET;
-        DestAddr.Ipv4.sin_port = XskPort;
-        If.GetRemoteIpv4Address(&DestAddr.Ipv4.sin_addr);
-    } else {
-        DestAddr.si_family = AF_INET6;
-        DestAddr.Ipv6.sin6_port = XskPort;
-        If.GetRemoteIpv6Address(&DestAddr.Ipv6.sin6_addr);
-    }
+        UINT32 ProducerIndex;
+        TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+
+        XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+        TxDesc->Address.AddressAndOffset = TxBuffer;
+        TxDesc->Length = TxFrameLength;
+        XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+
+        XSK_NOTIFY_RESULT_FLAGS PokeResult;
+        NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &PokeResult);
+        TEST_EQUAL(0, PokeResult);
+    };
 
-    //
-    // Using UDP segmentation offload, build one send with two UDP frames. The
-    // UDP data path should split the send into one NBL chained to two NBs. This
-    // feature is only supported on newer versions of Windows; if USO is not
-    // supported, send a single frame.
-    //
-    UINT32 NumFrames;
-    UINT32 UdpSegmentSize;
-    SIZE_T OptLen = sizeof(UdpSegmentSize);
-    CHAR UdpPayload[] = "GenericRxFromTxInspectPkt1GenericRxFromTxInspectPkt2";
+    XSK_NOTIFY_FLAGS NotifyFlags = XSK_NOTIFY_FLAG_NONE;
+    UINT32 ExpectedResult = 0;
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
 
-    HRESULT Result =
-        FnSockGetSockOpt(
-            UdpSocket.get(), IPPROTO_UDP, UDP_SEND_MSG_SIZE, (DWORD *)&UdpSegmentSize,
-            &OptLen);
-    if (FAILED(Result)) {
-        TEST_EQUAL(WSAEINVAL, FnSockGetLastError());
-        NumFrames = 1;
-        UdpSegmentSize = sizeof(UdpPayload) - 1;
+    if (Rx) {
+        NotifyFlags |= XSK_NOTIFY_FLAG_WAIT_RX;
+        ExpectedResult |= XSK_NOTIFY_RESULT_FLAG_RX_AVAILABLE;
     } else {
-        NumFrames = 2;
-        UdpSegmentSize = (UINT32)(strchr(UdpPayload, '1') - UdpPayload + 1);
-        TEST_HRESULT(
-            FnSockSetSockOpt(
-                UdpSocket.get(), IPPROTO_UDP, UDP_SEND_MSG_SIZE, &UdpSegmentSize,
-                sizeof(UdpSegmentSize)));
+        //
+        // Produce IO that does not satisfy the wait condition.
+        //
+        RxIndicate();
     }
 
-    TEST_EQUAL((SIZE_T)NumFrames * (SIZE_T)UdpSegmentSize + 1, sizeof(UdpPayload));
-
-    //
-    // Produce two XSK fill descriptors, one for each UDP frame.
-    //
-    SocketProduceRxFill(&Xsk, NumFrames);
-
-    //
-    // NDIS restarts protocol stacks from the NIC upwards towards protocols, so
-    // XDP completing a bind request does not imply that the TCPIP data path is
-    // restarted. Wait until the send succeeds.
-    //
-    Stopwatch<std::chrono::seconds> Watchdog(std::chrono::seconds(5));
-    INT Bytes;
-    do {
-        Bytes =
-            FnSockSendto(
-                UdpSocket.get(), UdpPayload, NumFrames * UdpSegmentSize, FALSE,
-                0, (SOCKADDR *)&DestAddr, sizeof(DestAddr));
+    if (Tx) {
+        NotifyFlags |= XSK_NOTIFY_FLAG_WAIT_TX;
+        ExpectedResult |= XSK_NOTIFY_RESULT_FLAG_TX_COMP_AVAILABLE;
+    } else {
+        //
+        // Produce IO that does not satisfy the wait condition.
+        //
+        TxIndicate();
+    }
 
-        if (Bytes != -1) {
-            break;
-        }
+    if (Spin) {
         //
-        // TCPIP returns WSAENOBUFS when it cannot reference the data path.
+        // Spinning is valid only when waiting for IO.
         //
-        TEST_EQUAL(WSAENOBUFS, FnSockGetLastError());
-    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+        TEST_EQUAL(
+            E_INVALIDARG,
+            TryNotifySocket(
+                Xsk.Handle.get(), XSK_NOTIFY_FLAG_WAIT_SPIN, WaitTimeoutMs, &NotifyResult));
 
-    TEST_EQUAL(NumFrames * UdpSegmentSize, (UINT32)Bytes);
+        NotifyFlags |= XSK_NOTIFY_FLAG_WAIT_SPIN;
+    }
 
     //
-    // Verify the NBL propagated correctly to XSK.
+    // Verify the wait times out when the requested IO is not available.
     //
-    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, NumFrames);
-    TEST_EQUAL(NumFrames, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+    Timer.Reset();
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_TIMEOUT),
+        TryNotifySocket(Xsk.Handle.get(), NotifyFlags, WaitTimeoutMs, &NotifyResult));
+    Timer.ExpectElapsed(std::chrono::milliseconds(WaitTimeoutMs));
 
-    for (UINT32 FrameIndex = 0; FrameIndex < NumFrames; FrameIndex++) {
-        auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex++);
+    auto AsyncThread = std::async(
+        std::launch::async,
+        [&] {
+            //
+            // On another thread, briefly delay execution to give the main test
+            // thread a chance to begin waiting. Then, produce RX and TX.
+            //
+            Sleep(10);
 
-        TEST_EQUAL(UDP_HEADER_BACKFILL(Af) + UdpSegmentSize, RxDesc->Length);
-        TEST_TRUE(
-            RtlEqualMemory(
-                Xsk.Umem.Buffer.get() + UDP_HEADER_BACKFILL(Af) +
-                    RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
-                &UdpPayload[FrameIndex * UdpSegmentSize],
-                UdpSegmentSize));
-    }
-}
+            if (Rx) {
+                RxIndicate();
+            }
 
-static
-VOID
-GenerateTestPassword(
-    _Out_writes_z_(BufferCount) WCHAR *Buffer,
-    _In_ UINT32 BufferCount
-    )
-{
-    TEST_TRUE(BufferCount >= 4);
-    ASSERT(BufferCount >= 4);
+            if (Tx) {
+                TxIndicate();
+            }
+        }
+    );
 
     //
-    // Terminate the string and attempt to satisfy complexity requirements with
-    // some hard-coded values.
+    // Verify the wait succeeds if any of the conditions is true, and that all
+    // conditions are eventually met.
     //
-    Buffer[--BufferCount] = L'\0';
-    Buffer[--BufferCount] = L'A';
-    Buffer[--BufferCount] = L'b';
-    Buffer[--BufferCount] = L'#';
+    do {
+        Timer.Reset(TEST_TIMEOUT_ASYNC);
+        NotifySocket(Xsk.Handle.get(), NotifyFlags, WaitTimeoutMs, &NotifyResult);
+        TEST_FALSE(Timer.IsExpired());
+        TEST_NOT_EQUAL(0, (NotifyResult & ExpectedResult));
 
-    for (UINT32 i = 0; i < BufferCount; i++) {
-        static const WCHAR Characters[] =
-            L"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-            "abcdefghijklmnopqrstuvwxyz"
-            "0123456789";
+        if (NotifyResult & XSK_NOTIFY_RESULT_FLAG_RX_AVAILABLE) {
+            XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
+        }
 
-        unsigned int r;
-        rand_s(&r);
+        if (NotifyResult & XSK_NOTIFY_RESULT_FLAG_TX_COMP_AVAILABLE) {
+            XskRingConsumerRelease(&Xsk.Rings.Completion, 1);
+        }
 
-        Buffer[i] = Characters[r % RTL_NUMBER_OF(Characters)];
-    }
+        ExpectedResult &= ~NotifyResult;
+    } while (ExpectedResult != 0);
+
+    //
+    // Verify the wait does not succeed after consuming the requested IO.
+    //
+    Timer.Reset();
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_TIMEOUT),
+        TryNotifySocket(Xsk.Handle.get(), NotifyFlags, WaitTimeoutMs, &NotifyResult));
+    Timer.ExpectElapsed(std::chrono::milliseconds(WaitTimeoutMs));
 }
 
 VOID
-SecurityAdjustDeviceAcl()
+GenericXskNotifySockets()
 {
-    PCWSTR UserName = L"xdpfnuser";
-    WCHAR UserPassword[16 + 1];
-    USER_INFO_1 UserInfo = {0};
-    NET_API_STATUS UserStatus;
-    SE_SID UserSid;
-    SID_NAME_USE UserSidUse;
     auto If = FnMpIf;
+    auto RxXsk = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+    auto TxXsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    const UINT32 WaitTimeoutMs = 100;
+    Stopwatch<std::chrono::milliseconds> Timer;
+    XSK_NOTIFY_SOCKET_ENTRY Sockets[2] = {0};
+    UINT32 ReadyCount;
 
-    //
-    // Create a standard, non-admin user on the local system and create a logon
-    // session for them.
-    //
-
-    UserInfo.usri1_name = (PWSTR)UserName;
-    UserInfo.usri1_password = (PWSTR)UserPassword;
-    UserInfo.usri1_priv = USER_PRIV_USER;
-    UserInfo.usri1_flags = UF_SCRIPT | UF_PASSWD_NOTREQD | UF_DONT_EXPIRE_PASSWD;
-
-    for (UINT32 i = 0; i < 10; i++) {
-        GenerateTestPassword(UserPassword, RTL_NUMBER_OF(UserPassword));
-
-        UserStatus = NetUserAdd(NULL, 1, (BYTE *)&UserInfo, NULL);
-        if (UserStatus == NERR_Success) {
-            break;
-        }
-    }
-
-    TEST_EQUAL(NERR_Success, UserStatus);
-
-    auto UserRemove = wil::scope_exit([&]
-    {
-        NET_API_STATUS UserStatus = NetUserDel(NULL, UserName);
-
-        if (UserStatus != NERR_Success) {
-            TEST_WARNING("NetUserDel failed: %x", UserStatus);
-        }
-    });
+    UCHAR Payload[] = "GenericXskNotifySockets";
 
-    wil::unique_handle Token;
-    TEST_TRUE(LogonUserW(
-        UserName, L".", UserPassword, LOGON32_LOGON_NETWORK, LOGON32_PROVIDER_DEFAULT, &Token));
+    Sockets[0].Socket = RxXsk.Handle.get();
+    Sockets[0].Flags = XSK_NOTIFY_FLAG_WAIT_TX;
+    Sockets[1].Socket = TxXsk.Handle.get();
+    Sockets[1].Flags = XSK_NOTIFY_FLAG_WAIT_TX;
 
     //
-    // As the non-admin user, verify XDP denies access to all handle types.
+    // Every socket's flags must be valid for that socket.
     //
-    {
-        TEST_TRUE(ImpersonateLoggedOnUser(Token.get()));
-        auto Unimpersonate = wil::scope_exit([&]
-        {
-            RevertToSelf();
-        });
-
-        wil::unique_handle Socket;
-        TEST_EQUAL(
-            HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED),
-            TryCreateSocket(Socket));
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TryNotifySockets(Sockets, RTL_NUMBER_OF(Sockets), 0, &ReadyCount));
 
-        wil::unique_handle Interface;
-        TEST_EQUAL(
-            HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED),
-            TryInterfaceOpen(If.GetIfIndex(), Interface));
-    }
+    //
+    // Verify the wait times out when no socket has requested IO available.
+    //
+    Sockets[0].Flags = XSK_NOTIFY_FLAG_WAIT_RX;
+    Timer.Reset();
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_TIMEOUT),
+        TryNotifySockets(Sockets, RTL_NUMBER_OF(Sockets), WaitTimeoutMs, &ReadyCount));
+    Timer.ExpectElapsed(std::chrono::milliseconds(WaitTimeoutMs));
+    TEST_EQUAL(0, ReadyCount);
 
     //
-    // Grant the test's standard user access to XDP.
+    // Verify RX on one socket completes the wait while it is in progress.
     //
+    auto AsyncThread = std::async(
+        std::launch::async,
+        [&] {
+            Sleep(10);
 
-    DWORD SidSize = sizeof(UserSid);
-    WCHAR Domain[256];
-    DWORD DomainSize = RTL_NUMBER_OF(Domain);
+            DATA_BUFFER Buffer = {0};
+            Buffer.DataLength = sizeof(Payload);
+            Buffer.BufferLength = Buffer.DataLength;
+            Buffer.VirtualAddress = Payload;
 
-    TEST_TRUE(LookupAccountNameW(
-        NULL, UserName, &UserSid.Sid, &SidSize, Domain, &DomainSize, &UserSidUse));
+            RX_FRAME Frame;
+            RxInitializeFrame(&Frame, If.GetQueueId(), &Buffer);
+            TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+            SocketProduceRxFill(&RxXsk, 1);
+            TEST_HRESULT(TryMpRxFlush(GenericMp));
+        }
+    );
 
-    wil::unique_hlocal_ansistring SidString;
-    TEST_TRUE(ConvertSidToStringSidA(&UserSid.Sid, wil::out_param(SidString)));
+    Timer.Reset(TEST_TIMEOUT_ASYNC);
+    TEST_HRESULT(
+        TryNotifySockets(Sockets, RTL_NUMBER_OF(Sockets), TEST_TIMEOUT_ASYNC_MS, &ReadyCount));
+    TEST_FALSE(Timer.IsExpired());
+    AsyncThread.wait();
+    TEST_EQUAL(1, ReadyCount);
+    TEST_EQUAL(XSK_NOTIFY_RESULT_FLAG_RX_AVAILABLE, Sockets[0].Result);
+    TEST_EQUAL(0, Sockets[1].Result);
+    XskRingConsumerRelease(&RxXsk.Rings.Rx, 1);
 
-    CHAR SddlBuff[256];
-    RtlZeroMemory(SddlBuff, sizeof(SddlBuff));
-    sprintf_s(SddlBuff, DEFAULT_XDP_SDDL "(A;;GA;;;%s)", SidString.get());
+    //
+    // Verify pokes are performed on each socket within the same call.
+    //
+    UINT64 TxBuffer = SocketFreePop(&TxXsk);
+    RtlCopyMemory(TxXsk.Umem.Buffer.get() + TxBuffer, Payload, sizeof(Payload));
 
-    SetDeviceSddl(SddlBuff);
-    auto ResetSddl = wil::scope_exit([&]
-    {
-        SetDeviceSddl(DEFAULT_XDP_SDDL);
+    UINT32 ProducerIndex;
+    TEST_EQUAL(1, XskRingProducerReserve(&TxXsk.Rings.Tx, 1, &ProducerIndex));
+    XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&TxXsk, ProducerIndex);
+    TxDesc->Address.AddressAndOffset = TxBuffer;
+    TxDesc->Length = sizeof(Payload);
+    XskRingProducerSubmit(&TxXsk.Rings.Tx, 1);
 
-        HRESULT Result = TryRestartService(XDP_SERVICE_NAME);
-        if (FAILED(Result)) {
-            TEST_WARNING("TryRestartService(XDP_SERVICE_NAME) failed: %x", Result);
-        }
-    });
+    Sockets[1].Flags = XSK_NOTIFY_FLAG_POKE_TX | XSK_NOTIFY_FLAG_WAIT_TX;
+    TEST_HRESULT(
+        TryNotifySockets(Sockets, RTL_NUMBER_OF(Sockets), TEST_TIMEOUT_ASYNC_MS, &ReadyCount));
+    TEST_EQUAL(1, ReadyCount);
+    TEST_EQUAL(0, Sockets[0].Result);
+    TEST_EQUAL(XSK_NOTIFY_RESULT_FLAG_TX_COMP_AVAILABLE, Sockets[1].Result);
+}
 
-    TEST_HRESULT(TryRestartService(XDP_SERVICE_NAME));
+VOID
+GenericXskSockopts()
+{
+    auto If = FnMpIf;
+    MY_SOCKET Xsk;
+    UINT32 RingSize = DEFAULT_RING_SIZE;
+    XSK_RING_INFO_SET InfoSet = {0};
+    XDP_HOOK_ID TxHookId = {0};
+    UINT32 Unused = 0;
+    XSK_SOCKOPT_ENTRY Options[6] = {0};
+    UINT32 CompletedCount;
+
+    Xsk.Handle = CreateSocket();
+    Xsk.Umem.Buffer = AllocUmemBuffer();
+    InitUmem(&Xsk.Umem.Reg, Xsk.Umem.Buffer.get());
+
+    //
+    // Configure the socket and read back its ring info in a single call.
+    //
+    Options[0].OptionName = XSK_SOCKOPT_UMEM_REG;
+    Options[0].OptionValue = &Xsk.Umem.Reg;
+    Options[0].OptionLength = sizeof(Xsk.Umem.Reg);
+    Options[1].OptionName = XSK_SOCKOPT_RX_FILL_RING_SIZE;
+    Options[1].OptionValue = &RingSize;
+    Options[1].OptionLength = sizeof(RingSize);
+    Options[2].OptionName = XSK_SOCKOPT_TX_COMPLETION_RING_SIZE;
+    Options[2].OptionValue = &RingSize;
+    Options[2].OptionLength = sizeof(RingSize);
+    Options[3].OptionName = XSK_SOCKOPT_TX_RING_SIZE;
+    Options[3].OptionValue = &RingSize;
+    Options[3].OptionLength = sizeof(RingSize);
+    Options[4].OptionName = XSK_SOCKOPT_RING_INFO;
+    Options[4].Flags = XSK_SOCKOPT_ENTRY_FLAG_GET;
+    Options[4].OptionValue = &InfoSet;
+    Options[4].OptionLength = sizeof(InfoSet);
+    Options[5].OptionName = XSK_SOCKOPT_TX_HOOK_ID;
+    Options[5].Flags = XSK_SOCKOPT_ENTRY_FLAG_GET;
+    Options[5].OptionValue = &TxHookId;
+    Options[5].OptionLength = sizeof(TxHookId);
+
+    TEST_HRESULT(TrySockopts(Xsk.Handle.get(), Options, RTL_NUMBER_OF(Options), &CompletedCount));
+    TEST_EQUAL(RTL_NUMBER_OF(Options), CompletedCount);
+    TEST_EQUAL(sizeof(InfoSet), Options[4].OptionLength);
+    TEST_EQUAL(RingSize, InfoSet.Fill.Size);
+    TEST_EQUAL(RingSize, InfoSet.Completion.Size);
+    TEST_EQUAL(RingSize, InfoSet.Tx.Size);
+    TEST_EQUAL(0, InfoSet.Rx.Size);
+    TEST_EQUAL(sizeof(TxHookId), Options[5].OptionLength);
+    TEST_EQUAL(XDP_HOOK_L2, TxHookId.Layer);
+    TEST_EQUAL(XDP_HOOK_TX, TxHookId.Direction);
+
+    //
+    // Processing stops at the first failed option, leaving later options
+    // untouched.
+    //
+    Options[0].OptionName = XSK_SOCKOPT_TX_HOOK_ID;
+    Options[0].Flags = XSK_SOCKOPT_ENTRY_FLAG_GET;
+    Options[0].OptionValue = &TxHookId;
+    Options[0].OptionLength = sizeof(TxHookId);
+    Options[1].OptionName = 0xFFFF;
+    Options[1].Flags = XSK_SOCKOPT_ENTRY_FLAG_NONE;
+    Options[1].OptionValue = &Unused;
+    Options[1].OptionLength = sizeof(Unused);
+    Options[2].OptionName = XSK_SOCKOPT_RING_INFO;
+    Options[2].Flags = XSK_SOCKOPT_ENTRY_FLAG_GET;
+    Options[2].OptionValue = &InfoSet;
+    Options[2].OptionLength = sizeof(InfoSet);
+    RtlZeroMemory(&InfoSet, sizeof(InfoSet));
+
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED),
+        TrySockopts(Xsk.Handle.get(), Options, 3, &CompletedCount));
+    TEST_EQUAL(1, CompletedCount);
+    TEST_EQUAL(0, InfoSet.Fill.Size);
 
     //
-    // As the non-admin user, verify XDP now grants access to all handle types.
+    // The socket configured by the vectored call binds and activates normally.
     //
-    {
-        TEST_TRUE(ImpersonateLoggedOnUser(Token.get()));
-        auto Unimpersonate = wil::scope_exit([&]
-        {
-            RevertToSelf();
-        });
-
-        CreateSocket();
-        InterfaceOpen(If.GetIfIndex());
-    }
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Xsk.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_TX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Xsk.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
 }
 
-static
-HRESULT
-TryAttachEbpfXdpProgram(
-    _Out_ unique_bpf_object &BpfObject,
-    _In_ const TestInterface &If,
-    _In_ const CHAR *BpfRelativeFileName,
-    _In_ const CHAR *BpfProgramName,
-    _In_ INT AttachFlags = 0
+VOID
+GenericXskWaitAsync(
+    _In_ BOOLEAN Rx,
+    _In_ BOOLEAN Tx
     )
 {
-    HRESULT Result;
-    CHAR Path[MAX_PATH];
-    std::string BpfAbsoluteFileName;
-    bpf_program *Program;
-    int ProgramFd;
-    int ErrnoResult;
+    auto If = FnMpIf;
+    auto Xsk = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, TRUE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    const UINT32 WaitTimeoutMs = 1000;
+    OVERLAPPED ov = {0};
+    wil::unique_handle iocp(CreateIoCompletionPort(Xsk.Handle.get(), NULL, 0, 0));
 
-    Result = GetCurrentBinaryPath(Path, RTL_NUMBER_OF(Path));
-    if (FAILED(Result)) {
-        goto Exit;
-    }
+    UCHAR Payload[] = "GenericXskWaitAsync";
 
-    BpfAbsoluteFileName = Path;
-    BpfAbsoluteFileName += BpfRelativeFileName;
+    auto RxIndicate = [&] {
+        DATA_BUFFER Buffer = {0};
+        Buffer.DataOffset = 0;
+        Buffer.DataLength = sizeof(Payload);
+        Buffer.BufferLength = Buffer.DataLength;
+        Buffer.VirtualAddress = Payload;
 
-    BpfObject.reset(bpf_object__open(BpfAbsoluteFileName.c_str()));
-    if (BpfObject.get() == NULL) {
-        TraceError("bpf_object__open failed: %d", errno);
-        Result = E_FAIL;
-        goto Exit;
-    }
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), &Buffer);
+        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+        SocketProduceRxFill(&Xsk, 1);
+        TEST_HRESULT(TryMpRxFlush(GenericMp));
+    };
 
-    ErrnoResult = bpf_object__load(BpfObject.get());
-    if (ErrnoResult != 0) {
-        TraceError("bpf_object__load failed: %d, errno=%d", ErrnoResult, errno);
-        Result = E_FAIL;
-        goto Exit;
-    }
+    auto TxIndicate = [&] {
+        UINT64 TxBuffer = SocketFreePop(&Xsk);
+        UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
+        UINT32 TxFrameLength = sizeof(Payload);
+        ASSERT(TxFrameLength <= Xsk.Umem.Reg.ChunkSize);
+        RtlCopyMemory(TxFrame, Payload, sizeof(Payload));
 
-    Program = bpf_object__find_program_by_name(BpfObject.get(), BpfProgramName);
-    if (Program == NULL) {
-        TraceError("bpf_object__find_program_by_name failed: %d", errno);
-        Result = E_FAIL;
-        goto Exit;
-    }
+        UINT32 ProducerIndex;
+        TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
 
-    ProgramFd = bpf_program__fd(Program);
-    if (ProgramFd < 0) {
-        TraceError("bpf_program__fd failed: %d", errno);
-        Result = E_FAIL;
-        goto Exit;
-    }
+        XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+        TxDesc->Address.AddressAndOffset = TxBuffer;
+        TxDesc->Length = TxFrameLength;
+        XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
 
-    ErrnoResult = bpf_xdp_attach(If.GetIfIndex(), ProgramFd, AttachFlags, NULL);
-    if (ErrnoResult != 0) {
-        TraceError("bpf_xdp_attach failed: %d, errno=%d", ErrnoResult, errno);
-        Result = E_FAIL;
-        goto Exit;
-    }
+        XSK_NOTIFY_RESULT_FLAGS PokeResult;
+        NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &PokeResult);
+        TEST_EQUAL(0, PokeResult);
+    };
 
-    Result = S_OK;
+    XSK_NOTIFY_FLAGS NotifyFlags = XSK_NOTIFY_FLAG_NONE;
+    UINT32 ExpectedResult = 0;
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
 
-Exit:
+    if (Rx) {
+        NotifyFlags |= XSK_NOTIFY_FLAG_WAIT_RX;
+        ExpectedResult |= XSK_NOTIFY_RESULT_FLAG_RX_AVAILABLE;
+    } else {
+        //
+        // Produce IO that does not satisfy the wait condition.
+        //
+        RxIndicate();
+    }
 
-    if (FAILED(Result)) {
-        BpfObject.reset();
+    if (Tx) {
+        NotifyFlags |= XSK_NOTIFY_FLAG_WAIT_TX;
+        ExpectedResult |= XSK_NOTIFY_RESULT_FLAG_TX_COMP_AVAILABLE;
+    } else {
+        //
+        // Produce IO that does not satisfy the wait condition.
+        //
+        TxIndicate();
     }
 
-    return Result;
-}
+    //
+    // Verify the wait times out when the requested IO is not available.
+    //
+    DWORD bytes;
+    ULONG_PTR key;
+    OVERLAPPED *ovp;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_IO_PENDING),
+        TryNotifyAsync(Xsk.Handle.get(), NotifyFlags, &ov));
+    TEST_FALSE(GetQueuedCompletionStatus(iocp.get(), &bytes, &key, &ovp, WaitTimeoutMs));
+    TEST_EQUAL(WAIT_TIMEOUT, GetLastError());
 
-static
-unique_bpf_object
-AttachEbpfXdpProgram(
-    _In_ const TestInterface &If,
-    _In_ const CHAR *BpfRelativeFileName,
-    _In_ const CHAR *BpfProgramName,
-    _In_ INT AttachFlags = 0
-    )
-{
-    unique_bpf_object BpfObject;
-    HRESULT Result;
+    auto AsyncThread = std::async(
+        std::launch::async,
+        [&] {
+            //
+            // On another thread, briefly delay execution to give the main test
+            // thread a chance to begin waiting. Then, produce RX and TX.
+            //
+            Sleep(10);
+
+            if (Rx) {
+                RxIndicate();
+            }
+
+            if (Tx) {
+                TxIndicate();
+            }
+        }
+    );
 
     //
-    // TODO: https://github.com/microsoft/ebpf-for-windows/issues/2133
-    // Workaround till the above issue is fixed (and eBPF returns E_BUSY):
-    // Try a few times to load and attach the program with a sleep in between.
+    // Verify the wait succeeds if any of the conditions is true, and that all
+    // conditions are eventually met.
     //
-    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
     do {
-        Result = TryAttachEbpfXdpProgram(
-            BpfObject, If, BpfRelativeFileName, BpfProgramName, AttachFlags);
-        if (Result == S_OK) {
-            break;
+        TEST_TRUE(GetQueuedCompletionStatus(iocp.get(), &bytes, &key, &ovp, WaitTimeoutMs));
+        TEST_EQUAL(&ov, ovp);
+        GetNotifyAsyncResult(&ov, &NotifyResult);
+        TEST_NOT_EQUAL(0, (NotifyResult & ExpectedResult));
+
+        if (NotifyResult & XSK_NOTIFY_RESULT_FLAG_RX_AVAILABLE) {
+            XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
         }
-    } while (Sleep(2 * POLL_INTERVAL_MS), !Watchdog.IsExpired());
 
-    TEST_HRESULT(Result);
+        if (NotifyResult & XSK_NOTIFY_RESULT_FLAG_TX_COMP_AVAILABLE) {
+            XskRingConsumerRelease(&Xsk.Rings.Completion, 1);
+        }
 
-    return BpfObject;
+        ExpectedResult &= ~NotifyResult;
+
+        if (ExpectedResult != 0) {
+            HRESULT res = TryNotifyAsync(Xsk.Handle.get(), NotifyFlags, &ov);
+            if (!SUCCEEDED(res)) {
+                TEST_EQUAL(HRESULT_FROM_WIN32(ERROR_IO_PENDING), res);
+            }
+        }
+    } while (ExpectedResult != 0);
+
+    //
+    // Verify cancellation (happy path).
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_IO_PENDING),
+        TryNotifyAsync(Xsk.Handle.get(), NotifyFlags, &ov));
+    TEST_FALSE(GetQueuedCompletionStatus(iocp.get(), &bytes, &key, &ovp, WaitTimeoutMs));
+    TEST_EQUAL(WAIT_TIMEOUT, GetLastError());
+    TEST_TRUE(CancelIoEx(Xsk.Handle.get(), &ov));
+    TEST_FALSE(GetQueuedCompletionStatus(iocp.get(), &bytes, &key, &ovp, WaitTimeoutMs));
+    TEST_EQUAL(ERROR_OPERATION_ABORTED, GetLastError());
 }
 
 VOID
-GenericRxEbpfAttach()
+GenericXskNotifyCompletionPort()
 {
     auto If = FnMpIf;
+    auto Xsk = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, TRUE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    const ULONG_PTR CompletionKey = 0x5C;
+    wil::unique_handle iocp;
+    OVERLAPPED Context = {0};
+    XSK_NOTIFY_COMPLETION_PORT Completion = {};
+    DWORD bytes;
+    ULONG_PTR key;
+    OVERLAPPED *ovp;
+
+    UCHAR Payload[] = "GenericXskNotifyCompletionPort";
+
+    auto RxIndicate = [&] {
+        DATA_BUFFER Buffer = {0};
+        Buffer.DataOffset = 0;
+        Buffer.DataLength = sizeof(Payload);
+        Buffer.BufferLength = Buffer.DataLength;
+        Buffer.VirtualAddress = Payload;
+
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), &Buffer);
+        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+        SocketProduceRxFill(&Xsk, 1);
+        TEST_HRESULT(TryMpRxFlush(GenericMp));
+    };
+
+    auto TxIndicate = [&] {
+        UINT64 TxBuffer = SocketFreePop(&Xsk);
+        UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
+        UINT32 TxFrameLength = sizeof(Payload);
+        ASSERT(TxFrameLength <= Xsk.Umem.Reg.ChunkSize);
+        RtlCopyMemory(TxFrame, Payload, sizeof(Payload));
+
+        UINT32 ProducerIndex;
+        TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+
+        XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+        TxDesc->Address.AddressAndOffset = TxBuffer;
+        TxDesc->Length = TxFrameLength;
+        XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+
+        XSK_NOTIFY_RESULT_FLAGS PokeResult;
+        NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &PokeResult);
+        TEST_EQUAL(0, PokeResult);
+    };
 
-    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\drop.sys", "drop");
+    auto ExpectCompletion = [&](UINT32 ExpectedResult) {
+        TEST_TRUE(GetQueuedCompletionStatus(iocp.get(), &bytes, &key, &ovp, TEST_TIMEOUT_ASYNC_MS));
+        TEST_EQUAL(CompletionKey, key);
+        TEST_EQUAL(&Context, ovp);
+        TEST_EQUAL(ExpectedResult, bytes);
+    };
 
-    unique_bpf_object BpfObjectReplacement;
-    TEST_TRUE(FAILED(TryAttachEbpfXdpProgram(BpfObjectReplacement, If, "\\bpf\\pass.sys", "pass")));
+    auto ExpectNoCompletion = [&] {
+        TEST_FALSE(GetQueuedCompletionStatus(iocp.get(), &bytes, &key, &ovp, TEST_TIMEOUT_ASYNC_MS));
+        TEST_EQUAL(WAIT_TIMEOUT, GetLastError());
+    };
+
+    Completion.Flags = XSK_NOTIFY_FLAG_WAIT_RX | XSK_NOTIFY_FLAG_WAIT_TX;
+    Completion.Context = &Context;
 
     //
-    // eBPF doesn't wait for the pass.sys driver to completely unload after
-    // tearing down the object, so allow some time for that to happen before
-    // retrying with the replace flag.
+    // The socket handle must be associated with a completion port.
     //
-    Sleep(TEST_TIMEOUT_ASYNC_MS);
-    BpfObjectReplacement =
-        AttachEbpfXdpProgram(If, "\\bpf\\pass.sys", "pass", XDP_FLAGS_REPLACE);
-}
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(
+            Xsk.Handle.get(), XSK_SOCKOPT_NOTIFY_COMPLETION_PORT, &Completion,
+            sizeof(Completion)));
 
-VOID
-GenericRxEbpfDrop()
-{
-    auto If = FnMpIf;
-    unique_fnmp_handle GenericMp;
-    unique_fnlwf_handle FnLwf;
-    const UCHAR Payload[] = "GenericRxEbpfDrop";
+    iocp.reset(CreateIoCompletionPort(Xsk.Handle.get(), NULL, CompletionKey, 0));
+    TEST_NOT_NULL(iocp.get());
 
-    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\drop.sys", "drop");
+    //
+    // Only wait flags are accepted.
+    //
+    Completion.Flags = XSK_NOTIFY_FLAG_POKE_RX;
+    TEST_FALSE(
+        SUCCEEDED(
+            TrySetSockopt(
+                Xsk.Handle.get(), XSK_SOCKOPT_NOTIFY_COMPLETION_PORT, &Completion,
+                sizeof(Completion))));
 
-    GenericMp = MpOpenGeneric(If.GetIfIndex());
-    FnLwf = LwfOpenDefault(If.GetIfIndex());
+    Completion.Flags = XSK_NOTIFY_FLAG_WAIT_RX | XSK_NOTIFY_FLAG_WAIT_TX;
+    SetSockopt(
+        Xsk.Handle.get(), XSK_SOCKOPT_NOTIFY_COMPLETION_PORT, &Completion, sizeof(Completion));
+    ExpectNoCompletion();
 
-    std::vector<UCHAR> Mask(sizeof(Payload), 0xFF);
-    auto LwfFilter = LwfRxFilter(FnLwf, Payload, &Mask[0], sizeof(Payload));
+    //
+    // Verify an empty ring becoming non-empty queues a completion, and further
+    // entries are coalesced until the application drains the ring.
+    //
+    RxIndicate();
+    ExpectCompletion(XSK_NOTIFY_RESULT_FLAG_RX_AVAILABLE);
+    RxIndicate();
+    ExpectNoCompletion();
+    XskRingConsumerRelease(&Xsk.Rings.Rx, 2);
+    RxIndicate();
+    ExpectCompletion(XSK_NOTIFY_RESULT_FLAG_RX_AVAILABLE);
 
-    RX_FRAME Frame;
-    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    MpRxFlush(GenericMp);
+    TxIndicate();
+    ExpectCompletion(XSK_NOTIFY_RESULT_FLAG_TX_COMP_AVAILABLE);
+    XskRingConsumerRelease(&Xsk.Rings.Completion, 1);
 
-    Sleep(TEST_TIMEOUT_ASYNC_MS);
+    //
+    // Verify disabling completions, and that re-enabling them with a non-empty
+    // ring immediately queues a completion.
+    //
+    Completion.Flags = 0;
+    SetSockopt(
+        Xsk.Handle.get(), XSK_SOCKOPT_NOTIFY_COMPLETION_PORT, &Completion, sizeof(Completion));
+    XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
+    RxIndicate();
+    ExpectNoCompletion();
 
-    UINT32 FrameLength = 0;
-    TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
-        LwfRxGetFrame(FnLwf, If.GetQueueId(), &FrameLength, NULL));
+    Completion.Flags = XSK_NOTIFY_FLAG_WAIT_RX;
+    SetSockopt(
+        Xsk.Handle.get(), XSK_SOCKOPT_NOTIFY_COMPLETION_PORT, &Completion, sizeof(Completion));
+    ExpectCompletion(XSK_NOTIFY_RESULT_FLAG_RX_AVAILABLE);
 }
 
 VOID
-GenericRxEbpfPass()
+GenericXskStatisticsEx()
 {
     auto If = FnMpIf;
-    unique_fnmp_handle GenericMp;
-    unique_fnlwf_handle FnLwf;
-    const UCHAR Payload[] = "GenericRxEbpfPass";
-
-    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\pass.sys", "pass");
+    auto Xsk = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, TRUE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    XSK_STATISTICS_EX Stats;
+    UINT32 OptionLength;
 
-    GenericMp = MpOpenGeneric(If.GetIfIndex());
-    FnLwf = LwfOpenDefault(If.GetIfIndex());
+    //
+    // The optval must fit at least the first revision.
+    //
+    OptionLength = XSK_SIZEOF_STATISTICS_EX_REVISION_1 - 1;
+    TEST_FALSE(
+        SUCCEEDED(
+            TryGetSockopt(
+                Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS_EX, &Stats, &OptionLength)));
 
-    std::vector<UCHAR> Mask(sizeof(Payload), 0xFF);
-    auto LwfFilter = LwfRxFilter(FnLwf, Payload, &Mask[0], sizeof(Payload));
+    //
+    // An optval sized for the first revision returns the first revision.
+    //
+    OptionLength = XSK_SIZEOF_STATISTICS_EX_REVISION_1;
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS_EX, &Stats, &OptionLength);
+    TEST_EQUAL(XSK_SIZEOF_STATISTICS_EX_REVISION_1, OptionLength);
+    TEST_EQUAL(XSK_STATISTICS_EX_REVISION_1, Stats.Header.Revision);
+    TEST_EQUAL(XSK_SIZEOF_STATISTICS_EX_REVISION_1, Stats.Header.Size);
 
-    RX_FRAME Frame;
-    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    MpRxFlush(GenericMp);
+    OptionLength = sizeof(Stats);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS_EX, &Stats, &OptionLength);
+    TEST_EQUAL(XSK_SIZEOF_STATISTICS_EX_REVISION_3, OptionLength);
+    TEST_EQUAL(XSK_STATISTICS_EX_REVISION_3, Stats.Header.Revision);
+    TEST_EQUAL(XSK_SIZEOF_STATISTICS_EX_REVISION_3, Stats.Header.Size);
+    TEST_EQUAL(0, Stats.RxFillRingEmpty);
+    TEST_EQUAL(0, Stats.TxFramesScheduled);
+    TEST_EQUAL(0, Stats.TxCompletionsReordered);
+    TEST_EQUAL(0, Stats.TxPokes);
+    TEST_EQUAL(0, Stats.RxRingUsed);
 
-    LwfRxAllocateAndGetFrame(FnLwf, If.GetQueueId());
-    LwfRxDequeueFrame(FnLwf, If.GetQueueId());
-    LwfRxFlush(FnLwf);
-}
+    //
+    // Verify pokes are counted.
+    //
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    OptionLength = sizeof(Stats);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS_EX, &Stats, &OptionLength);
+    TEST_EQUAL(1, Stats.TxPokes);
 
-VOID
-GenericRxEbpfTx()
-{
-    auto If = FnMpIf;
-    unique_fnmp_handle GenericMp;
-    const UCHAR Payload[] = "GenericRxEbpfTx";
+    //
+    // Verify a frame indicated without fill descriptors is attributed to fill
+    // ring starvation.
+    //
+    UCHAR Payload[] = "GenericXskStatisticsEx";
+    DATA_BUFFER Buffer = {0};
+    Buffer.DataOffset = 0;
+    Buffer.DataLength = sizeof(Payload);
+    Buffer.BufferLength = Buffer.DataLength;
+    Buffer.VirtualAddress = Payload;
 
-    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\l1fwd.sys", "l1fwd");
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), &Buffer);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-    GenericMp = MpOpenGeneric(If.GetIfIndex());
+    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+    do {
+        OptionLength = sizeof(Stats);
+        GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS_EX, &Stats, &OptionLength);
+        if (Stats.Statistics.RxDropped > 0) {
+            break;
+        }
+    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
 
-    std::vector<UCHAR> Mask(sizeof(Payload), 0xFF);
-    auto MpFilter = MpTxFilter(GenericMp, Payload, &Mask[0], sizeof(Payload));
+    TEST_EQUAL(1, Stats.Statistics.RxDropped);
+    TEST_EQUAL(1, Stats.RxFillRingEmpty);
+    TEST_EQUAL(0, Stats.RxRingFull);
 
-    RX_FRAME Frame;
-    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    MpRxFlush(GenericMp);
+    //
+    // Verify ring occupancy reflects a received frame.
+    //
+    SocketProduceRxFill(&Xsk, 1);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    SocketConsumerReserve(&Xsk.Rings.Rx, 1);
 
-    MpTxAllocateAndGetFrame(GenericMp, If.GetQueueId());
-    MpTxDequeueFrame(GenericMp, If.GetQueueId());
-    MpTxFlush(GenericMp);
+    OptionLength = sizeof(Stats);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS_EX, &Stats, &OptionLength);
+    TEST_EQUAL(1, Stats.RxRingUsed);
+    TEST_EQUAL(0, Stats.RxFillRingUsed);
 }
 
 VOID
-GenericRxEbpfPayload()
+GenericXskStatisticsPage()
 {
     auto If = FnMpIf;
-    unique_fnmp_handle GenericMp;
-    unique_fnlwf_handle FnLwf;
-    UINT16 LocalPort = 0, RemotePort = 0;
-    ETHERNET_ADDRESS LocalHw = {}, RemoteHw = {};
-    INET_ADDR LocalIp = {}, RemoteIp = {};
-    const UINT32 Backfill = 13;
-    const UINT32 Trailer = 17;
-    const UCHAR UdpPayload[] = "GenericRxEbpfPayload";
-
-    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\allow_ipv6.sys", "allow_ipv6");
-
-    GenericMp = MpOpenGeneric(If.GetIfIndex());
-    FnLwf = LwfOpenDefault(If.GetIfIndex());
-
-    UCHAR UdpFrame[Backfill + UDP_HEADER_STORAGE + sizeof(UdpPayload) + Trailer];
-    UINT32 UdpFrameLength = sizeof(UdpFrame) - Backfill - Trailer;
+    auto Xsk = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, TRUE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    XSK_STATISTICS_PAGE_INFO Info;
+    XSK_STATISTICS_PAGE_INFO InfoAgain;
+    UINT32 OptionLength;
+
+    OptionLength = sizeof(Info);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS_PAGE, &Info, &OptionLength);
+    TEST_EQUAL(sizeof(Info), OptionLength);
+    TEST_NOT_NULL(Info.Page);
+
+    const volatile XSK_STATISTICS_PAGE *Page = Info.Page;
+    TEST_EQUAL(XSK_STATISTICS_PAGE_REVISION_1, Page->Header.Revision);
+    TEST_EQUAL(XSK_SIZEOF_STATISTICS_PAGE_REVISION_1, Page->Header.Size);
+    TEST_TRUE(Page->ProcessorCount > 0);
+    TEST_TRUE(Page->ProcessorStride >= sizeof(XSK_STATISTICS_PAGE_PROCESSOR));
     TEST_TRUE(
-        PktBuildUdpFrame(
-            UdpFrame + Backfill, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
-            &RemoteHw, AF_INET6, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+        Page->ProcessorOffset + (UINT64)Page->ProcessorCount * Page->ProcessorStride <=
+            Info.Size);
+    TEST_EQUAL(0, Page->Statistics.RxDropped);
 
-    std::vector<UCHAR> Mask(UdpFrameLength, 0xFF);
-    auto LwfFilter = LwfRxFilter(FnLwf, UdpFrame + Backfill, &Mask[0], UdpFrameLength);
+    //
+    // The statistics are mapped once per socket.
+    //
+    OptionLength = sizeof(InfoAgain);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS_PAGE, &InfoAgain, &OptionLength);
+    TEST_EQUAL(Info.Page, InfoAgain.Page);
 
-    RX_FRAME Frame;
+    //
+    // Verify the data path updates the mapped statistics in place: a frame
+    // indicated without fill descriptors is dropped.
+    //
+    UCHAR Payload[] = "GenericXskStatisticsPage";
     DATA_BUFFER Buffer = {0};
-    Buffer.DataOffset = Backfill;
-    Buffer.DataLength = UdpFrameLength;
-    Buffer.BufferLength = Backfill + UdpFrameLength + Trailer;
-    Buffer.VirtualAddress = UdpFrame;
+    Buffer.DataOffset = 0;
+    Buffer.DataLength = sizeof(Payload);
+    Buffer.BufferLength = Buffer.DataLength;
+    Buffer.VirtualAddress = Payload;
 
+    RX_FRAME Frame;
     RxInitializeFrame(&Frame, If.GetQueueId(), &Buffer);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    MpRxFlush(GenericMp);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-    LwfRxAllocateAndGetFrame(FnLwf, If.GetQueueId());
-    LwfRxDequeueFrame(FnLwf, If.GetQueueId());
-    LwfRxFlush(FnLwf);
+    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+    while (Page->Statistics.RxDropped == 0 && !Watchdog.IsExpired()) {
+        Sleep(POLL_INTERVAL_MS);
+    }
+
+    TEST_EQUAL(1, Page->Statistics.RxDropped);
+
+    UINT64 RxFillRingEmpty = 0;
+    for (UINT32 Index = 0; Index < Page->ProcessorCount; Index++) {
+        const volatile XSK_STATISTICS_PAGE_PROCESSOR *Processor =
+            (const volatile XSK_STATISTICS_PAGE_PROCESSOR *)
+                ((const UCHAR *)Info.Page + Page->ProcessorOffset +
+                    (SIZE_T)Index * Page->ProcessorStride);
+        RxFillRingEmpty += Processor->RxFillRingEmpty;
+    }
+    TEST_EQUAL(1, RxFillRingEmpty);
 }
 
 VOID
-ProgTestRunRxEbpfPayload()
+GenericXskUmemAlloc()
 {
-    auto If = FnMpIf;
-    UINT16 LocalPort = 0, RemotePort = 0;
-    ETHERNET_ADDRESS LocalHw = {}, RemoteHw = {};
-    INET_ADDR LocalIp = {}, RemoteIp = {};
-    const UCHAR UdpPayload[] = "ProgTestRunRxEbpfPayload";
-    bpf_test_run_opts Opts = {};
+    auto Xsk = CreateSocket();
+    auto SharedXsk = CreateSocket();
+    XSK_UMEM_REG UmemReg = {0};
+    VOID *Umem;
+    VOID *UmemAgain;
+    VOID *SharedUmem;
+    UINT32 OptionLength;
 
-    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\allow_ipv6.sys", "allow_ipv6");
-    fd_t ProgFd = bpf_program__fd(bpf_object__find_program_by_name(BpfObject.get(), "allow_ipv6"));
+    //
+    // XDP allocates the UMEM, so the registration must not provide an address.
+    //
+    UmemReg.TotalSize = 0x10000;
+    UmemReg.ChunkSize = 0x1000;
+    UmemReg.Address = &UmemReg;
+    TEST_FALSE(
+        SUCCEEDED(TrySetSockopt(Xsk.get(), XSK_SOCKOPT_UMEM_ALLOC, &UmemReg, sizeof(UmemReg))));
 
-    // Build a v6 packet and verify it is allowed.
-    UCHAR UdpFrameV6[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
-    UCHAR UdpFrameOutV6[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
-    UINT32 UdpFrameLength = sizeof(UdpFrameV6);
-    TEST_TRUE(
-        PktBuildUdpFrame(
-            UdpFrameV6, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
-            &RemoteHw, AF_INET6, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    //
+    // The socket has no UMEM to map.
+    //
+    OptionLength = sizeof(Umem);
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TryGetSockopt(Xsk.get(), XSK_SOCKOPT_UMEM_MAPPING, &Umem, &OptionLength));
 
-    Opts.data_in = UdpFrameV6;
-    Opts.data_size_in = sizeof(UdpFrameV6);
-    Opts.data_out = UdpFrameOutV6;
-    Opts.data_size_out = sizeof(UdpFrameOutV6);
-    Opts.ctx_in = nullptr;
-    Opts.ctx_size_in = 0;
-    Opts.ctx_out = nullptr;
-    Opts.ctx_size_out = 0;
+    UmemReg.Address = NULL;
+    SetSockopt(Xsk.get(), XSK_SOCKOPT_UMEM_ALLOC, &UmemReg, sizeof(UmemReg));
 
-    TEST_EQUAL(0, bpf_prog_test_run_opts(ProgFd, &Opts));
-    TEST_EQUAL(Opts.retval, XDP_PASS);
+    OptionLength = sizeof(Umem);
+    GetSockopt(Xsk.get(), XSK_SOCKOPT_UMEM_MAPPING, &Umem, &OptionLength);
+    TEST_EQUAL(sizeof(Umem), OptionLength);
+    TEST_NOT_NULL(Umem);
 
-    TEST_EQUAL(memcmp(UdpFrameV6, UdpFrameOutV6, sizeof(UdpFrameV6)), 0);
+    //
+    // The UMEM is mapped once per socket.
+    //
+    OptionLength = sizeof(UmemAgain);
+    GetSockopt(Xsk.get(), XSK_SOCKOPT_UMEM_MAPPING, &UmemAgain, &OptionLength);
+    TEST_EQUAL(Umem, UmemAgain);
 
-    // Build a v4 packet and verify it is dropped.
-    UCHAR UdpFrameV4[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
-    UCHAR UdpFrameOutV4[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
-    UdpFrameLength = sizeof(UdpFrameV4);
+    //
+    // Share the UMEM via a duplicated socket handle, as a process receiving the
+    // handle from the registering process would.
+    //
+    HANDLE DuplicateHandleValue;
     TEST_TRUE(
-        PktBuildUdpFrame(
-            UdpFrameV4, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
-            &RemoteHw, AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
-
-    Opts.data_in = UdpFrameV4;
-    Opts.data_size_in = sizeof(UdpFrameV4);
-    Opts.data_out = UdpFrameOutV4;
-    Opts.data_size_out = sizeof(UdpFrameOutV4);
-    Opts.ctx_in = nullptr;
-    Opts.ctx_size_in = 0;
-    Opts.ctx_out = nullptr;
-    Opts.ctx_size_out = 0;
-
-    TEST_EQUAL(0, bpf_prog_test_run_opts(ProgFd, &Opts));
-    TEST_EQUAL(Opts.retval, XDP_DROP);
-
-    TEST_EQUAL(memcmp(UdpFrameV4, UdpFrameOutV4, sizeof(UdpFrameV4)), 0);
-}
-
-VOID
-GenericRxEbpfIfIndex()
-{
-    auto If = FnMpIf;
-    unique_fnmp_handle GenericMp;
-    unique_fnlwf_handle FnLwf;
-    const UCHAR Payload[] = "GenericRxEbpfIfIndex";
-    UINT32 Zero = 0;
-
-    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\selective_drop.sys", "selective_drop");
-
-    GenericMp = MpOpenGeneric(If.GetIfIndex());
-    FnLwf = LwfOpenDefault(If.GetIfIndex());
-
-    // Get the interface_map fd.
-    fd_t interface_map_fd = bpf_object__find_map_fd_by_name(BpfObject.get(), "interface_map");
-    TEST_NOT_EQUAL(interface_map_fd, ebpf_fd_invalid);
+        DuplicateHandle(
+            GetCurrentProcess(), Xsk.get(), GetCurrentProcess(), &DuplicateHandleValue, 0,
+            FALSE, DUPLICATE_SAME_ACCESS));
+    wil::unique_handle Duplicate(DuplicateHandleValue);
+    SetSockopt(
+        SharedXsk.get(), XSK_SOCKOPT_SHARED_UMEM, &DuplicateHandleValue,
+        sizeof(DuplicateHandleValue));
 
-    // Update the interface_map with the interface index of the test interface.
-    UINT32 IfIndex = If.GetIfIndex();
-    TEST_NOT_EQUAL(IfIndex, IFI_UNSPECIFIED);
+    //
+    // Each socket sharing the UMEM maps the same frames.
+    //
+    OptionLength = sizeof(SharedUmem);
+    GetSockopt(SharedXsk.get(), XSK_SOCKOPT_UMEM_MAPPING, &SharedUmem, &OptionLength);
+    TEST_NOT_NULL(SharedUmem);
+    TEST_NOT_EQUAL(Umem, SharedUmem);
 
-    TEST_EQUAL(0, bpf_map_update_elem(interface_map_fd, &Zero, &IfIndex, BPF_ANY));
+    memset(Umem, 0x5A, (SIZE_T)UmemReg.TotalSize);
+    TEST_EQUAL(0, memcmp(Umem, SharedUmem, (SIZE_T)UmemReg.TotalSize));
 
-    std::vector<UCHAR> Mask(sizeof(Payload), 0xFF);
-    auto LwfFilter = LwfRxFilter(FnLwf, Payload, &Mask[0], sizeof(Payload));
+    //
+    // The shared UMEM remains mapped after the registering socket is closed.
+    //
+    Duplicate.reset();
+    Xsk.reset();
+    TEST_EQUAL(0x5A, ((UCHAR *)SharedUmem)[UmemReg.TotalSize - 1]);
 
-    RX_FRAME Frame;
-    RxInitializeFrame(&Frame, If.GetQueueId(), Payload, sizeof(Payload));
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    MpRxFlush(GenericMp);
+    //
+    // UMEMs registered from application memory are not mapped by XDP.
+    //
+    auto UserXsk = SetupSocket(FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+    OptionLength = sizeof(Umem);
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TryGetSockopt(UserXsk.Handle.get(), XSK_SOCKOPT_UMEM_MAPPING, &Umem, &OptionLength));
+}
 
-    Sleep(TEST_TIMEOUT_ASYNC_MS);
+VOID
+GenericXskHandoff()
+{
+    auto If = FnMpIf;
+    XSK_UMEM_REG UmemReg = {0};
+    XSK_RING_INFO_SET RingInfo;
+    XSK_RING_INFO_SET RingInfoAfter;
+    UINT32 RingSize = 32;
+    UINT32 OptionLength;
 
-    UINT32 FrameLength = 0;
-    // Packet should be dropped.
+    //
+    // Sockets with a UMEM registered from application memory are bound to the
+    // registering process.
+    //
+    auto UserXsk = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
     TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
-        LwfRxGetFrame(FnLwf, If.GetQueueId(), &FrameLength, NULL));
-
-    // Validate that the dropped_packet_map contains a non-0 entry for the IfIndex.
-    fd_t dropped_packet_map_fd = bpf_object__find_map_fd_by_name(BpfObject.get(), "dropped_packet_map");
-    TEST_NOT_EQUAL(dropped_packet_map_fd, ebpf_fd_invalid);
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(UserXsk.Handle.get(), XSK_SOCKOPT_HANDOFF, NULL, 0));
+    UserXsk.Handle.reset();
+
+    auto Xsk = CreateSocket();
+    UmemReg.TotalSize = 0x10000;
+    UmemReg.ChunkSize = 0x1000;
+    SetSockopt(Xsk.get(), XSK_SOCKOPT_UMEM_ALLOC, &UmemReg, sizeof(UmemReg));
+    SetSockopt(Xsk.get(), XSK_SOCKOPT_RX_RING_SIZE, &RingSize, sizeof(RingSize));
+    SetSockopt(Xsk.get(), XSK_SOCKOPT_RX_FILL_RING_SIZE, &RingSize, sizeof(RingSize));
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Xsk.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Xsk.get(), XSK_ACTIVATE_FLAG_NONE));
 
-    UINT64 DroppedPacketCount = 0;
-    TEST_EQUAL(0, bpf_map_lookup_elem(dropped_packet_map_fd, &Zero, &DroppedPacketCount));
-    TEST_EQUAL(DroppedPacketCount, 1);
+    OptionLength = sizeof(RingInfo);
+    GetSockopt(Xsk.get(), XSK_SOCKOPT_RING_INFO, &RingInfo, &OptionLength);
 
-    // Now set the ifIndex to some other value and verify that the packet is not dropped.
-    UINT32 OtherIfIndex = If.GetIfIndex() + 1;
-    TEST_EQUAL(0, bpf_map_update_elem(interface_map_fd, &Zero, &OtherIfIndex, BPF_ANY));
+    XSK_RING FillRing;
+    XskRingInitialize(&FillRing, &RingInfo.Fill);
+    UINT32 ProducerIndex;
+    TEST_EQUAL(RingSize, XskRingProducerReserve(&FillRing, RingSize, &ProducerIndex));
+    for (UINT32 Index = 0; Index < RingSize; Index++) {
+        *(UINT64 *)XskRingGetElement(&FillRing, ProducerIndex++) =
+            (UINT64)(Index % (UmemReg.TotalSize / UmemReg.ChunkSize)) * UmemReg.ChunkSize;
+    }
+    XskRingProducerSubmit(&FillRing, RingSize);
 
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    MpRxFlush(GenericMp);
+    //
+    // Handing a socket off to its current owner leaves its mappings in place,
+    // and the socket remains active with its rings intact.
+    //
+    SetSockopt(Xsk.get(), XSK_SOCKOPT_HANDOFF, NULL, 0);
 
-    Sleep(TEST_TIMEOUT_ASYNC_MS);
+    OptionLength = sizeof(RingInfoAfter);
+    GetSockopt(Xsk.get(), XSK_SOCKOPT_RING_INFO, &RingInfoAfter, &OptionLength);
+    TEST_EQUAL(RingInfo.Rx.Ring, RingInfoAfter.Rx.Ring);
+    TEST_EQUAL(RingInfo.Fill.Ring, RingInfoAfter.Fill.Ring);
 
-    // Packet should not be dropped.
-    TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_MORE_DATA),
-        LwfRxGetFrame(FnLwf, If.GetQueueId(), &FrameLength, NULL));
+    XSK_RING FillRingAfter;
+    XskRingInitialize(&FillRingAfter, &RingInfoAfter.Fill);
+    TEST_EQUAL(*FillRing.SharedProducer, *FillRingAfter.SharedProducer);
 }
 
 VOID
-GenericRxEbpfFragments()
+GenericXskTxWeight()
 {
     auto If = FnMpIf;
-    unique_fnmp_handle GenericMp;
-    const UINT32 Backfill = 3;
-    const UINT32 Trailer = 4;
-    const UINT32 SplitAt = 4;
-    DATA_BUFFER Buffers[2] = {};
-    const UCHAR Payload[] = "123GenericRxEbpfFragments4321";
+    UINT32 Weight;
+    UINT32 OptionLength;
 
-    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\l1fwd.sys", "l1fwd");
+    //
+    // Sockets start with the default weight, and the weight must be in range.
+    //
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
 
-    GenericMp = MpOpenGeneric(If.GetIfIndex());
+    OptionLength = sizeof(Weight);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_TX_WEIGHT, &Weight, &OptionLength);
+    TEST_EQUAL(sizeof(Weight), OptionLength);
+    TEST_EQUAL(XSK_TX_WEIGHT_DEFAULT, Weight);
 
-    Buffers[0].DataLength = SplitAt;
-    Buffers[0].DataOffset = Backfill;
-    Buffers[0].BufferLength = Backfill + SplitAt;
-    Buffers[0].VirtualAddress = Payload;
-    Buffers[1].DataLength = sizeof(Payload) - Buffers[0].BufferLength - Trailer;
-    Buffers[1].DataOffset = 0;
-    Buffers[1].BufferLength = Buffers[1].DataLength + Trailer;
-    Buffers[1].VirtualAddress = Payload + Buffers[0].BufferLength;
+    Weight = 0;
+    TEST_FALSE(
+        SUCCEEDED(
+            TrySetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_TX_WEIGHT, &Weight, sizeof(Weight))));
+    Weight = XSK_TX_WEIGHT_MAX + 1;
+    TEST_FALSE(
+        SUCCEEDED(
+            TrySetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_TX_WEIGHT, &Weight, sizeof(Weight))));
 
     //
-    // XDP-for-Windows has limited eBPF support for fragments: the first buffer
-    // is visible to eBPF programs, and the remaining fragments (if any) are
-    // inaccessible.
+    // The weight may be changed while the socket is active.
     //
-    // Actions apply to the entire frame, not just to the first fragement.
+    Weight = XSK_TX_WEIGHT_MAX;
+    SetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_TX_WEIGHT, &Weight, sizeof(Weight));
+    Weight = 0;
+    OptionLength = sizeof(Weight);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_TX_WEIGHT, &Weight, &OptionLength);
+    TEST_EQUAL(XSK_TX_WEIGHT_MAX, Weight);
+
     //
-    std::vector<UCHAR> Mask((SIZE_T)Buffers[0].DataLength + Buffers[1].DataLength, 0xFF);
-    auto MpFilter = MpTxFilter(GenericMp, Payload + Backfill, &Mask[0], (ULONG)Mask.size());
+    // Verify transmitted frames are counted against the socket.
+    //
+    UINT64 Pattern = 0x8A2C03B5E451F7D9ui64;
+    UINT64 Mask = ~0ui64;
+    auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
 
-    RX_FRAME Frame;
-    RxInitializeFrame(&Frame, If.GetQueueId(), Buffers, RTL_NUMBER_OF(Buffers));
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    MpRxFlush(GenericMp);
+    UINT64 TxBuffer = SocketFreePop(&Xsk);
+    UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
+    RtlCopyMemory(TxFrame, &Pattern, sizeof(Pattern));
 
-    MpTxAllocateAndGetFrame(GenericMp, If.GetQueueId());
-    MpTxDequeueFrame(GenericMp, If.GetQueueId());
+    UINT32 ProducerIndex;
+    TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+
+    XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+    TxDesc->Address.BaseAddress = TxBuffer;
+    TxDesc->Address.Offset = 0;
+    TxDesc->Length = sizeof(Pattern);
+    XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+
+    MpTxAllocateAndGetFrame(GenericMp, 0);
+    MpTxDequeueFrame(GenericMp, 0);
     MpTxFlush(GenericMp);
+    SocketConsumerReserve(&Xsk.Rings.Completion, 1);
+
+    XSK_STATISTICS_EX Stats;
+    OptionLength = sizeof(Stats);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS_EX, &Stats, &OptionLength);
+    TEST_EQUAL(XSK_STATISTICS_EX_REVISION_2, Stats.Header.Revision);
+    TEST_EQUAL(1, Stats.TxFramesScheduled);
 }
 
 VOID
-GenericRxEbpfUnload()
+GenericXskTxRateLimit()
 {
     auto If = FnMpIf;
+    MY_SOCKET Xsk;
+    XSK_TX_RATE_LIMIT RateLimit = {0};
+    UINT32 OptionLength;
+    UINT32 FrameBufferLength;
 
-    unique_bpf_object BpfObject = AttachEbpfXdpProgram(If, "\\bpf\\pass.sys", "pass");
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
 
-    TEST_HRESULT(TryStopService(XDP_SERVICE_NAME));
-    TEST_HRESULT(TryStartService(XDP_SERVICE_NAME));
-}
+    Xsk.Handle = CreateSocket();
+    XskSetupPreBind(&Xsk, FALSE, TRUE);
 
-VOID
-GenericTxToRxInject()
-{
-    auto If = FnMpIf;
-    UINT16 LocalPort, RemotePort;
-    ETHERNET_ADDRESS LocalHw, RemoteHw;
-    INET_ADDR LocalIp, RemoteIp;
-    XDP_HOOK_ID TxInjectToRxL2 = {};
+    //
+    // Sockets are not paced by default.
+    //
+    OptionLength = sizeof(RateLimit);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_TX_RATE_LIMIT, &RateLimit, &OptionLength);
+    TEST_EQUAL(sizeof(RateLimit), OptionLength);
+    TEST_EQUAL(0, RateLimit.BitsPerSecond);
+    TEST_EQUAL(0, RateLimit.FramesPerSecond);
 
-    TxInjectToRxL2.Layer = XDP_HOOK_L2;
-    TxInjectToRxL2.Direction = XDP_HOOK_RX;
-    TxInjectToRxL2.SubLayer = XDP_HOOK_INJECT;
+    RateLimit.FramesPerSecond = 4;
+    RateLimit.BurstMs = XSK_TX_RATE_LIMIT_BURST_MS_MAX + 1;
+    TEST_FALSE(
+        SUCCEEDED(
+            TrySetSockopt(
+                Xsk.Handle.get(), XSK_SOCKOPT_TX_RATE_LIMIT, &RateLimit, sizeof(RateLimit))));
 
-    auto UdpSocket = CreateUdpSocket(AF_INET, &If, &LocalPort);
-    auto Xsk =
-        CreateAndBindSocket(
-            If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_UNSPEC, XSK_BIND_FLAG_NONE, nullptr,
-            &TxInjectToRxL2);
+    //
+    // Allow four frames per second, with a burst of a single frame.
+    //
+    RateLimit.BurstMs = 0;
+    SetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_TX_RATE_LIMIT, &RateLimit, sizeof(RateLimit));
+    RtlZeroMemory(&RateLimit, sizeof(RateLimit));
+    OptionLength = sizeof(RateLimit);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_TX_RATE_LIMIT, &RateLimit, &OptionLength);
+    TEST_EQUAL(4, RateLimit.FramesPerSecond);
+    TEST_EQUAL(XSK_TX_RATE_LIMIT_BURST_MS_DEFAULT, RateLimit.BurstMs);
 
-    RemotePort = htons(1234);
-    If.GetHwAddress(&LocalHw);
-    If.GetRemoteHwAddress(&RemoteHw);
-    If.GetIpv4Address(&LocalIp.Ipv4);
-    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Xsk.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_TX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Xsk.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    XskSetupPostBind(&Xsk, FALSE, TRUE);
 
-    UINT16 FrameOffset = 16;
-    UCHAR UdpPayload[] = "GenericTxToRxInject";
-    CHAR RecvPayload[sizeof(UdpPayload)];
-    UINT64 TxBuffer = SocketFreePop(&Xsk);
-    UCHAR *UdpFrame = Xsk.Umem.Buffer.get() + TxBuffer + FrameOffset;
-    UINT32 UdpFrameLength = Xsk.Umem.Reg.ChunkSize - FrameOffset;
-    TEST_TRUE(
-        PktBuildUdpFrame(
-            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
-            &RemoteHw, AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    //
+    // The rate limit cannot be changed once the socket is activated.
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(
+            Xsk.Handle.get(), XSK_SOCKOPT_TX_RATE_LIMIT, &RateLimit, sizeof(RateLimit)));
+
+    UINT64 Pattern = 0x5D1F3A9C7E2B4086ui64;
+    UINT64 Mask = ~0ui64;
+    auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
 
     UINT32 ProducerIndex;
-    TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+    TEST_EQUAL(2, XskRingProducerReserve(&Xsk.Rings.Tx, 2, &ProducerIndex));
 
-    XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
-    TxDesc->Address.BaseAddress = TxBuffer;
-    TxDesc->Address.Offset = FrameOffset;
-    TxDesc->Length = UdpFrameLength;
-    XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+    for (UINT32 Index = 0; Index < 2; Index++) {
+        UINT64 TxBuffer = SocketFreePop(&Xsk);
+        RtlCopyMemory(Xsk.Umem.Buffer.get() + TxBuffer, &Pattern, sizeof(Pattern));
+
+        XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+        TxDesc->Address.BaseAddress = TxBuffer;
+        TxDesc->Address.Offset = 0;
+        TxDesc->Length = sizeof(Pattern);
+    }
+    XskRingProducerSubmit(&Xsk.Rings.Tx, 2);
 
     XSK_NOTIFY_RESULT_FLAGS NotifyResult;
     NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
     TEST_EQUAL(0, NotifyResult);
 
+    //
+    // The bucket admits the first frame immediately and holds back the second
+    // until the pacing interval has elapsed.
+    //
+    MpTxAllocateAndGetFrame(GenericMp, 0);
+    FrameBufferLength = 0;
     TEST_EQUAL(
-        sizeof(UdpPayload),
-        FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+        MpTxGetFrame(GenericMp, 1, &FrameBufferLength, NULL));
+
+    MpTxAllocateAndGetFrame(GenericMp, 1);
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxFlush(GenericMp);
+    SocketConsumerReserve(&Xsk.Rings.Completion, 2);
 }
 
 VOID
-GenericTxSingleFrame()
+GenericXskTxLaunchTime()
 {
     auto If = FnMpIf;
-    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
+    MY_SOCKET Xsk;
+    BOOLEAN LaunchTime = TRUE;
+    UINT32 OptionLength;
+    UINT32 FrameBufferLength;
+    LARGE_INTEGER FrequencyQpc;
+    LARGE_INTEGER CurrentQpc;
+
     auto GenericMp = MpOpenGeneric(If.GetIfIndex());
 
-    UINT64 Pattern = 0xA5CC7729CE99C16Aui64;
-    UINT64 Mask = ~0ui64;
+    Xsk.Handle = CreateSocket();
+    XskSetupPreBind(&Xsk, FALSE, TRUE);
+    SetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_TX_LAUNCH_TIME, &LaunchTime, sizeof(LaunchTime));
+
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Xsk.Handle.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_TX | XSK_BIND_FLAG_GENERIC));
+    TEST_HRESULT(XdpApi->XskActivate(Xsk.Handle.get(), XSK_ACTIVATE_FLAG_NONE));
+    XskSetupPostBind(&Xsk, FALSE, TRUE);
+
+    LaunchTime = FALSE;
+    OptionLength = sizeof(LaunchTime);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_TX_LAUNCH_TIME, &LaunchTime, &OptionLength);
+    TEST_EQUAL(sizeof(LaunchTime), OptionLength);
+    TEST_TRUE(LaunchTime);
+
+    //
+    // Launch times cannot be toggled once the socket is activated.
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(
+            Xsk.Handle.get(), XSK_SOCKOPT_TX_LAUNCH_TIME, &LaunchTime, sizeof(LaunchTime)));
 
+    UINT64 Pattern = 0x93E6B0174C2AD85Fui64;
+    UINT64 Mask = ~0ui64;
     auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
 
-    UINT16 FrameOffset = 13;
-    UCHAR Payload[] = "GenericTxSingleFrame";
-    UINT64 TxBuffer = SocketFreePop(&Xsk);
-    UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer + FrameOffset;
-    UINT32 TxFrameLength = sizeof(Pattern) + sizeof(Payload);
-    ASSERT(FrameOffset + TxFrameLength <= Xsk.Umem.Reg.ChunkSize);
+    //
+    // Stamp the frame to launch a quarter second from now; the launch time is
+    // stored in front of the frame data.
+    //
+    TEST_TRUE(QueryPerformanceFrequency(&FrequencyQpc));
+    TEST_TRUE(QueryPerformanceCounter(&CurrentQpc));
 
-    RtlCopyMemory(TxFrame, &Pattern, sizeof(Pattern));
-    RtlCopyMemory(TxFrame + sizeof(Pattern), Payload, sizeof(Payload));
+    UINT64 TxBuffer = SocketFreePop(&Xsk);
+    UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
+    *(UINT64 UNALIGNED *)TxFrame = CurrentQpc.QuadPart + FrequencyQpc.QuadPart / 4;
+    RtlCopyMemory(TxFrame + sizeof(UINT64), &Pattern, sizeof(Pattern));
 
     UINT32 ProducerIndex;
     TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
 
     XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
     TxDesc->Address.BaseAddress = TxBuffer;
-    TxDesc->Address.Offset = FrameOffset;
-    TxDesc->Length = TxFrameLength;
+    TxDesc->Address.Offset = sizeof(UINT64);
+    TxDesc->Length = sizeof(Pattern);
     XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
 
     XSK_NOTIFY_RESULT_FLAGS NotifyResult;
     NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
     TEST_EQUAL(0, NotifyResult);
 
-    auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
-    TEST_EQUAL(1, MpTxFrame->BufferCount);
-
-    const DATA_BUFFER *MpTxBuffer = &MpTxFrame->Buffers[0];
-    TEST_EQUAL(TxFrameLength, MpTxBuffer->BufferLength);
-#pragma warning(push)
-#pragma warning(disable:6385)  // Reading invalid data from 'TxFrame':  the readable size is '_Old_10`8' bytes, but '29' bytes may be read.
-    TEST_TRUE(
-        RtlEqualMemory(
-            TxFrame, MpTxBuffer->VirtualAddress + MpTxBuffer->DataOffset,
-            TxFrameLength));
-#pragma warning(pop)
+    //
+    // The frame is held until its launch time, then transmitted without
+    // another poke.
+    //
+    FrameBufferLength = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+        MpTxGetFrame(GenericMp, 0, &FrameBufferLength, NULL));
 
+    MpTxAllocateAndGetFrame(GenericMp, 0);
     MpTxDequeueFrame(GenericMp, 0);
     MpTxFlush(GenericMp);
+    SocketConsumerReserve(&Xsk.Rings.Completion, 1);
+}
 
-    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 1);
-    TEST_EQUAL(TxBuffer, SocketGetTxCompDesc(&Xsk, ConsumerIndex));
+VOID
+GenericXskLargePages()
+{
+    MY_SOCKET Xsk;
+    BOOLEAN LargePages = TRUE;
+    UINT32 OptionLength;
+
+    Xsk.Handle = CreateSocket();
+
+    OptionLength = sizeof(LargePages);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_LARGE_PAGES, &LargePages, &OptionLength);
+    TEST_EQUAL(sizeof(LargePages), OptionLength);
+    TEST_FALSE(LargePages);
+
+    LargePages = TRUE;
+    SetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_LARGE_PAGES, &LargePages, sizeof(LargePages));
+
+    LargePages = FALSE;
+    OptionLength = sizeof(LargePages);
+    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_LARGE_PAGES, &LargePages, &OptionLength);
+    TEST_EQUAL(sizeof(LargePages), OptionLength);
+    TEST_TRUE(LargePages);
+
+    //
+    // A UMEM backed by small pages is rejected.
+    //
+    Xsk.Umem.Buffer = AllocUmemBuffer();
+    InitUmem(&Xsk.Umem.Reg, Xsk.Umem.Buffer.get());
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TrySetSockopt(
+            Xsk.Handle.get(), XSK_SOCKOPT_UMEM_REG, &Xsk.Umem.Reg, sizeof(Xsk.Umem.Reg)));
+
+    //
+    // Large pages cannot be toggled once the UMEM is registered.
+    //
+    LargePages = FALSE;
+    SetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_LARGE_PAGES, &LargePages, sizeof(LargePages));
+    SetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_UMEM_REG, &Xsk.Umem.Reg, sizeof(Xsk.Umem.Reg));
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(
+            Xsk.Handle.get(), XSK_SOCKOPT_LARGE_PAGES, &LargePages, sizeof(LargePages)));
 }
 
 VOID
-GenericTxOutOfOrder()
+GenericXskModeFailover()
 {
     auto If = FnMpIf;
-    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
-    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    wil::unique_handle Socket = CreateSocket();
+    BOOLEAN Enabled = TRUE;
+    UINT32 OptionLength;
 
-    UINT64 Pattern = 0x2865A18EE4DB02F0ui64;
-    UINT64 Mask = ~0ui64;
+    OptionLength = sizeof(Enabled);
+    GetSockopt(Socket.get(), XSK_SOCKOPT_MODE_FAILOVER, &Enabled, &OptionLength);
+    TEST_EQUAL(sizeof(Enabled), OptionLength);
+    TEST_FALSE(Enabled);
 
-    auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
+    Enabled = TRUE;
+    SetSockopt(Socket.get(), XSK_SOCKOPT_MODE_FAILOVER, &Enabled, sizeof(Enabled));
 
-    UINT16 FrameOffset = 13;
-    UCHAR Payload[] = "GenericTxOutOfOrder";
-    UINT64 TxBuffer0 = SocketFreePop(&Xsk);
-    UINT64 TxBuffer1 = SocketFreePop(&Xsk);
-    UCHAR *TxFrame0 = Xsk.Umem.Buffer.get() + TxBuffer0 + FrameOffset;
-    UCHAR *TxFrame1 = Xsk.Umem.Buffer.get() + TxBuffer1 + FrameOffset;
-    UINT32 TxFrameLength = sizeof(Pattern) + sizeof(Payload);
-    ASSERT(FrameOffset + TxFrameLength <= Xsk.Umem.Reg.ChunkSize);
+    Enabled = FALSE;
+    OptionLength = sizeof(Enabled);
+    GetSockopt(Socket.get(), XSK_SOCKOPT_MODE_FAILOVER, &Enabled, &OptionLength);
+    TEST_EQUAL(sizeof(Enabled), OptionLength);
+    TEST_TRUE(Enabled);
 
-    RtlCopyMemory(TxFrame0, &Pattern, sizeof(Pattern));
-    RtlCopyMemory(TxFrame1, &Pattern, sizeof(Pattern));
-    RtlCopyMemory(TxFrame0 + sizeof(Pattern), Payload, sizeof(Payload));
-    RtlCopyMemory(TxFrame1 + sizeof(Pattern), Payload, sizeof(Payload));
+    //
+    // Failover cannot be toggled once the socket is bound.
+    //
+    TEST_HRESULT(
+        XdpApi->XskBind(
+            Socket.get(), If.GetIfIndex(), If.GetQueueId(),
+            XSK_BIND_FLAG_RX | XSK_BIND_FLAG_GENERIC));
+    Enabled = FALSE;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(Socket.get(), XSK_SOCKOPT_MODE_FAILOVER, &Enabled, sizeof(Enabled)));
+}
+
+VOID
+GenericXskTxCompletionInOrder()
+{
+    auto If = FnMpIf;
+    wil::unique_handle Socket = CreateSocket();
+    BOOLEAN InOrder = TRUE;
+    UINT32 OptionLength;
 
-    UINT32 ProducerIndex;
-    TEST_EQUAL(2, XskRingProducerReserve(&Xsk.Rings.Tx, 2, &ProducerIndex));
+    OptionLength = sizeof(InOrder);
+    GetSockopt(Socket.get(), XSK_SOCKOPT_TX_COMPLETION_IN_ORDER, &InOrder, &OptionLength);
+    TEST_EQUAL(sizeof(InOrder), OptionLength);
+    TEST_FALSE(InOrder);
 
-    XSK_BUFFER_DESCRIPTOR *TxDesc0 = SocketGetTxDesc(&Xsk, ProducerIndex++);
-    TxDesc0->Address.BaseAddress = TxBuffer0;
-    TxDesc0->Address.Offset = FrameOffset;
-    TxDesc0->Length = TxFrameLength;
-    XSK_BUFFER_DESCRIPTOR *TxDesc1 = SocketGetTxDesc(&Xsk, ProducerIndex++);
-    TxDesc1->Address.BaseAddress = TxBuffer1;
-    TxDesc1->Address.Offset = FrameOffset;
-    TxDesc1->Length = TxFrameLength;
+    InOrder = TRUE;
+    SetSockopt(Socket.get(), XSK_SOCKOPT_TX_COMPLETION_IN_ORDER, &InOrder, sizeof(InOrder));
 
-    XskRingProducerSubmit(&Xsk.Rings.Tx, 2);
+    InOrder = FALSE;
+    OptionLength = sizeof(InOrder);
+    GetSockopt(Socket.get(), XSK_SOCKOPT_TX_COMPLETION_IN_ORDER, &InOrder, &OptionLength);
+    TEST_EQUAL(sizeof(InOrder), OptionLength);
+    TEST_TRUE(InOrder);
 
-    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
-    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
-    TEST_EQUAL(0, NotifyResult);
+    //
+    // The option cannot be changed once the socket is active.
+    //
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TrySetSockopt(
+            Xsk.Handle.get(), XSK_SOCKOPT_TX_COMPLETION_IN_ORDER, &InOrder, sizeof(InOrder)));
+}
 
-    MpTxDequeueFrame(GenericMp, 1);
-    MpTxFlush(GenericMp);
+VOID
+GenericXskMemoryUsage()
+{
+    wil::unique_handle Socket = CreateSocket();
+    XSK_MEMORY_USAGE Usage;
+    XSK_MEMORY_USAGE InitialUsage;
+    UINT32 OptionLength;
 
-    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 1);
-    TEST_EQUAL(TxBuffer1, SocketGetTxCompDesc(&Xsk, ConsumerIndex));
-    XskRingConsumerRelease(&Xsk.Rings.Completion, 1);
+    OptionLength = sizeof(InitialUsage);
+    GetSockopt(Socket.get(), XSK_SOCKOPT_MEMORY_USAGE, &InitialUsage, &OptionLength);
+    TEST_EQUAL(sizeof(InitialUsage), OptionLength);
+    TEST_EQUAL(0, InitialUsage.RingBytes);
+    TEST_EQUAL(0, InitialUsage.BounceBytes);
+    TEST_EQUAL(0, InitialUsage.OtherBytes);
 
-    MpTxDequeueFrame(GenericMp, 0);
-    MpTxFlush(GenericMp);
+    //
+    // Rings are charged to the socket and its process once allocated.
+    //
+    SetRxRing(Socket.get());
+    SetCompletionRing(Socket.get());
 
-    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 1);
-    TEST_EQUAL(TxBuffer0, SocketGetTxCompDesc(&Xsk, ConsumerIndex));
+    OptionLength = sizeof(Usage);
+    GetSockopt(Socket.get(), XSK_SOCKOPT_MEMORY_USAGE, &Usage, &OptionLength);
+    TEST_EQUAL(sizeof(Usage), OptionLength);
+    TEST_TRUE(
+        Usage.RingBytes >=
+            DEFAULT_RING_SIZE * (sizeof(XSK_FRAME_DESCRIPTOR) + sizeof(UINT64)));
+    TEST_EQUAL(0, Usage.BounceBytes);
+    TEST_EQUAL(InitialUsage.ProcessBytes + Usage.RingBytes, Usage.ProcessBytes);
+    TEST_EQUAL(InitialUsage.ProcessLimitBytes, Usage.ProcessLimitBytes);
+
+    OptionLength = sizeof(Usage) - 1;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER),
+        TryGetSockopt(Socket.get(), XSK_SOCKOPT_MEMORY_USAGE, &Usage, &OptionLength));
 }
 
 VOID
-GenericTxSharing()
+GenericXskRingOccupancy()
 {
     auto If = FnMpIf;
+    auto Socket = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
     auto GenericMp = MpOpenGeneric(If.GetIfIndex());
-    MY_SOCKET Sockets[4] = {};
-
-    for (UINT32 i = 0; i < RTL_NUMBER_OF(Sockets); i++) {
-        Sockets[i] =
-            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
-    }
-
-    for (UINT32 i = 0; i < RTL_NUMBER_OF(Sockets); i++) {
-        auto &Xsk = Sockets[i];
-        UINT64 Pattern = 0xA5CC7729CE99C16Aui64 + i;
-        UINT64 Mask = ~0ui64;
+    XSK_RING_OCCUPANCY Occupancy;
+    UINT32 OptionLength;
+
+    OptionLength = sizeof(Occupancy);
+    GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_RING_OCCUPANCY, &Occupancy, &OptionLength);
+    TEST_EQUAL(sizeof(Occupancy), OptionLength);
+    TEST_EQUAL(DEFAULT_RING_SIZE, Occupancy.Rx.Size);
+    TEST_EQUAL(DEFAULT_RING_SIZE, Occupancy.RxFill.Size);
+    TEST_EQUAL(0, Occupancy.Tx.Size);
+    TEST_EQUAL(0, Occupancy.Tx.RecommendedSize);
+    TEST_EQUAL(0, Occupancy.TxCompletion.Size);
+    TEST_EQUAL(0, Occupancy.RxPriority.Size);
 
-        auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
-
-        UINT16 FrameOffset = 13;
-        UCHAR Payload[] = "GenericTxSharing";
-        UINT64 TxBuffer = SocketFreePop(&Xsk);
-        UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer + FrameOffset;
-        UINT32 TxFrameLength = sizeof(Pattern) + sizeof(Payload);
-        ASSERT(FrameOffset + TxFrameLength <= Xsk.Umem.Reg.ChunkSize);
+    DATA_BUFFER Buffer = {0};
+    const UCHAR BufferVa[] = "GenericXskRingOccupancy";
+    Buffer.DataLength = sizeof(BufferVa);
+    Buffer.BufferLength = Buffer.DataLength;
+    Buffer.VirtualAddress = BufferVa;
 
-        RtlCopyMemory(TxFrame, &Pattern, sizeof(Pattern));
-        RtlCopyMemory(TxFrame + sizeof(Pattern), Payload, sizeof(Payload));
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), &Buffer);
 
-        UINT32 ProducerIndex;
-        TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+    //
+    // Fill the RX ring without releasing any of its descriptors.
+    //
+    SocketProduceRxFill(&Socket, DEFAULT_RING_SIZE);
+    for (UINT32 Index = 0; Index < DEFAULT_RING_SIZE; Index++) {
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    }
 
-        XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
-        TxDesc->Address.BaseAddress = TxBuffer;
-        TxDesc->Address.Offset = FrameOffset;
-        TxDesc->Length = TxFrameLength;
-        XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, DEFAULT_RING_SIZE);
 
-        XSK_NOTIFY_RESULT_FLAGS NotifyResult;
-        NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
-        TEST_EQUAL(0, NotifyResult);
+    //
+    // Recycle the frames' buffers through the fill ring, but leave the RX ring
+    // full, so the next frame overflows it.
+    //
+    for (UINT32 Index = 0; Index < DEFAULT_RING_SIZE; Index++) {
+        SocketGetAndFreeRxDesc(&Socket, ConsumerIndex + Index);
+    }
 
-        auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
-        TEST_EQUAL(1, MpTxFrame->BufferCount);
+    SocketProduceRxFill(&Socket, 1);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-        const DATA_BUFFER *MpTxBuffer = &MpTxFrame->Buffers[0];
-        TEST_EQUAL(TxFrameLength, MpTxBuffer->BufferLength);
-#pragma warning(push)
-#pragma warning(disable:6385)  // Reading invalid data from 'TxFrame':  the readable size is '_Old_10`8' bytes, but '29' bytes may be read.
-        TEST_TRUE(
-            RtlEqualMemory(
-                TxFrame, MpTxBuffer->VirtualAddress + MpTxBuffer->DataOffset,
-                TxFrameLength));
-#pragma warning(pop)
+    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+    do {
+        OptionLength = sizeof(Occupancy);
+        GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_RING_OCCUPANCY, &Occupancy, &OptionLength);
+        if (Occupancy.Rx.HighWater == DEFAULT_RING_SIZE) {
+            break;
+        }
+    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
 
-        MpTxDequeueFrame(GenericMp, 0);
-        MpTxFlush(GenericMp);
+    //
+    // An overflowed RX ring is recommended to double, and the fill ring to
+    // match the RX ring.
+    //
+    TEST_EQUAL(DEFAULT_RING_SIZE, Occupancy.Rx.HighWater);
+    TEST_EQUAL(DEFAULT_RING_SIZE * 2, Occupancy.Rx.RecommendedSize);
+    TEST_EQUAL(Occupancy.Rx.RecommendedSize, Occupancy.RxFill.RecommendedSize);
 
-        UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 1);
-        TEST_EQUAL(TxBuffer, SocketGetTxCompDesc(&Xsk, ConsumerIndex));
-    }
+    OptionLength = sizeof(Occupancy) - 1;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER),
+        TryGetSockopt(
+            Socket.Handle.get(), XSK_SOCKOPT_RING_OCCUPANCY, &Occupancy, &OptionLength));
 }
 
 VOID
-GenericTxPoke()
+GenericLwfDelayDetach(
+    _In_ BOOLEAN Rx,
+    _In_ BOOLEAN Tx
+    )
 {
-    auto If = FnMpIf;
-    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
-    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    const CHAR *DelayDetachTimeoutRegName = "GenericDelayDetachTimeoutSec";
 
-    UINT64 Pattern = 0x4FA3DF603CC44911ui64;
-    UINT64 Mask = ~0ui64;
+    //
+    // Configure the LWF delay detach timeout.
+    //
+    wil::unique_hkey XdpParametersKey;
+    DWORD DelayTimeoutMs;
+    DWORD DelayTimeoutSec;
+    TEST_EQUAL(
+        ERROR_SUCCESS,
+        RegCreateKeyExA(
+            HKEY_LOCAL_MACHINE,
+            "System\\CurrentControlSet\\Services\\Xdp\\Parameters",
+            0, NULL, REG_OPTION_VOLATILE, KEY_WRITE, NULL, &XdpParametersKey, NULL));
 
-    auto MpFilter = MpTxFilter(GenericMp, &Pattern, &Mask, sizeof(Pattern));
+    //
+    // Setup a generic socket to attach the LWF datapath, then close the socket
+    // to trigger LWF datapath detach. Verify LWF datapath detach timestamp by
+    // using XDPFNMP miniport pause timestamp as an approximation.
+    //
 
-    UINT16 FrameOffset = 13;
-    UCHAR Payload[] = "GenericTxPoke";
-    UINT64 TxBuffer = SocketFreePop(&Xsk);
-    UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer + FrameOffset;
-    UINT32 TxFrameLength = sizeof(Pattern) + sizeof(Payload);
-    ASSERT(FrameOffset + TxFrameLength <= Xsk.Umem.Reg.ChunkSize);
+    //
+    // Verify LWF datapath detach delay does not impact LWF detach.
+    //
 
-    RtlCopyMemory(TxFrame, &Pattern, sizeof(Pattern));
-    RtlCopyMemory(TxFrame + sizeof(Pattern), Payload, sizeof(Payload));
+    DelayTimeoutMs = 5 * (DWORD)std::chrono::milliseconds(MP_RESTART_TIMEOUT).count();
+    DelayTimeoutSec = DelayTimeoutMs / 1000;
+    TEST_EQUAL(
+        ERROR_SUCCESS,
+        RegSetValueExA(
+            XdpParametersKey.get(),
+            DelayDetachTimeoutRegName,
+            0, REG_DWORD, (BYTE *)&DelayTimeoutSec, sizeof(DelayTimeoutSec)));
+    auto RegValueScopeGuard = wil::scope_exit([&]
+    {
+        //
+        // Remove the registry key and restart the NDIS filter stack: the
+        // delayed detach parameter does not reliably take effect until each
+        // data path is fully detached. The only way to assure this (without
+        // restarting XDP itself) is to restart the filter stack.
+        //
+        TEST_EQUAL(
+            ERROR_SUCCESS,
+            RegDeleteValueA(XdpParametersKey.get(), DelayDetachTimeoutRegName));
+        Sleep(TEST_TIMEOUT_ASYNC_MS); // Give time for the reg change notification to occur.
+        FnMpIf.Restart();
+    });
+    Sleep(TEST_TIMEOUT_ASYNC_MS); // Give time for the reg change notification to occur.
 
-    UINT32 ProducerIndex;
-    TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+    FnMpIf.Restart();
+    {
+        auto Xsk = SetupSocket(FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), Rx, Tx, XDP_GENERIC);
+    }
+    Stopwatch<std::chrono::milliseconds> Timer(MP_RESTART_TIMEOUT);
+    FnMpIf.Restart();
+    TEST_FALSE(Timer.IsExpired());
 
-    XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
-    TxDesc->Address.BaseAddress = TxBuffer;
-    TxDesc->Address.Offset = FrameOffset;
-    TxDesc->Length = TxFrameLength;
+    //
+    // Verify LWF detach occurs at the expected time by observing FNMP pause events.
+    //
 
-    TEST_TRUE(XskRingProducerNeedPoke(&Xsk.Rings.Tx));
-    XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+    DelayTimeoutMs = TEST_TIMEOUT_ASYNC_MS * 3;
+    DelayTimeoutSec = DelayTimeoutMs / 1000;
+    TEST_EQUAL(
+        ERROR_SUCCESS,
+        RegSetValueExA(
+            XdpParametersKey.get(),
+            DelayDetachTimeoutRegName,
+            0, REG_DWORD, (BYTE *)&DelayTimeoutSec, sizeof(DelayTimeoutSec)));
+    Sleep(TEST_TIMEOUT_ASYNC_MS); // Give time for the reg change notification to occur.
 
-    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
-    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
-    TEST_EQUAL(0, NotifyResult);
+    FnMpIf.Restart();
+    auto GenericMp = MpOpenGeneric(FnMpIf.GetIfIndex());
+    LARGE_INTEGER LowerBoundTime;
+    LARGE_INTEGER UpperBoundTime;
+    LARGE_INTEGER LastMpPauseTime;
+    LARGE_INTEGER SocketClosureTime;
 
     //
-    // While NBLs are pending in the miniport, XSKs should not require TX pokes.
+    // Simple case: close socket, wait for delay.
     //
-    MpTxAllocateAndGetFrame(GenericMp, 0);
-    TEST_FALSE(XskRingProducerNeedPoke(&Xsk.Rings.Tx));
+    // 0s                                  -> close socket
+    // DelayTimeoutMs - TEST_TIMEOUT_ASYNC_MS   -> lower bound
+    // DelayTimeoutMs                      -> expected datapath detach
+    // DelayTimeoutMs + TEST_TIMEOUT_ASYNC_MS   -> upper bound
+    //
+    {
+        auto Xsk = SetupSocket(FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), Rx, Tx, XDP_GENERIC);
+        QueryPerformanceCounter(&SocketClosureTime);
+    }
+    Sleep(DelayTimeoutMs - TEST_TIMEOUT_ASYNC_MS);
+    LastMpPauseTime = MpGetLastMiniportPauseTimestamp(GenericMp);
+    TEST_TRUE(LastMpPauseTime.QuadPart < SocketClosureTime.QuadPart);
+    QueryPerformanceCounter(&LowerBoundTime);
+    Sleep(TEST_TIMEOUT_ASYNC_MS * 2);
+    QueryPerformanceCounter(&UpperBoundTime);
 
-    MpTxDequeueFrame(GenericMp, 0);
-    MpTxFlush(GenericMp);
+    LastMpPauseTime = MpGetLastMiniportPauseTimestamp(GenericMp);
+    TEST_TRUE(LastMpPauseTime.QuadPart > LowerBoundTime.QuadPart);
+    TEST_TRUE(LastMpPauseTime.QuadPart < UpperBoundTime.QuadPart);
 
     //
-    // XSKs require TX pokes when no sends are outstanding.
+    // Reset case: close socket, open and close another socket, wait for delay.
     //
-    SocketConsumerReserve(&Xsk.Rings.Completion, 1);
-    SocketProducerCheckNeedPoke(&Xsk.Rings.Tx, TRUE);
+    // 0s                                   -> close socket
+    // DelayTimeoutMs - TEST_TIMEOUT_ASYNC_MS    -> close another socket
+    // DelayTimeoutMs + TEST_TIMEOUT_ASYNC_MS    -> lower bound
+    // 2*DelayTimeoutMs - TEST_TIMEOUT_ASYNC_MS  -> expected datapath detach
+    // 2*DelayTimeoutMs                     -> upper bound
+    //
+    {
+        auto Xsk = SetupSocket(FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), Rx, Tx, XDP_GENERIC);
+        QueryPerformanceCounter(&SocketClosureTime);
+    }
+    Sleep(DelayTimeoutMs - TEST_TIMEOUT_ASYNC_MS);
+    {
+        auto Xsk = SetupSocket(FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), Rx, Tx, XDP_GENERIC);
+    }
+    Sleep(TEST_TIMEOUT_ASYNC_MS * 2);
+    LastMpPauseTime = MpGetLastMiniportPauseTimestamp(GenericMp);
+    TEST_TRUE(LastMpPauseTime.QuadPart < SocketClosureTime.QuadPart);
+    QueryPerformanceCounter(&LowerBoundTime);
+    Sleep(TEST_TIMEOUT_ASYNC_MS * 2);
+    QueryPerformanceCounter(&UpperBoundTime);
+
+    LastMpPauseTime = MpGetLastMiniportPauseTimestamp(GenericMp);
+    TEST_TRUE(LastMpPauseTime.QuadPart > LowerBoundTime.QuadPart);
+    TEST_TRUE(LastMpPauseTime.QuadPart < UpperBoundTime.QuadPart);
 }
 
 VOID
-GenericTxMtu()
+GenericLoopback(
+    _In_ ADDRESS_FAMILY Af
+    )
 {
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    SOCKADDR_INET LocalSockAddr = {0};
+
     auto If = FnMpIf;
-    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
-    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
-    auto MtuScopeGuard = wil::scope_exit([&]
-    {
-        MpSetMtu(GenericMp, FNMP_DEFAULT_MTU);
-        //
-        // Wait for the MTU changes to quiesce, which may involve a complete NDIS
-        // rebind for filters and protocols.
-        //
-        Sleep(TEST_TIMEOUT_ASYNC_MS);
-        WaitForWfpQuarantine(If);
-    });
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, TRUE, XDP_GENERIC);
+    SocketProduceRxFill(&Xsk, 1);
 
-    const UINT32 TestMtu = 2048;
-    C_ASSERT(TestMtu != FNMP_DEFAULT_MTU);
-    C_ASSERT(TestMtu < DEFAULT_UMEM_CHUNK_SIZE);
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
 
-    MpSetMtu(GenericMp, TestMtu);
+    RemotePort = htons(4321);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    LocalSockAddr.si_family = Af;
 
-    //
-    // The XSK TX path should be torn down after an MTU change.
-    //
-    Stopwatch<std::chrono::milliseconds> Watchdog(MP_RESTART_TIMEOUT);
-    do {
-        if (XskRingError(&Xsk.Rings.Tx)) {
-            break;
-        }
-    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
-    TEST_TRUE(XskRingError(&Xsk.Rings.Tx));
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+        LocalSockAddr.Ipv4.sin_addr = LocalIp.Ipv4;
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+        LocalSockAddr.Ipv6.sin6_addr = LocalIp.Ipv6;
+    }
+
+    XDP_RULE Rule;
+    Rule.Match = XDP_MATCH_ALL;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Redirect.Target = Xsk.Handle.get();
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    unique_fnsock RawSocket;
+    TEST_HRESULT(FnSockCreate(Af, SOCK_RAW, IPPROTO_IP, &RawSocket));
+    TEST_NOT_NULL(RawSocket.get());
+
+    TEST_HRESULT(FnSockBind(RawSocket.get(), (SOCKADDR *)&LocalSockAddr, sizeof(LocalSockAddr)));
+
+    DWORD Opt = RCVALL_ON;
+    ULONG BytesReturned;
+    TEST_HRESULT(
+        FnSockIoctl(
+            RawSocket.get(), SIO_RCVALL, &Opt, sizeof(Opt), NULL, 0, &BytesReturned));
 
     //
-    // Wait for the MTU changes to quiesce. If filter or protocol drivers
-    // incompatible with MTU changes are installed, this requires a complete
-    // detach/attach cycle of the entire interface stack.
+    // When promiscuous mode is enabled from a RAW socket in TCPIP, locally sent
+    // frames should get looped back at L2. These looped frames should be
+    // ignored by XDP and be passed up the stack.
     //
-    WaitForNdisDatapath(If, MP_RESTART_TIMEOUT);
-
-    Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
 
     //
-    // Post a TX of size MTU and verify the packet was completed.
+    // Send a frame.
     //
 
-    UCHAR Payload[] = "GenericTxMtu";
+    UCHAR UdpPayload[] = "GenericLoopback";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
     UINT64 TxBuffer = SocketFreePop(&Xsk);
     UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
-    RtlCopyMemory(TxFrame, Payload, sizeof(Payload));
+    ASSERT(UdpFrameLength <= Xsk.Umem.Reg.ChunkSize);
+
+    RtlCopyMemory(TxFrame, UdpFrame, UdpFrameLength);
 
     UINT32 ProducerIndex;
     TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
 
     XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
     TxDesc->Address.AddressAndOffset = TxBuffer;
-    TxDesc->Length = TestMtu;
-
+    TxDesc->Length = UdpFrameLength;
     XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+
     XSK_NOTIFY_RESULT_FLAGS NotifyResult;
     NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
     TEST_EQUAL(0, NotifyResult);
-    SocketConsumerReserve(&Xsk.Rings.Completion, 1);
-
-    XSK_STATISTICS Stats = {0};
-    UINT32 StatsSize = sizeof(Stats);
-    GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS, &Stats, &StatsSize);
-    TEST_EQUAL(0, Stats.TxInvalidDescriptors);
 
     //
-    // Post a TX larger than the MTU and verify the packet was dropped.
+    // Verify that TCPIP received the frame.
     //
 
-    TxBuffer = SocketFreePop(&Xsk);
-    TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
-    RtlCopyMemory(TxFrame, Payload, sizeof(Payload));
-
-    TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
-
-    TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
-    TxDesc->Address.AddressAndOffset = TxBuffer;
-    TxDesc->Length = TestMtu + 1;
-
-    XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
-    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
-    TEST_EQUAL(0, NotifyResult);
+    TEST_EQUAL(
+        sizeof(UdpPayload),
+        FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
 
-    Watchdog.Reset();
-    do {
-        GetSockopt(Xsk.Handle.get(), XSK_SOCKOPT_STATISTICS, &Stats, &StatsSize);
+    //
+    // Verify that the XSK did not receive the frame.
+    //
 
-        if (Stats.TxInvalidDescriptors == 1) {
-            break;
-        }
-    } while (!Watchdog.IsExpired());
-    TEST_EQUAL(1, Stats.TxInvalidDescriptors);
+    UINT32 ConsumerIndex;
+    TEST_EQUAL(0, XskRingConsumerReserve(&Xsk.Rings.Rx, 1, &ConsumerIndex));
 }
 
-VOID
-GenericXskWait(
-    _In_ BOOLEAN Rx,
-    _In_ BOOLEAN Tx
+static
+unique_malloc_ptr<XDP_RSS_CONFIGURATION>
+GetXdpRss(
+    _In_ const wil::unique_handle &InterfaceHandle,
+    _Out_opt_ UINT32 *RssConfigSize = NULL
     )
 {
-    auto If = FnMpIf;
-    auto Xsk = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, TRUE, XDP_GENERIC);
-    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
-    const UINT32 WaitTimeoutMs = 1000;
-    Stopwatch<std::chrono::milliseconds> Timer;
-
-    UCHAR Payload[] = "GenericXskWait";
-
-    auto RxIndicate = [&] {
-        DATA_BUFFER Buffer = {0};
-        Buffer.DataOffset = 0;
-        Buffer.DataLength = sizeof(Payload);
-        Buffer.BufferLength = Buffer.DataLength;
-        Buffer.VirtualAddress = Payload;
-
-        RX_FRAME Frame;
-        RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), &Buffer);
-        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-        SocketProduceRxFill(&Xsk, 1);
-        TEST_HRESULT(TryMpRxFlush(GenericMp));
-    };
-
-    auto TxIndicate = [&] {
-        UINT64 TxBuffer = SocketFreePop(&Xsk);
-        UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
-        UINT32 TxFrameLength = sizeof(Payload);
-        ASSERT(TxFrameLength <= Xsk.Umem.Reg.ChunkSize);
-        RtlCopyMemory(TxFrame, Payload, sizeof(Payload));
-
-        UINT32 ProducerIndex;
-        TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
-
-        XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
-        TxDesc->Address.AddressAndOffset = TxBuffer;
-        TxDesc->Length = TxFrameLength;
-        XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
-
-        XSK_NOTIFY_RESULT_FLAGS PokeResult;
-        NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &PokeResult);
-        TEST_EQUAL(0, PokeResult);
-    };
-
-    XSK_NOTIFY_FLAGS NotifyFlags = XSK_NOTIFY_FLAG_NONE;
-    UINT32 ExpectedResult = 0;
-    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
-
-    if (Rx) {
-        NotifyFlags |= XSK_NOTIFY_FLAG_WAIT_RX;
-        ExpectedResult |= XSK_NOTIFY_RESULT_FLAG_RX_AVAILABLE;
-    } else {
-        //
-        // Produce IO that does not satisfy the wait condition.
-        //
-        RxIndicate();
-    }
-
-    if (Tx) {
-        NotifyFlags |= XSK_NOTIFY_FLAG_WAIT_TX;
-        ExpectedResult |= XSK_NOTIFY_RESULT_FLAG_TX_COMP_AVAILABLE;
-    } else {
-        //
-        // Produce IO that does not satisfy the wait condition.
-        //
-        TxIndicate();
-    }
-
-    //
-    // Verify the wait times out when the requested IO is not available.
-    //
-    Timer.Reset();
-    TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_TIMEOUT),
-        TryNotifySocket(Xsk.Handle.get(), NotifyFlags, WaitTimeoutMs, &NotifyResult));
-    Timer.ExpectElapsed(std::chrono::milliseconds(WaitTimeoutMs));
-
-    auto AsyncThread = std::async(
-        std::launch::async,
-        [&] {
-            //
-            // On another thread, briefly delay execution to give the main test
-            // thread a chance to begin waiting. Then, produce RX and TX.
-            //
-            Sleep(10);
-
-            if (Rx) {
-                RxIndicate();
-            }
-
-            if (Tx) {
-                TxIndicate();
-            }
-        }
-    );
-
-    //
-    // Verify the wait succeeds if any of the conditions is true, and that all
-    // conditions are eventually met.
-    //
-    do {
-        Timer.Reset(TEST_TIMEOUT_ASYNC);
-        NotifySocket(Xsk.Handle.get(), NotifyFlags, WaitTimeoutMs, &NotifyResult);
-        TEST_FALSE(Timer.IsExpired());
-        TEST_NOT_EQUAL(0, (NotifyResult & ExpectedResult));
+    unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig;
+    UINT32 Size = 0;
 
-        if (NotifyResult & XSK_NOTIFY_RESULT_FLAG_RX_AVAILABLE) {
-            XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
-        }
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_MORE_DATA),
+        TryRssGet(InterfaceHandle.get(), NULL, &Size));
+    TEST_TRUE(Size >= sizeof(*RssConfig.get()));
 
-        if (NotifyResult & XSK_NOTIFY_RESULT_FLAG_TX_COMP_AVAILABLE) {
-            XskRingConsumerRelease(&Xsk.Rings.Completion, 1);
-        }
+    RssConfig.reset((XDP_RSS_CONFIGURATION *)malloc(Size));
+    TEST_TRUE(RssConfig.get() != NULL);
 
-        ExpectedResult &= ~NotifyResult;
-    } while (ExpectedResult != 0);
+    RssGet(InterfaceHandle.get(), RssConfig.get(), &Size);
+    TEST_EQUAL(RssConfig->Header.Revision, XDP_RSS_CONFIGURATION_REVISION_1);
+    TEST_EQUAL(RssConfig->Header.Size, XDP_SIZEOF_RSS_CONFIGURATION_REVISION_1);
 
-    //
-    // Verify the wait does not succeed after consuming the requested IO.
-    //
-    Timer.Reset();
-    TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_TIMEOUT),
-        TryNotifySocket(Xsk.Handle.get(), NotifyFlags, WaitTimeoutMs, &NotifyResult));
-    Timer.ExpectElapsed(std::chrono::milliseconds(WaitTimeoutMs));
+    if (RssConfigSize != NULL) {
+        *RssConfigSize = Size;
+    }
+
+    return RssConfig;
 }
 
+static
 VOID
-GenericXskWaitAsync(
-    _In_ BOOLEAN Rx,
-    _In_ BOOLEAN Tx
+GetXdpRssIndirectionTable(
+    _In_ const TestInterface &If,
+    _Out_ unique_malloc_ptr<PROCESSOR_NUMBER> &IndirectionTableOut,
+    _Out_ UINT32 &IndirectionTableSizeOut
     )
 {
-    auto If = FnMpIf;
-    auto Xsk = SetupSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, TRUE, XDP_GENERIC);
-    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
-    const UINT32 WaitTimeoutMs = 1000;
-    OVERLAPPED ov = {0};
-    wil::unique_handle iocp(CreateIoCompletionPort(Xsk.Handle.get(), NULL, 0, 0));
-
-    UCHAR Payload[] = "GenericXskWaitAsync";
-
-    auto RxIndicate = [&] {
-        DATA_BUFFER Buffer = {0};
-        Buffer.DataOffset = 0;
-        Buffer.DataLength = sizeof(Payload);
-        Buffer.BufferLength = Buffer.DataLength;
-        Buffer.VirtualAddress = Payload;
-
-        RX_FRAME Frame;
-        RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), &Buffer);
-        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-        SocketProduceRxFill(&Xsk, 1);
-        TEST_HRESULT(TryMpRxFlush(GenericMp));
-    };
+    wil::unique_handle InterfaceHandle = InterfaceOpen(If.GetIfIndex());
+    unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig = GetXdpRss(InterfaceHandle);
 
-    auto TxIndicate = [&] {
-        UINT64 TxBuffer = SocketFreePop(&Xsk);
-        UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
-        UINT32 TxFrameLength = sizeof(Payload);
-        ASSERT(TxFrameLength <= Xsk.Umem.Reg.ChunkSize);
-        RtlCopyMemory(TxFrame, Payload, sizeof(Payload));
+    IndirectionTableOut.reset((PROCESSOR_NUMBER *)malloc(RssConfig->IndirectionTableSize));
 
-        UINT32 ProducerIndex;
-        TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+    PROCESSOR_NUMBER *IndirectionTable =
+        (PROCESSOR_NUMBER *)RTL_PTR_ADD(RssConfig.get(), RssConfig->IndirectionTableOffset);
+    RtlCopyMemory(IndirectionTableOut.get(), IndirectionTable, RssConfig->IndirectionTableSize);
+    IndirectionTableSizeOut = RssConfig->IndirectionTableSize;
+}
 
-        XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
-        TxDesc->Address.AddressAndOffset = TxBuffer;
-        TxDesc->Length = TxFrameLength;
-        XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+static
+VOID
+SetXdpRss(
+    _In_ const TestInterface &If,
+    _In_ const wil::unique_handle &InterfaceHandle,
+    _In_ const unique_malloc_ptr<PROCESSOR_NUMBER> &IndirectionTable,
+    _In_ UINT32 IndirectionTableSize
+    )
+{
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto AdapterMp = MpOpenAdapter(If.GetIfIndex());
+    unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig;
+    UINT16 HashSecretKeySize = 40;
+    UINT32 RssConfigSize = sizeof(*RssConfig) + HashSecretKeySize + IndirectionTableSize;
 
-        XSK_NOTIFY_RESULT_FLAGS PokeResult;
-        NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &PokeResult);
-        TEST_EQUAL(0, PokeResult);
-    };
+    //
+    // Form the XdpSetRss input.
+    //
 
-    XSK_NOTIFY_FLAGS NotifyFlags = XSK_NOTIFY_FLAG_NONE;
-    UINT32 ExpectedResult = 0;
-    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    RssConfig.reset((XDP_RSS_CONFIGURATION *)malloc(RssConfigSize));
+    XdpInitializeRssConfiguration(RssConfig.get(), RssConfigSize);
+    RssConfig->HashSecretKeyOffset = sizeof(*RssConfig);
+    RssConfig->IndirectionTableOffset = RssConfig->HashSecretKeyOffset + HashSecretKeySize;
 
-    if (Rx) {
-        NotifyFlags |= XSK_NOTIFY_FLAG_WAIT_RX;
-        ExpectedResult |= XSK_NOTIFY_RESULT_FLAG_RX_AVAILABLE;
-    } else {
-        //
-        // Produce IO that does not satisfy the wait condition.
-        //
-        RxIndicate();
-    }
+    PROCESSOR_NUMBER *IndirectionTableDst =
+        (PROCESSOR_NUMBER *)RTL_PTR_ADD(RssConfig.get(), RssConfig->IndirectionTableOffset);
+    RtlCopyMemory(IndirectionTableDst, IndirectionTable.get(), IndirectionTableSize);
 
-    if (Tx) {
-        NotifyFlags |= XSK_NOTIFY_FLAG_WAIT_TX;
-        ExpectedResult |= XSK_NOTIFY_RESULT_FLAG_TX_COMP_AVAILABLE;
-    } else {
-        //
-        // Produce IO that does not satisfy the wait condition.
-        //
-        TxIndicate();
-    }
+    RssConfig->Flags =
+        XDP_RSS_FLAG_SET_HASH_TYPE | XDP_RSS_FLAG_SET_HASH_SECRET_KEY |
+        XDP_RSS_FLAG_SET_INDIRECTION_TABLE;
+    RssConfig->HashType = XDP_RSS_HASH_TYPE_TCP_IPV4 | XDP_RSS_HASH_TYPE_TCP_IPV6;
+    RssConfig->HashSecretKeySize = HashSecretKeySize;
+    RssConfig->IndirectionTableSize = (USHORT)IndirectionTableSize;
 
     //
-    // Verify the wait times out when the requested IO is not available.
+    // Set an OID filter, initiate XdpSetRss, verify the resulting OID, close
+    // the handle to allow OID completion.
     //
-    DWORD bytes;
-    ULONG_PTR key;
-    OVERLAPPED *ovp;
-    TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_IO_PENDING),
-        TryNotifyAsync(Xsk.Handle.get(), NotifyFlags, &ov));
-    TEST_FALSE(GetQueuedCompletionStatus(iocp.get(), &bytes, &key, &ovp, WaitTimeoutMs));
-    TEST_EQUAL(WAIT_TIMEOUT, GetLastError());
+
+    OID_KEY Key;
+    InitializeOidKey(&Key, OID_GEN_RECEIVE_SCALE_PARAMETERS, NdisRequestSetInformation);
+    MpOidFilter(AdapterMp, &Key, 1);
 
     auto AsyncThread = std::async(
         std::launch::async,
         [&] {
-            //
-            // On another thread, briefly delay execution to give the main test
-            // thread a chance to begin waiting. Then, produce RX and TX.
-            //
-            Sleep(10);
-
-            if (Rx) {
-                RxIndicate();
-            }
-
-            if (Tx) {
-                TxIndicate();
-            }
+            return TryRssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
         }
     );
 
-    //
-    // Verify the wait succeeds if any of the conditions is true, and that all
-    // conditions are eventually met.
-    //
-    do {
-        TEST_TRUE(GetQueuedCompletionStatus(iocp.get(), &bytes, &key, &ovp, WaitTimeoutMs));
-        TEST_EQUAL(&ov, ovp);
-        GetNotifyAsyncResult(&ov, &NotifyResult);
-        TEST_NOT_EQUAL(0, (NotifyResult & ExpectedResult));
+    UINT32 OidInfoBufferLength;
+    unique_malloc_ptr<VOID> OidInfoBuffer =
+        MpOidAllocateAndGetRequest(AdapterMp, Key, &OidInfoBufferLength);
 
-        if (NotifyResult & XSK_NOTIFY_RESULT_FLAG_RX_AVAILABLE) {
-            XskRingConsumerRelease(&Xsk.Rings.Rx, 1);
-        }
+    NDIS_RECEIVE_SCALE_PARAMETERS *NdisParams =
+        (NDIS_RECEIVE_SCALE_PARAMETERS *)OidInfoBuffer.get();
+    TEST_EQUAL(NdisParams->IndirectionTableSize, IndirectionTableSize);
+    PROCESSOR_NUMBER *NdisIndirectionTable =
+        (PROCESSOR_NUMBER *)RTL_PTR_ADD(NdisParams, NdisParams->IndirectionTableOffset);
+    TEST_TRUE(RtlEqualMemory(NdisIndirectionTable, IndirectionTable.get(), IndirectionTableSize));
 
-        if (NotifyResult & XSK_NOTIFY_RESULT_FLAG_TX_COMP_AVAILABLE) {
-            XskRingConsumerRelease(&Xsk.Rings.Completion, 1);
-        }
+    AdapterMp.reset();
+    TEST_EQUAL(AsyncThread.wait_for(TEST_TIMEOUT_ASYNC), std::future_status::ready);
+    TEST_HRESULT(AsyncThread.get());
+}
 
-        ExpectedResult &= ~NotifyResult;
+static
+VOID
+IndicateOnAllActiveRssQueues(
+    _In_ TestInterface &If,
+    _In_ UINT32 NumRssQueues
+    )
+{
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
 
-        if (ExpectedResult != 0) {
-            HRESULT res = TryNotifyAsync(Xsk.Handle.get(), NotifyFlags, &ov);
-            if (!SUCCEEDED(res)) {
-                TEST_EQUAL(HRESULT_FROM_WIN32(ERROR_IO_PENDING), res);
-            }
-        }
-    } while (ExpectedResult != 0);
+    UCHAR Payload[] = "IndicateOnAllActiveRssQueuesQ#";
 
-    //
-    // Verify cancellation (happy path).
-    //
-    TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_IO_PENDING),
-        TryNotifyAsync(Xsk.Handle.get(), NotifyFlags, &ov));
-    TEST_FALSE(GetQueuedCompletionStatus(iocp.get(), &bytes, &key, &ovp, WaitTimeoutMs));
-    TEST_EQUAL(WAIT_TIMEOUT, GetLastError());
-    TEST_TRUE(CancelIoEx(Xsk.Handle.get(), &ov));
-    TEST_FALSE(GetQueuedCompletionStatus(iocp.get(), &bytes, &key, &ovp, WaitTimeoutMs));
-    TEST_EQUAL(ERROR_OPERATION_ABORTED, GetLastError());
+    DATA_BUFFER Buffer = {0};
+    Buffer.DataOffset = 0;
+    Buffer.DataLength = sizeof(Payload);
+    Buffer.BufferLength = Buffer.DataLength;
+    Buffer.VirtualAddress = Payload;
+
+    for (UINT32 i = 0; i < NumRssQueues; i++) {
+        Payload[sizeof(Payload) - 1] = (UCHAR)i;
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, i, &Buffer);
+        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+
+        DATA_FLUSH_OPTIONS FlushOptions = {0};
+        FlushOptions.Flags.RssCpu = TRUE;
+        FlushOptions.RssCpuQueueId = i;
+        TEST_HRESULT(TryMpRxFlush(GenericMp, &FlushOptions));
+    }
+}
+
+static
+VOID
+PrintProcArray(
+    _In_ const char* Prefix,
+    _In_ const std::vector<UINT32> &ProcArray
+    )
+{
+    std::string Msg;
+
+    Msg += Prefix;
+    Msg += "[";
+    for (int i = 0; i < ProcArray.size(); i++) {
+        Msg += std::to_string(ProcArray[i]);
+        if (i != ProcArray.size() - 1) {
+            Msg += ",";
+        }
+    }
+    Msg += "]";
+
+    TraceVerbose("%s", Msg.c_str());
 }
 
+static
 VOID
-GenericLwfDelayDetach(
-    _In_ BOOLEAN Rx,
-    _In_ BOOLEAN Tx
+VerifyRssSettings(
+    _In_ const TestInterface &If,
+    _In_ const unique_malloc_ptr<PROCESSOR_NUMBER> &ExpectedXdpIndirectionTable,
+    _In_ UINT32 ExpectedXdpIndirectionTableSize
     )
 {
-    const CHAR *DelayDetachTimeoutRegName = "GenericDelayDetachTimeoutSec";
+    unique_malloc_ptr<PROCESSOR_NUMBER> IndirectionTable;
+    UINT32 IndirectionTableSize;
 
-    //
-    // Configure the LWF delay detach timeout.
-    //
-    wil::unique_hkey XdpParametersKey;
-    DWORD DelayTimeoutMs;
-    DWORD DelayTimeoutSec;
-    TEST_EQUAL(
-        ERROR_SUCCESS,
-        RegCreateKeyExA(
-            HKEY_LOCAL_MACHINE,
-            "System\\CurrentControlSet\\Services\\Xdp\\Parameters",
-            0, NULL, REG_OPTION_VOLATILE, KEY_WRITE, NULL, &XdpParametersKey, NULL));
+    GetXdpRssIndirectionTable(If, IndirectionTable, IndirectionTableSize);
+    TEST_EQUAL(IndirectionTableSize, ExpectedXdpIndirectionTableSize);
+    TEST_TRUE(
+        RtlEqualMemory(
+            IndirectionTable.get(), ExpectedXdpIndirectionTable.get(), IndirectionTableSize));
+}
 
-    //
-    // Setup a generic socket to attach the LWF datapath, then close the socket
-    // to trigger LWF datapath detach. Verify LWF datapath detach timestamp by
-    // using XDPFNMP miniport pause timestamp as an approximation.
-    //
+typedef struct _PROCESSOR_NUMBER_COMP {
+    bool operator()(const PROCESSOR_NUMBER &A, const PROCESSOR_NUMBER &B) const {
+        return (A.Group == B.Group) ? A.Number < B.Number : A.Group < B.Group;
+    }
+} PROCESSOR_NUMBER_COMP;
+
+static
+std::set<PROCESSOR_NUMBER, PROCESSOR_NUMBER_COMP>
+GetRssProcessorSetFromIndirectionTable(
+    _In_ const PROCESSOR_NUMBER *IndirectionTable,
+    _In_ UINT32 IndirectionTableSize
+    )
+{
+    std::set<PROCESSOR_NUMBER, PROCESSOR_NUMBER_COMP> RssProcessors;
 
     //
-    // Verify LWF datapath detach delay does not impact LWF detach.
+    // Convert indirection table to processor set.
     //
+    for (UINT32 Index = 0;
+        Index < IndirectionTableSize / sizeof(*IndirectionTable);
+        Index++) {
+        PROCESSOR_NUMBER Processor = IndirectionTable[Index];
+        RssProcessors.insert(Processor);
+    }
 
-    DelayTimeoutMs = 5 * (DWORD)std::chrono::milliseconds(MP_RESTART_TIMEOUT).count();
-    DelayTimeoutSec = DelayTimeoutMs / 1000;
-    TEST_EQUAL(
-        ERROR_SUCCESS,
-        RegSetValueExA(
-            XdpParametersKey.get(),
-            DelayDetachTimeoutRegName,
-            0, REG_DWORD, (BYTE *)&DelayTimeoutSec, sizeof(DelayTimeoutSec)));
-    auto RegValueScopeGuard = wil::scope_exit([&]
-    {
-        //
-        // Remove the registry key and restart the NDIS filter stack: the
-        // delayed detach parameter does not reliably take effect until each
-        // data path is fully detached. The only way to assure this (without
-        // restarting XDP itself) is to restart the filter stack.
-        //
-        TEST_EQUAL(
-            ERROR_SUCCESS,
-            RegDeleteValueA(XdpParametersKey.get(), DelayDetachTimeoutRegName));
-        Sleep(TEST_TIMEOUT_ASYNC_MS); // Give time for the reg change notification to occur.
-        FnMpIf.Restart();
-    });
-    Sleep(TEST_TIMEOUT_ASYNC_MS); // Give time for the reg change notification to occur.
+    return RssProcessors;
+}
 
-    FnMpIf.Restart();
-    {
-        auto Xsk = SetupSocket(FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), Rx, Tx, XDP_GENERIC);
-    }
-    Stopwatch<std::chrono::milliseconds> Timer(MP_RESTART_TIMEOUT);
-    FnMpIf.Restart();
-    TEST_FALSE(Timer.IsExpired());
+static
+VOID
+VerifyRssDatapath(
+    _In_ TestInterface &If,
+    _In_ const unique_malloc_ptr<PROCESSOR_NUMBER> &IndirectionTable,
+    _In_ UINT32 IndirectionTableSize
+    )
+{
+    std::set<PROCESSOR_NUMBER, PROCESSOR_NUMBER_COMP> RssProcessors =
+        GetRssProcessorSetFromIndirectionTable(IndirectionTable.get(), IndirectionTableSize);
 
     //
-    // Verify LWF detach occurs at the expected time by observing FNMP pause events.
+    // Indicate RX on each miniport RSS queue and capture all packets after XDP
+    // passes them up.
     //
 
-    DelayTimeoutMs = TEST_TIMEOUT_ASYNC_MS * 3;
-    DelayTimeoutSec = DelayTimeoutMs / 1000;
-    TEST_EQUAL(
-        ERROR_SUCCESS,
-        RegSetValueExA(
-            XdpParametersKey.get(),
-            DelayDetachTimeoutRegName,
-            0, REG_DWORD, (BYTE *)&DelayTimeoutSec, sizeof(DelayTimeoutSec)));
-    Sleep(TEST_TIMEOUT_ASYNC_MS); // Give time for the reg change notification to occur.
+    auto DefaultLwf = LwfOpenDefault(If.GetIfIndex());
+    UCHAR Pattern = 0x00;
+    UCHAR Mask = 0x00;
+    auto LwfFilter = LwfRxFilter(DefaultLwf, &Pattern, &Mask, sizeof(Pattern));
 
-    FnMpIf.Restart();
-    auto GenericMp = MpOpenGeneric(FnMpIf.GetIfIndex());
-    LARGE_INTEGER LowerBoundTime;
-    LARGE_INTEGER UpperBoundTime;
-    LARGE_INTEGER LastMpPauseTime;
-    LARGE_INTEGER SocketClosureTime;
+    IndicateOnAllActiveRssQueues(If, (UINT32)RssProcessors.size());
 
     //
-    // Simple case: close socket, wait for delay.
+    // Verify that the resulting indications are as expected.
     //
-    // 0s                                  -> close socket
-    // DelayTimeoutMs - TEST_TIMEOUT_ASYNC_MS   -> lower bound
-    // DelayTimeoutMs                      -> expected datapath detach
-    // DelayTimeoutMs + TEST_TIMEOUT_ASYNC_MS   -> upper bound
+    // XDP re-hashes IP frames with the upper edge RSS settings and steers
+    // them to the upper edge RSS processors. The indicated frames are not IP,
+    // so XDP zeroes out their NBL hash OOB and maintains the same processor
+    // for indication. So verify that a single packet was indicated on each
+    // processor in the miniport's RSS processor set and that its RSS hash is 0.
     //
-    {
-        auto Xsk = SetupSocket(FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), Rx, Tx, XDP_GENERIC);
-        QueryPerformanceCounter(&SocketClosureTime);
-    }
-    Sleep(DelayTimeoutMs - TEST_TIMEOUT_ASYNC_MS);
-    LastMpPauseTime = MpGetLastMiniportPauseTimestamp(GenericMp);
-    TEST_TRUE(LastMpPauseTime.QuadPart < SocketClosureTime.QuadPart);
-    QueryPerformanceCounter(&LowerBoundTime);
-    Sleep(TEST_TIMEOUT_ASYNC_MS * 2);
-    QueryPerformanceCounter(&UpperBoundTime);
-
-    LastMpPauseTime = MpGetLastMiniportPauseTimestamp(GenericMp);
-    TEST_TRUE(LastMpPauseTime.QuadPart > LowerBoundTime.QuadPart);
-    TEST_TRUE(LastMpPauseTime.QuadPart < UpperBoundTime.QuadPart);
 
-    //
-    // Reset case: close socket, open and close another socket, wait for delay.
-    //
-    // 0s                                   -> close socket
-    // DelayTimeoutMs - TEST_TIMEOUT_ASYNC_MS    -> close another socket
-    // DelayTimeoutMs + TEST_TIMEOUT_ASYNC_MS    -> lower bound
-    // 2*DelayTimeoutMs - TEST_TIMEOUT_ASYNC_MS  -> expected datapath detach
-    // 2*DelayTimeoutMs                     -> upper bound
-    //
-    {
-        auto Xsk = SetupSocket(FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), Rx, Tx, XDP_GENERIC);
-        QueryPerformanceCounter(&SocketClosureTime);
-    }
-    Sleep(DelayTimeoutMs - TEST_TIMEOUT_ASYNC_MS);
-    {
-        auto Xsk = SetupSocket(FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), Rx, Tx, XDP_GENERIC);
+    UINT32 NumRssProcessors = (UINT32)RssProcessors.size();
+    for (UINT32 Index = 0; Index < NumRssProcessors; Index++) {
+        auto Frame = LwfRxAllocateAndGetFrame(DefaultLwf, Index);
+        PROCESSOR_NUMBER Processor = Frame->Output.ProcessorNumber;
+        TEST_EQUAL(1, RssProcessors.erase(Processor));
+        TEST_EQUAL(0, Frame->Output.RssHash);
     }
-    Sleep(TEST_TIMEOUT_ASYNC_MS * 2);
-    LastMpPauseTime = MpGetLastMiniportPauseTimestamp(GenericMp);
-    TEST_TRUE(LastMpPauseTime.QuadPart < SocketClosureTime.QuadPart);
-    QueryPerformanceCounter(&LowerBoundTime);
-    Sleep(TEST_TIMEOUT_ASYNC_MS * 2);
-    QueryPerformanceCounter(&UpperBoundTime);
 
-    LastMpPauseTime = MpGetLastMiniportPauseTimestamp(GenericMp);
-    TEST_TRUE(LastMpPauseTime.QuadPart > LowerBoundTime.QuadPart);
-    TEST_TRUE(LastMpPauseTime.QuadPart < UpperBoundTime.QuadPart);
+    UINT32 FrameLength = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+        LwfRxGetFrame(DefaultLwf, NumRssProcessors, &FrameLength, NULL));
 }
 
 VOID
-GenericLoopback(
-    _In_ ADDRESS_FAMILY Af
-    )
+OffloadRssError()
 {
-    UINT16 LocalPort, RemotePort;
-    ETHERNET_ADDRESS LocalHw, RemoteHw;
-    INET_ADDR LocalIp, RemoteIp;
-    SOCKADDR_INET LocalSockAddr = {0};
-
-    auto If = FnMpIf;
-    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, TRUE, XDP_GENERIC);
-    SocketProduceRxFill(&Xsk, 1);
-
-    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
-
-    RemotePort = htons(4321);
-    If.GetHwAddress(&LocalHw);
-    If.GetRemoteHwAddress(&RemoteHw);
-    LocalSockAddr.si_family = Af;
-
-    if (Af == AF_INET) {
-        If.GetIpv4Address(&LocalIp.Ipv4);
-        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
-        LocalSockAddr.Ipv4.sin_addr = LocalIp.Ipv4;
-    } else {
-        If.GetIpv6Address(&LocalIp.Ipv6);
-        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
-        LocalSockAddr.Ipv6.sin6_addr = LocalIp.Ipv6;
-    }
-
-    XDP_RULE Rule;
-    Rule.Match = XDP_MATCH_ALL;
-    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
-    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
-    Rule.Redirect.Target = Xsk.Handle.get();
-
-    wil::unique_handle ProgramHandle =
-        CreateXdpProg(
-            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
-
-    unique_fnsock RawSocket;
-    TEST_HRESULT(FnSockCreate(Af, SOCK_RAW, IPPROTO_IP, &RawSocket));
-    TEST_NOT_NULL(RawSocket.get());
-
-    TEST_HRESULT(FnSockBind(RawSocket.get(), (SOCKADDR *)&LocalSockAddr, sizeof(LocalSockAddr)));
-
-    DWORD Opt = RCVALL_ON;
-    ULONG BytesReturned;
-    TEST_HRESULT(
-        FnSockIoctl(
-            RawSocket.get(), SIO_RCVALL, &Opt, sizeof(Opt), NULL, 0, &BytesReturned));
+    wil::unique_handle InterfaceHandle;
+    unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig;
+    UINT16 IndirectionTableSize = 1 * sizeof(PROCESSOR_NUMBER);
+    UINT32 RssConfigSize = sizeof(*RssConfig) + IndirectionTableSize;
 
     //
-    // When promiscuous mode is enabled from a RAW socket in TCPIP, locally sent
-    // frames should get looped back at L2. These looped frames should be
-    // ignored by XDP and be passed up the stack.
+    // Only run if we have at least 2 LPs.
+    // Our expected test automation environment is at least a 2VP VM.
     //
+    if (GetProcessorCount() < 2) {
+        TEST_WARNING("Test requires at least 2 logical processors. Skipping.");
+        return;
+    }
 
     //
-    // Send a frame.
+    // Open with invalid IfIndex.
     //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+        TryInterfaceOpen(MAXUINT32, InterfaceHandle));
 
-    UCHAR UdpPayload[] = "GenericLoopback";
-    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
-    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
-    UINT32 UdpFrameLength = sizeof(UdpFrame);
-    TEST_TRUE(
-        PktBuildUdpFrame(
-            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
-            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
 
-    UINT64 TxBuffer = SocketFreePop(&Xsk);
-    UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
-    ASSERT(UdpFrameLength <= Xsk.Umem.Reg.ChunkSize);
+    //
+    // Work around issue #3: if TCPIP hasn't already plumbed RSS configuration,
+    // XDP fails to partially set RSS. Wait for TCPIP's configuration before
+    // continuing with this test case.
+    //
+    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+    HRESULT CurrentRssResult;
+    do {
+        UINT32 CurrentRssConfigSize = 0;
+        CurrentRssResult = TryRssGet(InterfaceHandle.get(), NULL, &CurrentRssConfigSize);
+        if (CurrentRssResult == HRESULT_FROM_WIN32(ERROR_MORE_DATA)) {
+            break;
+        }
+    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+    TEST_EQUAL(HRESULT_FROM_WIN32(ERROR_MORE_DATA), CurrentRssResult);
 
-    RtlCopyMemory(TxFrame, UdpFrame, UdpFrameLength);
+    RssConfig.reset((XDP_RSS_CONFIGURATION *)malloc(RssConfigSize));
 
-    UINT32 ProducerIndex;
-    TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+    XdpInitializeRssConfiguration(RssConfig.get(), RssConfigSize);
+    RssConfig->Flags = XDP_RSS_FLAG_SET_INDIRECTION_TABLE;
+    RssConfig->IndirectionTableSize = IndirectionTableSize;
+    RssConfig->IndirectionTableOffset = sizeof(*RssConfig);
 
-    XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
-    TxDesc->Address.AddressAndOffset = TxBuffer;
-    TxDesc->Length = UdpFrameLength;
-    XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+    PROCESSOR_NUMBER *IndirectionTable =
+        (PROCESSOR_NUMBER *)RTL_PTR_ADD(RssConfig.get(), RssConfig->IndirectionTableOffset);
+    IndirectionTable[0].Number = 1;
+    RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
+    InterfaceHandle.reset();
+    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
 
-    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
-    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
-    TEST_EQUAL(0, NotifyResult);
+    for (auto Case : RxTxTestCases) {
+        auto Socket = SetupSocket(FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), Case.Rx, Case.Tx, XDP_GENERIC);
+        RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
+    }
 
     //
-    // Verify that TCPIP received the frame.
+    // Set while another handle has already set.
     //
 
+    RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
+
+    wil::unique_handle InterfaceHandle2 = InterfaceOpen(FnMpIf.GetIfIndex());
     TEST_EQUAL(
-        sizeof(UdpPayload),
-        FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
-    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
+        TryRssSet(InterfaceHandle2.get(), RssConfig.get(), RssConfigSize));
+}
+
+VOID
+OffloadRssReference()
+{
+    wil::unique_handle InterfaceHandle;
+    unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig;
+    unique_malloc_ptr<XDP_RSS_CONFIGURATION> ModifiedRssConfig;
+    unique_malloc_ptr<XDP_RSS_CONFIGURATION> OriginalRssConfig;
+    UINT32 RssConfigSize;
+    UINT32 ModifiedRssConfigSize;
+    UINT32 OriginalRssConfigSize;
 
     //
-    // Verify that the XSK did not receive the frame.
+    // Only run if we have at least 2 LPs.
+    // Our expected test automation environment is at least a 2VP VM.
     //
+    if (GetProcessorCount() < 2) {
+        TEST_WARNING("Test requires at least 2 logical processors. Skipping.");
+        return;
+    }
 
-    UINT32 ConsumerIndex;
-    TEST_EQUAL(0, XskRingConsumerReserve(&Xsk.Rings.Rx, 1, &ConsumerIndex));
-}
+    for (auto Case : RxTxTestCases) {
+        //
+        // Get original RSS settings.
+        //
+        InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+        OriginalRssConfig = GetXdpRss(InterfaceHandle, &OriginalRssConfigSize);
 
-static
-unique_malloc_ptr<XDP_RSS_CONFIGURATION>
-GetXdpRss(
-    _In_ const wil::unique_handle &InterfaceHandle,
-    _Out_opt_ UINT32 *RssConfigSize = NULL
-    )
-{
-    unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig;
-    UINT32 Size = 0;
+        //
+        // Configure new RSS settings.
+        //
 
-    TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_MORE_DATA),
-        TryRssGet(InterfaceHandle.get(), NULL, &Size));
-    TEST_TRUE(Size >= sizeof(*RssConfig.get()));
+        ModifiedRssConfigSize = OriginalRssConfigSize;
+        ModifiedRssConfig.reset((XDP_RSS_CONFIGURATION *)malloc(ModifiedRssConfigSize));
 
-    RssConfig.reset((XDP_RSS_CONFIGURATION *)malloc(Size));
-    TEST_TRUE(RssConfig.get() != NULL);
+        XdpInitializeRssConfiguration(ModifiedRssConfig.get(), ModifiedRssConfigSize);
+        ModifiedRssConfig->Flags = XDP_RSS_FLAG_SET_HASH_TYPE;
+        ModifiedRssConfig->HashType =
+            OriginalRssConfig->HashType ^ (XDP_RSS_HASH_TYPE_TCP_IPV4 | XDP_RSS_HASH_TYPE_TCP_IPV6);
+        TEST_TRUE(ModifiedRssConfig->HashType != OriginalRssConfig->HashType);
 
-    RssGet(InterfaceHandle.get(), RssConfig.get(), &Size);
-    TEST_EQUAL(RssConfig->Header.Revision, XDP_RSS_CONFIGURATION_REVISION_1);
-    TEST_EQUAL(RssConfig->Header.Size, XDP_SIZEOF_RSS_CONFIGURATION_REVISION_1);
+        RssSet(InterfaceHandle.get(), ModifiedRssConfig.get(), ModifiedRssConfigSize);
 
-    if (RssConfigSize != NULL) {
-        *RssConfigSize = Size;
-    }
+        //
+        // Bind socket (and setup RX program).
+        //
+        auto Socket =
+            SetupSocket(
+                FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), Case.Rx, Case.Tx, XDP_GENERIC);
 
-    return RssConfig;
+        //
+        // Close RSS handle.
+        //
+        InterfaceHandle.reset();
+
+        //
+        // Verify RSS settings restored.
+        //
+        InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+        RssConfig = GetXdpRss(InterfaceHandle, &RssConfigSize);
+        TEST_EQUAL(RssConfig->HashType, OriginalRssConfig->HashType);
+    }
 }
 
-static
 VOID
-GetXdpRssIndirectionTable(
-    _In_ const TestInterface &If,
-    _Out_ unique_malloc_ptr<PROCESSOR_NUMBER> &IndirectionTableOut,
-    _Out_ UINT32 &IndirectionTableSizeOut
-    )
+OffloadRssUnchanged()
 {
-    wil::unique_handle InterfaceHandle = InterfaceOpen(If.GetIfIndex());
-    unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig = GetXdpRss(InterfaceHandle);
+    wil::unique_handle InterfaceHandle;
+    unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig;
+    UINT32 RssConfigSize;
+    UCHAR *HashSecretKey;
+    PROCESSOR_NUMBER *IndirectionTable;
 
-    IndirectionTableOut.reset((PROCESSOR_NUMBER *)malloc(RssConfig->IndirectionTableSize));
+    //
+    // Only run if we have at least 2 LPs.
+    // Our expected test automation environment is at least a 2VP VM.
+    //
+    if (GetProcessorCount() < 2) {
+        TEST_WARNING("Test requires at least 2 logical processors. Skipping.");
+        return;
+    }
 
-    PROCESSOR_NUMBER *IndirectionTable =
+    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+
+    //
+    // Hash type.
+    //
+    RssConfig = GetXdpRss(InterfaceHandle, &RssConfigSize);
+    UINT32 ExpectedHashType = RssConfig->HashType;
+    RssConfig->Flags = XDP_RSS_FLAG_SET_HASH_SECRET_KEY | XDP_RSS_FLAG_SET_INDIRECTION_TABLE;
+    RssConfig->HashType = 0;
+    RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
+    RssConfig = GetXdpRss(InterfaceHandle);
+    TEST_EQUAL(RssConfig->HashType, ExpectedHashType);
+
+    //
+    // Hash secret key.
+    //
+    RssConfig = GetXdpRss(InterfaceHandle, &RssConfigSize);
+    HashSecretKey = (UCHAR *)RTL_PTR_ADD(RssConfig.get(), RssConfig->HashSecretKeyOffset);
+    UCHAR ExpectedHashSecretKey[40];
+    UINT32 ExpectedHashSecretKeySize = RssConfig->HashSecretKeySize;
+    ASSERT(ExpectedHashSecretKeySize <= sizeof(ExpectedHashSecretKey));
+    RtlCopyMemory(&ExpectedHashSecretKey, HashSecretKey, RssConfig->HashSecretKeySize);
+    RssConfig->Flags = XDP_RSS_FLAG_SET_HASH_TYPE | XDP_RSS_FLAG_SET_INDIRECTION_TABLE;
+    RtlZeroMemory(HashSecretKey, RssConfig->HashSecretKeySize);
+    RssConfig->HashSecretKeySize = 0;
+    RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
+    RssConfig = GetXdpRss(InterfaceHandle);
+    TEST_EQUAL(RssConfig->HashSecretKeySize, ExpectedHashSecretKeySize);
+    HashSecretKey = (UCHAR *)RTL_PTR_ADD(RssConfig.get(), RssConfig->HashSecretKeyOffset);
+    TEST_TRUE(RtlEqualMemory(HashSecretKey, &ExpectedHashSecretKey, ExpectedHashSecretKeySize));
+
+    //
+    // Indirection table.
+    //
+    RssConfig = GetXdpRss(InterfaceHandle, &RssConfigSize);
+    IndirectionTable =
         (PROCESSOR_NUMBER *)RTL_PTR_ADD(RssConfig.get(), RssConfig->IndirectionTableOffset);
-    RtlCopyMemory(IndirectionTableOut.get(), IndirectionTable, RssConfig->IndirectionTableSize);
-    IndirectionTableSizeOut = RssConfig->IndirectionTableSize;
+    PROCESSOR_NUMBER ExpectedIndirectionTable[128];
+    UINT32 ExpectedIndirectionTableSize = RssConfig->IndirectionTableSize;
+    ASSERT(ExpectedIndirectionTableSize <= sizeof(ExpectedIndirectionTable));
+    RtlCopyMemory(&ExpectedIndirectionTable, IndirectionTable, RssConfig->IndirectionTableSize);
+    RssConfig->Flags = XDP_RSS_FLAG_SET_HASH_TYPE | XDP_RSS_FLAG_SET_HASH_SECRET_KEY;
+    RtlZeroMemory(IndirectionTable, RssConfig->IndirectionTableSize);
+    RssConfig->IndirectionTableSize = 0;
+    RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
+    RssConfig = GetXdpRss(InterfaceHandle);
+    TEST_EQUAL(RssConfig->IndirectionTableSize, ExpectedIndirectionTableSize);
+    IndirectionTable =
+        (PROCESSOR_NUMBER *)RTL_PTR_ADD(RssConfig.get(), RssConfig->IndirectionTableOffset);
+    TEST_TRUE(
+        RtlEqualMemory(IndirectionTable, &ExpectedIndirectionTable, ExpectedIndirectionTableSize));
 }
 
-static
 VOID
-SetXdpRss(
-    _In_ const TestInterface &If,
-    _In_ const wil::unique_handle &InterfaceHandle,
-    _In_ const unique_malloc_ptr<PROCESSOR_NUMBER> &IndirectionTable,
-    _In_ UINT32 IndirectionTableSize
-    )
+OffloadRssInterfaceRestart()
 {
-    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
-    auto AdapterMp = MpOpenAdapter(If.GetIfIndex());
+    wil::unique_handle InterfaceHandle;
     unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig;
-    UINT16 HashSecretKeySize = 40;
-    UINT32 RssConfigSize = sizeof(*RssConfig) + HashSecretKeySize + IndirectionTableSize;
+    unique_malloc_ptr<XDP_RSS_CONFIGURATION> OriginalRssConfig;
+    UINT32 RssConfigSize;
+    UINT32 OriginalRssConfigSize;
+    VOID *HashSecretKey;
+    VOID *OriginalHashSecretKey;
+    VOID *IndirectionTable;
+    VOID *OriginalIndirectionTable;
 
     //
-    // Form the XdpSetRss input.
+    // Only run if we have at least 2 LPs.
+    // Our expected test automation environment is at least a 2VP VM.
     //
-
-    RssConfig.reset((XDP_RSS_CONFIGURATION *)malloc(RssConfigSize));
-    XdpInitializeRssConfiguration(RssConfig.get(), RssConfigSize);
-    RssConfig->HashSecretKeyOffset = sizeof(*RssConfig);
-    RssConfig->IndirectionTableOffset = RssConfig->HashSecretKeyOffset + HashSecretKeySize;
-
-    PROCESSOR_NUMBER *IndirectionTableDst =
-        (PROCESSOR_NUMBER *)RTL_PTR_ADD(RssConfig.get(), RssConfig->IndirectionTableOffset);
-    RtlCopyMemory(IndirectionTableDst, IndirectionTable.get(), IndirectionTableSize);
-
-    RssConfig->Flags =
-        XDP_RSS_FLAG_SET_HASH_TYPE | XDP_RSS_FLAG_SET_HASH_SECRET_KEY |
-        XDP_RSS_FLAG_SET_INDIRECTION_TABLE;
-    RssConfig->HashType = XDP_RSS_HASH_TYPE_TCP_IPV4 | XDP_RSS_HASH_TYPE_TCP_IPV6;
-    RssConfig->HashSecretKeySize = HashSecretKeySize;
-    RssConfig->IndirectionTableSize = (USHORT)IndirectionTableSize;
+    if (GetProcessorCount() < 2) {
+        TEST_WARNING("Test requires at least 2 logical processors. Skipping.");
+        return;
+    }
 
     //
-    // Set an OID filter, initiate XdpSetRss, verify the resulting OID, close
-    // the handle to allow OID completion.
+    // Get original RSS settings and configure new settings.
     //
 
-    OID_KEY Key;
-    InitializeOidKey(&Key, OID_GEN_RECEIVE_SCALE_PARAMETERS, NdisRequestSetInformation);
-    MpOidFilter(AdapterMp, &Key, 1);
+    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+    OriginalRssConfig = GetXdpRss(InterfaceHandle, &OriginalRssConfigSize);
+
+    RssConfig.reset((XDP_RSS_CONFIGURATION *)malloc(OriginalRssConfigSize));
+    RtlCopyMemory(RssConfig.get(), OriginalRssConfig.get(), OriginalRssConfigSize);
+    RssConfigSize = OriginalRssConfigSize;
 
-    auto AsyncThread = std::async(
-        std::launch::async,
-        [&] {
-            return TryRssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
-        }
-    );
+    RssConfig->Flags = XDP_RSS_FLAG_SET_HASH_TYPE;
+    RssConfig->HashType =
+        RssConfig->HashType ^ (XDP_RSS_HASH_TYPE_TCP_IPV4 | XDP_RSS_HASH_TYPE_TCP_IPV6);
 
-    UINT32 OidInfoBufferLength;
-    unique_malloc_ptr<VOID> OidInfoBuffer =
-        MpOidAllocateAndGetRequest(AdapterMp, Key, &OidInfoBufferLength);
+    RssConfig->Flags = XDP_RSS_FLAG_SET_HASH_SECRET_KEY;
+    TEST_TRUE(RssConfig->HashSecretKeySize > 0);
+    HashSecretKey = (UCHAR *)RTL_PTR_ADD(RssConfig.get(), RssConfig->HashSecretKeyOffset);
+    ((UCHAR *)HashSecretKey)[0] = ~(((UCHAR *)HashSecretKey)[0]);
 
-    NDIS_RECEIVE_SCALE_PARAMETERS *NdisParams =
-        (NDIS_RECEIVE_SCALE_PARAMETERS *)OidInfoBuffer.get();
-    TEST_EQUAL(NdisParams->IndirectionTableSize, IndirectionTableSize);
-    PROCESSOR_NUMBER *NdisIndirectionTable =
-        (PROCESSOR_NUMBER *)RTL_PTR_ADD(NdisParams, NdisParams->IndirectionTableOffset);
-    TEST_TRUE(RtlEqualMemory(NdisIndirectionTable, IndirectionTable.get(), IndirectionTableSize));
+    RssConfig->Flags = XDP_RSS_FLAG_SET_INDIRECTION_TABLE;
+    TEST_TRUE(RssConfig->IndirectionTableSize >= (2 * sizeof(PROCESSOR_NUMBER)));
+    RssConfig->IndirectionTableSize /= 2;
 
-    AdapterMp.reset();
-    TEST_EQUAL(AsyncThread.wait_for(TEST_TIMEOUT_ASYNC), std::future_status::ready);
-    TEST_HRESULT(AsyncThread.get());
-}
+    RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
 
-static
-VOID
-IndicateOnAllActiveRssQueues(
-    _In_ TestInterface &If,
-    _In_ UINT32 NumRssQueues
-    )
-{
-    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    FnMpIf.Restart();
 
-    UCHAR Payload[] = "IndicateOnAllActiveRssQueuesQ#";
+    //
+    // Verify old handle is invalid.
+    //
 
-    DATA_BUFFER Buffer = {0};
-    Buffer.DataOffset = 0;
-    Buffer.DataLength = sizeof(Payload);
-    Buffer.BufferLength = Buffer.DataLength;
-    Buffer.VirtualAddress = Payload;
+    UINT32 Size = RssConfigSize;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_READY),
+        TryRssGet(InterfaceHandle.get(), RssConfig.get(), &Size));
 
-    for (UINT32 i = 0; i < NumRssQueues; i++) {
-        Payload[sizeof(Payload) - 1] = (UCHAR)i;
-        RX_FRAME Frame;
-        RxInitializeFrame(&Frame, i, &Buffer);
-        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_READY),
+        TryRssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize));
 
-        DATA_FLUSH_OPTIONS FlushOptions = {0};
-        FlushOptions.Flags.RssCpu = TRUE;
-        FlushOptions.RssCpuQueueId = i;
-        TEST_HRESULT(TryMpRxFlush(GenericMp, &FlushOptions));
-    }
-}
+    InterfaceHandle.reset();
 
-static
-VOID
-PrintProcArray(
-    _In_ const char* Prefix,
-    _In_ const std::vector<UINT32> &ProcArray
-    )
-{
-    std::string Msg;
+    //
+    // Verify original RSS settings are restored.
+    //
 
-    Msg += Prefix;
-    Msg += "[";
-    for (int i = 0; i < ProcArray.size(); i++) {
-        Msg += std::to_string(ProcArray[i]);
-        if (i != ProcArray.size() - 1) {
-            Msg += ",";
+    //
+    // Wait for the interface to be up and RSS to be configured by the upper
+    // layer protocol.
+    //
+    Stopwatch<std::chrono::milliseconds> Watchdog(MP_RESTART_TIMEOUT);
+    HRESULT Result = S_OK;
+    do {
+        Result = TryInterfaceOpen(FnMpIf.GetIfIndex(), InterfaceHandle);
+        if (FAILED(Result)) {
+            TEST_EQUAL(HRESULT_FROM_WIN32(ERROR_NOT_FOUND), Result);
+            continue;
         }
-    }
-    Msg += "]";
 
-    TraceVerbose("%s", Msg.c_str());
-}
+        Size = 0;
+        Result = TryRssGet(InterfaceHandle.get(), NULL, &Size);
+        if (Result == HRESULT_FROM_WIN32(ERROR_MORE_DATA)) {
+            break;
+        }
+    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+    TEST_EQUAL(HRESULT_FROM_WIN32(ERROR_MORE_DATA), Result);
 
-static
-VOID
-VerifyRssSettings(
-    _In_ const TestInterface &If,
-    _In_ const unique_malloc_ptr<PROCESSOR_NUMBER> &ExpectedXdpIndirectionTable,
-    _In_ UINT32 ExpectedXdpIndirectionTableSize
-    )
-{
-    unique_malloc_ptr<PROCESSOR_NUMBER> IndirectionTable;
-    UINT32 IndirectionTableSize;
+    RssConfig = GetXdpRss(InterfaceHandle, &RssConfigSize);
 
-    GetXdpRssIndirectionTable(If, IndirectionTable, IndirectionTableSize);
-    TEST_EQUAL(IndirectionTableSize, ExpectedXdpIndirectionTableSize);
+    TEST_EQUAL(RssConfig->Flags, OriginalRssConfig->Flags);
+    TEST_EQUAL(RssConfig->HashType, OriginalRssConfig->HashType);
+
+    TEST_EQUAL(RssConfig->HashSecretKeySize, OriginalRssConfig->HashSecretKeySize);
+    HashSecretKey = RTL_PTR_ADD(RssConfig.get(), RssConfig->HashSecretKeyOffset);
+    OriginalHashSecretKey =
+        RTL_PTR_ADD(OriginalRssConfig.get(), OriginalRssConfig->HashSecretKeyOffset);
     TEST_TRUE(
-        RtlEqualMemory(
-            IndirectionTable.get(), ExpectedXdpIndirectionTable.get(), IndirectionTableSize));
-}
+        RtlEqualMemory(HashSecretKey, OriginalHashSecretKey, RssConfig->HashSecretKeySize));
 
-typedef struct _PROCESSOR_NUMBER_COMP {
-    bool operator()(const PROCESSOR_NUMBER &A, const PROCESSOR_NUMBER &B) const {
-        return (A.Group == B.Group) ? A.Number < B.Number : A.Group < B.Group;
-    }
-} PROCESSOR_NUMBER_COMP;
+    TEST_EQUAL(RssConfig->IndirectionTableSize, OriginalRssConfig->IndirectionTableSize);
+    IndirectionTable = RTL_PTR_ADD(RssConfig.get(), RssConfig->IndirectionTableOffset);
+    OriginalIndirectionTable =
+        RTL_PTR_ADD(OriginalRssConfig.get(), OriginalRssConfig->IndirectionTableOffset);
+    TEST_TRUE(
+        RtlEqualMemory(IndirectionTable, OriginalIndirectionTable, RssConfig->IndirectionTableSize));
+}
 
-static
-std::set<PROCESSOR_NUMBER, PROCESSOR_NUMBER_COMP>
-GetRssProcessorSetFromIndirectionTable(
-    _In_ const PROCESSOR_NUMBER *IndirectionTable,
-    _In_ UINT32 IndirectionTableSize
-    )
+VOID
+OffloadRssUpperSet()
 {
-    std::set<PROCESSOR_NUMBER, PROCESSOR_NUMBER_COMP> RssProcessors;
+    wil::unique_handle InterfaceHandle;
+    unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig;
+    unique_malloc_ptr<NDIS_RECEIVE_SCALE_PARAMETERS> NdisRssParams;
+    unique_malloc_ptr<NDIS_RECEIVE_SCALE_PARAMETERS> OriginalNdisRssParams;
+    NDIS_RECEIVE_SCALE_PARAMETERS UpperNdisRssParams = {0};
+    unique_malloc_ptr<XDP_RSS_CONFIGURATION> LowerRssConfig;
+    UINT32 RssConfigSize;
+    UINT32 NdisRssParamsSize;
+    UINT32 OriginalNdisRssParamsSize;
+    UINT32 UpperNdisRssParamsSize;
+    UINT32 LowerRssConfigSize;
+    const UINT32 LowerXdpRssHashType = XDP_RSS_HASH_TYPE_TCP_IPV4;
+    const UINT32 UpperXdpRssHashType = XDP_RSS_HASH_TYPE_TCP_IPV6;
+    const UINT32 UpperNdisRssHashType = NDIS_HASH_TCP_IPV6;
+    OID_KEY OidKey;
+    auto DefaultLwf = LwfOpenDefault(FnMpIf.GetIfIndex());
 
     //
-    // Convert indirection table to processor set.
+    // Only run if we have at least 2 LPs.
+    // Our expected test automation environment is at least a 2VP VM.
     //
-    for (UINT32 Index = 0;
-        Index < IndirectionTableSize / sizeof(*IndirectionTable);
-        Index++) {
-        PROCESSOR_NUMBER Processor = IndirectionTable[Index];
-        RssProcessors.insert(Processor);
+    if (GetProcessorCount() < 2) {
+        TEST_WARNING("Test requires at least 2 logical processors. Skipping.");
+        return;
     }
 
-    return RssProcessors;
-}
-
-static
-VOID
-VerifyRssDatapath(
-    _In_ TestInterface &If,
-    _In_ const unique_malloc_ptr<PROCESSOR_NUMBER> &IndirectionTable,
-    _In_ UINT32 IndirectionTableSize
-    )
-{
-    std::set<PROCESSOR_NUMBER, PROCESSOR_NUMBER_COMP> RssProcessors =
-        GetRssProcessorSetFromIndirectionTable(IndirectionTable.get(), IndirectionTableSize);
-
     //
-    // Indicate RX on each miniport RSS queue and capture all packets after XDP
-    // passes them up.
+    // Get original settings (both XDP and NDIS formats for convenience).
     //
 
-    auto DefaultLwf = LwfOpenDefault(If.GetIfIndex());
-    UCHAR Pattern = 0x00;
-    UCHAR Mask = 0x00;
-    auto LwfFilter = LwfRxFilter(DefaultLwf, &Pattern, &Mask, sizeof(Pattern));
+    InitializeOidKey(&OidKey, OID_GEN_RECEIVE_SCALE_PARAMETERS, NdisRequestQueryInformation);
+    OriginalNdisRssParams =
+        LwfOidAllocateAndSubmitRequest<NDIS_RECEIVE_SCALE_PARAMETERS>(
+            DefaultLwf, OidKey, &OriginalNdisRssParamsSize);
 
-    IndicateOnAllActiveRssQueues(If, (UINT32)RssProcessors.size());
+    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+    RssConfig = GetXdpRss(InterfaceHandle, &RssConfigSize);
 
     //
-    // Verify that the resulting indications are as expected.
-    //
-    // XDP's current level of RSS offload data path translation is zeroing out
-    // the NBL hash OOB and maintaining the same processor for indication. So
-    // verify that a single packet was indicated on each processor in the
-    // miniport's RSS processor set and that its RSS hash is 0.
+    // Set lower edge settings via XDP.
     //
+    LowerRssConfig.reset((XDP_RSS_CONFIGURATION *)malloc(RssConfigSize));
+    LowerRssConfigSize = RssConfigSize;
+    RtlCopyMemory(LowerRssConfig.get(), RssConfig.get(), RssConfigSize);
+    LowerRssConfig->Flags = XDP_RSS_FLAG_SET_HASH_TYPE;
+    LowerRssConfig->HashType = LowerXdpRssHashType;
+    RssSet(InterfaceHandle.get(), LowerRssConfig.get(), LowerRssConfigSize);
 
-    UINT32 NumRssProcessors = (UINT32)RssProcessors.size();
-    for (UINT32 Index = 0; Index < NumRssProcessors; Index++) {
-        auto Frame = LwfRxAllocateAndGetFrame(DefaultLwf, Index);
-        PROCESSOR_NUMBER Processor = Frame->Output.ProcessorNumber;
-        TEST_EQUAL(1, RssProcessors.erase(Processor));
-        TEST_EQUAL(0, Frame->Output.RssHash);
-    }
-
-    UINT32 FrameLength = 0;
-    TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
-        LwfRxGetFrame(DefaultLwf, NumRssProcessors, &FrameLength, NULL));
-}
-
-VOID
-OffloadRssError()
-{
-    wil::unique_handle InterfaceHandle;
-    unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig;
-    UINT16 IndirectionTableSize = 1 * sizeof(PROCESSOR_NUMBER);
-    UINT32 RssConfigSize = sizeof(*RssConfig) + IndirectionTableSize;
+    //
+    // Set upper edge settings via NDIS.
+    //
+    InitializeOidKey(&OidKey, OID_GEN_RECEIVE_SCALE_PARAMETERS, NdisRequestSetInformation);
+    UpperNdisRssParams.Header.Type = NDIS_OBJECT_TYPE_RSS_PARAMETERS;
+    UpperNdisRssParams.Header.Revision = NDIS_RECEIVE_SCALE_PARAMETERS_REVISION_2;
+    UpperNdisRssParams.Header.Size = NDIS_SIZEOF_RECEIVE_SCALE_PARAMETERS_REVISION_2;
+    UpperNdisRssParams.Flags =
+        NDIS_RSS_PARAM_FLAG_BASE_CPU_UNCHANGED |
+        NDIS_RSS_PARAM_FLAG_ITABLE_UNCHANGED |
+        NDIS_RSS_PARAM_FLAG_HASH_KEY_UNCHANGED;
+    UpperNdisRssParams.HashInformation =
+        NDIS_RSS_HASH_INFO_FROM_TYPE_AND_FUNC(
+            UpperNdisRssHashType, NdisHashFunctionToeplitz);
+    UpperNdisRssParamsSize = sizeof(UpperNdisRssParams);
+    TEST_HRESULT(
+        LwfOidSubmitRequest(
+            DefaultLwf, OidKey, &UpperNdisRssParamsSize, &UpperNdisRssParams));
 
     //
-    // Only run if we have at least 2 LPs.
-    // Our expected test automation environment is at least a 2VP VM.
+    // Upon test case exit, revert to original upper edge settings.
     //
-    if (GetProcessorCount() < 2) {
-        TEST_WARNING("Test requires at least 2 logical processors. Skipping.");
-        return;
-    }
+    auto RssScopeGuard = wil::scope_exit([&]
+    {
+        if (OriginalNdisRssParams.get() != NULL) {
+            OidKey.Oid = OID_GEN_RECEIVE_SCALE_PARAMETERS;
+            OidKey.RequestType = NdisRequestSetInformation;
+            LwfOidSubmitRequest(
+                DefaultLwf, OidKey, &OriginalNdisRssParamsSize, OriginalNdisRssParams.get());
+        }
+    });
 
     //
-    // Open with invalid IfIndex.
+    // Verify upper edge settings.
     //
-    TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
-        TryInterfaceOpen(MAXUINT32, InterfaceHandle));
-
-    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+    InitializeOidKey(&OidKey, OID_GEN_RECEIVE_SCALE_PARAMETERS, NdisRequestQueryInformation);
+    NdisRssParams =
+        LwfOidAllocateAndSubmitRequest<NDIS_RECEIVE_SCALE_PARAMETERS>(
+            DefaultLwf, OidKey, &NdisRssParamsSize);
+    TEST_EQUAL(NdisRssParams->HashInformation, UpperNdisRssParams.HashInformation);
+    TEST_TRUE(UpperNdisRssParams.HashInformation != OriginalNdisRssParams->HashInformation);
 
     //
-    // Work around issue #3: if TCPIP hasn't already plumbed RSS configuration,
-    // XDP fails to partially set RSS. Wait for TCPIP's configuration before
-    // continuing with this test case.
+    // Verify lower edge settings persist.
     //
-    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
-    HRESULT CurrentRssResult;
-    do {
-        UINT32 CurrentRssConfigSize = 0;
-        CurrentRssResult = TryRssGet(InterfaceHandle.get(), NULL, &CurrentRssConfigSize);
-        if (CurrentRssResult == HRESULT_FROM_WIN32(ERROR_MORE_DATA)) {
-            break;
-        }
-    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
-    TEST_EQUAL(HRESULT_FROM_WIN32(ERROR_MORE_DATA), CurrentRssResult);
-
-    RssConfig.reset((XDP_RSS_CONFIGURATION *)malloc(RssConfigSize));
-
-    XdpInitializeRssConfiguration(RssConfig.get(), RssConfigSize);
-    RssConfig->Flags = XDP_RSS_FLAG_SET_INDIRECTION_TABLE;
-    RssConfig->IndirectionTableSize = IndirectionTableSize;
-    RssConfig->IndirectionTableOffset = sizeof(*RssConfig);
+    RssConfig = GetXdpRss(InterfaceHandle, &RssConfigSize);
+    TEST_EQUAL(RssConfig->HashType, LowerRssConfig->HashType);
 
-    PROCESSOR_NUMBER *IndirectionTable =
-        (PROCESSOR_NUMBER *)RTL_PTR_ADD(RssConfig.get(), RssConfig->IndirectionTableOffset);
-    IndirectionTable[0].Number = 1;
-    RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
+    //
+    // Reset lower edge settings.
+    //
     InterfaceHandle.reset();
-    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
-
-    for (auto Case : RxTxTestCases) {
-        auto Socket = SetupSocket(FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), Case.Rx, Case.Tx, XDP_GENERIC);
-        RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
-    }
 
     //
-    // Set while another handle has already set.
+    // Verify lower edge settings now match upper edge.
     //
+    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+    RssConfig = GetXdpRss(InterfaceHandle, &RssConfigSize);
+    TEST_EQUAL(RssConfig->HashType, UpperXdpRssHashType);
+}
 
-    RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
+static
+VOID
+CreateIndirectionTable(
+    _In_ const std::vector<UINT32> &ProcessorIndices,
+    _Out_ unique_malloc_ptr<PROCESSOR_NUMBER> &IndirectionTable,
+    _Out_ UINT32 *IndirectionTableSize
+    )
+{
+    *IndirectionTableSize = (UINT32)ProcessorIndices.size() * sizeof(*IndirectionTable);
 
-    wil::unique_handle InterfaceHandle2 = InterfaceOpen(FnMpIf.GetIfIndex());
-    TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_BAD_COMMAND),
-        TryRssSet(InterfaceHandle2.get(), RssConfig.get(), RssConfigSize));
+    IndirectionTable.reset((PROCESSOR_NUMBER *)malloc(*IndirectionTableSize));
+    TEST_TRUE(IndirectionTable.get() != NULL);
+
+    RtlZeroMemory(IndirectionTable.get(), *IndirectionTableSize);
+    for (UINT32 i = 0; i < ProcessorIndices.size(); i++) {
+        ProcessorIndexToProcessorNumber(ProcessorIndices[i], &IndirectionTable.get()[i]);
+    }
 }
 
 VOID
-OffloadRssReference()
+OffloadRssSingleSet(
+    _In_ const std::vector<UINT32> &ProcessorIndices
+    )
 {
+    unique_malloc_ptr<PROCESSOR_NUMBER> IndirectionTable;
+    unique_malloc_ptr<PROCESSOR_NUMBER> OldIndirectionTable;
+    unique_malloc_ptr<PROCESSOR_NUMBER> ResetIndirectionTable;
     wil::unique_handle InterfaceHandle;
-    unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig;
-    unique_malloc_ptr<XDP_RSS_CONFIGURATION> ModifiedRssConfig;
-    unique_malloc_ptr<XDP_RSS_CONFIGURATION> OriginalRssConfig;
-    UINT32 RssConfigSize;
-    UINT32 ModifiedRssConfigSize;
-    UINT32 OriginalRssConfigSize;
+    UINT32 IndirectionTableSize;
+    UINT32 OldIndirectionTableSize;
+    UINT32 ResetIndirectionTableSize;
 
-    //
-    // Only run if we have at least 2 LPs.
-    // Our expected test automation environment is at least a 2VP VM.
-    //
-    if (GetProcessorCount() < 2) {
-        TEST_WARNING("Test requires at least 2 logical processors. Skipping.");
-        return;
-    }
+    PrintProcArray("OffloadRssSingleSet:", ProcessorIndices);
 
-    for (auto Case : RxTxTestCases) {
-        //
-        // Get original RSS settings.
-        //
-        InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
-        OriginalRssConfig = GetXdpRss(InterfaceHandle, &OriginalRssConfigSize);
+    CreateIndirectionTable(ProcessorIndices, IndirectionTable, &IndirectionTableSize);
 
-        //
-        // Configure new RSS settings.
-        //
+    GetXdpRssIndirectionTable(FnMpIf, OldIndirectionTable, OldIndirectionTableSize);
 
-        ModifiedRssConfigSize = OriginalRssConfigSize;
-        ModifiedRssConfig.reset((XDP_RSS_CONFIGURATION *)malloc(ModifiedRssConfigSize));
+    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+    SetXdpRss(FnMpIf, InterfaceHandle, IndirectionTable, IndirectionTableSize);
+    VerifyRssSettings(FnMpIf, IndirectionTable, IndirectionTableSize);
+    VerifyRssDatapath(FnMpIf, IndirectionTable, IndirectionTableSize);
 
-        XdpInitializeRssConfiguration(ModifiedRssConfig.get(), ModifiedRssConfigSize);
-        ModifiedRssConfig->Flags = XDP_RSS_FLAG_SET_HASH_TYPE;
-        ModifiedRssConfig->HashType =
-            OriginalRssConfig->HashType ^ (XDP_RSS_HASH_TYPE_TCP_IPV4 | XDP_RSS_HASH_TYPE_TCP_IPV6);
-        TEST_TRUE(ModifiedRssConfig->HashType != OriginalRssConfig->HashType);
+    InterfaceHandle.reset();
+    GetXdpRssIndirectionTable(FnMpIf, ResetIndirectionTable, ResetIndirectionTableSize);
+    TEST_EQUAL(ResetIndirectionTableSize, OldIndirectionTableSize);
+    TEST_TRUE(
+        RtlEqualMemory(
+            ResetIndirectionTable.get(), OldIndirectionTable.get(), ResetIndirectionTableSize));
+}
 
-        RssSet(InterfaceHandle.get(), ModifiedRssConfig.get(), ModifiedRssConfigSize);
+VOID
+OffloadRssSubsequentSet(
+    _In_ const std::vector<UINT32> &ProcessorIndices1,
+    _In_ const std::vector<UINT32> &ProcessorIndices2
+    )
+{
+    wil::unique_handle InterfaceHandle;
+    unique_malloc_ptr<PROCESSOR_NUMBER> IndirectionTable1;
+    unique_malloc_ptr<PROCESSOR_NUMBER> IndirectionTable2;
+    UINT32 IndirectionTable1Size;
+    UINT32 IndirectionTable2Size;
 
-        //
-        // Bind socket (and setup RX program).
-        //
-        auto Socket =
-            SetupSocket(
-                FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), Case.Rx, Case.Tx, XDP_GENERIC);
+    TraceVerbose("OffloadRssSubsequentSet");
+    PrintProcArray("XDP1:", ProcessorIndices1);
+    PrintProcArray("XDP2:", ProcessorIndices2);
 
-        //
-        // Close RSS handle.
-        //
-        InterfaceHandle.reset();
+    CreateIndirectionTable(ProcessorIndices1, IndirectionTable1, &IndirectionTable1Size);
+    CreateIndirectionTable(ProcessorIndices2, IndirectionTable2, &IndirectionTable2Size);
 
-        //
-        // Verify RSS settings restored.
-        //
-        InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
-        RssConfig = GetXdpRss(InterfaceHandle, &RssConfigSize);
-        TEST_EQUAL(RssConfig->HashType, OriginalRssConfig->HashType);
-    }
+    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+
+    SetXdpRss(FnMpIf, InterfaceHandle, IndirectionTable1, IndirectionTable2Size);
+    VerifyRssSettings(FnMpIf, IndirectionTable1, IndirectionTable2Size);
+    VerifyRssDatapath(FnMpIf, IndirectionTable1, IndirectionTable2Size);
+
+    SetXdpRss(FnMpIf, InterfaceHandle, IndirectionTable2, IndirectionTable2Size);
+    VerifyRssSettings(FnMpIf, IndirectionTable2, IndirectionTable2Size);
+    VerifyRssDatapath(FnMpIf, IndirectionTable2, IndirectionTable2Size);
 }
 
 VOID
-OffloadRssUnchanged()
+OffloadRssSet()
 {
-    wil::unique_handle InterfaceHandle;
-    unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig;
-    UINT32 RssConfigSize;
-    UCHAR *HashSecretKey;
-    PROCESSOR_NUMBER *IndirectionTable;
-
     //
     // Only run if we have at least 2 LPs.
     // Our expected test automation environment is at least a 2VP VM.
@@ -6240,71 +14761,59 @@ OffloadRssUnchanged()
         return;
     }
 
-    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
-
-    //
-    // Hash type.
-    //
-    RssConfig = GetXdpRss(InterfaceHandle, &RssConfigSize);
-    UINT32 ExpectedHashType = RssConfig->HashType;
-    RssConfig->Flags = XDP_RSS_FLAG_SET_HASH_SECRET_KEY | XDP_RSS_FLAG_SET_INDIRECTION_TABLE;
-    RssConfig->HashType = 0;
-    RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
-    RssConfig = GetXdpRss(InterfaceHandle);
-    TEST_EQUAL(RssConfig->HashType, ExpectedHashType);
-
-    //
-    // Hash secret key.
-    //
-    RssConfig = GetXdpRss(InterfaceHandle, &RssConfigSize);
-    HashSecretKey = (UCHAR *)RTL_PTR_ADD(RssConfig.get(), RssConfig->HashSecretKeyOffset);
-    UCHAR ExpectedHashSecretKey[40];
-    UINT32 ExpectedHashSecretKeySize = RssConfig->HashSecretKeySize;
-    ASSERT(ExpectedHashSecretKeySize <= sizeof(ExpectedHashSecretKey));
-    RtlCopyMemory(&ExpectedHashSecretKey, HashSecretKey, RssConfig->HashSecretKeySize);
-    RssConfig->Flags = XDP_RSS_FLAG_SET_HASH_TYPE | XDP_RSS_FLAG_SET_INDIRECTION_TABLE;
-    RtlZeroMemory(HashSecretKey, RssConfig->HashSecretKeySize);
-    RssConfig->HashSecretKeySize = 0;
-    RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
-    RssConfig = GetXdpRss(InterfaceHandle);
-    TEST_EQUAL(RssConfig->HashSecretKeySize, ExpectedHashSecretKeySize);
-    HashSecretKey = (UCHAR *)RTL_PTR_ADD(RssConfig.get(), RssConfig->HashSecretKeyOffset);
-    TEST_TRUE(RtlEqualMemory(HashSecretKey, &ExpectedHashSecretKey, ExpectedHashSecretKeySize));
-
-    //
-    // Indirection table.
-    //
-    RssConfig = GetXdpRss(InterfaceHandle, &RssConfigSize);
-    IndirectionTable =
-        (PROCESSOR_NUMBER *)RTL_PTR_ADD(RssConfig.get(), RssConfig->IndirectionTableOffset);
-    PROCESSOR_NUMBER ExpectedIndirectionTable[128];
-    UINT32 ExpectedIndirectionTableSize = RssConfig->IndirectionTableSize;
-    ASSERT(ExpectedIndirectionTableSize <= sizeof(ExpectedIndirectionTable));
-    RtlCopyMemory(&ExpectedIndirectionTable, IndirectionTable, RssConfig->IndirectionTableSize);
-    RssConfig->Flags = XDP_RSS_FLAG_SET_HASH_TYPE | XDP_RSS_FLAG_SET_HASH_SECRET_KEY;
-    RtlZeroMemory(IndirectionTable, RssConfig->IndirectionTableSize);
-    RssConfig->IndirectionTableSize = 0;
-    RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
-    RssConfig = GetXdpRss(InterfaceHandle);
-    TEST_EQUAL(RssConfig->IndirectionTableSize, ExpectedIndirectionTableSize);
-    IndirectionTable =
-        (PROCESSOR_NUMBER *)RTL_PTR_ADD(RssConfig.get(), RssConfig->IndirectionTableOffset);
-    TEST_TRUE(
-        RtlEqualMemory(IndirectionTable, &ExpectedIndirectionTable, ExpectedIndirectionTableSize));
+    OffloadRssSingleSet({0});
+    OffloadRssSingleSet({1});
+    OffloadRssSingleSet({0,1});
+
+    OffloadRssSubsequentSet({0}, {1});
+
+    if (GetProcessorCount() >= 4) {
+        OffloadRssSingleSet({0,2});
+        OffloadRssSingleSet({1,3});
+        OffloadRssSingleSet({0,1,2,3});
+
+        OffloadRssSubsequentSet({0,2}, {1,3});
+    }
 }
 
 VOID
-OffloadRssInterfaceRestart()
+OffloadRssCapabilities()
 {
     wil::unique_handle InterfaceHandle;
-    unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig;
-    unique_malloc_ptr<XDP_RSS_CONFIGURATION> OriginalRssConfig;
-    UINT32 RssConfigSize;
-    UINT32 OriginalRssConfigSize;
-    VOID *HashSecretKey;
-    VOID *OriginalHashSecretKey;
-    VOID *IndirectionTable;
-    VOID *OriginalIndirectionTable;
+    unique_malloc_ptr<XDP_RSS_CAPABILITIES> RssCapabilities;
+    UINT32 Size = 0;
+
+    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_MORE_DATA),
+        TryRssGetCapabilities(InterfaceHandle.get(), NULL, &Size));
+    TEST_EQUAL(Size, XDP_SIZEOF_RSS_CAPABILITIES_REVISION_2);
+
+    RssCapabilities.reset((XDP_RSS_CAPABILITIES *)malloc(Size));
+    TEST_TRUE(RssCapabilities.get() != NULL);
+
+    RssGetCapabilities(InterfaceHandle.get(), RssCapabilities.get(), &Size);
+    TEST_EQUAL(RssCapabilities->Header.Revision, XDP_RSS_CAPABILITIES_REVISION_2);
+    TEST_EQUAL(RssCapabilities->Header.Size, XDP_SIZEOF_RSS_CAPABILITIES_REVISION_2);
+    TEST_EQUAL(
+        RssCapabilities->HashTypes,
+        (XDP_RSS_HASH_TYPE_IPV4 | XDP_RSS_HASH_TYPE_IPV6 |
+            XDP_RSS_HASH_TYPE_TCP_IPV4 | XDP_RSS_HASH_TYPE_TCP_IPV6));
+    TEST_EQUAL(RssCapabilities->HashSecretKeySize, 40);
+    TEST_EQUAL(RssCapabilities->NumberOfReceiveQueues, FNMP_DEFAULT_RSS_QUEUES);
+    TEST_EQUAL(RssCapabilities->NumberOfIndirectionTableEntries, FNMP_MAX_RSS_INDIR_COUNT);
+}
+
+VOID
+OffloadRssReset()
+{
+    auto &If = FnMpIf;
+    unique_malloc_ptr<PROCESSOR_NUMBER> IndirectionTable;
+    unique_malloc_ptr<PROCESSOR_NUMBER> OriginalIndirectionTable;
+    unique_malloc_ptr<PROCESSOR_NUMBER> ResetIndirectionTable;
+    UINT32 IndirectionTableSize;
+    UINT32 OriginalIndirectionTableSize;
 
     //
     // Only run if we have at least 2 LPs.
@@ -6315,352 +14824,400 @@ OffloadRssInterfaceRestart()
         return;
     }
 
+    auto InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+    auto AdapterMp = MpOpenAdapter(If.GetIfIndex());
+
     //
-    // Get original RSS settings and configure new settings.
+    // Query the original RSS table. This is what XDP should revert to when the
+    // interface is being torn down.
     //
+    GetXdpRssIndirectionTable(FnMpIf, OriginalIndirectionTable, OriginalIndirectionTableSize);
 
-    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
-    OriginalRssConfig = GetXdpRss(InterfaceHandle, &OriginalRssConfigSize);
+    //
+    // Create and set a new RSS table.
+    //
 
-    RssConfig.reset((XDP_RSS_CONFIGURATION *)malloc(OriginalRssConfigSize));
-    RtlCopyMemory(RssConfig.get(), OriginalRssConfig.get(), OriginalRssConfigSize);
-    RssConfigSize = OriginalRssConfigSize;
+    CreateIndirectionTable({1, 0}, IndirectionTable, &IndirectionTableSize);
+    unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig;
+    UINT16 HashSecretKeySize = 40;
+    UINT32 RssConfigSize = sizeof(*RssConfig) + HashSecretKeySize + IndirectionTableSize;
 
-    RssConfig->Flags = XDP_RSS_FLAG_SET_HASH_TYPE;
-    RssConfig->HashType =
-        RssConfig->HashType ^ (XDP_RSS_HASH_TYPE_TCP_IPV4 | XDP_RSS_HASH_TYPE_TCP_IPV6);
+    RssConfig.reset((XDP_RSS_CONFIGURATION *)malloc(RssConfigSize));
+    XdpInitializeRssConfiguration(RssConfig.get(), RssConfigSize);
+    RssConfig->HashSecretKeyOffset = sizeof(*RssConfig);
+    RssConfig->IndirectionTableOffset = RssConfig->HashSecretKeyOffset + HashSecretKeySize;
 
-    RssConfig->Flags = XDP_RSS_FLAG_SET_HASH_SECRET_KEY;
-    TEST_TRUE(RssConfig->HashSecretKeySize > 0);
-    HashSecretKey = (UCHAR *)RTL_PTR_ADD(RssConfig.get(), RssConfig->HashSecretKeyOffset);
-    ((UCHAR *)HashSecretKey)[0] = ~(((UCHAR *)HashSecretKey)[0]);
+    PROCESSOR_NUMBER *IndirectionTableDst =
+        (PROCESSOR_NUMBER *)RTL_PTR_ADD(RssConfig.get(), RssConfig->IndirectionTableOffset);
+    RtlCopyMemory(IndirectionTableDst, IndirectionTable.get(), IndirectionTableSize);
 
-    RssConfig->Flags = XDP_RSS_FLAG_SET_INDIRECTION_TABLE;
-    TEST_TRUE(RssConfig->IndirectionTableSize >= (2 * sizeof(PROCESSOR_NUMBER)));
-    RssConfig->IndirectionTableSize /= 2;
+    RssConfig->Flags =
+        XDP_RSS_FLAG_SET_HASH_TYPE | XDP_RSS_FLAG_SET_HASH_SECRET_KEY |
+        XDP_RSS_FLAG_SET_INDIRECTION_TABLE;
+    RssConfig->HashType = XDP_RSS_HASH_TYPE_TCP_IPV4 | XDP_RSS_HASH_TYPE_TCP_IPV6;
+    RssConfig->HashSecretKeySize = HashSecretKeySize;
+    RssConfig->IndirectionTableSize = (USHORT)IndirectionTableSize;
 
     RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
 
-    FnMpIf.Restart();
-
-    //
-    // Verify old handle is invalid.
-    //
-
-    UINT32 Size = RssConfigSize;
-    TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_NOT_READY),
-        TryRssGet(InterfaceHandle.get(), RssConfig.get(), &Size));
-
-    TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_NOT_READY),
-        TryRssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize));
-
-    InterfaceHandle.reset();
-
     //
-    // Verify original RSS settings are restored.
+    // Set an OID filter, start tearing down the NIC and filter binding, verify
+    // the resulting OID, then close the handle to allow OID completion.
     //
 
-    //
-    // Wait for the interface to be up and RSS to be configured by the upper
-    // layer protocol.
-    //
-    Stopwatch<std::chrono::milliseconds> Watchdog(MP_RESTART_TIMEOUT);
-    HRESULT Result = S_OK;
-    do {
-        Result = TryInterfaceOpen(FnMpIf.GetIfIndex(), InterfaceHandle);
-        if (FAILED(Result)) {
-            TEST_EQUAL(HRESULT_FROM_WIN32(ERROR_NOT_FOUND), Result);
-            continue;
-        }
+    OID_KEY Key;
+    InitializeOidKey(&Key, OID_GEN_RECEIVE_SCALE_PARAMETERS, NdisRequestSetInformation);
+    MpOidFilter(AdapterMp, &Key, 1);
 
-        Size = 0;
-        Result = TryRssGet(InterfaceHandle.get(), NULL, &Size);
-        if (Result == HRESULT_FROM_WIN32(ERROR_MORE_DATA)) {
-            break;
+    auto AsyncThread = std::async(
+        std::launch::async,
+        [&] {
+            return If.TryUnbindXdp();
         }
-    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
-    TEST_EQUAL(HRESULT_FROM_WIN32(ERROR_MORE_DATA), Result);
+    );
 
-    RssConfig = GetXdpRss(InterfaceHandle, &RssConfigSize);
+    auto BindingScopeGuard = wil::scope_exit([&]
+    {
+        TEST_HRESULT(If.TryRebindXdp());
+    });
 
-    TEST_EQUAL(RssConfig->Flags, OriginalRssConfig->Flags);
-    TEST_EQUAL(RssConfig->HashType, OriginalRssConfig->HashType);
+    UINT32 OidInfoBufferLength;
+    unique_malloc_ptr<VOID> OidInfoBuffer =
+        MpOidAllocateAndGetRequest(AdapterMp, Key, &OidInfoBufferLength, MP_RESTART_TIMEOUT);
 
-    TEST_EQUAL(RssConfig->HashSecretKeySize, OriginalRssConfig->HashSecretKeySize);
-    HashSecretKey = RTL_PTR_ADD(RssConfig.get(), RssConfig->HashSecretKeyOffset);
-    OriginalHashSecretKey =
-        RTL_PTR_ADD(OriginalRssConfig.get(), OriginalRssConfig->HashSecretKeyOffset);
+    NDIS_RECEIVE_SCALE_PARAMETERS *NdisParams =
+        (NDIS_RECEIVE_SCALE_PARAMETERS *)OidInfoBuffer.get();
+    TEST_EQUAL(NdisParams->IndirectionTableSize, OriginalIndirectionTableSize);
+    PROCESSOR_NUMBER *NdisIndirectionTable =
+        (PROCESSOR_NUMBER *)RTL_PTR_ADD(NdisParams, NdisParams->IndirectionTableOffset);
     TEST_TRUE(
-        RtlEqualMemory(HashSecretKey, OriginalHashSecretKey, RssConfig->HashSecretKeySize));
+        RtlEqualMemory(NdisIndirectionTable,
+        OriginalIndirectionTable.get(),
+        OriginalIndirectionTableSize));
 
-    TEST_EQUAL(RssConfig->IndirectionTableSize, OriginalRssConfig->IndirectionTableSize);
-    IndirectionTable = RTL_PTR_ADD(RssConfig.get(), RssConfig->IndirectionTableOffset);
-    OriginalIndirectionTable =
-        RTL_PTR_ADD(OriginalRssConfig.get(), OriginalRssConfig->IndirectionTableOffset);
-    TEST_TRUE(
-        RtlEqualMemory(IndirectionTable, OriginalIndirectionTable, RssConfig->IndirectionTableSize));
+    AdapterMp.reset();
+    TEST_EQUAL(AsyncThread.wait_for(TEST_TIMEOUT_ASYNC), std::future_status::ready);
+    TEST_HRESULT(AsyncThread.get());
 }
 
 VOID
-OffloadRssUpperSet()
+OffloadRssSymmetric()
 {
     wil::unique_handle InterfaceHandle;
     unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig;
-    unique_malloc_ptr<NDIS_RECEIVE_SCALE_PARAMETERS> NdisRssParams;
-    unique_malloc_ptr<NDIS_RECEIVE_SCALE_PARAMETERS> OriginalNdisRssParams;
-    NDIS_RECEIVE_SCALE_PARAMETERS UpperNdisRssParams = {0};
-    unique_malloc_ptr<XDP_RSS_CONFIGURATION> LowerRssConfig;
-    UINT32 RssConfigSize;
-    UINT32 NdisRssParamsSize;
-    UINT32 OriginalNdisRssParamsSize;
-    UINT32 UpperNdisRssParamsSize;
-    UINT32 LowerRssConfigSize;
-    const UINT32 LowerXdpRssHashType = XDP_RSS_HASH_TYPE_TCP_IPV4;
-    const UINT32 UpperXdpRssHashType = XDP_RSS_HASH_TYPE_TCP_IPV6;
-    const UINT32 UpperNdisRssHashType = NDIS_HASH_TCP_IPV6;
-    OID_KEY OidKey;
-    auto DefaultLwf = LwfOpenDefault(FnMpIf.GetIfIndex());
-
-    //
-    // Only run if we have at least 2 LPs.
-    // Our expected test automation environment is at least a 2VP VM.
-    //
-    if (GetProcessorCount() < 2) {
-        TEST_WARNING("Test requires at least 2 logical processors. Skipping.");
-        return;
-    }
-
-    //
-    // Get original settings (both XDP and NDIS formats for convenience).
-    //
-
-    InitializeOidKey(&OidKey, OID_GEN_RECEIVE_SCALE_PARAMETERS, NdisRequestQueryInformation);
-    OriginalNdisRssParams =
-        LwfOidAllocateAndSubmitRequest<NDIS_RECEIVE_SCALE_PARAMETERS>(
-            DefaultLwf, OidKey, &OriginalNdisRssParamsSize);
+    UINT16 HashSecretKeySize = 40;
+    UINT32 RssConfigSize = sizeof(*RssConfig) + HashSecretKeySize;
+    UCHAR *HashSecretKey;
 
     InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
-    RssConfig = GetXdpRss(InterfaceHandle, &RssConfigSize);
-
-    //
-    // Set lower edge settings via XDP.
-    //
-    LowerRssConfig.reset((XDP_RSS_CONFIGURATION *)malloc(RssConfigSize));
-    LowerRssConfigSize = RssConfigSize;
-    RtlCopyMemory(LowerRssConfig.get(), RssConfig.get(), RssConfigSize);
-    LowerRssConfig->Flags = XDP_RSS_FLAG_SET_HASH_TYPE;
-    LowerRssConfig->HashType = LowerXdpRssHashType;
-    RssSet(InterfaceHandle.get(), LowerRssConfig.get(), LowerRssConfigSize);
-
-    //
-    // Set upper edge settings via NDIS.
-    //
-    InitializeOidKey(&OidKey, OID_GEN_RECEIVE_SCALE_PARAMETERS, NdisRequestSetInformation);
-    UpperNdisRssParams.Header.Type = NDIS_OBJECT_TYPE_RSS_PARAMETERS;
-    UpperNdisRssParams.Header.Revision = NDIS_RECEIVE_SCALE_PARAMETERS_REVISION_2;
-    UpperNdisRssParams.Header.Size = NDIS_SIZEOF_RECEIVE_SCALE_PARAMETERS_REVISION_2;
-    UpperNdisRssParams.Flags =
-        NDIS_RSS_PARAM_FLAG_BASE_CPU_UNCHANGED |
-        NDIS_RSS_PARAM_FLAG_ITABLE_UNCHANGED |
-        NDIS_RSS_PARAM_FLAG_HASH_KEY_UNCHANGED;
-    UpperNdisRssParams.HashInformation =
-        NDIS_RSS_HASH_INFO_FROM_TYPE_AND_FUNC(
-            UpperNdisRssHashType, NdisHashFunctionToeplitz);
-    UpperNdisRssParamsSize = sizeof(UpperNdisRssParams);
-    TEST_HRESULT(
-        LwfOidSubmitRequest(
-            DefaultLwf, OidKey, &UpperNdisRssParamsSize, &UpperNdisRssParams));
 
     //
-    // Upon test case exit, revert to original upper edge settings.
+    // Wait for TCPIP's RSS configuration before setting a partial configuration.
     //
-    auto RssScopeGuard = wil::scope_exit([&]
-    {
-        if (OriginalNdisRssParams.get() != NULL) {
-            OidKey.Oid = OID_GEN_RECEIVE_SCALE_PARAMETERS;
-            OidKey.RequestType = NdisRequestSetInformation;
-            LwfOidSubmitRequest(
-                DefaultLwf, OidKey, &OriginalNdisRssParamsSize, OriginalNdisRssParams.get());
+    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+    HRESULT CurrentRssResult;
+    do {
+        UINT32 CurrentRssConfigSize = 0;
+        CurrentRssResult = TryRssGet(InterfaceHandle.get(), NULL, &CurrentRssConfigSize);
+        if (CurrentRssResult == HRESULT_FROM_WIN32(ERROR_MORE_DATA)) {
+            break;
         }
-    });
+    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+    TEST_EQUAL(HRESULT_FROM_WIN32(ERROR_MORE_DATA), CurrentRssResult);
 
-    //
-    // Verify upper edge settings.
-    //
-    InitializeOidKey(&OidKey, OID_GEN_RECEIVE_SCALE_PARAMETERS, NdisRequestQueryInformation);
-    NdisRssParams =
-        LwfOidAllocateAndSubmitRequest<NDIS_RECEIVE_SCALE_PARAMETERS>(
-            DefaultLwf, OidKey, &NdisRssParamsSize);
-    TEST_EQUAL(NdisRssParams->HashInformation, UpperNdisRssParams.HashInformation);
-    TEST_TRUE(UpperNdisRssParams.HashInformation != OriginalNdisRssParams->HashInformation);
+    RssConfig.reset((XDP_RSS_CONFIGURATION *)malloc(RssConfigSize));
+    TEST_TRUE(RssConfig.get() != NULL);
+    HashSecretKey = (UCHAR *)RTL_PTR_ADD(RssConfig.get(), sizeof(*RssConfig));
 
     //
-    // Verify lower edge settings persist.
+    // A symmetric hash with a key that does not repeat every 16 bits is invalid.
     //
-    RssConfig = GetXdpRss(InterfaceHandle, &RssConfigSize);
-    TEST_EQUAL(RssConfig->HashType, LowerRssConfig->HashType);
+    XdpInitializeRssConfiguration(RssConfig.get(), RssConfigSize);
+    RssConfig->Flags = XDP_RSS_FLAG_SYMMETRIC_HASH | XDP_RSS_FLAG_SET_HASH_SECRET_KEY;
+    RssConfig->HashSecretKeyOffset = sizeof(*RssConfig);
+    RssConfig->HashSecretKeySize = HashSecretKeySize;
+    for (UINT16 Index = 0; Index < HashSecretKeySize; Index++) {
+        HashSecretKey[Index] = (UCHAR)Index;
+    }
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryRssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize));
 
     //
-    // Reset lower edge settings.
+    // A symmetric key is accepted.
     //
-    InterfaceHandle.reset();
+    for (UINT16 Index = 0; Index < HashSecretKeySize; Index++) {
+        HashSecretKey[Index] = (Index % 2 == 0) ? 0x12 : 0x34;
+    }
+    RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
+
+    auto SymmetricRssConfig = GetXdpRss(InterfaceHandle);
+    TEST_TRUE(SymmetricRssConfig->Flags & XDP_RSS_FLAG_SYMMETRIC_HASH);
+    TEST_EQUAL(SymmetricRssConfig->HashSecretKeySize, HashSecretKeySize);
+    TEST_TRUE(
+        RtlEqualMemory(
+            RTL_PTR_ADD(SymmetricRssConfig.get(), SymmetricRssConfig->HashSecretKeyOffset),
+            HashSecretKey, HashSecretKeySize));
 
     //
-    // Verify lower edge settings now match upper edge.
+    // Without a key, XDP generates a symmetric key.
     //
-    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
-    RssConfig = GetXdpRss(InterfaceHandle, &RssConfigSize);
-    TEST_EQUAL(RssConfig->HashType, UpperXdpRssHashType);
+    XdpInitializeRssConfiguration(RssConfig.get(), RssConfigSize);
+    RssConfig->Flags = XDP_RSS_FLAG_SYMMETRIC_HASH;
+    RssSet(InterfaceHandle.get(), RssConfig.get(), sizeof(*RssConfig));
+
+    SymmetricRssConfig = GetXdpRss(InterfaceHandle);
+    TEST_TRUE(SymmetricRssConfig->Flags & XDP_RSS_FLAG_SYMMETRIC_HASH);
+    TEST_TRUE(SymmetricRssConfig->HashSecretKeySize >= 4);
+    HashSecretKey =
+        (UCHAR *)RTL_PTR_ADD(SymmetricRssConfig.get(), SymmetricRssConfig->HashSecretKeyOffset);
+    for (UINT16 Index = 2; Index < SymmetricRssConfig->HashSecretKeySize; Index++) {
+        TEST_EQUAL(HashSecretKey[Index], HashSecretKey[Index - 2]);
+    }
 }
 
 static
-VOID
-CreateIndirectionTable(
-    _In_ const std::vector<UINT32> &ProcessorIndices,
-    _Out_ unique_malloc_ptr<PROCESSOR_NUMBER> &IndirectionTable,
-    _Out_ UINT32 *IndirectionTableSize
+std::vector<PROCESSOR_NUMBER>
+GetNdisRssIndirectionTable(
+    _In_ const NDIS_RECEIVE_SCALE_PARAMETERS *NdisRssParams
     )
 {
-    *IndirectionTableSize = (UINT32)ProcessorIndices.size() * sizeof(*IndirectionTable);
-
-    IndirectionTable.reset((PROCESSOR_NUMBER *)malloc(*IndirectionTableSize));
-    TEST_TRUE(IndirectionTable.get() != NULL);
+    const PROCESSOR_NUMBER *IndirectionTable =
+        (const PROCESSOR_NUMBER *)RTL_PTR_ADD(NdisRssParams, NdisRssParams->IndirectionTableOffset);
 
-    RtlZeroMemory(IndirectionTable.get(), *IndirectionTableSize);
-    for (UINT32 i = 0; i < ProcessorIndices.size(); i++) {
-        ProcessorIndexToProcessorNumber(ProcessorIndices[i], &IndirectionTable.get()[i]);
-    }
+    return
+        std::vector<PROCESSOR_NUMBER>(
+            IndirectionTable,
+            IndirectionTable + NdisRssParams->IndirectionTableSize / sizeof(*IndirectionTable));
 }
 
-VOID
-OffloadRssSingleSet(
-    _In_ const std::vector<UINT32> &ProcessorIndices
+static
+BOOLEAN
+IsSameProcessor(
+    _In_ const PROCESSOR_NUMBER &A,
+    _In_ const PROCESSOR_NUMBER &B
     )
 {
-    unique_malloc_ptr<PROCESSOR_NUMBER> IndirectionTable;
-    unique_malloc_ptr<PROCESSOR_NUMBER> OldIndirectionTable;
-    unique_malloc_ptr<PROCESSOR_NUMBER> ResetIndirectionTable;
-    wil::unique_handle InterfaceHandle;
-    UINT32 IndirectionTableSize;
-    UINT32 OldIndirectionTableSize;
-    UINT32 ResetIndirectionTableSize;
-
-    PrintProcArray("OffloadRssSingleSet:", ProcessorIndices);
+    return A.Group == B.Group && A.Number == B.Number;
+}
 
-    CreateIndirectionTable(ProcessorIndices, IndirectionTable, &IndirectionTableSize);
+static
+std::vector<PROCESSOR_NUMBER>
+RssRebalanceCaptureIndirectionTable(
+    _In_ const unique_fnmp_handle &AdapterMp,
+    _In_ OID_KEY Key
+    )
+{
+    std::vector<PROCESSOR_NUMBER> IndirectionTable;
+    UINT32 OidInfoBufferLength;
+    unique_malloc_ptr<VOID> OidInfoBuffer =
+        MpOidAllocateAndGetRequest(AdapterMp, Key, &OidInfoBufferLength);
 
-    GetXdpRssIndirectionTable(FnMpIf, OldIndirectionTable, OldIndirectionTableSize);
+    IndirectionTable =
+        GetNdisRssIndirectionTable((NDIS_RECEIVE_SCALE_PARAMETERS *)OidInfoBuffer.get());
 
-    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
-    SetXdpRss(FnMpIf, InterfaceHandle, IndirectionTable, IndirectionTableSize);
-    VerifyRssSettings(FnMpIf, IndirectionTable, IndirectionTableSize);
-    VerifyRssDatapath(FnMpIf, IndirectionTable, IndirectionTableSize);
+    TEST_HRESULT(
+        MpOidCompleteRequest(
+            AdapterMp, Key, NDIS_STATUS_SUCCESS, OidInfoBuffer.get(), OidInfoBufferLength));
 
-    InterfaceHandle.reset();
-    GetXdpRssIndirectionTable(FnMpIf, ResetIndirectionTable, ResetIndirectionTableSize);
-    TEST_EQUAL(ResetIndirectionTableSize, OldIndirectionTableSize);
-    TEST_TRUE(
-        RtlEqualMemory(
-            ResetIndirectionTable.get(), OldIndirectionTable.get(), ResetIndirectionTableSize));
+    return IndirectionTable;
 }
 
-VOID
-OffloadRssSubsequentSet(
-    _In_ const std::vector<UINT32> &ProcessorIndices1,
-    _In_ const std::vector<UINT32> &ProcessorIndices2
+static
+BOOLEAN
+RssRebalanceTrigger(
+    _In_ const TestInterface &If,
+    _Out_ std::vector<PROCESSOR_NUMBER> &UpperIndirectionTable,
+    _Out_ std::vector<PROCESSOR_NUMBER> &IndirectionTable,
+    _Out_ PROCESSOR_NUMBER *HotProcessor
     )
 {
-    wil::unique_handle InterfaceHandle;
-    unique_malloc_ptr<PROCESSOR_NUMBER> IndirectionTable1;
-    unique_malloc_ptr<PROCESSOR_NUMBER> IndirectionTable2;
-    UINT32 IndirectionTable1Size;
-    UINT32 IndirectionTable2Size;
-
-    TraceVerbose("OffloadRssSubsequentSet");
-    PrintProcArray("XDP1:", ProcessorIndices1);
-    PrintProcArray("XDP2:", ProcessorIndices2);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto AdapterMp = MpOpenAdapter(If.GetIfIndex());
+    auto DefaultLwf = LwfOpenDefault(If.GetIfIndex());
+    wil::unique_handle InterfaceHandle = InterfaceOpen(If.GetIfIndex());
+    UCHAR Payload[] = "RssRebalance";
+    const UINT32 QueueId = 0;
+    const UINT32 FramesPerFlush = 64;
+    DATA_BUFFER Buffer = {0};
+    RX_FRAME Frame;
+    DATA_FLUSH_OPTIONS FlushOptions = {0};
+    OID_KEY Key;
+    UINT32 OidInfoBufferLength;
+    HRESULT Result;
 
-    CreateIndirectionTable(ProcessorIndices1, IndirectionTable1, &IndirectionTable1Size);
-    CreateIndirectionTable(ProcessorIndices2, IndirectionTable2, &IndirectionTable2Size);
+    //
+    // Wait for TCPIP's RSS configuration: the rebalancer only reprograms the
+    // upper edge settings once RSS is enabled.
+    //
+    Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+    do {
+        UINT32 CurrentRssConfigSize = 0;
+        Result = TryRssGet(InterfaceHandle.get(), NULL, &CurrentRssConfigSize);
+        if (Result == HRESULT_FROM_WIN32(ERROR_MORE_DATA)) {
+            break;
+        }
+    } while (Sleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+    TEST_EQUAL(HRESULT_FROM_WIN32(ERROR_MORE_DATA), Result);
+    InterfaceHandle.reset();
 
-    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+    InitializeOidKey(&Key, OID_GEN_RECEIVE_SCALE_PARAMETERS, NdisRequestQueryInformation);
+    UINT32 NdisRssParamsSize;
+    unique_malloc_ptr<NDIS_RECEIVE_SCALE_PARAMETERS> NdisRssParams =
+        LwfOidAllocateAndSubmitRequest<NDIS_RECEIVE_SCALE_PARAMETERS>(
+            DefaultLwf, Key, &NdisRssParamsSize);
+    UpperIndirectionTable = GetNdisRssIndirectionTable(NdisRssParams.get());
+
+    if (std::find_if(
+            UpperIndirectionTable.begin(), UpperIndirectionTable.end(),
+            [&](const PROCESSOR_NUMBER &Processor) {
+                return !IsSameProcessor(Processor, UpperIndirectionTable[0]);
+            }) == UpperIndirectionTable.end()) {
+        TEST_WARNING("Test requires at least 2 RSS processors. Skipping.");
+        return FALSE;
+    }
 
-    SetXdpRss(FnMpIf, InterfaceHandle, IndirectionTable1, IndirectionTable2Size);
-    VerifyRssSettings(FnMpIf, IndirectionTable1, IndirectionTable2Size);
-    VerifyRssDatapath(FnMpIf, IndirectionTable1, IndirectionTable2Size);
+    //
+    // Attach the generic RX datapath without attaching an XDP queue to any RSS
+    // queue, since the rebalancer never moves entries of queues bound to XDP.
+    //
+    XDP_RULE Rule;
+    Rule.Match = XDP_MATCH_ALL;
+    Rule.Action = XDP_PROGRAM_ACTION_PASS;
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, XDP_DEDICATED_QUEUE_ID_BASE, XDP_GENERIC, &Rule, 1);
 
-    SetXdpRss(FnMpIf, InterfaceHandle, IndirectionTable2, IndirectionTable2Size);
-    VerifyRssSettings(FnMpIf, IndirectionTable2, IndirectionTable2Size);
-    VerifyRssDatapath(FnMpIf, IndirectionTable2, IndirectionTable2Size);
-}
+    Buffer.DataLength = sizeof(Payload);
+    Buffer.BufferLength = Buffer.DataLength;
+    Buffer.VirtualAddress = Payload;
+    FlushOptions.Flags.RssCpu = TRUE;
+    FlushOptions.RssCpuQueueId = QueueId;
 
-VOID
-OffloadRssSet()
-{
     //
-    // Only run if we have at least 2 LPs.
-    // Our expected test automation environment is at least a 2VP VM.
+    // Find the processor the miniport indicates the queue's frames on. The
+    // frames carry a zero RSS hash, so generic RSS assigns them to the RSS
+    // queue of the processor they are indicated on.
     //
-    if (GetProcessorCount() < 2) {
-        TEST_WARNING("Test requires at least 2 logical processors. Skipping.");
-        return;
+    {
+        UCHAR Mask[sizeof(Payload)];
+        std::memset(Mask, 0xFF, sizeof(Mask));
+        auto LwfFilter = LwfRxFilter(DefaultLwf, Payload, Mask, sizeof(Payload));
+
+        RxInitializeFrame(&Frame, QueueId, &Buffer);
+        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+        TEST_HRESULT(TryMpRxFlush(GenericMp, &FlushOptions));
+
+        auto LwfFrame = LwfRxAllocateAndGetFrame(DefaultLwf, 0);
+        *HotProcessor = LwfFrame->Output.ProcessorNumber;
     }
 
-    OffloadRssSingleSet({0});
-    OffloadRssSingleSet({1});
-    OffloadRssSingleSet({0,1});
+    //
+    // Load a single RSS queue until the rebalancer reprograms the indirection
+    // table.
+    //
+    InitializeOidKey(&Key, OID_GEN_RECEIVE_SCALE_PARAMETERS, NdisRequestSetInformation);
+    MpOidFilter(AdapterMp, &Key, 1);
 
-    OffloadRssSubsequentSet({0}, {1});
+    Watchdog.Reset();
+    do {
+        for (UINT32 Index = 0; Index < FramesPerFlush; Index++) {
+            RxInitializeFrame(&Frame, QueueId, &Buffer);
+            TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+        }
+        TEST_HRESULT(TryMpRxFlush(GenericMp, &FlushOptions));
 
-    if (GetProcessorCount() >= 4) {
-        OffloadRssSingleSet({0,2});
-        OffloadRssSingleSet({1,3});
-        OffloadRssSingleSet({0,1,2,3});
+        OidInfoBufferLength = 0;
+        Result = MpOidGetRequest(AdapterMp, Key, &OidInfoBufferLength, NULL);
+    } while (Result == HRESULT_FROM_WIN32(ERROR_NOT_FOUND) && !Watchdog.IsExpired());
+    TEST_EQUAL(HRESULT_FROM_WIN32(ERROR_MORE_DATA), Result);
 
-        OffloadRssSubsequentSet({0,2}, {1,3});
-    }
+    IndirectionTable = RssRebalanceCaptureIndirectionTable(AdapterMp, Key);
+
+    return TRUE;
 }
 
+static
 VOID
-OffloadRssCapabilities()
+VerifyRssRebalancedIndirectionTable(
+    _In_ const std::vector<PROCESSOR_NUMBER> &UpperIndirectionTable,
+    _In_ const std::vector<PROCESSOR_NUMBER> &IndirectionTable,
+    _In_ const PROCESSOR_NUMBER &HotProcessor
+    )
 {
-    wil::unique_handle InterfaceHandle;
-    unique_malloc_ptr<XDP_RSS_CAPABILITIES> RssCapabilities;
-    UINT32 Size = 0;
+    std::vector<PROCESSOR_NUMBER> ExpectedIndirectionTable = UpperIndirectionTable;
+    PROCESSOR_NUMBER ColdProcessor = {0};
+    UINT32 HotEntryCount = 0;
+    UINT32 FirstHotIndex = MAXUINT32;
+    UINT32 FirstColdIndex = MAXUINT32;
+    UINT32 MovedCount = 0;
 
-    InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+    TEST_EQUAL(UpperIndirectionTable.size(), IndirectionTable.size());
 
-    TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_MORE_DATA),
-        TryRssGetCapabilities(InterfaceHandle.get(), NULL, &Size));
-    TEST_EQUAL(Size, XDP_SIZEOF_RSS_CAPABILITIES_REVISION_2);
+    //
+    // Every rewritten entry moved from the hot processor to a single cold
+    // processor.
+    //
+    for (UINT32 Index = 0; Index < IndirectionTable.size(); Index++) {
+        if (IsSameProcessor(UpperIndirectionTable[Index], IndirectionTable[Index])) {
+            continue;
+        }
 
-    RssCapabilities.reset((XDP_RSS_CAPABILITIES *)malloc(Size));
-    TEST_TRUE(RssCapabilities.get() != NULL);
+        if (MovedCount++ == 0) {
+            ColdProcessor = IndirectionTable[Index];
+        }
 
-    RssGetCapabilities(InterfaceHandle.get(), RssCapabilities.get(), &Size);
-    TEST_EQUAL(RssCapabilities->Header.Revision, XDP_RSS_CAPABILITIES_REVISION_2);
-    TEST_EQUAL(RssCapabilities->Header.Size, XDP_SIZEOF_RSS_CAPABILITIES_REVISION_2);
-    TEST_EQUAL(
-        RssCapabilities->HashTypes,
-        (XDP_RSS_HASH_TYPE_IPV4 | XDP_RSS_HASH_TYPE_IPV6 |
-            XDP_RSS_HASH_TYPE_TCP_IPV4 | XDP_RSS_HASH_TYPE_TCP_IPV6));
-    TEST_EQUAL(RssCapabilities->HashSecretKeySize, 40);
-    TEST_EQUAL(RssCapabilities->NumberOfReceiveQueues, FNMP_DEFAULT_RSS_QUEUES);
-    TEST_EQUAL(RssCapabilities->NumberOfIndirectionTableEntries, FNMP_MAX_RSS_INDIR_COUNT);
+        TEST_TRUE(IsSameProcessor(UpperIndirectionTable[Index], HotProcessor));
+        TEST_TRUE(IsSameProcessor(IndirectionTable[Index], ColdProcessor));
+    }
+
+    TEST_TRUE(MovedCount > 0);
+    TEST_FALSE(IsSameProcessor(ColdProcessor, HotProcessor));
+
+    for (UINT32 Index = 0; Index < UpperIndirectionTable.size(); Index++) {
+        if (IsSameProcessor(UpperIndirectionTable[Index], HotProcessor)) {
+            HotEntryCount++;
+            FirstHotIndex = min(FirstHotIndex, Index);
+        } else if (IsSameProcessor(UpperIndirectionTable[Index], ColdProcessor)) {
+            FirstColdIndex = min(FirstColdIndex, Index);
+        }
+    }
+
+    //
+    // No other queue carries load, so at most half of the hot processor's
+    // entries move, and they are its last entries after the cold processor's
+    // first entry. Each processor keeps its first entry.
+    //
+    TEST_NOT_EQUAL(MAXUINT32, FirstColdIndex);
+    TEST_TRUE(MovedCount <= HotEntryCount / 2);
+
+    UINT32 ExpectedMovedCount = 0;
+    for (UINT32 Index = (UINT32)ExpectedIndirectionTable.size() - 1;
+        Index > FirstColdIndex && ExpectedMovedCount < MovedCount;
+        Index--) {
+        if (Index != FirstHotIndex &&
+            IsSameProcessor(ExpectedIndirectionTable[Index], HotProcessor)) {
+            ExpectedIndirectionTable[Index] = ColdProcessor;
+            ExpectedMovedCount++;
+        }
+    }
+
+    TEST_EQUAL(MovedCount, ExpectedMovedCount);
+    TEST_TRUE(
+        RtlEqualMemory(
+            ExpectedIndirectionTable.data(), IndirectionTable.data(),
+            IndirectionTable.size() * sizeof(IndirectionTable[0])));
 }
 
 VOID
-OffloadRssReset()
+OffloadRssRebalance()
 {
-    auto &If = FnMpIf;
-    unique_malloc_ptr<PROCESSOR_NUMBER> IndirectionTable;
-    unique_malloc_ptr<PROCESSOR_NUMBER> OriginalIndirectionTable;
-    unique_malloc_ptr<PROCESSOR_NUMBER> ResetIndirectionTable;
-    UINT32 IndirectionTableSize;
-    UINT32 OriginalIndirectionTableSize;
+    const CHAR *RebalanceIntervalRegName = "RssRebalanceIntervalMs";
+    DWORD RebalanceIntervalMs = 100;
+    std::vector<PROCESSOR_NUMBER> UpperIndirectionTable;
+    std::vector<PROCESSOR_NUMBER> IndirectionTable;
+    PROCESSOR_NUMBER HotProcessor;
+    OID_KEY Key;
 
     //
     // Only run if we have at least 2 LPs.
@@ -6671,80 +15228,102 @@ OffloadRssReset()
         return;
     }
 
-    auto InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
-    auto AdapterMp = MpOpenAdapter(If.GetIfIndex());
+    //
+    // Enable the RSS rebalancer, which reads its interval when the filter
+    // binds.
+    //
+    wil::unique_hkey XdpParametersKey;
+    TEST_EQUAL(
+        ERROR_SUCCESS,
+        RegCreateKeyExA(
+            HKEY_LOCAL_MACHINE,
+            "System\\CurrentControlSet\\Services\\Xdp\\Parameters",
+            0, NULL, REG_OPTION_VOLATILE, KEY_WRITE, NULL, &XdpParametersKey, NULL));
+    TEST_EQUAL(
+        ERROR_SUCCESS,
+        RegSetValueExA(
+            XdpParametersKey.get(), RebalanceIntervalRegName, 0, REG_DWORD,
+            (BYTE *)&RebalanceIntervalMs, sizeof(RebalanceIntervalMs)));
+    auto RegValueScopeGuard = wil::scope_exit([&]
+    {
+        //
+        // The value is already deleted if the test case ran to completion.
+        //
+        RegDeleteValueA(XdpParametersKey.get(), RebalanceIntervalRegName);
+        Sleep(TEST_TIMEOUT_ASYNC_MS); // Give time for the reg change notification to occur.
+        FnMpIf.Restart();
+    });
+    Sleep(TEST_TIMEOUT_ASYNC_MS); // Give time for the reg change notification to occur.
+    FnMpIf.Restart();
 
     //
-    // Query the original RSS table. This is what XDP should revert to when the
-    // interface is being torn down.
+    // Verify the rebalancer moves indirection table entries from the loaded
+    // processor to an idle one.
     //
-    GetXdpRssIndirectionTable(FnMpIf, OriginalIndirectionTable, OriginalIndirectionTableSize);
+    if (!RssRebalanceTrigger(FnMpIf, UpperIndirectionTable, IndirectionTable, &HotProcessor)) {
+        return;
+    }
+    VerifyRssRebalancedIndirectionTable(UpperIndirectionTable, IndirectionTable, HotProcessor);
 
     //
-    // Create and set a new RSS table.
+    // Verify the upper edge indirection table is restored when the interface
+    // is torn down.
     //
+    {
+        auto AdapterMp = MpOpenAdapter(FnMpIf.GetIfIndex());
+        InitializeOidKey(&Key, OID_GEN_RECEIVE_SCALE_PARAMETERS, NdisRequestSetInformation);
+        MpOidFilter(AdapterMp, &Key, 1);
 
-    CreateIndirectionTable({1, 0}, IndirectionTable, &IndirectionTableSize);
-    unique_malloc_ptr<XDP_RSS_CONFIGURATION> RssConfig;
-    UINT16 HashSecretKeySize = 40;
-    UINT32 RssConfigSize = sizeof(*RssConfig) + HashSecretKeySize + IndirectionTableSize;
-
-    RssConfig.reset((XDP_RSS_CONFIGURATION *)malloc(RssConfigSize));
-    XdpInitializeRssConfiguration(RssConfig.get(), RssConfigSize);
-    RssConfig->HashSecretKeyOffset = sizeof(*RssConfig);
-    RssConfig->IndirectionTableOffset = RssConfig->HashSecretKeyOffset + HashSecretKeySize;
+        auto AsyncThread = std::async(
+            std::launch::async,
+            [&] {
+                return FnMpIf.TryRestart();
+            }
+        );
 
-    PROCESSOR_NUMBER *IndirectionTableDst =
-        (PROCESSOR_NUMBER *)RTL_PTR_ADD(RssConfig.get(), RssConfig->IndirectionTableOffset);
-    RtlCopyMemory(IndirectionTableDst, IndirectionTable.get(), IndirectionTableSize);
+        //
+        // In case of failure, ensure the adapter is cleaned up before the
+        // async thread destructor runs; otherwise a deadlock on the OID
+        // path occurs.
+        //
+        auto AdapterScopeGuard = wil::scope_exit([&]
+        {
+            AdapterMp.reset();
+        });
 
-    RssConfig->Flags =
-        XDP_RSS_FLAG_SET_HASH_TYPE | XDP_RSS_FLAG_SET_HASH_SECRET_KEY |
-        XDP_RSS_FLAG_SET_INDIRECTION_TABLE;
-    RssConfig->HashType = XDP_RSS_HASH_TYPE_TCP_IPV4 | XDP_RSS_HASH_TYPE_TCP_IPV6;
-    RssConfig->HashSecretKeySize = HashSecretKeySize;
-    RssConfig->IndirectionTableSize = (USHORT)IndirectionTableSize;
+        IndirectionTable = RssRebalanceCaptureIndirectionTable(AdapterMp, Key);
+        TEST_EQUAL(UpperIndirectionTable.size(), IndirectionTable.size());
+        TEST_TRUE(
+            RtlEqualMemory(
+                UpperIndirectionTable.data(), IndirectionTable.data(),
+                IndirectionTable.size() * sizeof(IndirectionTable[0])));
 
-    RssSet(InterfaceHandle.get(), RssConfig.get(), RssConfigSize);
+        AdapterMp.reset();
+        TEST_EQUAL(AsyncThread.wait_for(MP_RESTART_TIMEOUT), std::future_status::ready);
+        TEST_TRUE(AsyncThread.get());
+    }
 
     //
-    // Set an OID filter, start tearing down the NIC and filter binding, verify
-    // the resulting OID, then close the handle to allow OID completion.
+    // Verify the upper edge indirection table is restored when the rebalancer
+    // is disabled.
     //
+    TEST_TRUE(
+        RssRebalanceTrigger(FnMpIf, UpperIndirectionTable, IndirectionTable, &HotProcessor));
+    VerifyRssRebalancedIndirectionTable(UpperIndirectionTable, IndirectionTable, HotProcessor);
 
-    OID_KEY Key;
+    auto AdapterMp = MpOpenAdapter(FnMpIf.GetIfIndex());
     InitializeOidKey(&Key, OID_GEN_RECEIVE_SCALE_PARAMETERS, NdisRequestSetInformation);
     MpOidFilter(AdapterMp, &Key, 1);
 
-    auto AsyncThread = std::async(
-        std::launch::async,
-        [&] {
-            return If.TryUnbindXdp();
-        }
-    );
-
-    auto BindingScopeGuard = wil::scope_exit([&]
-    {
-        TEST_HRESULT(If.TryRebindXdp());
-    });
-
-    UINT32 OidInfoBufferLength;
-    unique_malloc_ptr<VOID> OidInfoBuffer =
-        MpOidAllocateAndGetRequest(AdapterMp, Key, &OidInfoBufferLength, MP_RESTART_TIMEOUT);
+    TEST_EQUAL(ERROR_SUCCESS, RegDeleteValueA(XdpParametersKey.get(), RebalanceIntervalRegName));
+    Sleep(TEST_TIMEOUT_ASYNC_MS); // Give time for the reg change notification to occur.
 
-    NDIS_RECEIVE_SCALE_PARAMETERS *NdisParams =
-        (NDIS_RECEIVE_SCALE_PARAMETERS *)OidInfoBuffer.get();
-    TEST_EQUAL(NdisParams->IndirectionTableSize, OriginalIndirectionTableSize);
-    PROCESSOR_NUMBER *NdisIndirectionTable =
-        (PROCESSOR_NUMBER *)RTL_PTR_ADD(NdisParams, NdisParams->IndirectionTableOffset);
+    IndirectionTable = RssRebalanceCaptureIndirectionTable(AdapterMp, Key);
+    TEST_EQUAL(UpperIndirectionTable.size(), IndirectionTable.size());
     TEST_TRUE(
-        RtlEqualMemory(NdisIndirectionTable,
-        OriginalIndirectionTable.get(),
-        OriginalIndirectionTableSize));
-
-    AdapterMp.reset();
-    TEST_EQUAL(AsyncThread.wait_for(TEST_TIMEOUT_ASYNC), std::future_status::ready);
-    TEST_HRESULT(AsyncThread.get());
+        RtlEqualMemory(
+            UpperIndirectionTable.data(), IndirectionTable.data(),
+            IndirectionTable.size() * sizeof(IndirectionTable[0])));
 }
 
 static
@@ -6908,79 +15487,400 @@ GenericXskQueryAffinity()
             TEST_FALSE(XskRingAffinityChanged(&Socket.Rings.Tx));
         }
 
-        //
-        // Verify that activity on the data path updates the RSS state.
-        //
+        //
+        // Verify that activity on the data path updates the RSS state.
+        //
+
+        for (UINT32 ProcIndex = 0; ProcIndex < 2; ProcIndex++) {
+            unique_malloc_ptr<PROCESSOR_NUMBER> IndirectionTable;
+            wil::unique_handle InterfaceHandle;
+            UINT32 IndirectionTableSize;
+
+            PROCESSOR_NUMBER TargetProcNumber;
+            ProcessorIndexToProcessorNumber(ProcIndex, &TargetProcNumber);
+
+            CreateIndirectionTable({ProcIndex}, IndirectionTable, &IndirectionTableSize);
+            InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+            SetXdpRss(FnMpIf, InterfaceHandle, IndirectionTable, IndirectionTableSize);
+
+            if (Case.Rx) {
+                TEST_FALSE(XskRingAffinityChanged(&Socket.Rings.Rx));
+
+                SocketProduceRxFill(&Socket, 1);
+
+                RX_FRAME Frame;
+                RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), BufferVa, sizeof(BufferVa));
+                TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+
+                DATA_FLUSH_OPTIONS FlushOptions = {0};
+                FlushOptions.Flags.RssCpu = TRUE;
+                FlushOptions.RssCpuQueueId = FnMpIf.GetQueueId();
+                TEST_HRESULT(TryMpRxFlush(GenericMp, &FlushOptions));
+
+                SocketConsumerReserve(&Socket.Rings.Rx, 1);
+                XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+                TEST_TRUE(XskRingAffinityChanged(&Socket.Rings.Rx));
+
+                GetSockopt(
+                    Socket.Handle.get(), XSK_SOCKOPT_RX_PROCESSOR_AFFINITY, &ProcNumber,
+                    &ProcNumberSize);
+                TEST_EQUAL(sizeof(ProcNumber), ProcNumberSize);
+                TEST_EQUAL(TargetProcNumber.Group, ProcNumber.Group);
+                TEST_EQUAL(TargetProcNumber.Number, ProcNumber.Number);
+
+                TEST_FALSE(XskRingAffinityChanged(&Socket.Rings.Rx));
+            }
+
+            if (Case.Tx) {
+                TEST_FALSE(XskRingAffinityChanged(&Socket.Rings.Tx));
+
+                UINT64 TxBuffer = SocketFreePop(&Socket);
+                UCHAR *UdpFrame = Socket.Umem.Buffer.get() + TxBuffer;
+                RtlCopyMemory(UdpFrame, BufferVa, sizeof(BufferVa));
+                UINT32 ProducerIndex;
+                TEST_EQUAL(1, XskRingProducerReserve(&Socket.Rings.Tx, 1, &ProducerIndex));
+                XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Socket, ProducerIndex++);
+                TxDesc->Address.AddressAndOffset = TxBuffer;
+                TxDesc->Length = sizeof(BufferVa);
+                XskRingProducerSubmit(&Socket.Rings.Tx, 1);
+                XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+                NotifySocket(Socket.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+                TEST_EQUAL(0, NotifyResult);
+                SocketConsumerReserve(&Socket.Rings.Completion, 1);
+                XskRingConsumerRelease(&Socket.Rings.Completion, 1);
+
+                TEST_TRUE(XskRingAffinityChanged(&Socket.Rings.Tx));
+
+                GetSockopt(
+                    Socket.Handle.get(), XSK_SOCKOPT_TX_PROCESSOR_AFFINITY, &ProcNumber,
+                    &ProcNumberSize);
+                TEST_EQUAL(sizeof(ProcNumber), ProcNumberSize);
+                TEST_EQUAL(TargetProcNumber.Group, ProcNumber.Group);
+                TEST_EQUAL(TargetProcNumber.Number, ProcNumber.Number);
+
+                TEST_FALSE(XskRingAffinityChanged(&Socket.Rings.Tx));
+            }
+        }
+    }
+}
+
+VOID
+GenericXskRssSetQueueProcessor()
+{
+    UCHAR BufferVa[] = "GenericXskRssSetQueueProcessor";
+    auto GenericMp = MpOpenGeneric(FnMpIf.GetIfIndex());
+    unique_malloc_ptr<PROCESSOR_NUMBER> IndirectionTable;
+    UINT32 IndirectionTableSize;
+    PROCESSOR_NUMBER ProcNumber;
+    PROCESSOR_NUMBER TargetProcNumber;
+    UINT32 ProcNumberSize;
+
+    if (GetProcessorCount() < 2) {
+        TEST_WARNING("Test requires at least 2 logical processors. Skipping.");
+        return;
+    }
+
+    auto Socket =
+        SetupSocket(FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+    wil::unique_handle InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+
+    //
+    // The queue's processor is unknown until it receives frames.
+    //
+    ProcessorIndexToProcessorNumber(1, &TargetProcNumber);
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_READY),
+        TryRssSetQueueProcessor(InterfaceHandle.get(), Socket.Handle.get(), &TargetProcNumber));
+
+    CreateIndirectionTable({0}, IndirectionTable, &IndirectionTableSize);
+    SetXdpRss(FnMpIf, InterfaceHandle, IndirectionTable, IndirectionTableSize);
+
+    SocketProduceRxFill(&Socket, 1);
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), BufferVa, sizeof(BufferVa));
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+
+    DATA_FLUSH_OPTIONS FlushOptions = {0};
+    FlushOptions.Flags.RssCpu = TRUE;
+    FlushOptions.RssCpuQueueId = FnMpIf.GetQueueId();
+    TEST_HRESULT(TryMpRxFlush(GenericMp, &FlushOptions));
+
+    SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    XskRingConsumerRelease(&Socket.Rings.Rx, 1);
+
+    ProcNumberSize = sizeof(ProcNumber);
+    GetSockopt(
+        Socket.Handle.get(), XSK_SOCKOPT_RX_PROCESSOR_AFFINITY, &ProcNumber, &ProcNumberSize);
+    PROCESSOR_NUMBER QueueProcNumber;
+    ProcessorIndexToProcessorNumber(0, &QueueProcNumber);
+    TEST_EQUAL(QueueProcNumber.Group, ProcNumber.Group);
+    TEST_EQUAL(QueueProcNumber.Number, ProcNumber.Number);
+
+    //
+    // Move the queue to the target processor: every indirection entry of the
+    // queue now targets it.
+    //
+    TEST_HRESULT(
+        TryRssSetQueueProcessor(InterfaceHandle.get(), Socket.Handle.get(), &TargetProcNumber));
+
+    auto RssConfig = GetXdpRss(InterfaceHandle);
+    PROCESSOR_NUMBER *Entries =
+        (PROCESSOR_NUMBER *)RTL_PTR_ADD(RssConfig.get(), RssConfig->IndirectionTableOffset);
+    for (UINT32 Index = 0;
+        Index < RssConfig->IndirectionTableSize / sizeof(*Entries);
+        Index++) {
+        TEST_EQUAL(TargetProcNumber.Group, Entries[Index].Group);
+        TEST_EQUAL(TargetProcNumber.Number, Entries[Index].Number);
+    }
+}
+
+VOID
+GenericRxRssHashless()
+{
+    UCHAR BufferVa[] = "GenericRxRssHashless";
+    auto GenericMp = MpOpenGeneric(FnMpIf.GetIfIndex());
+    unique_malloc_ptr<PROCESSOR_NUMBER> IndirectionTable;
+    UINT32 IndirectionTableSize;
+    MY_SOCKET Sockets[2];
+
+    if (GetProcessorCount() < RTL_NUMBER_OF(Sockets)) {
+        TEST_WARNING("Test requires at least 2 logical processors. Skipping.");
+        return;
+    }
+
+    wil::unique_handle InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+
+    //
+    // Queues are assigned in order of each processor's first indirection
+    // entry, so each queue's ideal processor has the same index as the queue.
+    //
+    CreateIndirectionTable({0, 1}, IndirectionTable, &IndirectionTableSize);
+    SetXdpRss(FnMpIf, InterfaceHandle, IndirectionTable, IndirectionTableSize);
+
+    for (UINT32 QueueId = 0; QueueId < RTL_NUMBER_OF(Sockets); QueueId++) {
+        Sockets[QueueId] = SetupSocket(FnMpIf.GetIfIndex(), QueueId, TRUE, FALSE, XDP_GENERIC);
+        SocketProduceRxFill(&Sockets[QueueId], 1);
+    }
+
+    //
+    // Indicate a frame without an RSS hash on each miniport RSS processor.
+    //
+    for (UINT32 QueueId = 0; QueueId < RTL_NUMBER_OF(Sockets); QueueId++) {
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, 0, BufferVa, sizeof(BufferVa));
+        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+
+        DATA_FLUSH_OPTIONS FlushOptions = {0};
+        FlushOptions.Flags.RssCpu = TRUE;
+        FlushOptions.RssCpuQueueId = QueueId;
+        TEST_HRESULT(TryMpRxFlush(GenericMp, &FlushOptions));
+    }
+
+    //
+    // Verify each frame was received on the queue affinitized to the processor
+    // it was indicated on.
+    //
+    for (UINT32 QueueId = 0; QueueId < RTL_NUMBER_OF(Sockets); QueueId++) {
+        auto &Socket = Sockets[QueueId];
+        PROCESSOR_NUMBER ProcNumber;
+        PROCESSOR_NUMBER QueueProcNumber;
+        UINT32 ProcNumberSize = sizeof(ProcNumber);
+
+        UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+        TEST_EQUAL(1, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+        auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+        TEST_EQUAL(sizeof(BufferVa), RxDesc->Length);
+
+        GetSockopt(
+            Socket.Handle.get(), XSK_SOCKOPT_RX_PROCESSOR_AFFINITY, &ProcNumber, &ProcNumberSize);
+        ProcessorIndexToProcessorNumber(QueueId, &QueueProcNumber);
+        TEST_EQUAL(QueueProcNumber.Group, ProcNumber.Group);
+        TEST_EQUAL(QueueProcNumber.Number, ProcNumber.Number);
+    }
+}
+
+VOID
+GenericRxRssIndirectionMove()
+{
+    UCHAR BufferVa[] = "GenericRxRssIndirectionMove?";
+    auto GenericMp = MpOpenGeneric(FnMpIf.GetIfIndex());
+    unique_malloc_ptr<PROCESSOR_NUMBER> IndirectionTable;
+    UINT32 IndirectionTableSize;
+    MY_SOCKET Sockets[2];
+
+    if (GetProcessorCount() < RTL_NUMBER_OF(Sockets)) {
+        TEST_WARNING("Test requires at least 2 logical processors. Skipping.");
+        return;
+    }
+
+    wil::unique_handle InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+
+    CreateIndirectionTable({0, 1, 0, 1}, IndirectionTable, &IndirectionTableSize);
+    SetXdpRss(FnMpIf, InterfaceHandle, IndirectionTable, IndirectionTableSize);
+
+    for (UINT32 QueueId = 0; QueueId < RTL_NUMBER_OF(Sockets); QueueId++) {
+        Sockets[QueueId] = SetupSocket(FnMpIf.GetIfIndex(), QueueId, TRUE, FALSE, XDP_GENERIC);
+    }
+
+    //
+    // Indicate a frame on each nonzero indirection entry and verify it is
+    // received on the queue the entry currently maps to.
+    //
+    auto VerifyEntries = [&](const std::vector<UINT32> &EntryQueueIds) {
+        for (UINT32 Entry = 1; Entry < EntryQueueIds.size(); Entry++) {
+            auto &Socket = Sockets[EntryQueueIds[Entry]];
+            RX_FRAME Frame;
+
+            BufferVa[sizeof(BufferVa) - 1] = (UCHAR)Entry;
+            SocketProduceRxFill(&Socket, 1);
+            RxInitializeFrame(&Frame, Entry, BufferVa, sizeof(BufferVa));
+            TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+            UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+            TEST_EQUAL(1, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+            auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+            UCHAR *RxBuffer =
+                Socket.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset;
+            TEST_EQUAL(sizeof(BufferVa), RxDesc->Length);
+            TEST_EQUAL((UCHAR)Entry, RxBuffer[sizeof(BufferVa) - 1]);
+        }
+    };
+
+    VerifyEntries({0, 1, 0, 1});
+
+    //
+    // Move entries between the processors without changing either processor's
+    // first entry, so each queue keeps its processor and sockets, and verify
+    // frames follow the moved entries.
+    //
+    CreateIndirectionTable({0, 1, 1, 0}, IndirectionTable, &IndirectionTableSize);
+    SetXdpRss(FnMpIf, InterfaceHandle, IndirectionTable, IndirectionTableSize);
+
+    VerifyEntries({0, 1, 1, 0});
+
+    for (UINT32 QueueId = 0; QueueId < RTL_NUMBER_OF(Sockets); QueueId++) {
+        PROCESSOR_NUMBER ProcNumber;
+        PROCESSOR_NUMBER QueueProcNumber;
+        UINT32 ProcNumberSize = sizeof(ProcNumber);
+
+        GetSockopt(
+            Sockets[QueueId].Handle.get(), XSK_SOCKOPT_RX_PROCESSOR_AFFINITY, &ProcNumber,
+            &ProcNumberSize);
+        ProcessorIndexToProcessorNumber(QueueId, &QueueProcNumber);
+        TEST_EQUAL(QueueProcNumber.Group, ProcNumber.Group);
+        TEST_EQUAL(QueueProcNumber.Number, ProcNumber.Number);
+    }
+
+    //
+    // Verify moving the entries back also takes effect.
+    //
+    CreateIndirectionTable({0, 1, 0, 1}, IndirectionTable, &IndirectionTableSize);
+    SetXdpRss(FnMpIf, InterfaceHandle, IndirectionTable, IndirectionTableSize);
 
-        for (UINT32 ProcIndex = 0; ProcIndex < 2; ProcIndex++) {
-            unique_malloc_ptr<PROCESSOR_NUMBER> IndirectionTable;
-            wil::unique_handle InterfaceHandle;
-            UINT32 IndirectionTableSize;
+    VerifyEntries({0, 1, 0, 1});
+}
 
-            PROCESSOR_NUMBER TargetProcNumber;
-            ProcessorIndexToProcessorNumber(ProcIndex, &TargetProcNumber);
+VOID
+GenericTeamQueues()
+{
+    XDP_RSS_CAPABILITIES RssCapabilities;
+    UINT32 RssCapabilitiesSize = sizeof(RssCapabilities);
+    UINT32 QueueCount = 0;
+    HANDLE Program;
+    UINT32 ProgramCount = 0;
+    XDP_RULE Rule = {};
 
-            CreateIndirectionTable({ProcIndex}, IndirectionTable, &IndirectionTableSize);
-            InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
-            SetXdpRss(FnMpIf, InterfaceHandle, IndirectionTable, IndirectionTableSize);
+    //
+    // The test adapter has no lower interfaces, so it is its own sole team
+    // member, and each of its RSS queues is a logical queue of the team.
+    //
+    wil::unique_handle InterfaceHandle = InterfaceOpen(FnMpIf.GetIfIndex());
+    TEST_HRESULT(
+        TryRssGetCapabilities(InterfaceHandle.get(), &RssCapabilities, &RssCapabilitiesSize));
+    TEST_NOT_EQUAL(0, RssCapabilities.NumberOfReceiveQueues);
 
-            if (Case.Rx) {
-                TEST_FALSE(XskRingAffinityChanged(&Socket.Rings.Rx));
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_MORE_DATA),
+        TryTeamGetQueues(FnMpIf.GetIfIndex(), NULL, &QueueCount));
+    TEST_EQUAL(RssCapabilities.NumberOfReceiveQueues, QueueCount);
 
-                SocketProduceRxFill(&Socket, 1);
+    std::vector<XDP_TEAM_QUEUE> Queues(QueueCount);
+    TEST_HRESULT(TryTeamGetQueues(FnMpIf.GetIfIndex(), Queues.data(), &QueueCount));
+    TEST_EQUAL(Queues.size(), QueueCount);
 
-                RX_FRAME Frame;
-                RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), BufferVa, sizeof(BufferVa));
-                TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    for (UINT32 Index = 0; Index < QueueCount; Index++) {
+        TEST_EQUAL(FnMpIf.GetIfIndex(), Queues[Index].IfIndex);
+        TEST_EQUAL(Index, Queues[Index].QueueId);
+    }
 
-                DATA_FLUSH_OPTIONS FlushOptions = {0};
-                FlushOptions.Flags.RssCpu = TRUE;
-                FlushOptions.RssCpuQueueId = FnMpIf.GetQueueId();
-                TEST_HRESULT(TryMpRxFlush(GenericMp, &FlushOptions));
+    //
+    // A logical queue is bound like any other queue.
+    //
+    auto Socket =
+        SetupSocket(
+            Queues[QueueCount - 1].IfIndex, Queues[QueueCount - 1].QueueId, TRUE, FALSE,
+            XDP_GENERIC);
 
-                SocketConsumerReserve(&Socket.Rings.Rx, 1);
-                XskRingConsumerRelease(&Socket.Rings.Rx, 1);
-                TEST_TRUE(XskRingAffinityChanged(&Socket.Rings.Rx));
+    Rule.Match = XDP_MATCH_ALL;
+    Rule.Action = XDP_PROGRAM_ACTION_PASS;
 
-                GetSockopt(
-                    Socket.Handle.get(), XSK_SOCKOPT_RX_PROCESSOR_AFFINITY, &ProcNumber,
-                    &ProcNumberSize);
-                TEST_EQUAL(sizeof(ProcNumber), ProcNumberSize);
-                TEST_EQUAL(TargetProcNumber.Group, ProcNumber.Group);
-                TEST_EQUAL(TargetProcNumber.Number, ProcNumber.Number);
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_MORE_DATA),
+        TryTeamCreateProgram(
+            FnMpIf.GetIfIndex(), &XdpInspectRxL2, XDP_CREATE_PROGRAM_FLAG_GENERIC, &Rule, 1,
+            NULL, &ProgramCount));
+    TEST_EQUAL(1, ProgramCount);
 
-                TEST_FALSE(XskRingAffinityChanged(&Socket.Rings.Rx));
-            }
+    TEST_HRESULT(
+        TryTeamCreateProgram(
+            FnMpIf.GetIfIndex(), &XdpInspectRxL2, XDP_CREATE_PROGRAM_FLAG_GENERIC, &Rule, 1,
+            &Program, &ProgramCount));
+    wil::unique_handle ProgramHandle(Program);
+    TEST_EQUAL(1, ProgramCount);
+}
 
-            if (Case.Tx) {
-                TEST_FALSE(XskRingAffinityChanged(&Socket.Rings.Tx));
+VOID
+GenericXskNumaNode()
+{
+    ULONG HighestNodeNumber;
 
-                UINT64 TxBuffer = SocketFreePop(&Socket);
-                UCHAR *UdpFrame = Socket.Umem.Buffer.get() + TxBuffer;
-                RtlCopyMemory(UdpFrame, BufferVa, sizeof(BufferVa));
-                UINT32 ProducerIndex;
-                TEST_EQUAL(1, XskRingProducerReserve(&Socket.Rings.Tx, 1, &ProducerIndex));
-                XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Socket, ProducerIndex++);
-                TxDesc->Address.AddressAndOffset = TxBuffer;
-                TxDesc->Length = sizeof(BufferVa);
-                XskRingProducerSubmit(&Socket.Rings.Tx, 1);
-                XSK_NOTIFY_RESULT_FLAGS NotifyResult;
-                NotifySocket(Socket.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
-                TEST_EQUAL(0, NotifyResult);
-                SocketConsumerReserve(&Socket.Rings.Completion, 1);
-                XskRingConsumerRelease(&Socket.Rings.Completion, 1);
+    TEST_TRUE(GetNumaHighestNodeNumber(&HighestNodeNumber));
 
-                TEST_TRUE(XskRingAffinityChanged(&Socket.Rings.Tx));
+    for (auto Case : RxTxTestCases) {
+        XSK_NUMA_NODE_INFO NodeInfo;
+        UINT32 OptionLength;
 
-                GetSockopt(
-                    Socket.Handle.get(), XSK_SOCKOPT_TX_PROCESSOR_AFFINITY, &ProcNumber,
-                    &ProcNumberSize);
-                TEST_EQUAL(sizeof(ProcNumber), ProcNumberSize);
-                TEST_EQUAL(TargetProcNumber.Group, ProcNumber.Group);
-                TEST_EQUAL(TargetProcNumber.Number, ProcNumber.Number);
+        //
+        // The node is unknown until the socket is activated.
+        //
+        auto Xsk = CreateSocket();
+        OptionLength = sizeof(NodeInfo);
+        TEST_TRUE(
+            FAILED(TryGetSockopt(Xsk.get(), XSK_SOCKOPT_NUMA_NODE, &NodeInfo, &OptionLength)));
 
-                TEST_FALSE(XskRingAffinityChanged(&Socket.Rings.Tx));
-            }
+        auto Socket =
+            SetupSocket(
+                FnMpIf.GetIfIndex(), FnMpIf.GetQueueId(), Case.Rx, Case.Tx, XDP_GENERIC);
+
+        OptionLength = sizeof(NodeInfo);
+        GetSockopt(Socket.Handle.get(), XSK_SOCKOPT_NUMA_NODE, &NodeInfo, &OptionLength);
+        TEST_EQUAL(sizeof(NodeInfo), OptionLength);
+
+        //
+        // The generic data path always reports its RSS processor, so bound
+        // directions are placed on a valid node.
+        //
+        if (Case.Rx) {
+            TEST_TRUE(NodeInfo.Rx <= HighestNodeNumber);
+        } else {
+            TEST_EQUAL(XSK_NUMA_NODE_UNSPECIFIED, NodeInfo.Rx);
+        }
+
+        if (Case.Tx) {
+            TEST_TRUE(NodeInfo.Tx <= HighestNodeNumber);
+        } else {
+            TEST_EQUAL(XSK_NUMA_NODE_UNSPECIFIED, NodeInfo.Tx);
         }
     }
 }
@@ -7179,65 +16079,201 @@ OffloadQeoConnection()
             TEST_TRUE(RtlEqualMemory(
                 Connection.HeaderKey, NdisConnection->HeaderKey, sizeof(Connection.HeaderKey)));
 
-            C_ASSERT(sizeof(Connection.PayloadIv) == sizeof(NdisConnection->PayloadIv));
-            TEST_TRUE(RtlEqualMemory(
-                Connection.PayloadIv, NdisConnection->PayloadIv, sizeof(Connection.PayloadIv)));
+            C_ASSERT(sizeof(Connection.PayloadIv) == sizeof(NdisConnection->PayloadIv));
+            TEST_TRUE(RtlEqualMemory(
+                Connection.PayloadIv, NdisConnection->PayloadIv, sizeof(Connection.PayloadIv)));
+
+            //
+            // Complete the OID with the connection offload status updated.
+            //
+            NdisConnection->Status = OffloadStatus.Ndis;
+
+            MpOidCompleteRequest(
+                AdapterMp, Key, NDIS_STATUS_SUCCESS, NdisConnection, sizeof(*NdisConnection));
+
+            //
+            // Verify the XDP offload API is completed once the OID completes.
+            //
+            TEST_EQUAL(AsyncThread.wait_for(TEST_TIMEOUT_ASYNC), std::future_status::ready);
+
+            //
+            // Verify the XDP offload API succeeded.
+            //
+            TEST_HRESULT(AsyncThread.get());
+
+            //
+            // Verify the connection's status field was updated with the miniport
+            // status.
+            //
+            TEST_EQUAL(OffloadStatus.Xdp, Connection.Status);
+
+            if (SUCCEEDED(OffloadStatus.Xdp)) {
+                //
+                // Verify duplicate connections cannot be added, and non-existent
+                // entries cannot be removed.
+                //
+                if (Operation.Xdp == XDP_QUIC_OPERATION_ADD) {
+                    TEST_EQUAL(
+                        HRESULT_FROM_WIN32(ERROR_OBJECT_ALREADY_EXISTS),
+                        TryQeoSet(InterfaceHandle.get(), &Connection, sizeof(Connection)));
+                } else {
+                    ASSERT(Operation.Xdp == XDP_QUIC_OPERATION_REMOVE);
+                    TEST_EQUAL(
+                        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+                        TryQeoSet(InterfaceHandle.get(), &Connection, sizeof(Connection)));
+                }
+            }
+        }}}}}}
+    }
+}
+
+VOID
+OffloadQeoRevert(
+    _In_ REVERT_REASON RevertReason
+    )
+{
+    auto If = FnMpIf;
+    auto InterfaceHandle = InterfaceOpen(If.GetIfIndex());
+    auto AdapterMp = MpOpenAdapter(If.GetIfIndex());
+    const auto Timeout =
+        RevertReason == RevertReasonInterfaceRemoval ?
+            MP_RESTART_TIMEOUT : TEST_TIMEOUT_ASYNC;
+
+    const auto &Operation = QeoOperationMap[0];
+    const auto &Direction = QeoDirectionMap[0];
+    const auto &DecryptFailureAction = QeoDecryptFailureActionMap[0];
+    const auto &KeyPhase = 0U;
+    const auto &CipherType = QeoCipherTypeMap[0];
+    const auto &AddressFamily = QeoAddressFamilyMap[0];
+
+    ASSERT(Operation.Xdp == XDP_QUIC_OPERATION_ADD);
+
+    //
+    // Initialize the connection for the add operation.
+    //
+    XDP_QUIC_CONNECTION Connection;
+    XdpInitializeQuicConnection(&Connection, sizeof(Connection));
+    Connection.Operation = Operation.Xdp;
+    Connection.Direction = Direction.Xdp;
+    Connection.DecryptFailureAction = DecryptFailureAction.Xdp;
+    Connection.KeyPhase = KeyPhase;
+    Connection.CipherType = CipherType.Xdp;
+    Connection.AddressFamily = AddressFamily.Xdp;
+    Connection.UdpPort = htons(1234);
+    Connection.NextPacketNumber = 5678;
+    Connection.ConnectionIdLength = 3;
+    strcpy_s((CHAR *)Connection.Address, sizeof(Connection.Address), "Address");
+    strcpy_s((CHAR *)Connection.ConnectionId, sizeof(Connection.ConnectionId), "Id");
+    strcpy_s((CHAR *)Connection.PayloadKey, sizeof(Connection.PayloadKey), "PayloadKey");
+    strcpy_s((CHAR *)Connection.HeaderKey, sizeof(Connection.HeaderKey), "HeaderKey");
+    strcpy_s((CHAR *)Connection.PayloadIv, sizeof(Connection.PayloadIv), "PayloadIv");
+    Connection.Status = E_FAIL;
+
+    TEST_HRESULT(TryQeoSet(InterfaceHandle.get(), &Connection, sizeof(Connection)));
+
+    //
+    // Configure the functional miniport to capture the offload request OID.
+    //
+    OID_KEY Key;
+    InitializeOidKey(
+        &Key, OffloadQeoGetExpectedOid(), NdisRequestMethod, OID_REQUEST_INTERFACE_DIRECT);
+    MpOidFilter(AdapterMp, &Key, 1);
+
+    //
+    // Initiate the offload request on a separate thread: the operation will
+    // block until the OID is completed, which won't happen until the miniport
+    // handle is reset below.
+    //
+    auto AsyncThread = std::async(
+        std::launch::async,
+        [&] {
+            if (RevertReason == RevertReasonInterfaceRemoval) {
+                return If.TryRestart();
+            } else {
+                ASSERT(RevertReason == RevertReasonHandleClosure);
+                InterfaceHandle.reset();
+                return (BOOLEAN)TRUE;
+            }
+        }
+    );
+
+    //
+    // In case of failure, ensure the adapter is cleaned up before the
+    // async thread destructor runs; otherwise a deadlock on the OID
+    // path occurs.
+    //
+    auto AdapterScopeGuard = wil::scope_exit([&]
+    {
+        AdapterMp.reset();
+    });
+
+    //
+    // Retrieve the captured offload OID from the functional miniport.
+    //
+    UINT32 OidInfoBufferLength;
+    unique_malloc_ptr<VOID> OidInfoBuffer =
+        MpOidAllocateAndGetRequest(AdapterMp, Key, &OidInfoBufferLength, Timeout);
+
+    //
+    // Verify the OID parameters match the XDP connection request.
+    //
+    NDIS_QUIC_CONNECTION *NdisConnection = (NDIS_QUIC_CONNECTION *)OidInfoBuffer.get();
+
+    TEST_EQUAL(sizeof(*NdisConnection), OidInfoBufferLength);
+
+    TEST_EQUAL((UINT32)NDIS_QUIC_OPERATION_REMOVE, NdisConnection->Operation);
+    TEST_EQUAL((UINT32)Direction.Ndis, NdisConnection->Direction);
+    TEST_EQUAL((UINT32)DecryptFailureAction.Ndis, NdisConnection->DecryptFailureAction);
+    TEST_EQUAL(KeyPhase, NdisConnection->KeyPhase);
+    TEST_EQUAL((UINT32)CipherType.Ndis, NdisConnection->CipherType);
+    TEST_EQUAL(AddressFamily.Ndis, NdisConnection->AddressFamily);
+    TEST_EQUAL(Connection.UdpPort, NdisConnection->UdpPort);
+    TEST_EQUAL(Connection.NextPacketNumber, NdisConnection->NextPacketNumber);
+    TEST_EQUAL(Connection.ConnectionIdLength, NdisConnection->ConnectionIdLength);
+
+    C_ASSERT(sizeof(Connection.Address) == sizeof(NdisConnection->Address));
+    TEST_TRUE(RtlEqualMemory(
+        Connection.Address, NdisConnection->Address, sizeof(Connection.Address)));
+
+    C_ASSERT(sizeof(Connection.ConnectionId) == sizeof(NdisConnection->ConnectionId));
+    TEST_TRUE(RtlEqualMemory(
+        Connection.ConnectionId, NdisConnection->ConnectionId, Connection.ConnectionIdLength));
 
-            //
-            // Complete the OID with the connection offload status updated.
-            //
-            NdisConnection->Status = OffloadStatus.Ndis;
+    C_ASSERT(sizeof(Connection.PayloadKey) == sizeof(NdisConnection->PayloadKey));
+    TEST_TRUE(RtlEqualMemory(
+        Connection.PayloadKey, NdisConnection->PayloadKey, sizeof(Connection.PayloadKey)));
 
-            MpOidCompleteRequest(
-                AdapterMp, Key, NDIS_STATUS_SUCCESS, NdisConnection, sizeof(*NdisConnection));
+    C_ASSERT(sizeof(Connection.HeaderKey) == sizeof(NdisConnection->HeaderKey));
+    TEST_TRUE(RtlEqualMemory(
+        Connection.HeaderKey, NdisConnection->HeaderKey, sizeof(Connection.HeaderKey)));
 
-            //
-            // Verify the XDP offload API is completed once the OID completes.
-            //
-            TEST_EQUAL(AsyncThread.wait_for(TEST_TIMEOUT_ASYNC), std::future_status::ready);
+    C_ASSERT(sizeof(Connection.PayloadIv) == sizeof(NdisConnection->PayloadIv));
+    TEST_TRUE(RtlEqualMemory(
+        Connection.PayloadIv, NdisConnection->PayloadIv, sizeof(Connection.PayloadIv)));
 
-            //
-            // Verify the XDP offload API succeeded.
-            //
-            TEST_HRESULT(AsyncThread.get());
+    //
+    // Reset the miniport handle, allowing the captured OID to be completed.
+    //
+    AdapterMp.reset();
 
-            //
-            // Verify the connection's status field was updated with the miniport
-            // status.
-            //
-            TEST_EQUAL(OffloadStatus.Xdp, Connection.Status);
+    //
+    // Verify the revert/teardown is completed once the OID completes.
+    //
+    TEST_EQUAL(AsyncThread.wait_for(Timeout), std::future_status::ready);
 
-            if (SUCCEEDED(OffloadStatus.Xdp)) {
-                //
-                // Verify duplicate connections cannot be added, and non-existent
-                // entries cannot be removed.
-                //
-                if (Operation.Xdp == XDP_QUIC_OPERATION_ADD) {
-                    TEST_EQUAL(
-                        HRESULT_FROM_WIN32(ERROR_OBJECT_ALREADY_EXISTS),
-                        TryQeoSet(InterfaceHandle.get(), &Connection, sizeof(Connection)));
-                } else {
-                    ASSERT(Operation.Xdp == XDP_QUIC_OPERATION_REMOVE);
-                    TEST_EQUAL(
-                        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
-                        TryQeoSet(InterfaceHandle.get(), &Connection, sizeof(Connection)));
-                }
-            }
-        }}}}}}
-    }
+    //
+    // Verify the revert/teardown succeeded.
+    //
+    TEST_TRUE(AsyncThread.get());
 }
 
 VOID
-OffloadQeoRevert(
-    _In_ REVERT_REASON RevertReason
+OffloadQeoOidFailure(
     )
 {
     auto If = FnMpIf;
     auto InterfaceHandle = InterfaceOpen(If.GetIfIndex());
     auto AdapterMp = MpOpenAdapter(If.GetIfIndex());
-    const auto Timeout =
-        RevertReason == RevertReasonInterfaceRemoval ?
-            MP_RESTART_TIMEOUT : TEST_TIMEOUT_ASYNC;
 
     const auto &Operation = QeoOperationMap[0];
     const auto &Direction = QeoDirectionMap[0];
@@ -7269,8 +16305,6 @@ OffloadQeoRevert(
     strcpy_s((CHAR *)Connection.PayloadIv, sizeof(Connection.PayloadIv), "PayloadIv");
     Connection.Status = E_FAIL;
 
-    TEST_HRESULT(TryQeoSet(InterfaceHandle.get(), &Connection, sizeof(Connection)));
-
     //
     // Configure the functional miniport to capture the offload request OID.
     //
@@ -7287,177 +16321,643 @@ OffloadQeoRevert(
     auto AsyncThread = std::async(
         std::launch::async,
         [&] {
-            if (RevertReason == RevertReasonInterfaceRemoval) {
-                return If.TryRestart();
-            } else {
-                ASSERT(RevertReason == RevertReasonHandleClosure);
-                InterfaceHandle.reset();
-                return (BOOLEAN)TRUE;
-            }
+            return TryQeoSet(InterfaceHandle.get(), &Connection, sizeof(Connection));
         }
     );
 
     //
-    // In case of failure, ensure the adapter is cleaned up before the
-    // async thread destructor runs; otherwise a deadlock on the OID
-    // path occurs.
+    // In case of failure, ensure the adapter is cleaned up before the
+    // async thread destructor runs; otherwise a deadlock on the OID
+    // path occurs.
+    //
+    auto AdapterScopeGuard = wil::scope_exit([&]
+    {
+        AdapterMp.reset();
+    });
+
+    //
+    // Retrieve the captured offload OID from the functional miniport.
+    //
+    UINT32 OidInfoBufferLength;
+    unique_malloc_ptr<VOID> OidInfoBuffer =
+        MpOidAllocateAndGetRequest(AdapterMp, Key, &OidInfoBufferLength);
+
+    NDIS_QUIC_CONNECTION *NdisConnection = (NDIS_QUIC_CONNECTION *)OidInfoBuffer.get();
+
+    TEST_EQUAL(sizeof(*NdisConnection), OidInfoBufferLength);
+    TEST_EQUAL(NDIS_STATUS_PENDING, NdisConnection->Status);
+
+    MpOidCompleteRequest(AdapterMp, Key, NDIS_STATUS_FAILURE, NdisConnection, OidInfoBufferLength);
+
+    //
+    // Verify the offload API fails once the OID completes.
+    //
+    TEST_EQUAL(AsyncThread.wait_for(TEST_TIMEOUT_ASYNC), std::future_status::ready);
+
+    //
+    // Verify the XDP offload API failed.
+    //
+    TEST_TRUE(FAILED(AsyncThread.get()));
+}
+
+VOID
+OffloadQeoSoftwareFallback(
+    )
+{
+    auto If = FnMpIf;
+    const CHAR *SoftwareFallbackRegName = "GenericQeoSoftwareFallback";
+    const UINT16 LocalPort = htons(1234);
+    const UINT16 RemotePort = htons(4321);
+    const UINT8 ConnectionIdLength = 8;
+    const UINT32 PnLength = 4;
+    const UINT32 TagLength = 16;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    //
+    // Enable the generic data path's software QEO fallback.
+    //
+    wil::unique_hkey XdpParametersKey;
+    DWORD SoftwareFallback = 1;
+    TEST_EQUAL(
+        ERROR_SUCCESS,
+        RegCreateKeyExA(
+            HKEY_LOCAL_MACHINE,
+            "System\\CurrentControlSet\\Services\\Xdp\\Parameters",
+            0, NULL, REG_OPTION_VOLATILE, KEY_WRITE, NULL, &XdpParametersKey, NULL));
+    TEST_EQUAL(
+        ERROR_SUCCESS,
+        RegSetValueExA(
+            XdpParametersKey.get(), SoftwareFallbackRegName, 0, REG_DWORD,
+            (BYTE *)&SoftwareFallback, sizeof(SoftwareFallback)));
+    auto RegValueScopeGuard = wil::scope_exit([&]
+    {
+        TEST_EQUAL(
+            ERROR_SUCCESS, RegDeleteValueA(XdpParametersKey.get(), SoftwareFallbackRegName));
+        Sleep(TEST_TIMEOUT_ASYNC_MS); // Give time for the reg change notification to occur.
+    });
+    Sleep(TEST_TIMEOUT_ASYNC_MS); // Give time for the reg change notification to occur.
+
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), FALSE, TRUE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto InterfaceHandle = InterfaceOpen(If.GetIfIndex());
+
+    UCHAR Mask[sizeof(RemoteHw)];
+    std::memset(Mask, 0xFF, sizeof(Mask));
+    auto MpFilter = MpTxFilter(GenericMp, &RemoteHw, Mask, sizeof(RemoteHw));
+
+    //
+    // The functional miniport does not support QEO, so the connection is
+    // offloaded to the generic data path.
+    //
+    XDP_QUIC_CONNECTION Connection;
+    XdpInitializeQuicConnection(&Connection, sizeof(Connection));
+    Connection.Operation = XDP_QUIC_OPERATION_ADD;
+    Connection.Direction = XDP_QUIC_DIRECTION_TRANSMIT;
+    Connection.DecryptFailureAction = XDP_QUIC_DECRYPT_FAILURE_ACTION_DROP;
+    Connection.KeyPhase = 0;
+    Connection.CipherType = XDP_QUIC_CIPHER_TYPE_AEAD_AES_128_GCM;
+    Connection.AddressFamily = XDP_QUIC_ADDRESS_FAMILY_INET4;
+    Connection.UdpPort = RemotePort;
+    Connection.NextPacketNumber = 5678;
+    Connection.ConnectionIdLength = ConnectionIdLength;
+    RtlCopyMemory(Connection.Address, &RemoteIp.Ipv4, sizeof(RemoteIp.Ipv4));
+    std::memset(Connection.ConnectionId, 0x11, ConnectionIdLength);
+    std::memset(Connection.PayloadKey, 0x22, 16);
+    std::memset(Connection.HeaderKey, 0x33, 16);
+    std::memset(Connection.PayloadIv, 0x44, sizeof(Connection.PayloadIv));
+    Connection.Status = E_FAIL;
+
+    TEST_HRESULT(TryQeoSet(InterfaceHandle.get(), &Connection, sizeof(Connection)));
+    TEST_HRESULT(Connection.Status);
+
+    //
+    // Build a short header packet with four packet number bytes, a plaintext
+    // payload, and trailing space reserved for the AEAD tag.
+    //
+    UCHAR Packet[1 + ConnectionIdLength + PnLength + 32 + TagLength] = {0};
+    const UINT32 PayloadOffset = 1 + ConnectionIdLength + PnLength;
+    Packet[0] = 0x40 | (PnLength - 1);
+    std::memset(Packet + 1, 0x11, ConnectionIdLength);
+    *(UINT32 *)(Packet + 1 + ConnectionIdLength) = htonl((UINT32)Connection.NextPacketNumber);
+    std::memset(Packet + PayloadOffset, 0x55, sizeof(Packet) - PayloadOffset - TagLength);
+
+    UINT64 TxBuffer = SocketFreePop(&Xsk);
+    UCHAR *TxFrame = Xsk.Umem.Buffer.get() + TxBuffer;
+    UINT32 TxFrameLength = Xsk.Umem.Reg.ChunkSize;
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            TxFrame, &TxFrameLength, Packet, sizeof(Packet), &RemoteHw, &LocalHw, AF_INET,
+            &RemoteIp, &LocalIp, RemotePort, LocalPort));
+
+    UINT32 ProducerIndex;
+    TEST_EQUAL(1, XskRingProducerReserve(&Xsk.Rings.Tx, 1, &ProducerIndex));
+
+    XSK_BUFFER_DESCRIPTOR *TxDesc = SocketGetTxDesc(&Xsk, ProducerIndex++);
+    TxDesc->Address.AddressAndOffset = TxBuffer;
+    TxDesc->Length = TxFrameLength;
+    XskRingProducerSubmit(&Xsk.Rings.Tx, 1);
+
+    XSK_NOTIFY_RESULT_FLAGS NotifyResult;
+    NotifySocket(Xsk.Handle.get(), XSK_NOTIFY_FLAG_POKE_TX, 0, &NotifyResult);
+    TEST_EQUAL(0, NotifyResult);
+
+    //
+    // Verify the connection ID is intact while the payload is encrypted and
+    // the tag is filled in.
+    //
+    auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
+    TEST_EQUAL(1, MpTxFrame->BufferCount);
+
+    const DATA_BUFFER *MpTxBuffer = &MpTxFrame->Buffers[0];
+    const UCHAR *MpPacket =
+        MpTxBuffer->VirtualAddress + MpTxBuffer->DataOffset + UDP_HEADER_BACKFILL(AF_INET);
+    TEST_EQUAL(TxFrameLength, MpTxBuffer->BufferLength);
+    TEST_TRUE(RtlEqualMemory(MpPacket + 1, Packet + 1, ConnectionIdLength));
+    TEST_FALSE(
+        RtlEqualMemory(
+            MpPacket + PayloadOffset, Packet + PayloadOffset, sizeof(Packet) - PayloadOffset));
+
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxFlush(GenericMp);
+
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Completion, 1);
+    TEST_EQUAL(TxBuffer, SocketGetTxCompDesc(&Xsk, ConsumerIndex));
+
+    Connection.Operation = XDP_QUIC_OPERATION_REMOVE;
+    Connection.Status = E_FAIL;
+    TEST_HRESULT(TryQeoSet(InterfaceHandle.get(), &Connection, sizeof(Connection)));
+    TEST_HRESULT(Connection.Status);
+}
+
+VOID
+OffloadFlowSteeringFilter()
+{
+    auto If = FnMpIf;
+    auto InterfaceHandle = InterfaceOpen(If.GetIfIndex());
+    XDP_FLOW_STEERING_FILTER Filter;
+    XDP_FLOW_STEERING_FILTER QueriedFilter;
+    UINT32 Size;
+
+    XdpInitializeFlowSteeringFilter(&Filter, sizeof(Filter));
+    Filter.Operation = XDP_FLOW_STEERING_OPERATION_ADD;
+    Filter.AddressFamily = XDP_FLOW_STEERING_ADDRESS_FAMILY_INET4;
+    Filter.Protocol = XDP_FLOW_STEERING_PROTOCOL_UDP;
+    Filter.DestinationPort = htons(1234);
+    Filter.DestinationAddress[0] = 192;
+    Filter.DestinationAddress[2] = 2;
+    Filter.DestinationAddress[3] = 1;
+    Filter.QueueId = 0;
+    Filter.Status = E_FAIL;
+
+    //
+    // Verify the destination tuple is required.
+    //
+    XDP_FLOW_STEERING_FILTER InvalidFilter = Filter;
+    InvalidFilter.DestinationPort = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryFlowSteeringSet(InterfaceHandle.get(), &InvalidFilter, sizeof(InvalidFilter)));
+
+    //
+    // Verify no filters are initially reported.
+    //
+    Size = 0;
+    TEST_HRESULT(TryFlowSteeringGet(InterfaceHandle.get(), NULL, &Size));
+    TEST_EQUAL(0, Size);
+
+    TEST_HRESULT(TryFlowSteeringSet(InterfaceHandle.get(), &Filter, sizeof(Filter)));
+    TEST_EQUAL(S_OK, Filter.Status);
+
+    //
+    // Verify duplicate filters cannot be added.
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_OBJECT_ALREADY_EXISTS),
+        TryFlowSteeringSet(InterfaceHandle.get(), &Filter, sizeof(Filter)));
+
+    //
+    // Verify the filter is reported by the query.
+    //
+    Size = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_MORE_DATA),
+        TryFlowSteeringGet(InterfaceHandle.get(), NULL, &Size));
+    TEST_EQUAL(sizeof(QueriedFilter), Size);
+
+    TEST_HRESULT(TryFlowSteeringGet(InterfaceHandle.get(), &QueriedFilter, &Size));
+    TEST_EQUAL(sizeof(QueriedFilter), Size);
+    TEST_EQUAL(Filter.AddressFamily, QueriedFilter.AddressFamily);
+    TEST_EQUAL(Filter.Protocol, QueriedFilter.Protocol);
+    TEST_EQUAL(Filter.DestinationPort, QueriedFilter.DestinationPort);
+    TEST_EQUAL(Filter.QueueId, QueriedFilter.QueueId);
+    TEST_TRUE(RtlEqualMemory(
+        Filter.DestinationAddress, QueriedFilter.DestinationAddress,
+        sizeof(Filter.DestinationAddress)));
+
+    //
+    // Verify the filter can be removed exactly once.
+    //
+    Filter.Operation = XDP_FLOW_STEERING_OPERATION_REMOVE;
+    Filter.Status = E_FAIL;
+    TEST_HRESULT(TryFlowSteeringSet(InterfaceHandle.get(), &Filter, sizeof(Filter)));
+    TEST_EQUAL(S_OK, Filter.Status);
+
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+        TryFlowSteeringSet(InterfaceHandle.get(), &Filter, sizeof(Filter)));
+
+    Size = 0;
+    TEST_HRESULT(TryFlowSteeringGet(InterfaceHandle.get(), NULL, &Size));
+    TEST_EQUAL(0, Size);
+}
+
+VOID
+GenericRxDedicatedQueue()
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort;
+    UINT16 RemotePort = htons(1234);
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+
+    auto Socket = CreateUdpSocket(AF_INET, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto InterfaceHandle = InterfaceOpen(If.GetIfIndex());
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    auto Xsk =
+        CreateAndBindSocket(
+            If.GetIfIndex(), XDP_DEDICATED_QUEUE_ID_BASE, TRUE, FALSE, XDP_GENERIC);
+
+    XDP_RULE Rule;
+    Rule.Match = XDP_MATCH_ALL;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Redirect.Target = Xsk.Handle.get();
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, XDP_DEDICATED_QUEUE_ID_BASE, XDP_GENERIC, &Rule, 1);
+
+    XDP_FLOW_STEERING_FILTER Filter;
+    XdpInitializeFlowSteeringFilter(&Filter, sizeof(Filter));
+    Filter.Operation = XDP_FLOW_STEERING_OPERATION_ADD;
+    Filter.AddressFamily = XDP_FLOW_STEERING_ADDRESS_FAMILY_INET4;
+    Filter.Protocol = XDP_FLOW_STEERING_PROTOCOL_UDP;
+    Filter.DestinationPort = LocalPort;
+    RtlCopyMemory(Filter.DestinationAddress, &LocalIp.Ipv4, sizeof(LocalIp.Ipv4));
+    Filter.Status = E_FAIL;
+
+    //
+    // Verify filters cannot target dedicated queues beyond the last one.
     //
-    auto AdapterScopeGuard = wil::scope_exit([&]
-    {
-        AdapterMp.reset();
-    });
+    Filter.QueueId = XDP_DEDICATED_QUEUE_ID_BASE + XDP_DEDICATED_QUEUE_COUNT;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryFlowSteeringSet(InterfaceHandle.get(), &Filter, sizeof(Filter)));
+
+    const UCHAR Payload[] = "GenericRxDedicatedQueue";
+    UCHAR PacketBuffer[UDP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 PacketBufferLength = sizeof(PacketBuffer);
+    RX_FRAME Frame;
+
+    SocketProduceRxFill(&Xsk, 2);
+
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            PacketBuffer, &PacketBufferLength, Payload, sizeof(Payload), &LocalHw,
+            &RemoteHw, AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
 
     //
-    // Retrieve the captured offload OID from the functional miniport.
+    // Verify the dedicated queue receives nothing from RSS.
     //
-    UINT32 OidInfoBufferLength;
-    unique_malloc_ptr<VOID> OidInfoBuffer =
-        MpOidAllocateAndGetRequest(AdapterMp, Key, &OidInfoBufferLength, Timeout);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    Sleep(TEST_TIMEOUT_ASYNC_MS * 2);
+
+    UINT32 ConsumerIndex;
+    TEST_EQUAL(0, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
 
     //
-    // Verify the OID parameters match the XDP connection request.
+    // Steer the flow to the dedicated queue and verify it is received there.
     //
-    NDIS_QUIC_CONNECTION *NdisConnection = (NDIS_QUIC_CONNECTION *)OidInfoBuffer.get();
+    Filter.QueueId = XDP_DEDICATED_QUEUE_ID_BASE;
+    TEST_HRESULT(TryFlowSteeringSet(InterfaceHandle.get(), &Filter, sizeof(Filter)));
+    TEST_EQUAL(S_OK, Filter.Status);
 
-    TEST_EQUAL(sizeof(*NdisConnection), OidInfoBufferLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
 
-    TEST_EQUAL((UINT32)NDIS_QUIC_OPERATION_REMOVE, NdisConnection->Operation);
-    TEST_EQUAL((UINT32)Direction.Ndis, NdisConnection->Direction);
-    TEST_EQUAL((UINT32)DecryptFailureAction.Ndis, NdisConnection->DecryptFailureAction);
-    TEST_EQUAL(KeyPhase, NdisConnection->KeyPhase);
-    TEST_EQUAL((UINT32)CipherType.Ndis, NdisConnection->CipherType);
-    TEST_EQUAL(AddressFamily.Ndis, NdisConnection->AddressFamily);
-    TEST_EQUAL(Connection.UdpPort, NdisConnection->UdpPort);
-    TEST_EQUAL(Connection.NextPacketNumber, NdisConnection->NextPacketNumber);
-    TEST_EQUAL(Connection.ConnectionIdLength, NdisConnection->ConnectionIdLength);
+    ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+    auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+    TEST_EQUAL(PacketBufferLength, RxDesc->Length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Xsk.Umem.Buffer.get() + RxDesc->Address.BaseAddress + RxDesc->Address.Offset,
+            PacketBuffer,
+            PacketBufferLength));
+}
 
-    C_ASSERT(sizeof(Connection.Address) == sizeof(NdisConnection->Address));
-    TEST_TRUE(RtlEqualMemory(
-        Connection.Address, NdisConnection->Address, sizeof(Connection.Address)));
+VOID
+GenericRxBypassQueue()
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort;
+    UINT16 RemotePort = htons(1234);
+    const UINT16 PassPort = htons(1235);
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    const UINT32 InspectQueueId = 0;
+    const UINT32 BypassQueueId = 1;
 
-    C_ASSERT(sizeof(Connection.ConnectionId) == sizeof(NdisConnection->ConnectionId));
-    TEST_TRUE(RtlEqualMemory(
-        Connection.ConnectionId, NdisConnection->ConnectionId, Connection.ConnectionIdLength));
+    if (GetProcessorCount() < 2) {
+        TEST_WARNING("Test requires at least 2 logical processors. Skipping.");
+        return;
+    }
 
-    C_ASSERT(sizeof(Connection.PayloadKey) == sizeof(NdisConnection->PayloadKey));
-    TEST_TRUE(RtlEqualMemory(
-        Connection.PayloadKey, NdisConnection->PayloadKey, sizeof(Connection.PayloadKey)));
+    auto Socket = CreateUdpSocket(AF_INET, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto DefaultLwf = LwfOpenDefault(If.GetIfIndex());
+    auto InterfaceHandle = InterfaceOpen(If.GetIfIndex());
 
-    C_ASSERT(sizeof(Connection.HeaderKey) == sizeof(NdisConnection->HeaderKey));
-    TEST_TRUE(RtlEqualMemory(
-        Connection.HeaderKey, NdisConnection->HeaderKey, sizeof(Connection.HeaderKey)));
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
 
-    C_ASSERT(sizeof(Connection.PayloadIv) == sizeof(NdisConnection->PayloadIv));
-    TEST_TRUE(RtlEqualMemory(
-        Connection.PayloadIv, NdisConnection->PayloadIv, sizeof(Connection.PayloadIv)));
+    //
+    // Redirect the socket's flow on one RSS queue and inspect every frame on
+    // another, so both queues have clients.
+    //
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), InspectQueueId, TRUE, FALSE, XDP_GENERIC);
+
+    XDP_RULE Rule;
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Redirect.Target = Xsk.Handle.get();
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, InspectQueueId, XDP_GENERIC, &Rule, 1);
+
+    XDP_RULE PassRule;
+    PassRule.Match = XDP_MATCH_ALL;
+    PassRule.Action = XDP_PROGRAM_ACTION_PASS;
+
+    wil::unique_handle PassProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, BypassQueueId, XDP_GENERIC, &PassRule, 1);
+
+    const UCHAR Payload[] = "GenericRxBypassQueue";
+    UCHAR MatchPacket[UDP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 MatchPacketLength = sizeof(MatchPacket);
+    UCHAR PassPacket[UDP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 PassPacketLength = sizeof(PassPacket);
+
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            MatchPacket, &MatchPacketLength, Payload, sizeof(Payload), &LocalHw,
+            &RemoteHw, AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            PassPacket, &PassPacketLength, Payload, sizeof(Payload), &LocalHw,
+            &RemoteHw, AF_INET, &LocalIp, &RemoteIp, PassPort, RemotePort));
+
+    auto IndicateOnQueue = [&](UCHAR *Packet, UINT32 PacketLength, UINT32 QueueId) {
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, QueueId, Packet, PacketLength);
+        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+
+        DATA_FLUSH_OPTIONS FlushOptions = {0};
+        FlushOptions.Flags.RssCpu = TRUE;
+        FlushOptions.RssCpuQueueId = QueueId;
+        TEST_HRESULT(TryMpRxFlush(GenericMp, &FlushOptions));
+    };
+
+    auto VerifyXskFrame = [&](MY_SOCKET *XskSocket) {
+        UINT32 ConsumerIndex = SocketConsumerReserve(&XskSocket->Rings.Rx, 1);
+        TEST_EQUAL(1, XskRingConsumerReserve(&XskSocket->Rings.Rx, MAXUINT32, &ConsumerIndex));
+        auto RxDesc = SocketGetAndFreeRxDesc(XskSocket, ConsumerIndex);
+        TEST_EQUAL(MatchPacketLength, RxDesc->Length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                XskSocket->Umem.Buffer.get() + RxDesc->Address.BaseAddress +
+                    RxDesc->Address.Offset,
+                MatchPacket, MatchPacketLength));
+    };
+
+    std::vector<UCHAR> Mask(PassPacketLength, 0xFF);
+    auto LwfFilter = LwfRxFilter(DefaultLwf, PassPacket, &Mask[0], PassPacketLength);
 
     //
-    // Reset the miniport handle, allowing the captured OID to be completed.
+    // Capture a frame passed by inspection on the queue.
     //
-    AdapterMp.reset();
+    IndicateOnQueue(PassPacket, PassPacketLength, BypassQueueId);
+    auto InspectedFrame = LwfRxAllocateAndGetFrame(DefaultLwf, 0);
+    LwfRxDequeueFrame(DefaultLwf, 0);
+    LwfRxFlush(DefaultLwf);
 
     //
-    // Verify the revert/teardown is completed once the OID completes.
+    // Detach the queue's only client and verify its frames now bypass
+    // inspection unchanged: same contents, RSS hash and processor.
     //
-    TEST_EQUAL(AsyncThread.wait_for(Timeout), std::future_status::ready);
+    PassProgramHandle.reset();
+
+    IndicateOnQueue(PassPacket, PassPacketLength, BypassQueueId);
+    auto BypassedFrame = LwfRxAllocateAndGetFrame(DefaultLwf, 0);
+    TEST_EQUAL(1, BypassedFrame->BufferCount);
+    TEST_EQUAL(PassPacketLength, BypassedFrame->Buffers[0].DataLength);
+    TEST_TRUE(
+        RtlEqualMemory(
+            BypassedFrame->Buffers[0].VirtualAddress + BypassedFrame->Buffers[0].DataOffset,
+            PassPacket, PassPacketLength));
+    TEST_EQUAL(InspectedFrame->Output.RssHash, BypassedFrame->Output.RssHash);
+    TEST_EQUAL(
+        InspectedFrame->Output.ProcessorNumber.Group,
+        BypassedFrame->Output.ProcessorNumber.Group);
+    TEST_EQUAL(
+        InspectedFrame->Output.ProcessorNumber.Number,
+        BypassedFrame->Output.ProcessorNumber.Number);
+    LwfRxDequeueFrame(DefaultLwf, 0);
+    LwfRxFlush(DefaultLwf);
 
     //
-    // Verify the revert/teardown succeeded.
+    // Verify the queue with a client is still inspected.
     //
-    TEST_TRUE(AsyncThread.get());
+    SocketProduceRxFill(&Xsk, 1);
+    IndicateOnQueue(MatchPacket, MatchPacketLength, InspectQueueId);
+    VerifyXskFrame(&Xsk);
+
+    //
+    // Flow steering applies to every RSS queue, so it must disable the bypass:
+    // steer the socket's flow to a dedicated queue and verify it is received
+    // there from the queue without clients.
+    //
+    auto DedicatedXsk =
+        CreateAndBindSocket(
+            If.GetIfIndex(), XDP_DEDICATED_QUEUE_ID_BASE, TRUE, FALSE, XDP_GENERIC);
+
+    Rule.Match = XDP_MATCH_ALL;
+    Rule.Redirect.Target = DedicatedXsk.Handle.get();
+
+    wil::unique_handle DedicatedProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, XDP_DEDICATED_QUEUE_ID_BASE, XDP_GENERIC, &Rule, 1);
+
+    XDP_FLOW_STEERING_FILTER Filter;
+    XdpInitializeFlowSteeringFilter(&Filter, sizeof(Filter));
+    Filter.Operation = XDP_FLOW_STEERING_OPERATION_ADD;
+    Filter.AddressFamily = XDP_FLOW_STEERING_ADDRESS_FAMILY_INET4;
+    Filter.Protocol = XDP_FLOW_STEERING_PROTOCOL_UDP;
+    Filter.DestinationPort = LocalPort;
+    RtlCopyMemory(Filter.DestinationAddress, &LocalIp.Ipv4, sizeof(LocalIp.Ipv4));
+    Filter.QueueId = XDP_DEDICATED_QUEUE_ID_BASE;
+    Filter.Status = E_FAIL;
+    TEST_HRESULT(TryFlowSteeringSet(InterfaceHandle.get(), &Filter, sizeof(Filter)));
+    TEST_EQUAL(S_OK, Filter.Status);
+
+    SocketProduceRxFill(&DedicatedXsk, 1);
+    IndicateOnQueue(MatchPacket, MatchPacketLength, BypassQueueId);
+    VerifyXskFrame(&DedicatedXsk);
 }
 
 VOID
-OffloadQeoOidFailure(
-    )
+GenericRxAllQueuesLateQueue()
 {
     auto If = FnMpIf;
-    auto InterfaceHandle = InterfaceOpen(If.GetIfIndex());
-    auto AdapterMp = MpOpenAdapter(If.GetIfIndex());
+    UINT16 LocalPort;
+    UINT16 RemotePort = htons(1234);
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
 
-    const auto &Operation = QeoOperationMap[0];
-    const auto &Direction = QeoDirectionMap[0];
-    const auto &DecryptFailureAction = QeoDecryptFailureActionMap[0];
-    const auto &KeyPhase = 0U;
-    const auto &CipherType = QeoCipherTypeMap[0];
-    const auto &AddressFamily = QeoAddressFamilyMap[0];
+    auto Socket = CreateUdpSocket(AF_INET, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto InterfaceHandle = InterfaceOpen(If.GetIfIndex());
 
-    ASSERT(Operation.Xdp == XDP_QUIC_OPERATION_ADD);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
 
     //
-    // Initialize the connection for the add operation.
+    // Dedicated queues lie outside the RSS queues an all-queues program is
+    // attached to when it is created, so their RX queues are created later.
     //
-    XDP_QUIC_CONNECTION Connection;
-    XdpInitializeQuicConnection(&Connection, sizeof(Connection));
-    Connection.Operation = Operation.Xdp;
-    Connection.Direction = Direction.Xdp;
-    Connection.DecryptFailureAction = DecryptFailureAction.Xdp;
-    Connection.KeyPhase = KeyPhase;
-    Connection.CipherType = CipherType.Xdp;
-    Connection.AddressFamily = AddressFamily.Xdp;
-    Connection.UdpPort = htons(1234);
-    Connection.NextPacketNumber = 5678;
-    Connection.ConnectionIdLength = 3;
-    strcpy_s((CHAR *)Connection.Address, sizeof(Connection.Address), "Address");
-    strcpy_s((CHAR *)Connection.ConnectionId, sizeof(Connection.ConnectionId), "Id");
-    strcpy_s((CHAR *)Connection.PayloadKey, sizeof(Connection.PayloadKey), "PayloadKey");
-    strcpy_s((CHAR *)Connection.HeaderKey, sizeof(Connection.HeaderKey), "HeaderKey");
-    strcpy_s((CHAR *)Connection.PayloadIv, sizeof(Connection.PayloadIv), "PayloadIv");
-    Connection.Status = E_FAIL;
+    XDP_RULE Rule;
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_L2FWD;
 
-    //
-    // Configure the functional miniport to capture the offload request OID.
-    //
-    OID_KEY Key;
-    InitializeOidKey(
-        &Key, OffloadQeoGetExpectedOid(), NdisRequestMethod, OID_REQUEST_INTERFACE_DIRECT);
-    MpOidFilter(AdapterMp, &Key, 1);
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1,
+            XDP_CREATE_PROGRAM_FLAG_ALL_QUEUES);
 
-    //
-    // Initiate the offload request on a separate thread: the operation will
-    // block until the OID is completed, which won't happen until the miniport
-    // handle is reset below.
-    //
-    auto AsyncThread = std::async(
-        std::launch::async,
-        [&] {
-            return TryQeoSet(InterfaceHandle.get(), &Connection, sizeof(Connection));
+    XDP_FLOW_STEERING_FILTER Filter;
+    XdpInitializeFlowSteeringFilter(&Filter, sizeof(Filter));
+    Filter.Operation = XDP_FLOW_STEERING_OPERATION_ADD;
+    Filter.AddressFamily = XDP_FLOW_STEERING_ADDRESS_FAMILY_INET4;
+    Filter.Protocol = XDP_FLOW_STEERING_PROTOCOL_UDP;
+    Filter.DestinationPort = LocalPort;
+    RtlCopyMemory(Filter.DestinationAddress, &LocalIp.Ipv4, sizeof(LocalIp.Ipv4));
+    Filter.QueueId = XDP_DEDICATED_QUEUE_ID_BASE;
+    Filter.Status = E_FAIL;
+    TEST_HRESULT(TryFlowSteeringSet(InterfaceHandle.get(), &Filter, sizeof(Filter)));
+    TEST_EQUAL(S_OK, Filter.Status);
+
+    const UCHAR Payload[] = "GenericRxAllQueuesLateQueue";
+    UCHAR PacketBuffer[UDP_HEADER_STORAGE + sizeof(Payload)];
+    UINT32 PacketBufferLength = sizeof(PacketBuffer);
+    UCHAR L2FwdBuffer[sizeof(PacketBuffer)];
+    UINT32 L2FwdLength = sizeof(L2FwdBuffer);
+    UCHAR Mask[sizeof(PacketBuffer)];
+    RX_FRAME Frame;
+
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            PacketBuffer, &PacketBufferLength, Payload, sizeof(Payload), &LocalHw,
+            &RemoteHw, AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            L2FwdBuffer, &L2FwdLength, Payload, sizeof(Payload), &RemoteHw,
+            &LocalHw, AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    RtlFillMemory(Mask, sizeof(Mask), 0xFF);
+
+    auto MpFilter = MpTxFilter(GenericMp, L2FwdBuffer, Mask, L2FwdLength);
+
+    auto VerifyForwarded = [&](BOOLEAN Forwarded) {
+        RxInitializeFrame(&Frame, If.GetQueueId(), PacketBuffer, PacketBufferLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        if (Forwarded) {
+            auto TxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
+            TEST_EQUAL(1, TxFrame->BufferCount);
+            TEST_EQUAL(L2FwdLength, TxFrame->Buffers[0].DataLength);
+            MpTxDequeueFrame(GenericMp, 0);
+            MpTxFlush(GenericMp);
+        } else {
+            UINT32 FrameLength = 0;
+
+            Sleep(TEST_TIMEOUT_ASYNC_MS);
+            TEST_EQUAL(
+                HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+                MpTxGetFrame(GenericMp, 0, &FrameLength, NULL));
         }
-    );
+    };
 
     //
-    // In case of failure, ensure the adapter is cleaned up before the
-    // async thread destructor runs; otherwise a deadlock on the OID
-    // path occurs.
+    // Without an RX queue on the dedicated queue, steered frames are not
+    // inspected.
     //
-    auto AdapterScopeGuard = wil::scope_exit([&]
-    {
-        AdapterMp.reset();
-    });
+    VerifyForwarded(FALSE);
 
     //
-    // Retrieve the captured offload OID from the functional miniport.
+    // Binding a socket creates the dedicated RX queue, and the all-queues
+    // program is attached to it.
     //
-    UINT32 OidInfoBufferLength;
-    unique_malloc_ptr<VOID> OidInfoBuffer =
-        MpOidAllocateAndGetRequest(AdapterMp, Key, &OidInfoBufferLength);
-
-    NDIS_QUIC_CONNECTION *NdisConnection = (NDIS_QUIC_CONNECTION *)OidInfoBuffer.get();
-
-    TEST_EQUAL(sizeof(*NdisConnection), OidInfoBufferLength);
-    TEST_EQUAL(NDIS_STATUS_PENDING, NdisConnection->Status);
-
-    MpOidCompleteRequest(AdapterMp, Key, NDIS_STATUS_FAILURE, NdisConnection, OidInfoBufferLength);
+    auto Xsk =
+        CreateAndBindSocket(
+            If.GetIfIndex(), XDP_DEDICATED_QUEUE_ID_BASE, TRUE, FALSE, XDP_GENERIC);
+    VerifyForwarded(TRUE);
 
     //
-    // Verify the offload API fails once the OID completes.
+    // Closing the program detaches it from the later RX queue too.
     //
-    TEST_EQUAL(AsyncThread.wait_for(TEST_TIMEOUT_ASYNC), std::future_status::ready);
+    ProgramHandle.reset();
+    VerifyForwarded(FALSE);
 
     //
-    // Verify the XDP offload API failed.
+    // Recreate the program while the dedicated RX queue exists, then close
+    // the socket first: the RX queue is deleted with the program attached,
+    // and a new socket's RX queue is attached again.
     //
-    TEST_TRUE(FAILED(AsyncThread.get()));
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1,
+            XDP_CREATE_PROGRAM_FLAG_ALL_QUEUES);
+    VerifyForwarded(TRUE);
+
+    Xsk.Handle.reset();
+    Xsk =
+        CreateAndBindSocket(
+            If.GetIfIndex(), XDP_DEDICATED_QUEUE_ID_BASE, TRUE, FALSE, XDP_GENERIC);
+    VerifyForwarded(TRUE);
+
+    ProgramHandle.reset();
+    Xsk.Handle.reset();
+    VerifyForwarded(FALSE);
 }
 
 VOID
@@ -23,12 +23,60 @@ GenericBinding();
 VOID
 GenericBindingResetAdapter();
 
+VOID
+GenericBindingIfIndexAlias();
+
 VOID
 GenericRxSingleFrame();
 
 VOID
 GenericRxNoPoke();
 
+VOID
+GenericRxMultiBuffer();
+
+VOID
+GenericRxHeaderSplit();
+
+VOID
+GenericRxCoalesce();
+
+VOID
+GenericXskRingIndexes();
+
+VOID
+GenericXskUmemAlignedChunks();
+
+VOID
+GenericXskRxNonTemporalCopy();
+
+VOID
+GenericXskNotifyModeration();
+
+VOID
+GenericXskWakeParameters();
+
+VOID
+GenericXskRingConsumerWait();
+
+VOID
+GenericTxCompletionBatch();
+
+VOID
+GenericTxInlineBudget();
+
+VOID
+GenericXskTimestamps();
+
+VOID
+GenericRxMetadata();
+
+VOID
+GenericXskPollParameters();
+
+VOID
+GenericXskPollModeInline();
+
 VOID
 GenericRxBackfillAndTrailer();
 
@@ -37,6 +85,22 @@ GenericRxAllQueueRedirect(
     _In_ ADDRESS_FAMILY Af
     );
 
+VOID
+GenericRxPersistedProgram();
+
+VOID
+GenericRxMatchVlan(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxIpv6ExtensionHeaders();
+
+VOID
+GenericRxIpFragmentAffinity(
+    _In_ ADDRESS_FAMILY Af
+    );
+
 VOID
 GenericRxTcpControl(
     _In_ ADDRESS_FAMILY Af
@@ -54,12 +118,117 @@ GenericRxMatchIpPrefix(
     _In_ UINT16 AddressFamily
     );
 
+VOID
+GenericRxMatchIndexedTuple(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxMatchIndexedQuicCid(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxMatchLpm(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxMatchSource(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxUpdateRules(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxProgramReplace();
+
+VOID
+GenericRxRuleCounters(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxAllQueuesDropOffload(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxFlightRecorder();
+
+VOID
+GenericRxTuning();
+
+VOID
+GenericRxL2FwdCloneCache();
+
 VOID
 GenericRxLowResources();
 
+VOID
+GenericRxLowResourcesL2Fwd();
+
 VOID
 GenericRxMultiSocket();
 
+VOID
+GenericRxMultiSocketInterleaved();
+
+VOID
+GenericRxBatchFragments();
+
+VOID
+GenericRxMultiSocketPortSet();
+
+VOID
+GenericRxXskMapRedirect(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxXskFanoutRedirect(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxXskFanoutDistinct();
+
+VOID
+GenericRxQuicLbRedirect(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxSample();
+
+VOID
+GenericRxPolice();
+
+VOID
+GenericRxConntrack();
+
+VOID
+GenericRxDecapRedirect();
+
+VOID
+GenericRxLoadBalance(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxRedirectInterfaceTx();
+
+VOID
+GenericRxEncap();
+
+VOID
+GenericRxSynCookie(
+    _In_ ADDRESS_FAMILY Af
+    );
+
 VOID
 GenericRxMultiProgram();
 
@@ -86,6 +255,11 @@ GenericRxTooManyFragments(
     _In_ BOOLEAN IsUdp
     );
 
+VOID
+GenericRxFragmentLimit(
+    _In_ ADDRESS_FAMILY Af
+    );
+
 VOID
 GenericRxHeaderFragments(
     _In_ ADDRESS_FAMILY Af,
@@ -100,6 +274,12 @@ GenericRxFromTxInspect(
     _In_ ADDRESS_FAMILY Af
     );
 
+VOID
+NativeTxInspectDropPass();
+
+VOID
+NativeRxBackpressure();
+
 VOID
 SecurityAdjustDeviceAcl();
 
@@ -109,18 +289,42 @@ GenericRxEbpfAttach();
 VOID
 GenericRxEbpfDrop();
 
+VOID
+GenericTxEbpfDrop();
+
 VOID
 GenericRxEbpfPass();
 
+VOID
+GenericRxEbpfReplace();
+
+VOID
+GenericRxEbpfFlowCache();
+
+VOID
+GenericRxEbpfPrefilter();
+
 VOID
 GenericRxEbpfTx();
 
 VOID
 GenericRxEbpfPayload();
 
+VOID
+GenericRxEbpfAdjustTail();
+
+VOID
+GenericRxEbpfRedirectXsk();
+
+VOID
+GenericRxEbpfMetadata();
+
 VOID
 ProgTestRunRxEbpfPayload();
 
+VOID
+ProgTestRunRxEbpfRepeat();
+
 VOID
 GenericRxEbpfIfIndex();
 
@@ -136,6 +340,45 @@ GenericTxToRxInject();
 VOID
 GenericTxSingleFrame();
 
+VOID
+GenericXskKernelNpi();
+
+VOID
+GenericTxZeroCopy();
+
+VOID
+GenericTxRebindSocket();
+
+VOID
+GenericTxSharedUmem();
+
+VOID
+GenericXskSharedFillRing();
+
+VOID
+GenericXskRxFillPool();
+
+VOID
+GenericXskRxPriorityRing();
+
+VOID
+GenericXskSharedRxRing();
+
+VOID
+GenericXskUmemRegions();
+
+VOID
+GenericTxSegmentation();
+
+VOID
+GenericTxTcpSegmentation();
+
+VOID
+GenericTxChecksumOffload();
+
+VOID
+GenericTxSendHash();
+
 VOID
 GenericTxOutOfOrder();
 
@@ -145,13 +388,17 @@ GenericTxSharing();
 VOID
 GenericTxPoke();
 
+VOID
+GenericTxPokeLinger();
+
 VOID
 GenericTxMtu();
 
 VOID
 GenericXskWait(
     _In_ BOOLEAN Rx,
-    _In_ BOOLEAN Tx
+    _In_ BOOLEAN Tx,
+    _In_ BOOLEAN Spin
     );
 
 VOID
@@ -160,6 +407,51 @@ GenericXskWaitAsync(
     _In_ BOOLEAN Tx
     );
 
+VOID
+GenericXskNotifySockets();
+
+VOID
+GenericXskSockopts();
+
+VOID
+GenericXskNotifyCompletionPort();
+
+VOID
+GenericXskStatisticsEx();
+
+VOID
+GenericXskStatisticsPage();
+
+VOID
+GenericXskUmemAlloc();
+
+VOID
+GenericXskHandoff();
+
+VOID
+GenericXskTxWeight();
+
+VOID
+GenericXskTxRateLimit();
+
+VOID
+GenericXskTxLaunchTime();
+
+VOID
+GenericXskLargePages();
+
+VOID
+GenericXskModeFailover();
+
+VOID
+GenericXskTxCompletionInOrder();
+
+VOID
+GenericXskMemoryUsage();
+
+VOID
+GenericXskRingOccupancy();
+
 VOID
 GenericLwfDelayDetach(
     _In_ BOOLEAN Rx,
@@ -195,12 +487,33 @@ OffloadRssCapabilities();
 VOID
 OffloadRssReset();
 
+VOID
+OffloadRssSymmetric();
+
+VOID
+OffloadRssRebalance();
+
 VOID
 OffloadSetHardwareCapabilities();
 
 VOID
 GenericXskQueryAffinity();
 
+VOID
+GenericXskRssSetQueueProcessor();
+
+VOID
+GenericRxRssHashless();
+
+VOID
+GenericRxRssIndirectionMove();
+
+VOID
+GenericTeamQueues();
+
+VOID
+GenericXskNumaNode();
+
 VOID
 OffloadQeoConnection();
 
@@ -218,5 +531,21 @@ VOID
 OffloadQeoOidFailure(
     );
 
+VOID
+OffloadQeoSoftwareFallback(
+    );
+
+VOID
+OffloadFlowSteeringFilter();
+
+VOID
+GenericRxDedicatedQueue();
+
+VOID
+GenericRxBypassQueue();
+
+VOID
+GenericRxAllQueuesLateQueue();
+
 VOID
 OidPassthru();
@@ -115,6 +115,10 @@ public:
         ::GenericBindingResetAdapter();
     }
 
+    TEST_METHOD(GenericBindingIfIndexAlias) {
+        ::GenericBindingIfIndexAlias();
+    }
+
     TEST_METHOD(GenericRxSingleFrame) {
         ::GenericRxSingleFrame();
     }
@@ -123,18 +127,174 @@ public:
         ::GenericRxNoPoke();
     }
 
+    TEST_METHOD(GenericRxMultiBuffer) {
+        ::GenericRxMultiBuffer();
+    }
+
+    TEST_METHOD(GenericRxHeaderSplit) {
+        ::GenericRxHeaderSplit();
+    }
+
+    TEST_METHOD(GenericRxCoalesce) {
+        ::GenericRxCoalesce();
+    }
+
+    TEST_METHOD(GenericXskRingIndexes) {
+        ::GenericXskRingIndexes();
+    }
+
+    TEST_METHOD(GenericXskUmemAlignedChunks) {
+        ::GenericXskUmemAlignedChunks();
+    }
+
+    TEST_METHOD(GenericXskRxNonTemporalCopy) {
+        ::GenericXskRxNonTemporalCopy();
+    }
+
+    TEST_METHOD(GenericXskNotifyModeration) {
+        ::GenericXskNotifyModeration();
+    }
+
+    TEST_METHOD(GenericXskWakeParameters) {
+        ::GenericXskWakeParameters();
+    }
+
+    TEST_METHOD(GenericXskRingConsumerWait) {
+        ::GenericXskRingConsumerWait();
+    }
+
+    TEST_METHOD(GenericTxCompletionBatch) {
+        ::GenericTxCompletionBatch();
+    }
+
+    TEST_METHOD(GenericTxInlineBudget) {
+        ::GenericTxInlineBudget();
+    }
+
+    TEST_METHOD(GenericXskTimestamps) {
+        ::GenericXskTimestamps();
+    }
+
+    TEST_METHOD(GenericRxMetadata) {
+        ::GenericRxMetadata();
+    }
+
+    TEST_METHOD(GenericXskPollParameters) {
+        ::GenericXskPollParameters();
+    }
+
+    TEST_METHOD(GenericXskPollModeInline) {
+        ::GenericXskPollModeInline();
+    }
+
     TEST_METHOD(GenericRxBackfillAndTrailer) {
         ::GenericRxBackfillAndTrailer();
     }
 
+    TEST_METHOD_PRERELEASE(GenericRxFlightRecorder) {
+        ::GenericRxFlightRecorder();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericRxTuning) {
+        ::GenericRxTuning();
+    }
+
+    TEST_METHOD(GenericRxL2FwdCloneCache) {
+        ::GenericRxL2FwdCloneCache();
+    }
+
     TEST_METHOD(GenericRxLowResources) {
         ::GenericRxLowResources();
     }
 
+    TEST_METHOD(GenericRxLowResourcesL2Fwd) {
+        ::GenericRxLowResourcesL2Fwd();
+    }
+
     TEST_METHOD(GenericRxMultiSocket) {
         ::GenericRxMultiSocket();
     }
 
+    TEST_METHOD(GenericRxMultiSocketInterleaved) {
+        ::GenericRxMultiSocketInterleaved();
+    }
+
+    TEST_METHOD(GenericRxBatchFragments) {
+        ::GenericRxBatchFragments();
+    }
+
+    TEST_METHOD(GenericRxMultiSocketPortSet) {
+        ::GenericRxMultiSocketPortSet();
+    }
+
+    TEST_METHOD(GenericRxXskMapRedirectV4) {
+        GenericRxXskMapRedirect(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxXskMapRedirectV6) {
+        GenericRxXskMapRedirect(AF_INET6);
+    }
+
+    TEST_METHOD(GenericRxXskFanoutRedirectV4) {
+        GenericRxXskFanoutRedirect(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxXskFanoutRedirectV6) {
+        GenericRxXskFanoutRedirect(AF_INET6);
+    }
+
+    TEST_METHOD(GenericRxXskFanoutDistinct) {
+        ::GenericRxXskFanoutDistinct();
+    }
+
+    TEST_METHOD(GenericRxQuicLbRedirectV4) {
+        GenericRxQuicLbRedirect(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxQuicLbRedirectV6) {
+        GenericRxQuicLbRedirect(AF_INET6);
+    }
+
+    TEST_METHOD(GenericRxSample) {
+        ::GenericRxSample();
+    }
+
+    TEST_METHOD(GenericRxPolice) {
+        ::GenericRxPolice();
+    }
+
+    TEST_METHOD(GenericRxConntrack) {
+        ::GenericRxConntrack();
+    }
+
+    TEST_METHOD(GenericRxDecapRedirect) {
+        ::GenericRxDecapRedirect();
+    }
+
+    TEST_METHOD(GenericRxLoadBalanceV4) {
+        ::GenericRxLoadBalance(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxLoadBalanceV6) {
+        ::GenericRxLoadBalance(AF_INET6);
+    }
+
+    TEST_METHOD(GenericRxRedirectInterfaceTx) {
+        ::GenericRxRedirectInterfaceTx();
+    }
+
+    TEST_METHOD(GenericRxEncap) {
+        ::GenericRxEncap();
+    }
+
+    TEST_METHOD(GenericRxSynCookieV4) {
+        ::GenericRxSynCookie(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxSynCookieV6) {
+        ::GenericRxSynCookie(AF_INET6);
+    }
+
     TEST_METHOD(GenericRxMultiProgram) {
         ::GenericRxMultiProgram();
     }
@@ -147,6 +307,58 @@ public:
         ::GenericTxSingleFrame();
     }
 
+    TEST_METHOD(GenericXskKernelNpi) {
+        ::GenericXskKernelNpi();
+    }
+
+    TEST_METHOD(GenericTxZeroCopy) {
+        ::GenericTxZeroCopy();
+    }
+
+    TEST_METHOD(GenericTxRebindSocket) {
+        ::GenericTxRebindSocket();
+    }
+
+    TEST_METHOD(GenericTxSharedUmem) {
+        ::GenericTxSharedUmem();
+    }
+
+    TEST_METHOD(GenericXskSharedFillRing) {
+        ::GenericXskSharedFillRing();
+    }
+
+    TEST_METHOD(GenericXskRxFillPool) {
+        ::GenericXskRxFillPool();
+    }
+
+    TEST_METHOD(GenericXskRxPriorityRing) {
+        ::GenericXskRxPriorityRing();
+    }
+
+    TEST_METHOD(GenericXskSharedRxRing) {
+        ::GenericXskSharedRxRing();
+    }
+
+    TEST_METHOD(GenericXskUmemRegions) {
+        ::GenericXskUmemRegions();
+    }
+
+    TEST_METHOD(GenericTxSegmentation) {
+        ::GenericTxSegmentation();
+    }
+
+    TEST_METHOD(GenericTxTcpSegmentation) {
+        ::GenericTxTcpSegmentation();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericTxChecksumOffload) {
+        ::GenericTxChecksumOffload();
+    }
+
+    TEST_METHOD(GenericTxSendHash) {
+        ::GenericTxSendHash();
+    }
+
     TEST_METHOD(GenericTxOutOfOrder) {
         ::GenericTxOutOfOrder();
     }
@@ -159,6 +371,10 @@ public:
         ::GenericTxPoke();
     }
 
+    TEST_METHOD_PRERELEASE(GenericTxPokeLinger) {
+        ::GenericTxPokeLinger();
+    }
+
     TEST_METHOD(GenericTxMtu) {
         ::GenericTxMtu();
     }
@@ -179,6 +395,30 @@ public:
         GenericRxAllQueueRedirect(AF_INET6);
     }
 
+    TEST_METHOD(GenericRxPersistedProgram) {
+        ::GenericRxPersistedProgram();
+    }
+
+    TEST_METHOD(GenericRxMatchVlanV4) {
+        GenericRxMatchVlan(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxMatchVlanV6) {
+        GenericRxMatchVlan(AF_INET6);
+    }
+
+    TEST_METHOD(GenericRxIpv6ExtensionHeaders) {
+        ::GenericRxIpv6ExtensionHeaders();
+    }
+
+    TEST_METHOD(GenericRxIpFragmentAffinityV4) {
+        GenericRxIpFragmentAffinity(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxIpFragmentAffinityV6) {
+        GenericRxIpFragmentAffinity(AF_INET6);
+    }
+
     TEST_METHOD(GenericRxMatchUdpV4) {
         GenericRxMatch(AF_INET, XDP_MATCH_UDP, TRUE);
     }
@@ -243,6 +483,66 @@ public:
         GenericRxMatchIpPrefix(AF_INET6);
     }
 
+    TEST_METHOD(GenericRxMatchIndexedTupleV4) {
+        GenericRxMatchIndexedTuple(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxMatchIndexedTupleV6) {
+        GenericRxMatchIndexedTuple(AF_INET6);
+    }
+
+    TEST_METHOD(GenericRxMatchIndexedQuicCidV4) {
+        GenericRxMatchIndexedQuicCid(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxMatchIndexedQuicCidV6) {
+        GenericRxMatchIndexedQuicCid(AF_INET6);
+    }
+
+    TEST_METHOD(GenericRxMatchLpmV4) {
+        GenericRxMatchLpm(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxMatchLpmV6) {
+        GenericRxMatchLpm(AF_INET6);
+    }
+
+    TEST_METHOD(GenericRxMatchSourceV4) {
+        GenericRxMatchSource(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxMatchSourceV6) {
+        GenericRxMatchSource(AF_INET6);
+    }
+
+    TEST_METHOD(GenericRxUpdateRulesV4) {
+        GenericRxUpdateRules(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxUpdateRulesV6) {
+        GenericRxUpdateRules(AF_INET6);
+    }
+
+    TEST_METHOD(GenericRxProgramReplace) {
+        ::GenericRxProgramReplace();
+    }
+
+    TEST_METHOD(GenericRxRuleCountersV4) {
+        GenericRxRuleCounters(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxRuleCountersV6) {
+        GenericRxRuleCounters(AF_INET6);
+    }
+
+    TEST_METHOD(GenericRxAllQueuesDropOffloadV4) {
+        GenericRxAllQueuesDropOffload(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxAllQueuesDropOffloadV6) {
+        GenericRxAllQueuesDropOffload(AF_INET6);
+    }
+
     TEST_METHOD(GenericRxMatchUdpPortSetV4) {
         GenericRxMatch(AF_INET, XDP_MATCH_UDP_PORT_SET, TRUE);
     }
@@ -267,6 +567,30 @@ public:
         GenericRxMatch(AF_INET6, XDP_MATCH_IPV6_TCP_PORT_SET, FALSE);
     }
 
+    TEST_METHOD(GenericRxMatchUdpPortRangeV4) {
+        GenericRxMatch(AF_INET, XDP_MATCH_UDP_PORT_RANGE, TRUE);
+    }
+
+    TEST_METHOD(GenericRxMatchUdpPortRangeV6) {
+        GenericRxMatch(AF_INET6, XDP_MATCH_UDP_PORT_RANGE, TRUE);
+    }
+
+    TEST_METHOD(GenericRxMatchIpv4UdpPortRange) {
+        GenericRxMatch(AF_INET, XDP_MATCH_IPV4_UDP_PORT_RANGE, TRUE);
+    }
+
+    TEST_METHOD(GenericRxMatchIpv6UdpPortRange) {
+        GenericRxMatch(AF_INET6, XDP_MATCH_IPV6_UDP_PORT_RANGE, TRUE);
+    }
+
+    TEST_METHOD(GenericRxMatchIpv4TcpPortRange) {
+        GenericRxMatch(AF_INET, XDP_MATCH_IPV4_TCP_PORT_RANGE, FALSE);
+    }
+
+    TEST_METHOD(GenericRxMatchIpv6TcpPortRange) {
+        GenericRxMatch(AF_INET6, XDP_MATCH_IPV6_TCP_PORT_RANGE, FALSE);
+    }
+
     TEST_METHOD(GenericRxMatchTcpPortV4) {
         GenericRxMatch(AF_INET, XDP_MATCH_TCP_DST, FALSE);
     }
@@ -275,16 +599,44 @@ public:
         GenericRxMatch(AF_INET6, XDP_MATCH_TCP_DST, FALSE);
     }
 
+    TEST_METHOD(GenericRxMatchTcpTupleV4) {
+        GenericRxMatch(AF_INET, XDP_MATCH_IPV4_TCP_TUPLE, FALSE);
+    }
+
+    TEST_METHOD(GenericRxMatchTcpTupleV6) {
+        GenericRxMatch(AF_INET6, XDP_MATCH_IPV6_TCP_TUPLE, FALSE);
+    }
+
+    TEST_METHOD(GenericRxMatchUdpPayloadV4) {
+        GenericRxMatch(AF_INET, XDP_MATCH_UDP_PAYLOAD, TRUE);
+    }
+
+    TEST_METHOD(GenericRxMatchUdpPayloadV6) {
+        GenericRxMatch(AF_INET6, XDP_MATCH_UDP_PAYLOAD, TRUE);
+    }
+
+    TEST_METHOD(GenericRxMatchTcpPayloadV4) {
+        GenericRxMatch(AF_INET, XDP_MATCH_TCP_PAYLOAD, FALSE);
+    }
+
+    TEST_METHOD(GenericRxMatchTcpPayloadV6) {
+        GenericRxMatch(AF_INET6, XDP_MATCH_TCP_PAYLOAD, FALSE);
+    }
+
     TEST_METHOD(GenericXskWaitRx) {
-        GenericXskWait(TRUE, FALSE);
+        GenericXskWait(TRUE, FALSE, FALSE);
     }
 
     TEST_METHOD(GenericXskWaitTx) {
-        GenericXskWait(FALSE, TRUE);
+        GenericXskWait(FALSE, TRUE, FALSE);
     }
 
     TEST_METHOD(GenericXskWaitRxTx) {
-        GenericXskWait(TRUE, TRUE);
+        GenericXskWait(TRUE, TRUE, FALSE);
+    }
+
+    TEST_METHOD(GenericXskWaitSpinRxTx) {
+        GenericXskWait(TRUE, TRUE, TRUE);
     }
 
     TEST_METHOD(GenericXskWaitAsyncRx) {
@@ -299,6 +651,66 @@ public:
         GenericXskWaitAsync(TRUE, TRUE);
     }
 
+    TEST_METHOD(GenericXskNotifySockets) {
+        ::GenericXskNotifySockets();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericXskSockopts) {
+        ::GenericXskSockopts();
+    }
+
+    TEST_METHOD(GenericXskNotifyCompletionPort) {
+        ::GenericXskNotifyCompletionPort();
+    }
+
+    TEST_METHOD(GenericXskStatisticsEx) {
+        ::GenericXskStatisticsEx();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericXskStatisticsPage) {
+        ::GenericXskStatisticsPage();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericXskUmemAlloc) {
+        ::GenericXskUmemAlloc();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericXskHandoff) {
+        ::GenericXskHandoff();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericXskTxWeight) {
+        ::GenericXskTxWeight();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericXskTxRateLimit) {
+        ::GenericXskTxRateLimit();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericXskTxLaunchTime) {
+        ::GenericXskTxLaunchTime();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericXskLargePages) {
+        ::GenericXskLargePages();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericXskModeFailover) {
+        ::GenericXskModeFailover();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericXskTxCompletionInOrder) {
+        ::GenericXskTxCompletionInOrder();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericXskMemoryUsage) {
+        ::GenericXskMemoryUsage();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericXskRingOccupancy) {
+        ::GenericXskRingOccupancy();
+    }
+
     TEST_METHOD(GenericLwfDelayDetachRx) {
         GenericLwfDelayDetach(TRUE, FALSE);
     }
@@ -367,6 +779,14 @@ public:
         GenericRxTooManyFragments(AF_INET6, FALSE);
     }
 
+    TEST_METHOD(GenericRxFragmentLimitV4) {
+        GenericRxFragmentLimit(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxFragmentLimitV6) {
+        GenericRxFragmentLimit(AF_INET6);
+    }
+
     TEST_METHOD(GenericRxUdpHeaderFragmentsV4) {
         GenericRxHeaderFragments(AF_INET, XDP_PROGRAM_ACTION_REDIRECT, TRUE);
     }
@@ -403,6 +823,14 @@ public:
         GenericRxFromTxInspect(AF_INET6);
     }
 
+    TEST_METHOD(NativeTxInspectDropPass) {
+        ::NativeTxInspectDropPass();
+    }
+
+    TEST_METHOD(NativeRxBackpressure) {
+        ::NativeRxBackpressure();
+    }
+
     TEST_METHOD(SecurityAdjustDeviceAcl) {
         ::SecurityAdjustDeviceAcl();
     }
@@ -415,10 +843,26 @@ public:
         ::GenericRxEbpfDrop();
     }
 
+    TEST_METHOD_PRERELEASE(GenericTxEbpfDrop) {
+        ::GenericTxEbpfDrop();
+    }
+
     TEST_METHOD_PRERELEASE(GenericRxEbpfPass) {
         ::GenericRxEbpfPass();
     }
 
+    TEST_METHOD_PRERELEASE(GenericRxEbpfReplace) {
+        ::GenericRxEbpfReplace();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericRxEbpfFlowCache) {
+        ::GenericRxEbpfFlowCache();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericRxEbpfPrefilter) {
+        ::GenericRxEbpfPrefilter();
+    }
+
     TEST_METHOD_PRERELEASE(GenericRxEbpfTx) {
         ::GenericRxEbpfTx();
     }
@@ -427,10 +871,26 @@ public:
         ::GenericRxEbpfPayload();
     }
 
+    TEST_METHOD_PRERELEASE(GenericRxEbpfAdjustTail) {
+        ::GenericRxEbpfAdjustTail();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericRxEbpfRedirectXsk) {
+        ::GenericRxEbpfRedirectXsk();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericRxEbpfMetadata) {
+        ::GenericRxEbpfMetadata();
+    }
+
     TEST_METHOD_PRERELEASE(ProgTestRunRxEbpfPayload) {
         ::ProgTestRunRxEbpfPayload();
     }
 
+    TEST_METHOD_PRERELEASE(ProgTestRunRxEbpfRepeat) {
+        ::ProgTestRunRxEbpfRepeat();
+    }
+
     TEST_METHOD_PRERELEASE(GenericRxEbpfIfIndex) {
         ::GenericRxEbpfIfIndex();
     }
@@ -483,6 +943,14 @@ public:
         ::OffloadRssReset();
     }
 
+    TEST_METHOD_PRERELEASE(OffloadRssSymmetric) {
+        ::OffloadRssSymmetric();
+    }
+
+    TEST_METHOD_PRERELEASE(OffloadRssRebalance) {
+        ::OffloadRssRebalance();
+    }
+
     TEST_METHOD_PRERELEASE(OffloadSetHardwareCapabilities) {
         ::OffloadSetHardwareCapabilities();
     }
@@ -491,6 +959,26 @@ public:
         ::GenericXskQueryAffinity();
     }
 
+    TEST_METHOD_PRERELEASE(GenericXskRssSetQueueProcessor) {
+        ::GenericXskRssSetQueueProcessor();
+    }
+
+    TEST_METHOD(GenericRxRssHashless) {
+        ::GenericRxRssHashless();
+    }
+
+    TEST_METHOD(GenericRxRssIndirectionMove) {
+        ::GenericRxRssIndirectionMove();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericTeamQueues) {
+        ::GenericTeamQueues();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericXskNumaNode) {
+        ::GenericXskNumaNode();
+    }
+
     TEST_METHOD_PRERELEASE(OffloadQeoConnection) {
         ::OffloadQeoConnection();
     }
@@ -507,6 +995,26 @@ public:
         ::OffloadQeoOidFailure();
     }
 
+    TEST_METHOD_PRERELEASE(OffloadQeoSoftwareFallback) {
+        ::OffloadQeoSoftwareFallback();
+    }
+
+    TEST_METHOD_PRERELEASE(OffloadFlowSteeringFilter) {
+        ::OffloadFlowSteeringFilter();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericRxDedicatedQueue) {
+        ::GenericRxDedicatedQueue();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericRxBypassQueue) {
+        ::GenericRxBypassQueue();
+    }
+
+    TEST_METHOD_PRERELEASE(GenericRxAllQueuesLateQueue) {
+        ::GenericRxAllQueuesLateQueue();
+    }
+
     TEST_METHOD(OidPassthru) {
         ::OidPassthru();
     }
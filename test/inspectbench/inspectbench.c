@@ -0,0 +1,554 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+//
+// Measures the per-frame cost of the XDP rule engine in isolation by running
+// XdpInspect over a synthetic frame ring.
+//
+
+#include "precomp.h"
+#include <programinspect.h>
+
+typedef struct _XDP_FRAME_WITH_EXTENSIONS {
+    XDP_FRAME Frame;
+    XDP_BUFFER_VIRTUAL_ADDRESS BufferVirtualAddress;
+    XDP_FRAME_FRAGMENT Fragment;
+} XDP_FRAME_WITH_EXTENSIONS;
+
+C_ASSERT(
+    FIELD_OFFSET(XDP_FRAME_WITH_EXTENSIONS, BufferVirtualAddress) ==
+    RTL_SIZEOF_THROUGH_FIELD(XDP_FRAME_WITH_EXTENSIONS, Frame.Buffer));
+
+#define BENCH_FRAME_COUNT 32
+#define BENCH_MAX_FRAGMENTS 8
+
+typedef struct _XDP_FRAME_RING {
+    XDP_RING Ring;
+    XDP_FRAME_WITH_EXTENSIONS Frames[BENCH_FRAME_COUNT];
+} XDP_FRAME_RING;
+
+C_ASSERT(
+    FIELD_OFFSET(XDP_FRAME_RING, Frames) ==
+    RTL_SIZEOF_THROUGH_FIELD(XDP_FRAME_RING, Ring));
+
+typedef struct _XDP_BUFFER_WITH_EXTENSIONS {
+    XDP_BUFFER Buffer;
+    XDP_BUFFER_VIRTUAL_ADDRESS BufferVirtualAddress;
+} XDP_BUFFER_WITH_EXTENSIONS;
+
+C_ASSERT(
+    FIELD_OFFSET(XDP_BUFFER_WITH_EXTENSIONS, BufferVirtualAddress) ==
+    RTL_SIZEOF_THROUGH_FIELD(XDP_BUFFER_WITH_EXTENSIONS, Buffer));
+
+typedef struct _XDP_FRAGMENT_RING {
+    XDP_RING Ring;
+    XDP_BUFFER_WITH_EXTENSIONS Buffers[BENCH_FRAME_COUNT * BENCH_MAX_FRAGMENTS];
+} XDP_FRAGMENT_RING;
+
+C_ASSERT(
+    FIELD_OFFSET(XDP_FRAGMENT_RING, Buffers) ==
+    RTL_SIZEOF_THROUGH_FIELD(XDP_FRAGMENT_RING, Ring));
+
+//
+// How each frame's bytes are laid out across XDP buffers.
+//
+typedef enum _BENCH_LAYOUT {
+    //
+    // The entire frame is in the frame's first buffer.
+    //
+    BenchLayoutContiguous,
+    //
+    // The Ethernet header is in the frame's first buffer, and the remainder
+    // is in a single fragment buffer, as produced by header-data split NICs.
+    //
+    BenchLayoutHeaderSplit,
+    //
+    // The frame is scattered across small buffers, splitting the IP and UDP
+    // headers across buffer boundaries.
+    //
+    BenchLayoutScattered,
+    BenchLayoutMax
+} BENCH_LAYOUT;
+
+static const CHAR *BenchLayoutNames[] = {
+    "contiguous",
+    "headersplit",
+    "scattered",
+};
+
+C_ASSERT(RTL_NUMBER_OF(BenchLayoutNames) == BenchLayoutMax);
+
+#define BENCH_SCATTERED_BUFFER_LENGTH 24
+
+typedef struct _BENCH_MATCH {
+    const CHAR *Name;
+    XDP_MATCH_TYPE Match;
+    //
+    // Whether the stubbed pattern captures make the frame's verdict
+    // unpredictable, in which case the last rule is not verified to match.
+    //
+    BOOLEAN StubPattern;
+} BENCH_MATCH;
+
+static const BENCH_MATCH BenchMatches[] = {
+    { "UDP_DST", XDP_MATCH_UDP_DST, FALSE },
+    { "IPV4_DST_MASK", XDP_MATCH_IPV4_DST_MASK, FALSE },
+    { "IPV4_UDP_TUPLE", XDP_MATCH_IPV4_UDP_TUPLE, FALSE },
+    { "IPV4_UDP_PORT_SET", XDP_MATCH_IPV4_UDP_PORT_SET, TRUE },
+    { "IPV4_DST_LPM", XDP_MATCH_IPV4_DST_LPM, TRUE },
+    { "IPV4_UDP_PORT_RANGE", XDP_MATCH_IPV4_UDP_PORT_RANGE, TRUE },
+};
+
+static const UINT32 BenchRuleCounts[] = { 1, 8, 64, 256 };
+
+#define BENCH_LOCAL_PORT 9000
+#define BENCH_REMOTE_PORT 50000
+#define BENCH_PAYLOAD_LENGTH 64
+
+static XDP_FRAME_RING FrameRing = {
+    .Ring.ElementStride = sizeof(FrameRing.Frames[0]),
+    .Ring.Mask = RTL_NUMBER_OF(FrameRing.Frames) - 1,
+};
+
+static XDP_FRAGMENT_RING FragmentRing = {
+    .Ring.ElementStride = sizeof(FragmentRing.Buffers[0]),
+    .Ring.Mask = RTL_NUMBER_OF(FragmentRing.Buffers) - 1,
+};
+
+static XDP_EXTENSION FragmentExtension = {
+    .Reserved = FIELD_OFFSET(XDP_FRAME_WITH_EXTENSIONS, Fragment)
+};
+
+static XDP_EXTENSION VirtualAddressExtension = {
+    .Reserved = FIELD_OFFSET(XDP_BUFFER_WITH_EXTENSIONS, BufferVirtualAddress)
+};
+
+static UCHAR FrameData[BENCH_FRAME_COUNT][UDP_HEADER_STORAGE + BENCH_PAYLOAD_LENGTH];
+static UINT32 FrameLength;
+static ETHERNET_ADDRESS LocalHw = {{ 0x00, 0x15, 0x5d, 0x00, 0x00, 0x01 }};
+static ETHERNET_ADDRESS RemoteHw = {{ 0x00, 0x15, 0x5d, 0x00, 0x00, 0x02 }};
+static INET_ADDR LocalIp;
+static INET_ADDR RemoteIp;
+
+static UINT32 Iterations = 100000;
+static BOOLEAN CsvOutput = FALSE;
+static BOOLEAN Verbose = FALSE;
+
+static
+VOID
+Usage(
+    VOID
+    )
+{
+    fprintf(stderr,
+        "Usage: inspectbench.exe [-i <Iterations>] [-csv] [-v]\n"
+        "\n"
+        "Measures XdpInspect ns/frame across match types, rule counts, frame\n"
+        "layouts, and compiled vs. linear rule evaluation.\n"
+        "\n"
+        "   -i <Iterations>  Passes over the %u-frame ring per measurement\n"
+        "                    Default: %u\n"
+        "   -csv             Write results as CSV\n"
+        "   -v               Verbose output\n",
+        BENCH_FRAME_COUNT, Iterations);
+    exit(1);
+}
+
+static
+VOID
+ParseArgs(
+    _In_ INT ArgC,
+    _In_ CHAR **ArgV
+    )
+{
+    for (INT i = 1; i < ArgC; i++) {
+        if (!strcmp(ArgV[i], "-i") && i + 1 < ArgC) {
+            Iterations = atoi(ArgV[++i]);
+        } else if (!strcmp(ArgV[i], "-csv")) {
+            CsvOutput = TRUE;
+        } else if (!strcmp(ArgV[i], "-v")) {
+            Verbose = TRUE;
+        } else {
+            Usage();
+        }
+    }
+
+    if (Iterations == 0) {
+        Usage();
+    }
+}
+
+static
+VOID
+InitializeFrames(
+    VOID
+    )
+{
+    UCHAR Payload[BENCH_PAYLOAD_LENGTH] = "inspectbench";
+
+    LocalIp.Ipv4.S_un.S_addr = htonl(0xc0a80101);  // 192.168.1.1
+    RemoteIp.Ipv4.S_un.S_addr = htonl(0xc0a80202); // 192.168.2.2
+
+    //
+    // Every frame carries the same flow, but in its own buffer, so that
+    // frames do not share cache lines.
+    //
+    for (UINT32 i = 0; i < RTL_NUMBER_OF(FrameData); i++) {
+        FrameLength = sizeof(FrameData[i]);
+
+        if (!PktBuildUdpFrame(
+                FrameData[i], &FrameLength, Payload, sizeof(Payload), &LocalHw, &RemoteHw,
+                AF_INET, &LocalIp, &RemoteIp, htons(BENCH_REMOTE_PORT),
+                htons(BENCH_LOCAL_PORT))) {
+            fprintf(stderr, "PktBuildUdpFrame failed\n");
+            exit(1);
+        }
+    }
+}
+
+static
+VOID
+SetBuffer(
+    _Out_ XDP_BUFFER *Buffer,
+    _Out_ XDP_BUFFER_VIRTUAL_ADDRESS *BufferVa,
+    _In_ UCHAR *Data,
+    _In_ UINT32 DataLength
+    )
+{
+    Buffer->DataOffset = 0;
+    Buffer->DataLength = DataLength;
+    Buffer->BufferLength = DataLength;
+    BufferVa->VirtualAddress = Data;
+}
+
+static
+VOID
+LayoutFrames(
+    _In_ BENCH_LAYOUT Layout
+    )
+{
+    UINT32 FragmentIndex = 0;
+
+    for (UINT32 i = 0; i < RTL_NUMBER_OF(FrameRing.Frames); i++) {
+        XDP_FRAME_WITH_EXTENSIONS *FrameExt = &FrameRing.Frames[i];
+        UINT32 FirstLength;
+        UINT32 Offset;
+
+        switch (Layout) {
+        case BenchLayoutHeaderSplit:
+            FirstLength = sizeof(ETHERNET_HEADER);
+            break;
+        case BenchLayoutScattered:
+            FirstLength = BENCH_SCATTERED_BUFFER_LENGTH;
+            break;
+        default:
+            FirstLength = FrameLength;
+            break;
+        }
+
+        SetBuffer(
+            &FrameExt->Frame.Buffer, &FrameExt->BufferVirtualAddress, FrameData[i],
+            FirstLength);
+        FrameExt->Fragment.FragmentBufferCount = 0;
+        Offset = FirstLength;
+
+        while (Offset < FrameLength) {
+            XDP_BUFFER_WITH_EXTENSIONS *BufferExt = &FragmentRing.Buffers[FragmentIndex++];
+            UINT32 Length = FrameLength - Offset;
+
+            if (Layout == BenchLayoutScattered) {
+                Length = min(Length, BENCH_SCATTERED_BUFFER_LENGTH);
+            }
+
+            ASSERT(FrameExt->Fragment.FragmentBufferCount < BENCH_MAX_FRAGMENTS);
+            SetBuffer(
+                &BufferExt->Buffer, &BufferExt->BufferVirtualAddress, FrameData[i] + Offset,
+                Length);
+            FrameExt->Fragment.FragmentBufferCount++;
+            Offset += Length;
+        }
+    }
+
+    FrameRing.Ring.ProducerIndex = RTL_NUMBER_OF(FrameRing.Frames);
+    FrameRing.Ring.ConsumerIndex = 0;
+    FragmentRing.Ring.ProducerIndex = FragmentIndex;
+    FragmentRing.Ring.ConsumerIndex = 0;
+}
+
+//
+// Builds a rule of the given match type. Only the rule at MatchIndex matches
+// the benchmark frames; all preceding rules are near misses of the same type.
+//
+static
+VOID
+BuildRule(
+    _Out_ XDP_RULE *Rule,
+    _In_ XDP_MATCH_TYPE Match,
+    _In_ UINT32 RuleIndex,
+    _In_ UINT32 MatchIndex
+    )
+{
+    static UINT8 PortSet[XDP_PORT_SET_BUFFER_SIZE];
+    static XDP_IP_PREFIX Prefix;
+    static XDP_PORT_RANGE PortRange;
+    BOOLEAN IsMatch = (RuleIndex == MatchIndex);
+
+    RtlZeroMemory(Rule, sizeof(*Rule));
+    Rule->Match = Match;
+    Rule->Action = IsMatch ? XDP_PROGRAM_ACTION_PASS : XDP_PROGRAM_ACTION_DROP;
+
+    switch (Match) {
+    case XDP_MATCH_UDP_DST:
+        Rule->Pattern.Port = IsMatch ? htons(BENCH_LOCAL_PORT) : htons((UINT16)(1 + RuleIndex));
+        break;
+
+    case XDP_MATCH_IPV4_DST_MASK:
+        Rule->Pattern.IpMask.Mask.Ipv4.S_un.S_addr = MAXUINT32;
+        Rule->Pattern.IpMask.Address.Ipv4 = LocalIp.Ipv4;
+        if (!IsMatch) {
+            Rule->Pattern.IpMask.Address.Ipv4.S_un.S_addr = htonl(0x0a000000 + RuleIndex);
+        }
+        break;
+
+    case XDP_MATCH_IPV4_UDP_TUPLE:
+        Rule->Pattern.Tuple.SourceAddress.Ipv4 = RemoteIp.Ipv4;
+        Rule->Pattern.Tuple.DestinationAddress.Ipv4 = LocalIp.Ipv4;
+        Rule->Pattern.Tuple.SourcePort = htons(BENCH_REMOTE_PORT);
+        Rule->Pattern.Tuple.DestinationPort = htons(BENCH_LOCAL_PORT);
+        if (!IsMatch) {
+            Rule->Pattern.Tuple.DestinationPort = htons((UINT16)(1 + RuleIndex));
+        }
+        break;
+
+    case XDP_MATCH_IPV4_UDP_PORT_SET:
+        Rule->Pattern.IpPortSet.Address.Ipv4 = LocalIp.Ipv4;
+        Rule->Pattern.IpPortSet.PortSet.PortSet = PortSet;
+        if (!IsMatch) {
+            Rule->Pattern.IpPortSet.Address.Ipv4.S_un.S_addr = htonl(0x0a000000 + RuleIndex);
+        }
+        break;
+
+    case XDP_MATCH_IPV4_DST_LPM:
+        Rule->Pattern.PrefixTable.Prefixes = &Prefix;
+        Rule->Pattern.PrefixTable.PrefixCount = 1;
+        break;
+
+    case XDP_MATCH_IPV4_UDP_PORT_RANGE:
+        Rule->Pattern.IpPortRanges.Address.Ipv4 = LocalIp.Ipv4;
+        Rule->Pattern.IpPortRanges.PortRanges.Ranges = &PortRange;
+        Rule->Pattern.IpPortRanges.PortRanges.RangeCount = 1;
+        if (!IsMatch) {
+            Rule->Pattern.IpPortRanges.Address.Ipv4.S_un.S_addr =
+                htonl(0x0a000000 + RuleIndex);
+        }
+        break;
+
+    default:
+        ASSERT(FALSE);
+        break;
+    }
+}
+
+static
+XDP_PROGRAM *
+CreateProgram(
+    _In_ XDP_MATCH_TYPE Match,
+    _In_ UINT32 RuleCount
+    )
+{
+    NTSTATUS Status;
+    SIZE_T Size;
+    XDP_PROGRAM *Program;
+
+    Status = XdpProgramGetCompiledSize(RuleCount, &Size);
+    if (!NT_SUCCESS(Status)) {
+        fprintf(stderr, "XdpProgramGetCompiledSize failed: 0x%x\n", Status);
+        exit(1);
+    }
+
+    Program = _aligned_malloc(Size, SYSTEM_CACHE_ALIGNMENT_SIZE);
+    if (Program == NULL) {
+        fprintf(stderr, "Failed to allocate program\n");
+        exit(1);
+    }
+
+    RtlZeroMemory(Program, Size);
+
+    for (UINT32 i = 0; i < RuleCount; i++) {
+        XDP_RULE UserRule;
+
+        BuildRule(&UserRule, Match, i, RuleCount - 1);
+
+        Status = XdpProgramValidateRule(&Program->Rules[i], UserMode, &UserRule);
+        if (!NT_SUCCESS(Status)) {
+            fprintf(stderr, "XdpProgramValidateRule failed: 0x%x\n", Status);
+            exit(1);
+        }
+
+        Program->RuleCount++;
+    }
+
+    return Program;
+}
+
+static
+VOID
+DeleteProgram(
+    _In_ XDP_PROGRAM *Program
+    )
+{
+    for (UINT32 i = 0; i < Program->RuleCount; i++) {
+        XdpProgramDeleteRule(&Program->Rules[i]);
+    }
+
+    _aligned_free(Program);
+}
+
+static
+UINT32
+InspectRing(
+    _In_ XDP_PROGRAM *Program,
+    _In_ XDP_INSPECTION_CONTEXT *InspectionContext,
+    _In_opt_ XDP_RING *FragmentRingOption
+    )
+{
+    UINT32 FragmentIndex = 0;
+    UINT32 PassCount = 0;
+
+    for (UINT32 i = 0; i < RTL_NUMBER_OF(FrameRing.Frames); i++) {
+        XDP_RX_ACTION Action;
+
+        Action =
+            XdpInspect(
+                Program, InspectionContext, &FrameRing.Ring, i, FragmentRingOption,
+                &FragmentExtension, FragmentRingOption != NULL ? FragmentIndex : 0,
+                &VirtualAddressExtension);
+
+        PassCount += (Action == XDP_RX_ACTION_PASS);
+        FragmentIndex += FrameRing.Frames[i].Fragment.FragmentBufferCount;
+    }
+
+    return PassCount;
+}
+
+static
+VOID
+RunScenario(
+    _In_ const BENCH_MATCH *Match,
+    _In_ UINT32 RuleCount,
+    _In_ BENCH_LAYOUT Layout,
+    _In_ BOOLEAN Compiled,
+    _Inout_ INT *ExitCode
+    )
+{
+    XDP_PROGRAM *Program;
+    XDP_INSPECTION_CONTEXT *InspectionContext;
+    XDP_RING *FragmentRingOption;
+    LARGE_INTEGER Frequency;
+    LARGE_INTEGER Start;
+    LARGE_INTEGER End;
+    UINT32 PassCount;
+    UINT64 FrameCount;
+    double NsPerFrame;
+
+    //
+    // The inspection context embeds per-batch eBPF state and is too large for
+    // the stack.
+    //
+    InspectionContext = calloc(1, sizeof(*InspectionContext));
+    if (InspectionContext == NULL) {
+        fprintf(stderr, "Failed to allocate inspection context\n");
+        exit(1);
+    }
+
+    Program = CreateProgram(Match->Match, RuleCount);
+    XdpProgramCompile(Program, RuleCount);
+
+    if (!Compiled) {
+        Program->Segments = NULL;
+        Program->SegmentCount = 0;
+    }
+
+    LayoutFrames(Layout);
+    FragmentRingOption = (Layout == BenchLayoutContiguous) ? NULL : &FragmentRing.Ring;
+
+    //
+    // Verify the expected rule is hit, then warm up the caches.
+    //
+    PassCount = InspectRing(Program, InspectionContext, FragmentRingOption);
+    if (!Match->StubPattern && PassCount != RTL_NUMBER_OF(FrameRing.Frames)) {
+        fprintf(
+            stderr, "%s rules=%u layout=%s: %u/%u frames matched the last rule\n",
+            Match->Name, RuleCount, BenchLayoutNames[Layout], PassCount,
+            (UINT32)RTL_NUMBER_OF(FrameRing.Frames));
+        *ExitCode = 1;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    for (UINT32 i = 0; i < Iterations; i++) {
+        InspectRing(Program, InspectionContext, FragmentRingOption);
+    }
+
+    QueryPerformanceCounter(&End);
+
+    FrameCount = (UINT64)Iterations * RTL_NUMBER_OF(FrameRing.Frames);
+    NsPerFrame =
+        (double)(End.QuadPart - Start.QuadPart) * 1000000000.0 /
+        (double)Frequency.QuadPart / (double)FrameCount;
+
+    if (CsvOutput) {
+        printf(
+            "%s,%u,%s,%s,%u,%.2f\n", Match->Name, RuleCount, BenchLayoutNames[Layout],
+            Compiled ? "compiled" : "linear", Program->SegmentCount, NsPerFrame);
+    } else {
+        printf(
+            "%-20s %6u %-12s %-9s %8u %10.2f\n", Match->Name, RuleCount,
+            BenchLayoutNames[Layout], Compiled ? "compiled" : "linear",
+            Program->SegmentCount, NsPerFrame);
+    }
+
+    if (Verbose) {
+        fprintf(
+            stderr, "%s rules=%u layout=%s: %u/%u frames passed\n", Match->Name, RuleCount,
+            BenchLayoutNames[Layout], PassCount, (UINT32)RTL_NUMBER_OF(FrameRing.Frames));
+    }
+
+    DeleteProgram(Program);
+    free(InspectionContext);
+}
+
+INT
+__cdecl
+main(
+    _In_ INT ArgC,
+    _In_ CHAR **ArgV
+    )
+{
+    INT ExitCode = 0;
+
+    ParseArgs(ArgC, ArgV);
+    InitializeFrames();
+
+    if (CsvOutput) {
+        printf("Match,Rules,Layout,Evaluation,Segments,NsPerFrame\n");
+    } else {
+        printf(
+            "%-20s %6s %-12s %-9s %8s %10s\n", "Match", "Rules", "Layout", "Eval",
+            "Segments", "ns/frame");
+    }
+
+    for (UINT32 m = 0; m < RTL_NUMBER_OF(BenchMatches); m++) {
+        for (UINT32 r = 0; r < RTL_NUMBER_OF(BenchRuleCounts); r++) {
+            for (BENCH_LAYOUT Layout = 0; Layout < BenchLayoutMax; Layout++) {
+                RunScenario(&BenchMatches[m], BenchRuleCounts[r], Layout, TRUE, &ExitCode);
+                RunScenario(&BenchMatches[m], BenchRuleCounts[r], Layout, FALSE, &ExitCode);
+            }
+        }
+    }
+
+    return ExitCode;
+}
@@ -0,0 +1,40 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+#include <winsock2.h>
+#include <windows.h>
+#include <bcrypt.h>
+#include <winternl.h>
+#include <netiodef.h>
+#include <ws2def.h>
+#include <mstcpip.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pkthlp.h>
+#include <xdp/buffervirtualaddress.h>
+#include <xdp/datapath.h>
+#include <xdp/extensioninfo.h>
+#include <xdp/framefragment.h>
+#include <xdp/framerxaction.h>
+#include <xdp/program.h>
+#include <xdp/rtl.h>
+
+#include <stubs/ntos.h>
+#include <stubs/ebpf.h>
+
+#include <xdpassert.h>
+#include <xdppcw.h>
+#include <xdprtl.h>
+
+#include <stubs/dispatch.h>
+#include <extensionset.h>
+#include <program.h>
+#include <stubs/rx.h>
+#include <stubs/xsk.h>
+#include <xdpp.h>
@@ -0,0 +1,232 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+//
+// Converts a pcap capture into the XDPMP RX replay file format.
+//
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <xdpmpreplay.h>
+
+CONST CHAR *UsageText =
+"Usage: pcapcmd InputPcapFile OutputReplayFile [MaxFrames]\n"
+"\n"
+"Converts an Ethernet pcap capture into an XDPMP RX replay file. Frames\n"
+"shorter than an Ethernet header or longer than 64KB are skipped. Captures in\n"
+"pcapng format must first be converted to pcap, e.g. with editcap -F pcap.\n";
+
+#define PCAP_MAGIC 0xA1B2C3D4
+#define PCAP_MAGIC_SWAPPED 0xD4C3B2A1
+#define PCAP_MAGIC_NS 0xA1B23C4D
+#define PCAP_MAGIC_NS_SWAPPED 0x4D3CB2A1
+#define PCAP_LINKTYPE_ETHERNET 1
+
+typedef struct {
+    UINT32 Magic;
+    UINT16 VersionMajor;
+    UINT16 VersionMinor;
+    INT32 ThisZone;
+    UINT32 SigFigs;
+    UINT32 SnapLength;
+    UINT32 LinkType;
+} PCAP_FILE_HEADER;
+
+typedef struct {
+    UINT32 TimestampSeconds;
+    UINT32 TimestampFraction;
+    UINT32 CapturedLength;
+    UINT32 OriginalLength;
+} PCAP_RECORD_HEADER;
+
+VOID
+Usage(
+    CHAR *Error
+    )
+{
+    fprintf(stderr, "Error: %s\n%s", Error, UsageText);
+}
+
+static
+UINT32
+PcapToHost(
+    _In_ BOOLEAN Swapped,
+    _In_ UINT32 Value
+    )
+{
+    return Swapped ? _byteswap_ulong(Value) : Value;
+}
+
+INT
+__cdecl
+main(
+    INT ArgC,
+    CHAR **ArgV
+    )
+{
+    INT Err = 0;
+    FILE *Input = NULL;
+    FILE *Output = NULL;
+    PCAP_FILE_HEADER PcapHeader;
+    PCAP_RECORD_HEADER PcapRecord;
+    XDPMP_REPLAY_HEADER ReplayHeader = {0};
+    XDPMP_REPLAY_RECORD ReplayRecord = {0};
+    UCHAR *Frame = NULL;
+    UINT32 MaxFrames = MAXUINT32;
+    UINT32 SkippedFrames = 0;
+    UINT32 TruncatedFrames = 0;
+    UINT64 TotalBytes = 0;
+    BOOLEAN Swapped;
+
+    if (ArgC < 3) {
+        Usage("Missing parameter");
+        Err = 1;
+        goto Exit;
+    }
+
+    if (ArgC > 3) {
+        MaxFrames = strtoul(ArgV[3], NULL, 0);
+        if (MaxFrames == 0) {
+            Usage("MaxFrames");
+            Err = 1;
+            goto Exit;
+        }
+    }
+
+    if (fopen_s(&Input, ArgV[1], "rb") != 0) {
+        Usage("Failed to open InputPcapFile");
+        Err = 1;
+        goto Exit;
+    }
+
+    if (fread(&PcapHeader, sizeof(PcapHeader), 1, Input) != 1) {
+        Usage("Failed to read pcap header");
+        Err = 1;
+        goto Exit;
+    }
+
+    if (PcapHeader.Magic == PCAP_MAGIC || PcapHeader.Magic == PCAP_MAGIC_NS) {
+        Swapped = FALSE;
+    } else if (PcapHeader.Magic == PCAP_MAGIC_SWAPPED ||
+        PcapHeader.Magic == PCAP_MAGIC_NS_SWAPPED) {
+        Swapped = TRUE;
+    } else {
+        Usage("Unsupported capture format");
+        Err = 1;
+        goto Exit;
+    }
+
+    if (PcapToHost(Swapped, PcapHeader.LinkType) != PCAP_LINKTYPE_ETHERNET) {
+        Usage("Unsupported link type");
+        Err = 1;
+        goto Exit;
+    }
+
+    Frame = malloc(XDPMP_REPLAY_MAX_FRAME_LENGTH + XDPMP_REPLAY_RECORD_ALIGNMENT);
+    if (Frame == NULL) {
+        Usage("Failed to allocate frame buffer");
+        Err = 1;
+        goto Exit;
+    }
+
+    if (fopen_s(&Output, ArgV[2], "wb") != 0) {
+        Usage("Failed to open OutputReplayFile");
+        Err = 1;
+        goto Exit;
+    }
+
+    //
+    // Write a placeholder header, then rewrite it once the frame count is
+    // known.
+    //
+    ReplayHeader.Magic = XDPMP_REPLAY_MAGIC;
+    ReplayHeader.Version = XDPMP_REPLAY_VERSION;
+
+    if (fwrite(&ReplayHeader, sizeof(ReplayHeader), 1, Output) != 1) {
+        Usage("Failed to write replay header");
+        Err = 1;
+        goto Exit;
+    }
+
+    while (ReplayHeader.FrameCount < MaxFrames &&
+        fread(&PcapRecord, sizeof(PcapRecord), 1, Input) == 1) {
+        UINT32 CapturedLength = PcapToHost(Swapped, PcapRecord.CapturedLength);
+        UINT32 OriginalLength = PcapToHost(Swapped, PcapRecord.OriginalLength);
+        UINT32 PaddedLength;
+
+        if (CapturedLength < XDPMP_REPLAY_MIN_FRAME_LENGTH ||
+            CapturedLength > XDPMP_REPLAY_MAX_FRAME_LENGTH) {
+            if (fseek(Input, CapturedLength, SEEK_CUR) != 0) {
+                Usage("Failed to read pcap record");
+                Err = 1;
+                goto Exit;
+            }
+
+            SkippedFrames++;
+            continue;
+        }
+
+        if (fread(Frame, CapturedLength, 1, Input) != 1) {
+            Usage("Failed to read pcap record");
+            Err = 1;
+            goto Exit;
+        }
+
+        if (CapturedLength < OriginalLength) {
+            TruncatedFrames++;
+        }
+
+        PaddedLength =
+            (CapturedLength + XDPMP_REPLAY_RECORD_ALIGNMENT - 1) &
+                ~(XDPMP_REPLAY_RECORD_ALIGNMENT - 1);
+        ZeroMemory(Frame + CapturedLength, PaddedLength - CapturedLength);
+
+        ReplayRecord.FrameLength = CapturedLength;
+
+        if (fwrite(&ReplayRecord, sizeof(ReplayRecord), 1, Output) != 1 ||
+            fwrite(Frame, PaddedLength, 1, Output) != 1) {
+            Usage("Failed to write replay record");
+            Err = 1;
+            goto Exit;
+        }
+
+        ReplayHeader.FrameCount++;
+        TotalBytes += CapturedLength;
+    }
+
+    if (ReplayHeader.FrameCount == 0) {
+        Usage("No frames converted");
+        Err = 1;
+        goto Exit;
+    }
+
+    if (fseek(Output, 0, SEEK_SET) != 0 ||
+        fwrite(&ReplayHeader, sizeof(ReplayHeader), 1, Output) != 1) {
+        Usage("Failed to write replay header");
+        Err = 1;
+        goto Exit;
+    }
+
+    printf(
+        "Converted %u frames (%llu bytes), skipped %u, %u truncated by the capture\n",
+        ReplayHeader.FrameCount, TotalBytes, SkippedFrames, TruncatedFrames);
+
+Exit:
+
+    if (Output != NULL) {
+        fclose(Output);
+    }
+
+    if (Input != NULL) {
+        fclose(Input);
+    }
+
+    if (Frame != NULL) {
+        free(Frame);
+    }
+
+    return Err;
+}
@@ -89,9 +89,14 @@ LLVMFuzzerTestOneInput(
         .Ring.Mask = RTL_NUMBER_OF(FragmentRing.Buffers) - 1,
     };
     XDP_RING *FragmentRingOption = NULL;
-    UCHAR ProgramBuffer[FIELD_OFFSET(XDP_PROGRAM, Rules) + sizeof(Metadata->Rules)];
+    UCHAR ProgramBuffer[
+        FIELD_OFFSET(XDP_PROGRAM, Rules) +
+        RTL_NUMBER_OF(Metadata->Rules) *
+            (sizeof(XDP_RULE) + sizeof(XDP_PROGRAM_RULE_COUNTER) +
+            sizeof(XDP_PROGRAM_RULE_SEGMENT) + XDP_PROGRAM_HASH_SLOTS_PER_RULE * sizeof(UINT32))];
     XDP_PROGRAM *Program = (XDP_PROGRAM *)ProgramBuffer;
     XDP_INSPECTION_CONTEXT InspectionContext = {0};
+    UINT32 ValidatedRuleCount = 0;
     UINT32 FrameRingIndex;
     UINT32 FragmentRingIndex = 0;
     XDP_FRAME_WITH_EXTENSIONS *FrameExt = NULL;
@@ -176,6 +181,7 @@ LLVMFuzzerTestOneInput(
     }
 
     Program->RuleCount = RTL_NUMBER_OF(Metadata->Rules);
+    Program->RuleCounters = NULL;
 
     for (UINT32 i = 0; i < Program->RuleCount; i++) {
         Status =
@@ -186,8 +192,12 @@ LLVMFuzzerTestOneInput(
             Result = -1;
             goto Exit;
         }
+
+        ValidatedRuleCount++;
     }
 
+    XdpProgramCompile(Program, Program->RuleCount);
+
     XdpInspect(
         Program, &InspectionContext, &FrameRing.Ring, FrameRingIndex, FragmentRingOption,
         &FragmentExtension, FragmentRingIndex, &VirtualAddressExtension);
@@ -196,6 +206,10 @@ LLVMFuzzerTestOneInput(
 
 Exit:
 
+    for (UINT32 i = 0; i < ValidatedRuleCount; i++) {
+        XdpProgramDeleteRule(&Program->Rules[i]);
+    }
+
     for (UINT32 i = 0; i < RTL_NUMBER_OF(FragmentRing.Buffers); i++) {
         XDP_BUFFER_WITH_EXTENSIONS *BufferExt = &FragmentRing.Buffers[i];
 
@@ -7,6 +7,7 @@
 
 #include <winsock2.h>
 #include <windows.h>
+#include <bcrypt.h>
 #include <winternl.h>
 #include <netiodef.h>
 #include <ws2def.h>
@@ -34,5 +35,6 @@
 #include <extensionset.h>
 #include <program.h>
 #include <stubs/rx.h>
+#include <stubs/txtarget.h>
 #include <stubs/xsk.h>
 #include <xdpp.h>
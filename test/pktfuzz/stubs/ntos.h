@@ -6,6 +6,7 @@
 #pragma once
 
 #define STATUS_SUCCESS ((NTSTATUS)0x00000000L)
+#define STATUS_INSUFFICIENT_RESOURCES ((NTSTATUS)0xC000009AL)
 
 typedef enum {
     PagedPool,
@@ -39,6 +40,26 @@ ExFreePoolWithTag(
     free(P);
 }
 
+inline
+ULONG
+KeGetCurrentProcessorIndex(
+    VOID
+    )
+{
+    return 0;
+}
+
+#define KeMemoryBarrier MemoryBarrier
+
+inline
+ULONGLONG
+KeQueryInterruptTime(
+    VOID
+    )
+{
+    return 0;
+}
+
 typedef CCHAR KPROCESSOR_MODE;
 
 typedef enum _MODE {
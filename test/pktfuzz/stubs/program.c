@@ -4,6 +4,7 @@
 //
 
 #include "precomp.h"
+#include <programinspect.h>
 
 static const UINT8 DummyPortSet[(UINT16_MAX + 1) / RTL_BITS_OF(UINT8)] = "Bogus values";
 
@@ -29,3 +30,345 @@ XdpProgramCapturePortSet(
 
     return STATUS_SUCCESS;
 }
+
+NTSTATUS
+XdpProgramCapturePrefixTable(
+    _In_ const XDP_IP_PREFIX_TABLE *UserPrefixTable,
+    _In_ UINT32 AddressLength,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_IP_PREFIX_TABLE *KernelPrefixTable
+    )
+{
+    NTSTATUS Status;
+    XDP_LPM_TABLE *Table;
+    const XDP_IP_PREFIX DummyPrefixes[] = {
+        {
+            .PrefixLength = 0,
+            .Action = XDP_IP_PREFIX_ACTION_SKIP,
+        },
+        {
+            .Address.Ipv6.u.Byte = { 0x0a },
+            .PrefixLength = 8,
+            .Action = XDP_IP_PREFIX_ACTION_RULE,
+        },
+        {
+            .Address.Ipv6.u.Byte = { 0x0a, 0x01 },
+            .PrefixLength = 13,
+            .Action = XDP_IP_PREFIX_ACTION_DROP,
+        },
+        {
+            .Address.Ipv6.u.Byte = { 0xc0, 0xa8, 0x01, 0x01 },
+            .PrefixLength = 32,
+            .Action = XDP_IP_PREFIX_ACTION_PASS,
+        },
+    };
+
+    UNREFERENCED_PARAMETER(UserPrefixTable);
+    UNREFERENCED_PARAMETER(RequestorMode);
+
+    Status =
+        XdpProgramCreateLpmTable(
+            AddressLength, DummyPrefixes, RTL_NUMBER_OF(DummyPrefixes), &Table);
+    if (NT_SUCCESS(Status)) {
+        KernelPrefixTable->PrefixCount = RTL_NUMBER_OF(DummyPrefixes);
+        KernelPrefixTable->Reserved = Table;
+    }
+
+    return Status;
+}
+
+NTSTATUS
+XdpProgramCaptureTupleSet(
+    _In_ const XDP_MASKED_TUPLE_SET *UserTupleSet,
+    _In_ UINT32 AddressLength,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_MASKED_TUPLE_SET *KernelTupleSet
+    )
+{
+    NTSTATUS Status;
+    XDP_TUPLE_TABLE *Table;
+    const XDP_MASKED_TUPLE DummyTuples[] = {
+        {
+            .Mask.Protocol = 0xFF,
+            .Mask.DestinationPort = 0xFFFF,
+            .Tuple.Protocol = IPPROTO_UDP,
+            .Tuple.DestinationPort = 0x3412,
+        },
+        {
+            .Mask.SourceAddress.Ipv6.u.Byte = { 0xff, 0xff, 0xff, 0xff },
+            .Tuple.SourceAddress.Ipv6.u.Byte = { 0xc0, 0xa8, 0x01, 0x01 },
+        },
+        {
+            .Mask.Protocol = 0xFF,
+            .Mask.SourcePort = 0xFFFF,
+            .Mask.DestinationPort = 0xFFFF,
+            .Tuple.Protocol = IPPROTO_TCP,
+            .Tuple.SourcePort = 0x5000,
+            .Tuple.DestinationPort = 0xBB01,
+        },
+    };
+
+    UNREFERENCED_PARAMETER(UserTupleSet);
+    UNREFERENCED_PARAMETER(RequestorMode);
+
+    Status =
+        XdpProgramCreateTupleTable(
+            AddressLength, DummyTuples, RTL_NUMBER_OF(DummyTuples), &Table);
+    if (NT_SUCCESS(Status)) {
+        KernelTupleSet->TupleCount = RTL_NUMBER_OF(DummyTuples);
+        KernelTupleSet->Reserved = Table;
+    }
+
+    return Status;
+}
+
+NTSTATUS
+XdpProgramCapturePortRangeSet(
+    _In_ const XDP_PORT_RANGE_SET *UserPortRanges,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_PORT_RANGE_SET *KernelPortRanges
+    )
+{
+    NTSTATUS Status;
+    XDP_PORT_RANGE_TABLE *Table;
+    XDP_PORT_RANGE DummyRanges[] = {
+        { .LowPort = 49152, .HighPort = 65535 },
+        { .LowPort = 443, .HighPort = 443 },
+        { .LowPort = 1000, .HighPort = 2000 },
+        { .LowPort = 1500, .HighPort = 3000 },
+        { .LowPort = 0, .HighPort = 80 },
+    };
+
+    UNREFERENCED_PARAMETER(UserPortRanges);
+    UNREFERENCED_PARAMETER(RequestorMode);
+
+    Status =
+        XdpProgramCreatePortRangeTable(DummyRanges, RTL_NUMBER_OF(DummyRanges), &Table);
+    if (NT_SUCCESS(Status)) {
+        KernelPortRanges->RangeCount = RTL_NUMBER_OF(DummyRanges);
+        KernelPortRanges->Reserved = Table;
+    }
+
+    return Status;
+}
+
+NTSTATUS
+XdpProgramCapturePayloadMatch(
+    _In_ const XDP_PAYLOAD_MATCH *UserPayload,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_PAYLOAD_MATCH *KernelPayload
+    )
+{
+    NTSTATUS Status;
+    XDP_PAYLOAD_PATTERN_TABLE *Table;
+    XDP_PAYLOAD_PATTERN DummyPattern = {0};
+
+    UNREFERENCED_PARAMETER(RequestorMode);
+
+    //
+    // Straddle the end of short payloads so both the in-place and the copied
+    // comparison paths are exercised.
+    //
+    DummyPattern.Offset = 4;
+    DummyPattern.Length = 12;
+    DummyPattern.Value[0] = 0x01;
+    DummyPattern.Mask[0] = 0x0F;
+
+    Status = XdpProgramCreatePayloadPatternTable(&DummyPattern, &Table);
+    if (NT_SUCCESS(Status)) {
+        KernelPayload->Port = UserPayload->Port;
+        KernelPayload->Reserved = Table;
+    }
+
+    return Status;
+}
+
+NTSTATUS
+XdpProgramCaptureXskMap(
+    _In_ const XDP_XSK_MAP *UserXskMap,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _In_ BOOLEAN Distinct,
+    _Out_ XDP_XSK_MAP_TABLE **Table
+    )
+{
+    XDP_XSK_MAP_TABLE *NewTable;
+    const UINT32 SocketCount = 3;
+
+    UNREFERENCED_PARAMETER(UserXskMap);
+    UNREFERENCED_PARAMETER(RequestorMode);
+    UNREFERENCED_PARAMETER(Distinct);
+
+    NewTable =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, sizeof(*NewTable) + SocketCount * sizeof(HANDLE),
+            XDP_POOLTAG_XSK_MAP);
+    if (NewTable == NULL) {
+        *Table = NULL;
+        return STATUS_NO_MEMORY;
+    }
+
+    NewTable->SocketCount = SocketCount;
+    for (UINT32 Index = 0; Index < SocketCount; Index++) {
+        NewTable->Sockets[Index] = (HANDLE)(ULONG_PTR)(Index + 1);
+    }
+
+    *Table = NewTable;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+XdpProgramCaptureQuicLb(
+    _In_ const XDP_QUIC_LB *UserQuicLb,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Out_ XDP_QUIC_LB_TABLE **Table
+    )
+{
+    NTSTATUS Status;
+    XDP_QUIC_LB QuicLb = {0};
+    XDP_QUIC_LB_SERVER Servers[3] = {0};
+
+    UNREFERENCED_PARAMETER(UserQuicLb);
+    UNREFERENCED_PARAMETER(RequestorMode);
+
+    //
+    // Use a plaintext configuration so fuzzed connection IDs reach both the
+    // server ID lookup and the flow hash fallback.
+    //
+    QuicLb.ConfigId = 1;
+    QuicLb.ServerIdLength = 2;
+    QuicLb.Servers = Servers;
+    QuicLb.ServerCount = RTL_NUMBER_OF(Servers);
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Servers); Index++) {
+        Servers[Index].ServerId[1] = (UINT8)Index;
+    }
+
+    Status = XdpProgramCreateQuicLbTable(&QuicLb, Servers, Table);
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Servers); Index++) {
+        (*Table)->Servers[Index].Socket = (HANDLE)(ULONG_PTR)(Index + 1);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+XdpProgramCreatePolicer(
+    _In_ const XDP_POLICE_PARAMS *Params,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Out_ XDP_POLICER **Policer
+    )
+{
+    XDP_POLICER *NewPolicer;
+
+    UNREFERENCED_PARAMETER(RequestorMode);
+
+    NewPolicer =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, sizeof(*NewPolicer) + sizeof(NewPolicer->Buckets[0]),
+            XDP_POOLTAG_POLICER);
+    if (NewPolicer == NULL) {
+        *Policer = NULL;
+        return STATUS_NO_MEMORY;
+    }
+
+    NewPolicer->PacketsPerSecond = Params->PacketsPerSecond;
+    NewPolicer->BytesPerSecond = Params->BytesPerSecond;
+    NewPolicer->BucketCount = 1;
+
+    *Policer = NewPolicer;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+XdpProgramCaptureLoadBalancer(
+    _In_ const XDP_LOAD_BALANCE_PARAMS *UserParams,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_LOAD_BALANCE_PARAMS *KernelParams
+    )
+{
+    NTSTATUS Status;
+    XDP_LOAD_BALANCER *LoadBalancer;
+    const XDP_LOAD_BALANCER_BACKEND DummyBackends[] = {
+        {
+            .EthernetAddress = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 },
+            .IpAddress.Ipv4.S_un.S_addr = 0x0101a8c0,
+        },
+        {
+            .EthernetAddress = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 },
+            .IpAddress.Ipv4.S_un.S_addr = 0x0201a8c0,
+        },
+        {
+            .EthernetAddress = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x03 },
+            .IpAddress.Ipv6.u.Byte = { 0xfe, 0x80, [15] = 0x03 },
+        },
+    };
+
+    UNREFERENCED_PARAMETER(RequestorMode);
+
+    Status =
+        XdpProgramCreateLoadBalancer(
+            DummyBackends, RTL_NUMBER_OF(DummyBackends), UserParams->Flags, &LoadBalancer);
+    if (NT_SUCCESS(Status)) {
+        KernelParams->BackendCount = RTL_NUMBER_OF(DummyBackends);
+        KernelParams->Flags = UserParams->Flags;
+        KernelParams->Reserved = LoadBalancer;
+    }
+
+    return Status;
+}
+
+NTSTATUS
+XdpProgramCaptureEncap(
+    _In_ const XDP_ENCAP_PARAMS *UserParams,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_ENCAP_PARAMS *KernelParams
+    )
+{
+    NTSTATUS Status;
+    XDP_ENCAPSULATOR *Encapsulator;
+    UINT32 HeaderLength;
+    UINT8 DummyHeader[sizeof(ETHERNET_HEADER) + sizeof(IPV4_HEADER) + sizeof(UDP_HDR) +
+        sizeof(XDP_VXLAN_HEADER)] = {
+        [12] = 0x08, [13] = 0x00,                   // EtherType IPv4
+        [14] = 0x45, [22] = 64,                     // Version, IHL, TTL
+        [26] = 192, [27] = 168, [28] = 1, [29] = 1, // Source address
+        [30] = 192, [31] = 168, [32] = 1, [33] = 2, // Destination address
+    };
+
+    UNREFERENCED_PARAMETER(RequestorMode);
+
+    switch (UserParams->Type) {
+    case XDP_ENCAP_TYPE_VXLAN:
+        DummyHeader[23] = IPPROTO_UDP;
+        DummyHeader[36] = 0x12;                     // Destination port 4789
+        DummyHeader[37] = 0xb5;
+        DummyHeader[42] = XDP_VXLAN_FLAG_VNI;
+        HeaderLength = sizeof(DummyHeader);
+        break;
+
+    case XDP_ENCAP_TYPE_GRE:
+        DummyHeader[23] = IPPROTO_GRE;
+        DummyHeader[36] = 0x08;                     // Protocol type IPv4
+        HeaderLength = sizeof(ETHERNET_HEADER) + sizeof(IPV4_HEADER) + sizeof(XDP_GRE_HEADER);
+        break;
+
+    default:
+        HeaderLength = sizeof(ETHERNET_HEADER) + sizeof(IPV4_HEADER);
+        break;
+    }
+
+    Status =
+        XdpProgramCreateEncapsulator(UserParams->Type, DummyHeader, HeaderLength, &Encapsulator);
+    if (NT_SUCCESS(Status)) {
+        KernelParams->Type = UserParams->Type;
+        KernelParams->Flags = UserParams->Flags;
+        KernelParams->HeaderLength = HeaderLength;
+        KernelParams->Reserved = Encapsulator;
+    }
+
+    return Status;
+}
@@ -16,3 +16,19 @@ XdpRxQueueGetStatsFromInspectionContext(
 
     return &PcwStats;
 }
+
+VOID
+XdpRxQueueSampleDrop(
+    _In_ XDP_PCW_RX_QUEUE *RxQueueStats,
+    _In_ XDP_DROP_REASON Reason,
+    _In_ UINT32 DropCount,
+    _In_opt_ XDP_FRAME *Frame,
+    _In_opt_ XDP_EXTENSION *VirtualAddressExtension
+    )
+{
+    UNREFERENCED_PARAMETER(RxQueueStats);
+    UNREFERENCED_PARAMETER(Reason);
+    UNREFERENCED_PARAMETER(DropCount);
+    UNREFERENCED_PARAMETER(Frame);
+    UNREFERENCED_PARAMETER(VirtualAddressExtension);
+}
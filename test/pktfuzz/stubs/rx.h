@@ -9,3 +9,23 @@ XDP_PCW_RX_QUEUE *
 XdpRxQueueGetStatsFromInspectionContext(
     _In_ const XDP_INSPECTION_CONTEXT *Context
     );
+
+typedef enum _XDP_DROP_REASON {
+    XdpDropReasonFillRingEmpty,
+    XdpDropReasonRxRingFull,
+    XdpDropReasonTruncated,
+    XdpDropReasonInvalidDescriptor,
+    XdpDropReasonRule,
+    XdpDropReasonEbpfFailure,
+    XdpDropReasonBounceFailure,
+    XdpDropReasonLowResources,
+} XDP_DROP_REASON;
+
+VOID
+XdpRxQueueSampleDrop(
+    _In_ XDP_PCW_RX_QUEUE *RxQueueStats,
+    _In_ XDP_DROP_REASON Reason,
+    _In_ UINT32 DropCount,
+    _In_opt_ XDP_FRAME *Frame,
+    _In_opt_ XDP_EXTENSION *VirtualAddressExtension
+    );
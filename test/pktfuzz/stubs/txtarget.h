@@ -0,0 +1,31 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+typedef struct _XDP_TX_TARGET XDP_TX_TARGET;
+
+inline
+NTSTATUS
+XdpTxTargetCreate(
+    _In_ const XDP_INTERFACE_TX_TARGET *Params,
+    _Out_ XDP_TX_TARGET **Target
+    )
+{
+    *Target = (XDP_TX_TARGET *)(ULONG_PTR)(Params->IfIndex + 1);
+
+    return STATUS_SUCCESS;
+}
+
+inline
+VOID
+XdpTxTargetDelete(
+    _In_ XDP_TX_TARGET *Target
+    )
+{
+    DBG_UNREFERENCED_PARAMETER(Target);
+
+    ASSERT(Target != NULL);
+}
@@ -0,0 +1,19 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+#include <windows.h>
+#include <winternl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <xdpassert.h>
+
+#include <stubs/ntos.h>
+
+#include <xdprefcount.h>
+
+#define XDP_POOLTAG_REFCOUNT 'CcdX' // XdcC
@@ -0,0 +1,278 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+//
+// Unit tests for the sharded reference count, run against a simulated kernel in
+// which each thread selects the processor it runs on.
+//
+
+#include "precomp.h"
+
+__declspec(thread) ULONG FakeCurrentProcessor;
+BOOLEAN FakeAllocationFails;
+
+#define RACE_ITERATIONS 1000
+#define RACE_REFERENCES 16
+
+#define TEST_TRUE(e) \
+    if (!(e)) { \
+        fprintf(stderr, "%s:%u: %s failed\n", __FILE__, __LINE__, #e); \
+        exit(EXIT_FAILURE); \
+    }
+
+#define TEST_FALSE(e) TEST_TRUE(!(e))
+#define TEST_EQUAL(Expected, Actual) TEST_TRUE((Expected) == (Actual))
+
+static
+VOID
+TestInitialize(
+    _Out_ XDP_SHARDED_REFERENCE_COUNT *RefCount
+    )
+{
+    TEST_EQUAL(STATUS_SUCCESS, XdpInitializeShardedReferenceCount(RefCount));
+    TEST_TRUE(RefCount->Shards != NULL);
+    TEST_EQUAL(FAKE_PROCESSOR_COUNT, RefCount->ShardCount);
+}
+
+static
+VOID
+TestCleanup(
+    _Inout_ XDP_SHARDED_REFERENCE_COUNT *RefCount
+    )
+{
+    TEST_EQUAL(0, RefCount->Shared);
+    XdpCleanupShardedReferenceCount(RefCount);
+    TEST_TRUE(RefCount->Shards == NULL);
+}
+
+static
+VOID
+TestDrainUnreferenced(
+    VOID
+    )
+{
+    XDP_SHARDED_REFERENCE_COUNT RefCount;
+
+    //
+    // Draining releases the initial reference, which is the last.
+    //
+    TestInitialize(&RefCount);
+    TEST_TRUE(XdpDrainShardedReferenceCount(&RefCount));
+    TestCleanup(&RefCount);
+}
+
+static
+VOID
+TestAcrossShards(
+    VOID
+    )
+{
+    XDP_SHARDED_REFERENCE_COUNT RefCount;
+
+    TestInitialize(&RefCount);
+
+    //
+    // Acquire references on one processor and release them on another, so the
+    // shards hold counts of opposite signs. No release is the last while the
+    // initial reference is held.
+    //
+    FakeCurrentProcessor = 0;
+    for (UINT32 Index = 0; Index < 3; Index++) {
+        XdpIncrementShardedReferenceCount(&RefCount);
+    }
+
+    FakeCurrentProcessor = 1;
+    for (UINT32 Index = 0; Index < 3; Index++) {
+        TEST_FALSE(XdpDecrementShardedReferenceCount(&RefCount));
+    }
+
+    TEST_EQUAL(3, RefCount.Shards[0].Count);
+    TEST_EQUAL(-3, RefCount.Shards[1].Count);
+    TEST_EQUAL(1, RefCount.Shared);
+
+    //
+    // Hold two references across the drain, acquired on different processors.
+    //
+    XdpIncrementShardedReferenceCount(&RefCount);
+    FakeCurrentProcessor = 2;
+    XdpIncrementShardedReferenceCount(&RefCount);
+
+    TEST_FALSE(XdpDrainShardedReferenceCount(&RefCount));
+    TEST_EQUAL(2, RefCount.Shared);
+
+    //
+    // Shards refuse counts once drained, so references acquired after the
+    // drain use the shared count.
+    //
+    for (ULONG Processor = 0; Processor < FAKE_PROCESSOR_COUNT; Processor++) {
+        FakeCurrentProcessor = Processor;
+        TEST_FALSE(XdpAddReferenceCountShard(&RefCount, 1));
+        TEST_FALSE(XdpAddReferenceCountShard(&RefCount, -1));
+        TEST_EQUAL(XDP_REFERENCE_COUNT_SHARD_DRAINED, RefCount.Shards[Processor].Count);
+    }
+
+    FakeCurrentProcessor = 3;
+    XdpIncrementShardedReferenceCount(&RefCount);
+    TEST_EQUAL(3, RefCount.Shared);
+
+    //
+    // Only the release of the last reference reports it, regardless of the
+    // processor it was acquired on.
+    //
+    FakeCurrentProcessor = 0;
+    TEST_FALSE(XdpDecrementShardedReferenceCount(&RefCount));
+    TEST_FALSE(XdpDecrementShardedReferenceCount(&RefCount));
+    TEST_TRUE(XdpDecrementShardedReferenceCount(&RefCount));
+
+    TestCleanup(&RefCount);
+    FakeCurrentProcessor = 0;
+}
+
+static
+VOID
+TestUnsharded(
+    VOID
+    )
+{
+    XDP_SHARDED_REFERENCE_COUNT RefCount;
+
+    //
+    // The count remains usable if the shards cannot be allocated.
+    //
+    FakeAllocationFails = TRUE;
+    TEST_EQUAL(STATUS_NO_MEMORY, XdpInitializeShardedReferenceCount(&RefCount));
+    FakeAllocationFails = FALSE;
+    TEST_TRUE(RefCount.Shards == NULL);
+
+    TEST_FALSE(XdpAddReferenceCountShard(&RefCount, 1));
+    XdpIncrementShardedReferenceCount(&RefCount);
+    TEST_EQUAL(2, RefCount.Shared);
+
+    TEST_FALSE(XdpDrainShardedReferenceCount(&RefCount));
+    TEST_TRUE(XdpDecrementShardedReferenceCount(&RefCount));
+
+    TestCleanup(&RefCount);
+}
+
+typedef struct _RACE_WORKER {
+    XDP_SHARDED_REFERENCE_COUNT *RefCount;
+    HANDLE StartEvent;
+    ULONG Processor;
+    volatile LONG *FinalReleaseCount;
+} RACE_WORKER;
+
+static
+DWORD
+WINAPI
+RaceWorkerThread(
+    _In_ VOID *Context
+    )
+{
+    RACE_WORKER *Worker = Context;
+
+    FakeCurrentProcessor = Worker->Processor;
+    WaitForSingleObject(Worker->StartEvent, INFINITE);
+
+    //
+    // Release the references the test acquired on another processor, and
+    // churn a reference on this processor while at least one is still held.
+    //
+    for (UINT32 Index = 0; Index < RACE_REFERENCES; Index++) {
+        XdpIncrementShardedReferenceCount(Worker->RefCount);
+        TEST_FALSE(XdpDecrementShardedReferenceCount(Worker->RefCount));
+
+        if (XdpDecrementShardedReferenceCount(Worker->RefCount)) {
+            InterlockedIncrement(Worker->FinalReleaseCount);
+        }
+    }
+
+    return 0;
+}
+
+static
+VOID
+TestReleaseRacingDrain(
+    VOID
+    )
+{
+    RACE_WORKER Workers[FAKE_PROCESSOR_COUNT];
+    HANDLE Threads[FAKE_PROCESSOR_COUNT];
+    HANDLE StartEvent;
+
+    StartEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    TEST_TRUE(StartEvent != NULL);
+
+    for (UINT32 Iteration = 0; Iteration < RACE_ITERATIONS; Iteration++) {
+        XDP_SHARDED_REFERENCE_COUNT RefCount;
+        volatile LONG FinalReleaseCount = 0;
+
+        TestInitialize(&RefCount);
+        TEST_TRUE(ResetEvent(StartEvent));
+
+        for (ULONG Processor = 0; Processor < FAKE_PROCESSOR_COUNT; Processor++) {
+            //
+            // Acquire each worker's references on the next processor, so the
+            // worker's releases drive its own shard negative.
+            //
+            FakeCurrentProcessor = (Processor + 1) % FAKE_PROCESSOR_COUNT;
+            for (UINT32 Index = 0; Index < RACE_REFERENCES; Index++) {
+                XdpIncrementShardedReferenceCount(&RefCount);
+            }
+
+            Workers[Processor].RefCount = &RefCount;
+            Workers[Processor].StartEvent = StartEvent;
+            Workers[Processor].Processor = Processor;
+            Workers[Processor].FinalReleaseCount = &FinalReleaseCount;
+
+            Threads[Processor] =
+                CreateThread(NULL, 0, RaceWorkerThread, &Workers[Processor], 0, NULL);
+            TEST_TRUE(Threads[Processor] != NULL);
+        }
+
+        FakeCurrentProcessor = Iteration % FAKE_PROCESSOR_COUNT;
+        TEST_TRUE(SetEvent(StartEvent));
+
+        if (XdpDrainShardedReferenceCount(&RefCount)) {
+            InterlockedIncrement(&FinalReleaseCount);
+        }
+
+        TEST_EQUAL(
+            WAIT_OBJECT_0,
+            WaitForMultipleObjects(FAKE_PROCESSOR_COUNT, Threads, TRUE, INFINITE));
+
+        for (ULONG Processor = 0; Processor < FAKE_PROCESSOR_COUNT; Processor++) {
+            CloseHandle(Threads[Processor]);
+        }
+
+        //
+        // Exactly one release, by a worker or the drain, is the last.
+        //
+        TEST_EQUAL(1, FinalReleaseCount);
+        TestCleanup(&RefCount);
+    }
+
+    CloseHandle(StartEvent);
+    FakeCurrentProcessor = 0;
+}
+
+INT
+__cdecl
+main(
+    INT Argc,
+    CHAR **Argv
+    )
+{
+    UNREFERENCED_PARAMETER(Argc);
+    UNREFERENCED_PARAMETER(Argv);
+
+    TestDrainUnreferenced();
+    TestAcrossShards();
+    TestUnsharded();
+    TestReleaseRacingDrain();
+
+    printf("Passed\n");
+
+    return EXIT_SUCCESS;
+}
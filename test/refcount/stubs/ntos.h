@@ -0,0 +1,81 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+//
+// A simulation of the kernel services used by the sharded reference count.
+// Each thread runs on the fake processor it selects, and allocations fail
+// while the test requests it.
+//
+
+#define STATUS_SUCCESS ((NTSTATUS)0x00000000L)
+
+#define FAKE_PROCESSOR_COUNT 4
+
+typedef enum {
+    NonPagedPoolNx,
+    NonPagedPoolNxCacheAligned,
+} POOL_TYPE;
+
+extern __declspec(thread) ULONG FakeCurrentProcessor;
+extern BOOLEAN FakeAllocationFails;
+
+inline
+VOID *
+ExAllocatePoolZero(
+    _In_ POOL_TYPE PoolType,
+    _In_ SIZE_T NumberOfBytes,
+    _In_ ULONG Tag
+    )
+{
+    VOID *P;
+
+    UNREFERENCED_PARAMETER(PoolType);
+    UNREFERENCED_PARAMETER(Tag);
+
+    if (FakeAllocationFails) {
+        return NULL;
+    }
+
+    P = _aligned_malloc(NumberOfBytes, SYSTEM_CACHE_ALIGNMENT_SIZE);
+    if (P != NULL) {
+        RtlZeroMemory(P, NumberOfBytes);
+    }
+
+    return P;
+}
+
+inline
+VOID
+ExFreePoolWithTag(
+    _In_ VOID *P,
+    _In_ ULONG Tag
+    )
+{
+    UNREFERENCED_PARAMETER(Tag);
+
+    _aligned_free(P);
+}
+
+inline
+ULONG
+KeQueryMaximumProcessorCountEx(
+    _In_ USHORT GroupNumber
+    )
+{
+    UNREFERENCED_PARAMETER(GroupNumber);
+
+    return FAKE_PROCESSOR_COUNT;
+}
+
+inline
+ULONG
+KeGetCurrentProcessorIndex(
+    VOID
+    )
+{
+    return FakeCurrentProcessor;
+}
@@ -37,6 +37,7 @@
 #define DEFAULT_QUEUE_COUNT 4
 #define DEFAULT_FUZZER_COUNT 3
 #define DEFAULT_SUCCESS_THRESHOLD 50
+#define DEFAULT_STALL_THRESHOLD_MS 100
 
 CHAR *HELP =
 "spinxsk.exe -IfIndex <ifindex> [OPTIONS]\n"
@@ -62,6 +63,11 @@ CHAR *HELP =
 "                         Default: " STR_OF(DEFAULT_SUCCESS_THRESHOLD) "\n"
 "   -EnableEbpf           Enables eBPF testing\n"
 "                         Default: off\n"
+"   -Soak                 Measure datapath throughput, TX completion latency\n"
+"                         and stalls while churn runs, reported every second\n"
+"                         Default: off\n"
+"   -StallThresholdMs <ms> Minimum datapath stall reported in soak mode\n"
+"                         Default: " STR_OF(DEFAULT_STALL_THRESHOLD_MS) "\n"
 ;
 
 #define ASSERT_FRE(expr) \
@@ -85,6 +91,15 @@ CHAR *HELP =
 #define WAIT_DRIVER_TIMEOUT_MS 1050
 #define ADMIN_THREAD_TIMEOUT_SEC 1
 #define WATCHDOG_THREAD_TIMEOUT_SEC 10
+#define SOAK_THREAD_TIMEOUT_SEC 1
+
+//
+// Soak mode latencies are recorded in microseconds into a log-linear histogram:
+// values below 8 have their own bucket, and every power of two above that is
+// split into 8 linear sub-buckets, bounding the percentile error to 12.5%.
+//
+#define SOAK_LATENCY_SUB_BUCKETS 8
+#define SOAK_LATENCY_BUCKETS ((64 - 2) * SOAK_LATENCY_SUB_BUCKETS)
 
 typedef struct QUEUE_CONTEXT QUEUE_CONTEXT;
 
@@ -94,6 +109,25 @@ typedef enum {
     XdpModeNative,
 } XDP_MODE;
 
+typedef enum {
+    SoakChurnRssSet,
+    SoakChurnProgramAttach,
+    SoakChurnProgramDetach,
+    SoakChurnSocketBind,
+    SoakChurnAdapterRestart,
+    SoakChurnMax,
+} SOAK_CHURN_TYPE;
+
+CHAR *SoakChurnToString[] = {
+    "rssSet",
+    "programAttach",
+    "programDetach",
+    "socketBind",
+    "adapterRestart",
+};
+
+C_ASSERT(RTL_NUMBER_OF(SoakChurnToString) == SoakChurnMax);
+
 CHAR *XdpModeToString[] = {
     "System",
     "Generic",
@@ -155,6 +189,14 @@ typedef struct {
     PROGRAM_HANDLE Handles[8];
 } XSK_PROGRAM_SET;
 
+typedef struct {
+    ULONGLONG rxPackets;
+    ULONGLONG txPackets;
+    ULONGLONG stallCount;
+    ULONGLONG maxStallUs;
+    ULONGLONG txLatencyUs[SOAK_LATENCY_BUCKETS];
+} SOAK_STATS;
+
 typedef struct {
     HANDLE threadHandle;
     XSK_DATAPATH_SHARED *shared;
@@ -186,6 +228,17 @@ typedef struct {
 
     BYTE *rxFreeRingBase;
     BYTE *txFreeRingBase;
+
+    //
+    // Soak mode state: the queue worker's stats, the time each direction last
+    // made progress, and the time each TX descriptor was posted.
+    //
+    SOAK_STATS *soakStats;
+    ULONGLONG rxProgressPerfCount;
+    ULONGLONG txProgressPerfCount;
+    UINT64 txDescriptorStart;
+    UINT32 txDescriptorCount;
+    ULONGLONG *txPostPerfCounts;
 } XSK_DATAPATH_WORKER;
 
 typedef struct {
@@ -257,6 +310,7 @@ typedef struct {
     UINT32 queueId;
     ULONGLONG watchdogPerfCount;
     SETUP_STATS setupStats;
+    SOAK_STATS soakStats;
 } QUEUE_WORKER;
 
 INT ifindex = -1;
@@ -266,6 +320,10 @@ BOOLEAN cleanDatapath = FALSE;
 BOOLEAN done = FALSE;
 BOOLEAN extraStats = FALSE;
 BOOLEAN enableEbpf = FALSE;
+BOOLEAN soak = FALSE;
+ULONG stallThresholdMs = DEFAULT_STALL_THRESHOLD_MS;
+ULONGLONG stallThresholdInCounts;
+ULONGLONG soakChurnPerfCount[SoakChurnMax];
 UINT8 successThresholdPercent = DEFAULT_SUCCESS_THRESHOLD;
 HANDLE stopEvent;
 HANDLE workersDoneEvent;
@@ -295,6 +353,99 @@ Pct(
     return (Divisor == 0) ? 0 : Dividend * 100 / Divisor;
 }
 
+ULONGLONG
+PerfCountToUs(
+    ULONGLONG PerfCount
+    )
+{
+    return PerfCount * 1000000 / perfFreq;
+}
+
+VOID
+SoakRecordChurn(
+    SOAK_CHURN_TYPE Type
+    )
+{
+    ULONGLONG perfCount;
+
+    if (!soak) {
+        return;
+    }
+
+    //
+    // Only the most recent occurrence of each type of churn is kept, which is
+    // enough to attribute a stall to the churn that preceded it.
+    //
+    QueryPerformanceCounter((LARGE_INTEGER*)&perfCount);
+    WriteNoFence64((LONG64 *)&soakChurnPerfCount[Type], perfCount);
+}
+
+UINT32
+SoakLatencyBucket(
+    ULONGLONG LatencyUs
+    )
+{
+    ULONG msb;
+
+    if (LatencyUs < SOAK_LATENCY_SUB_BUCKETS) {
+        return (UINT32)LatencyUs;
+    }
+
+    _BitScanReverse64(&msb, LatencyUs);
+
+    return
+        (msb - 2) * SOAK_LATENCY_SUB_BUCKETS +
+        (UINT32)((LatencyUs >> (msb - 3)) & (SOAK_LATENCY_SUB_BUCKETS - 1));
+}
+
+ULONGLONG
+SoakBucketLatency(
+    UINT32 Bucket
+    )
+{
+    UINT32 msb;
+    UINT32 subBucket;
+
+    if (Bucket < SOAK_LATENCY_SUB_BUCKETS) {
+        return Bucket;
+    }
+
+    msb = Bucket / SOAK_LATENCY_SUB_BUCKETS + 2;
+    subBucket = Bucket % SOAK_LATENCY_SUB_BUCKETS;
+
+    return (ULONGLONG)(SOAK_LATENCY_SUB_BUCKETS + subBucket) << (msb - 3);
+}
+
+//
+// Returns the lower bound of the histogram bucket containing the given
+// percentile, in hundredths of a percent.
+//
+ULONGLONG
+SoakLatencyPercentile(
+    _In_ const ULONGLONG *Histogram,
+    ULONGLONG Total,
+    ULONG PercentileHundredths
+    )
+{
+    ULONGLONG target;
+    ULONGLONG count = 0;
+
+    if (Total == 0) {
+        return 0;
+    }
+
+    target = (Total * PercentileHundredths + 9999) / 10000;
+
+    for (UINT32 i = 0; i < SOAK_LATENCY_BUCKETS; i++) {
+        count += Histogram[i];
+        if (count >= target) {
+            return SoakBucketLatency(i);
+        }
+    }
+
+    return SoakBucketLatency(SOAK_LATENCY_BUCKETS - 1);
+}
+
 BOOLEAN
 ScenarioConfigActivateReady(
     _In_ const SCENARIO_CONFIG *ScenarioConfig
@@ -681,6 +832,8 @@ AttachXdpProgram(
     HRESULT res;
     UINT8 *PortSet = NULL;
 
+    SoakRecordChurn(SoakChurnProgramAttach);
+
     if (RxRequired) {
         rule.Match = XDP_MATCH_ALL;
         rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
@@ -811,6 +964,10 @@ DetachXdpProgram(
     }
     LeaveCriticalSection(&RxProgramSet->Lock);
 
+    if (Handle != NULL || BpfObject != NULL) {
+        SoakRecordChurn(SoakChurnProgramDetach);
+    }
+
     if (Handle != NULL) {
         ASSERT_FRE(CloseHandle(Handle));
     }
@@ -1001,6 +1158,8 @@ FuzzRssSet(
     // crash the system.
     //
 
+    SoakRecordChurn(SoakChurnRssSet);
+
     if (fuzzer->fuzzerInterface != NULL) {
         (void)queue->XdpRssSet(fuzzer->fuzzerInterface, RssConfiguration, RssConfigSize);
     } else {
@@ -1690,6 +1849,7 @@ FuzzSocketBind(
             bindFlags |= 0x1 << (RandUlong() % 32);
         }
 
+        SoakRecordChurn(SoakChurnSocketBind);
         res = Queue->xdpApi->XskBind(Sock, ifindex, Queue->queueId, bindFlags);
         if (SUCCEEDED(res)) {
             WriteBooleanRelease(WasSockBound, TRUE);
@@ -1730,6 +1890,10 @@ CleanupDatapath(
     if (Datapath->txFreeRingBase) {
         free(Datapath->txFreeRingBase);
     }
+    if (Datapath->txPostPerfCounts) {
+        free(Datapath->txPostPerfCounts);
+        Datapath->txPostPerfCounts = NULL;
+    }
 }
 
 HRESULT
@@ -1798,6 +1962,17 @@ InitializeDatapath(
         if (FAILED(res)) {
             goto Exit;
         }
+
+        if (soak) {
+            Datapath->txDescriptorStart = descriptorStart;
+            Datapath->txDescriptorCount = descriptorCount;
+            Datapath->txPostPerfCounts =
+                calloc(descriptorCount, sizeof(*Datapath->txPostPerfCounts));
+            if (Datapath->txPostPerfCounts == NULL) {
+                res = E_OUTOFMEMORY;
+                goto Exit;
+            }
+        }
     }
 
     res =
@@ -1809,6 +1984,12 @@ InitializeDatapath(
 
     ASSERT_FRE(SUCCEEDED(res));
 
+    if (soak) {
+        Datapath->soakStats = &queueWorkers[queue->queueId].soakStats;
+        QueryPerformanceCounter((LARGE_INTEGER*)&Datapath->rxProgressPerfCount);
+        Datapath->txProgressPerfCount = Datapath->rxProgressPerfCount;
+    }
+
 Exit:
 
     if (FAILED(res)) {
@@ -1844,6 +2025,97 @@ NotifyDriver(
     }
 }
 
+VOID
+SoakRecordProgress(
+    _In_ XSK_DATAPATH_WORKER *Datapath,
+    _In_z_ CONST CHAR *Direction,
+    _Inout_ ULONGLONG *ProgressPerfCount,
+    ULONGLONG PerfCount
+    )
+{
+    ULONGLONG stallInCounts = PerfCount - *ProgressPerfCount;
+
+    if (stallInCounts >= stallThresholdInCounts) {
+        SOAK_STATS *soakStats = Datapath->soakStats;
+        ULONGLONG stallUs = PerfCountToUs(stallInCounts);
+        ULONGLONG maxStallUs = ReadNoFence64((LONG64 *)&soakStats->maxStallUs);
+        CHAR churn[256] = { 0 };
+        SIZE_T churnLength = 0;
+
+        InterlockedIncrement64((LONG64 *)&soakStats->stallCount);
+
+        while (stallUs > maxStallUs) {
+            ULONGLONG oldMaxStallUs =
+                InterlockedCompareExchange64(
+                    (LONG64 *)&soakStats->maxStallUs, stallUs, maxStallUs);
+            if (oldMaxStallUs == maxStallUs) {
+                break;
+            }
+            maxStallUs = oldMaxStallUs;
+        }
+
+        //
+        // Attribute the stall to each type of churn that last occurred within
+        // a threshold of the stall starting, or during the stall, with its
+        // offset from the start of the stall.
+        //
+        for (UINT32 i = 0; i < SoakChurnMax; i++) {
+            ULONGLONG churnPerfCount = ReadNoFence64((LONG64 *)&soakChurnPerfCount[i]);
+            LONGLONG offsetInCounts =
+                (LONGLONG)(churnPerfCount - *ProgressPerfCount);
+
+            if (churnPerfCount != 0 &&
+                offsetInCounts > -(LONGLONG)stallThresholdInCounts &&
+                churnPerfCount <= PerfCount) {
+                INT written =
+                    sprintf_s(
+                        churn + churnLength, sizeof(churn) - churnLength, " %s(%+lldms)",
+                        SoakChurnToString[i], offsetInCounts * 1000 / (LONGLONG)perfFreq);
+                if (written > 0) {
+                    churnLength += written;
+                }
+            }
+        }
+
+        printf(
+            "q[%u]d[0x%p]: %s STALL %llums churn:%s\n",
+            Datapath->shared->queue->queueId, Datapath->threadHandle, Direction,
+            stallUs / 1000, churnLength > 0 ? churn : " none");
+    }
+
+    *ProgressPerfCount = PerfCount;
+}
+
+VOID
+SoakRecordTxCompletion(
+    _Inout_ XSK_DATAPATH_WORKER *Datapath,
+    UINT64 Address,
+    ULONGLONG PerfCount
+    )
+{
+    UINT64 index =
+        (Address - Datapath->txDescriptorStart) / Datapath->shared->queue->umemReg.ChunkSize;
+    ULONGLONG postPerfCount;
+
+    //
+    // Descriptors are posted and completed by this thread only, but the
+    // address is supplied by the driver, so validate it before use.
+    //
+    if (Address < Datapath->txDescriptorStart || index >= Datapath->txDescriptorCount) {
+        return;
+    }
+
+    postPerfCount = Datapath->txPostPerfCounts[index];
+    if (postPerfCount == 0) {
+        return;
+    }
+
+    Datapath->txPostPerfCounts[index] = 0;
+    InterlockedIncrement64(
+        (LONG64 *)&Datapath->soakStats->txLatencyUs[
+            SoakLatencyBucket(PerfCountToUs(PerfCount - postPerfCount))]);
+}
+
 BOOLEAN
 ProcessPkts(
     _Inout_ XSK_DATAPATH_WORKER *Datapath
@@ -1853,6 +2125,11 @@ ProcessPkts(
     UINT32 available;
     UINT32 consumerIndex;
     UINT32 producerIndex;
+    ULONGLONG perfCount = 0;
+
+    if (soak) {
+        QueryPerformanceCounter((LARGE_INTEGER*)&perfCount);
+    }
 
     if (Datapath->flags.rx) {
         //
@@ -1874,6 +2151,11 @@ ProcessPkts(
 
             Datapath->rxPacketCount += available;
             QueryPerformanceCounter((LARGE_INTEGER*)&Datapath->rxWatchdogPerfCount);
+
+            if (soak) {
+                InterlockedAdd64((LONG64 *)&Datapath->soakStats->rxPackets, available);
+                SoakRecordProgress(Datapath, "rx", &Datapath->rxProgressPerfCount, perfCount);
+            }
         }
 
         //
@@ -1923,6 +2205,10 @@ ProcessPkts(
                 UINT64 *freeDesc = XskRingGetElement(&Datapath->txFreeRing, producerIndex++);
 
                 *freeDesc = *compDesc;
+
+                if (soak) {
+                    SoakRecordTxCompletion(Datapath, *compDesc, perfCount);
+                }
             }
 
             XskRingConsumerRelease(&Datapath->compRing, available);
@@ -1936,6 +2222,11 @@ ProcessPkts(
             }
 
             QueryPerformanceCounter((LARGE_INTEGER*)&Datapath->txWatchdogPerfCount);
+
+            if (soak) {
+                InterlockedAdd64((LONG64 *)&Datapath->soakStats->txPackets, available);
+                SoakRecordProgress(Datapath, "tx", &Datapath->txProgressPerfCount, perfCount);
+            }
         }
 
         //
@@ -1951,6 +2242,15 @@ ProcessPkts(
 
                 txDesc->Address.AddressAndOffset = *freeDesc;
                 txDesc->Length = Datapath->txiosize;
+
+                if (soak) {
+                    UINT64 index =
+                        (*freeDesc - Datapath->txDescriptorStart) /
+                            Datapath->shared->queue->umemReg.ChunkSize;
+                    if (index < Datapath->txDescriptorCount) {
+                        Datapath->txPostPerfCounts[index] = perfCount;
+                    }
+                }
             }
 
             XskRingConsumerRelease(&Datapath->txFreeRing, available);
@@ -2387,6 +2687,7 @@ AdminFn(
         if (!cleanDatapath && !(RandUlong() % 10)) {
             INT exitCode;
             TraceVerbose("admin: restart adapter");
+            SoakRecordChurn(SoakChurnAdapterRestart);
             RtlZeroMemory(cmdBuff, sizeof(cmdBuff));
             sprintf_s(
                 cmdBuff, sizeof(cmdBuff),
@@ -2474,6 +2775,132 @@ WatchdogFn(
     return 0;
 }
 
+VOID
+SoakAccumulate(
+    _Inout_ SOAK_STATS *Total,
+    _In_ SOAK_STATS *Stats
+    )
+{
+    ULONGLONG maxStallUs = ReadNoFence64((LONG64 *)&Stats->maxStallUs);
+
+    Total->rxPackets += ReadNoFence64((LONG64 *)&Stats->rxPackets);
+    Total->txPackets += ReadNoFence64((LONG64 *)&Stats->txPackets);
+    Total->stallCount += ReadNoFence64((LONG64 *)&Stats->stallCount);
+    Total->maxStallUs = max(Total->maxStallUs, maxStallUs);
+
+    for (UINT32 i = 0; i < SOAK_LATENCY_BUCKETS; i++) {
+        Total->txLatencyUs[i] += ReadNoFence64((LONG64 *)&Stats->txLatencyUs[i]);
+    }
+}
+
+VOID
+PrintSoakStats(
+    _In_z_ CONST CHAR *Prefix,
+    _In_ const SOAK_STATS *Stats,
+    ULONGLONG DurationUs
+    )
+{
+    ULONGLONG txCompletions = 0;
+
+    for (UINT32 i = 0; i < SOAK_LATENCY_BUCKETS; i++) {
+        txCompletions += Stats->txLatencyUs[i];
+    }
+
+    if (DurationUs == 0) {
+        DurationUs = 1;
+    }
+
+    printf(
+        "%s: rx:%llu pps tx:%llu pps txLatencyUs p50:%llu p99:%llu p99.9:%llu max:%llu "
+        "stalls:%llu maxStallMs:%llu\n",
+        Prefix, Stats->rxPackets * 1000000 / DurationUs, Stats->txPackets * 1000000 / DurationUs,
+        SoakLatencyPercentile(Stats->txLatencyUs, txCompletions, 5000),
+        SoakLatencyPercentile(Stats->txLatencyUs, txCompletions, 9900),
+        SoakLatencyPercentile(Stats->txLatencyUs, txCompletions, 9990),
+        SoakLatencyPercentile(Stats->txLatencyUs, txCompletions, 10000),
+        Stats->stallCount, Stats->maxStallUs / 1000);
+}
+
+DWORD
+WINAPI
+SoakFn(
+    _In_ VOID *ThreadParameter
+    )
+{
+    DWORD res;
+    ULONGLONG startPerfCount;
+    ULONGLONG previousPerfCount;
+    ULONGLONG perfCount;
+    SOAK_STATS *previous;
+    SOAK_STATS *current;
+    SOAK_STATS *interval;
+    CHAR prefix[32];
+
+    UNREFERENCED_PARAMETER(ThreadParameter);
+
+    TraceEnter("-");
+
+    previous = calloc(1, sizeof(*previous));
+    current = calloc(1, sizeof(*current));
+    interval = calloc(1, sizeof(*interval));
+    ASSERT_FRE(previous != NULL && current != NULL && interval != NULL);
+
+    QueryPerformanceCounter((LARGE_INTEGER*)&startPerfCount);
+    previousPerfCount = startPerfCount;
+
+    while (TRUE) {
+        res = WaitForSingleObject(workersDoneEvent, SOAK_THREAD_TIMEOUT_SEC * 1000);
+        if (res == WAIT_OBJECT_0) {
+            break;
+        }
+
+        //
+        // Report the datapath's progress over the last interval, summed over
+        // all queues.
+        //
+        QueryPerformanceCounter((LARGE_INTEGER*)&perfCount);
+        RtlZeroMemory(current, sizeof(*current));
+        for (UINT32 i = 0; i < queueCount; i++) {
+            SoakAccumulate(current, &queueWorkers[i].soakStats);
+        }
+
+        interval->rxPackets = current->rxPackets - previous->rxPackets;
+        interval->txPackets = current->txPackets - previous->txPackets;
+        interval->stallCount = current->stallCount - previous->stallCount;
+        interval->maxStallUs = current->maxStallUs;
+        for (UINT32 i = 0; i < SOAK_LATENCY_BUCKETS; i++) {
+            interval->txLatencyUs[i] = current->txLatencyUs[i] - previous->txLatencyUs[i];
+        }
+
+        PrintSoakStats("soak", interval, PerfCountToUs(perfCount - previousPerfCount));
+
+        *previous = *current;
+        previousPerfCount = perfCount;
+    }
+
+    //
+    // All workers have returned, so summarize the entire run.
+    //
+    QueryPerformanceCounter((LARGE_INTEGER*)&perfCount);
+    RtlZeroMemory(current, sizeof(*current));
+    for (UINT32 i = 0; i < queueCount; i++) {
+        RtlZeroMemory(interval, sizeof(*interval));
+        SoakAccumulate(interval, &queueWorkers[i].soakStats);
+        SoakAccumulate(current, &queueWorkers[i].soakStats);
+
+        sprintf_s(prefix, sizeof(prefix), "q[%u]: soak total", i);
+        PrintSoakStats(prefix, interval, PerfCountToUs(perfCount - startPerfCount));
+    }
+    PrintSoakStats("soak total", current, PerfCountToUs(perfCount - startPerfCount));
+
+    free(interval);
+    free(current);
+    free(previous);
+
+    TraceExit("-");
+    return 0;
+}
+
 VOID
 PrintUsage(
     _In_ INT Line
@@ -2541,6 +2968,14 @@ ParseArgs(
             TraceVerbose("successThresholdPercent=%u", successThresholdPercent);
         } else if (!strcmp(argv[i], "-EnableEbpf")) {
             enableEbpf = TRUE;
+        } else if (!strcmp(argv[i], "-Soak")) {
+            soak = TRUE;
+        } else if (!strcmp(argv[i], "-StallThresholdMs")) {
+            if (++i >= argc) {
+                Usage();
+            }
+            stallThresholdMs = atoi(argv[i]);
+            TraceVerbose("stallThresholdMs=%u", stallThresholdMs);
         } else {
             Usage();
         }
@@ -2580,6 +3015,7 @@ main(
 {
     HANDLE adminThread;
     HANDLE watchdogThread;
+    HANDLE soakThread = NULL;
 
     WPP_INIT_TRACING(NULL);
 
@@ -2597,6 +3033,7 @@ main(
     powershellPrefix = GetPowershellPrefix();
 
     QueryPerformanceFrequency((LARGE_INTEGER*)&perfFreq);
+    stallThresholdInCounts = perfFreq * stallThresholdMs / 1000;
 
     stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
     ASSERT_FRE(stopEvent != NULL);
@@ -2620,12 +3057,16 @@ main(
     }
 
     //
-    // Create admin and watchdog thread for queue workers.
+    // Create admin, watchdog and soak threads for queue workers.
     //
     adminThread = CreateThread(NULL, 0, AdminFn, NULL, 0, NULL);
     ASSERT_FRE(adminThread);
     watchdogThread = CreateThread(NULL, 0, WatchdogFn, NULL, 0, NULL);
     ASSERT_FRE(watchdogThread);
+    if (soak) {
+        soakThread = CreateThread(NULL, 0, SoakFn, NULL, 0, NULL);
+        ASSERT_FRE(soakThread);
+    }
 
     //
     // Kick off the queue workers.
@@ -2659,7 +3100,7 @@ main(
     }
 
     //
-    // Cleanup the admin and watchdog threads after all workers have exited.
+    // Cleanup the admin, watchdog and soak threads after all workers have exited.
     //
 
     SetEvent(workersDoneEvent);
@@ -2674,6 +3115,13 @@ main(
     ASSERT_FRE(CloseHandle(watchdogThread));
     watchdogThread = NULL;
 
+    if (soakThread != NULL) {
+        TraceVerbose("main: waiting for soak...");
+        WaitForSingleObject(soakThread, INFINITE);
+        ASSERT_FRE(CloseHandle(soakThread));
+        soakThread = NULL;
+    }
+
     free(queueWorkers);
 
     printf("done\n");
@@ -0,0 +1,26 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+#include <windows.h>
+#include <winternl.h>
+#include <intsafe.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <xdp/rtl.h>
+#include <xdpassert.h>
+
+#include <stubs/ntos.h>
+
+#include <xdprtl.h>
+#include <xdptimerwheel.h>
+
+#pragma warning(disable:4200) // nonstandard extension used: zero-sized array in struct/union
+
+#define XDP_POOLTAG_TIMER_WHEEL 'HcdX' // XdcH
+
+extern EX_RUNDOWN_REF XdpRtlRundown;
@@ -0,0 +1,503 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+//
+// A single-threaded simulation of the kernel services used by the timer wheel.
+// Time advances only when the test advances it, DPCs run only when the test
+// runs them, and spin locks and IRQLs have no effect.
+//
+
+#define STATUS_SUCCESS ((NTSTATUS)0x00000000L)
+
+#define NT_VERIFY(e) (e)
+
+#define FAKE_PROCESSOR_COUNT 2
+#define FAKE_MAX_QUEUED_DPCS FAKE_PROCESSOR_COUNT
+
+typedef enum {
+    NonPagedPoolNx,
+    NonPagedPoolNxCacheAligned,
+} POOL_TYPE;
+
+inline
+VOID *
+ExAllocatePoolZero(
+    _In_ POOL_TYPE PoolType,
+    _In_ SIZE_T NumberOfBytes,
+    _In_ ULONG Tag
+    )
+{
+    UNREFERENCED_PARAMETER(PoolType);
+    UNREFERENCED_PARAMETER(Tag);
+
+    return calloc(1, NumberOfBytes);
+}
+
+inline
+VOID
+ExFreePoolWithTag(
+    _In_ VOID *P,
+    _In_ ULONG Tag
+    )
+{
+    UNREFERENCED_PARAMETER(Tag);
+
+    free(P);
+}
+
+inline
+NTSTATUS
+RtlSIZETAdd(
+    _In_ SIZE_T a,
+    _In_ SIZE_T b,
+    _Out_ SIZE_T *c
+    )
+{
+    if (SUCCEEDED(SIZETAdd(a, b, c))) {
+        return STATUS_SUCCESS;
+    } else {
+        return STATUS_INTEGER_OVERFLOW;
+    }
+}
+
+inline
+NTSTATUS
+RtlSIZETMult(
+    _In_ SIZE_T a,
+    _In_ SIZE_T b,
+    _Out_ SIZE_T *c
+    )
+{
+    if (SUCCEEDED(SIZETMult(a, b, c))) {
+        return STATUS_SUCCESS;
+    } else {
+        return STATUS_INTEGER_OVERFLOW;
+    }
+}
+
+inline
+VOID
+InitializeListHead(
+    _Out_ LIST_ENTRY *ListHead
+    )
+{
+    ListHead->Flink = ListHead->Blink = ListHead;
+}
+
+inline
+BOOLEAN
+IsListEmpty(
+    _In_ const LIST_ENTRY *ListHead
+    )
+{
+    return (BOOLEAN)(ListHead->Flink == ListHead);
+}
+
+inline
+BOOLEAN
+RemoveEntryList(
+    _In_ LIST_ENTRY *Entry
+    )
+{
+    LIST_ENTRY *Flink = Entry->Flink;
+    LIST_ENTRY *Blink = Entry->Blink;
+
+    Blink->Flink = Flink;
+    Flink->Blink = Blink;
+
+    return (BOOLEAN)(Flink == Blink);
+}
+
+inline
+LIST_ENTRY *
+RemoveHeadList(
+    _Inout_ LIST_ENTRY *ListHead
+    )
+{
+    LIST_ENTRY *Entry = ListHead->Flink;
+
+    RemoveEntryList(Entry);
+
+    return Entry;
+}
+
+inline
+VOID
+InsertTailList(
+    _Inout_ LIST_ENTRY *ListHead,
+    _Out_ LIST_ENTRY *Entry
+    )
+{
+    LIST_ENTRY *Blink = ListHead->Blink;
+
+    Entry->Flink = ListHead;
+    Entry->Blink = Blink;
+    Blink->Flink = Entry;
+    ListHead->Blink = Entry;
+}
+
+inline
+VOID
+AppendTailList(
+    _Inout_ LIST_ENTRY *ListHead,
+    _Inout_ LIST_ENTRY *ListToAppend
+    )
+{
+    LIST_ENTRY *ListEnd = ListHead->Blink;
+
+    ListHead->Blink->Flink = ListToAppend;
+    ListHead->Blink = ListToAppend->Blink;
+    ListToAppend->Blink->Flink = ListHead;
+    ListToAppend->Blink = ListEnd;
+}
+
+typedef struct _EX_RUNDOWN_REF {
+    ULONG_PTR Count;
+} EX_RUNDOWN_REF;
+
+inline
+BOOLEAN
+ExAcquireRundownProtection(
+    _Inout_ EX_RUNDOWN_REF *RunRef
+    )
+{
+    RunRef->Count++;
+    return TRUE;
+}
+
+inline
+VOID
+ExReleaseRundownProtection(
+    _Inout_ EX_RUNDOWN_REF *RunRef
+    )
+{
+    RunRef->Count--;
+}
+
+typedef ULONG_PTR KSPIN_LOCK;
+typedef UCHAR KIRQL;
+
+#define PASSIVE_LEVEL 0
+#define DISPATCH_LEVEL 2
+
+extern ULONG FakeCurrentProcessor;
+extern KIRQL FakeCurrentIrql;
+extern UINT64 FakeInterruptTime;
+
+inline
+VOID
+KeInitializeSpinLock(
+    _Out_ KSPIN_LOCK *SpinLock
+    )
+{
+    *SpinLock = 0;
+}
+
+inline
+VOID
+KeAcquireSpinLockAtDpcLevel(
+    _Inout_ KSPIN_LOCK *SpinLock
+    )
+{
+    FRE_ASSERT(*SpinLock == 0);
+    *SpinLock = 1;
+}
+
+inline
+VOID
+KeReleaseSpinLockFromDpcLevel(
+    _Inout_ KSPIN_LOCK *SpinLock
+    )
+{
+    FRE_ASSERT(*SpinLock == 1);
+    *SpinLock = 0;
+}
+
+inline
+KIRQL
+KeRaiseIrqlToDpcLevel(
+    VOID
+    )
+{
+    KIRQL OldIrql = FakeCurrentIrql;
+
+    FakeCurrentIrql = DISPATCH_LEVEL;
+    return OldIrql;
+}
+
+inline
+VOID
+KeLowerIrql(
+    _In_ KIRQL NewIrql
+    )
+{
+    FakeCurrentIrql = NewIrql;
+}
+
+inline
+VOID
+KeAcquireSpinLock(
+    _Inout_ KSPIN_LOCK *SpinLock,
+    _Out_ KIRQL *OldIrql
+    )
+{
+    *OldIrql = KeRaiseIrqlToDpcLevel();
+    KeAcquireSpinLockAtDpcLevel(SpinLock);
+}
+
+inline
+VOID
+KeReleaseSpinLock(
+    _Inout_ KSPIN_LOCK *SpinLock,
+    _In_ KIRQL NewIrql
+    )
+{
+    KeReleaseSpinLockFromDpcLevel(SpinLock);
+    KeLowerIrql(NewIrql);
+}
+
+#define KeMemoryBarrier MemoryBarrier
+
+inline
+ULONGLONG
+KeQueryUnbiasedInterruptTime(
+    VOID
+    )
+{
+    return FakeInterruptTime;
+}
+
+inline
+ULONG
+KeQueryMaximumProcessorCountEx(
+    _In_ USHORT GroupNumber
+    )
+{
+    UNREFERENCED_PARAMETER(GroupNumber);
+
+    return FAKE_PROCESSOR_COUNT;
+}
+
+inline
+ULONG
+KeGetCurrentProcessorIndex(
+    VOID
+    )
+{
+    return FakeCurrentProcessor;
+}
+
+inline
+NTSTATUS
+KeGetProcessorNumberFromIndex(
+    _In_ ULONG ProcIndex,
+    _Out_ PROCESSOR_NUMBER *ProcNumber
+    )
+{
+    ProcNumber->Group = 0;
+    ProcNumber->Number = (UCHAR)ProcIndex;
+    ProcNumber->Reserved = 0;
+
+    return STATUS_SUCCESS;
+}
+
+typedef struct _KDPC KDPC;
+
+typedef
+VOID
+KDEFERRED_ROUTINE(
+    _In_ KDPC *Dpc,
+    _In_opt_ VOID *DeferredContext,
+    _In_opt_ VOID *SystemArgument1,
+    _In_opt_ VOID *SystemArgument2
+    );
+
+typedef struct _KDPC {
+    KDEFERRED_ROUTINE *DeferredRoutine;
+    VOID *DeferredContext;
+    ULONG Processor;
+    BOOLEAN Queued;
+} KDPC;
+
+extern KDPC *FakeQueuedDpcs[FAKE_MAX_QUEUED_DPCS];
+extern UINT32 FakeQueuedDpcCount;
+
+inline
+VOID
+KeInitializeDpc(
+    _Out_ KDPC *Dpc,
+    _In_ KDEFERRED_ROUTINE *DeferredRoutine,
+    _In_opt_ VOID *DeferredContext
+    )
+{
+    RtlZeroMemory(Dpc, sizeof(*Dpc));
+    Dpc->DeferredRoutine = DeferredRoutine;
+    Dpc->DeferredContext = DeferredContext;
+}
+
+inline
+NTSTATUS
+KeSetTargetProcessorDpcEx(
+    _Inout_ KDPC *Dpc,
+    _In_ PROCESSOR_NUMBER *ProcNumber
+    )
+{
+    Dpc->Processor = ProcNumber->Number;
+
+    return STATUS_SUCCESS;
+}
+
+inline
+BOOLEAN
+KeInsertQueueDpc(
+    _Inout_ KDPC *Dpc,
+    _In_opt_ VOID *SystemArgument1,
+    _In_opt_ VOID *SystemArgument2
+    )
+{
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    if (Dpc->Queued) {
+        return FALSE;
+    }
+
+    FRE_ASSERT(FakeQueuedDpcCount < FAKE_MAX_QUEUED_DPCS);
+    Dpc->Queued = TRUE;
+    FakeQueuedDpcs[FakeQueuedDpcCount++] = Dpc;
+
+    return TRUE;
+}
+
+//
+// Runs every queued DPC on its target processor, in the order queued.
+//
+inline
+VOID
+KeFlushQueuedDpcs(
+    VOID
+    )
+{
+    ULONG Processor = FakeCurrentProcessor;
+    KIRQL Irql = FakeCurrentIrql;
+
+    while (FakeQueuedDpcCount > 0) {
+        KDPC *Dpc = FakeQueuedDpcs[0];
+
+        FakeQueuedDpcCount--;
+        RtlMoveMemory(
+            &FakeQueuedDpcs[0], &FakeQueuedDpcs[1], FakeQueuedDpcCount * sizeof(Dpc));
+
+        Dpc->Queued = FALSE;
+        FakeCurrentProcessor = Dpc->Processor;
+        FakeCurrentIrql = DISPATCH_LEVEL;
+        Dpc->DeferredRoutine(Dpc, Dpc->DeferredContext, NULL, NULL);
+    }
+
+    FakeCurrentProcessor = Processor;
+    FakeCurrentIrql = Irql;
+}
+
+struct _EX_TIMER;
+typedef struct _EX_TIMER *PEX_TIMER;
+
+typedef
+VOID
+EXT_CALLBACK(
+    _In_ PEX_TIMER Timer,
+    _In_opt_ VOID *Context
+    );
+
+struct _EX_TIMER {
+    EXT_CALLBACK *Callback;
+    VOID *Context;
+    LONGLONG Period;
+    BOOLEAN Armed;
+};
+
+extern PEX_TIMER FakeTimer;
+
+inline
+PEX_TIMER
+ExAllocateTimer(
+    _In_ EXT_CALLBACK *Callback,
+    _In_opt_ VOID *CallbackContext,
+    _In_ ULONG Attributes
+    )
+{
+    PEX_TIMER Timer;
+
+    UNREFERENCED_PARAMETER(Attributes);
+    FRE_ASSERT(FakeTimer == NULL);
+
+    Timer = calloc(1, sizeof(*Timer));
+    if (Timer != NULL) {
+        Timer->Callback = Callback;
+        Timer->Context = CallbackContext;
+        FakeTimer = Timer;
+    }
+
+    return Timer;
+}
+
+inline
+BOOLEAN
+ExSetTimer(
+    _In_ PEX_TIMER Timer,
+    _In_ LONGLONG DueTime,
+    _In_ LONGLONG Period,
+    _In_opt_ VOID *Parameters
+    )
+{
+    BOOLEAN WasArmed = Timer->Armed;
+
+    UNREFERENCED_PARAMETER(DueTime);
+    UNREFERENCED_PARAMETER(Parameters);
+
+    Timer->Period = Period;
+    Timer->Armed = TRUE;
+
+    return WasArmed;
+}
+
+inline
+BOOLEAN
+ExCancelTimer(
+    _In_ PEX_TIMER Timer,
+    _In_opt_ VOID *Parameters
+    )
+{
+    BOOLEAN WasArmed = Timer->Armed;
+
+    UNREFERENCED_PARAMETER(Parameters);
+
+    Timer->Armed = FALSE;
+
+    return WasArmed;
+}
+
+inline
+BOOLEAN
+ExDeleteTimer(
+    _In_ PEX_TIMER Timer,
+    _In_ BOOLEAN Cancel,
+    _In_ BOOLEAN Wait,
+    _In_opt_ VOID *Parameters
+    )
+{
+    BOOLEAN WasArmed = Timer->Armed;
+
+    UNREFERENCED_PARAMETER(Cancel);
+    UNREFERENCED_PARAMETER(Wait);
+    UNREFERENCED_PARAMETER(Parameters);
+
+    FRE_ASSERT(FakeTimer == Timer);
+    FakeTimer = NULL;
+    free(Timer);
+
+    return WasArmed;
+}
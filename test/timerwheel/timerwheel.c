@@ -0,0 +1,382 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+//
+// Unit tests for the timer wheel, run against a simulated kernel in which time
+// advances only when a test advances it.
+//
+
+#include "precomp.h"
+
+ULONG FakeCurrentProcessor;
+KIRQL FakeCurrentIrql;
+UINT64 FakeInterruptTime;
+KDPC *FakeQueuedDpcs[FAKE_MAX_QUEUED_DPCS];
+UINT32 FakeQueuedDpcCount;
+PEX_TIMER FakeTimer;
+EX_RUNDOWN_REF XdpRtlRundown;
+
+#define TICK_MS 1
+
+//
+// The number of ticks covered by each level of the wheel, and by the wheel.
+//
+#define LEVEL_SPAN(Level) (1ui64 << (6 * ((Level) + 1)))
+#define LEVELS 4
+#define WHEEL_SPAN LEVEL_SPAN(LEVELS - 1)
+
+#define TEST_TRUE(e) \
+    if (!(e)) { \
+        fprintf(stderr, "%s:%u: %s failed\n", __FILE__, __LINE__, #e); \
+        exit(EXIT_FAILURE); \
+    }
+
+#define TEST_FALSE(e) TEST_TRUE(!(e))
+#define TEST_EQUAL(Expected, Actual) TEST_TRUE((Expected) == (Actual))
+
+typedef struct _TEST_ENTRY {
+    XDP_TIMER_WHEEL_ENTRY WheelEntry;
+    XDP_TIMER_WHEEL *Wheel;
+    UINT64 DueTick;
+    UINT32 ExpireCount;
+    ULONG ExpireProcessor;
+    UINT32 RestartMs;
+} TEST_ENTRY;
+
+static XDP_TIMER_WHEEL *Wheel;
+static UINT64 StartTime;
+static UINT64 CurrentTick;
+
+static XDP_TIMER_WHEEL_ROUTINE TestEntryExpire;
+
+_Use_decl_annotations_
+VOID
+TestEntryExpire(
+    XDP_TIMER_WHEEL_ENTRY *WheelEntry
+    )
+{
+    TEST_ENTRY *Entry = CONTAINING_RECORD(WheelEntry, TEST_ENTRY, WheelEntry);
+
+    TEST_EQUAL(DISPATCH_LEVEL, FakeCurrentIrql);
+
+    Entry->ExpireCount++;
+    Entry->ExpireProcessor = FakeCurrentProcessor;
+
+    if (Entry->RestartMs > 0) {
+        TEST_FALSE(XdpTimerWheelStart(Entry->Wheel, &Entry->WheelEntry, Entry->RestartMs));
+    }
+}
+
+static
+VOID
+TestInitializeEntry(
+    _Out_ TEST_ENTRY *Entry
+    )
+{
+    RtlZeroMemory(Entry, sizeof(*Entry));
+    XdpTimerWheelInitializeEntry(&Entry->WheelEntry, TestEntryExpire);
+    Entry->Wheel = Wheel;
+}
+
+static
+VOID
+TestStartEntry(
+    _Inout_ TEST_ENTRY *Entry,
+    _In_ UINT64 DueTicks
+    )
+{
+    Entry->DueTick = CurrentTick + DueTicks;
+    TEST_FALSE(XdpTimerWheelStart(Wheel, &Entry->WheelEntry, (UINT32)(DueTicks * TICK_MS)));
+}
+
+//
+// Advances time to a tick and fires the periodic tick, if it is armed. Ticks in
+// between are not fired individually; the wheel catches up on all of them.
+//
+static
+VOID
+TestAdvanceToTick(
+    _In_ UINT64 Tick
+    )
+{
+    TEST_TRUE(Tick >= CurrentTick);
+    CurrentTick = Tick;
+    FakeInterruptTime = StartTime + CurrentTick * RTL_MILLISEC_TO_100NANOSEC(TICK_MS);
+
+    if (FakeTimer->Armed) {
+        FakeCurrentIrql = DISPATCH_LEVEL;
+        FakeTimer->Callback(FakeTimer, FakeTimer->Context);
+        FakeCurrentIrql = PASSIVE_LEVEL;
+        KeFlushQueuedDpcs();
+    }
+}
+
+//
+// Verifies an entry expires on exactly its due tick.
+//
+static
+VOID
+TestExpireOnDueTick(
+    _In_ TEST_ENTRY *Entries,
+    _In_ UINT32 EntryCount,
+    _In_ UINT64 DueTick
+    )
+{
+    TestAdvanceToTick(DueTick - 1);
+
+    for (UINT32 Index = 0; Index < EntryCount; Index++) {
+        TEST_EQUAL((Entries[Index].DueTick <= DueTick - 1) ? 1 : 0, Entries[Index].ExpireCount);
+    }
+
+    TestAdvanceToTick(DueTick);
+
+    for (UINT32 Index = 0; Index < EntryCount; Index++) {
+        TEST_EQUAL((Entries[Index].DueTick <= DueTick) ? 1 : 0, Entries[Index].ExpireCount);
+    }
+}
+
+static
+VOID
+TestInsertExpire(
+    VOID
+    )
+{
+    TEST_ENTRY Entry;
+
+    TestInitializeEntry(&Entry);
+    TestStartEntry(&Entry, 5);
+    TEST_TRUE(FakeTimer->Armed);
+
+    TestExpireOnDueTick(&Entry, 1, Entry.DueTick);
+    TEST_FALSE(XdpTimerWheelCancel(Wheel, &Entry.WheelEntry));
+
+    //
+    // The tick stops once every wheel is empty.
+    //
+    TestAdvanceToTick(CurrentTick + 100);
+    TEST_EQUAL(1, Entry.ExpireCount);
+    TEST_FALSE(FakeTimer->Armed);
+
+    //
+    // A zero due time is rounded up to the next tick.
+    //
+    TestInitializeEntry(&Entry);
+    TestStartEntry(&Entry, 0);
+    Entry.DueTick = CurrentTick + 1;
+    TEST_TRUE(FakeTimer->Armed);
+    TestExpireOnDueTick(&Entry, 1, Entry.DueTick);
+}
+
+static
+VOID
+TestCancel(
+    VOID
+    )
+{
+    TEST_ENTRY Entry;
+
+    TestInitializeEntry(&Entry);
+    TestStartEntry(&Entry, 10);
+    TEST_TRUE(XdpTimerWheelCancel(Wheel, &Entry.WheelEntry));
+    TEST_FALSE(XdpTimerWheelCancel(Wheel, &Entry.WheelEntry));
+
+    TestAdvanceToTick(CurrentTick + 20);
+    TEST_EQUAL(0, Entry.ExpireCount);
+
+    //
+    // Restarting a started entry cancels it and starts it from the present.
+    //
+    TestStartEntry(&Entry, 10);
+    TestAdvanceToTick(CurrentTick + 5);
+    Entry.DueTick = CurrentTick + 10;
+    TEST_TRUE(XdpTimerWheelStart(Wheel, &Entry.WheelEntry, 10 * TICK_MS));
+
+    TestExpireOnDueTick(&Entry, 1, Entry.DueTick);
+
+    //
+    // Cancel entries that have cascaded out of the upper levels.
+    //
+    for (UINT32 Level = 1; Level < LEVELS; Level++) {
+        TestInitializeEntry(&Entry);
+        TestStartEntry(&Entry, LEVEL_SPAN(Level) - 1);
+        TestAdvanceToTick(Entry.DueTick - 1);
+        TEST_TRUE(XdpTimerWheelCancel(Wheel, &Entry.WheelEntry));
+        TestAdvanceToTick(Entry.DueTick + 1);
+        TEST_EQUAL(0, Entry.ExpireCount);
+    }
+}
+
+static
+VOID
+TestLevelBoundaries(
+    VOID
+    )
+{
+    //
+    // Start entries due on the first and last tick of each level, from both a
+    // tick aligned to every level and from unaligned ticks.
+    //
+    const UINT64 StartOffsets[] = { 0, 1, 37, LEVEL_SPAN(0) - 1, LEVEL_SPAN(1) + 5 };
+
+    for (UINT32 Level = 0; Level < LEVELS; Level++) {
+        const UINT64 DueTicks[] = {
+            (Level == 0) ? 1 : LEVEL_SPAN(Level - 1),
+            LEVEL_SPAN(Level) - 1,
+        };
+
+        for (UINT32 Offset = 0; Offset < RTL_NUMBER_OF(StartOffsets); Offset++) {
+            for (UINT32 Due = 0; Due < RTL_NUMBER_OF(DueTicks); Due++) {
+                TEST_ENTRY Entry;
+
+                TestAdvanceToTick(
+                    RTL_NUM_ALIGN_UP(CurrentTick + 1, WHEEL_SPAN) + StartOffsets[Offset]);
+                TestInitializeEntry(&Entry);
+                TestStartEntry(&Entry, DueTicks[Due]);
+                TestExpireOnDueTick(&Entry, 1, Entry.DueTick);
+            }
+        }
+    }
+}
+
+static
+VOID
+TestCascade(
+    VOID
+    )
+{
+    //
+    // Start entries due in every level at once, so entries cascade into slots
+    // already holding other entries, and verify each expires on its due tick.
+    // Due times are in increasing order.
+    //
+    const UINT64 DueTicks[] = {
+        1, 2, 63, 64, 65, 127, 128, 4095, 4096, 4097, 4096 + 64, 262143, 262144, 262145,
+        262144 + 4096 + 64 + 1, WHEEL_SPAN - 1,
+    };
+    TEST_ENTRY Entries[RTL_NUMBER_OF(DueTicks)];
+
+    TestAdvanceToTick(RTL_NUM_ALIGN_UP(CurrentTick + 1, WHEEL_SPAN) + 4321);
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Entries); Index++) {
+        TestInitializeEntry(&Entries[Index]);
+        TestStartEntry(&Entries[Index], DueTicks[Index]);
+    }
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Entries); Index++) {
+        TestExpireOnDueTick(Entries, RTL_NUMBER_OF(Entries), Entries[Index].DueTick);
+    }
+}
+
+static
+VOID
+TestBeyondSpan(
+    VOID
+    )
+{
+    //
+    // Entries due beyond the span of the wheel are parked in the last level and
+    // re-placed as they cascade.
+    //
+    TEST_ENTRY Entries[3];
+
+    TestAdvanceToTick(CurrentTick + 77);
+
+    TestInitializeEntry(&Entries[0]);
+    TestStartEntry(&Entries[0], WHEEL_SPAN);
+    TestInitializeEntry(&Entries[1]);
+    TestStartEntry(&Entries[1], WHEEL_SPAN + 100);
+    TestInitializeEntry(&Entries[2]);
+    TestStartEntry(&Entries[2], 2 * WHEEL_SPAN + 5);
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Entries); Index++) {
+        TestExpireOnDueTick(Entries, RTL_NUMBER_OF(Entries), Entries[Index].DueTick);
+    }
+}
+
+static
+VOID
+TestRestartFromRoutine(
+    VOID
+    )
+{
+    TEST_ENTRY Entry;
+
+    TestInitializeEntry(&Entry);
+    Entry.RestartMs = 10 * TICK_MS;
+    TestStartEntry(&Entry, 10);
+
+    for (UINT32 Count = 1; Count <= 3; Count++) {
+        TestAdvanceToTick(Entry.DueTick - 1);
+        TEST_EQUAL(Count - 1, Entry.ExpireCount);
+        TestAdvanceToTick(Entry.DueTick);
+        TEST_EQUAL(Count, Entry.ExpireCount);
+        Entry.DueTick += 10;
+    }
+
+    TEST_TRUE(XdpTimerWheelCancel(Wheel, &Entry.WheelEntry));
+    TestAdvanceToTick(Entry.DueTick);
+    TEST_EQUAL(3, Entry.ExpireCount);
+}
+
+static
+VOID
+TestProcessors(
+    VOID
+    )
+{
+    //
+    // Entries expire on the processor they were started on.
+    //
+    TEST_ENTRY Entries[FAKE_PROCESSOR_COUNT];
+
+    for (ULONG Processor = 0; Processor < FAKE_PROCESSOR_COUNT; Processor++) {
+        FakeCurrentProcessor = Processor;
+        TestInitializeEntry(&Entries[Processor]);
+        TestStartEntry(&Entries[Processor], 3 + Processor);
+    }
+
+    FakeCurrentProcessor = 0;
+
+    for (ULONG Processor = 0; Processor < FAKE_PROCESSOR_COUNT; Processor++) {
+        TestExpireOnDueTick(Entries, RTL_NUMBER_OF(Entries), Entries[Processor].DueTick);
+        TEST_EQUAL(Processor, Entries[Processor].ExpireProcessor);
+    }
+}
+
+INT
+__cdecl
+main(
+    INT Argc,
+    CHAR **Argv
+    )
+{
+    UNREFERENCED_PARAMETER(Argc);
+    UNREFERENCED_PARAMETER(Argv);
+
+    //
+    // Start the wheel between ticks of the system clock.
+    //
+    FakeInterruptTime = RTL_SEC_TO_100NANOSEC(1000) + 1234;
+    StartTime = FakeInterruptTime;
+
+    Wheel = XdpTimerWheelCreate(TICK_MS);
+    TEST_TRUE(Wheel != NULL);
+    TEST_FALSE(FakeTimer->Armed);
+
+    TestInsertExpire();
+    TestCancel();
+    TestLevelBoundaries();
+    TestCascade();
+    TestBeyondSpan();
+    TestRestartFromRoutine();
+    TestProcessors();
+
+    XdpTimerWheelDelete(Wheel);
+    TEST_EQUAL(0, XdpRtlRundown.Count);
+
+    printf("Passed\n");
+
+    return EXIT_SUCCESS;
+}
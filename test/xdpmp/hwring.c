@@ -56,5 +56,131 @@ HwRingFreeRing(
     _In_ HW_RING *Ring
     )
 {
+    if (Ring->PostQpc != NULL) {
+        ExFreePoolWithTag(Ring->PostQpc, POOLTAG_HWRING);
+    }
+
     ExFreePoolWithTag(Ring, POOLTAG_HWRING);
 }
+
+NTSTATUS
+HwRingSetCompletionModel(
+    _Inout_ HW_RING *Ring,
+    _In_ UINT32 LatencyUs,
+    _In_ UINT32 CompletionBatch,
+    _In_ UINT32 CoalesceUs
+    )
+{
+    LARGE_INTEGER FrequencyQpc;
+
+    //
+    // The model must be set before any elements are posted.
+    //
+    ASSERT(Ring->ProducerIndex == 0);
+
+    if (LatencyUs == 0 && CompletionBatch <= 1) {
+        return STATUS_SUCCESS;
+    }
+
+    Ring->PostQpc =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, (SIZE_T)(Ring->Mask + 1) * sizeof(*Ring->PostQpc), POOLTAG_HWRING);
+    if (Ring->PostQpc == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    KeQueryPerformanceCounter(&FrequencyQpc);
+
+    Ring->LatencyQpc = ((INT64)LatencyUs * FrequencyQpc.QuadPart) / 1000 / 1000;
+    Ring->CoalesceQpc = ((INT64)CoalesceUs * FrequencyQpc.QuadPart) / 1000 / 1000;
+    Ring->CompletionBatch = max(CompletionBatch, 1);
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+HwRingRecordPost(
+    _In_ HW_RING *Ring,
+    _In_ UINT32 Head,
+    _In_ UINT32 Count
+    )
+{
+    INT64 PostQpc = KeQueryPerformanceCounter(NULL).QuadPart;
+
+    for (UINT32 Index = 0; Index < Count; Index++) {
+        Ring->PostQpc[(Head + Index) & Ring->Mask] = PostQpc;
+    }
+}
+
+UINT32
+HwRingHwCompleteModeled(
+    _In_ HW_RING *Ring,
+    _In_ UINT32 Count,
+    _In_ INT64 CurrentQpc
+    )
+{
+    UINT32 ProducerIndex = ReadUInt32Acquire(&Ring->ProducerIndex);
+    UINT32 Index = Ring->HardwareCompletionIndex;
+    UINT32 Ready = 0;
+    UINT32 Partial;
+
+    Count = min(Count, ProducerIndex - Index);
+
+    //
+    // Find the elements whose completion latency has elapsed.
+    //
+    while (Ready < Count &&
+            Ring->PostQpc[(Index + Ready) & Ring->Mask] + Ring->LatencyQpc <= CurrentQpc) {
+        Ready++;
+    }
+
+    //
+    // Write back whole batches only, unless the first element of the partial
+    // batch has been ready for the duration of the coalescing timer.
+    //
+    Partial = Ready % Ring->CompletionBatch;
+    if (Partial > 0 &&
+        CurrentQpc <
+            Ring->PostQpc[(Index + Ready - Partial) & Ring->Mask] +
+                Ring->LatencyQpc + Ring->CoalesceQpc) {
+        Ready -= Partial;
+    }
+
+    Ring->HardwareCompletionIndex += Ready;
+
+    return Ready;
+}
+
+INT64
+HwRingGetNextCompletionQpc(
+    _In_ HW_RING *Ring
+    )
+{
+    UINT32 Index = Ring->HardwareCompletionIndex;
+    UINT32 Pending;
+    INT64 NextQpc;
+
+    if (Ring->PostQpc == NULL) {
+        return MAXLONGLONG;
+    }
+
+    Pending = ReadUInt32Acquire(&Ring->ProducerIndex) - Index;
+    if (Pending == 0) {
+        return MAXLONGLONG;
+    }
+
+    //
+    // The next completion occurs when either the coalescing timer expires for
+    // the oldest pending element or a whole batch becomes ready.
+    //
+    NextQpc = Ring->PostQpc[Index & Ring->Mask] + Ring->LatencyQpc + Ring->CoalesceQpc;
+
+    if (Pending >= Ring->CompletionBatch) {
+        NextQpc =
+            min(NextQpc,
+                Ring->PostQpc[(Index + Ring->CompletionBatch - 1) & Ring->Mask] +
+                    Ring->LatencyQpc);
+    }
+
+    return NextQpc;
+}
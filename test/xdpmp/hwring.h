@@ -18,6 +18,11 @@
 // P = ProducerIndex
 // R = ProducerReserved (MP enqueue)
 //
+// The hardware optionally models NIC completion behavior: each element
+// completes no earlier than a fixed latency after it was posted, and
+// completions are written back in batches, with partial batches held until
+// the interrupt coalescing timer expires.
+//
 typedef struct _HW_RING {
     UINT32 ProducerIndex;
     UINT32 ProducerReserved;
@@ -25,9 +30,31 @@ typedef struct _HW_RING {
     UINT32 HardwareCompletionIndex;
     UINT32 Mask;
     UINT32 ElementStride;
+
+    //
+    // The completion model, enabled if PostQpc is non-NULL.
+    //
+    INT64 *PostQpc;
+    INT64 LatencyQpc;
+    INT64 CoalesceQpc;
+    UINT32 CompletionBatch;
     /* Followed by power-of-two array of ring elements */
 } HW_RING;
 
+UINT32
+HwRingHwCompleteModeled(
+    _In_ HW_RING *Ring,
+    _In_ UINT32 Count,
+    _In_ INT64 CurrentQpc
+    );
+
+VOID
+HwRingRecordPost(
+    _In_ HW_RING *Ring,
+    _In_ UINT32 Head,
+    _In_ UINT32 Count
+    );
+
 //
 // Returns a pointer to the ring element at the specified index. The index
 // must be within [0, Ring->Mask].
@@ -97,17 +124,27 @@ HwRingConsPeek(
 }
 
 //
-// The hardware "completes" up to the specified number of elements.
+// The hardware "completes" up to the specified number of elements. If the
+// completion model is enabled, only elements the model permits to complete by
+// the current time are completed.
 //
 inline
 UINT32
 HwRingHwComplete(
     _In_ HW_RING *Ring,
-    _In_ UINT32 Count
+    _In_ UINT32 Count,
+    _In_ INT64 CurrentQpc
     )
 {
-    UINT32 ProducerIndex = (UINT32)ReadNoFence((LONG*)&Ring->ProducerIndex);
-    UINT32 HardwareAvailable = ProducerIndex - Ring->HardwareCompletionIndex;
+    UINT32 ProducerIndex;
+    UINT32 HardwareAvailable;
+
+    if (Ring->PostQpc != NULL) {
+        return HwRingHwCompleteModeled(Ring, Count, CurrentQpc);
+    }
+
+    ProducerIndex = (UINT32)ReadNoFence((LONG*)&Ring->ProducerIndex);
+    HardwareAvailable = ProducerIndex - Ring->HardwareCompletionIndex;
 
     Count = min(Count, HardwareAvailable);
     Ring->HardwareCompletionIndex += Count;
@@ -174,6 +211,10 @@ HwRingMpCommit(
     _In_ _IRQL_restores_ KIRQL OldIrql
     )
 {
+    if (Ring->PostQpc != NULL) {
+        HwRingRecordPost(Ring, Head, Count);
+    }
+
     while ((UINT32)ReadNoFence((LONG*)&Ring->ProducerIndex) != Head);
     WriteUInt32Release(&Ring->ProducerIndex, Head + Count);
     KeLowerIrql(OldIrql);
@@ -191,3 +232,16 @@ VOID
 HwRingFreeRing(
     _In_ HW_RING *Ring
     );
+
+NTSTATUS
+HwRingSetCompletionModel(
+    _Inout_ HW_RING *Ring,
+    _In_ UINT32 LatencyUs,
+    _In_ UINT32 CompletionBatch,
+    _In_ UINT32 CoalesceUs
+    );
+
+INT64
+HwRingGetNextCompletionQpc(
+    _In_ HW_RING *Ring
+    );
@@ -17,6 +17,15 @@ NDIS_STRING RegRxBufferLength = NDIS_STRING_CONST("RxBufferLength");
 NDIS_STRING RegRxDataLength = NDIS_STRING_CONST("RxDataLength");
 NDIS_STRING RegRxPattern = NDIS_STRING_CONST("RxPattern");
 NDIS_STRING RegRxPatternCopy = NDIS_STRING_CONST("RxPatternCopy");
+NDIS_STRING RegRxFlowCount = NDIS_STRING_CONST("RxFlowCount");
+NDIS_STRING RegRxFlowVary = NDIS_STRING_CONST("RxFlowVary");
+NDIS_STRING RegRxSizeMix = NDIS_STRING_CONST("RxSizeMix");
+NDIS_STRING RegRxReplayFile = NDIS_STRING_CONST("RxReplayFile");
+NDIS_STRING RegRxMaxFragments = NDIS_STRING_CONST("RxMaxFragments");
+NDIS_STRING RegRxInspectBatch = NDIS_STRING_CONST("RxInspectBatch");
+NDIS_STRING RegHwCompletionLatencyUs = NDIS_STRING_CONST("HwCompletionLatencyUs");
+NDIS_STRING RegHwCompletionBatch = NDIS_STRING_CONST("HwCompletionBatch");
+NDIS_STRING RegHwInterruptCoalesceUs = NDIS_STRING_CONST("HwInterruptCoalesceUs");
 NDIS_STRING RegPollProvider = NDIS_STRING_CONST("PollProvider");
 
 PCSTR MpDriverFriendlyName = "XDPMP";
@@ -46,6 +55,13 @@ UCHAR MpMacAddressBase[MAC_ADDR_LEN] = {0x22, 0x22, 0x22, 0x22, 0x00, 0x00};
 #define DEFAULT_RX_BUFFER_DATA_LENGTH 64
 #define MAX_RX_DATA_LENGTH 65536
 
+#define DEFAULT_RX_FLOW_VARY (RxFlowVarySourcePort | RxFlowVarySourceAddress)
+
+#define MAX_HW_COMPLETION_LATENCY_US 1000000
+#define MIN_HW_COMPLETION_BATCH 1
+#define MAX_HW_COMPLETION_BATCH 8192
+#define MAX_HW_INTERRUPT_COALESCE_US 1000000
+
 //
 // The driver only supports the driver API version in the DDK or higher.
 // Drivers can set lower values for backwards compatibility.
@@ -61,6 +77,7 @@ CONST XDP_VERSION XdpDriverApiVersion = {
 // Define custom OIDs in the vendor-private range [0xFF00000, 0xFFFFFFFF].
 //
 #define OID_XDPMP_RATE_SIM 0xFF00000
+#define OID_XDPMP_RX_FRAME 0xFF00001
 
 GLOBAL_CONTEXT MpGlobalContext = {0};
 
@@ -107,6 +124,7 @@ NDIS_OID MpSupportedOidArray[] =
     OID_GEN_RECEIVE_SCALE_PARAMETERS,
 
     OID_XDPMP_RATE_SIM,
+    OID_XDPMP_RX_FRAME,
 
     OID_XDP_QUERY_CAPABILITIES,
 };
@@ -118,6 +136,12 @@ static const NDIS_GUID MpCustomGuidArray[] = {
         sizeof(XDPMP_RATE_SIM_WMI),
         fNDIS_GUID_TO_OID,
     },
+    {
+        XdpMpRxFrameGuid,
+        OID_XDPMP_RX_FRAME,
+        sizeof(XDPMP_RX_FRAME_WMI),
+        fNDIS_GUID_TO_OID,
+    },
 };
 
 MINIPORT_SUPPORTED_XDP_EXTENSIONS MpSupportedXdpExtensions = {0};
@@ -278,6 +302,11 @@ MpInitialize(
         goto Exit;
     }
 
+    //
+    // Outgoing NBs are inspected by the poll before they are posted.
+    //
+    Adapter->Capabilities.CapabilitiesEx.TxInspectSupported = TRUE;
+
     RegistrationAttributes = &AdapterAttributes.RegistrationAttributes;
 
     RegistrationAttributes->Header.Type =
@@ -391,13 +420,6 @@ MpInitialize(
 
     Adapter->MdlSize = (UINT32)MmSizeOfMdl((VOID *)(PAGE_SIZE - 1), Adapter->RxBufferLength);
     Adapter->MdlSize = ALIGN_UP(Adapter->MdlSize, MEMORY_ALLOCATION_ALIGNMENT);
-    if (Adapter->MdlSize > MAXUSHORT) {
-        TraceError(
-            TRACE_CONTROL, "NdisMiniportHandle=%p Error: MdlSize too large MdlSize=%lu",
-            NdisMiniportHandle, Adapter->MdlSize);
-        Status = STATUS_INVALID_BUFFER_SIZE;
-        goto Exit;
-    }
 
     NET_BUFFER_LIST_POOL_PARAMETERS NetBufferListPoolParameters = { 0 };
     NetBufferListPoolParameters.Header.Type = NDIS_OBJECT_TYPE_DEFAULT;
@@ -407,7 +429,6 @@ MpInitialize(
         sizeof(NetBufferListPoolParameters);
     NetBufferListPoolParameters.fAllocateNetBuffer = TRUE;
     NetBufferListPoolParameters.PoolTag = POOLTAG_NBL;
-    NetBufferListPoolParameters.ContextSize = (UINT16)Adapter->MdlSize;
 
     Adapter->RxNblPool =
         NdisAllocateNetBufferListPool(
@@ -653,12 +674,30 @@ DriverEntry(
         XDP_BUFFER_EXTENSION_VIRTUAL_ADDRESS_VERSION_1,
         XDP_EXTENSION_TYPE_BUFFER);
 
+    XdpInitializeExtensionInfo(
+        &MpSupportedXdpExtensions.Mdl,
+        XDP_BUFFER_EXTENSION_MDL_NAME,
+        XDP_BUFFER_EXTENSION_MDL_VERSION_1,
+        XDP_EXTENSION_TYPE_BUFFER);
+
     XdpInitializeExtensionInfo(
         &MpSupportedXdpExtensions.RxAction,
         XDP_FRAME_EXTENSION_RX_ACTION_NAME,
         XDP_FRAME_EXTENSION_RX_ACTION_VERSION_1,
         XDP_EXTENSION_TYPE_FRAME);
 
+    XdpInitializeExtensionInfo(
+        &MpSupportedXdpExtensions.RxMetadata,
+        XDP_FRAME_EXTENSION_RX_METADATA_NAME,
+        XDP_FRAME_EXTENSION_RX_METADATA_VERSION_1,
+        XDP_EXTENSION_TYPE_FRAME);
+
+    XdpInitializeExtensionInfo(
+        &MpSupportedXdpExtensions.Fragment,
+        XDP_FRAME_EXTENSION_FRAGMENT_NAME,
+        XDP_FRAME_EXTENSION_FRAGMENT_VERSION_1,
+        XDP_EXTENSION_TYPE_FRAME);
+
     MpGlobalContext.NdisVersion = NdisGetVersion();
     MpGlobalContext.Medium = NdisMedium802_3;
     MpGlobalContext.LinkSpeed = MAXULONG;
@@ -820,6 +859,7 @@ MpReturnAdapter(
     }
 
     MpDepopulateRssQueues(Adapter);
+    MpReplayCleanup(Adapter);
 
     if (Adapter->RxNblPool != NULL) {
         NdisFreeNetBufferListPool(Adapter->RxNblPool);
@@ -924,6 +964,177 @@ MpSetRxPattern(
     return NDIS_STATUS_SUCCESS;
 }
 
+NDIS_STATUS
+MpSetRxSizeMix(
+    _Inout_ ADAPTER_CONTEXT *Adapter,
+    _In_ const WCHAR *SizeMix,
+    _In_ UINT32 Length
+    )
+{
+    RX_SIZE_MIX_ENTRY *Entry = NULL;
+    UINT32 *Value = NULL;
+
+    //
+    // Parse a comma-separated list of <length>:<weight> pairs.
+    //
+
+    ASSERT(Length % sizeof(*SizeMix) == 0);
+    Length /= sizeof(*SizeMix);
+
+    Adapter->RxSizeMixCount = 0;
+
+    for (UINT32 Index = 0; Index <= Length; Index++) {
+        WCHAR Char = (Index < Length) ? SizeMix[Index] : L',';
+
+        if (Char == UNICODE_NULL) {
+            Char = L',';
+            Length = Index;
+        }
+
+        if (Char >= L'0' && Char <= L'9') {
+            if (Value == NULL) {
+                if (Adapter->RxSizeMixCount == RTL_NUMBER_OF(Adapter->RxSizeMix)) {
+                    return NDIS_STATUS_BUFFER_TOO_SHORT;
+                }
+
+                Entry = &Adapter->RxSizeMix[Adapter->RxSizeMixCount++];
+                Entry->Length = 0;
+                Entry->Weight = 0;
+                Value = &Entry->Length;
+            }
+
+            if (*Value > (MAXUINT32 - 9) / 10) {
+                return NDIS_STATUS_INVALID_PARAMETER;
+            }
+
+            *Value = *Value * 10 + (Char - L'0');
+        } else if (Char == L':' && Entry != NULL && Value == &Entry->Length) {
+            Value = &Entry->Weight;
+        } else if (Char == L',' && Entry != NULL && Value == &Entry->Weight) {
+            if (Entry->Length < MIN_RX_DATA_LENGTH ||
+                Entry->Length > MAX_RX_DATA_LENGTH ||
+                Entry->Length > Adapter->RxBufferLength * (Adapter->RxMaxFragments + 1) ||
+                Entry->Weight == 0) {
+                return NDIS_STATUS_INVALID_PARAMETER;
+            }
+
+            Entry = NULL;
+            Value = NULL;
+        } else if (Char != L',' || Entry != NULL) {
+            return NDIS_STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    return NDIS_STATUS_SUCCESS;
+}
+
+NDIS_STATUS
+MpSetRxFlowPattern(
+    _Inout_ ADAPTER_CONTEXT *Adapter
+    )
+{
+    RX_FLOW_PATTERN *FlowPattern = &Adapter->RxFlowPattern;
+    const ETHERNET_HEADER *Ethernet = (const ETHERNET_HEADER *)Adapter->RxPattern;
+    UINT32 L4HeaderLength;
+
+    //
+    // The multi-flow RX generator rewrites the tuple and length fields of the
+    // RX pattern, which must therefore start with Ethernet, IPv4 or IPv6, and
+    // UDP or TCP headers.
+    //
+
+    RtlZeroMemory(FlowPattern, sizeof(*FlowPattern));
+
+    if (Adapter->RxPatternLength < sizeof(*Ethernet)) {
+        return NDIS_STATUS_INVALID_PARAMETER;
+    }
+
+    FlowPattern->L3Offset = sizeof(*Ethernet);
+
+    if (Ethernet->Type == htons(ETHERNET_TYPE_IPV4)) {
+        const IPV4_HEADER *Ipv4 = (const IPV4_HEADER *)(Ethernet + 1);
+
+        if (Adapter->RxPatternLength < FlowPattern->L3Offset + sizeof(*Ipv4) ||
+            Ipv4->HeaderLength < sizeof(*Ipv4) / sizeof(UINT32)) {
+            return NDIS_STATUS_INVALID_PARAMETER;
+        }
+
+        FlowPattern->L4Offset = FlowPattern->L3Offset + Ipv4->HeaderLength * sizeof(UINT32);
+        FlowPattern->AddressLength = sizeof(Ipv4->SourceAddress);
+        FlowPattern->IpProto = Ipv4->Protocol;
+    } else if (Ethernet->Type == htons(ETHERNET_TYPE_IPV6)) {
+        const IPV6_HEADER *Ipv6 = (const IPV6_HEADER *)(Ethernet + 1);
+
+        if (Adapter->RxPatternLength < FlowPattern->L3Offset + sizeof(*Ipv6)) {
+            return NDIS_STATUS_INVALID_PARAMETER;
+        }
+
+        FlowPattern->L4Offset = FlowPattern->L3Offset + sizeof(*Ipv6);
+        FlowPattern->AddressLength = sizeof(Ipv6->SourceAddress);
+        FlowPattern->IpProto = Ipv6->NextHeader;
+        FlowPattern->Ipv6 = TRUE;
+    } else {
+        return NDIS_STATUS_INVALID_PARAMETER;
+    }
+
+    if (FlowPattern->IpProto == IPPROTO_UDP) {
+        L4HeaderLength = sizeof(UDP_HDR);
+    } else if (FlowPattern->IpProto == IPPROTO_TCP) {
+        L4HeaderLength = sizeof(TCP_HDR);
+    } else {
+        return NDIS_STATUS_INVALID_PARAMETER;
+    }
+
+    FlowPattern->HeaderLength = FlowPattern->L4Offset + L4HeaderLength;
+
+    if (Adapter->RxPatternLength < FlowPattern->HeaderLength ||
+        Adapter->RxDataLength < FlowPattern->HeaderLength) {
+        return NDIS_STATUS_INVALID_PARAMETER;
+    }
+
+    for (UINT32 Index = 0; Index < Adapter->RxSizeMixCount; Index++) {
+        if (Adapter->RxSizeMix[Index].Length < FlowPattern->HeaderLength) {
+            return NDIS_STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    return NDIS_STATUS_SUCCESS;
+}
+
+NDIS_STATUS
+MpUpdateRxFrame(
+    _Inout_ ADAPTER_CONTEXT *Adapter,
+    _In_ const XDPMP_RX_FRAME_WMI *RxFrameWmi
+    )
+{
+    if (RxFrameWmi->FrameLength != 0 &&
+        (RxFrameWmi->FrameLength < MIN_RX_DATA_LENGTH ||
+            RxFrameWmi->FrameLength > MAX_RX_DATA_LENGTH ||
+            RxFrameWmi->FrameLength > Adapter->RxBufferLength * (Adapter->RxMaxFragments + 1) ||
+            RxFrameWmi->FrameLength < Adapter->RxFlowPattern.HeaderLength)) {
+        return NDIS_STATUS_INVALID_PARAMETER;
+    }
+
+    if (RxFrameWmi->FragmentLength > Adapter->RxBufferLength) {
+        return NDIS_STATUS_INVALID_PARAMETER;
+    }
+
+    Adapter->RxFrame = *RxFrameWmi;
+
+    for (UINT32 Index = 0; Index < Adapter->NumRssQueues; Index++) {
+        ADAPTER_RX_QUEUE *Rq = &Adapter->RssQueues[Index].Rq;
+
+        //
+        // The data path reads each length independently and bounds the number
+        // of buffers per frame, so no synchronization is required.
+        //
+        WriteUInt32Release(&Rq->FrameLength, RxFrameWmi->FrameLength);
+        WriteUInt32Release(&Rq->FragmentLength, RxFrameWmi->FragmentLength);
+    }
+
+    return NDIS_STATUS_SUCCESS;
+}
+
 NDIS_STATUS
 MpReadConfiguration(
    _Inout_ ADAPTER_CONTEXT *Adapter
@@ -1009,6 +1220,17 @@ MpReadConfiguration(
         goto Exit;
     }
 
+    Adapter->RxMaxFragments = 0;
+    TRY_READ_INT_CONFIGURATION(ConfigHandle, RegRxMaxFragments, &Adapter->RxMaxFragments);
+    if (Adapter->RxMaxFragments > MAX_RX_FRAGMENTS ||
+        Adapter->RxMaxFragments >= Adapter->NumRxBuffers) {
+        Status = NDIS_STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Adapter->RxInspectBatch = 0;
+    TRY_READ_INT_CONFIGURATION(ConfigHandle, RegRxInspectBatch, &Adapter->RxInspectBatch);
+
     NdisReadConfiguration(&Status, &ConfigParam, ConfigHandle, &RegRxPattern, NdisParameterString);
     if (Status == NDIS_STATUS_SUCCESS) {
         if (ConfigParam->ParameterType != NdisParameterString) {
@@ -1029,6 +1251,90 @@ MpReadConfiguration(
     TRY_READ_INT_CONFIGURATION(ConfigHandle, RegRxPatternCopy, &Adapter->RxPatternCopy);
     Adapter->RxPatternCopy = !!Adapter->RxPatternCopy;
 
+    Adapter->RxFlowCount = 0;
+    TRY_READ_INT_CONFIGURATION(ConfigHandle, RegRxFlowCount, &Adapter->RxFlowCount);
+    if (Adapter->RxFlowCount > MAX_RX_FLOW_COUNT) {
+        Status = NDIS_STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Adapter->RxFlowVary = DEFAULT_RX_FLOW_VARY;
+    TRY_READ_INT_CONFIGURATION(ConfigHandle, RegRxFlowVary, &Adapter->RxFlowVary);
+
+    NdisReadConfiguration(&Status, &ConfigParam, ConfigHandle, &RegRxSizeMix, NdisParameterString);
+    if (Status == NDIS_STATUS_SUCCESS) {
+        if (ConfigParam->ParameterType != NdisParameterString) {
+            Status = NDIS_STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+
+        Status =
+            MpSetRxSizeMix(
+                Adapter, ConfigParam->ParameterData.StringData.Buffer,
+                ConfigParam->ParameterData.StringData.Length);
+        if (Status != NDIS_STATUS_SUCCESS) {
+            goto Exit;
+        }
+    }
+
+    if (Adapter->RxFlowCount > 0 || Adapter->RxSizeMixCount > 0) {
+        Status = MpSetRxFlowPattern(Adapter);
+        if (Status != NDIS_STATUS_SUCCESS) {
+            goto Exit;
+        }
+    }
+
+    NdisReadConfiguration(
+        &Status, &ConfigParam, ConfigHandle, &RegRxReplayFile, NdisParameterString);
+    if (Status == NDIS_STATUS_SUCCESS) {
+        if (ConfigParam->ParameterType != NdisParameterString) {
+            Status = NDIS_STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+
+        if (ConfigParam->ParameterData.StringData.Length > 0) {
+            //
+            // Replayed frames replace the RX pattern generators.
+            //
+            if (Adapter->RxFlowCount > 0 || Adapter->RxSizeMixCount > 0) {
+                Status = NDIS_STATUS_INVALID_PARAMETER;
+                goto Exit;
+            }
+
+            Status = MpReplayLoad(Adapter, &ConfigParam->ParameterData.StringData);
+            if (Status != NDIS_STATUS_SUCCESS) {
+                goto Exit;
+            }
+        }
+    }
+
+    Adapter->HwCompletionLatencyUs = 0;
+    TRY_READ_INT_CONFIGURATION(
+        ConfigHandle, RegHwCompletionLatencyUs, &Adapter->HwCompletionLatencyUs);
+    if (Adapter->HwCompletionLatencyUs > MAX_HW_COMPLETION_LATENCY_US) {
+        Status = NDIS_STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Adapter->HwCompletionBatch = MIN_HW_COMPLETION_BATCH;
+    TRY_READ_INT_CONFIGURATION(ConfigHandle, RegHwCompletionBatch, &Adapter->HwCompletionBatch);
+    if (Adapter->HwCompletionBatch < MIN_HW_COMPLETION_BATCH ||
+        Adapter->HwCompletionBatch > MAX_HW_COMPLETION_BATCH) {
+        Status = NDIS_STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Adapter->HwInterruptCoalesceUs = 0;
+    TRY_READ_INT_CONFIGURATION(
+        ConfigHandle, RegHwInterruptCoalesceUs, &Adapter->HwInterruptCoalesceUs);
+    if (Adapter->HwInterruptCoalesceUs > MAX_HW_INTERRUPT_COALESCE_US) {
+        Status = NDIS_STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Adapter->RxFrame.FrameLength = 0;
+    Adapter->RxFrame.FragmentLength = 0;
+
     Adapter->RateSim.IntervalUs = 1000;             // 1ms
     Adapter->RateSim.RxFramesPerInterval = 1000;    // 1Mpps
     Adapter->RateSim.TxFramesPerInterval = 1000;    // 1Mpps
@@ -1304,6 +1610,11 @@ MpQueryInformationHandler(
             DataLength = sizeof(Adapter->RateSim);
             break;
 
+        case OID_XDPMP_RX_FRAME:
+            DataPointer = &Adapter->RxFrame;
+            DataLength = sizeof(Adapter->RxFrame);
+            break;
+
         case OID_XDP_QUERY_CAPABILITIES:
             DataPointer = &Adapter->Capabilities;
             DataLength = sizeof(Adapter->Capabilities);
@@ -1478,6 +1789,17 @@ MpSetInformationHandler(
             break;
         }
 
+        case OID_XDPMP_RX_FRAME:
+        {
+            if (InformationBufferLength < sizeof(XDPMP_RX_FRAME_WMI)) {
+                Status = NDIS_STATUS_INVALID_LENGTH;
+                break;
+            }
+
+            Status = MpUpdateRxFrame(Adapter, InformationBuffer);
+            break;
+        }
+
         default:
 
             Status = NDIS_STATUS_NOT_SUPPORTED;
@@ -12,6 +12,11 @@
 #define MAX_MULTICAST_ADDRESSES 16
 #define MAX_RSS_QUEUES 64
 #define MAX_RSS_INDIR_COUNT 128
+#define MAX_RX_FLOW_COUNT 4096
+#define MAX_RX_SIZE_MIX 16
+#define RX_SIZE_SCHEDULE_LENGTH 1024
+#define MAX_RX_FRAGMENTS 16
+#define MAX_TX_INSPECT_FRAGMENTS 16
 
 #define TRY_READ_INT_CONFIGURATION(hConfig, Keyword, pValue) \
     { \
@@ -25,6 +30,7 @@
     }
 
 typedef XdpMpRateSim XDPMP_RATE_SIM_WMI;
+typedef XdpMpRxFrame XDPMP_RX_FRAME_WMI;
 
 typedef enum {
     XDP_STATE_INACTIVE,
@@ -46,6 +52,83 @@ typedef struct {
     TX_SOURCE Source;
 } TX_SHADOW_DESCRIPTOR;
 
+//
+// XDP creates L2 TX inspect queues with the RX queue routines, so each
+// interface RX queue handle begins with the type of queue it refers to.
+//
+typedef enum {
+    MpXdpRxQueueTypeRx,
+    MpXdpRxQueueTypeTxInspect,
+} MP_XDP_RX_QUEUE_TYPE;
+
+//
+// A queue of NBs owned by the poll execution context.
+//
+typedef struct {
+    NET_BUFFER *Head;
+    NET_BUFFER **Tail;
+    UINT32 Count;
+} NB_QUEUE;
+
+typedef enum {
+    RxFlowVarySourcePort = 0x1,
+    RxFlowVaryDestinationPort = 0x2,
+    RxFlowVarySourceAddress = 0x4,
+    RxFlowVaryDestinationAddress = 0x8,
+} RX_FLOW_VARY_FLAGS;
+
+//
+// The layout of the RX pattern headers rewritten by the multi-flow RX
+// generator.
+//
+typedef struct {
+    UINT32 L3Offset;
+    UINT32 L4Offset;
+    UINT32 HeaderLength;
+    UINT32 AddressLength;
+    UINT8 IpProto;
+    BOOLEAN Ipv6;
+} RX_FLOW_PATTERN;
+
+//
+// The varied tuple fields of a generated RX flow, in network byte order, and
+// the RSS hash the flow's frames are indicated with. Addresses vary only in
+// their last 32 bits.
+//
+typedef struct {
+    UINT16 SourcePort;
+    UINT16 DestinationPort;
+    UINT32 SourceAddressTail;
+    UINT32 DestinationAddressTail;
+    UINT32 RssHash;
+    UINT32 RssHashType;
+} RX_FLOW;
+
+typedef struct {
+    UINT32 Length;
+    UINT32 Weight;
+} RX_SIZE_MIX_ENTRY;
+
+//
+// A frame of the RX replay capture: the location of the frame's bytes within
+// the loaded replay file, and the RSS hash the frame is indicated with.
+//
+typedef struct {
+    UINT32 Offset;
+    UINT32 Length;
+    UINT32 RssHash;
+    UINT32 RssHashType;
+} RX_REPLAY_FRAME;
+
+//
+// A hardware RX buffer holding all or part of a generated frame.
+//
+typedef struct {
+    UINT32 HwRxDescriptor;
+    UINT32 DataOffset;
+    UINT32 DataLength;
+} RX_BUFFER_DESCRIPTOR;
+
 typedef struct _ADAPTER_RX_QUEUE ADAPTER_RX_QUEUE;
 typedef struct _ADAPTER_TX_QUEUE ADAPTER_TX_QUEUE;
 
@@ -55,8 +138,15 @@ typedef struct _ADAPTER_RX_QUEUE {
 
     XDP_RX_QUEUE_HANDLE XdpRxQueue;
     XDP_RING *FrameRing;
-    XDP_EXTENSION BufferVaExtension;
-    XDP_EXTENSION RxActionExtension;
+    XDP_RING *FragmentRing;
+    XDP_NDIS_RX_EXTENSIONS Extensions;
+
+    //
+    // Frames are inspected in sub-batches of InspectBatchSize as they are
+    // generated, or once the frame ring is full if zero.
+    //
+    XDP_RX_BATCH XdpBatch;
+    UINT32 InspectBatchSize;
 
     HW_RING *HwRing;
     UCHAR *BufferArray;
@@ -69,6 +159,41 @@ typedef struct _ADAPTER_RX_QUEUE {
     UINT32 DataLength;
     UINT32 PatternLength;
     const UCHAR *PatternBuffer;
+
+    //
+    // The multi-flow RX generator, if enabled. Each queue generates the flows
+    // that the adapter's RSS configuration places on the queue, cycling
+    // through a precomputed frame length schedule.
+    //
+    const RX_FLOW_PATTERN *FlowPattern;
+    RX_FLOW *Flows;
+    UINT32 FlowCount;
+    UINT32 FlowIndex;
+    UINT32 *FrameLengths;
+    UINT32 FrameLengthIndex;
+
+    //
+    // The RX replay generator, if enabled. Each queue replays, in capture
+    // order, the frames that the adapter's RSS configuration places on the
+    // queue: ReplayCount entries of the replay order starting at ReplayStart.
+    //
+    const UCHAR *ReplayData;
+    const RX_REPLAY_FRAME *ReplayFrames;
+    const UINT32 *ReplayOrder;
+    UINT32 ReplayFrameCount;
+    UINT32 ReplayStart;
+    UINT32 ReplayCount;
+    UINT32 ReplayIndex;
+
+    //
+    // Frames longer than the fragment length are split across up to
+    // MaxFragments additional buffers. The frame and fragment lengths are
+    // updated at runtime via WMI; zero selects the default length.
+    //
+    UINT32 MaxFragments;
+    UINT32 FrameLength;
+    UINT32 FragmentLength;
+
     UINT32 RecycleIndex;
     UINT32 RxTxIndex;
 
@@ -80,13 +205,43 @@ typedef struct _ADAPTER_RX_QUEUE {
         UINT64 RxDrops;
     } Stats;
 
+    //
+    // Each RX buffer is described by an MDL in MdlArray, indexed by buffer,
+    // and frames are indicated to NDIS with NBLs from NblCache.
+    //
     PEX_RUNDOWN_REF_CACHE_AWARE NblRundown;
-    NET_BUFFER_LIST **NblArray;
+    XDP_NDIS_RX_NBL_CACHE NblCache;
+    UCHAR *MdlArray;
+    UINT32 MdlSize;
     UINT32 RssHash;
 
     KEVENT *DeleteComplete;
 } ADAPTER_RX_QUEUE;
 
+//
+// The L2 TX inspect queue of a TX queue. While the queue is active, outgoing
+// NBs are moved to PendingQueue and inspected in batches within the poll.
+// NBs that XDP passes are moved to PassQueue to be posted to the hardware, and
+// all others are completed without being posted.
+//
+typedef struct _ADAPTER_TX_INSPECT_QUEUE {
+    MP_XDP_RX_QUEUE_TYPE XdpRxQueueType;
+    XDP_QUEUE_STATE XdpState;
+    BOOLEAN NeedFlush;
+
+    XDP_RX_QUEUE_HANDLE XdpRxQueue;
+    XDP_RING *FrameRing;
+    XDP_RING *FragmentRing;
+    XDP_EXTENSION VaExtension;
+    XDP_EXTENSION RxActionExtension;
+    XDP_EXTENSION FragmentExtension;
+
+    NB_QUEUE PendingQueue;
+    NB_QUEUE PassQueue;
+
+    KEVENT *DeleteComplete;
+} ADAPTER_TX_INSPECT_QUEUE;
+
 typedef struct _ADAPTER_TX_QUEUE {
     XDP_QUEUE_STATE XdpState;
     BOOLEAN NeedFlush;
@@ -114,10 +269,16 @@ typedef struct _ADAPTER_TX_QUEUE {
     NET_BUFFER **NbQueueTail;
     KSPIN_LOCK NbQueueLock;
 
+    ADAPTER_TX_INSPECT_QUEUE Inspect;
+
     KEVENT *DeleteComplete;
 } ADAPTER_TX_QUEUE;
 
 typedef struct DECLSPEC_CACHEALIGN _ADAPTER_QUEUE {
+    //
+    // The queue is the interface RX queue handle of its L2 RX inspect queue.
+    //
+    MP_XDP_RX_QUEUE_TYPE XdpRxQueueType;
     UINT32 QueueId;
 
     ADAPTER_RX_QUEUE Rq;
@@ -146,6 +307,7 @@ typedef struct DECLSPEC_CACHEALIGN _ADAPTER_QUEUE {
         INT64 FrequencyQpc;
         UINT32 RxFrameRate;
         UINT32 TxFrameRate;
+        BOOLEAN HwModel;
         PKEVENT CleanupEvent;
     } RateSim;
 
@@ -171,6 +333,9 @@ typedef struct _ADAPTER_CONTEXT {
     ULONG IndirectionMask;
     ADAPTER_QUEUE *RssQueues;
     ULONG IndirectionTable[MAX_RSS_INDIR_COUNT];
+    ULONG RssHashType;
+    ULONG RssHashSecretKeySize;
+    UCHAR RssHashSecretKey[NDIS_RSS_HASH_SECRET_KEY_MAX_SIZE_REVISION_2];
 
     NDIS_HANDLE RxNblPool;
     UINT32 MdlSize;
@@ -192,6 +357,21 @@ typedef struct _ADAPTER_CONTEXT {
     ULONG RxPatternLength;
     UCHAR RxPattern[128];
     ULONG RxPatternCopy;
+    ULONG RxFlowCount;
+    ULONG RxFlowVary;
+    RX_FLOW_PATTERN RxFlowPattern;
+    ULONG RxSizeMixCount;
+    RX_SIZE_MIX_ENTRY RxSizeMix[MAX_RX_SIZE_MIX];
+    UCHAR *RxReplayData;
+    RX_REPLAY_FRAME *RxReplayFrames;
+    UINT32 *RxReplayOrder;
+    UINT32 RxReplayFrameCount;
+    ULONG RxMaxFragments;
+    ULONG RxInspectBatch;
+    ULONG HwCompletionLatencyUs;
+    ULONG HwCompletionBatch;
+    ULONG HwInterruptCoalesceUs;
+    XDPMP_RX_FRAME_WMI RxFrame;
     XDPMP_RATE_SIM_WMI RateSim;
     FNDIS_NPI_CLIENT FndisClient;
     ADAPTER_POLL_PROVIDER PollProvider;
@@ -216,8 +396,11 @@ typedef struct {
 
 typedef struct _MINIPORT_SUPPORTED_XDP_EXTENSIONS {
     XDP_EXTENSION_INFO VirtualAddress;
+    XDP_EXTENSION_INFO Mdl;
     XDP_EXTENSION_INFO LogicalAddress;
     XDP_EXTENSION_INFO RxAction;
+    XDP_EXTENSION_INFO RxMetadata;
+    XDP_EXTENSION_INFO Fragment;
 } MINIPORT_SUPPORTED_XDP_EXTENSIONS;
 
 extern MINIPORT_SUPPORTED_XDP_EXTENSIONS MpSupportedXdpExtensions;
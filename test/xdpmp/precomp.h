@@ -15,12 +15,14 @@
 #include <xdprtl.h>
 #include <fndispoll.h>
 #include <fndisnpi.h>
+#include <xdpmpreplay.h>
 
 #include "xdpmpwmi.h"
 #include "hwring.h"
 #include "miniport.h"
 #include "poll.h"
 #include "ratesim.h"
+#include "replay.h"
 #include "rss.h"
 #include "rx.h"
 #include "trace.h"
@@ -30,6 +32,7 @@
 #define POOLTAG_RXBUFFER 'BpmX' // XmpB
 #define POOLTAG_HWRING   'HpmX' // XmpH
 #define POOLTAG_NBL      'NpmX' // XmpN
+#define POOLTAG_REPLAY   'PpmX' // XmpP
 #define POOLTAG_QUEUE    'QpmX' // XmpQ
 #define POOLTAG_RSS      'RpmX' // XmpR
 #define POOLTAG_TX       'TpmX' // XmpT
@@ -49,6 +49,7 @@ MpRateSim(
 {
     UINT32 RxFrameRate = ReadUInt32Acquire(&RssQueue->RateSim.RxFrameRate);
     UINT32 TxFrameRate = ReadUInt32Acquire(&RssQueue->RateSim.TxFrameRate);
+    LARGE_INTEGER CurrentQpc = {0};
 
     //
     // Produce continuous batches of frames while the hardware queue is
@@ -65,9 +66,11 @@ MpRateSim(
     // If RX or TX are rate-limited, check the current time and produce the next
     // batch of frames if the rate interval expired.
     //
-    if (RxFrameRate < MAXUINT32 || TxFrameRate < MAXUINT32) {
-        LARGE_INTEGER CurrentQpc = KeQueryPerformanceCounter(NULL);
+    if (RxFrameRate < MAXUINT32 || TxFrameRate < MAXUINT32 || RssQueue->RateSim.HwModel) {
+        CurrentQpc = KeQueryPerformanceCounter(NULL);
+    }
 
+    if (RxFrameRate < MAXUINT32 || TxFrameRate < MAXUINT32) {
         if (CurrentQpc.QuadPart >= RssQueue->RateSim.ExpirationQpc) {
             //
             // Timer expired. Produce a new batch of frames.
@@ -93,9 +96,11 @@ MpRateSim(
     }
 
     RssQueue->Rq.RateSimFramesAvailable -=
-        HwRingHwComplete(RssQueue->Rq.HwRing, RssQueue->Rq.RateSimFramesAvailable);
+        HwRingHwComplete(
+            RssQueue->Rq.HwRing, RssQueue->Rq.RateSimFramesAvailable, CurrentQpc.QuadPart);
     RssQueue->Tq.RateSimFramesAvailable -=
-        HwRingHwComplete(RssQueue->Tq.HwRing, RssQueue->Tq.RateSimFramesAvailable);
+        HwRingHwComplete(
+            RssQueue->Tq.HwRing, RssQueue->Tq.RateSimFramesAvailable, CurrentQpc.QuadPart);
 }
 
 VOID
@@ -105,6 +110,7 @@ MpRateSimEnableInterrupt(
 {
     LARGE_INTEGER CurrentQpc;
     LARGE_INTEGER DueTime;
+    INT64 DueQpc;
     PKEVENT CleanupEvent;
 
     //
@@ -141,7 +147,21 @@ MpRateSimEnableInterrupt(
     }
 
     ASSERT(CurrentQpc.QuadPart < RssQueue->RateSim.ExpirationQpc);
-    DueTime.QuadPart = RssQueue->RateSim.ExpirationQpc - CurrentQpc.QuadPart;
+    DueQpc = RssQueue->RateSim.ExpirationQpc;
+
+    //
+    // If the hardware completion model is enabled, interrupt no later than the
+    // next modeled completion.
+    //
+    if (RssQueue->RateSim.HwModel) {
+        if (RssQueue->HwActiveRx) {
+            DueQpc = min(DueQpc, HwRingGetNextCompletionQpc(RssQueue->Rq.HwRing));
+        }
+        DueQpc = min(DueQpc, HwRingGetNextCompletionQpc(RssQueue->Tq.HwRing));
+        DueQpc = max(DueQpc, CurrentQpc.QuadPart + 1);
+    }
+
+    DueTime.QuadPart = DueQpc - CurrentQpc.QuadPart;
     DueTime.QuadPart *= -10i64 * 1000 * 1000;
     DueTime.QuadPart /= RssQueue->RateSim.FrequencyQpc;
 
@@ -216,6 +236,8 @@ MpInitializeRateSim(
     RssQueue->RateSim.TxFrameRate = Adapter->RateSim.TxFramesPerInterval;
     RssQueue->RateSim.IntervalQpc =
         (Adapter->RateSim.IntervalUs * RssQueue->RateSim.FrequencyQpc) / 1000 / 1000;
+    RssQueue->RateSim.HwModel =
+        Adapter->HwCompletionLatencyUs > 0 || Adapter->HwCompletionBatch > 1;
 
 Exit:
 
@@ -0,0 +1,384 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#include "precomp.h"
+#include "replay.tmh"
+
+#define MAX_RX_REPLAY_FILE_SIZE (512 * 1024 * 1024)
+#define IP4_FRAGMENT_MASK 0x3FFF
+
+VOID
+MpReplayCleanup(
+    _Inout_ ADAPTER_CONTEXT *Adapter
+    )
+{
+    if (Adapter->RxReplayOrder != NULL) {
+        ExFreePoolWithTag(Adapter->RxReplayOrder, POOLTAG_REPLAY);
+        Adapter->RxReplayOrder = NULL;
+    }
+
+    if (Adapter->RxReplayFrames != NULL) {
+        ExFreePoolWithTag(Adapter->RxReplayFrames, POOLTAG_REPLAY);
+        Adapter->RxReplayFrames = NULL;
+    }
+
+    if (Adapter->RxReplayData != NULL) {
+        ExFreePoolWithTag(Adapter->RxReplayData, POOLTAG_REPLAY);
+        Adapter->RxReplayData = NULL;
+    }
+
+    Adapter->RxReplayFrameCount = 0;
+}
+
+static
+NDIS_STATUS
+MpReplayParse(
+    _Inout_ ADAPTER_CONTEXT *Adapter,
+    _In_ UINT32 FileSize
+    )
+{
+    const XDPMP_REPLAY_HEADER *Header = (const XDPMP_REPLAY_HEADER *)Adapter->RxReplayData;
+    UINT32 Offset = sizeof(*Header);
+
+    if (Header->Magic != XDPMP_REPLAY_MAGIC ||
+        Header->Version != XDPMP_REPLAY_VERSION ||
+        Header->FrameCount == 0 ||
+        Header->FrameCount > (FileSize - sizeof(*Header)) / sizeof(XDPMP_REPLAY_RECORD)) {
+        return NDIS_STATUS_INVALID_PARAMETER;
+    }
+
+    Adapter->RxReplayFrames =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, (SIZE_T)Header->FrameCount * sizeof(*Adapter->RxReplayFrames),
+            POOLTAG_REPLAY);
+    if (Adapter->RxReplayFrames == NULL) {
+        return NDIS_STATUS_RESOURCES;
+    }
+
+    Adapter->RxReplayOrder =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, (SIZE_T)Header->FrameCount * sizeof(*Adapter->RxReplayOrder),
+            POOLTAG_REPLAY);
+    if (Adapter->RxReplayOrder == NULL) {
+        return NDIS_STATUS_RESOURCES;
+    }
+
+    for (UINT32 Index = 0; Index < Header->FrameCount; Index++) {
+        const XDPMP_REPLAY_RECORD *Record;
+        RX_REPLAY_FRAME *Frame = &Adapter->RxReplayFrames[Index];
+        UINT32 PaddedLength;
+
+        if (FileSize - Offset < sizeof(*Record)) {
+            return NDIS_STATUS_INVALID_PARAMETER;
+        }
+
+        Record = (const XDPMP_REPLAY_RECORD *)(Adapter->RxReplayData + Offset);
+        Offset += sizeof(*Record);
+
+        if (Record->FrameLength < XDPMP_REPLAY_MIN_FRAME_LENGTH ||
+            Record->FrameLength > XDPMP_REPLAY_MAX_FRAME_LENGTH) {
+            return NDIS_STATUS_INVALID_PARAMETER;
+        }
+
+        PaddedLength = ALIGN_UP_BY(Record->FrameLength, XDPMP_REPLAY_RECORD_ALIGNMENT);
+        if (FileSize - Offset < PaddedLength) {
+            return NDIS_STATUS_INVALID_PARAMETER;
+        }
+
+        //
+        // Until RSS is configured, every queue replays every frame in capture
+        // order.
+        //
+        Frame->Offset = Offset;
+        Frame->Length = Record->FrameLength;
+        Frame->RssHash = 0;
+        Frame->RssHashType = NDIS_HASH_IPV4;
+        Adapter->RxReplayOrder[Index] = Index;
+
+        Offset += PaddedLength;
+    }
+
+    Adapter->RxReplayFrameCount = Header->FrameCount;
+
+    return NDIS_STATUS_SUCCESS;
+}
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NDIS_STATUS
+MpReplayLoad(
+    _Inout_ ADAPTER_CONTEXT *Adapter,
+    _In_ const UNICODE_STRING *FileName
+    )
+{
+    NDIS_STATUS Status;
+    UNICODE_STRING Path = {0};
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    FILE_STANDARD_INFORMATION StandardInfo;
+    LARGE_INTEGER ReadOffset = {0};
+    HANDLE FileHandle = NULL;
+    UINT32 FileSize;
+
+    TraceEnter(TRACE_CONTROL, "NdisMiniportHandle=%p", Adapter->MiniportHandle);
+
+    //
+    // The replay file is configured as a DOS path, e.g. C:\captures\rx.xmpr,
+    // and opened via the DOS devices namespace.
+    //
+    Path.MaximumLength = sizeof(L"\\??\\") - sizeof(UNICODE_NULL) + FileName->Length;
+    Path.Buffer = ExAllocatePoolZero(NonPagedPoolNx, Path.MaximumLength, POOLTAG_REPLAY);
+    if (Path.Buffer == NULL) {
+        Status = NDIS_STATUS_RESOURCES;
+        goto Exit;
+    }
+
+    RtlAppendUnicodeToString(&Path, L"\\??\\");
+    RtlAppendUnicodeStringToString(&Path, FileName);
+
+    InitializeObjectAttributes(
+        &ObjectAttributes, &Path, OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE, NULL, NULL);
+
+    Status =
+        ZwCreateFile(
+            &FileHandle, GENERIC_READ | SYNCHRONIZE, &ObjectAttributes, &IoStatusBlock, NULL,
+            FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ, FILE_OPEN,
+            FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT, NULL, 0);
+    if (!NT_SUCCESS(Status)) {
+        FileHandle = NULL;
+        TraceError(
+            TRACE_CONTROL, "NdisMiniportHandle=%p Failed to open RX replay file Status=%!STATUS!",
+            Adapter->MiniportHandle, Status);
+        goto Exit;
+    }
+
+    Status =
+        ZwQueryInformationFile(
+            FileHandle, &IoStatusBlock, &StandardInfo, sizeof(StandardInfo),
+            FileStandardInformation);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    if (StandardInfo.EndOfFile.QuadPart < sizeof(XDPMP_REPLAY_HEADER) ||
+        StandardInfo.EndOfFile.QuadPart > MAX_RX_REPLAY_FILE_SIZE) {
+        Status = NDIS_STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    FileSize = (UINT32)StandardInfo.EndOfFile.QuadPart;
+
+    //
+    // Load the entire capture into non-paged memory up front, so the data path
+    // replays frames with a copy from memory, as it does for RX patterns.
+    //
+    Adapter->RxReplayData = ExAllocatePoolZero(NonPagedPoolNx, FileSize, POOLTAG_REPLAY);
+    if (Adapter->RxReplayData == NULL) {
+        Status = NDIS_STATUS_RESOURCES;
+        goto Exit;
+    }
+
+    Status =
+        ZwReadFile(
+            FileHandle, NULL, NULL, NULL, &IoStatusBlock, Adapter->RxReplayData, FileSize,
+            &ReadOffset, NULL);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    if (IoStatusBlock.Information != FileSize) {
+        Status = NDIS_STATUS_INVALID_LENGTH;
+        goto Exit;
+    }
+
+    Status = MpReplayParse(Adapter, FileSize);
+    if (Status != NDIS_STATUS_SUCCESS) {
+        TraceError(
+            TRACE_CONTROL, "NdisMiniportHandle=%p Invalid RX replay file Status=%!STATUS!",
+            Adapter->MiniportHandle, Status);
+        goto Exit;
+    }
+
+    TraceInfo(
+        TRACE_CONTROL, "NdisMiniportHandle=%p Loaded RX replay FrameCount=%u FileSize=%u",
+        Adapter->MiniportHandle, Adapter->RxReplayFrameCount, FileSize);
+
+Exit:
+
+    if (Status != NDIS_STATUS_SUCCESS) {
+        MpReplayCleanup(Adapter);
+    }
+
+    if (FileHandle != NULL) {
+        ZwClose(FileHandle);
+    }
+
+    if (Path.Buffer != NULL) {
+        ExFreePoolWithTag(Path.Buffer, POOLTAG_REPLAY);
+    }
+
+    TraceExitStatus(TRACE_CONTROL);
+
+    return Status;
+}
+
+static
+UINT32
+MpReplayHashFrame(
+    _In_ const ADAPTER_CONTEXT *Adapter,
+    _In_reads_bytes_(Length) const UCHAR *Pkt,
+    _In_ UINT32 Length,
+    _Out_ UINT32 *RssHashType
+    )
+{
+    const ETHERNET_HEADER *Ethernet = (const ETHERNET_HEADER *)Pkt;
+    UCHAR Input[2 * sizeof(IN6_ADDR) + 2 * sizeof(UINT16)];
+    const UCHAR *Ports = NULL;
+    UINT32 AddressLength;
+    UINT32 InputLength;
+    UINT8 IpProto;
+
+    //
+    // Hash the frame's IP addresses, and its ports if the configured hash
+    // types include the frame's transport protocol, as hardware would.
+    // Frames that are not IP are indicated without a hash.
+    //
+
+    *RssHashType = 0;
+
+    if (Ethernet->Type == htons(ETHERNET_TYPE_IPV4)) {
+        const IPV4_HEADER *Ipv4 = (const IPV4_HEADER *)(Ethernet + 1);
+        UINT32 L4Offset;
+
+        if (Length < sizeof(*Ethernet) + sizeof(*Ipv4) ||
+            Ipv4->HeaderLength < sizeof(*Ipv4) / sizeof(UINT32)) {
+            return 0;
+        }
+
+        AddressLength = sizeof(Ipv4->SourceAddress);
+        RtlCopyMemory(Input, &Ipv4->SourceAddress, AddressLength);
+        RtlCopyMemory(Input + AddressLength, &Ipv4->DestinationAddress, AddressLength);
+        IpProto = Ipv4->Protocol;
+        L4Offset = sizeof(*Ethernet) + Ipv4->HeaderLength * sizeof(UINT32);
+        *RssHashType = NDIS_HASH_IPV4;
+
+        if ((ntohs(Ipv4->FlagsAndOffset) & IP4_FRAGMENT_MASK) == 0 &&
+            Length >= L4Offset + 2 * sizeof(UINT16) &&
+            ((IpProto == IPPROTO_TCP && (Adapter->RssHashType & NDIS_HASH_TCP_IPV4)) ||
+                (IpProto == IPPROTO_UDP && (Adapter->RssHashType & NDIS_HASH_UDP_IPV4)))) {
+            Ports = Pkt + L4Offset;
+            *RssHashType = (IpProto == IPPROTO_TCP) ? NDIS_HASH_TCP_IPV4 : NDIS_HASH_UDP_IPV4;
+        }
+    } else if (Ethernet->Type == htons(ETHERNET_TYPE_IPV6)) {
+        const IPV6_HEADER *Ipv6 = (const IPV6_HEADER *)(Ethernet + 1);
+        UINT32 L4Offset = sizeof(*Ethernet) + sizeof(*Ipv6);
+
+        if (Length < L4Offset) {
+            return 0;
+        }
+
+        AddressLength = sizeof(Ipv6->SourceAddress);
+        RtlCopyMemory(Input, &Ipv6->SourceAddress, AddressLength);
+        RtlCopyMemory(Input + AddressLength, &Ipv6->DestinationAddress, AddressLength);
+        IpProto = Ipv6->NextHeader;
+        *RssHashType = NDIS_HASH_IPV6;
+
+        //
+        // Extension headers are not parsed, so such frames hash addresses only.
+        //
+        if (Length >= L4Offset + 2 * sizeof(UINT16) &&
+            ((IpProto == IPPROTO_TCP &&
+                    (Adapter->RssHashType & (NDIS_HASH_TCP_IPV6 | NDIS_HASH_TCP_IPV6_EX))) ||
+                (IpProto == IPPROTO_UDP &&
+                    (Adapter->RssHashType & (NDIS_HASH_UDP_IPV6 | NDIS_HASH_UDP_IPV6_EX))))) {
+            Ports = Pkt + L4Offset;
+            *RssHashType = (IpProto == IPPROTO_TCP) ? NDIS_HASH_TCP_IPV6 : NDIS_HASH_UDP_IPV6;
+        }
+    } else {
+        return 0;
+    }
+
+    InputLength = 2 * AddressLength;
+
+    if (Ports != NULL) {
+        RtlCopyMemory(Input + InputLength, Ports, 2 * sizeof(UINT16));
+        InputLength += 2 * sizeof(UINT16);
+    }
+
+    return
+        MpRssToeplitzHash(
+            Adapter->RssHashSecretKey, Adapter->RssHashSecretKeySize, Input, InputLength);
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpReplaySetFlows(
+    _Inout_ ADAPTER_CONTEXT *Adapter
+    )
+{
+    UINT32 QueueCounts[MAX_RSS_QUEUES] = {0};
+    UINT32 QueueStarts[MAX_RSS_QUEUES];
+    UINT32 QueueOffsets[MAX_RSS_QUEUES];
+    UINT32 Start = 0;
+
+    if (Adapter->RxReplayFrameCount == 0) {
+        return;
+    }
+
+    //
+    // Place each frame on the queue the RSS indirection table selects for the
+    // frame's Toeplitz hash, as hardware would, and group the replay order by
+    // queue while preserving capture order within each queue. Frames without
+    // a hash are placed by the first indirection table entry.
+    //
+
+    for (UINT32 Index = 0; Index < Adapter->RxReplayFrameCount; Index++) {
+        RX_REPLAY_FRAME *Frame = &Adapter->RxReplayFrames[Index];
+        ULONG QueueId;
+
+        Frame->RssHash =
+            MpReplayHashFrame(
+                Adapter, Adapter->RxReplayData + Frame->Offset, Frame->Length,
+                &Frame->RssHashType);
+
+        QueueId = Adapter->IndirectionTable[Frame->RssHash & Adapter->IndirectionMask];
+        if (QueueId < Adapter->NumRssQueues) {
+            QueueCounts[QueueId]++;
+        }
+    }
+
+    for (ULONG Index = 0; Index < Adapter->NumRssQueues; Index++) {
+        QueueStarts[Index] = Start;
+        QueueOffsets[Index] = Start;
+        Start += QueueCounts[Index];
+    }
+
+    //
+    // As with the indirection table itself, the replay order is updated in
+    // place without synchronizing with the data path, so frames replayed
+    // during an RSS update may be placed on a stale queue.
+    //
+    for (UINT32 Index = 0; Index < Adapter->RxReplayFrameCount; Index++) {
+        const RX_REPLAY_FRAME *Frame = &Adapter->RxReplayFrames[Index];
+        ULONG QueueId = Adapter->IndirectionTable[Frame->RssHash & Adapter->IndirectionMask];
+
+        if (QueueId < Adapter->NumRssQueues) {
+            Adapter->RxReplayOrder[QueueOffsets[QueueId]++] = Index;
+        }
+    }
+
+    for (ULONG Index = 0; Index < Adapter->NumRssQueues; Index++) {
+        ADAPTER_QUEUE *RssQueue = &Adapter->RssQueues[Index];
+
+        WriteUInt32Release(&RssQueue->Rq.ReplayStart, QueueStarts[Index]);
+        WriteUInt32Release(&RssQueue->Rq.ReplayCount, QueueCounts[Index]);
+
+        //
+        // A queue with no frames receives no traffic.
+        //
+        if (QueueCounts[Index] == 0) {
+            RssQueue->HwActiveRx = FALSE;
+        }
+    }
+}
@@ -0,0 +1,24 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NDIS_STATUS
+MpReplayLoad(
+    _Inout_ ADAPTER_CONTEXT *Adapter,
+    _In_ const UNICODE_STRING *FileName
+    );
+
+VOID
+MpReplayCleanup(
+    _Inout_ ADAPTER_CONTEXT *Adapter
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpReplaySetFlows(
+    _Inout_ ADAPTER_CONTEXT *Adapter
+    );
@@ -77,6 +77,7 @@ MpXdpNotify(
     ADAPTER_QUEUE *RssQueue = (ADAPTER_QUEUE *)InterfaceQueue;
 
     static const PollMask =
+        XDP_NOTIFY_QUEUE_FLAG_RX |
         XDP_NOTIFY_QUEUE_FLAG_TX |
         XDP_NOTIFY_QUEUE_FLAG_RX_FLUSH |
         XDP_NOTIFY_QUEUE_FLAG_TX_FLUSH;
@@ -94,6 +95,43 @@ MpXdpNotify(
     }
 }
 
+UINT32
+MpRssToeplitzHash(
+    _In_reads_bytes_(HashSecretKeySize) const UCHAR *HashSecretKey,
+    _In_ UINT32 HashSecretKeySize,
+    _In_reads_bytes_(InputLength) const UCHAR *Input,
+    _In_ UINT32 InputLength
+    )
+{
+    UINT32 Hash = 0;
+    UINT32 Window = 0;
+    UINT32 KeyIndex;
+
+    //
+    // Key bytes beyond the end of the key are treated as zero.
+    //
+    for (KeyIndex = 0; KeyIndex < sizeof(Window); KeyIndex++) {
+        Window <<= 8;
+        if (KeyIndex < HashSecretKeySize) {
+            Window |= HashSecretKey[KeyIndex];
+        }
+    }
+
+    for (UINT32 Index = 0; Index < InputLength; Index++, KeyIndex++) {
+        UCHAR NextKeyByte = (KeyIndex < HashSecretKeySize) ? HashSecretKey[KeyIndex] : 0;
+
+        for (UINT32 Bit = 0; Bit < 8; Bit++) {
+            if (Input[Index] & (0x80 >> Bit)) {
+                Hash ^= Window;
+            }
+
+            Window = (Window << 1) | ((NextKeyByte >> (7 - Bit)) & 1);
+        }
+    }
+
+    return Hash;
+}
+
 VOID
 MpDepopulateRssQueues(
     _Inout_ ADAPTER_CONTEXT *Adapter
@@ -235,6 +273,12 @@ MpSetRss(
         return;
     }
 
+    if (RssParams->HashSecretKeySize > sizeof(Adapter->RssHashSecretKey) ||
+        RssParams->HashSecretKeyOffset + RssParams->HashSecretKeySize > RssParamsLength ||
+        RssParams->IndirectionTableOffset + RssParams->IndirectionTableSize > RssParamsLength) {
+        return;
+    }
+
     EntryCount = RssParams->IndirectionTableSize / sizeof(PROCESSOR_NUMBER);
     RssTable = (PROCESSOR_NUMBER *)
         (((UCHAR *)RssParams) + RssParams->IndirectionTableOffset);
@@ -288,4 +332,13 @@ MpSetRss(
 
     FRE_ASSERT(RTL_IS_POWER_OF_TWO(EntryCount));
     Adapter->IndirectionMask = EntryCount - 1;
+
+    Adapter->RssHashType = NDIS_RSS_HASH_TYPE_FROM_HASH_INFO(RssParams->HashInformation);
+    Adapter->RssHashSecretKeySize = RssParams->HashSecretKeySize;
+    RtlCopyMemory(
+        Adapter->RssHashSecretKey, (UCHAR *)RssParams + RssParams->HashSecretKeyOffset,
+        RssParams->HashSecretKeySize);
+
+    MpReceiveSetFlows(Adapter);
+    MpReplaySetFlows(Adapter);
 }
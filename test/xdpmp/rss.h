@@ -34,3 +34,11 @@ MpSetRss(
     _In_ NDIS_RECEIVE_SCALE_PARAMETERS *RssParams,
     _In_ SIZE_T RssParamsLength
     );
+
+UINT32
+MpRssToeplitzHash(
+    _In_reads_bytes_(HashSecretKeySize) const UCHAR *HashSecretKey,
+    _In_ UINT32 HashSecretKeySize,
+    _In_reads_bytes_(InputLength) const UCHAR *Input,
+    _In_ UINT32 InputLength
+    );
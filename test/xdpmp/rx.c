@@ -80,41 +80,550 @@ MpReceiveFlushRxTx(
     MpReceiveRecycleFlush((ADAPTER_RX_QUEUE *)Rq);
 }
 
+static
+UINT16
+MpIpv4HeaderChecksum(
+    _In_ const IPV4_HEADER *Ipv4
+    )
+{
+    const UINT16 *Words = (const UINT16 *)Ipv4;
+    UINT32 Sum = 0;
+
+    for (UINT32 Index = 0; Index < Ipv4->HeaderLength * sizeof(UINT32) / sizeof(*Words); Index++) {
+        Sum += Words[Index];
+    }
+
+    Sum = (Sum & 0xFFFF) + (Sum >> 16);
+    Sum = (Sum & 0xFFFF) + (Sum >> 16);
+
+    return (UINT16)~Sum;
+}
+
+static
+VOID
+MpReceiveGetFlowTuple(
+    _In_ const ADAPTER_CONTEXT *Adapter,
+    _In_ UINT32 FlowIndex,
+    _Out_ RX_FLOW *Flow
+    )
+{
+    const RX_FLOW_PATTERN *FlowPattern = &Adapter->RxFlowPattern;
+    const UCHAR *L3 = Adapter->RxPattern + FlowPattern->L3Offset;
+    const UINT16 *Ports = (const UINT16 *)(Adapter->RxPattern + FlowPattern->L4Offset);
+    const UCHAR *SourceAddress;
+    const UCHAR *DestinationAddress;
+
+    //
+    // Flow N offsets each varied field of the RX pattern by N.
+    //
+
+    if (FlowPattern->Ipv6) {
+        SourceAddress = (const UCHAR *)&((const IPV6_HEADER *)L3)->SourceAddress;
+        DestinationAddress = (const UCHAR *)&((const IPV6_HEADER *)L3)->DestinationAddress;
+    } else {
+        SourceAddress = (const UCHAR *)&((const IPV4_HEADER *)L3)->SourceAddress;
+        DestinationAddress = (const UCHAR *)&((const IPV4_HEADER *)L3)->DestinationAddress;
+    }
+
+    Flow->SourcePort = Ports[0];
+    Flow->DestinationPort = Ports[1];
+    RtlCopyMemory(
+        &Flow->SourceAddressTail,
+        SourceAddress + FlowPattern->AddressLength - sizeof(Flow->SourceAddressTail),
+        sizeof(Flow->SourceAddressTail));
+    RtlCopyMemory(
+        &Flow->DestinationAddressTail,
+        DestinationAddress + FlowPattern->AddressLength - sizeof(Flow->DestinationAddressTail),
+        sizeof(Flow->DestinationAddressTail));
+
+    if (Adapter->RxFlowVary & RxFlowVarySourcePort) {
+        Flow->SourcePort = htons((UINT16)(ntohs(Flow->SourcePort) + FlowIndex));
+    }
+    if (Adapter->RxFlowVary & RxFlowVaryDestinationPort) {
+        Flow->DestinationPort = htons((UINT16)(ntohs(Flow->DestinationPort) + FlowIndex));
+    }
+    if (Adapter->RxFlowVary & RxFlowVarySourceAddress) {
+        Flow->SourceAddressTail = htonl(ntohl(Flow->SourceAddressTail) + FlowIndex);
+    }
+    if (Adapter->RxFlowVary & RxFlowVaryDestinationAddress) {
+        Flow->DestinationAddressTail = htonl(ntohl(Flow->DestinationAddressTail) + FlowIndex);
+    }
+
+    Flow->RssHash = 0;
+    Flow->RssHashType = NDIS_HASH_IPV4;
+}
+
+static
+VOID
+MpReceiveWriteFlowTuple(
+    _In_ const RX_FLOW_PATTERN *FlowPattern,
+    _In_ const RX_FLOW *Flow,
+    _Inout_ UCHAR *Pkt
+    )
+{
+    UCHAR *L3 = Pkt + FlowPattern->L3Offset;
+    UINT16 *Ports = (UINT16 *)(Pkt + FlowPattern->L4Offset);
+    UCHAR *SourceAddress;
+    UCHAR *DestinationAddress;
+
+    if (FlowPattern->Ipv6) {
+        SourceAddress = (UCHAR *)&((IPV6_HEADER *)L3)->SourceAddress;
+        DestinationAddress = (UCHAR *)&((IPV6_HEADER *)L3)->DestinationAddress;
+    } else {
+        SourceAddress = (UCHAR *)&((IPV4_HEADER *)L3)->SourceAddress;
+        DestinationAddress = (UCHAR *)&((IPV4_HEADER *)L3)->DestinationAddress;
+    }
+
+    Ports[0] = Flow->SourcePort;
+    Ports[1] = Flow->DestinationPort;
+    RtlCopyMemory(
+        SourceAddress + FlowPattern->AddressLength - sizeof(Flow->SourceAddressTail),
+        &Flow->SourceAddressTail, sizeof(Flow->SourceAddressTail));
+    RtlCopyMemory(
+        DestinationAddress + FlowPattern->AddressLength - sizeof(Flow->DestinationAddressTail),
+        &Flow->DestinationAddressTail, sizeof(Flow->DestinationAddressTail));
+}
+
+static
+VOID
+MpReceiveInitializeFrame(
+    _Inout_ ADAPTER_RX_QUEUE *Rq,
+    _Out_writes_bytes_(min(Rq->PatternLength, DataLength)) UCHAR *Pkt,
+    _In_ UINT32 DataLength,
+    _Out_ UINT32 *RssHash,
+    _Out_ UINT32 *RssHashType
+    )
+{
+    const RX_FLOW_PATTERN *FlowPattern = Rq->FlowPattern;
+    UINT32 FlowCount;
+
+    *RssHash = Rq->RssHash;
+    *RssHashType = NDIS_HASH_IPV4;
+
+    if (FlowPattern == NULL) {
+        if (Rq->PatternLength > 0) {
+            //
+            // Reinitialize packet content. This is disabled by default, but
+            // needs to be enabled in scenarios where the upper protocol
+            // rewrites packets.
+            //
+            RtlCopyMemory(Pkt, Rq->PatternBuffer, min(Rq->PatternLength, DataLength));
+        }
+
+        return;
+    }
+
+    //
+    // Generate the next frame of the queue's flows. Only the IPv4 header
+    // checksum is updated: the miniport reports all checksums as validated.
+    //
+
+    RtlCopyMemory(Pkt, Rq->PatternBuffer, min(Rq->PatternLength, DataLength));
+
+    FlowCount = ReadUInt32Acquire(&Rq->FlowCount);
+    if (FlowCount > 0) {
+        const RX_FLOW *Flow = &Rq->Flows[Rq->FlowIndex++ % FlowCount];
+
+        MpReceiveWriteFlowTuple(FlowPattern, Flow, Pkt);
+        *RssHash = Flow->RssHash;
+        *RssHashType = Flow->RssHashType;
+    }
+
+    if (FlowPattern->Ipv6) {
+        IPV6_HEADER *Ipv6 = (IPV6_HEADER *)(Pkt + FlowPattern->L3Offset);
+
+        Ipv6->PayloadLength = htons((UINT16)(DataLength - FlowPattern->L4Offset));
+    } else {
+        IPV4_HEADER *Ipv4 = (IPV4_HEADER *)(Pkt + FlowPattern->L3Offset);
+
+        Ipv4->TotalLength = htons((UINT16)(DataLength - FlowPattern->L3Offset));
+        Ipv4->HeaderChecksum = 0;
+        Ipv4->HeaderChecksum = MpIpv4HeaderChecksum(Ipv4);
+    }
+
+    if (FlowPattern->IpProto == IPPROTO_UDP) {
+        UDP_HDR *Udp = (UDP_HDR *)(Pkt + FlowPattern->L4Offset);
+
+        Udp->uh_ulen = htons((UINT16)(DataLength - FlowPattern->L4Offset));
+    }
+}
+
+static
+UINT32
+MpReceiveReplayFrame(
+    _Inout_ ADAPTER_RX_QUEUE *Rq,
+    _Out_writes_to_(MAX_RX_FRAGMENTS + 1, return) RX_BUFFER_DESCRIPTOR *Buffers,
+    _Out_ UINT32 *RssHash,
+    _Out_ UINT32 *RssHashType
+    )
+{
+    UINT32 ReplayCount = ReadUInt32Acquire(&Rq->ReplayCount);
+    UINT32 FragmentLength = ReadUInt32NoFence(&Rq->FragmentLength);
+    const RX_REPLAY_FRAME *Frame;
+    const UCHAR *FrameData;
+    UINT32 DataLength;
+    UINT32 BufferCount;
+    UINT32 Index;
+
+    if (ReplayCount == 0) {
+        return 0;
+    }
+
+    //
+    // Replay the queue's next frame. During an RSS update, the start and count
+    // may be briefly inconsistent, so bound the index to the replay order.
+    //
+    Index = ReadUInt32NoFence(&Rq->ReplayStart) + Rq->ReplayIndex % ReplayCount;
+    if (Index >= Rq->ReplayFrameCount) {
+        Index = 0;
+    }
+
+    Frame = &Rq->ReplayFrames[Rq->ReplayOrder[Index]];
+    FrameData = Rq->ReplayData + Frame->Offset;
+    DataLength = Frame->Length;
+
+    if (FragmentLength == 0 || FragmentLength > Rq->BufferLength) {
+        FragmentLength = Rq->BufferLength;
+    }
+
+    BufferCount = (DataLength + FragmentLength - 1) / FragmentLength;
+    if (BufferCount > Rq->MaxFragments + 1) {
+        //
+        // Truncate frames that do not fit within the fragment limit.
+        //
+        BufferCount = Rq->MaxFragments + 1;
+        DataLength = BufferCount * FragmentLength;
+    }
+
+    if (HwRingConsPeek(Rq->HwRing) < BufferCount) {
+        return 0;
+    }
+
+    Rq->ReplayIndex++;
+
+    for (Index = 0; Index < BufferCount; Index++) {
+        Buffers[Index].HwRxDescriptor = *(UINT32 *)HwRingConsPopElement(Rq->HwRing);
+        Buffers[Index].DataOffset = 0;
+        Buffers[Index].DataLength = min(FragmentLength, DataLength - Index * FragmentLength);
+
+        RtlCopyMemory(
+            Rq->BufferArray + Buffers[Index].HwRxDescriptor, FrameData + Index * FragmentLength,
+            Buffers[Index].DataLength);
+    }
+
+    *RssHash = Frame->RssHash;
+    *RssHashType = Frame->RssHashType;
+
+    return BufferCount;
+}
+
+static
+UINT32
+MpReceiveGenerateFrame(
+    _Inout_ ADAPTER_RX_QUEUE *Rq,
+    _Out_writes_to_(MAX_RX_FRAGMENTS + 1, return) RX_BUFFER_DESCRIPTOR *Buffers,
+    _Out_ UINT32 *RssHash,
+    _Out_ UINT32 *RssHashType
+    )
+{
+    UCHAR Header[RTL_FIELD_SIZE(ADAPTER_CONTEXT, RxPattern)];
+    UINT32 FrameLength = ReadUInt32NoFence(&Rq->FrameLength);
+    UINT32 FragmentLength = ReadUInt32NoFence(&Rq->FragmentLength);
+    UINT32 DataLength = Rq->DataLength;
+    UINT32 HeaderLength;
+    UINT32 BufferCount;
+    UINT32 Offset;
+
+    if (Rq->ReplayFrames != NULL) {
+        return MpReceiveReplayFrame(Rq, Buffers, RssHash, RssHashType);
+    }
+
+    //
+    // Select the frame length from the WMI override, the frame length
+    // schedule, or the configured data length, in that order, and split the
+    // frame into buffers of at most the fragment length.
+    //
+
+    if (Rq->FrameLengths != NULL) {
+        DataLength = Rq->FrameLengths[Rq->FrameLengthIndex++ & (RX_SIZE_SCHEDULE_LENGTH - 1)];
+    }
+
+    if (FrameLength != 0) {
+        DataLength = FrameLength;
+    }
+
+    if (FragmentLength == 0 || FragmentLength > Rq->BufferLength) {
+        FragmentLength = Rq->BufferLength;
+    }
+
+    BufferCount = (DataLength + FragmentLength - 1) / FragmentLength;
+    if (BufferCount > Rq->MaxFragments + 1) {
+        //
+        // Truncate frames that do not fit within the fragment limit.
+        //
+        BufferCount = Rq->MaxFragments + 1;
+        DataLength = BufferCount * FragmentLength;
+    }
+
+    if (HwRingConsPeek(Rq->HwRing) < BufferCount) {
+        return 0;
+    }
+
+    for (UINT32 Index = 0; Index < BufferCount; Index++) {
+        Buffers[Index].HwRxDescriptor = *(UINT32 *)HwRingConsPopElement(Rq->HwRing);
+        Buffers[Index].DataOffset = 0;
+        Buffers[Index].DataLength = min(FragmentLength, DataLength - Index * FragmentLength);
+    }
+
+    //
+    // Headers spanning multiple buffers are generated in a scratch buffer and
+    // then scattered across the frame's buffers.
+    //
+    HeaderLength = min(Rq->PatternLength, DataLength);
+
+    if (HeaderLength <= Buffers[0].DataLength) {
+        MpReceiveInitializeFrame(
+            Rq, Rq->BufferArray + Buffers[0].HwRxDescriptor, DataLength, RssHash, RssHashType);
+        return BufferCount;
+    }
+
+    MpReceiveInitializeFrame(Rq, Header, DataLength, RssHash, RssHashType);
+
+    Offset = 0;
+    for (UINT32 Index = 0; Offset < HeaderLength; Index++) {
+        UINT32 CopyLength = min(Buffers[Index].DataLength, HeaderLength - Offset);
+
+        RtlCopyMemory(Rq->BufferArray + Buffers[Index].HwRxDescriptor, Header + Offset, CopyLength);
+        Offset += CopyLength;
+    }
+
+    return BufferCount;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpReceiveSetFlows(
+    _Inout_ ADAPTER_CONTEXT *Adapter
+    )
+{
+    const RX_FLOW_PATTERN *FlowPattern = &Adapter->RxFlowPattern;
+    UINT32 FlowCounts[MAX_RSS_QUEUES] = {0};
+    UCHAR Input[2 * sizeof(IN6_ADDR) + 2 * sizeof(UINT16)];
+    const UCHAR *L3 = Adapter->RxPattern + FlowPattern->L3Offset;
+    const UCHAR *SourceAddress;
+    const UCHAR *DestinationAddress;
+    BOOLEAN HashPorts;
+
+    if (Adapter->RxFlowCount == 0) {
+        return;
+    }
+
+    //
+    // Place each flow on the queue the RSS indirection table selects for the
+    // flow's Toeplitz hash, as hardware would. Ports are hashed only if the
+    // configured hash types include the pattern's transport protocol.
+    //
+
+    if (FlowPattern->Ipv6) {
+        SourceAddress = (const UCHAR *)&((const IPV6_HEADER *)L3)->SourceAddress;
+        DestinationAddress = (const UCHAR *)&((const IPV6_HEADER *)L3)->DestinationAddress;
+        HashPorts =
+            (FlowPattern->IpProto == IPPROTO_TCP &&
+                (Adapter->RssHashType & (NDIS_HASH_TCP_IPV6 | NDIS_HASH_TCP_IPV6_EX))) ||
+            (FlowPattern->IpProto == IPPROTO_UDP &&
+                (Adapter->RssHashType & (NDIS_HASH_UDP_IPV6 | NDIS_HASH_UDP_IPV6_EX)));
+    } else {
+        SourceAddress = (const UCHAR *)&((const IPV4_HEADER *)L3)->SourceAddress;
+        DestinationAddress = (const UCHAR *)&((const IPV4_HEADER *)L3)->DestinationAddress;
+        HashPorts =
+            (FlowPattern->IpProto == IPPROTO_TCP &&
+                (Adapter->RssHashType & NDIS_HASH_TCP_IPV4)) ||
+            (FlowPattern->IpProto == IPPROTO_UDP &&
+                (Adapter->RssHashType & NDIS_HASH_UDP_IPV4));
+    }
+
+    RtlCopyMemory(Input, SourceAddress, FlowPattern->AddressLength);
+    RtlCopyMemory(Input + FlowPattern->AddressLength, DestinationAddress, FlowPattern->AddressLength);
+
+    for (UINT32 FlowIndex = 0; FlowIndex < Adapter->RxFlowCount; FlowIndex++) {
+        UINT32 TailOffset = FlowPattern->AddressLength - sizeof(UINT32);
+        UINT32 InputLength = 2 * FlowPattern->AddressLength;
+        ADAPTER_RX_QUEUE *Rq;
+        RX_FLOW Flow;
+        ULONG QueueId;
+
+        MpReceiveGetFlowTuple(Adapter, FlowIndex, &Flow);
+
+        RtlCopyMemory(Input + TailOffset, &Flow.SourceAddressTail, sizeof(UINT32));
+        RtlCopyMemory(
+            Input + FlowPattern->AddressLength + TailOffset, &Flow.DestinationAddressTail,
+            sizeof(UINT32));
+
+        if (HashPorts) {
+            RtlCopyMemory(Input + InputLength, &Flow.SourcePort, sizeof(UINT16));
+            RtlCopyMemory(
+                Input + InputLength + sizeof(UINT16), &Flow.DestinationPort, sizeof(UINT16));
+            InputLength += 2 * sizeof(UINT16);
+            Flow.RssHashType =
+                FlowPattern->Ipv6 ?
+                    ((FlowPattern->IpProto == IPPROTO_TCP) ?
+                        NDIS_HASH_TCP_IPV6 : NDIS_HASH_UDP_IPV6) :
+                    ((FlowPattern->IpProto == IPPROTO_TCP) ?
+                        NDIS_HASH_TCP_IPV4 : NDIS_HASH_UDP_IPV4);
+        } else {
+            Flow.RssHashType = FlowPattern->Ipv6 ? NDIS_HASH_IPV6 : NDIS_HASH_IPV4;
+        }
+
+        Flow.RssHash =
+            MpRssToeplitzHash(
+                Adapter->RssHashSecretKey, Adapter->RssHashSecretKeySize, Input, InputLength);
+
+        QueueId = Adapter->IndirectionTable[Flow.RssHash & Adapter->IndirectionMask];
+        if (QueueId >= Adapter->NumRssQueues) {
+            continue;
+        }
+
+        //
+        // As with the indirection table itself, flows are updated in place
+        // without synchronizing with the data path, so frames generated during
+        // an RSS update may carry stale tuples.
+        //
+        Rq = &Adapter->RssQueues[QueueId].Rq;
+        Rq->Flows[FlowCounts[QueueId]++] = Flow;
+    }
+
+    for (ULONG Index = 0; Index < Adapter->NumRssQueues; Index++) {
+        ADAPTER_QUEUE *RssQueue = &Adapter->RssQueues[Index];
+
+        WriteUInt32Release(&RssQueue->Rq.FlowCount, FlowCounts[Index]);
+
+        //
+        // A queue with no flows receives no traffic.
+        //
+        if (FlowCounts[Index] == 0) {
+            RssQueue->HwActiveRx = FALSE;
+        }
+    }
+}
+
+static
+MDL *
+MpReceiveGetMdl(
+    _In_ const ADAPTER_RX_QUEUE *Rq,
+    _In_ UINT32 HwRxDescriptor
+    )
+{
+    return (MDL *)(Rq->MdlArray + (SIZE_T)(HwRxDescriptor / Rq->BufferLength) * Rq->MdlSize);
+}
+
 static
 VOID
 MpNdisReceive(
     ADAPTER_RX_QUEUE *Rq,
-    UINT32 HwRxDescriptor,
-    UINT32 DataOffset,
-    UINT32 DataLength,
-    COUNTED_NBL_CHAIN *NblChain
+    const RX_BUFFER_DESCRIPTOR *Buffers,
+    UINT32 BufferCount,
+    UINT32 RssHash,
+    UINT32 RssHashType,
+    XDP_NDIS_RX_NBL_CHAIN *NblChain
     )
 {
-    UINT32 DescriptorIndex = HwRxDescriptor / Rq->BufferLength;
-    NET_BUFFER_LIST *NetBufferList = Rq->NblArray[DescriptorIndex];
-    NET_BUFFER *NetBuffer = NET_BUFFER_LIST_FIRST_NB(NetBufferList);
+    NET_BUFFER_LIST *NetBufferList = XdpNdisRxAllocateNbl(&Rq->NblCache);
+    XDP_FRAME_RX_METADATA RxMetadata = {0};
+    NET_BUFFER *NetBuffer;
+    MDL *Mdl;
+    UINT32 DataLength = Buffers[0].DataLength;
+
+    if (NetBufferList == NULL) {
+        Rq->Stats.RxDrops++;
+        for (UINT32 Index = 0; Index < BufferCount; Index++) {
+            MpReceiveRecycle(Rq, Buffers[Index].HwRxDescriptor);
+        }
+        return;
+    }
 
-    NET_BUFFER_DATA_OFFSET(NetBuffer) = DataOffset;
-    NET_BUFFER_DATA_LENGTH(NetBuffer) = DataLength;
+    NetBuffer = NET_BUFFER_LIST_FIRST_NB(NetBufferList);
+    Mdl = MpReceiveGetMdl(Rq, Buffers[0].HwRxDescriptor);
+    NET_BUFFER_FIRST_MDL(NetBuffer) = Mdl;
+    NET_BUFFER_CURRENT_MDL(NetBuffer) = Mdl;
 
-    NET_BUFFER_LIST_SET_HASH_VALUE(NetBufferList, Rq->RssHash);
-    NET_BUFFER_LIST_SET_HASH_TYPE(NetBufferList, NDIS_HASH_IPV4);
+    //
+    // Chain the MDLs of a fragmented frame's remaining buffers behind the
+    // first buffer's MDL, trimming each non-terminal MDL to its data. The
+    // chain is undone when the NBL is released to the cache.
+    //
+    for (UINT32 Index = 1; Index < BufferCount; Index++) {
+        MDL *FragmentMdl = MpReceiveGetMdl(Rq, Buffers[Index].HwRxDescriptor);
+
+        ASSERT(Buffers[Index].DataOffset == 0);
+        Mdl->ByteCount = Buffers[Index - 1].DataOffset + Buffers[Index - 1].DataLength;
+        Mdl->Next = FragmentMdl;
+        Mdl = FragmentMdl;
+        DataLength += Buffers[Index].DataLength;
+    }
+
+    NET_BUFFER_DATA_OFFSET(NetBuffer) = Buffers[0].DataOffset;
+    NET_BUFFER_CURRENT_MDL_OFFSET(NetBuffer) = Buffers[0].DataOffset;
+    NET_BUFFER_DATA_LENGTH(NetBuffer) = DataLength;
 
-    CountedNblChainAppend(NblChain, NetBufferList);
+    //
+    // Declare all checksum validation has been offloaded, matching the RX
+    // metadata reported to XDP.
+    //
+    RxMetadata.RssHash = RssHash;
+    RxMetadata.RssHashType = RssHashType;
+    RxMetadata.Layer3Checksum = XdpFrameRxChecksumEvaluationSucceeded;
+    RxMetadata.Layer4Checksum = XdpFrameRxChecksumEvaluationSucceeded;
+    XdpNdisRxSetNblInfo(
+        NetBufferList, &RxMetadata,
+        Rq->BufferArray + Buffers[0].HwRxDescriptor + Buffers[0].DataOffset,
+        Buffers[0].DataLength);
+
+    *NblChain->Tail = NetBufferList;
+    NblChain->Tail = &NET_BUFFER_LIST_NEXT_NBL(NetBufferList);
+    NblChain->Count++;
 
     Rq->Stats.RxFrames++;
     Rq->Stats.RxBytes += DataLength;
 }
 
+static
+UINT32
+MpReceiveReleaseNbl(
+    _In_ ADAPTER_RX_QUEUE *Rq,
+    _In_ NET_BUFFER_LIST *NetBufferList,
+    _Out_writes_to_(MAX_RX_FRAGMENTS + 1, return) UINT32 *HwRxDescriptors
+    )
+{
+    MDL *Mdls[MAX_RX_FRAGMENTS + 1];
+    UINT32 Count;
+
+    //
+    // Release the NBL to the cache, which unchains the buffers of fragmented
+    // frames and restores their MDLs.
+    //
+    Count = XdpNdisRxReleaseNbl(&Rq->NblCache, NetBufferList, Mdls, RTL_NUMBER_OF(Mdls));
+
+    for (UINT32 Index = 0; Index < Count; Index++) {
+        HwRxDescriptors[Index] =
+            (UINT32)((UCHAR *)MmGetMdlVirtualAddress(Mdls[Index]) - Rq->BufferArray);
+    }
+
+    return Count;
+}
+
 static
 UINT32
 MpReceiveProcessBatch(
     _In_ ADAPTER_RX_QUEUE *Rq,
-    _Inout_ UINT32 *StartIndex,
-    _Inout_ COUNTED_NBL_CHAIN *NblChain
+    _In_ UINT32 FrameCount,
+    _Inout_ XDP_NDIS_RX_NBL_CHAIN *NblChain
     )
 {
     XDP_RING *FrameRing = Rq->FrameRing;
+    XDP_RING *FragmentRing = Rq->FragmentRing;
+    UINT32 FrameIndex = Rq->XdpBatch.InspectedFrameIndex;
+    UINT32 FragmentIndex = Rq->XdpBatch.InspectedFragmentIndex;
+    RX_BUFFER_DESCRIPTOR Buffers[MAX_RX_FRAGMENTS + 1];
     XDP_FRAME *Frame;
     XDP_BUFFER *Buffer;
     XDP_FRAME_RX_ACTION *Action;
@@ -123,27 +632,60 @@ MpReceiveProcessBatch(
     UINT32 XdpAbsorbed = 0;
 
     //
-    // Inspect a batch of frames.
+    // Describe the batch's PASS frames with NBLs from the cache. Frames that
+    // cannot be described are converted into drops.
     //
-    XdpReceive(Rq->XdpRxQueue);
+    XdpNdisRxPassFrames(
+        &Rq->NblCache, &Rq->Extensions, FrameRing, FragmentRing, FrameIndex, FrameCount,
+        FragmentIndex, NblChain);
 
     //
-    // Perform action for each frame in the batch.
+    // Perform action for each frame in the inspected batch.
     //
-    while (*StartIndex != FrameRing->ProducerIndex) {
-        UINT32 FrameRingIndex = (*StartIndex)++ & FrameRing->Mask;
+    while (FrameCount-- > 0) {
+        UINT32 FrameRingIndex = FrameIndex++ & FrameRing->Mask;
+        UINT32 BufferCount = 1;
+        UINT32 FrameLength;
+
         Frame = XdpRingGetElement(FrameRing, FrameRingIndex);
         Buffer = &Frame->Buffer;
-        Action = XdpGetRxActionExtension(Frame, &Rq->RxActionExtension);
-        Va = XdpGetVirtualAddressExtension(Buffer, &Rq->BufferVaExtension);
+        Action = XdpGetRxActionExtension(Frame, &Rq->Extensions.RxActionExtension);
+        Va = XdpGetVirtualAddressExtension(Buffer, &Rq->Extensions.VaExtension);
         HwRxDescriptor = (UINT32)(Va->VirtualAddress - Rq->BufferArray);
 
+        Buffers[0].HwRxDescriptor = HwRxDescriptor;
+        Buffers[0].DataOffset = Buffer->DataOffset;
+        Buffers[0].DataLength = Buffer->DataLength;
+        FrameLength = Buffer->DataLength;
+
+        if (FragmentRing != NULL) {
+            XDP_FRAME_FRAGMENT *Fragment =
+                XdpGetFragmentExtension(Frame, &Rq->Extensions.FragmentExtension);
+
+            for (UINT32 Index = 0; Index < Fragment->FragmentBufferCount; Index++) {
+                XDP_BUFFER *FragmentBuffer =
+                    XdpRingGetElement(
+                        FragmentRing, FragmentIndex++ & FragmentRing->Mask);
+                XDP_BUFFER_VIRTUAL_ADDRESS *FragmentVa =
+                    XdpGetVirtualAddressExtension(FragmentBuffer, &Rq->Extensions.VaExtension);
+
+                Buffers[BufferCount].HwRxDescriptor =
+                    (UINT32)(FragmentVa->VirtualAddress - Rq->BufferArray);
+                Buffers[BufferCount].DataOffset = FragmentBuffer->DataOffset;
+                Buffers[BufferCount].DataLength = FragmentBuffer->DataLength;
+                FrameLength += FragmentBuffer->DataLength;
+                BufferCount++;
+            }
+        }
+
         switch (Action->RxAction) {
         case XDP_RX_ACTION_PASS:
             //
-            // Pass the frame onto the regular NDIS receive path.
+            // The frame's NBL was appended to the chain for the regular NDIS
+            // receive path.
             //
-            MpNdisReceive(Rq, HwRxDescriptor, Buffer->DataOffset, Buffer->DataLength, NblChain);
+            Rq->Stats.RxFrames++;
+            Rq->Stats.RxBytes += FrameLength;
             break;
 
         case XDP_RX_ACTION_DROP:
@@ -153,14 +695,29 @@ MpReceiveProcessBatch(
             //
             XdpAbsorbed++;
             Rq->Stats.RxFrames++;
-            Rq->Stats.RxBytes += Buffer->DataLength;
-            MpReceiveRecycle(Rq, HwRxDescriptor);
+            Rq->Stats.RxBytes += FrameLength;
+            for (UINT32 Index = 0; Index < BufferCount; Index++) {
+                MpReceiveRecycle(Rq, Buffers[Index].HwRxDescriptor);
+            }
             break;
 
         case XDP_RX_ACTION_TX:
+            XdpAbsorbed++;
+
+            //
+            // The paired TX queue transmits single-buffer frames only, so drop
+            // fragmented frames.
+            //
+            if (BufferCount > 1) {
+                Rq->Stats.RxDrops++;
+                for (UINT32 Index = 0; Index < BufferCount; Index++) {
+                    MpReceiveRecycle(Rq, Buffers[Index].HwRxDescriptor);
+                }
+                break;
+            }
+
             Rq->Stats.RxFrames++;
             Rq->Stats.RxBytes += Buffer->DataLength;
-            XdpAbsorbed++;
             Rq->RxTxArray[Rq->RxTxIndex++] = FrameRingIndex;
             break;
 
@@ -184,7 +741,7 @@ MpReceiveProcessBatch(
         if (Count > 0) {
             for (UINT32 Index = 0; Index < Count; Index++) {
                 Frame = XdpRingGetElement(FrameRing, Rq->RxTxArray[Index]);
-                Va = XdpGetVirtualAddressExtension(&Frame->Buffer, &Rq->BufferVaExtension);
+                Va = XdpGetVirtualAddressExtension(&Frame->Buffer, &Rq->Extensions.VaExtension);
 
                 //
                 // XDPMP is a software device not capable of DMA, so just use
@@ -205,8 +762,8 @@ MpReceiveProcessBatch(
             for (UINT32 Index = Count; Index < Rq->RxTxIndex; Index++) {
                 Frame = XdpRingGetElement(FrameRing, Rq->RxTxArray[Index]);
                 Buffer = &Frame->Buffer;
-                Action = XdpGetRxActionExtension(Frame, &Rq->RxActionExtension);
-                Va = XdpGetVirtualAddressExtension(Buffer, &Rq->BufferVaExtension);
+                Action = XdpGetRxActionExtension(Frame, &Rq->Extensions.RxActionExtension);
+                Va = XdpGetVirtualAddressExtension(Buffer, &Rq->Extensions.VaExtension);
                 HwRxDescriptor = (UINT32)(Va->VirtualAddress - Rq->BufferArray);
 
                 MpReceiveRecycle(Rq, HwRxDescriptor);
@@ -224,48 +781,97 @@ UINT32
 MpReceiveUseXdpMultiFrameApi(
     ADAPTER_RX_QUEUE *Rq,
     UINT32 FrameQuota,
-    COUNTED_NBL_CHAIN *NblChain
+    XDP_NDIS_RX_NBL_CHAIN *NblChain
     )
 {
-    UINT32 *HwRxDescriptor;
+    RX_BUFFER_DESCRIPTOR Buffers[MAX_RX_FRAGMENTS + 1];
+    UINT32 BufferCount;
+    UINT32 RssHash;
+    UINT32 RssHashType;
     UINT32 XdpAbsorbed = 0;
 
     if (ReadUInt32Acquire((UINT32 *)&Rq->XdpState) == XDP_STATE_ACTIVE) {
-        XDP_RING *FrameRing = Rq->FrameRing;
-        UINT32 StartIndex = FrameRing->ProducerIndex;
+        XDP_RING *FragmentRing = Rq->FragmentRing;
+        UINT32 InspectedCount;
+
+        //
+        // Offer frames left in the rings under backpressure to XDP again
+        // before receiving new frames behind them.
+        //
+        InspectedCount = XdpRxBatchInspect(&Rq->XdpBatch);
+        if (InspectedCount > 0) {
+            XdpAbsorbed += MpReceiveProcessBatch(Rq, InspectedCount, NblChain);
+        }
 
-        while (FrameQuota-- > 0 && HwRingConsPeek(Rq->HwRing) > 0) {
+        while (FrameQuota-- > 0 && XdpRxBatchCanCommitFrame(&Rq->XdpBatch)) {
             XDP_FRAME *Frame;
             XDP_BUFFER_VIRTUAL_ADDRESS *Va;
+            XDP_BUFFER_MDL *BufferMdl;
+            XDP_FRAME_RX_METADATA *RxMetadata;
 
-            HwRxDescriptor = HwRingConsPopElement(Rq->HwRing);
-
-            if (Rq->PatternLength > 0) {
-                //
-                // Reinitialize packet content. This is disabled by default, but
-                // needs to be enabled in scenarios where the upper protocol
-                // rewrites packets.
-                //
-                UCHAR *Pkt = Rq->BufferArray + *HwRxDescriptor;
-                RtlCopyMemory(Pkt, Rq->PatternBuffer, Rq->PatternLength);
+            BufferCount = MpReceiveGenerateFrame(Rq, Buffers, &RssHash, &RssHashType);
+            if (BufferCount == 0) {
+                break;
             }
 
-            Frame = XdpRingGetElement(FrameRing, FrameRing->ProducerIndex++ & FrameRing->Mask);
+            Frame = XdpRxBatchGetFrame(&Rq->XdpBatch);
 
-            Frame->Buffer.DataLength = Rq->DataLength;
+            Frame->Buffer.DataLength = Buffers[0].DataLength;
             Frame->Buffer.BufferLength = Rq->BufferLength;
             Frame->Buffer.DataOffset = 0;
 
-            Va = XdpGetVirtualAddressExtension(&Frame->Buffer, &Rq->BufferVaExtension);
-            Va->VirtualAddress = Rq->BufferArray + *HwRxDescriptor;
+            Va = XdpGetVirtualAddressExtension(&Frame->Buffer, &Rq->Extensions.VaExtension);
+            Va->VirtualAddress = Rq->BufferArray + Buffers[0].HwRxDescriptor;
+            BufferMdl = XdpGetMdlExtension(&Frame->Buffer, &Rq->Extensions.MdlExtension);
+            BufferMdl->Mdl = MpReceiveGetMdl(Rq, Buffers[0].HwRxDescriptor);
+            BufferMdl->MdlOffset = 0;
+
+            if (FragmentRing != NULL) {
+                for (UINT32 Index = 1; Index < BufferCount; Index++) {
+                    XDP_BUFFER *Fragment =
+                        XdpRingGetElement(
+                            FragmentRing, FragmentRing->ProducerIndex++ & FragmentRing->Mask);
+
+                    Fragment->DataLength = Buffers[Index].DataLength;
+                    Fragment->BufferLength = Rq->BufferLength;
+                    Fragment->DataOffset = 0;
+
+                    Va = XdpGetVirtualAddressExtension(Fragment, &Rq->Extensions.VaExtension);
+                    Va->VirtualAddress = Rq->BufferArray + Buffers[Index].HwRxDescriptor;
+                    BufferMdl = XdpGetMdlExtension(Fragment, &Rq->Extensions.MdlExtension);
+                    BufferMdl->Mdl = MpReceiveGetMdl(Rq, Buffers[Index].HwRxDescriptor);
+                    BufferMdl->MdlOffset = 0;
+                }
+
+                XdpGetFragmentExtension(
+                    Frame, &Rq->Extensions.FragmentExtension)->FragmentBufferCount =
+                        (UINT8)(BufferCount - 1);
+            }
+
+            //
+            // Report the same hash and checksum validation results that are
+            // indicated to NDIS for frames passed up the regular receive path.
+            //
+            RxMetadata = XdpGetRxMetadataExtension(Frame, &Rq->Extensions.RxMetadataExtension);
+            RxMetadata->RssHash = RssHash;
+            RxMetadata->RssHashType = RssHashType;
+            RxMetadata->Layer3Checksum = XdpFrameRxChecksumEvaluationSucceeded;
+            RxMetadata->Layer4Checksum = XdpFrameRxChecksumEvaluationSucceeded;
+            RxMetadata->CoalescedSegmentCount = 0;
 
-            if (XdpRingFree(FrameRing) == 0) {
-                XdpAbsorbed += MpReceiveProcessBatch(Rq, &StartIndex, NblChain);
+            //
+            // Inspection starts as soon as a sub-batch is ready, while the
+            // headers of its frames are still in cache.
+            //
+            InspectedCount = XdpRxBatchCommitFrame(&Rq->XdpBatch);
+            if (InspectedCount > 0) {
+                XdpAbsorbed += MpReceiveProcessBatch(Rq, InspectedCount, NblChain);
             }
         }
 
-        if (XdpRingCount(FrameRing) > 0) {
-            XdpAbsorbed += MpReceiveProcessBatch(Rq, &StartIndex, NblChain);
+        InspectedCount = XdpRxBatchInspect(&Rq->XdpBatch);
+        if (InspectedCount > 0) {
+            XdpAbsorbed += MpReceiveProcessBatch(Rq, InspectedCount, NblChain);
         }
 
         if (Rq->NeedFlush) {
@@ -273,26 +879,56 @@ MpReceiveUseXdpMultiFrameApi(
             XdpFlushReceive(Rq->XdpRxQueue);
         }
     } else {
-        while (FrameQuota-- > 0 && HwRingConsPeek(Rq->HwRing) > 0) {
-            HwRxDescriptor = HwRingConsPopElement(Rq->HwRing);
-
-            if (Rq->PatternLength > 0) {
-                //
-                // Reinitialize packet content. This is disabled by default, but
-                // needs to be enabled in scenarios where the upper protocol
-                // rewrites packets.
-                //
-                UCHAR *Pkt = Rq->BufferArray + *HwRxDescriptor;
-                RtlCopyMemory(Pkt, Rq->PatternBuffer, Rq->PatternLength);
+        while (FrameQuota-- > 0) {
+            BufferCount = MpReceiveGenerateFrame(Rq, Buffers, &RssHash, &RssHashType);
+            if (BufferCount == 0) {
+                break;
             }
 
-            MpNdisReceive(Rq, *HwRxDescriptor, 0, Rq->DataLength, NblChain);
+            MpNdisReceive(Rq, Buffers, BufferCount, RssHash, RssHashType, NblChain);
         }
     }
 
     return XdpAbsorbed;
 }
 
+static
+VOID
+MpReceiveReleaseHeldFrames(
+    _In_ ADAPTER_RX_QUEUE *Rq
+    )
+{
+    XDP_RING *FrameRing = Rq->FrameRing;
+    XDP_RING *FragmentRing = Rq->FragmentRing;
+
+    //
+    // Return the hardware descriptors of frames XDP left in the rings under
+    // backpressure before the rings are released.
+    //
+    while (XdpRingCount(FrameRing) > 0) {
+        XDP_FRAME *Frame =
+            XdpRingGetElement(FrameRing, FrameRing->ConsumerIndex++ & FrameRing->Mask);
+        XDP_BUFFER_VIRTUAL_ADDRESS *Va =
+            XdpGetVirtualAddressExtension(&Frame->Buffer, &Rq->Extensions.VaExtension);
+
+        MpReceiveRecycle(Rq, (UINT32)(Va->VirtualAddress - Rq->BufferArray));
+
+        if (FragmentRing != NULL) {
+            XDP_FRAME_FRAGMENT *Fragment =
+                XdpGetFragmentExtension(Frame, &Rq->Extensions.FragmentExtension);
+
+            for (UINT32 Index = 0; Index < Fragment->FragmentBufferCount; Index++) {
+                XDP_BUFFER *FragmentBuffer =
+                    XdpRingGetElement(
+                        FragmentRing, FragmentRing->ConsumerIndex++ & FragmentRing->Mask);
+
+                Va = XdpGetVirtualAddressExtension(FragmentBuffer, &Rq->Extensions.VaExtension);
+                MpReceiveRecycle(Rq, (UINT32)(Va->VirtualAddress - Rq->BufferArray));
+            }
+        }
+    }
+}
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
 MpReceive(
@@ -301,9 +937,9 @@ MpReceive(
     _Inout_ XDP_POLL_RECEIVE_DATA *XdpPoll
     )
 {
-    COUNTED_NBL_CHAIN NblChain;
+    XDP_NDIS_RX_NBL_CHAIN NblChain;
 
-    CountedNblChainInitialize(&NblChain);
+    XdpNdisRxInitializeNblChain(&NblChain);
 
     ASSERT(Rq->RecycleIndex == 0);
     ASSERT(Rq->RxTxIndex == 0);
@@ -312,6 +948,7 @@ MpReceive(
     // First, check if the XDP state needs to be updated.
     //
     if (ReadUInt32Acquire((UINT32 *)&Rq->XdpState) == XDP_STATE_DELETE_PENDING) {
+        MpReceiveReleaseHeldFrames(Rq);
         Rq->XdpState = XDP_STATE_INACTIVE;
         KeSetEvent(Rq->DeleteComplete, 0, FALSE);
     }
@@ -329,8 +966,16 @@ MpReceive(
             Poll->NumberOfIndicatedNbls = NblChain.Count;
         } else {
             while (NblChain.Head != NULL) {
-                MpReceiveRecycle(Rq, (UINT32)(ULONG_PTR)NblChain.Head->MiniportReserved[1]);
-                NblChain.Head = NblChain.Head->Next;
+                NET_BUFFER_LIST *NetBufferList = NblChain.Head;
+                UINT32 HwRxDescriptors[MAX_RX_FRAGMENTS + 1];
+                UINT32 Count;
+
+                NblChain.Head = NetBufferList->Next;
+                Count = MpReceiveReleaseNbl(Rq, NetBufferList, HwRxDescriptors);
+
+                for (UINT32 Index = 0; Index < Count; Index++) {
+                    MpReceiveRecycle(Rq, HwRxDescriptors[Index]);
+                }
             }
         }
     }
@@ -352,7 +997,7 @@ MpReturnNetBufferLists(
 {
     ADAPTER_CONTEXT *Adapter = (ADAPTER_CONTEXT *)MiniportAdapterContext;
     ADAPTER_RX_QUEUE *BatchRq = NULL;
-    UINT32 HwDescriptors[32];
+    UINT32 HwDescriptors[32 + MAX_RX_FRAGMENTS + 1];
     UINT32 HwDescriptorCount = 0;
     UINT32 NblCount = 0;
 
@@ -364,8 +1009,10 @@ MpReturnNetBufferLists(
     //
 
     while (NetBufferLists != NULL) {
-        ADAPTER_RX_QUEUE *Rq = NetBufferLists->MiniportReserved[0];
+        NET_BUFFER_LIST *NetBufferList = NetBufferLists;
+        ADAPTER_RX_QUEUE *Rq = NetBufferList->MiniportReserved[0];
 
+        NetBufferLists = NetBufferLists->Next;
         NblCount++;
 
         //
@@ -379,13 +1026,12 @@ MpReturnNetBufferLists(
             BatchRq = Rq;
         }
 
-        HwDescriptors[HwDescriptorCount] = (UINT32)(ULONG_PTR)NetBufferLists->MiniportReserved[1];
+        HwDescriptorCount +=
+            MpReceiveReleaseNbl(Rq, NetBufferList, &HwDescriptors[HwDescriptorCount]);
 
-        if (++HwDescriptorCount == RTL_NUMBER_OF(HwDescriptors)) {
+        if (HwDescriptorCount >= RTL_NUMBER_OF(HwDescriptors) - MAX_RX_FRAGMENTS) {
             MpHwReceiveReturn(BatchRq, HwDescriptors, &HwDescriptorCount);
         }
-
-        NetBufferLists = NetBufferLists->Next;
     }
 
     if (HwDescriptorCount > 0) {
@@ -400,16 +1046,21 @@ MpCleanupReceiveQueue(
     _Inout_ ADAPTER_RX_QUEUE *Rq
     )
 {
-    if (Rq->NblArray != NULL) {
-        for (UINT32 Index = 0; Index < Rq->NumBuffers; Index++) {
-#pragma warning(suppress:6001) // Rq->NblArray is initialized.
-            if (Rq->NblArray[Index] != NULL) {
-                NdisFreeNetBufferList(Rq->NblArray[Index]);
-            }
-        }
+    XdpNdisRxCleanupNblCache(&Rq->NblCache);
+
+    if (Rq->MdlArray != NULL) {
+        ExFreePoolWithTag(Rq->MdlArray, POOLTAG_RXBUFFER);
+        Rq->MdlArray = NULL;
+    }
+
+    if (Rq->FrameLengths != NULL) {
+        ExFreePoolWithTag(Rq->FrameLengths, POOLTAG_RXBUFFER);
+        Rq->FrameLengths = NULL;
+    }
 
-        ExFreePoolWithTag(Rq->NblArray, POOLTAG_RXBUFFER);
-        Rq->NblArray = NULL;
+    if (Rq->Flows != NULL) {
+        ExFreePoolWithTag(Rq->Flows, POOLTAG_RXBUFFER);
+        Rq->Flows = NULL;
     }
 
     if (Rq->RxTxArray != NULL) {
@@ -449,6 +1100,10 @@ MpInitializeReceiveQueue(
     Rq->BufferLength = Adapter->RxBufferLength;
     Rq->BufferMask = ~(Rq->BufferLength - 1);
     Rq->DataLength = Adapter->RxDataLength;
+    Rq->MaxFragments = Adapter->RxMaxFragments;
+    Rq->InspectBatchSize = Adapter->RxInspectBatch;
+    Rq->FrameLength = Adapter->RxFrame.FrameLength;
+    Rq->FragmentLength = Adapter->RxFrame.FragmentLength;
     Rq->NblRundown = Adapter->NblRundown;
     Rq->Tq = &RssQueue->Tq;
 
@@ -468,6 +1123,15 @@ MpInitializeReceiveQueue(
         goto Exit;
     }
 
+    Status =
+        HwRingSetCompletionModel(
+            Rq->HwRing, Adapter->HwCompletionLatencyUs, Adapter->HwCompletionBatch,
+            Adapter->HwInterruptCoalesceUs);
+    if (Status != STATUS_SUCCESS) {
+        Status = NDIS_STATUS_RESOURCES;
+        goto Exit;
+    }
+
     Rq->RecycleArray =
         ExAllocatePoolZero(
             NonPagedPoolNx, Rq->NumBuffers * sizeof(*Rq->RecycleArray), POOLTAG_RXBUFFER);
@@ -484,61 +1148,114 @@ MpInitializeReceiveQueue(
         goto Exit;
     }
 
-    Rq->NblArray =
+    Rq->MdlSize = Adapter->MdlSize;
+    Rq->MdlArray =
         ExAllocatePoolZero(
-            NonPagedPoolNx, Rq->NumBuffers * sizeof(*Rq->NblArray), POOLTAG_RXBUFFER);
-    if (Rq->NblArray == NULL) {
+            NonPagedPoolNx, (SIZE_T)Rq->NumBuffers * (SIZE_T)Rq->MdlSize, POOLTAG_RXBUFFER);
+    if (Rq->MdlArray == NULL) {
         Status = NDIS_STATUS_RESOURCES;
         goto Exit;
     }
 
+    //
+    // Each NBL describes at least one buffer, so the cache never runs dry.
+    //
+    Status =
+        XdpNdisRxInitializeNblCache(
+            &Rq->NblCache, Adapter->RxNblPool, Adapter->MiniportHandle, Rq->NumBuffers,
+            Rq->BufferLength);
+    if (Status != NDIS_STATUS_SUCCESS) {
+        goto Exit;
+    }
+
+    for (NET_BUFFER_LIST *NetBufferList = Rq->NblCache.Free; NetBufferList != NULL;
+            NetBufferList = NET_BUFFER_LIST_NEXT_NBL(NetBufferList)) {
+        NetBufferList->MiniportReserved[0] = (VOID *)Rq;
+    }
+
     Rq->PatternBuffer = Adapter->RxPattern;
     Rq->PatternLength = Adapter->RxPatternCopy ? PatternLength : 0;
 
-    for (UINT32 i = 0; i < Rq->NumBuffers; i++) {
-        UINT32 *Descriptor = HwRingGetElement(Rq->HwRing, i & Rq->HwRing->Mask);
-        NET_BUFFER_LIST *NetBufferList;
-        NET_BUFFER *NetBuffer;
-        MDL *Mdl;
-        NDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO *CsoInfo;
-
-        *Descriptor = i * Rq->BufferLength;
+    if (Adapter->RxFlowCount > 0 || Adapter->RxSizeMixCount > 0) {
+        Rq->FlowPattern = &Adapter->RxFlowPattern;
+        Rq->PatternLength = Adapter->RxPatternLength;
+    }
 
-#pragma warning(push) // i is always less than Rq->NumBuffers
-#pragma warning(disable:6385)
-#pragma warning(disable:6386)
-        Rq->NblArray[i] =
-            NdisAllocateNetBufferList(Adapter->RxNblPool, (USHORT)Adapter->MdlSize, 0);
-        if (Rq->NblArray[i] == NULL) {
-            Status = STATUS_NO_MEMORY;
+    if (Adapter->RxFlowCount > 0) {
+        Rq->Flows =
+            ExAllocatePoolZero(
+                NonPagedPoolNx, Adapter->RxFlowCount * sizeof(*Rq->Flows), POOLTAG_RXBUFFER);
+        if (Rq->Flows == NULL) {
+            Status = NDIS_STATUS_RESOURCES;
             goto Exit;
         }
 
-        NetBufferList = Rq->NblArray[i];
-#pragma warning(pop)
-        NetBufferList->SourceHandle = Adapter->MiniportHandle;
-        NetBufferList->MiniportReserved[0] = (VOID *)Rq;
-        NetBufferList->MiniportReserved[1] = (VOID *)*Descriptor;
+        //
+        // Until RSS is configured, every queue generates every flow.
+        //
+        for (UINT32 Index = 0; Index < Adapter->RxFlowCount; Index++) {
+            MpReceiveGetFlowTuple(Adapter, Index, &Rq->Flows[Index]);
+        }
+        Rq->FlowCount = Adapter->RxFlowCount;
+    }
 
-        Mdl = (MDL *)NET_BUFFER_LIST_CONTEXT_DATA_START(NetBufferList);
-        MmInitializeMdl(Mdl, Rq->BufferArray + *Descriptor, Adapter->RxBufferLength);
-        MmBuildMdlForNonPagedPool(Mdl);
-        NetBuffer = NET_BUFFER_LIST_FIRST_NB(NetBufferList);
-        NET_BUFFER_FIRST_MDL(NetBuffer) = Mdl;
-        NET_BUFFER_CURRENT_MDL(NetBuffer) = Mdl;
+    if (Adapter->RxReplayFrameCount > 0) {
+        //
+        // Until RSS is configured, every queue replays every frame.
+        //
+        Rq->ReplayData = Adapter->RxReplayData;
+        Rq->ReplayFrames = Adapter->RxReplayFrames;
+        Rq->ReplayOrder = Adapter->RxReplayOrder;
+        Rq->ReplayFrameCount = Adapter->RxReplayFrameCount;
+        Rq->ReplayStart = 0;
+        Rq->ReplayCount = Adapter->RxReplayFrameCount;
+    }
 
-        NET_BUFFER_LIST_SET_HASH_FUNCTION(NetBufferList, NdisHashFunctionToeplitz);
+    if (Adapter->RxSizeMixCount > 0) {
+        INT32 Current[MAX_RX_SIZE_MIX] = {0};
+        INT32 TotalWeight = 0;
+
+        Rq->FrameLengths =
+            ExAllocatePoolZero(
+                NonPagedPoolNx, RX_SIZE_SCHEDULE_LENGTH * sizeof(*Rq->FrameLengths),
+                POOLTAG_RXBUFFER);
+        if (Rq->FrameLengths == NULL) {
+            Status = NDIS_STATUS_RESOURCES;
+            goto Exit;
+        }
+
+        for (UINT32 Index = 0; Index < Adapter->RxSizeMixCount; Index++) {
+            TotalWeight += (INT32)Adapter->RxSizeMix[Index].Weight;
+        }
 
         //
-        // Declare all checksum validation has been offloaded. Implementation
-        // detail: the TCPIP stack will examine each succeeded bit only if it
-        // matches the protocol in the header.
+        // Interleave the frame lengths in proportion to their weights using
+        // smooth weighted round-robin selection.
         //
-        CsoInfo = (NDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO *)
-            &NET_BUFFER_LIST_INFO(NetBufferList, TcpIpChecksumNetBufferListInfo);
-        CsoInfo->Receive.IpChecksumSucceeded = TRUE;
-        CsoInfo->Receive.TcpChecksumSucceeded = TRUE;
-        CsoInfo->Receive.UdpChecksumSucceeded = TRUE;
+        for (UINT32 Slot = 0; Slot < RX_SIZE_SCHEDULE_LENGTH; Slot++) {
+            UINT32 Selected = 0;
+
+            for (UINT32 Index = 0; Index < Adapter->RxSizeMixCount; Index++) {
+                Current[Index] += (INT32)Adapter->RxSizeMix[Index].Weight;
+                if (Current[Index] > Current[Selected]) {
+                    Selected = Index;
+                }
+            }
+
+            Current[Selected] -= TotalWeight;
+            Rq->FrameLengths[Slot] = Adapter->RxSizeMix[Selected].Length;
+        }
+    }
+
+    for (UINT32 i = 0; i < Rq->NumBuffers; i++) {
+        UINT32 *Descriptor = HwRingGetElement(Rq->HwRing, i & Rq->HwRing->Mask);
+        MDL *Mdl;
+
+        *Descriptor = i * Rq->BufferLength;
+
+        Mdl = MpReceiveGetMdl(Rq, *Descriptor);
+        MmInitializeMdl(Mdl, Rq->BufferArray + *Descriptor, Rq->BufferLength);
+        MmBuildMdlForNonPagedPool(Mdl);
 
         //
         // Initialize packet content.
@@ -575,6 +1292,7 @@ MpXdpCreateRxQueue(
 {
     ADAPTER_CONTEXT *Adapter = (ADAPTER_CONTEXT *)InterfaceContext;
     const XDP_QUEUE_INFO *QueueInfo;
+    const XDP_HOOK_ID *HookId;
     ADAPTER_QUEUE *AdapterQueue;
     ADAPTER_RX_QUEUE *Rq;
     XDP_RX_CAPABILITIES RxCapabilities;
@@ -591,15 +1309,33 @@ MpXdpCreateRxQueue(
     }
 
     AdapterQueue = &Adapter->RssQueues[QueueInfo->QueueId];
+
+    HookId = XdpRxQueueGetHookId(Config);
+    if (HookId != NULL && HookId->Direction == XDP_HOOK_TX) {
+        return
+            MpXdpCreateTxInspectQueue(
+                AdapterQueue, Config, InterfaceRxQueue, InterfaceRxQueueDispatch);
+    }
+
     Rq = &AdapterQueue->Rq;
     ASSERT(Rq->XdpState == XDP_STATE_INACTIVE);
 
     XdpRxQueueRegisterExtensionVersion(Config, &MpSupportedXdpExtensions.VirtualAddress);
 
+    XdpRxQueueRegisterExtensionVersion(Config, &MpSupportedXdpExtensions.Mdl);
+
     XdpRxQueueRegisterExtensionVersion(Config, &MpSupportedXdpExtensions.RxAction);
 
+    XdpRxQueueRegisterExtensionVersion(Config, &MpSupportedXdpExtensions.RxMetadata);
+
     XdpInitializeRxCapabilitiesDriverVa(&RxCapabilities);
     RxCapabilities.TxActionSupported = TRUE;
+    RxCapabilities.BackpressureSupported = TRUE;
+
+    if (Rq->MaxFragments > 0) {
+        XdpRxQueueRegisterExtensionVersion(Config, &MpSupportedXdpExtensions.Fragment);
+        RxCapabilities.MaximumFragments = Rq->MaxFragments;
+    }
     XdpRxQueueSetCapabilities(Config, &RxCapabilities);
 
     XdpInitializeExclusivePollInfo(&PollInfo, AdapterQueue->NdisPollHandle);
@@ -622,6 +1358,10 @@ MpXdpActivateRxQueue(
     ADAPTER_QUEUE *AdapterQueue = (ADAPTER_QUEUE *)InterfaceRxQueue;
     ADAPTER_RX_QUEUE *Rq = &AdapterQueue->Rq;
 
+    if (*(MP_XDP_RX_QUEUE_TYPE *)InterfaceRxQueue == MpXdpRxQueueTypeTxInspect) {
+        return MpXdpActivateTxInspectQueue(InterfaceRxQueue, XdpRxQueue, Config);
+    }
+
     ASSERT(Rq->XdpState == XDP_STATE_INACTIVE);
 
     Rq->XdpRxQueue = XdpRxQueue;
@@ -631,10 +1371,32 @@ MpXdpActivateRxQueue(
 
     ASSERT(XdpRxQueueIsVirtualAddressEnabled(Config));
     XdpRxQueueGetExtension(
-        Config, &MpSupportedXdpExtensions.VirtualAddress, &Rq->BufferVaExtension);
+        Config, &MpSupportedXdpExtensions.VirtualAddress, &Rq->Extensions.VaExtension);
+
+    XdpRxQueueGetExtension(
+        Config, &MpSupportedXdpExtensions.Mdl, &Rq->Extensions.MdlExtension);
+
+    XdpRxQueueGetExtension(
+        Config, &MpSupportedXdpExtensions.RxAction, &Rq->Extensions.RxActionExtension);
 
     XdpRxQueueGetExtension(
-        Config, &MpSupportedXdpExtensions.RxAction, &Rq->RxActionExtension);
+        Config, &MpSupportedXdpExtensions.RxMetadata, &Rq->Extensions.RxMetadataExtension);
+
+    //
+    // The RX metadata extension is enabled by registration, and every frame's
+    // metadata is translated into NBL OOB data when passed to NDIS.
+    //
+    Rq->Extensions.RxMetadataEnabled = TRUE;
+
+    if (Rq->MaxFragments > 0) {
+        Rq->FragmentRing = XdpRxQueueGetFragmentRing(Config);
+        XdpRxQueueGetExtension(
+            Config, &MpSupportedXdpExtensions.Fragment, &Rq->Extensions.FragmentExtension);
+    }
+
+    XdpRxBatchInitialize(
+        &Rq->XdpBatch, XdpRxQueue, Rq->FrameRing, Rq->FragmentRing, &Rq->Extensions.VaExtension,
+        Rq->InspectBatchSize, Rq->MaxFragments);
 
     WriteUInt32Release((UINT32 *)&Rq->XdpState, XDP_STATE_ACTIVE);
 
@@ -651,6 +1413,11 @@ MpXdpDeleteRxQueue(
     ADAPTER_RX_QUEUE *Rq = &AdapterQueue->Rq;
     KEVENT DeleteComplete;
 
+    if (*(MP_XDP_RX_QUEUE_TYPE *)InterfaceRxQueue == MpXdpRxQueueTypeTxInspect) {
+        MpXdpDeleteTxInspectQueue(InterfaceRxQueue);
+        return;
+    }
+
     if (Rq->XdpState == XDP_STATE_INACTIVE) {
         //
         // XDP is allowed to delete a created but inactive queue.
@@ -675,4 +1442,5 @@ MpXdpDeleteRxQueue(
     Rq->DeleteComplete = NULL;
     Rq->XdpRxQueue = NULL;
     Rq->FrameRing = NULL;
+    Rq->FragmentRing = NULL;
 }
@@ -39,6 +39,12 @@ MpCleanupReceiveQueue(
     _Inout_ ADAPTER_RX_QUEUE *Rq
     );
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpReceiveSetFlows(
+    _Inout_ ADAPTER_CONTEXT *Adapter
+    );
+
 XDP_CREATE_RX_QUEUE     MpXdpCreateRxQueue;
 XDP_ACTIVATE_RX_QUEUE   MpXdpActivateRxQueue;
 XDP_DELETE_RX_QUEUE     MpXdpDeleteRxQueue;
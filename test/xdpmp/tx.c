@@ -14,6 +14,16 @@ typedef struct {
 #define MP_NB_GET_OWNING_NBL(Nb)        ((NET_BUFFER_LIST **)&((Nb)->MiniportReserved[0]))
 #define MP_NB_GET_NB_QUEUE_LINK(Nb)     ((NET_BUFFER **)&((Nb)->MiniportReserved[1]))
 
+//
+// A buffer of an outgoing NB, as described to the L2 TX inspect queue.
+//
+typedef struct {
+    UCHAR *VirtualAddress;
+    UINT32 BufferLength;
+    UINT32 DataOffset;
+    UINT32 DataLength;
+} TX_INSPECT_BUFFER;
+
 inline
 UINT32
 XdpRingCountInOrder(
@@ -194,11 +204,274 @@ MpTransmitRxTx(
     ShadowDescriptor->Source = TxSourceXdpRx;
 }
 
+static
+VOID
+NbQueueInitialize(
+    _Out_ NB_QUEUE *Queue
+    )
+{
+    Queue->Head = NULL;
+    Queue->Tail = &Queue->Head;
+    Queue->Count = 0;
+}
+
+static
+VOID
+NbQueueAppend(
+    _Inout_ NB_QUEUE *Queue,
+    _In_ NET_BUFFER *Nb
+    )
+{
+    *MP_NB_GET_NB_QUEUE_LINK(Nb) = NULL;
+    *Queue->Tail = Nb;
+    Queue->Tail = MP_NB_GET_NB_QUEUE_LINK(Nb);
+    Queue->Count++;
+}
+
+static
+NET_BUFFER *
+NbQueuePop(
+    _Inout_ NB_QUEUE *Queue
+    )
+{
+    NET_BUFFER *Nb = Queue->Head;
+
+    ASSERT(Queue->Count > 0);
+
+    Queue->Head = *MP_NB_GET_NB_QUEUE_LINK(Nb);
+    if (--Queue->Count == 0) {
+        Queue->Tail = &Queue->Head;
+    }
+
+    return Nb;
+}
+
+static
+VOID
+PostNbQueueToHwInOrder(
+    _In_ ADAPTER_TX_QUEUE *Tq,
+    _Inout_ NB_QUEUE *Queue
+    )
+{
+    UINT32 Count;
+
+    if (Queue->Count == 0) {
+        return;
+    }
+
+    Count = PostNbQueueToHw(Tq, Queue->Count, &Queue->Head);
+    Queue->Count -= Count;
+    if (Queue->Count == 0) {
+        Queue->Tail = &Queue->Head;
+    }
+}
+
+//
+// Describes the data of an NB with up to MAX_TX_INSPECT_FRAGMENTS + 1 buffers.
+// Returns zero if the NB cannot be described.
+//
+static
+UINT32
+MpTransmitGetInspectBuffers(
+    _In_ NET_BUFFER *Nb,
+    _Out_writes_to_(MAX_TX_INSPECT_FRAGMENTS + 1, return) TX_INSPECT_BUFFER *Buffers
+    )
+{
+    MDL *Mdl = NET_BUFFER_CURRENT_MDL(Nb);
+    UINT32 MdlOffset = NET_BUFFER_CURRENT_MDL_OFFSET(Nb);
+    UINT32 DataRemaining = NET_BUFFER_DATA_LENGTH(Nb);
+    UINT32 BufferCount = 0;
+
+    while (DataRemaining > 0) {
+        UINT32 MdlByteCount;
+        UCHAR *VirtualAddress;
+
+        if (Mdl == NULL || BufferCount == MAX_TX_INSPECT_FRAGMENTS + 1) {
+            return 0;
+        }
+
+        MdlByteCount = MmGetMdlByteCount(Mdl);
+
+        if (MdlOffset < MdlByteCount) {
+            VirtualAddress =
+                MmGetSystemAddressForMdlSafe(Mdl, LowPagePriority | MdlMappingNoExecute);
+            if (VirtualAddress == NULL) {
+                return 0;
+            }
+
+            Buffers[BufferCount].VirtualAddress = VirtualAddress;
+            Buffers[BufferCount].BufferLength = MdlByteCount;
+            Buffers[BufferCount].DataOffset = MdlOffset;
+            Buffers[BufferCount].DataLength = min(MdlByteCount - MdlOffset, DataRemaining);
+            DataRemaining -= Buffers[BufferCount].DataLength;
+            BufferCount++;
+        }
+
+        MdlOffset = 0;
+        Mdl = Mdl->Next;
+    }
+
+    return BufferCount;
+}
+
+//
+// Completes an NB without posting it to the hardware. Returns whether the
+// owning NBL was appended to the chain.
+//
+static
+BOOLEAN
+MpTransmitDropNb(
+    _Inout_ ADAPTER_TX_QUEUE *Tq,
+    _In_ NET_BUFFER *Nb,
+    _Inout_ COUNTED_NBL_CHAIN *NblChain
+    )
+{
+    NET_BUFFER_LIST **OwningNbl = MP_NB_GET_OWNING_NBL(Nb);
+    ULONG *OwningNblRefCount = MP_NBL_GET_REF_COUNT(*OwningNbl);
+
+    InterlockedIncrement64((LONG64 *)&Tq->Stats.TxDrops);
+
+    if (--(*OwningNblRefCount) == 0) {
+        (*OwningNbl)->Status = NDIS_STATUS_SUCCESS;
+        CountedNblChainAppend(NblChain, *OwningNbl);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+//
+// Inspects a batch of outgoing NBs with the L2 TX inspect queue.
+//
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpTransmitInspect(
+    _Inout_ ADAPTER_TX_QUEUE *Tq,
+    _Inout_ COUNTED_NBL_CHAIN *NblChain
+    )
+{
+    ADAPTER_TX_INSPECT_QUEUE *Inspect = &Tq->Inspect;
+    XDP_RING *FrameRing = Inspect->FrameRing;
+    XDP_RING *FragmentRing = Inspect->FragmentRing;
+    TX_INSPECT_BUFFER Buffers[MAX_TX_INSPECT_FRAGMENTS + 1];
+    NET_BUFFER **Link;
+    UINT32 FrameIndex;
+    UINT32 FrameCount = 0;
+    UINT32 NblCount = 0;
+
+    //
+    // Take ownership of the NBs queued since the last poll.
+    //
+    if (Tq->NbQueueCount > 0) {
+        KIRQL OldIrql;
+
+        KeAcquireSpinLock(&Tq->NbQueueLock, &OldIrql);
+        if (Tq->NbQueueHead != NULL) {
+            *Inspect->PendingQueue.Tail = Tq->NbQueueHead;
+            Inspect->PendingQueue.Tail = Tq->NbQueueTail;
+            Inspect->PendingQueue.Count += Tq->NbQueueCount;
+            Tq->NbQueueHead = NULL;
+            Tq->NbQueueTail = &Tq->NbQueueHead;
+            Tq->NbQueueCount = 0;
+        }
+        KeReleaseSpinLock(&Tq->NbQueueLock, OldIrql);
+    }
+
+    if (Inspect->NeedFlush) {
+        Inspect->NeedFlush = FALSE;
+        XdpFlushReceive(Inspect->XdpRxQueue);
+    }
+
+    ASSERT(XdpRingCount(FrameRing) == 0);
+    FrameIndex = FrameRing->ProducerIndex;
+
+    //
+    // Produce a frame for each pending NB, in order, until the rings are full.
+    // NBs that cannot be described are dropped.
+    //
+    Link = &Inspect->PendingQueue.Head;
+
+    while (FrameCount < Inspect->PendingQueue.Count && XdpRingFree(FrameRing) > 0) {
+        NET_BUFFER *Nb = *Link;
+        UINT32 BufferCount = MpTransmitGetInspectBuffers(Nb, Buffers);
+        XDP_FRAME *Frame;
+
+        if (BufferCount == 0) {
+            *Link = *MP_NB_GET_NB_QUEUE_LINK(Nb);
+            if (--Inspect->PendingQueue.Count == FrameCount) {
+                Inspect->PendingQueue.Tail = Link;
+            }
+            NblCount += MpTransmitDropNb(Tq, Nb, NblChain);
+            continue;
+        }
+
+        if (XdpRingFree(FragmentRing) < BufferCount - 1) {
+            break;
+        }
+
+        Frame = XdpRingGetElement(FrameRing, FrameRing->ProducerIndex++ & FrameRing->Mask);
+        Frame->Buffer.BufferLength = Buffers[0].BufferLength;
+        Frame->Buffer.DataOffset = Buffers[0].DataOffset;
+        Frame->Buffer.DataLength = Buffers[0].DataLength;
+        XdpGetVirtualAddressExtension(&Frame->Buffer, &Inspect->VaExtension)->VirtualAddress =
+            Buffers[0].VirtualAddress;
+
+        for (UINT32 Index = 1; Index < BufferCount; Index++) {
+            XDP_BUFFER *Fragment =
+                XdpRingGetElement(FragmentRing, FragmentRing->ProducerIndex++ & FragmentRing->Mask);
+
+            Fragment->BufferLength = Buffers[Index].BufferLength;
+            Fragment->DataOffset = Buffers[Index].DataOffset;
+            Fragment->DataLength = Buffers[Index].DataLength;
+            XdpGetVirtualAddressExtension(Fragment, &Inspect->VaExtension)->VirtualAddress =
+                Buffers[Index].VirtualAddress;
+        }
+
+        XdpGetFragmentExtension(Frame, &Inspect->FragmentExtension)->FragmentBufferCount =
+            (UINT8)(BufferCount - 1);
+
+        Link = MP_NB_GET_NB_QUEUE_LINK(Nb);
+        FrameCount++;
+    }
+
+    if (FrameCount > 0) {
+        XdpReceive(Inspect->XdpRxQueue);
+
+        //
+        // TX inspect queues do not support backpressure, so XDP has consumed
+        // every frame. Apply each frame's action to its NB: only PASS frames
+        // are posted to the hardware. XDP copies frames redirected to sockets,
+        // and TX actions are not supported, so all other frames are dropped.
+        //
+        ASSERT(XdpRingCount(FrameRing) == 0);
+
+        while (FrameCount-- > 0) {
+            XDP_FRAME *Frame = XdpRingGetElement(FrameRing, FrameIndex++ & FrameRing->Mask);
+            XDP_FRAME_RX_ACTION *Action =
+                XdpGetRxActionExtension(Frame, &Inspect->RxActionExtension);
+            NET_BUFFER *Nb = NbQueuePop(&Inspect->PendingQueue);
+
+            if (Action->RxAction == XDP_RX_ACTION_PASS) {
+                NbQueueAppend(&Inspect->PassQueue, Nb);
+            } else {
+                NblCount += MpTransmitDropNb(Tq, Nb, NblChain);
+            }
+        }
+    }
+
+    if (NblCount > 0) {
+        ExReleaseRundownProtectionCacheAwareEx(Tq->NblRundown, NblCount);
+    }
+}
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 UINT32
 MpTransmitProcessPosts(
     ADAPTER_TX_QUEUE *Tq,
-    BOOLEAN XdpActive
+    BOOLEAN XdpActive,
+    BOOLEAN InspectActive,
+    COUNTED_NBL_CHAIN *NblChain
     )
 {
     KIRQL OldIrql;
@@ -263,9 +536,20 @@ MpTransmitProcessPosts(
     }
 
     //
-    // Post NBL TX to HW.
+    // Post NBL TX to HW. Outgoing NBs are inspected first if a TX inspect queue
+    // is active, and NBs left by a deleted TX inspect queue are posted before
+    // any newer NBs.
     //
-    if (Tq->NbQueueCount > 0) {
+    if (InspectActive) {
+        MpTransmitInspect(Tq, NblChain);
+    } else {
+        PostNbQueueToHwInOrder(Tq, &Tq->Inspect.PendingQueue);
+    }
+
+    PostNbQueueToHwInOrder(Tq, &Tq->Inspect.PassQueue);
+
+    if (Tq->NbQueueCount > 0 && !InspectActive &&
+        Tq->Inspect.PendingQueue.Count == 0 && Tq->Inspect.PassQueue.Count == 0) {
         KeAcquireSpinLock(&Tq->NbQueueLock, &OldIrql);
 
         Count = PostNbQueueToHw(Tq, Tq->NbQueueCount, &Tq->NbQueueHead);
@@ -290,7 +574,9 @@ MpTransmit(
     )
 {
     BOOLEAN XdpActive = FALSE;
+    BOOLEAN InspectActive = FALSE;
     XDP_QUEUE_STATE XdpState = ReadUInt32Acquire((UINT32 *)&Tq->XdpState);
+    XDP_QUEUE_STATE InspectState = ReadUInt32Acquire((UINT32 *)&Tq->Inspect.XdpState);
     COUNTED_NBL_CHAIN NblChain;
 
     CountedNblChainInitialize(&NblChain);
@@ -309,9 +595,17 @@ MpTransmit(
         }
     }
 
+    if (InspectState == XDP_STATE_DELETE_PENDING) {
+        Tq->Inspect.XdpState = XDP_STATE_INACTIVE;
+        KeSetEvent(Tq->Inspect.DeleteComplete, 0, FALSE);
+    } else if (InspectState == XDP_STATE_ACTIVE) {
+        InspectActive = TRUE;
+    }
+
     XdpPoll->FramesCompleted +=
         MpTransmitProcessCompletions(Tq, XdpActive, Poll->MaxNblsToComplete, &NblChain);
-    XdpPoll->FramesTransmitted += MpTransmitProcessPosts(Tq, XdpActive);
+    XdpPoll->FramesTransmitted +=
+        MpTransmitProcessPosts(Tq, XdpActive, InspectActive, &NblChain);
 
     //
     // If NBLs were completed, return those to NDIS.
@@ -406,9 +700,12 @@ MpSendNetBufferLists(
     }
 
     //
-    // Attempt to post NBs to the HW ring.
+    // Attempt to post NBs to the HW ring, unless they must be inspected within
+    // the poll first.
     //
-    if (Tq->NbQueueCount == 0) {
+    if (Tq->NbQueueCount == 0 &&
+        ReadUInt32Acquire((UINT32 *)&Tq->Inspect.XdpState) == XDP_STATE_INACTIVE &&
+        Tq->Inspect.PendingQueue.Count == 0 && Tq->Inspect.PassQueue.Count == 0) {
         PostedNbCount = PostNbQueueToHw(Tq, NbCount, &LocalNbQueueHead);
         if (PostedNbCount > 0) {
             //
@@ -471,6 +768,10 @@ MpInitializeTransmitQueue(
     Tq->Rq = &RssQueue->Rq;
     KeInitializeSpinLock(&Tq->NbQueueLock);
 
+    Tq->Inspect.XdpRxQueueType = MpXdpRxQueueTypeTxInspect;
+    NbQueueInitialize(&Tq->Inspect.PendingQueue);
+    NbQueueInitialize(&Tq->Inspect.PassQueue);
+
     Tq->XdpHwDescriptorsAvailable = Adapter->TxRingSize * Adapter->TxXdpQosPct / 100;
     if (Tq->XdpHwDescriptorsAvailable == 0) {
         Tq->XdpHwDescriptorsAvailable = 1;
@@ -485,6 +786,15 @@ MpInitializeTransmitQueue(
         goto Exit;
     }
 
+    Status =
+        HwRingSetCompletionModel(
+            Tq->HwRing, Adapter->HwCompletionLatencyUs, Adapter->HwCompletionBatch,
+            Adapter->HwInterruptCoalesceUs);
+    if (Status != STATUS_SUCCESS) {
+        Status = NDIS_STATUS_RESOURCES;
+        goto Exit;
+    }
+
     Tq->ShadowRing =
         ExAllocatePoolZero(
             NonPagedPoolNxCacheAligned,
@@ -617,3 +927,133 @@ MpXdpDeleteTxQueue(
     Tq->XdpTxQueue = NULL;
     Tq->FrameRing = NULL;
 }
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+MpXdpTxInspectNotify(
+    _In_ XDP_INTERFACE_HANDLE InterfaceQueue,
+    _In_ XDP_NOTIFY_QUEUE_FLAGS Flags
+    )
+{
+    ADAPTER_TX_INSPECT_QUEUE *Inspect = (ADAPTER_TX_INSPECT_QUEUE *)InterfaceQueue;
+    ADAPTER_TX_QUEUE *Tq = CONTAINING_RECORD(Inspect, ADAPTER_TX_QUEUE, Inspect);
+    ADAPTER_QUEUE *AdapterQueue = CONTAINING_RECORD(Tq, ADAPTER_QUEUE, Tq);
+
+    if (Flags & XDP_NOTIFY_QUEUE_FLAG_RX_FLUSH) {
+        Inspect->NeedFlush = TRUE;
+        AdapterQueue->Adapter->PollDispatch.RequestPoll(AdapterQueue->NdisPollHandle, 0);
+    }
+}
+
+static const XDP_INTERFACE_RX_QUEUE_DISPATCH MpXdpTxInspectDispatch = {
+    MpXdpTxInspectNotify,
+};
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+MpXdpCreateTxInspectQueue(
+    _In_ ADAPTER_QUEUE *AdapterQueue,
+    _Inout_ XDP_RX_QUEUE_CONFIG_CREATE Config,
+    _Out_ XDP_INTERFACE_HANDLE *InterfaceRxQueue,
+    _Out_ const XDP_INTERFACE_RX_QUEUE_DISPATCH **InterfaceRxQueueDispatch
+    )
+{
+    ADAPTER_TX_INSPECT_QUEUE *Inspect = &AdapterQueue->Tq.Inspect;
+    XDP_RX_CAPABILITIES RxCapabilities;
+    XDP_POLL_INFO PollInfo;
+
+    ASSERT(Inspect->XdpState == XDP_STATE_INACTIVE);
+
+    XdpRxQueueRegisterExtensionVersion(Config, &MpSupportedXdpExtensions.VirtualAddress);
+
+    XdpRxQueueRegisterExtensionVersion(Config, &MpSupportedXdpExtensions.RxAction);
+
+    XdpRxQueueRegisterExtensionVersion(Config, &MpSupportedXdpExtensions.Fragment);
+
+    //
+    // Outgoing NBs are described in place by their system addresses, and each
+    // MDL of an NB is a separate buffer of the frame.
+    //
+    XdpInitializeRxCapabilitiesDriverVa(&RxCapabilities);
+    RxCapabilities.MaximumFragments = MAX_TX_INSPECT_FRAGMENTS;
+    XdpRxQueueSetCapabilities(Config, &RxCapabilities);
+
+    XdpInitializeExclusivePollInfo(&PollInfo, AdapterQueue->NdisPollHandle);
+    XdpRxQueueSetPollInfo(Config, &PollInfo);
+
+    *InterfaceRxQueue = (XDP_INTERFACE_HANDLE)Inspect;
+    *InterfaceRxQueueDispatch = &MpXdpTxInspectDispatch;
+
+    return STATUS_SUCCESS;
+}
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+MpXdpActivateTxInspectQueue(
+    _In_ XDP_INTERFACE_HANDLE InterfaceRxQueue,
+    _In_ XDP_RX_QUEUE_HANDLE XdpRxQueue,
+    _In_ XDP_RX_QUEUE_CONFIG_ACTIVATE Config
+    )
+{
+    ADAPTER_TX_INSPECT_QUEUE *Inspect = (ADAPTER_TX_INSPECT_QUEUE *)InterfaceRxQueue;
+
+    ASSERT(Inspect->XdpState == XDP_STATE_INACTIVE);
+
+    Inspect->XdpRxQueue = XdpRxQueue;
+    Inspect->FrameRing = XdpRxQueueGetFrameRing(Config);
+    Inspect->FragmentRing = XdpRxQueueGetFragmentRing(Config);
+    Inspect->NeedFlush = FALSE;
+    Inspect->DeleteComplete = NULL;
+
+    XdpRxQueueGetExtension(
+        Config, &MpSupportedXdpExtensions.VirtualAddress, &Inspect->VaExtension);
+
+    XdpRxQueueGetExtension(
+        Config, &MpSupportedXdpExtensions.RxAction, &Inspect->RxActionExtension);
+
+    XdpRxQueueGetExtension(
+        Config, &MpSupportedXdpExtensions.Fragment, &Inspect->FragmentExtension);
+
+    WriteUInt32Release((UINT32 *)&Inspect->XdpState, XDP_STATE_ACTIVE);
+
+    return STATUS_SUCCESS;
+}
+
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+MpXdpDeleteTxInspectQueue(
+    _In_ XDP_INTERFACE_HANDLE InterfaceRxQueue
+    )
+{
+    ADAPTER_TX_INSPECT_QUEUE *Inspect = (ADAPTER_TX_INSPECT_QUEUE *)InterfaceRxQueue;
+    ADAPTER_TX_QUEUE *Tq = CONTAINING_RECORD(Inspect, ADAPTER_TX_QUEUE, Inspect);
+    ADAPTER_QUEUE *AdapterQueue = CONTAINING_RECORD(Tq, ADAPTER_QUEUE, Tq);
+    KEVENT DeleteComplete;
+
+    if (Inspect->XdpState == XDP_STATE_INACTIVE) {
+        //
+        // XDP is allowed to delete a created but inactive queue.
+        //
+        return;
+    }
+
+    KeInitializeEvent(&DeleteComplete, NotificationEvent, FALSE);
+    Inspect->DeleteComplete = &DeleteComplete;
+
+    //
+    // Pending NBs are posted uninspected by the poll once the queue is
+    // inactive.
+    //
+    ASSERT(Inspect->XdpState == XDP_STATE_ACTIVE);
+    WriteUInt32Release((UINT32 *)&Inspect->XdpState, XDP_STATE_DELETE_PENDING);
+    AdapterQueue->Adapter->PollDispatch.RequestPoll(AdapterQueue->NdisPollHandle, 0);
+
+    KeWaitForSingleObject(&DeleteComplete, Executive, KernelMode, FALSE, NULL);
+    ASSERT(Inspect->XdpState == XDP_STATE_INACTIVE);
+
+    Inspect->DeleteComplete = NULL;
+    Inspect->XdpRxQueue = NULL;
+    Inspect->FrameRing = NULL;
+    Inspect->FragmentRing = NULL;
+}
@@ -38,3 +38,15 @@ MpCleanupTransmitQueue(
 XDP_CREATE_TX_QUEUE     MpXdpCreateTxQueue;
 XDP_ACTIVATE_TX_QUEUE   MpXdpActivateTxQueue;
 XDP_DELETE_TX_QUEUE     MpXdpDeleteTxQueue;
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+MpXdpCreateTxInspectQueue(
+    _In_ ADAPTER_QUEUE *AdapterQueue,
+    _Inout_ XDP_RX_QUEUE_CONFIG_CREATE Config,
+    _Out_ XDP_INTERFACE_HANDLE *InterfaceRxQueue,
+    _Out_ const XDP_INTERFACE_RX_QUEUE_DISPATCH **InterfaceRxQueueDispatch
+    );
+
+XDP_ACTIVATE_RX_QUEUE   MpXdpActivateTxInspectQueue;
+XDP_DELETE_RX_QUEUE     MpXdpDeleteTxInspectQueue;
@@ -36,11 +36,14 @@
 #define DEFAULT_UDP_DEST_PORT 0
 #define DEFAULT_DURATION ULONG_MAX
 #define DEFAULT_TX_IO_SIZE 64
-#define DEFAULT_LAT_COUNT 10000000
+#define DEFAULT_LAT_COUNT 0
 #define DEFAULT_YIELD_COUNT 0
+#define DEFAULT_FLOW_COUNT 1
+#define TX_SCHEDULE_SIZE 1024
+#define TX_MIX_MAX 16
 
 CHAR *HELP =
-"xskbench.exe <rx|tx|fwd|lat> -i <ifindex> [OPTIONS] <-t THREAD_PARAMS> [-t THREAD_PARAMS...] \n"
+"xskbench.exe <rx|tx|fwd|l2fwd|lat> -i <ifindex> [OPTIONS] <-t THREAD_PARAMS> [-t THREAD_PARAMS...] \n"
 "\n"
 "THREAD_PARAMS: \n"
 "   -q <QUEUE_PARAMS> [-q QUEUE_PARAMS...] \n"
@@ -80,6 +83,7 @@ CHAR *HELP =
 "                      - system:  The system default polling mode\n"
 "                      - busy:    The system aggressively polls\n"
 "                      - socket:  The socket polls\n"
+"                      - inline:  TX pokes poll idle interfaces inline\n"
 "                      Default: system\n"
 "   -xdp_mode <mode>   The XDP interface provider:\n"
 "                      - system:  The system determines the ideal XDP provider\n"
@@ -96,11 +100,30 @@ CHAR *HELP =
 "                      The pktcmd.exe tool outputs hexadecimal headers. Any\n"
 "                      trailing bytes in the XSK buffer are set to zero\n"
 "                      Default: \"\"\n"
-"   -lat_count         Number of latency samples to collect\n"
+"   -lat_count         Number of latency samples to collect, or 0 for no limit\n"
 "                      Default: " STR_OF(DEFAULT_LAT_COUNT) "\n"
+"   -flows <count>     The number of distinct flows generated in tx mode. The\n"
+"                      -tx_pattern must contain Ethernet, IPv4 or IPv6, and UDP\n"
+"                      headers; each flow offsets the -flow_vary fields by the\n"
+"                      flow index\n"
+"                      Default: " STR_OF(DEFAULT_FLOW_COUNT) "\n"
+"   -flow_vary <list>  The comma-separated 5-tuple fields varied across flows:\n"
+"                      srcport, dstport, srcip, dstip\n"
+"                      Default: srcport\n"
+"   -flow_weights <list> The comma-separated relative rates of each flow, in flow\n"
+"                      order. Unlisted flows have weight 1\n"
+"                      Default: all flows have weight 1\n"
+"   -imix <list>       The comma-separated <size>:<weight> frame size mix in tx\n"
+"                      mode, e.g. 64:7,594:4,1518:1. Requires -tx_pattern\n"
+"                      Default: all frames have size <txiosize>\n"
 
 "\n"
 "OPTIONS: \n"
+"   -ti <ifindex>      The interface frames are transmitted on in l2fwd mode.\n"
+"                      Frames received on each <ifindex> queue are forwarded,\n"
+"                      unmodified, to the same queue ID on this interface\n"
+"                      through a socket sharing the receiving socket's UMEM\n"
+"                      Default: <ifindex>\n"
 "   -d                 Duration of execution in seconds\n"
 "                      Default: infinite\n"
 "   -v                 Verbose logging\n"
@@ -109,18 +132,27 @@ CHAR *HELP =
 "                      Default: " STR_OF(DEFAULT_UDP_DEST_PORT) "\n"
 "   -lp                Use large pages. Requires privileged account.\n"
 "                      Default: off\n"
+"   -output <format>   The statistics output format:\n"
+"                      - text:  Human-readable text\n"
+"                      - json:  One JSON object per record and line\n"
+"                      - csv:   record,mode,id,metric,value rows\n"
+"                      Default: text\n"
 "\n"
 "Examples\n"
 "   xskbench.exe rx -i 6 -t -q -id 0\n"
 "   xskbench.exe rx -i 6 -t -ca 0x2 -q -id 0 -t -ca 0x4 -q -id 1\n"
 "   xskbench.exe tx -i 6 -t -q -id 0 -q -id 1\n"
 "   xskbench.exe fwd -i 6 -t -q -id 0 -y\n"
+"   xskbench.exe l2fwd -i 6 -ti 7 -t -q -id 0\n"
 "   xskbench.exe lat -i 6 -t -q -id 0 -ring_size 8\n"
 ;
 
 #define printf_error(...) \
     fprintf(stderr, __VA_ARGS__)
 
+#define printf_text(...) \
+    if (outputFormat == OutputText) { printf(__VA_ARGS__); }
+
 #define printf_verbose(format, ...) \
     if (verbose) { LARGE_INTEGER Qpc; QueryPerformanceCounter(&Qpc); printf("Qpc=%llu " format, Qpc.QuadPart, __VA_ARGS__); }
 
@@ -141,22 +173,56 @@ CHAR *HELP =
 #define WAIT_DRIVER_TIMEOUT_MS 1050
 #define STATS_ARRAY_SIZE 60
 
+//
+// Latency samples are recorded into a log-linear histogram: values below
+// 2^(LAT_SUB_BUCKET_BITS + 1) have exact buckets, and each higher power of two
+// is split into 2^LAT_SUB_BUCKET_BITS linear buckets, bounding the relative
+// error of any reported value to under 1% with fixed memory.
+//
+#define LAT_SUB_BUCKET_BITS 7
+#define LAT_SUB_BUCKET_COUNT (1ui64 << LAT_SUB_BUCKET_BITS)
+#define LAT_BUCKET_COUNT ((64 - LAT_SUB_BUCKET_BITS + 1) * LAT_SUB_BUCKET_COUNT)
+
 typedef enum {
     ModeRx,
     ModeTx,
     ModeFwd,
+    ModeL2Fwd,
     ModeLat,
 } MODE;
 
+typedef enum {
+    OutputText,
+    OutputJson,
+    OutputCsv,
+} OUTPUT_FORMAT;
+
 typedef enum {
     XdpModeSystem,
     XdpModeGeneric,
     XdpModeNative,
 } XDP_MODE;
 
+typedef struct {
+    UINT64 buckets[LAT_BUCKET_COUNT];
+} LAT_HISTOGRAM;
+
+typedef enum {
+    FlowVarySrcPort = 0x1,
+    FlowVaryDstPort = 0x2,
+    FlowVarySrcIp = 0x4,
+    FlowVaryDstIp = 0x8,
+} FLOW_VARY_FLAGS;
+
+typedef struct {
+    UINT32 value;
+    UINT32 weight;
+} TX_MIX_ENTRY;
+
 typedef struct {
     INT queueId;
     HANDLE sock;
+    HANDLE peerSock;
     HANDLE rxProgram;
     XDP_MODE xdpMode;
     ULONG umemsize;
@@ -167,9 +233,23 @@ typedef struct {
     UINT32 ringsize;
     UCHAR *txPattern;
     UINT32 txPatternLength;
-    INT64 *latSamples;
+    UINT32 flowCount;
+    UINT32 flowVary;
+    UINT32 *flowWeights;
+    TX_MIX_ENTRY txSizeMix[TX_MIX_MAX];
+    UINT32 txSizeMixCount;
+    //
+    // Precomputed frame headers and lengths, cycled through in tx mode when
+    // generating multiple flows or a frame size mix.
+    //
+    UCHAR *txSchedule;
+    UINT32 *txScheduleLengths;
+    UINT32 txScheduleIndex;
+    LAT_HISTOGRAM *latHistogram;
+    LAT_HISTOGRAM *latHistogramLast;
+    LAT_HISTOGRAM *latHistogramInterval;
     UINT32 latSamplesCount;
-    UINT32 latIndex;
+    UINT64 latIndex;
     XSK_POLL_MODE pollMode;
 
     struct {
@@ -187,6 +267,8 @@ typedef struct {
     ULONGLONG lastTick;
     ULONGLONG packetCount;
     ULONGLONG lastPacketCount;
+    ULONGLONG rxPacketCount;
+    ULONGLONG lastRxPacketCount;
     ULONGLONG lastRxDropCount;
     ULONGLONG pokesRequestedCount;
     ULONGLONG lastPokesRequestedCount;
@@ -198,6 +280,8 @@ typedef struct {
     XSK_RING fillRing;
     XSK_RING compRing;
     XSK_RING freeRing;
+    XSK_RING peerTxRing;
+    XSK_RING peerCompRing;
     XSK_UMEM_REG umemReg;
 } MY_QUEUE;
 
@@ -217,6 +301,7 @@ typedef struct {
 
 CONST XDP_API_TABLE *XdpApi;
 INT ifindex = -1;
+INT txIfindex = -1;
 UINT16 udpDestPort = DEFAULT_UDP_DEST_PORT;
 ULONG duration = DEFAULT_DURATION;
 BOOLEAN verbose = FALSE;
@@ -224,6 +309,7 @@ BOOLEAN done = FALSE;
 BOOLEAN largePages = FALSE;
 MODE mode;
 CHAR *modestr;
+OUTPUT_FORMAT outputFormat = OutputText;
 HANDLE periodicStatsEvent;
 
 UINT32
@@ -385,6 +471,266 @@ GetDescriptorPattern(
     }
 }
 
+UINT32
+ParseMixList(
+    _In_z_ CONST CHAR *List,
+    _Out_writes_to_(MaxCount, return) TX_MIX_ENTRY *Entries,
+    _In_ UINT32 MaxCount,
+    _In_ BOOLEAN Pairs
+    )
+{
+    UINT32 count = 0;
+
+    //
+    // Parses "<value>[:<weight>],..." lists. Weights default to 1.
+    //
+    while (*List != '\0') {
+        CHAR *end;
+
+        ASSERT_FRE(count < MaxCount);
+        Entries[count].value = strtoul(List, &end, 10);
+        Entries[count].weight = 1;
+        ASSERT_FRE(end != List);
+
+        if (Pairs) {
+            ASSERT_FRE(*end == ':');
+            List = end + 1;
+            Entries[count].weight = strtoul(List, &end, 10);
+            ASSERT_FRE(end != List);
+        }
+
+        ASSERT_FRE(*end == ',' || *end == '\0');
+        List = (*end == ',') ? end + 1 : end;
+        count++;
+    }
+
+    return count;
+}
+
+UINT32
+PickWeighted(
+    _In_ UINT32 Random,
+    _In_ CONST UINT32 *Weights,
+    _In_ UINT32 Stride,
+    _In_ UINT32 Count,
+    _In_ UINT64 TotalWeight
+    )
+{
+    UINT64 target = Random % TotalWeight;
+    UINT32 i;
+
+    for (i = 0; i < Count - 1; i++) {
+        UINT32 weight = *(CONST UINT32 *)((CONST UCHAR *)Weights + (SIZE_T)i * Stride);
+        if (target < weight) {
+            break;
+        }
+        target -= weight;
+    }
+
+    return i;
+}
+
+UINT32
+XorShift32(
+    _Inout_ UINT32 *State
+    )
+{
+    UINT32 x = *State;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *State = x;
+    return x;
+}
+
+UINT32
+ChecksumAdd(
+    _In_ UINT32 Sum,
+    _In_reads_bytes_(Length) CONST UCHAR *Buffer,
+    _In_ UINT32 Length
+    )
+{
+    for (UINT32 i = 0; i + 1 < Length; i += 2) {
+        Sum += (Buffer[i] << 8) | Buffer[i + 1];
+    }
+    if (Length & 1) {
+        Sum += Buffer[Length - 1] << 8;
+    }
+
+    return Sum;
+}
+
+UINT16
+ChecksumFold(
+    _In_ UINT32 Sum
+    )
+{
+    while (Sum >> 16) {
+        Sum = (Sum & 0xFFFF) + (Sum >> 16);
+    }
+
+    return (UINT16)~Sum;
+}
+
+VOID
+WriteBe16(
+    _Out_writes_bytes_(2) UCHAR *Buffer,
+    _In_ UINT32 Value
+    )
+{
+    Buffer[0] = (UCHAR)(Value >> 8);
+    Buffer[1] = (UCHAR)Value;
+}
+
+VOID
+AddBe32(
+    _Inout_updates_bytes_(4) UCHAR *Buffer,
+    _In_ UINT32 Value
+    )
+{
+    UINT32 field =
+        ((UINT32)Buffer[0] << 24) | ((UINT32)Buffer[1] << 16) |
+        ((UINT32)Buffer[2] << 8) | Buffer[3];
+
+    field += Value;
+    Buffer[0] = (UCHAR)(field >> 24);
+    Buffer[1] = (UCHAR)(field >> 16);
+    Buffer[2] = (UCHAR)(field >> 8);
+    Buffer[3] = (UCHAR)field;
+}
+
+VOID
+SetupTxSchedule(
+    MY_QUEUE *Queue
+    )
+{
+    CONST UCHAR *pattern = Queue->txPattern;
+    UINT32 patternLength = Queue->txPatternLength;
+    UINT32 l3Offset = 14;
+    UINT32 l4Offset;
+    UINT32 addressOffset;
+    UINT32 addressLength;
+    BOOLEAN ipv6;
+    UINT64 totalFlowWeight = 0;
+    UINT64 totalSizeWeight = 0;
+    UINT32 random = Queue->queueId + 1;
+
+    //
+    // Precompute a schedule of complete frame headers so the TX path only
+    // copies headers into UMEM, without per-frame parsing, checksum
+    // calculation, or allocation. Flows and sizes are drawn according to their
+    // weights with a fixed seed, so runs are repeatable.
+    //
+    ASSERT_FRE(patternLength >= l3Offset);
+    if (pattern[12] == 0x81 && pattern[13] == 0x00) {
+        l3Offset += 4;
+        ASSERT_FRE(patternLength >= l3Offset);
+    }
+
+    if (pattern[l3Offset - 2] == 0x08 && pattern[l3Offset - 1] == 0x00) {
+        ipv6 = FALSE;
+        ASSERT_FRE(patternLength >= l3Offset + 20);
+        l4Offset = l3Offset + (pattern[l3Offset] & 0xF) * 4;
+        ASSERT_FRE(pattern[l3Offset + 9] == 17);
+        addressOffset = l3Offset + 12;
+        addressLength = 4;
+    } else if (pattern[l3Offset - 2] == 0x86 && pattern[l3Offset - 1] == 0xDD) {
+        ipv6 = TRUE;
+        ASSERT_FRE(patternLength >= l3Offset + 40);
+        l4Offset = l3Offset + 40;
+        ASSERT_FRE(pattern[l3Offset + 6] == 17);
+        addressOffset = l3Offset + 8;
+        addressLength = 16;
+    } else {
+        ABORT("-flows and -imix require an IPv4 or IPv6 UDP -tx_pattern\n");
+    }
+
+    ASSERT_FRE(patternLength >= l4Offset + 8);
+
+    if (Queue->txSizeMixCount == 0) {
+        Queue->txSizeMix[0].value = Queue->txiosize;
+        Queue->txSizeMix[0].weight = 1;
+        Queue->txSizeMixCount = 1;
+    }
+
+    for (UINT32 i = 0; i < Queue->txSizeMixCount; i++) {
+        ASSERT_FRE(Queue->txSizeMix[i].value >= patternLength);
+        ASSERT_FRE(Queue->txSizeMix[i].value <= Queue->umemchunksize - Queue->umemheadroom);
+        totalSizeWeight += Queue->txSizeMix[i].weight;
+    }
+
+    for (UINT32 i = 0; i < Queue->flowCount; i++) {
+        totalFlowWeight += Queue->flowWeights[i];
+    }
+
+    ASSERT_FRE(totalSizeWeight > 0 && totalFlowWeight > 0);
+
+    Queue->txSchedule = malloc((SIZE_T)TX_SCHEDULE_SIZE * patternLength);
+    ASSERT_FRE(Queue->txSchedule != NULL);
+    Queue->txScheduleLengths = malloc(TX_SCHEDULE_SIZE * sizeof(*Queue->txScheduleLengths));
+    ASSERT_FRE(Queue->txScheduleLengths != NULL);
+
+    for (UINT32 i = 0; i < TX_SCHEDULE_SIZE; i++) {
+        UCHAR *header = Queue->txSchedule + (SIZE_T)i * patternLength;
+        UINT32 flow =
+            PickWeighted(
+                XorShift32(&random), Queue->flowWeights, sizeof(*Queue->flowWeights),
+                Queue->flowCount, totalFlowWeight);
+        UINT32 size =
+            Queue->txSizeMix[
+                PickWeighted(
+                    XorShift32(&random), &Queue->txSizeMix[0].weight,
+                    sizeof(Queue->txSizeMix[0]), Queue->txSizeMixCount,
+                    totalSizeWeight)].value;
+        UINT32 sum;
+
+        memcpy(header, pattern, patternLength);
+
+        //
+        // Offset the varied fields by the flow index. Addresses are offset in
+        // their low 32 bits.
+        //
+        if (Queue->flowVary & FlowVarySrcPort) {
+            WriteBe16(header + l4Offset, ((header[l4Offset] << 8) | header[l4Offset + 1]) + flow);
+        }
+        if (Queue->flowVary & FlowVaryDstPort) {
+            WriteBe16(
+                header + l4Offset + 2,
+                ((header[l4Offset + 2] << 8) | header[l4Offset + 3]) + flow);
+        }
+        if (Queue->flowVary & FlowVarySrcIp) {
+            AddBe32(header + addressOffset + addressLength - 4, flow);
+        }
+        if (Queue->flowVary & FlowVaryDstIp) {
+            AddBe32(header + addressOffset + 2 * addressLength - 4, flow);
+        }
+
+        //
+        // Update the lengths and checksums for the frame size. Bytes beyond
+        // the pattern are zero and do not contribute to the UDP checksum.
+        //
+        if (ipv6) {
+            WriteBe16(header + l3Offset + 4, size - l4Offset);
+        } else {
+            WriteBe16(header + l3Offset + 2, size - l3Offset);
+            WriteBe16(header + l3Offset + 10, 0);
+            WriteBe16(
+                header + l3Offset + 10,
+                ChecksumFold(ChecksumAdd(0, header + l3Offset, l4Offset - l3Offset)));
+        }
+
+        WriteBe16(header + l4Offset + 4, size - l4Offset);
+        WriteBe16(header + l4Offset + 6, 0);
+        sum = ChecksumAdd(0, header + addressOffset, 2 * addressLength);
+        sum += 17 + (size - l4Offset);
+        sum = ChecksumAdd(sum, header + l4Offset, patternLength - l4Offset);
+        sum = ChecksumFold(sum);
+        WriteBe16(header + l4Offset + 6, (sum == 0) ? 0xFFFF : sum);
+
+        Queue->txScheduleLengths[i] = size;
+    }
+}
+
 VOID
 SetupSock(
     INT IfIndex,
@@ -407,11 +753,19 @@ SetupSock(
     Queue->umemReg.TotalSize = Queue->umemsize;
 
     if (largePages) {
+        BOOLEAN enable = TRUE;
+
         //
         // The memory subsystem requires allocations and mappings be aligned to
         // the large page size. XDP ignores the final chunk, if truncated.
         //
         Queue->umemReg.TotalSize = ALIGN_UP_BY(Queue->umemReg.TotalSize, GetLargePageMinimum());
+
+        printf_verbose("XSK_SOCKOPT_LARGE_PAGES\n");
+        res =
+            XdpApi->XskSetSockopt(
+                Queue->sock, XSK_SOCKOPT_LARGE_PAGES, &enable, sizeof(enable));
+        ASSERT_FRE(res == S_OK);
     }
 
     Queue->umemReg.Address =
@@ -563,6 +917,354 @@ SetupSock(
     AttachXdpProgram(Queue);
 }
 
+VOID
+SetupPeerSock(
+    INT IfIndex,
+    MY_QUEUE *Queue
+    )
+{
+    HRESULT res;
+    UINT32 bindFlags = XSK_BIND_FLAG_TX;
+
+    //
+    // The peer socket transmits from the UMEM registered by the queue's
+    // receiving socket, so received frames are forwarded by descriptor alone.
+    //
+    printf_verbose("creating peer sock\n");
+    res = XdpApi->XskCreate(&Queue->peerSock);
+    if (res != S_OK) {
+        ABORT("err: XskCreate returned %d\n", res);
+    }
+
+    printf_verbose("XSK_SOCKOPT_SHARED_UMEM\n");
+    res =
+        XdpApi->XskSetSockopt(
+            Queue->peerSock, XSK_SOCKOPT_SHARED_UMEM, &Queue->sock, sizeof(Queue->sock));
+    ASSERT_FRE(res == S_OK);
+
+    printf_verbose("configuring peer completion ring with size %d\n", Queue->ringsize);
+    res =
+        XdpApi->XskSetSockopt(
+            Queue->peerSock, XSK_SOCKOPT_TX_COMPLETION_RING_SIZE, &Queue->ringsize,
+            sizeof(Queue->ringsize));
+    ASSERT_FRE(res == S_OK);
+
+    printf_verbose("configuring peer tx ring with size %d\n", Queue->ringsize);
+    res =
+        XdpApi->XskSetSockopt(
+            Queue->peerSock, XSK_SOCKOPT_TX_RING_SIZE, &Queue->ringsize,
+            sizeof(Queue->ringsize));
+    ASSERT_FRE(res == S_OK);
+
+    if (Queue->xdpMode == XdpModeGeneric) {
+        bindFlags |= XSK_BIND_FLAG_GENERIC;
+    } else if (Queue->xdpMode == XdpModeNative) {
+        bindFlags |= XSK_BIND_FLAG_NATIVE;
+    }
+
+    printf_verbose(
+        "binding peer sock to ifindex %d queueId %d flags 0x%x\n",
+        IfIndex, Queue->queueId, bindFlags);
+    res = XdpApi->XskBind(Queue->peerSock, IfIndex, Queue->queueId, bindFlags);
+    ASSERT_FRE(res == S_OK);
+
+    printf_verbose("activating peer sock\n");
+    res = XdpApi->XskActivate(Queue->peerSock, 0);
+    ASSERT_FRE(res == S_OK);
+
+    printf_verbose("XSK_SOCKOPT_RING_INFO\n");
+    XSK_RING_INFO_SET infoSet = { 0 };
+    UINT32 ringInfoSize = sizeof(infoSet);
+    res = XdpApi->XskGetSockopt(Queue->peerSock, XSK_SOCKOPT_RING_INFO, &infoSet, &ringInfoSize);
+    ASSERT_FRE(res == S_OK);
+    ASSERT_FRE(ringInfoSize == sizeof(infoSet));
+    PrintRingInfo(infoSet);
+
+    XskRingInitialize(&Queue->peerTxRing, &infoSet.Tx);
+    XskRingInitialize(&Queue->peerCompRing, &infoSet.Completion);
+
+    res =
+        XdpApi->XskSetSockopt(
+            Queue->peerSock, XSK_SOCKOPT_POLL_MODE, &Queue->pollMode, sizeof(Queue->pollMode));
+    ASSERT_FRE(res == S_OK);
+}
+
+VOID
+BeginRecord(
+    CONST CHAR *Record,
+    INT Id
+    )
+{
+    if (outputFormat == OutputJson) {
+        printf("{\"record\":\"%s\",\"mode\":\"%s\",\"id\":%d", Record, modestr, Id);
+    }
+}
+
+VOID
+RecordMetric(
+    CONST CHAR *Record,
+    INT Id,
+    CONST CHAR *Metric,
+    double Value
+    )
+{
+    if (outputFormat == OutputJson) {
+        printf(",\"%s\":%.3f", Metric, Value);
+    } else if (outputFormat == OutputCsv) {
+        printf("%s,%s,%d,%s,%.3f\n", Record, modestr, Id, Metric, Value);
+    }
+}
+
+VOID
+EndRecord(
+    VOID
+    )
+{
+    if (outputFormat == OutputJson) {
+        printf("}\n");
+    }
+}
+
+INT64
+QpcToUs64(
+    INT64 Qpc,
+    INT64 QpcFrequency
+    )
+{
+    //
+    // Multiply by a big number (1000000, to convert seconds to microseconds)
+    // and divide by a big number (QpcFrequency, to convert counts to secs).
+    //
+    // Avoid overflow with separate multiplication/division of the high and low
+    // bits.
+    //
+    // Taken from QuicTimePlatToUs64 (https://github.com/microsoft/msquic).
+    //
+    UINT64 High = (Qpc >> 32) * 1000000;
+    UINT64 Low = (Qpc & 0xFFFFFFFF) * 1000000;
+    return
+        ((High / QpcFrequency) << 32) +
+        ((Low + ((High % QpcFrequency) << 32)) / QpcFrequency);
+}
+
+UINT32
+LatHistogramIndex(
+    UINT64 Value
+    )
+{
+    ULONG msb;
+    UINT32 shift;
+
+    if (Value < 2 * LAT_SUB_BUCKET_COUNT) {
+        return (UINT32)Value;
+    }
+
+    _BitScanReverse64(&msb, Value);
+    shift = msb - LAT_SUB_BUCKET_BITS;
+
+    return
+        (UINT32)((shift + 1) * LAT_SUB_BUCKET_COUNT +
+            ((Value >> shift) - LAT_SUB_BUCKET_COUNT));
+}
+
+UINT64
+LatHistogramValue(
+    UINT32 Index
+    )
+{
+    UINT32 shift;
+
+    //
+    // Returns the highest value recorded into the bucket.
+    //
+    if (Index < 2 * LAT_SUB_BUCKET_COUNT) {
+        return Index;
+    }
+
+    shift = (UINT32)(Index / LAT_SUB_BUCKET_COUNT) - 1;
+
+    return
+        (((Index % LAT_SUB_BUCKET_COUNT) + LAT_SUB_BUCKET_COUNT) << shift) +
+            ((1ui64 << shift) - 1);
+}
+
+VOID
+LatHistogramRecord(
+    LAT_HISTOGRAM *Histogram,
+    INT64 Value
+    )
+{
+    UINT32 index = LatHistogramIndex(Value > 0 ? (UINT64)Value : 0);
+
+    //
+    // The recording thread is the only writer. Other threads may read the
+    // buckets concurrently; each bucket only ever increases.
+    //
+    WriteNoFence64(
+        (LONG64 *)&Histogram->buckets[index], (LONG64)Histogram->buckets[index] + 1);
+}
+
+UINT64
+LatHistogramAdd(
+    LAT_HISTOGRAM *Dst,
+    CONST LAT_HISTOGRAM *Src
+    )
+{
+    UINT64 count = 0;
+
+    for (UINT32 i = 0; i < LAT_BUCKET_COUNT; i++) {
+        UINT64 bucket = (UINT64)ReadNoFence64((LONG64 *)&Src->buckets[i]);
+        Dst->buckets[i] += bucket;
+        count += bucket;
+    }
+
+    return count;
+}
+
+UINT64
+LatHistogramInterval(
+    LAT_HISTOGRAM *Interval,
+    LAT_HISTOGRAM *Last,
+    CONST LAT_HISTOGRAM *Current
+    )
+{
+    UINT64 count = 0;
+
+    //
+    // Computes the samples recorded since the last interval from a snapshot of
+    // a histogram that may be concurrently recorded into.
+    //
+    for (UINT32 i = 0; i < LAT_BUCKET_COUNT; i++) {
+        UINT64 bucket = (UINT64)ReadNoFence64((LONG64 *)&Current->buckets[i]);
+        Interval->buckets[i] = bucket - Last->buckets[i];
+        Last->buckets[i] = bucket;
+        count += Interval->buckets[i];
+    }
+
+    return count;
+}
+
+UINT64
+LatHistogramPercentile(
+    CONST LAT_HISTOGRAM *Histogram,
+    UINT64 Count,
+    double Percentile
+    )
+{
+    UINT64 target = (UINT64)ceil(Count * Percentile / 100);
+    UINT64 cumulative = 0;
+
+    if (target == 0) {
+        target = 1;
+    }
+
+    for (UINT32 i = 0; i < LAT_BUCKET_COUNT; i++) {
+        cumulative += Histogram->buckets[i];
+        if (cumulative >= target) {
+            return LatHistogramValue(i);
+        }
+    }
+
+    return 0;
+}
+
+VOID
+PrintLatHistogram(
+    CONST CHAR *Label,
+    CONST CHAR *Record,
+    INT Id,
+    CONST LAT_HISTOGRAM *Histogram,
+    UINT64 Count
+    )
+{
+    LARGE_INTEGER FreqQpc;
+    VERIFY(QueryPerformanceFrequency(&FreqQpc));
+
+#define LAT_US(_Percentile) \
+    QpcToUs64(LatHistogramPercentile(Histogram, Count, (_Percentile)), FreqQpc.QuadPart)
+
+    if (outputFormat != OutputText) {
+        BeginRecord(Record, Id);
+        RecordMetric(Record, Id, "latSamples", (double)Count);
+        if (Count > 0) {
+            RecordMetric(Record, Id, "latMinUs", (double)LAT_US(0));
+            RecordMetric(Record, Id, "latP50Us", (double)LAT_US(50));
+            RecordMetric(Record, Id, "latP90Us", (double)LAT_US(90));
+            RecordMetric(Record, Id, "latP99Us", (double)LAT_US(99));
+            RecordMetric(Record, Id, "latP99.9Us", (double)LAT_US(99.9));
+            RecordMetric(Record, Id, "latP99.99Us", (double)LAT_US(99.99));
+            RecordMetric(Record, Id, "latP99.999Us", (double)LAT_US(99.999));
+            RecordMetric(Record, Id, "latP99.9999Us", (double)LAT_US(99.9999));
+            RecordMetric(Record, Id, "latMaxUs", (double)LAT_US(100));
+        }
+        EndRecord();
+        return;
+    }
+
+    if (Count == 0) {
+        printf("%s: no latency samples\n", Label);
+        return;
+    }
+
+    printf(
+        "%s: min=%llu P50=%llu P90=%llu P99=%llu P99.9=%llu P99.99=%llu P99.999=%llu P99.9999=%llu max=%llu us rtt (%llu samples)\n",
+        Label, LAT_US(0), LAT_US(50), LAT_US(90), LAT_US(99), LAT_US(99.9), LAT_US(99.99),
+        LAT_US(99.999), LAT_US(99.9999), LAT_US(100), Count);
+
+#undef LAT_US
+}
+
+VOID
+PrintFinalLatStats(
+    MY_QUEUE *Queue
+    )
+{
+    CHAR label[32];
+    UINT64 count;
+
+    ZeroMemory(Queue->latHistogramInterval, sizeof(*Queue->latHistogramInterval));
+    count = LatHistogramAdd(Queue->latHistogramInterval, Queue->latHistogram);
+
+    sprintf_s(label, sizeof(label), "%-3s[%d]", modestr, Queue->queueId);
+    PrintLatHistogram(label, "lat", Queue->queueId, Queue->latHistogramInterval, count);
+}
+
+VOID
+PrintMergedLatStats(
+    MY_THREAD *Threads,
+    UINT32 ThreadCount
+    )
+{
+    LAT_HISTOGRAM *merged;
+    CHAR label[32];
+    UINT64 count = 0;
+    UINT32 queueCount = 0;
+
+    for (UINT32 tIndex = 0; tIndex < ThreadCount; tIndex++) {
+        queueCount += Threads[tIndex].queueCount;
+    }
+
+    if (queueCount < 2) {
+        return;
+    }
+
+    merged = malloc(sizeof(*merged));
+    ASSERT_FRE(merged != NULL);
+    ZeroMemory(merged, sizeof(*merged));
+
+    for (UINT32 tIndex = 0; tIndex < ThreadCount; tIndex++) {
+        MY_THREAD *Thread = &Threads[tIndex];
+        for (UINT32 qIndex = 0; qIndex < Thread->queueCount; qIndex++) {
+            count += LatHistogramAdd(merged, Thread->queues[qIndex].latHistogram);
+        }
+    }
+
+    sprintf_s(label, sizeof(label), "%-3s[all]", modestr);
+    PrintLatHistogram(label, "lat", -1, merged, count);
+
+    free(merged);
+}
+
 VOID
 ProcessPeriodicStats(
     MY_QUEUE *Queue
@@ -572,7 +1274,10 @@ ProcessPeriodicStats(
     UINT64 tickDiff = currentTick - Queue->lastTick;
     UINT64 packetCount;
     UINT64 packetDiff;
+    UINT64 rxPacketCount;
+    UINT64 rxPacketDiff;
     double kpps;
+    double rxKpps;
 
     if (tickDiff == 0) {
         return;
@@ -582,6 +1287,10 @@ ProcessPeriodicStats(
     packetDiff = packetCount - Queue->lastPacketCount;
     kpps = (packetDiff) ? (double)packetDiff / tickDiff : 0;
 
+    rxPacketCount = Queue->rxPacketCount;
+    rxPacketDiff = rxPacketCount - Queue->lastRxPacketCount;
+    rxKpps = (rxPacketDiff) ? (double)rxPacketDiff / tickDiff : 0;
+
     if (Queue->flags.periodicStats) {
         XSK_STATISTICS stats;
         UINT32 optSize = sizeof(stats);
@@ -622,79 +1331,71 @@ ProcessPeriodicStats(
         rxDropKpps = rxDropDiff ? (double)rxDropDiff / tickDiff : 0;
         Queue->lastRxDropCount = stats.RxDropped;
 
-        printf("%s[%d]: %9.3f kpps %9.3f rxDropKpps rxDrop:%llu rxTrunc:%llu "
-            "rxBadDesc:%llu txBadDesc:%llu pokesAvoided:%llu%%\n",
-            modestr, Queue->queueId, kpps, rxDropKpps, stats.RxDropped, stats.RxTruncated,
-            stats.RxInvalidDescriptors, stats.TxInvalidDescriptors,
-            pokesAvoidedPercentage);
+        if (mode == ModeL2Fwd) {
+            XSK_STATISTICS peerStats;
 
-        Queue->lastPokesRequestedCount = pokesRequested;
-        Queue->lastPokesPerformedCount = pokesPerformed;
-    }
-
-    Queue->statsArray[Queue->currStatsArrayIdx++ % STATS_ARRAY_SIZE] = kpps;
-    Queue->lastPacketCount = packetCount;
-    Queue->lastTick = currentTick;
-}
-
-INT
-LatCmp(
-    const VOID *A,
-    const VOID *B
-    )
-{
-    const UINT64 *a = A;
-    const UINT64 *b = B;
-    return (*a > *b) - (*a < *b);
-}
-
-INT64
-QpcToUs64(
-    INT64 Qpc,
-    INT64 QpcFrequency
-    )
-{
-    //
-    // Multiply by a big number (1000000, to convert seconds to microseconds)
-    // and divide by a big number (QpcFrequency, to convert counts to secs).
-    //
-    // Avoid overflow with separate multiplication/division of the high and low
-    // bits.
-    //
-    // Taken from QuicTimePlatToUs64 (https://github.com/microsoft/msquic).
-    //
-    UINT64 High = (Qpc >> 32) * 1000000;
-    UINT64 Low = (Qpc & 0xFFFFFFFF) * 1000000;
-    return
-        ((High / QpcFrequency) << 32) +
-        ((Low + ((High % QpcFrequency) << 32)) / QpcFrequency);
-}
+            //
+            // Transmit statistics are maintained by the peer socket.
+            //
+            optSize = sizeof(peerStats);
+            res =
+                XdpApi->XskGetSockopt(
+                    Queue->peerSock, XSK_SOCKOPT_STATISTICS, &peerStats, &optSize);
+            ASSERT_FRE(res == S_OK);
+            ASSERT_FRE(optSize == sizeof(peerStats));
+            stats.TxInvalidDescriptors = peerStats.TxInvalidDescriptors;
+        }
 
-VOID
-PrintFinalLatStats(
-    MY_QUEUE *Queue
-    )
-{
-    LARGE_INTEGER FreqQpc;
-    VERIFY(QueryPerformanceFrequency(&FreqQpc));
+        if (outputFormat == OutputText && mode == ModeL2Fwd) {
+            printf("%s[%d]: %9.3f rxKpps %9.3f txKpps %9.3f rxDropKpps rxDrop:%llu "
+                "rxTrunc:%llu rxBadDesc:%llu txBadDesc:%llu pokesAvoided:%llu%%\n",
+                modestr, Queue->queueId, rxKpps, kpps, rxDropKpps, stats.RxDropped,
+                stats.RxTruncated, stats.RxInvalidDescriptors, stats.TxInvalidDescriptors,
+                pokesAvoidedPercentage);
+        } else if (outputFormat == OutputText) {
+            printf("%s[%d]: %9.3f kpps %9.3f rxDropKpps rxDrop:%llu rxTrunc:%llu "
+                "rxBadDesc:%llu txBadDesc:%llu pokesAvoided:%llu%%\n",
+                modestr, Queue->queueId, kpps, rxDropKpps, stats.RxDropped, stats.RxTruncated,
+                stats.RxInvalidDescriptors, stats.TxInvalidDescriptors,
+                pokesAvoidedPercentage);
+        } else {
+            BeginRecord("interval", Queue->queueId);
+            RecordMetric("interval", Queue->queueId, "kpps", kpps);
+            if (mode == ModeL2Fwd) {
+                RecordMetric("interval", Queue->queueId, "rxKpps", rxKpps);
+            }
+            RecordMetric("interval", Queue->queueId, "rxDropKpps", rxDropKpps);
+            RecordMetric("interval", Queue->queueId, "rxDrop", (double)stats.RxDropped);
+            RecordMetric("interval", Queue->queueId, "rxTrunc", (double)stats.RxTruncated);
+            RecordMetric(
+                "interval", Queue->queueId, "rxBadDesc", (double)stats.RxInvalidDescriptors);
+            RecordMetric(
+                "interval", Queue->queueId, "txBadDesc", (double)stats.TxInvalidDescriptors);
+            RecordMetric(
+                "interval", Queue->queueId, "pokesAvoidedPercent",
+                (double)pokesAvoidedPercentage);
+            EndRecord();
+        }
+
+        Queue->lastPokesRequestedCount = pokesRequested;
+        Queue->lastPokesPerformedCount = pokesPerformed;
+    }
 
-    qsort(Queue->latSamples, Queue->latIndex, sizeof(*Queue->latSamples), LatCmp);
+    if (mode == ModeLat && Queue->flags.periodicStats) {
+        CHAR label[32];
+        UINT64 count =
+            LatHistogramInterval(
+                Queue->latHistogramInterval, Queue->latHistogramLast, Queue->latHistogram);
 
-    for (UINT32 i = 0; i < Queue->latIndex; i++) {
-        Queue->latSamples[i] = QpcToUs64(Queue->latSamples[i], FreqQpc.QuadPart);
+        sprintf_s(label, sizeof(label), "%s[%d]", modestr, Queue->queueId);
+        PrintLatHistogram(
+            label, "latInterval", Queue->queueId, Queue->latHistogramInterval, count);
     }
 
-    printf(
-        "%-3s[%d]: min=%llu P50=%llu P90=%llu P99=%llu P99.9=%llu P99.99=%llu P99.999=%llu P99.9999=%llu us rtt\n",
-        modestr, Queue->queueId,
-        Queue->latSamples[0],
-        Queue->latSamples[(UINT32)(Queue->latIndex * 0.5)],
-        Queue->latSamples[(UINT32)(Queue->latIndex * 0.9)],
-        Queue->latSamples[(UINT32)(Queue->latIndex * 0.99)],
-        Queue->latSamples[(UINT32)(Queue->latIndex * 0.999)],
-        Queue->latSamples[(UINT32)(Queue->latIndex * 0.9999)],
-        Queue->latSamples[(UINT32)(Queue->latIndex * 0.99999)],
-        Queue->latSamples[(UINT32)(Queue->latIndex * 0.999999)]);
+    Queue->statsArray[Queue->currStatsArrayIdx++ % STATS_ARRAY_SIZE] = kpps;
+    Queue->lastPacketCount = packetCount;
+    Queue->lastRxPacketCount = rxPacketCount;
+    Queue->lastTick = currentTick;
 }
 
 VOID
@@ -760,14 +1461,94 @@ PrintFinalStats(
 
     stdDev = sqrt(stdDev / (numEntries - 1));
 
-    printf("%-3s[%d]: avg=%08.3f stddev=%08.3f min=%08.3f max=%08.3f Kpps\n",
-        modestr, Queue->queueId, avg, stdDev, min, max);
+    if (outputFormat == OutputText) {
+        printf("%-3s[%d]: avg=%08.3f stddev=%08.3f min=%08.3f max=%08.3f Kpps\n",
+            modestr, Queue->queueId, avg, stdDev, min, max);
+        if (mode == ModeL2Fwd) {
+            printf("%-3s[%d]: rx=%llu tx=%llu packets\n",
+                modestr, Queue->queueId, Queue->rxPacketCount, Queue->packetCount);
+        }
+    } else {
+        BeginRecord("queue", Queue->queueId);
+        RecordMetric("queue", Queue->queueId, "avgKpps", avg);
+        RecordMetric("queue", Queue->queueId, "stddevKpps", stdDev);
+        RecordMetric("queue", Queue->queueId, "minKpps", min);
+        RecordMetric("queue", Queue->queueId, "maxKpps", max);
+        RecordMetric("queue", Queue->queueId, "packets", (double)Queue->packetCount);
+        if (mode == ModeL2Fwd) {
+            RecordMetric("queue", Queue->queueId, "rxPackets", (double)Queue->rxPacketCount);
+        }
+        EndRecord();
+    }
 
     if (mode == ModeLat) {
         PrintFinalLatStats(Queue);
     }
 }
 
+UINT64
+FileTimeToUs(
+    CONST FILETIME *FileTime
+    )
+{
+    ULARGE_INTEGER time;
+
+    time.LowPart = FileTime->dwLowDateTime;
+    time.HighPart = FileTime->dwHighDateTime;
+
+    return time.QuadPart / 10;
+}
+
+VOID
+PrintThreadStats(
+    MY_THREAD *Thread,
+    UINT32 ThreadIndex
+    )
+{
+    ULONG64 cycles;
+    FILETIME creationTime;
+    FILETIME exitTime;
+    FILETIME kernelTime;
+    FILETIME userTime;
+    UINT64 kernelUs;
+    UINT64 userUs;
+    UINT64 packets = 0;
+    double cyclesPerPacket;
+    double kernelPercent;
+
+    //
+    // Attribute the thread's CPU cost to the packets processed by its queues.
+    // Cycles are those charged to the thread itself, in both user and kernel
+    // mode; work performed by XDP on other threads or in DPCs is not included.
+    //
+    for (UINT32 qIndex = 0; qIndex < Thread->queueCount; qIndex++) {
+        packets += Thread->queues[qIndex].packetCount;
+    }
+
+    VERIFY(QueryThreadCycleTime(Thread->threadHandle, &cycles));
+    VERIFY(GetThreadTimes(Thread->threadHandle, &creationTime, &exitTime, &kernelTime, &userTime));
+    kernelUs = FileTimeToUs(&kernelTime);
+    userUs = FileTimeToUs(&userTime);
+
+    cyclesPerPacket = packets ? (double)cycles / packets : 0;
+    kernelPercent = (kernelUs + userUs) ? (double)kernelUs * 100 / (kernelUs + userUs) : 0;
+
+    if (outputFormat == OutputText) {
+        printf(
+            "thread[%u]: packets=%llu cycles/pkt=%.1f kernel=%llu us user=%llu us (%.1f%% kernel)\n",
+            ThreadIndex, packets, cyclesPerPacket, kernelUs, userUs, kernelPercent);
+    } else {
+        BeginRecord("thread", (INT)ThreadIndex);
+        RecordMetric("thread", (INT)ThreadIndex, "packets", (double)packets);
+        RecordMetric("thread", (INT)ThreadIndex, "cycles", (double)cycles);
+        RecordMetric("thread", (INT)ThreadIndex, "cyclesPerPacket", cyclesPerPacket);
+        RecordMetric("thread", (INT)ThreadIndex, "kernelUs", (double)kernelUs);
+        RecordMetric("thread", (INT)ThreadIndex, "userUs", (double)userUs);
+        RecordMetric("thread", (INT)ThreadIndex, "kernelPercent", kernelPercent);
+        EndRecord();
+    }
+}
+
 VOID
 NotifyDriver(
     MY_QUEUE *Queue,
@@ -912,7 +1693,7 @@ DoRxMode(
         queue->lastTick = GetTickCount64();
     }
 
-    printf("Receiving...\n");
+    printf_text("Receiving...\n");
     SetEvent(Thread->readyEvent);
 
     while (!ReadBooleanNoFence(&done)) {
@@ -945,10 +1726,25 @@ WriteTxPackets(
         txDesc->Address.BaseAddress = *freeDesc;
         assert(Queue->umemReg.Headroom <= MAXUINT16);
         txDesc->Address.Offset = (UINT16)Queue->umemReg.Headroom;
-        txDesc->Length = Queue->txiosize;
-        //
-        // This benchmark does not write data into the TX packet.
-        //
+
+        if (Queue->txSchedule != NULL) {
+            UINT32 entry = Queue->txScheduleIndex++ % TX_SCHEDULE_SIZE;
+
+            //
+            // Rewrite the frame headers in place for the next scheduled flow
+            // and size.
+            //
+            memcpy(
+                (UCHAR *)Queue->umemReg.Address + *freeDesc + Queue->umemReg.Headroom,
+                Queue->txSchedule + (SIZE_T)entry * Queue->txPatternLength,
+                Queue->txPatternLength);
+            txDesc->Length = Queue->txScheduleLengths[entry];
+        } else {
+            //
+            // This benchmark does not write data into the TX packet.
+            //
+            txDesc->Length = Queue->txiosize;
+        }
         printf_verbose("Producing TX entry {address:%llu, offset:%llu, length:%d}\n",
             txDesc->Address.BaseAddress, txDesc->Address.Offset, txDesc->Length);
     }
@@ -1045,7 +1841,7 @@ DoTxMode(
         queue->lastTick = GetTickCount64();
     }
 
-    printf("Sending...\n");
+    printf_text("Sending...\n");
     SetEvent(Thread->readyEvent);
 
     while (!ReadBooleanNoFence(&done)) {
@@ -1203,7 +1999,7 @@ DoFwdMode(
         queue->lastTick = GetTickCount64();
     }
 
-    printf("Forwarding...\n");
+    printf_text("Forwarding...\n");
     SetEvent(Thread->readyEvent);
 
     while (!ReadBooleanNoFence(&done)) {
@@ -1222,6 +2018,202 @@ DoFwdMode(
     }
 }
 
+VOID
+NotifyPeer(
+    MY_QUEUE *Queue,
+    XSK_NOTIFY_FLAGS DirectionFlags
+    )
+{
+    HRESULT res;
+    XSK_NOTIFY_RESULT_FLAGS notifyResult;
+
+    if (Queue->flags.optimizePoking) {
+        //
+        // Ensure poke flags are read after writing producer/consumer indices.
+        //
+        MemoryBarrier();
+
+        if ((DirectionFlags & XSK_NOTIFY_FLAG_POKE_TX) &&
+            !XskRingProducerNeedPoke(&Queue->peerTxRing)) {
+            DirectionFlags &= ~XSK_NOTIFY_FLAG_POKE_TX;
+        }
+    }
+
+    Queue->pokesRequestedCount++;
+
+    if (DirectionFlags != 0) {
+        Queue->pokesPerformedCount++;
+        res =
+            XdpApi->XskNotifySocket(
+                Queue->peerSock, DirectionFlags, WAIT_DRIVER_TIMEOUT_MS, &notifyResult);
+
+        if (DirectionFlags & XSK_NOTIFY_FLAG_WAIT_TX) {
+            ASSERT_FRE(res == S_OK || res == HRESULT_FROM_WIN32(ERROR_TIMEOUT));
+        } else {
+            ASSERT_FRE(res == S_OK);
+            ASSERT_FRE(notifyResult == 0);
+        }
+    }
+}
+
+UINT32
+ProcessL2Fwd(
+    MY_QUEUE *Queue,
+    BOOLEAN Wait
+    )
+{
+    XSK_NOTIFY_FLAGS notifyFlags = XSK_NOTIFY_FLAG_NONE;
+    XSK_NOTIFY_FLAGS peerNotifyFlags = XSK_NOTIFY_FLAG_NONE;
+    UINT32 available;
+    UINT32 consumerIndex;
+    UINT32 producerIndex;
+    UINT32 processed = 0;
+
+    //
+    // Move packets from the RX ring to the peer TX ring. Both sockets share a
+    // UMEM, so only the descriptors are forwarded; frames are not modified.
+    //
+    available =
+        RingPairReserve(
+            &Queue->rxRing, &consumerIndex, &Queue->peerTxRing, &producerIndex,
+            Queue->iobatchsize);
+    if (available > 0) {
+        for (UINT32 i = 0; i < available; i++) {
+            XSK_BUFFER_DESCRIPTOR *rxDesc = XskRingGetElement(&Queue->rxRing, consumerIndex++);
+            XSK_BUFFER_DESCRIPTOR *txDesc =
+                XskRingGetElement(&Queue->peerTxRing, producerIndex++);
+
+            *txDesc = *rxDesc;
+
+            printf_verbose("Forwarding RX entry  {address:%llu, offset:%llu, length:%d}\n",
+                rxDesc->Address.BaseAddress, rxDesc->Address.Offset, rxDesc->Length);
+        }
+
+        XskRingConsumerRelease(&Queue->rxRing, available);
+        XskRingProducerSubmit(&Queue->peerTxRing, available);
+
+        processed += available;
+        Queue->rxPacketCount += available;
+        peerNotifyFlags |= XSK_NOTIFY_FLAG_POKE_TX;
+    }
+
+    //
+    // Move packets from the peer completion ring to the free ring.
+    //
+    available =
+        RingPairReserve(
+            &Queue->peerCompRing, &consumerIndex, &Queue->freeRing, &producerIndex,
+            Queue->iobatchsize);
+    if (available > 0) {
+        for (UINT32 i = 0; i < available; i++) {
+            UINT64 *compDesc = XskRingGetElement(&Queue->peerCompRing, consumerIndex++);
+            UINT64 *freeDesc = XskRingGetElement(&Queue->freeRing, producerIndex++);
+
+            *freeDesc = *compDesc;
+
+            printf_verbose("Consuming COMP entry {address:%llu}\n", *compDesc);
+        }
+
+        XskRingConsumerRelease(&Queue->peerCompRing, available);
+        XskRingProducerSubmit(&Queue->freeRing, available);
+
+        processed += available;
+        Queue->packetCount += available;
+
+        if (XskRingProducerReserve(&Queue->peerTxRing, MAXUINT32, &producerIndex) !=
+                Queue->peerTxRing.Size) {
+            peerNotifyFlags |= XSK_NOTIFY_FLAG_POKE_TX;
+        }
+    }
+
+    //
+    // Move packets from the free ring to the fill ring.
+    //
+    available =
+        RingPairReserve(
+            &Queue->freeRing, &consumerIndex, &Queue->fillRing, &producerIndex, Queue->iobatchsize);
+    if (available > 0) {
+        for (UINT32 i = 0; i < available; i++) {
+            UINT64 *freeDesc = XskRingGetElement(&Queue->freeRing, consumerIndex++);
+            UINT64 *fillDesc = XskRingGetElement(&Queue->fillRing, producerIndex++);
+
+            *fillDesc = *freeDesc;
+
+            printf_verbose("Producing FILL entry {address:%llu}\n", *freeDesc);
+        }
+
+        XskRingConsumerRelease(&Queue->freeRing, available);
+        XskRingProducerSubmit(&Queue->fillRing, available);
+
+        processed += available;
+        notifyFlags |= XSK_NOTIFY_FLAG_POKE_RX;
+    }
+
+    if (Wait && processed == 0) {
+        //
+        // A single notification cannot wait on both sockets: wait for peer TX
+        // completions while any frames are outstanding, otherwise for RX.
+        //
+        if (XskRingProducerReserve(&Queue->peerTxRing, MAXUINT32, &producerIndex) !=
+                Queue->peerTxRing.Size) {
+            peerNotifyFlags |= XSK_NOTIFY_FLAG_WAIT_TX;
+        } else {
+            notifyFlags |= XSK_NOTIFY_FLAG_WAIT_RX;
+        }
+    }
+
+    if (Queue->pollMode == XSK_POLL_MODE_SOCKET) {
+        //
+        // If socket poll mode is supported by the program, always enable pokes.
+        //
+        notifyFlags |= XSK_NOTIFY_FLAG_POKE_RX;
+        peerNotifyFlags |= XSK_NOTIFY_FLAG_POKE_TX;
+    }
+
+    if (peerNotifyFlags != 0) {
+        NotifyPeer(Queue, peerNotifyFlags);
+    }
+
+    if (notifyFlags != 0) {
+        NotifyDriver(Queue, notifyFlags);
+    }
+
+    return processed;
+}
+
+VOID
+DoL2FwdMode(
+    MY_THREAD *Thread
+    )
+{
+    for (UINT32 qIndex = 0; qIndex < Thread->queueCount; qIndex++) {
+        MY_QUEUE *queue = &Thread->queues[qIndex];
+
+        queue->flags.rx = TRUE;
+        queue->flags.tx = FALSE;
+        SetupSock(ifindex, queue);
+        SetupPeerSock(txIfindex, queue);
+        queue->lastTick = GetTickCount64();
+    }
+
+    printf_text("Forwarding from ifindex %d to ifindex %d...\n", ifindex, txIfindex);
+    SetEvent(Thread->readyEvent);
+
+    while (!ReadBooleanNoFence(&done)) {
+        BOOLEAN Processed = FALSE;
+
+        for (UINT32 qIndex = 0; qIndex < Thread->queueCount; qIndex++) {
+            Processed |= !!ProcessL2Fwd(&Thread->queues[qIndex], Thread->wait);
+        }
+
+        if (!Processed) {
+            for (UINT32 i = 0; i < Thread->yieldCount; i++) {
+                YieldProcessor();
+            }
+        }
+    }
+}
+
 UINT32
 ProcessLat(
     MY_QUEUE *Queue,
@@ -1260,8 +2252,9 @@ ProcessLat(
 
             printf_verbose("latency: %lld\n", NowQpc.QuadPart - *Timestamp);
 
-            if (Queue->latIndex < Queue->latSamplesCount) {
-                Queue->latSamples[Queue->latIndex++] = NowQpc.QuadPart - *Timestamp;
+            if (Queue->latSamplesCount == 0 || Queue->latIndex < Queue->latSamplesCount) {
+                LatHistogramRecord(Queue->latHistogram, NowQpc.QuadPart - *Timestamp);
+                Queue->latIndex++;
             }
 
             *fillDesc = rxDesc->Address.BaseAddress;
@@ -1383,7 +2376,7 @@ DoLatMode(
         XskRingProducerSubmit(&queue->fillRing, available);
     }
 
-    printf("Probing latency...\n");
+    printf_text("Probing latency...\n");
     SetEvent(Thread->readyEvent);
 
     while (!ReadBooleanNoFence(&done)) {
@@ -1427,6 +2420,9 @@ ParseQueueArgs(
     Queue->flags.optimizePoking = TRUE;
     Queue->txiosize = DEFAULT_TX_IO_SIZE;
     Queue->latSamplesCount = DEFAULT_LAT_COUNT;
+    Queue->flowCount = DEFAULT_FLOW_COUNT;
+    Queue->flowVary = FlowVarySrcPort;
+    CONST CHAR *flowWeights = NULL;
 
     for (INT i = 0; i < argc; i++) {
         if (!_stricmp(argv[i], "-id")) {
@@ -1478,6 +2474,8 @@ ParseQueueArgs(
                 Queue->pollMode = XSK_POLL_MODE_BUSY;
             } else if (!_stricmp(argv[i], "socket")) {
                 Queue->pollMode = XSK_POLL_MODE_SOCKET;
+            } else if (!_stricmp(argv[i], "inline")) {
+                Queue->pollMode = XSK_POLL_MODE_INLINE;
             } else {
                 Usage();
             }
@@ -1513,6 +2511,43 @@ ParseQueueArgs(
                 Usage();
             }
             Queue->latSamplesCount = atoi(argv[i]);
+        } else if (!strcmp(argv[i], "-flows")) {
+            if (++i >= argc) {
+                Usage();
+            }
+            Queue->flowCount = atoi(argv[i]);
+            ASSERT_FRE(Queue->flowCount > 0);
+        } else if (!strcmp(argv[i], "-flow_vary")) {
+            if (++i >= argc) {
+                Usage();
+            }
+            Queue->flowVary = 0;
+            if (strstr(argv[i], "srcport") != NULL) {
+                Queue->flowVary |= FlowVarySrcPort;
+            }
+            if (strstr(argv[i], "dstport") != NULL) {
+                Queue->flowVary |= FlowVaryDstPort;
+            }
+            if (strstr(argv[i], "srcip") != NULL) {
+                Queue->flowVary |= FlowVarySrcIp;
+            }
+            if (strstr(argv[i], "dstip") != NULL) {
+                Queue->flowVary |= FlowVaryDstIp;
+            }
+            if (Queue->flowVary == 0) {
+                Usage();
+            }
+        } else if (!strcmp(argv[i], "-flow_weights")) {
+            if (++i >= argc) {
+                Usage();
+            }
+            flowWeights = argv[i];
+        } else if (!strcmp(argv[i], "-imix")) {
+            if (++i >= argc) {
+                Usage();
+            }
+            Queue->txSizeMixCount =
+                ParseMixList(argv[i], Queue->txSizeMix, RTL_NUMBER_OF(Queue->txSizeMix), TRUE);
         } else {
             Usage();
         }
@@ -1530,13 +2565,43 @@ ParseQueueArgs(
     ASSERT_FRE(Queue->umemchunksize >= Queue->umemheadroom);
     ASSERT_FRE(Queue->umemchunksize - Queue->umemheadroom >= Queue->txPatternLength);
 
+    if (Queue->flowCount > 1 || Queue->txSizeMixCount > 0) {
+        ASSERT_FRE(mode == ModeTx);
+        ASSERT_FRE(Queue->txPattern != NULL);
+
+        Queue->flowWeights = malloc(Queue->flowCount * sizeof(*Queue->flowWeights));
+        ASSERT_FRE(Queue->flowWeights != NULL);
+        for (UINT32 f = 0; f < Queue->flowCount; f++) {
+            Queue->flowWeights[f] = 1;
+        }
+
+        if (flowWeights != NULL) {
+            TX_MIX_ENTRY *weights = malloc(Queue->flowCount * sizeof(*weights));
+            UINT32 weightCount;
+
+            ASSERT_FRE(weights != NULL);
+            weightCount = ParseMixList(flowWeights, weights, Queue->flowCount, FALSE);
+            for (UINT32 f = 0; f < weightCount; f++) {
+                Queue->flowWeights[f] = weights[f].value;
+            }
+            free(weights);
+        }
+
+        SetupTxSchedule(Queue);
+    }
+
     if (mode == ModeLat) {
         ASSERT_FRE(
             Queue->umemchunksize - Queue->umemheadroom >= Queue->txPatternLength + sizeof(UINT64));
 
-        Queue->latSamples = malloc(Queue->latSamplesCount * sizeof(*Queue->latSamples));
-        ASSERT_FRE(Queue->latSamples != NULL);
-        ZeroMemory(Queue->latSamples, Queue->latSamplesCount * sizeof(*Queue->latSamples));
+        Queue->latHistogram = malloc(sizeof(*Queue->latHistogram));
+        ASSERT_FRE(Queue->latHistogram != NULL);
+        ZeroMemory(Queue->latHistogram, sizeof(*Queue->latHistogram));
+        Queue->latHistogramLast = malloc(sizeof(*Queue->latHistogramLast));
+        ASSERT_FRE(Queue->latHistogramLast != NULL);
+        ZeroMemory(Queue->latHistogramLast, sizeof(*Queue->latHistogramLast));
+        Queue->latHistogramInterval = malloc(sizeof(*Queue->latHistogramInterval));
+        ASSERT_FRE(Queue->latHistogramInterval != NULL);
     }
 }
 
@@ -1645,6 +2710,8 @@ ParseArgs(
         mode = ModeTx;
     } else if (!_stricmp(argv[i], "fwd")) {
         mode = ModeFwd;
+    } else if (!_stricmp(argv[i], "l2fwd")) {
+        mode = ModeL2Fwd;
     } else if (!_stricmp(argv[i], "lat")) {
         mode = ModeLat;
     } else {
@@ -1666,6 +2733,11 @@ ParseArgs(
                 Usage();
             }
             udpDestPort = (UINT16)atoi(argv[i]);
+        } else if (!strcmp(argv[i], "-ti")) {
+            if (++i >= argc) {
+                Usage();
+            }
+            txIfindex = atoi(argv[i]);
         } else if (!strcmp(argv[i], "-d")) {
             if (++i >= argc) {
                 Usage();
@@ -1676,6 +2748,19 @@ ParseArgs(
         } else if (!_stricmp(argv[i], "-lp")) {
             largePages = TRUE;
             EnableLargePages();
+        } else if (!_stricmp(argv[i], "-output")) {
+            if (++i >= argc) {
+                Usage();
+            }
+            if (!_stricmp(argv[i], "text")) {
+                outputFormat = OutputText;
+            } else if (!_stricmp(argv[i], "json")) {
+                outputFormat = OutputJson;
+            } else if (!_stricmp(argv[i], "csv")) {
+                outputFormat = OutputCsv;
+            } else {
+                Usage();
+            }
         } else if (threadCount == 0) {
             Usage();
         }
@@ -1687,6 +2772,10 @@ ParseArgs(
         Usage();
     }
 
+    if (txIfindex == -1) {
+        txIfindex = ifindex;
+    }
+
     if (threadCount == 0) {
         Usage();
     }
@@ -1775,6 +2864,8 @@ DoThread(
         DoTxMode(thread);
     } else if (mode == ModeFwd) {
         DoFwdMode(thread);
+    } else if (mode == ModeL2Fwd) {
+        DoL2FwdMode(thread);
     } else if (mode == ModeLat) {
         DoLatMode(thread);
     }
@@ -1816,6 +2907,10 @@ main(
 
     ASSERT_FRE(SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE));
 
+    if (outputFormat == OutputCsv) {
+        printf("record,mode,id,metric,value\n");
+    }
+
     for (UINT32 tIndex = 0; tIndex < threadCount; tIndex++) {
         threads[tIndex].readyEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
         ASSERT_FRE(threads[tIndex].readyEvent != NULL);
@@ -1843,6 +2938,11 @@ main(
         for (UINT32 qIndex = 0; qIndex < Thread->queueCount; qIndex++) {
             PrintFinalStats(&Thread->queues[qIndex]);
         }
+        PrintThreadStats(Thread, tIndex);
+    }
+
+    if (mode == ModeLat) {
+        PrintMergedLatStats(threads, threadCount);
     }
 
     XdpCloseApi(XdpApi);
@@ -0,0 +1,821 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#include "precomp.h"
+#include "driver.tmh"
+
+//
+// NMR client of the XSK NPI, exercised by the functional tests through the
+// ioctls in xsknpitestioctl.h.
+//
+
+#define XSKNPITEST_CHUNK_SIZE 4096
+#define XSKNPITEST_CHUNK_COUNT 4
+#define XSKNPITEST_RING_SIZE 4
+
+//
+// The RX fill ring owns every chunk but the last, which is used for TX.
+//
+#define XSKNPITEST_TX_CHUNK (XSKNPITEST_CHUNK_COUNT - 1)
+
+typedef struct _XSKNPITEST_SESSION {
+    EX_PUSH_LOCK Lock;
+    const XSK_KERNEL_DISPATCH *Dispatch;
+    XSK_KERNEL_SOCKET *Socket;
+    HANDLE Program;
+    UCHAR *Umem;
+    XSK_RING RxRing;
+    XSK_RING FillRing;
+    XSK_RING TxRing;
+    XSK_RING CompletionRing;
+    KEVENT RxEvent;
+    KEVENT CompletionEvent;
+} XSKNPITEST_SESSION;
+
+static DEVICE_OBJECT *XskNpiTestDeviceObject;
+static HANDLE XskNpiTestNmrClientHandle;
+
+//
+// The NMR binding is referenced by the attach itself and by each bound
+// session. The detach completes once the last reference is released.
+//
+static EX_PUSH_LOCK XskNpiTestBindingLock;
+static HANDLE XskNpiTestBindingHandle;
+static const XSK_KERNEL_DISPATCH *XskNpiTestDispatch;
+static LONG XskNpiTestBindingReferences;
+
+static
+const XSK_KERNEL_DISPATCH *
+XskNpiTestReferenceBinding(
+    VOID
+    )
+{
+    const XSK_KERNEL_DISPATCH *Dispatch;
+
+    KeEnterCriticalRegion();
+    ExAcquirePushLockShared(&XskNpiTestBindingLock);
+
+    Dispatch = XskNpiTestDispatch;
+    if (Dispatch != NULL) {
+        InterlockedIncrement(&XskNpiTestBindingReferences);
+    }
+
+    ExReleasePushLockShared(&XskNpiTestBindingLock);
+    KeLeaveCriticalRegion();
+
+    return Dispatch;
+}
+
+static
+VOID
+XskNpiTestDereferenceBinding(
+    VOID
+    )
+{
+    if (InterlockedDecrement(&XskNpiTestBindingReferences) == 0) {
+        NmrClientDetachProviderComplete(XskNpiTestBindingHandle);
+    }
+}
+
+static
+NTSTATUS
+XskNpiTestAttachProvider(
+    _In_ HANDLE NmrBindingHandle,
+    _In_ VOID *ClientContext,
+    _In_ const NPI_REGISTRATION_INSTANCE *ProviderRegistrationInstance
+    )
+{
+    NTSTATUS Status;
+    VOID *ProviderBindingContext;
+    const XSK_KERNEL_DISPATCH *Dispatch;
+
+    UNREFERENCED_PARAMETER(ClientContext);
+    UNREFERENCED_PARAMETER(ProviderRegistrationInstance);
+
+    TraceEnter(TRACE_CONTROL, "NmrBindingHandle=%p", NmrBindingHandle);
+
+    Status =
+        NmrClientAttachProvider(
+            NmrBindingHandle, NULL, NULL, &ProviderBindingContext, (const VOID **)&Dispatch);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    //
+    // Sockets are driven through the revision 2 routines.
+    //
+    if (Dispatch->Header.Revision < XSK_KERNEL_DISPATCH_REVISION_2 ||
+        Dispatch->Header.Size < XSK_KERNEL_DISPATCH_REVISION_2_SIZE) {
+        TraceError(
+            TRACE_CONTROL, "Unsupported dispatch Revision=%u Size=%u",
+            Dispatch->Header.Revision, Dispatch->Header.Size);
+        Status = STATUS_NOINTERFACE;
+        goto Exit;
+    }
+
+    KeEnterCriticalRegion();
+    ExAcquirePushLockExclusive(&XskNpiTestBindingLock);
+    XskNpiTestBindingHandle = NmrBindingHandle;
+    XskNpiTestBindingReferences = 1;
+    XskNpiTestDispatch = Dispatch;
+    ExReleasePushLockExclusive(&XskNpiTestBindingLock);
+    KeLeaveCriticalRegion();
+
+Exit:
+
+    TraceExitStatus(TRACE_CONTROL);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskNpiTestDetachProvider(
+    _In_ VOID *ClientBindingContext
+    )
+{
+    NTSTATUS Status;
+
+    UNREFERENCED_PARAMETER(ClientBindingContext);
+
+    TraceEnter(TRACE_CONTROL, "-");
+
+    KeEnterCriticalRegion();
+    ExAcquirePushLockExclusive(&XskNpiTestBindingLock);
+    XskNpiTestDispatch = NULL;
+    ExReleasePushLockExclusive(&XskNpiTestBindingLock);
+    KeLeaveCriticalRegion();
+
+    //
+    // Bound sessions keep using the dispatch until their handles are closed.
+    //
+    if (InterlockedDecrement(&XskNpiTestBindingReferences) == 0) {
+        Status = STATUS_SUCCESS;
+    } else {
+        Status = STATUS_PENDING;
+    }
+
+    TraceExitStatus(TRACE_CONTROL);
+
+    return Status;
+}
+
+static const NPI_MODULEID XskNpiTestModuleId = {
+    .Length = sizeof(NPI_MODULEID),
+    .Type = MIT_GUID,
+    .Guid = { /* 5c0e2f9a-1d47-4b83-9e26-7a4f3b8d0c15 */
+        0x5c0e2f9a,
+        0x1d47,
+        0x4b83,
+        {0x9e, 0x26, 0x7a, 0x4f, 0x3b, 0x8d, 0x0c, 0x15}
+    },
+};
+
+static const NPI_CLIENT_CHARACTERISTICS XskNpiTestClientCharacteristics = {
+    .Length = sizeof(NPI_CLIENT_CHARACTERISTICS),
+    .ClientAttachProvider = XskNpiTestAttachProvider,
+    .ClientDetachProvider = XskNpiTestDetachProvider,
+    .ClientRegistrationInstance = {
+        .Size = sizeof(NPI_REGISTRATION_INSTANCE),
+        .NpiId = &XSK_KERNEL_NPI_ID,
+        .ModuleId = &XskNpiTestModuleId,
+    },
+};
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XskNpiTestNotify(
+    _In_opt_ VOID *Context,
+    _In_ XSK_NOTIFY_RESULT_FLAGS Result
+    )
+{
+    XSKNPITEST_SESSION *Session = Context;
+
+    ASSERT(Session != NULL);
+    __analysis_assume(Session != NULL);
+
+    if (Result & XSK_NOTIFY_RESULT_FLAG_RX_AVAILABLE) {
+        KeSetEvent(&Session->RxEvent, IO_NO_INCREMENT, FALSE);
+    }
+
+    if (Result & XSK_NOTIFY_RESULT_FLAG_TX_COMP_AVAILABLE) {
+        KeSetEvent(&Session->CompletionEvent, IO_NO_INCREMENT, FALSE);
+    }
+}
+
+static
+VOID
+XskNpiTestSessionUnbind(
+    _Inout_ XSKNPITEST_SESSION *Session
+    )
+{
+    if (Session->Program != NULL) {
+        ZwClose(Session->Program);
+        Session->Program = NULL;
+    }
+
+    //
+    // Closing the socket waits for in-flight notifications.
+    //
+    if (Session->Socket != NULL) {
+        Session->Dispatch->Close(Session->Socket);
+        Session->Socket = NULL;
+    }
+
+    if (Session->Umem != NULL) {
+        ExFreePoolWithTag(Session->Umem, POOLTAG_UMEM);
+        Session->Umem = NULL;
+    }
+
+    if (Session->Dispatch != NULL) {
+        Session->Dispatch = NULL;
+        XskNpiTestDereferenceBinding();
+    }
+}
+
+static
+NTSTATUS
+XskNpiTestSetRingSize(
+    _In_ XSKNPITEST_SESSION *Session,
+    _In_ UINT32 OptionName
+    )
+{
+    UINT32 RingSize = XSKNPITEST_RING_SIZE;
+
+    return Session->Dispatch->SetSockopt(Session->Socket, OptionName, &RingSize, sizeof(RingSize));
+}
+
+static
+NTSTATUS
+XskNpiTestSessionBind(
+    _Inout_ XSKNPITEST_SESSION *Session,
+    _In_ const XSKNPITEST_BIND_IN *In
+    )
+{
+    NTSTATUS Status;
+    const XSK_KERNEL_DISPATCH *Dispatch;
+    XSK_UMEM_REG UmemReg = {0};
+    XSK_RING_INFO_SET RingInfo;
+    UINT32 OptionLength;
+    XDP_HOOK_ID HookId = {0};
+    XDP_CREATE_PROGRAM_FLAGS ProgramFlags = XDP_CREATE_PROGRAM_FLAG_NONE;
+    XDP_RULE Rule = {0};
+    UINT32 ProducerIndex;
+
+    TraceEnter(TRACE_CONTROL, "IfIndex=%u QueueId=%u", In->IfIndex, In->QueueId);
+
+    if (Session->Dispatch != NULL) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    Dispatch = XskNpiTestReferenceBinding();
+    if (Dispatch == NULL) {
+        Status = STATUS_DEVICE_NOT_READY;
+        goto Exit;
+    }
+    Session->Dispatch = Dispatch;
+
+    Status = Dispatch->Create(&Session->Socket);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Session->Umem =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, XSKNPITEST_CHUNK_SIZE * XSKNPITEST_CHUNK_COUNT, POOLTAG_UMEM);
+    if (Session->Umem == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    UmemReg.TotalSize = XSKNPITEST_CHUNK_SIZE * XSKNPITEST_CHUNK_COUNT;
+    UmemReg.ChunkSize = XSKNPITEST_CHUNK_SIZE;
+    UmemReg.Address = Session->Umem;
+
+    Status =
+        Dispatch->SetSockopt(Session->Socket, XSK_SOCKOPT_UMEM_REG, &UmemReg, sizeof(UmemReg));
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = XskNpiTestSetRingSize(Session, XSK_SOCKOPT_RX_RING_SIZE);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = XskNpiTestSetRingSize(Session, XSK_SOCKOPT_RX_FILL_RING_SIZE);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = XskNpiTestSetRingSize(Session, XSK_SOCKOPT_TX_RING_SIZE);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = XskNpiTestSetRingSize(Session, XSK_SOCKOPT_TX_COMPLETION_RING_SIZE);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status =
+        Dispatch->Bind(
+            Session->Socket, In->IfIndex, In->QueueId,
+            In->Flags | XSK_BIND_FLAG_RX | XSK_BIND_FLAG_TX);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = Dispatch->Activate(Session->Socket, XSK_ACTIVATE_FLAG_NONE);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    OptionLength = sizeof(RingInfo);
+    Status =
+        Dispatch->GetSockopt(Session->Socket, XSK_SOCKOPT_RING_INFO, &RingInfo, &OptionLength);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    //
+    // The rings are accessed directly via their system addresses.
+    //
+    XskRingInitialize(&Session->RxRing, &RingInfo.Rx);
+    XskRingInitialize(&Session->FillRing, &RingInfo.Fill);
+    XskRingInitialize(&Session->TxRing, &RingInfo.Tx);
+    XskRingInitialize(&Session->CompletionRing, &RingInfo.Completion);
+
+    if (XskRingProducerReserve(
+            &Session->FillRing, XSKNPITEST_TX_CHUNK, &ProducerIndex) != XSKNPITEST_TX_CHUNK) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    for (UINT32 Index = 0; Index < XSKNPITEST_TX_CHUNK; Index++) {
+        UINT64 *Fill = XskRingGetElement(&Session->FillRing, ProducerIndex++);
+        *Fill = (UINT64)Index * XSKNPITEST_CHUNK_SIZE;
+    }
+
+    XskRingProducerSubmit(&Session->FillRing, XSKNPITEST_TX_CHUNK);
+
+    Status =
+        Dispatch->SetNotifyRoutine(
+            Session->Socket, XSK_NOTIFY_FLAG_WAIT_RX | XSK_NOTIFY_FLAG_WAIT_TX,
+            XskNpiTestNotify, Session);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    if (In->Flags & XSK_BIND_FLAG_GENERIC) {
+        ProgramFlags |= XDP_CREATE_PROGRAM_FLAG_GENERIC;
+    } else if (In->Flags & XSK_BIND_FLAG_NATIVE) {
+        ProgramFlags |= XDP_CREATE_PROGRAM_FLAG_NATIVE;
+    }
+
+    HookId.Layer = XDP_HOOK_L2;
+    HookId.Direction = XDP_HOOK_RX;
+    HookId.SubLayer = XDP_HOOK_INSPECT;
+
+    Rule.Match = XDP_MATCH_ALL;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Redirect.Target = Dispatch->GetHandle(Session->Socket);
+
+    Status =
+        Dispatch->CreateProgram(
+            In->IfIndex, &HookId, In->QueueId, ProgramFlags, &Rule, 1, &Session->Program);
+    if (!NT_SUCCESS(Status)) {
+        Session->Program = NULL;
+        goto Exit;
+    }
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        XskNpiTestSessionUnbind(Session);
+    }
+
+    TraceExitStatus(TRACE_CONTROL);
+
+    return Status;
+}
+
+//
+// Waits for at least one element on a ring the XDP driver produces, or returns
+// STATUS_IO_TIMEOUT.
+//
+static
+NTSTATUS
+XskNpiTestWaitForRing(
+    _In_ XSK_RING *Ring,
+    _In_ KEVENT *Event,
+    _In_ UINT32 TimeoutMilliseconds,
+    _Out_ UINT32 *ConsumerIndex
+    )
+{
+    LARGE_INTEGER Timeout;
+
+    Timeout.QuadPart = -(LONGLONG)TimeoutMilliseconds * 10000;
+
+    while (XskRingConsumerReserve(Ring, 1, ConsumerIndex) == 0) {
+        NTSTATUS Status =
+            KeWaitForSingleObject(Event, Executive, KernelMode, FALSE, &Timeout);
+
+        if (Status == STATUS_TIMEOUT && XskRingConsumerReserve(Ring, 1, ConsumerIndex) == 0) {
+            return STATUS_IO_TIMEOUT;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XskNpiTestSessionReceive(
+    _Inout_ XSKNPITEST_SESSION *Session,
+    _In_ const XSKNPITEST_WAIT_IN *In,
+    _Out_writes_bytes_to_(OutputBufferLength, *BytesReturned) VOID *OutputBuffer,
+    _In_ UINT32 OutputBufferLength,
+    _Out_ ULONG_PTR *BytesReturned
+    )
+{
+    NTSTATUS Status;
+    const XSK_BUFFER_DESCRIPTOR *RxDesc;
+    XSK_BUFFER_ADDRESS Address;
+    UINT32 ConsumerIndex;
+    UINT32 ProducerIndex;
+    UINT64 *Fill;
+
+    *BytesReturned = 0;
+
+    if (Session->Socket == NULL) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    Status =
+        XskNpiTestWaitForRing(
+            &Session->RxRing, &Session->RxEvent, In->TimeoutMilliseconds, &ConsumerIndex);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    RxDesc = XskRingGetElement(&Session->RxRing, ConsumerIndex);
+    Address = RxDesc->Address;
+
+    if (RxDesc->Length > OutputBufferLength) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+    } else {
+        RtlCopyMemory(
+            OutputBuffer, Session->Umem + Address.BaseAddress + Address.Offset, RxDesc->Length);
+        *BytesReturned = RxDesc->Length;
+        Status = STATUS_SUCCESS;
+    }
+
+    XskRingConsumerRelease(&Session->RxRing, 1);
+
+    //
+    // Return the chunk to the fill ring, which has room for every RX chunk.
+    //
+    if (XskRingProducerReserve(&Session->FillRing, 1, &ProducerIndex) == 1) {
+        Fill = XskRingGetElement(&Session->FillRing, ProducerIndex);
+        *Fill = Address.BaseAddress;
+        XskRingProducerSubmit(&Session->FillRing, 1);
+    }
+
+Exit:
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskNpiTestSessionSend(
+    _Inout_ XSKNPITEST_SESSION *Session,
+    _In_reads_bytes_(InputBufferLength) const VOID *InputBuffer,
+    _In_ UINT32 InputBufferLength
+    )
+{
+    NTSTATUS Status;
+    XSK_BUFFER_DESCRIPTOR *TxDesc;
+    XSK_NOTIFY_RESULT_FLAGS Result;
+    UINT32 ProducerIndex;
+
+    if (Session->Socket == NULL) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    if (InputBufferLength == 0 || InputBufferLength > XSKNPITEST_CHUNK_SIZE) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    if (XskRingProducerReserve(&Session->TxRing, 1, &ProducerIndex) != 1) {
+        Status = STATUS_DEVICE_BUSY;
+        goto Exit;
+    }
+
+    RtlCopyMemory(
+        Session->Umem + XSKNPITEST_TX_CHUNK * XSKNPITEST_CHUNK_SIZE, InputBuffer,
+        InputBufferLength);
+
+    TxDesc = XskRingGetElement(&Session->TxRing, ProducerIndex);
+    TxDesc->Address.AddressAndOffset = 0;
+    TxDesc->Address.BaseAddress = XSKNPITEST_TX_CHUNK * XSKNPITEST_CHUNK_SIZE;
+    TxDesc->Length = InputBufferLength;
+    XskRingProducerSubmit(&Session->TxRing, 1);
+
+    Status = Session->Dispatch->Notify(Session->Socket, XSK_NOTIFY_FLAG_POKE_TX, 0, &Result);
+
+Exit:
+
+    return Status;
+}
+
+static
+NTSTATUS
+XskNpiTestSessionCompleteSend(
+    _Inout_ XSKNPITEST_SESSION *Session,
+    _In_ const XSKNPITEST_WAIT_IN *In
+    )
+{
+    NTSTATUS Status;
+    UINT64 *Completion;
+    UINT32 ConsumerIndex;
+
+    if (Session->Socket == NULL) {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        goto Exit;
+    }
+
+    Status =
+        XskNpiTestWaitForRing(
+            &Session->CompletionRing, &Session->CompletionEvent, In->TimeoutMilliseconds,
+            &ConsumerIndex);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Completion = XskRingGetElement(&Session->CompletionRing, ConsumerIndex);
+    if (*Completion != XSKNPITEST_TX_CHUNK * XSKNPITEST_CHUNK_SIZE) {
+        TraceError(TRACE_CONTROL, "Unexpected TX completion Address=%llu", *Completion);
+        Status = STATUS_UNSUCCESSFUL;
+    }
+
+    XskRingConsumerRelease(&Session->CompletionRing, 1);
+
+Exit:
+
+    return Status;
+}
+
+static
+__declspec(code_seg("PAGE"))
+_Dispatch_type_(IRP_MJ_CREATE)
+NTSTATUS
+IrpIoCreate(
+    _In_ DEVICE_OBJECT *DeviceObject,
+    _Inout_ IRP *Irp
+    )
+{
+    NTSTATUS Status;
+    IO_STACK_LOCATION *IrpSp = IoGetCurrentIrpStackLocation(Irp);
+    XSKNPITEST_SESSION *Session;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    PAGED_CODE();
+
+    Session = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Session), POOLTAG_SESSION);
+    if (Session == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    ExInitializePushLock(&Session->Lock);
+    KeInitializeEvent(&Session->RxEvent, SynchronizationEvent, FALSE);
+    KeInitializeEvent(&Session->CompletionEvent, SynchronizationEvent, FALSE);
+
+    IrpSp->FileObject->FsContext = Session;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    Irp->IoStatus.Status = Status;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return Status;
+}
+
+static
+__declspec(code_seg("PAGE"))
+_Dispatch_type_(IRP_MJ_CLOSE)
+NTSTATUS
+IrpIoClose(
+    _In_ DEVICE_OBJECT *DeviceObject,
+    _Inout_ IRP *Irp
+    )
+{
+    IO_STACK_LOCATION *IrpSp = IoGetCurrentIrpStackLocation(Irp);
+    XSKNPITEST_SESSION *Session = IrpSp->FileObject->FsContext;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    PAGED_CODE();
+
+    if (Session != NULL) {
+        XskNpiTestSessionUnbind(Session);
+        ExFreePoolWithTag(Session, POOLTAG_SESSION);
+        IrpSp->FileObject->FsContext = NULL;
+    }
+
+    Irp->IoStatus.Status = STATUS_SUCCESS;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return STATUS_SUCCESS;
+}
+
+static
+_Function_class_(DRIVER_DISPATCH)
+_IRQL_requires_(PASSIVE_LEVEL)
+_IRQL_requires_same_
+__declspec(code_seg("PAGE"))
+NTSTATUS
+IrpIoDeviceControl(
+    _In_ DEVICE_OBJECT *DeviceObject,
+    _Inout_ IRP *Irp
+    )
+{
+    NTSTATUS Status;
+    IO_STACK_LOCATION *IrpSp = IoGetCurrentIrpStackLocation(Irp);
+    XSKNPITEST_SESSION *Session = IrpSp->FileObject->FsContext;
+    VOID *Buffer = Irp->AssociatedIrp.SystemBuffer;
+    UINT32 InputBufferLength = IrpSp->Parameters.DeviceIoControl.InputBufferLength;
+    UINT32 OutputBufferLength = IrpSp->Parameters.DeviceIoControl.OutputBufferLength;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    PAGED_CODE();
+
+    //
+    // Requests on a handle are serialized; each handle drives one socket.
+    //
+    KeEnterCriticalRegion();
+    ExAcquirePushLockExclusive(&Session->Lock);
+
+    switch (IrpSp->Parameters.DeviceIoControl.IoControlCode) {
+
+    case IOCTL_XSKNPITEST_BIND:
+        if (InputBufferLength < sizeof(XSKNPITEST_BIND_IN)) {
+            Status = STATUS_BUFFER_TOO_SMALL;
+            break;
+        }
+
+        Status = XskNpiTestSessionBind(Session, Buffer);
+        break;
+
+    case IOCTL_XSKNPITEST_RECEIVE:
+    {
+        XSKNPITEST_WAIT_IN In;
+
+        if (InputBufferLength < sizeof(In)) {
+            Status = STATUS_BUFFER_TOO_SMALL;
+            break;
+        }
+
+        //
+        // The input and output share the system buffer.
+        //
+        In = *(const XSKNPITEST_WAIT_IN *)Buffer;
+        Status =
+            XskNpiTestSessionReceive(
+                Session, &In, Buffer, OutputBufferLength, &Irp->IoStatus.Information);
+        break;
+    }
+
+    case IOCTL_XSKNPITEST_SEND:
+        Status = XskNpiTestSessionSend(Session, Buffer, InputBufferLength);
+        break;
+
+    case IOCTL_XSKNPITEST_COMPLETE_SEND:
+        if (InputBufferLength < sizeof(XSKNPITEST_WAIT_IN)) {
+            Status = STATUS_BUFFER_TOO_SMALL;
+            break;
+        }
+
+        Status = XskNpiTestSessionCompleteSend(Session, Buffer);
+        break;
+
+    default:
+        Status = STATUS_INVALID_DEVICE_REQUEST;
+        break;
+    }
+
+    ExReleasePushLockExclusive(&Session->Lock);
+    KeLeaveCriticalRegion();
+
+    Irp->IoStatus.Status = Status;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return Status;
+}
+
+static
+VOID
+DriverUnload(
+    _In_ DRIVER_OBJECT *DriverObject
+    )
+{
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_CONTROL, "DriverObject=%p", DriverObject);
+
+    if (XskNpiTestNmrClientHandle != NULL) {
+        Status = NmrDeregisterClient(XskNpiTestNmrClientHandle);
+        FRE_ASSERT(Status == STATUS_PENDING);
+
+        Status = NmrWaitForClientDeregisterComplete(XskNpiTestNmrClientHandle);
+        FRE_ASSERT(Status == STATUS_SUCCESS);
+        XskNpiTestNmrClientHandle = NULL;
+    }
+
+    if (XskNpiTestDeviceObject != NULL) {
+        IoDeleteDevice(XskNpiTestDeviceObject);
+        XskNpiTestDeviceObject = NULL;
+    }
+
+    TraceExitSuccess(TRACE_CONTROL);
+
+    WPP_CLEANUP(DriverObject);
+}
+
+_Function_class_(DRIVER_INITIALIZE)
+_IRQL_requires_same_
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+DriverEntry(
+    _In_ struct _DRIVER_OBJECT *DriverObject,
+    _In_ PUNICODE_STRING RegistryPath
+    )
+{
+    NTSTATUS Status;
+    UNICODE_STRING DeviceName;
+
+#pragma prefast(suppress : __WARNING_BANNED_MEM_ALLOCATION_UNSAFE, "Non executable pool is enabled via -DPOOL_NX_OPTIN_AUTO=1.")
+    ExInitializeDriverRuntime(0);
+    WPP_INIT_TRACING(DriverObject, RegistryPath);
+    RtlInitUnicodeString(&DeviceName, XSKNPITEST_DEVICE_NAME);
+    ExInitializePushLock(&XskNpiTestBindingLock);
+
+    TraceEnter(TRACE_CONTROL, "DriverObject=%p", DriverObject);
+
+    Status =
+        IoCreateDevice(
+            DriverObject,
+            0,
+            &DeviceName,
+            FILE_DEVICE_NETWORK,
+            FILE_DEVICE_SECURE_OPEN,
+            FALSE,
+            &XskNpiTestDeviceObject);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    DriverObject->MajorFunction[IRP_MJ_CREATE] = IrpIoCreate;
+    DriverObject->MajorFunction[IRP_MJ_CLOSE] = IrpIoClose;
+#pragma warning(push)
+#pragma warning(disable:28168) // The function 'IrpIoDeviceControl' does not have a _Dispatch_type_ annotation matching dispatch table position 'IRP_MJ_DEVICE_CONTROL' (0x0e).
+    DriverObject->MajorFunction[IRP_MJ_DEVICE_CONTROL] = IrpIoDeviceControl;
+#pragma warning(pop)
+    DriverObject->DriverUnload = DriverUnload;
+
+    //
+    // The XDP driver may load before or after this driver; NMR attaches the
+    // client whenever both are registered.
+    //
+    Status =
+        NmrRegisterClient(
+            (NPI_CLIENT_CHARACTERISTICS *)&XskNpiTestClientCharacteristics, NULL,
+            &XskNpiTestNmrClientHandle);
+    if (!NT_SUCCESS(Status)) {
+        XskNpiTestNmrClientHandle = NULL;
+        goto Exit;
+    }
+
+Exit:
+
+    TraceExitStatus(TRACE_CONTROL);
+
+    if (!NT_SUCCESS(Status)) {
+        DriverUnload(DriverObject);
+    }
+
+    return Status;
+}
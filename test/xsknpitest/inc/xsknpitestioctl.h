@@ -0,0 +1,49 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+//
+// The xsknpitest driver is a kernel mode client of the XSK NPI. Each handle to
+// its device drives one kernel mode socket on behalf of the functional tests.
+//
+
+#define XSKNPITEST_DEVICE_NAME L"\\Device\\xsknpitest"
+#define XSKNPITEST_USER_DEVICE_NAME L"\\\\?\\GLOBALROOT\\Device\\xsknpitest"
+
+//
+// Creates a kernel mode socket, binds it to the RX and TX paths of a queue, and
+// redirects all of the queue's RX frames to the socket.
+//
+#define IOCTL_XSKNPITEST_BIND \
+    CTL_CODE(FILE_DEVICE_NETWORK, 0x0, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// Waits for a frame on the socket's RX ring and returns its data.
+//
+#define IOCTL_XSKNPITEST_RECEIVE \
+    CTL_CODE(FILE_DEVICE_NETWORK, 0x1, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// Transmits the input buffer as a frame on the socket's TX ring.
+//
+#define IOCTL_XSKNPITEST_SEND \
+    CTL_CODE(FILE_DEVICE_NETWORK, 0x2, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// Waits for the completion of the last frame sent.
+//
+#define IOCTL_XSKNPITEST_COMPLETE_SEND \
+    CTL_CODE(FILE_DEVICE_NETWORK, 0x3, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+typedef struct _XSKNPITEST_BIND_IN {
+    UINT32 IfIndex;
+    UINT32 QueueId;
+    XSK_BIND_FLAGS Flags;
+} XSKNPITEST_BIND_IN;
+
+typedef struct _XSKNPITEST_WAIT_IN {
+    UINT32 TimeoutMilliseconds;
+} XSKNPITEST_WAIT_IN;
@@ -0,0 +1,22 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+#include <ntdef.h>
+#include <ntstatus.h>
+#include <ntifs.h>
+#include <ntintsafe.h>
+#include <netioddk.h>
+#include <afxdp_helper.h>
+#include <xdpapi.h>
+#include <xdp/xsknpi.h>
+#include <xdpassert.h>
+#include <xsknpitestioctl.h>
+
+#include "trace.h"
+
+#define POOLTAG_SESSION     'SnpX'  // XpnS
+#define POOLTAG_UMEM        'UnpX'  // XpnU
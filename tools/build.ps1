@@ -30,7 +30,10 @@ param (
     [switch]$TestArchive = $false,
 
     [Parameter(Mandatory = $false)]
-    [switch]$UpdateDeps = $false
+    [switch]$UpdateDeps = $false,
+
+    [Parameter(Mandatory = $false)]
+    [switch]$PerfStages = $false
 )
 
 Set-StrictMode -Version 'Latest'
@@ -77,6 +80,7 @@ nuget.exe restore $RootDir\src\xdpinstaller\xdpinstaller.sln `
 msbuild.exe $RootDir\xdp.sln `
     /p:Configuration=$Config `
     /p:Platform=$Platform `
+    /p:XdpPerfStages=$($PerfStages.IsPresent.ToString().ToLower()) `
     /t:$($Tasks -join ",") `
     /maxCpuCount
 if (!$?) {
@@ -33,6 +33,7 @@ copy docs\usage.md $DstPath
 
 New-Item -Path $DstPath\bin -ItemType Directory > $null
 copy "$ArtifactBin\pktcmd.exe" $DstPath\bin
+copy "$ArtifactBin\pcapcmd.exe" $DstPath\bin
 copy "$ArtifactBin\rxfilter.exe" $DstPath\bin
 copy "$ArtifactBin\xdpcfg.exe" $DstPath\bin
 copy "$ArtifactBin\xskbench.exe" $DstPath\bin
@@ -43,6 +44,7 @@ New-Item -Path $DstPath\symbols -ItemType Directory > $null
 copy "$ArtifactBin\xdp.pdb"   $DstPath\symbols
 copy "$ArtifactBin\xdpapi.pdb" $DstPath\symbols
 copy "$ArtifactBin\pktcmd.pdb" $DstPath\symbols
+copy "$ArtifactBin\pcapcmd.pdb" $DstPath\symbols
 copy "$ArtifactBin\rxfilter.pdb" $DstPath\symbols
 copy "$ArtifactBin\xdpcfg.pdb" $DstPath\symbols
 copy "$ArtifactBin\xskbench.pdb" $DstPath\symbols
@@ -0,0 +1,103 @@
+#
+# Runs the XDP control plane benchmark (ctlbench.exe) against an adapter,
+# installing XDP and, for the XDPMP adapter, xdpmp for the duration of the run.
+#
+
+param (
+    [Parameter(Mandatory = $false)]
+    [ValidateSet("Debug", "Release")]
+    [string]$Config = "Release",
+
+    [Parameter(Mandatory = $false)]
+    [ValidateSet("x64", "arm64")]
+    [string]$Arch = "x64",
+
+    [Parameter(Mandatory=$false)]
+    [string]$AdapterName = "XDPMP",
+
+    [Parameter(Mandatory=$false)]
+    [ValidateSet("System", "Generic", "Native")]
+    [string]$XdpMode = "Generic",
+
+    [Parameter(Mandatory=$false)]
+    [int]$Iterations = 0,
+
+    [Parameter(Mandatory=$false)]
+    [string]$RuleCounts = "",
+
+    [Parameter(Mandatory=$false)]
+    [string]$QeoCounts = "",
+
+    [Parameter(Mandatory=$false)]
+    [string]$RawResultsFile = "",
+
+    [Parameter(Mandatory=$false)]
+    [switch]$Fndis = $false
+)
+
+Set-StrictMode -Version 'Latest'
+$ErrorActionPreference = 'Stop'
+
+$RootDir = Split-Path $PSScriptRoot -Parent
+. $RootDir\tools\common.ps1
+$ArtifactsDir = Get-ArtifactBinPath -Config $Config -Arch $Arch
+
+try {
+    if ($AdapterName -eq "XDPMP") {
+        $XdpmpPollProvider = "NDIS"
+
+        if ($Fndis) {
+            $XdpmpPollProvider = "FNDIS"
+
+            Write-Verbose "installing fndis..."
+            & "$RootDir\tools\setup.ps1" -Install fndis -Config $Config -Arch $Arch
+            Write-Verbose "installed fndis."
+        }
+
+        Write-Verbose "installing xdpmp..."
+        & "$RootDir\tools\setup.ps1" -Install xdpmp -Config $Config -Arch $Arch -XdpmpPollProvider $XdpmpPollProvider
+        Write-Verbose "installed xdpmp."
+    }
+
+    Write-Verbose "installing xdp..."
+    & "$RootDir\tools\setup.ps1" -Install xdp -Config $Config -Arch $Arch
+    Write-Verbose "installed xdp."
+
+    $Adapter = Get-NetAdapter $AdapterName
+    $ArgList = @("-i", $Adapter.ifIndex, "-xdp_mode", $XdpMode.ToLower())
+
+    if ($Iterations -gt 0) {
+        $ArgList += "-n", $Iterations
+    }
+    if (![string]::IsNullOrEmpty($RuleCounts)) {
+        $ArgList += "-rules", $RuleCounts
+    }
+    if (![string]::IsNullOrEmpty($QeoCounts)) {
+        $ArgList += "-qeo", $QeoCounts
+    }
+    if (![string]::IsNullOrEmpty($RawResultsFile)) {
+        $ArgList += "-output", "csv"
+    }
+
+    Write-Verbose "ctlbench.exe $ArgList"
+    $Output = & $ArtifactsDir\ctlbench.exe $ArgList
+
+    if (!$?) {
+        Write-Error "ctlbench.exe failed: $LastExitCode"
+    }
+
+    if (![string]::IsNullOrEmpty($RawResultsFile)) {
+        New-Item -ItemType Directory -Force -Path (Split-Path $RawResultsFile -Parent) | Out-Null
+        $Output | Out-File -FilePath $RawResultsFile -Encoding ascii
+    }
+
+    $Output
+} finally {
+    & "$RootDir\tools\setup.ps1" -Uninstall xdp -Config $Config -Arch $Arch -ErrorAction 'Continue'
+    if ($AdapterName -eq "XDPMP") {
+        & "$RootDir\tools\setup.ps1" -Uninstall xdpmp -Config $Config -Arch $Arch -ErrorAction 'Continue'
+        if ($Fndis) {
+            & "$RootDir\tools\setup.ps1" -Uninstall fndis -Config $Config -Arch $Arch -ErrorAction 'Continue'
+        }
+    }
+}
@@ -110,6 +110,14 @@ for ($i = 1; $i -le $Iterations; $i++) {
         & "$RootDir\tools\setup.ps1" -Install fnsock -Config $Config -Arch $Arch
         Write-Verbose "installed fnsock."
 
+        Write-Verbose "installing xsknpitest..."
+        & "$RootDir\tools\setup.ps1" -Install xsknpitest -Config $Config -Arch $Arch
+        Write-Verbose "installed xsknpitest."
+
+        Write-Verbose "installing xdpmp..."
+        & "$RootDir\tools\setup.ps1" -Install xdpmp -Config $Config -Arch $Arch
+        Write-Verbose "installed xdpmp."
+
         if (!$EbpfPreinstalled) {
             Write-Verbose "installing ebpf..."
             & "$RootDir\tools\setup.ps1" -Install ebpf -Config $Config -Arch $Arch -UseJitEbpf:$UseJitEbpf
@@ -159,6 +167,8 @@ for ($i = 1; $i -le $Iterations; $i++) {
         if (!$EbpfPreinstalled) {
             & "$RootDir\tools\setup.ps1" -Uninstall ebpf -Config $Config -Arch $Arch -ErrorAction 'Continue'
         }
+        & "$RootDir\tools\setup.ps1" -Uninstall xdpmp -Config $Config -Arch $Arch -ErrorAction 'Continue'
+        & "$RootDir\tools\setup.ps1" -Uninstall xsknpitest -Config $Config -Arch $Arch -ErrorAction 'Continue'
         & "$RootDir\tools\setup.ps1" -Uninstall fnsock -Config $Config -Arch $Arch -ErrorAction 'Continue'
         & "$RootDir\tools\setup.ps1" -Uninstall fnlwf -Config $Config -Arch $Arch -ErrorAction 'Continue'
         & "$RootDir\tools\setup.ps1" -Uninstall fnmp -Config $Config -Arch $Arch -ErrorAction 'Continue'
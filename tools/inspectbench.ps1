@@ -0,0 +1,52 @@
+#
+# Runs the XDP rule engine micro-benchmark, which measures XdpInspect ns/frame
+# in user mode across match types, rule counts, and frame layouts.
+#
+
+param (
+    [Parameter(Mandatory = $false)]
+    [ValidateSet("Debug", "Release")]
+    [string]$Config = "Release",
+
+    [Parameter(Mandatory = $false)]
+    [ValidateSet("x64", "arm64")]
+    [string]$Arch = "x64",
+
+    [Parameter(Mandatory = $false)]
+    [int]$Iterations = 0,
+
+    [Parameter(Mandatory = $false)]
+    [string]$RawResultsFile = ""
+)
+
+Set-StrictMode -Version 'Latest'
+$ErrorActionPreference = 'Stop'
+
+# Important paths.
+$RootDir = Split-Path $PSScriptRoot -Parent
+. $RootDir\tools\common.ps1
+$ArtifactsDir = Get-ArtifactBinPath -Config $Config -Arch $Arch
+
+$Options = @()
+
+if ($Iterations -gt 0) {
+    $Options += "-i", $Iterations
+}
+
+if (![string]::IsNullOrEmpty($RawResultsFile)) {
+    $Options += "-csv"
+}
+
+Write-Verbose "$ArtifactsDir\inspectbench.exe $Options"
+$Output = & $ArtifactsDir\inspectbench.exe $Options
+
+if (!$?) {
+    Write-Error "inspectbench.exe failed: $LastExitCode"
+}
+
+if (![string]::IsNullOrEmpty($RawResultsFile)) {
+    New-Item -ItemType Directory -Force -Path (Split-Path $RawResultsFile -Parent) | Out-Null
+    $Output | Out-File -FilePath $RawResultsFile -Encoding ascii
+}
+
+$Output
@@ -0,0 +1,128 @@
+#
+# Statistics helpers for the XDP perf scripts.
+#
+
+# Two-sided, p = 0.05, indexed by (degrees of freedom - 1)
+$TCriticalValues =
+@(
+    12.71, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+    2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101,
+    2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052
+)
+
+#
+# Perf metrics, and whether a higher value is an improvement. Metrics not
+# listed here are treated as lower-is-better costs.
+#
+$HigherIsBetterMetrics = @("kpps")
+
+function Get-TCriticalValue {
+    param($DegreesOfFreedom)
+
+    $df = [Math]::Max(1, [Math]::Floor($DegreesOfFreedom))
+    if ($df -gt $TCriticalValues.Count) {
+        # Degrees of freedom exceeds our table. Cap the degrees of freedom for a
+        # conservative approximation.
+        $df = $TCriticalValues.Count
+    }
+
+    return $TCriticalValues[$df - 1]
+}
+
+function Measure-Variance {
+    param($List)
+
+    if ($List.Count -lt 2) {
+        return -1
+    }
+
+    $var = 0
+    $avg = ($List | Measure-Object -Average).Average
+    foreach ($val in $List) {
+        $var += [Math]::pow(($val - $avg), 2)
+    }
+
+    return $var / ($List.Count - 1)
+}
+
+#
+# Returns the mean and the half-width of its 95% confidence interval.
+#
+function Measure-ConfidenceInterval {
+    param($List)
+
+    $avg = ($List | Measure-Object -Average).Average
+    $var = Measure-Variance $List
+
+    if ($var -lt 0) {
+        return @{ Mean = $avg; HalfWidth = -1 }
+    }
+
+    $halfWidth = (Get-TCriticalValue ($List.Count - 1)) * [Math]::sqrt($var / $List.Count)
+
+    return @{ Mean = $avg; HalfWidth = $halfWidth }
+}
+
+#
+# Compares two samples with Welch's t-test and returns the means, the percent
+# change from the first to the second, and whether the change is significant.
+#
+function Compare-Samples {
+    param($List1, $List2)
+
+    $x1 = ($List1 | Measure-Object -Average).Average
+    $x2 = ($List2 | Measure-Object -Average).Average
+    $s1 = Measure-Variance $List1
+    $s2 = Measure-Variance $List2
+    $n1 = $List1.Count
+    $n2 = $List2.Count
+    $pctDiff = 0
+    $significant = $false
+
+    if ($x1 -ne 0) {
+        $pctDiff = (($x2 - $x1) / $x1) * 100
+    }
+
+    if ($s1 -ge 0 -and $s2 -ge 0) {
+        $se = ($s1 / $n1) + ($s2 / $n2)
+
+        if ($se -eq 0) {
+            $significant = $x1 -ne $x2
+        } else {
+            # t-test statistic
+            $t = [Math]::abs(($x1 - $x2) / [Math]::sqrt($se))
+
+            # Degrees of freedom
+            $df = [Math]::pow($se, 2) / (([Math]::pow(($s1 / $n1), 2) / ($n1 - 1)) + ([Math]::pow(($s2 / $n2), 2) / ($n2 - 1)))
+
+            $p = Get-TCriticalValue $df
+            $significant = $t -ge $p
+            Write-Verbose "x1:$x1 x2:$x2 s1:$s1 s2:$s2 n1:$n1 n2:$n2 t:$t df:$df p:$p"
+        }
+    }
+
+    return @{
+        Mean1 = $x1
+        Mean2 = $x2
+        PercentDiff = $pctDiff
+        Significant = $significant
+    }
+}
+
+#
+# Returns whether a significant change in a metric is a regression of at least
+# ThresholdPercent.
+#
+function Test-Regression {
+    param($Metric, $Comparison, $ThresholdPercent)
+
+    if (-not $Comparison.Significant) {
+        return $false
+    }
+
+    if ($HigherIsBetterMetrics.Contains($Metric)) {
+        return $Comparison.PercentDiff -le -$ThresholdPercent
+    }
+
+    return $Comparison.PercentDiff -ge $ThresholdPercent
+}
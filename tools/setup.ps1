@@ -33,11 +33,11 @@ param (
     [string]$Arch = "x64",
 
     [Parameter(Mandatory = $false)]
-    [ValidateSet("", "fndis", "xdp", "xdpmp", "fnmp", "fnlwf", "fnsock", "ebpf")]
+    [ValidateSet("", "fndis", "xdp", "xdpmp", "fnmp", "fnlwf", "fnsock", "ebpf", "xsknpitest")]
     [string]$Install = "",
 
     [Parameter(Mandatory = $false)]
-    [ValidateSet("", "fndis", "xdp", "xdpmp", "fnmp", "fnlwf", "fnsock", "ebpf")]
+    [ValidateSet("", "fndis", "xdp", "xdpmp", "fnmp", "fnlwf", "fnsock", "ebpf", "xsknpitest")]
     [string]$Uninstall = "",
 
     [Parameter(Mandatory = $false)]
@@ -77,6 +77,7 @@ $XdpFileVersion = (Get-Item "$ArtifactsDir\xdp\xdp.sys").VersionInfo.FileVersion
 $XdpFileVersion = $XdpFileVersion.substring(0, $XdpFileVersion.LastIndexOf('.'))
 $XdpMsiFullPath = "$ArtifactsDir\xdpinstaller\xdp-for-windows.$XdpFileVersion.msi"
 $FndisSys = "$ArtifactsDir\fndis\fndis.sys"
+$XskNpiTestSys = "$ArtifactsDir\xsknpitest\xsknpitest.sys"
 $XdpMpSys = "$ArtifactsDir\xdpmp\xdpmp.sys"
 $XdpMpInf = "$ArtifactsDir\xdpmp\xdpmp.inf"
 $XdpMpComponentId = "ms_xdpmp"
@@ -341,6 +342,33 @@ function Uninstall-FakeNdis {
     Write-Verbose "fndis.sys uninstall complete!"
 }
 
+# Installs the xsknpitest driver.
+function Install-XskNpiTest {
+    if (!(Test-Path $XskNpiTestSys)) {
+        Write-Error "$XskNpiTestSys does not exist!"
+    }
+
+    Write-Verbose "sc.exe create xsknpitest type= kernel start= demand binpath= $XskNpiTestSys"
+    sc.exe create xsknpitest type= kernel start= demand binpath= $XskNpiTestSys | Write-Verbose
+    if ($LastExitCode) {
+        Write-Error "sc.exe exit code: $LastExitCode"
+    }
+
+    Start-Service-With-Retry xsknpitest
+
+    Write-Verbose "xsknpitest.sys install complete!"
+}
+
+# Uninstalls the xsknpitest driver.
+function Uninstall-XskNpiTest {
+    Write-Verbose "Stop-Service xsknpitest"
+    try { Stop-Service xsknpitest -NoWait } catch { }
+
+    Cleanup-Service xsknpitest
+
+    Write-Verbose "xsknpitest.sys uninstall complete!"
+}
+
 # Installs the xdpmp driver.
 function Install-XdpMp {
     if (!(Test-Path $XdpMpSys)) {
@@ -609,6 +637,9 @@ try {
     if ($Install -eq "fnsock") {
         Install-FnSock
     }
+    if ($Install -eq "xsknpitest") {
+        Install-XskNpiTest
+    }
 
     if ($Uninstall -eq "fndis") {
         Uninstall-FakeNdis
@@ -631,6 +662,9 @@ try {
     if ($Uninstall -eq "fnsock") {
         Uninstall-FnSock
     }
+    if ($Uninstall -eq "xsknpitest") {
+        Uninstall-XskNpiTest
+    }
 } catch {
     Write-Error $_ -ErrorAction $OriginalErrorActionPreference
 }
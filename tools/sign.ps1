@@ -75,6 +75,7 @@ $XdpSys = Join-Path $XdpDir "xdp.sys"
 $XdpInf = Join-Path $XdpDir "xdp.inf"
 $XdpCat = Join-Path $XdpDir "xdp.cat"
 $FndisSys = Join-Path $ArtifactsDir "fndis\fndis.sys"
+$XskNpiTestSys = Join-Path $ArtifactsDir "xsknpitest\xsknpitest.sys"
 $XdpMpDir = Join-Path $ArtifactsDir "xdpmp"
 $XdpMpSys = Join-Path $XdpMpDir "xdpmp.sys"
 $XdpMpInf = Join-Path $XdpMpDir "xdpmp.inf"
@@ -84,6 +85,7 @@ $XdpMpCat = Join-Path $XdpMpDir "xdpmp.cat"
 if (!(Test-Path $XdpSys)) { Write-Error "$XdpSys does not exist!" }
 if (!(Test-Path $XdpInf)) { Write-Error "$XdpInf does not exist!" }
 if (!(Test-Path $FndisSys)) { Write-Error "$FndisSys does not exist!" }
+if (!(Test-Path $XskNpiTestSys)) { Write-Error "$XskNpiTestSys does not exist!" }
 if (!(Test-Path $XdpMpSys)) { Write-Error "$XdpMpSys does not exist!" }
 if (!(Test-Path $XdpMpInf)) { Write-Error "$XdpMpInf does not exist!" }
 
@@ -92,6 +94,8 @@ if (!(Test-Path $XdpMpInf)) { Write-Error "$XdpMpInf does not exist!" }
 if ($LastExitCode) { Write-Error "signtool.exe exit code: $LastExitCode" }
 & $SignToolPath sign /f $CertPath -p "placeholder" /fd SHA256 $FndisSys
 if ($LastExitCode) { Write-Error "signtool.exe exit code: $LastExitCode" }
+& $SignToolPath sign /f $CertPath -p "placeholder" /fd SHA256 $XskNpiTestSys
+if ($LastExitCode) { Write-Error "signtool.exe exit code: $LastExitCode" }
 & $SignToolPath sign /f $CertPath -p "placeholder" /fd SHA256 $XdpMpSys
 if ($LastExitCode) { Write-Error "signtool.exe exit code: $LastExitCode" }
 
@@ -39,6 +39,12 @@ more coverage for setup and cleanup.
 .PARAMETER EnableEbpf
     Enable eBPF in the XDP driver and spinxsk test cases.
 
+.PARAMETER Soak
+    Measure datapath throughput, TX completion latency and stalls while churn runs.
+
+.PARAMETER StallThresholdMs
+    Minimum datapath stall reported in soak mode, in milliseconds.
+
 #>
 
 param (
@@ -82,7 +88,13 @@ param (
     [switch]$EnableEbpf = $false,
 
     [Parameter(Mandatory = $false)]
-    [switch]$EbpfPreinstalled = $false
+    [switch]$EbpfPreinstalled = $false,
+
+    [Parameter(Mandatory = $false)]
+    [switch]$Soak = $false,
+
+    [Parameter(Mandatory = $false)]
+    [Int32]$StallThresholdMs = 0
 )
 
 Set-StrictMode -Version 'Latest'
@@ -179,6 +191,12 @@ while (($Minutes -eq 0) -or (((Get-Date)-$StartTime).TotalMinutes -lt $Minutes))
         if ($EnableEbpf) {
             $Args += "-EnableEbpf"
         }
+        if ($Soak) {
+            $Args += "-Soak"
+        }
+        if ($StallThresholdMs -gt 0) {
+            $Args += "-StallThresholdMs", $StallThresholdMs
+        }
         Write-Verbose "$SpinXsk $Args"
         & $SpinXsk $Args
         if ($LastExitCode -ne 0) {
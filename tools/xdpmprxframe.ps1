@@ -0,0 +1,48 @@
+#
+# Wrapper script for XDPMP dynamic RX frame length configuration.
+#
+
+param (
+    [Parameter(Mandatory=$false)]
+    [string]$AdapterName = "XDPMP",
+
+    [Parameter(Mandatory=$false)]
+    [UInt32]$FrameLength = 0,
+
+    [Parameter(Mandatory=$false)]
+    [UInt32]$FragmentLength = 0
+)
+
+$Adapter = Get-NetAdapter -Name $AdapterName
+$IfDesc = $Adapter.InterfaceDescription
+
+#
+# If the adapter was freshly restarted, this configuration can race with various
+# WMI registrations. Retry a few times as a workaround.
+#
+$Retries = 10
+do {
+    try {
+        $Config = Get-CimInstance -Namespace root\wmi -Class XdpMpRxFrame -Filter "InstanceName = '$IfDesc'"
+        if ($Config -eq $null) {
+            throw "WMI object not found."
+        }
+
+        $Config.FrameLength = $FrameLength
+        $Config.FragmentLength = $FragmentLength
+
+        Set-CimInstance $Config | Out-Null
+
+        break
+    } catch {
+        Write-Warning "$($PSItem.Exception.Message)`n$($PSItem.ScriptStackTrace)"
+
+        if ($Retries-- -eq 0) {
+            Write-Error "Failed to configure RX frame generation."
+            break
+        }
+
+        Write-Warning "Retrying RX frame generation configuration."
+        Sleep -Milliseconds 500
+    }
+} while ($true)
@@ -65,7 +65,26 @@ param (
     [string]$XperfDirectory = "",
 
     [Parameter(Mandatory=$false)]
-    [string]$CommitHash = ""
+    [string]$CommitHash = "",
+
+    #
+    # Directory of per-scenario baselines. Scenarios with a baseline are
+    # compared against it, and significant regressions are flagged.
+    #
+    [Parameter(Mandatory=$false)]
+    [string]$BaselineDirectory = "",
+
+    # Replace the baselines with this run's results.
+    [Parameter(Mandatory=$false)]
+    [switch]$UpdateBaseline = $false,
+
+    # The minimum significant change, in percent, flagged as a regression.
+    [Parameter(Mandatory=$false)]
+    [double]$RegressionThresholdPercent = 5,
+
+    # Fail the suite if any regression is flagged.
+    [Parameter(Mandatory=$false)]
+    [switch]$FailOnRegression = $false
 )
 
 Set-StrictMode -Version 'Latest'
@@ -101,6 +120,62 @@ function ExtractKppsStat {
     return $min
 }
 
+function ExtractMaxStat {
+    param(
+        $FileName,
+        $Token
+        )
+
+    #
+    # Returns the highest value following Token on any line, e.g. the costliest
+    # thread's cycles per packet, or null if no line contains Token.
+    #
+    $max = $null
+
+    foreach ($s in Get-Content $FileName) {
+        $index = $s.IndexOf($Token)
+
+        if ($index -lt 0) {
+            continue
+        }
+
+        $s = $s.SubString($index + $Token.Length)
+        $end = $s.IndexOfAny(@(" ", ","))
+        if ($end -ge 0) {
+            $s = $s.SubString(0, $end)
+        }
+        $s = [double]$s
+
+        if ($max -eq $null -or $s -gt $max) {
+            $max = $s
+        }
+    }
+
+    return $max
+}
+
+#
+# Per-iteration metrics scraped from xskbench text output, in addition to kpps.
+#
+$ExtraMetrics = [ordered]@{
+    "cyclesPerPacket" = "cycles/pkt="
+    "latP50Us" = " P50="
+    "latP99Us" = " P99="
+}
+
+function ReadBaseline {
+    param($File)
+
+    $baseline = @{}
+
+    foreach ($line in Get-Content $File) {
+        $array = $line.Split(",")
+        $baseline[$array[0]] = [double[]]$array[1..($array.Count - 1)]
+    }
+
+    return $baseline
+}
+
 function MeasureStandardDeviation {
     param(
         $list
@@ -137,6 +212,12 @@ if ($DeepInspection) {
 }
 
 $RootDir = Split-Path $PSScriptRoot -Parent
+. $RootDir\tools\perfstats.ps1
+$RegressionCount = 0
+
+if (-not [string]::IsNullOrEmpty($BaselineDirectory)) {
+    New-Item -ItemType Directory -Force -Path $BaselineDirectory | Out-Null
+}
 
 try {
     if ($AdapterNames.Contains("XDPMP")) {
@@ -159,14 +240,22 @@ try {
     & "$RootDir\tools\setup.ps1" -Install xdp -Config $Config -Arch $Arch
     Write-Verbose "installed xdp."
 
-    $Format = "{0,-73} {1,-14} {2,-14}"
-    Write-Host $($Format -f "Test Case", "Avg (Kpps)", "Std Dev (Kpps)")
+    $Format = "{0,-73} {1,-14} {2,-14} {3,-14} {4,-14}"
+    $BaselineFormat = "    {0,-20} {1,-14} {2,-14} {3,-8} {4,-16}"
+    Write-Host $($Format -f "Test Case", "Avg (Kpps)", "Std Dev (Kpps)", "95% CI (Kpps)", "Cycles/Pkt")
+    if (-not [string]::IsNullOrEmpty($BaselineDirectory) -and -not $UpdateBaseline) {
+        Write-Host $($BaselineFormat -f "Metric", "Baseline Avg", "Avg", "%Diff", "Significance")
+    }
     foreach ($AdapterName in $AdapterNames) {
         foreach ($XdpMode in $XdpModes) {
             foreach ($Mode in $Modes) {
                 foreach ($WaitMode in $WaitModes) {
                     foreach ($IoBufferPair in $IoBufferPairs) {
                         $kppsList = @()
+                        $metricLists = [ordered]@{}
+                        foreach ($Metric in $ExtraMetrics.Keys) {
+                            $metricLists[$Metric] = @()
+                        }
 
                         $WaitMode = $WaitMode.ToUpper()
                         $Wait = $WaitMode -eq "WAIT"
@@ -212,11 +301,63 @@ try {
                                     -Arch $Arch -XperfFile $XperfFile
 
                                 $kppsList += ExtractKppsStat $TmpFile
+                                foreach ($Metric in $ExtraMetrics.Keys) {
+                                    $value = ExtractMaxStat $TmpFile $ExtraMetrics[$Metric]
+                                    if ($value -ne $null) {
+                                        $metricLists[$Metric] += $value
+                                    }
+                                }
+                            }
+
+                            #
+                            # Only keep metrics reported by every iteration.
+                            #
+                            $results = [ordered]@{ "kpps" = $kppsList }
+                            foreach ($Metric in $metricLists.Keys) {
+                                if ($metricLists[$Metric].Count -eq $Iterations) {
+                                    $results[$Metric] = $metricLists[$Metric]
+                                }
                             }
 
                             $avg = ($kppsList | Measure-Object -Average).Average
                             $stddev = MeasureStandardDeviation $kppsList
-                            Write-Host $($Format -f $ScenarioName, [Math]::ceiling($avg), [Math]::ceiling($stddev))
+                            $ci = Measure-ConfidenceInterval $kppsList
+                            $cyclesPerPacket = "-"
+                            if ($results.Contains("cyclesPerPacket")) {
+                                $cyclesPerPacket = [Math]::round(($results["cyclesPerPacket"] | Measure-Object -Average).Average, 1)
+                            }
+                            Write-Host $($Format -f $ScenarioName, [Math]::ceiling($avg), [Math]::ceiling($stddev), `
+                                "+/-$([Math]::ceiling($ci.HalfWidth))", $cyclesPerPacket)
+
+                            if (-not [string]::IsNullOrEmpty($BaselineDirectory)) {
+                                $BaselineFile = "$BaselineDirectory\$ScenarioName.csv"
+
+                                if (-not $UpdateBaseline -and (Test-Path $BaselineFile)) {
+                                    $baseline = ReadBaseline $BaselineFile
+
+                                    foreach ($Metric in $results.Keys) {
+                                        if (-not $baseline.ContainsKey($Metric)) {
+                                            continue
+                                        }
+
+                                        $cmp = Compare-Samples $baseline[$Metric] $results[$Metric]
+                                        $verdict = "NOT Significant"
+                                        if (Test-Regression $Metric $cmp $RegressionThresholdPercent) {
+                                            $verdict = "REGRESSION"
+                                            $RegressionCount++
+                                        } elseif ($cmp.Significant) {
+                                            $verdict = "Significant"
+                                        }
+
+                                        Write-Host $($BaselineFormat -f $Metric, `
+                                            [Math]::round($cmp.Mean1, 1), [Math]::round($cmp.Mean2, 1), `
+                                            [Math]::round($cmp.PercentDiff, 1), $verdict)
+                                    }
+                                } elseif ($UpdateBaseline) {
+                                    Set-Content -Path $BaselineFile -Value `
+                                        ($results.Keys | ForEach-Object { "$_," + ($results[$_] -join ",") })
+                                }
+                            }
 
                             if (-not [string]::IsNullOrEmpty($RawResultsFile)) {
                                 Add-Content -Path $RawResultsFile -Value `
@@ -225,10 +366,23 @@ try {
                                         $CommitHash, `
                                         ([DateTimeOffset](Get-Date)).ToUnixTimeSeconds(), `
                                         ($kppsList -join ","))
+
+                                foreach ($Metric in $results.Keys) {
+                                    if ($Metric -eq "kpps") {
+                                        continue
+                                    }
+
+                                    Add-Content -Path $RawResultsFile -Value `
+                                        ("{0}:{1},{2},{3},{4}" -f `
+                                            $ScenarioName, $Metric, `
+                                            $CommitHash, `
+                                            ([DateTimeOffset](Get-Date)).ToUnixTimeSeconds(), `
+                                            ($results[$Metric] -join ","))
+                                }
                             }
                         } catch {
                             Write-Error "$($PSItem.Exception.Message)`n$($PSItem.ScriptStackTrace)"
-                            Write-Host $($Format -f $ScenarioName, -1, -1)
+                            Write-Host $($Format -f $ScenarioName, -1, -1, -1, -1)
                         }
                     }
                 }
@@ -244,3 +398,7 @@ try {
         }
     }
 }
+
+if ($FailOnRegression -and $RegressionCount -gt 0) {
+    Write-Error "$RegressionCount significant regression(s) of at least $RegressionThresholdPercent% vs. baseline"
+}